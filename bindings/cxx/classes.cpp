@@ -28,6 +28,7 @@
 
 #include <sstream>
 #include <cmath>
+#include <cstring>
 
 namespace sigrok
 {
@@ -379,6 +380,85 @@ shared_ptr<Packet> Context::create_analog_packet(
 	return shared_ptr<Packet>{new Packet{nullptr, packet}, default_delete<Packet>{}};
 }
 
+/* The structures of a packet created over existing data, and the data's owner. */
+struct ForeignPacket
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_spec spec;
+	shared_ptr<const void> owner;
+
+	~ForeignPacket()
+	{
+		g_slist_free(meaning.channels);
+	}
+};
+
+shared_ptr<Packet> Context::create_logic_packet(const void *data_pointer,
+	size_t data_length, unsigned int unit_size, shared_ptr<const void> owner)
+{
+	auto foreign = make_shared<ForeignPacket>();
+	foreign->logic.length = data_length;
+	foreign->logic.unitsize = unit_size;
+	foreign->logic.data = const_cast<void *>(data_pointer);
+	foreign->packet.type = SR_DF_LOGIC;
+	foreign->packet.payload = &foreign->logic;
+	foreign->owner = move(owner);
+
+	shared_ptr<Packet> packet {new Packet{nullptr, &foreign->packet},
+		default_delete<Packet>{}};
+	packet->_owner = move(foreign);
+	return packet;
+}
+
+shared_ptr<Packet> Context::create_analog_packet(
+	vector<shared_ptr<Channel> > channels,
+	const void *data_pointer, unsigned int num_samples,
+	unsigned int unitsize, bool is_float, bool is_signed,
+	const Quantity *mq, const Unit *unit,
+	vector<const QuantityFlag *> mqflags, shared_ptr<const void> owner)
+{
+	auto foreign = make_shared<ForeignPacket>();
+	auto meaning = &foreign->meaning;
+	auto encoding = &foreign->encoding;
+
+	for (const auto &channel : channels)
+		meaning->channels = g_slist_append(meaning->channels, channel->_structure);
+	meaning->mq = static_cast<sr_mq>(mq->id());
+	meaning->unit = static_cast<sr_unit>(unit->id());
+	meaning->mqflags = static_cast<sr_mqflag>(QuantityFlag::mask_from_flags(move(mqflags)));
+
+	encoding->unitsize = unitsize;
+	encoding->is_signed = is_float || is_signed;
+	encoding->is_float = is_float;
+#ifdef WORDS_BIGENDIAN
+	encoding->is_bigendian = TRUE;
+#else
+	encoding->is_bigendian = FALSE;
+#endif
+	encoding->scale.p = 1;
+	encoding->scale.q = 1;
+	encoding->offset.p = 0;
+	encoding->offset.q = 1;
+
+	foreign->analog.meaning = meaning;
+	foreign->analog.encoding = encoding;
+	foreign->analog.spec = &foreign->spec;
+	foreign->analog.num_samples = num_samples;
+	foreign->analog.data = const_cast<void *>(data_pointer);
+	foreign->packet.type = SR_DF_ANALOG;
+	foreign->packet.payload = &foreign->analog;
+	foreign->owner = move(owner);
+
+	shared_ptr<Packet> packet {new Packet{nullptr, &foreign->packet},
+		default_delete<Packet>{}};
+	packet->_owner = move(foreign);
+	return packet;
+}
+
 shared_ptr<Packet> Context::create_end_packet()
 {
 	auto packet = g_new(struct sr_datafeed_packet, 1);
@@ -902,12 +982,199 @@ DatafeedCallbackData::DatafeedCallbackData(Session *session,
 {
 }
 
+/* Packets kept for reuse, per datafeed callback. */
+static const size_t packet_pool_size = 4;
+
+shared_ptr<Packet> DatafeedCallbackData::pooled_packet(
+	shared_ptr<Device> device, const struct sr_datafeed_packet *pkt)
+{
+	/* A packet only referenced by the pool is not in use anymore. */
+	for (auto &packet : _packet_pool) {
+		if (packet.use_count() == 1) {
+			packet->reset(move(device), pkt);
+			return packet;
+		}
+	}
+
+	shared_ptr<Packet> packet {new Packet{move(device), pkt},
+		default_delete<Packet>{}};
+	if (_packet_pool.size() < packet_pool_size)
+		_packet_pool.push_back(packet);
+	return packet;
+}
+
 void DatafeedCallbackData::run(const struct sr_dev_inst *sdi,
 	const struct sr_datafeed_packet *pkt)
 {
 	auto device = _session->get_device(sdi);
-	shared_ptr<Packet> packet {new Packet{device, pkt}, default_delete<Packet>{}};
-	_callback(move(device), move(packet));
+	_callback(device, pooled_packet(device, pkt));
+
+	/* Idle packets must not keep their device, and thus the session, alive. */
+	for (auto &packet : _packet_pool)
+		if (packet.use_count() == 1)
+			packet->_device.reset();
+}
+
+PacketView::PacketView(const PacketType *type, unsigned int unit_size,
+		uint64_t num_samples, DataView data) :
+	_type(type),
+	_unit_size(unit_size),
+	_num_samples(num_samples),
+	_data(move(data))
+{
+}
+
+DatafeedBatchCallbackData::DatafeedBatchCallbackData(Session *session,
+		DatafeedBatchCallbackFunction callback,
+		size_t max_packets, uint64_t max_latency_us) :
+	_callback(move(callback)),
+	_session(session),
+	_max_packets(max_packets ? max_packets : 1),
+	_max_latency_us(max_latency_us),
+	_sdi(nullptr),
+	_first_time(0)
+{
+	_views.reserve(_max_packets);
+}
+
+void DatafeedBatchCallbackData::flush()
+{
+	if (_views.empty())
+		return;
+
+	_callback(_session->get_device(_sdi), _views);
+	_views.clear();
+}
+
+void DatafeedBatchCallbackData::run(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *pkt)
+{
+	if (sdi != _sdi)
+		flush();
+	_sdi = sdi;
+	if (_views.empty())
+		_first_time = g_get_monotonic_time();
+
+	switch (pkt->type) {
+	case SR_DF_LOGIC:
+	{
+		auto *const logic =
+			static_cast<const struct sr_datafeed_logic *>(pkt->payload);
+		_views.push_back(PacketView{PacketType::get(pkt->type),
+			logic->unitsize,
+			logic->unitsize ? logic->length / logic->unitsize : 0,
+			DataView::retain(pkt, logic->data, logic->length)});
+		break;
+	}
+	case SR_DF_ANALOG:
+	{
+		auto *const analog =
+			static_cast<const struct sr_datafeed_analog *>(pkt->payload);
+		const size_t num_channels = analog->meaning ?
+			g_slist_length(analog->meaning->channels) : 0;
+		const size_t size =
+			(size_t)analog->num_samples * num_channels * sizeof(float);
+		auto values = static_cast<float *>(g_malloc(size));
+		DataView data{values, size, shared_ptr<const void>{values, &g_free}};
+		if (size)
+			check(sr_analog_to_float(analog, values));
+		_views.push_back(PacketView{PacketType::get(pkt->type),
+			static_cast<unsigned int>(num_channels * sizeof(float)),
+			analog->num_samples, move(data)});
+		break;
+	}
+	default:
+		/* Everything else ends the batch, e.g. a trigger or the end. */
+		_views.push_back(PacketView{PacketType::get(pkt->type),
+			0, 0, DataView{}});
+		flush();
+		return;
+	}
+
+	if (_views.size() >= _max_packets ||
+			g_get_monotonic_time() - _first_time >= (int64_t)_max_latency_us)
+		flush();
+}
+
+BatchQueue::BatchQueue(BatchExecutor executor) :
+	_executor(move(executor)),
+	_closed(false)
+{
+}
+
+BatchQueue::~BatchQueue()
+{
+}
+
+void BatchQueue::wake(unique_lock<mutex> &lock)
+{
+	auto resume = move(_resume);
+	_resume = nullptr;
+	auto executor = _executor;
+	/* The coroutine may await the next batch right away. */
+	lock.unlock();
+	if (!resume)
+		return;
+	if (executor)
+		executor(move(resume));
+	else
+		resume();
+}
+
+void BatchQueue::push(PacketBatch batch)
+{
+	unique_lock<mutex> lock{_mutex};
+	_batches.push_back(move(batch));
+	wake(lock);
+}
+
+void BatchQueue::open()
+{
+	lock_guard<mutex> lock{_mutex};
+	_closed = false;
+}
+
+void BatchQueue::close()
+{
+	unique_lock<mutex> lock{_mutex};
+	_closed = true;
+	wake(lock);
+}
+
+void BatchQueue::set_executor(BatchExecutor executor)
+{
+	lock_guard<mutex> lock{_mutex};
+	_executor = move(executor);
+}
+
+bool BatchQueue::ready()
+{
+	lock_guard<mutex> lock{_mutex};
+	return !_batches.empty() || _closed;
+}
+
+bool BatchQueue::suspend(function<void()> resume)
+{
+	lock_guard<mutex> lock{_mutex};
+	if (!_batches.empty() || _closed)
+		return false;
+	_resume = move(resume);
+	return true;
+}
+
+PacketBatch BatchQueue::pop()
+{
+	lock_guard<mutex> lock{_mutex};
+	if (_batches.empty())
+		return PacketBatch{};
+	auto batch = move(_batches.front());
+	_batches.pop_front();
+	return batch;
+}
+
+BatchAwaitable::BatchAwaitable(shared_ptr<BatchQueue> queue) :
+	_queue(move(queue))
+{
 }
 
 SessionDevice::SessionDevice(struct sr_dev_inst *structure) :
@@ -993,7 +1260,15 @@ void Session::remove_devices()
 
 void Session::start()
 {
-	check(sr_session_start(_structure));
+	if (_batch_queue)
+		_batch_queue->open();
+	try {
+		check(sr_session_start(_structure));
+	} catch (...) {
+		if (_batch_queue)
+			_batch_queue->close();
+		throw;
+	}
 }
 
 void Session::run()
@@ -1014,23 +1289,31 @@ bool Session::is_running() const
 	return (ret != 0);
 }
 
-static void session_stopped_callback(void *data) noexcept
+void Session::stopped_callback(void *data) noexcept
 {
-	auto *const callback = static_cast<SessionStoppedCallback*>(data);
-	(*callback)();
+	auto *const session = static_cast<Session *>(data);
+	if (session->_batch_queue)
+		session->_batch_queue->close();
+	if (session->_stopped_callback)
+		session->_stopped_callback();
 }
 
-void Session::set_stopped_callback(SessionStoppedCallback callback)
+void Session::update_stopped_callback()
 {
-	_stopped_callback = move(callback);
-	if (_stopped_callback)
+	if (_stopped_callback || _batch_queue)
 		check(sr_session_stopped_callback_set(_structure,
-				&session_stopped_callback, &_stopped_callback));
+				&Session::stopped_callback, this));
 	else
 		check(sr_session_stopped_callback_set(_structure,
 				nullptr, nullptr));
 }
 
+void Session::set_stopped_callback(SessionStoppedCallback callback)
+{
+	_stopped_callback = move(callback);
+	update_stopped_callback();
+}
+
 static void datafeed_callback(const struct sr_dev_inst *sdi,
 	const struct sr_datafeed_packet *pkt, void *cb_data) noexcept
 {
@@ -1047,10 +1330,60 @@ void Session::add_datafeed_callback(DatafeedCallbackFunction callback)
 	_datafeed_callbacks.push_back(move(cb_data));
 }
 
+static void datafeed_batch_callback(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *pkt, void *cb_data) noexcept
+{
+	auto callback = static_cast<DatafeedBatchCallbackData *>(cb_data);
+	callback->run(sdi, pkt);
+}
+
+void Session::add_datafeed_batch_callback(
+	DatafeedBatchCallbackFunction callback,
+	size_t max_packets, uint64_t max_latency_us)
+{
+	unique_ptr<DatafeedBatchCallbackData> cb_data
+		{new DatafeedBatchCallbackData{this, move(callback),
+			max_packets, max_latency_us}};
+	check(sr_session_datafeed_callback_add(_structure,
+			&datafeed_batch_callback, cb_data.get()));
+	_batch_callbacks.push_back(move(cb_data));
+}
+
+BatchAwaitable Session::next_batch(size_t max_packets,
+	uint64_t max_latency_us)
+{
+	if (!_batch_queue) {
+		shared_ptr<BatchQueue> queue{new BatchQueue{_batch_executor}};
+		add_datafeed_batch_callback(
+			[queue](shared_ptr<Device> device,
+				const vector<PacketView> &views) {
+				queue->push(PacketBatch{move(device), views});
+			}, max_packets, max_latency_us);
+		_batch_queue = move(queue);
+		update_stopped_callback();
+	}
+	return BatchAwaitable{_batch_queue};
+}
+
+void Session::set_batch_executor(BatchExecutor executor)
+{
+	_batch_executor = move(executor);
+	if (_batch_queue)
+		_batch_queue->set_executor(_batch_executor);
+}
+
 void Session::remove_datafeed_callbacks()
 {
 	check(sr_session_datafeed_callback_remove_all(_structure));
 	_datafeed_callbacks.clear();
+	_batch_callbacks.clear();
+	if (_batch_queue) {
+		/* Have a coroutine still awaiting a batch get the empty one. */
+		auto queue = move(_batch_queue);
+		_batch_queue.reset();
+		update_stopped_callback();
+		queue->close();
+	}
 }
 
 shared_ptr<Trigger> Session::trigger()
@@ -1078,11 +1411,77 @@ shared_ptr<Context> Session::context()
 	return _context;
 }
 
+void Session::enable_stats(bool enable)
+{
+	check(sr_session_stats_enable(_structure, enable));
+}
+
+SessionStats Session::stats()
+{
+	struct sr_session_stats *structure;
+
+	check(sr_session_stats_get(_structure, &structure));
+	SessionStats result{structure};
+	sr_session_stats_free(structure);
+
+	return result;
+}
+
+Histogram::Histogram(const struct sr_stats_histogram *structure) :
+	count(structure->count),
+	total_us(structure->total_us),
+	max_us(structure->max_us),
+	buckets(structure->buckets,
+		structure->buckets + SR_STATS_HISTOGRAM_BUCKETS)
+{
+}
+
+SessionStats::SessionStats(const struct sr_session_stats *structure) :
+	source_dispatch(&structure->source_dispatch),
+	source_latency(&structure->source_latency)
+{
+	for (int i = 0; i < SR_DF_NUM_TYPES; i++) {
+		const PacketType *const type = PacketType::get(SR_DF_HEADER + i);
+		packets[type] = structure->packets[i];
+		bytes[type] = structure->bytes[i];
+	}
+	for (GSList *l = structure->transforms; l; l = l->next)
+		transforms.push_back(Histogram{
+			static_cast<const struct sr_stats_histogram *>(l->data)});
+	for (GSList *l = structure->callbacks; l; l = l->next)
+		callbacks.push_back(Histogram{
+			static_cast<const struct sr_stats_histogram *>(l->data)});
+}
+
 Packet::Packet(shared_ptr<Device> device,
 	const struct sr_datafeed_packet *structure) :
-	_structure(structure),
-	_device(move(device))
+	_structure(nullptr)
 {
+	reset(move(device), structure);
+}
+
+void Packet::reset(shared_ptr<Device> device,
+	const struct sr_datafeed_packet *structure)
+{
+	_structure = structure;
+	_device = move(device);
+
+	/* Reuse a payload of the same type, instead of allocating anew. */
+	if (structure->type == SR_DF_LOGIC) {
+		if (auto logic = dynamic_cast<Logic *>(_payload.get())) {
+			logic->_structure = static_cast<
+				const struct sr_datafeed_logic *>(structure->payload);
+			return;
+		}
+	} else if (structure->type == SR_DF_ANALOG) {
+		if (auto analog = dynamic_cast<Analog *>(_payload.get())) {
+			analog->_structure = static_cast<
+				const struct sr_datafeed_analog *>(structure->payload);
+			return;
+		}
+	}
+
+	_payload.reset();
 	switch (structure->type)
 	{
 		case SR_DF_HEADER:
@@ -1100,6 +1499,16 @@ Packet::Packet(shared_ptr<Device> device,
 				static_cast<const struct sr_datafeed_logic *>(
 					structure->payload)});
 			break;
+		case SR_DF_LOGIC_RLE:
+			_payload.reset(new LogicRLE{
+				static_cast<const struct sr_datafeed_logic_rle *>(
+					structure->payload)});
+			break;
+		case SR_DF_LOGIC_PACKED:
+			_payload.reset(new LogicPacked{
+				static_cast<const struct sr_datafeed_logic_packed *>(
+					structure->payload)});
+			break;
 		case SR_DF_ANALOG:
 			_payload.reset(new Analog{
 				static_cast<const struct sr_datafeed_analog *>(
@@ -1112,6 +1521,33 @@ Packet::~Packet()
 {
 }
 
+DataView::DataView() :
+	_data(nullptr),
+	_size(0)
+{
+}
+
+DataView::DataView(const void *data, size_t size,
+	shared_ptr<const void> owner) :
+	_data(static_cast<const uint8_t *>(data)),
+	_size(size),
+	_owner(move(owner))
+{
+}
+
+DataView DataView::retain(const struct sr_datafeed_packet *packet,
+	const void *data, size_t size)
+{
+	struct sr_buffer *buf = packet ? sr_packet_buffer_ref(packet) : nullptr;
+	if (buf)
+		return DataView{data, size,
+			shared_ptr<const void>{buf, &sr_buffer_unref}};
+
+	auto copy = static_cast<uint8_t *>(g_malloc(size));
+	memcpy(copy, data, size);
+	return DataView{copy, size, shared_ptr<const void>{copy, &g_free}};
+}
+
 const PacketType *Packet::type() const
 {
 	return PacketType::get(_structure->type);
@@ -1217,6 +1653,99 @@ unsigned int Logic::unit_size() const
 	return _structure->unitsize;
 }
 
+DataView Logic::data()
+{
+	return DataView{_structure->data, _structure->length};
+}
+
+DataView Logic::retain_data()
+{
+	return DataView::retain(_parent ? _parent->_structure : nullptr,
+		_structure->data, _structure->length);
+}
+
+LogicRLE::LogicRLE(const struct sr_datafeed_logic_rle *structure) :
+	PacketPayload(),
+	_structure(structure)
+{
+}
+
+LogicRLE::~LogicRLE()
+{
+}
+
+shared_ptr<PacketPayload> LogicRLE::share_owned_by(shared_ptr<Packet> _parent)
+{
+	return static_pointer_cast<PacketPayload>(
+		ParentOwned::share_owned_by(_parent));
+}
+
+uint64_t LogicRLE::num_samples() const
+{
+	return _structure->num_samples;
+}
+
+unsigned int LogicRLE::unit_size() const
+{
+	return _structure->unitsize;
+}
+
+uint64_t LogicRLE::num_runs() const
+{
+	return _structure->num_runs;
+}
+
+const uint64_t *LogicRLE::offsets() const
+{
+	return _structure->offsets;
+}
+
+const void *LogicRLE::values() const
+{
+	return _structure->values;
+}
+
+void LogicRLE::to_dense(uint64_t start, uint64_t count, uint8_t *dest) const
+{
+	check(sr_logic_rle_to_dense(_structure, start, count, dest));
+}
+
+LogicPacked::LogicPacked(const struct sr_datafeed_logic_packed *structure) :
+	PacketPayload(),
+	_structure(structure)
+{
+}
+
+LogicPacked::~LogicPacked()
+{
+}
+
+shared_ptr<PacketPayload> LogicPacked::share_owned_by(shared_ptr<Packet> _parent)
+{
+	return static_pointer_cast<PacketPayload>(
+		ParentOwned::share_owned_by(_parent));
+}
+
+uint64_t LogicPacked::num_samples() const
+{
+	return _structure->num_samples;
+}
+
+unsigned int LogicPacked::bits_per_sample() const
+{
+	return _structure->bits_per_sample;
+}
+
+const void *LogicPacked::data_pointer() const
+{
+	return _structure->data;
+}
+
+void LogicPacked::to_dense(uint64_t start, uint64_t count, uint8_t *dest) const
+{
+	check(sr_logic_packed_to_dense(_structure, start, count, dest));
+}
+
 Analog::Analog(const struct sr_datafeed_analog *structure) :
 	PacketPayload(),
 	_structure(structure)
@@ -1238,6 +1767,25 @@ void *Analog::data_pointer()
 	return _structure->data;
 }
 
+static size_t analog_data_size(const struct sr_datafeed_analog *analog)
+{
+	if (!analog->encoding || !analog->meaning)
+		return 0;
+	return (size_t)analog->num_samples * analog->encoding->unitsize *
+		g_slist_length(analog->meaning->channels);
+}
+
+DataView Analog::data()
+{
+	return DataView{_structure->data, analog_data_size(_structure)};
+}
+
+DataView Analog::retain_data()
+{
+	return DataView::retain(_parent ? _parent->_structure : nullptr,
+		_structure->data, analog_data_size(_structure));
+}
+
 void Analog::get_data_as_float(float *dest)
 {
 	check(sr_analog_to_float(_structure, dest));
@@ -82,6 +82,8 @@ G_GNUC_END_IGNORE_DEPRECATIONS
 #include <stdexcept>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <mutex>
 #include <map>
 #include <set>
 
@@ -108,6 +110,11 @@ class SR_API TriggerStage;
 class SR_API TriggerMatch;
 class SR_API TriggerMatchType;
 class SR_API ChannelType;
+class SR_API DataView;
+class SR_API PacketView;
+class SR_API PacketBatch;
+class SR_API BatchQueue;
+class SR_API BatchAwaitable;
 class SR_API Packet;
 class SR_API PacketPayload;
 class SR_API PacketType;
@@ -286,6 +293,33 @@ public:
 		std::vector<std::shared_ptr<Channel> > channels,
 		const float *data_pointer, unsigned int num_samples, const Quantity *mq,
 		const Unit *unit, std::vector<const QuantityFlag *> mqflags);
+	/** Create a logic packet over existing data, without copying it.
+	 * @param data_pointer Sample data.
+	 * @param data_length Size of the data in bytes.
+	 * @param unit_size Size of one sample in bytes.
+	 * @param owner Kept as long as the packet exists, to keep the data alive. */
+	std::shared_ptr<Packet> create_logic_packet(const void *data_pointer,
+		size_t data_length, unsigned int unit_size,
+		std::shared_ptr<const void> owner);
+	/** Create an analog packet over existing data, without copying it.
+	 * @param channels Channels the data belongs to.
+	 * @param data_pointer num_samples values per channel, channel after
+	 *        channel, in host byte order.
+	 * @param num_samples Number of samples per channel.
+	 * @param unitsize Size of one value in bytes.
+	 * @param is_float Whether values are floating point.
+	 * @param is_signed Whether integer values are signed.
+	 * @param mq Measured quantity.
+	 * @param unit Unit of the values.
+	 * @param mqflags Flags of the measured quantity.
+	 * @param owner Kept as long as the packet exists, to keep the data alive. */
+	std::shared_ptr<Packet> create_analog_packet(
+		std::vector<std::shared_ptr<Channel> > channels,
+		const void *data_pointer, unsigned int num_samples,
+		unsigned int unitsize, bool is_float, bool is_signed,
+		const Quantity *mq, const Unit *unit,
+		std::vector<const QuantityFlag *> mqflags,
+		std::shared_ptr<const void> owner);
 	/** Create an end packet. */
 	std::shared_ptr<Packet> create_end_packet();
 	/** Load a saved session.
@@ -588,10 +622,26 @@ private:
 	DatafeedCallbackFunction _callback;
 	DatafeedCallbackData(Session *session,
 		DatafeedCallbackFunction callback);
+	std::shared_ptr<Packet> pooled_packet(std::shared_ptr<Device> device,
+		const struct sr_datafeed_packet *pkt);
 	Session *_session;
+	/* Packets handed out before, reused once the user let go of them. */
+	std::vector<std::shared_ptr<Packet> > _packet_pool;
 	friend class Session;
 };
 
+/** Type of batched datafeed callback */
+typedef std::function<void(std::shared_ptr<Device>,
+		const std::vector<PacketView> &)>
+	DatafeedBatchCallbackFunction;
+
+class SR_PRIV DatafeedBatchCallbackData;
+
+/** Type of executor which resumes coroutines awaiting batches. It gets
+ * called with a function which resumes the coroutine, and is to call it
+ * in whatever thread or event loop the coroutine should continue in. */
+typedef std::function<void(std::function<void()>)> BatchExecutor;
+
 /** A virtual device associated with a stored session */
 class SR_API SessionDevice :
 	public ParentOwned<SessionDevice, Session>,
@@ -606,6 +656,46 @@ private:
 	friend struct std::default_delete<SessionDevice>;
 };
 
+/** Distribution of durations, see struct sr_stats_histogram. */
+class SR_API Histogram
+{
+public:
+	/** Number of samples. */
+	uint64_t count;
+	/** Sum of all durations, in microseconds. */
+	uint64_t total_us;
+	/** Longest duration, in microseconds. */
+	uint64_t max_us;
+	/** Counts per power of two microseconds, bucket 0 below 1 us. */
+	std::vector<uint64_t> buckets;
+private:
+	explicit Histogram(const struct sr_stats_histogram *structure);
+
+	friend class Session;
+};
+
+/** Session performance counters, see sr_session_stats_get(). */
+class SR_API SessionStats
+{
+public:
+	/** Packets sent by the devices, per type. */
+	std::map<const PacketType *, uint64_t> packets;
+	/** Logic and analog payload bytes sent by the devices, per type. */
+	std::map<const PacketType *, uint64_t> bytes;
+	/** Time spent in event source callbacks. */
+	Histogram source_dispatch;
+	/** Delay from event source being ready to it being dispatched. */
+	Histogram source_latency;
+	/** Time per transform module, in order. */
+	std::vector<Histogram> transforms;
+	/** Time per datafeed callback, in order of registration. */
+	std::vector<Histogram> callbacks;
+private:
+	explicit SessionStats(const struct sr_session_stats *structure);
+
+	friend class Session;
+};
+
 /** A sigrok session */
 class SR_API Session : public UserOwned<Session>
 {
@@ -620,6 +710,38 @@ public:
 	/** Add a datafeed callback to this session.
 	 * @param callback Callback of the form callback(Device, Packet). */
 	void add_datafeed_callback(DatafeedCallbackFunction callback);
+	/** Add a batched datafeed callback to this session.
+	 *
+	 * Logic and analog packets are collected into views, and handed
+	 * over together once max_packets are pending, or when the first
+	 * pending packet is older than max_latency_us when the next one
+	 * arrives. Any other packet ends the batch it is part of.
+	 * @param callback Callback of the form callback(Device, views).
+	 * @param max_packets Maximum number of packets per batch.
+	 * @param max_latency_us Maximum age of a batch, in microseconds. */
+	void add_datafeed_batch_callback(DatafeedBatchCallbackFunction callback,
+		size_t max_packets = 64, uint64_t max_latency_us = 10000);
+	/** Await the next batch of packets, in a C++20 coroutine.
+	 *
+	 * `co_await session->next_batch()` gives the next batch of the
+	 * session's datafeed, batched as with add_datafeed_batch_callback().
+	 * The first call sets up the queue of batches, with the bounds of
+	 * that call, so it is to be made before the session is started.
+	 * Batches which arrive while nobody awaits them queue up.
+	 *
+	 * Once the session has stopped and all its batches were taken, the
+	 * batch is empty. One coroutine at a time awaits the batches of a
+	 * session.
+	 * @param max_packets Maximum number of packets per batch.
+	 * @param max_latency_us Maximum age of a batch, in microseconds. */
+	BatchAwaitable next_batch(size_t max_packets = 64,
+		uint64_t max_latency_us = 10000);
+	/** Set the executor which resumes coroutines awaiting batches.
+	 *
+	 * Without one, they are resumed right in the datafeed callback, in
+	 * the thread which runs the session's event loop.
+	 * @param executor Executor to use, or nullptr for none. */
+	void set_batch_executor(BatchExecutor executor);
 	/** Remove all datafeed callbacks from this session. */
 	void remove_datafeed_callbacks();
 	/** Start the session. */
@@ -641,26 +763,191 @@ public:
 	void set_trigger(std::shared_ptr<Trigger> trigger);
 	/** Get filename this session was loaded from. */
 	std::string filename() const;
+	/** Enable or disable the performance counters.
+	 * @param enable Whether to count. */
+	void enable_stats(bool enable);
+	/** Get the performance counters of the current or last run. */
+	SessionStats stats();
 private:
 	explicit Session(std::shared_ptr<Context> context);
 	Session(std::shared_ptr<Context> context, std::string filename);
 	~Session();
 	std::shared_ptr<Device> get_device(const struct sr_dev_inst *sdi);
+	void update_stopped_callback();
+	static void stopped_callback(void *data) noexcept;
 	struct sr_session *_structure;
 	const std::shared_ptr<Context> _context;
 	std::map<const struct sr_dev_inst *, std::unique_ptr<SessionDevice> > _owned_devices;
 	std::map<const struct sr_dev_inst *, std::shared_ptr<Device> > _other_devices;
 	std::vector<std::unique_ptr<DatafeedCallbackData> > _datafeed_callbacks;
+	std::vector<std::unique_ptr<DatafeedBatchCallbackData> > _batch_callbacks;
 	SessionStoppedCallback _stopped_callback;
+	std::shared_ptr<BatchQueue> _batch_queue;
+	BatchExecutor _batch_executor;
 	std::string _filename;
 	std::shared_ptr<Trigger> _trigger;
 
 	friend class Context;
 	friend class DatafeedCallbackData;
+	friend class DatafeedBatchCallbackData;
 	friend class SessionDevice;
 	friend struct std::default_delete<Session>;
 };
 
+/**
+ * A contiguous, read-only view of packet data.
+ *
+ * A view either borrows the data, then it is only valid as long as the
+ * packet it came from, or it keeps the data alive on its own for as
+ * long as any copy of the view exists.
+ */
+class SR_API DataView
+{
+public:
+	/** Create an empty view. */
+	DataView();
+	/** Pointer to the first byte. */
+	const uint8_t *data() const { return _data; }
+	/** Size of the data in bytes. */
+	size_t size() const { return _size; }
+	/** Whether the view has no data. */
+	bool empty() const { return _size == 0; }
+	/** Pointer to the first byte, for range based loops. */
+	const uint8_t *begin() const { return _data; }
+	/** Pointer past the last byte, for range based loops. */
+	const uint8_t *end() const { return _data + _size; }
+	/** Byte at the given offset. */
+	uint8_t operator[](size_t offset) const { return _data[offset]; }
+	/** Whether the view keeps the data alive by itself. */
+	bool owns_data() const { return static_cast<bool>(_owner); }
+private:
+	DataView(const void *data, size_t size,
+		std::shared_ptr<const void> owner = nullptr);
+	static DataView retain(const struct sr_datafeed_packet *packet,
+		const void *data, size_t size);
+	const uint8_t *_data;
+	size_t _size;
+	std::shared_ptr<const void> _owner;
+
+	friend class Logic;
+	friend class Analog;
+	friend class DatafeedBatchCallbackData;
+};
+
+/**
+ * A lightweight view of a packet, as handed to batched datafeed callbacks.
+ *
+ * Logic views carry the packet's sample data, analog views the values of
+ * all the packet's channels converted to float. Other views only carry
+ * the packet type. Views keep their data alive by themselves.
+ */
+class SR_API PacketView
+{
+public:
+	/** Type of the packet. */
+	const PacketType *type() const { return _type; }
+	/** Size of one sample point in bytes. */
+	unsigned int unit_size() const { return _unit_size; }
+	/** Number of sample points in the packet. */
+	uint64_t num_samples() const { return _num_samples; }
+	/** Sample data of the packet. */
+	const DataView &data() const { return _data; }
+private:
+	PacketView(const PacketType *type, unsigned int unit_size,
+		uint64_t num_samples, DataView data);
+	const PacketType *_type;
+	unsigned int _unit_size;
+	uint64_t _num_samples;
+	DataView _data;
+
+	friend class DatafeedBatchCallbackData;
+};
+
+/* Data required for C callback function to call a batched C++ callback */
+class SR_PRIV DatafeedBatchCallbackData
+{
+public:
+	void run(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *pkt);
+private:
+	DatafeedBatchCallbackData(Session *session,
+		DatafeedBatchCallbackFunction callback,
+		size_t max_packets, uint64_t max_latency_us);
+	void flush();
+	DatafeedBatchCallbackFunction _callback;
+	Session *_session;
+	size_t _max_packets;
+	uint64_t _max_latency_us;
+	/* Pending views, all of them from the same device. */
+	const struct sr_dev_inst *_sdi;
+	std::vector<PacketView> _views;
+	int64_t _first_time;
+	friend class Session;
+};
+
+/** A batch of packet views from one device, see Session::next_batch(). */
+class SR_API PacketBatch
+{
+public:
+	/** Device which sent the packets, nullptr for the empty batch. */
+	std::shared_ptr<Device> device;
+	/** The packets. */
+	std::vector<PacketView> views;
+	/** Whether this is the empty batch at the end of the session. */
+	bool empty() const { return views.empty(); }
+};
+
+/* Batches of a session on their way to the coroutine awaiting them */
+class SR_API BatchQueue
+{
+public:
+	~BatchQueue();
+private:
+	explicit BatchQueue(BatchExecutor executor);
+	void push(PacketBatch batch);
+	void open();
+	void close();
+	void set_executor(BatchExecutor executor);
+	bool ready();
+	bool suspend(std::function<void()> resume);
+	PacketBatch pop();
+	void wake(std::unique_lock<std::mutex> &lock);
+	std::mutex _mutex;
+	std::deque<PacketBatch> _batches;
+	std::function<void()> _resume;
+	BatchExecutor _executor;
+	bool _closed;
+
+	friend class Session;
+	friend class BatchAwaitable;
+};
+
+/**
+ * What Session::next_batch() gives, to be awaited in a coroutine.
+ *
+ * The coroutine handle is only taken as a template parameter, so this
+ * does not need C++20 to be declared, just to be awaited.
+ */
+class SR_API BatchAwaitable
+{
+public:
+	/** Whether a batch is there already. */
+	bool await_ready() const { return _queue->ready(); }
+	/** Have the coroutine resumed once a batch is there. */
+	template <typename Handle>
+	bool await_suspend(Handle handle) const
+	{
+		return _queue->suspend([handle]() mutable { handle.resume(); });
+	}
+	/** Take the batch. */
+	PacketBatch await_resume() const { return _queue->pop(); }
+private:
+	explicit BatchAwaitable(std::shared_ptr<BatchQueue> queue);
+	std::shared_ptr<BatchQueue> _queue;
+
+	friend class Session;
+};
+
 /** A packet on the session datafeed */
 class SR_API Packet : public UserOwned<Packet>
 {
@@ -673,9 +960,13 @@ private:
 	Packet(std::shared_ptr<Device> device,
 		const struct sr_datafeed_packet *structure);
 	~Packet();
+	void reset(std::shared_ptr<Device> device,
+		const struct sr_datafeed_packet *structure);
 	const struct sr_datafeed_packet *_structure;
 	std::shared_ptr<Device> _device;
 	std::unique_ptr<PacketPayload> _payload;
+	/* Structures and data of packets created over existing data. */
+	std::shared_ptr<const void> _owner;
 
 	friend class Session;
 	friend class Output;
@@ -683,6 +974,8 @@ private:
 	friend class Header;
 	friend class Meta;
 	friend class Logic;
+	friend class LogicRLE;
+	friend class LogicPacked;
 	friend class Analog;
 	friend class Context;
 	friend struct std::default_delete<Packet>;
@@ -753,6 +1046,18 @@ public:
 	size_t data_length() const;
 	/* Size of each sample in bytes. */
 	unsigned int unit_size() const;
+	/**
+	 * View of the data, without copying it. Only valid as long as the
+	 * packet, which in a datafeed callback means until it returns.
+	 */
+	DataView data();
+	/**
+	 * View of the data that stays valid after the datafeed callback
+	 * returned. Takes a reference to the packet buffer if the driver
+	 * sent one, and only copies the data otherwise. Must be called
+	 * from within the datafeed callback.
+	 */
+	DataView retain_data();
 private:
 	explicit Logic(const struct sr_datafeed_logic *structure);
 	~Logic();
@@ -765,6 +1070,66 @@ private:
 	friend struct std::default_delete<Logic>;
 };
 
+/** Payload of a datafeed packet with run-length encoded logic data */
+class SR_API LogicRLE :
+	public ParentOwned<LogicRLE, Packet>,
+	public PacketPayload
+{
+public:
+	/** Number of samples the runs make up. */
+	uint64_t num_samples() const;
+	/** Size of each value in bytes. */
+	unsigned int unit_size() const;
+	/** Number of runs. */
+	uint64_t num_runs() const;
+	/** Sample offset of each run, in ascending order. */
+	const uint64_t *offsets() const;
+	/** Value of each run, unit_size() bytes each. */
+	const void *values() const;
+	/**
+	 * Expand samples start to start + count to dest, which must have
+	 * space for count * unit_size() bytes.
+	 */
+	void to_dense(uint64_t start, uint64_t count, uint8_t *dest) const;
+private:
+	explicit LogicRLE(const struct sr_datafeed_logic_rle *structure);
+	~LogicRLE();
+	std::shared_ptr<PacketPayload> share_owned_by(std::shared_ptr<Packet> parent);
+
+	const struct sr_datafeed_logic_rle *_structure;
+
+	friend class Packet;
+	friend struct std::default_delete<LogicRLE>;
+};
+
+/** Payload of a datafeed packet with several logic samples to a byte */
+class SR_API LogicPacked :
+	public ParentOwned<LogicPacked, Packet>,
+	public PacketPayload
+{
+public:
+	/** Number of samples. */
+	uint64_t num_samples() const;
+	/** Bits per sample: 1, 2 or 4. */
+	unsigned int bits_per_sample() const;
+	/** The samples, first one in the lowest bits of a byte. */
+	const void *data_pointer() const;
+	/**
+	 * Unpack samples start to start + count to dest, a byte per
+	 * sample, which must have space for count bytes.
+	 */
+	void to_dense(uint64_t start, uint64_t count, uint8_t *dest) const;
+private:
+	explicit LogicPacked(const struct sr_datafeed_logic_packed *structure);
+	~LogicPacked();
+	std::shared_ptr<PacketPayload> share_owned_by(std::shared_ptr<Packet> parent);
+
+	const struct sr_datafeed_logic_packed *_structure;
+
+	friend class Packet;
+	friend struct std::default_delete<LogicPacked>;
+};
+
 /** Payload of a datafeed packet with analog data */
 class SR_API Analog :
 	public ParentOwned<Analog, Packet>,
@@ -773,6 +1138,18 @@ class SR_API Analog :
 public:
 	/** Pointer to data. */
 	void *data_pointer();
+	/**
+	 * View of the raw data, without copying it. Only valid as long as
+	 * the packet, which in a datafeed callback means until it returns.
+	 */
+	DataView data();
+	/**
+	 * View of the raw data that stays valid after the datafeed callback
+	 * returned. Takes a reference to the packet buffer if the driver
+	 * sent one, and only copies the data otherwise. Must be called
+	 * from within the datafeed callback.
+	 */
+	DataView retain_data();
 	/**
 	 * Fills dest pointer with the analog data converted to float.
 	 * The pointer must have space for num_samples() floats.
@@ -372,6 +372,111 @@ typedef jobject jdatafeedcallback;
   }
 }
 
+/*
+ * Direct NIO buffers over packet data, without copying it into the Java
+ * heap. Each buffer keeps the data alive on its own, a Cleaner drops the
+ * data once the buffer (and any view of it) has become unreachable.
+ */
+
+%ignore sigrok::Logic::data_pointer;
+%ignore sigrok::Analog::data_pointer;
+
+%inline {
+typedef jobject jbytebuffer;
+}
+
+%typemap(jni) jbytebuffer "jobject"
+%typemap(jtype) jbytebuffer "java.nio.ByteBuffer"
+%typemap(jstype) jbytebuffer "java.nio.ByteBuffer"
+%typemap(javaout) jbytebuffer { return $jnicall; }
+%typemap(out) jbytebuffer %{ $result = $1; %}
+
+%nodefaultctor DataBufferOwner;
+%ignore DataBufferOwner::DataBufferOwner;
+
+%typemap(javacode) DataBufferOwner %{
+  private static final java.lang.ref.Cleaner cleaner =
+    java.lang.ref.Cleaner.create();
+
+  /* Hand out the owner's buffer, and drop the owner along with it. */
+  static java.nio.ByteBuffer track(final DataBufferOwner owner) {
+    java.nio.ByteBuffer buffer =
+      owner.buffer().order(java.nio.ByteOrder.nativeOrder());
+    cleaner.register(buffer, owner::delete);
+    return buffer;
+  }
+%}
+
+%inline {
+/* Keeps the data of a direct buffer alive. */
+class DataBufferOwner
+{
+  public:
+    explicit DataBufferOwner(sigrok::DataView view) :
+      _view(std::move(view)) {}
+    explicit DataBufferOwner(std::vector<float> values) :
+      _values(std::move(values)) {}
+    jbytebuffer buffer(JNIEnv *env)
+    {
+      if (!_values.empty())
+        return env->NewDirectByteBuffer(_values.data(),
+          _values.size() * sizeof(float));
+      return env->NewDirectByteBuffer(
+        const_cast<uint8_t *>(_view.data()), _view.size());
+    }
+  private:
+    sigrok::DataView _view;
+    std::vector<float> _values;
+};
+}
+
+%newobject sigrok::Logic::_retain_data_buffer;
+%newobject sigrok::Analog::_retain_data_buffer;
+%newobject sigrok::Analog::_retain_data_float_buffer;
+
+%extend sigrok::Logic
+{
+  DataBufferOwner *_retain_data_buffer()
+  {
+    return new DataBufferOwner($self->retain_data());
+  }
+}
+
+%extend sigrok::Analog
+{
+  DataBufferOwner *_retain_data_buffer()
+  {
+    return new DataBufferOwner($self->retain_data());
+  }
+
+  DataBufferOwner *_retain_data_float_buffer()
+  {
+    std::vector<float> values(
+      (size_t)$self->num_samples() * $self->channels().size());
+    $self->get_data_as_float(values.data());
+    return new DataBufferOwner(std::move(values));
+  }
+}
+
+%typemap(javacode) sigrok::Logic %{
+  /** Direct buffer over the sample data, without copying it. */
+  public java.nio.ByteBuffer data_buffer() {
+    return DataBufferOwner.track(_retain_data_buffer());
+  }
+%}
+
+%typemap(javacode) sigrok::Analog %{
+  /** Direct buffer over the raw sample data, without copying it. */
+  public java.nio.ByteBuffer data_buffer() {
+    return DataBufferOwner.track(_retain_data_buffer());
+  }
+
+  /** Direct buffer of the samples as float, channel after channel. */
+  public java.nio.FloatBuffer data_float_buffer() {
+    return DataBufferOwner.track(_retain_data_float_buffer()).asFloatBuffer();
+  }
+%}
+
 %include "doc.i"
 
 %define %enumextras(Class)
@@ -400,12 +400,85 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
     return output;
 }
 
+/* Drops the data of a NumPy array along with the array. */
+void data_view_release(PyObject *capsule)
+{
+    delete static_cast<sigrok::DataView *>(
+        PyCapsule_GetPointer(capsule, "sigrok.DataView"));
+}
+
+/* Create a read-only NumPy array using the data of a view, without copying it. */
+PyObject *array_from_data_view(const sigrok::DataView &view,
+    int nd, npy_intp *dims, PyArray_Descr *descr)
+{
+    auto owner = new sigrok::DataView(view);
+    PyObject *capsule = PyCapsule_New(owner, "sigrok.DataView", data_view_release);
+    if (!capsule) {
+        delete owner;
+        Py_DECREF(descr);
+        return nullptr;
+    }
+
+    PyObject *array = PyArray_NewFromDescr(&PyArray_Type, descr, nd, dims,
+        nullptr, const_cast<uint8_t *>(owner->data()), NPY_ARRAY_CARRAY_RO,
+        nullptr);
+    if (!array) {
+        Py_DECREF(capsule);
+        return nullptr;
+    }
+    /* The array keeps the capsule, and thus the data, from here on. */
+    if (PyArray_SetBaseObject((PyArrayObject *)array, capsule) < 0) {
+        Py_DECREF(array);
+        return nullptr;
+    }
+
+    return array;
+}
+
+/* NumPy type of the samples in an analog packet. */
+PyArray_Descr *analog_descr(sigrok::Analog *analog)
+{
+    int typenum;
+
+    switch (analog->unitsize()) {
+    case 1:
+        typenum = analog->is_signed() ? NPY_INT8 : NPY_UINT8;
+        break;
+    case 2:
+        typenum = analog->is_signed() ? NPY_INT16 : NPY_UINT16;
+        break;
+    case 4:
+        typenum = analog->is_float() ? NPY_FLOAT32 :
+            analog->is_signed() ? NPY_INT32 : NPY_UINT32;
+        break;
+    case 8:
+        typenum = analog->is_float() ? NPY_FLOAT64 :
+            analog->is_signed() ? NPY_INT64 : NPY_UINT64;
+        break;
+    default:
+        throw sigrok::Error(SR_ERR_NA);
+    }
+    if ((analog->unitsize() < 4) && analog->is_float())
+        throw sigrok::Error(SR_ERR_NA);
+
+    PyArray_Descr *descr = PyArray_DescrFromType(typenum);
+    if (!descr)
+        return nullptr;
+    PyArray_Descr *ordered = PyArray_DescrNewByteorder(descr,
+        analog->is_bigendian() ? NPY_BIG : NPY_LITTLE);
+    Py_DECREF(descr);
+
+    return ordered;
+}
+
 %}
 
 /* Ignore these methods, we will override them below. */
 %ignore sigrok::Analog::data;
+%ignore sigrok::Analog::get_data_as_float;
 %ignore sigrok::Logic::data;
 %ignore sigrok::Driver::scan;
+%ignore sigrok::Session::run;
 %ignore sigrok::InputFormat::create_input;
 %ignore sigrok::OutputFormat::create_output;
 
@@ -543,27 +616,75 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
     }
 }
 
-/* Return NumPy array from Analog::data(). */
+/*
+ * Return NumPy arrays over the analog data. The raw samples are not
+ * copied if the driver sent them in a reference counted buffer, the
+ * array keeps that buffer alive.
+ */
 %extend sigrok::Analog
 {
     PyObject * _data()
     {
-        int nd = 2;
         npy_intp dims[2];
         dims[0] = $self->channels().size();
         dims[1] = $self->num_samples();
-        int typenum = NPY_FLOAT;
-        void *data = $self->data_pointer();
-        return PyArray_SimpleNewFromData(nd, dims, typenum, data);
+        PyArray_Descr *descr = analog_descr($self);
+        if (!descr)
+            return nullptr;
+        return array_from_data_view($self->retain_data(), 2, dims, descr);
+    }
+
+    PyObject * _data_float(PyObject *out)
+    {
+        npy_intp dims[2];
+        dims[0] = $self->channels().size();
+        dims[1] = $self->num_samples();
+        PyArrayObject *array;
+
+        if (out == Py_None) {
+            array = (PyArrayObject *)PyArray_SimpleNew(2, dims, NPY_FLOAT32);
+            if (!array)
+                return nullptr;
+        } else {
+            /* Convert right into the caller's array. */
+            if (!PyArray_Check(out))
+                throw sigrok::Error(SR_ERR_ARG);
+            array = (PyArrayObject *)out;
+            if (PyArray_TYPE(array) != NPY_FLOAT32 ||
+                    !PyArray_ISCARRAY(array) ||
+                    PyArray_SIZE(array) < dims[0] * dims[1])
+                throw sigrok::Error(SR_ERR_ARG);
+            Py_INCREF(out);
+        }
+
+        try {
+            $self->get_data_as_float((float *)PyArray_DATA(array));
+        } catch (...) {
+            Py_DECREF(array);
+            throw;
+        }
+
+        return (PyObject *)array;
     }
 
 %pythoncode
 {
     data = property(_data)
+
+    def data_float_into(self, out):
+        """Convert the samples to float into a preallocated, C-contiguous
+        float32 array with at least channels x num_samples elements."""
+        return self._data_float(out)
+
+    data_float = property(lambda self: self._data_float(None))
 }
 }
 
-/* Return NumPy array from Logic::data(). */
+/*
+ * Return NumPy array over the logic data. The data is not copied if the
+ * driver sent it in a reference counted buffer, the array keeps that
+ * buffer alive.
+ */
 %extend sigrok::Logic
 {
     PyObject * _data()
@@ -571,9 +692,8 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
         npy_intp dims[2];
         dims[0] = $self->data_length() / $self->unit_size();
         dims[1] = $self->unit_size();
-        int typenum = NPY_UINT8;
-        void *data = $self->data_pointer();
-        return PyArray_SimpleNewFromData(2, dims, typenum, data);
+        return array_from_data_view($self->retain_data(), 2, dims,
+            PyArray_DescrFromType(NPY_UINT8));
     }
 
 %pythoncode
@@ -582,23 +702,304 @@ std::map<std::string, Glib::VariantBase> dict_to_map_options(PyObject *dict,
 }
 }
 
-/* Create logic packet from Python buffer. */
+%{
+/* Drops a Python buffer which packet data referred to. */
+void py_buffer_release(const void *data)
+{
+    auto view = static_cast<Py_buffer *>(const_cast<void *>(data));
+    auto gstate = PyGILState_Ensure();
+    PyBuffer_Release(view);
+    PyGILState_Release(gstate);
+    delete view;
+}
+
+/* Get a C-contiguous buffer, which is released along with the returned owner. */
+std::shared_ptr<const void> py_buffer_get(PyObject *obj, Py_buffer **view, int flags)
+{
+    *view = new Py_buffer;
+    if (PyObject_GetBuffer(obj, *view, flags | PyBUF_C_CONTIGUOUS) < 0) {
+        delete *view;
+        PyErr_Clear();
+        throw sigrok::Error(SR_ERR_ARG);
+    }
+    return std::shared_ptr<const void>(*view, py_buffer_release);
+}
+%}
+
+/*
+ * Create packets over Python buffers without copying. The packets keep
+ * a reference to the buffer for as long as they exist.
+ */
 %extend sigrok::Context
 {
     std::shared_ptr<Packet> _create_logic_packet_buf(PyObject *buf, unsigned int unit_size)
     {
-        Py_buffer view;
-        PyObject_GetBuffer(buf, &view, PyBUF_SIMPLE);
-        return $self->create_logic_packet(view.buf, view.len, unit_size);
+        Py_buffer *view;
+        auto owner = py_buffer_get(buf, &view, PyBUF_SIMPLE);
+        return $self->create_logic_packet(view->buf, view->len,
+            unit_size, owner);
+    }
+
+    std::shared_ptr<Packet> _create_analog_packet_buf(
+        std::vector<std::shared_ptr<sigrok::Channel> > channels,
+        PyObject *buf, const sigrok::Quantity *mq, const sigrok::Unit *unit,
+        std::vector<const sigrok::QuantityFlag *> mqflags)
+    {
+        Py_buffer *view;
+        auto owner = py_buffer_get(buf, &view, PyBUF_FORMAT);
+
+        /* float32 or int16 in host byte order. */
+        const char *format = view->format ? view->format : "B";
+        if (*format == '@' || *format == '=')
+            format++;
+#ifndef WORDS_BIGENDIAN
+        if (*format == '<')
+            format++;
+#else
+        if (*format == '>' || *format == '!')
+            format++;
+#endif
+        bool is_float;
+        if (!strcmp(format, "f") && view->itemsize == 4)
+            is_float = true;
+        else if (!strcmp(format, "h") && view->itemsize == 2)
+            is_float = false;
+        else
+            throw sigrok::Error(SR_ERR_ARG);
+
+        /* One value per channel, or channels x samples. */
+        if (channels.empty() || view->ndim > 2)
+            throw sigrok::Error(SR_ERR_ARG);
+        if (view->ndim == 2 && (size_t)view->shape[0] != channels.size())
+            throw sigrok::Error(SR_ERR_ARG);
+        size_t num_values = view->len / view->itemsize;
+        if (num_values % channels.size())
+            throw sigrok::Error(SR_ERR_ARG);
+
+        return $self->create_analog_packet(channels, view->buf,
+            num_values / channels.size(), view->itemsize, is_float, true,
+            mq, unit, mqflags, owner);
     }
 }
 
 %pythoncode
 {
     def _Context_create_logic_packet(self, buf, unit_size):
+        """Create a logic packet over the data of a buffer, without
+        copying it."""
         return self._create_logic_packet_buf(buf, unit_size)
 
     Context.create_logic_packet = _Context_create_logic_packet
+
+    def _Context_create_analog_packet(self, channels, buf, mq, unit, mqflags=[]):
+        """Create an analog packet over a float32 or int16 buffer, e.g.
+        a NumPy array of channels x samples, without copying it."""
+        return self._create_analog_packet_buf(channels, buf, mq, unit, mqflags)
+
+    Context.create_analog_packet = _Context_create_analog_packet
+}
+
+/*
+ * Packet queue for consumers in Python. The session thread fills it
+ * through a batched datafeed callback which does not take the GIL,
+ * Python code drains it in bulk. A full queue holds up the session
+ * thread until the consumer catches up, so sessions feeding a queue
+ * should run in a different thread than the consumer.
+ */
+%{
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+class PacketQueue
+{
+public:
+    explicit PacketQueue(size_t max_packets) :
+        _max_packets(max_packets ? max_packets : 1),
+        _closed(false)
+    {
+    }
+
+    void push(const std::vector<sigrok::PacketView> &views)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (auto &view : views) {
+            if (view.type() == sigrok::PacketType::HEADER)
+                _closed = false;
+            _not_full.wait(lock, [this] {
+                return _closed || _packets.size() < _max_packets;
+            });
+            _packets.push_back(view);
+            if (view.type() == sigrok::PacketType::END)
+                _closed = true;
+        }
+        _not_empty.notify_all();
+    }
+
+    /* Wait up to timeout seconds for packets, a negative timeout waits forever. */
+    void pop(std::vector<sigrok::PacketView> &out, size_t max_n, double timeout)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto ready = [this] { return _closed || !_packets.empty(); };
+        if (timeout < 0)
+            _not_empty.wait(lock, ready);
+        else
+            _not_empty.wait_for(lock,
+                std::chrono::duration<double>(timeout), ready);
+        while (!_packets.empty() && out.size() < max_n) {
+            out.push_back(std::move(_packets.front()));
+            _packets.pop_front();
+        }
+        _not_full.notify_all();
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+
+private:
+    size_t _max_packets;
+    bool _closed;
+    std::deque<sigrok::PacketView> _packets;
+    std::mutex _mutex;
+    std::condition_variable _not_empty;
+    std::condition_variable _not_full;
+};
+
+/* Queues by session. Session callbacks own them, this only looks them up. */
+static std::map<sigrok::Session *, std::weak_ptr<PacketQueue> > packet_queues;
+static std::mutex packet_queues_mutex;
+
+static std::shared_ptr<PacketQueue> packet_queue_get(sigrok::Session *session)
+{
+    std::lock_guard<std::mutex> lock(packet_queues_mutex);
+    auto it = packet_queues.find(session);
+    if (it == packet_queues.end())
+        return nullptr;
+    return it->second.lock();
+}
+
+/* NumPy array over the data of a packet view, or None. */
+static PyObject *packet_view_to_array(const sigrok::PacketView &view)
+{
+    npy_intp dims[2];
+
+    if (view.data().empty() || !view.unit_size()) {
+        Py_RETURN_NONE;
+    } else if (view.type() == sigrok::PacketType::LOGIC) {
+        dims[0] = view.num_samples();
+        dims[1] = view.unit_size();
+        return array_from_data_view(view.data(), 2, dims,
+            PyArray_DescrFromType(NPY_UINT8));
+    } else {
+        /* Same layout as Analog.data_float, channels x samples. */
+        dims[0] = view.unit_size() / sizeof(float);
+        dims[1] = view.num_samples();
+        return array_from_data_view(view.data(), 2, dims,
+            PyArray_DescrFromType(NPY_FLOAT32));
+    }
+}
+%}
+
+%extend sigrok::Session
+{
+    /* Run the session's event loop without holding the GIL. */
+    void _run_nogil()
+    {
+        int result = SR_OK;
+
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            $self->run();
+        } catch (sigrok::Error &e) {
+            result = e.result;
+        }
+        Py_END_ALLOW_THREADS
+
+        if (result != SR_OK)
+            throw sigrok::Error(result);
+    }
+
+    void _enable_packet_queue(size_t max_packets)
+    {
+        auto queue = std::make_shared<PacketQueue>(max_packets);
+        {
+            std::lock_guard<std::mutex> lock(packet_queues_mutex);
+            for (auto it = packet_queues.begin(); it != packet_queues.end(); ) {
+                if (it->second.expired())
+                    it = packet_queues.erase(it);
+                else
+                    ++it;
+            }
+            auto old = packet_queues.find($self);
+            if (old != packet_queues.end())
+                if (auto old_queue = old->second.lock())
+                    old_queue->close();
+            packet_queues[$self] = queue;
+        }
+        $self->add_datafeed_batch_callback([queue] (
+                std::shared_ptr<sigrok::Device>,
+                const std::vector<sigrok::PacketView> &views) {
+            queue->push(views);
+        });
+    }
+
+    PyObject *_read_packets(size_t max_n, double timeout)
+    {
+        auto queue = packet_queue_get($self);
+        if (!queue)
+            throw sigrok::Error(SR_ERR_NA);
+
+        std::vector<sigrok::PacketView> views;
+        Py_BEGIN_ALLOW_THREADS
+        queue->pop(views, max_n, timeout);
+        Py_END_ALLOW_THREADS
+
+        PyObject *list = PyList_New(views.size());
+        if (!list)
+            return nullptr;
+        for (size_t i = 0; i < views.size(); i++) {
+            auto type_obj = SWIG_NewPointerObj(
+                SWIG_as_voidptr(views[i].type()),
+                SWIGTYPE_p_sigrok__PacketType, 0);
+            auto data_obj = packet_view_to_array(views[i]);
+            if (!type_obj || !data_obj) {
+                Py_XDECREF(type_obj);
+                Py_XDECREF(data_obj);
+                Py_DECREF(list);
+                return nullptr;
+            }
+            PyList_SET_ITEM(list, i, Py_BuildValue("(NN)", type_obj, data_obj));
+        }
+
+        return list;
+    }
+
+%pythoncode
+{
+    def run(self):
+        """Run the session event loop. Other Python threads keep running
+        meanwhile, callbacks take the GIL when they get invoked."""
+        self._run_nogil()
+
+    def enable_packet_queue(self, max_packets=1024):
+        """Collect logic and analog packets in a queue of max_packets,
+        to be drained by read_packets()."""
+        self._enable_packet_queue(max_packets)
+
+    def read_packets(self, max_n=256, timeout=None):
+        """Return up to max_n queued packets as (PacketType, data) tuples.
+        Logic data are uint8 arrays of samples x unit size, analog data
+        are float32 arrays of channels x samples, other packets have no
+        data. Waits up to timeout seconds for the first packet, or until
+        the end of the acquisition when timeout is None."""
+        return self._read_packets(max_n, -1.0 if timeout is None else timeout)
+}
 }
 
 %include "doc_end.i"
@@ -431,3 +431,42 @@ int convert_option_by_key(VALUE key, VALUE val, VALUE in) {
         return channels;
     }
 }
+
+/*
+ * Return frozen binary strings over packet data, without copying it.
+ * Each string keeps the data alive on its own, through a hidden
+ * reference to a retained view.
+ */
+%{
+static void data_view_free(void *view)
+{
+    delete static_cast<sigrok::DataView *>(view);
+}
+
+static VALUE string_from_data_view(sigrok::DataView view)
+{
+    auto owner = new sigrok::DataView(std::move(view));
+    VALUE owner_obj = Data_Wrap_Struct(rb_cObject, NULL, data_view_free, owner);
+    VALUE str = rb_str_new_static(
+        reinterpret_cast<const char *>(owner->data()), owner->size());
+    rb_ivar_set(str, rb_intern("@__data_view"), owner_obj);
+    return rb_obj_freeze(str);
+}
+%}
+
+%rename sigrok::Logic::_data data;
+%extend sigrok::Logic
+{
+    VALUE _data()
+    {
+        return string_from_data_view($self->retain_data());
+    }
+}
+
+%extend sigrok::Analog
+{
+    VALUE raw_data()
+    {
+        return string_from_data_view($self->retain_data());
+    }
+}
@@ -65,6 +65,8 @@ template< class T > class enable_shared_from_this;
 %shared_ptr(sigrok::Meta);
 %shared_ptr(sigrok::Analog);
 %shared_ptr(sigrok::Logic);
+%shared_ptr(sigrok::LogicRLE);
+%shared_ptr(sigrok::LogicPacked);
 %shared_ptr(sigrok::InputFormat);
 %shared_ptr(sigrok::Input);
 %shared_ptr(sigrok::InputDevice);
@@ -81,6 +83,36 @@ template< class T > class enable_shared_from_this;
 
 %ignore sigrok::DatafeedCallbackData;
 
+/* Batched datafeed callbacks are a C++ only interface. */
+%ignore sigrok::DatafeedBatchCallbackData;
+%ignore sigrok::PacketView;
+%ignore sigrok::Session::add_datafeed_batch_callback;
+%ignore sigrok::PacketBatch;
+%ignore sigrok::BatchQueue;
+%ignore sigrok::BatchAwaitable;
+%ignore sigrok::Session::next_batch;
+%ignore sigrok::Session::set_batch_executor;
+
+/* Packets over foreign data, the language bindings manage owners their own way. */
+%ignore sigrok::Context::create_logic_packet(const void *, size_t,
+    unsigned int, std::shared_ptr<const void>);
+%ignore sigrok::Context::create_analog_packet(
+    std::vector<std::shared_ptr<Channel> >, const void *, unsigned int,
+    unsigned int, bool, bool, const Quantity *, const Unit *,
+    std::vector<const QuantityFlag *>, std::shared_ptr<const void>);
+
+/* Raw memory views, the language bindings expose data their own way. */
+%ignore sigrok::DataView;
+%ignore sigrok::Logic::data;
+%ignore sigrok::Logic::retain_data;
+%ignore sigrok::LogicRLE::offsets;
+%ignore sigrok::LogicRLE::values;
+%ignore sigrok::LogicRLE::to_dense;
+%ignore sigrok::LogicPacked::data_pointer;
+%ignore sigrok::LogicPacked::to_dense;
+%ignore sigrok::Analog::data;
+%ignore sigrok::Analog::retain_data;
+
 #ifndef SWIGJAVA
 
 #define SWIG_ATTRIBUTE_TEMPLATE
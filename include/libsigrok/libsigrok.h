@@ -176,6 +176,12 @@ enum sr_packettype {
 	SR_DF_FRAME_END,
 	/** Payload is struct sr_datafeed_analog. */
 	SR_DF_ANALOG,
+	/** Payload is struct sr_datafeed_logic_rle. */
+	SR_DF_LOGIC_RLE,
+	/** Payload is struct sr_datafeed_logic_planar. */
+	SR_DF_LOGIC_PLANAR,
+	/** Payload is struct sr_datafeed_logic_packed. */
+	SR_DF_LOGIC_PACKED,
 
 	/* Update datafeed_dump() (session.c) upon changes! */
 };
@@ -436,6 +442,13 @@ struct sr_trigger_stage {
 	int stage;
 	/** List of pointers to struct sr_trigger_match. */
 	GSList *matches;
+	/** Number of consecutive samples the matches must hold for,
+	 * 0 is the same as 1. @since 0.6.0 */
+	uint64_t repeat;
+	/** Number of samples after the previous stage within which this
+	 * stage must start to match, 0 for right on the next sample.
+	 * Not used on the first stage. @since 0.6.0 */
+	uint64_t window;
 };
 
 /** A channel to match and what to match it on. */
@@ -483,6 +496,41 @@ struct sr_context;
  */
 struct sr_session;
 
+/**
+ * @struct sr_session_file
+ * Opaque structure representing a session file opened for random access.
+ *
+ * @see sr_session_file_open(), sr_session_file_close().
+ */
+struct sr_session_file;
+
+/** Properties of a session file, see sr_session_file_probe(). */
+struct sr_session_file_info {
+	/** Version of the session file format. */
+	uint64_t version;
+	/** Samplerate in Hz, 0 if unknown. */
+	uint64_t samplerate;
+	/** Number of logic samples. */
+	uint64_t num_samples;
+	/** Size of each logic sample in bytes, 0 without logic data. */
+	uint16_t unitsize;
+	/** Number of logic channels. */
+	int num_logic_channels;
+	/** Number of analog channels. */
+	int num_analog_channels;
+};
+
+/**
+ * @struct sr_buffer
+ * Opaque, reference counted payload buffer.
+ *
+ * Drivers can send datafeed packets backed by one, consumers can then
+ * keep the payload by taking a reference instead of copying it.
+ *
+ * @see sr_buffer_new(), sr_packet_buffer_ref().
+ */
+struct sr_buffer;
+
 struct sr_rational {
 	/** Numerator of the rational number. */
 	int64_t p;
@@ -490,6 +538,87 @@ struct sr_rational {
 	uint64_t q;
 };
 
+/** What asynchronous datafeed dispatch does when its queue is full. */
+enum sr_dispatch_policy {
+	/** Wait for the consumer to catch up. */
+	SR_DISPATCH_BLOCK,
+	/** Drop logic and analog packets, and count them. */
+	SR_DISPATCH_DROP,
+	/** Keep logic packets in a temporary file until there is room. */
+	SR_DISPATCH_SPILL,
+};
+
+/** Asynchronous datafeed dispatch statistics. */
+struct sr_dispatch_stats {
+	/** Packets that went through the queue. */
+	uint64_t packets;
+	/** Packets dropped for lack of room. */
+	uint64_t dropped;
+	/** Packets that went through the spill file. */
+	uint64_t spilled;
+	/** Times the sender had to wait for room. */
+	uint64_t blocked;
+	/** Highest number of queued packets. */
+	uint64_t max_depth;
+};
+
+/** Number of packet types, for arrays indexed by type - SR_DF_HEADER. */
+#define SR_DF_NUM_TYPES (SR_DF_LOGIC_PACKED - SR_DF_HEADER + 1)
+
+/** Number of sr_stats_histogram buckets. */
+#define SR_STATS_HISTOGRAM_BUCKETS 24
+
+/** Distribution of durations, in microseconds. */
+struct sr_stats_histogram {
+	/** Number of samples. */
+	uint64_t count;
+	/** Sum of all durations. */
+	uint64_t total_us;
+	/** Longest duration. */
+	uint64_t max_us;
+	/**
+	 * Bucket 0 counts durations below 1 us, bucket n those from
+	 * 2^(n-1) us up to 2^n us. The last bucket takes all longer ones.
+	 */
+	uint64_t buckets[SR_STATS_HISTOGRAM_BUCKETS];
+};
+
+/** Session performance counters, see sr_session_stats_get(). */
+struct sr_session_stats {
+	/** Packets sent by the devices, per type. */
+	uint64_t packets[SR_DF_NUM_TYPES];
+	/** Logic and analog payload bytes sent by the devices, per type. */
+	uint64_t bytes[SR_DF_NUM_TYPES];
+	/** Time spent in event source callbacks, that is the drivers. */
+	struct sr_stats_histogram source_dispatch;
+	/** Delay from event source being ready to it being dispatched. */
+	struct sr_stats_histogram source_latency;
+	/** Time per transform module, struct sr_stats_histogram, in order. */
+	GSList *transforms;
+	/** Time per datafeed callback, struct sr_stats_histogram, in order. */
+	GSList *callbacks;
+};
+
+/** Statistics of a channel, see sr_session_channel_stats_get(). */
+struct sr_channel_stats {
+	/** The channel. */
+	struct sr_channel *channel;
+	/** Number of samples seen. */
+	uint64_t num_samples;
+	/** Logic channels: number of level changes. */
+	uint64_t edges;
+	/** Logic channels: number of samples at high level. */
+	uint64_t high_samples;
+	/** Logic channels: sample number of the last change, if any. */
+	uint64_t last_edge;
+	/** Analog channels: smallest value. */
+	float min;
+	/** Analog channels: largest value. */
+	float max;
+	/** Analog channels: mean value. */
+	double mean;
+};
+
 /** Packet in a sigrok data feed. */
 struct sr_datafeed_packet {
 	uint16_t type;
@@ -514,6 +643,76 @@ struct sr_datafeed_logic {
 	void *data;
 };
 
+/**
+ * Logic datafeed payload for type SR_DF_LOGIC_RLE.
+ *
+ * The samples as runs of the same value: run n starts at sample
+ * offsets[n] of the packet and takes the value n of values, up to the
+ * start of the next run or the end of the packet. The first run starts
+ * at offset 0, each run has a different value than the one before.
+ *
+ * @since 0.6.0
+ */
+struct sr_datafeed_logic_rle {
+	/** Number of samples. */
+	uint64_t num_samples;
+	/** Size of each value in bytes, as with SR_DF_LOGIC. */
+	uint16_t unitsize;
+	/** Number of runs. */
+	uint64_t num_runs;
+	/** Sample offset of each run, in ascending order. */
+	uint64_t *offsets;
+	/** Value of each run, unitsize bytes each. */
+	void *values;
+};
+
+/**
+ * Logic datafeed payload for type SR_DF_LOGIC_PLANAR.
+ *
+ * The samples channel major, as blocks of num_planes words of
+ * word_bits bits each. Word n of a block holds word_bits consecutive
+ * samples of plane n, in host byte order and with the first sample in
+ * bit 0. Plane n is bit plane_bits[n] of the dense samples, the bits
+ * without a plane are 0. The last block may hold more words than
+ * num_samples needs, their extra bits are undefined.
+ *
+ * @since 0.6.0
+ */
+struct sr_datafeed_logic_planar {
+	/** Number of samples. */
+	uint64_t num_samples;
+	/** Size of a dense sample in bytes, as with SR_DF_LOGIC. */
+	uint16_t unitsize;
+	/** Bits per word: 8, 16, 32 or 64. */
+	uint16_t word_bits;
+	/** Number of planes, which is the number of words per block. */
+	uint16_t num_planes;
+	/** Sample bit of each plane. NULL when plane n is bit n. */
+	uint16_t *plane_bits;
+	/** The blocks. */
+	void *data;
+};
+
+/**
+ * Logic datafeed payload for type SR_DF_LOGIC_PACKED.
+ *
+ * Samples of fewer than 8 bits, several to a byte. Sample n of a byte
+ * is in its bits n * bits_per_sample and up, the first sample in the
+ * lowest bits. As a dense sample, a packed one has unitsize 1, with
+ * the bits above bits_per_sample 0. The last byte may hold fewer than
+ * 8 / bits_per_sample samples, its extra bits are undefined.
+ *
+ * @since 0.6.0
+ */
+struct sr_datafeed_logic_packed {
+	/** Number of samples. */
+	uint64_t num_samples;
+	/** Bits per sample: 1, 2 or 4. */
+	uint16_t bits_per_sample;
+	/** The samples, (num_samples * bits_per_sample + 7) / 8 bytes. */
+	void *data;
+};
+
 /** Analog datafeed payload for type SR_DF_ANALOG. */
 struct sr_datafeed_analog {
 	void *data;
@@ -618,6 +817,112 @@ struct sr_resource {
 enum sr_output_flag {
 	/** If set, this output module writes the output itself. */
 	SR_OUTPUT_INTERNAL_IO_HANDLING = 0x01,
+	/**
+	 * The output is the sample data of the logic packets, unchanged,
+	 * and nothing else. Frontends may write sample data from wherever
+	 * they have it, see sr_output_write_samples().
+	 */
+	SR_OUTPUT_PASSTHROUGH_LOGIC = 0x02,
+	/**
+	 * Sample data is handed to sr_output_send_iov() callbacks where
+	 * it is in the packets, it gets neither formatted nor copied.
+	 * Data which the module holds back, like the pre-trigger samples
+	 * of the "chronovu-la8" format, is the exception.
+	 */
+	SR_OUTPUT_ZERO_COPY = 0x04,
+};
+
+/** Piece of output handed to a write callback, see sr_output_send_iov().
+ * @since 0.6.0
+ */
+struct sr_output_iov {
+	/** Start of the output bytes. */
+	const void *data;
+	/** Number of bytes. */
+	size_t len;
+};
+
+/** Type definition for callback function for output writing.
+ * @since 0.6.0
+ */
+typedef int (*sr_output_write_callback)(const struct sr_output_iov *iov,
+		size_t iovcnt, void *cb_data);
+
+/**
+ * @struct sr_output_group
+ * Opaque group of outputs which get fed in parallel.
+ *
+ * @see sr_output_group_new(), sr_output_group_free().
+ */
+struct sr_output_group;
+
+/** Memory accounting of a context, see sr_mem_stats_get().
+ * @since 0.6.0
+ */
+struct sr_mem_stats {
+	/** The budget in bytes, 0 for none. */
+	uint64_t budget;
+	/** Bytes held by acquisition buffers. */
+	uint64_t used;
+	/** Most bytes held at once. */
+	uint64_t peak;
+	/** Buffers refused for exceeding the budget. */
+	uint64_t refused;
+};
+
+/** Statistics of an output in a group, see sr_output_group_stats().
+ * @since 0.6.0
+ */
+struct sr_output_group_stats {
+	/** Packets the output has processed. */
+	uint64_t packets;
+	/** Samples in those packets. */
+	uint64_t samples;
+	/** Bytes the output passed to its write callback. */
+	uint64_t output_bytes;
+	/** Time spent in the output module and the callback, in us. */
+	uint64_t busy_us;
+	/** Packets waiting for the output. */
+	size_t queued;
+	/** The error the output failed with, or SR_OK. */
+	int error;
+};
+
+/**
+ * @struct sr_stream_server
+ * Opaque server streaming a session to remote clients over TCP.
+ *
+ * @see sr_stream_server_new(), sr_stream_server_free().
+ */
+struct sr_stream_server;
+
+/**
+ * @struct sr_shm_reader
+ * Opaque reader of the shared memory ring the "shm" output module writes.
+ *
+ * @see sr_shm_reader_open(), sr_shm_reader_close().
+ */
+struct sr_shm_reader;
+
+/** Packet read from a shared memory ring, see sr_shm_reader_next().
+ * @since 0.6.0
+ */
+struct sr_shm_packet {
+	/** Sequence number, gaps tell how many packets were lost. */
+	uint64_t seq;
+	/** Datafeed packet type, SR_DF_*. */
+	int type;
+	/** SR_DF_LOGIC: bytes per sample, SR_DF_ANALOG: sizeof(float),
+	 * SR_DF_META: the config key, only SR_CONF_SAMPLERATE so far. */
+	uint32_t unitsize;
+	/** SR_DF_ANALOG: index of the first channel, else -1. */
+	int channel;
+	/** Number of bytes at data. */
+	uint64_t length;
+	/** Logic samples, float analog samples of the channels one after
+	 * the other, or the uint64_t value of the meta key. Points into the
+	 * ring, valid until sr_shm_reader_release(). */
+	const void *data;
 };
 
 struct sr_input;
@@ -1192,6 +1497,105 @@ enum sr_configkey {
 	/** Number of powerline cycles for ADC integration time. */
 	SR_CONF_ADC_POWERLINE_CYCLES,
 
+	/**
+	 * Plan of the bulk transfers an acquisition uses.
+	 * @arg type: string, "<count>x<bytes> bytes per <duration>ms"
+	 * @arg get: get the plan for the current configuration
+	 */
+	SR_CONF_TRANSFER_PLAN,
+
+	/**
+	 * Number of overruns (lost data) detected during a streaming
+	 * acquisition, sent as meta packet when the count changes.
+	 * @arg type: uint64
+	 * @arg get: get the count of the current or last acquisition
+	 */
+	SR_CONF_BUFFER_OVERRUNS,
+
+	/**
+	 * Transfer statistics of a streaming acquisition, sent as meta
+	 * packet in regular intervals. Keys and values are device specific.
+	 * @arg type: dictionary
+	 * @arg get: get the statistics of the current or last acquisition
+	 */
+	SR_CONF_TRANSFER_STATS,
+
+	/**
+	 * Start all devices of the session that have this set together,
+	 * once the last of them is ready. Their streams get aligned in
+	 * time, but are not merged: each device still sends its own
+	 * packets for its own channels.
+	 * @arg type: boolean
+	 * @arg get: @b true if the device is part of the synchronized group
+	 * @arg set: @b true to join the group
+	 */
+	SR_CONF_SYNC_START,
+
+	/**
+	 * Time in microseconds between the start of the first device of a
+	 * synchronized group and this device, sent as meta packet once
+	 * the group has been started.
+	 * @arg type: uint64
+	 * @arg get: get the skew of the current or last acquisition
+	 */
+	SR_CONF_SYNC_SKEW,
+
+	/**
+	 * Number of bulk transfers an acquisition keeps in flight.
+	 * @arg type: uint64
+	 * @arg get: get the configured count, 0 when the driver picks it
+	 * @arg set: set the count, 0 to have the driver pick it
+	 */
+	SR_CONF_TRANSFER_COUNT,
+
+	/**
+	 * Size of each bulk transfer in bytes. Takes precedence over
+	 * SR_CONF_TRANSFER_LATENCY. Drivers round it as their device needs.
+	 * @arg type: uint64
+	 * @arg get: get the configured size, 0 when the driver picks it
+	 * @arg set: set the size, 0 to have the driver pick it
+	 */
+	SR_CONF_TRANSFER_SIZE,
+
+	/**
+	 * Duration of the data which each bulk transfer holds, in ms.
+	 * Shorter transfers get data to the application sooner, longer
+	 * ones need less overhead.
+	 * @arg type: uint64
+	 * @arg get: get the configured duration, 0 when the driver picks it
+	 * @arg set: set the duration, 0 to have the driver pick it
+	 */
+	SR_CONF_TRANSFER_LATENCY,
+
+	/**
+	 * Benchmark mode. The device sends data as fast as the session
+	 * takes it, instead of at the pace of the samplerate, and reports
+	 * the achieved throughput.
+	 * @arg type: boolean
+	 * @arg get: @b true if benchmark mode is enabled
+	 * @arg set: @b true to enable benchmark mode
+	 */
+	SR_CONF_BENCHMARK,
+
+	/**
+	 * File to write the device's raw data to, instead of sending it
+	 * to the session. The "rawcapture" input module unpacks it later.
+	 * @arg type: string
+	 * @arg get: get the file, empty when disabled
+	 * @arg set: set the file, empty to disable
+	 */
+	SR_CONF_RAW_CAPTURE_FILE,
+
+	/**
+	 * Result of the last link throughput test, an acquisition in the
+	 * device's maximum speed test pattern mode. Once there is one, the
+	 * device only lists samplerates and channel counts the link kept
+	 * up with. Keys and values are device specific.
+	 * @arg type: dictionary
+	 * @arg get: get the result, empty before the first test
+	 */
+	SR_CONF_LINK_TEST,
+
 	/* Update sr_key_info_config[] (hwdriver.c) upon changes! */
 
 	/*--- Acquisition modes, sample limiting ----------------------------*/
@@ -1305,6 +1709,14 @@ enum sr_dev_inst_status {
 	SR_ST_STOPPING,
 };
 
+/**
+ * @struct sr_user_feed
+ * Opaque ring buffer feeding logic samples into a user device's session.
+ *
+ * @see sr_user_feed_new(), sr_user_feed_free().
+ */
+struct sr_user_feed;
+
 /** Device driver data. See also http://sigrok.org/wiki/Hardware_driver_API . */
 struct sr_dev_driver {
 	/* Driver-specific */
@@ -1344,6 +1756,17 @@ struct sr_dev_driver {
 	int (*config_set) (uint32_t key, GVariant *data,
 			const struct sr_dev_inst *sdi,
 			const struct sr_channel_group *cg);
+	/** Query several configuration keys in one transaction, setting
+	 *  the data of each key it got. Optional.
+	 *  @see sr_config_get_multi(). @since 0.6.0 */
+	int (*config_get_multi) (struct sr_config *items, size_t count,
+			const struct sr_dev_inst *sdi,
+			const struct sr_channel_group *cg);
+	/** Set several configuration keys in one transaction. Optional.
+	 *  @see sr_config_set_multi(). @since 0.6.0 */
+	int (*config_set_multi) (const struct sr_config *items, size_t count,
+			const struct sr_dev_inst *sdi,
+			const struct sr_channel_group *cg);
 	/** Channel status change.
 	 *  @see sr_dev_channel_enable(). */
 	int (*config_channel_set) (const struct sr_dev_inst *sdi,
@@ -30,6 +30,8 @@
 
 SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		float *buf);
+SR_API int sr_analog_to_double(const struct sr_datafeed_analog *analog,
+		double *buf);
 SR_API const char *sr_analog_si_prefix(float *value, int *digits);
 SR_API gboolean sr_analog_si_prefix_friendly(enum sr_unit unit);
 SR_API int sr_analog_unit_to_string(const struct sr_datafeed_analog *analog,
@@ -50,6 +52,11 @@ SR_API GSList *sr_buildinfo_libs_get(void);
 SR_API char *sr_buildinfo_host_get(void);
 SR_API char *sr_buildinfo_scpi_backends_get(void);
 
+/*--- mem_budget.c ----------------------------------------------------------*/
+
+SR_API int sr_mem_budget_set(struct sr_context *ctx, uint64_t bytes);
+SR_API int sr_mem_stats_get(struct sr_context *ctx, struct sr_mem_stats *stats);
+
 /*--- conversion.c ----------------------------------------------------------*/
 
 SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
@@ -57,6 +64,34 @@ SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
 SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
 		uint64_t count);
+SR_API int sr_a2l_threshold_bits(const struct sr_datafeed_analog *analog,
+		float threshold, uint8_t *output, uint64_t count);
+SR_API int sr_a2l_schmitt_trigger_bits(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
+		uint64_t count);
+SR_API int sr_a2l_threshold_multi(const struct sr_datafeed_analog **analogs,
+		size_t num_channels, const float *thresholds, uint8_t *output,
+		uint16_t unitsize, uint64_t count, unsigned int num_threads);
+SR_API int sr_a2l_schmitt_trigger_multi(const struct sr_datafeed_analog **analogs,
+		size_t num_channels, const float *lo_thr, const float *hi_thr,
+		uint8_t *state, uint8_t *output, uint16_t unitsize,
+		uint64_t count);
+SR_API int sr_logic_rle_to_dense(const struct sr_datafeed_logic_rle *rle,
+		uint64_t start, uint64_t count, uint8_t *output);
+SR_API int sr_logic_rle_from_dense(const struct sr_datafeed_logic *logic,
+		struct sr_datafeed_logic_rle **rle);
+SR_API void sr_logic_rle_free(struct sr_datafeed_logic_rle *rle);
+SR_API int sr_logic_planar_to_dense(const struct sr_datafeed_logic_planar *planar,
+		uint64_t start, uint64_t count, uint8_t *output);
+SR_API int sr_logic_dense_to_planar(const struct sr_datafeed_logic *logic,
+		struct sr_datafeed_logic_planar **planar);
+SR_API void sr_logic_planar_free(struct sr_datafeed_logic_planar *planar);
+SR_API int sr_logic_packed_to_dense(const struct sr_datafeed_logic_packed *packed,
+		uint64_t start, uint64_t count, uint8_t *output);
+SR_API int sr_logic_dense_to_packed(const struct sr_datafeed_logic *logic,
+		unsigned int bits_per_sample,
+		struct sr_datafeed_logic_packed **packed);
+SR_API void sr_logic_packed_free(struct sr_datafeed_logic_packed *packed);
 
 /*--- log.c -----------------------------------------------------------------*/
 
@@ -68,6 +103,9 @@ SR_API int sr_log_loglevel_get(void);
 SR_API int sr_log_callback_set(sr_log_callback cb, void *cb_data);
 SR_API int sr_log_callback_set_default(void);
 SR_API int sr_log_callback_get(sr_log_callback *cb, void **cb_data);
+SR_API int sr_log_async_start(unsigned int num_records);
+SR_API int sr_log_async_stop(void);
+SR_API uint64_t sr_log_async_dropped(void);
 
 /*--- device.c --------------------------------------------------------------*/
 
@@ -98,6 +136,27 @@ SR_API struct sr_dev_inst *sr_dev_inst_user_new(const char *vendor,
 		const char *model, const char *version);
 SR_API int sr_dev_inst_channel_add(struct sr_dev_inst *sdi, int index, int type, const char *name);
 
+typedef void (*sr_config_change_callback)(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, GVariant *data,
+		void *cb_data);
+
+SR_API int sr_dev_config_listener_add(struct sr_dev_inst *sdi,
+		sr_config_change_callback cb, void *cb_data);
+SR_API int sr_dev_config_listener_remove(struct sr_dev_inst *sdi,
+		sr_config_change_callback cb, void *cb_data);
+
+/*--- user_feed.c -----------------------------------------------------------*/
+
+SR_API int sr_user_feed_new(const struct sr_dev_inst *sdi, uint16_t unitsize,
+		size_t slot_samples, size_t num_slots, unsigned int flush_ms,
+		struct sr_user_feed **feed);
+SR_API void *sr_user_feed_acquire(struct sr_user_feed *feed);
+SR_API int sr_user_feed_commit(struct sr_user_feed *feed, void *slot,
+		size_t samples);
+SR_API int sr_user_feed_flush(struct sr_user_feed *feed);
+SR_API uint64_t sr_user_feed_overruns(struct sr_user_feed *feed);
+SR_API int sr_user_feed_free(struct sr_user_feed *feed);
+
 /*--- hwdriver.c ------------------------------------------------------------*/
 
 SR_API struct sr_dev_driver **sr_driver_list(const struct sr_context *ctx);
@@ -105,6 +164,9 @@ SR_API int sr_driver_init(struct sr_context *ctx,
 		struct sr_dev_driver *driver);
 SR_API GArray *sr_driver_scan_options_list(const struct sr_dev_driver *driver);
 SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options);
+SR_API int sr_driver_scan_all(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, GSList *options, int timeout_ms,
+		GSList **devices);
 SR_API int sr_config_get(const struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
@@ -112,6 +174,13 @@ SR_API int sr_config_get(const struct sr_dev_driver *driver,
 SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 		const struct sr_channel_group *cg,
 		uint32_t key, GVariant *data);
+SR_API int sr_config_get_multi(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		struct sr_config *items, size_t count);
+SR_API int sr_config_set_multi(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		const struct sr_config *items, size_t count);
 SR_API int sr_config_commit(const struct sr_dev_inst *sdi);
 SR_API int sr_config_list(const struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi,
@@ -145,6 +214,8 @@ SR_API int sr_session_trigger_set(struct sr_session *session, struct sr_trigger
 SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session);
 SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 		sr_datafeed_callback cb, void *cb_data);
+SR_API int sr_session_datafeed_callback_remove(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data);
 
 /* Session control */
 SR_API int sr_session_start(struct sr_session *session);
@@ -153,11 +224,116 @@ SR_API int sr_session_stop(struct sr_session *session);
 SR_API int sr_session_is_running(struct sr_session *session);
 SR_API int sr_session_stopped_callback_set(struct sr_session *session,
 		sr_session_stopped_callback cb, void *cb_data);
+SR_API int sr_session_dispatch_async_set(struct sr_session *session,
+		size_t depth, enum sr_dispatch_policy policy);
+SR_API int sr_session_dispatch_stats_get(struct sr_session *session,
+		struct sr_dispatch_stats *stats);
+SR_API int sr_session_coalesce_set(struct sr_session *session,
+		uint64_t max_bytes, uint64_t max_latency_ms);
+SR_API int sr_session_stats_enable(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_stats_get(struct sr_session *session,
+		struct sr_session_stats **stats);
+SR_API void sr_session_stats_free(struct sr_session_stats *stats);
+SR_API int sr_session_channel_stats_enable(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_channel_stats_get(struct sr_session *session,
+		GSList **stats);
+SR_API void sr_session_channel_stats_free(GSList *stats);
+SR_API int sr_session_device_threads_set(struct sr_session *session,
+		gboolean enable);
+SR_API int sr_session_store_set(struct sr_session *session,
+		gboolean enable, size_t segment_size, const char *backing_dir);
+SR_API int sr_session_store_logic_info(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t *num_samples,
+		uint16_t *unitsize);
+SR_API int sr_session_store_logic_read(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t start, uint64_t count,
+		void *dest);
+SR_API int sr_session_store_analog_info(struct sr_session *session,
+		const struct sr_channel *ch, uint64_t *num_samples);
+SR_API int sr_session_store_analog_read(struct sr_session *session,
+		const struct sr_channel *ch, uint64_t start, uint64_t count,
+		float *dest);
+SR_API int sr_session_overview_set(struct sr_session *session,
+		gboolean enable, uint64_t block_samples);
+SR_API int sr_session_overview_logic_info(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t *num_samples,
+		uint16_t *unitsize);
+SR_API int sr_session_overview_logic(struct sr_session *session,
+		const struct sr_dev_inst *sdi, unsigned int level,
+		uint64_t first, uint64_t *count, uint8_t *changed,
+		uint8_t *values);
+SR_API int sr_session_overview_analog_info(struct sr_session *session,
+		const struct sr_channel *ch, uint64_t *num_samples);
+SR_API int sr_session_overview_analog(struct sr_session *session,
+		const struct sr_channel *ch, unsigned int level,
+		uint64_t first, uint64_t *count, float *min, float *max);
+SR_API int sr_session_frames_info(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t *first_frame,
+		uint64_t *num_frames, uint16_t *unitsize);
+SR_API int sr_session_frame_get(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t frame,
+		const uint8_t **data, uint64_t *num_samples, int64_t *trigger_pos);
 
 SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		struct sr_datafeed_packet **copy);
 SR_API void sr_packet_free(struct sr_datafeed_packet *packet);
 
+typedef void (*sr_buffer_release_callback)(void *data, void *cb_data);
+SR_API struct sr_buffer *sr_buffer_new(void *data, size_t size,
+		sr_buffer_release_callback release, void *cb_data);
+SR_API struct sr_buffer *sr_buffer_ref(struct sr_buffer *buf);
+SR_API void sr_buffer_unref(struct sr_buffer *buf);
+SR_API void *sr_buffer_data(const struct sr_buffer *buf);
+SR_API size_t sr_buffer_size(const struct sr_buffer *buf);
+SR_API struct sr_buffer *sr_packet_buffer_ref(
+		const struct sr_datafeed_packet *packet);
+
+/*--- session_file_reader.c -------------------------------------------------*/
+
+SR_API int sr_session_file_open(const char *filename,
+		struct sr_session_file **file);
+SR_API void sr_session_file_close(struct sr_session_file *file);
+SR_API int sr_session_file_probe(const char *filename,
+		struct sr_session_file_info *info);
+SR_API int sr_session_file_logic_info(struct sr_session_file *file,
+		uint64_t *num_samples, uint16_t *unitsize);
+SR_API int sr_session_file_logic_read(struct sr_session_file *file,
+		uint64_t start, uint64_t count, void *dest);
+SR_API int sr_session_file_summary_info(struct sr_session_file *file,
+		uint64_t *block_samples);
+SR_API int sr_session_file_logic_summary(struct sr_session_file *file,
+		unsigned int level, uint64_t first, uint64_t *count,
+		uint8_t *changed, uint8_t *values);
+SR_API int sr_session_file_analog_summary(struct sr_session_file *file,
+		unsigned int channel, unsigned int level, uint64_t first,
+		uint64_t *count, float *min, float *max);
+SR_API int sr_session_file_logic_next_edge(struct sr_session_file *file,
+		unsigned int channel, uint64_t start, uint64_t *offset);
+SR_API int sr_session_file_export(struct sr_session_file *file,
+		uint64_t start, uint64_t count,
+		const struct sr_output_module *omod, GHashTable *options,
+		const char *filename, sr_output_write_callback cb, void *cb_data);
+
+/*--- shm_reader.c ----------------------------------------------------------*/
+
+SR_API int sr_shm_reader_open(const char *name, struct sr_shm_reader **reader);
+SR_API void sr_shm_reader_close(struct sr_shm_reader *reader);
+SR_API int sr_shm_reader_next(struct sr_shm_reader *reader,
+		struct sr_shm_packet *packet);
+SR_API int sr_shm_reader_release(struct sr_shm_reader *reader);
+SR_API uint64_t sr_shm_reader_lost(const struct sr_shm_reader *reader);
+SR_API gboolean sr_shm_reader_active(const struct sr_shm_reader *reader);
+
+/*--- stream_server.c -------------------------------------------------------*/
+
+SR_API int sr_stream_server_new(struct sr_session *session,
+		const char *address, const char *port,
+		struct sr_stream_server **server);
+SR_API int sr_stream_server_free(struct sr_stream_server *server);
+SR_API int sr_stream_server_num_clients(struct sr_stream_server *server);
+
 /*--- input/input.c ---------------------------------------------------------*/
 
 SR_API const struct sr_input_module **sr_input_list(void);
@@ -176,6 +352,8 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in);
 SR_API const struct sr_input_module *sr_input_module_get(const struct sr_input *in);
 SR_API struct sr_dev_inst *sr_input_dev_inst_get(const struct sr_input *in);
 SR_API int sr_input_send(const struct sr_input *in, GString *buf);
+SR_API int sr_input_send_mapped(const struct sr_input *in,
+		const char *filename);
 SR_API int sr_input_end(const struct sr_input *in);
 SR_API int sr_input_reset(const struct sr_input *in);
 SR_API void sr_input_free(const struct sr_input *in);
@@ -198,8 +376,26 @@ SR_API gboolean sr_output_test_flag(const struct sr_output_module *omod,
 		uint64_t flag);
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out);
+SR_API int sr_output_send_iov(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		sr_output_write_callback cb, void *cb_data);
+SR_API int sr_output_write_samples(const struct sr_output *o,
+		const void *data, size_t length,
+		sr_output_write_callback cb, void *cb_data);
 SR_API int sr_output_free(const struct sr_output *o);
 
+/*--- output/group.c --------------------------------------------------------*/
+
+SR_API int sr_output_group_new(struct sr_output_group **group);
+SR_API int sr_output_group_add(struct sr_output_group *group,
+		const struct sr_output *o,
+		sr_output_write_callback cb, void *cb_data);
+SR_API int sr_output_group_send(struct sr_output_group *group,
+		const struct sr_datafeed_packet *packet);
+SR_API int sr_output_group_stats(struct sr_output_group *group,
+		const struct sr_output *o, struct sr_output_group_stats *stats);
+SR_API int sr_output_group_free(struct sr_output_group *group);
+
 /*--- transform/transform.c -------------------------------------------------*/
 
 SR_API const struct sr_transform_module **sr_transform_list(void);
@@ -220,6 +416,19 @@ SR_API void sr_trigger_free(struct sr_trigger *trig);
 SR_API struct sr_trigger_stage *sr_trigger_stage_add(struct sr_trigger *trig);
 SR_API int sr_trigger_match_add(struct sr_trigger_stage *stage,
 		struct sr_channel *ch, int trigger_match, float value);
+SR_API int sr_trigger_stage_repeat_set(struct sr_trigger_stage *stage,
+		uint64_t count);
+SR_API int sr_trigger_stage_window_set(struct sr_trigger_stage *stage,
+		uint64_t samples);
+
+/*--- trigger_search.c ------------------------------------------------------*/
+
+SR_API int sr_trigger_search(const struct sr_trigger *trigger,
+		const void *data, uint64_t length, unsigned int unitsize,
+		unsigned int num_threads, GArray **offsets);
+SR_API int sr_trigger_search_session(struct sr_session *session,
+		const struct sr_dev_inst *sdi, const struct sr_trigger *trigger,
+		unsigned int num_threads, GArray **offsets);
 
 /*--- serial.c --------------------------------------------------------------*/
 
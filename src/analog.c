@@ -157,38 +157,63 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
 	return SR_OK;
 }
 
-/**
- * Convert an analog datafeed payload to an array of floats.
- *
- * The caller must provide the #outbuf space for the conversion result,
- * and is expected to free allocated space after use.
- *
- * @param[in] analog The analog payload to convert. Must not be NULL.
- *                   analog->data, analog->meaning, and analog->encoding
- *                   must not be NULL.
- * @param[out] outbuf Memory where to store the result. Must not be NULL.
- *
- * @retval SR_OK Success.
- * @retval SR_ERR Unsupported encoding.
- * @retval SR_ERR_ARG Invalid argument.
- *
- * @since 0.4.0
+/*
+ * Convert all input values with the reader, apply scale and offset.
+ * Either output buffer is used, in a loop of its own for each.
  */
-SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
-		float *outbuf)
+#define CONVERT_VALUES(reader, size) do { \
+	if (outbuf) { \
+		for (i = 0; i < count; i++) { \
+			value = reader(&data8[i * (size)]); \
+			value *= scale; \
+			value += offset; \
+			outbuf[i] = value; \
+		} \
+	} else { \
+		for (i = 0; i < count; i++) { \
+			value = reader(&data8[i * (size)]); \
+			value *= scale; \
+			value += offset; \
+			outbuf_dbl[i] = value; \
+		} \
+	} \
+} while (0)
+
+/*
+ * Convert 8-bit values by looking up each of them in a table of the
+ * 256 results, which is as exact as computing them one by one.
+ */
+#define CONVERT_BYTES(reader) do { \
+	for (i = 0; i < 256; i++) { \
+		byte = i; \
+		table[i] = reader(&byte) * scale + offset; \
+	} \
+	if (outbuf) { \
+		for (i = 0; i < count; i++) \
+			outbuf[i] = table[data8[i]]; \
+	} else { \
+		for (i = 0; i < count; i++) \
+			outbuf_dbl[i] = table[data8[i]]; \
+	} \
+} while (0)
+
+/* Conversion for sr_analog_to_float() and sr_analog_to_double(). */
+static int analog_convert(const struct sr_datafeed_analog *analog,
+		float *outbuf, double *outbuf_dbl)
 {
-	size_t count;
+	size_t count, i;
 	gboolean host_bigendian;
 	gboolean input_float, input_signed, input_bigendian;
 	size_t input_unitsize;
 	double scale, offset, value;
+	double table[256];
 	const uint8_t *data8;
-	gboolean input_is_native;
+	uint8_t byte;
 	char type_text[10];
 
 	if (!analog || !analog->data || !analog->meaning || !analog->encoding)
 		return SR_ERR_ARG;
-	if (!outbuf)
+	if (!outbuf && !outbuf_dbl)
 		return SR_ERR_ARG;
 
 	count = analog->num_samples * g_slist_length(analog->meaning->channels);
@@ -228,11 +253,9 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 	 * native format. Do apply scale/offset though when applicable
 	 * on our way out.
 	 */
-	input_is_native = input_float &&
-		input_unitsize == sizeof(outbuf[0]) &&
-		input_bigendian == host_bigendian;
-	if (input_is_native) {
-		memcpy(outbuf, data8, count * sizeof(outbuf[0]));
+	if (outbuf && input_float && input_unitsize == sizeof(float) &&
+			input_bigendian == host_bigendian) {
+		memcpy(outbuf, data8, count * sizeof(float));
 		if (scale != 1.0 || offset != 0.0) {
 			while (count--) {
 				*outbuf *= scale;
@@ -242,6 +265,15 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 		}
 		return SR_OK;
 	}
+	if (outbuf_dbl && input_float && input_unitsize == sizeof(double) &&
+			input_bigendian == host_bigendian) {
+		memcpy(outbuf_dbl, data8, count * sizeof(double));
+		if (scale != 1.0 || offset != 0.0) {
+			for (i = 0; i < count; i++)
+				outbuf_dbl[i] = outbuf_dbl[i] * scale + offset;
+		}
+		return SR_OK;
+	}
 
 	/*
 	 * Accept sample values in different widths and data types and
@@ -249,135 +281,139 @@ SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
 	 * integer, in either endianess, for a set of supported widths).
 	 * Common scale/offset factors apply to all sample values.
 	 *
-	 * Do most internal calculations on double precision values.
-	 * Only trim the result data to single precision, since that's
-	 * the routine's result data type in its public API which needs
-	 * to be kept for compatibility. It remains an option for later
-	 * to add another public routine which returns double precision
-	 * result data, call sites could migrate at their own pace.
+	 * Do all internal calculations on double precision values, and
+	 * only trim the results to single precision for float output.
+	 *
+	 * The loops index the input with the unit size instead of going
+	 * through reader callbacks, so that compilers can inline the
+	 * accessors and vectorize the conversion. 8-bit values take a
+	 * table lookup, once there are enough of them to fill it.
 	 */
 	if (input_float && input_unitsize == sizeof(float)) {
-		float (*reader)(const uint8_t **p);
 		if (input_bigendian)
-			reader = read_fltbe_inc;
+			CONVERT_VALUES(read_fltbe, sizeof(float));
 		else
-			reader = read_fltle_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+			CONVERT_VALUES(read_fltle, sizeof(float));
 		return SR_OK;
 	}
 	if (input_float && input_unitsize == sizeof(double)) {
-		double (*reader)(const uint8_t **p);
 		if (input_bigendian)
-			reader = read_dblbe_inc;
+			CONVERT_VALUES(read_dblbe, sizeof(double));
 		else
-			reader = read_dblle_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+			CONVERT_VALUES(read_dblle, sizeof(double));
 		return SR_OK;
 	}
 	if (input_float) {
 		snprintf(type_text, sizeof(type_text), "%c%zu%s",
 			'f', input_unitsize * 8, input_bigendian ? "be" : "le");
-		sr_err("Unsupported type for analog-to-float conversion: %s.",
+		sr_err("Unsupported type for analog conversion: %s.",
 			type_text);
 		return SR_ERR;
 	}
 
+	if (input_unitsize == sizeof(uint8_t) && count >= 256) {
+		if (input_signed)
+			CONVERT_BYTES(read_i8);
+		else
+			CONVERT_BYTES(read_u8);
+		return SR_OK;
+	}
 	if (input_unitsize == sizeof(uint8_t) && input_signed) {
-		int8_t (*reader)(const uint8_t **p);
-		reader = read_i8_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+		CONVERT_VALUES(read_i8, sizeof(int8_t));
 		return SR_OK;
 	}
 	if (input_unitsize == sizeof(uint8_t)) {
-		uint8_t (*reader)(const uint8_t **p);
-		reader = read_u8_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+		CONVERT_VALUES(read_u8, sizeof(uint8_t));
 		return SR_OK;
 	}
 	if (input_unitsize == sizeof(uint16_t) && input_signed) {
-		int16_t (*reader)(const uint8_t **p);
 		if (input_bigendian)
-			reader = read_i16be_inc;
+			CONVERT_VALUES(read_i16be, sizeof(int16_t));
 		else
-			reader = read_i16le_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+			CONVERT_VALUES(read_i16le, sizeof(int16_t));
 		return SR_OK;
 	}
 	if (input_unitsize == sizeof(uint16_t)) {
-		uint16_t (*reader)(const uint8_t **p);
 		if (input_bigendian)
-			reader = read_u16be_inc;
+			CONVERT_VALUES(read_u16be, sizeof(uint16_t));
 		else
-			reader = read_u16le_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+			CONVERT_VALUES(read_u16le, sizeof(uint16_t));
 		return SR_OK;
 	}
 	if (input_unitsize == sizeof(uint32_t) && input_signed) {
-		int32_t (*reader)(const uint8_t **p);
 		if (input_bigendian)
-			reader = read_i32be_inc;
+			CONVERT_VALUES(read_i32be, sizeof(int32_t));
 		else
-			reader = read_i32le_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+			CONVERT_VALUES(read_i32le, sizeof(int32_t));
 		return SR_OK;
 	}
 	if (input_unitsize == sizeof(uint32_t)) {
-		uint32_t (*reader)(const uint8_t **p);
 		if (input_bigendian)
-			reader = read_u32be_inc;
+			CONVERT_VALUES(read_u32be, sizeof(uint32_t));
 		else
-			reader = read_u32le_inc;
-		while (count--) {
-			value = reader(&data8);
-			value *= scale;
-			value += offset;
-			*outbuf++ = value;
-		}
+			CONVERT_VALUES(read_u32le, sizeof(uint32_t));
 		return SR_OK;
 	}
 	snprintf(type_text, sizeof(type_text), "%c%zu%s",
 		input_float ? 'f' : input_signed ? 'i' : 'u',
 		input_unitsize * 8, input_bigendian ? "be" : "le");
-	sr_err("Unsupported type for analog-to-float conversion: %s.",
+	sr_err("Unsupported type for analog conversion: %s.",
 		type_text);
 	return SR_ERR;
 }
 
+/**
+ * Convert an analog datafeed payload to an array of floats.
+ *
+ * The caller must provide the #outbuf space for the conversion result,
+ * and is expected to free allocated space after use.
+ *
+ * @param[in] analog The analog payload to convert. Must not be NULL.
+ *                   analog->data, analog->meaning, and analog->encoding
+ *                   must not be NULL.
+ * @param[out] outbuf Memory where to store the result. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.4.0
+ */
+SR_API int sr_analog_to_float(const struct sr_datafeed_analog *analog,
+		float *outbuf)
+{
+	if (!outbuf)
+		return SR_ERR_ARG;
+
+	return analog_convert(analog, outbuf, NULL);
+}
+
+/**
+ * Convert an analog datafeed payload to an array of doubles.
+ *
+ * The same as sr_analog_to_float(), without rounding the results to
+ * single precision. Double precision input passes without loss.
+ *
+ * @param[in] analog The analog payload to convert. Must not be NULL.
+ *                   analog->data, analog->meaning, and analog->encoding
+ *                   must not be NULL.
+ * @param[out] outbuf Memory where to store the result. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR Unsupported encoding.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_analog_to_double(const struct sr_datafeed_analog *analog,
+		double *outbuf)
+{
+	if (!outbuf)
+		return SR_ERR_ARG;
+
+	return analog_convert(analog, NULL, outbuf);
+}
+
 /**
  * Scale a float value to the appropriate SI prefix.
  *
@@ -515,6 +551,34 @@ SR_API void sr_rational_set(struct sr_rational *r, int64_t p, uint64_t q)
 	r->q = q;
 }
 
+/**
+ * Set sr_rational r to a decimal approximation of a floating point value.
+ *
+ * The denominator is the largest power of ten up to 10^15 which keeps
+ * the numerator within the exact range of a double, so that scale and
+ * offset factors which devices report as floats survive the round trip.
+ *
+ * @param[out] r Rational number struct to set. Must not be NULL.
+ * @param[in] value The value to approximate.
+ *
+ * @private
+ */
+SR_PRIV void sr_rational_from_double(struct sr_rational *r, double value)
+{
+	uint64_t q;
+
+	if (!r)
+		return;
+
+	q = 1;
+	while (q < UINT64_C(1000000000000000) &&
+			fabs(value) * q * 10 < (double)(UINT64_C(1) << 53))
+		q *= 10;
+
+	r->p = (int64_t)llround(value * q);
+	r->q = q;
+}
+
 #ifndef HAVE___INT128_T
 struct sr_int128_t {
 	int64_t high;
@@ -560,6 +624,67 @@ static void mult_uint64(struct sr_uint128_t *res, const uint64_t a,
 }
 #endif
 
+static uint64_t gcd_uint64(uint64_t a, uint64_t b)
+{
+	uint64_t t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/* Divide out the common factors of x and y. */
+static void reduce_uint64(uint64_t *x, uint64_t *y)
+{
+	uint64_t g;
+
+	g = gcd_uint64(*x, *y);
+	if (g > 1) {
+		*x /= g;
+		*y /= g;
+	}
+}
+
+/*
+ * Multiply two sr_rational whose product doesn't fit as it is. Any
+ * factor both the numerator and the denominator of the product have
+ * comes from one of the four terms, so reducing each numerator against
+ * each denominator leaves the product in lowest terms. Only then it
+ * doesn't fit at all.
+ */
+static int mult_reduced(struct sr_rational *res, const struct sr_rational *a,
+	const struct sr_rational *b)
+{
+	uint64_t pa, qa, pb, qb, p_max;
+	gboolean negative;
+
+	negative = (a->p < 0) != (b->p < 0);
+	pa = (a->p < 0) ? -(uint64_t)a->p : (uint64_t)a->p;
+	pb = (b->p < 0) ? -(uint64_t)b->p : (uint64_t)b->p;
+	qa = a->q;
+	qb = b->q;
+
+	reduce_uint64(&pa, &qa);
+	reduce_uint64(&pb, &qb);
+	reduce_uint64(&pa, &qb);
+	reduce_uint64(&pb, &qa);
+
+	p_max = negative ? (uint64_t)INT64_MAX + 1 : INT64_MAX;
+	if (pa && pb > p_max / pa)
+		return SR_ERR_ARG;
+	if (qa && qb > UINT64_MAX / qa)
+		return SR_ERR_ARG;
+
+	res->p = negative ? (int64_t)(0 - pa * pb) : (int64_t)(pa * pb);
+	res->q = qa * qb;
+
+	return SR_OK;
+}
+
 /**
  * Compare two sr_rational for equality.
  *
@@ -597,9 +722,9 @@ SR_API int sr_rational_eq(const struct sr_rational *a, const struct sr_rational
 /**
  * Multiply two sr_rational.
  *
- * The resulting nominator/denominator are reduced if the result would not fit
- * otherwise. If the resulting nominator/denominator are relatively prime,
- * this may not be possible.
+ * The resulting nominator/denominator are reduced to lowest terms if the
+ * result would not fit otherwise. If it doesn't fit in lowest terms either,
+ * SR_ERR_ARG is returned.
  *
  * It is safe to use the same variable for result and input values.
  *
@@ -622,17 +747,8 @@ SR_API int sr_rational_mult(struct sr_rational *res, const struct sr_rational *a
 	p = (__int128_t)(a->p) * (__int128_t)(b->p);
 	q = (__uint128_t)(a->q) * (__uint128_t)(b->q);
 
-	if ((p > INT64_MAX) || (p < INT64_MIN) || (q > UINT64_MAX)) {
-		while (!((p & 1) || (q & 1))) {
-			p /= 2;
-			q /= 2;
-		}
-	}
-
-	if ((p > INT64_MAX) || (p < INT64_MIN) || (q > UINT64_MAX)) {
-		// TODO: determine gcd to do further reduction
-		return SR_ERR_ARG;
-	}
+	if ((p > INT64_MAX) || (p < INT64_MIN) || (q > UINT64_MAX))
+		return mult_reduced(res, a, b);
 
 	res->p = (int64_t)p;
 	res->q = (uint64_t)q;
@@ -646,23 +762,9 @@ SR_API int sr_rational_mult(struct sr_rational *res, const struct sr_rational *a
 	mult_int64(&p, a->p, b->p);
 	mult_uint64(&q, a->q, b->q);
 
-	while (!(p.low & 1) && !(q.low & 1)) {
-		p.low /= 2;
-		if (p.high & 1)
-			p.low |= (1ll << 63);
-		p.high >>= 1;
-		q.low /= 2;
-		if (q.high & 1)
-			q.low |= (1ll << 63);
-		q.high >>= 1;
-	}
-
-	if (q.high)
-		return SR_ERR_ARG;
-	if ((p.high >= 0) && (p.low > INT64_MAX))
-		return SR_ERR_ARG;
-	if (p.high < -1)
-		return SR_ERR_ARG;
+	/* The product fits if the high half only repeats the sign bit. */
+	if (q.high || p.high != ((p.low > INT64_MAX) ? -1 : 0))
+		return mult_reduced(res, a, b);
 
 	res->p = (int64_t)p.low;
 	res->q = q.low;
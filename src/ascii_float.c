@@ -0,0 +1,205 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/* Powers of ten which doubles hold exactly. */
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Convert plain decimal text like "-12.345e-3" without the C library.
+ *
+ * Only takes numbers which convert exactly: significant digits which
+ * fit 53 bits, and a power of ten which a double holds exactly. One
+ * multiplication or division then rounds the same way strtod() does.
+ * Anything else, including white space, "inf", "nan" and hex, is left
+ * to g_ascii_strtod().
+ *
+ * @param[in] p The text to convert. Must not be NULL.
+ * @param[in] end The end of the text.
+ * @param[out] ret The value. Must not be NULL.
+ *
+ * @return Where the number ends, or NULL when it takes g_ascii_strtod().
+ *
+ * @private
+ */
+SR_PRIV const char *sr_scan_decimal(const char *p, const char *end,
+		double *ret)
+{
+	const char *digits;
+	uint64_t mant;
+	int ndigits, scale, exp, exp_sign;
+	gboolean neg;
+
+	neg = FALSE;
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+
+	/* Leading zeros don't count, digits past the 19th don't fit. */
+	mant = 0;
+	ndigits = scale = 0;
+	digits = p;
+	while (p < end && g_ascii_isdigit(*p)) {
+		if (ndigits < 19 && (mant || *p != '0')) {
+			mant = mant * 10 + (*p - '0');
+			ndigits++;
+		} else if (mant) {
+			scale++;
+		}
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && g_ascii_isdigit(*p)) {
+			if (ndigits < 19 && (mant || *p != '0')) {
+				mant = mant * 10 + (*p - '0');
+				ndigits++;
+				scale--;
+			} else if (!mant) {
+				scale--;
+			}
+			p++;
+		}
+	}
+	if (p == digits || (p == digits + 1 && *digits == '.'))
+		return NULL;
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		exp_sign = 1;
+		if (p < end && (*p == '-' || *p == '+'))
+			exp_sign = *p++ == '-' ? -1 : 1;
+		if (p == end || !g_ascii_isdigit(*p))
+			return NULL;
+		exp = 0;
+		while (p < end && g_ascii_isdigit(*p)) {
+			if (exp < 10000)
+				exp = exp * 10 + (*p - '0');
+			p++;
+		}
+		scale += exp_sign * exp;
+	}
+
+	/* Zero is exact with any exponent. */
+	if (!mant)
+		scale = 0;
+	if (mant > (UINT64_C(1) << 53) || scale < -22 || scale > 22)
+		return NULL;
+	*ret = scale < 0 ? (double)mant / exact_pow10[-scale] :
+		(double)mant * exact_pow10[scale];
+	if (neg)
+		*ret = -*ret;
+
+	return p;
+}
+
+/*
+ * Scan one number of a list, up to the next separator or white space.
+ * Returns where the number ends, or NULL.
+ */
+static const char *scan_float(const char *p, const char *end, char sep,
+		double *ret)
+{
+	const char *start, *next;
+	char buf[G_ASCII_DTOSTR_BUF_SIZE], *text, *endptr;
+	size_t len;
+
+	next = sr_scan_decimal(p, end, ret);
+	if (next && (next == end || g_ascii_isspace(*next) || *next == sep))
+		return next;
+
+	/* The token needs to be NUL terminated for strtod. */
+	start = p;
+	while (p < end && !g_ascii_isspace(*p) && *p != sep)
+		p++;
+	len = p - start;
+	text = len < sizeof(buf) ? buf : g_malloc(len + 1);
+	memcpy(text, start, len);
+	text[len] = '\0';
+	errno = 0;
+	*ret = g_ascii_strtod(text, &endptr);
+	next = endptr == text || errno ? NULL : start + (endptr - text);
+	if (text != buf)
+		g_free(text);
+
+	return next;
+}
+
+/**
+ * Convert a list of numbers to floats, such as SCPI instruments send.
+ *
+ * The numbers are separated by sep and optional white space, a single
+ * separator after the last one is accepted. Like sr_atof_ascii() this
+ * ignores the locale. Nothing is allocated, the values are written to
+ * the caller's buffer. Counting the separators gives its size.
+ *
+ * @param[in] str The text to convert. Must not be NULL.
+ * @param[in] len The length of the text.
+ * @param[in] sep The separator.
+ * @param[out] values Where to store the values. Must not be NULL.
+ * @param[in] max_count The number of values which fit.
+ * @param[out] count The number of values converted. Must not be NULL.
+ *
+ * @retval SR_OK Conversion successful.
+ * @retval SR_ERR_DATA Text which is not a number, count has the values
+ *                     before it.
+ * @retval SR_ERR More than max_count values.
+ *
+ * @private
+ */
+SR_PRIV int sr_atof_ascii_list(const char *str, size_t len, char sep,
+	float *values, size_t max_count, size_t *count)
+{
+	const char *p, *end, *next;
+	double value;
+	size_t n;
+
+	p = str;
+	end = str + len;
+	n = 0;
+	*count = 0;
+	while (TRUE) {
+		while (p < end && g_ascii_isspace(*p))
+			p++;
+		/* Nothing at all, or a separator after the last value. */
+		if (p == end)
+			break;
+		if (n == max_count)
+			return SR_ERR;
+		if (!(next = scan_float(p, end, sep, &value)))
+			return SR_ERR_DATA;
+		values[n++] = value;
+		*count = n;
+		p = next;
+		while (p < end && g_ascii_isspace(*p))
+			p++;
+		if (p == end)
+			break;
+		if (*p++ != sep)
+			return SR_ERR_DATA;
+	}
+
+	return SR_OK;
+}
@@ -25,6 +25,7 @@
 #endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
+#include "cpu_features.h"
 #include "minilzo/minilzo.h"
 
 /** @cond PRIVATE */
@@ -143,6 +144,12 @@ SR_API GSList *sr_buildinfo_libs_get(void)
 	l = g_slist_append(l, m);
 #endif
 
+#ifdef HAVE_LIBZSTD
+	m = g_slist_append(NULL, g_strdup("libzstd"));
+	m = g_slist_append(m, g_strdup_printf("%s", CONF_LIBZSTD_VERSION));
+	l = g_slist_append(l, m);
+#endif
+
 	m = g_slist_append(NULL, g_strdup("libzip"));
 	m = g_slist_append(m, g_strdup_printf("%s", CONF_LIBZIP_VERSION));
 	l = g_slist_append(l, m);
@@ -279,6 +286,10 @@ static void print_versions(void)
 	str = sr_buildinfo_scpi_backends_get();
 	sr_dbg("SCPI backends: %s.", str);
 	g_free(str);
+
+	str = sr_cpu_features_to_string(sr_cpu_features());
+	sr_dbg("CPU features: %s.", str);
+	g_free(str);
 }
 
 static void print_resourcepaths(void)
@@ -574,6 +585,14 @@ SR_API int sr_init(struct sr_context **ctx)
 	}
 
 	context = g_malloc0(sizeof(struct sr_context));
+	g_mutex_init(&context->scan_mutex);
+	g_cond_init(&context->scan_cond);
+	g_mutex_init(&context->resource_mutex);
+	g_mutex_init(&context->mem_mutex);
+	context->busy_resources = g_hash_table_new_full(g_str_hash,
+		g_str_equal, g_free, NULL);
+	context->scan_idle = g_hash_table_new_full(g_str_hash,
+		g_str_equal, g_free, NULL);
 
 	sr_drivers_init(context);
 
@@ -620,6 +639,8 @@ SR_API int sr_init(struct sr_context **ctx)
 		ret = SR_ERR;
 		goto done;
 	}
+	sr_usb_capture_init(context);
+	sr_usb_cache_init(context);
 #endif
 #ifdef HAVE_LIBHIDAPI
 	/*
@@ -637,11 +658,23 @@ SR_API int sr_init(struct sr_context **ctx)
 #endif
 	sr_resource_set_hooks(context, NULL, NULL, NULL, NULL);
 
+	/* Keep logging off the time critical paths, for debugging them. */
+	if (g_getenv("SIGROK_LOG_ASYNC") && sr_log_async_start(0) == SR_OK)
+		context->log_async = TRUE;
+
 	*ctx = context;
 	context = NULL;
 	ret = SR_OK;
 
 done:
+	if (context) {
+		g_hash_table_destroy(context->busy_resources);
+		g_hash_table_destroy(context->scan_idle);
+		g_cond_clear(&context->scan_cond);
+		g_mutex_clear(&context->scan_mutex);
+		g_mutex_clear(&context->resource_mutex);
+		g_mutex_clear(&context->mem_mutex);
+	}
 	g_free(context);
 	return ret;
 }
@@ -663,7 +696,13 @@ SR_API int sr_exit(struct sr_context *ctx)
 		return SR_ERR;
 	}
 
+#ifdef HAVE_LIBUSB_1_0
+	sr_usb_event_thread_stop(ctx);
+#endif
 	sr_hw_cleanup_all(ctx);
+#ifdef HAVE_LIBUSB_1_0
+	sr_usb_capture_exit(ctx);
+#endif
 
 #ifdef _WIN32
 	WSACleanup();
@@ -673,10 +712,24 @@ SR_API int sr_exit(struct sr_context *ctx)
 	hid_exit();
 #endif
 #ifdef HAVE_LIBUSB_1_0
+	sr_usb_cache_exit(ctx);
 	libusb_exit(ctx->libusb_ctx);
 #endif
 
 	g_free(sr_driver_list(ctx));
+	g_hash_table_destroy(ctx->busy_resources);
+	g_hash_table_destroy(ctx->scan_idle);
+	g_free(ctx->scan_fingerprint);
+	g_cond_clear(&ctx->scan_cond);
+	g_mutex_clear(&ctx->scan_mutex);
+	sr_resource_cache_clear(ctx);
+	g_mutex_clear(&ctx->resource_mutex);
+	if (ctx->mem.used)
+		sr_warn("%" PRIu64 " bytes of acquisition buffers not released.",
+			ctx->mem.used);
+	g_mutex_clear(&ctx->mem_mutex);
+	if (ctx->log_async)
+		sr_log_async_stop();
 	g_free(ctx);
 
 	return SR_OK;
@@ -97,6 +97,14 @@
 #define CONNECT_RFCOMM_TRIES	3
 #define CONNECT_RFCOMM_RETRY_MS	100
 
+/* ATT MTU to ask for when the caller did not specify one. */
+#define MTU_EXCHANGE_DEFAULT	247
+/* Most messages and bytes to gather per notification check. */
+#define NOTIFY_BATCH_MESSAGES	64
+#define NOTIFY_BATCH_BYTES	4096
+/* Connection parameter update command timeout. */
+#define CONN_UPDATE_TIMEOUT_MS	1000
+
 /* {{{ compat decls */
 /*
  * The availability of conversion helpers in <bluetooth/bluetooth.h>
@@ -238,10 +246,15 @@ struct sr_bt_desc {
 	uint16_t cccd_handle;
 	uint16_t cccd_value;
 	uint16_t ble_mtu;
+	uint16_t conn_interval;
+	gboolean mtu_exchange;
+	gboolean batch;
 	/* Internal state. */
 	int devid;
 	int fd;
 	struct hci_filter orig_filter;
+	uint16_t att_mtu;
+	GByteArray *rx_batch;
 };
 
 static int sr_bt_desc_open(struct sr_bt_desc *desc, int *id_ref);
@@ -265,6 +278,7 @@ SR_PRIV struct sr_bt_desc *sr_bt_desc_new(void)
 
 	desc->devid = -1;
 	desc->fd = -1;
+	desc->rx_batch = g_byte_array_new();
 
 	return desc;
 }
@@ -275,6 +289,7 @@ SR_PRIV void sr_bt_desc_free(struct sr_bt_desc *desc)
 		return;
 
 	sr_bt_desc_close(desc);
+	g_byte_array_free(desc->rx_batch, TRUE);
 	g_free(desc);
 }
 
@@ -378,6 +393,28 @@ SR_PRIV int sr_bt_config_notify(struct sr_bt_desc *desc,
 	return 0;
 }
 
+/*
+ * Tune a BLE connection for throughput. A connection interval other
+ * than zero (in units of 1.25ms) gets requested after connecting. With
+ * mtu_exchange the central asks for a larger ATT MTU, ble_mtu or else
+ * a default, instead of only answering the peripheral's request. With
+ * batch the notifications which are pending at a check are passed to
+ * the data callback in one call, which suits byte streams but not
+ * callers which take each notification as a message of its own.
+ */
+SR_PRIV int sr_bt_config_throughput(struct sr_bt_desc *desc,
+	uint16_t conn_interval, gboolean mtu_exchange, gboolean batch)
+{
+	if (!desc)
+		return -1;
+
+	desc->conn_interval = conn_interval;
+	desc->mtu_exchange = mtu_exchange;
+	desc->batch = batch;
+
+	return 0;
+}
+
 static int sr_bt_desc_open(struct sr_bt_desc *desc, int *id_ref)
 {
 	int id, sock;
@@ -656,6 +693,64 @@ SR_PRIV int sr_bt_scan_bt(struct sr_bt_desc *desc, int duration)
 /* }}} scan */
 /* {{{ connect/disconnect */
 
+/* Ask the controller for the configured connection interval. */
+static void sr_bt_update_conn_params(struct sr_bt_desc *desc)
+{
+	struct l2cap_conninfo info;
+	socklen_t len;
+	bdaddr_t mac;
+	int id, dd, ret;
+	uint16_t timeout;
+
+	len = sizeof(info);
+	memset(&info, 0, sizeof(info));
+	if (getsockopt(desc->fd, SOL_L2CAP, L2CAP_CONNINFO, &info, &len) < 0) {
+		sr_warn("Cannot get the BLE connection handle: %s.",
+			g_strerror(errno));
+		return;
+	}
+	if (desc->local_addr[0]) {
+		id = hci_devid(desc->local_addr);
+	} else {
+		str2ba(desc->remote_addr, &mac);
+		id = hci_get_route(&mac);
+	}
+	if (id < 0 || (dd = hci_open_dev(id)) < 0) {
+		sr_warn("Cannot open the HCI device.");
+		return;
+	}
+
+	/* Supervision timeout in 10ms units, some intervals at least. */
+	timeout = MAX(400, desc->conn_interval / 2);
+	ret = hci_le_conn_update(dd, info.hci_handle,
+		desc->conn_interval, desc->conn_interval, 0, timeout,
+		CONN_UPDATE_TIMEOUT_MS);
+	if (ret < 0)
+		sr_warn("Connection interval update failed: %s.",
+			g_strerror(errno));
+	else
+		sr_dbg("Requested connection interval %u.",
+			desc->conn_interval);
+	hci_close_dev(dd);
+}
+
+/* Apply the sr_bt_config_throughput() settings to a new connection. */
+static void sr_bt_tune_ble(struct sr_bt_desc *desc)
+{
+	uint16_t mtu;
+
+	desc->att_mtu = 0;
+	if (desc->conn_interval)
+		sr_bt_update_conn_params(desc);
+	if (desc->mtu_exchange) {
+		mtu = desc->ble_mtu ? desc->ble_mtu : MTU_EXCHANGE_DEFAULT;
+		sr_dbg("MTU exchange request, central value %" PRIu16, mtu);
+		if (sr_bt_write_type_handle(desc,
+				BLE_ATT_EXCHANGE_MTU_REQ, mtu) < 0)
+			sr_warn("Cannot send the MTU exchange request.");
+	}
+}
+
 SR_PRIV int sr_bt_connect_ble(struct sr_bt_desc *desc)
 {
 	struct sockaddr_l2 sl2;
@@ -782,6 +877,7 @@ SR_PRIV int sr_bt_connect_ble(struct sr_bt_desc *desc)
 		perror("connect");
 		return ret;
 	}
+	sr_bt_tune_ble(desc);
 
 	return 0;
 }
@@ -897,10 +993,25 @@ SR_PRIV int sr_bt_start_notify(struct sr_bt_desc *desc)
 	return 0;
 }
 
-SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
+/* Pass received notification data on, or keep it for a batch. */
+static int sr_bt_deliver(struct sr_bt_desc *desc,
+	uint8_t *data, size_t dlen)
+{
+	if (!desc->data_cb)
+		return 0;
+	if (desc->batch) {
+		if (data && dlen)
+			g_byte_array_append(desc->rx_batch, data, dlen);
+		return 0;
+	}
+
+	return desc->data_cb(desc->data_cb_data, data, dlen);
+}
+
+/* Handle one message which was read from the Bluetooth socket. */
+static int sr_bt_handle_message(struct sr_bt_desc *desc,
+	uint8_t *buf, size_t rdlen)
 {
-	uint8_t buf[1024];
-	ssize_t rdlen;
 	const uint8_t *bufptr;
 	size_t buflen;
 	uint8_t packet_type;
@@ -911,34 +1022,12 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 	int ret;
 	uint16_t mtu;
 
-	if (!desc)
-		return -1;
-
-	if (sr_bt_check_socket_usable(desc) < 0)
-		return -2;
-
-	/*
-	 * Get another message from the Bluetooth socket.
-	 *
-	 * TODO Can we assume that every "message" comes in a separate
-	 * read(2) call, or can data combine at the caller's? Need we
-	 * loop over the received content until all was consumed?
-	 */
-	rdlen = sr_bt_read(desc, buf, sizeof(buf));
-	if (rdlen < 0) {
-		sr_dbg("check notifiy, read error, %zd", rdlen);
-		return -2;
-	}
-	if (!rdlen) {
-		if (0) sr_spew("check notifiy, empty read");
-		return 0;
-	}
 	bufptr = &buf[0];
-	buflen = (size_t)rdlen;
+	buflen = rdlen;
 	if (sr_log_loglevel_get() >= SR_LOG_SPEW) {
 		GString *txt;
 		txt = sr_hexdump_new(bufptr, buflen);
-		sr_spew("check notifiy, read succes, length %zd, data: %s",
+		sr_spew("check notifiy, read succes, length %zu, data: %s",
 			rdlen, txt->str);
 		sr_hexdump_free(txt);
 	}
@@ -984,6 +1073,18 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 		}
 		sr_warn("Unhandled BLE %s.", type_text);
 		break;
+	case BLE_ATT_EXCHANGE_MTU_RESP:
+		type_text = "MTU exchange response";
+		if (buflen < sizeof(uint16_t)) {
+			sr_dbg("%s, invalid (size)", type_text);
+			break;
+		}
+		mtu = read_u16le_inc_len(&bufptr, &buflen);
+		desc->att_mtu = MIN(mtu, desc->ble_mtu ?
+			desc->ble_mtu : MTU_EXCHANGE_DEFAULT);
+		sr_dbg("%s, peripheral value %" PRIu16 ", using %" PRIu16,
+			type_text, mtu, desc->att_mtu);
+		break;
 	case BLE_ATT_ERROR_RESP:
 		type_text = "error response";
 		if (!buflen) {
@@ -1004,10 +1105,7 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 		sr_spew("%s, confirmation sent", type_text);
 		if (packet_handle != desc->read_handle)
 			return -4;
-		if (!desc->data_cb)
-			return 0;
-		ret = desc->data_cb(desc->data_cb_data,
-			packet_data, packet_dlen);
+		ret = sr_bt_deliver(desc, packet_data, packet_dlen);
 		sr_spew("%s, data cb ret %d", type_text, ret);
 		return ret;
 	case BLE_ATT_HANDLE_NOTIFICATION:
@@ -1015,10 +1113,7 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 		sr_dbg("%s, data len %zu", type_text, packet_dlen);
 		if (packet_handle != desc->read_handle)
 			return -4;
-		if (!desc->data_cb)
-			return 0;
-		ret = desc->data_cb(desc->data_cb_data,
-			packet_data, packet_dlen);
+		ret = sr_bt_deliver(desc, packet_data, packet_dlen);
 		sr_spew("%s, data cb ret %d", type_text, ret);
 		return ret;
 	default:
@@ -1030,6 +1125,57 @@ SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
 	return 0;
 }
 
+SR_PRIV int sr_bt_check_notify(struct sr_bt_desc *desc)
+{
+	uint8_t buf[1024];
+	ssize_t rdlen;
+	size_t count;
+	int ret, cb_ret;
+
+	if (!desc)
+		return -1;
+
+	if (sr_bt_check_socket_usable(desc) < 0)
+		return -2;
+
+	/*
+	 * Get the messages which are pending on the Bluetooth socket,
+	 * each read(2) call returns one of them. Without batching, only
+	 * take one. With batching, pass the payload of all notifications
+	 * which were received to the data callback at once, that's one
+	 * callback and one wakeup of the RX path for many of them.
+	 */
+	ret = 0;
+	for (count = 0; count < NOTIFY_BATCH_MESSAGES; count++) {
+		rdlen = sr_bt_read(desc, buf, sizeof(buf));
+		if (rdlen < 0) {
+			sr_dbg("check notifiy, read error, %zd", rdlen);
+			ret = -2;
+			break;
+		}
+		if (!rdlen) {
+			if (0) sr_spew("check notifiy, empty read");
+			break;
+		}
+		ret = sr_bt_handle_message(desc, buf, rdlen);
+		if (ret < 0 || !desc->batch)
+			break;
+		if (desc->rx_batch->len >= NOTIFY_BATCH_BYTES)
+			break;
+	}
+
+	if (desc->rx_batch->len) {
+		sr_spew("check notify, batch of %u bytes", desc->rx_batch->len);
+		cb_ret = desc->data_cb(desc->data_cb_data,
+			desc->rx_batch->data, desc->rx_batch->len);
+		g_byte_array_set_size(desc->rx_batch, 0);
+		if (ret >= 0)
+			ret = cb_ret;
+	}
+
+	return ret;
+}
+
 /* }}} indication/notification */
 /* {{{ read/write */
 
@@ -23,13 +23,193 @@
  * Conversion helper functions.
  */
 
+#include <config.h>
+#include <math.h>
+#include <string.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
+#include "transpose.h"
 
 /** @cond PRIVATE */
 #define LOG_PREFIX "conv"
 /** @endcond */
 
+/* Values converted at once on the stack, a multiple of 8. */
+#define CHUNK_SAMPLES 1024
+
+/*
+ * Get values start to start + n of a packet's sole channel as floats,
+ * the way sr_analog_to_float() converts them. Points into the packet
+ * where its data already is such, or else converts into buf.
+ */
+static void sub_analog(const struct sr_datafeed_analog *analog,
+		uint64_t start, uint64_t n, struct sr_datafeed_analog *chunk,
+		struct sr_analog_meaning *meaning, GSList *channel)
+{
+	*chunk = *analog;
+	*meaning = *analog->meaning;
+	channel->data = NULL;
+	channel->next = NULL;
+	meaning->channels = channel;
+	chunk->meaning = meaning;
+	chunk->data = (uint8_t *)analog->data + start * analog->encoding->unitsize;
+	chunk->num_samples = n;
+}
+
+static const float *get_values(const struct sr_datafeed_analog *analog,
+		uint64_t start, uint64_t n, float *buf)
+{
+	const struct sr_analog_encoding *enc;
+	struct sr_datafeed_analog chunk;
+	struct sr_analog_meaning meaning;
+	GSList channel;
+	gboolean host_bigendian;
+
+#ifdef WORDS_BIGENDIAN
+	host_bigendian = TRUE;
+#else
+	host_bigendian = FALSE;
+#endif
+	enc = analog->encoding;
+	if (enc->is_float && enc->unitsize == sizeof(float) &&
+			enc->is_bigendian == host_bigendian &&
+			enc->scale.p == (int64_t)enc->scale.q && enc->offset.p == 0)
+		return (const float *)analog->data + start;
+
+	sub_analog(analog, start, n, &chunk, &meaning, &channel);
+	if (sr_analog_to_float(&chunk, buf) != SR_OK)
+		return NULL;
+
+	return buf;
+}
+
+/* The value a raw integer converts to, as in sr_analog_to_float(). */
+static float raw_value(double scale, double offset, int64_t raw)
+{
+	double value;
+
+	value = raw;
+	value *= scale;
+	value += offset;
+
+	return value;
+}
+
+/*
+ * For 8-bit and 16-bit integer encodings which grow with the raw value,
+ * get the range of raw values. These can be compared with thresholds
+ * moved into the raw domain, without converting each value.
+ */
+static gboolean raw_range(const struct sr_analog_encoding *enc,
+		int64_t *min, int64_t *max)
+{
+	if (enc->is_float || enc->scale.p <= 0)
+		return FALSE;
+	if (enc->unitsize != sizeof(uint8_t) && enc->unitsize != sizeof(uint16_t))
+		return FALSE;
+
+	*max = (INT64_C(1) << (enc->unitsize * 8 - (enc->is_signed ? 1 : 0))) - 1;
+	*min = enc->is_signed ? -*max - 1 : 0;
+
+	return TRUE;
+}
+
+/*
+ * Find the smallest raw value which converts to at least the threshold,
+ * or above it if strict, or max + 1 if there is none. Conversion rounds
+ * to floats, so this searches for where the results compare as wanted
+ * instead of computing the bound.
+ */
+static int64_t raw_bound(const struct sr_analog_encoding *enc, int64_t min,
+		int64_t max, float thr, gboolean strict)
+{
+	double scale, offset;
+	int64_t lo, hi, mid;
+	float v;
+
+	offset = enc->offset.p;
+	offset /= enc->offset.q;
+	scale = enc->scale.p;
+	scale /= enc->scale.q;
+
+	lo = min;
+	hi = max + 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		v = raw_value(scale, offset, mid);
+		if (strict ? v > thr : v >= thr)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+/* Pack the comparison of n raw values with a bound into bits. */
+#define THRESHOLD_BITS(reader, size) do { \
+	for (i = 0; i + 8 <= count; i += 8) { \
+		bits = 0; \
+		for (j = 0; j < 8; j++) \
+			bits |= (reader(&data8[(i + j) * (size)]) >= bound) << j; \
+		output[i / 8] = bits; \
+	} \
+	if (i < count) { \
+		bits = 0; \
+		for (j = 0; i + j < count; j++) \
+			bits |= (reader(&data8[(i + j) * (size)]) >= bound) << j; \
+		output[i / 8] = bits; \
+	} \
+} while (0)
+
+/* Run the Schmitt trigger on raw values, into bits. */
+#define SCHMITT_BITS(reader, size) do { \
+	for (i = 0; i < count; i += 8) { \
+		bits = 0; \
+		for (j = 0; j < 8 && i + j < count; j++) { \
+			raw = reader(&data8[(i + j) * (size)]); \
+			s = (raw >= bound_lo) & ((raw >= bound_hi) | s); \
+			bits |= s << j; \
+		} \
+		output[i / 8] = bits; \
+	} \
+} while (0)
+
+static void threshold_values_bits(const float *input, float threshold,
+		uint8_t *output, uint64_t count)
+{
+	uint64_t i, j;
+	uint8_t bits;
+
+	for (i = 0; i < count; i += 8) {
+		bits = 0;
+		for (j = 0; j < 8 && i + j < count; j++)
+			bits |= (input[i + j] >= threshold) << j;
+		output[i / 8] = bits;
+	}
+}
+
+static uint8_t schmitt_values_bits(const float *input, float lo_thr,
+		float hi_thr, uint8_t state, uint8_t *output, uint64_t count)
+{
+	uint64_t i, j;
+	uint8_t bits, s;
+	float v;
+
+	s = state;
+	for (i = 0; i < count; i += 8) {
+		bits = 0;
+		for (j = 0; j < 8 && i + j < count; j++) {
+			v = input[i + j];
+			s = ((v > hi_thr) | s) & !(v < lo_thr);
+			bits |= s << j;
+		}
+		output[i / 8] = bits;
+	}
+
+	return s;
+}
+
 /**
  * Convert analog values to logic values by using a fixed threshold.
  *
@@ -44,22 +224,92 @@
 SR_API int sr_a2l_threshold(const struct sr_datafeed_analog *analog,
 		float threshold, uint8_t *output, uint64_t count)
 {
-	float *input;
+	const float *input;
+	float buf[CHUNK_SAMPLES];
+	uint64_t i, start, n;
+
+	if (analog->encoding->is_float) {
+		input = analog->data;
+		for (i = 0; i < count; i++)
+			output[i] = (input[i] >= threshold) ? 1 : 0;
+		return SR_OK;
+	}
 
-	if (!analog->encoding->is_float) {
-		input = g_try_malloc(sizeof(float) * count);
+	for (start = 0; start < count; start += n) {
+		n = MIN(count - start, CHUNK_SAMPLES);
+		input = get_values(analog, start, n, buf);
 		if (!input)
 			return SR_ERR;
+		for (i = 0; i < n; i++)
+			output[start + i] = (input[i] >= threshold) ? 1 : 0;
+	}
 
-		sr_analog_to_float(analog, input);
-	} else
-		input = analog->data;
+	return SR_OK;
+}
+
+/**
+ * Convert analog values to logic values by using a fixed threshold, into
+ * packed bits.
+ *
+ * Unlike sr_a2l_threshold(), the values are taken with the scale and
+ * offset of their encoding, as sr_analog_to_float() gives them. 8-bit and
+ * 16-bit integer values are compared with the threshold as it is in
+ * their raw form, which gives the same results without converting them.
+ *
+ * @param[in] analog The analog input values, of a single channel.
+ * @param[in] threshold The threshold to use.
+ * @param[out] output Bit n % 8 of byte n / 8 is set when value n is at
+ *                    or above the threshold. Must provide space for
+ *                    (count + 7) / 8 bytes.
+ * @param[in] count The number of samples to process.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Unsupported encoding.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_threshold_bits(const struct sr_datafeed_analog *analog,
+		float threshold, uint8_t *output, uint64_t count)
+{
+	const struct sr_analog_encoding *enc;
+	const uint8_t *data8;
+	const float *input;
+	float buf[CHUNK_SAMPLES];
+	int64_t min, max, bound;
+	uint64_t i, j, start, n;
+	uint8_t bits;
 
-	for (uint64_t i = 0; i < count; i++)
-		output[i] = (input[i] >= threshold) ? 1 : 0;
+	if (!analog || !analog->data || !analog->encoding ||
+			!analog->meaning || !output)
+		return SR_ERR_ARG;
+	enc = analog->encoding;
+	data8 = analog->data;
 
-	if (!analog->encoding->is_float)
-		g_free(input);
+	if (!isnan(threshold) && raw_range(enc, &min, &max)) {
+		bound = raw_bound(enc, min, max, threshold, FALSE);
+		if (enc->unitsize == 1 && enc->is_signed)
+			THRESHOLD_BITS(read_i8, 1);
+		else if (enc->unitsize == 1)
+			THRESHOLD_BITS(read_u8, 1);
+		else if (enc->is_signed && enc->is_bigendian)
+			THRESHOLD_BITS(read_i16be, 2);
+		else if (enc->is_signed)
+			THRESHOLD_BITS(read_i16le, 2);
+		else if (enc->is_bigendian)
+			THRESHOLD_BITS(read_u16be, 2);
+		else
+			THRESHOLD_BITS(read_u16le, 2);
+		return SR_OK;
+	}
+
+	for (start = 0; start < count; start += n) {
+		n = MIN(count - start, CHUNK_SAMPLES);
+		input = get_values(analog, start, n, buf);
+		if (!input)
+			return SR_ERR;
+		threshold_values_bits(input, threshold, output + start / 8, n);
+	}
 
 	return SR_OK;
 }
@@ -82,28 +332,898 @@ SR_API int sr_a2l_schmitt_trigger(const struct sr_datafeed_analog *analog,
 		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
 		uint64_t count)
 {
-	float *input;
+	const float *input;
+	float buf[CHUNK_SAMPLES];
+	uint64_t i, start, n;
 
-	if (!analog->encoding->is_float) {
-		input = g_try_malloc(sizeof(float) * count);
+	for (start = 0; start < count; start += n) {
+		n = MIN(count - start, CHUNK_SAMPLES);
+		if (analog->encoding->is_float)
+			input = (const float *)analog->data + start;
+		else
+			input = get_values(analog, start, n, buf);
 		if (!input)
 			return SR_ERR;
+		for (i = 0; i < n; i++) {
+			if (input[i] < lo_thr)
+				*state = 0;
+			else if (input[i] > hi_thr)
+				*state = 1;
 
-		sr_analog_to_float(analog, input);
-	} else
-		input = analog->data;
+			output[start + i] = *state;
+		}
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Convert analog values to logic values by using a Schmitt-trigger
+ * algorithm, into packed bits.
+ *
+ * Takes the values as sr_a2l_threshold_bits() does, and compares 8-bit
+ * and 16-bit integer values in their raw form the same way.
+ *
+ * @param analog The analog input values, of a single channel.
+ * @param lo_thr The low threshold - result becomes 0 below it.
+ * @param hi_thr The high threshold - result becomes 1 above it.
+ * @param state The internal converter state. Must contain the state of logic
+ *        sample n-1, will contain the state of logic sample n+count upon exit.
+ * @param output Bit n % 8 of byte n / 8 is the state after value n. Must
+ *        provide space for (count + 7) / 8 bytes.
+ * @param count The number of samples to process.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Unsupported encoding.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_schmitt_trigger_bits(const struct sr_datafeed_analog *analog,
+		float lo_thr, float hi_thr, uint8_t *state, uint8_t *output,
+		uint64_t count)
+{
+	const struct sr_analog_encoding *enc;
+	const uint8_t *data8;
+	const float *input;
+	float buf[CHUNK_SAMPLES];
+	int64_t min, max, bound_lo, bound_hi, raw;
+	uint64_t i, j, start, n;
+	uint8_t bits, s;
 
-	for (uint64_t i = 0; i < count; i++) {
-		if (input[i] < lo_thr)
-			*state = 0;
-		else if (input[i] > hi_thr)
-			*state = 1;
+	if (!analog || !analog->data || !analog->encoding ||
+			!analog->meaning || !state || !output)
+		return SR_ERR_ARG;
+	enc = analog->encoding;
+	data8 = analog->data;
+	s = *state ? 1 : 0;
 
-		output[i] = *state;
+	if (!isnan(lo_thr) && !isnan(hi_thr) && raw_range(enc, &min, &max)) {
+		/* Not below lo_thr, and above hi_thr. */
+		bound_lo = raw_bound(enc, min, max, lo_thr, FALSE);
+		bound_hi = raw_bound(enc, min, max, hi_thr, TRUE);
+		if (enc->unitsize == 1 && enc->is_signed)
+			SCHMITT_BITS(read_i8, 1);
+		else if (enc->unitsize == 1)
+			SCHMITT_BITS(read_u8, 1);
+		else if (enc->is_signed && enc->is_bigendian)
+			SCHMITT_BITS(read_i16be, 2);
+		else if (enc->is_signed)
+			SCHMITT_BITS(read_i16le, 2);
+		else if (enc->is_bigendian)
+			SCHMITT_BITS(read_u16be, 2);
+		else
+			SCHMITT_BITS(read_u16le, 2);
+		*state = s;
+		return SR_OK;
 	}
 
-	if (!analog->encoding->is_float)
-		g_free(input);
+	for (start = 0; start < count; start += n) {
+		n = MIN(count - start, CHUNK_SAMPLES);
+		input = get_values(analog, start, n, buf);
+		if (!input)
+			return SR_ERR;
+		s = schmitt_values_bits(input, lo_thr, hi_thr, s,
+			output + start / 8, n);
+	}
+	*state = s;
 
 	return SR_OK;
 }
+
+/* Samples each thread converts at once, a multiple of 8. */
+#define MULTI_TILE_SAMPLES (16 * 1024)
+/* Fewer samples than this aren't worth starting threads for. */
+#define MULTI_THREAD_SAMPLES (256 * 1024)
+
+struct a2l_multi {
+	const struct sr_datafeed_analog **analogs;
+	size_t num_channels;
+	const float *lo_thr;
+	const float *hi_thr;
+	uint8_t *state;
+	uint8_t *output;
+	uint16_t unitsize;
+	uint64_t count;
+	volatile gint next_tile;
+	int num_tiles;
+	volatile gint ret;
+};
+
+/* Set bit ch of each sample from packed bits, the others are kept. */
+static void scatter_bits(uint8_t *output, uint16_t unitsize, size_t ch,
+		const uint8_t *bits, uint64_t n)
+{
+	uint64_t i;
+	uint8_t mask;
+	int shift;
+
+	output += ch / 8;
+	shift = ch % 8;
+	mask = 1 << shift;
+	for (i = 0; i < n; i++, output += unitsize) {
+		*output = (*output & ~mask) |
+			(((bits[i / 8] >> (i % 8)) & 1) << shift);
+	}
+}
+
+static int convert_tile(struct a2l_multi *m, uint64_t start, uint64_t n)
+{
+	struct sr_datafeed_analog chunk;
+	struct sr_analog_meaning meaning;
+	GSList channel;
+	uint8_t bits[MULTI_TILE_SAMPLES / 8];
+	size_t ch;
+	int ret;
+
+	for (ch = 0; ch < m->num_channels; ch++) {
+		sub_analog(m->analogs[ch], start, n, &chunk, &meaning, &channel);
+		if (m->state)
+			ret = sr_a2l_schmitt_trigger_bits(&chunk, m->lo_thr[ch],
+				m->hi_thr[ch], &m->state[ch], bits, n);
+		else
+			ret = sr_a2l_threshold_bits(&chunk, m->lo_thr[ch],
+				bits, n);
+		if (ret != SR_OK)
+			return ret;
+		scatter_bits(m->output + start * m->unitsize, m->unitsize, ch,
+			bits, n);
+	}
+
+	return SR_OK;
+}
+
+static gpointer multi_thread(gpointer data)
+{
+	struct a2l_multi *m;
+	uint64_t start;
+	int idx, ret;
+
+	m = data;
+
+	while ((idx = g_atomic_int_add(&m->next_tile, 1)) < m->num_tiles) {
+		if (g_atomic_int_get(&m->ret) != SR_OK)
+			break;
+		start = (uint64_t)idx * MULTI_TILE_SAMPLES;
+		ret = convert_tile(m, start,
+			MIN(m->count - start, MULTI_TILE_SAMPLES));
+		if (ret != SR_OK)
+			g_atomic_int_set(&m->ret, ret);
+	}
+
+	return NULL;
+}
+
+static int multi_run(struct a2l_multi *m, unsigned int num_threads)
+{
+	GThread **threads;
+	unsigned int i, started;
+	size_t ch;
+
+	if (!m->analogs || !m->lo_thr || !m->output || !m->num_channels)
+		return SR_ERR_ARG;
+	if (m->num_channels > (size_t)m->unitsize * 8)
+		return SR_ERR_ARG;
+	for (ch = 0; ch < m->num_channels; ch++) {
+		if (!m->analogs[ch] || !m->analogs[ch]->data ||
+				!m->analogs[ch]->encoding || !m->analogs[ch]->meaning)
+			return SR_ERR_ARG;
+	}
+	if (m->count / MULTI_TILE_SAMPLES >= G_MAXINT)
+		return SR_ERR_ARG;
+
+	m->num_tiles = (m->count + MULTI_TILE_SAMPLES - 1) / MULTI_TILE_SAMPLES;
+	m->next_tile = 0;
+	m->ret = SR_OK;
+
+	/* The Schmitt trigger state passes from one tile to the next. */
+	if (m->state || m->count < MULTI_THREAD_SAMPLES)
+		num_threads = 1;
+	if (!num_threads) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		num_threads = g_get_num_processors();
+#else
+		num_threads = 1;
+#endif
+	}
+	num_threads = MIN(num_threads, (unsigned int)MAX(m->num_tiles, 1));
+
+	/* The calling thread converts too. */
+	threads = g_new0(GThread *, num_threads);
+	for (started = 0; started + 1 < num_threads; started++) {
+		threads[started] = g_thread_try_new("sr-a2l", multi_thread,
+			m, NULL);
+		if (!threads[started])
+			break;
+	}
+	multi_thread(m);
+	for (i = 0; i < started; i++)
+		g_thread_join(threads[i]);
+	g_free(threads);
+
+	return m->ret;
+}
+
+/**
+ * Convert the analog values of several channels to logic samples by
+ * using a fixed threshold for each.
+ *
+ * Does what sr_a2l_threshold_bits() does for each of the channels, and
+ * puts bit n of each logic sample together from channel n. The other
+ * bits of the samples are left alone. Tiles of the samples are
+ * converted by several threads.
+ *
+ * @param[in] analogs The analog input values, one packet per channel,
+ *                    each with at least count values. Must not be NULL.
+ * @param[in] num_channels Number of channels, at most unitsize * 8.
+ * @param[in] thresholds The threshold of each channel. Must not be NULL.
+ * @param[out] output The logic samples, count * unitsize bytes. Must not
+ *                    be NULL.
+ * @param[in] unitsize Size of each logic sample in bytes.
+ * @param[in] count The number of samples to process.
+ * @param[in] num_threads Number of threads to use, 0 for one per
+ *                        processor.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Unsupported encoding.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_threshold_multi(const struct sr_datafeed_analog **analogs,
+		size_t num_channels, const float *thresholds, uint8_t *output,
+		uint16_t unitsize, uint64_t count, unsigned int num_threads)
+{
+	struct a2l_multi m = { 0 };
+
+	m.analogs = analogs;
+	m.num_channels = num_channels;
+	m.lo_thr = thresholds;
+	m.output = output;
+	m.unitsize = unitsize;
+	m.count = count;
+
+	return multi_run(&m, num_threads);
+}
+
+/**
+ * Convert the analog values of several channels to logic samples by
+ * using a Schmitt-trigger algorithm for each.
+ *
+ * Does what sr_a2l_schmitt_trigger_bits() does for each of the
+ * channels, and puts the logic samples together the same way as
+ * sr_a2l_threshold_multi(). The state of each channel depends on all
+ * of its earlier samples, so this runs in the calling thread only.
+ *
+ * @param[in] analogs The analog input values, one packet per channel,
+ *                    each with at least count values. Must not be NULL.
+ * @param[in] num_channels Number of channels, at most unitsize * 8.
+ * @param[in] lo_thr The low threshold of each channel. Must not be NULL.
+ * @param[in] hi_thr The high threshold of each channel. Must not be NULL.
+ * @param[in,out] state The state of each channel, as with
+ *                      sr_a2l_schmitt_trigger(). Must not be NULL.
+ * @param[out] output The logic samples, count * unitsize bytes. Must not
+ *                    be NULL.
+ * @param[in] unitsize Size of each logic sample in bytes.
+ * @param[in] count The number of samples to process.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Unsupported encoding.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_a2l_schmitt_trigger_multi(const struct sr_datafeed_analog **analogs,
+		size_t num_channels, const float *lo_thr, const float *hi_thr,
+		uint8_t *state, uint8_t *output, uint16_t unitsize,
+		uint64_t count)
+{
+	struct a2l_multi m = { 0 };
+
+	if (!hi_thr || !state)
+		return SR_ERR_ARG;
+
+	m.analogs = analogs;
+	m.num_channels = num_channels;
+	m.lo_thr = lo_thr;
+	m.hi_thr = hi_thr;
+	m.state = state;
+	m.output = output;
+	m.unitsize = unitsize;
+	m.count = count;
+
+	return multi_run(&m, 1);
+}
+
+/*
+ * Find the run which sample lies in, the runs' offsets are ascending.
+ * Samples before the first run's offset count as the first run's.
+ */
+static uint64_t rle_find_run(const struct sr_datafeed_logic_rle *rle,
+		uint64_t sample)
+{
+	uint64_t lo, hi, mid;
+
+	lo = 0;
+	hi = rle->num_runs;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (rle->offsets[mid] <= sample)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/**
+ * Expand run-length encoded logic samples to their dense form.
+ *
+ * @param[in] rle The runs. Must not be NULL.
+ * @param[in] start Index of the first sample to expand.
+ * @param[in] count Number of samples to expand.
+ * @param[out] output The samples, count * rle->unitsize bytes. Must not
+ *                    be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or samples beyond the runs.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_logic_rle_to_dense(const struct sr_datafeed_logic_rle *rle,
+		uint64_t start, uint64_t count, uint8_t *output)
+{
+	const uint8_t *value;
+	uint64_t run, end, n, i;
+	uint16_t unitsize;
+
+	if (!rle || !output)
+		return SR_ERR_ARG;
+	if (start > rle->num_samples || count > rle->num_samples - start)
+		return SR_ERR_ARG;
+	if (!count)
+		return SR_OK;
+	if (!rle->num_runs || !rle->unitsize)
+		return SR_ERR_ARG;
+
+	unitsize = rle->unitsize;
+	run = rle_find_run(rle, start);
+	while (count) {
+		end = run + 1 < rle->num_runs ?
+			rle->offsets[run + 1] : rle->num_samples;
+		n = MIN(count, end - start);
+		value = (const uint8_t *)rle->values + run * unitsize;
+		if (unitsize == 1) {
+			memset(output, *value, n);
+		} else {
+			for (i = 0; i < n; i++)
+				memcpy(output + i * unitsize, value, unitsize);
+		}
+		output += n * unitsize;
+		start += n;
+		count -= n;
+		run++;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Run-length encode dense logic samples.
+ *
+ * Where a block of samples doesn't change, it compares equal to itself
+ * one sample later, so runs are skipped many bytes at a time.
+ *
+ * @param[in] logic The samples. Must not be NULL.
+ * @param[out] rle The runs, to be freed with sr_logic_rle_free(). Must
+ *                 not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_logic_rle_from_dense(const struct sr_datafeed_logic *logic,
+		struct sr_datafeed_logic_rle **rle)
+{
+	struct sr_datafeed_logic_rle *runs;
+	const uint8_t *data, *prev, *cur;
+	uint64_t num_samples, i, n;
+	GArray *offsets;
+	GByteArray *values;
+	uint16_t unitsize;
+
+	if (!logic || !rle || !logic->unitsize)
+		return SR_ERR_ARG;
+
+	data = logic->data;
+	unitsize = logic->unitsize;
+	num_samples = logic->length / unitsize;
+	offsets = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	values = g_byte_array_new();
+
+	if (num_samples) {
+		i = 0;
+		g_array_append_val(offsets, i);
+		g_byte_array_append(values, data, unitsize);
+	}
+	i = 1;
+	while (i < num_samples) {
+		prev = data + (i - 1) * unitsize;
+		n = MIN(CHUNK_SAMPLES, num_samples - i);
+		if (memcmp(prev, prev + unitsize, n * unitsize) == 0) {
+			i += n;
+			continue;
+		}
+		for (; n; n--, i++) {
+			cur = data + i * unitsize;
+			if (memcmp(cur - unitsize, cur, unitsize) == 0)
+				continue;
+			g_array_append_val(offsets, i);
+			g_byte_array_append(values, cur, unitsize);
+		}
+	}
+
+	runs = g_malloc0(sizeof(*runs));
+	runs->num_samples = num_samples;
+	runs->unitsize = unitsize;
+	runs->num_runs = offsets->len;
+	runs->offsets = (uint64_t *)g_array_free(offsets, FALSE);
+	runs->values = g_byte_array_free(values, FALSE);
+	*rle = runs;
+
+	return SR_OK;
+}
+
+/**
+ * Free runs which sr_logic_rle_from_dense() created.
+ *
+ * @param[in] rle The runs. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_logic_rle_free(struct sr_datafeed_logic_rle *rle)
+{
+	if (!rle)
+		return;
+	g_free(rle->offsets);
+	g_free(rle->values);
+	g_free(rle);
+}
+
+/**
+ * Size of the blocks of planar logic samples.
+ *
+ * @param[in] planar The samples. Must not be NULL.
+ *
+ * @return The size of planar->data in bytes.
+ *
+ * @private
+ */
+SR_PRIV size_t sr_logic_planar_data_size(const struct sr_datafeed_logic_planar *planar)
+{
+	uint64_t num_blocks;
+
+	if (!planar->word_bits)
+		return 0;
+	num_blocks = (planar->num_samples + planar->word_bits - 1) /
+		planar->word_bits;
+
+	return num_blocks * planar->num_planes * planar->word_bits / 8;
+}
+
+static uint64_t planar_word(const struct sr_datafeed_logic_planar *planar,
+		uint64_t block, unsigned int plane)
+{
+	const uint8_t *p;
+	uint64_t w;
+	uint32_t w32;
+	uint16_t w16;
+
+	p = (const uint8_t *)planar->data + (block * planar->num_planes +
+		plane) * planar->word_bits / 8;
+	switch (planar->word_bits) {
+	case 8:
+		return *p;
+	case 16:
+		memcpy(&w16, p, sizeof(w16));
+		return w16;
+	case 32:
+		memcpy(&w32, p, sizeof(w32));
+		return w32;
+	default:
+		memcpy(&w, p, sizeof(w));
+		return w;
+	}
+}
+
+/**
+ * Convert planar logic samples to their dense form.
+ *
+ * Up to 16 planes of up to 2 byte samples go through the bit transpose
+ * kernels, a block at a time.
+ *
+ * @param[in] planar The samples. Must not be NULL.
+ * @param[in] start Index of the first sample to convert.
+ * @param[in] count Number of samples to convert.
+ * @param[out] output The samples, count * planar->unitsize bytes. Must
+ *                    not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or samples beyond the packet.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_logic_planar_to_dense(const struct sr_datafeed_logic_planar *planar,
+		uint64_t start, uint64_t count, uint8_t *output)
+{
+	struct sr_transpose tp;
+	uint16_t masks[SR_TRANSPOSE_MAX_WORDS], samples[64];
+	uint64_t block, w, i, n, offset;
+	unsigned int plane, bit, unitsize, word_bits;
+
+	if (!planar || !output)
+		return SR_ERR_ARG;
+	if (start > planar->num_samples || count > planar->num_samples - start)
+		return SR_ERR_ARG;
+	if (!count)
+		return SR_OK;
+	unitsize = planar->unitsize;
+	word_bits = planar->word_bits;
+	if (!unitsize || (word_bits != 8 && word_bits != 16 &&
+			word_bits != 32 && word_bits != 64))
+		return SR_ERR_ARG;
+	for (plane = 0; plane < planar->num_planes; plane++) {
+		bit = planar->plane_bits ? planar->plane_bits[plane] : plane;
+		if (bit >= unitsize * 8)
+			return SR_ERR_ARG;
+		if (plane < SR_TRANSPOSE_MAX_WORDS)
+			masks[plane] = 1 << (bit % 16);
+	}
+
+	if (unitsize <= 2 && planar->num_planes &&
+			planar->num_planes <= SR_TRANSPOSE_MAX_WORDS) {
+		sr_transpose_init(&tp, word_bits, FALSE, masks,
+			planar->num_planes);
+		while (count) {
+			block = start / word_bits;
+			offset = start % word_bits;
+			n = MIN(count, word_bits - offset);
+			sr_transpose_blocks(&tp, samples,
+				(const uint8_t *)planar->data +
+				block * sr_transpose_block_bytes(&tp), 1);
+			for (i = 0; i < n; i++) {
+				if (unitsize == 1)
+					output[i] = samples[offset + i];
+				else
+					WL16(&output[i * 2], samples[offset + i]);
+			}
+			output += n * unitsize;
+			start += n;
+			count -= n;
+		}
+		return SR_OK;
+	}
+
+	/* Wider samples, a bit at a time. */
+	memset(output, 0, count * unitsize);
+	for (plane = 0; plane < planar->num_planes; plane++) {
+		bit = planar->plane_bits ? planar->plane_bits[plane] : plane;
+		for (i = 0; i < count; i++) {
+			w = planar_word(planar, (start + i) / word_bits, plane);
+			if ((w >> ((start + i) % word_bits)) & 1)
+				output[i * unitsize + bit / 8] |= 1 << (bit % 8);
+		}
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Convert dense logic samples to planar ones.
+ *
+ * Every bit of the samples gets its plane, of 64 bit words. Samples of
+ * up to 2 bytes go through the bit transpose kernels.
+ *
+ * @param[in] logic The samples. Must not be NULL.
+ * @param[out] planar The planar samples, to be freed with
+ *                    sr_logic_planar_free(). Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_MALLOC Out of memory.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_logic_dense_to_planar(const struct sr_datafeed_logic *logic,
+		struct sr_datafeed_logic_planar **planar)
+{
+	struct sr_datafeed_logic_planar *p;
+	const struct sr_transpose_impl *impl;
+	const uint8_t *data;
+	uint16_t samples[64];
+	uint64_t num_samples, num_blocks, block, w, i, n;
+	uint64_t *words;
+	unsigned int unitsize, plane;
+
+	if (!logic || !planar || !logic->unitsize)
+		return SR_ERR_ARG;
+
+	unitsize = logic->unitsize;
+	num_samples = logic->length / unitsize;
+	num_blocks = (num_samples + 63) / 64;
+	p = g_malloc0(sizeof(*p));
+	p->num_samples = num_samples;
+	p->unitsize = unitsize;
+	p->word_bits = 64;
+	p->num_planes = unitsize * 8;
+	p->data = g_try_malloc0(sr_logic_planar_data_size(p));
+	if (num_blocks && !p->data) {
+		g_free(p);
+		return SR_ERR_MALLOC;
+	}
+
+	data = logic->data;
+	words = p->data;
+	if (unitsize <= 2) {
+		impl = sr_transpose_impl_get();
+		for (block = 0; block < num_blocks; block++) {
+			n = MIN(64, num_samples - block * 64);
+			memset(samples, 0, sizeof(samples));
+			for (i = 0; i < n; i++, data += unitsize)
+				samples[i] = unitsize == 1 ? *data : RL16(data);
+			sr_transpose_to_planar(impl,
+				&words[block * p->num_planes], samples,
+				p->num_planes, 1);
+		}
+	} else {
+		for (i = 0; i < num_samples; i++, data += unitsize) {
+			for (plane = 0; plane < p->num_planes; plane++) {
+				if (!(data[plane / 8] & (1 << (plane % 8))))
+					continue;
+				w = (uint64_t)1 << (i % 64);
+				words[(i / 64) * p->num_planes + plane] |= w;
+			}
+		}
+	}
+	*planar = p;
+
+	return SR_OK;
+}
+
+/**
+ * Free planar samples which sr_logic_dense_to_planar() created.
+ *
+ * @param[in] planar The samples. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_logic_planar_free(struct sr_datafeed_logic_planar *planar)
+{
+	if (!planar)
+		return;
+	g_free(planar->plane_bits);
+	g_free(planar->data);
+	g_free(planar);
+}
+
+/**
+ * Size of the packed logic samples.
+ *
+ * @param[in] packed The samples. Must not be NULL.
+ *
+ * @return The size of packed->data in bytes.
+ *
+ * @private
+ */
+SR_PRIV size_t sr_logic_packed_data_size(const struct sr_datafeed_logic_packed *packed)
+{
+	return (packed->num_samples * packed->bits_per_sample + 7) / 8;
+}
+
+static gboolean packed_bits_valid(unsigned int bits)
+{
+	return bits == 1 || bits == 2 || bits == 4;
+}
+
+/* Spread whole bytes of packed samples to a byte per sample. */
+static void unpack_bytes(uint8_t *dst, const uint8_t *src, uint64_t nbytes,
+		unsigned int bits)
+{
+	uint64_t i, x;
+	uint32_t y;
+
+	switch (bits) {
+	case 1:
+		for (i = 0; i < nbytes; i++, dst += 8) {
+			x = src[i];
+			x = (x | x << 28) & UINT64_C(0x0000000f0000000f);
+			x = (x | x << 14) & UINT64_C(0x0003000300030003);
+			x = (x | x << 7) & UINT64_C(0x0101010101010101);
+			WL64(dst, x);
+		}
+		break;
+	case 2:
+		for (i = 0; i < nbytes; i++, dst += 4) {
+			y = src[i];
+			y = (y | y << 12) & 0x000f000f;
+			y = (y | y << 6) & 0x03030303;
+			WL32(dst, y);
+		}
+		break;
+	default:
+		for (i = 0; i < nbytes; i++, dst += 2) {
+			dst[0] = src[i] & 0x0f;
+			dst[1] = src[i] >> 4;
+		}
+		break;
+	}
+}
+
+/* The reverse of unpack_bytes(), bits above the sample size are dropped. */
+static void pack_bytes(uint8_t *dst, const uint8_t *src, uint64_t nbytes,
+		unsigned int bits)
+{
+	uint64_t i, x;
+	uint32_t y;
+
+	switch (bits) {
+	case 1:
+		for (i = 0; i < nbytes; i++, src += 8) {
+			x = RL64(src) & UINT64_C(0x0101010101010101);
+			dst[i] = (x * UINT64_C(0x0102040810204080)) >> 56;
+		}
+		break;
+	case 2:
+		for (i = 0; i < nbytes; i++, src += 4) {
+			y = RL32(src) & 0x03030303;
+			y = (y | y >> 6) & 0x000f000f;
+			dst[i] = y | y >> 12;
+		}
+		break;
+	default:
+		for (i = 0; i < nbytes; i++, src += 2)
+			dst[i] = (src[0] & 0x0f) | (src[1] & 0x0f) << 4;
+		break;
+	}
+}
+
+/**
+ * Convert packed logic samples to their dense form, a byte per sample.
+ *
+ * @param[in] packed The samples. Must not be NULL.
+ * @param[in] start Index of the first sample to convert.
+ * @param[in] count Number of samples to convert.
+ * @param[out] output The samples, count bytes. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or samples beyond the packet.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_logic_packed_to_dense(const struct sr_datafeed_logic_packed *packed,
+		uint64_t start, uint64_t count, uint8_t *output)
+{
+	const uint8_t *data;
+	unsigned int bits, per_byte, mask;
+	uint64_t nbytes;
+
+	if (!packed || !output || !packed_bits_valid(packed->bits_per_sample))
+		return SR_ERR_ARG;
+	if (start > packed->num_samples || count > packed->num_samples - start)
+		return SR_ERR_ARG;
+
+	data = packed->data;
+	bits = packed->bits_per_sample;
+	per_byte = 8 / bits;
+	mask = (1 << bits) - 1;
+	/* Up to a byte boundary, whole bytes, then the rest. */
+	while (count && start % per_byte) {
+		*output++ = (data[start / per_byte] >>
+			(start % per_byte * bits)) & mask;
+		start++;
+		count--;
+	}
+	nbytes = count / per_byte;
+	unpack_bytes(output, data + start / per_byte, nbytes, bits);
+	output += nbytes * per_byte;
+	start += nbytes * per_byte;
+	count -= nbytes * per_byte;
+	while (count--) {
+		*output++ = (data[start / per_byte] >>
+			(start % per_byte * bits)) & mask;
+		start++;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Convert dense logic samples of one byte to packed ones.
+ *
+ * @param[in] logic The samples, with a unitsize of 1. Must not be NULL.
+ * @param[in] bits_per_sample Bits per packed sample: 1, 2 or 4. Higher
+ *                            bits of the samples are dropped.
+ * @param[out] packed The packed samples, to be freed with
+ *                    sr_logic_packed_free(). Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_MALLOC Out of memory.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_logic_dense_to_packed(const struct sr_datafeed_logic *logic,
+		unsigned int bits_per_sample,
+		struct sr_datafeed_logic_packed **packed)
+{
+	struct sr_datafeed_logic_packed *p;
+	const uint8_t *src;
+	uint8_t *dst;
+	unsigned int per_byte, mask, shift;
+	uint64_t nbytes, i;
+
+	if (!logic || !packed || logic->unitsize != 1)
+		return SR_ERR_ARG;
+	if (!packed_bits_valid(bits_per_sample))
+		return SR_ERR_ARG;
+
+	p = g_malloc0(sizeof(*p));
+	p->num_samples = logic->length;
+	p->bits_per_sample = bits_per_sample;
+	p->data = g_try_malloc0(sr_logic_packed_data_size(p));
+	if (p->num_samples && !p->data) {
+		g_free(p);
+		return SR_ERR_MALLOC;
+	}
+
+	src = logic->data;
+	dst = p->data;
+	per_byte = 8 / bits_per_sample;
+	mask = (1 << bits_per_sample) - 1;
+	nbytes = p->num_samples / per_byte;
+	pack_bytes(dst, src, nbytes, bits_per_sample);
+	for (i = nbytes * per_byte; i < p->num_samples; i++) {
+		shift = i % per_byte * bits_per_sample;
+		dst[nbytes] |= (src[i] & mask) << shift;
+	}
+	*packed = p;
+
+	return SR_OK;
+}
+
+/**
+ * Free packed samples which sr_logic_dense_to_packed() created.
+ *
+ * @param[in] packed The samples. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_logic_packed_free(struct sr_datafeed_logic_packed *packed)
+{
+	if (!packed)
+		return;
+	g_free(packed->data);
+	g_free(packed);
+}
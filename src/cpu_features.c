@@ -0,0 +1,128 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "cpu_features.h"
+
+static const struct {
+	const char *name;
+	uint32_t feature;
+} feature_names[] = {
+	{ "sse2", SR_CPU_SSE2, },
+	{ "ssse3", SR_CPU_SSSE3, },
+	{ "avx2", SR_CPU_AVX2, },
+	{ "avx512bw", SR_CPU_AVX512BW, },
+	{ "bmi2", SR_CPU_BMI2, },
+	{ "neon", SR_CPU_NEON, },
+};
+
+static uint32_t detect(void)
+{
+	uint32_t features;
+
+	features = 0;
+#ifdef SR_CPU_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		features |= SR_CPU_SSE2;
+	if (__builtin_cpu_supports("ssse3"))
+		features |= SR_CPU_SSSE3;
+	if (__builtin_cpu_supports("avx2"))
+		features |= SR_CPU_AVX2;
+	/* The AVX-512 kernels need both, as does every CPU with BW. */
+	if (__builtin_cpu_supports("avx512f") &&
+			__builtin_cpu_supports("avx512bw"))
+		features |= SR_CPU_AVX512BW;
+	if (__builtin_cpu_supports("bmi2"))
+		features |= SR_CPU_BMI2;
+#endif
+#ifdef SR_CPU_NEON_BUILD
+	/* Part of the baseline on aarch64. */
+	features |= SR_CPU_NEON;
+#endif
+
+	return features;
+}
+
+/*
+ * Limit the detected features to those in a SIGROK_CPU_FEATURES value.
+ * Unknown names are ignored, "none" or an empty list allows no feature.
+ */
+SR_PRIV uint32_t sr_cpu_features_parse(const char *str, uint32_t detected)
+{
+	gchar **names;
+	uint32_t allowed;
+	unsigned int i, j;
+
+	if (!str)
+		return detected;
+
+	allowed = 0;
+	names = g_strsplit(str, ",", 0);
+	for (i = 0; names[i]; i++) {
+		g_strstrip(names[i]);
+		for (j = 0; j < G_N_ELEMENTS(feature_names); j++) {
+			if (g_ascii_strcasecmp(names[i], feature_names[j].name) == 0)
+				allowed |= feature_names[j].feature;
+		}
+	}
+	g_strfreev(names);
+
+	return detected & allowed;
+}
+
+/* Names of the features, for log messages, "none" without any. */
+SR_PRIV char *sr_cpu_features_to_string(uint32_t features)
+{
+	GString *s;
+	unsigned int i;
+
+	s = g_string_sized_new(32);
+	for (i = 0; i < G_N_ELEMENTS(feature_names); i++) {
+		if (!(features & feature_names[i].feature))
+			continue;
+		if (s->len)
+			g_string_append_c(s, ' ');
+		g_string_append(s, feature_names[i].name);
+	}
+	if (!s->len)
+		g_string_append(s, "none");
+
+	return g_string_free(s, FALSE);
+}
+
+/* The features of the running CPU which kernels may use, detected once. */
+SR_PRIV uint32_t sr_cpu_features(void)
+{
+	static gsize features;
+
+	if (g_once_init_enter(&features)) {
+		/* Never 0, so that 0 features get cached as well. */
+		g_once_init_leave(&features, 0x80000000 |
+			sr_cpu_features_parse(g_getenv("SIGROK_CPU_FEATURES"),
+			detect()));
+	}
+
+	return features & 0x7fffffff;
+}
+
+/* Whether the running CPU has all of the features and may use them. */
+SR_PRIV gboolean sr_cpu_has(uint32_t features)
+{
+	return (sr_cpu_features() & features) == features;
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_CPU_FEATURES_H
+#define LIBSIGROK_CPU_FEATURES_H
+
+#include <stdint.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+
+/*
+ * CPU features which SIMD kernels get picked by at runtime.
+ *
+ * Kernels for x86 ISAs beyond the baseline one get built with target
+ * attributes where the compiler supports them (HAVE_TARGET_ATTRIBUTE),
+ * NEON kernels only where the build targets NEON anyway. Each of them
+ * sits in a NULL terminated table of implementations, scalar reference
+ * first and fastest last, and is picked once when its user gets set up.
+ *
+ * SIGROK_CPU_FEATURES limits the features which get used, to debug and
+ * benchmark kernels: "none" forces the scalar paths, a comma separated
+ * list like "sse2,ssse3" allows just those features.
+ *
+ * This file does not depend on anything but glib, so that the unit
+ * tests and benchmarks can link it directly.
+ */
+
+#if defined(__GNUC__) && defined(HAVE_TARGET_ATTRIBUTE) && \
+	(defined(__x86_64__) || defined(__i386__))
+#define SR_CPU_X86
+#define SR_TARGET_SSE2 __attribute__((target("sse2")))
+#define SR_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define SR_TARGET_AVX2 __attribute__((target("avx2")))
+#define SR_TARGET_AVX512BW __attribute__((target("avx512f,avx512bw")))
+#define SR_TARGET_BMI2 __attribute__((target("bmi2")))
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define SR_CPU_NEON_BUILD
+#endif
+
+enum sr_cpu_feature {
+	SR_CPU_SSE2 = 1 << 0,
+	SR_CPU_SSSE3 = 1 << 1,
+	SR_CPU_AVX2 = 1 << 2,
+	SR_CPU_AVX512BW = 1 << 3,
+	SR_CPU_BMI2 = 1 << 4,
+	SR_CPU_NEON = 1 << 5,
+};
+
+SR_PRIV uint32_t sr_cpu_features(void);
+SR_PRIV gboolean sr_cpu_has(uint32_t features);
+SR_PRIV uint32_t sr_cpu_features_parse(const char *str, uint32_t detected);
+SR_PRIV char *sr_cpu_features_to_string(uint32_t features);
+
+#endif
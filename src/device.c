@@ -71,6 +71,7 @@ SR_PRIV struct sr_channel *sr_channel_new(struct sr_dev_inst *sdi,
 		ch->name = g_strdup(name);
 
 	sdi->channels = g_slist_append(sdi->channels, ch);
+	sr_dev_channel_index_invalidate(sdi);
 
 	return ch;
 }
@@ -153,6 +154,8 @@ SR_API int sr_dev_channel_enable(struct sr_channel *channel, gboolean state)
 	sdi = channel->sdi;
 	was_enabled = channel->enabled;
 	channel->enabled = state;
+	if (!state != !was_enabled)
+		sr_dev_channel_index_invalidate(sdi);
 	if (!state != !was_enabled && sdi->driver
 			&& sdi->driver->config_channel_set) {
 		ret = sdi->driver->config_channel_set(
@@ -165,6 +168,155 @@ SR_API int sr_dev_channel_enable(struct sr_channel *channel, gboolean state)
 	return SR_OK;
 }
 
+static void channel_index_free(struct sr_channel_index *index)
+{
+	if (!index)
+		return;
+	g_free(index->channels);
+	g_free(index->slots);
+	g_free(index->logic);
+	g_free(index->analog);
+	g_free(index->logic_mask);
+	g_hash_table_destroy(index->positions);
+	g_free(index);
+}
+
+/**
+ * Drop the device's channel index, have it rebuilt on next use.
+ *
+ * Needs to be called when channels get added, or their type or enabled
+ * state changes other than by sr_dev_channel_enable().
+ *
+ * @param[in] sdi The device instance. Can be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_dev_channel_index_invalidate(struct sr_dev_inst *sdi)
+{
+	if (!sdi)
+		return;
+	channel_index_free(sdi->channel_index);
+	sdi->channel_index = NULL;
+}
+
+/**
+ * Get the device's channel index, build it if needed.
+ *
+ * The index has arrays of all channels, of the enabled logic and of
+ * the enabled analog channels, each in the order of sdi->channels, and
+ * a bit mask of the enabled logic channels' indices. This is what the
+ * per-packet code needs, without walking the channel list.
+ *
+ * @param[in] sdi The device instance. Must not be NULL.
+ *
+ * @return The channel index, valid until the next invalidation.
+ *
+ * @private
+ */
+SR_PRIV const struct sr_channel_index *sr_dev_channel_index(
+		const struct sr_dev_inst *sdi)
+{
+	struct sr_dev_inst *inst;
+	struct sr_channel_index *index;
+	struct sr_channel *ch;
+	GSList *l;
+	size_t pos, max_index;
+
+	if (sdi->channel_index)
+		return sdi->channel_index;
+
+	index = g_malloc0(sizeof(*index));
+	index->num_channels = g_slist_length(sdi->channels);
+	index->channels = g_malloc0_n(index->num_channels + 1,
+		sizeof(index->channels[0]));
+	index->slots = g_malloc0_n(index->num_channels + 1,
+		sizeof(index->slots[0]));
+	index->logic = g_malloc0_n(index->num_channels + 1,
+		sizeof(index->logic[0]));
+	index->analog = g_malloc0_n(index->num_channels + 1,
+		sizeof(index->analog[0]));
+	index->positions = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	max_index = 0;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC && ch->index >= 0)
+			max_index = MAX(max_index, (size_t)ch->index + 1);
+	}
+	index->logic_mask_words = (max_index + 63) / 64;
+	index->logic_mask = g_malloc0_n(index->logic_mask_words + 1,
+		sizeof(index->logic_mask[0]));
+
+	for (l = sdi->channels, pos = 0; l; l = l->next, pos++) {
+		ch = l->data;
+		index->channels[pos] = ch;
+		index->slots[pos] = -1;
+		g_hash_table_insert(index->positions, ch,
+			GSIZE_TO_POINTER(pos + 1));
+		if (!ch->enabled)
+			continue;
+		index->num_enabled++;
+		if (ch->type == SR_CHANNEL_LOGIC) {
+			index->slots[pos] = index->num_logic;
+			index->logic[index->num_logic++] = ch;
+			if (ch->index >= 0)
+				index->logic_mask[ch->index / 64] |=
+					UINT64_C(1) << (ch->index % 64);
+		} else if (ch->type == SR_CHANNEL_ANALOG) {
+			index->slots[pos] = index->num_analog;
+			index->analog[index->num_analog++] = ch;
+		}
+	}
+
+	/* The index is a cache, building it doesn't change the device. */
+	inst = (struct sr_dev_inst *)sdi;
+	inst->channel_index = index;
+
+	return index;
+}
+
+/**
+ * Get a channel's position in its device's channel list.
+ *
+ * @param[in] ch The channel. Must not be NULL.
+ *
+ * @return The position, or -1 when the channel is not in the list.
+ *
+ * @private
+ */
+SR_PRIV int sr_dev_channel_position(const struct sr_channel *ch)
+{
+	const struct sr_channel_index *index;
+
+	index = sr_dev_channel_index(ch->sdi);
+
+	return GPOINTER_TO_SIZE(g_hash_table_lookup(index->positions, ch)) - 1;
+}
+
+/**
+ * Get a channel's slot among its device's enabled channels of its type.
+ *
+ * This is where the channel is in the index' logic or analog array.
+ *
+ * @param[in] ch The channel. Must not be NULL.
+ *
+ * @return The slot, or -1 when the channel is disabled.
+ *
+ * @private
+ */
+SR_PRIV int sr_dev_channel_slot(const struct sr_channel *ch)
+{
+	const struct sr_channel_index *index;
+	int pos;
+
+	pos = sr_dev_channel_position(ch);
+	if (pos < 0)
+		return -1;
+	index = sr_dev_channel_index(ch->sdi);
+
+	return index->slots[pos];
+}
+
 /**
  * Returns the next enabled channel, wrapping around if necessary.
  *
@@ -179,16 +331,18 @@ SR_API int sr_dev_channel_enable(struct sr_channel *channel, gboolean state)
 SR_PRIV struct sr_channel *sr_next_enabled_channel(const struct sr_dev_inst *sdi,
 		struct sr_channel *cur_channel)
 {
+	const struct sr_channel_index *index;
 	struct sr_channel *next_channel;
-	GSList *l;
+	int pos;
 
-	next_channel = cur_channel;
+	index = sr_dev_channel_index(sdi);
+	pos = cur_channel ? sr_dev_channel_position(cur_channel) : -1;
 	do {
-		l = g_slist_find(sdi->channels, next_channel);
-		if (l && l->next)
-			next_channel = l->next->data;
+		if (pos + 1 < (int)index->num_channels)
+			pos++;
 		else
-			next_channel = sdi->channels->data;
+			pos = 0;
+		next_channel = index->channels[pos];
 	} while (!next_channel->enabled);
 
 	return next_channel;
@@ -517,7 +671,9 @@ SR_PRIV void sr_dev_inst_free(struct sr_dev_inst *sdi)
 		sr_channel_free(ch);
 	}
 	g_slist_free(sdi->channels);
+	sr_dev_channel_index_invalidate(sdi);
 	g_slist_free_full(sdi->channel_groups, sr_channel_group_free_cb);
+	g_slist_free_full(sdi->config_listeners, g_free);
 
 	if (sdi->session)
 		sr_session_dev_remove(sdi->session, sdi);
@@ -566,6 +722,8 @@ SR_PRIV struct sr_usb_dev_inst *sr_usb_dev_inst_new(uint8_t bus,
  */
 SR_PRIV void sr_usb_dev_inst_free(struct sr_usb_dev_inst *usb)
 {
+	if (usb && usb->dev_mem)
+		g_hash_table_destroy(usb->dev_mem);
 	g_free(usb);
 }
 
@@ -629,6 +787,8 @@ SR_PRIV void sr_serial_dev_inst_free(struct sr_serial_dev_inst *serial)
 
 	g_free(serial->port);
 	g_free(serial->serialcomm);
+	if (serial->rx_ahead)
+		g_string_free(serial->rx_ahead, TRUE);
 	g_free(serial);
 }
 #endif
@@ -968,4 +1128,124 @@ SR_API GSList *sr_dev_inst_channel_groups_get(const struct sr_dev_inst *sdi)
 	return sdi->channel_groups;
 }
 
+/** @cond PRIVATE */
+struct config_listener {
+	sr_config_change_callback cb;
+	void *cb_data;
+};
+
+/* Drivers report changes from whichever thread observes them. */
+static GMutex config_listeners_mutex;
+/** @endcond */
+
+/**
+ * Get notified of configuration changes of a device.
+ *
+ * Drivers report the values of keys which they observe to change,
+ * e.g. from front panel controls or status they stream, as well as the
+ * values set through sr_config_set(). Frontends can use this instead of
+ * polling sr_config_get().
+ *
+ * The callback runs on the thread which observed the change, which is
+ * the thread running the session for most drivers. It must not add or
+ * remove listeners. The value is only valid during the callback, use
+ * g_variant_ref() to keep it.
+ *
+ * @param sdi The device instance. Must not be NULL.
+ * @param cb The callback. Must not be NULL.
+ * @param cb_data Opaque pointer passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_dev_config_listener_add(struct sr_dev_inst *sdi,
+		sr_config_change_callback cb, void *cb_data)
+{
+	struct config_listener *l;
+
+	if (!sdi || !cb)
+		return SR_ERR_ARG;
+
+	l = g_malloc0(sizeof(*l));
+	l->cb = cb;
+	l->cb_data = cb_data;
+	g_mutex_lock(&config_listeners_mutex);
+	sdi->config_listeners = g_slist_append(sdi->config_listeners, l);
+	g_mutex_unlock(&config_listeners_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Stop notifications of configuration changes of a device.
+ *
+ * @param sdi The device instance. Must not be NULL.
+ * @param cb The callback, as it was added.
+ * @param cb_data The opaque pointer, as it was added.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG No such listener.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_dev_config_listener_remove(struct sr_dev_inst *sdi,
+		sr_config_change_callback cb, void *cb_data)
+{
+	struct config_listener *l;
+	GSList *e;
+	int ret;
+
+	if (!sdi)
+		return SR_ERR_ARG;
+
+	ret = SR_ERR_ARG;
+	g_mutex_lock(&config_listeners_mutex);
+	for (e = sdi->config_listeners; e; e = e->next) {
+		l = e->data;
+		if (l->cb != cb || l->cb_data != cb_data)
+			continue;
+		sdi->config_listeners = g_slist_delete_link(
+			sdi->config_listeners, e);
+		g_free(l);
+		ret = SR_OK;
+		break;
+	}
+	g_mutex_unlock(&config_listeners_mutex);
+
+	return ret;
+}
+
+/**
+ * Report the new value of a configuration key to the device's
+ * listeners, see sr_dev_config_listener_add().
+ *
+ * @param sdi The device instance.
+ * @param cg The channel group the key is for, or NULL.
+ * @param key The configuration key (SR_CONF_*).
+ * @param data The new value. A floating reference is sunk and unreffed.
+ *
+ * @private
+ */
+SR_PRIV void sr_dev_config_changed(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, GVariant *data)
+{
+	struct config_listener *l;
+	GSList *e;
+
+	if (!data)
+		return;
+	g_variant_ref_sink(data);
+	if (sdi && sdi->config_listeners) {
+		g_mutex_lock(&config_listeners_mutex);
+		for (e = sdi->config_listeners; e; e = e->next) {
+			l = e->data;
+			l->cb(sdi, cg, key, data, l->cb_data);
+		}
+		g_mutex_unlock(&config_listeners_mutex);
+	}
+	g_variant_unref(data);
+}
+
 /** @} */
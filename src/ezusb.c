@@ -33,8 +33,19 @@
 
 #define LOG_PREFIX "ezusb"
 
+/*
+ * The largest control transfer that works everywhere, Linux usbfs
+ * takes no more than a page.
+ */
 #define FW_CHUNKSIZE (4 * 1024)
 
+/* How often to look for a renumerated device without hotplug events. */
+#define RENUM_POLL_MS 20
+
+/* Where firmware was uploaded, port path to the device's old address. */
+static GMutex renum_mutex;
+static GHashTable *renum_ports;
+
 SR_PRIV int ezusb_reset(struct libusb_device_handle *hdl, int set_clear)
 {
 	int ret;
@@ -56,17 +67,19 @@ SR_PRIV int ezusb_install_firmware(struct sr_context *ctx,
 				   libusb_device_handle *hdl,
 				   const char *name)
 {
-	unsigned char *firmware;
+	GBytes *bytes;
+	const unsigned char *firmware;
 	size_t length, offset, chunksize;
 	int ret, result;
 
 	/* Max size is 64 kiB since the value field of the setup packet,
 	 * which holds the firmware offset, is only 16 bit wide.
 	 */
-	firmware = sr_resource_load(ctx, SR_RESOURCE_FIRMWARE,
-			name, &length, 1 << 16);
-	if (!firmware)
+	bytes = sr_resource_load_cached(ctx, SR_RESOURCE_FIRMWARE,
+			name, 1 << 16);
+	if (!bytes)
 		return SR_ERR;
+	firmware = g_bytes_get_data(bytes, &length);
 
 	sr_info("Uploading firmware '%s'.", name);
 
@@ -77,18 +90,18 @@ SR_PRIV int ezusb_install_firmware(struct sr_context *ctx,
 
 		ret = libusb_control_transfer(hdl, LIBUSB_REQUEST_TYPE_VENDOR |
 					      LIBUSB_ENDPOINT_OUT, 0xa0, offset,
-					      0x0000, firmware + offset,
+					      0x0000, (unsigned char *)firmware + offset,
 					      chunksize, 100);
 		if (ret < 0) {
 			sr_err("Unable to send firmware to device: %s.",
 					libusb_error_name(ret));
-			g_free(firmware);
+			g_bytes_unref(bytes);
 			return SR_ERR;
 		}
-		sr_info("Uploaded %zu bytes.", chunksize);
+		sr_spew("Uploaded %zu bytes.", chunksize);
 		offset += chunksize;
 	}
-	g_free(firmware);
+	g_bytes_unref(bytes);
 
 	sr_info("Firmware upload done.");
 
@@ -99,11 +112,23 @@ SR_PRIV int ezusb_upload_firmware(struct sr_context *ctx, libusb_device *dev,
 				  int configuration, const char *name)
 {
 	struct libusb_device_handle *hdl;
+	char path[64];
 	int ret;
 
 	sr_info("uploading firmware to device on %d.%d",
 		libusb_get_bus_number(dev), libusb_get_device_address(dev));
 
+	/* The device comes back at the same port, with another address. */
+	if (usb_get_port_path(dev, path, sizeof(path)) == 0) {
+		g_mutex_lock(&renum_mutex);
+		if (!renum_ports)
+			renum_ports = g_hash_table_new_full(g_str_hash,
+				g_str_equal, g_free, NULL);
+		g_hash_table_insert(renum_ports, g_strdup(path),
+			GINT_TO_POINTER(libusb_get_device_address(dev)));
+		g_mutex_unlock(&renum_mutex);
+	}
+
 	if ((ret = libusb_open(dev, &hdl)) < 0) {
 		sr_err("failed to open device: %s.", libusb_error_name(ret));
 		return SR_ERR;
@@ -142,3 +167,120 @@ SR_PRIV int ezusb_upload_firmware(struct sr_context *ctx, libusb_device *dev,
 
 	return SR_OK;
 }
+
+/* Whether a device other than the one at old_address is at the port. */
+static gboolean renum_present(libusb_context *usb_ctx, const char *port_path,
+		int old_address)
+{
+	libusb_device **devlist;
+	char path[64];
+	gboolean found;
+	int i;
+
+	if (libusb_get_device_list(usb_ctx, &devlist) < 0)
+		return FALSE;
+	found = FALSE;
+	for (i = 0; devlist[i] && !found; i++) {
+		if (libusb_get_device_address(devlist[i]) == old_address)
+			continue;
+		if (usb_get_port_path(devlist[i], path, sizeof(path)) < 0)
+			continue;
+		found = !strcmp(path, port_path);
+	}
+	libusb_free_device_list(devlist, 1);
+
+	return found;
+}
+
+static int LIBUSB_CALL renum_arrived(libusb_context *usb_ctx,
+		libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+	(void)usb_ctx;
+	(void)dev;
+	(void)event;
+
+	g_atomic_int_set((gint *)user_data, 1);
+
+	return 0;
+}
+
+/**
+ * Wait for an FX2 to come back after ezusb_upload_firmware().
+ *
+ * The FX2 drops off the bus when it starts the new firmware, and comes
+ * back at the same port with another address. This returns as soon as
+ * it is there. Hotplug events, where libusb has them, wake this up
+ * right away, otherwise the bus is looked at every few milliseconds.
+ *
+ * @param sdi The device instance, with the port path in connection_id.
+ * @param timeout_ms How long to wait at most.
+ *
+ * @retval SR_OK The device is back, or firmware wasn't uploaded here.
+ * @retval SR_ERR_TIMEOUT The device didn't come back in time.
+ *
+ * @private
+ */
+SR_PRIV int ezusb_wait_renumerated(const struct sr_dev_inst *sdi,
+		unsigned int timeout_ms)
+{
+	struct drv_context *drvc;
+	libusb_context *usb_ctx;
+	libusb_hotplug_callback_handle handle;
+	struct timeval tv;
+	gpointer value;
+	gboolean known, hotplug, present;
+	int64_t start, deadline;
+	int old_address;
+	gint *arrived;
+
+	if (!sdi->connection_id)
+		return SR_OK;
+
+	g_mutex_lock(&renum_mutex);
+	known = renum_ports && g_hash_table_lookup_extended(renum_ports,
+		sdi->connection_id, NULL, &value);
+	g_mutex_unlock(&renum_mutex);
+	if (!known)
+		return SR_OK;
+	old_address = GPOINTER_TO_INT(value);
+
+	drvc = sdi->driver->context;
+	usb_ctx = drvc->sr_ctx->libusb_ctx;
+	arrived = g_malloc0(sizeof(*arrived));
+	hotplug = libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) &&
+		libusb_hotplug_register_callback(usb_ctx,
+			LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, 0,
+			LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+			LIBUSB_HOTPLUG_MATCH_ANY, renum_arrived, arrived,
+			&handle) == LIBUSB_SUCCESS;
+
+	start = g_get_monotonic_time();
+	deadline = start + (int64_t)timeout_ms * 1000;
+	while (!(present = renum_present(usb_ctx, sdi->connection_id,
+			old_address)) && g_get_monotonic_time() < deadline) {
+		if (hotplug) {
+			g_atomic_int_set(arrived, 0);
+			tv.tv_sec = 0;
+			tv.tv_usec = RENUM_POLL_MS * 1000;
+			libusb_handle_events_timeout_completed(usb_ctx, &tv,
+				arrived);
+		} else {
+			g_usleep(RENUM_POLL_MS * 1000);
+		}
+	}
+
+	if (hotplug)
+		libusb_hotplug_deregister_callback(usb_ctx, handle);
+	g_free(arrived);
+
+	if (!present)
+		return SR_ERR_TIMEOUT;
+
+	g_mutex_lock(&renum_mutex);
+	g_hash_table_remove(renum_ports, sdi->connection_id);
+	g_mutex_unlock(&renum_mutex);
+	sr_dbg("Device renumerated after %" G_GINT64_FORMAT "ms.",
+		(g_get_monotonic_time() - start) / 1000);
+
+	return SR_OK;
+}
@@ -21,6 +21,9 @@
 
 #include <string.h>
 #include <unistd.h>
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#endif
 
 #include "protocol.h"
 
@@ -59,6 +62,8 @@ SR_PRIV int omega_rtm_cli_open(const struct sr_dev_inst *sdi)
 	memset(&devc->samples, 0, sizeof(devc->samples));
 	devc->samples.queue = feed_queue_logic_alloc(sdi,
 		FEED_QUEUE_DEPTH, sizeof(devc->samples.last_sample));
+	(void)feed_queue_logic_rle(devc->samples.queue,
+		sr_session_takes_logic_rle(sdi->session));
 
 	/*
 	 * Start the background process. May take considerable time
@@ -116,6 +121,19 @@ SR_PRIV int omega_rtm_cli_open(const struct sr_dev_inst *sdi)
 	sr_dbg("stamp %u, samples %x %x", stamp, sample1, sample2);
 	write_u16le(devc->samples.last_sample, sample2);
 
+#ifdef G_OS_UNIX
+	/*
+	 * Have the pipe hold as much as the receive buffer does, so that
+	 * the vendor application does not stall while the session is
+	 * busy. And drain it without blocking when data is available.
+	 */
+#ifdef F_SETPIPE_SZ
+	if (fcntl(fd_out, F_SETPIPE_SZ, RTMCLI_STDOUT_CHUNKSIZE) < 0)
+		sr_dbg("Cannot grow the vendor application's pipe.");
+#endif
+	fcntl(fd_out, F_SETFL, fcntl(fd_out, F_GETFL) | O_NONBLOCK);
+#endif
+
 	return SR_OK;
 }
 
@@ -164,6 +182,68 @@ SR_PRIV int omega_rtm_cli_close(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+/* Submit the samples which were expanded so far. */
+static int flush_expanded(struct dev_context *devc)
+{
+	size_t count;
+
+	count = devc->samples.expand_fill;
+	if (!count)
+		return SR_OK;
+	devc->samples.expand_fill = 0;
+
+	return feed_queue_logic_submit_many(devc->samples.queue,
+		(const uint8_t *)devc->samples.expand, count);
+}
+
+/*
+ * Queue a number of samples of the same value. Short runs get expanded
+ * into a local buffer, which gets submitted in bulk. Long runs go to
+ * the feed queue directly, its fill is cheaper for them.
+ */
+static int queue_run(struct dev_context *devc, uint16_t value, size_t count)
+{
+	uint16_t *wrptr, le_value;
+	size_t space, i;
+	int ret;
+
+	if (!count)
+		return SR_OK;
+
+	space = EXPAND_SAMPLES - devc->samples.expand_fill;
+	if (count > EXPAND_LONG_RUN || count > space) {
+		ret = flush_expanded(devc);
+		if (ret != SR_OK)
+			return ret;
+		if (count > EXPAND_LONG_RUN) {
+			write_u16le(devc->samples.last_sample, value);
+			return feed_queue_logic_submit_one(devc->samples.queue,
+				devc->samples.last_sample, count);
+		}
+	}
+
+	/* A plain store loop, which compilers turn into vector stores. */
+	le_value = GUINT16_TO_LE(value);
+	wrptr = &devc->samples.expand[devc->samples.expand_fill];
+	for (i = 0; i < count; i++)
+		wrptr[i] = le_value;
+	devc->samples.expand_fill += count;
+
+	return SR_OK;
+}
+
+/* Cap a sample count to the user specified limit, account for it. */
+static size_t take_count(struct dev_context *devc, size_t count)
+{
+	if (devc->samples.check_count) {
+		if (count > devc->samples.remain_count)
+			count = devc->samples.remain_count;
+		devc->samples.remain_count -= count;
+	}
+
+	return count;
+}
+
 /*
  * Process received sample data, which comes in 6-byte chunks.
  * Uncompress the RLE stream. Strictly enforce user specified sample
@@ -177,13 +257,15 @@ static int omega_rtm_cli_process_rawdata(const struct sr_dev_inst *sdi)
 	struct dev_context *devc;
 	const uint8_t *rdptr;
 	size_t avail, taken, count;
-	uint16_t stamp, sample1, sample2;
+	uint64_t samples;
+	uint16_t stamp, sample1, sample2, last;
 	int ret;
 
 	devc = sdi->priv;
 	rdptr = &devc->rawdata.buff[0];
 	avail = devc->rawdata.fill;
 	taken = 0;
+	samples = 0;
 	ret = SR_OK;
 
 	/* Cope with previous errors, silently discard RX data. */
@@ -191,6 +273,7 @@ static int omega_rtm_cli_process_rawdata(const struct sr_dev_inst *sdi)
 		ret = SR_ERR_DATA;
 
 	/* Process those chunks whose reception has completed. */
+	last = read_u16le(devc->samples.last_sample);
 	while (ret == SR_OK && avail >= chunk_size) {
 		stamp = read_u16le_inc(&rdptr);
 		sample1 = read_u16le_inc(&rdptr);
@@ -208,19 +291,11 @@ static int omega_rtm_cli_process_rawdata(const struct sr_dev_inst *sdi)
 		 */
 		if (stamp)
 			stamp--;
-		count = stamp * 2;
-		if (devc->samples.check_count) {
-			if (count > devc->samples.remain_count)
-				count = devc->samples.remain_count;
-			devc->samples.remain_count -= count;
-		}
-		if (count) {
-			ret = feed_queue_logic_submit_one(devc->samples.queue,
-				devc->samples.last_sample, count);
-			if (ret != SR_OK)
-				break;
-			sr_sw_limits_update_samples_read(&devc->limits, count);
-		}
+		count = take_count(devc, stamp * 2);
+		ret = queue_run(devc, last, count);
+		samples += count;
+		if (ret != SR_OK)
+			break;
 		if (devc->samples.check_count && !devc->samples.remain_count)
 			break;
 
@@ -228,28 +303,22 @@ static int omega_rtm_cli_process_rawdata(const struct sr_dev_inst *sdi)
 		 * Also send the current samples. Keep the last value at
 		 * hand because future chunks might repeat it.
 		 */
-		write_u16le(devc->samples.last_sample, sample1);
-		ret = feed_queue_logic_submit_one(devc->samples.queue,
-			devc->samples.last_sample, 1);
+		count = take_count(devc, 2);
+		ret = queue_run(devc, sample1, 1);
+		if (ret == SR_OK && count > 1)
+			ret = queue_run(devc, sample2, 1);
+		last = count > 1 ? sample2 : sample1;
+		samples += count;
 		if (ret != SR_OK)
 			break;
-
-		write_u16le(devc->samples.last_sample, sample2);
-		ret = feed_queue_logic_submit_one(devc->samples.queue,
-			devc->samples.last_sample, 1);
-		if (ret != SR_OK)
+		if (devc->samples.check_count && !devc->samples.remain_count)
 			break;
-
-		count = 2;
-		sr_sw_limits_update_samples_read(&devc->limits, count);
-		if (devc->samples.check_count) {
-			if (count > devc->samples.remain_count)
-				count = devc->samples.remain_count;
-			devc->samples.remain_count -= count;
-			if (!devc->samples.remain_count)
-				break;
-		}
 	}
+	if (ret == SR_OK)
+		ret = flush_expanded(devc);
+	devc->samples.expand_fill = 0;
+	write_u16le(devc->samples.last_sample, last);
+	sr_sw_limits_update_samples_read(&devc->limits, samples);
 
 	/*
 	 * Silently consume all chunks which were successfully received.
@@ -286,7 +355,7 @@ SR_PRIV int omega_rtm_cli_receive_data(int fd, int revents, void *cb_data)
 	uint8_t *buff;
 	size_t space;
 	ssize_t rcvd;
-	int ret;
+	int reads, ret;
 
 	sdi = cb_data;
 	if (!sdi)
@@ -295,8 +364,17 @@ SR_PRIV int omega_rtm_cli_receive_data(int fd, int revents, void *cb_data)
 	if (!devc)
 		return TRUE;
 
-	/* Process receive data when available. */
-	if (revents & G_IO_IN) do {
+	/*
+	 * Process receive data when available. Where the pipe is not
+	 * blocking, drain it in several reads while it fills them, to
+	 * keep up with high signal activity.
+	 */
+#ifdef G_OS_UNIX
+	reads = RTMCLI_READS_PER_CALL;
+#else
+	reads = 1;
+#endif
+	if (revents & G_IO_IN) while (reads--) {
 		buff = &devc->rawdata.buff[devc->rawdata.fill];
 		space = sizeof(devc->rawdata.buff) - devc->rawdata.fill;
 		rcvd = read(fd, buff, space);
@@ -308,7 +386,9 @@ SR_PRIV int omega_rtm_cli_receive_data(int fd, int revents, void *cb_data)
 		if (ret != SR_OK) {
 			sr_err("Could not process sample data.");
 		}
-	} while (0);
+		if ((size_t)rcvd < space)
+			break;
+	}
 
 	/* Handle receive errors. */
 	if (revents & G_IO_ERR) {
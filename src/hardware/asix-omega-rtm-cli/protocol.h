@@ -29,7 +29,10 @@
 #define LOG_PREFIX "asix-omega-rtm-cli"
 
 #define RTMCLI_STDOUT_CHUNKSIZE (1024 * 1024)
+#define RTMCLI_READS_PER_CALL 8
 #define FEED_QUEUE_DEPTH (256 * 1024)
+#define EXPAND_SAMPLES (64 * 1024)
+#define EXPAND_LONG_RUN 256
 
 struct dev_context {
 	char **channel_names;
@@ -51,6 +54,9 @@ struct dev_context {
 		uint8_t last_sample[sizeof(uint16_t)];
 		uint64_t remain_count;
 		gboolean check_count;
+		/* Short runs get expanded here, in little endian format. */
+		uint16_t expand[EXPAND_SAMPLES];
+		size_t expand_fill;
 	} samples;
 };
 
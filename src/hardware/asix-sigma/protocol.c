@@ -381,8 +381,12 @@ static int sigma_read_pos(struct dev_context *devc,
 	return SR_OK;
 }
 
-static int sigma_read_dram(struct dev_context *devc,
-	size_t startchunk, size_t numchunks, uint8_t *data)
+/*
+ * Ask for DRAM content, which then gets sent back in numchunks rows
+ * of ROW_LENGTH_BYTES each.
+ */
+static int sigma_request_dram(struct dev_context *devc,
+	size_t startchunk, size_t numchunks)
 {
 	uint8_t buf[128], *wrptr, regval;
 	size_t chunk;
@@ -421,11 +425,7 @@ static int sigma_read_dram(struct dev_context *devc,
 		if (!is_last)
 			write_u8_inc(&wrptr, REG_DRAM_WAIT_ACK);
 	}
-	ret = sigma_write_sr(devc, buf, wrptr - buf);
-	if (ret != SR_OK)
-		return ret;
-
-	return sigma_read_sr(devc, data, numchunks * ROW_LENGTH_BYTES);
+	return sigma_write_sr(devc, buf, wrptr - buf);
 }
 
 /* Upload trigger look-up tables to Sigma. */
@@ -1266,28 +1266,76 @@ static int addto_submit_buffer(struct dev_context *devc,
 	struct submit_buffer *buffer;
 	struct sr_sw_limits *limits;
 	int ret;
+	size_t n, i;
+	uint64_t remain;
+	gboolean exceeded;
 
 	buffer = devc->buffer;
 	limits = &devc->limit.submit;
-	if (!devc->use_triggers && sr_sw_limits_check(limits))
-		count = 0;
 
 	/*
-	 * Individually accumulate and check each sample, such that
-	 * accumulation between flushes won't exceed local storage, and
-	 * enforcement of user specified limits is exact.
+	 * Accumulate as many samples at once as fit into local storage
+	 * and are within user specified limits, such that accumulation
+	 * between flushes won't exceed local storage, and enforcement
+	 * of user specified limits is exact.
 	 */
-	while (count--) {
-		write_u16le_inc(&buffer->write_pointer, sample);
-		buffer->curr_samples++;
+	while (count) {
+		n = MIN(count, buffer->max_samples - buffer->curr_samples);
+		if (!devc->use_triggers && limits->limit_samples) {
+			sr_sw_limits_get_remain(limits, &remain, NULL, NULL,
+				&exceeded);
+			if (exceeded)
+				break;
+			n = MIN(n, remain);
+		}
+		for (i = 0; i < n; i++)
+			write_u16le_inc(&buffer->write_pointer, sample);
+		buffer->curr_samples += n;
+		count -= n;
 		if (buffer->curr_samples == buffer->max_samples) {
 			ret = flush_submit_buffer(devc);
 			if (ret != SR_OK)
 				return ret;
 		}
-		sr_sw_limits_update_samples_read(limits, 1);
-		if (!devc->use_triggers && sr_sw_limits_check(limits))
-			break;
+		sr_sw_limits_update_samples_read(limits, n);
+	}
+
+	return SR_OK;
+}
+
+/* Like addto_submit_buffer(), for a run of different samples. */
+static int addto_submit_samples(struct dev_context *devc,
+	const uint16_t *samples, size_t count)
+{
+	struct submit_buffer *buffer;
+	struct sr_sw_limits *limits;
+	int ret;
+	size_t n, i;
+	uint64_t remain;
+	gboolean exceeded;
+
+	buffer = devc->buffer;
+	limits = &devc->limit.submit;
+
+	while (count) {
+		n = MIN(count, buffer->max_samples - buffer->curr_samples);
+		if (!devc->use_triggers && limits->limit_samples) {
+			sr_sw_limits_get_remain(limits, &remain, NULL, NULL,
+				&exceeded);
+			if (exceeded)
+				break;
+			n = MIN(n, remain);
+		}
+		for (i = 0; i < n; i++)
+			write_u16le_inc(&buffer->write_pointer, *samples++);
+		buffer->curr_samples += n;
+		count -= n;
+		if (buffer->curr_samples == buffer->max_samples) {
+			ret = flush_submit_buffer(devc);
+			if (ret != SR_OK)
+				return ret;
+		}
+		sr_sw_limits_update_samples_read(limits, n);
 	}
 
 	return SR_OK;
@@ -1447,10 +1495,14 @@ static int alloc_sample_buffer(struct dev_context *devc,
 	interp->fetch.lines_total %= ROW_COUNT;
 	interp->fetch.lines_done = 0;
 
-	/* Arrange for chunked download, N lines per USB request. */
+	/*
+	 * Arrange for chunked download, N lines per USB request. Space
+	 * for twice as many to receive the next while decoding one.
+	 */
 	interp->fetch.lines_per_read = 32;
+	interp->fetch.next_line = interp->start.line;
 	alloc_size = sizeof(devc->interp.fetch.rcvd_lines[0]);
-	alloc_size *= devc->interp.fetch.lines_per_read;
+	alloc_size *= 2 * devc->interp.fetch.lines_per_read;
 	devc->interp.fetch.rcvd_lines = g_try_malloc0(alloc_size);
 	if (!devc->interp.fetch.rcvd_lines)
 		return SR_ERR_MALLOC;
@@ -1461,11 +1513,80 @@ static int alloc_sample_buffer(struct dev_context *devc,
 static uint16_t sigma_deinterlace_data_4x4(uint16_t indata, int idx);
 static uint16_t sigma_deinterlace_data_2x8(uint16_t indata, int idx);
 
-static int fetch_sample_buffer(struct dev_context *devc)
+/*
+ * Request the next set of DRAM lines, and start reading them into the
+ * half of the receive buffer which is not being decoded.
+ */
+static int fetch_submit(struct dev_context *devc)
 {
 	struct sigma_sample_interp *interp;
+	struct sigma_dram_line *lines;
 	size_t count;
 	int ret;
+
+	interp = &devc->interp;
+
+	count = interp->fetch.lines_total - interp->fetch.lines_requested;
+	if (count > interp->fetch.lines_per_read)
+		count = interp->fetch.lines_per_read;
+	if (!count)
+		return SR_OK;
+
+	ret = sigma_request_dram(devc, interp->fetch.next_line, count);
+	if (ret != SR_OK)
+		return ret;
+
+	lines = interp->fetch.rcvd_lines;
+	if (interp->fetch.curr_line < lines + interp->fetch.lines_per_read)
+		lines += interp->fetch.lines_per_read;
+	interp->fetch.pending = ftdi_read_data_submit(&devc->ftdi.ctx,
+		(unsigned char *)lines, count * ROW_LENGTH_BYTES);
+	if (!interp->fetch.pending) {
+		sr_err("USB data read failed: %s",
+			ftdi_get_error_string(&devc->ftdi.ctx));
+		return SR_ERR_IO;
+	}
+	interp->fetch.pending_lines = lines;
+	interp->fetch.pending_count = count;
+	interp->fetch.lines_requested += count;
+	interp->fetch.next_line += count;
+	interp->fetch.next_line %= ROW_COUNT;
+
+	return SR_OK;
+}
+
+/* Wait for the read in flight to complete. */
+static int fetch_complete(struct dev_context *devc)
+{
+	struct sigma_sample_interp *interp;
+	int ret;
+
+	interp = &devc->interp;
+
+	ret = ftdi_transfer_data_done(interp->fetch.pending);
+	interp->fetch.pending = NULL;
+	if (ret < 0) {
+		sr_err("USB data read failed: %s",
+			ftdi_get_error_string(&devc->ftdi.ctx));
+		return SR_ERR_IO;
+	}
+	if ((size_t)ret != interp->fetch.pending_count * ROW_LENGTH_BYTES)
+		return SR_ERR_IO;
+
+	interp->fetch.lines_rcvd = interp->fetch.pending_count;
+	interp->fetch.curr_line = interp->fetch.pending_lines;
+
+	return SR_OK;
+}
+
+/*
+ * Get another set of DRAM lines. With prefetch, the read of the set
+ * after it gets started, and completes while this one is decoded.
+ */
+static int fetch_sample_buffer(struct dev_context *devc, gboolean prefetch)
+{
+	struct sigma_sample_interp *interp;
+	int ret;
 	const uint8_t *rdptr;
 	uint16_t ts, data;
 
@@ -1476,16 +1597,19 @@ static int fetch_sample_buffer(struct dev_context *devc)
 		interp->iter = interp->start;
 	}
 
-	/* Get another set of DRAM lines in one read call. */
-	count = interp->fetch.lines_total - interp->fetch.lines_done;
-	if (count > interp->fetch.lines_per_read)
-		count = interp->fetch.lines_per_read;
-	ret = sigma_read_dram(devc, interp->iter.line, count,
-		(uint8_t *)interp->fetch.rcvd_lines);
+	if (!interp->fetch.pending) {
+		ret = fetch_submit(devc);
+		if (ret != SR_OK)
+			return ret;
+	}
+	ret = fetch_complete(devc);
 	if (ret != SR_OK)
 		return ret;
-	interp->fetch.lines_rcvd = count;
-	interp->fetch.curr_line = &interp->fetch.rcvd_lines[0];
+	if (prefetch) {
+		ret = fetch_submit(devc);
+		if (ret != SR_OK)
+			return ret;
+	}
 
 	/* First invocation? Get initial timestamp and sample data. */
 	if (!interp->fetch.lines_done) {
@@ -1506,9 +1630,11 @@ static int fetch_sample_buffer(struct dev_context *devc)
 
 static void free_sample_buffer(struct dev_context *devc)
 {
+	/* The buffer must not be released while a read is in flight. */
+	if (devc->interp.fetch.pending)
+		(void)ftdi_transfer_data_done(devc->interp.fetch.pending);
 	g_free(devc->interp.fetch.rcvd_lines);
-	devc->interp.fetch.rcvd_lines = NULL;
-	devc->interp.fetch.lines_per_read = 0;
+	memset(&devc->interp.fetch, 0, sizeof(devc->interp.fetch));
 }
 
 /*
@@ -1848,6 +1974,40 @@ static uint16_t sigma_deinterlace_data_4x4(uint16_t indata, int idx)
 	return outdata;
 }
 
+/*
+ * Decode all events of a cluster in one go, for clusters where no
+ * trigger match checks are involved.
+ */
+static void sigma_decode_dram_cluster_bulk(struct dev_context *devc,
+	struct sigma_dram_cluster *dram_cluster,
+	size_t events_in_cluster)
+{
+	uint16_t samples[EVENTS_PER_CLUSTER * 4], item16, *wrptr;
+	size_t evt, count, idx;
+
+	count = 0;
+	for (evt = 0; evt < events_in_cluster; evt++) {
+		item16 = sigma_dram_cluster_data(dram_cluster, evt);
+		wrptr = &samples[count];
+		if (devc->interp.samples_per_event == 4) {
+			for (idx = 0; idx < 4; idx++)
+				wrptr[idx] = sigma_deinterlace_data_4x4(item16, idx);
+			count += 4;
+		} else if (devc->interp.samples_per_event == 2) {
+			for (idx = 0; idx < 2; idx++)
+				wrptr[idx] = sigma_deinterlace_data_2x8(item16, idx);
+			count += 2;
+		} else {
+			samples[count++] = item16;
+		}
+		sigma_location_increment(&devc->interp.iter);
+	}
+	if (!count)
+		return;
+	(void)addto_submit_samples(devc, samples, count);
+	devc->interp.last.sample = samples[count - 1];
+}
+
 static void sigma_decode_dram_cluster(struct dev_context *devc,
 	struct sigma_dram_cluster *dram_cluster,
 	size_t events_in_cluster)
@@ -1855,6 +2015,7 @@ static void sigma_decode_dram_cluster(struct dev_context *devc,
 	uint16_t tsdiff, ts, sample, item16;
 	size_t count;
 	size_t evt;
+	struct sigma_sample_interp *interp;
 
 	/*
 	 * If this cluster is not adjacent to the previously received
@@ -1875,6 +2036,18 @@ static void sigma_decode_dram_cluster(struct dev_context *devc,
 	}
 	devc->interp.last.ts = ts + EVENTS_PER_CLUSTER;
 
+	/*
+	 * Unless software trigger checks are armed, or get armed within
+	 * this cluster, no event needs looking at individually.
+	 */
+	interp = &devc->interp;
+	if (!interp->trig_chk.armed && (interp->trig_chk.matched ||
+			!sigma_location_is_eq(&interp->iter, &interp->trig_arm, FALSE))) {
+		sigma_decode_dram_cluster_bulk(devc, dram_cluster,
+			events_in_cluster);
+		return;
+	}
+
 	/*
 	 * Grab sample data from the current cluster and prepare their
 	 * submission to the session feed. Handle samplerate dependent
@@ -2053,8 +2226,12 @@ static int download_capture(struct sr_dev_inst *sdi)
 	while (interp->fetch.lines_done < interp->fetch.lines_total) {
 		size_t dl_events_in_line;
 
-		/* Read another chunk of sample memory (several lines). */
-		ret = fetch_sample_buffer(devc);
+		/*
+		 * Read another chunk of sample memory (several lines).
+		 * Have the next one load while this one gets decoded,
+		 * unless control returns to the application after it.
+		 */
+		ret = fetch_sample_buffer(devc, chunks_per_receive_call > 1);
 		if (ret != SR_OK)
 			return FALSE;
 
@@ -2202,45 +2379,17 @@ SR_PRIV int sigma_receive_data(int fd, int revents, void *cb_data)
 static void build_lut_entry(uint16_t *lut_entry,
 	uint16_t spec_value, uint16_t spec_mask)
 {
-	size_t quad, bitidx, ch;
-	uint16_t quadmask, bitmask;
-	gboolean spec_value_low, bit_idx_low;
+	size_t quad;
 
 	/*
-	 * For each quad-channel-group, for each bit in the LUT (each
-	 * bit pattern of the channel signals, aka LUT address), for
-	 * each channel in the quad, setup the bit in the LUT entry.
-	 *
-	 * Start from all-ones in the LUT (true, always matches), then
-	 * "pessimize the truthness" for specified conditions.
+	 * One LUT per quad-channel-group, addressed by the levels of
+	 * its channels. Unspecified channels match on any level.
 	 */
-	for (quad = 0; quad < 4; quad++) {
-		lut_entry[quad] = ~0;
-		for (bitidx = 0; bitidx < 16; bitidx++) {
-			for (ch = 0; ch < 4; ch++) {
-				quadmask = BIT(ch);
-				bitmask = quadmask << (quad * 4);
-				if (!(spec_mask & bitmask))
-					continue;
-				/*
-				 * This bit is part of the spec. The
-				 * condition which gets checked here
-				 * (got checked in all implementations
-				 * so far) is uncertain. A bit position
-				 * in the current index' number(!) is
-				 * checked?
-				 */
-				spec_value_low = !(spec_value & bitmask);
-				bit_idx_low = !(bitidx & quadmask);
-				if (spec_value_low == bit_idx_low)
-					continue;
-				lut_entry[quad] &= ~BIT(bitidx);
-			}
-		}
-	}
+	for (quad = 0; quad < 4; quad++)
+		lut_entry[quad] = hw_trigger_lut(spec_value, spec_mask,
+			quad * 4, 4);
 }
 
-/* Add a logical function to LUT mask. */
 static void add_trigger_function(enum triggerop oper, enum triggerfunc func,
 	size_t index, gboolean neg, uint16_t *mask)
 {
@@ -367,8 +367,14 @@ struct dev_context {
 			size_t lines_total, lines_done;
 			size_t lines_per_read; /* USB transfer limit */
 			size_t lines_rcvd;
+			/* Two halves, one gets decoded while the other loads. */
 			struct sigma_dram_line *rcvd_lines;
 			struct sigma_dram_line *curr_line;
+			/* The read that is in flight, if any. */
+			struct ftdi_transfer_control *pending;
+			struct sigma_dram_line *pending_lines;
+			size_t pending_count;
+			size_t lines_requested, next_line;
 		} fetch;
 		struct {
 			gboolean armed;
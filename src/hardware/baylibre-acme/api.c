@@ -246,6 +246,9 @@ static void dev_acquisition_close(const struct sr_dev_inst *sdi)
 	GSList *chl;
 	struct sr_channel *ch;
 
+	for (chl = sdi->channel_groups; chl; chl = chl->next)
+		bl_acme_close_probe(chl->data);
+
 	for (chl = sdi->channels; chl; chl = chl->next) {
 		ch = chl->data;
 		bl_acme_close_channel(ch);
@@ -266,6 +269,13 @@ static int dev_acquisition_open(const struct sr_dev_inst *sdi)
 		}
 	}
 
+	for (chl = sdi->channel_groups; chl; chl = chl->next) {
+		if (bl_acme_open_probe(chl->data) != SR_OK) {
+			dev_acquisition_close(sdi);
+			return SR_ERR;
+		}
+	}
+
 	return 0;
 }
 
@@ -39,20 +39,44 @@ enum channel_type {
 	TEMP_OUT,
 };
 
+/*
+ * Probes which are bound to the ina2xx-adc IIO driver instead of the
+ * hwmon one get read in buffered mode: the kernel samples the chip on
+ * its own and queues binary scans, which we drain once per tick.
+ */
+#define IIO_BUFFER_SCANS	64
+
 struct channel_group_priv {
 	uint8_t rev;
 	int hwmon_num;
+	int iio_num;
+	int iio_fd;
+	size_t scan_size;
+	uint8_t *scan_buf;
 	int probe_type;
 	int index;
 	int has_pws;
 	uint32_t pws_gpio;
 };
 
+/* Layout of a channel within an IIO scan. */
+struct scan_elem {
+	int index;
+	size_t offset;
+	size_t bytes;
+	unsigned int bits;
+	unsigned int shift;
+	gboolean is_signed;
+	gboolean big_endian;
+	double scale;
+};
+
 struct channel_priv {
 	int ch_type;
 	int fd;
 	int digits;
 	float val;
+	struct scan_elem elem;
 	struct channel_group_priv *probe;
 };
 
@@ -182,7 +206,7 @@ SR_PRIV gboolean bl_acme_detect_probe(unsigned int addr,
 		 */
 		probe_hwmon_path(addr, path);
 		status = g_file_test(path->str, G_FILE_TEST_IS_DIR);
-		if (status) {
+		if (status || get_iio_index(addr) >= 0) {
 			/* We have found an ACME probe. */
 			ret = TRUE;
 		}
@@ -194,6 +218,34 @@ SR_PRIV gboolean bl_acme_detect_probe(unsigned int addr,
 	return ret;
 }
 
+/*
+ * Find the IIO device of a probe, if the ina2xx-adc driver took it.
+ * Returns -1 when there is none.
+ */
+static int get_iio_index(unsigned int addr)
+{
+	GString *path = g_string_sized_new(64);
+	const char *name;
+	GDir *dir;
+	int iio;
+
+	g_string_printf(path, "/sys/class/i2c-adapter/i2c-1/1-00%02x", addr);
+	dir = g_dir_open(path->str, 0, NULL);
+	g_string_free(path, TRUE);
+	if (!dir)
+		return -1;
+
+	iio = -1;
+	while ((name = g_dir_read_name(dir))) {
+		if (sscanf(name, "iio:device%d", &iio) == 1)
+			break;
+		iio = -1;
+	}
+	g_dir_close(dir);
+
+	return iio;
+}
+
 static int get_hwmon_index(unsigned int addr)
 {
 	int status, hwmon;
@@ -324,13 +376,19 @@ SR_PRIV gboolean bl_acme_register_probe(struct sr_dev_inst *sdi, int type,
 	struct sr_channel_group *cg;
 	struct channel_group_priv *cgp;
 	struct probe_eeprom eeprom;
-	int hwmon, status;
+	int hwmon, iio, status;
 	uint32_t gpio;
 
-	/* Obtain the hwmon index. */
-	hwmon = get_hwmon_index(addr);
-	if (hwmon < 0)
-		return FALSE;
+	/* Prefer buffered IIO capture, else obtain the hwmon index. */
+	hwmon = -1;
+	iio = type == PROBE_ENRG ? get_iio_index(addr) : -1;
+	if (iio < 0) {
+		hwmon = get_hwmon_index(addr);
+		if (hwmon < 0)
+			return FALSE;
+	} else {
+		sr_dbg("Probe %d uses IIO device %d.", prb_num, iio);
+	}
 
 	cgp = g_malloc0(sizeof(struct channel_group_priv));
 	cg = sr_channel_group_new(sdi, NULL, cgp);
@@ -346,6 +404,8 @@ SR_PRIV gboolean bl_acme_register_probe(struct sr_dev_inst *sdi, int type,
 	prb_num = cgp->rev == ACME_REV_A ? prb_num : revB_addr_to_num(addr);
 
 	cgp->hwmon_num = hwmon;
+	cgp->iio_num = iio;
+	cgp->iio_fd = -1;
 	cgp->probe_type = type;
 	cgp->index = prb_num - 1;
 	cg->name = g_strdup_printf("Probe_%d", prb_num);
@@ -413,9 +473,14 @@ static int get_shunt_path(const struct sr_channel_group *cg, GString *path)
 		return SR_ERR_ARG;
 	}
 
-	g_string_append_printf(path,
-			       "/sys/class/hwmon/hwmon%d/shunt_resistor",
-			       cgp->hwmon_num);
+	if (cgp->iio_num >= 0)
+		g_string_append_printf(path,
+				"/sys/bus/iio/devices/iio:device%d/in_shunt_resistor",
+				cgp->iio_num);
+	else
+		g_string_append_printf(path,
+				"/sys/class/hwmon/hwmon%d/shunt_resistor",
+				cgp->hwmon_num);
 
 	/*
 	 * The shunt_resistor sysfs attribute is available
@@ -448,6 +513,8 @@ SR_PRIV void bl_acme_maybe_set_update_interval(const struct sr_dev_inst *sdi,
 	for (l = sdi->channel_groups; l != NULL; l = l->next) {
 		cg = l->data;
 		cgp = cg->priv;
+		if (cgp->hwmon_num < 0)
+			continue;
 
 		hwmon = g_string_sized_new(64);
 		g_string_append_printf(hwmon,
@@ -629,30 +696,140 @@ static int type_digits(int type)
 	}
 }
 
+/*
+ * Persistent file descriptors get read with pread(), which saves the
+ * lseek() call per sample.
+ */
 static float read_sample(struct sr_channel *ch)
 {
 	struct channel_priv *chp;
 	char buf[16];
 	ssize_t len;
-	int fd;
 
 	chp = ch->priv;
-	fd = chp->fd;
-
-	lseek(fd, 0, SEEK_SET);
 
-	len = read(fd, buf, sizeof(buf));
+	len = pread(chp->fd, buf, sizeof(buf) - 1, 0);
 	if (len < 0) {
 		sr_err("Error reading from channel %s (hwmon: %d): %s",
 			ch->name, chp->probe->hwmon_num, g_strerror(errno));
 		ch->enabled = FALSE;
 		return -1.0;
 	}
+	buf[len] = '\0';
 
 	chp->digits = type_digits(chp->ch_type);
 	return strtol(buf, NULL, 10) * powf(10, -chp->digits);
 }
 
+static const char *iio_channel_name(int type)
+{
+	switch (type) {
+	case ENRG_PWR:	return "in_power2";
+	case ENRG_CURR:	return "in_current3";
+	case ENRG_VOL:	return "in_voltage1";
+	default:	return NULL;
+	}
+}
+
+static char *iio_read_attr(int iio_num, const char *attr)
+{
+	char *path, *contents;
+
+	path = g_strdup_printf("/sys/bus/iio/devices/iio:device%d/%s",
+			       iio_num, attr);
+	if (!g_file_get_contents(path, &contents, NULL, NULL))
+		contents = NULL;
+	g_free(path);
+
+	return contents;
+}
+
+static int iio_write_attr(int iio_num, const char *attr, const char *value)
+{
+	char *path;
+	FILE *fd;
+	int ret;
+
+	path = g_strdup_printf("/sys/bus/iio/devices/iio:device%d/%s",
+			       iio_num, attr);
+	/* See bl_acme_set_shunt() for why this isn't g_file_set_contents(). */
+	fd = g_fopen(path, "w");
+	if (!fd) {
+		sr_err("Error opening %s: %s", path, g_strerror(errno));
+		g_free(path);
+		return SR_ERR_IO;
+	}
+	ret = fprintf(fd, "%s\n", value) < 0 ? SR_ERR_IO : SR_OK;
+	if (fclose(fd) != 0)
+		ret = SR_ERR_IO;
+	g_free(path);
+
+	return ret;
+}
+
+/* Enable a channel's scan element, and learn its format. */
+static int iio_open_channel(struct sr_channel *ch)
+{
+	struct channel_priv *chp;
+	struct scan_elem *elem;
+	const char *name;
+	char *attr, *val, endian, sign;
+	unsigned int bits, storage, shift;
+	int ret;
+
+	chp = ch->priv;
+	elem = &chp->elem;
+	name = iio_channel_name(chp->ch_type);
+	if (!name) {
+		sr_err("Invalid channel type: %d.", chp->ch_type);
+		return SR_ERR;
+	}
+
+	attr = g_strdup_printf("scan_elements/%s_en", name);
+	ret = iio_write_attr(chp->probe->iio_num, attr, "1");
+	g_free(attr);
+	if (ret != SR_OK)
+		return ret;
+
+	attr = g_strdup_printf("scan_elements/%s_index", name);
+	val = iio_read_attr(chp->probe->iio_num, attr);
+	g_free(attr);
+	if (!val)
+		return SR_ERR_IO;
+	elem->index = strtol(val, NULL, 10);
+	g_free(val);
+
+	/* Formatted like "le:s16/16>>0". */
+	attr = g_strdup_printf("scan_elements/%s_type", name);
+	val = iio_read_attr(chp->probe->iio_num, attr);
+	g_free(attr);
+	if (!val)
+		return SR_ERR_IO;
+	ret = sscanf(val, "%ce:%c%u/%u>>%u",
+		     &endian, &sign, &bits, &storage, &shift);
+	g_free(val);
+	if (ret != 5 || storage % 8 || storage > 64 || !bits) {
+		sr_err("Unsupported scan element format for %s.", ch->name);
+		return SR_ERR_DATA;
+	}
+	elem->big_endian = endian == 'b';
+	elem->is_signed = sign == 's';
+	elem->bits = bits;
+	elem->bytes = storage / 8;
+	elem->shift = shift;
+
+	/* The driver reports in mW, mA and mV. */
+	attr = g_strdup_printf("%s_scale", name);
+	val = iio_read_attr(chp->probe->iio_num, attr);
+	g_free(attr);
+	elem->scale = (val ? g_ascii_strtod(val, NULL) : 1.0) / 1000.0;
+	g_free(val);
+
+	chp->digits = type_digits(chp->ch_type);
+
+	return SR_OK;
+}
+
 SR_PRIV int bl_acme_open_channel(struct sr_channel *ch)
 {
 	struct channel_priv *chp;
@@ -662,6 +839,11 @@ SR_PRIV int bl_acme_open_channel(struct sr_channel *ch)
 
 	chp = ch->priv;
 
+	if (chp->probe->iio_num >= 0) {
+		chp->fd = -1;
+		return ch->enabled ? iio_open_channel(ch) : SR_OK;
+	}
+
 	switch (chp->ch_type) {
 	case ENRG_PWR:	file = "power1_input";	break;
 	case ENRG_CURR:	file = "curr1_input";	break;
@@ -693,10 +875,194 @@ SR_PRIV void bl_acme_close_channel(struct sr_channel *ch)
 	struct channel_priv *chp;
 
 	chp = ch->priv;
-	close(chp->fd);
+	if (chp->fd >= 0)
+		close(chp->fd);
 	chp->fd = -1;
 }
 
+static gint elem_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct channel_priv *ca, *cb;
+
+	ca = ((const struct sr_channel *)a)->priv;
+	cb = ((const struct sr_channel *)b)->priv;
+
+	return ca->elem.index - cb->elem.index;
+}
+
+/*
+ * Start buffered capture of an IIO probe, after its channels' scan
+ * elements were enabled. Scan elements are placed in index order,
+ * each aligned to its own size.
+ */
+SR_PRIV int bl_acme_open_probe(struct sr_channel_group *cg)
+{
+	struct channel_group_priv *cgp;
+	struct channel_priv *chp;
+	struct sr_channel *ch;
+	GSList *elems, *l;
+	size_t offset, align;
+	char *path, *len;
+	int ret;
+
+	cgp = cg->priv;
+	if (cgp->iio_num < 0)
+		return SR_OK;
+
+	elems = NULL;
+	for (l = cg->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->enabled)
+			elems = g_slist_insert_sorted(elems, ch, elem_cmp);
+	}
+	if (!elems)
+		return SR_OK;
+
+	offset = align = 0;
+	for (l = elems; l; l = l->next) {
+		chp = ((struct sr_channel *)l->data)->priv;
+		offset = (offset + chp->elem.bytes - 1) / chp->elem.bytes *
+			 chp->elem.bytes;
+		chp->elem.offset = offset;
+		offset += chp->elem.bytes;
+		align = MAX(align, chp->elem.bytes);
+	}
+	g_slist_free(elems);
+	cgp->scan_size = (offset + align - 1) / align * align;
+	cgp->scan_buf = g_malloc(cgp->scan_size * IIO_BUFFER_SCANS);
+
+	len = g_strdup_printf("%d", IIO_BUFFER_SCANS * 4);
+	ret = iio_write_attr(cgp->iio_num, "buffer/length", len);
+	g_free(len);
+	if (ret == SR_OK)
+		ret = iio_write_attr(cgp->iio_num, "buffer/enable", "1");
+	if (ret != SR_OK) {
+		sr_err("Cannot start buffered capture on %s.", cg->name);
+		return ret;
+	}
+
+	path = g_strdup_printf("/dev/iio:device%d", cgp->iio_num);
+	cgp->iio_fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (cgp->iio_fd < 0) {
+		sr_err("Error opening %s: %s", path, g_strerror(errno));
+		g_free(path);
+		iio_write_attr(cgp->iio_num, "buffer/enable", "0");
+		return SR_ERR;
+	}
+	g_free(path);
+
+	return SR_OK;
+}
+
+SR_PRIV void bl_acme_close_probe(struct sr_channel_group *cg)
+{
+	struct channel_group_priv *cgp;
+
+	cgp = cg->priv;
+	g_free(cgp->scan_buf);
+	cgp->scan_buf = NULL;
+	if (cgp->iio_fd < 0)
+		return;
+
+	close(cgp->iio_fd);
+	cgp->iio_fd = -1;
+	iio_write_attr(cgp->iio_num, "buffer/enable", "0");
+}
+
+static float decode_elem(const struct scan_elem *elem, const uint8_t *scan)
+{
+	const uint8_t *p;
+	uint64_t raw;
+	int64_t val;
+	size_t i;
+
+	p = scan + elem->offset;
+	raw = 0;
+	for (i = 0; i < elem->bytes; i++) {
+		if (elem->big_endian)
+			raw = (raw << 8) | p[i];
+		else
+			raw |= (uint64_t)p[i] << (8 * i);
+	}
+	raw >>= elem->shift;
+	if (elem->bits < 64)
+		raw &= (UINT64_C(1) << elem->bits) - 1;
+	val = raw;
+	if (elem->is_signed && elem->bits < 64 &&
+	    (raw & (UINT64_C(1) << (elem->bits - 1))))
+		val -= (int64_t)(UINT64_C(1) << elem->bits);
+
+	return val * elem->scale;
+}
+
+/*
+ * Drain the scans which the kernel queued since the last tick, and take
+ * the values of the most recent one. Without a new scan the channels
+ * keep their previous values.
+ */
+static void read_probe_scans(struct sr_channel_group *cg)
+{
+	struct channel_group_priv *cgp;
+	struct channel_priv *chp;
+	struct sr_channel *ch;
+	const uint8_t *last;
+	ssize_t len;
+	GSList *l;
+
+	cgp = cg->priv;
+	last = NULL;
+	while (TRUE) {
+		len = read(cgp->iio_fd, cgp->scan_buf,
+			   cgp->scan_size * IIO_BUFFER_SCANS);
+		if (len < (ssize_t)cgp->scan_size)
+			break;
+		last = cgp->scan_buf + (len / cgp->scan_size - 1) *
+		       cgp->scan_size;
+		if (len < (ssize_t)(cgp->scan_size * IIO_BUFFER_SCANS))
+			break;
+	}
+	if (len < 0 && errno != EAGAIN)
+		sr_warn("Error reading from %s: %s", cg->name,
+			g_strerror(errno));
+	if (!last)
+		return;
+
+	for (l = cg->channels; l; l = l->next) {
+		ch = l->data;
+		chp = ch->priv;
+		if (ch->enabled)
+			chp->val = decode_elem(&chp->elem, last);
+	}
+}
+
+/*
+ * Take one sample of all enabled channels, before any of them is sent.
+ * IIO probes deliver all their channels with one read.
+ */
+static void read_samples(const struct sr_dev_inst *sdi)
+{
+	struct sr_channel_group *cg;
+	struct channel_group_priv *cgp;
+	struct sr_channel *ch;
+	struct channel_priv *chp;
+	GSList *l, *chl;
+
+	for (l = sdi->channel_groups; l; l = l->next) {
+		cg = l->data;
+		cgp = cg->priv;
+		if (cgp->iio_fd >= 0) {
+			read_probe_scans(cg);
+			continue;
+		}
+		for (chl = cg->channels; chl; chl = chl->next) {
+			ch = chl->data;
+			chp = ch->priv;
+			if (ch->enabled && chp->fd >= 0)
+				chp->val = read_sample(ch);
+		}
+	}
+}
+
 SR_PRIV int bl_acme_receive_data(int fd, int revents, void *cb_data)
 {
 	uint64_t nrexpiration;
@@ -739,6 +1105,8 @@ SR_PRIV int bl_acme_receive_data(int fd, int revents, void *cb_data)
 	if (nrexpiration > 1)
 		devc->samples_missed += nrexpiration - 1;
 
+	read_samples(sdi);
+
 	/*
 	 * XXX This is a nasty workaround...
 	 *
@@ -748,9 +1116,9 @@ SR_PRIV int bl_acme_receive_data(int fd, int revents, void *cb_data)
 	 * plots.
 	 *
 	 * To compensate for the delay we check if any clock events were
-	 * missed and - if so - don't really read the next value, but send
-	 * the same sample as fast as possible. We do it until we are back
-	 * on schedule.
+	 * missed and - if so - don't read values again, but send the same
+	 * sample as fast as possible. We do it until we are back on
+	 * schedule.
 	 *
 	 * At high sampling rate this doesn't seem to visibly reduce the
 	 * accuracy.
@@ -775,9 +1143,6 @@ SR_PRIV int bl_acme_receive_data(int fd, int revents, void *cb_data)
 			analog.meaning->mq = channel_to_mq(chl->data);
 			analog.meaning->unit = channel_to_unit(ch);
 
-			if (i < 1)
-				chp->val = read_sample(ch);
-
 			analog.encoding->digits  = chp->digits;
 			analog.spec->spec_digits = chp->digits;
 			analog.data = &chp->val;
@@ -89,4 +89,8 @@ SR_PRIV int bl_acme_receive_data(int fd, int revents, void *cb_data);
 SR_PRIV int bl_acme_open_channel(struct sr_channel *ch);
 
 SR_PRIV void bl_acme_close_channel(struct sr_channel *ch);
+
+SR_PRIV int bl_acme_open_probe(struct sr_channel_group *cg);
+
+SR_PRIV void bl_acme_close_probe(struct sr_channel_group *cg);
 #endif
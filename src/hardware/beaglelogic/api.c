@@ -110,7 +110,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	/* Default non-zero values (if any) */
 	devc->fd = -1;
 	devc->limit_samples = 10000000;
-	devc->tcp_buffer = 0;
+	devc->tcp_codec = -1;
 
 	if (!conn) {
 		devc->beaglelogic = &beaglelogic_native_ops;
@@ -187,7 +187,9 @@ static int dev_open(struct sr_dev_inst *sdi)
 			return SR_ERR;
 		}
 	} else {
-		devc->tcp_buffer = g_malloc(TCP_BUFFER_SIZE);
+		devc->tcp_pool = beaglelogic_tcp_pool_new();
+		devc->tcp_rx = g_malloc(TCP_RX_SIZE);
+		devc->tcp_rx_len = 0;
 	}
 
 	return SR_OK;
@@ -197,17 +199,27 @@ static int dev_close(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc = sdi->priv;
 
+	if (devc->stl) {
+		soft_trigger_logic_free(devc->stl);
+		devc->stl = NULL;
+	}
+
 	/* Close the memory mapping and the file */
 	if (devc->beaglelogic == &beaglelogic_native_ops)
 		devc->beaglelogic->munmap(devc);
 	devc->beaglelogic->close(devc);
 
+	/* Packets still held by consumers keep the pool alive. */
+	beaglelogic_tcp_pool_unref(devc->tcp_pool);
+	devc->tcp_pool = NULL;
+	g_free(devc->tcp_rx);
+	devc->tcp_rx = NULL;
+
 	return SR_OK;
 }
 
 static void clear_helper(struct dev_context *devc)
 {
-	g_free(devc->tcp_buffer);
 	g_free(devc->address);
 	g_free(devc->port);
 }
@@ -332,6 +344,15 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	if (devc->triggerflags == BL_TRIGGERFLAGS_CONTINUOUS)
 		devc->limit_samples = UINT64_MAX;
 
+	/*
+	 * Release pre-trigger data of a previous acquisition, it can
+	 * hold packets in the kernel buffer.
+	 */
+	if (devc->stl) {
+		soft_trigger_logic_free(devc->stl);
+		devc->stl = NULL;
+	}
+
 	/* Configure triggers & send header packet */
 	if ((trigger = sr_session_trigger_get(sdi->session))) {
 		int pre_trigger_samples = 0;
@@ -119,19 +119,45 @@ static int beaglelogic_set_bufunitsize(struct dev_context *devc)
 	return ioctl(devc->fd, IOCTL_BL_SET_BUFUNIT_SIZE, devc->bufunitsize);
 }
 
+/* Unmap once the last packet in the kernel buffer was released. */
+static void beaglelogic_mapping_release(void *data, void *cb_data)
+{
+	struct beaglelogic_mapping *map;
+
+	map = cb_data;
+	munmap(data, map->size);
+	g_free(map);
+}
+
 static int beaglelogic_mmap(struct dev_context *devc)
 {
+	struct beaglelogic_mapping *map;
+
 	if (!devc->buffersize)
 		beaglelogic_get_buffersize(devc);
 	devc->sample_buf = mmap(NULL, devc->buffersize,
 			PROT_READ, MAP_SHARED, devc->fd, 0);
+	if (devc->sample_buf == MAP_FAILED)
+		return -1;
 
-	return ((devc->sample_buf == MAP_FAILED) ? -1 : SR_OK);
+	map = g_malloc0(sizeof(*map));
+	map->size = devc->buffersize;
+	devc->map = map;
+	devc->mapping = sr_buffer_new(devc->sample_buf, map->size,
+			beaglelogic_mapping_release, map);
+
+	return SR_OK;
 }
 
+/* Consumers may still hold packets, which keep the mapping alive. */
 static int beaglelogic_munmap(struct dev_context *devc)
 {
-	return munmap(devc->sample_buf, devc->buffersize);
+	sr_buffer_unref(devc->mapping);
+	devc->mapping = NULL;
+	devc->map = NULL;
+	devc->sample_buf = NULL;
+
+	return SR_OK;
 }
 
 SR_PRIV const struct beaglelogic_ops beaglelogic_native_ops = {
@@ -46,7 +46,7 @@ static int beaglelogic_tcp_open(struct dev_context *devc)
 {
 	struct addrinfo hints;
 	struct addrinfo *results, *res;
-	int err;
+	int err, rcvbuf;
 
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = AF_UNSPEC;
@@ -81,6 +81,12 @@ static int beaglelogic_tcp_open(struct dev_context *devc)
 		return SR_ERR;
 	}
 
+	/* Room for data that arrives while packets get processed. */
+	rcvbuf = TCP_RCVBUF_SIZE;
+	if (setsockopt(devc->socket, SOL_SOCKET, SO_RCVBUF,
+			(const void *)&rcvbuf, sizeof(rcvbuf)) < 0)
+		sr_dbg("Failed to set SO_RCVBUF: %s", g_strerror(errno));
+
 	return SR_OK;
 }
 
@@ -165,6 +171,21 @@ SR_PRIV int beaglelogic_tcp_drain(struct dev_context *devc)
 	return SR_OK;
 }
 
+/* Wait up to timeout_us for data to read. */
+static gboolean beaglelogic_tcp_wait(struct dev_context *devc,
+				     unsigned int timeout_us)
+{
+	fd_set rset;
+	struct timeval tv;
+
+	FD_ZERO(&rset);
+	FD_SET(devc->socket, &rset);
+	tv.tv_sec = timeout_us / (1000 * 1000);
+	tv.tv_usec = timeout_us % (1000 * 1000);
+
+	return select(devc->socket + 1, &rset, NULL, NULL, &tv) > 0;
+}
+
 static int beaglelogic_tcp_get_string(struct dev_context *devc, const char *cmd,
 				      char **tcp_resp)
 {
@@ -367,9 +388,68 @@ static int beaglelogic_get_lasterror(struct dev_context *devc)
 	return SR_OK;
 }
 
+/*
+ * Ask for a compressed stream: "compression" with the codecs this build
+ * has, best first, and the largest raw frame size taken. Servers which
+ * support it answer with the codec they picked, then send the samples
+ * as sigrok-stream LOGIC frames (see stream.h). Otherwise the samples
+ * come raw.
+ */
+static int beaglelogic_tcp_negotiate(struct dev_context *devc)
+{
+	GString *codecs;
+	uint32_t mask;
+	int codec, ret;
+	char *resp;
+
+	devc->tcp_codec = -1;
+
+	mask = sr_stream_codecs() & ~(1 << STREAM_CODEC_NONE);
+	if (!mask)
+		return SR_OK;
+
+	codecs = g_string_sized_new(32);
+	for (codec = STREAM_NUM_CODECS - 1; codec > STREAM_CODEC_NONE; codec--) {
+		if (!(mask & (1 << codec)))
+			continue;
+		if (codecs->len)
+			g_string_append_c(codecs, ',');
+		g_string_append(codecs, sr_stream_codec_name(codec));
+	}
+	ret = beaglelogic_tcp_send_cmd(devc, "compression %s %d",
+		codecs->str, TCP_BUFFER_SIZE);
+	g_string_free(codecs, TRUE);
+	if (ret != SR_OK)
+		return ret;
+
+	/* Servers without compression support might not answer at all. */
+	if (!beaglelogic_tcp_wait(devc, devc->read_timeout) ||
+			beaglelogic_tcp_get_string(devc, NULL, &resp) != SR_OK) {
+		sr_dbg("No compressed stream, receiving raw samples.");
+		return SR_OK;
+	}
+
+	for (codec = STREAM_CODEC_NONE + 1; codec < STREAM_NUM_CODECS; codec++) {
+		if ((mask & (1 << codec)) &&
+				!g_ascii_strcasecmp(resp, sr_stream_codec_name(codec)))
+			devc->tcp_codec = codec;
+	}
+	g_free(resp);
+
+	if (devc->tcp_codec < 0)
+		sr_dbg("No compressed stream, receiving raw samples.");
+	else
+		sr_info("Receiving %s compressed stream.",
+			sr_stream_codec_name(devc->tcp_codec));
+
+	return SR_OK;
+}
+
 static int beaglelogic_start(struct dev_context *devc)
 {
+	beaglelogic_tcp_negotiate(devc);
 	beaglelogic_tcp_drain(devc);
+	devc->tcp_rx_len = 0;
 
 	return beaglelogic_tcp_send_cmd(devc, "get");
 }
@@ -32,14 +32,48 @@
 #include "protocol.h"
 #include "beaglelogic.h"
 
-/* Define data packet size independent of packet (bufunitsize bytes) size
- * from the BeagleLogic kernel module */
-#define PACKET_SIZE	(512 * 1024)
-
-/* This implementation is zero copy from the libsigrok side.
- * It does not copy any data, just passes a pointer from the mmap'ed
- * kernel buffers appropriately. It is up to the application which is
- * using libsigrok to decide how to deal with the data.
+static void block_release(void *data, void *cb_data)
+{
+	(void)data;
+
+	sr_buffer_unref(cb_data);
+}
+
+static void copy_release(void *data, void *cb_data)
+{
+	(void)cb_data;
+
+	g_free(data);
+}
+
+/*
+ * Get a block of the mapping as a buffer of its own. In one shot mode
+ * the kernel fills its buffer only once, the block is used in place and
+ * keeps the mapping alive. In continuous mode the kernel refills blocks
+ * once the read pointer wrapped around, regardless of consumers still
+ * holding them, so the data gets copied.
+ */
+static struct sr_buffer *block_new(struct dev_context *devc,
+	uint32_t offset, uint32_t size)
+{
+	uint8_t *copy;
+
+	if (devc->triggerflags == BL_TRIGGERFLAGS_CONTINUOUS) {
+		copy = g_malloc(size);
+		memcpy(copy, devc->sample_buf + offset, size);
+		return sr_buffer_new(copy, size, copy_release, NULL);
+	}
+
+	return sr_buffer_new(devc->sample_buf + offset, size,
+		block_release, sr_buffer_ref(devc->mapping));
+}
+
+/* This implementation is zero copy from the libsigrok side in one shot
+ * mode. It does not copy any data, just passes a pointer from the mmap'ed
+ * kernel buffers appropriately. Packets are backed by reference counted
+ * buffers, consumers and the soft trigger's pre-trigger data can keep
+ * them without copying. In continuous mode each block is copied once,
+ * as the kernel reuses the buffer.
  */
 SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 {
@@ -47,6 +81,7 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 	struct dev_context *devc;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
+	struct sr_buffer *buf;
 
 	int trigger_offset;
 	int pre_trigger_samples;
@@ -68,16 +103,18 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 		/* Configure data packet */
 		packet.type = SR_DF_LOGIC;
 		packet.payload = &logic;
-		logic.data = devc->sample_buf + devc->offset;
+		buf = block_new(devc, devc->offset, packetsize);
+		logic.data = sr_buffer_data(buf);
 		logic.length = MIN(packetsize, bytes_remaining);
 
 		if (devc->trigger_fired) {
 			/* Send the incoming transfer to the session bus. */
-			sr_session_send(sdi, &packet);
+			sr_session_send_buffer(sdi, &packet, buf);
 		} else {
 			/* Check for trigger */
-			trigger_offset = soft_trigger_logic_check(devc->stl,
-					logic.data, packetsize, &pre_trigger_samples);
+			trigger_offset = soft_trigger_logic_check_ref(devc->stl,
+					logic.data, packetsize, buf,
+					&pre_trigger_samples);
 			if (trigger_offset > -1) {
 				devc->bytes_read += pre_trigger_samples * logic.unitsize;
 				trigger_offset *= logic.unitsize;
@@ -85,11 +122,12 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 						bytes_remaining);
 				logic.data += trigger_offset;
 
-				sr_session_send(sdi, &packet);
+				sr_session_send_buffer(sdi, &packet, buf);
 
 				devc->trigger_fired = TRUE;
 			}
 		}
+		sr_buffer_unref(buf);
 
 		/* Move the read pointer forward */
 		lseek(fd, packetsize, SEEK_CUR);
@@ -117,80 +155,307 @@ SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data)
 	return TRUE;
 }
 
-SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
+struct pool_ref {
+	struct beaglelogic_tcp_pool *pool;
+	gint *held;
+};
+
+SR_PRIV struct beaglelogic_tcp_pool *beaglelogic_tcp_pool_new(void)
+{
+	struct beaglelogic_tcp_pool *pool;
+	int i;
+
+	pool = g_malloc0(sizeof(*pool));
+	pool->refcount = 1;
+	for (i = 0; i < TCP_NUM_BUFFERS; i++)
+		pool->data[i] = g_malloc(TCP_BUFFER_SIZE);
+
+	return pool;
+}
+
+SR_PRIV void beaglelogic_tcp_pool_unref(struct beaglelogic_tcp_pool *pool)
+{
+	int i;
+
+	if (!pool || !g_atomic_int_dec_and_test(&pool->refcount))
+		return;
+
+	for (i = 0; i < TCP_NUM_BUFFERS; i++)
+		g_free(pool->data[i]);
+	g_free(pool);
+}
+
+static void pool_release(void *data, void *cb_data)
+{
+	struct pool_ref *ref;
+
+	(void)data;
+
+	ref = cb_data;
+	g_atomic_int_set(ref->held, 0);
+	beaglelogic_tcp_pool_unref(ref->pool);
+	g_free(ref);
+}
+
+static void unpooled_release(void *data, void *cb_data)
+{
+	(void)cb_data;
+
+	g_free(data);
+}
+
+/*
+ * Get a packet buffer of the pool, which keeps the pool alive until
+ * consumers released the packet. When they hold all of them, a buffer
+ * of its own is allocated rather than waiting for them.
+ */
+static struct sr_buffer *pool_get(struct dev_context *devc)
+{
+	struct beaglelogic_tcp_pool *pool;
+	struct pool_ref *ref;
+	int i;
+
+	pool = devc->tcp_pool;
+	for (i = 0; i < TCP_NUM_BUFFERS; i++) {
+		if (!g_atomic_int_compare_and_exchange(&pool->held[i], 0, 1))
+			continue;
+		ref = g_malloc(sizeof(*ref));
+		ref->pool = pool;
+		ref->held = &pool->held[i];
+		g_atomic_int_inc(&pool->refcount);
+		return sr_buffer_new(pool->data[i], TCP_BUFFER_SIZE,
+			pool_release, ref);
+	}
+
+	sr_spew("All pool buffers in use, allocating another one.");
+
+	return sr_buffer_new(g_malloc(TCP_BUFFER_SIZE), TCP_BUFFER_SIZE,
+		unpooled_release, NULL);
+}
+
+/*
+ * Read all data the socket has, up to size bytes, without blocking.
+ * Returns the number of bytes read, or -1 upon errors.
+ */
+static int read_available(int fd, uint8_t *buf, size_t size, gboolean *eof)
+{
+	size_t fill;
+	int len;
+
+	*eof = FALSE;
+	fill = 0;
+	while (fill < size) {
+		len = recv(fd, buf + fill, size - fill, MSG_DONTWAIT);
+		if (len > 0) {
+			fill += len;
+			continue;
+		}
+		if (len == 0) {
+			*eof = TRUE;
+			break;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			break;
+		sr_err("Receive error: %s", g_strerror(errno));
+		return -1;
+	}
+
+	return fill;
+}
+
+/*
+ * Send received samples to the session bus, checking for the trigger
+ * first. Returns FALSE when the capture is done.
+ */
+static gboolean send_samples(const struct sr_dev_inst *sdi,
+	struct sr_buffer *buf, uint32_t packetsize)
 {
-	const struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 
-	int len;
 	int pre_trigger_samples;
 	int trigger_offset;
-	uint32_t packetsize;
 	uint64_t bytes_remaining;
 
-	if (!(sdi = cb_data) || !(devc = sdi->priv))
-		return TRUE;
-
-	packetsize = TCP_BUFFER_SIZE;
+	devc = sdi->priv;
 	logic.unitsize = SAMPLEUNIT_TO_BYTES(devc->sampleunit);
 
-	if (revents == G_IO_IN) {
-		sr_info("In callback G_IO_IN");
-
-		len = recv(fd, devc->tcp_buffer, TCP_BUFFER_SIZE, 0);
-		if (len < 0) {
-			sr_err("Receive error: %s", g_strerror(errno));
-			return SR_ERR;
+	bytes_remaining = (devc->limit_samples * logic.unitsize) -
+			devc->bytes_read;
+
+	/* Configure data packet */
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.data = sr_buffer_data(buf);
+	logic.length = MIN(packetsize, bytes_remaining);
+
+	if (devc->trigger_fired) {
+		/* Send the incoming transfer to the session bus. */
+		sr_session_send_buffer(sdi, &packet, buf);
+	} else {
+		/* Check for trigger */
+		trigger_offset = soft_trigger_logic_check_ref(devc->stl,
+				logic.data, packetsize, buf,
+				&pre_trigger_samples);
+		if (trigger_offset > -1) {
+			devc->bytes_read += pre_trigger_samples * logic.unitsize;
+			trigger_offset *= logic.unitsize;
+			logic.length = MIN(packetsize - trigger_offset,
+					bytes_remaining);
+			logic.data += trigger_offset;
+
+			sr_session_send_buffer(sdi, &packet, buf);
+
+			devc->trigger_fired = TRUE;
 		}
+	}
 
-		packetsize = len;
+	/* Update byte count and offset (roll over if needed) */
+	devc->bytes_read += logic.length;
+	if ((devc->offset += packetsize) >= devc->buffersize) {
+		/* One shot capture, we abort and settle with less than
+		 * the required number of samples */
+		if (devc->triggerflags == BL_TRIGGERFLAGS_CONTINUOUS)
+			devc->offset = 0;
+		else
+			return FALSE;
+	}
 
-		bytes_remaining = (devc->limit_samples * logic.unitsize) -
-				devc->bytes_read;
+	return devc->bytes_read < devc->limit_samples * logic.unitsize;
+}
 
-		/* Configure data packet */
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.data = devc->tcp_buffer;
-		logic.length = MIN(packetsize, bytes_remaining);
+/* A raw stream: samples, possibly split anywhere. */
+static gboolean receive_raw(const struct sr_dev_inst *sdi, int fd)
+{
+	struct dev_context *devc;
+	struct sr_buffer *buf;
+	uint8_t *data;
+	size_t fill, unitsize;
+	int len;
+	gboolean eof, more;
 
-		if (devc->trigger_fired) {
-			/* Send the incoming transfer to the session bus. */
-			sr_session_send(sdi, &packet);
-		} else {
-			/* Check for trigger */
-			trigger_offset = soft_trigger_logic_check(devc->stl,
-					logic.data, packetsize, &pre_trigger_samples);
-			if (trigger_offset > -1) {
-				devc->bytes_read += pre_trigger_samples * logic.unitsize;
-				trigger_offset *= logic.unitsize;
-				logic.length = MIN(packetsize - trigger_offset,
-						bytes_remaining);
-				logic.data += trigger_offset;
+	devc = sdi->priv;
+	unitsize = SAMPLEUNIT_TO_BYTES(devc->sampleunit);
 
-				sr_session_send(sdi, &packet);
+	buf = pool_get(devc);
+	data = sr_buffer_data(buf);
+	memcpy(data, devc->tcp_rx, devc->tcp_rx_len);
+	fill = devc->tcp_rx_len;
 
-				devc->trigger_fired = TRUE;
-			}
-		}
+	len = read_available(fd, data + fill, TCP_BUFFER_SIZE - fill, &eof);
+	if (len < 0) {
+		sr_buffer_unref(buf);
+		return FALSE;
+	}
+	fill += len;
 
-		/* Update byte count and offset (roll over if needed) */
-		devc->bytes_read += logic.length;
-		if ((devc->offset += packetsize) >= devc->buffersize) {
-			/* One shot capture, we abort and settle with less than
-			 * the required number of samples */
-			if (devc->triggerflags == BL_TRIGGERFLAGS_CONTINUOUS)
-				devc->offset = 0;
-			else
-				packetsize = 0;
+	/* Keep a partial sample for the next read. */
+	devc->tcp_rx_len = fill % unitsize;
+	fill -= devc->tcp_rx_len;
+	memcpy(devc->tcp_rx, data + fill, devc->tcp_rx_len);
+
+	more = TRUE;
+	if (fill)
+		more = send_samples(sdi, buf, fill);
+	sr_buffer_unref(buf);
+
+	return more && !eof;
+}
+
+/* A compressed stream: sigrok-stream frames, see stream.h. */
+static gboolean receive_frames(const struct sr_dev_inst *sdi, int fd)
+{
+	struct dev_context *devc;
+	struct stream_frame_header hdr;
+	struct sr_buffer *buf;
+	const uint8_t *payload;
+	size_t pos, unitsize;
+	int len, ret;
+	gboolean eof, more;
+
+	devc = sdi->priv;
+	unitsize = SAMPLEUNIT_TO_BYTES(devc->sampleunit);
+
+	len = read_available(fd, devc->tcp_rx + devc->tcp_rx_len,
+		TCP_RX_SIZE - devc->tcp_rx_len, &eof);
+	if (len < 0)
+		return FALSE;
+	devc->tcp_rx_len += len;
+
+	more = TRUE;
+	pos = 0;
+	while (more && devc->tcp_rx_len - pos >= STREAM_FRAME_HEADER_SIZE) {
+		if (sr_stream_header_read(devc->tcp_rx + pos, &hdr) != SR_OK ||
+				hdr.length > TCP_BUFFER_SIZE ||
+				hdr.raw_length > TCP_BUFFER_SIZE ||
+				hdr.raw_length % unitsize) {
+			sr_err("Invalid frame in compressed stream.");
+			return FALSE;
+		}
+		if (devc->tcp_rx_len - pos < STREAM_FRAME_HEADER_SIZE + hdr.length)
+			break;
+		payload = devc->tcp_rx + pos + STREAM_FRAME_HEADER_SIZE;
+		pos += STREAM_FRAME_HEADER_SIZE + hdr.length;
+
+		if (hdr.type == STREAM_FRAME_END) {
+			more = FALSE;
+			break;
+		}
+		if (hdr.type != STREAM_FRAME_LOGIC || !hdr.raw_length)
+			continue;
+
+		buf = pool_get(devc);
+		ret = sr_stream_decompress(hdr.codec, payload, hdr.length,
+			sr_buffer_data(buf), hdr.raw_length);
+		if (ret != SR_OK) {
+			sr_err("Failed to decompress %s frame.",
+				sr_stream_codec_name(hdr.codec));
+			sr_buffer_unref(buf);
+			return FALSE;
 		}
+		more = send_samples(sdi, buf, hdr.raw_length);
+		sr_buffer_unref(buf);
+	}
+
+	devc->tcp_rx_len -= pos;
+	memmove(devc->tcp_rx, devc->tcp_rx + pos, devc->tcp_rx_len);
+
+	return more && !eof;
+}
+
+/*
+ * Each wakeup reads all the data there is, rather than a single small
+ * read, which keeps up with the link rate. Packets are backed by pool
+ * buffers, consumers and the soft trigger's pre-trigger data can keep
+ * them without copying.
+ */
+SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data)
+{
+	const struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	gboolean more;
+	int unitsize;
+
+	if (!(sdi = cb_data) || !(devc = sdi->priv))
+		return TRUE;
+
+	unitsize = SAMPLEUNIT_TO_BYTES(devc->sampleunit);
+	more = TRUE;
+
+	if (revents == G_IO_IN) {
+		sr_spew("In callback G_IO_IN");
+
+		if (devc->tcp_codec < 0)
+			more = receive_raw(sdi, fd);
+		else
+			more = receive_frames(sdi, fd);
 	}
 
 	/* EOF Received or we have reached the limit */
-	if (devc->bytes_read >= devc->limit_samples * logic.unitsize ||
-			packetsize == 0) {
+	if (devc->bytes_read >= devc->limit_samples * unitsize || !more) {
 		/* Send EOA Packet, stop polling */
 		std_session_send_df_end(sdi);
 		devc->beaglelogic->stop(devc);
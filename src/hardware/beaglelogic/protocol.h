@@ -24,6 +24,7 @@
 #include <glib.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
+#include "stream.h"
 
 #define LOG_PREFIX "beaglelogic"
 
@@ -32,7 +33,35 @@
 
 #define SAMPLEUNIT_TO_BYTES(x)	((x) == 1 ? 1 : 2)
 
-#define TCP_BUFFER_SIZE         (128 * 1024)
+/*
+ * TCP receive: each wakeup reads all data that is there, up to a packet
+ * of TCP_BUFFER_SIZE bytes, into a buffer of a pool which is reused once
+ * consumers released the packet. Also the largest raw size of frames of
+ * a compressed stream.
+ */
+#define TCP_BUFFER_SIZE         (1024 * 1024)
+#define TCP_NUM_BUFFERS         4
+#define TCP_RCVBUF_SIZE         (4 * 1024 * 1024)
+#define TCP_RX_SIZE             (STREAM_FRAME_HEADER_SIZE + TCP_BUFFER_SIZE)
+
+/* Define data packet size independent of packet (bufunitsize bytes) size
+ * from the BeagleLogic kernel module */
+#define PACKET_SIZE	(512 * 1024)
+
+/*
+ * The mmap'd kernel buffer, which stays mapped for as long as consumers
+ * hold references to packets in it.
+ */
+struct beaglelogic_mapping {
+	size_t size;
+};
+
+/* Packet buffers for TCP, held[] is set while a packet uses one. */
+struct beaglelogic_tcp_pool {
+	gint refcount;
+	gint held[TCP_NUM_BUFFERS];
+	uint8_t *data[TCP_NUM_BUFFERS];
+};
 
 /** Private, per-device-instance driver context. */
 struct dev_context {
@@ -47,7 +76,15 @@ struct dev_context {
 	char *port;
 	int socket;
 	unsigned int read_timeout;
-	unsigned char *tcp_buffer;
+	struct beaglelogic_tcp_pool *tcp_pool;
+	/*
+	 * Received bytes not processed yet: a partial sample of a raw
+	 * stream, or a partial frame of a compressed one.
+	 */
+	uint8_t *tcp_rx;
+	size_t tcp_rx_len;
+	/* STREAM_CODEC_* of the framed stream, or -1 for raw samples. */
+	int tcp_codec;
 
 	/* Acquisition settings: see beaglelogic.h */
 	uint64_t cur_samplerate;
@@ -68,6 +105,8 @@ struct dev_context {
 	uint64_t sent_samples;
 	uint32_t offset;
 	uint8_t *sample_buf;	/* mmap'd kernel buffer here */
+	struct sr_buffer *mapping;
+	struct beaglelogic_mapping *map;
 
 	/* Trigger logic */
 	struct soft_trigger_logic *stl;
@@ -76,5 +115,7 @@ struct dev_context {
 
 SR_PRIV int beaglelogic_native_receive_data(int fd, int revents, void *cb_data);
 SR_PRIV int beaglelogic_tcp_receive_data(int fd, int revents, void *cb_data);
+SR_PRIV struct beaglelogic_tcp_pool *beaglelogic_tcp_pool_new(void);
+SR_PRIV void beaglelogic_tcp_pool_unref(struct beaglelogic_tcp_pool *pool);
 
 #endif
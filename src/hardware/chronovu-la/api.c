@@ -47,6 +47,8 @@ static const int32_t trigger_matches[] = {
 
 static void clear_helper(struct dev_context *devc)
 {
+	if (devc->stl)
+		soft_trigger_logic_free(devc->stl);
 	ftdi_free(devc->ftdic);
 	g_free(devc->final_buf);
 }
@@ -75,14 +77,17 @@ static int add_device(int model, struct libusb_device_descriptor *des,
 	devc->cur_samplerate = 0; /* Set later (different for LA8/LA16). */
 	devc->limit_msec = 0;
 	devc->limit_samples = 0;
-	memset(devc->mangled_buf, 0, BS);
+	memset(devc->mangled_buf, 0, sizeof(devc->mangled_buf));
+	devc->pending = NULL;
+	devc->pending_buf = NULL;
 	devc->final_buf = NULL;
 	devc->trigger_pattern = 0x0000; /* Irrelevant, see trigger_mask. */
 	devc->trigger_mask = 0x0000; /* All channels: "don't care". */
 	devc->trigger_edgemask = 0x0000; /* All channels: "state triggered". */
-	devc->trigger_found = 0;
+	devc->stl = NULL;
 	devc->done = 0;
-	devc->block_counter = 0;
+	devc->bytes_read = 0;
+	devc->bytes_requested = 0;
 	devc->divcount = 0;
 	devc->usb_vid = des->idVendor;
 	devc->usb_pid = des->idProduct;
@@ -148,7 +153,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	if (conn)
 		conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
 
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		bus = libusb_get_bus_number(devlist[i]);
 		addr = libusb_get_device_address(devlist[i]);
@@ -381,7 +386,7 @@ static int config_list(uint32_t key, GVariant **data,
 
 static int receive_data(int fd, int revents, void *cb_data)
 {
-	int i, ret;
+	int ret;
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 
@@ -410,11 +415,9 @@ static int receive_data(int fd, int revents, void *cb_data)
 		return FALSE;
 	}
 
-	/* We need to get exactly NUM_BLOCKS blocks (i.e. 8MB) of data. */
-	if (devc->block_counter != (NUM_BLOCKS - 1)) {
-		devc->block_counter++;
+	/* We need to get exactly SDRAM_SIZE bytes (i.e. 8MB) of data. */
+	if (devc->bytes_read != SDRAM_SIZE)
 		return TRUE;
-	}
 
 	sr_dbg("Sampling finished, sending data to session bus now.");
 
@@ -426,8 +429,7 @@ static int receive_data(int fd, int revents, void *cb_data)
 	 * manner while we receive it. We have to receive and de-mangle the
 	 * full 8MByte first, only then the whole buffer contains valid data.
 	 */
-	for (i = 0; i < NUM_BLOCKS; i++)
-		cv_send_block_to_session_bus(sdi, i);
+	cv_send_to_session_bus(sdi);
 
 	sr_dev_acquisition_stop(sdi);
 
@@ -458,6 +460,15 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+	/* Compile the trigger for finding the trigger point in the data. */
+	if (devc->stl)
+		soft_trigger_logic_free(devc->stl);
+	devc->stl = NULL;
+	if ((devc->trigger_mask | devc->trigger_edgemask) != 0x0000)
+		devc->stl = soft_trigger_logic_search_new(
+			sr_session_trigger_get(sdi->session),
+			devc->prof->num_channels / 8);
+
 	/* Fill acquisition parameters into buf[]. */
 	if (devc->prof->model == CHRONOVU_LA8) {
 		buf[0] = devc->divcount;
@@ -490,8 +501,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	/* Time when we should be done (for detecting trigger timeouts). */
 	devc->done = (devc->divcount + 1) * devc->prof->trigger_constant +
 			g_get_monotonic_time() + (10 * G_TIME_SPAN_SECOND);
-	devc->block_counter = 0;
-	devc->trigger_found = 0;
+	devc->bytes_read = 0;
+	devc->bytes_requested = 0;
+	devc->pending = NULL;
+	devc->pending_buf = NULL;
 
 	/* Hook up a dummy handler to receive data from the device. */
 	sr_session_source_add(sdi->session, -1, 0, 0, receive_data, (void *)sdi);
@@ -501,6 +514,11 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	cv_read_abort(devc);
 	sr_session_source_remove(sdi->session, -1);
 	std_session_send_df_end(sdi);
 
@@ -347,31 +347,74 @@ SR_PRIV int cv_set_samplerate(const struct sr_dev_inst *sdi, uint64_t samplerate
 	return SR_OK;
 }
 
-/**
- * Get a block of data from the device.
- *
- * @param devc The struct containing private per-device-instance data. Must not
- *             be NULL. devc->ftdic must not be NULL either.
- *
- * @return SR_OK upon success, or SR_ERR upon errors.
+/* De-mangle bytes of SDRAM, from within the same megabyte. */
+static void demangle(struct dev_context *devc, const uint8_t *buf,
+		int byte_offset, int len)
+{
+	int i, m, mi, p, q, index;
+
+	m = byte_offset / (1024 * 1024);
+	mi = m * (1024 * 1024);
+	for (i = 0; i < len; i++) {
+		if (devc->prof->model == CHRONOVU_LA8) {
+			p = i & (1 << 0);
+			index = m * 2 + (((byte_offset + i) - mi) / 2) * 16;
+			index += (devc->divcount == 0) ? p : (1 - p);
+		} else {
+			p = i & (1 << 0);
+			q = i & (1 << 1);
+			index = m * 4 + (((byte_offset + i) - mi) / 4) * 32;
+			index += q + (1 - p);
+		}
+		devc->final_buf[index] = buf[i];
+	}
+}
+
+/*
+ * Start an async read of the next SDRAM bytes, into the buffer which
+ * is not in use. Reads end on READ_SIZE boundaries, which keeps each
+ * within a megabyte.
  */
-SR_PRIV int cv_read_block(struct dev_context *devc)
+static int submit_read(struct dev_context *devc)
 {
-	int i, byte_offset, m, mi, p, q, index, bytes_read;
-	gint64 now;
+	uint8_t *buf;
+	int len;
 
-	/* Note: Caller checked that devc and devc->ftdic != NULL. */
+	len = READ_SIZE - (devc->bytes_requested % READ_SIZE);
+	len = MIN(len, SDRAM_SIZE - devc->bytes_requested);
+	if (!len)
+		return SR_OK;
+
+	buf = devc->mangled_buf[devc->pending_buf == devc->mangled_buf[0]];
+	devc->pending = ftdi_read_data_submit(devc->ftdic, buf, len);
+	if (!devc->pending) {
+		sr_err("Failed to submit read: %s.",
+		       ftdi_get_error_string(devc->ftdic));
+		return SR_ERR;
+	}
+	devc->pending_buf = buf;
+	devc->pending_len = len;
+	devc->bytes_requested += len;
+
+	return SR_OK;
+}
+
+/* Wait for the trigger, i.e. the first block of data. */
+static int read_first_block(struct dev_context *devc)
+{
+	int bytes_read;
+	gint64 now;
 
-	sr_spew("Reading block %d.", devc->block_counter);
+	sr_spew("Reading block 0.");
 
-	bytes_read = cv_read(devc, devc->mangled_buf, BS);
+	bytes_read = cv_read(devc, devc->mangled_buf[0], BS);
 
 	/* If first block read got 0 bytes, retry until success or timeout. */
-	if ((bytes_read == 0) && (devc->block_counter == 0)) {
+	if (bytes_read == 0) {
 		do {
 			sr_spew("Reading block 0 (again).");
 			/* Note: If bytes_read < 0 cv_read() will log errors. */
-			bytes_read = cv_read(devc, devc->mangled_buf, BS);
+			bytes_read = cv_read(devc, devc->mangled_buf[0], BS);
 			now = g_get_monotonic_time();
 		} while ((devc->done > now) && (bytes_read == 0));
 	}
@@ -383,130 +426,177 @@ SR_PRIV int cv_read_block(struct dev_context *devc)
 		return SR_ERR;
 	}
 
-	/* De-mangle the data. */
-	sr_spew("Demangling block %d.", devc->block_counter);
-	byte_offset = devc->block_counter * BS;
-	m = byte_offset / (1024 * 1024);
-	mi = m * (1024 * 1024);
-	for (i = 0; i < BS; i++) {
-		if (devc->prof->model == CHRONOVU_LA8) {
-			p = i & (1 << 0);
-			index = m * 2 + (((byte_offset + i) - mi) / 2) * 16;
-			index += (devc->divcount == 0) ? p : (1 - p);
-		} else {
-			p = i & (1 << 0);
-			q = i & (1 << 1);
-			index = m * 4 + (((byte_offset + i) - mi) / 4) * 32;
-			index += q + (1 - p);
+	demangle(devc, devc->mangled_buf[0], 0, BS);
+	devc->bytes_read = devc->bytes_requested = BS;
+
+	return SR_OK;
+}
+
+/**
+ * Get a block of data from the device.
+ *
+ * The first call waits for the trigger. Later calls wait for the read in
+ * flight, start the next one, and de-mangle the data while it runs.
+ * All data was received once devc->bytes_read is SDRAM_SIZE.
+ *
+ * @param devc The struct containing private per-device-instance data. Must not
+ *             be NULL. devc->ftdic must not be NULL either.
+ *
+ * @return SR_OK upon success, or SR_ERR upon errors.
+ */
+SR_PRIV int cv_read_block(struct dev_context *devc)
+{
+	uint8_t *buf;
+	int len, ret;
+
+	/* Note: Caller checked that devc and devc->ftdic != NULL. */
+
+	if (!devc->bytes_read) {
+		if (read_first_block(devc) != SR_OK)
+			return SR_ERR;
+		if (submit_read(devc) != SR_OK) {
+			(void) reset_device(devc); /* Ignore errors. */
+			return SR_ERR;
 		}
-		devc->final_buf[index] = devc->mangled_buf[i];
+		return SR_OK;
+	}
+
+	if (!devc->pending)
+		return SR_OK;
+
+	sr_spew("Reading %d bytes at offset %d.",
+		devc->pending_len, devc->bytes_read);
+
+	ret = ftdi_transfer_data_done(devc->pending);
+	devc->pending = NULL;
+	if (ret != devc->pending_len) {
+		sr_err("Failed to read data (%d): %s.",
+		       ret, ftdi_get_error_string(devc->ftdic));
+		(void) reset_device(devc); /* Ignore errors. */
+		return SR_ERR;
 	}
+	buf = devc->pending_buf;
+	len = devc->pending_len;
+
+	if (submit_read(devc) != SR_OK) {
+		(void) reset_device(devc); /* Ignore errors. */
+		return SR_ERR;
+	}
+
+	demangle(devc, buf, devc->bytes_read, len);
+	devc->bytes_read += len;
 
 	return SR_OK;
 }
 
-SR_PRIV void cv_send_block_to_session_bus(const struct sr_dev_inst *sdi, int block)
+/**
+ * Wait for a read in flight, so that the device can be reset or closed.
+ *
+ * @param devc The struct containing private per-device-instance data.
+ */
+SR_PRIV void cv_read_abort(struct dev_context *devc)
 {
-	int i, idx;
-	uint8_t sample, expected_sample, tmp8;
+	if (devc->pending)
+		(void) ftdi_transfer_data_done(devc->pending);
+	devc->pending = NULL;
+	devc->pending_buf = NULL;
+}
+
+/* Find the first sample where the trigger matches, or -1. */
+static int find_trigger(const struct soft_trigger_logic *stl,
+		const uint8_t *buf, int num)
+{
+	GArray *offsets;
+	int from, to, trigger_point;
+
+	/* Scan a block at a time, all matches in it get collected. */
+	offsets = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	for (from = 0; from < num && !offsets->len; from = to) {
+		to = MIN(from + BS, num);
+		soft_trigger_logic_find_all(stl, buf, num, from, to, 0, offsets);
+	}
+	trigger_point = offsets->len ?
+		(int)g_array_index(offsets, uint64_t, 0) : -1;
+	g_array_free(offsets, TRUE);
+
+	return trigger_point;
+}
+
+/* Send samples in packets of at most READ_SIZE bytes. */
+static void send_samples(const struct sr_dev_inst *sdi, int start, int num)
+{
+	struct dev_context *devc;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
-	int trigger_point; /* Relative trigger point (in this block). */
-	struct dev_context *devc;
-
-	/* Note: Caller ensures devc/devc->ftdic != NULL and block > 0. */
+	int unitsize, len;
 
 	devc = sdi->priv;
+	unitsize = devc->prof->num_channels / 8;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = unitsize;
+	while (num > 0) {
+		len = MIN(num, READ_SIZE / unitsize);
+		sr_spew("Sending SR_DF_LOGIC packet, start = %d, "
+			"length = %d.", start, len);
+		logic.length = len * unitsize;
+		logic.data = devc->final_buf + start * unitsize;
+		sr_session_send(sdi, &packet);
+		start += len;
+		num -= len;
+	}
+}
 
-	/* TODO: Implement/test proper trigger support for the LA16. */
+/**
+ * Send all received samples to the session bus.
+ *
+ * The trigger point is searched for in the whole buffer at once, with the
+ * session's trigger compiled for the sample format, which also handles
+ * the LA16's edge triggers.
+ *
+ * @param sdi The device instance. All of the SDRAM must have been read.
+ */
+SR_PRIV void cv_send_to_session_bus(const struct sr_dev_inst *sdi)
+{
+	int i, num, trigger_point;
+	uint8_t tmp8;
+	struct dev_context *devc;
 
-	/* Check if we can find the trigger condition in this block. */
-	trigger_point = -1;
-	expected_sample = devc->trigger_pattern & devc->trigger_mask;
-	for (i = 0; i < BS; i++) {
-		/* Don't continue if the trigger was found previously. */
-		if (devc->trigger_found)
-			break;
-
-		/*
-		 * Also, don't continue if triggers are "don't care", i.e. if
-		 * no trigger conditions were specified by the user. In that
-		 * case we don't want to send an SR_DF_TRIGGER packet at all.
-		 */
-		if (devc->trigger_mask == 0x0000)
-			break;
-
-		sample = *(devc->final_buf + (block * BS) + i);
-
-		if ((sample & devc->trigger_mask) == expected_sample) {
-			trigger_point = i;
-			devc->trigger_found = 1;
-			break;
-		}
-	}
+	devc = sdi->priv;
 
 	/* Swap low and high bytes of the 16-bit LA16 samples. */
 	if (devc->prof->model == CHRONOVU_LA16) {
-		for (i = 0; i < BS; i += 2) {
-			idx = (block * BS) + i;
-			tmp8 = devc->final_buf[idx];
-			devc->final_buf[idx] = devc->final_buf[idx + 1];
-			devc->final_buf[idx + 1] = tmp8;
+		for (i = 0; i < SDRAM_SIZE; i += 2) {
+			tmp8 = devc->final_buf[i];
+			devc->final_buf[i] = devc->final_buf[i + 1];
+			devc->final_buf[i + 1] = tmp8;
 		}
 	}
 
-	/* If no trigger was found, send one SR_DF_LOGIC packet. */
-	if (trigger_point == -1) {
-		/* Send an SR_DF_LOGIC packet to the session bus. */
-		sr_spew("Sending SR_DF_LOGIC packet (%d bytes) for "
-		        "block %d.", BS, block);
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.length = BS;
-		logic.unitsize = devc->prof->num_channels / 8;
-		logic.data = devc->final_buf + (block * BS);
-		sr_session_send(sdi, &packet);
-		return;
-	}
+	num = SDRAM_SIZE / (devc->prof->num_channels / 8);
 
 	/*
-	 * We found the trigger, so some special handling is needed. We have
-	 * to send an SR_DF_LOGIC packet with the samples before the trigger
-	 * (if any), then the SD_DF_TRIGGER packet itself, then another
-	 * SR_DF_LOGIC packet with the samples after the trigger (if any).
+	 * Don't search if triggers are "don't care", i.e. if no trigger
+	 * conditions were specified by the user. In that case we don't
+	 * want to send an SR_DF_TRIGGER packet at all.
 	 */
+	trigger_point = -1;
+	if (devc->stl)
+		trigger_point = find_trigger(devc->stl, devc->final_buf, num);
 
-	/* TODO: Send SR_DF_TRIGGER packet before or after the actual sample? */
-
-	/* If at least one sample is located before the trigger... */
-	if (trigger_point > 0) {
-		/* Send pre-trigger SR_DF_LOGIC packet to the session bus. */
-		sr_spew("Sending pre-trigger SR_DF_LOGIC packet, "
-			"start = %d, length = %d.", block * BS, trigger_point);
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.length = trigger_point;
-		logic.unitsize = devc->prof->num_channels / 8;
-		logic.data = devc->final_buf + (block * BS);
-		sr_session_send(sdi, &packet);
+	if (trigger_point == -1) {
+		send_samples(sdi, 0, num);
+		return;
 	}
 
-	/* Send the SR_DF_TRIGGER packet to the session bus. */
-	sr_spew("Sending SR_DF_TRIGGER packet, sample = %d.",
-		(block * BS) + trigger_point);
+	/*
+	 * We found the trigger, so send the samples before the trigger
+	 * (if any), then the SD_DF_TRIGGER packet itself, then the samples
+	 * after the trigger.
+	 */
+	send_samples(sdi, 0, trigger_point);
+	sr_spew("Sending SR_DF_TRIGGER packet, sample = %d.", trigger_point);
 	std_session_send_df_trigger(sdi);
-
-	/* If at least one sample is located after the trigger... */
-	if (trigger_point < (BS - 1)) {
-		/* Send post-trigger SR_DF_LOGIC packet to the session bus. */
-		sr_spew("Sending post-trigger SR_DF_LOGIC packet, "
-			"start = %d, length = %d.",
-			(block * BS) + trigger_point, BS - trigger_point);
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.length = BS - trigger_point;
-		logic.unitsize = devc->prof->num_channels / 8;
-		logic.data = devc->final_buf + (block * BS) + trigger_point;
-		sr_session_send(sdi, &packet);
-	}
+	send_samples(sdi, trigger_point, num - trigger_point);
 }
@@ -34,7 +34,8 @@
 #define MAX_NUM_SAMPLES			SDRAM_SIZE
 
 #define BS				4096 /* Block size */
-#define NUM_BLOCKS			2048 /* Number of blocks */
+/* Read size once the first block arrived, divides 1MB. */
+#define READ_SIZE			(16 * BS)
 
 enum {
 	CHRONOVU_LA8,
@@ -59,10 +60,16 @@ struct dev_context {
 	uint64_t limit_samples;
 
 	/**
-	 * A buffer containing some (mangled) samples from the device.
+	 * Two buffers containing some (mangled) samples from the device.
+	 * One gets filled by an async read while the other is de-mangled.
 	 * Format: Pretty mangled-up (due to hardware reasons), see code.
 	 */
-	uint8_t mangled_buf[BS];
+	uint8_t mangled_buf[2][READ_SIZE];
+
+	/** The async read in flight (if any), and its buffer and size. */
+	struct ftdi_transfer_control *pending;
+	uint8_t *pending_buf;
+	int pending_len;
 
 	/**
 	 * An 8MB buffer where we'll store the de-mangled samples.
@@ -94,14 +101,15 @@ struct dev_context {
 	 */
 	uint16_t trigger_edgemask;
 
-	/** Tells us whether an SR_DF_TRIGGER packet was already sent. */
-	int trigger_found;
+	/** The session's trigger, to find the trigger point in the data. */
+	struct soft_trigger_logic *stl;
 
 	/** Used for keeping track how much time has passed. */
 	gint64 done;
 
-	/** Counter/index for the data block to be read. */
-	int block_counter;
+	/** Bytes of SDRAM received, and requested, so far. */
+	int bytes_read;
+	int bytes_requested;
 
 	/** The divcount value (determines the sample period). */
 	uint8_t divcount;
@@ -123,6 +131,7 @@ SR_PRIV int cv_write(struct dev_context *devc, uint8_t *buf, int size);
 SR_PRIV int cv_convert_trigger(const struct sr_dev_inst *sdi);
 SR_PRIV int cv_set_samplerate(const struct sr_dev_inst *sdi, uint64_t samplerate);
 SR_PRIV int cv_read_block(struct dev_context *devc);
-SR_PRIV void cv_send_block_to_session_bus(const struct sr_dev_inst *sdi, int block);
+SR_PRIV void cv_read_abort(struct dev_context *devc);
+SR_PRIV void cv_send_to_session_bus(const struct sr_dev_inst *sdi);
 
 #endif
@@ -69,6 +69,8 @@ static const uint32_t devopts[] = {
 	SR_CONF_AVG_SAMPLES | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_BENCHMARK | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_STATS | SR_CONF_GET,
 };
 
 static const uint32_t devopts_cg_logic[] = {
@@ -93,6 +95,8 @@ static const int32_t trigger_matches[] = {
 	SR_TRIGGER_RISING,
 	SR_TRIGGER_FALLING,
 	SR_TRIGGER_EDGE,
+	SR_TRIGGER_OVER,
+	SR_TRIGGER_UNDER,
 };
 
 static const uint64_t samplerates[] = {
@@ -148,6 +152,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	devc->limit_frames = limit_frames;
 	devc->capture_ratio = 20;
 	devc->stl = NULL;
+	devc->sta = NULL;
 
 	if (num_logic_channels > 0) {
 		/* Logic channels, all in one channel group. */
@@ -262,6 +267,12 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_AVERAGING:
 		*data = g_variant_new_boolean(devc->avg);
 		break;
+	case SR_CONF_BENCHMARK:
+		*data = g_variant_new_boolean(devc->benchmark);
+		break;
+	case SR_CONF_TRANSFER_STATS:
+		*data = demo_bench_stats_get(devc);
+		break;
 	case SR_CONF_AVG_SAMPLES:
 		*data = g_variant_new_uint64(devc->avg_samples);
 		break;
@@ -353,6 +364,9 @@ static int config_set(uint32_t key, GVariant *data,
 		devc->avg = g_variant_get_boolean(data);
 		sr_dbg("%s averaging", devc->avg ? "Enabling" : "Disabling");
 		break;
+	case SR_CONF_BENCHMARK:
+		devc->benchmark = g_variant_get_boolean(data);
+		break;
 	case SR_CONF_AVG_SAMPLES:
 		devc->avg_samples = g_variant_get_uint64(data);
 		sr_dbg("Setting averaging rate to %" PRIu64, devc->avg_samples);
@@ -489,12 +503,31 @@ static int config_list(uint32_t key, GVariant **data,
 	return SR_OK;
 }
 
+/* Whether the trigger has matches on analog channels. */
+static gboolean trigger_is_analog(const struct sr_trigger *trigger)
+{
+	const struct sr_trigger_stage *stage;
+	const struct sr_trigger_match *match;
+	GSList *l, *m;
+
+	for (l = trigger->stages; l; l = l->next) {
+		stage = l->data;
+		for (m = stage->matches; m; m = m->next) {
+			match = m->data;
+			if (match->channel->type == SR_CHANNEL_ANALOG)
+				return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
 static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	GSList *l;
 	struct sr_channel *ch;
-	int bitpos;
+	int bitpos, ret;
 	uint8_t mask;
 	struct sr_trigger *trigger;
 
@@ -502,23 +535,47 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	devc->sent_samples = 0;
 	devc->sent_frame_samples = 0;
 
+	/*
+	 * Benchmark mode only sends logic data, and does not check or
+	 * wait for triggers.
+	 */
+	trigger = NULL;
+	if (!devc->benchmark)
+		trigger = sr_session_trigger_get(sdi->session);
+
 	/* Setup triggers */
-	if ((trigger = sr_session_trigger_get(sdi->session))) {
+	if (trigger) {
 		int pre_trigger_samples = 0;
 		if (devc->limit_samples > 0)
 			pre_trigger_samples = (devc->capture_ratio * devc->limit_samples) / 100;
-		devc->stl = soft_trigger_logic_new(sdi, trigger, pre_trigger_samples);
-		if (!devc->stl)
-			return SR_ERR_MALLOC;
+		if (trigger_is_analog(trigger)) {
+			devc->sta = soft_trigger_analog_new(sdi, trigger,
+					pre_trigger_samples, 0);
+			if (!devc->sta)
+				return SR_ERR_ARG;
 
-		/* Disable all analog channels since using them when there are logic
-		 * triggers set up would require having pre-trigger sample buffers
-		 * for analog sample data.
-		 */
-		for (l = sdi->channels; l; l = l->next) {
-			ch = l->data;
-			if (ch->type == SR_CHANNEL_ANALOG)
-				ch->enabled = FALSE;
+			/* Only the trigger channel's data is kept before the
+			 * trigger, disable all other channels.
+			 */
+			for (l = sdi->channels; l; l = l->next) {
+				ch = l->data;
+				if (ch != devc->sta->channel)
+					ch->enabled = FALSE;
+			}
+		} else {
+			devc->stl = soft_trigger_logic_new(sdi, trigger, pre_trigger_samples);
+			if (!devc->stl)
+				return SR_ERR_MALLOC;
+
+			/* Disable all analog channels since using them when there are logic
+			 * triggers set up would require having pre-trigger sample buffers
+			 * for analog sample data.
+			 */
+			for (l = sdi->channels; l; l = l->next) {
+				ch = l->data;
+				if (ch->type == SR_CHANNEL_ANALOG)
+					ch->enabled = FALSE;
+			}
 		}
 	}
 	devc->trigger_fired = FALSE;
@@ -561,8 +618,21 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		devc->first_partial_logic_index,
 		devc->first_partial_logic_mask);
 
-	sr_session_source_add(sdi->session, -1, 0, 100,
-			demo_prepare_data, (struct sr_dev_inst *)sdi);
+	devc->step = 0;
+	if (devc->benchmark) {
+		if (!devc->enabled_logic_channels) {
+			sr_err("Benchmark mode needs enabled logic channels.");
+			return SR_ERR_ARG;
+		}
+		ret = demo_bench_prepare((struct sr_dev_inst *)sdi);
+		if (ret != SR_OK)
+			return ret;
+		sr_session_source_add(sdi->session, -1, 0, 0,
+				demo_bench_data, (struct sr_dev_inst *)sdi);
+	} else {
+		sr_session_source_add(sdi->session, -1, 0, 100,
+				demo_prepare_data, (struct sr_dev_inst *)sdi);
+	}
 
 	std_session_send_df_header(sdi);
 
@@ -572,7 +642,6 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	/* We use this timestamp to decide how many more samples to send. */
 	devc->start_us = g_get_monotonic_time();
 	devc->spent_us = 0;
-	devc->step = 0;
 
 	return SR_OK;
 }
@@ -593,6 +662,11 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 		soft_trigger_logic_free(devc->stl);
 		devc->stl = NULL;
 	}
+	if (devc->sta) {
+		soft_trigger_analog_free(devc->sta);
+		devc->sta = NULL;
+	}
+	demo_bench_free(devc);
 
 	return SR_OK;
 }
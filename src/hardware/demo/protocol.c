@@ -399,11 +399,44 @@ static void logic_fixup_feed(struct dev_context *devc,
 	}
 }
 
+/*
+ * Send an analog packet. An analog trigger keeps what comes before it,
+ * and sends that as pre-trigger data when it fires.
+ */
+static void analog_send(struct sr_dev_inst *sdi,
+		const struct sr_datafeed_analog *analog)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog tail;
+	int offset;
+
+	devc = sdi->priv;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = analog;
+	if (!devc->sta || devc->trigger_fired) {
+		sr_session_send(sdi, &packet);
+		return;
+	}
+
+	offset = soft_trigger_analog_check(devc->sta, analog, NULL);
+	if (offset < 0)
+		return;
+	devc->trigger_fired = TRUE;
+
+	/* Send after-trigger data */
+	tail = *analog;
+	tail.data = (float *)analog->data + offset;
+	tail.num_samples -= offset;
+	packet.payload = &tail;
+	if (tail.num_samples)
+		sr_session_send(sdi, &packet);
+}
+
 static void send_analog_packet(struct analog_gen *ag,
 		struct sr_dev_inst *sdi, uint64_t *analog_sent,
 		uint64_t analog_pos, uint64_t analog_todo)
 {
-	struct sr_datafeed_packet packet;
 	struct dev_context *devc;
 	struct analog_pattern *pattern;
 	uint64_t sending_now, to_avg;
@@ -416,8 +449,6 @@ static void send_analog_packet(struct analog_gen *ag,
 		return;
 
 	devc = sdi->priv;
-	packet.type = SR_DF_ANALOG;
-	packet.payload = &ag->packet;
 
 	pattern = devc->analog_patterns[ag->pattern];
 
@@ -524,7 +555,7 @@ static void send_analog_packet(struct analog_gen *ag,
 			ag->packet.data = pattern->data + ag_pattern_pos;
 		}
 		ag->packet.num_samples = sending_now;
-		sr_session_send(sdi, &packet);
+		analog_send(sdi, &ag->packet);
 
 		/* Whichever channel group gets there first. */
 		*analog_sent = MAX(*analog_sent, sending_now);
@@ -564,7 +595,7 @@ do_send:
 		ag->packet.data = &ag->avg_val;
 		ag->packet.num_samples = 1;
 
-		sr_session_send(sdi, &packet);
+		analog_send(sdi, &ag->packet);
 		*analog_sent = ag->num_avgs;
 
 		ag->num_avgs = 0;
@@ -572,6 +603,13 @@ do_send:
 	}
 }
 
+static void pre_trigger_free(void *data, void *cb_data)
+{
+	(void)cb_data;
+
+	g_free(data);
+}
+
 /* Callback handling data */
 SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 {
@@ -585,7 +623,9 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 	uint64_t samples_todo, logic_done, analog_done, analog_sent, sending_now;
 	int64_t elapsed_us, limit_us, todo_us;
 	int64_t trigger_offset;
-	int pre_trigger_samples;
+	int pre_trigger_samples, len;
+	uint8_t *copy;
+	struct sr_buffer *ref;
 
 	(void)fd;
 	(void)revents;
@@ -653,9 +693,18 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 			logic_generator(sdi, sending_now * devc->logic_unitsize);
 			/* Check for trigger and send pre-trigger data if needed */
 			if (devc->stl && (!devc->trigger_fired)) {
-				trigger_offset = soft_trigger_logic_check(devc->stl,
-						devc->logic_data, sending_now * devc->logic_unitsize,
-						&pre_trigger_samples);
+				/*
+				 * Hand the soft trigger a buffer of its own, so it keeps
+				 * pre-trigger data by reference like with a driver's
+				 * transfers. logic_data gets overwritten next round.
+				 */
+				len = sending_now * devc->logic_unitsize;
+				copy = g_malloc(len);
+				memcpy(copy, devc->logic_data, len);
+				ref = sr_buffer_new(copy, len, pre_trigger_free, NULL);
+				trigger_offset = soft_trigger_logic_check_ref(devc->stl,
+						copy, len, ref, &pre_trigger_samples);
+				sr_buffer_unref(ref);
 				if (trigger_offset > -1) {
 					devc->trigger_fired = TRUE;
 					logic_done = pre_trigger_samples;
@@ -731,11 +780,9 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 			g_hash_table_iter_init(&iter, devc->ch_ag);
 			while (g_hash_table_iter_next(&iter, NULL, &value)) {
 				ag = value;
-				packet.type = SR_DF_ANALOG;
-				packet.payload = &ag->packet;
 				ag->packet.data = &ag->avg_val;
 				ag->packet.num_samples = 1;
-				sr_session_send(sdi, &packet);
+				analog_send(sdi, &ag->packet);
 			}
 		}
 		sr_dbg("Requested number of samples reached.");
@@ -747,3 +794,139 @@ SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data)
 
 	return G_SOURCE_CONTINUE;
 }
+
+/*
+ * Generate the pattern for benchmark mode once. It repeats after the
+ * buffer size, which is a multiple of the slice size.
+ */
+SR_PRIV int demo_bench_prepare(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_logic logic;
+	size_t off, len, gen_size;
+
+	devc = sdi->priv;
+
+	devc->bench_chunk = BENCH_CHUNKSIZE / devc->logic_unitsize;
+	devc->bench_chunk *= devc->logic_unitsize;
+	devc->bench_size = devc->bench_chunk * (BENCH_BUFSIZE / BENCH_CHUNKSIZE);
+	devc->bench_data = g_try_malloc(devc->bench_size);
+	if (!devc->bench_data)
+		return SR_ERR_MALLOC;
+
+	gen_size = (LOGIC_BUFSIZE / devc->logic_unitsize) * devc->logic_unitsize;
+	for (off = 0; off < devc->bench_size; off += len) {
+		len = MIN(devc->bench_size - off, gen_size);
+		logic_generator(sdi, len);
+		memcpy(&devc->bench_data[off], devc->logic_data, len);
+	}
+	logic.length = devc->bench_size;
+	logic.unitsize = devc->logic_unitsize;
+	logic.data = devc->bench_data;
+	logic_fixup_feed(devc, &logic);
+
+	devc->bench_pos = 0;
+	devc->bench_bytes = 0;
+	devc->bench_stats_us = g_get_monotonic_time();
+
+	return SR_OK;
+}
+
+SR_PRIV void demo_bench_free(struct dev_context *devc)
+{
+	g_free(devc->bench_data);
+	devc->bench_data = NULL;
+}
+
+/** Throughput of the current or last benchmark, as a{sv} dictionary. */
+SR_PRIV GVariant *demo_bench_stats_get(const struct dev_context *devc)
+{
+	GVariantBuilder b;
+	int64_t elapsed_us;
+
+	elapsed_us = devc->spent_us;
+	if (devc->bench_data)
+		elapsed_us = g_get_monotonic_time() - devc->start_us;
+
+	g_variant_builder_init(&b, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&b, "{sv}", "bytes",
+		g_variant_new_uint64(devc->bench_bytes));
+	g_variant_builder_add(&b, "{sv}", "samples",
+		g_variant_new_uint64(devc->sent_samples));
+	g_variant_builder_add(&b, "{sv}", "elapsed_us",
+		g_variant_new_uint64(elapsed_us));
+	g_variant_builder_add(&b, "{sv}", "bytes_per_sec",
+		g_variant_new_uint64(elapsed_us > 0 ?
+			devc->bench_bytes * G_USEC_PER_SEC / elapsed_us : 0));
+
+	return g_variant_builder_end(&b);
+}
+
+/*
+ * Send slices of the pattern buffer without copying them, as fast as
+ * the session consumes them. Each call sends for a limited time, such
+ * that the main loop keeps running.
+ */
+SR_PRIV int demo_bench_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	int64_t now, deadline, limit_us;
+	uint64_t remain;
+	size_t len;
+	gboolean done;
+
+	(void)fd;
+	(void)revents;
+
+	sdi = cb_data;
+	devc = sdi->priv;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = devc->logic_unitsize;
+
+	limit_us = 1000 * devc->limit_msec;
+	now = g_get_monotonic_time();
+	deadline = now + BENCH_BUDGET_US;
+	done = FALSE;
+	while (!done && now < deadline) {
+		len = devc->bench_chunk;
+		if (devc->limit_samples) {
+			remain = devc->limit_samples - devc->sent_samples;
+			len = MIN(len, remain * devc->logic_unitsize);
+		}
+		logic.length = len;
+		logic.data = &devc->bench_data[devc->bench_pos];
+		sr_session_send(sdi, &packet);
+		devc->bench_pos += len;
+		if (devc->bench_pos == devc->bench_size)
+			devc->bench_pos = 0;
+		devc->bench_bytes += len;
+		devc->sent_samples += len / devc->logic_unitsize;
+
+		now = g_get_monotonic_time();
+		if (devc->limit_samples && devc->sent_samples >= devc->limit_samples)
+			done = TRUE;
+		if (limit_us > 0 && now - devc->start_us >= limit_us)
+			done = TRUE;
+	}
+
+	if (done || now - devc->bench_stats_us >= BENCH_STATS_US) {
+		devc->bench_stats_us = now;
+		sr_session_send_meta(sdi, SR_CONF_TRANSFER_STATS,
+			demo_bench_stats_get(devc));
+	}
+	if (done) {
+		devc->spent_us = now - devc->start_us;
+		sr_info("Benchmark: %" PRIu64 " bytes in %.3f s, %.1f MiB/s.",
+			devc->bench_bytes, devc->spent_us / 1e6,
+			devc->bench_bytes / 1048576.0 /
+			(MAX(devc->spent_us, 1) / 1e6));
+		sr_dev_acquisition_stop(sdi);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
@@ -38,6 +38,15 @@
 #define SAMPLES_PER_FRAME		1000UL
 #define DEFAULT_LIMIT_FRAMES		0
 
+/*
+ * Benchmark mode sends slices of a pattern buffer which gets generated
+ * once, for as long as the time budget of a callback allows.
+ */
+#define BENCH_BUFSIZE			(16 * 1024 * 1024)
+#define BENCH_CHUNKSIZE			(256 * 1024)
+#define BENCH_BUDGET_US			10000
+#define BENCH_STATS_US			G_USEC_PER_SEC
+
 #define DEFAULT_ANALOG_ENCODING_DIGITS	4
 #define DEFAULT_ANALOG_SPEC_DIGITS		4
 #define DEFAULT_ANALOG_AMPLITUDE		10
@@ -138,10 +147,17 @@ struct dev_context {
 	size_t enabled_analog_channels;
 	size_t first_partial_logic_index;
 	uint8_t first_partial_logic_mask;
+	/* Benchmark mode */
+	gboolean benchmark;
+	uint8_t *bench_data;
+	size_t bench_size, bench_chunk, bench_pos;
+	uint64_t bench_bytes;
+	int64_t bench_stats_us;
 	/* Triggers */
 	uint64_t capture_ratio;
 	gboolean trigger_fired;
 	struct soft_trigger_logic *stl;
+	struct soft_trigger_analog *sta;
 };
 
 struct analog_gen {
@@ -163,5 +179,9 @@ struct analog_gen {
 SR_PRIV void demo_generate_analog_pattern(struct dev_context *devc);
 SR_PRIV void demo_free_analog_pattern(struct dev_context *devc);
 SR_PRIV int demo_prepare_data(int fd, int revents, void *cb_data);
+SR_PRIV int demo_bench_prepare(struct sr_dev_inst *sdi);
+SR_PRIV void demo_bench_free(struct dev_context *devc);
+SR_PRIV GVariant *demo_bench_stats_get(const struct dev_context *devc);
+SR_PRIV int demo_bench_data(int fd, int revents, void *cb_data);
 
 #endif
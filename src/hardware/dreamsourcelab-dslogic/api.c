@@ -156,7 +156,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	/* Find all DSLogic compatible devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -305,8 +305,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 	ret = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/* Returns once the FX2 is back with its new firmware. */
+		ezusb_wait_renumerated(sdi, MAX_RENUM_DELAY_MS);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((ret = dslogic_dev_open(sdi, di)) == SR_OK)
@@ -371,12 +371,16 @@ static int dev_open(struct sr_dev_inst *sdi)
 static int dev_close(struct sr_dev_inst *sdi)
 {
 	struct sr_usb_dev_inst *usb;
+	struct dev_context *devc;
 
 	usb = sdi->conn;
+	devc = sdi->priv;
 
 	if (!usb->devhdl)
 		return SR_ERR_BUG;
 
+	devc->fpga_firmware = NULL;
+
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
@@ -223,14 +223,10 @@ static int command_stop_acquisition(const struct sr_dev_inst *sdi)
 SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi)
 {
 	const char *name = NULL;
-	uint64_t sum;
-	struct sr_resource bitstream;
+	GBytes *bitstream;
 	struct drv_context *drvc;
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
-	unsigned char *buf;
-	ssize_t chunksize;
-	int transferred;
 	int result, ret;
 	const uint8_t cmd[3] = {0, 0, 0};
 
@@ -256,58 +252,43 @@ SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
+	/* Nothing to do when it is there since the device was opened. */
+	if (devc->fpga_firmware && !strcmp(devc->fpga_firmware, name)) {
+		sr_dbg("FPGA firmware '%s' already loaded.", name);
+		return SR_OK;
+	}
+	devc->fpga_firmware = NULL;
+
 	sr_dbg("Uploading FPGA firmware '%s'.", name);
 
-	result = sr_resource_open(drvc->sr_ctx, &bitstream,
-			SR_RESOURCE_FIRMWARE, name);
-	if (result != SR_OK)
-		return result;
+	bitstream = sr_resource_load_cached(drvc->sr_ctx,
+			SR_RESOURCE_FIRMWARE, name, FW_BUFSIZE);
+	if (!bitstream)
+		return SR_ERR;
 
 	/* Tell the device firmware is coming. */
 	if ((ret = libusb_control_transfer(usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR |
 			LIBUSB_ENDPOINT_OUT, DS_CMD_CONFIG, 0x0000, 0x0000,
 			(unsigned char *)&cmd, sizeof(cmd), USB_TIMEOUT)) < 0) {
 		sr_err("Failed to upload FPGA firmware: %s.", libusb_error_name(ret));
-		sr_resource_close(drvc->sr_ctx, &bitstream);
+		g_bytes_unref(bitstream);
 		return SR_ERR;
 	}
 
 	/* Give the FX2 time to get ready for FPGA firmware upload. */
 	g_usleep(FPGA_UPLOAD_DELAY);
 
-	buf = g_malloc(FW_BUFSIZE);
-	sum = 0;
-	result = SR_OK;
-	while (1) {
-		chunksize = sr_resource_read(drvc->sr_ctx, &bitstream,
-				buf, FW_BUFSIZE);
-		if (chunksize < 0)
-			result = SR_ERR;
-		if (chunksize <= 0)
-			break;
-
-		if ((ret = libusb_bulk_transfer(usb->devhdl, 2 | LIBUSB_ENDPOINT_OUT,
-				buf, chunksize, &transferred, USB_TIMEOUT)) < 0) {
-			sr_err("Unable to configure FPGA firmware: %s.",
-					libusb_error_name(ret));
-			result = SR_ERR;
-			break;
-		}
-		sum += transferred;
-		sr_spew("Uploaded %" PRIu64 "/%" PRIu64 " bytes.",
-			sum, bitstream.size);
-
-		if (transferred != chunksize) {
-			sr_err("Short transfer while uploading FPGA firmware.");
-			result = SR_ERR;
-			break;
-		}
-	}
-	g_free(buf);
-	sr_resource_close(drvc->sr_ctx, &bitstream);
+	result = sr_usb_bulk_upload(drvc->sr_ctx, usb->devhdl,
+			2 | LIBUSB_ENDPOINT_OUT, g_bytes_get_data(bitstream, NULL),
+			g_bytes_get_size(bitstream), FW_BUFSIZE, USB_TIMEOUT);
+	g_bytes_unref(bitstream);
+	if (result != SR_OK)
+		sr_err("Unable to configure FPGA firmware.");
 
-	if (result == SR_OK)
+	if (result == SR_OK) {
 		sr_dbg("FPGA firmware upload done.");
+		devc->fpga_firmware = name;
+	}
 
 	return result;
 }
@@ -672,12 +653,17 @@ static void abort_acquisition(struct dev_context *devc)
 	}
 }
 
+static void pipeline_stop(struct sr_dev_inst *sdi);
+
 static void finish_acquisition(struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 
 	devc = sdi->priv;
 
+	/* Send what the worker still has, before the end. */
+	pipeline_stop(sdi);
+
 	std_session_send_df_end(sdi);
 
 	usb_source_remove(sdi->session, devc->ctx);
@@ -696,7 +682,7 @@ static void free_transfer(struct libusb_transfer *transfer)
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
-	g_free(transfer->buffer);
+	sr_usb_buffer_free(sdi->conn, transfer->buffer, transfer->length);
 	transfer->buffer = NULL;
 	libusb_free_transfer(transfer);
 
@@ -724,30 +710,6 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 
 }
 
-static void deinterleave_buffer(const uint8_t *src, size_t length,
-	uint16_t *dst_ptr, size_t channel_count, uint16_t channel_mask)
-{
-	uint16_t sample;
-
-	for (const uint64_t *src_ptr = (uint64_t*)src;
-		src_ptr < (uint64_t*)(src + length);
-		src_ptr += channel_count) {
-		for (int bit = 0; bit != 64; bit++) {
-			const uint64_t *word_ptr = src_ptr;
-			sample = 0;
-			for (unsigned int channel = 0; channel != 16;
-				channel++) {
-				const uint16_t m = channel_mask >> channel;
-				if (!m)
-					break;
-				if ((m & 1) && ((*word_ptr++ >> bit) & UINT64_C(1)))
-					sample |= 1 << channel;
-			}
-			*dst_ptr++ = sample;
-		}
-	}
-}
-
 static void send_data(struct sr_dev_inst *sdi,
 	uint16_t *data, size_t sample_count)
 {
@@ -765,19 +727,237 @@ static void send_data(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
+/* Send transposed samples, up to the limit and with the trigger. */
+static void send_samples(struct sr_dev_inst *sdi, uint16_t *samples,
+	unsigned int cur_sample_count)
+{
+	struct dev_context *const devc = sdi->priv;
+	unsigned int num_samples;
+	int trigger_offset;
+
+	if (devc->limit_samples && devc->sent_samples >= devc->limit_samples)
+		return;
+
+	if (devc->limit_samples && devc->sent_samples + cur_sample_count > devc->limit_samples)
+		num_samples = devc->limit_samples - devc->sent_samples;
+	else
+		num_samples = cur_sample_count;
+
+	/* Send the incoming transfer to the session bus. */
+	if (devc->trigger_pos > devc->sent_samples
+		&& devc->trigger_pos <= devc->sent_samples + num_samples) {
+		/* DSLogic trigger in this block. Send trigger position. */
+		trigger_offset = devc->trigger_pos - devc->sent_samples;
+		/* Pre-trigger samples. */
+		send_data(sdi, samples, trigger_offset);
+		devc->sent_samples += trigger_offset;
+		/* Trigger position. */
+		devc->trigger_pos = 0;
+		std_session_send_df_trigger(sdi);
+		/* Post trigger samples. */
+		num_samples -= trigger_offset;
+		send_data(sdi, samples + trigger_offset, num_samples);
+		devc->sent_samples += num_samples;
+	} else {
+		send_data(sdi, samples, num_samples);
+		devc->sent_samples += num_samples;
+	}
+}
+
+/*
+ * Send a transfer as it came, for consumers which take planar data.
+ * Returns FALSE for a transfer with the trigger in it, a planar packet
+ * can't start within a block, so that one still gets transposed.
+ */
+static gboolean send_planar(struct sr_dev_inst *sdi, void *buf,
+	unsigned int cur_sample_count)
+{
+	struct dev_context *const devc = sdi->priv;
+	struct sr_datafeed_logic_planar planar;
+	struct sr_datafeed_packet packet;
+	unsigned int num_samples;
+
+	if (devc->trigger_pos > devc->sent_samples
+		&& devc->trigger_pos <= devc->sent_samples + cur_sample_count)
+		return FALSE;
+
+	num_samples = cur_sample_count;
+	if (devc->limit_samples && devc->sent_samples + num_samples > devc->limit_samples)
+		num_samples = devc->limit_samples - devc->sent_samples;
+	if (!num_samples)
+		return TRUE;
+
+	planar.num_samples = num_samples;
+	planar.unitsize = sizeof(uint16_t);
+	planar.word_bits = 64;
+	planar.num_planes = devc->transpose.num_words;
+	planar.plane_bits = devc->plane_bits;
+	planar.data = buf;
+	packet.type = SR_DF_LOGIC_PLANAR;
+	packet.payload = &planar;
+	sr_session_send(sdi, &packet);
+	devc->sent_samples += num_samples;
+
+	return TRUE;
+}
+
+static gpointer pipeline_worker(gpointer data)
+{
+	struct dev_context *devc;
+	struct dslogic_block *block;
+	size_t block_bytes;
+
+	devc = data;
+	block_bytes = sr_transpose_block_bytes(&devc->transpose);
+
+	/* A block without raw data asks the worker to stop. */
+	while ((block = g_async_queue_pop(devc->fill_queue))->raw) {
+		sr_transpose_blocks(&devc->transpose, block->samples,
+			block->raw, block->raw_len / block_bytes);
+		g_async_queue_push(devc->done_queue, block);
+	}
+	g_free(block);
+
+	return NULL;
+}
+
+/*
+ * Send the blocks the worker has finished, in order. With wait, block
+ * until at least one is done.
+ */
+static void pipeline_drain(struct sr_dev_inst *sdi, gboolean wait)
+{
+	struct dev_context *devc;
+	struct dslogic_block *block;
+
+	devc = sdi->priv;
+
+	if (!devc->worker)
+		return;
+
+	block = wait ? g_async_queue_pop(devc->done_queue) :
+		g_async_queue_try_pop(devc->done_queue);
+	while (block) {
+		send_samples(sdi, block->samples, block->num_samples);
+		devc->free_blocks[devc->num_free_blocks++] = block;
+		block = g_async_queue_try_pop(devc->done_queue);
+	}
+}
+
+static void pipeline_free(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	unsigned int i;
+
+	devc = sdi->priv;
+
+	for (i = 0; i < NUM_PIPELINE_BLOCKS; i++) {
+		sr_usb_buffer_free(sdi->conn, devc->blocks[i].raw,
+			devc->block_size);
+		g_free(devc->blocks[i].samples);
+	}
+	memset(devc->blocks, 0, sizeof(devc->blocks));
+	devc->num_free_blocks = 0;
+	if (devc->fill_queue)
+		g_async_queue_unref(devc->fill_queue);
+	if (devc->done_queue)
+		g_async_queue_unref(devc->done_queue);
+	devc->fill_queue = NULL;
+	devc->done_queue = NULL;
+}
+
+/*
+ * Start the transpose worker, with blocks of transfer size bytes. Falls
+ * back to transposing in receive_transfer() if that fails.
+ */
+static void pipeline_start(struct sr_dev_inst *sdi, size_t size,
+	size_t samples_size)
+{
+	struct dev_context *devc;
+	struct dslogic_block *block;
+	unsigned int i;
+
+	devc = sdi->priv;
+
+	devc->queued_samples = 0;
+	devc->num_free_blocks = 0;
+	devc->block_size = size;
+	for (i = 0; i < NUM_PIPELINE_BLOCKS; i++) {
+		block = &devc->blocks[i];
+		block->raw = sr_usb_buffer_alloc(sdi->conn, size);
+		block->samples = g_try_malloc(samples_size);
+		if (!block->raw || !block->samples)
+			break;
+		devc->free_blocks[devc->num_free_blocks++] = block;
+	}
+	if (i < NUM_PIPELINE_BLOCKS) {
+		sr_warn("No memory for transpose buffers, not pipelining.");
+		pipeline_free(sdi);
+		return;
+	}
+
+	devc->fill_queue = g_async_queue_new();
+	devc->done_queue = g_async_queue_new();
+	devc->worker = g_thread_try_new("dslogic-transpose", pipeline_worker,
+		devc, NULL);
+	if (!devc->worker) {
+		sr_warn("Failed to start transpose thread, not pipelining.");
+		pipeline_free(sdi);
+	}
+}
+
+static void pipeline_stop(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (!devc->worker)
+		return;
+
+	g_async_queue_push(devc->fill_queue, g_malloc0(sizeof(struct dslogic_block)));
+	g_thread_join(devc->worker);
+	pipeline_drain(sdi, FALSE);
+	devc->worker = NULL;
+	pipeline_free(sdi);
+}
+
+/*
+ * Hand a filled transfer to the worker, and put a spare buffer in its
+ * place. Waits for the worker if all blocks are taken.
+ */
+static void pipeline_push(struct sr_dev_inst *sdi,
+	struct libusb_transfer *transfer, unsigned int num_samples)
+{
+	struct dev_context *devc;
+	struct dslogic_block *block;
+	uint8_t *spare;
+
+	devc = sdi->priv;
+
+	if (!devc->num_free_blocks)
+		pipeline_drain(sdi, TRUE);
+	block = devc->free_blocks[--devc->num_free_blocks];
+
+	spare = block->raw;
+	block->raw = transfer->buffer;
+	block->raw_len = transfer->actual_length;
+	block->num_samples = num_samples;
+	transfer->buffer = spare;
+	g_async_queue_push(devc->fill_queue, block);
+	devc->queued_samples += num_samples;
+}
+
 static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *const sdi = transfer->user_data;
 	struct dev_context *const devc = sdi->priv;
 	const size_t channel_count = enabled_channel_count(sdi);
-	const uint16_t channel_mask = enabled_channel_mask(sdi);
 	const unsigned int cur_sample_count = DSLOGIC_ATOMIC_SAMPLES *
 		transfer->actual_length /
 		(DSLOGIC_ATOMIC_BYTES * channel_count);
 
 	gboolean packet_has_error = FALSE;
-	unsigned int num_samples;
-	int trigger_offset;
 
 	/*
 	 * If acquisition has already ended, just free any queued up
@@ -823,47 +1003,42 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		devc->empty_transfer_count = 0;
 	}
 
+	/**
+	 * The DSLogic emits sample data as sequences of 64-bit sample words
+	 * in a round-robin i.e. 64-bits from channel 0, 64-bits from channel 1
+	 * etc. for each of the enabled channels, then looping back to the
+	 * channel.
+	 *
+	 * Because sigrok's internal representation is bit-interleaved channels
+	 * we must recast the data.
+	 *
+	 * Hopefully in future it will be possible to pass the data on as-is.
+	 */
+	if (transfer->actual_length % (DSLOGIC_ATOMIC_BYTES * channel_count) != 0)
+		sr_err("Invalid transfer length!");
+
+	if (devc->worker) {
+		pipeline_drain(sdi, FALSE);
+		if (!devc->limit_samples || devc->queued_samples < devc->limit_samples)
+			pipeline_push(sdi, transfer, cur_sample_count);
+		/* The rest gets sent when the last transfer is gone. */
+		if (devc->limit_samples && devc->queued_samples >= devc->limit_samples) {
+			abort_acquisition(devc);
+			free_transfer(transfer);
+		} else
+			resubmit_transfer(transfer);
+		return;
+	}
+
 	if (!devc->limit_samples || devc->sent_samples < devc->limit_samples) {
-		if (devc->limit_samples && devc->sent_samples + cur_sample_count > devc->limit_samples)
-			num_samples = devc->limit_samples - devc->sent_samples;
-		else
-			num_samples = cur_sample_count;
-
-		/**
-		 * The DSLogic emits sample data as sequences of 64-bit sample words
-		 * in a round-robin i.e. 64-bits from channel 0, 64-bits from channel 1
-		 * etc. for each of the enabled channels, then looping back to the
-		 * channel.
-		 *
-		 * Because sigrok's internal representation is bit-interleaved channels
-		 * we must recast the data.
-		 *
-		 * Hopefully in future it will be possible to pass the data on as-is.
-		 */
-		if (transfer->actual_length % (DSLOGIC_ATOMIC_BYTES * channel_count) != 0)
-			sr_err("Invalid transfer length!");
-		deinterleave_buffer(transfer->buffer, transfer->actual_length,
-			devc->deinterleave_buffer, channel_count, channel_mask);
-
-		/* Send the incoming transfer to the session bus. */
-		if (devc->trigger_pos > devc->sent_samples
-			&& devc->trigger_pos <= devc->sent_samples + num_samples) {
-			/* DSLogic trigger in this block. Send trigger position. */
-			trigger_offset = devc->trigger_pos - devc->sent_samples;
-			/* Pre-trigger samples. */
-			send_data(sdi, devc->deinterleave_buffer, trigger_offset);
-			devc->sent_samples += trigger_offset;
-			/* Trigger position. */
-			devc->trigger_pos = 0;
-			std_session_send_df_trigger(sdi);
-			/* Post trigger samples. */
-			num_samples -= trigger_offset;
-			send_data(sdi, devc->deinterleave_buffer
-				+ trigger_offset, num_samples);
-			devc->sent_samples += num_samples;
-		} else {
-			send_data(sdi, devc->deinterleave_buffer, num_samples);
-			devc->sent_samples += num_samples;
+		if (!devc->planar || !send_planar(sdi, transfer->buffer,
+				cur_sample_count)) {
+			sr_transpose_blocks(&devc->transpose,
+				devc->deinterleave_buffer, transfer->buffer,
+				transfer->actual_length /
+				(DSLOGIC_ATOMIC_BYTES * channel_count));
+			send_samples(sdi, devc->deinterleave_buffer,
+				cur_sample_count);
 		}
 	}
 
@@ -878,6 +1053,8 @@ static int receive_data(int fd, int revents, void *cb_data)
 {
 	struct timeval tv;
 	struct drv_context *drvc;
+	struct sr_dev_inst *sdi;
+	GSList *l;
 
 	(void)fd;
 	(void)revents;
@@ -887,6 +1064,13 @@ static int receive_data(int fd, int revents, void *cb_data)
 	tv.tv_sec = tv.tv_usec = 0;
 	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
 
+	/* Pass on what the transpose workers got done meanwhile. */
+	for (l = drvc->instances; l; l = l->next) {
+		sdi = l->data;
+		if (sdi->priv)
+			pipeline_drain(sdi, FALSE);
+	}
+
 	return TRUE;
 }
 
@@ -944,7 +1128,8 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
 	struct libusb_transfer *transfer;
-	unsigned int i;
+	uint16_t channel_mask, word_masks[16];
+	unsigned int i, num_words;
 	int ret;
 	unsigned char *buf;
 
@@ -971,9 +1156,29 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 		return SR_ERR_MALLOC;
 	}
 
+	/* Each enabled channel sends one word per block, in channel order. */
+	num_words = 0;
+	channel_mask = enabled_channel_mask(sdi);
+	for (i = 0; i < 16; i++) {
+		if (!(channel_mask & (1 << i)))
+			continue;
+		devc->plane_bits[num_words] = i;
+		word_masks[num_words++] = 1 << i;
+	}
+	if ((ret = sr_transpose_init(&devc->transpose, 64, FALSE,
+			word_masks, num_words)) != SR_OK)
+		return ret;
+
+	/* Planar consumers get the transfers as they are, no worker needed. */
+	devc->planar = sr_session_takes_logic_planar(sdi->session);
+	if (!devc->planar)
+		pipeline_start((struct sr_dev_inst *)sdi, size,
+			DSLOGIC_ATOMIC_SAMPLES * (size / (channel_count *
+			DSLOGIC_ATOMIC_BYTES)) * sizeof(uint16_t));
+
 	devc->num_transfers = num_transfers;
 	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
+		if (!(buf = sr_usb_buffer_alloc(usb, size))) {
 			sr_err("USB transfer buffer malloc failed.");
 			return SR_ERR_MALLOC;
 		}
@@ -986,7 +1191,7 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			libusb_free_transfer(transfer);
-			g_free(buf);
+			sr_usb_buffer_free(usb, buf, size);
 			abort_acquisition(devc);
 			return SR_ERR;
 		}
@@ -28,6 +28,7 @@
 #include <libusb.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
+#include "transpose.h"
 
 #define LOG_PREFIX "dreamsourcelab-dslogic"
 
@@ -37,6 +38,8 @@
 #define MAX_RENUM_DELAY_MS	3000
 #define NUM_SIMUL_TRANSFERS	32
 #define MAX_EMPTY_TRANSFERS	(NUM_SIMUL_TRANSFERS * 2)
+/* Filled transfer buffers the transpose worker may hold at once. */
+#define NUM_PIPELINE_BLOCKS	4
 
 #define NUM_CHANNELS		16
 #define NUM_TRIGGER_STAGES	16
@@ -105,6 +108,14 @@ struct dslogic_profile {
 	uint64_t mem_depth;
 };
 
+/* A filled transfer buffer, and room for its transposed samples. */
+struct dslogic_block {
+	uint8_t *raw;
+	int raw_len;
+	uint16_t *samples;
+	unsigned int num_samples;
+};
+
 struct dev_context {
 	const struct dslogic_profile *profile;
 	/*
@@ -133,6 +144,24 @@ struct dev_context {
 	struct sr_context *ctx;
 
 	uint16_t *deinterleave_buffer;
+	struct sr_transpose transpose;
+	/* Pass transfers on as SR_DF_LOGIC_PLANAR, plane n is bit plane_bits[n]. */
+	gboolean planar;
+	uint16_t plane_bits[16];
+
+	/*
+	 * Transfers are transposed on a worker thread, so that they can
+	 * be resubmitted with a spare buffer right away. Without the
+	 * worker, receive_transfer() transposes them itself.
+	 */
+	GThread *worker;
+	GAsyncQueue *fill_queue;
+	GAsyncQueue *done_queue;
+	struct dslogic_block blocks[NUM_PIPELINE_BLOCKS];
+	struct dslogic_block *free_blocks[NUM_PIPELINE_BLOCKS];
+	unsigned int num_free_blocks;
+	size_t block_size;
+	unsigned int queued_samples;
 
 	uint16_t mode;
 	uint32_t trigger_pos;
@@ -140,6 +169,8 @@ struct dev_context {
 	gboolean continuous_mode;
 	int clock_edge;
 	double cur_threshold;
+	/* The FPGA firmware uploaded since the device was opened. */
+	const char *fpga_firmware;
 };
 
 SR_PRIV int dslogic_fpga_firmware_upload(const struct sr_dev_inst *sdi);
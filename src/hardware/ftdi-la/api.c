@@ -275,7 +275,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	if (conn) {
 		devices = NULL;
-		libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+		sr_usb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
 		for (i = 0; devlist[i]; i++) {
 			conn_devices = sr_usb_find(drvc->sr_ctx->libusb_ctx, conn);
 			for (l = conn_devices; l; l = l->next) {
@@ -466,6 +466,10 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	std_session_send_df_header(sdi);
 
+	devc->async = (ftdi_la_start_transfers(sdi) == SR_OK);
+	if (!devc->async)
+		sr_warn("Bulk transfers unavailable, reading synchronously.");
+
 	/* Hook up a dummy handler to receive data from the device. */
 	sr_session_source_add(sdi->session, -1, G_IO_IN, 0,
 			      ftdi_la_receive_data, (void *)sdi);
@@ -475,8 +479,17 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
 	sr_session_source_remove(sdi->session, -1);
 
+	if (devc->async) {
+		ftdi_la_abort_transfers(devc);
+		devc->async = FALSE;
+	}
+
 	std_session_send_df_end(sdi);
 
 	return SR_OK;
@@ -19,9 +19,11 @@
 
 #include <config.h>
 #include <ftdi.h>
+#include <string.h>
 #include "protocol.h"
 
-static void send_samples(struct sr_dev_inst *sdi, uint64_t samples_to_send)
+static void send_samples(struct sr_dev_inst *sdi, unsigned char *data,
+	uint64_t samples_to_send)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
@@ -35,11 +37,146 @@ static void send_samples(struct sr_dev_inst *sdi, uint64_t samples_to_send)
 	packet.payload = &logic;
 	logic.length = samples_to_send;
 	logic.unitsize = 1;
-	logic.data = devc->data_buf;
+	logic.data = data;
 	sr_session_send(sdi, &packet);
 
 	devc->samples_sent += samples_to_send;
-	devc->bytes_received -= samples_to_send;
+}
+
+static void free_transfer(struct dev_context *devc,
+	struct libusb_transfer *transfer)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfers[i] == transfer) {
+			devc->transfers[i] = NULL;
+			break;
+		}
+	}
+	g_free(transfer->buffer);
+	transfer->buffer = NULL;
+	libusb_free_transfer(transfer);
+	devc->submitted_transfers--;
+}
+
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	int packet_size, pos, len, num_bytes;
+	uint64_t samples_to_send;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	if (devc->acq_done || transfer->status == LIBUSB_TRANSFER_CANCELLED) {
+		free_transfer(devc, transfer);
+		return;
+	}
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED &&
+	    transfer->status != LIBUSB_TRANSFER_TIMED_OUT) {
+		sr_err("Bulk transfer failed (%d).", transfer->status);
+		devc->acq_done = TRUE;
+		free_transfer(devc, transfer);
+		return;
+	}
+
+	/*
+	 * Every packet starts with two modem status bytes. Strip them for
+	 * the whole transfer in one pass, moving the samples down in place.
+	 */
+	packet_size = devc->ftdic->max_packet_size;
+	num_bytes = 0;
+	for (pos = 0; pos < transfer->actual_length; pos += packet_size) {
+		len = MIN(packet_size, transfer->actual_length - pos) - 2;
+		if (len <= 0)
+			continue;
+		memmove(transfer->buffer + num_bytes,
+			transfer->buffer + pos + 2, len);
+		num_bytes += len;
+	}
+
+	if (num_bytes > 0) {
+		samples_to_send = num_bytes;
+		if (devc->limit_samples && samples_to_send >=
+		    devc->limit_samples - devc->samples_sent) {
+			samples_to_send = devc->limit_samples - devc->samples_sent;
+			devc->acq_done = TRUE;
+		}
+		send_samples(sdi, transfer->buffer, samples_to_send);
+	}
+
+	if (devc->acq_done || libusb_submit_transfer(transfer) != 0) {
+		devc->acq_done = TRUE;
+		free_transfer(devc, transfer);
+	}
+}
+
+/*
+ * Keep several bulk transfers in flight on the FTDI read endpoint, so
+ * that the chip's small FIFO gets emptied while the host is busy
+ * sending samples to the session. Returns an error if not even one
+ * transfer could be submitted, the caller then reads synchronously.
+ */
+SR_PRIV int ftdi_la_start_transfers(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct libusb_transfer *transfer;
+	unsigned char *buf;
+	unsigned int i;
+	int size, ret;
+
+	devc = sdi->priv;
+	devc->acq_done = FALSE;
+	devc->submitted_transfers = 0;
+	memset(devc->transfers, 0, sizeof(devc->transfers));
+
+	size = TRANSFER_PACKETS * devc->ftdic->max_packet_size;
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		buf = g_try_malloc(size);
+		if (!buf)
+			break;
+		transfer = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfer, devc->ftdic->usb_dev,
+			devc->ftdic->out_ep, buf, size, receive_transfer,
+			(void *)sdi, 0);
+		ret = libusb_submit_transfer(transfer);
+		if (ret != 0) {
+			sr_dbg("Failed to submit transfer: %s.",
+			       libusb_error_name(ret));
+			libusb_free_transfer(transfer);
+			g_free(buf);
+			break;
+		}
+		devc->transfers[i] = transfer;
+		devc->submitted_transfers++;
+	}
+
+	if (!devc->submitted_transfers)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+SR_PRIV void ftdi_la_abort_transfers(struct dev_context *devc)
+{
+	struct timeval tv;
+	unsigned int i, tries;
+
+	devc->acq_done = TRUE;
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfers[i])
+			libusb_cancel_transfer(devc->transfers[i]);
+	}
+
+	/* Let the cancelled transfers complete, they free themselves. */
+	for (tries = 0; devc->submitted_transfers && tries < 100; tries++) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 10000;
+		libusb_handle_events_timeout_completed(devc->ftdic->usb_ctx,
+			&tv, NULL);
+	}
 }
 
 SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc)
@@ -60,6 +197,7 @@ SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
+	struct timeval tv;
 	int bytes_read;
 	uint64_t n;
 
@@ -75,6 +213,21 @@ SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 	if (!devc->ftdic)
 		return TRUE;
 
+	if (devc->async) {
+		/* The completion handler sends the samples. */
+		tv.tv_sec = 0;
+		tv.tv_usec = 10000;
+		libusb_handle_events_timeout_completed(devc->ftdic->usb_ctx,
+			&tv, NULL);
+		if (devc->acq_done) {
+			if (devc->limit_samples &&
+			    devc->samples_sent >= devc->limit_samples)
+				sr_info("Requested number of samples reached.");
+			sr_dev_acquisition_stop(sdi);
+		}
+		return TRUE;
+	}
+
 	/* Get a block of data. */
 	bytes_read = ftdi_read_data(devc->ftdic, devc->data_buf, DATA_BUF_SIZE);
 	if (bytes_read < 0) {
@@ -93,12 +246,15 @@ SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data)
 	n = devc->samples_sent + devc->bytes_received;
 
 	if (devc->limit_samples && (n >= devc->limit_samples)) {
-		send_samples(sdi, devc->limit_samples - devc->samples_sent);
+		send_samples(sdi, devc->data_buf,
+			devc->limit_samples - devc->samples_sent);
+		devc->bytes_received = 0;
 		sr_info("Requested number of samples reached.");
 		sr_dev_acquisition_stop(sdi);
 		return TRUE;
 	} else {
-		send_samples(sdi, devc->bytes_received);
+		send_samples(sdi, devc->data_buf, devc->bytes_received);
+		devc->bytes_received = 0;
 	}
 
 	return TRUE;
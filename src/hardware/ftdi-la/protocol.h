@@ -29,6 +29,10 @@
 
 #define DATA_BUF_SIZE (16 * 1024)
 
+/* Number of bulk transfers kept in flight, and their size in packets. */
+#define NUM_TRANSFERS 8
+#define TRANSFER_PACKETS 64
+
 struct ftdi_chip_desc {
 	uint16_t vendor;
 	uint16_t product;
@@ -46,9 +50,17 @@ struct dev_context {
 	unsigned char *data_buf;
 	uint64_t samples_sent;
 	uint64_t bytes_received;
+
+	/* Asynchronous reads, used unless they can't be submitted. */
+	gboolean async;
+	gboolean acq_done;
+	struct libusb_transfer *transfers[NUM_TRANSFERS];
+	unsigned int submitted_transfers;
 };
 
 SR_PRIV int ftdi_la_set_samplerate(struct dev_context *devc);
+SR_PRIV int ftdi_la_start_transfers(const struct sr_dev_inst *sdi);
+SR_PRIV void ftdi_la_abort_transfers(struct dev_context *devc);
 SR_PRIV int ftdi_la_receive_data(int fd, int revents, void *cb_data);
 
 #endif
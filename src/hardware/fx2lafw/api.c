@@ -132,6 +132,10 @@ static const uint32_t devopts[] = {
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_LIST,
 	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_PLAN | SR_CONF_GET,
+	SR_CONF_TRANSFER_COUNT | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_SIZE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_LATENCY | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const int32_t trigger_matches[] = {
@@ -230,7 +234,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	/* Find all fx2lafw compatible devices and upload firmware to them. */
 	devices = NULL;
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -430,8 +434,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 	ret = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/* Returns once the FX2 is back with its new firmware. */
+		ezusb_wait_renumerated(sdi, MAX_RENUM_DELAY_MS);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((ret = fx2lafw_dev_open(sdi, di)) == SR_OK)
@@ -495,6 +499,7 @@ static int dev_close(struct sr_dev_inst *sdi)
 
 	sr_info("Closing device on %d.%d (logical) / %s (physical) interface %d.",
 		usb->bus, usb->address, sdi->connection_id, USB_INTERFACE);
+	fx2lafw_free_buffers(sdi);
 	libusb_release_interface(usb->devhdl, USB_INTERFACE);
 	libusb_close(usb->devhdl);
 	usb->devhdl = NULL;
@@ -507,6 +512,8 @@ static int config_get(uint32_t key, GVariant **data,
 {
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
+	unsigned int count, duration;
+	size_t size;
 
 	(void)cg;
 
@@ -538,6 +545,20 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_CAPTURE_RATIO:
 		*data = g_variant_new_uint64(devc->capture_ratio);
 		break;
+	case SR_CONF_TRANSFER_PLAN:
+		fx2lafw_transfer_plan(devc, &count, &size, &duration);
+		*data = g_variant_new_printf("%ux%zu bytes per %ums",
+			count, size, duration);
+		break;
+	case SR_CONF_TRANSFER_COUNT:
+		*data = g_variant_new_uint64(devc->transfer_count);
+		break;
+	case SR_CONF_TRANSFER_SIZE:
+		*data = g_variant_new_uint64(devc->transfer_size);
+		break;
+	case SR_CONF_TRANSFER_LATENCY:
+		*data = g_variant_new_uint64(devc->transfer_latency);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -573,6 +594,15 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_CAPTURE_RATIO:
 		devc->capture_ratio = g_variant_get_uint64(data);
 		break;
+	case SR_CONF_TRANSFER_COUNT:
+		devc->transfer_count = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_TRANSFER_SIZE:
+		devc->transfer_size = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_TRANSFER_LATENCY:
+		devc->transfer_latency = g_variant_get_uint64(data);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
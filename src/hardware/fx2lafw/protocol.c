@@ -292,17 +292,24 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 
 	devc->num_transfers = 0;
 	g_free(devc->transfers);
-
-	/* Free the deinterlace buffers if we had them. */
-	if (g_slist_length(devc->enabled_analog_channels) > 0) {
-		g_free(devc->logic_buffer);
-		g_free(devc->analog_buffer);
-	}
+	devc->transfers = NULL;
 
 	if (devc->stl) {
 		soft_trigger_logic_free(devc->stl);
 		devc->stl = NULL;
 	}
+
+	if (devc->seg_stl) {
+		soft_trigger_logic_free(devc->seg_stl);
+		devc->seg_stl = NULL;
+		devc->seg_frames = FALSE;
+		g_free(devc->seg_history);
+		g_free(devc->seg_join);
+		g_array_free(devc->seg_offsets, TRUE);
+		devc->seg_history = NULL;
+		devc->seg_join = NULL;
+		devc->seg_offsets = NULL;
+	}
 }
 
 static void free_transfer(struct libusb_transfer *transfer)
@@ -314,7 +321,7 @@ static void free_transfer(struct libusb_transfer *transfer)
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
-	g_free(transfer->buffer);
+	/* The buffer stays in the pool for the next acquisition. */
 	transfer->buffer = NULL;
 	libusb_free_transfer(transfer);
 
@@ -334,6 +341,7 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 {
 	int ret;
 
+	SR_TRACE1(usb_resubmit, transfer);
 	if ((ret = libusb_submit_transfer(transfer)) == LIBUSB_SUCCESS)
 		return;
 
@@ -351,6 +359,9 @@ static void mso_send_data_proc(struct sr_dev_inst *sdi,
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
+	uint8_t *bits;
+	float *values;
+	const float *lut;
 
 	(void)sample_width;
 
@@ -358,12 +369,17 @@ static void mso_send_data_proc(struct sr_dev_inst *sdi,
 
 	length /= 2;
 
-	/* Send the logic */
-	for (i = 0; i < length; i++) {
-		devc->logic_buffer[i] = data[i * 2];
-		/* Rescale to -10V - +10V from 0-255. */
-		devc->analog_buffer[i] = (data[i * 2 + 1] - 128.0f) / 12.8f;
-	};
+	/*
+	 * Deinterleave in separate loops, the logic one vectorizes. The
+	 * analog values come from a table instead of a division each.
+	 */
+	bits = devc->logic_buffer;
+	for (i = 0; i < length; i++)
+		bits[i] = data[i * 2];
+	values = devc->analog_buffer;
+	lut = devc->analog_lut;
+	for (i = 0; i < length; i++)
+		values[i] = lut[data[i * 2 + 1]];
 
 	const struct sr_datafeed_logic logic = {
 		.length = length,
@@ -411,6 +427,177 @@ static void la_send_data_proc(struct sr_dev_inst *sdi,
 	sr_session_send(sdi, &packet);
 }
 
+/*
+ * Find the trigger positions in a transfer of num samples. Triggers
+ * which start in the previous transfer are searched for in the tail of
+ * it joined with the head of this one, the rest in the transfer itself.
+ */
+static void segmented_find(struct dev_context *devc, const uint8_t *buf,
+	int num)
+{
+	GArray *offsets;
+	int unitsize, p, h, from;
+	unsigned int keep;
+
+	unitsize = devc->seg_stl->unitsize;
+	offsets = devc->seg_offsets;
+	g_array_set_size(offsets, 0);
+
+	p = MIN(devc->seg_hist_len, devc->seg_span + 1);
+	if (p > 0) {
+		h = MIN((uint64_t)num, devc->seg_span + 1);
+		memcpy(devc->seg_join, devc->seg_history +
+			(devc->seg_hist_len - p) * unitsize, p * unitsize);
+		memcpy(devc->seg_join + p * unitsize, buf, h * unitsize);
+		/* The first sample only is a previous one after the start. */
+		from = (uint64_t)p == devc->seg_pos ? 0 : 1;
+		soft_trigger_logic_find_all(devc->seg_stl, devc->seg_join,
+			p + h, from, p + 1, devc->seg_pos - p, offsets);
+		/* Those completing in the previous transfer were found with it. */
+		keep = 0;
+		while (keep < offsets->len && g_array_index(offsets,
+				uint64_t, keep) < devc->seg_pos)
+			keep++;
+		g_array_remove_range(offsets, 0, keep);
+	}
+	soft_trigger_logic_find_all(devc->seg_stl, buf, num, p > 0 ? 1 : 0,
+		num, devc->seg_pos, offsets);
+}
+
+/* Keep the end of the received data, for the next transfer. */
+static void segmented_keep(struct dev_context *devc, const uint8_t *buf,
+	uint64_t num)
+{
+	uint64_t drop;
+	int unitsize;
+
+	unitsize = devc->seg_stl->unitsize;
+	if (num >= devc->seg_hist_cap) {
+		memcpy(devc->seg_history, buf + (num - devc->seg_hist_cap) * unitsize,
+			devc->seg_hist_cap * unitsize);
+		devc->seg_hist_len = devc->seg_hist_cap;
+	} else {
+		drop = devc->seg_hist_len + num > devc->seg_hist_cap ?
+			devc->seg_hist_len + num - devc->seg_hist_cap : 0;
+		memmove(devc->seg_history, devc->seg_history + drop * unitsize,
+			(devc->seg_hist_len - drop) * unitsize);
+		devc->seg_hist_len -= drop;
+		memcpy(devc->seg_history + devc->seg_hist_len * unitsize, buf,
+			num * unitsize);
+		devc->seg_hist_len += num;
+	}
+	devc->seg_pos += num;
+}
+
+/* Send samples in pieces no larger than a transfer, as MSO expects. */
+static void segmented_send(struct sr_dev_inst *sdi, uint8_t *data,
+	uint64_t num)
+{
+	struct dev_context *devc;
+	size_t len, unitsize;
+
+	devc = sdi->priv;
+	unitsize = devc->seg_stl->unitsize;
+	if (devc->seg_frames) {
+		sr_session_frame_append(sdi, data, num);
+		return;
+	}
+	while (num) {
+		len = MIN(num * unitsize, devc->transfer_buffer_size);
+		devc->send_data_proc(sdi, data, len, unitsize);
+		data += len;
+		num -= len / unitsize;
+	}
+}
+
+/*
+ * Cut frames out of a transfer at all trigger positions found in it.
+ * A frame starts with up to seg_pre samples before its trigger, none
+ * from the previous frame though. Triggers within a frame are skipped.
+ */
+static void receive_segmented(struct sr_dev_inst *sdi,
+	struct libusb_transfer *transfer)
+{
+	struct dev_context *devc;
+	GArray *offsets;
+	uint8_t *buf;
+	uint64_t num, i, trig, lo, n;
+	unsigned int idx;
+	int unitsize;
+	gboolean done;
+
+	devc = sdi->priv;
+	unitsize = devc->seg_stl->unitsize;
+	buf = transfer->buffer;
+	num = transfer->actual_length / unitsize;
+	offsets = devc->seg_offsets;
+
+	segmented_find(devc, buf, num);
+
+	idx = 0;
+	i = 0;
+	done = FALSE;
+	while (i < num && !done) {
+		if (!devc->trigger_fired) {
+			while (idx < offsets->len && g_array_index(offsets,
+					uint64_t, idx) < devc->seg_pos + i)
+				idx++;
+			if (idx == offsets->len)
+				break;
+			trig = g_array_index(offsets, uint64_t, idx++);
+
+			if (!devc->seg_frames)
+				std_session_send_df_frame_begin(sdi);
+			lo = MAX(devc->seg_frame_end,
+				devc->seg_pos - devc->seg_hist_len);
+			lo = MAX(lo, trig > devc->seg_pre ? trig - devc->seg_pre : 0);
+			if (lo < devc->seg_pos) {
+				n = devc->seg_pos - lo;
+				segmented_send(sdi, devc->seg_history +
+					(devc->seg_hist_len - n) * unitsize, n);
+			}
+			if (trig > devc->seg_pos && trig > lo) {
+				n = MAX(lo, devc->seg_pos) - devc->seg_pos;
+				segmented_send(sdi, buf + n * unitsize,
+					trig - devc->seg_pos - n);
+			}
+			devc->sent_samples = trig - lo;
+			if (devc->seg_frames)
+				sr_session_frame_trigger(sdi);
+			else
+				std_session_send_df_trigger(sdi);
+			devc->trigger_fired = TRUE;
+			i = trig - devc->seg_pos;
+		}
+
+		n = MIN(num - i, devc->limit_samples - devc->sent_samples);
+		segmented_send(sdi, buf + i * unitsize, n);
+		devc->sent_samples += n;
+		i += n;
+
+		if (devc->sent_samples >= devc->limit_samples) {
+			devc->num_frames++;
+			devc->sent_samples = 0;
+			devc->trigger_fired = FALSE;
+			devc->seg_frame_end = devc->seg_pos + i;
+			if (devc->seg_frames)
+				sr_session_frame_end(sdi);
+			else
+				std_session_send_df_frame_end(sdi);
+			if (devc->limit_frames && devc->num_frames >= devc->limit_frames)
+				done = TRUE;
+		}
+	}
+
+	segmented_keep(devc, buf, num);
+
+	if (done) {
+		fx2lafw_abort_acquisition(devc);
+		free_transfer(transfer);
+	} else
+		resubmit_transfer(transfer);
+}
+
 static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *sdi;
@@ -423,6 +610,9 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
+	SR_TRACE3(usb_transfer_done, transfer, transfer->status,
+		transfer->actual_length);
+
 	/*
 	 * If acquisition has already ended, just free any queued up
 	 * transfer that come in.
@@ -470,6 +660,11 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		devc->empty_transfer_count = 0;
 	}
 
+	if (devc->seg_stl) {
+		receive_segmented(sdi, transfer);
+		return;
+	}
+
 check_trigger:
 	if (devc->trigger_fired) {
 		if (!devc->limit_samples || devc->sent_samples < devc->limit_samples) {
@@ -520,7 +715,7 @@ check_trigger:
 		if (processed_samples < cur_sample_count) {
 			/* Reset the trigger stage */
 			if (devc->stl)
-				devc->stl->cur_stage = 0;
+				soft_trigger_logic_reset(devc->stl);
 			else {
 				std_session_send_df_frame_begin(sdi);
 				devc->trigger_fired = TRUE;
@@ -575,30 +770,44 @@ static unsigned int to_bytes_per_ms(unsigned int samplerate)
 	return samplerate / 1000;
 }
 
-static size_t get_buffer_size(struct dev_context *devc)
+static size_t get_buffer_size(const struct dev_context *devc)
 {
-	size_t s;
+	uint64_t s, latency;
 
 	/*
-	 * The buffer should be large enough to hold 10ms of data and
-	 * a multiple of 512.
+	 * The buffer should be large enough to hold 10ms of data, or
+	 * the configured size or duration, and a multiple of 512.
 	 */
-	s = 10 * to_bytes_per_ms(devc->cur_samplerate);
-	return (s + 511) & ~511;
+	latency = devc->transfer_latency ? devc->transfer_latency : TRANSFER_LATENCY_MS;
+	s = devc->transfer_size ? devc->transfer_size :
+		latency * to_bytes_per_ms(devc->cur_samplerate);
+	s = MIN(s, 16 * 1024 * 1024);
+	return MAX((s + 511) & ~(uint64_t)511, 512);
 }
 
-static unsigned int get_number_of_transfers(struct dev_context *devc)
+static unsigned int get_number_of_transfers(const struct dev_context *devc)
 {
 	unsigned int n;
 
+	if (devc->transfer_count)
+		return MIN(devc->transfer_count, MAX_SIMUL_TRANSFERS);
+
 	/* Total buffer size should be able to hold about 500ms of data. */
-	n = (500 * to_bytes_per_ms(devc->cur_samplerate) /
+	n = (TRANSFER_QUEUE_MS * to_bytes_per_ms(devc->cur_samplerate) /
 		get_buffer_size(devc));
 
 	if (n > NUM_SIMUL_TRANSFERS)
 		return NUM_SIMUL_TRANSFERS;
 
-	return n;
+	return MAX(n, 1);
+}
+
+SR_PRIV void fx2lafw_transfer_plan(const struct dev_context *devc,
+	unsigned int *count, size_t *size, unsigned int *duration)
+{
+	*count = get_number_of_transfers(devc);
+	*size = get_buffer_size(devc);
+	*duration = MAX(*size / MAX(to_bytes_per_ms(devc->cur_samplerate), 1), 1);
 }
 
 static unsigned int get_timeout(struct dev_context *devc)
@@ -628,6 +837,135 @@ static int receive_data(int fd, int revents, void *cb_data)
 	return TRUE;
 }
 
+/*
+ * Have count transfer buffers of size bytes each. Buffers of another
+ * size are released, the rest is reused.
+ */
+static int get_transfer_buffers(const struct sr_dev_inst *sdi,
+	unsigned int count, size_t size)
+{
+	struct dev_context *devc;
+	uint8_t **buffers;
+	unsigned int i;
+
+	devc = sdi->priv;
+
+	if (devc->transfer_buffer_size != size) {
+		for (i = 0; i < devc->num_transfer_buffers; i++) {
+			sr_usb_buffer_free(sdi->conn, devc->transfer_buffers[i],
+				devc->transfer_buffer_size);
+		}
+		devc->num_transfer_buffers = 0;
+		devc->transfer_buffer_size = size;
+	}
+	if (count <= devc->num_transfer_buffers)
+		return SR_OK;
+
+	buffers = g_try_realloc(devc->transfer_buffers, count * sizeof(*buffers));
+	if (!buffers)
+		return SR_ERR_MALLOC;
+	devc->transfer_buffers = buffers;
+	for (i = devc->num_transfer_buffers; i < count; i++) {
+		if (!(buffers[i] = sr_usb_buffer_alloc(sdi->conn, size)))
+			return SR_ERR_MALLOC;
+		devc->num_transfer_buffers++;
+	}
+
+	return SR_OK;
+}
+
+/* Have the MSO deinterleave buffers hold a transfer of size bytes. */
+static int get_deinterleave_buffers(struct dev_context *devc, size_t size)
+{
+	unsigned int v;
+
+	for (v = 0; v < ARRAY_SIZE(devc->analog_lut); v++) {
+		/* Rescale to -10V - +10V from 0-255. */
+		devc->analog_lut[v] = (v - 128.0f) / 12.8f;
+	}
+
+	/* We need a buffer half the size of a transfer. */
+	if (devc->deinterleave_len >= size / 2)
+		return SR_OK;
+
+	g_free(devc->logic_buffer);
+	g_free(devc->analog_buffer);
+	devc->logic_buffer = g_try_malloc(size / 2);
+	devc->analog_buffer = g_try_malloc(sizeof(float) * size / 2);
+	if (!devc->logic_buffer || !devc->analog_buffer) {
+		devc->deinterleave_len = 0;
+		return SR_ERR_MALLOC;
+	}
+	devc->deinterleave_len = size / 2;
+
+	return SR_OK;
+}
+
+/* Release the pooled buffers, while the device is still open. */
+SR_PRIV void fx2lafw_free_buffers(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	unsigned int i;
+
+	devc = sdi->priv;
+
+	for (i = 0; i < devc->num_transfer_buffers; i++) {
+		sr_usb_buffer_free(sdi->conn, devc->transfer_buffers[i],
+			devc->transfer_buffer_size);
+	}
+	g_free(devc->transfer_buffers);
+	devc->transfer_buffers = NULL;
+	devc->num_transfer_buffers = 0;
+	devc->transfer_buffer_size = 0;
+
+	g_free(devc->logic_buffer);
+	g_free(devc->analog_buffer);
+	devc->logic_buffer = NULL;
+	devc->analog_buffer = NULL;
+	devc->deinterleave_len = 0;
+}
+
+/*
+ * Set up rapid frames, for a trigger which is short enough to search
+ * the joints of transfers for. Leaves seg_stl unset otherwise.
+ */
+static int segmented_start(struct dev_context *devc,
+	const struct sr_trigger *trigger, uint64_t pre_trigger_samples)
+{
+	struct soft_trigger_logic *stl;
+	int unitsize;
+
+	unitsize = devc->sample_wide ? 2 : 1;
+	if (!(stl = soft_trigger_logic_search_new(trigger, unitsize)))
+		return SR_OK;
+	devc->seg_span = soft_trigger_logic_span(stl);
+	if (devc->seg_span >= SEGMENTED_MAX_SPAN) {
+		sr_dbg("Trigger spans too many samples for rapid frames.");
+		soft_trigger_logic_free(stl);
+		return SR_OK;
+	}
+
+	devc->seg_pre = pre_trigger_samples;
+	devc->seg_pos = 0;
+	devc->seg_frame_end = 0;
+	devc->seg_hist_len = 0;
+	devc->seg_hist_cap = MAX(devc->seg_span + 1, pre_trigger_samples);
+	devc->seg_history = g_try_malloc(devc->seg_hist_cap * unitsize);
+	devc->seg_join = g_try_malloc(2 * (devc->seg_span + 1) * unitsize);
+	if (!devc->seg_history || !devc->seg_join) {
+		g_free(devc->seg_history);
+		g_free(devc->seg_join);
+		devc->seg_history = NULL;
+		devc->seg_join = NULL;
+		soft_trigger_logic_free(stl);
+		return SR_ERR_MALLOC;
+	}
+	devc->seg_offsets = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	devc->seg_stl = stl;
+
+	return SR_OK;
+}
+
 static int start_transfers(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
@@ -650,9 +988,15 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 		int pre_trigger_samples = 0;
 		if (devc->limit_samples > 0)
 			pre_trigger_samples = (devc->capture_ratio * devc->limit_samples) / 100;
-		devc->stl = soft_trigger_logic_new(sdi, trigger, pre_trigger_samples);
-		if (!devc->stl)
-			return SR_ERR_MALLOC;
+		if (devc->limit_samples > 0 && devc->limit_frames != 1) {
+			if (segmented_start(devc, trigger, pre_trigger_samples) != SR_OK)
+				return SR_ERR_MALLOC;
+		}
+		if (!devc->seg_stl) {
+			devc->stl = soft_trigger_logic_new(sdi, trigger, pre_trigger_samples);
+			if (!devc->stl)
+				return SR_ERR_MALLOC;
+		}
 		devc->trigger_fired = FALSE;
 	} else {
 		std_session_send_df_frame_begin(sdi);
@@ -664,6 +1008,11 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	size = get_buffer_size(devc);
 	devc->submitted_transfers = 0;
 
+	if (get_transfer_buffers(sdi, num_transfers, size) != SR_OK) {
+		sr_err("USB transfer buffer malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+
 	devc->transfers = g_try_malloc0(sizeof(*devc->transfers) * num_transfers);
 	if (!devc->transfers) {
 		sr_err("USB transfers malloc failed.");
@@ -673,10 +1022,7 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	timeout = get_timeout(devc);
 	devc->num_transfers = num_transfers;
 	for (i = 0; i < num_transfers; i++) {
-		if (!(buf = g_try_malloc(size))) {
-			sr_err("USB transfer buffer malloc failed.");
-			return SR_ERR_MALLOC;
-		}
+		buf = devc->transfer_buffers[i];
 		transfer = libusb_alloc_transfer(0);
 		libusb_fill_bulk_transfer(transfer, usb->devhdl,
 				2 | LIBUSB_ENDPOINT_IN, buf, size,
@@ -686,7 +1032,6 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			libusb_free_transfer(transfer);
-			g_free(buf);
 			fx2lafw_abort_acquisition(devc);
 			return SR_ERR;
 		}
@@ -704,6 +1049,15 @@ static int start_transfers(const struct sr_dev_inst *sdi)
 	else
 		devc->send_data_proc = la_send_data_proc;
 
+	/*
+	 * Rapid frames of logic data go to storage which the session
+	 * allocates for all of them up front.
+	 */
+	devc->seg_frames = devc->seg_stl &&
+		devc->send_data_proc == la_send_data_proc &&
+		sr_session_frames_setup(sdi, devc->seg_stl->unitsize,
+			devc->limit_samples, devc->limit_frames) == SR_OK;
+
 	std_session_send_df_header(sdi);
 
 	return SR_OK;
@@ -732,17 +1086,18 @@ SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi)
 		return SR_ERR;
 	}
 
-	timeout = get_timeout(devc);
-	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
-
 	size = get_buffer_size(devc);
 	/* Prepare for analog sampling. */
 	if (g_slist_length(devc->enabled_analog_channels) > 0) {
-		/* We need a buffer half the size of a transfer. */
-		devc->logic_buffer = g_try_malloc(size / 2);
-		devc->analog_buffer = g_try_malloc(
-			sizeof(float) * size / 2);
+		if (get_deinterleave_buffers(devc, size) != SR_OK) {
+			sr_err("Deinterleave buffer malloc failed.");
+			return SR_ERR_MALLOC;
+		}
 	}
+
+	timeout = get_timeout(devc);
+	usb_source_add(sdi->session, devc->ctx, timeout, receive_data, drvc);
+
 	start_transfers(sdi);
 	if ((ret = command_start_acquisition(sdi)) != SR_OK) {
 		fx2lafw_abort_acquisition(devc);
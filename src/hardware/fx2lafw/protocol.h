@@ -37,8 +37,16 @@
 
 #define MAX_RENUM_DELAY_MS	3000
 #define NUM_SIMUL_TRANSFERS	32
+#define MAX_SIMUL_TRANSFERS	256
 #define MAX_EMPTY_TRANSFERS	(NUM_SIMUL_TRANSFERS * 2)
 
+/* Longest trigger, in samples, which rapid frames are searched for. */
+#define SEGMENTED_MAX_SPAN	(64 * 1024)
+
+/* Default duration of one transfer, and of all queued transfers. */
+#define TRANSFER_LATENCY_MS	10
+#define TRANSFER_QUEUE_MS	500
+
 #define NUM_CHANNELS		16
 
 #define FX2LAFW_REQUIRED_VERSION_MAJOR	1
@@ -107,11 +115,35 @@ struct dev_context {
 	uint64_t limit_samples;
 	uint64_t capture_ratio;
 
+	/* Transfer geometry overrides, 0 picks the default. */
+	uint64_t transfer_count;
+	uint64_t transfer_size;
+	uint64_t transfer_latency;
+
 	gboolean trigger_fired;
 	gboolean acq_aborted;
 	gboolean sample_wide;
 	struct soft_trigger_logic *stl;
 
+	/*
+	 * Rapid frames: all trigger positions of a transfer are searched
+	 * at once, with the end of the previously received data kept for
+	 * pre-trigger samples and for triggers across transfers.
+	 */
+	struct soft_trigger_logic *seg_stl;
+	uint64_t seg_span;
+	uint64_t seg_pre;
+	/* Sample numbers since the start of the acquisition. */
+	uint64_t seg_pos;
+	uint64_t seg_frame_end;
+	uint8_t *seg_history;
+	uint64_t seg_hist_cap;
+	uint64_t seg_hist_len;
+	uint8_t *seg_join;
+	GArray *seg_offsets;
+	/* Frames are kept by the session, see sr_session_frames_setup(). */
+	gboolean seg_frames;
+
 	uint64_t num_frames;
 	uint64_t sent_samples;
 	int submitted_transfers;
@@ -122,13 +154,28 @@ struct dev_context {
 	struct sr_context *ctx;
 	void (*send_data_proc)(struct sr_dev_inst *sdi,
 		uint8_t *data, size_t length, size_t sample_width);
+
+	/*
+	 * Transfer buffers are kept from one acquisition to the next,
+	 * as long as their size does not change.
+	 */
+	uint8_t **transfer_buffers;
+	unsigned int num_transfer_buffers;
+	size_t transfer_buffer_size;
+
+	/* MSO deinterleave buffers, for up to deinterleave_len samples. */
 	uint8_t *logic_buffer;
 	float *analog_buffer;
+	size_t deinterleave_len;
+	float analog_lut[256];
 };
 
 SR_PRIV int fx2lafw_dev_open(struct sr_dev_inst *sdi, struct sr_dev_driver *di);
 SR_PRIV struct dev_context *fx2lafw_dev_new(void);
 SR_PRIV int fx2lafw_start_acquisition(const struct sr_dev_inst *sdi);
 SR_PRIV void fx2lafw_abort_acquisition(struct dev_context *devc);
+SR_PRIV void fx2lafw_transfer_plan(const struct dev_context *devc,
+	unsigned int *count, size_t *size, unsigned int *duration);
+SR_PRIV void fx2lafw_free_buffers(const struct sr_dev_inst *sdi);
 
 #endif
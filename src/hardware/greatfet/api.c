@@ -50,6 +50,8 @@ static const uint32_t devopts[] = {
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_COUNT | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_SIZE | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const uint32_t devopts_cg[] = {
@@ -416,6 +418,16 @@ static int config_get(uint32_t key, GVariant **data,
 		if (!devc)
 			return SR_ERR_NA;
 		return sr_sw_limits_config_get(&devc->sw_limits, key, data);
+	case SR_CONF_TRANSFER_COUNT:
+		if (!devc)
+			return SR_ERR_NA;
+		*data = g_variant_new_uint64(devc->transfer_count);
+		return SR_OK;
+	case SR_CONF_TRANSFER_SIZE:
+		if (!devc)
+			return SR_ERR_NA;
+		*data = g_variant_new_uint64(devc->transfer_size);
+		return SR_OK;
 	default:
 		return SR_ERR_NA;
 	}
@@ -448,6 +460,16 @@ static int config_set(uint32_t key, GVariant *data,
 		if (!devc)
 			return SR_ERR_NA;
 		return sr_sw_limits_config_set(&devc->sw_limits, key, data);
+	case SR_CONF_TRANSFER_COUNT:
+		if (!devc)
+			return SR_ERR_NA;
+		devc->transfer_count = g_variant_get_uint64(data);
+		return SR_OK;
+	case SR_CONF_TRANSFER_SIZE:
+		if (!devc)
+			return SR_ERR_NA;
+		devc->transfer_size = g_variant_get_uint64(data);
+		return SR_OK;
 	default:
 		return SR_ERR_NA;
 	}
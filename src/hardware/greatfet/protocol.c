@@ -134,6 +134,9 @@
 #define LOGIC_DEFAULT_TIMEOUT	1000
 #define TRANSFER_POOL_SIZE	16
 #define TRANSFER_BUFFER_SIZE	(256 * 1024)
+#define TRANSFER_POOL_MAX	64
+#define TRANSFER_BUFFER_MAX	(16 * 1024 * 1024)
+#define UNPACK_CHUNK_BYTES	256
 
 static int greatfet_process_receive_data(const struct sr_dev_inst *sdi,
 	const uint8_t *data, size_t dlen);
@@ -727,9 +730,10 @@ static int greatfet_calc_capture_chans(const struct sr_dev_inst *sdi)
  * the value which the device firmware has provided in the LA config
  * response.
  *
- * We let the opportunity pass. Always use a fixed value for the host
- * configuration. BULK transfers will adopt, which reduces the number
- * of transfer completion events for the host.
+ * We let the opportunity pass. Always use the value which was picked
+ * at allocation time, either the default or the user's configuration.
+ * BULK transfers will adopt, which reduces the number of transfer
+ * completion events for the host.
  *
  * Notice that transfer size adjustment is _not_ a means to get user
  * feedback earlier at low samplerates. This may be done in other
@@ -791,11 +795,17 @@ static void greatfet_abort_acquisition_quick(const struct sr_dev_inst *sdi)
 		feed_queue_logic_flush(acq->feed_queue);
 }
 
-/* Allocate USB transfers and associated receive buffers. */
+/*
+ * Allocate USB transfers and associated receive buffers. The number
+ * and size of transfers can be configured, zero selects the defaults.
+ * The receive buffer also holds the unpack worker's spare buffers,
+ * which get swapped with transfers' buffers during acquisition.
+ */
 static int greatfet_allocate_transfers(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	struct dev_transfers_t *dxfer;
+	uint64_t count, size;
 	size_t alloc_size, idx;
 	struct libusb_transfer *xfer;
 
@@ -806,14 +816,24 @@ static int greatfet_allocate_transfers(const struct sr_dev_inst *sdi)
 		return SR_ERR_ARG;
 	dxfer = &devc->transfers;
 
-	dxfer->transfer_bufsize = TRANSFER_BUFFER_SIZE;
-	dxfer->transfers_count = TRANSFER_POOL_SIZE;
-
-	alloc_size = dxfer->transfers_count * dxfer->transfer_bufsize;
-	dxfer->transfer_buffer = g_malloc0(alloc_size);
+	count = devc->transfer_count ? devc->transfer_count : TRANSFER_POOL_SIZE;
+	size = devc->transfer_size ? devc->transfer_size : TRANSFER_BUFFER_SIZE;
+	count = MIN(count, TRANSFER_POOL_MAX);
+	size = MIN(size, TRANSFER_BUFFER_MAX);
+	size = MAX((size + 511) & ~(uint64_t)511, 512);
+	dxfer->transfer_bufsize = size;
+	dxfer->transfers_count = count;
+	sr_dbg("USB transfers: %zu x %zu bytes.",
+		dxfer->transfers_count, dxfer->transfer_bufsize);
+
+	g_free(dxfer->transfer_buffer);
+	alloc_size = dxfer->transfers_count + NUM_UNPACK_BLOCKS;
+	alloc_size *= dxfer->transfer_bufsize;
+	dxfer->transfer_buffer = g_try_malloc0(alloc_size);
 	if (!dxfer->transfer_buffer)
 		return SR_ERR_MALLOC;
 
+	g_free(dxfer->transfers);
 	alloc_size = dxfer->transfers_count;
 	alloc_size *= sizeof(dxfer->transfers[0]);
 	dxfer->transfers = g_malloc0(alloc_size);
@@ -920,6 +940,248 @@ static int greatfet_cancel_transfers(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+/* Forward sample data to the session, within the acquisition limits. */
+static int greatfet_submit_samples(const struct sr_dev_inst *sdi,
+	const uint8_t *samples, size_t count)
+{
+	struct dev_context *devc;
+	struct dev_acquisition_t *acq;
+	int ret;
+
+	devc = sdi->priv;
+	acq = &devc->acquisition;
+
+	count = sr_sw_limits_samples_allowed(&devc->sw_limits, count);
+	if (!count)
+		return SR_OK;
+	ret = feed_queue_logic_submit_many(acq->feed_queue, samples, count);
+	if (ret != SR_OK)
+		return ret;
+	sr_sw_limits_update_samples_read(&devc->sw_limits, count);
+
+	return SR_OK;
+}
+
+/*
+ * Prepare the translation of packed sample memory bytes to session
+ * feed items. Each possible byte value maps to a fixed sequence of
+ * 16bit sample values, which gets looked up instead of taking apart
+ * individual bits.
+ */
+static void greatfet_unpack_init(struct dev_context *devc)
+{
+	struct dev_acquisition_t *acq;
+	struct dev_unpack_t *unpack;
+	size_t shift, points_per_byte, points_count, value;
+	uint8_t raw_mask, raw_data;
+	uint16_t wr_data;
+	uint8_t *wrptr;
+
+	acq = &devc->acquisition;
+	unpack = &devc->unpack;
+
+	shift = acq->channel_shift ? acq->channel_shift : 8;
+	points_per_byte = 8 / shift;
+	raw_mask = (1UL << shift) - 1;
+	sr_dbg("sample mem: ch count %zu, ch shift %zu, mask 0x%x, points %zu, upper %d",
+		acq->capture_channels, acq->channel_shift,
+		raw_mask, points_per_byte, acq->use_upper_pins);
+
+	unpack->lut_stride = points_per_byte * sizeof(wr_data);
+	for (value = 0; value < 256; value++) {
+		wrptr = &unpack->lut[value * unpack->lut_stride];
+		raw_data = value;
+		points_count = points_per_byte;
+		while (points_count--) {
+			wr_data = raw_data & raw_mask;
+			if (acq->use_upper_pins)
+				wr_data <<= 8;
+			write_u16le_inc(&wrptr, wr_data);
+			raw_data >>= shift;
+		}
+	}
+}
+
+/* Unpack sample memory bytes, returns the number of sample points. */
+static size_t greatfet_unpack_samples(const struct dev_context *devc,
+	uint8_t *samples, const uint8_t *data, size_t dlen)
+{
+	const uint8_t *lut;
+	size_t stride, idx;
+
+	lut = devc->unpack.lut;
+	stride = devc->unpack.lut_stride;
+	for (idx = 0; idx < dlen; idx++) {
+		memcpy(samples, &lut[data[idx] * stride], stride);
+		samples += stride;
+	}
+
+	return dlen * stride / sizeof(uint16_t);
+}
+
+static gpointer greatfet_unpack_worker(gpointer data)
+{
+	struct dev_context *devc;
+	struct greatfet_block *block;
+
+	devc = data;
+
+	/* A block without raw data asks the worker to stop. */
+	while ((block = g_async_queue_pop(devc->unpack.fill_queue))->raw) {
+		block->num_samples = greatfet_unpack_samples(devc,
+			block->samples, block->raw, block->raw_len);
+		g_async_queue_push(devc->unpack.done_queue, block);
+	}
+	g_free(block);
+
+	return NULL;
+}
+
+/*
+ * Forward the blocks which the worker has finished, in order. With
+ * wait, block until at least one is done.
+ */
+static int greatfet_unpack_drain(const struct sr_dev_inst *sdi,
+	gboolean wait)
+{
+	struct dev_context *devc;
+	struct dev_unpack_t *unpack;
+	struct greatfet_block *block;
+	int ret;
+
+	devc = sdi->priv;
+	unpack = &devc->unpack;
+	if (!unpack->worker)
+		return SR_OK;
+
+	ret = SR_OK;
+	block = wait ? g_async_queue_pop(unpack->done_queue) :
+		g_async_queue_try_pop(unpack->done_queue);
+	while (block) {
+		if (ret == SR_OK)
+			ret = greatfet_submit_samples(sdi,
+				block->samples, block->num_samples);
+		unpack->free_blocks[unpack->num_free_blocks++] = block;
+		block = g_async_queue_try_pop(unpack->done_queue);
+	}
+
+	return ret;
+}
+
+static void greatfet_unpack_free(struct dev_context *devc)
+{
+	struct dev_unpack_t *unpack;
+
+	unpack = &devc->unpack;
+
+	if (unpack->fill_queue)
+		g_async_queue_unref(unpack->fill_queue);
+	if (unpack->done_queue)
+		g_async_queue_unref(unpack->done_queue);
+	unpack->fill_queue = NULL;
+	unpack->done_queue = NULL;
+	g_free(unpack->samples_buffer);
+	unpack->samples_buffer = NULL;
+	memset(unpack->blocks, 0, sizeof(unpack->blocks));
+	unpack->num_free_blocks = 0;
+}
+
+/*
+ * Start the unpack worker when sample memory is packed. Falls back
+ * to unpacking in the transfer callback if that fails. The spare raw
+ * buffers are found after the transfers' buffers.
+ */
+static void greatfet_unpack_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct dev_acquisition_t *acq;
+	struct dev_transfers_t *dxfer;
+	struct dev_unpack_t *unpack;
+	struct greatfet_block *block;
+	size_t samples_size, idx;
+
+	devc = sdi->priv;
+	acq = &devc->acquisition;
+	dxfer = &devc->transfers;
+	unpack = &devc->unpack;
+
+	if (acq->wire_unit_size == devc->feed_unit_size)
+		return;
+	greatfet_unpack_init(devc);
+
+	samples_size = dxfer->transfer_bufsize * unpack->lut_stride;
+	unpack->samples_buffer = g_try_malloc(NUM_UNPACK_BLOCKS * samples_size);
+	if (!unpack->samples_buffer) {
+		sr_warn("No memory for unpack buffers, not using a worker.");
+		return;
+	}
+	unpack->num_free_blocks = 0;
+	for (idx = 0; idx < NUM_UNPACK_BLOCKS; idx++) {
+		block = &unpack->blocks[idx];
+		block->raw = &dxfer->transfer_buffer[
+			(dxfer->transfers_count + idx) * dxfer->transfer_bufsize];
+		block->samples = &unpack->samples_buffer[idx * samples_size];
+		unpack->free_blocks[unpack->num_free_blocks++] = block;
+	}
+
+	unpack->fill_queue = g_async_queue_new();
+	unpack->done_queue = g_async_queue_new();
+	unpack->worker = g_thread_try_new("greatfet-unpack",
+		greatfet_unpack_worker, devc, NULL);
+	if (!unpack->worker) {
+		sr_warn("Failed to start unpack thread, not using a worker.");
+		greatfet_unpack_free(devc);
+	}
+}
+
+static void greatfet_unpack_stop(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct dev_unpack_t *unpack;
+
+	devc = sdi->priv;
+	unpack = &devc->unpack;
+	if (!unpack->worker)
+		return;
+
+	g_async_queue_push(unpack->fill_queue,
+		g_malloc0(sizeof(struct greatfet_block)));
+	g_thread_join(unpack->worker);
+	(void)greatfet_unpack_drain(sdi, FALSE);
+	unpack->worker = NULL;
+	greatfet_unpack_free(devc);
+}
+
+/*
+ * Hand a completed transfer's data to the worker, and put a spare
+ * buffer in its place. Waits for the worker if all blocks are taken.
+ */
+static int greatfet_unpack_push(const struct sr_dev_inst *sdi,
+	struct libusb_transfer *xfer)
+{
+	struct dev_context *devc;
+	struct dev_unpack_t *unpack;
+	struct greatfet_block *block;
+	uint8_t *spare;
+	int ret;
+
+	devc = sdi->priv;
+	unpack = &devc->unpack;
+
+	ret = SR_OK;
+	if (!unpack->num_free_blocks)
+		ret = greatfet_unpack_drain(sdi, TRUE);
+	block = unpack->free_blocks[--unpack->num_free_blocks];
+
+	spare = block->raw;
+	block->raw = xfer->buffer;
+	block->raw_len = xfer->actual_length;
+	xfer->buffer = spare;
+	g_async_queue_push(unpack->fill_queue, block);
+
+	return ret;
+}
+
 /*
  * Free an individual transfer during its callback's execution.
  * Releasing the last USB transfer also happens to drive more of
@@ -958,13 +1220,17 @@ static void greatfet_free_transfer(const struct sr_dev_inst *sdi,
 	libusb_free_transfer(xfer);
 
 	/* Done here when more transfers are still pending. */
-	if (!dxfer->active_transfers)
+	if (dxfer->active_transfers)
 		return;
 
 	/*
 	 * The last USB transfer has been freed after completion.
-	 * Post process the previous acquisition's execution.
+	 * Post process the previous acquisition's execution. Forward
+	 * what the unpack worker still holds before the end of frame.
 	 */
+	greatfet_unpack_stop(sdi);
+	if (acq->feed_queue)
+		feed_queue_logic_flush(acq->feed_queue);
 	(void)greatfet_stop_acquisition(sdi);
 	if (acq->frame_begin_sent) {
 		std_session_send_df_end(sdi);
@@ -1051,7 +1317,10 @@ static void LIBUSB_CALL xfer_complete_cb(struct libusb_transfer *xfer)
 	if (has_timedout)
 		sr_warn("USB transfer timed out. Using available data.");
 	if (was_completed || has_timedout) {
-		ret = greatfet_process_receive_data(sdi, data, dlen);
+		if (devc->unpack.worker)
+			ret = greatfet_unpack_push(sdi, xfer);
+		else
+			ret = greatfet_process_receive_data(sdi, data, dlen);
 		if (ret != SR_OK) {
 			sr_err("Error processing sample data. Aborting.");
 			shall_abort = TRUE;
@@ -1141,6 +1410,8 @@ SR_PRIV int greatfet_start_acquisition(const struct sr_dev_inst *sdi)
 	ret = libusb_claim_interface(usb->devhdl, acq->samples_interface);
 	acq->samples_interface_claimed = ret == 0;
 
+	greatfet_unpack_start(sdi);
+
 	/*
 	 * Ideally we could submit USB transfers before sending the
 	 * logic analyzer start request. Experience suggests that this
@@ -1175,6 +1446,10 @@ SR_PRIV void greatfet_abort_acquisition(const struct sr_dev_inst *sdi)
 
 	(void)greatfet_logic_stop(sdi);
 	greatfet_abort_acquisition_quick(sdi);
+
+	/* Without pending transfers nothing else stops the worker. */
+	if (!devc->transfers.active_transfers)
+		greatfet_unpack_stop(sdi);
 }
 
 SR_PRIV int greatfet_stop_acquisition(const struct sr_dev_inst *sdi)
@@ -1247,11 +1522,10 @@ SR_PRIV void greatfet_release_resources(const struct sr_dev_inst *sdi)
  *   byte. Samples taken next are found in upper bits of the byte. For
  *   example a byte containing 4x 2bit sample data is seen as 33221100.
  * - Depending on the number of enabled channels there could be up to
- *   eight samples in one byte of sample memory. This implementation
- *   tries to accumulate one input byte's content, but not more. To
- *   simplify the implementation. Performance can get tuned later as
- *   the need gets identified. Sampling at 204MHz results in some 3%
- *   CPU load with Pulseview on the local workstation.
+ *   eight samples in one byte of sample memory. A lookup table maps
+ *   each byte value to its sequence of sample values. The unpack worker
+ *   translates whole transfers, or this routine translates chunks of
+ *   received data when the worker is not available.
  * - Samples for 16 channels transparently are handled by the simple
  *   8 channel case above. All logic data of an individual samplepoint
  *   occupies full bytes, endianess of sample data as provided by the
@@ -1261,20 +1535,10 @@ SR_PRIV void greatfet_release_resources(const struct sr_dev_inst *sdi)
 static int greatfet_process_receive_data(const struct sr_dev_inst *sdi,
 	const uint8_t *data, size_t dlen)
 {
-	static int diag_shown;
-
 	struct dev_context *devc;
 	struct dev_acquisition_t *acq;
-	struct feed_queue_logic *q;
-	uint64_t samples_remain;
-	gboolean exceeded;
-	size_t samples_rcvd;
-	uint8_t raw_mask, raw_data;
-	size_t points_per_byte, points_count;
-	uint16_t wr_data;
-	uint8_t accum[8 * sizeof(wr_data)];
-	const uint8_t *rdptr;
-	uint8_t *wrptr;
+	uint8_t samples[UNPACK_CHUNK_BYTES * 8 * sizeof(uint16_t)];
+	size_t chunk, count;
 	int ret;
 
 	if (!sdi)
@@ -1283,20 +1547,6 @@ static int greatfet_process_receive_data(const struct sr_dev_inst *sdi,
 	if (!devc)
 		return SR_ERR_ARG;
 	acq = &devc->acquisition;
-	q = acq->feed_queue;
-
-	/*
-	 * Check whether acquisition limits apply, and whether they
-	 * were reached or exceeded before. Constrain the submission
-	 * of more sample values to what's still within the limits of
-	 * the current acquisition.
-	 */
-	ret = sr_sw_limits_get_remain(&devc->sw_limits,
-		&samples_remain, NULL, NULL, &exceeded);
-	if (ret != SR_OK)
-		return ret;
-	if (exceeded)
-		return SR_OK;
 
 	/*
 	 * Check for the simple case first. Where the firmware provides
@@ -1307,18 +1557,15 @@ static int greatfet_process_receive_data(const struct sr_dev_inst *sdi,
 	 * This happens to work because sample data received from the
 	 * device and logic data in sigrok sessions both are in little
 	 * endian format.
+	 *
+	 * Either way, constrain the submission of more sample values
+	 * to what's still within the limits of the current acquisition.
+	 * Nothing is sent when the limits were reached before.
 	 */
-	if (acq->wire_unit_size == devc->feed_unit_size) {
-		samples_rcvd = dlen / acq->wire_unit_size;
-		if (samples_remain && samples_rcvd > samples_remain)
-			samples_rcvd = samples_remain;
-		ret = feed_queue_logic_submit_many(q, data, samples_rcvd);
-		if (ret != SR_OK)
-			return ret;
-		sr_sw_limits_update_samples_read(&devc->sw_limits, samples_rcvd);
-		return SR_OK;
-	}
-	if (sizeof(wr_data) != devc->feed_unit_size) {
+	if (acq->wire_unit_size == devc->feed_unit_size)
+		return greatfet_submit_samples(sdi, data,
+			dlen / acq->wire_unit_size);
+	if (sizeof(uint16_t) != devc->feed_unit_size) {
 		sr_err("Unhandled unit size mismatch. Flawed implementation?");
 		return SR_ERR_BUG;
 	}
@@ -1335,46 +1582,21 @@ static int greatfet_process_receive_data(const struct sr_dev_inst *sdi,
 	 * fragments which could span several transfers.
 	 *
 	 * Notice that "upper pins" and "multiple samples per byte" can
-	 * happen in combination. The implementation transparently deals
+	 * happen in combination. The lookup table transparently deals
 	 * with upper pin use where bytes carry exactly one value.
 	 */
-	if (acq->channel_shift) {
-		raw_mask = (1UL << acq->channel_shift) - 1;
-		points_per_byte = 8 / acq->channel_shift;
-	} else {
-		raw_mask = (1UL << 8) - 1;
-		points_per_byte = 1;
-	}
-	if (!diag_shown++) {
-		sr_dbg("sample mem: ch count %zu, ch shift %zu, mask 0x%x, points %zu, upper %d",
-			acq->capture_channels, acq->channel_shift,
-			raw_mask, points_per_byte, acq->use_upper_pins);
-	}
-	samples_rcvd = dlen * points_per_byte;
-	if (samples_remain && samples_rcvd > samples_remain) {
-		samples_rcvd = samples_remain;
-		dlen = samples_rcvd;
-		dlen += points_per_byte - 1;
-		dlen /= points_per_byte;
-	}
-	rdptr = data;
-	while (dlen--) {
-		raw_data = read_u8_inc(&rdptr);
-		wrptr = accum;
-		points_count = points_per_byte;
-		while (points_count--) {
-			wr_data = raw_data & raw_mask;
-			if (acq->use_upper_pins)
-				wr_data <<= 8;
-			write_u16le_inc(&wrptr, wr_data);
-			raw_data >>= acq->channel_shift;
-		}
-		points_count = points_per_byte;
-		ret = feed_queue_logic_submit_many(q, accum, points_count);
+	while (dlen) {
+		if (!sr_sw_limits_samples_allowed(&devc->sw_limits, 1))
+			break;
+		chunk = MIN(dlen, UNPACK_CHUNK_BYTES);
+		count = greatfet_unpack_samples(devc, samples, data, chunk);
+		ret = greatfet_submit_samples(sdi, samples, count);
 		if (ret != SR_OK)
 			return ret;
-		sr_sw_limits_update_samples_read(&devc->sw_limits, points_count);
+		data += chunk;
+		dlen -= chunk;
 	}
+
 	return SR_OK;
 }
 
@@ -1408,6 +1630,12 @@ SR_PRIV int greatfet_receive_data(int fd, int revents, void *cb_data)
 	tv.tv_sec = tv.tv_usec = 0;
 	libusb_handle_events_timeout(ctx, &tv);
 
+	/* Forward the sample data which the unpack worker has finished. */
+	if (greatfet_unpack_drain(sdi, FALSE) != SR_OK) {
+		sr_err("Error processing sample data. Aborting.");
+		greatfet_abort_acquisition_quick(sdi);
+	}
+
 	/*
 	 * End the current acquisition when limites were reached.
 	 * Process USB transfers again here before returning, because
@@ -30,6 +30,15 @@
 
 #define LOG_PREFIX "greatfet"
 
+#define NUM_UNPACK_BLOCKS	4
+
+struct greatfet_block {
+	uint8_t *raw;
+	size_t raw_len;
+	uint8_t *samples;
+	size_t num_samples;
+};
+
 struct dev_context {
 	struct sr_dev_inst *sdi;
 	GString *usb_comm_buffer;
@@ -40,6 +49,8 @@ struct dev_context {
 	size_t feed_unit_size;
 	struct sr_sw_limits sw_limits;
 	uint64_t samplerate;
+	uint64_t transfer_count;
+	uint64_t transfer_size;
 	struct dev_acquisition_t {
 		uint64_t bandwidth_threshold;
 		size_t wire_unit_size;
@@ -72,6 +83,22 @@ struct dev_context {
 		size_t active_transfers;
 		size_t capture_bufsize;
 	} transfers;
+	/*
+	 * Packed sample data gets unpacked on a worker thread, so that
+	 * transfers can be resubmitted with a spare buffer right away.
+	 * Without the worker, the transfer callback unpacks the data.
+	 */
+	struct dev_unpack_t {
+		GThread *worker;
+		GAsyncQueue *fill_queue;
+		GAsyncQueue *done_queue;
+		struct greatfet_block blocks[NUM_UNPACK_BLOCKS];
+		struct greatfet_block *free_blocks[NUM_UNPACK_BLOCKS];
+		size_t num_free_blocks;
+		uint8_t *samples_buffer;
+		uint8_t lut[256 * 8 * sizeof(uint16_t)];
+		size_t lut_stride;
+	} unpack;
 };
 
 SR_PRIV int greatfet_get_serial_number(const struct sr_dev_inst *sdi);
@@ -104,6 +104,8 @@ static void clear_helper(struct dev_context *devc)
 	hmo_scope_state_free(devc->model_state);
 	g_free(devc->analog_groups);
 	g_free(devc->digital_groups);
+	if (devc->block)
+		g_byte_array_free(devc->block, TRUE);
 }
 
 static int dev_clear(const struct sr_dev_driver *di)
@@ -897,6 +899,14 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 	devc->num_frames = 0;
 	g_slist_free(devc->enabled_channels);
 	devc->enabled_channels = NULL;
+	if (devc->block) {
+		g_byte_array_free(devc->block, TRUE);
+		devc->block = NULL;
+	}
+	if (devc->logic_data) {
+		g_byte_array_free(devc->logic_data, TRUE);
+		devc->logic_data = NULL;
+	}
 	scpi = sdi->conn;
 	sr_scpi_source_remove(sdi->session, scpi);
 
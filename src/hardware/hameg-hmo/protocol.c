@@ -1378,19 +1378,48 @@ SR_PRIV int hmo_init_device(struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+/*
+ * Put the bytes of one pod at every pod_count-th position of the combined
+ * samples. The common pod counts get loops with a constant stride, which
+ * compilers unroll and vectorize.
+ */
+static void hmo_interleave_pod(uint8_t *dst, const uint8_t *src,
+			       size_t count, size_t pod_count)
+{
+	size_t idx;
+
+	switch (pod_count) {
+	case 2:
+		for (idx = 0; idx < count; idx++)
+			dst[2 * idx] = src[idx];
+		break;
+	case 4:
+		for (idx = 0; idx < count; idx++)
+			dst[4 * idx] = src[idx];
+		break;
+	default:
+		for (idx = 0; idx < count; idx++)
+			dst[pod_count * idx] = src[idx];
+		break;
+	}
+}
+
 /* Queue data of one channel group, for later submission. */
 SR_PRIV void hmo_queue_logic_data(struct dev_context *devc,
 				  size_t group, GByteArray *pod_data)
 {
-	size_t size;
+	size_t size, count;
 	GByteArray *store;
-	uint8_t *logic_data;
-	size_t idx, logic_step;
+
+	if (group >= devc->pod_count)
+		return;
 
 	/*
-	 * Upon first invocation, allocate the array which can hold the
-	 * combined logic data for all channels. Assume that each channel
-	 * will yield an identical number of samples per receive call.
+	 * Upon the first invocation in a frame, size the array which holds
+	 * the combined logic data for all channels. Assume that each channel
+	 * will yield an identical number of samples per receive call. The
+	 * array is kept across frames, so its memory only gets allocated
+	 * when the frames grow.
 	 *
 	 * As a poor man's safety measure: (Silently) skip processing
 	 * for unexpected sample counts, and ignore samples for
@@ -1399,34 +1428,26 @@ SR_PRIV void hmo_queue_logic_data(struct dev_context *devc,
 	 * pod, and the most capable supported models have two pods of
 	 * identical size. We haven't yet seen any "odd" configuration.
 	 */
-	if (!devc->logic_data) {
-		size = pod_data->len * devc->pod_count;
-		store = g_byte_array_sized_new(size);
-		memset(store->data, 0, size);
-		store = g_byte_array_set_size(store, size);
-		devc->logic_data = store;
-	} else {
-		store = devc->logic_data;
-		size = store->len / devc->pod_count;
-		if (group >= devc->pod_count)
-			return;
+	if (!devc->logic_data)
+		devc->logic_data = g_byte_array_new();
+	store = devc->logic_data;
+	if (!store->len) {
+		size = pod_data->len;
+		/* Truncate acquisition if a smaller number of samples has been requested. */
+		if (devc->samples_limit > 0 && size > devc->samples_limit)
+			size = devc->samples_limit;
+		g_byte_array_set_size(store, size * devc->pod_count);
+		memset(store->data, 0, store->len);
 	}
+	size = store->len / devc->pod_count;
 
 	/*
 	 * Fold the data of the most recently received channel group into
 	 * the storage, where data resides for all channels combined.
 	 */
-	logic_data = store->data;
-	logic_data += group;
-	logic_step = devc->pod_count;
-	for (idx = 0; idx < pod_data->len; idx++) {
-		*logic_data = pod_data->data[idx];
-		logic_data += logic_step;
-	}
-
-	/* Truncate acquisition if a smaller number of samples has been requested. */
-	if (devc->samples_limit > 0 && devc->logic_data->len > devc->samples_limit * devc->pod_count)
-		devc->logic_data->len = devc->samples_limit * devc->pod_count;
+	count = MIN(pod_data->len, size);
+	hmo_interleave_pod(store->data + group, pod_data->data,
+		count, devc->pod_count);
 }
 
 /* Submit data for all channels, after the individual groups got collected. */
@@ -1436,7 +1457,7 @@ SR_PRIV void hmo_send_logic_packet(struct sr_dev_inst *sdi,
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 
-	if (!devc->logic_data)
+	if (!devc->logic_data || !devc->logic_data->len)
 		return;
 
 	logic.data = devc->logic_data->data;
@@ -1447,6 +1468,9 @@ SR_PRIV void hmo_send_logic_packet(struct sr_dev_inst *sdi,
 	packet.payload = &logic;
 
 	sr_session_send(sdi, &packet);
+
+	/* Keep the memory for the next frame, which may differ in length. */
+	g_byte_array_set_size(devc->logic_data, 0);
 }
 
 /* Undo previous resource allocation. */
@@ -1509,12 +1533,11 @@ SR_PRIV int hmo_receive_data(int fd, int revents, void *cb_data)
 	 */
 	switch (ch->type) {
 	case SR_CHANNEL_ANALOG:
-		data = NULL;
-		if (sr_scpi_get_block(sdi->conn, NULL, &data) != SR_OK) {
-			if (data)
-				g_byte_array_free(data, TRUE);
+		if (!devc->block)
+			devc->block = g_byte_array_new();
+		data = devc->block;
+		if (sr_scpi_get_block_into(sdi->conn, NULL, data) != SR_OK)
 			return TRUE;
-		}
 
 		packet.type = SR_DF_ANALOG;
 
@@ -1538,16 +1561,13 @@ SR_PRIV int hmo_receive_data(int fd, int revents, void *cb_data)
 		sr_session_send(sdi, &packet);
 		devc->num_samples = data->len / sizeof(float);
 		g_slist_free(meaning.channels);
-		g_byte_array_free(data, TRUE);
-		data = NULL;
 		break;
 	case SR_CHANNEL_LOGIC:
-		data = NULL;
-		if (sr_scpi_get_block(sdi->conn, NULL, &data) != SR_OK) {
-			if (data)
-				g_byte_array_free(data, TRUE);
+		if (!devc->block)
+			devc->block = g_byte_array_new();
+		data = devc->block;
+		if (sr_scpi_get_block_into(sdi->conn, NULL, data) != SR_OK)
 			return TRUE;
-		}
 
 		/*
 		 * If only data from the first pod is involved in the
@@ -1578,8 +1598,6 @@ SR_PRIV int hmo_receive_data(int fd, int revents, void *cb_data)
 		}
 
 		devc->num_samples = data->len / devc->pod_count;
-		g_byte_array_free(data, TRUE);
-		data = NULL;
 		break;
 	default:
 		sr_err("Invalid channel type.");
@@ -1598,14 +1616,6 @@ SR_PRIV int hmo_receive_data(int fd, int revents, void *cb_data)
 	}
 	hmo_send_logic_packet(sdi, devc);
 
-	/*
-	 * Release the logic data storage after each frame. This copes
-	 * with sample counts that differ in length per frame. -- Is
-	 * this a real constraint when acquiring multiple frames with
-	 * identical device settings?
-	 */
-	hmo_cleanup_logic_data(devc);
-
 	std_session_send_df_frame_end(sdi);
 
 	/*
@@ -131,6 +131,8 @@ struct dev_context {
 
 	size_t pod_count;
 	GByteArray *logic_data;
+	/* Received waveform data, kept for the next channel and frame. */
+	GByteArray *block;
 };
 
 SR_PRIV int hmo_init_device(struct sr_dev_inst *sdi);
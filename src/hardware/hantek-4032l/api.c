@@ -42,6 +42,7 @@ static const uint32_t devopts[] = {
 	SR_CONF_EXTERNAL_CLOCK | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_EXTERNAL_CLOCK_SOURCE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_CLOCK_EDGE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
+	SR_CONF_TRANSFER_COUNT | SR_CONF_GET | SR_CONF_SET,
 };
 
 static const uint32_t devopts_fpga_zero[] = {
@@ -200,7 +201,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	else
 		conn_devices = NULL;
 
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			struct sr_usb_dev_inst *usb = NULL;
@@ -378,6 +379,9 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_CLOCK_EDGE:
 		*data = g_variant_new_string(signal_edges[devc->clock_edge]);
 		break;
+	case SR_CONF_TRANSFER_COUNT:
+		*data = g_variant_new_uint64(devc->transfer_count);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -442,6 +446,9 @@ static int config_set(uint32_t key, GVariant *data,
 			return SR_ERR_ARG;
 		devc->clock_edge = idx;
 		break;
+	case SR_CONF_TRANSFER_COUNT:
+		devc->transfer_count = g_variant_get_uint64(data);
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -498,12 +505,28 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	struct dev_context *devc = sdi->priv;
 	struct sr_trigger *trigger = sr_session_trigger_get(sdi->session);
 	struct h4032l_cmd_pkt *cmd_pkt = &devc->cmd_pkt;
+	struct sr_channel *ch;
+	GSList *l;
+	int max_index;
 
 	/* Initialize variables. */
 	devc->acq_aborted = FALSE;
 	devc->submitted_transfers = 0;
 	devc->sent_samples = 0;
 
+	/*
+	 * Send samples of one or two bytes when only A0-A3/B0-B3 resp.
+	 * A0-A7/B0-B7 are enabled, which cuts the session's bandwidth.
+	 * The banks' channels alternate in the sample data.
+	 */
+	max_index = 0;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->enabled)
+			max_index = MAX(max_index, ch->index);
+	}
+	devc->unitsize = max_index < 8 ? 1 : max_index < 16 ? 2 : 4;
+
 	/* Calculate packet ratio. */
 	cmd_pkt->pre_trigger_size = (cmd_pkt->sample_size * devc->capture_ratio) / 100;
 	devc->trigger_pos = cmd_pkt->pre_trigger_size;
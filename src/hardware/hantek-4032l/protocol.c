@@ -63,6 +63,22 @@ static void finish_acquisition(struct sr_dev_inst *sdi)
 
 	devc->num_transfers = 0;
 	g_free(devc->transfers);
+	devc->transfers = NULL;
+	g_free(devc->transfer_bufs);
+	devc->transfer_bufs = NULL;
+}
+
+/* Data transfers share one receive buffer, which outlives them. */
+static gboolean is_pool_buffer(struct dev_context *devc, const uint8_t *buf)
+{
+	const uint8_t *pool;
+
+	pool = devc->transfer_bufs;
+	if (!pool)
+		return FALSE;
+
+	return buf >= pool &&
+		buf < pool + devc->num_transfers * H4032L_DATA_BUFFER_SIZE;
 }
 
 static void free_transfer(struct libusb_transfer *transfer)
@@ -72,7 +88,8 @@ static void free_transfer(struct libusb_transfer *transfer)
 	unsigned int i;
 
 	if ((transfer->buffer != (unsigned char *)&devc->cmd_pkt) &&
-	    (transfer->buffer != devc->buf)) {
+	    (transfer->buffer != devc->buf) &&
+	    !is_pool_buffer(devc, transfer->buffer)) {
 		g_free(transfer->buffer);
 	}
 
@@ -101,14 +118,36 @@ static void resubmit_transfer(struct libusb_transfer *transfer)
 	free_transfer(transfer);
 }
 
+/*
+ * Keep the low bytes of each sample, when only channels of the low
+ * bytes are enabled. Works in place, each sample moves down in memory.
+ */
+static void narrow_samples(uint8_t *data, size_t sample_count,
+	unsigned int unitsize)
+{
+	size_t i;
+
+	if (unitsize == 1) {
+		for (i = 0; i < sample_count; i++)
+			data[i] = data[i * sizeof(uint32_t)];
+	} else if (unitsize == 2) {
+		for (i = 0; i < sample_count; i++) {
+			data[2 * i + 0] = data[i * sizeof(uint32_t) + 0];
+			data[2 * i + 1] = data[i * sizeof(uint32_t) + 1];
+		}
+	}
+}
+
 static void send_data(struct sr_dev_inst *sdi,
 	uint32_t *data, size_t sample_count)
 {
 	struct dev_context *devc = sdi->priv;
+	unsigned int unitsize = devc->unitsize;
+	uint8_t *bytes = (uint8_t *)data;
 	struct sr_datafeed_logic logic = {
-		.length = sample_count * sizeof(uint32_t),
-		.unitsize = sizeof(uint32_t),
-		.data = data
+		.length = sample_count * unitsize,
+		.unitsize = unitsize,
+		.data = bytes
 	};
 	const struct sr_datafeed_packet packet = {
 		.type = SR_DF_LOGIC,
@@ -116,11 +155,14 @@ static void send_data(struct sr_dev_inst *sdi,
 	};
 	size_t trigger_offset;
 
+	if (unitsize < sizeof(uint32_t))
+		narrow_samples(bytes, sample_count, unitsize);
+
 	if (devc->trigger_pos >= devc->sent_samples &&
 		devc->trigger_pos < (devc->sent_samples + sample_count)) {
 		/* Get trigger position. */
 		trigger_offset = devc->trigger_pos - devc->sent_samples;
-		logic.length = trigger_offset * sizeof(uint32_t);
+		logic.length = trigger_offset * unitsize;
 		if (logic.length)
 			sr_session_send(sdi, &packet);
 
@@ -128,8 +170,8 @@ static void send_data(struct sr_dev_inst *sdi,
 		std_session_send_df_trigger(sdi);
 
 		/* Send rest of data. */
-		logic.length = (sample_count - trigger_offset) * sizeof(uint32_t);
-		logic.data = data + trigger_offset;
+		logic.length = (sample_count - trigger_offset) * unitsize;
+		logic.data = bytes + trigger_offset * unitsize;
 		if (logic.length)
 			sr_session_send(sdi, &packet);
 	} else {
@@ -185,9 +227,9 @@ void LIBUSB_CALL h4032l_data_transfer_callback(struct libusb_transfer *transfer)
 
 	num_samples = MIN(devc->remaining_samples, max_samples);
 	devc->remaining_samples -= num_samples;
-	send_data(sdi, buf, num_samples);
 	sr_dbg("Remaining: %d %08X %08X.", devc->remaining_samples,
 		buf[0], buf[1]);
+	send_data(sdi, buf, num_samples);
 
 	/* Close data receiving. */
 	if (devc->remaining_samples == 0) {
@@ -286,9 +328,9 @@ void LIBUSB_CALL h4032l_usb_callback(struct libusb_transfer *transfer)
 	case H4032L_STATUS_TRANSFER:
 		num_samples = MIN(devc->remaining_samples, max_samples);
 		devc->remaining_samples -= num_samples;
-		send_data(sdi, buf, num_samples);
 		sr_dbg("Remaining: %d %08X %08X.", devc->remaining_samples,
 		       buf[0], buf[1]);
+		send_data(sdi, buf, num_samples);
 		break;
 	}
 
@@ -360,27 +402,39 @@ SR_PRIV int h4032l_start_data_transfers(const struct sr_dev_inst *sdi)
 	struct sr_usb_dev_inst *usb = sdi->conn;
 	struct libusb_transfer *transfer;
 	uint8_t *buf;
-	unsigned int num_transfers;
+	unsigned int num_transfers, max_transfers;
 	unsigned int i;
 	int ret;
 
 	devc->submitted_transfers = 0;
 
 	/*
-	 * Set number of data transfers regarding to size of buffer.
-	 * FPGA version 0 can't transfer multiple transfers at once.
+	 * Set number of data transfers regarding to size of buffer,
+	 * and the user's choice. FPGA version 0 can't transfer multiple
+	 * transfers at once.
 	 */
+	max_transfers = H4032L_DATA_TRANSFER_MAX_NUM;
+	if (devc->transfer_count)
+		max_transfers = MIN(devc->transfer_count,
+			H4032L_DATA_TRANSFER_LIMIT);
+	if (!devc->fpga_version)
+		max_transfers = 1;
 	if ((num_transfers = MIN(devc->remaining_samples * sizeof(uint32_t) /
-	    H4032L_DATA_BUFFER_SIZE, devc->fpga_version ?
-	    H4032L_DATA_TRANSFER_MAX_NUM : 1)) == 0)
+	    H4032L_DATA_BUFFER_SIZE, max_transfers)) == 0)
 		num_transfers = 1;
 
+	/*
+	 * Transfers get resubmitted with their buffers, one allocation
+	 * covers all of them for the whole acquisition.
+	 */
 	g_free(devc->transfers);
-	devc->transfers = g_malloc(sizeof(*devc->transfers) * num_transfers);
+	devc->transfers = g_malloc0(sizeof(*devc->transfers) * num_transfers);
 	devc->num_transfers = num_transfers;
+	g_free(devc->transfer_bufs);
+	devc->transfer_bufs = g_malloc(num_transfers * H4032L_DATA_BUFFER_SIZE);
 
 	for (i = 0; i < num_transfers; i++) {
-		buf = g_malloc(H4032L_DATA_BUFFER_SIZE);
+		buf = &devc->transfer_bufs[i * H4032L_DATA_BUFFER_SIZE];
 		transfer = libusb_alloc_transfer(0);
 
 		libusb_fill_bulk_transfer(transfer, usb->devhdl,
@@ -394,7 +448,6 @@ SR_PRIV int h4032l_start_data_transfers(const struct sr_dev_inst *sdi)
 			sr_err("Failed to submit transfer: %s.",
 			       libusb_error_name(ret));
 			libusb_free_transfer(transfer);
-			g_free(buf);
 			abort_acquisition(devc);
 			return SR_ERR;
 		}
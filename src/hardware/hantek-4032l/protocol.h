@@ -35,6 +35,7 @@
 
 #define H4032L_DATA_BUFFER_SIZE (2 * 1024)
 #define H4032L_DATA_TRANSFER_MAX_NUM 32
+#define H4032L_DATA_TRANSFER_LIMIT 256
 
 #define H4043L_NUM_SAMPLES_MIN (2 * 1024)
 #define H4032L_NUM_SAMPLES_MAX (64 * 1024 * 1024)
@@ -163,6 +164,9 @@ struct dev_context {
 	struct h4032l_cmd_pkt cmd_pkt;
 	unsigned int num_transfers;
 	struct libusb_transfer **transfers;
+	uint64_t transfer_count;
+	uint8_t *transfer_bufs;
+	unsigned int unitsize;
 	uint8_t buf[512];
 	uint64_t capture_ratio;
 	uint32_t trigger_pos;
@@ -130,6 +130,7 @@ static const struct hantek_6xxx_profile dev_profiles[] = {
 
 
 static int read_channel(const struct sr_dev_inst *sdi, uint32_t amount);
+static void queue_transfers(const struct sr_dev_inst *sdi);
 
 static struct sr_dev_inst *hantek_6xxx_dev_new(const struct hantek_6xxx_profile *prof)
 {
@@ -198,6 +199,7 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 static void clear_helper(struct dev_context *devc)
 {
 	g_slist_free(devc->enabled_channels);
+	g_free(devc->chunk_buf);
 }
 
 static int dev_clear(const struct sr_dev_driver *di)
@@ -238,7 +240,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		conn_devices = NULL;
 
 	/* Find all Hantek 60xx devices and upload firmware to all of them. */
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -324,8 +326,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 	err = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/* Returns once the FX2 is back with its new firmware. */
+		ezusb_wait_renumerated(sdi, MAX_RENUM_DELAY_MS);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((err = hantek_6xxx_open(sdi)) == SR_OK)
@@ -531,7 +533,8 @@ static uint32_t data_amount(const struct sr_dev_inst *sdi)
 		time_left = devc->limit_msec - (g_get_monotonic_time() - devc->aq_started) / 1000;
 		data_left = devc->samplerate * MAX(time_left, 0) * NUM_CHANNELS / 1000;
 	} else if (devc->limit_samples) {
-		data_left = (devc->limit_samples - devc->samp_received) * NUM_CHANNELS;
+		data_left = (devc->limit_samples - devc->samp_received -
+			devc->samp_queued) * NUM_CHANNELS;
 	} else {
 		data_left = devc->samplerate * NUM_CHANNELS;
 	}
@@ -556,27 +559,38 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 	struct sr_analog_spec spec;
 	struct dev_context *devc = sdi->priv;
 	GSList *channels = devc->enabled_channels;
+	const uint64_t *vdiv;
+	uint8_t *data;
 
 	const float ch_bit[] = { RANGE(0) / 255, RANGE(1) / 255 };
-	const float ch_center[] = { RANGE(0) / 2, RANGE(1) / 2 };
+
+	if (devc->chunk_buf_size < (size_t)num_samples) {
+		g_free(devc->chunk_buf);
+		devc->chunk_buf = g_try_malloc(num_samples);
+		devc->chunk_buf_size = devc->chunk_buf ? num_samples : 0;
+		if (!devc->chunk_buf) {
+			sr_err("Analog data buffer malloc failed.");
+			devc->dev_state = STOPPING;
+			return;
+		}
+	}
+	data = devc->chunk_buf;
 
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
 
 	packet.type = SR_DF_ANALOG;
 	packet.payload = &analog;
 
+	/* Pass the raw ADC codes, scale and offset convert them to volts. */
+	analog.data = data;
 	analog.num_samples = num_samples;
+	analog.encoding->unitsize = sizeof(uint8_t);
+	analog.encoding->is_signed = FALSE;
+	analog.encoding->is_float = FALSE;
 	analog.meaning->mq = SR_MQ_VOLTAGE;
 	analog.meaning->unit = SR_UNIT_VOLT;
 	analog.meaning->mqflags = 0;
 
-	analog.data = g_try_malloc(num_samples * sizeof(float));
-	if (!analog.data) {
-		sr_err("Analog data buffer malloc failed.");
-		devc->dev_state = STOPPING;
-		return;
-	}
-
 	for (int ch = 0; ch < NUM_CHANNELS; ch++) {
 		if (!devc->ch_enabled[ch])
 			continue;
@@ -587,54 +601,66 @@ static void send_chunk(struct sr_dev_inst *sdi, unsigned char *buf,
 		analog.spec->spec_digits = digits;
 		analog.meaning->channels = g_slist_append(NULL, channels->data);
 
-		for (int i = 0; i < num_samples; i++) {
-			/*
-			 * The device always sends data for both channels. If a channel
-			 * is disabled, it contains a copy of the enabled channel's
-			 * data. However, we only send the requested channels to
-			 * the bus.
-			 *
-			 * Voltage values are encoded as a value 0-255, where the
-			 * value is a point in the range represented by the vdiv
-			 * setting. There are 10 vertical divs, so e.g. 500mV/div
-			 * represents 5V peak-to-peak where 0 = -2.5V and 255 = +2.5V.
-			 */
-			((float *)analog.data)[i] = ch_bit[ch] * *(buf + i * 2 + ch) - ch_center[ch];
-		}
+		/*
+		 * Voltage values are encoded as a value 0-255, where the
+		 * value is a point in the range represented by the vdiv
+		 * setting. There are 10 vertical divs, so e.g. 500mV/div
+		 * represents 5V peak-to-peak where 0 = -2.5V and 255 = +2.5V.
+		 */
+		vdiv = devc->vdivs[devc->voltage[ch]];
+		sr_rational_set(&analog.encoding->scale,
+			vdiv[0] * VDIV_MULTIPLIER, vdiv[1] * 255);
+		sr_rational_set(&analog.encoding->offset,
+			-(int64_t)(vdiv[0] * VDIV_MULTIPLIER), vdiv[1] * 2);
+
+		/*
+		 * The device always sends data for both channels. If a channel
+		 * is disabled, it contains a copy of the enabled channel's
+		 * data. However, we only send the requested channels to
+		 * the bus.
+		 */
+		for (int i = 0; i < num_samples; i++)
+			data[i] = buf[i * NUM_CHANNELS + ch];
 
 		sr_session_send(sdi, &packet);
 		g_slist_free(analog.meaning->channels);
 
 		channels = channels->next;
 	}
-	g_free(analog.data);
 }
 
 /*
  * Called by libusb (as triggered by handle_event()) when a transfer comes in.
- * Only channel data comes in asynchronously, and all transfers for this are
- * queued up beforehand, so this just needs to chuck the incoming data onto
- * the libsigrok session bus.
+ * Only channel data comes in asynchronously. Up to NUM_TRANSFERS reads are
+ * kept queued, so this just needs to chuck the incoming data onto the
+ * libsigrok session bus and queue the next read.
  */
 static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
+	uint64_t samples_received;
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
 
+	devc->transfers_queued--;
+	devc->samp_queued -= transfer->length / NUM_CHANNELS;
+
 	if (devc->dev_state == FLUSH) {
 		g_free(transfer->buffer);
 		libusb_free_transfer(transfer);
 		devc->dev_state = CAPTURE;
 		devc->aq_started = g_get_monotonic_time();
-		read_channel(sdi, data_amount(sdi));
+		queue_transfers(sdi);
 		return;
 	}
 
-	if (devc->dev_state != CAPTURE)
+	if (devc->dev_state != CAPTURE) {
+		g_free(transfer->buffer);
+		libusb_free_transfer(transfer);
 		return;
+	}
 
 	sr_spew("receive_transfer(): calculated samplerate == %" PRIu64 "ks/s",
 		(uint64_t)(transfer->actual_length * 1000 /
@@ -644,13 +670,14 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	sr_spew("receive_transfer(): status %s received %d bytes.",
 		libusb_error_name(transfer->status), transfer->actual_length);
 
-	if (transfer->actual_length == 0)
-		/* Nothing to send to the bus. */
-		return;
-
-	unsigned samples_received = transfer->actual_length / NUM_CHANNELS;
-	send_chunk(sdi, transfer->buffer, samples_received);
-	devc->samp_received += samples_received;
+	samples_received = transfer->actual_length / NUM_CHANNELS;
+	if (devc->limit_samples)
+		samples_received = MIN(samples_received,
+			devc->limit_samples - devc->samp_received);
+	if (samples_received) {
+		send_chunk(sdi, transfer->buffer, samples_received);
+		devc->samp_received += samples_received;
+	}
 
 	g_free(transfer->buffer);
 	libusb_free_transfer(transfer);
@@ -667,7 +694,7 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 			(uint32_t)(g_get_monotonic_time() - devc->aq_started) / 1000);
 		sr_dev_acquisition_stop(sdi);
 	} else {
-		read_channel(sdi, data_amount(sdi));
+		queue_transfers(sdi);
 	}
 }
 
@@ -681,10 +708,33 @@ static int read_channel(const struct sr_dev_inst *sdi, uint32_t amount)
 	amount = MIN(amount, MAX_PACKET_SIZE);
 	ret = hantek_6xxx_get_channeldata(sdi, receive_transfer, amount);
 	devc->read_start_ts = g_get_monotonic_time();
+	if (ret == SR_OK) {
+		devc->transfers_queued++;
+		devc->samp_queued += amount / NUM_CHANNELS;
+	}
 
 	return ret;
 }
 
+/*
+ * Keep the endpoint busy with several reads, so that the device's FIFO
+ * gets emptied while earlier data is being sent to the session.
+ */
+static void queue_transfers(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	while (devc->transfers_queued < NUM_TRANSFERS) {
+		if (devc->limit_samples && devc->samp_received +
+				devc->samp_queued >= devc->limit_samples)
+			break;
+		if (read_channel(sdi, data_amount(sdi)) != SR_OK)
+			break;
+	}
+}
+
 static int handle_event(int fd, int revents, void *cb_data)
 {
 	const struct sr_dev_inst *sdi;
@@ -718,6 +768,10 @@ static int handle_event(int fd, int revents, void *cb_data)
 
 		std_session_send_df_end(sdi);
 
+		g_free(devc->chunk_buf);
+		devc->chunk_buf = NULL;
+		devc->chunk_buf_size = 0;
+
 		devc->dev_state = IDLE;
 
 		return TRUE;
@@ -745,6 +799,8 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	std_session_send_df_header(sdi);
 
 	devc->samp_received = 0;
+	devc->samp_queued = 0;
+	devc->transfers_queued = 0;
 	devc->dev_state = FLUSH;
 
 	usb_source_add(sdi->session, drvc->sr_ctx, TICK,
@@ -74,6 +74,9 @@
 #define MAX_PACKET_SIZE		(12 * 1024 * 1024)
 #endif
 
+/* Number of channel data reads kept queued while capturing. */
+#define NUM_TRANSFERS		4
+
 #define HANTEK_EP_IN		0x86
 #define USB_INTERFACE		0
 #define USB_CONFIGURATION	1
@@ -132,6 +135,12 @@ struct dev_context {
 	uint64_t aq_started;
 
 	uint64_t read_start_ts;
+	int transfers_queued;
+	uint64_t samp_queued;
+
+	/* Deinterleaved samples of one channel, reused across chunks. */
+	uint8_t *chunk_buf;
+	size_t chunk_buf_size;
 
 	gboolean ch_enabled[NUM_CHANNELS];
 	int voltage[NUM_CHANNELS];
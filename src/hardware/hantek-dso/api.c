@@ -294,7 +294,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 		conn_devices = NULL;
 
 	/* Find all Hantek DSO devices and upload firmware to all of them. */
-	libusb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
+	sr_usb_get_device_list(drvc->sr_ctx->libusb_ctx, &devlist);
 	for (i = 0; devlist[i]; i++) {
 		if (conn) {
 			usb = NULL;
@@ -379,8 +379,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 	err = SR_ERR;
 	if (devc->fw_updated > 0) {
 		sr_info("Waiting for device to reset.");
-		/* Takes >= 300ms for the FX2 to be gone from the USB bus. */
-		g_usleep(300 * 1000);
+		/* Returns once the FX2 is back with its new firmware. */
+		ezusb_wait_renumerated(sdi, MAX_RENUM_DELAY_MS);
 		timediff_ms = 0;
 		while (timediff_ms < MAX_RENUM_DELAY_MS) {
 			if ((err = dso_open(sdi)) == SR_OK)
@@ -42,15 +42,22 @@ static const int32_t trigger_matches[] = {
 	SR_TRIGGER_EDGE,
 };
 
-static void ipdbg_la_split_addr_port(const char *conn, char **addr,
-	char **port)
+static int ipdbg_la_split_addr_port(const char *conn,
+	struct ipdbg_la_tcp *tcp)
 {
-	char **strs = g_strsplit(conn, "/", 3);
-
-	*addr = g_strdup(strs[1]);
-	*port = g_strdup(strs[2]);
+	char **strs = g_strsplit(conn, "/", 0);
+	int ret = SR_ERR_ARG;
+
+	/* Socket options can follow the port, see sr_tcp_parse_options(). */
+	if (strs[0] && strs[1] && strs[2]) {
+		tcp->address = g_strdup(strs[1]);
+		tcp->port = g_strdup(strs[2]);
+		ret = sr_tcp_parse_options(&tcp->opts, strs + 3);
+	}
 
 	g_strfreev(strs);
+
+	return ret;
 }
 
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
@@ -80,9 +87,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 
 	struct ipdbg_la_tcp *tcp = ipdbg_la_tcp_new();
 
-	ipdbg_la_split_addr_port(conn, &tcp->address, &tcp->port);
-
-	if (!tcp->address)
+	if (ipdbg_la_split_addr_port(conn, tcp) != SR_OK)
 		return NULL;
 
 	if (ipdbg_la_tcp_open(tcp) != SR_OK)
@@ -37,6 +37,15 @@
 
 #define BUFFER_SIZE 4
 
+/*
+ * Socket receive buffer size. A large window lets the server keep
+ * sending while the host is busy, which matters on high latency JTAG
+ * links.
+ */
+#define RCVBUF_SIZE (1024 * 1024)
+/* Maximum number of bytes to request with one recv() call. */
+#define RECV_CHUNK_SIZE (256 * 1024)
+
 /* Top-level command opcodes */
 #define CMD_SET_TRIGGER            0x00
 #define CMD_CFG_TRIGGER            0xF0
@@ -86,6 +95,10 @@ SR_PRIV struct ipdbg_la_tcp *ipdbg_la_tcp_new(void)
 	tcp->address = NULL;
 	tcp->port = NULL;
 	tcp->socket = -1;
+	/* Commands are sent as single bytes, don't hold them back. */
+	tcp->opts.nodelay = TRUE;
+	tcp->opts.rcvbuf = RCVBUF_SIZE;
+	tcp->opts.connect_timeout_ms = SR_TCP_CONNECT_TIMEOUT_MS;
 
 	return tcp;
 }
@@ -98,42 +111,12 @@ SR_PRIV void ipdbg_la_tcp_free(struct ipdbg_la_tcp *tcp)
 
 SR_PRIV int ipdbg_la_tcp_open(struct ipdbg_la_tcp *tcp)
 {
-	struct addrinfo hints;
-	struct addrinfo *results, *res;
-	int err;
-
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_protocol = IPPROTO_TCP;
-
-	err = getaddrinfo(tcp->address, tcp->port, &hints, &results);
-
-	if (err) {
-		sr_err("Address lookup failed: %s:%s: %s", tcp->address,
-			tcp->port, gai_strerror(err));
-		return SR_ERR;
-	}
-
-	for (res = results; res; res = res->ai_next) {
-		if ((tcp->socket = socket(res->ai_family, res->ai_socktype,
-			res->ai_protocol)) < 0)
-			continue;
-		if (connect(tcp->socket, res->ai_addr, res->ai_addrlen) != 0) {
-			close(tcp->socket);
-			tcp->socket = -1;
-			continue;
-		}
-		break;
-	}
-
-	freeaddrinfo(results);
+	int fd;
 
-	if (tcp->socket < 0) {
-		sr_err("Failed to connect to %s:%s: %s", tcp->address, tcp->port,
-			g_strerror(errno));
+	fd = sr_tcp_connect_socket(tcp->address, tcp->port, &tcp->opts);
+	if (fd < 0)
 		return SR_ERR;
-	}
+	tcp->socket = fd;
 
 	return SR_OK;
 }
@@ -297,6 +280,10 @@ SR_PRIV int ipdbg_la_receive_data(int fd, int revents, void *cb_data)
 	struct ipdbg_la_tcp *tcp = sdi->conn;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
+	uint8_t discard[4096], *dst;
+	uint64_t total, wanted;
+	size_t len;
+	int recd;
 
 	if (!devc->raw_sample_buf) {
 		devc->raw_sample_buf =
@@ -307,54 +294,58 @@ SR_PRIV int ipdbg_la_receive_data(int fd, int revents, void *cb_data)
 		}
 	}
 
-	if (devc->num_transfers <
-		(devc->limit_samples_max * devc->data_width_bytes)) {
-		const size_t bufsize = 1024;
-		uint8_t buffer[bufsize];
-
-		const int recd = ipdbg_la_tcp_receive(tcp, buffer, bufsize);
-		if ( recd > 0) {
-			int num_move = (((devc->num_transfers + recd) <=
-							 (devc->limit_samples * devc->data_width_bytes))
-			?
-				recd
-			:
-				(int)((devc->limit_samples * devc->data_width_bytes) -
-						devc->num_transfers));
-			if ( num_move > 0 )
-				memcpy(&(devc->raw_sample_buf[devc->num_transfers]),
-						buffer, num_move);
-			devc->num_transfers += recd;
-		}
-	} else {
-		if (devc->delay_value > 0) {
-			/* There are pre-trigger samples, send those first. */
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
-			logic.length = devc->delay_value * devc->data_width_bytes;
-			logic.unitsize = devc->data_width_bytes;
-			logic.data = devc->raw_sample_buf;
-			sr_session_send(cb_data, &packet);
+	/*
+	 * Read everything the socket has right away, straight into the
+	 * sample buffer, in large requests. The device always sends its
+	 * whole memory, samples beyond limit_samples are dropped.
+	 */
+	total = devc->limit_samples_max * devc->data_width_bytes;
+	wanted = devc->limit_samples * devc->data_width_bytes;
+	while (devc->num_transfers < total) {
+		if (devc->num_transfers < wanted) {
+			dst = &devc->raw_sample_buf[devc->num_transfers];
+			len = MIN(wanted - devc->num_transfers, RECV_CHUNK_SIZE);
+		} else {
+			dst = discard;
+			len = MIN(total - devc->num_transfers, sizeof(discard));
 		}
+		recd = ipdbg_la_tcp_receive(tcp, dst, len);
+		if (recd <= 0)
+			break;
+		devc->num_transfers += recd;
+	}
 
-		/* Send the trigger. */
-		std_session_send_df_trigger(cb_data);
+	/* Wait for the rest of the device memory. */
+	if (devc->num_transfers < total)
+		return TRUE;
 
-		/* Send post-trigger samples. */
+	if (devc->delay_value > 0) {
+		/* There are pre-trigger samples, send those first. */
 		packet.type = SR_DF_LOGIC;
 		packet.payload = &logic;
-		logic.length = (devc->limit_samples - devc->delay_value) *
-			devc->data_width_bytes;
+		logic.length = devc->delay_value * devc->data_width_bytes;
 		logic.unitsize = devc->data_width_bytes;
-		logic.data = devc->raw_sample_buf +
-			(devc->delay_value * devc->data_width_bytes);
+		logic.data = devc->raw_sample_buf;
 		sr_session_send(cb_data, &packet);
+	}
 
-		g_free(devc->raw_sample_buf);
-		devc->raw_sample_buf = NULL;
+	/* Send the trigger. */
+	std_session_send_df_trigger(cb_data);
 
-		ipdbg_la_abort_acquisition(sdi);
-	}
+	/* Send post-trigger samples. */
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.length = (devc->limit_samples - devc->delay_value) *
+		devc->data_width_bytes;
+	logic.unitsize = devc->data_width_bytes;
+	logic.data = devc->raw_sample_buf +
+		(devc->delay_value * devc->data_width_bytes);
+	sr_session_send(cb_data, &packet);
+
+	g_free(devc->raw_sample_buf);
+	devc->raw_sample_buf = NULL;
+
+	ipdbg_la_abort_acquisition(sdi);
 
 	return TRUE;
 }
@@ -362,23 +353,24 @@ SR_PRIV int ipdbg_la_receive_data(int fd, int revents, void *cb_data)
 static int send_escaping(struct ipdbg_la_tcp *tcp, uint8_t *data_to_send,
 	uint32_t length)
 {
-	uint8_t escape = CMD_ESCAPE;
+	uint8_t *buf;
+	size_t pos;
 
+	/* Escape into one buffer, and send it with a single call. */
+	buf = g_malloc(2 * length);
+	pos = 0;
 	while (length--) {
 		uint8_t payload = *data_to_send++;
 
-		if (payload == CMD_RESET)
-			if (tcp_send(tcp, &escape, 1) != SR_OK)
-				sr_warn("Couldn't send escape");
-
-		if (payload == CMD_ESCAPE)
-			if (tcp_send(tcp, &escape, 1) != SR_OK)
-				sr_warn("Couldn't send escape");
-
-		if (tcp_send(tcp, &payload, 1) != SR_OK)
-			sr_warn("Couldn't send data");
+		if (payload == CMD_RESET || payload == CMD_ESCAPE)
+			buf[pos++] = CMD_ESCAPE;
+		buf[pos++] = payload;
 	}
 
+	if (pos && tcp_send(tcp, buf, pos) != SR_OK)
+		sr_warn("Couldn't send data");
+	g_free(buf);
+
 	return SR_OK;
 }
 
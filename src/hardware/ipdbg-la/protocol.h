@@ -30,6 +30,7 @@
 struct ipdbg_la_tcp {
 	char *address;
 	char *port;
+	struct sr_tcp_options opts;
 	int socket;
 };
 
@@ -49,6 +49,7 @@ static const uint32_t devopts[] = {
 	SR_CONF_SAMPLERATE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LIMIT_FRAMES | SR_CONF_GET | SR_CONF_SET,
 #if WITH_THRESHOLD_DEVCFG
 	SR_CONF_VOLTAGE_THRESHOLD | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 #endif
@@ -479,7 +480,7 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	devices = NULL;
 	found_devices = NULL;
 	renum_devices = NULL;
-	ret = libusb_get_device_list(ctx->libusb_ctx, &devlist);
+	ret = sr_usb_get_device_list(ctx->libusb_ctx, &devlist);
 	if (ret < 0) {
 		sr_err("Cannot get device list: %s.", libusb_error_name(ret));
 		return devices;
@@ -829,6 +830,7 @@ static int config_get(uint32_t key, GVariant **data,
 		break;
 	case SR_CONF_LIMIT_SAMPLES:
 	case SR_CONF_LIMIT_MSEC:
+	case SR_CONF_LIMIT_FRAMES:
 		return sr_sw_limits_config_get(&devc->sw_limits, key, data);
 	case SR_CONF_CAPTURE_RATIO:
 		*data = g_variant_new_uint64(devc->capture_ratio);
@@ -925,6 +927,7 @@ static int config_set(uint32_t key, GVariant *data,
 		break;
 	case SR_CONF_LIMIT_SAMPLES:
 	case SR_CONF_LIMIT_MSEC:
+	case SR_CONF_LIMIT_FRAMES:
 		return sr_sw_limits_config_set(&devc->sw_limits, key, data);
 	case SR_CONF_CAPTURE_RATIO:
 		devc->capture_ratio = g_variant_get_uint64(data);
@@ -1082,6 +1085,12 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		devc->packets_per_chunk /= unitsize + repsize;
 	}
 
+	/* Pass on the (value, repetitions) pairs as runs where possible. */
+	ret = feed_queue_logic_rle(devc->feed_queue,
+		!devc->continuous && sr_session_takes_logic_rle(sdi->session));
+	if (ret != SR_OK)
+		return ret;
+
 	sr_sw_limits_acquisition_start(&devc->sw_limits);
 
 	voltage = threshold_voltage(sdi, NULL);
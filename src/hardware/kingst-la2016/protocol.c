@@ -289,13 +289,11 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 {
 	struct drv_context *drvc;
 	struct sr_usb_dev_inst *usb;
-	struct sr_resource bitstream;
+	GBytes *bitstream;
 	uint32_t bitstream_size;
 	uint8_t buffer[sizeof(uint32_t)];
 	uint8_t *wrptr;
-	uint8_t block[4096];
-	int len, act_len;
-	unsigned int pos;
+	uint8_t *padded;
 	int ret;
 	unsigned int zero_pad_to;
 
@@ -304,20 +302,20 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 
 	sr_info("Uploading FPGA bitstream '%s'.", bitstream_fname);
 
-	ret = sr_resource_open(drvc->sr_ctx, &bitstream,
-		SR_RESOURCE_FIRMWARE, bitstream_fname);
-	if (ret != SR_OK) {
+	bitstream = sr_resource_load_cached(drvc->sr_ctx,
+		SR_RESOURCE_FIRMWARE, bitstream_fname, G_MAXUINT32);
+	if (!bitstream) {
 		sr_err("Cannot find FPGA bitstream %s.", bitstream_fname);
-		return ret;
+		return SR_ERR;
 	}
 
-	bitstream_size = (uint32_t)bitstream.size;
+	bitstream_size = (uint32_t)g_bytes_get_size(bitstream);
 	wrptr = buffer;
 	write_u32le_inc(&wrptr, bitstream_size);
 	ret = ctrl_out(sdi, CMD_FPGA_INIT, 0x00, 0, buffer, wrptr - buffer);
 	if (ret != SR_OK) {
 		sr_err("Cannot initiate FPGA bitstream upload.");
-		sr_resource_close(drvc->sr_ctx, &bitstream);
+		g_bytes_unref(bitstream);
 		return ret;
 	}
 	zero_pad_to = bitstream_size;
@@ -325,47 +323,21 @@ static int upload_fpga_bitstream(const struct sr_dev_inst *sdi,
 	zero_pad_to /= LA2016_EP2_PADDING;
 	zero_pad_to *= LA2016_EP2_PADDING;
 
-	pos = 0;
-	while (1) {
-		if (pos < bitstream.size) {
-			len = (int)sr_resource_read(drvc->sr_ctx, &bitstream,
-				block, sizeof(block));
-			if (len < 0) {
-				sr_err("Cannot read FPGA bitstream.");
-				sr_resource_close(drvc->sr_ctx, &bitstream);
-				return SR_ERR_IO;
-			}
-		} else {
-			/*  Zero-pad until 'zero_pad_to'. */
-			len = zero_pad_to - pos;
-			if ((unsigned)len > sizeof(block))
-				len = sizeof(block);
-			memset(&block, 0, len);
-		}
-		if (len == 0)
-			break;
-
-		ret = libusb_bulk_transfer(usb->devhdl, USB_EP_FPGA_BITSTREAM,
-			&block[0], len, &act_len, DEFAULT_TIMEOUT_MS);
-		if (ret != 0) {
-			sr_dbg("Cannot write FPGA bitstream, block %#x len %d: %s.",
-				pos, (int)len, libusb_error_name(ret));
-			ret = SR_ERR_IO;
-			break;
-		}
-		if (act_len != len) {
-			sr_dbg("Short write for FPGA bitstream, block %#x len %d: got %d.",
-				pos, (int)len, act_len);
-			ret = SR_ERR_IO;
-			break;
-		}
-		pos += len;
-	}
-	sr_resource_close(drvc->sr_ctx, &bitstream);
-	if (ret != SR_OK)
+	/* Zero-pad until 'zero_pad_to'. */
+	padded = g_malloc0(zero_pad_to);
+	memcpy(padded, g_bytes_get_data(bitstream, NULL), bitstream_size);
+	g_bytes_unref(bitstream);
+
+	ret = sr_usb_bulk_upload(drvc->sr_ctx, usb->devhdl,
+		USB_EP_FPGA_BITSTREAM, padded, zero_pad_to, 4096,
+		DEFAULT_TIMEOUT_MS);
+	g_free(padded);
+	if (ret != SR_OK) {
+		sr_dbg("Cannot write FPGA bitstream.");
 		return ret;
-	sr_info("FPGA bitstream upload (%" PRIu64 " bytes) done.",
-		bitstream.size);
+	}
+	sr_info("FPGA bitstream upload (%" PRIu32 " bytes) done.",
+		bitstream_size);
 
 	return SR_OK;
 }
@@ -1147,6 +1119,7 @@ static int la2016_usbxfer_resubmit(const struct sr_dev_inst *sdi,
 			libusb_error_name(ret));
 		return SR_ERR_IO;
 	}
+	devc->xfers_busy++;
 
 	return SR_OK;
 }
@@ -1182,6 +1155,7 @@ SR_PRIV int la2016_setup_acquisition(const struct sr_dev_inst *sdi,
 	uint8_t cmd;
 
 	devc = sdi->priv;
+	devc->acq_voltage = voltage;
 
 	ret = set_threshold_voltage(sdi, voltage);
 	if (ret != SR_OK)
@@ -1211,6 +1185,8 @@ SR_PRIV int la2016_start_acquisition(const struct sr_dev_inst *sdi)
 	int ret;
 
 	devc = sdi->priv;
+	devc->acq_aborted = FALSE;
+	g_queue_clear(&devc->rx_queue);
 
 	ret = la2016_usbxfer_allocate(sdi);
 	if (ret != SR_OK)
@@ -1257,8 +1233,12 @@ static int la2016_stop_acquisition(const struct sr_dev_inst *sdi)
 
 SR_PRIV int la2016_abort_acquisition(const struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
 	int ret;
 
+	devc = sdi->priv;
+	devc->acq_aborted = TRUE;
+
 	ret = la2016_stop_acquisition(sdi);
 	if (ret != SR_OK)
 		return ret;
@@ -1287,6 +1267,9 @@ static int la2016_start_download(const struct sr_dev_inst *sdi)
 	devc->n_bytes_to_read *= devc->transfer_size;
 	devc->read_pos = devc->info.write_pos - devc->n_bytes_to_read;
 	devc->n_reps_until_trigger = devc->info.n_rep_packets_before_trigger;
+	devc->n_bytes_to_receive = devc->n_bytes_to_read;
+	devc->download_received = FALSE;
+	devc->rearmed = FALSE;
 
 	sr_dbg("Want to read %u xfer-packets starting from pos %" PRIu32 ".",
 		devc->n_transfer_packets_to_read, devc->read_pos);
@@ -1350,7 +1333,7 @@ static void send_chunk(struct sr_dev_inst *sdi,
 	size_t num_xfers, num_pkts, num_seqs;
 	const uint8_t *rp;
 	uint32_t sample_value;
-	size_t repetitions;
+	size_t repetitions, chunk_samples;
 	uint8_t sample_buff[sizeof(sample_value)];
 
 	devc = sdi->priv;
@@ -1376,6 +1359,7 @@ static void send_chunk(struct sr_dev_inst *sdi,
 
 	/* Process the received chunk of capture data. */
 	sample_value = 0;
+	chunk_samples = 0;
 	rp = data_buffer;
 	num_xfers = data_length / devc->transfer_size;
 	while (num_xfers--) {
@@ -1389,12 +1373,11 @@ static void send_chunk(struct sr_dev_inst *sdi,
 			repetitions = read_u8_inc(&rp);
 
 			devc->total_samples += repetitions;
+			chunk_samples += repetitions;
 
 			write_u32le(sample_buff, sample_value);
 			feed_queue_logic_submit_one(devc->feed_queue,
 				sample_buff, repetitions);
-			sr_sw_limits_update_samples_read(&devc->sw_limits,
-				repetitions);
 
 			if (devc->trigger_involved && !devc->trigger_marked) {
 				if (!--devc->n_reps_until_trigger) {
@@ -1411,6 +1394,7 @@ static void send_chunk(struct sr_dev_inst *sdi,
 		while (num_seqs--)
 			(void)read_u8_inc(&rp);
 	}
+	sr_sw_limits_update_samples_read(&devc->sw_limits, chunk_samples);
 
 	/*
 	 * Check for several conditions which shall terminate the
@@ -1545,10 +1529,12 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	gboolean was_cancelled, device_gone;
+	uint32_t length;
 	int ret;
 
 	sdi = transfer->user_data;
 	devc = sdi->priv;
+	devc->xfers_busy--;
 
 	was_cancelled = transfer->status == LIBUSB_TRANSFER_CANCELLED;
 	device_gone = transfer->status == LIBUSB_TRANSFER_NO_DEVICE;
@@ -1560,17 +1546,34 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 		return;
 	}
 
+	/*
+	 * Capture data download: Just account for the reception here,
+	 * queue the transfer and have the session source callback
+	 * process its data, and re-submit it. Keeps the USB callback
+	 * short, and tells early when all of the device's memory has
+	 * arrived on the host.
+	 */
+	if (!devc->continuous) {
+		if (was_cancelled)
+			return;
+		length = transfer->actual_length;
+		if (length > devc->n_bytes_to_receive)
+			devc->n_bytes_to_receive = 0;
+		else
+			devc->n_bytes_to_receive -= length;
+		if (!devc->n_bytes_to_receive)
+			devc->download_received = TRUE;
+		g_queue_push_tail(&devc->rx_queue, transfer);
+		return;
+	}
+
 	/*
 	 * Implementation detail: A USB transfer timeout is not fatal
 	 * here. We just process whatever was received, empty input is
 	 * perfectly acceptable. Reaching (or exceeding) the sw limits
-	 * or exhausting the device's captured data will complete the
-	 * sample data download.
+	 * will complete the stream's reception.
 	 */
-	if (devc->continuous)
-		stream_data(sdi, transfer->buffer, transfer->actual_length);
-	else
-		send_chunk(sdi, transfer->buffer, transfer->actual_length);
+	stream_data(sdi, transfer->buffer, transfer->actual_length);
 
 	/*
 	 * Re-submit completed transfers (regardless of timeout or
@@ -1585,9 +1588,75 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer)
 	}
 }
 
+/*
+ * Process the capture data of queued USB transfers. Re-submit them
+ * while more of the device's memory content is expected. A transfer
+ * timeout is not fatal, empty input is perfectly acceptable.
+ */
+static void process_received(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct libusb_transfer *xfer;
+	int ret;
+
+	devc = sdi->priv;
+	while ((xfer = g_queue_pop_head(&devc->rx_queue))) {
+		send_chunk(sdi, xfer->buffer, xfer->actual_length);
+		if (devc->download_received || devc->download_finished)
+			continue;
+		ret = la2016_usbxfer_resubmit(sdi, xfer);
+		if (ret != SR_OK)
+			devc->download_finished = TRUE;
+	}
+}
+
+/* Whether another capture follows the current one. */
+static gboolean more_frames(const struct dev_context *devc)
+{
+	const struct sr_sw_limits *limits;
+
+	if (devc->continuous || devc->acq_aborted)
+		return FALSE;
+	limits = &devc->sw_limits;
+	if (!limits->limit_frames)
+		return FALSE;
+
+	return limits->frames_read + 1 < limits->limit_frames;
+}
+
+/*
+ * Start the next capture of a repetitive acquisition. The previous
+ * capture's data has been received, or is no longer needed.
+ */
+static int la2016_rearm(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	int ret;
+
+	devc = sdi->priv;
+	if (devc->rearmed)
+		return SR_OK;
+	devc->rearmed = TRUE;
+
+	(void)la2016_usbxfer_cancel_all(sdi);
+
+	ret = set_run_mode(sdi, RUNMODE_HALT);
+	if (ret != SR_OK)
+		return ret;
+	ret = la2016_setup_acquisition(sdi, devc->acq_voltage);
+	if (ret != SR_OK)
+		return ret;
+	ret = set_run_mode(sdi, RUNMODE_RUN);
+	if (ret != SR_OK)
+		return ret;
+	sr_dbg("Re-armed for the next capture.");
+
+	return SR_OK;
+}
+
 SR_PRIV int la2016_receive_data(int fd, int revents, void *cb_data)
 {
-	const struct sr_dev_inst *sdi;
+	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct drv_context *drvc;
 	struct timeval tv;
@@ -1629,10 +1698,17 @@ SR_PRIV int la2016_receive_data(int fd, int revents, void *cb_data)
 	 * Periodically check a potentially configured msecs timeout.
 	 */
 	if (!devc->continuous && !devc->completion_seen) {
+		/* Transfers of a previous capture must have retired. */
+		if (devc->xfers_busy) {
+			memset(&tv, 0, sizeof(tv));
+			libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
+			return TRUE;
+		}
 		if (!la2016_is_idle(sdi)) {
 			if (sr_sw_limits_check(&devc->sw_limits)) {
 				devc->sw_limits.limit_msec = 0;
 				sr_dbg("Limit reached. Stopping acquisition.");
+				devc->acq_aborted = TRUE;
 				la2016_stop_acquisition(sdi);
 			}
 			/* Not yet ready for sample data download. */
@@ -1650,6 +1726,7 @@ SR_PRIV int la2016_receive_data(int fd, int revents, void *cb_data)
 		/* Initiate the download of acquired sample data. */
 		std_session_send_df_frame_begin(sdi);
 		devc->frame_begin_sent = TRUE;
+		g_queue_clear(&devc->rx_queue);
 		ret = la2016_start_download(sdi);
 		if (ret != SR_OK) {
 			sr_err("Cannot start acquisition data download.");
@@ -1664,6 +1741,22 @@ SR_PRIV int la2016_receive_data(int fd, int revents, void *cb_data)
 	memset(&tv, 0, sizeof(tv));
 	libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
 
+	/*
+	 * Re-arm for the next capture as soon as all capture data has
+	 * arrived on the host, before processing it. Which overlaps the
+	 * host side processing with the next capture in the device.
+	 */
+	if (!devc->continuous) {
+		if (devc->download_received && !devc->rearmed && more_frames(devc)) {
+			ret = la2016_rearm(sdi);
+			if (ret != SR_OK) {
+				sr_err("Cannot re-arm for the next capture.");
+				devc->acq_aborted = TRUE;
+			}
+		}
+		process_received(sdi);
+	}
+
 	/*
 	 * Periodically flush acquisition data in streaming mode.
 	 * Without this nudge, previously received and accumulated data
@@ -1683,6 +1776,27 @@ SR_PRIV int la2016_receive_data(int fd, int revents, void *cb_data)
 		}
 	}
 
+	/*
+	 * Complete the frame when another capture follows. A download
+	 * which ended early (sw limits) has not re-armed the device yet.
+	 */
+	if (devc->download_finished && more_frames(devc)) {
+		sr_dbg("Frame complete, waiting for the next capture.");
+		feed_queue_logic_flush(devc->feed_queue);
+		std_session_send_df_frame_end(sdi);
+		devc->frame_begin_sent = FALSE;
+		sr_sw_limits_update_frames_read(&devc->sw_limits, 1);
+		devc->sw_limits.samples_read = 0;
+		g_queue_clear(&devc->rx_queue);
+		ret = la2016_rearm(sdi);
+		if (ret == SR_OK) {
+			devc->completion_seen = FALSE;
+			return TRUE;
+		}
+		sr_err("Cannot re-arm for the next capture.");
+		devc->acq_aborted = TRUE;
+	}
+
 	/* Postprocess completion of sample data download. */
 	if (devc->download_finished) {
 		sr_dbg("Download finished, post processing.");
@@ -1694,6 +1808,7 @@ SR_PRIV int la2016_receive_data(int fd, int revents, void *cb_data)
 		memset(&tv, 0, sizeof(tv));
 		libusb_handle_events_timeout(drvc->sr_ctx->libusb_ctx, &tv);
 
+		g_queue_clear(&devc->rx_queue);
 		feed_queue_logic_flush(devc->feed_queue);
 		feed_queue_logic_free(devc->feed_queue);
 		devc->feed_queue = NULL;
@@ -1920,6 +2035,11 @@ SR_PRIV int la2016_deinit_hardware(const struct sr_dev_inst *sdi)
 
 SR_PRIV void la2016_release_resources(const struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+	if (devc)
+		g_queue_clear(&devc->rx_queue);
 	(void)la2016_usbxfer_release(sdi);
 }
 
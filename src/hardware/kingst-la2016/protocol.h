@@ -156,6 +156,20 @@ struct dev_context {
 	uint64_t total_samples;
 	uint32_t read_pos;
 
+	/*
+	 * Repetitive captures (frames). Completed USB transfers queue up
+	 * for processing outside of the USB callback. The device gets
+	 * re-armed for the next capture as soon as all of its memory
+	 * content was received, while the host still processes it.
+	 */
+	double acq_voltage;
+	gboolean acq_aborted;
+	gboolean download_received;
+	gboolean rearmed;
+	uint32_t n_bytes_to_receive;
+	size_t xfers_busy;
+	GQueue rx_queue;
+
 	struct feed_queue_logic *feed_queue;
 	GSList *transfers;
 	size_t transfer_bufsize;
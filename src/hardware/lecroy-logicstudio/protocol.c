@@ -36,6 +36,10 @@
 
 #define USB_TIMEOUT_MS 100
 
+/* Sample memory readback, the first transfer takes a little more. */
+#define BULK_XFER_SIZE_FIRST (17 << 10)
+#define BULK_XFER_SIZE (16 << 10)
+
 /* Firmware for acquisition on 8 channels. */
 #define FPGA_FIRMWARE_8 "lecroy-logicstudio16-8.bitstream"
 /* Firmware for acquisition on 16 channels. */
@@ -241,26 +245,56 @@ static void prep_regw(struct regval *regval, uint8_t reg, uint16_t val)
 	regval->val = val;
 }
 
-static void LIBUSB_CALL handle_fetch_samples_done(struct libusb_transfer *xfer)
+/*
+ * Submit bulk transfers for the rest of the sample memory at once, each
+ * for its own part of the buffer. The device streams its memory, with
+ * several transfers queued there is no gap between them.
+ */
+static void submit_fetch_round(const struct sr_dev_inst *sdi)
 {
-	const struct sr_dev_inst *sdi;
 	struct sr_usb_dev_inst *usb;
 	struct dev_context *devc;
+	struct libusb_transfer *xfer;
+	uint32_t offset, length;
+	unsigned int i;
 
-	sdi = xfer->user_data;
 	usb = sdi->conn;
 	devc = sdi->priv;
 
+	offset = devc->total_received_sample_bytes;
+	devc->bulk_count = 0;
+	devc->bulk_pending = 0;
+	for (i = 0; i < NUM_BULK_XFERS && offset < SAMPLE_BUF_SIZE; i++) {
+		length = offset ? BULK_XFER_SIZE : BULK_XFER_SIZE_FIRST;
+		length = MIN(length, SAMPLE_BUF_SIZE - offset);
+		xfer = devc->bulk_xfers[i];
+		libusb_fill_bulk_transfer(xfer, usb->devhdl, EP_BULK,
+			devc->fetched_samples + offset, length,
+			recv_bulk_transfer, (void *)sdi, USB_TIMEOUT_MS);
+		if (libusb_submit_transfer(xfer) < 0) {
+			sr_err("Failed to submit bulk transfer.");
+			break;
+		}
+		devc->bulk_offsets[i] = offset;
+		devc->bulk_received[i] = 0;
+		devc->bulk_count++;
+		devc->bulk_pending++;
+		offset += length;
+	}
+}
+
+static void LIBUSB_CALL handle_fetch_samples_done(struct libusb_transfer *xfer)
+{
+	const struct sr_dev_inst *sdi;
+
+	sdi = xfer->user_data;
+
 	g_free(xfer->buffer);
 	xfer->buffer = NULL;
 
 	libusb_free_transfer(xfer);
 
-	libusb_fill_bulk_transfer(devc->bulk_xfer, usb->devhdl, EP_BULK,
-		devc->fetched_samples, 17 << 10,
-		recv_bulk_transfer, (void *)sdi, USB_TIMEOUT_MS);
-
-	libusb_submit_transfer(devc->bulk_xfer);
+	submit_fetch_round(sdi);
 }
 
 static void calc_unk0(uint32_t *a, uint32_t *b)
@@ -934,6 +968,10 @@ static void LIBUSB_CALL recv_intr_transfer(struct libusb_transfer *xfer)
 	}
 }
 
+/*
+ * Send a block of fetched sample memory. The block never exceeds the
+ * sample memory, and thus fits the conversion buffer as a whole.
+ */
 static void send_samples(const struct sr_dev_inst *sdi,
 	uint8_t *samples, uint32_t length)
 {
@@ -941,53 +979,42 @@ static void send_samples(const struct sr_dev_inst *sdi,
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
 	gboolean lower_enabled, upper_enabled;
-	uint32_t shift, i;
+	uint16_t *conv;
+	uint32_t i;
 
 	devc = sdi->priv;
 
+	if (!length)
+		return;
+
 	lower_enabled = (devc->channel_mask & 0x00ff) != 0x00;
 	upper_enabled = (devc->channel_mask & 0xff00) != 0x00;
 
-	logic.unitsize = 2;
-
 	packet.type = SR_DF_LOGIC;
 	packet.payload = &logic;
 
 	if (lower_enabled && upper_enabled) {
+		logic.unitsize = 2;
+		logic.length = length;
+		logic.data = samples;
+	} else if (lower_enabled) {
+		/* The lower channels are the low byte, send as is. */
+		logic.unitsize = 1;
 		logic.length = length;
 		logic.data = samples;
-
-		sr_session_send(sdi, &packet);
 	} else {
-		/* Which channel group is enabled? */
-		shift = (lower_enabled) ? 0 : 8;
-
-		while (length >= (CONV_8TO16_BUF_SIZE / 2)) {
-			for (i = 0; i < (CONV_8TO16_BUF_SIZE / 2); i++) {
-				devc->conv8to16[i] = samples[i];
-				devc->conv8to16[i] <<= shift;
-			}
-
-			logic.length = CONV_8TO16_BUF_SIZE;
-			logic.data = devc->conv8to16;
-
-			sr_session_send(sdi, &packet);
-
-			samples += CONV_8TO16_BUF_SIZE / 2;
-			length -= CONV_8TO16_BUF_SIZE / 2;
-		}
-
-		/* Handle the remaining samples. */
-		for (i = 0; i < length; i++) {
-			devc->conv8to16[i] = samples[i];
-			devc->conv8to16[i] <<= shift;
-		}
+		/* The upper channels go to the high byte. */
+		length = MIN(length, CONV_8TO16_BUF_SIZE / 2);
+		conv = devc->conv8to16;
+		for (i = 0; i < length; i++)
+			conv[i] = (uint16_t)samples[i] << 8;
 
+		logic.unitsize = 2;
 		logic.length = length * 2;
-		logic.data = devc->conv8to16;
-
-		sr_session_send(sdi, &packet);
+		logic.data = conv;
 	}
+
+	sr_session_send(sdi, &packet);
 }
 
 static uint16_t sample_to_byte_offset(struct dev_context *devc, uint64_t o)
@@ -1003,8 +1030,9 @@ static void LIBUSB_CALL recv_bulk_transfer(struct libusb_transfer *xfer)
 	const struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct drv_context *drvc;
-	uint32_t bytes_left, length;
+	uint32_t bytes_left, length, dest;
 	uint16_t read_offset, trigger_offset;
+	unsigned int i;
 
 	sdi = xfer->user_data;
 
@@ -1014,16 +1042,30 @@ static void LIBUSB_CALL recv_bulk_transfer(struct libusb_transfer *xfer)
 	drvc = sdi->driver->context;
 	devc = sdi->priv;
 
-	devc->total_received_sample_bytes += xfer->actual_length;
-
-	if (devc->total_received_sample_bytes < SAMPLE_BUF_SIZE) {
-		xfer->buffer = devc->fetched_samples
-			+ devc->total_received_sample_bytes;
+	for (i = 0; i < devc->bulk_count; i++) {
+		if (devc->bulk_xfers[i] == xfer)
+			devc->bulk_received[i] = xfer->actual_length;
+	}
+	if (devc->bulk_pending && --devc->bulk_pending)
+		return;
 
-		xfer->length = MIN(16 << 10,
-			SAMPLE_BUF_SIZE - devc->total_received_sample_bytes);
+	/*
+	 * All transfers of the round are done. Usually they all got
+	 * filled, else move the data down so that it is contiguous, and
+	 * fetch the rest in another round.
+	 */
+	dest = devc->total_received_sample_bytes;
+	for (i = 0; i < devc->bulk_count; i++) {
+		if (dest != devc->bulk_offsets[i])
+			memmove(devc->fetched_samples + dest,
+				devc->fetched_samples + devc->bulk_offsets[i],
+				devc->bulk_received[i]);
+		dest += devc->bulk_received[i];
+	}
+	devc->total_received_sample_bytes = dest;
 
-		libusb_submit_transfer(xfer);
+	if (devc->total_received_sample_bytes < SAMPLE_BUF_SIZE) {
+		submit_fetch_round(sdi);
 		return;
 	}
 
@@ -28,14 +28,23 @@
 #define LOG_PREFIX "lecroy-logicstudio"
 
 #define SAMPLE_BUF_SIZE 40960u
-#define CONV_8TO16_BUF_SIZE 8192
+#define CONV_8TO16_BUF_SIZE (2 * SAMPLE_BUF_SIZE)
 #define INTR_BUF_SIZE 32
 
+/* Bulk transfers which fetch sample memory at the same time. */
+#define NUM_BULK_XFERS 3
+
 struct samplerate_info;
 
 struct dev_context {
 	struct libusb_transfer *intr_xfer;
-	struct libusb_transfer *bulk_xfer;
+	struct libusb_transfer *bulk_xfers[NUM_BULK_XFERS];
+
+	/** Where each bulk transfer of the current round puts its data. */
+	uint32_t bulk_offsets[NUM_BULK_XFERS];
+	uint32_t bulk_received[NUM_BULK_XFERS];
+	unsigned int bulk_count;
+	unsigned int bulk_pending;
 
 	const struct samplerate_info *samplerate_info;
 
@@ -47,8 +56,9 @@ struct dev_context {
 
 	/**
 	 * Used to convert 8 bit samples (8 channels) to 16 bit samples
-	 * (16 channels), thus only used in 8 channel mode.
-	 * Holds CONV_8TO16_BUF_SIZE bytes.
+	 * (16 channels), thus only used in 8 channel mode when the upper
+	 * channels are enabled. Holds CONV_8TO16_BUF_SIZE bytes, which
+	 * covers the whole sample memory.
 	 */
 	uint16_t *conv8to16;
 
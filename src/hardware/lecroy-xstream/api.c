@@ -373,6 +373,8 @@ SR_PRIV int lecroy_xstream_request_data(const struct sr_dev_inst *sdi)
 	if (ch->type != SR_CHANNEL_ANALOG)
 		return SR_ERR;
 
+	devc->data_started = FALSE;
+
 	g_snprintf(command, sizeof(command), "C%d:WAVEFORM?", ch->index + 1);
 	return sr_scpi_send(sdi->conn, command);
 }
@@ -481,6 +483,10 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 	devc->num_frames = 0;
 	g_slist_free(devc->enabled_channels);
 	devc->enabled_channels = NULL;
+	if (devc->desc) {
+		g_byte_array_free(devc->desc, TRUE);
+		devc->desc = NULL;
+	}
 	scpi = sdi->conn;
 	sr_scpi_source_remove(sdi->session, scpi);
 
@@ -540,75 +540,167 @@ SR_PRIV int lecroy_xstream_init_device(struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static int lecroy_waveform_2_x_to_analog(GByteArray *data,
-		struct lecroy_wavedesc *desc, struct sr_datafeed_analog *analog)
+static void lecroy_waveform_2_x_params(struct dev_context *devc,
+		const struct lecroy_wavedesc *desc)
 {
-	struct sr_analog_encoding *encoding = analog->encoding;
-	struct sr_analog_meaning *meaning = analog->meaning;
-	struct sr_analog_spec *spec = analog->spec;
-	float *data_float;
-	int16_t *waveform_data;
-	unsigned int i, num_samples;
-
-	data_float = g_malloc(desc->version_2_x.wave_array_count * sizeof(float));
-	num_samples = desc->version_2_x.wave_array_count;
-
-	waveform_data = (int16_t*)(data->data +
-		+ desc->version_2_x.wave_descriptor_length
-		+ desc->version_2_x.user_text_len);
-
-	for (i = 0; i < num_samples; i++)
-		data_float[i] = (float)waveform_data[i]
-			* desc->version_2_x.vertical_gain
-			+ desc->version_2_x.vertical_offset;
-
-	analog->data = data_float;
-	analog->num_samples = num_samples;
-
-	encoding->unitsize = sizeof(float);
-	encoding->is_signed = TRUE;
-	encoding->is_float = TRUE;
-	encoding->is_bigendian = FALSE;
-	encoding->scale.p = 1;
-	encoding->scale.q = 1;
-	encoding->offset.p = 0;
-	encoding->offset.q = 1;
-
-	encoding->digits = 6;
-	encoding->is_digits_decimal = FALSE;
+	devc->num_samples = desc->version_2_x.wave_array_count;
+
+	/* The 16-bit samples get passed on as they are. */
+	sr_rational_from_double(&devc->scale, desc->version_2_x.vertical_gain);
+	sr_rational_from_double(&devc->offset, desc->version_2_x.vertical_offset);
 
 	if (strcmp(desc->version_2_x.vertunit, "A")) {
-		meaning->mq = SR_MQ_CURRENT;
-		meaning->unit = SR_UNIT_AMPERE;
+		devc->mq = SR_MQ_CURRENT;
+		devc->unit = SR_UNIT_AMPERE;
 	} else {
 		/* Default to voltage. */
-		meaning->mq = SR_MQ_VOLTAGE;
-		meaning->unit = SR_UNIT_VOLT;
+		devc->mq = SR_MQ_VOLTAGE;
+		devc->unit = SR_UNIT_VOLT;
+	}
+}
+
+/*
+ * Check the waveform descriptor collected so far. Gets the number of
+ * bytes still missing from it and the user text, 0 once complete.
+ */
+static int lecroy_waveform_desc_missing(struct dev_context *devc,
+		size_t *missing)
+{
+	const struct lecroy_wavedesc *desc;
+	size_t total;
+
+	if (devc->desc->len < sizeof(struct lecroy_wavedesc)) {
+		*missing = sizeof(struct lecroy_wavedesc) - devc->desc->len;
+		return SR_OK;
 	}
 
-	meaning->mqflags = 0;
-	spec->spec_digits = 3;
+	desc = (const struct lecroy_wavedesc *)devc->desc->data;
+
+	if (strncmp(desc->template_name, "LECROY_2_2", 16) &&
+	    strncmp(desc->template_name, "LECROY_2_3", 16)) {
+		sr_err("Waveformat template '%.16s' not supported.",
+			desc->template_name);
+		return SR_ERR;
+	}
+
+	total = (size_t)desc->version_2_x.wave_descriptor_length
+		+ desc->version_2_x.user_text_len;
+	total = MAX(total, sizeof(struct lecroy_wavedesc));
+	*missing = total - MIN(total, devc->desc->len);
+	if (!*missing)
+		lecroy_waveform_2_x_params(devc, desc);
 
 	return SR_OK;
 }
 
-static int lecroy_waveform_to_analog(GByteArray *data,
-		struct sr_datafeed_analog *analog)
+static void lecroy_samples_send(struct sr_dev_inst *sdi,
+		const uint8_t *data, size_t num_samples)
 {
-	struct lecroy_wavedesc *desc;
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
 
-	if (data->len < sizeof(struct lecroy_wavedesc))
-		return SR_ERR;
+	devc = sdi->priv;
+
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 6);
+	analog.data = (void *)data;
+	analog.num_samples = num_samples;
+
+	encoding.unitsize = sizeof(int16_t);
+	encoding.is_signed = TRUE;
+	encoding.is_float = FALSE;
+	encoding.is_bigendian = FALSE;
+	encoding.scale = devc->scale;
+	encoding.offset = devc->offset;
+	encoding.is_digits_decimal = FALSE;
+
+	meaning.mq = devc->mq;
+	meaning.unit = devc->unit;
+	meaning.mqflags = 0;
+	meaning.channels = g_slist_append(NULL, devc->current_channel->data);
+	spec.spec_digits = 3;
+
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	sr_session_send(sdi, &packet);
 
-	desc = (struct lecroy_wavedesc*)data->data;
+	g_slist_free(meaning.channels);
+}
 
-	if (!strncmp(desc->template_name, "LECROY_2_2", 16) ||
-	    !strncmp(desc->template_name, "LECROY_2_3", 16)) {
-		return lecroy_waveform_2_x_to_analog(data, desc, analog);
+/*
+ * Take the block header and the waveform descriptor off the start of
+ * the response, then pass on the samples as they arrive. A partial
+ * sample stays in the receive buffer for the next read.
+ */
+static int lecroy_stream_data(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	uint8_t *p;
+	size_t avail, n, missing;
+	int digits;
+
+	devc = sdi->priv;
+	p = devc->rx_buf;
+	avail = devc->rx_len;
+
+	while (avail && !devc->header_done) {
+		devc->block_header[devc->block_header_len++] = *p++;
+		avail--;
+		if (devc->block_header[0] != '#')
+			return SR_ERR;
+		if (devc->block_header_len < 2)
+			continue;
+		digits = devc->block_header[1] - '0';
+		if (digits < 1 || digits > 9)
+			return SR_ERR;
+		if (devc->block_header_len == (size_t)(2 + digits))
+			devc->header_done = TRUE;
 	}
 
-	sr_err("Waveformat template '%.16s' not supported.", desc->template_name);
-	return SR_ERR;
+	while (avail && devc->header_done && !devc->desc_done) {
+		if (lecroy_waveform_desc_missing(devc, &missing) != SR_OK)
+			return SR_ERR;
+		n = MIN(avail, missing);
+		g_byte_array_append(devc->desc, p, n);
+		p += n;
+		avail -= n;
+		if (lecroy_waveform_desc_missing(devc, &missing) != SR_OK)
+			return SR_ERR;
+		if (!missing) {
+			devc->desc_done = TRUE;
+			devc->samples_left = devc->num_samples;
+		}
+	}
+
+	if (devc->desc_done && devc->samples_left &&
+			avail >= sizeof(int16_t)) {
+		n = MIN(avail / sizeof(int16_t), devc->samples_left);
+
+		/*
+		 * Send "frame begin" packet upon reception of data for the
+		 * first enabled channel.
+		 */
+		if (devc->samples_left == devc->num_samples &&
+				devc->current_channel == devc->enabled_channels)
+			std_session_send_df_frame_begin(sdi);
+
+		lecroy_samples_send(sdi, p, n);
+		p += n * sizeof(int16_t);
+		avail -= n * sizeof(int16_t);
+		devc->samples_left -= n;
+	}
+
+	/* Drop what follows the samples. */
+	if (devc->desc_done && !devc->samples_left)
+		avail = 0;
+
+	memmove(devc->rx_buf, p, avail);
+	devc->rx_len = avail;
+
+	return SR_OK;
 }
 
 SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
@@ -618,12 +710,7 @@ SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct scope_state *state;
-	struct sr_datafeed_packet packet;
-	GByteArray *data;
-	struct sr_datafeed_analog analog;
-	struct sr_analog_encoding encoding;
-	struct sr_analog_meaning meaning;
-	struct sr_analog_spec spec;
+	int len;
 
 	(void)fd;
 	(void)revents;
@@ -640,57 +727,56 @@ SR_PRIV int lecroy_xstream_receive_data(int fd, int revents, void *cb_data)
 	if (ch->type != SR_CHANNEL_ANALOG)
 		return SR_ERR;
 
-	data = NULL;
-	if (sr_scpi_get_block(sdi->conn, NULL, &data) != SR_OK) {
-		if (data)
-			g_byte_array_free(data, TRUE);
-		return TRUE;
+	/*
+	 * Deliver the waveform in pieces while it is being received,
+	 * rather than holding the complete record in memory.
+	 */
+	if (!devc->data_started) {
+		if (sr_scpi_read_begin(sdi->conn) != SR_OK)
+			return TRUE;
+		if (!devc->desc)
+			devc->desc = g_byte_array_new();
+		g_byte_array_set_size(devc->desc, 0);
+		devc->data_started = TRUE;
+		devc->header_done = FALSE;
+		devc->block_header_len = 0;
+		devc->desc_done = FALSE;
+		devc->rx_len = 0;
 	}
 
-	analog.encoding = &encoding;
-	analog.meaning = &meaning;
-	analog.spec = &spec;
+	len = sr_scpi_read_data(sdi->conn, (char *)devc->rx_buf + devc->rx_len,
+		sizeof(devc->rx_buf) - devc->rx_len);
+	if (len < 0) {
+		devc->data_started = FALSE;
+		return TRUE;
+	}
+	devc->rx_len += len;
 
-	if (lecroy_waveform_to_analog(data, &analog) != SR_OK)
+	if (lecroy_stream_data(sdi) != SR_OK) {
+		devc->data_started = FALSE;
 		return SR_ERR;
+	}
 
-	if (analog.num_samples == 0) {
-		g_free(analog.data);
-		g_byte_array_free(data, TRUE);
+	if (!sr_scpi_read_complete(sdi->conn))
+		return TRUE;
 
+	devc->data_started = FALSE;
+	if (!devc->desc_done)
+		return SR_ERR;
+
+	if (devc->num_samples == 0) {
 		/* No data available, we have to acquire data first. */
 		g_snprintf(command, sizeof(command), "ARM;WAIT;*OPC;C%d:WAVEFORM?", ch->index + 1);
 		sr_scpi_send(sdi->conn, command);
 
 		state->sample_rate = 0;
 		return TRUE;
-	} else {
-		/* Update sample rate if needed. */
-		if (state->sample_rate == 0)
-			if (lecroy_xstream_update_sample_rate(sdi, analog.num_samples) != SR_OK) {
-				g_free(analog.data);
-				g_byte_array_free(data, TRUE);
-				return SR_ERR;
-			}
 	}
 
-	/*
-	 * Send "frame begin" packet upon reception of data for the
-	 * first enabled channel.
-	 */
-	if (devc->current_channel == devc->enabled_channels)
-		std_session_send_df_frame_begin(sdi);
-
-	meaning.channels = g_slist_append(NULL, ch);
-	packet.payload = &analog;
-	packet.type = SR_DF_ANALOG;
-	sr_session_send(sdi, &packet);
-
-	g_byte_array_free(data, TRUE);
-	data = NULL;
-
-	g_slist_free(meaning.channels);
-	g_free(analog.data);
+	/* Update sample rate if needed, now that the response is complete. */
+	if (state->sample_rate == 0)
+		if (lecroy_xstream_update_sample_rate(sdi, devc->num_samples) != SR_OK)
+			return SR_ERR;
 
 	/*
 	 * Advance to the next enabled channel. When data for all enabled
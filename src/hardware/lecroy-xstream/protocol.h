@@ -31,6 +31,7 @@
 #define MAX_INSTRUMENT_VERSIONS 10
 #define MAX_COMMAND_SIZE 48
 #define MAX_ANALOG_CHANNEL_COUNT 4
+#define RECEIVE_BUFFER_SIZE (64 * 1024)
 
 struct scope_config {
 	const char *name[MAX_INSTRUMENT_VERSIONS];
@@ -88,6 +89,22 @@ struct dev_context {
 	uint64_t num_frames;
 
 	uint64_t frame_limit;
+
+	/* Waveform query response being received. */
+	gboolean data_started;
+	gboolean header_done;
+	char block_header[12];
+	size_t block_header_len;
+	GByteArray *desc;
+	gboolean desc_done;
+	uint32_t num_samples;
+	uint32_t samples_left;
+	struct sr_rational scale;
+	struct sr_rational offset;
+	enum sr_mq mq;
+	enum sr_unit unit;
+	size_t rx_len;
+	uint8_t rx_buf[RECEIVE_BUFFER_SIZE];
 };
 
 SR_PRIV int lecroy_xstream_init_device(struct sr_dev_inst *sdi);
@@ -322,14 +322,23 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	sr_sw_limits_acquisition_start(&devc->limits);
 	std_session_send_df_header(sdi);
 
-	devc->reply_pending = FALSE;
-	devc->req_sent_at = 0;
+	devc->buf[0] = '\0';
+	devc->buflen = 0;
 
 	serial = sdi->conn;
-	serial_source_add(sdi->session, serial, G_IO_IN, 10,
-			hcs_receive_data, (void *)sdi);
+	return sr_serial_poll_add(sdi->session, serial,
+		POLL_INTERVAL_MS * 1000, REQ_TIMEOUT_MS * 1000,
+		&hcs_poll_ops, (void *)sdi);
+}
 
-	return SR_OK;
+static int dev_acquisition_stop(struct sr_dev_inst *sdi)
+{
+	int ret;
+
+	if ((ret = sr_serial_poll_remove(sdi->session, sdi->conn)) < 0)
+		return ret;
+
+	return std_session_send_df_end(sdi);
 }
 
 static struct sr_dev_driver manson_hcs_3xxx_driver_info = {
@@ -347,7 +356,7 @@ static struct sr_dev_driver manson_hcs_3xxx_driver_info = {
 	.dev_open = std_serial_dev_open,
 	.dev_close = std_serial_dev_close,
 	.dev_acquisition_start = dev_acquisition_start,
-	.dev_acquisition_stop = std_serial_dev_acquisition_stop,
+	.dev_acquisition_stop = dev_acquisition_stop,
 	.context = NULL,
 };
 SR_REGISTER_DEV_DRIVER(manson_hcs_3xxx_driver_info);
@@ -21,8 +21,6 @@
 #include <config.h>
 #include "protocol.h"
 
-#define REQ_TIMEOUT_MS 500
-
 SR_PRIV int hcs_send_cmd(struct sr_serial_dev_inst *serial, const char *cmd, ...)
 {
 	int ret;
@@ -172,82 +170,82 @@ static int parse_reply(struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static int handle_new_data(struct sr_dev_inst *sdi)
+static int poll_request(struct sr_serial_dev_inst *serial, void *cb_data)
 {
-	int len;
+	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	struct sr_serial_dev_inst *serial;
+	static const char cmd[] = "GETD\r";
 
+	sdi = cb_data;
 	devc = sdi->priv;
-	serial = sdi->conn;
 
-	len = serial_read_blocking(serial, devc->buf + devc->buflen, 1, 0);
-	if (len < 1)
+	if (sr_sw_limits_check(&devc->limits)) {
+		sr_dev_acquisition_stop(sdi);
 		return SR_ERR;
+	}
+
+	/* Get voltage, current, and mode (CC or CV). */
+	if (serial_write_nonblocking(serial, cmd, strlen(cmd))
+			!= (int)strlen(cmd)) {
+		sr_err("Error sending command.");
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+static gboolean poll_receive(struct sr_serial_dev_inst *serial, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	int len;
+
+	sdi = cb_data;
+	devc = sdi->priv;
+
+	len = serial_read_nonblocking(serial, devc->buf + devc->buflen,
+		sizeof(devc->buf) - 1 - devc->buflen);
+	if (len < 1)
+		return FALSE;
 
 	devc->buflen += len;
 	devc->buf[devc->buflen] = '\0';
 
 	/* Wait until we received an "OK\r" (among other bytes). */
-	if (!g_str_has_suffix(devc->buf, "OK\r"))
-		return SR_OK;
+	if (!g_str_has_suffix(devc->buf, "OK\r")) {
+		if (devc->buflen == sizeof(devc->buf) - 1)
+			devc->buflen = 0;
+		return FALSE;
+	}
 
 	parse_reply(sdi);
 
 	devc->buf[0] = '\0';
 	devc->buflen = 0;
 
-	devc->reply_pending = FALSE;
+	if (sr_sw_limits_check(&devc->limits))
+		sr_dev_acquisition_stop(sdi);
 
-	return SR_OK;
+	return TRUE;
 }
 
-/** Driver/serial data reception function. */
-SR_PRIV int hcs_receive_data(int fd, int revents, void *cb_data)
+static void poll_timeout(struct sr_serial_dev_inst *serial, void *cb_data)
 {
 	struct sr_dev_inst *sdi;
 	struct dev_context *devc;
-	struct sr_serial_dev_inst *serial;
-	uint64_t elapsed_us;
 
-	(void)fd;
-
-	if (!(sdi = cb_data))
-		return TRUE;
-
-	if (!(devc = sdi->priv))
-		return TRUE;
-
-	serial = sdi->conn;
-
-	if (revents == G_IO_IN) {
-		/* New data arrived. */
-		handle_new_data(sdi);
-	} else {
-		/* Timeout. */
-	}
+	(void)serial;
 
-	if (sr_sw_limits_check(&devc->limits)) {
-		sr_dev_acquisition_stop(sdi);
-		return TRUE;
-	}
-
-	/* Request next packet, if required. */
-	if (sdi->status == SR_ST_ACTIVE) {
-		if (devc->reply_pending) {
-			elapsed_us = g_get_monotonic_time() - devc->req_sent_at;
-			if (elapsed_us > (REQ_TIMEOUT_MS * 1000))
-				devc->reply_pending = FALSE;
-			return TRUE;
-		}
-
-		/* Send command to get voltage, current, and mode (CC or CV). */
-		if (hcs_send_cmd(serial, "GETD\r") < 0)
-			return TRUE;
-
-		devc->req_sent_at = g_get_monotonic_time();
-		devc->reply_pending = TRUE;
-	}
+	sdi = cb_data;
+	devc = sdi->priv;
 
-	return TRUE;
+	devc->buf[0] = '\0';
+	devc->buflen = 0;
 }
+
+/** Requests and replies of the acquisition, see sr_serial_poll_add(). */
+SR_PRIV const struct sr_serial_poll_ops hcs_poll_ops = {
+	.request = poll_request,
+	.receive = poll_receive,
+	.timeout = poll_timeout,
+};
@@ -30,6 +30,10 @@
 
 #define LOG_PREFIX "manson-hcs-3xxx"
 
+/* Time between GETD requests, and to wait for their replies. */
+#define POLL_INTERVAL_MS 100
+#define REQ_TIMEOUT_MS 500
+
 enum {
 	MANSON_HCS_3100,
 	MANSON_HCS_3102,
@@ -62,8 +66,6 @@ struct dev_context {
 	const struct hcs_model *model; /**< Model information. */
 
 	struct sr_sw_limits limits;
-	int64_t req_sent_at;
-	gboolean reply_pending;
 
 	float current;		/**< Last current value [A] read from device. */
 	float current_max;	/**< Output current set. */
@@ -82,6 +84,6 @@ struct dev_context {
 SR_PRIV int hcs_parse_volt_curr_mode(struct sr_dev_inst *sdi, char **tokens);
 SR_PRIV int hcs_read_reply(struct sr_serial_dev_inst *serial, int lines, char *buf, int buflen);
 SR_PRIV int hcs_send_cmd(struct sr_serial_dev_inst *serial, const char *cmd, ...);
-SR_PRIV int hcs_receive_data(int fd, int revents, void *cb_data);
+SR_PRIV extern const struct sr_serial_poll_ops hcs_poll_ops;
 
 #endif
@@ -344,16 +344,148 @@ SR_PRIV int ols_set_samplerate(const struct sr_dev_inst *sdi,
 
 SR_PRIV void abort_acquisition(const struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
 	struct sr_serial_dev_inst *serial;
 
+	devc = sdi->priv;
 	serial = sdi->conn;
 	ols_send_reset(serial);
 
 	serial_source_remove(sdi->session, serial);
 
+	g_free(devc->rx_buf);
+	devc->rx_buf = NULL;
+	g_free(devc->raw_sample_buf);
+	devc->raw_sample_buf = NULL;
+
 	std_session_send_df_end(sdi);
 }
 
+/*
+ * Expand one received sample of the enabled channel groups to 32 bits
+ * little endian. Some channel groups may have been turned off, to speed
+ * up transfer between the hardware and the PC. Whatever is listening on
+ * the bus will be expecting a full sample of devc->unitsize bytes, based
+ * on the maximum number of channels.
+ */
+static inline uint32_t ols_expand_sample(const uint8_t *src,
+	const uint8_t *shift, int num_changroups)
+{
+	uint32_t sample;
+	int i;
+
+	sample = 0;
+	for (i = 0; i < num_changroups; i++)
+		sample |= (uint32_t)src[i] << shift[i];
+
+	return sample;
+}
+
+/*
+ * Store count copies of a sample, cropped to unitsize. Only the first
+ * copy is assembled, the rest of the run gets duplicated in blocks of
+ * doubling size.
+ */
+static void ols_fill_samples(uint8_t *dst, uint32_t sample,
+	size_t count, uint16_t unitsize)
+{
+	uint8_t tmp[4];
+	size_t done, chunk;
+
+	if (unitsize == 1) {
+		memset(dst, sample & 0xff, count);
+		return;
+	}
+	WL32(tmp, sample);
+	memcpy(dst, tmp, unitsize);
+	for (done = 1; done < count; done += chunk) {
+		chunk = MIN(done, count - done);
+		memcpy(dst + done * unitsize, dst, chunk * unitsize);
+	}
+}
+
+/*
+ * Convert the whole download in the receive buffer into devc->raw_sample_buf.
+ * The OLS sends its sample buffer backwards, so samples get stored from
+ * the end of the buffer towards its start, which leaves them in the
+ * proper order for the session bus. Here cropping to devc->unitsize
+ * happens.
+ */
+static void ols_decode_samples(struct dev_context *devc)
+{
+	uint8_t shift[4], tmp[4];
+	const uint8_t *src;
+	uint8_t *dst;
+	uint32_t sample, rle_count;
+	size_t num_words, num_samples, run, w;
+	uint16_t unitsize;
+	int num_changroups, i;
+
+	num_changroups = 0;
+	for (i = 0; i < 4; i++) {
+		if (((devc->capture_flags >> 2) & (1 << i)) == 0)
+			shift[num_changroups++] = i * 8;
+	}
+	unitsize = devc->unitsize;
+	num_words = devc->rx_len / num_changroups;
+	src = devc->rx_buf;
+	dst = devc->raw_sample_buf + devc->limit_samples * unitsize;
+
+	if (!(devc->capture_flags & CAPTURE_FLAG_RLE)) {
+		/* One sample per word, a plain reverse of the buffer. */
+		num_samples = MIN(num_words, devc->limit_samples);
+		if (num_changroups == 4 && unitsize == 4) {
+			for (w = 0; w < num_samples; w++)
+				memcpy(dst - (w + 1) * 4, &src[w * 4], 4);
+		} else if (unitsize == 1) {
+			for (w = 0; w < num_samples; w++)
+				*(dst - w - 1) = ols_expand_sample(
+					&src[w * num_changroups], shift, num_changroups);
+		} else {
+			for (w = 0; w < num_samples; w++) {
+				sample = ols_expand_sample(&src[w * num_changroups],
+					shift, num_changroups);
+				WL32(tmp, sample);
+				memcpy(dst - (w + 1) * unitsize, tmp, unitsize);
+			}
+		}
+		devc->num_samples = num_samples;
+		devc->cnt_samples = devc->cnt_samples_rle = num_samples;
+		return;
+	}
+
+	/*
+	 * In RLE mode the high bit of the last received byte is the "count"
+	 * flag, meaning this word is the number of times the next sample
+	 * occurred.
+	 */
+	num_samples = 0;
+	rle_count = 0;
+	devc->cnt_samples = devc->cnt_samples_rle = 0;
+	for (w = 0; w < num_words && num_samples < devc->limit_samples; w++) {
+		src = &devc->rx_buf[w * num_changroups];
+		devc->cnt_samples++;
+		devc->cnt_samples_rle++;
+		if (src[num_changroups - 1] & 0x80) {
+			/* Clear the high bit. */
+			rle_count = 0;
+			for (i = 0; i < num_changroups; i++)
+				rle_count |= (uint32_t)src[i] << (i * 8);
+			rle_count &= ~(0x80U << (num_changroups - 1) * 8);
+			devc->cnt_samples_rle += rle_count;
+			continue;
+		}
+		sample = ols_expand_sample(src, shift, num_changroups);
+		/* Save us from overrunning the buffer. */
+		run = MIN((size_t)rle_count + 1,
+			devc->limit_samples - num_samples);
+		num_samples += run;
+		ols_fill_samples(dst - num_samples * unitsize, sample, run, unitsize);
+		rle_count = 0;
+	}
+	devc->num_samples = num_samples;
+}
+
 SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 {
 	struct dev_context *devc;
@@ -361,10 +493,9 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 	struct sr_serial_dev_inst *serial;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
-	uint32_t sample;
-	int num_changroups, offset, j;
+	size_t num_words;
+	int num_changroups, len;
 	unsigned int i;
-	unsigned char byte;
 
 	(void)fd;
 
@@ -377,6 +508,13 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 		return TRUE;
 	}
 
+	num_changroups = 0;
+	for (i = 0x20; i > 0x02; i >>= 1) {
+		if ((devc->capture_flags & i) == 0) {
+			num_changroups++;
+		}
+	}
+
 	if (devc->num_transfers++ == 0) {
 		devc->raw_sample_buf = g_try_malloc(devc->limit_samples * 4);
 		if (!devc->raw_sample_buf) {
@@ -385,165 +523,90 @@ SR_PRIV int ols_receive_data(int fd, int revents, void *cb_data)
 		}
 		/* fill with 1010... for debugging */
 		memset(devc->raw_sample_buf, 0x82, devc->limit_samples * 4);
-	}
 
-	num_changroups = 0;
-	for (i = 0x20; i > 0x02; i >>= 1) {
-		if ((devc->capture_flags & i) == 0) {
-			num_changroups++;
+		/*
+		 * The device sends whole groups of four samples in RLE
+		 * mode, of which any count can be RLE counts. Without RLE
+		 * the download is complete after limit_samples.
+		 */
+		num_words = devc->limit_samples;
+		if (devc->capture_flags & CAPTURE_FLAG_RLE)
+			num_words = (num_words + 3) & ~3;
+		devc->rx_size = num_words * num_changroups;
+		devc->rx_len = 0;
+		devc->rx_buf = g_try_malloc(devc->rx_size);
+		if (!devc->rx_buf) {
+			sr_err("Receive buffer malloc failed.");
+			return FALSE;
 		}
 	}
 
-	if (revents == G_IO_IN && devc->num_samples < devc->limit_samples) {
-		if (serial_read_nonblocking(serial, &byte, 1) != 1)
+	if (revents == G_IO_IN) {
+		/* Take everything the port has, straight into the buffer. */
+		len = serial_read_nonblocking(serial,
+			devc->rx_buf + devc->rx_len, devc->rx_size - devc->rx_len);
+		if (len < 0)
 			return FALSE;
-		devc->cnt_bytes++;
+		devc->cnt_bytes += len;
+		devc->rx_len += len;
+		sr_spew("Received %d bytes, %zu of %zu.", len,
+			devc->rx_len, devc->rx_size);
 
-		/* Ignore it if we've read enough. */
-		if (devc->num_samples >= devc->limit_samples)
+		/* Wait for the timeout unless the buffer is complete. */
+		if (devc->rx_len < devc->rx_size)
 			return TRUE;
+	}
 
-		devc->sample[devc->num_bytes++] = byte;
-		sr_spew("Received byte 0x%.2x.", byte);
-		if (devc->num_bytes == num_changroups) {
-			devc->cnt_samples++;
-			devc->cnt_samples_rle++;
-			/*
-			 * Got a full sample. Convert from the OLS's little-endian
-			 * sample to the local format.
-			 */
-			sample = devc->sample[0] | (devc->sample[1] << 8) |
-				 (devc->sample[2] << 16) |
-				 (devc->sample[3] << 24);
-			sr_dbg("Received sample 0x%.*x.", devc->num_bytes * 2,
-			       sample);
-			if (devc->capture_flags & CAPTURE_FLAG_RLE) {
-				/*
-				 * In RLE mode the high bit of the sample is the
-				 * "count" flag, meaning this sample is the number
-				 * of times the previous sample occurred.
-				 */
-				if (devc->sample[devc->num_bytes - 1] & 0x80) {
-					/* Clear the high bit. */
-					sample &= ~(0x80 << (devc->num_bytes -
-							     1) * 8);
-					devc->rle_count = sample;
-					devc->cnt_samples_rle +=
-						devc->rle_count;
-					sr_dbg("RLE count: %u.",
-					       devc->rle_count);
-					devc->num_bytes = 0;
-					return TRUE;
-				}
-			}
-			devc->num_samples += devc->rle_count + 1;
-			if (devc->num_samples > devc->limit_samples) {
-				/* Save us from overrunning the buffer. */
-				devc->rle_count -=
-					devc->num_samples - devc->limit_samples;
-				devc->num_samples = devc->limit_samples;
-			}
-
-			if (num_changroups < 4) {
-				/*
-				 * Some channel groups may have been turned
-				 * off, to speed up transfer between the
-				 * hardware and the PC. Expand that here before
-				 * submitting it over the session bus --
-				 * whatever is listening on the bus will be
-				 * expecting a full sample of devc->unitsize bytes,
-				 * based on the maximum number of channels.
-				 * For simplicity we expand the sample to 32 bits
-				 * little endian, and crop below
-				 */
-				j = 0;
-				uint8_t tmp_sample[4] = { 0, 0, 0, 0 };
-				for (i = 0; i < 4; i++) {
-					if (((devc->capture_flags >> 2) &
-					     (1 << i)) == 0) {
-						/*
-						 * This channel group was
-						 * enabled, copy from received
-						 * sample.
-						 */
-						tmp_sample[i] =
-							devc->sample[j++];
-					}
-				}
-				memcpy(devc->sample, tmp_sample, 4);
-				sr_spew("Expanded sample: 0x%.2hhx%.2hhx%.2hhx%.2hhx ",
-					devc->sample[3], devc->sample[2],
-					devc->sample[1], devc->sample[0]);
-			}
-
-			/*
-			 * the OLS sends its sample buffer backwards.
-			 * store it in reverse order here, so we can dump
-			 * this on the session bus later.
-			 * Here cropping to devc->unitsize happens
-			 */
-			offset = (devc->limit_samples - devc->num_samples) * devc->unitsize;
-			for (i = 0; i <= devc->rle_count; i++) {
-				memcpy(devc->raw_sample_buf + offset + (i * devc->unitsize),
-				       devc->sample, devc->unitsize);
-			}
-			memset(devc->sample, 0, 4);
-			devc->num_bytes = 0;
-			devc->rle_count = 0;
-		}
-	} else {
+	/*
+	 * This is the main loop telling us a timeout was reached, or
+	 * we've acquired all the samples we asked for -- we're done.
+	 * Send the (properly-ordered) buffer to the frontend.
+	 */
+	ols_decode_samples(devc);
+	sr_dbg("Received %d bytes, %d samples, %d decompressed samples.",
+	       devc->cnt_bytes, devc->cnt_samples,
+	       devc->cnt_samples_rle);
+	if (devc->trigger_at_smpl != OLS_NO_TRIGGER) {
 		/*
-		 * This is the main loop telling us a timeout was reached, or
-		 * we've acquired all the samples we asked for -- we're done.
-		 * Send the (properly-ordered) buffer to the frontend.
+		 * A trigger was set up, so we need to tell the frontend
+		 * about it.
 		 */
-		sr_dbg("Received %d bytes, %d samples, %d decompressed samples.",
-		       devc->cnt_bytes, devc->cnt_samples,
-		       devc->cnt_samples_rle);
-		if (devc->trigger_at_smpl != OLS_NO_TRIGGER) {
-			/*
-			 * A trigger was set up, so we need to tell the frontend
-			 * about it.
-			 */
-			if (devc->trigger_at_smpl > 0) {
-				/* There are pre-trigger samples, send those first. */
-				packet.type = SR_DF_LOGIC;
-				packet.payload = &logic;
-				logic.length = devc->trigger_at_smpl * devc->unitsize;
-				logic.unitsize = devc->unitsize;
-				logic.data = devc->raw_sample_buf +
-					     (devc->limit_samples -
-					      devc->num_samples) *
-						     devc->unitsize;
-				sr_session_send(sdi, &packet);
-			}
-
-			/* Send the trigger. */
-			std_session_send_df_trigger(sdi);
+		if (devc->trigger_at_smpl > 0) {
+			/* There are pre-trigger samples, send those first. */
+			packet.type = SR_DF_LOGIC;
+			packet.payload = &logic;
+			logic.length = devc->trigger_at_smpl * devc->unitsize;
+			logic.unitsize = devc->unitsize;
+			logic.data = devc->raw_sample_buf +
+				     (devc->limit_samples -
+				      devc->num_samples) *
+					     devc->unitsize;
+			sr_session_send(sdi, &packet);
 		}
 
-		/* Send post-trigger / all captured samples. */
-		int num_pre_trigger_samples = devc->trigger_at_smpl ==
-							      OLS_NO_TRIGGER ?
-							    0 :
-							    devc->trigger_at_smpl;
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.length =
-			(devc->num_samples - num_pre_trigger_samples) * devc->unitsize;
-		logic.unitsize = devc->unitsize;
-		logic.data = devc->raw_sample_buf +
-			     (num_pre_trigger_samples + devc->limit_samples -
-			      devc->num_samples) *
-				     devc->unitsize;
-		sr_session_send(sdi, &packet);
-
-		g_free(devc->raw_sample_buf);
-
-		serial_flush(serial);
-		abort_acquisition(sdi);
+		/* Send the trigger. */
+		std_session_send_df_trigger(sdi);
 	}
 
+	/* Send post-trigger / all captured samples. */
+	int num_pre_trigger_samples = devc->trigger_at_smpl ==
+						      OLS_NO_TRIGGER ?
+						    0 :
+						    devc->trigger_at_smpl;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.length =
+		(devc->num_samples - num_pre_trigger_samples) * devc->unitsize;
+	logic.unitsize = devc->unitsize;
+	logic.data = devc->raw_sample_buf +
+		     (num_pre_trigger_samples + devc->limit_samples -
+		      devc->num_samples) *
+			     devc->unitsize;
+	sr_session_send(sdi, &packet);
+
+	serial_flush(serial);
+	abort_acquisition(sdi);
+
 	return TRUE;
 }
 
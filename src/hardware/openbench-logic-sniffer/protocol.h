@@ -118,13 +118,14 @@ struct dev_context {
 
 	unsigned int num_transfers;
 	unsigned int num_samples;
-	int num_bytes;
 	int cnt_bytes;
 	int cnt_samples;
 	int cnt_samples_rle;
 
-	unsigned int rle_count;
-	unsigned char sample[4];
+	/* The download as received, decoded once it is complete. */
+	uint8_t *rx_buf;
+	size_t rx_len;
+	size_t rx_size;
 	unsigned char *raw_sample_buf;
 
 	uint16_t unitsize;
@@ -159,11 +159,16 @@ SR_PRIV void pols_channel_mask(const struct sr_dev_inst *sdi)
 
 SR_PRIV int pols_convert_trigger(const struct sr_dev_inst *sdi)
 {
+	static const struct hw_trigger_caps caps = {
+		.num_stages = NUM_TRIGGER_STAGES,
+		.num_channels = NUM_CHANNELS,
+		.matches = HW_TRIGGER_MATCH(SR_TRIGGER_ZERO) |
+			HW_TRIGGER_MATCH(SR_TRIGGER_ONE) |
+			HW_TRIGGER_MATCH(SR_TRIGGER_RISING) |
+			HW_TRIGGER_MATCH(SR_TRIGGER_FALLING),
+	};
 	struct dev_context *devc;
-	struct sr_trigger *trigger;
-	struct sr_trigger_stage *stage;
-	struct sr_trigger_match *match;
-	const GSList *l, *m;
+	struct hw_trigger *hwt;
 	int i;
 
 	devc = sdi->priv;
@@ -175,30 +180,24 @@ SR_PRIV int pols_convert_trigger(const struct sr_dev_inst *sdi)
 		devc->trigger_edge[i] = 0;
 	}
 
-	if (!(trigger = sr_session_trigger_get(sdi->session)))
+	hw_trigger_compile(sr_session_trigger_get(sdi->session), &caps, &hwt);
+	if (!hwt)
 		return SR_OK;
 
-	devc->num_stages = g_slist_length(trigger->stages);
-	if (devc->num_stages > NUM_TRIGGER_STAGES) {
-		sr_err("This device only supports %d trigger stages.",
-				NUM_TRIGGER_STAGES);
+	if (!hwt->complete) {
+		sr_err("This device only supports %d trigger stages, "
+				"on levels and edges.", NUM_TRIGGER_STAGES);
+		hw_trigger_free(hwt);
 		return SR_ERR;
 	}
 
-	for (l = trigger->stages; l; l = l->next) {
-		stage = l->data;
-		for (m = stage->matches; m; m = m->next) {
-			match = m->data;
-			if (!match->channel->enabled)
-				/* Ignore disabled channels with a trigger. */
-				continue;
-			devc->trigger_mask[stage->stage] |= 1 << match->channel->index;
-			if (match->match == SR_TRIGGER_ONE || match->match == SR_TRIGGER_RISING)
-				devc->trigger_value[stage->stage] |= 1 << match->channel->index;
-			if (match->match == SR_TRIGGER_RISING || match->match == SR_TRIGGER_FALLING)
-				devc->trigger_edge[stage->stage] |= 1 << match->channel->index;
-		}
+	devc->num_stages = hwt->num_stages;
+	for (i = 0; i < hwt->num_stages; i++) {
+		devc->trigger_mask[i] = hwt->stages[i].mask;
+		devc->trigger_value[i] = hwt->stages[i].value;
+		devc->trigger_edge[i] = hwt->stages[i].edge;
 	}
+	hw_trigger_free(hwt);
 
 	return SR_OK;
 }
@@ -367,6 +366,40 @@ SR_PRIV int p_ols_set_samplerate(const struct sr_dev_inst *sdi,
 	return SR_OK;
 }
 
+/*
+ * Convert count samples that arrived without RLE, each of num_channels
+ * bytes. Disabled channel groups get expanded to a full 32-bit sample,
+ * and the samples are stored backwards from the current end of the
+ * sample buffer, like the byte by byte path below does.
+ */
+static void p_ols_reverse_samples(struct dev_context *devc,
+	const uint8_t *src, size_t count, int num_channels)
+{
+	uint8_t shift[4], *dst;
+	uint32_t sample;
+	size_t w;
+	int i, j;
+
+	j = 0;
+	for (i = 0; i < 4; i++) {
+		if (((devc->flag_reg >> 2) & (1 << i)) == 0)
+			shift[j++] = i * 8;
+	}
+
+	dst = devc->raw_sample_buf + (devc->limit_samples - devc->num_samples) * 4;
+	if (num_channels == 4) {
+		for (w = 0; w < count; w++)
+			memcpy(dst - (w + 1) * 4, &src[w * 4], 4);
+		return;
+	}
+	for (w = 0; w < count; w++) {
+		sample = 0;
+		for (i = 0; i < num_channels; i++)
+			sample |= (uint32_t)src[w * num_channels + i] << shift[i];
+		WL32(dst - (w + 1) * 4, sample);
+	}
+}
+
 SR_PRIV int p_ols_receive_data(int fd, int revents, void *cb_data)
 {
 	struct dev_context *devc;
@@ -376,6 +409,7 @@ SR_PRIV int p_ols_receive_data(int fd, int revents, void *cb_data)
 	uint32_t sample;
 	int num_channels, offset, j;
 	int bytes_read, index;
+	size_t count;
 	unsigned int i;
 	unsigned char byte;
 
@@ -420,6 +454,24 @@ SR_PRIV int p_ols_receive_data(int fd, int revents, void *cb_data)
 		sr_dbg("Received %d bytes", bytes_read);
 
 		index = 0;
+		if (!(devc->flag_reg & FLAG_RLE) && devc->num_bytes == 0) {
+			/*
+			 * Without RLE every word is one sample, so convert
+			 * all complete words of the block in one pass. The
+			 * loop below only handles a partial word at the end.
+			 */
+			count = MIN((size_t)bytes_read / num_channels,
+				devc->limit_samples - devc->num_samples);
+			p_ols_reverse_samples(devc, devc->ftdi_buf, count,
+				num_channels);
+			index = count * num_channels;
+			devc->cnt_bytes += index;
+			devc->cnt_samples += count;
+			devc->cnt_samples_rle += count;
+			devc->num_samples += count;
+			if (devc->num_samples >= devc->limit_samples)
+				index = bytes_read;
+		}
 		while (index < bytes_read) {
 			byte = devc->ftdi_buf[index++];
 			devc->cnt_bytes++;
@@ -786,6 +786,10 @@ static int dev_acquisition_stop(struct sr_dev_inst *sdi)
 
 	sr_dbg("At dev_acquisition_stop");
 
+	/* Samples may still be held in the data buffers on a user stop */
+	if (devc->rxstate == RX_ACTIVE)
+		flush_group(sdi, devc);
+
 	std_session_send_df_end(sdi);
 
 	/* If we reached this while still active it is likely because the stop
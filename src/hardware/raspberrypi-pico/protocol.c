@@ -119,102 +119,129 @@ SR_PRIV int send_serial_w_ack(struct sr_serial_dev_inst *serial, char *str)
 	}
 }
 
+/* Decoding of one byte of the D4 stream, see d4_codes_init() */
+enum d4_kind {
+	D4_RLE = 0,	/* Repeat the previous value rle times */
+	D4_SAMPLE,	/* Repeat the previous value rle times, then take val */
+	D4_STOP,	/* '$', start of the final byte cnt */
+	D4_ABORT,	/* Anything else is a frame error */
+};
+
+struct d4_code {
+	uint16_t rle;
+	uint8_t val;
+	uint8_t kind;
+};
+
+static struct d4_code d4_codes[256];
+static gboolean d4_codes_valid;
+
+/* Each byte is 4 channels of data and a 3 bit rle value (0x80-0xFF), or a
+ * larger rle value that is a multiple of 8 (48-127), or a control signal. */
+static void d4_codes_init(void)
+{
+	unsigned int i;
+
+	if (d4_codes_valid)
+		return;
+
+	for (i = 0; i < 256; i++) {
+		if (i >= 0x80) {
+			d4_codes[i].kind = D4_SAMPLE;
+			d4_codes[i].rle = (i & 0x70) >> 4;
+			d4_codes[i].val = i & 0xF;
+		} else if (i >= 48) {
+			d4_codes[i].kind = D4_RLE;
+			d4_codes[i].rle = (i - 47) * 8;
+		} else {
+			d4_codes[i].kind = (i == '$') ? D4_STOP : D4_ABORT;
+		}
+	}
+	d4_codes_valid = TRUE;
+}
+
+/* Duplicate the previous value num_slices times. Unlike rle_memset() this
+ * accepts any count, and forwards the data buffer to process_group whenever
+ * it fills up, so that sends are always as large as the buffer allows. */
+static void d4_expand(struct sr_dev_inst *sdi, struct dev_context *d,
+	uint32_t num_slices)
+{
+	uint32_t room, chunk;
+
+	while (num_slices) {
+		room = d->sample_buf_size - d->cbuf_wrptr;
+		if (!room) {
+			sr_spew("D4 buffer full wrptr %d", d->cbuf_wrptr);
+			process_group(sdi, d, d->cbuf_wrptr);
+			continue;
+		}
+		chunk = MIN(num_slices, room);
+		rle_memset(d, chunk);
+		num_slices -= chunk;
+	}
+}
+
 /* Process incoming data stream assuming it is optimized packing of 4 channels
  * or less.
- * Each byte is 4 channels of data and a 3 bit rle value, or a larger rle value,
- * or a control signal. This also checks for aborts and ends.
- * If an end is seen we stop processing but do not check the byte_cnt
- * The output is a set of samples fed to process group to perform sw triggering
- * and sending of data to the session as well as maintenance of the serial rx
- * byte cnt.
- * Since we can get huge rle values we chop them up for processing into smaller
- * groups.
+ * The whole serial buffer is decoded through the d4_codes table. A sample
+ * byte is handled as a run of one of its new value, which is only written
+ * out once the following sample byte ends the run. This also checks for
+ * aborts and ends. If an end is seen we stop processing but do not check
+ * the byte_cnt.
+ * Samples are left in the data buffer, which is only forwarded to
+ * process_group when it is full. The receive callback flushes the rest once
+ * no more data is pending, see flush_group().
  * In this mode we can always consume all bytes because there are no cases where
  * the processing of one byte requires the one after it. */
 void process_D4(struct sr_dev_inst *sdi, struct dev_context *d)
 {
-	uint32_t j;
-	uint8_t cbyte, cval;
-	uint32_t rlecnt = 0;
-
-	while (d->ser_rdptr < d->bytes_avail) {
-		cbyte = d->buffer[(d->ser_rdptr)];
-
-		/*RLE only byte */
-		if ((cbyte >= 48) && (cbyte <= 127)) {
-			rlecnt += (cbyte - 47) * 8;
-			d->byte_cnt++;
-		} else if (cbyte >= 0x80) {	/* sample with possible rle */
-			rlecnt += (cbyte & 0x70) >> 4;
-			if (rlecnt) {
-				/* On a value change, duplicate the previous values first. */
-				rle_memset(d, rlecnt);
-				rlecnt = 0;
-			}
-			/* Finally add in the new values */
-			cval = cbyte & 0xF;
-			uint32_t didx = (d->cbuf_wrptr) * (d->dig_sample_bytes);
-			d->d_data_buf[didx] = cval;
-
-			/* Pad in all other bytes since the sessions even wants disabled
-			 * channels reported */
-			for (j = 1; j < d->dig_sample_bytes; j++)
-				d->d_data_buf[didx+j] = 0;
-
-			d->byte_cnt++;
-			sr_spew("Dchan4 rdptr %d wrptr %d bytein 0x%X rle %d cval 0x%X didx %d",
-				(d->ser_rdptr) - 1, d->cbuf_wrptr, cbyte, rlecnt, cval, didx);
-			d->cbuf_wrptr++;
-			rlecnt = 0;
-			d->d_last[0] = cval;
+	const struct d4_code *code;
+	uint32_t rdptr, rlecnt;
+
+	d4_codes_init();
+
+	rdptr = d->ser_rdptr;
+	rlecnt = 0;
+	while (rdptr < d->bytes_avail) {
+		code = &d4_codes[d->buffer[rdptr]];
+		if (code->kind == D4_RLE) {
+			rlecnt += code->rle;
+		} else if (code->kind == D4_SAMPLE) {
+			/* On a value change, duplicate the previous values first. */
+			d4_expand(sdi, d, rlecnt + code->rle);
+			/* Only the low byte carries data, pad in all other bytes
+			 * since the session even wants disabled channels reported */
+			d->d_last[0] = code->val;
+			d->d_last[1] = d->d_last[2] = d->d_last[3] = 0;
+			rlecnt = 1;
 		} else {
 			/* Any other character ends parsing - it could be a frame error or a
 			 * start of the final byte cnt */
-			if (cbyte == '$') {
+			if (code->kind == D4_STOP) {
 				sr_info("D4 Data stream stops with cbyte %d char %c rdidx %d cnt %lu",
-					cbyte, cbyte, d->ser_rdptr, d->byte_cnt);
+					d->buffer[rdptr], d->buffer[rdptr], rdptr,
+					d->byte_cnt + rdptr - d->ser_rdptr);
 				d->rxstate = RX_STOPPED;
 			} else {
 				sr_err("D4 Data stream aborts with cbyte %d char %c rdidx %d cnt %lu",
-					cbyte, cbyte, d->ser_rdptr, d->byte_cnt);
+					d->buffer[rdptr], d->buffer[rdptr], rdptr,
+					d->byte_cnt + rdptr - d->ser_rdptr);
 				d->rxstate = RX_ABORT;
 			}
 			break;	/* break from while loop */
 		}
-
-		(d->ser_rdptr)++;
-		/* To ensure we don't overflow the sample buffer, but still send it
-		 * large chunks of data (to make the packet sends to the session
-		 * efficient) only call process group after a large number of samples
-		 * have been seen. cbuf_wrptr counts slices, so shift right by 2 to
-		 * create a worst case x4 multiple ratio of cbuf_wrptr value to the
-		 * depth of the sample buffer.
-		 * Likely we could use the max rle value of 640 but 1024 gives some
-		 * extra room. Also do a simple check of rlecnt>2000 since that is a
-		 * reasonable minimal value to send to the session */
-		if ((rlecnt >= 2000) || \
-			((rlecnt + ((d->cbuf_wrptr) <<2 ))) > (d->sample_buf_size - 1024)) {
-			sr_spew("D4 preoverflow wrptr %d bufsize %d rlecnt %d\n\r",
-				d->cbuf_wrptr, d->sample_buf_size, rlecnt);
-			rle_memset(d, rlecnt);
-			process_group(sdi, d, d->cbuf_wrptr);
-			rlecnt = 0;
-		}
-
+		rdptr++;
 	} /*while rdptr < wrptr*/
 
-	sr_spew("D4 while done rdptr %d", d->ser_rdptr);
+	/* Every consumed byte was an RLE or a sample */
+	d->byte_cnt += rdptr - d->ser_rdptr;
+	d->ser_rdptr = rdptr;
 
-	/* If we reach the end of the serial input stream send any remaining values
-	 * or rles to the session */
-	if (rlecnt) {
-		sr_spew("Residual D4 slice rlecnt %d", rlecnt);
-		rle_memset(d, rlecnt);
-	}
-	if (d->cbuf_wrptr) {
-		sr_spew("Residual D4 data wrptr %d", d->cbuf_wrptr);
-		process_group(sdi, d, d->cbuf_wrptr);
-	}
+	/* The run of the last value is not carried over to the next serial
+	 * buffer, so write it out now */
+	d4_expand(sdi, d, rlecnt);
+
+	sr_spew("D4 while done rdptr %d wrptr %d", d->ser_rdptr, d->cbuf_wrptr);
 }
 
 /* Process incoming data stream and forward to trigger processing with
@@ -266,7 +293,7 @@ void process_slice(struct sr_dev_inst *sdi, struct dev_context *devc)
 		else
 			rlecnt = (devc->buffer[devc->ser_rdptr] - 78) * 32;
 
-		sr_info("RLEcnt of %d in %d", rlecnt, devc->buffer[devc->ser_rdptr]);
+		sr_spew("RLEcnt of %d in %d", rlecnt, devc->buffer[devc->ser_rdptr]);
 		if ((rlecnt < 1) || (rlecnt > 1568))
 			sr_err("Bad rlecnt val %d in %d",
 				rlecnt, devc->buffer[devc->ser_rdptr]);
@@ -336,10 +363,6 @@ void process_slice(struct sr_dev_inst *sdi, struct dev_context *devc)
 
            }
 	}/* While another slice or RLE available */
-	if (devc->cbuf_wrptr){
-		process_group(sdi, devc, devc->cbuf_wrptr);
-	}
-
 }
 
 /* Send the processed analog values to the session */
@@ -646,21 +669,45 @@ int process_group(struct sr_dev_inst *sdi, struct dev_context *devc,
  * the full value of the rle */
 void rle_memset(struct dev_context *devc, uint32_t num_slices)
 {
-	uint32_t j, k, didx;
+	uint32_t dsb, done, chunk;
+	uint8_t *dst;
+
+	if (!num_slices)
+		return;
 	sr_spew("rle_memset vals 0x%X, 0x%X, 0x%X slices %d dsb %d",
 		devc->d_last[0], devc->d_last[1], devc->d_last[2],
 		num_slices, devc->dig_sample_bytes);
 
 	/* Even if a channel is disabled, PV expects the same location and size for
 	 * the enabled channels as if the channel were enabled. */
-	for (j = 0; j < num_slices; j++) {
-		didx = devc->cbuf_wrptr * devc->dig_sample_bytes;
-		for (k = 0; k < devc->dig_sample_bytes; k++)
-			devc->d_data_buf[didx + k] =  devc->d_last[k];
-		/* cbuf_wrptr always counts slices/samples (and not the bytes in the
-		 * buffer) regardless of mode */
-		devc->cbuf_wrptr++;
+	dsb = devc->dig_sample_bytes;
+	dst = devc->d_data_buf + devc->cbuf_wrptr * dsb;
+	if (dsb == 1) {
+		memset(dst, devc->d_last[0], num_slices);
+	} else {
+		/* Write one slice, then keep doubling what is already written */
+		memcpy(dst, devc->d_last, dsb);
+		for (done = 1; done < num_slices; done += chunk) {
+			chunk = MIN(done, num_slices - done);
+			memcpy(dst + done * dsb, dst, chunk * dsb);
+		}
 	}
+	/* cbuf_wrptr always counts slices/samples (and not the bytes in the
+	 * buffer) regardless of mode */
+	devc->cbuf_wrptr += num_slices;
+}
+
+/* Forward samples that are still held in the data buffers to the session.
+ * The process functions only send when the buffers fill up, so this is
+ * called once no more data is pending on the serial port, the run is over,
+ * or the buffered samples reach the sample limit. */
+SR_PRIV void flush_group(struct sr_dev_inst *sdi, struct dev_context *devc)
+{
+	if (!devc->cbuf_wrptr)
+		return;
+
+	sr_spew("Flush data wrptr %d", devc->cbuf_wrptr);
+	process_group(sdi, devc, devc->cbuf_wrptr);
 }
 
 /* This callback function is mapped from api.c with serial_source_add and is
@@ -719,6 +766,9 @@ SR_PRIV int raspberrypi_pico_receive(int fd, int revents, void *cb_data)
 			len, devc->bytes_avail, devc->sent_samples, devc->wrptr);
 	} else {
 		if (len == 0) {
+			/* The link is idle, don't hold back buffered samples */
+			if (devc->rxstate == RX_ACTIVE)
+				flush_group(sdi, devc);
 			return TRUE;
 		} else {
 			sr_err("ERROR: Negative serial read code %d", len);
@@ -735,6 +785,18 @@ SR_PRIV int raspberrypi_pico_receive(int fd, int revents, void *cb_data)
 			process_D4(sdi, devc);
 		else
 			process_slice(sdi, devc);
+
+		/* The data buffers are only forwarded when full, so that the
+		 * session gets large packets at full USB throughput. A read that
+		 * did not fill the serial buffer means no more data is pending,
+		 * so send what we have instead of waiting for the next transfer.
+		 * Also send once the sample limit is in the buffers so that the
+		 * device gets stopped below. */
+		if ((devc->rxstate != RX_ACTIVE) \
+			|| ((uint32_t)len < bytes_rem - 1) \
+			|| (devc->trigger_fired && devc->limit_samples \
+			&& (devc->sent_samples + devc->cbuf_wrptr >= devc->limit_samples)))
+			flush_group(sdi, devc);
 	}
 
 	/* process_slice/process_D4 increment ser_rdptr as bytes of the serial
@@ -156,6 +156,7 @@ int send_analog_ring(struct sr_dev_inst *sdi, struct dev_context *devc,
 int process_group(struct sr_dev_inst *sdi, struct dev_context *devc,
 	uint32_t num_slices);
 void rle_memset(struct dev_context *devc, uint32_t num_slices);
+SR_PRIV void flush_group(struct sr_dev_inst *sdi, struct dev_context *devc);
 SR_PRIV int check_marker(struct dev_context *d, int *len);
 
 
@@ -309,6 +309,8 @@ static int dev_open(struct sr_dev_inst *sdi)
 	if (sr_modbus_open(modbus) < 0)
 		return SR_ERR;
 
+	rdtech_dps_plan_reads(sdi->priv);
+
 	memset(&state, 0, sizeof(state));
 	state.lock = TRUE;
 	state.mask |= STATE_LOCK;
@@ -321,6 +323,7 @@ static int dev_open(struct sr_dev_inst *sdi)
 
 static int dev_close(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
 	struct sr_modbus_dev_inst *modbus;
 	struct rdtech_dps_state state;
 
@@ -333,6 +336,12 @@ static int dev_close(struct sr_dev_inst *sdi)
 	state.mask |= STATE_LOCK;
 	(void)rdtech_dps_set_state(sdi, &state);
 
+	devc = sdi->priv;
+	sr_modbus_regmap_free(devc->regs_meas);
+	sr_modbus_regmap_free(devc->regs_all);
+	devc->regs_meas = NULL;
+	devc->regs_all = NULL;
+
 	return sr_modbus_close(modbus);
 }
 
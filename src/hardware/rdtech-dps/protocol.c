@@ -127,6 +127,23 @@ static int rdtech_dps_read_holding_registers(struct sr_modbus_dev_inst *modbus,
 	return ret;
 }
 
+/* Retries failed reads of a register plan, like the above. */
+static int rdtech_dps_read_regmap(struct sr_modbus_dev_inst *modbus,
+	struct sr_modbus_regmap *map)
+{
+	size_t retries;
+	int ret;
+
+	retries = 3;
+	while (retries--) {
+		ret = sr_modbus_regmap_read(modbus, map);
+		if (ret == SR_OK)
+			return ret;
+	}
+
+	return ret;
+}
+
 /* Set one 16bit register. LE format for DPS devices. */
 static int rdtech_dps_set_reg(const struct sr_dev_inst *sdi,
 	uint16_t address, uint16_t value)
@@ -295,15 +312,50 @@ static int send_value(const struct sr_dev_inst *sdi,
 	return ret;
 }
 
+/*
+ * Plan the register reads of rdtech_dps_get_state().
+ *
+ * The protection thresholds are far from the other registers, reading
+ * them takes a request of its own. Only read them for the configuration,
+ * so that every acquisition poll is a single request.
+ */
+SR_PRIV void rdtech_dps_plan_reads(struct dev_context *devc)
+{
+	struct sr_modbus_regmap *meas, *all;
+	int count;
+
+	meas = sr_modbus_regmap_new(RDTECH_DPS_REG_GAP);
+	all = sr_modbus_regmap_new(RDTECH_DPS_REG_GAP);
+	switch (devc->model->model_type) {
+	case MODEL_DPS:
+		count = REG_DPS_ENABLE - REG_DPS_USET + 1;
+		sr_modbus_regmap_add(meas, REG_DPS_USET, count);
+		sr_modbus_regmap_add(all, REG_DPS_USET, count);
+		sr_modbus_regmap_add(all, PRE_DPS_OVPSET, 2);
+		break;
+	case MODEL_RD:
+		count = devc->model->n_ranges > 1
+			? REG_RD_RANGE - REG_RD_VOLT_TGT + 1
+			: REG_RD_ENABLE - REG_RD_VOLT_TGT + 1;
+		sr_modbus_regmap_add(meas, REG_RD_VOLT_TGT, count);
+		sr_modbus_regmap_add(all, REG_RD_VOLT_TGT, count);
+		sr_modbus_regmap_add(all, REG_RD_OVP_THR, 2);
+		break;
+	default:
+		break;
+	}
+
+	sr_modbus_regmap_free(devc->regs_meas);
+	sr_modbus_regmap_free(devc->regs_all);
+	devc->regs_meas = meas;
+	devc->regs_all = all;
+}
+
 /*
  * Get the device's current state. Exhaustively, relentlessly.
  * Concentrate all details of communication in the physical transport,
  * register layout interpretation, and potential model dependency in
  * this central spot, to simplify maintenance.
- *
- * TODO Optionally limit the transfer volume depending on caller's spec
- * which detail level is desired? Is 10 registers each 16bits an issue
- * when the UART bitrate is only 9600bps?
  */
 SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 	struct rdtech_dps_state *state, enum rdtech_dps_state_context reason)
@@ -311,7 +363,7 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 	struct dev_context *devc;
 	struct sr_modbus_dev_inst *modbus;
 	gboolean get_config, get_init_state, get_curr_meas;
-	uint16_t registers[14];
+	struct sr_modbus_regmap *map;
 	int ret;
 	const uint8_t *rdptr;
 	uint16_t uset_raw, iset_raw, uout_raw, iout_raw, power_raw;
@@ -352,15 +404,20 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 		/* EMPTY */
 		break;
 	}
-	/*
-	 * TODO Make use of this information to reduce the transfer
-	 * volume, especially on low bitrate serial connections. Though
-	 * the device firmware's samplerate is probably more limiting
-	 * than communication bandwidth is.
-	 */
-	(void)get_config;
+	/* Only the configuration needs the protection thresholds. */
 	(void)get_init_state;
 	(void)get_curr_meas;
+	map = get_config ? devc->regs_all : devc->regs_meas;
+	if (!map)
+		return SR_ERR_BUG;
+
+	g_mutex_lock(&devc->rw_mutex);
+	ret = rdtech_dps_read_regmap(modbus, map);
+	g_mutex_unlock(&devc->rw_mutex);
+	if (ret != SR_OK)
+		return ret;
+	ovp_threshold = 0;
+	ocp_threshold = 0;
 
 	have_range = devc->model->n_ranges > 1;
 	if (!have_range)
@@ -369,23 +426,14 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 	switch (devc->model->model_type) {
 	case MODEL_DPS:
 		/*
-		 * Transfer a chunk of registers in a single call. It's
-		 * unfortunate that the model dependency and the sparse
+		 * It's unfortunate that the model dependency and the sparse
 		 * register map force us to open code addresses, sizes,
 		 * and the sequence of the registers and how to interpret
 		 * their bit fields. But then this is not too unusual for
 		 * a hardware specific device driver ...
 		 */
-		g_mutex_lock(&devc->rw_mutex);
-		ret = rdtech_dps_read_holding_registers(modbus,
-			REG_DPS_USET, REG_DPS_ENABLE - REG_DPS_USET + 1,
-			registers);
-		g_mutex_unlock(&devc->rw_mutex);
-		if (ret != SR_OK)
-			return ret;
-
-		/* Interpret the registers' values. */
-		rdptr = (const void *)registers;
+		rdptr = (const void *)sr_modbus_regmap_get(map,
+			REG_DPS_USET, REG_DPS_ENABLE - REG_DPS_USET + 1);
 		uset_raw = read_u16be_inc(&rdptr);
 		volt_target = uset_raw / devc->voltage_multiplier;
 		iset_raw = read_u16be_inc(&rdptr);
@@ -407,16 +455,11 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 		out_state = read_u16be_inc(&rdptr); /* ENABLE */
 		is_out_enabled = out_state != 0;
 
-		/* Transfer another chunk of registers in a single call. */
-		g_mutex_lock(&devc->rw_mutex);
-		ret = rdtech_dps_read_holding_registers(modbus,
-			PRE_DPS_OVPSET, 2, registers);
-		g_mutex_unlock(&devc->rw_mutex);
-		if (ret != SR_OK)
-			return ret;
-
 		/* Interpret the second registers chunk's values. */
-		rdptr = (const void *)registers;
+		if (!get_config)
+			break;
+		rdptr = (const void *)sr_modbus_regmap_get(map,
+			PRE_DPS_OVPSET, 2);
 		ovpset_raw = read_u16be_inc(&rdptr); /* PRE OVPSET */
 		ovp_threshold = ovpset_raw * devc->voltage_multiplier;
 		ocpset_raw = read_u16be_inc(&rdptr); /* PRE OCPSET */
@@ -425,20 +468,9 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 		break;
 
 	case MODEL_RD:
-		/* Retrieve a set of adjacent registers. */
-		g_mutex_lock(&devc->rw_mutex);
-		ret = rdtech_dps_read_holding_registers(modbus,
-			REG_RD_VOLT_TGT,
-			devc->model->n_ranges > 1
-				? REG_RD_RANGE - REG_RD_VOLT_TGT + 1
-				: REG_RD_ENABLE - REG_RD_VOLT_TGT + 1,
-			registers);
-		g_mutex_unlock(&devc->rw_mutex);
-		if (ret != SR_OK)
-			return ret;
-
 		/* Interpret the registers' raw content. */
-		rdptr = (const void *)registers;
+		rdptr = (const void *)sr_modbus_regmap_get(map,
+			REG_RD_VOLT_TGT, REG_RD_ENABLE - REG_RD_VOLT_TGT + 1);
 		uset_raw = read_u16be_inc(&rdptr); /* USET */
 		volt_target = uset_raw / devc->voltage_multiplier;
 		iset_raw = read_u16be_inc(&rdptr); /* ISET */
@@ -464,24 +496,19 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 			range = read_u16be_inc(&rdptr) ? 1 : 0; /* RANGE */
 		}
 
-		/* Retrieve a set of adjacent registers. */
-		g_mutex_lock(&devc->rw_mutex);
-		ret = rdtech_dps_read_holding_registers(modbus,
-			REG_RD_OVP_THR, 2, registers);
-		g_mutex_unlock(&devc->rw_mutex);
-		if (ret != SR_OK)
-			return ret;
+		/* Details which we cannot query from the device. */
+		is_lock = FALSE;
 
 		/* Interpret the registers' raw content. */
-		rdptr = (const void *)registers;
+		if (!get_config)
+			break;
+		rdptr = (const void *)sr_modbus_regmap_get(map,
+			REG_RD_OVP_THR, 2);
 		ovpset_raw = read_u16be_inc(&rdptr); /* OVP THR */
 		ovp_threshold = ovpset_raw / devc->voltage_multiplier;
 		ocpset_raw = read_u16be_inc(&rdptr); /* OCP THR */
 		ocp_threshold = ocpset_raw / devc->current_multiplier;
 
-		/* Details which we cannot query from the device. */
-		is_lock = FALSE;
-
 		break;
 
 	default:
@@ -513,10 +540,12 @@ SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 	state->mask |= STATE_VOLTAGE_TARGET;
 	state->current_limit = curr_limit;
 	state->mask |= STATE_CURRENT_LIMIT;
-	state->ovp_threshold = ovp_threshold;
-	state->mask |= STATE_OVP_THRESHOLD;
-	state->ocp_threshold = ocp_threshold;
-	state->mask |= STATE_OCP_THRESHOLD;
+	if (get_config) {
+		state->ovp_threshold = ovp_threshold;
+		state->mask |= STATE_OVP_THRESHOLD;
+		state->ocp_threshold = ocp_threshold;
+		state->mask |= STATE_OCP_THRESHOLD;
+	}
 	state->voltage = curr_voltage;
 	state->mask |= STATE_VOLTAGE;
 	state->current = curr_current;
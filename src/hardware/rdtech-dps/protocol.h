@@ -32,6 +32,9 @@
 
 #define LOG_PREFIX "rdtech-dps"
 
+/* Unneeded registers to read rather than sending another request. */
+#define RDTECH_DPS_REG_GAP 8
+
 enum rdtech_dps_model_type {
 	MODEL_NONE,
 	MODEL_DPS,
@@ -67,6 +70,8 @@ struct dev_context {
 	gboolean curr_out_state;
 	size_t curr_range;
 	gboolean acquisition_started;
+	struct sr_modbus_regmap *regs_meas;
+	struct sr_modbus_regmap *regs_all;
 };
 
 /* Container to get and set parameter values. */
@@ -102,6 +107,7 @@ enum rdtech_dps_state_context {
 	ST_CTX_PRE_ACQ,
 	ST_CTX_IN_ACQ,
 };
+SR_PRIV void rdtech_dps_plan_reads(struct dev_context *devc);
 SR_PRIV int rdtech_dps_get_state(const struct sr_dev_inst *sdi,
 	struct rdtech_dps_state *state, enum rdtech_dps_state_context reason);
 SR_PRIV int rdtech_dps_set_state(const struct sr_dev_inst *sdi,
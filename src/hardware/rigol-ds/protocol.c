@@ -544,10 +544,62 @@ SR_PRIV int rigol_ds_channel_start(const struct sr_dev_inst *sdi)
 	devc->num_channel_bytes = 0;
 	devc->num_header_bytes = 0;
 	devc->num_block_bytes = 0;
+	devc->block_requested = FALSE;
 
 	return SR_OK;
 }
 
+/* Ask the scope for the next data block of the current channel. */
+static int rigol_ds_request_block(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	const gboolean first_frame = (devc->num_frames == 0);
+
+	if (devc->model->series->protocol >= PROTOCOL_V4) {
+		if (first_frame && rigol_ds_config_set(sdi, ":WAV:START %d",
+				devc->num_channel_bytes + 1) != SR_OK)
+			return SR_ERR;
+		if (first_frame && rigol_ds_config_set(sdi, ":WAV:STOP %d",
+				MIN(devc->num_channel_bytes + ACQ_BLOCK_SIZE,
+					devc->analog_frame_size)) != SR_OK)
+			return SR_ERR;
+	}
+
+	if (devc->model->series->protocol >= PROTOCOL_V3) {
+		if (rigol_ds_config_set(sdi, ":WAV:BEG") != SR_OK)
+			return SR_ERR;
+		if (sr_scpi_send(sdi->conn, ":WAV:DATA?") != SR_OK)
+			return SR_ERR;
+	}
+
+	devc->block_requested = TRUE;
+
+	return SR_OK;
+}
+
+/*
+ * Request the following data block before the one just read is
+ * converted and sent, so the scope prepares it in the meantime. Only
+ * V4 and later, V3 polls the scope's output buffer state first.
+ */
+static void rigol_ds_request_ahead(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (devc->model->series->protocol < PROTOCOL_V4
+			|| devc->format != FORMAT_IEEE488_2
+			|| devc->num_block_bytes != 0)
+		return;
+
+	if (rigol_ds_request_block(sdi) != SR_OK)
+		devc->block_requested = FALSE;
+}
+
 /* Read the header of a data block */
 static int rigol_ds_read_header(struct sr_dev_inst *sdi)
 {
@@ -605,10 +657,10 @@ static int rigol_ds_read_header(struct sr_dev_inst *sdi)
 	return ret;
 }
 
-SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
+/* Convert the block data just read for a channel and send it. */
+static void rigol_ds_send_data(const struct sr_dev_inst *sdi,
+		struct sr_channel *ch, int len)
 {
-	struct sr_dev_inst *sdi;
-	struct sr_scpi_dev_inst *scpi;
 	struct dev_context *devc;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
@@ -617,7 +669,53 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 	struct sr_analog_spec spec;
 	struct sr_datafeed_logic logic;
 	double vdiv, offset, origin;
-	int len, i, vref;
+	int i, vref;
+
+	devc = sdi->priv;
+
+	if (ch->type == SR_CHANNEL_ANALOG) {
+		vref = devc->vert_reference[ch->index];
+		vdiv = devc->vert_inc[ch->index];
+		origin = devc->vert_origin[ch->index];
+		offset = devc->vert_offset[ch->index];
+		if (devc->model->series->protocol >= PROTOCOL_V3)
+			for (i = 0; i < len; i++)
+				devc->data[i] = ((int)devc->buffer[i] - vref - origin) * vdiv;
+		else
+			for (i = 0; i < len; i++)
+				devc->data[i] = (128 - devc->buffer[i]) * vdiv - offset;
+		float vdivlog = log10f(vdiv);
+		int digits = -(int)vdivlog + (vdivlog < 0.0);
+		sr_analog_init(&analog, &encoding, &meaning, &spec, digits);
+		analog.meaning->channels = g_slist_append(NULL, ch);
+		analog.num_samples = len;
+		analog.data = devc->data;
+		analog.meaning->mq = SR_MQ_VOLTAGE;
+		analog.meaning->unit = SR_UNIT_VOLT;
+		analog.meaning->mqflags = 0;
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		sr_session_send(sdi, &packet);
+		g_slist_free(analog.meaning->channels);
+	} else {
+		logic.length = len;
+		// TODO: For the MSO1000Z series, we need a way to express that
+		// this data is in fact just for a single channel, with the valid
+		// data for that channel in the LSB of each byte.
+		logic.unitsize = devc->model->series->protocol >= PROTOCOL_V4 ? 1 : 2;
+		logic.data = devc->buffer;
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		sr_session_send(sdi, &packet);
+	}
+}
+
+SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_scpi_dev_inst *scpi;
+	struct dev_context *devc;
+	int len;
 	struct sr_channel *ch;
 	gsize expected_data_bytes;
 
@@ -634,8 +732,6 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 	if (!(revents == G_IO_IN || revents == 0))
 		return TRUE;
 
-	const gboolean first_frame = (devc->num_frames == 0);
-
 	switch (devc->wait_event) {
 	case WAIT_NONE:
 		break;
@@ -668,22 +764,10 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 			devc->analog_frame_size : devc->digital_frame_size;
 
 	if (devc->num_block_bytes == 0) {
-		if (devc->model->series->protocol >= PROTOCOL_V4) {
-			if (first_frame && rigol_ds_config_set(sdi, ":WAV:START %d",
-					devc->num_channel_bytes + 1) != SR_OK)
-				return TRUE;
-			if (first_frame && rigol_ds_config_set(sdi, ":WAV:STOP %d",
-					MIN(devc->num_channel_bytes + ACQ_BLOCK_SIZE,
-						devc->analog_frame_size)) != SR_OK)
-				return TRUE;
-		}
-
-		if (devc->model->series->protocol >= PROTOCOL_V3) {
-			if (rigol_ds_config_set(sdi, ":WAV:BEG") != SR_OK)
-				return TRUE;
-			if (sr_scpi_send(sdi->conn, ":WAV:DATA?") != SR_OK)
-				return TRUE;
-		}
+		if (!devc->block_requested
+				&& rigol_ds_request_block(sdi) != SR_OK)
+			return TRUE;
+		devc->block_requested = FALSE;
 
 		if (sr_scpi_read_begin(scpi) != SR_OK)
 			return TRUE;
@@ -738,42 +822,6 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 
 	devc->num_block_read += len;
 
-	if (ch->type == SR_CHANNEL_ANALOG) {
-		vref = devc->vert_reference[ch->index];
-		vdiv = devc->vert_inc[ch->index];
-		origin = devc->vert_origin[ch->index];
-		offset = devc->vert_offset[ch->index];
-		if (devc->model->series->protocol >= PROTOCOL_V3)
-			for (i = 0; i < len; i++)
-				devc->data[i] = ((int)devc->buffer[i] - vref - origin) * vdiv;
-		else
-			for (i = 0; i < len; i++)
-				devc->data[i] = (128 - devc->buffer[i]) * vdiv - offset;
-		float vdivlog = log10f(vdiv);
-		int digits = -(int)vdivlog + (vdivlog < 0.0);
-		sr_analog_init(&analog, &encoding, &meaning, &spec, digits);
-		analog.meaning->channels = g_slist_append(NULL, ch);
-		analog.num_samples = len;
-		analog.data = devc->data;
-		analog.meaning->mq = SR_MQ_VOLTAGE;
-		analog.meaning->unit = SR_UNIT_VOLT;
-		analog.meaning->mqflags = 0;
-		packet.type = SR_DF_ANALOG;
-		packet.payload = &analog;
-		sr_session_send(sdi, &packet);
-		g_slist_free(analog.meaning->channels);
-	} else {
-		logic.length = len;
-		// TODO: For the MSO1000Z series, we need a way to express that
-		// this data is in fact just for a single channel, with the valid
-		// data for that channel in the LSB of each byte.
-		logic.unitsize = devc->model->series->protocol >= PROTOCOL_V4 ? 1 : 2;
-		logic.data = devc->buffer;
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		sr_session_send(sdi, &packet);
-	}
-
 	if (devc->num_block_read == devc->num_block_bytes) {
 		sr_dbg("Block has been completed");
 		if (devc->model->series->protocol >= PROTOCOL_V3) {
@@ -798,9 +846,12 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 
 	devc->num_channel_bytes += len;
 
-	if (devc->num_channel_bytes < expected_data_bytes)
+	if (devc->num_channel_bytes < expected_data_bytes) {
 		/* Don't have the full data for this channel yet, re-run. */
+		rigol_ds_request_ahead(sdi);
+		rigol_ds_send_data(sdi, ch, len);
 		return TRUE;
+	}
 
 	/* End of data for this channel. */
 	if (devc->model->series->protocol == PROTOCOL_V3) {
@@ -817,8 +868,12 @@ SR_PRIV int rigol_ds_receive(int fd, int revents, void *cb_data)
 	if (devc->channel_entry->next) {
 		/* We got the frame for this channel, now get the next channel. */
 		devc->channel_entry = devc->channel_entry->next;
-		rigol_ds_channel_start(sdi);
+		if (rigol_ds_channel_start(sdi) == SR_OK)
+			rigol_ds_request_ahead(sdi);
+		rigol_ds_send_data(sdi, ch, len);
 	} else {
+		rigol_ds_send_data(sdi, ch, len);
+
 		/* Done with this frame. */
 		std_session_send_df_frame_end(sdi);
 
@@ -860,19 +915,62 @@ SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
 	struct sr_channel *ch;
-	char *cmd;
+	struct sr_scpi_batch *batch;
+	size_t q_analog, q_la, q_digital, q_timebase, q_probe, q_coupling;
+	size_t q_trig_source, q_trig_pos, q_trig_slope, q_trig_level;
+	char *response;
 	unsigned int i;
-	int res;
+	int len, res;
 
 	devc = sdi->priv;
 
+	/*
+	 * Query the whole configuration at once, except for the vertical
+	 * settings which also get updated on their own. Responses come
+	 * in the order of the queries.
+	 */
+	batch = sr_scpi_batch_new();
+	q_analog = 0;
+	for (i = 0; i < devc->model->analog_channels; i++)
+		sr_scpi_batch_add(batch, ":CHAN%d:DISP?", i + 1);
+	q_la = q_digital = 0;
+	if (devc->model->has_digital) {
+		q_la = sr_scpi_batch_add(batch, "%s",
+			devc->model->series->protocol >= PROTOCOL_V3 ?
+				":LA:STAT?" : ":LA:DISP?");
+		q_digital = q_la + 1;
+		for (i = 0; i < ARRAY_SIZE(devc->digital_channels); i++) {
+			if (devc->model->series->protocol >= PROTOCOL_V5)
+				sr_scpi_batch_add(batch, ":LA:DISP? D%d", i);
+			else if (devc->model->series->protocol >= PROTOCOL_V3)
+				sr_scpi_batch_add(batch, ":LA:DIG%d:DISP?", i);
+			else
+				sr_scpi_batch_add(batch, ":DIG%d:TURN?", i);
+		}
+	}
+	q_timebase = sr_scpi_batch_add(batch, ":TIM:SCAL?");
+	q_probe = q_timebase + 1;
+	for (i = 0; i < devc->model->analog_channels; i++)
+		sr_scpi_batch_add(batch, ":CHAN%d:PROB?", i + 1);
+	q_coupling = q_probe + devc->model->analog_channels;
+	for (i = 0; i < devc->model->analog_channels; i++)
+		sr_scpi_batch_add(batch, ":CHAN%d:COUP?", i + 1);
+	q_trig_source = sr_scpi_batch_add(batch, ":TRIG:EDGE:SOUR?");
+	q_trig_pos = sr_scpi_batch_add(batch, "%s",
+		devc->model->cmds[CMD_GET_HORIZ_TRIGGERPOS].str);
+	q_trig_slope = sr_scpi_batch_add(batch, ":TRIG:EDGE:SLOP?");
+	q_trig_level = sr_scpi_batch_add(batch, ":TRIG:EDGE:LEV?");
+
+	res = sr_scpi_batch_run(sdi->conn, batch);
+	if (res != SR_OK)
+		goto err;
+
 	/* Analog channel state. */
 	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:DISP?", i + 1);
-		res = sr_scpi_get_bool(sdi->conn, cmd, &devc->analog_channels[i]);
-		g_free(cmd);
+		res = sr_scpi_batch_get_bool(batch, q_analog + i,
+			&devc->analog_channels[i]);
 		if (res != SR_OK)
-			return SR_ERR;
+			goto err;
 		ch = g_slist_nth_data(sdi->channels, i);
 		ch->enabled = devc->analog_channels[i];
 	}
@@ -882,24 +980,16 @@ SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi)
 
 	/* Digital channel state. */
 	if (devc->model->has_digital) {
-		if (sr_scpi_get_bool(sdi->conn,
-				devc->model->series->protocol >= PROTOCOL_V3 ?
-					":LA:STAT?" : ":LA:DISP?",
-				&devc->la_enabled) != SR_OK)
-			return SR_ERR;
+		res = sr_scpi_batch_get_bool(batch, q_la, &devc->la_enabled);
+		if (res != SR_OK)
+			goto err;
 		sr_dbg("Logic analyzer %s, current digital channel state:",
 				devc->la_enabled ? "enabled" : "disabled");
 		for (i = 0; i < ARRAY_SIZE(devc->digital_channels); i++) {
-			if (devc->model->series->protocol >= PROTOCOL_V5)
-				cmd = g_strdup_printf(":LA:DISP? D%d", i);
-			else if (devc->model->series->protocol >= PROTOCOL_V3)
-				cmd = g_strdup_printf(":LA:DIG%d:DISP?", i);
-			else
-				cmd = g_strdup_printf(":DIG%d:TURN?", i);
-			res = sr_scpi_get_bool(sdi->conn, cmd, &devc->digital_channels[i]);
-			g_free(cmd);
+			res = sr_scpi_batch_get_bool(batch, q_digital + i,
+				&devc->digital_channels[i]);
 			if (res != SR_OK)
-				return SR_ERR;
+				goto err;
 			ch = g_slist_nth_data(sdi->channels, i + devc->model->analog_channels);
 			ch->enabled = devc->digital_channels[i];
 			sr_dbg("D%d: %s", i, devc->digital_channels[i] ? "on" : "off");
@@ -907,49 +997,40 @@ SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi)
 	}
 
 	/* Timebase. */
-	if (sr_scpi_get_float(sdi->conn, ":TIM:SCAL?", &devc->timebase) != SR_OK)
-		return SR_ERR;
+	res = sr_scpi_batch_get_float(batch, q_timebase, &devc->timebase);
+	if (res != SR_OK)
+		goto err;
 	sr_dbg("Current timebase %g", devc->timebase);
 
 	/* Probe attenuation. */
 	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:PROB?", i + 1);
-
 		/* DSO1000B series prints an X after the probe factor, so
 		 * we get a string and check for that instead of only handling
 		 * floats. */
-		char *response;
-		res = sr_scpi_get_string(sdi->conn, cmd, &response);
-		if (res != SR_OK)
-			return SR_ERR;
+		response = g_strdup(sr_scpi_batch_get_string(batch, q_probe + i));
+		if (!response) {
+			res = SR_ERR_DATA;
+			goto err;
+		}
 
-		int len = strlen(response);
-		if (response[len-1] == 'X')
+		len = strlen(response);
+		if (len && response[len-1] == 'X')
 			response[len-1] = 0;
 
 		res = sr_atof_ascii(response, &devc->attenuation[i]);
 		g_free(response);
-		g_free(cmd);
 		if (res != SR_OK)
-			return SR_ERR;
+			goto err;
 	}
 	sr_dbg("Current probe attenuation:");
 	for (i = 0; i < devc->model->analog_channels; i++)
 		sr_dbg("CH%d %g", i + 1, devc->attenuation[i]);
 
-	/* Vertical gain and offset. */
-	if (rigol_ds_get_dev_cfg_vertical(sdi) != SR_OK)
-		return SR_ERR;
-
 	/* Coupling. */
 	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:COUP?", i + 1);
 		g_free(devc->coupling[i]);
-		devc->coupling[i] = NULL;
-		res = sr_scpi_get_string(sdi->conn, cmd, &devc->coupling[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
+		devc->coupling[i] = g_strdup(sr_scpi_batch_get_string(batch,
+			q_coupling + i));
 	}
 	sr_dbg("Current coupling:");
 	for (i = 0; i < devc->model->analog_channels; i++)
@@ -957,61 +1038,77 @@ SR_PRIV int rigol_ds_get_dev_cfg(const struct sr_dev_inst *sdi)
 
 	/* Trigger source. */
 	g_free(devc->trigger_source);
-	devc->trigger_source = NULL;
-	if (sr_scpi_get_string(sdi->conn, ":TRIG:EDGE:SOUR?", &devc->trigger_source) != SR_OK)
-		return SR_ERR;
+	devc->trigger_source = g_strdup(sr_scpi_batch_get_string(batch,
+		q_trig_source));
 	sr_dbg("Current trigger source %s", devc->trigger_source);
 
 	/* Horizontal trigger position. */
-	if (sr_scpi_get_float(sdi->conn, devc->model->cmds[CMD_GET_HORIZ_TRIGGERPOS].str,
-			&devc->horiz_triggerpos) != SR_OK)
-		return SR_ERR;
+	res = sr_scpi_batch_get_float(batch, q_trig_pos, &devc->horiz_triggerpos);
+	if (res != SR_OK)
+		goto err;
 	sr_dbg("Current horizontal trigger position %g", devc->horiz_triggerpos);
 
 	/* Trigger slope. */
 	g_free(devc->trigger_slope);
-	devc->trigger_slope = NULL;
-	if (sr_scpi_get_string(sdi->conn, ":TRIG:EDGE:SLOP?", &devc->trigger_slope) != SR_OK)
-		return SR_ERR;
+	devc->trigger_slope = g_strdup(sr_scpi_batch_get_string(batch,
+		q_trig_slope));
 	sr_dbg("Current trigger slope %s", devc->trigger_slope);
 
 	/* Trigger level. */
-	if (sr_scpi_get_float(sdi->conn, ":TRIG:EDGE:LEV?", &devc->trigger_level) != SR_OK)
-		return SR_ERR;
+	res = sr_scpi_batch_get_float(batch, q_trig_level, &devc->trigger_level);
+	if (res != SR_OK)
+		goto err;
 	sr_dbg("Current trigger level %g", devc->trigger_level);
 
+	sr_scpi_batch_free(batch);
+
+	/* Vertical gain and offset. */
+	if (rigol_ds_get_dev_cfg_vertical(sdi) != SR_OK)
+		return SR_ERR;
+
 	return SR_OK;
+
+err:
+	sr_scpi_batch_free(batch);
+	return SR_ERR;
 }
 
 SR_PRIV int rigol_ds_get_dev_cfg_vertical(const struct sr_dev_inst *sdi)
 {
 	struct dev_context *devc;
-	char *cmd;
+	struct sr_scpi_batch *batch;
+	size_t q_offset;
 	unsigned int i;
 	int res;
 
 	devc = sdi->priv;
 
+	batch = sr_scpi_batch_new();
+	for (i = 0; i < devc->model->analog_channels; i++)
+		sr_scpi_batch_add(batch, ":CHAN%d:SCAL?", i + 1);
+	q_offset = devc->model->analog_channels;
+	for (i = 0; i < devc->model->analog_channels; i++)
+		sr_scpi_batch_add(batch, ":CHAN%d:OFFS?", i + 1);
+	res = sr_scpi_batch_run(sdi->conn, batch);
+
 	/* Vertical gain. */
-	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:SCAL?", i + 1);
-		res = sr_scpi_get_float(sdi->conn, cmd, &devc->vdiv[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
+	for (i = 0; res == SR_OK && i < devc->model->analog_channels; i++)
+		res = sr_scpi_batch_get_float(batch, i, &devc->vdiv[i]);
+	if (res != SR_OK) {
+		sr_scpi_batch_free(batch);
+		return SR_ERR;
 	}
 	sr_dbg("Current vertical gain:");
 	for (i = 0; i < devc->model->analog_channels; i++)
 		sr_dbg("CH%d %g", i + 1, devc->vdiv[i]);
 
 	/* Vertical offset. */
-	for (i = 0; i < devc->model->analog_channels; i++) {
-		cmd = g_strdup_printf(":CHAN%d:OFFS?", i + 1);
-		res = sr_scpi_get_float(sdi->conn, cmd, &devc->vert_offset[i]);
-		g_free(cmd);
-		if (res != SR_OK)
-			return SR_ERR;
-	}
+	for (i = 0; res == SR_OK && i < devc->model->analog_channels; i++)
+		res = sr_scpi_batch_get_float(batch, q_offset + i,
+			&devc->vert_offset[i]);
+	sr_scpi_batch_free(batch);
+	if (res != SR_OK)
+		return SR_ERR;
 	sr_dbg("Current vertical offset:");
 	for (i = 0; i < devc->model->analog_channels; i++)
 		sr_dbg("CH%d %g", i + 1, devc->vert_offset[i]);
@@ -492,17 +492,19 @@ static int upload_bitstream(const struct sr_dev_inst *sdi,
 			    const char *name)
 {
 	struct drv_context *drvc = sdi->driver->context;
-	unsigned char *bitstream = NULL;
+	GBytes *bytes;
+	const unsigned char *bitstream;
 	uint8_t req[2];
 	uint8_t rsp[1];
 	uint8_t reg_val;
 	int ret = SR_ERR;
 	size_t bs_size, bs_offset = 0, bs_part_size;
 
-	bitstream = sr_resource_load(drvc->sr_ctx, SR_RESOURCE_FIRMWARE,
-				     name, &bs_size, 512 * 1024);
-	if (!bitstream)
-		goto out;
+	bytes = sr_resource_load_cached(drvc->sr_ctx, SR_RESOURCE_FIRMWARE,
+				       name, 512 * 1024);
+	if (!bytes)
+		return SR_ERR;
+	bitstream = g_bytes_get_data(bytes, &bs_size);
 
 	sr_info("Uploading bitstream '%s'.", name);
 
@@ -511,7 +513,7 @@ static int upload_bitstream(const struct sr_dev_inst *sdi,
 
 	ret = transact(sdi, req, sizeof(req), rsp, sizeof(rsp));
 	if (ret != SR_OK)
-		return ret;
+		goto out;
 	if (rsp[0] != 0x00) {
 		sr_err("Failed to start bitstream upload (0x%02x).", rsp[0]);
 		ret = SR_ERR;
@@ -543,7 +545,7 @@ static int upload_bitstream(const struct sr_dev_inst *sdi,
 	}
 
  out:
-	g_free(bitstream);
+	g_bytes_unref(bytes);
 
 	return ret;
 }
@@ -585,7 +587,12 @@ static int configure_channels(const struct sr_dev_inst *sdi)
 	sr_dbg("%d channels enabled (0x%04x)",
 	       devc->dig_channel_cnt, devc->dig_channel_mask);
 
-	return SR_OK;
+	if (!devc->dig_channel_cnt)
+		return SR_OK;
+
+	/* One 32 bit word per channel and batch, first sample in the MSB. */
+	return sr_transpose_init(&devc->transpose, 32, TRUE,
+		devc->dig_channel_masks, devc->dig_channel_cnt);
 }
 
 SR_PRIV int saleae_logic_pro_init(const struct sr_dev_inst *sdi)
@@ -849,40 +856,42 @@ static void saleae_logic_pro_convert_data(const struct sr_dev_inst *sdi,
 					 const uint32_t *src, size_t srccnt)
 {
 	struct dev_context *devc = sdi->priv;
-	uint8_t *dst = devc->conv_buffer;
-	uint32_t samples;
-	uint16_t channel_mask;
-	unsigned int sample_index, batch_index;
-	uint16_t *dst_batch;
-
-	/* Copy partial batch to the beginning. */
-	memcpy(dst, dst + devc->conv_size, CONV_BATCH_SIZE);
+	uint16_t *dst = (uint16_t *)devc->conv_buffer;
+	unsigned int count;
+	size_t n;
+
 	/* Reset converted size. */
 	devc->conv_size = 0;
 
-	batch_index = devc->batch_index;
-	while (srccnt--) {
-		samples = *src++;
-		dst_batch = (uint16_t*)dst;
-
-		/* First index of the batch. */
-		if (batch_index == 0)
-			memset(dst, 0, CONV_BATCH_SIZE);
-
-		/* Convert one channel. */
-		channel_mask = devc->dig_channel_masks[batch_index];
-		for (sample_index = 0; sample_index <= 31; sample_index++)
-			if ((samples >> (31 - sample_index)) & 1)
-				dst_batch[sample_index] |= channel_mask;
-
-		/* Last index of the batch. */
-		if (++batch_index == devc->dig_channel_cnt) {
-			devc->conv_size += CONV_BATCH_SIZE;
-			batch_index = 0;
-			dst += CONV_BATCH_SIZE;
-		}
+	count = devc->dig_channel_cnt;
+	if (!count)
+		return;
+
+	/* Complete the batch which the previous packet started. */
+	if (devc->batch_index) {
+		n = MIN(count - devc->batch_index, srccnt);
+		memcpy(&devc->batch_words[devc->batch_index], src,
+			n * sizeof(*src));
+		devc->batch_index += n;
+		src += n;
+		srccnt -= n;
+		if (devc->batch_index < count)
+			return;
+		sr_transpose_blocks(&devc->transpose, dst, devc->batch_words, 1);
+		devc->conv_size += CONV_BATCH_SIZE;
+		dst += 32;
+		devc->batch_index = 0;
 	}
-	devc->batch_index = batch_index;
+
+	n = srccnt / count;
+	sr_transpose_blocks(&devc->transpose, dst, src, n);
+	devc->conv_size += n * CONV_BATCH_SIZE;
+	src += n * count;
+	srccnt -= n * count;
+
+	/* Keep the start of the next batch. */
+	memcpy(devc->batch_words, src, srccnt * sizeof(*src));
+	devc->batch_index = srccnt;
 }
 
 SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *transfer)
@@ -903,8 +912,15 @@ SR_PRIV void LIBUSB_CALL saleae_logic_pro_receive_data(struct libusb_transfer *t
 		return;
 	}
 
-	saleae_logic_pro_convert_data(sdi, (uint32_t*)transfer->buffer, 16 * 1024 / 4);
-	saleae_logic_pro_send_data(sdi, devc->conv_buffer, devc->conv_size, 2);
+	/*
+	 * Timed out transfers may hold less than a full packet, or not
+	 * even a complete batch.
+	 */
+	saleae_logic_pro_convert_data(sdi, (uint32_t *)transfer->buffer,
+		transfer->actual_length / sizeof(uint32_t));
+	if (devc->conv_size)
+		saleae_logic_pro_send_data(sdi, devc->conv_buffer,
+			devc->conv_size, 2);
 
 	if ((ret = libusb_submit_transfer(transfer)) != LIBUSB_SUCCESS)
 		sr_dbg("FIXME resubmit failed");
@@ -24,6 +24,7 @@
 #include <glib.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
+#include "transpose.h"
 
 #define LOG_PREFIX "saleae-logic-pro"
 
@@ -31,8 +32,9 @@
 #define CONV_BATCH_SIZE (2 * 32)
 
 /*
- * One packet + one partial conversion: Worst case is only one active
- * channel converted to 2 bytes per sample, with 8 * 16384 samples per packet.
+ * One packet + one batch which the previous packet started: Worst case is
+ * only one active channel converted to 2 bytes per sample, with 8 * 16384
+ * samples per packet.
  */
 #define CONV_BUFFER_SIZE (2 * 8 * 16384 + CONV_BATCH_SIZE)
 
@@ -48,8 +50,11 @@ struct dev_context {
 	unsigned int submitted_transfers;
 	struct libusb_transfer **transfers;
 
+	struct sr_transpose transpose;
 	uint8_t *conv_buffer;
 	unsigned int conv_size;
+	/* Words of a batch which did not end in the previous packet. */
+	uint32_t batch_words[16];
 	unsigned int batch_index;
 };
 
@@ -274,6 +274,7 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	cb_func = receive_data;
 	cb_data = (void *)sdi;
 	dmm = (struct dmm_info *)sdi->driver;
+	devc->sync = dmm_sync_find(dmm);
 	if (dmm && dmm->acquire_start) {
 		ret = dmm->acquire_start(dmm->dmm_state, sdi,
 			&cb_func, &cb_data);
@@ -27,6 +27,75 @@
 #include "libsigrok-internal.h"
 #include "protocol.h"
 
+/*
+ * Where the chipsets' packets carry a fixed byte (or nibble), which
+ * offsets can start a packet at all. Only those offsets need the full
+ * validation. Chipsets without an entry are checked at every offset.
+ */
+static const struct dmm_sync sync_table[] = {
+	{ sr_asycii_packet_valid, 15, 0xff, '\r', },
+	{ sr_brymen_bm25x_packet_valid, 0, 0xff, 0x02, },
+	{ sr_brymen_bm52x_packet_valid, 16, 0xff, 0x52, },
+	{ sr_brymen_bm82x_packet_valid, 16, 0xff, 0x82, },
+	{ sr_brymen_bm86x_packet_valid, 19, 0xff, 0x86, },
+	{ sr_digitech_qm1578_packet_valid, 14, 0xff, '\r', },
+	{ sr_dtm0660_packet_valid, 0, 0xf0, 0x10, },
+	{ sr_eev121gw_packet_valid, 0, 0xff, 0xf2, },
+	{ sr_es519xx_2400_11b_packet_valid, 10, 0xff, '\n', },
+	{ sr_es519xx_19200_11b_packet_valid, 10, 0xff, '\n', },
+	{ sr_es519xx_19200_14b_packet_valid, 13, 0xff, '\n', },
+	{ sr_fs9721_packet_valid, 0, 0xf0, 0x10, },
+	{ sr_fs9922_packet_valid, 13, 0xff, '\n', },
+	{ sr_m2110_packet_valid, 8, 0xff, '\n', },
+	{ sr_metex14_packet_valid, 13, 0xff, '\r', },
+	{ sr_ms2115b_packet_valid, 0, 0xff, 0x55, },
+	{ sr_ms8250d_packet_valid, 17, 0xff, 0x00, },
+	{ sr_ut71x_packet_valid, 10, 0xff, '\n', },
+	{ sr_vc870_packet_valid, 22, 0xff, '\n', },
+	{ sr_vc96_packet_valid, 12, 0xff, '\n', },
+};
+
+SR_PRIV const struct dmm_sync *dmm_sync_find(const struct dmm_info *dmm)
+{
+	size_t i;
+
+	if (!dmm->packet_valid)
+		return NULL;
+	for (i = 0; i < ARRAY_SIZE(sync_table); i++) {
+		if (sync_table[i].packet_valid != dmm->packet_valid)
+			continue;
+		if (sync_table[i].offset >= dmm->packet_size)
+			return NULL;
+		return &sync_table[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Get the next position at or after pos which can start a packet. When
+ * there is none, skip all positions whose sync byte was seen already.
+ */
+static size_t sync_next(const struct dmm_sync *sync,
+	const uint8_t *buf, size_t pos, size_t len)
+{
+	const uint8_t *hit;
+	size_t idx;
+
+	if (len <= pos + sync->offset)
+		return pos;
+
+	idx = pos + sync->offset;
+	if (sync->mask == 0xff) {
+		hit = memchr(&buf[idx], sync->value, len - idx);
+		return (hit ? (size_t)(hit - buf) : len) - sync->offset;
+	}
+	while (idx < len && (buf[idx] & sync->mask) != sync->value)
+		idx++;
+
+	return idx - sync->offset;
+}
+
 static void log_dmm_packet(const uint8_t *buf, size_t len)
 {
 	GString *text;
@@ -170,6 +239,11 @@ static void handle_new_data(struct sr_dev_inst *sdi, void *info)
 	 */
 	check_pos = 0;
 	while (check_pos < devc->buflen) {
+		/* Skip to where the chipset's sync byte says a packet may start. */
+		if (devc->sync)
+			check_pos = sync_next(devc->sync, devc->buf,
+				check_pos, devc->buflen);
+
 		/* Got the (minimum) amount of receive data for a packet? */
 		check_len = devc->buflen - check_pos;
 		if (check_len < dmm->packet_size)
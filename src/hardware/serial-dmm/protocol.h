@@ -80,6 +80,18 @@ struct dmm_info {
 		sr_receive_data_callback *cb, void **cb_data);
 };
 
+/** Fixed content of a chipset's packets, to find packet starts by. */
+struct dmm_sync {
+	/** The chipset's packet validation function. */
+	gboolean (*packet_valid)(const uint8_t *);
+	/** Offset of the fixed byte within the packet. */
+	size_t offset;
+	/** Which bits of that byte are fixed. */
+	uint8_t mask;
+	/** The fixed bits' value. */
+	uint8_t value;
+};
+
 #define DMM_BUFSIZE 256
 
 struct dev_context {
@@ -93,8 +105,12 @@ struct dev_context {
 	 * Used only if device needs polling.
 	 */
 	uint64_t req_next_at;
+
+	/** Where packets can start, NULL when at any position. */
+	const struct dmm_sync *sync;
 };
 
+SR_PRIV const struct dmm_sync *dmm_sync_find(const struct dmm_info *dmm);
 SR_PRIV int req_packet(struct sr_dev_inst *sdi);
 SR_PRIV int receive_data(int fd, int revents, void *cb_data);
 
@@ -30,6 +30,17 @@
 #include "protocol.h"
 #include "scpi.h"
 
+/*
+ * The horizontal settings, which get queried upon each samplerate
+ * config_get(). They only change by commands, or on the front panel
+ * between acquisitions.
+ */
+static const char *const cached_queries[] = {
+	"SANU?",
+	"TDIV?",
+	NULL,
+};
+
 static const uint32_t scanopts[] = {
 	SR_CONF_CONN,
 	SR_CONF_SERIALCOMM,
@@ -240,6 +251,9 @@ static void clear_helper(void *priv)
 		return;
 	g_free(devc->analog_groups);
 	g_free(devc->enabled_channels);
+	g_free(devc->dig_staging);
+	if (devc->dig_buffer)
+		g_array_free(devc->dig_buffer, TRUE);
 }
 
 static int dev_clear(const struct sr_dev_driver *di)
@@ -365,6 +379,7 @@ static int dev_open(struct sr_dev_inst *sdi)
 		sr_err("Failed to open SCPI device: %s.", sr_strerror(ret));
 		return SR_ERR;
 	}
+	sr_scpi_cache_enable(scpi, cached_queries);
 
 	if ((ret = siglent_sds_get_dev_cfg(sdi)) < 0) {
 		sr_err("Failed to get device config: %s.", sr_strerror(ret));
@@ -857,10 +872,12 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	// devc->analog_frame_size = devc->model->series->buffer_samples;
 	// devc->digital_frame_size = devc->model->series->buffer_samples;
 
+	/* Settings may have changed on the front panel since. */
+	sr_scpi_cache_invalidate(sdi->conn, NULL);
 	siglent_sds_get_dev_cfg_horizontal(sdi);
 	switch (devc->model->series->protocol) {
 	case SPO_MODEL:
-		if (siglent_sds_config_set(sdi, "WFSU SP,0,TYPE,1") != SR_OK)
+		if (siglent_sds_config_set(sdi, "WFSU SP,0,NP,0,FP,0,TYPE,1") != SR_OK)
 			return SR_ERR;
 		if (devc->average_enabled) {
 			if (siglent_sds_config_set(sdi, "ACQW AVERAGE,%i", devc->average_samples) != SR_OK)
@@ -872,11 +889,16 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		break;
 	case NON_SPO_MODEL:
 		/* TODO: Implement CML/CNL/DL models. */
-		if (siglent_sds_config_set(sdi, "WFSU SP,0,TYPE,1") != SR_OK)
+		if (siglent_sds_config_set(sdi, "WFSU SP,0,NP,0,FP,0,TYPE,1") != SR_OK)
 			return SR_ERR;
 		if (siglent_sds_config_set(sdi, "ACQW SAMPLING") != SR_OK)
 			return SR_ERR;
 		break;
+	case ESERIES:
+		/* All points of the memory in one response. */
+		if (siglent_sds_config_set(sdi, "WFSU SP,0,NP,0,FP,0") != SR_OK)
+			return SR_ERR;
+		break;
 	default:
 		break;
 	}
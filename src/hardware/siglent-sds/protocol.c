@@ -340,121 +340,77 @@ static int siglent_sds_read_header(struct sr_dev_inst *sdi)
 	return ret;
 }
 
+/*
+ * Fetch every enabled digital channel, each one a bit stream with eight
+ * samples per byte, and transpose them into 16-bit samples. The streams
+ * are interleaved byte by byte first, which makes them the channel major
+ * blocks the transpose kernels take.
+ */
 static int siglent_sds_get_digital(const struct sr_dev_inst *sdi, struct sr_channel *ch)
 {
 	struct sr_scpi_dev_inst *scpi = sdi->conn;
 	struct dev_context *devc = sdi->priv;
-	GArray *tmp_samplebuf; /* Temp buffer while iterating over the scope samples */
 	char *buf = (char *)devc->buffer; /* Buffer from scope */
-	uint8_t tmp_value; /* Holding temp value from data */
-	GArray *data_low_channels, *data_high_channels, *buffdata;
+	const uint8_t *data;
+	uint16_t word_masks[SR_TRANSPOSE_MAX_WORDS];
 	GSList *l;
-	gboolean low_channels; /* Lower channels enabled */
-	gboolean high_channels; /* Higher channels enabled */
-	int len, channel_index;
-	uint64_t samples_index;
-
-	len = 0;
-	channel_index = 0;
-	low_channels = FALSE;
-	high_channels = FALSE;
-	data_low_channels = g_array_new(FALSE, TRUE, sizeof(uint8_t));
-	data_high_channels = g_array_new(FALSE, TRUE, sizeof(uint8_t));
+	unsigned int num_words, word;
+	size_t num_blocks, b, avail;
+	uint64_t num_samples;
+	int len, ret;
 
+	num_words = 0;
 	for (l = sdi->channels; l; l = l->next) {
 		ch = l->data;
-		samples_index = 0;
-		if (ch->type != SR_CHANNEL_LOGIC)
+		if (ch->type != SR_CHANNEL_LOGIC || !ch->enabled)
 			continue;
-		if (!ch->enabled)
+		if (num_words == SR_TRANSPOSE_MAX_WORDS)
+			break;
+		word_masks[num_words++] = 1 << ch->index;
+	}
+	if (!num_words)
+		return SR_ERR;
+	if ((ret = sr_transpose_init(&devc->transpose, 8, FALSE,
+			word_masks, num_words)) != SR_OK)
+		return ret;
+
+	num_blocks = (devc->memory_depth_digital + 7) / 8;
+	if (devc->dig_staging_size < num_blocks * num_words) {
+		g_free(devc->dig_staging);
+		devc->dig_staging_size = num_blocks * num_words;
+		devc->dig_staging = g_malloc(devc->dig_staging_size);
+	}
+	memset(devc->dig_staging, 0, num_blocks * num_words);
+
+	word = 0;
+	for (l = sdi->channels; l && word < num_words; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_LOGIC || !ch->enabled)
 			continue;
 		if (sr_scpi_send(sdi->conn, "D%d:WF? DAT2", ch->index) != SR_OK)
 			return SR_ERR;
 		if (sr_scpi_read_begin(scpi) != SR_OK)
-			return TRUE;
+			return SR_ERR;
 		len = sr_scpi_read_data(scpi, buf, -1);
-		if (len < 0)
-			return TRUE;
-		len -= 15;
-		buffdata = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t), len);
-		buf += 15; /* Skipping the data header. */
-		g_array_append_vals(buffdata, buf, len);
-		tmp_samplebuf = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t), len); /* New temp buffer. */
-		for (uint64_t cur_sample_index = 0; cur_sample_index < devc->memory_depth_digital; cur_sample_index++) {
-			char sample = (char)g_array_index(buffdata, uint8_t, cur_sample_index);
-			for (int ii = 0; ii < 8; ii++, sample >>= 1) {
-				if (ch->index < 8) {
-					channel_index = ch->index;
-					if (data_low_channels->len <= samples_index) {
-						tmp_value = 0; /* New sample. */
-						low_channels = TRUE; /* We have at least one enabled low channel. */
-					} else {
-						/* Get previous stored sample from low channel buffer. */
-						tmp_value = g_array_index(data_low_channels, uint8_t, samples_index);
-					}
-				} else {
-					channel_index = ch->index - 8;
-					if (data_high_channels->len <= samples_index) {
-						tmp_value = 0; /* New sample. */
-						high_channels = TRUE; /* We have at least one enabled high channel. */
-					} else {
-						/* Get previous stored sample from high channel buffer. */
-						tmp_value = g_array_index(data_high_channels, uint8_t, samples_index);
-					}
-				}
-				/* Check if the current scope sample bit is set. */
-				if (sample & 0x1)
-					tmp_value |= 1UL << channel_index; /* Set current scope sample bit based on channel index. */
-				g_array_append_val(tmp_samplebuf, tmp_value);
-				samples_index++;
-			}
-		}
-
-		/* Clear the buffers to prepare for the new samples */
-		if (ch->index < 8) {
-			g_array_free(data_low_channels, TRUE);
-			data_low_channels = g_array_new(FALSE, FALSE, sizeof(uint8_t));
-		} else {
-			g_array_free(data_high_channels, TRUE);
-			data_high_channels = g_array_new(FALSE, FALSE, sizeof(uint8_t));
-		}
-
-		/* Storing the converted temp values from the the scope into the buffers. */
-		for (uint64_t index = 0; index < tmp_samplebuf->len; index++) {
-			uint8_t value = g_array_index(tmp_samplebuf, uint8_t, index);
-			if (ch->index < 8)
-				g_array_append_val(data_low_channels, value);
-			else
-				g_array_append_val(data_high_channels, value);
-		}
-		g_array_free(tmp_samplebuf, TRUE);
-		g_array_free(buffdata, TRUE);
-	}
-
-	/* Combining the lower and higher channel buffers into one buffer for sigrok. */
-	devc->dig_buffer = g_array_new(FALSE, FALSE, sizeof(uint8_t));
-	for (uint64_t index = 0; index < devc->memory_depth_digital; index++) {
-		uint8_t value;
-		if (low_channels) {
-			value = g_array_index(data_low_channels, uint8_t, index);
-			g_array_append_val(devc->dig_buffer, value);
-		} else {
-			value = 0;
-			g_array_append_val(devc->dig_buffer, value);
-		}
-		if (high_channels) {
-			value = g_array_index(data_high_channels, uint8_t, index);
-			g_array_append_val(devc->dig_buffer, value);
-		} else {
-			value = 0;
-			g_array_append_val(devc->dig_buffer, value);
-		}
+		if (len < 15)
+			return SR_ERR;
+		/* Skipping the data header. */
+		data = (const uint8_t *)buf + 15;
+		avail = MIN((size_t)len - 15, num_blocks);
+		for (b = 0; b < avail; b++)
+			devc->dig_staging[b * num_words + word] = data[b];
+		word++;
 	}
 
-	g_array_free(data_low_channels, TRUE);
-	g_array_free(data_high_channels, TRUE);
+	num_samples = MIN(devc->memory_depth_digital, num_blocks * 8);
+	if (!devc->dig_buffer)
+		devc->dig_buffer = g_array_new(FALSE, FALSE, sizeof(uint8_t));
+	g_array_set_size(devc->dig_buffer, num_blocks * 8 * sizeof(uint16_t));
+	sr_transpose_blocks(&devc->transpose,
+		(uint16_t *)devc->dig_buffer->data, devc->dig_staging, num_blocks);
+	g_array_set_size(devc->dig_buffer, num_samples * sizeof(uint16_t));
 
-	return len;
+	return SR_OK;
 }
 
 SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
@@ -469,6 +425,7 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 	struct sr_analog_spec spec;
 	struct sr_datafeed_logic logic;
 	struct sr_channel *ch;
+	const uint8_t *samples;
 	int len, i;
 	float wait;
 	gboolean read_complete = FALSE;
@@ -562,11 +519,15 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 				if (devc->num_block_bytes > devc->num_samples) {
 					/* We received all data as one block. */
 					/* Offset the data block buffer past the IEEE header and description header. */
-					devc->buffer += devc->block_header_size;
+					samples = devc->buffer + devc->block_header_size;
 					len = devc->num_samples;
 				} else {
-					sr_dbg("Requesting: %" PRIu64 " bytes.", devc->num_samples - devc->num_block_bytes);
-					len = sr_scpi_read_data(scpi, (char *)devc->buffer, devc->num_samples-devc->num_block_bytes);
+					/* Read as much as fits, into the same buffer every time. */
+					samples = devc->buffer;
+					len = MIN(devc->num_samples - devc->num_block_bytes,
+						(uint64_t)devc->model->series->buffer_samples);
+					sr_dbg("Requesting: %d bytes.", len);
+					len = sr_scpi_read_data(scpi, (char *)samples, len);
 					if (len == -1) {
 						sr_err("Read error, aborting capture.");
 						std_session_send_df_frame_end(sdi);
@@ -580,25 +541,17 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 				if (ch->type == SR_CHANNEL_ANALOG) {
 					float vdiv = devc->vdiv[ch->index];
 					float offset = devc->vert_offset[ch->index];
-					GArray *float_data;
-					static GArray *data;
-					float voltage, vdivlog;
+					float vdivlog;
 					int digits;
 
-					data = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t), len);
-					g_array_append_vals(data, devc->buffer, len);
-					float_data = g_array_new(FALSE, FALSE, sizeof(float));
-					for (i = 0; i < len; i++) {
-						voltage = (float)g_array_index(data, int8_t, i) / 25;
-						voltage = ((vdiv * voltage) - offset);
-						g_array_append_val(float_data, voltage);
-					}
+					for (i = 0; i < len; i++)
+						devc->data[i] = vdiv * ((float)(int8_t)samples[i] / 25) - offset;
 					vdivlog = log10f(vdiv);
 					digits = -(int) vdivlog + (vdivlog < 0.0);
 					sr_analog_init(&analog, &encoding, &meaning, &spec, digits);
 					analog.meaning->channels = g_slist_append(NULL, ch);
-					analog.num_samples = float_data->len;
-					analog.data = (float *)float_data->data;
+					analog.num_samples = len;
+					analog.data = devc->data;
 					analog.meaning->mq = SR_MQ_VOLTAGE;
 					analog.meaning->unit = SR_UNIT_VOLT;
 					analog.meaning->mqflags = 0;
@@ -606,7 +559,6 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 					packet.payload = &analog;
 					sr_session_send(sdi, &packet);
 					g_slist_free(analog.meaning->channels);
-					g_array_free(data, TRUE);
 				}
 				len = 0;
 				if (devc->num_samples == (devc->num_block_bytes - SIGLENT_HEADER_SIZE)) {
@@ -648,7 +600,7 @@ SR_PRIV int siglent_sds_receive(int fd, int revents, void *cb_data)
 			}
 		}
 	} else {
-		if (!siglent_sds_get_digital(sdi, ch))
+		if (siglent_sds_get_digital(sdi, ch) != SR_OK)
 			return TRUE;
 		logic.length = devc->dig_buffer->len;
 		logic.unitsize = 2;
@@ -24,6 +24,7 @@
 #include <glib.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
+#include "transpose.h"
 
 #define LOG_PREFIX "siglent-sds"
 
@@ -153,6 +154,10 @@ struct dev_context {
 	unsigned char *buffer;
 	float *data;
 	GArray *dig_buffer;
+	/* Digital channel bytes interleaved for the transpose. */
+	uint8_t *dig_staging;
+	size_t dig_staging_size;
+	struct sr_transpose transpose;
 };
 
 SR_PRIV int siglent_sds_config_set(const struct sr_dev_inst *sdi,
@@ -0,0 +1,361 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Client of the streaming server in stream_server.c: the device is a
+ * session running on another host, the data its datafeed. Use it with
+ * conn=tcp/<host>/<port>.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include "protocol.h"
+
+static const uint32_t scanopts[] = {
+	SR_CONF_CONN,
+};
+
+static const uint32_t drvopts[] = {
+	SR_CONF_LOGIC_ANALYZER,
+};
+
+static const uint32_t devopts[] = {
+	SR_CONF_CONTINUOUS,
+	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LIMIT_MSEC | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_SAMPLERATE | SR_CONF_GET,
+	SR_CONF_BUFFERSIZE | SR_CONF_GET | SR_CONF_SET,
+};
+
+static struct sr_tcp_dev_inst *parse_conn(const char *conn)
+{
+	struct sr_tcp_dev_inst *tcp;
+	char **fields;
+
+	fields = g_strsplit(conn, "/", 0);
+	tcp = NULL;
+	if (fields[0] && strcmp(fields[0], "tcp") == 0 && fields[1]) {
+		tcp = sr_tcp_dev_inst_new(fields[1],
+			fields[2] && *fields[2] ? fields[2] : STREAM_DEFAULT_PORT);
+		if (fields[2] && sr_tcp_parse_options(&tcp->opts,
+				fields + 3) != SR_OK) {
+			sr_tcp_dev_inst_free(tcp);
+			tcp = NULL;
+		}
+	}
+	g_strfreev(fields);
+
+	return tcp;
+}
+
+static int channel_cmp(gconstpointer a, gconstpointer b)
+{
+	int ia, ib;
+
+	ia = strtol(*(const char *const *)a + strlen("channel "), NULL, 10);
+	ib = strtol(*(const char *const *)b + strlen("channel "), NULL, 10);
+
+	return ia - ib;
+}
+
+/* Create the device as the server describes it. */
+static struct sr_dev_inst *device_new(const char *text, size_t len)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	GKeyFile *kf;
+	GPtrArray *groups;
+	char **names, *name, *type;
+	int index;
+	guint i;
+
+	kf = g_key_file_new();
+	if (!g_key_file_load_from_data(kf, text, len, G_KEY_FILE_NONE, NULL)) {
+		g_key_file_free(kf);
+		return NULL;
+	}
+
+	sdi = g_malloc0(sizeof(*sdi));
+	sdi->status = SR_ST_INACTIVE;
+	sdi->vendor = g_key_file_get_string(kf, "device", "vendor", NULL);
+	sdi->model = g_key_file_get_string(kf, "device", "model", NULL);
+	sdi->version = g_key_file_get_string(kf, "device", "version", NULL);
+	if (!sdi->vendor)
+		sdi->vendor = g_strdup("sigrok");
+	if (!sdi->model)
+		sdi->model = g_strdup("Stream");
+	devc = g_malloc0(sizeof(*devc));
+	sr_sw_limits_init(&devc->limits);
+	devc->window = DEFAULT_WINDOW;
+	devc->samplerate = g_key_file_get_uint64(kf, "device", "samplerate",
+		NULL);
+	sdi->priv = devc;
+
+	names = g_key_file_get_groups(kf, NULL);
+	groups = g_ptr_array_new();
+	for (i = 0; names[i]; i++) {
+		if (g_str_has_prefix(names[i], "channel "))
+			g_ptr_array_add(groups, names[i]);
+	}
+	g_ptr_array_sort(groups, channel_cmp);
+	for (i = 0; i < groups->len; i++) {
+		index = strtol((char *)groups->pdata[i] + strlen("channel "),
+			NULL, 10);
+		name = g_key_file_get_string(kf, groups->pdata[i], "name", NULL);
+		type = g_key_file_get_string(kf, groups->pdata[i], "type", NULL);
+		sr_channel_new(sdi, index, g_strcmp0(type, "analog") == 0 ?
+			SR_CHANNEL_ANALOG : SR_CHANNEL_LOGIC,
+			g_key_file_get_boolean(kf, groups->pdata[i], "enabled",
+				NULL), name);
+		g_free(name);
+		g_free(type);
+	}
+	g_ptr_array_free(groups, TRUE);
+	g_strfreev(names);
+	g_key_file_free(kf);
+
+	return sdi;
+}
+
+static struct sr_dev_inst *probe(struct sr_tcp_dev_inst *tcp)
+{
+	struct sr_dev_inst *sdi;
+	struct stream_frame_header hdr;
+	uint8_t *payload;
+	int codec;
+
+	if (sr_tcp_connect(tcp) != SR_OK)
+		return NULL;
+
+	sdi = NULL;
+	payload = NULL;
+	if (sigrok_stream_send_hello(tcp, 0) != SR_OK ||
+			sigrok_stream_read_frame(tcp, &hdr, &payload,
+				SCAN_TIMEOUT_MS) != SR_OK ||
+			sigrok_stream_check_hello(&hdr, payload, &codec) != SR_OK)
+		goto out;
+	g_free(payload);
+	payload = NULL;
+	if (sigrok_stream_read_frame(tcp, &hdr, &payload,
+			SCAN_TIMEOUT_MS) != SR_OK ||
+			hdr.type != STREAM_FRAME_DEVICE)
+		goto out;
+	sdi = device_new((const char *)payload, hdr.raw_length);
+
+out:
+	g_free(payload);
+	sr_tcp_disconnect(tcp);
+
+	return sdi;
+}
+
+static GSList *scan(struct sr_dev_driver *di, GSList *options)
+{
+	struct sr_config *src;
+	struct sr_dev_inst *sdi;
+	struct sr_tcp_dev_inst *tcp;
+	const char *conn;
+	GSList *l;
+
+	conn = NULL;
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_CONN)
+			conn = g_variant_get_string(src->data, NULL);
+	}
+	if (!conn)
+		return NULL;
+
+	if (!(tcp = parse_conn(conn)))
+		return NULL;
+	if (!(sdi = probe(tcp))) {
+		sr_tcp_dev_inst_free(tcp);
+		return NULL;
+	}
+	sdi->inst_type = SR_INST_USER;
+	sdi->conn = tcp;
+	sdi->connection_id = g_strdup(conn);
+
+	return std_scan_complete(di, g_slist_append(NULL, sdi));
+}
+
+static void clear_helper(struct dev_context *devc)
+{
+	g_free(devc->payload);
+	if (devc->rx)
+		g_byte_array_free(devc->rx, TRUE);
+}
+
+static int dev_clear(const struct sr_dev_driver *di)
+{
+	struct drv_context *drvc;
+	struct sr_dev_inst *sdi;
+	GSList *l;
+
+	if ((drvc = di->context)) {
+		for (l = drvc->instances; l; l = l->next) {
+			sdi = l->data;
+			sr_tcp_dev_inst_free(sdi->conn);
+			sdi->conn = NULL;
+		}
+	}
+
+	return std_dev_clear_with_callback(di,
+		(std_dev_clear_callback)clear_helper);
+}
+
+/* The connection is made per acquisition, the server takes one HELLO. */
+static int dev_open(struct sr_dev_inst *sdi)
+{
+	(void)sdi;
+
+	return SR_OK;
+}
+
+static int dev_close(struct sr_dev_inst *sdi)
+{
+	return sr_tcp_disconnect(sdi->conn);
+}
+
+static int config_get(uint32_t key, GVariant **data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	struct dev_context *devc;
+
+	(void)cg;
+
+	if (!sdi)
+		return SR_ERR_ARG;
+	devc = sdi->priv;
+
+	switch (key) {
+	case SR_CONF_CONN:
+		*data = g_variant_new_string(sdi->connection_id);
+		break;
+	case SR_CONF_SAMPLERATE:
+		*data = g_variant_new_uint64(devc->samplerate);
+		break;
+	case SR_CONF_BUFFERSIZE:
+		*data = g_variant_new_uint64(devc->window);
+		break;
+	case SR_CONF_LIMIT_SAMPLES:
+	case SR_CONF_LIMIT_MSEC:
+		return sr_sw_limits_config_get(&devc->limits, key, data);
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+static int config_set(uint32_t key, GVariant *data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	struct dev_context *devc;
+	uint64_t window;
+
+	(void)cg;
+
+	devc = sdi->priv;
+
+	switch (key) {
+	case SR_CONF_BUFFERSIZE:
+		window = g_variant_get_uint64(data);
+		if (window < MIN_WINDOW || window > G_MAXUINT32)
+			return SR_ERR_ARG;
+		devc->window = window;
+		break;
+	case SR_CONF_LIMIT_SAMPLES:
+	case SR_CONF_LIMIT_MSEC:
+		return sr_sw_limits_config_set(&devc->limits, key, data);
+	default:
+		return SR_ERR_NA;
+	}
+
+	return SR_OK;
+}
+
+static int config_list(uint32_t key, GVariant **data,
+	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
+{
+	return STD_CONFIG_LIST(key, data, sdi, cg, scanopts, drvopts, devopts);
+}
+
+static int dev_acquisition_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sr_tcp_dev_inst *tcp;
+	int ret;
+
+	devc = sdi->priv;
+	tcp = sdi->conn;
+
+	if ((ret = sr_tcp_connect(tcp)) != SR_OK)
+		return ret;
+	if ((ret = sigrok_stream_send_hello(tcp, devc->window)) != SR_OK) {
+		sr_tcp_disconnect(tcp);
+		return ret;
+	}
+
+	if (!devc->rx)
+		devc->rx = g_byte_array_sized_new(READ_CHUNK);
+	g_byte_array_set_size(devc->rx, 0);
+	devc->ungranted = 0;
+	devc->frames_lost = 0;
+	devc->stopping = FALSE;
+	sr_sw_limits_acquisition_start(&devc->limits);
+	std_session_send_df_header(sdi);
+
+	return sr_tcp_source_add(sdi->session, tcp, G_IO_IN, 100,
+		sigrok_stream_receive_data, (void *)sdi);
+}
+
+static int dev_acquisition_stop(struct sr_dev_inst *sdi)
+{
+	struct sr_tcp_dev_inst *tcp;
+
+	tcp = sdi->conn;
+	if (tcp->sock_fd < 0)
+		return SR_OK;
+	sr_tcp_source_remove(sdi->session, tcp);
+	/* The server notices and drops what it had queued for us. */
+	sr_tcp_disconnect(tcp);
+	std_session_send_df_end(sdi);
+
+	return SR_OK;
+}
+
+static struct sr_dev_driver sigrok_stream_driver_info = {
+	.name = "sigrok-stream",
+	.longname = "sigrok stream client",
+	.api_version = 1,
+	.init = std_init,
+	.cleanup = std_cleanup,
+	.scan = scan,
+	.dev_list = std_dev_list,
+	.dev_clear = dev_clear,
+	.config_get = config_get,
+	.config_set = config_set,
+	.config_list = config_list,
+	.dev_open = dev_open,
+	.dev_close = dev_close,
+	.dev_acquisition_start = dev_acquisition_start,
+	.dev_acquisition_stop = dev_acquisition_stop,
+	.context = NULL,
+};
+SR_REGISTER_DEV_DRIVER(sigrok_stream_driver_info);
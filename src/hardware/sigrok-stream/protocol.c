@@ -0,0 +1,397 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "protocol.h"
+
+static int write_all(struct sr_tcp_dev_inst *tcp, const uint8_t *data,
+		size_t len)
+{
+	int ret;
+
+	while (len) {
+		ret = sr_tcp_write_bytes(tcp, data, len);
+		if (ret <= 0)
+			return SR_ERR_IO;
+		data += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+static int send_frame(struct sr_tcp_dev_inst *tcp, uint8_t type,
+		uint32_t arg, const uint8_t *payload, size_t len)
+{
+	struct stream_frame_header hdr;
+	uint8_t buf[STREAM_FRAME_HEADER_SIZE];
+	int ret;
+
+	hdr.length = len;
+	hdr.type = type;
+	hdr.codec = STREAM_CODEC_NONE;
+	hdr.raw_length = len;
+	hdr.arg = arg;
+	sr_stream_header_write(buf, &hdr);
+	if ((ret = write_all(tcp, buf, sizeof(buf))) != SR_OK)
+		return ret;
+
+	return write_all(tcp, payload, len);
+}
+
+SR_PRIV int sigrok_stream_send_hello(struct sr_tcp_dev_inst *tcp,
+		uint32_t credit)
+{
+	uint8_t buf[20];
+
+	memcpy(buf, STREAM_MAGIC, 8);
+	WL32(&buf[8], STREAM_VERSION);
+	WL32(&buf[12], sr_stream_codecs());
+	WL32(&buf[16], credit);
+
+	return send_frame(tcp, STREAM_FRAME_HELLO, 0, buf, sizeof(buf));
+}
+
+static int read_all(struct sr_tcp_dev_inst *tcp, uint8_t *buf, size_t len,
+		int64_t deadline)
+{
+	int ret;
+
+	while (len) {
+		if (g_get_monotonic_time() > deadline)
+			return SR_ERR_TIMEOUT;
+		if (!sr_fd_is_readable(tcp->sock_fd)) {
+			g_usleep(1000);
+			continue;
+		}
+		ret = sr_tcp_read_bytes(tcp, buf, len, FALSE);
+		if (ret <= 0)
+			return SR_ERR_IO;
+		buf += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+/* Read a whole frame during scans, where there's no session yet. */
+SR_PRIV int sigrok_stream_read_frame(struct sr_tcp_dev_inst *tcp,
+		struct stream_frame_header *hdr, uint8_t **payload,
+		int timeout_ms)
+{
+	uint8_t buf[STREAM_FRAME_HEADER_SIZE];
+	uint8_t *wire;
+	int64_t deadline;
+	int ret;
+
+	deadline = g_get_monotonic_time() + timeout_ms * (int64_t)1000;
+	if ((ret = read_all(tcp, buf, sizeof(buf), deadline)) != SR_OK)
+		return ret;
+	if ((ret = sr_stream_header_read(buf, hdr)) != SR_OK)
+		return ret;
+
+	wire = g_malloc(hdr->length + 1);
+	if ((ret = read_all(tcp, wire, hdr->length, deadline)) != SR_OK) {
+		g_free(wire);
+		return ret;
+	}
+	if (hdr->codec == STREAM_CODEC_NONE) {
+		*payload = wire;
+	} else {
+		*payload = g_malloc(hdr->raw_length + 1);
+		ret = sr_stream_decompress(hdr->codec, wire, hdr->length,
+			*payload, hdr->raw_length);
+		g_free(wire);
+		if (ret != SR_OK) {
+			g_free(*payload);
+			return ret;
+		}
+	}
+	/* Text payloads can be used as strings. */
+	(*payload)[hdr->raw_length] = '\0';
+
+	return SR_OK;
+}
+
+SR_PRIV int sigrok_stream_check_hello(const struct stream_frame_header *hdr,
+		const uint8_t *payload, int *codec)
+{
+	uint32_t codecs;
+
+	if (hdr->type != STREAM_FRAME_HELLO || hdr->raw_length < 20 ||
+			memcmp(payload, STREAM_MAGIC, 8) != 0 ||
+			RL32(&payload[8]) != STREAM_VERSION) {
+		sr_err("The server speaks another protocol.");
+		return SR_ERR_DATA;
+	}
+	codecs = RL32(&payload[12]) & sr_stream_codecs();
+	if (!codecs)
+		return SR_ERR_DATA;
+	for (*codec = 0; !(codecs & (1 << *codec)); (*codec)++)
+		;
+
+	return SR_OK;
+}
+
+static void send_meta(const struct sr_dev_inst *sdi, uint32_t key,
+		const uint8_t *payload, size_t len)
+{
+	struct dev_context *devc;
+	const char *type;
+	size_t type_len;
+	void *data;
+	GVariant *v;
+
+	devc = sdi->priv;
+	type = (const char *)payload;
+	type_len = strnlen(type, len);
+	if (type_len == len || !g_variant_type_string_is_valid(type))
+		return;
+	len -= type_len + 1;
+	data = g_malloc(len);
+	memcpy(data, payload + type_len + 1, len);
+	v = g_variant_new_from_data(G_VARIANT_TYPE(type), data, len, FALSE,
+		g_free, data);
+#ifdef WORDS_BIGENDIAN
+	{
+		GVariant *swapped;
+
+		swapped = g_variant_byteswap(v);
+		g_variant_unref(v);
+		v = swapped;
+	}
+#endif
+	if (key == SR_CONF_SAMPLERATE &&
+			g_variant_is_of_type(v, G_VARIANT_TYPE_UINT64))
+		devc->samplerate = g_variant_get_uint64(v);
+	(void)sr_session_send_meta(sdi, key, v);
+}
+
+static void send_logic(const struct sr_dev_inst *sdi, uint16_t unitsize,
+		const uint8_t *data, size_t len)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	uint64_t num_samples;
+
+	devc = sdi->priv;
+	if (!unitsize)
+		return;
+	num_samples = sr_sw_limits_samples_allowed(&devc->limits,
+		len / unitsize);
+	if (!num_samples)
+		return;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.length = num_samples * unitsize;
+	logic.unitsize = unitsize;
+	logic.data = (void *)data;
+	sr_session_send(sdi, &packet);
+	sr_sw_limits_update_samples_read(&devc->limits, num_samples);
+}
+
+static void send_analog(const struct sr_dev_inst *sdi, int index,
+		const uint8_t *payload, size_t len)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct stream_analog sa;
+	struct sr_channel *ch;
+	GSList *l;
+
+	if (len < STREAM_ANALOG_SIZE)
+		return;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->index == index && ch->type == SR_CHANNEL_ANALOG)
+			break;
+	}
+	if (!l)
+		return;
+
+	sr_stream_analog_read(payload, &sa);
+	sr_analog_init(&analog, &encoding, &meaning, &spec, sa.digits);
+	meaning.mq = sa.mq;
+	meaning.unit = sa.unit;
+	meaning.mqflags = sa.mqflags;
+	meaning.channels = g_slist_append(NULL, ch);
+	analog.num_samples = (len - STREAM_ANALOG_SIZE) / sizeof(float);
+	analog.data = (void *)(payload + STREAM_ANALOG_SIZE);
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	sr_session_send(sdi, &packet);
+	g_slist_free(meaning.channels);
+}
+
+static int handle_frame(const struct sr_dev_inst *sdi,
+		const struct stream_frame_header *hdr, const uint8_t *wire)
+{
+	struct dev_context *devc;
+	const uint8_t *payload;
+	int ret;
+
+	devc = sdi->priv;
+	payload = wire;
+	/* Floats in the receive buffer may be unaligned, copy them too. */
+	if (hdr->codec != STREAM_CODEC_NONE ||
+			hdr->type == STREAM_FRAME_ANALOG) {
+		if (devc->payload_size < hdr->raw_length) {
+			g_free(devc->payload);
+			devc->payload = g_malloc(hdr->raw_length);
+			devc->payload_size = hdr->raw_length;
+		}
+		ret = sr_stream_decompress(hdr->codec, wire, hdr->length,
+			devc->payload, hdr->raw_length);
+		if (ret != SR_OK) {
+			sr_err("Cannot decompress a frame from the server.");
+			return ret;
+		}
+		payload = devc->payload;
+	}
+
+	switch (hdr->type) {
+	case STREAM_FRAME_HELLO:
+		if ((ret = sigrok_stream_check_hello(hdr, payload,
+				&devc->codec)) != SR_OK)
+			return ret;
+		sr_dbg("Server uses %s compression.",
+			sr_stream_codec_name(devc->codec));
+		break;
+	case STREAM_FRAME_META:
+		send_meta(sdi, hdr->arg, payload, hdr->raw_length);
+		break;
+	case STREAM_FRAME_LOGIC:
+		send_logic(sdi, hdr->arg, payload, hdr->raw_length);
+		break;
+	case STREAM_FRAME_ANALOG:
+		send_analog(sdi, hdr->arg, payload, hdr->raw_length);
+		break;
+	case STREAM_FRAME_TRIGGER:
+		std_session_send_df_trigger(sdi);
+		break;
+	case STREAM_FRAME_FRAME_BEGIN:
+		std_session_send_df_frame_begin(sdi);
+		break;
+	case STREAM_FRAME_FRAME_END:
+		std_session_send_df_frame_end(sdi);
+		break;
+	case STREAM_FRAME_DROPPED:
+		devc->frames_lost += hdr->arg;
+		sr_warn("Server dropped %u frames, %" PRIu64 " so far.",
+			hdr->arg, devc->frames_lost);
+		break;
+	case STREAM_FRAME_END:
+		sr_info("Remote acquisition ended.");
+		devc->stopping = TRUE;
+		break;
+	default:
+		/* The acquisition here has its own header. */
+		break;
+	}
+	if (hdr->type == STREAM_FRAME_LOGIC || hdr->type == STREAM_FRAME_ANALOG)
+		devc->ungranted += STREAM_FRAME_HEADER_SIZE + hdr->length;
+
+	return SR_OK;
+}
+
+/* Take complete frames from the receive buffer. */
+static int handle_frames(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct stream_frame_header hdr;
+	size_t pos;
+	int ret;
+
+	devc = sdi->priv;
+	pos = 0;
+	ret = SR_OK;
+	while (!devc->stopping &&
+			devc->rx->len - pos >= STREAM_FRAME_HEADER_SIZE) {
+		if ((ret = sr_stream_header_read(devc->rx->data + pos,
+				&hdr)) != SR_OK) {
+			sr_err("Bad frame from the server.");
+			break;
+		}
+		if (devc->rx->len - pos < STREAM_FRAME_HEADER_SIZE + hdr.length)
+			break;
+		ret = handle_frame(sdi, &hdr,
+			devc->rx->data + pos + STREAM_FRAME_HEADER_SIZE);
+		if (ret != SR_OK)
+			break;
+		pos += STREAM_FRAME_HEADER_SIZE + hdr.length;
+		if (sr_sw_limits_check(&devc->limits))
+			devc->stopping = TRUE;
+	}
+	g_byte_array_remove_range(devc->rx, 0, pos);
+
+	return ret;
+}
+
+SR_PRIV int sigrok_stream_receive_data(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct sr_tcp_dev_inst *tcp;
+	size_t total, old_len;
+	int ret;
+
+	(void)fd;
+
+	if (!(sdi = cb_data) || !(devc = sdi->priv))
+		return TRUE;
+	tcp = sdi->conn;
+
+	total = 0;
+	while (total < READ_CHUNK && sr_fd_is_readable(tcp->sock_fd)) {
+		old_len = devc->rx->len;
+		g_byte_array_set_size(devc->rx, old_len + 64 * 1024);
+		ret = sr_tcp_read_bytes(tcp, devc->rx->data + old_len,
+			64 * 1024, FALSE);
+		g_byte_array_set_size(devc->rx, old_len + MAX(ret, 0));
+		if (ret <= 0) {
+			sr_err("Connection to the server lost.");
+			devc->stopping = TRUE;
+			break;
+		}
+		total += ret;
+	}
+	if ((revents & G_IO_IN) && !total && !devc->stopping) {
+		sr_err("Connection to the server closed.");
+		devc->stopping = TRUE;
+	}
+
+	if (handle_frames(sdi) != SR_OK)
+		devc->stopping = TRUE;
+
+	if (!devc->stopping && devc->ungranted >= devc->window / 4) {
+		if (send_frame(tcp, STREAM_FRAME_CREDIT, devc->ungranted,
+				NULL, 0) != SR_OK)
+			devc->stopping = TRUE;
+		devc->ungranted = 0;
+	}
+
+	if (devc->stopping)
+		sr_dev_acquisition_stop(sdi);
+
+	return TRUE;
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_HARDWARE_SIGROK_STREAM_PROTOCOL_H
+#define LIBSIGROK_HARDWARE_SIGROK_STREAM_PROTOCOL_H
+
+#include <stdint.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "stream.h"
+
+#define LOG_PREFIX "sigrok-stream"
+
+/* Credit granted to the server, bytes on the wire. */
+#define DEFAULT_WINDOW		(16 * 1024 * 1024)
+#define MIN_WINDOW		(256 * 1024)
+/* Most bytes to read per callback, so the session stays responsive. */
+#define READ_CHUNK		(1024 * 1024)
+#define SCAN_TIMEOUT_MS		3000
+
+struct dev_context {
+	struct sr_sw_limits limits;
+	uint64_t samplerate;
+	uint64_t window;
+	/* Codec the server chose. */
+	int codec;
+
+	GByteArray *rx;
+	/* Decompressed payload. */
+	uint8_t *payload;
+	size_t payload_size;
+	/* Wire bytes consumed, not granted back yet. */
+	uint64_t ungranted;
+	uint64_t frames_lost;
+	gboolean stopping;
+};
+
+SR_PRIV int sigrok_stream_send_hello(struct sr_tcp_dev_inst *tcp,
+	uint32_t credit);
+SR_PRIV int sigrok_stream_read_frame(struct sr_tcp_dev_inst *tcp,
+	struct stream_frame_header *hdr, uint8_t **payload, int timeout_ms);
+SR_PRIV int sigrok_stream_check_hello(const struct stream_frame_header *hdr,
+	const uint8_t *payload, int *codec);
+SR_PRIV int sigrok_stream_receive_data(int fd, int revents, void *cb_data);
+
+#endif
@@ -29,21 +29,32 @@ static const uint32_t drvopts[] = {
 };
 
 static const uint32_t devopts[] = {
-	SR_CONF_CONTINUOUS,
+	SR_CONF_CONTINUOUS | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_LIMIT_SAMPLES | SR_CONF_GET | SR_CONF_SET,
 	SR_CONF_SAMPLERATE    | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_BUFFERSIZE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_PATTERN_MODE | SR_CONF_GET | SR_CONF_SET | SR_CONF_LIST,
 	SR_CONF_TRIGGER_MATCH | SR_CONF_GET | SR_CONF_LIST,
+	SR_CONF_CAPTURE_RATIO | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_PLAN | SR_CONF_GET,
+	SR_CONF_TRANSFER_COUNT | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_SIZE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_TRANSFER_LATENCY | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_BUFFER_OVERRUNS | SR_CONF_GET,
+	SR_CONF_TRANSFER_STATS | SR_CONF_GET,
+	SR_CONF_SYNC_START | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_SYNC_SKEW | SR_CONF_GET,
+	SR_CONF_RAW_CAPTURE_FILE | SR_CONF_GET | SR_CONF_SET,
+	SR_CONF_LINK_TEST | SR_CONF_GET,
 };
 
 
 static int slogic_lite_8_remote_run(const struct sr_dev_inst *sdi);
 static int slogic_lite_8_remote_stop(const struct sr_dev_inst *sdi);
-static void slogic_lite_8_submit_raw_data(void *data, size_t len, const struct sr_dev_inst *sdi);
+static uint8_t *slogic_lite_8_unpack_raw_data(const struct sr_dev_inst *sdi, uint8_t *dst, uint8_t *src, size_t *len);
 static int slogic_basic_16_remote_run(const struct sr_dev_inst *sdi);
 static int slogic_basic_16_remote_stop(const struct sr_dev_inst *sdi);
-static void slogic_basic_16_submit_raw_data(void *data, size_t len, const struct sr_dev_inst *sdi);
+static uint8_t *slogic_basic_16_unpack_raw_data(const struct sr_dev_inst *sdi, uint8_t *dst, uint8_t *src, size_t *len);
 
 static const struct slogic_model support_models[] = {
 	{
@@ -57,7 +68,9 @@ static const struct slogic_model support_models[] = {
 			.remote_run = slogic_lite_8_remote_run,
 			.remote_stop = slogic_lite_8_remote_stop,
 		},
-		.submit_raw_data = slogic_lite_8_submit_raw_data,
+		.unpack_raw_data = slogic_lite_8_unpack_raw_data,
+		.raw_channels = slogic_lite_8_channels,
+		.raw_layout = SR_RAW_CAPTURE_PACKED,
 	},
 	{
 		.name = "Slogic Basic 16 U3",
@@ -70,7 +83,9 @@ static const struct slogic_model support_models[] = {
 			.remote_run = slogic_basic_16_remote_run,
 			.remote_stop = slogic_basic_16_remote_stop,
 		},
-		.submit_raw_data = slogic_basic_16_submit_raw_data,
+		.unpack_raw_data = slogic_basic_16_unpack_raw_data,
+		.raw_channels = slogic_basic_16_channels,
+		.raw_layout = SR_RAW_CAPTURE_PLANAR,
 	},
 	{
 		.name = NULL,
@@ -131,13 +146,79 @@ static const int32_t trigger_matches[] = {
 
 static struct sr_dev_driver sipeed_slogic_analyzer_driver_info;
 
+/* A device instance of the given model, taking the strings. */
+static struct sr_dev_inst *slogic_dev_new(struct slogic_model *model,
+	struct sr_usb_dev_inst *usb, char *vendor, char *product,
+	char *serial, char *path, int speed)
+{
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct sr_channel *ch;
+	unsigned int i;
+	gchar *channel_name;
+
+	sdi = sr_dev_inst_user_new(vendor, product, NULL);
+	sdi->serial_num = serial;
+	sdi->connection_id = path;
+	sdi->status = SR_ST_INACTIVE;
+	sdi->conn = usb;
+	sdi->inst_type = SR_INST_USB;
+
+	devc = g_malloc0(sizeof(struct dev_context));
+	sdi->priv = devc;
+
+	devc->model = model;
+	devc->unpack = slogic_unpack_impl_get();
+	sr_dbg("Using %s unpack kernels.", devc->unpack->name);
+
+	devc->limit_samplechannel = devc->model->max_samplechannel;
+	devc->limit_samplerate = devc->model->max_bandwidth / devc->model->max_samplechannel;
+
+	devc->cur_samplechannel = devc->limit_samplechannel;
+	devc->cur_samplerate = devc->limit_samplerate;
+	devc->cur_pattern_mode_idx = PATTERN_MODE_NOMAL;
+
+	devc->digital_group = sr_channel_group_new(sdi, "LA", NULL);
+	for (i = 0; i < devc->model->max_samplechannel; i++) {
+		channel_name = g_strdup_printf("D%u", i);
+		ch = sr_channel_new(sdi, i, SR_CHANNEL_LOGIC, TRUE, channel_name);
+		g_free(channel_name);
+		devc->digital_group->channels = g_slist_append(
+			devc->digital_group->channels, ch);
+	}
+
+	devc->speed = speed;
+
+	return sdi;
+}
+
+/* The device of a USB capture being replayed, see sr_usb_replay_device(). */
+static GSList *scan_replay(struct sr_dev_driver *di, uint16_t vid,
+	uint16_t pid, int speed)
+{
+	struct slogic_model *model;
+	struct sr_dev_inst *sdi;
+
+	if (vid != USB_VID_SIPEED)
+		return std_scan_complete(di, NULL);
+	for (model = &support_models[0]; model->name; model++) {
+		if (model->pid != pid)
+			continue;
+		sdi = slogic_dev_new(model, sr_usb_dev_inst_new(0, 0, NULL),
+			g_strdup("Sipeed"), g_strdup(model->name),
+			g_strdup("replay"), g_strdup("replay"), speed);
+		return std_scan_complete(di, g_slist_append(NULL, sdi));
+	}
+
+	return std_scan_complete(di, NULL);
+}
+
 static GSList *scan(struct sr_dev_driver *di, GSList *options)
 {
 	int ret;
 	struct sr_dev_inst *sdi;
 	struct sr_usb_dev_inst *usb;
 	struct drv_context *drvc;
-	struct dev_context *devc;
 
 	struct slogic_model *model;
 	struct sr_config *option;
@@ -147,10 +228,8 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	const char *conn;
 	char cbuf[128];
 	char *iManufacturer, *iProduct, *iSerialNumber, *iPortPath;
-
-	struct sr_channel *ch;
-	unsigned int i;
-	gchar *channel_name;
+	uint16_t vid, pid;
+	int speed;
 
 	(void)options;
 
@@ -159,6 +238,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 	devices = NULL;
 	drvc = di->context;
 	// drvc->instances = NULL;
+
+	if (sr_usb_replay_device(drvc->sr_ctx, &vid, &pid, &speed))
+		return scan_replay(di, vid, pid, speed);
 	
 	/* scan for devices, either based on a SR_CONF_CONN option
 	 * or on a USB scan. */
@@ -199,37 +281,9 @@ static GSList *scan(struct sr_dev_driver *di, GSList *options)
 					cbuf, sizeof(cbuf));
 			iPortPath = g_strdup(cbuf);
 
-			sdi = sr_dev_inst_user_new(iManufacturer, iProduct, NULL);
-			sdi->serial_num = iSerialNumber;
-			sdi->connection_id = iPortPath;
-			sdi->status = SR_ST_INACTIVE;
-			sdi->conn = usb;
-			sdi->inst_type = SR_INST_USB;
-
-			devc = g_malloc0(sizeof(struct dev_context));
-			sdi->priv = devc;
-
-			{
-				devc->model = model;
-
-				devc->limit_samplechannel = devc->model->max_samplechannel;
-				devc->limit_samplerate = devc->model->max_bandwidth / devc->model->max_samplechannel;
-
-				devc->cur_samplechannel = devc->limit_samplechannel;
-				devc->cur_samplerate = devc->limit_samplerate;
-				devc->cur_pattern_mode_idx = PATTERN_MODE_NOMAL;
-
-				devc->digital_group = sr_channel_group_new(sdi, "LA", NULL);
-				for (i = 0; i < devc->model->max_samplechannel; i++) {
-					channel_name = g_strdup_printf("D%u", i);
-					ch = sr_channel_new(sdi, i, SR_CHANNEL_LOGIC, TRUE, channel_name);
-					g_free(channel_name);
-					devc->digital_group->channels = g_slist_append(
-						devc->digital_group->channels, ch);
-				}
-
-				devc->speed = libusb_get_device_speed(libusb_get_device(usb->devhdl));
-			}
+			sdi = slogic_dev_new(model, usb, iManufacturer, iProduct,
+				iSerialNumber, iPortPath,
+				libusb_get_device_speed(libusb_get_device(usb->devhdl)));
 
 			sr_usb_close(usb);
 			devices = g_slist_append(devices, sdi);
@@ -254,6 +308,10 @@ static int dev_open(struct sr_dev_inst *sdi)
 	di	 = sdi->driver;
 	drvc = di->context;
 
+	/* A replayed capture stands in for the device. */
+	if (sr_usb_replay_device(drvc->sr_ctx, NULL, NULL, NULL))
+		return std_dummy_dev_open(sdi);
+
 	ret = sr_usb_open(drvc->sr_ctx->libusb_ctx, usb);
 	if (SR_OK != ret) return ret;
 
@@ -291,6 +349,9 @@ static int dev_close(struct sr_dev_inst *sdi)
 	di	 = sdi->driver;
 	drvc = di->context;
 
+	if (!usb->devhdl)
+		return std_dummy_dev_close(sdi);
+
 	ret = libusb_release_interface(usb->devhdl, 0);
 	if (ret != LIBUSB_SUCCESS) {
 		switch (ret) {
@@ -315,6 +376,8 @@ static int config_get(uint32_t key, GVariant **data,
 {
 	int ret;
 	struct dev_context *devc;
+	struct slogic_transfer_plan plan;
+	char *str;
 
 	(void)cg;
 
@@ -334,6 +397,47 @@ static int config_get(uint32_t key, GVariant **data,
 	case SR_CONF_LIMIT_SAMPLES:
 		*data = g_variant_new_uint64(devc->cur_limit_samples);
 		break;
+	case SR_CONF_CONTINUOUS:
+		*data = g_variant_new_boolean(devc->continuous);
+		break;
+	case SR_CONF_CAPTURE_RATIO:
+		*data = g_variant_new_uint64(devc->capture_ratio);
+		break;
+	case SR_CONF_SYNC_START:
+		*data = g_variant_new_boolean(devc->sync_start);
+		break;
+	case SR_CONF_SYNC_SKEW:
+		*data = g_variant_new_uint64(devc->sync_skew);
+		break;
+	case SR_CONF_BUFFER_OVERRUNS:
+		*data = g_variant_new_uint64(devc->num_overruns);
+		break;
+	case SR_CONF_TRANSFER_STATS:
+		*data = sipeed_slogic_stats_get(devc);
+		break;
+	case SR_CONF_LINK_TEST:
+		*data = sipeed_slogic_link_test_get(devc);
+		break;
+	case SR_CONF_TRANSFER_PLAN:
+		sipeed_slogic_transfer_plan(devc, &plan);
+		str = g_strdup_printf("%zux%" PRIu64 " bytes per %" PRIu64 "ms",
+			plan.depth, plan.nbytes, plan.duration);
+		*data = g_variant_new_string(str);
+		g_free(str);
+		break;
+	case SR_CONF_TRANSFER_COUNT:
+		*data = g_variant_new_uint64(devc->transfer_count);
+		break;
+	case SR_CONF_TRANSFER_SIZE:
+		*data = g_variant_new_uint64(devc->transfer_nbytes);
+		break;
+	case SR_CONF_TRANSFER_LATENCY:
+		*data = g_variant_new_uint64(devc->transfer_latency);
+		break;
+	case SR_CONF_RAW_CAPTURE_FILE:
+		*data = g_variant_new_string(devc->raw_capture_path ?
+			devc->raw_capture_path : "");
+		break;
 	default:
 		return SR_ERR_NA;
 	}
@@ -356,7 +460,7 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_SAMPLERATE:
 		if (g_variant_get_uint64(data) > devc->limit_samplerate || std_u64_idx(data, ARRAY_AND_SIZE(samplerates)) < 0) {
 			devc->cur_samplerate = devc->limit_samplerate;
-			sr_warn("Reach limit or not supported, wrap to %uMHz.", devc->limit_samplerate/SR_MHZ(1));
+			sr_warn("Reach limit or not supported, wrap to %" PRIu64 "MHz.", devc->limit_samplerate/SR_MHZ(1));
 		} else {
 			devc->cur_samplerate = g_variant_get_uint64(data);
 		}
@@ -367,7 +471,7 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_BUFFERSIZE:
 		if (g_variant_get_uint64(data) > devc->limit_samplechannel || std_u64_idx(data, ARRAY_AND_SIZE(buffersizes)) < 0) {
 			devc->cur_samplechannel = devc->limit_samplechannel;
-			sr_warn("Reach limit or not supported, wrap to %uch.", devc->limit_samplechannel);
+			sr_warn("Reach limit or not supported, wrap to %" PRIu64 "ch.", devc->limit_samplechannel);
 		} else {
 			devc->cur_samplechannel = g_variant_get_uint64(data);
 		}
@@ -396,6 +500,30 @@ static int config_set(uint32_t key, GVariant *data,
 	case SR_CONF_LIMIT_SAMPLES:
 		devc->cur_limit_samples = g_variant_get_uint64(data);
 		break;
+	case SR_CONF_CONTINUOUS:
+		devc->continuous = g_variant_get_boolean(data);
+		break;
+	case SR_CONF_CAPTURE_RATIO:
+		devc->capture_ratio = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_SYNC_START:
+		devc->sync_start = g_variant_get_boolean(data);
+		break;
+	case SR_CONF_TRANSFER_COUNT:
+		devc->transfer_count = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_TRANSFER_SIZE:
+		devc->transfer_nbytes = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_TRANSFER_LATENCY:
+		devc->transfer_latency = g_variant_get_uint64(data);
+		break;
+	case SR_CONF_RAW_CAPTURE_FILE:
+		g_free(devc->raw_capture_path);
+		devc->raw_capture_path = NULL;
+		if (*g_variant_get_string(data, NULL))
+			devc->raw_capture_path = g_variant_dup_string(data, NULL);
+		break;
 	default:
 		ret = SR_ERR_NA;
 	}
@@ -403,6 +531,23 @@ static int config_set(uint32_t key, GVariant *data,
 	return ret;
 }
 
+/*
+ * Entries of the ascending samplerates[] or buffersizes[] up to the
+ * device limit, and once a link test ran, up to what the link kept up
+ * with at the other current setting. The lowest entry always stays.
+ */
+static size_t list_within_budget(const uint64_t *list, size_t count,
+	uint64_t limit, uint64_t other, uint64_t budget)
+{
+	size_t n;
+
+	n = 1 + std_u64_idx(g_variant_new_uint64(limit), list, count);
+	while (n > 1 && budget != UINT64_MAX && list[n - 1] * other / 8 > budget)
+		n--;
+
+	return n;
+}
+
 static int config_list(uint32_t key, GVariant **data,
 	const struct sr_dev_inst *sdi, const struct sr_channel_group *cg)
 {
@@ -420,10 +565,16 @@ static int config_list(uint32_t key, GVariant **data,
 		ret = STD_CONFIG_LIST(key, data, sdi, cg, scanopts, drvopts, devopts);
 		break;
 	case SR_CONF_SAMPLERATE:
-		*data = std_gvar_samplerates(samplerates, 1+std_u64_idx(g_variant_new_uint64(devc->limit_samplerate), ARRAY_AND_SIZE(samplerates)));
+		*data = std_gvar_samplerates(samplerates,
+			list_within_budget(ARRAY_AND_SIZE(samplerates),
+				devc->limit_samplerate, devc->cur_samplechannel,
+				sipeed_slogic_link_budget(devc)));
 		break;
 	case SR_CONF_BUFFERSIZE:
-		*data = std_gvar_array_u64(buffersizes, 1+std_u64_idx(g_variant_new_uint64(devc->limit_samplechannel), ARRAY_AND_SIZE(buffersizes)));
+		*data = std_gvar_array_u64(buffersizes,
+			list_within_budget(ARRAY_AND_SIZE(buffersizes),
+				devc->limit_samplechannel, devc->cur_samplerate,
+				sipeed_slogic_link_budget(devc)));
 		break;
 	case SR_CONF_PATTERN_MODE:
 		*data = g_variant_new_strv(ARRAY_AND_SIZE(patterns));
@@ -438,6 +589,16 @@ static int config_list(uint32_t key, GVariant **data,
 	return ret;
 }
 
+static void clear_helper(struct dev_context *devc)
+{
+	g_free(devc->raw_capture_path);
+}
+
+static int dev_clear(const struct sr_dev_driver *di)
+{
+	return std_dev_clear_with_callback(di, (std_dev_clear_callback)clear_helper);
+}
+
 static struct sr_dev_driver sipeed_slogic_analyzer_driver_info = {
 	.name = "sipeed-slogic-analyzer",
 	.longname = "Sipeed Slogic Analyzer",
@@ -446,7 +607,7 @@ static struct sr_dev_driver sipeed_slogic_analyzer_driver_info = {
 	.cleanup = std_cleanup,
 	.scan = scan,
 	.dev_list = std_dev_list,
-	.dev_clear = std_dev_clear,
+	.dev_clear = dev_clear,
 	.config_get = config_get,
 	.config_set = config_set,
 	.config_list = config_list,
@@ -499,39 +660,28 @@ static int slogic_lite_8_remote_stop(const struct sr_dev_inst *sdi) {
 	// return ret;
 }
 
-static void slogic_lite_8_submit_raw_data(void *data, size_t len, const struct sr_dev_inst *sdi) {
+/* Called from the unpack thread in pipelined mode. */
+static uint8_t *slogic_lite_8_unpack_raw_data(const struct sr_dev_inst *sdi, uint8_t *dst, uint8_t *src, size_t *len) {
 	struct dev_context *devc = sdi->priv;
+	size_t n;
 
-	size_t length = len * (8/devc->cur_samplechannel);
-	uint8_t *ptr = g_malloc(length);
-
-	for(size_t i=0; i<len; i+=devc->cur_samplechannel) {
-		for(size_t j=0; j<8; j++) {
-			ptr[i*(8/devc->cur_samplechannel)+j] = (((uint8_t *)data)[i+j/(8/devc->cur_samplechannel)] >> (j%(8/devc->cur_samplechannel) * devc->cur_samplechannel)) & ((1<<devc->cur_samplechannel)-1);
-			// switch (devc->cur_samplechannel) {
-			// case 8:
-			// 	ptr[i*1+j] = (((uint8_t *)data)[i+j/1] >> (j%1 * 8)) & 0xff;
-			// break;
-			// case 4:
-			// 	ptr[i*2+j] = (((uint8_t *)data)[i+j/2] >> (j%2 * 4)) & 0xf;
-			// break;
-			// case 2:
-			// 	ptr[i*4+j] = (((uint8_t *)data)[i+j/4] >> (j%4 * 2)) & 0x3;
-			// break;
-			// }
-		}
+	/* Only complete blocks can be unpacked. */
+	n = *len - *len % devc->cur_samplechannel;
+
+	/* Packed samples get passed on as they are, see send_logic(). */
+	if (devc->packed_bits) {
+		*len = n;
+		return src;
 	}
+	*len = slogic_lite_8_unpacked_len(n, devc->cur_samplechannel);
 
-	sr_session_send(sdi, &(struct sr_datafeed_packet) {
-		.type = SR_DF_LOGIC,
-		.payload = &(struct sr_datafeed_logic) {
-			.length = length,
-			.unitsize = 1,
-			.data = ptr,
-		}
-	});
+	/* Already one sample per byte, send the transfer buffer as is. */
+	if (devc->cur_samplechannel == 8)
+		return src;
 
-	g_free(ptr);
+	devc->unpack->lite_8(dst, src, n, devc->cur_samplechannel);
+
+	return dst;
 }
 /* Slogic Lite 8 end */
 
@@ -551,49 +701,18 @@ static int slogic_basic_16_remote_stop(const struct sr_dev_inst *sdi) {
 	return slogic_usb_control_write(sdi, SLOGIC_BASIC_16_CONTROL_OUT_REQ_REG_WRITE, 0x0004, 0x0000, ARRAY_AND_SIZE(cmd_rst), 500);
 }
 
-static void slogic_basic_16_submit_raw_data(void *data, size_t len, const struct sr_dev_inst *sdi) {
+/* Called from the unpack thread in pipelined mode. */
+static uint8_t *slogic_basic_16_unpack_raw_data(const struct sr_dev_inst *sdi, uint8_t *dst, uint8_t *src, size_t *len) {
 	struct dev_context *devc = sdi->priv;
+	size_t n;
 
-	size_t length = len * ((devc->cur_samplechannel>=8)?:(8/devc->cur_samplechannel));
-	uint8_t *ptr = g_malloc(length);
-
-	for(size_t i=0; i<len; i+=devc->cur_samplechannel) {
-		for(size_t j=0; j<8; j++) {
-			#define B(n) (((((uint8_t *)data)[i+(n)] >> 7-j) & 0x1) << ((n)%8))
-			switch (devc->cur_samplechannel) {
-			case 16:
-				ptr[i+j*2+0] =
-					B(0)|B(1)|B(2)|B(3)|B(4)|B(5)|B(6)|B(7);
-				ptr[i+j*2+1] =
-					B(8)|B(9)|B(10)|B(11)|B(12)|B(13)|B(14)|B(15);
-			break;
-			case 8:
-				ptr[i+j] =
-					B(0)|B(1)|B(2)|B(3)|B(4)|B(5)|B(6)|B(7);
-			break;
-			case 4:
-				ptr[i*2+j] =
-					B(0)|B(1)|B(2)|B(3);
-			break;
-			case 2:
-				ptr[i*4+j] =
-					B(0)|B(1);
-			break;
-			}
-			#undef B
-		}
-	}
+	/* Only complete blocks can be unpacked. */
+	n = *len - *len % devc->cur_samplechannel;
+	*len = slogic_basic_16_unpacked_len(n, devc->cur_samplechannel);
 
-	sr_session_send(sdi, &(struct sr_datafeed_packet) {
-		.type = SR_DF_LOGIC,
-		.payload = &(struct sr_datafeed_logic) {
-			.length = length,
-			.unitsize = (devc->cur_samplechannel + 7)/8,
-			.data = ptr,
-		}
-	});
+	devc->unpack->basic_16(dst, src, n, devc->cur_samplechannel);
 
-	g_free(ptr);
+	return dst;
 }
 /* Slogic Basic 16 end */
 
@@ -602,17 +721,19 @@ static int slogic_usb_control_write(const struct sr_dev_inst *sdi, uint8_t reque
 	int ret;
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
+	struct drv_context *drvc;
 
 	devc = sdi->priv;
 	usb  = sdi->conn;
+	drvc = sdi->driver->context;
 
-	sr_spew("%s req:%u value:%u index:%u %p:%u in %dms.", __func__, request, value, index, data, len, timeout);
+	sr_spew("%s req:%u value:%u index:%u %p:%zu in %dms.", __func__, request, value, index, data, len, timeout);
 	if (!data && len) {
-		sr_warn("%s Nothing to write although len(%u)>0!", __func__, len);
+		sr_warn("%s Nothing to write although len(%zu)>0!", __func__, len);
 		len = 0;
 	}
 
-	if ((ret = libusb_control_transfer(
+	if ((ret = sr_usb_control_transfer(drvc->sr_ctx,
 		usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT,
 		request,
 		value, index,
@@ -631,17 +752,19 @@ static int slogic_usb_control_read(const struct sr_dev_inst *sdi, uint8_t reques
 	int ret;
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
+	struct drv_context *drvc;
 
 	devc = sdi->priv;
 	usb  = sdi->conn;
+	drvc = sdi->driver->context;
 
-	sr_spew("%s req:%u value:%u index:%u %p:%u in %dms.", __func__, request, value, index, data, len, timeout);
+	sr_spew("%s req:%u value:%u index:%u %p:%zu in %dms.", __func__, request, value, index, data, len, timeout);
 	if (!data && len) {
-		sr_err("%s Can't read to NULL while len(%u)>0!", __func__, len);
+		sr_err("%s Can't read to NULL while len(%zu)>0!", __func__, len);
 		return SR_ERR_ARG;
 	}
 
-	if ((ret = libusb_control_transfer(
+	if ((ret = sr_usb_control_transfer(drvc->sr_ctx,
 		usb->devhdl, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_IN,
 		request,
 		value, index,
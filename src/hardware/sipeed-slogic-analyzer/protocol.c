@@ -18,92 +18,1131 @@
  */
 
 #include <config.h>
+#include <math.h>
 #include "protocol.h"
 
-static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer) {
+SR_PRIV int sipeed_slogic_unpack_pool_alloc(struct dev_context *devc, size_t size)
+{
+	size_t i;
+
+	sipeed_slogic_unpack_pool_free(devc);
+
+	for (i = 0; i < NUM_UNPACK_BUFFERS; i++) {
+		devc->unpack_buffers[i] = g_try_malloc(size);
+		if (!devc->unpack_buffers[i]) {
+			sr_err("Failed to allocate unpack buffer[%zu]: %zu bytes.", i, size);
+			sipeed_slogic_unpack_pool_free(devc);
+			return SR_ERR_MALLOC;
+		}
+	}
+	devc->unpack_buffer_size = size;
+	devc->unpack_buffer_next = 0;
+	sr_dbg("Allocated %u unpack buffers of %zu bytes.", NUM_UNPACK_BUFFERS, size);
+
+	return SR_OK;
+}
+
+SR_PRIV void sipeed_slogic_unpack_pool_free(struct dev_context *devc)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_UNPACK_BUFFERS; i++) {
+		g_free(devc->unpack_buffers[i]);
+		devc->unpack_buffers[i] = NULL;
+	}
+	devc->unpack_buffer_size = 0;
+	devc->unpack_buffer_next = 0;
+}
+
+/*
+ * Hand out the next buffer of the ring, when unpacking on the thread
+ * servicing the device. The packets are sent with sr_session_send(),
+ * consumers copy what they keep before it returns, so the buffer is
+ * free again right away. With pipelining, the buffers go round the
+ * unpack queue instead.
+ */
+SR_PRIV uint8_t *sipeed_slogic_unpack_buffer_get(struct dev_context *devc)
+{
+	uint8_t *buf;
+
+	buf = devc->unpack_buffers[devc->unpack_buffer_next];
+	devc->unpack_buffer_next = (devc->unpack_buffer_next + 1) % NUM_UNPACK_BUFFERS;
+
+	return buf;
+}
+
+struct drain_state {
+	int pending;
+	int done;
+	gboolean idle;
+	gboolean cancelled;
+	uint64_t bytes;
+};
+
+static void LIBUSB_CALL drain_transfer_cb(struct libusb_transfer *transfer)
+{
+	struct drain_state *ds = transfer->user_data;
+
+	ds->bytes += transfer->actual_length;
+
+	/* A transfer which times out without data: the FIFO is empty. */
+	if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT &&
+			!transfer->actual_length)
+		ds->idle = TRUE;
+
+	if (!ds->idle && !ds->cancelled &&
+			(transfer->status == LIBUSB_TRANSFER_COMPLETED ||
+			transfer->status == LIBUSB_TRANSFER_TIMED_OUT) &&
+			libusb_submit_transfer(transfer) == LIBUSB_SUCCESS)
+		return;
+
+	if (--ds->pending == 0)
+		ds->done = 1;
+}
+
+/* The old way, one small synchronous read after the other. */
+static void drain_ep_sync(struct sr_usb_dev_inst *usb, uint8_t ep)
+{
+	uint8_t tmp[1024];
+	int actual_length;
+
+	do {
+		actual_length = 0;
+		libusb_bulk_transfer(usb->devhdl, ep,
+				tmp, sizeof(tmp), &actual_length, 100);
+	} while (actual_length);
+}
+
+/*
+ * Throw away what the device still has queued from an earlier capture.
+ * Several large reads are kept in flight, so megabytes of stale data
+ * go at link speed. Done once a read times out empty, or at the
+ * deadline.
+ */
+SR_PRIV void sipeed_slogic_drain_ep(const struct sr_dev_inst *sdi,
+	unsigned int deadline_ms)
+{
+	struct dev_context *devc = sdi->priv;
+	struct sr_usb_dev_inst *usb = sdi->conn;
+	struct drv_context *drvc = sdi->driver->context;
+	struct libusb_transfer *transfers[NUM_DRAIN_TRANSFERS];
+	uint8_t *bufs[NUM_DRAIN_TRANSFERS];
+	struct drain_state ds;
+	struct timeval tv;
+	int64_t start, deadline;
+	uint8_t ep = devc->model->ep_in;
+	size_t i;
+
+	memset(&ds, 0, sizeof(ds));
+	memset(transfers, 0, sizeof(transfers));
+	memset(bufs, 0, sizeof(bufs));
+	start = g_get_monotonic_time();
+	deadline = start + (int64_t)deadline_ms * 1000;
+
+	for (i = 0; i < NUM_DRAIN_TRANSFERS; i++) {
+		bufs[i] = sr_usb_buffer_alloc(usb, DRAIN_TRANSFER_NBYTES);
+		transfers[i] = libusb_alloc_transfer(0);
+		if (!bufs[i] || !transfers[i])
+			break;
+		libusb_fill_bulk_transfer(transfers[i], usb->devhdl, ep,
+			bufs[i], DRAIN_TRANSFER_NBYTES, drain_transfer_cb, &ds,
+			DRAIN_IDLE_TIMEOUT);
+		if (libusb_submit_transfer(transfers[i]) != LIBUSB_SUCCESS)
+			break;
+		ds.pending++;
+	}
+
+	if (!ds.pending) {
+		sr_dbg("Async drain unavailable, draining synchronously.");
+		drain_ep_sync(usb, ep);
+	}
+
+	while (ds.pending) {
+		if (!ds.cancelled && (ds.idle ||
+				g_get_monotonic_time() >= deadline)) {
+			if (!ds.idle)
+				sr_warn("EP 0x%02x still busy after %u ms.",
+					ep, deadline_ms);
+			ds.cancelled = TRUE;
+			for (i = 0; i < NUM_DRAIN_TRANSFERS && transfers[i]; i++)
+				libusb_cancel_transfer(transfers[i]);
+		}
+		tv.tv_sec = 0;
+		tv.tv_usec = DRAIN_IDLE_TIMEOUT * 1000;
+		libusb_handle_events_timeout_completed(
+			drvc->sr_ctx->libusb_ctx, &tv, &ds.done);
+	}
+
+	for (i = 0; i < NUM_DRAIN_TRANSFERS; i++) {
+		libusb_free_transfer(transfers[i]);
+		sr_usb_buffer_free(usb, bufs[i], DRAIN_TRANSFER_NBYTES);
+	}
+
+	sr_dbg("Cleared EP: 0x%02x, %" PRIu64 " bytes in %" PRIi64 " ms.",
+		ep, ds.bytes, (g_get_monotonic_time() - start) / 1000);
+}
+
+/* Usable bulk throughput of the link in bytes per second. */
+static uint64_t link_bandwidth(enum libusb_speed speed)
+{
+	switch (speed) {
+	case LIBUSB_SPEED_LOW:
+		return 150 * 1000 / 8;
+	case LIBUSB_SPEED_FULL:
+		return 1000 * 1000;
+	case LIBUSB_SPEED_HIGH:
+		return 40 * 1000 * 1000;
+	case LIBUSB_SPEED_SUPER:
+		return 400 * 1000 * 1000;
+	default:
+		/* Unknown or faster, not a reason to limit anything. */
+		return UINT64_MAX;
+	}
+}
+
+/*
+ * Linux limits the memory of all in-flight usbfs transfers, 16MiB by
+ * default. Use the configured limit where it can be read.
+ */
+static uint64_t inflight_budget(void)
+{
+	gchar *contents;
+	uint64_t mb;
+
+	contents = NULL;
+	if (!g_file_get_contents("/sys/module/usbcore/parameters/usbfs_memory_mb",
+			&contents, NULL, NULL))
+		return TRANSFERS_INFLIGHT_MAX_NBYTES;
+	mb = g_ascii_strtoull(contents, NULL, 10);
+	g_free(contents);
+	if (!mb)
+		return UINT64_MAX;
+
+	return mb * 1024 * 1024;
+}
+
+/*
+ * Size the bulk transfers up front, instead of probing what the host
+ * accepts. A transfer carries TRANSFERS_LATENCY_TARGET ms worth of data,
+ * enough of them are queued to cover TRANSFERS_QUEUE_DURATION ms within
+ * the in-flight memory budget. The SR_CONF_TRANSFER_* options override
+ * the size, latency and count, within the same limits.
+ */
+SR_PRIV void sipeed_slogic_transfer_plan(const struct dev_context *devc,
+	struct slogic_transfer_plan *plan)
+{
+	uint64_t rate, link, nbytes, depth, budget, latency;
+
+	rate = devc->cur_samplerate * devc->cur_samplechannel / 8;
+	rate = MIN(rate, devc->model->max_bandwidth / 8);
+	rate = MAX(rate, 1);
+	link = link_bandwidth(devc->speed);
+	if (rate > link)
+		sr_warn("%" PRIu64 "B/s exceeds what the link can do (%" PRIu64 "B/s).",
+			rate, link);
+
+	latency = devc->transfer_latency ? devc->transfer_latency : TRANSFERS_LATENCY_TARGET;
+	nbytes = devc->transfer_nbytes ? devc->transfer_nbytes : rate * latency / 1000;
+	nbytes = (nbytes + TRANSFER_NBYTES_ALIGN - 1) & ~(uint64_t)(TRANSFER_NBYTES_ALIGN - 1);
+	nbytes = CLAMP(nbytes, TRANSFER_NBYTES_MIN, TRANSFER_NBYTES_MAX);
+
+	budget = inflight_budget();
+	if (devc->transfer_count)
+		depth = devc->transfer_count;
+	else
+		depth = (rate * TRANSFERS_QUEUE_DURATION / 1000 + nbytes - 1) / nbytes;
+	depth = MIN(depth, budget / nbytes);
+	depth = CLAMP(depth, 2, NUM_MAX_TRANSFERS);
+
+	plan->nbytes = nbytes;
+	plan->duration = MAX(nbytes * 1000 / rate, 1);
+	plan->depth = depth;
+}
+
+static void send_dense(const struct sr_dev_inst *sdi, uint8_t *samples, size_t len)
+{
+	struct dev_context *devc = sdi->priv;
+
+	sr_session_send(sdi, &(struct sr_datafeed_packet) {
+		.type = SR_DF_LOGIC,
+		.payload = &(struct sr_datafeed_logic) {
+			.length = len,
+			.unitsize = (devc->cur_samplechannel + 7) / 8,
+			.data = samples,
+		}
+	});
+}
+
+/* Send what unpack_raw_data() made, len bytes of packed or dense samples. */
+static void send_logic(const struct sr_dev_inst *sdi, uint8_t *samples, size_t len)
+{
+	struct dev_context *devc = sdi->priv;
+
+	if (!devc->packed_bits) {
+		send_dense(sdi, samples, len);
+		return;
+	}
+	sr_session_send(sdi, &(struct sr_datafeed_packet) {
+		.type = SR_DF_LOGIC_PACKED,
+		.payload = &(struct sr_datafeed_logic_packed) {
+			.num_samples = len * 8 / devc->packed_bits,
+			.bits_per_sample = devc->packed_bits,
+			.data = samples,
+		}
+	});
+}
 
+/*
+ * Like send_logic(), with the trigger after the first split samples.
+ * Packed samples split within a byte send that byte dense.
+ */
+static void send_logic_trigger(const struct sr_dev_inst *sdi, uint8_t *samples,
+	size_t len, size_t split)
+{
+	struct dev_context *devc = sdi->priv;
+	unsigned int bits = devc->packed_bits;
+	size_t unitsize, per_byte, at, head;
+	uint8_t dense[8];
+
+	if (!bits) {
+		unitsize = (devc->cur_samplechannel + 7) / 8;
+		split = MIN(split * unitsize, len);
+		send_logic(sdi, samples, split);
+		std_session_send_df_trigger(sdi);
+		send_logic(sdi, samples + split, len - split);
+		return;
+	}
+
+	per_byte = 8 / bits;
+	split = MIN(split, len * per_byte);
+	at = split / per_byte;
+	head = split % per_byte;
+	send_logic(sdi, samples, at);
+	if (head) {
+		sr_logic_packed_to_dense(&(struct sr_datafeed_logic_packed) {
+				.num_samples = per_byte,
+				.bits_per_sample = bits,
+				.data = samples + at,
+			}, 0, per_byte, dense);
+		send_dense(sdi, dense, head);
+		std_session_send_df_trigger(sdi);
+		send_dense(sdi, dense + head, per_byte - head);
+		at++;
+	} else {
+		std_session_send_df_trigger(sdi);
+	}
+	send_logic(sdi, samples + at, len - at);
+}
+
+/* Unpack and send in one go, used when not running pipelined. */
+static void submit_raw_data(const struct sr_dev_inst *sdi, uint8_t *data, size_t len)
+{
+	struct dev_context *devc = sdi->priv;
+	uint8_t *samples;
+
+	if (devc->raw_capture) {
+		sr_raw_capture_write(devc->raw_capture, data, len);
+		return;
+	}
+
+	samples = devc->model->unpack_raw_data(sdi,
+		sipeed_slogic_unpack_buffer_get(devc), data, &len);
+	send_logic(sdi, samples, len);
+}
+
+/* Like submit_raw_data(), for more than a transfer's worth of data. */
+static void submit_raw_chunked(const struct sr_dev_inst *sdi, uint8_t *data, size_t len)
+{
+	struct dev_context *devc = sdi->priv;
+	size_t n;
+
+	while (len) {
+		n = MIN(len, devc->per_transfer_nbytes);
+		submit_raw_data(sdi, data, n);
+		data += n;
+		len -= n;
+	}
+}
+
+/*
+ * Host side trigger, evaluated on the raw device format one block
+ * (channels bytes, 8 samples) at a time. Nothing is unpacked until it
+ * fires, the last raw blocks are kept in a ring for the pre-trigger
+ * part instead.
+ */
+static int raw_trigger_init(struct dev_context *devc)
+{
+	uint64_t samples, nbytes;
+
+	g_free(devc->pre_trigger);
+	devc->pre_trigger = NULL;
+	devc->trigger_last = 0;
+	devc->trigger_have_last = FALSE;
+	devc->pre_trigger_head = 0;
+	devc->pre_trigger_fill = 0;
+	devc->pre_trigger_size = 0;
+
+	samples = devc->cur_limit_samples * devc->capture_ratio / 100;
+	nbytes = (samples + 7) / 8 * devc->cur_samplechannel;
+	if (!nbytes)
+		return SR_OK;
+
+	devc->pre_trigger = g_try_malloc(nbytes);
+	if (!devc->pre_trigger) {
+		sr_err("Pre-trigger buffer malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+	devc->pre_trigger_size = nbytes;
+
+	return SR_OK;
+}
+
+static void raw_trigger_free(struct dev_context *devc)
+{
+	g_free(devc->pre_trigger);
+	devc->pre_trigger = NULL;
+	devc->pre_trigger_size = 0;
+}
+
+/* Returns the first matching sample, or -1. */
+static int64_t raw_trigger_find(struct dev_context *devc, const uint8_t *data, size_t len)
+{
+	const struct slogic_trigger_cfg *t = &devc->trigger;
+	unsigned int ch = devc->cur_samplechannel;
+	unsigned int c, k;
+	uint8_t vec[32], cur, prev, match;
+	uint32_t bit, last;
+	size_t i;
+
+	for (i = 0; i + ch <= len; i += ch) {
+		devc->model->raw_channels(vec, &data[i], ch);
+		match = 0xff;
+		last = 0;
+		for (c = 0; c < ch; c++) {
+			bit = UINT32_C(1) << c;
+			cur = vec[c];
+			if (cur & 0x1)
+				last |= bit;
+			if (!(t->mask & bit))
+				continue;
+			prev = (cur >> 1) | ((devc->trigger_last & bit) ? 0x80 : 0);
+			if (t->level & bit)
+				match &= (t->value & bit) ? cur : ~cur;
+			else if (t->any_edge & bit)
+				match &= cur ^ prev;
+			else if (t->value & bit)
+				match &= cur & ~prev;
+			else
+				match &= ~cur & prev;
+		}
+		/* The very first sample can't be an edge. */
+		if (!devc->trigger_have_last && (t->mask & ~t->level))
+			match &= 0x7f;
+		devc->trigger_last = last;
+		devc->trigger_have_last = TRUE;
+		if (match) {
+			for (k = 0; !(match & (0x80 >> k)); k++);
+			return (i / ch) * 8 + k;
+		}
+	}
+
+	return -1;
+}
+
+static void raw_trigger_keep(struct dev_context *devc, const uint8_t *data, size_t len)
+{
+	size_t n;
+
+	if (len > devc->pre_trigger_size) {
+		data += len - devc->pre_trigger_size;
+		len = devc->pre_trigger_size;
+	}
+	devc->pre_trigger_fill = MIN(devc->pre_trigger_fill + len, devc->pre_trigger_size);
+	while (len) {
+		n = MIN(len, devc->pre_trigger_size - devc->pre_trigger_head);
+		memcpy(&devc->pre_trigger[devc->pre_trigger_head], data, n);
+		devc->pre_trigger_head = (devc->pre_trigger_head + n) % devc->pre_trigger_size;
+		data += n;
+		len -= n;
+	}
+}
+
+/* Send the last len bytes of the pre-trigger ring. */
+static void raw_trigger_send_kept(const struct sr_dev_inst *sdi, size_t len)
+{
+	struct dev_context *devc = sdi->priv;
+	size_t pos, n;
+
+	if (!len)
+		return;
+	pos = (devc->pre_trigger_head + devc->pre_trigger_size - len) % devc->pre_trigger_size;
+	while (len) {
+		n = MIN(len, devc->pre_trigger_size - pos);
+		submit_raw_chunked(sdi, &devc->pre_trigger[pos], n);
+		pos = (pos + n) % devc->pre_trigger_size;
+		len -= n;
+	}
+}
+
+/*
+ * Look for the trigger in a transfer. Once it fires, the pre-trigger
+ * data and this transfer go out right here. That's ahead of anything
+ * in the pipeline, which stays empty until then.
+ */
+static void raw_trigger_check(const struct sr_dev_inst *sdi, uint8_t *data, size_t len)
+{
+	struct dev_context *devc = sdi->priv;
+	unsigned int ch = devc->cur_samplechannel;
+	size_t blk, start, kept;
+	int64_t pos;
+	uint8_t *samples;
+
+	len -= len % ch;
+	pos = raw_trigger_find(devc, data, len);
+	if (pos < 0) {
+		raw_trigger_keep(devc, data, len);
+		return;
+	}
+
+	sr_dbg("Host side trigger at sample %" PRIi64 " of the transfer.", pos);
+	devc->trigger_fired = TRUE;
+
+	/* Keep the pre-trigger size, counting data ahead in this transfer. */
+	blk = pos / 8 * ch;
+	if (blk >= devc->pre_trigger_size) {
+		start = blk - devc->pre_trigger_size;
+		kept = 0;
+	} else {
+		start = 0;
+		kept = MIN(devc->pre_trigger_fill, devc->pre_trigger_size - blk);
+	}
+	/* The ring is whole blocks, it can hold more than the sample limit. */
+	if (!devc->streaming)
+		kept = MIN(kept, devc->samples_need_nbytes - devc->samples_got_nbytes);
+	raw_trigger_send_kept(sdi, kept);
+	devc->samples_got_nbytes += kept;
+
+	len -= start;
+	if (!devc->streaming && len > devc->samples_need_nbytes - devc->samples_got_nbytes)
+		len = devc->samples_need_nbytes - devc->samples_got_nbytes;
+	devc->samples_got_nbytes += len;
+
+	samples = devc->model->unpack_raw_data(sdi,
+		sipeed_slogic_unpack_buffer_get(devc), data + start, &len);
+	send_logic_trigger(sdi, samples, len, pos - start / ch * 8);
+}
+
+static gboolean spsc_push(struct slogic_spsc_queue *q, gpointer item)
+{
+	gint tail, next;
+
+	tail = q->tail;
+	next = (tail + 1) % PIPELINE_QUEUE_SIZE;
+	if (next == g_atomic_int_get(&q->head))
+		return FALSE;
+	q->items[tail] = item;
+	g_atomic_int_set(&q->tail, next);
+
+	return TRUE;
+}
+
+static gpointer spsc_pop(struct slogic_spsc_queue *q)
+{
+	gint head;
+	gpointer item;
+
+	head = q->head;
+	if (head == g_atomic_int_get(&q->tail))
+		return NULL;
+	item = q->items[head];
+	g_atomic_int_set(&q->head, (head + 1) % PIPELINE_QUEUE_SIZE);
+
+	return item;
+}
+
+static gboolean spsc_empty(struct slogic_spsc_queue *q)
+{
+	return g_atomic_int_get(&q->head) == g_atomic_int_get(&q->tail);
+}
+
+static void pipeline_wake(struct dev_context *devc)
+{
+	g_mutex_lock(&devc->worker_mutex);
+	devc->worker_wake = TRUE;
+	g_cond_signal(&devc->worker_cond);
+	g_mutex_unlock(&devc->worker_mutex);
+}
+
+/*
+ * Worker thread: take filled raw buffers from the USB side, unpack them
+ * into a free unpack buffer and pass the result back to the thread that
+ * handles the USB events. That is the USB event thread if enabled, the
+ * session thread otherwise. This thread never talks to the session itself.
+ */
+static gpointer pipeline_worker(gpointer data)
+{
+	const struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct slogic_pipeline_buffer *desc;
+	uint8_t *unpack;
+
+	sdi = data;
+	devc = sdi->priv;
+
+	unpack = NULL;
+	for (;;) {
+		if (!unpack && !devc->raw_capture)
+			unpack = spsc_pop(&devc->unpack_queue);
+		desc = (unpack || devc->raw_capture) ?
+			spsc_pop(&devc->fill_queue) : NULL;
+		if (!desc) {
+			if (g_atomic_int_get(&devc->worker_stop) &&
+					spsc_empty(&devc->fill_queue))
+				break;
+			g_mutex_lock(&devc->worker_mutex);
+			if (!devc->worker_wake)
+				g_cond_wait_until(&devc->worker_cond, &devc->worker_mutex,
+					g_get_monotonic_time() + 10 * G_TIME_SPAN_MILLISECOND);
+			devc->worker_wake = FALSE;
+			g_mutex_unlock(&devc->worker_mutex);
+			continue;
+		}
+
+		if (devc->raw_capture) {
+			/* Straight to disk, unpacked later by the input module. */
+			sr_raw_capture_write(devc->raw_capture, desc->raw,
+				desc->raw_len);
+			desc->unpack = NULL;
+			desc->samples_len = 0;
+			spsc_push(&devc->done_queue, desc);
+			continue;
+		}
+
+		desc->unpack = unpack;
+		desc->samples_len = desc->raw_len;
+		desc->samples = devc->model->unpack_raw_data(sdi, unpack,
+			desc->raw, &desc->samples_len);
+		unpack = NULL;
+		spsc_push(&devc->done_queue, desc);
+	}
+
+	/* A still held unpack buffer is released with the pool. */
+	g_atomic_int_set(&devc->worker_done, 1);
+
+	return NULL;
+}
+
+static int pipeline_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+	struct drv_context *drvc = sdi->driver->context;
+	size_t i;
+	uint8_t *buf;
+
+	memset(&devc->fill_queue, 0, sizeof(devc->fill_queue));
+	memset(&devc->done_queue, 0, sizeof(devc->done_queue));
+	memset(&devc->unpack_queue, 0, sizeof(devc->unpack_queue));
+
+	for (i = 0; i < NUM_UNPACK_BUFFERS; i++)
+		spsc_push(&devc->unpack_queue, devc->unpack_buffers[i]);
+
+	devc->num_free_descs = 0;
+	for (i = 0; i < NUM_RAW_BUFFERS; i++)
+		devc->free_descs[devc->num_free_descs++] = &devc->descs[i];
+	devc->parked_head = 0;
+	devc->num_parked = 0;
+
+	/* Spare buffers let a completed transfer be resubmitted at once. */
+	devc->num_spare_raw = 0;
+	for (i = 0; i < NUM_SPARE_BUFFERS; i++) {
+		if (sr_mem_available(drvc->sr_ctx) < devc->per_transfer_nbytes)
+			break;
+		buf = sr_usb_buffer_alloc(sdi->conn, devc->per_transfer_nbytes);
+		if (!buf)
+			break;
+		sr_mem_reserve(drvc->sr_ctx, devc->per_transfer_nbytes,
+			"Spare USB buffer");
+		devc->raw_buffers[devc->num_raw_buffers++] = buf;
+		devc->spare_raw[devc->num_spare_raw++] = buf;
+	}
+
+	g_mutex_init(&devc->worker_mutex);
+	g_cond_init(&devc->worker_cond);
+	devc->worker_wake = FALSE;
+	devc->worker_stop = 0;
+	devc->worker_done = 0;
+	devc->worker = g_thread_try_new("slogic-unpack", pipeline_worker, (gpointer)sdi, NULL);
+	if (!devc->worker) {
+		sr_warn("Failed to start unpack thread, not pipelining.");
+		g_cond_clear(&devc->worker_cond);
+		g_mutex_clear(&devc->worker_mutex);
+		return SR_ERR;
+	}
+	sr_dbg("Pipelined with %zu spare buffers.", devc->num_spare_raw);
+
+	return SR_OK;
+}
+
+/*
+ * Convert the session trigger into per-channel masks. Returns SR_ERR_NA
+ * if it can't be expressed as a single stage, cfg->mask is 0 without a
+ * trigger.
+ */
+SR_PRIV int sipeed_slogic_trigger_cfg(const struct sr_dev_inst *sdi,
+	struct slogic_trigger_cfg *cfg)
+{
+	struct sr_trigger *trigger;
+	struct sr_trigger_stage *stage;
+	struct sr_trigger_match *match;
+	GSList *l;
+	uint32_t ch_mask;
+
+	memset(cfg, 0, sizeof(*cfg));
+
+	trigger = sr_session_trigger_get(sdi->session);
+	if (!trigger || !trigger->stages)
+		return SR_OK;
+	if (trigger->stages->next) {
+		sr_dbg("Multi stage triggers can't be checked on raw data.");
+		return SR_ERR_NA;
+	}
+
+	stage = trigger->stages->data;
+	for (l = stage->matches; l; l = l->next) {
+		match = l->data;
+		if (!match->channel->enabled)
+			continue;
+		ch_mask = UINT32_C(1) << match->channel->index;
+		switch (match->match) {
+		case SR_TRIGGER_ONE:
+			cfg->value |= ch_mask;
+			/* fall through */
+		case SR_TRIGGER_ZERO:
+			cfg->level |= ch_mask;
+			break;
+		case SR_TRIGGER_RISING:
+			cfg->value |= ch_mask;
+			break;
+		case SR_TRIGGER_FALLING:
+			break;
+		case SR_TRIGGER_EDGE:
+			cfg->any_edge |= ch_mask;
+			break;
+		default:
+			sr_err("Unknown trigger condition %d.", match->match);
+			return SR_ERR_ARG;
+		}
+		cfg->mask |= ch_mask;
+	}
+
+	return SR_OK;
+}
+
+/* Whether one more transfer is needed on top of those in flight. */
+static gboolean need_more_transfers(const struct dev_context *devc)
+{
+	if (devc->streaming)
+		return TRUE;
+
+	return devc->samples_got_nbytes + devc->num_transfers_used * devc->per_transfer_nbytes < devc->samples_need_nbytes;
+}
+
+/*
+ * Streaming acquisitions don't end on lost data, they note it in a
+ * meta packet and carry on.
+ */
+static void report_overrun(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+
+	devc->num_overruns += 1;
+	sr_session_send_meta(sdi, SR_CONF_BUFFER_OVERRUNS,
+		g_variant_new_uint64(devc->num_overruns));
+}
+
+static void stats_resubmitted(struct slogic_stats *stats, int64_t completed)
+{
+	uint64_t gap;
+
+	gap = g_get_monotonic_time() - completed;
+	stats->num_resubmits++;
+	stats->resubmit_gap_sum += gap;
+	if (gap > stats->resubmit_gap_max)
+		stats->resubmit_gap_max = gap;
+}
+
+static void stats_completed(struct slogic_stats *stats, int64_t duration)
+{
+	size_t i;
+	uint64_t ms;
+
+	ms = duration / 1000;
+	for (i = 0; ms && i < STATS_LATENCY_BUCKETS - 1; i++)
+		ms >>= 1;
+	stats->latency[i]++;
+}
+
+/** Snapshot of the link statistics, as a{sv} dictionary. */
+SR_PRIV GVariant *sipeed_slogic_stats_get(const struct dev_context *devc)
+{
+	const struct slogic_stats *stats = &devc->stats;
+	GVariantBuilder b;
+
+	g_variant_builder_init(&b, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&b, "{sv}", "bytes",
+		g_variant_new_uint64(stats->nbytes));
+	g_variant_builder_add(&b, "{sv}", "transfers",
+		g_variant_new_uint64(stats->num_transfers));
+	g_variant_builder_add(&b, "{sv}", "timeouts",
+		g_variant_new_uint64(stats->num_timeouts));
+	g_variant_builder_add(&b, "{sv}", "dropped",
+		g_variant_new_uint64(stats->num_dropped));
+	g_variant_builder_add(&b, "{sv}", "overruns",
+		g_variant_new_uint64(devc->num_overruns));
+	g_variant_builder_add(&b, "{sv}", "resubmit_gap_avg_us",
+		g_variant_new_uint64(stats->num_resubmits ?
+			stats->resubmit_gap_sum / stats->num_resubmits : 0));
+	g_variant_builder_add(&b, "{sv}", "resubmit_gap_max_us",
+		g_variant_new_uint64(stats->resubmit_gap_max));
+	g_variant_builder_add(&b, "{sv}", "latency_log2_ms",
+		g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64, stats->latency,
+			STATS_LATENCY_BUCKETS, sizeof(uint64_t)));
+
+	return g_variant_builder_end(&b);
+}
+
+static void link_test_start(struct dev_context *devc)
+{
+	memset(&devc->link_test, 0, sizeof(devc->link_test));
+	devc->link_test.speed = devc->speed;
+}
+
+static void link_test_completed(struct dev_context *devc, uint64_t nbytes,
+	int64_t interval)
+{
+	struct slogic_link_test *t = &devc->link_test;
+
+	if (!devc->num_transfers_completed || interval <= 0)
+		return;
+	t->nbytes += nbytes;
+	t->num_intervals++;
+	t->interval_sum += interval;
+	t->interval_sq_sum += (double)interval * interval;
+	if ((uint64_t)interval > t->interval_max) {
+		t->interval_max = interval;
+		t->max_interval_nbytes = nbytes;
+	}
+}
+
+static void link_test_finish(struct dev_context *devc)
+{
+	struct slogic_link_test *t = &devc->link_test;
+
+	t->num_dropped = devc->stats.num_dropped + devc->stats.num_timeouts;
+	t->valid = t->num_intervals > 0;
+	if (t->valid)
+		sr_info("Link test: %.2fMB/s sustained, %.2fMB/s worst, "
+			"%" PRIu64 " dropped.",
+			(double)t->nbytes / t->interval_sum,
+			(double)t->max_interval_nbytes / t->interval_max,
+			t->num_dropped);
+}
+
+/** Result of the last link test, as a{sv} dictionary. */
+SR_PRIV GVariant *sipeed_slogic_link_test_get(const struct dev_context *devc)
+{
+	const struct slogic_link_test *t = &devc->link_test;
+	GVariantBuilder b;
+	double mean, var;
+
+	g_variant_builder_init(&b, G_VARIANT_TYPE("a{sv}"));
+	if (!t->valid)
+		return g_variant_builder_end(&b);
+
+	mean = (double)t->interval_sum / t->num_intervals;
+	var = t->interval_sq_sum / t->num_intervals - mean * mean;
+	g_variant_builder_add(&b, "{sv}", "usb_speed",
+		g_variant_new_int32(t->speed));
+	g_variant_builder_add(&b, "{sv}", "sustained_mbps",
+		g_variant_new_double((double)t->nbytes / t->interval_sum));
+	g_variant_builder_add(&b, "{sv}", "worst_mbps",
+		g_variant_new_double((double)t->max_interval_nbytes / t->interval_max));
+	g_variant_builder_add(&b, "{sv}", "interval_avg_us",
+		g_variant_new_uint64(mean));
+	g_variant_builder_add(&b, "{sv}", "jitter_us",
+		g_variant_new_uint64(var > 0 ? sqrt(var) : 0));
+	g_variant_builder_add(&b, "{sv}", "transfers",
+		g_variant_new_uint64(t->num_intervals));
+	g_variant_builder_add(&b, "{sv}", "dropped",
+		g_variant_new_uint64(t->num_dropped));
+
+	return g_variant_builder_end(&b);
+}
+
+/*
+ * Bytes per second the link test found the host to keep up with, with
+ * some headroom. UINT64_MAX without a test on the current link, or
+ * when transfers got dropped, which says nothing about the rate.
+ */
+SR_PRIV uint64_t sipeed_slogic_link_budget(const struct dev_context *devc)
+{
+	const struct slogic_link_test *t = &devc->link_test;
+
+	if (!t->valid || t->speed != devc->speed)
+		return UINT64_MAX;
+
+	return t->nbytes * 1000000 / t->interval_sum * 9 / 10;
+}
+
+/* The counters since the last time, at debug level. */
+static void stats_log(struct dev_context *devc, int64_t now)
+{
+	const struct slogic_stats *cur = &devc->stats;
+	struct slogic_stats *last = &devc->stats_logged;
+	int64_t elapsed;
+
+	elapsed = now - devc->stats_time_sent;
+	if (elapsed <= 0)
+		return;
+	sr_dbg("%" PRIu64 " transfers, %.2fMBps (%.2fMBps avg), "
+		"%" PRIu64 " timeouts, %" PRIu64 " dropped, resubmit max %" PRIu64 "us.",
+		cur->num_transfers - last->num_transfers,
+		(double)(cur->nbytes - last->nbytes) / elapsed,
+		(double)cur->nbytes / (now - devc->transfers_reached_time_start),
+		cur->num_timeouts - last->num_timeouts,
+		cur->num_dropped - last->num_dropped,
+		cur->resubmit_gap_max);
+	*last = *cur;
+}
+
+static void stats_send(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+	int64_t now;
+
+	now = g_get_monotonic_time();
+	if (sr_log_enabled(SR_LOG_DBG))
+		stats_log(devc, now);
+	devc->stats_time_sent = now;
+	sr_session_send_meta(sdi, SR_CONF_TRANSFER_STATS,
+		sipeed_slogic_stats_get(devc));
+}
+
+static void resubmit_transfer(const struct sr_dev_inst *sdi,
+	struct libusb_transfer *transfer, int64_t completed)
+{
 	int ret;
+	struct dev_context *devc = sdi->priv;
+	struct drv_context *drvc = sdi->driver->context;
+
+	if (devc->num_transfers_used)
+		devc->num_transfers_used -= 1;
+	if (devc->acq_aborted)
+		return;
+	if (need_more_transfers(devc)) {
+		transfer->actual_length = 0;
+		transfer->timeout = (TRANSFERS_DURATION_TOLERANCE + 1) * devc->per_transfer_duration * (devc->num_transfers_used + 2);
+		SR_TRACE1(usb_resubmit, transfer);
+		ret = sr_usb_submit_transfer(drvc->sr_ctx, transfer);
+		if (ret) {
+			sr_dbg("Failed to submit transfer: %s", libusb_error_name(ret));
+			devc->stats.num_dropped++;
+		} else {
+			sr_spew("Resubmit transfer: %p", transfer);
+			devc->num_transfers_used += 1;
+			stats_resubmitted(&devc->stats, completed);
+		}
+	}
+}
+
+/*
+ * Send everything the worker has finished, in order, and recycle the
+ * buffers. A raw buffer coming back first goes to a transfer that is
+ * parked for the lack of one.
+ */
+static void pipeline_drain(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+	struct slogic_pipeline_buffer *desc;
+	struct libusb_transfer *transfer;
+	int64_t completed;
+
+	while ((desc = spsc_pop(&devc->done_queue))) {
+		if (desc->unpack) {
+			send_logic(sdi, desc->samples, desc->samples_len);
+			spsc_push(&devc->unpack_queue, desc->unpack);
+			pipeline_wake(devc);
+		}
+
+		if (devc->num_parked) {
+			transfer = devc->parked[devc->parked_head];
+			completed = devc->parked_time[devc->parked_head];
+			devc->parked_head = (devc->parked_head + 1) % NUM_MAX_TRANSFERS;
+			devc->num_parked--;
+			transfer->buffer = desc->raw;
+			resubmit_transfer(sdi, transfer, completed);
+		} else {
+			devc->spare_raw[devc->num_spare_raw++] = desc->raw;
+		}
+		devc->free_descs[devc->num_free_descs++] = desc;
+	}
+}
+
+static void pipeline_stop(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+
+	g_atomic_int_set(&devc->worker_stop, 1);
+	pipeline_wake(devc);
+	/* The worker may need unpack buffers back before it can finish. */
+	while (!g_atomic_int_get(&devc->worker_done)) {
+		pipeline_drain(sdi);
+		g_usleep(1000);
+	}
+	g_thread_join(devc->worker);
+	devc->worker = NULL;
+	pipeline_drain(sdi);
+
+	g_cond_clear(&devc->worker_cond);
+	g_mutex_clear(&devc->worker_mutex);
+}
+
+/* Hand a filled transfer buffer to the worker, returns FALSE if parked. */
+static gboolean pipeline_push(const struct sr_dev_inst *sdi,
+	struct libusb_transfer *transfer)
+{
+	struct dev_context *devc = sdi->priv;
+	struct slogic_pipeline_buffer *desc;
+	size_t i;
+
+	desc = devc->free_descs[--devc->num_free_descs];
+	desc->raw = transfer->buffer;
+	desc->raw_len = transfer->actual_length;
+	spsc_push(&devc->fill_queue, desc);
+	pipeline_wake(devc);
+
+	if (!devc->num_spare_raw) {
+		i = (devc->parked_head + devc->num_parked) % NUM_MAX_TRANSFERS;
+		devc->parked[i] = transfer;
+		devc->parked_time[i] = devc->transfers_reached_time_latest;
+		devc->num_parked++;
+		return FALSE;
+	}
+	transfer->buffer = devc->spare_raw[--devc->num_spare_raw];
+
+	return TRUE;
+}
+
+/* Drop what a device captured before the last of its sync group started. */
+static void sync_drop(struct dev_context *devc, struct libusb_transfer *transfer)
+{
+	size_t n;
+
+	n = MIN(devc->sync_drop_nbytes, (uint64_t)transfer->actual_length);
+	devc->sync_drop_nbytes -= n;
+	transfer->actual_length -= n;
+	if (transfer->actual_length)
+		memmove(transfer->buffer, transfer->buffer + n, transfer->actual_length);
+}
+
+/*
+ * Runs for every transfer, keep it cheap. Details go to the counters in
+ * devc->stats, which stats_send() reports periodically.
+ */
+static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer) {
+
+	const struct slogic_transfer *xfer;
 	const struct sr_dev_inst *sdi;
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
 
-	sdi  = transfer->user_data;
-	if (!sdi)
+	xfer = transfer->user_data;
+	if (!xfer)
 		return;
+	sdi  = xfer->sdi;
 	devc = sdi->priv;
 	usb  = sdi->conn;
 
 	int64_t transfers_reached_time_now = g_get_monotonic_time();
 	int64_t transfers_reached_duration = transfers_reached_time_now - devc->transfers_reached_time_latest;
 
+	SR_TRACE3(usb_transfer_done, transfer, transfer->status,
+		transfer->actual_length);
 	if (devc->acq_aborted == 1)
 		return;
 
-	sr_spew("Transfer[%d] status: %d(%s)", std_u64_idx(g_variant_new_uint64((uint64_t)transfer), (uint64_t*)devc->transfers, NUM_MAX_TRANSFERS),
-		transfer->status, libusb_error_name(transfer->status));
+	if (sr_log_enabled(SR_LOG_SPEW))
+		sr_spew("Transfer[%u] status: %d, %d bytes.", xfer->idx,
+			transfer->status, transfer->actual_length);
+	devc->stats.num_transfers++;
 	switch (transfer->status) {
-		case LIBUSB_TRANSFER_COMPLETED: 
-		case LIBUSB_TRANSFER_TIMED_OUT: { /* may have received some data */
-			devc->transfers_reached_nbytes_latest = transfer->actual_length;
-			devc->transfers_reached_nbytes += devc->transfers_reached_nbytes_latest;
-			if (transfer->actual_length > devc->samples_need_nbytes - devc->samples_got_nbytes)
+		case LIBUSB_TRANSFER_TIMED_OUT: /* may have received some data */
+			devc->stats.num_timeouts++;
+			/* fall through */
+		case LIBUSB_TRANSFER_COMPLETED: {
+			devc->stats.nbytes += transfer->actual_length;
+			stats_completed(&devc->stats, transfers_reached_duration);
+			if (devc->sync_drop_nbytes) {
+				sync_drop(devc, transfer);
+				if (!transfer->actual_length) {
+					devc->transfers_reached_time_latest = transfers_reached_time_now;
+					resubmit_transfer(sdi, transfer, transfers_reached_time_now);
+					break;
+				}
+			}
+			if (!devc->trigger_fired) {
+				devc->transfers_reached_time_latest = transfers_reached_time_now;
+				raw_trigger_check(sdi, transfer->buffer, transfer->actual_length);
+				resubmit_transfer(sdi, transfer, transfers_reached_time_now);
+				break;
+			}
+			if (!devc->streaming && transfer->actual_length > devc->samples_need_nbytes - devc->samples_got_nbytes)
 				transfer->actual_length = devc->samples_need_nbytes - devc->samples_got_nbytes;
 			devc->samples_got_nbytes += transfer->actual_length;
-			sr_dbg("[%u] Got(%.2f%%): %u/%u => speed: %.2fMBps, %.2fMBps(avg) => +%.3f=%.3fms.",
-				devc->num_transfers_completed,
-				100.f * devc->samples_got_nbytes / devc->samples_need_nbytes, devc->samples_got_nbytes, devc->samples_need_nbytes,
-				(double)devc->transfers_reached_nbytes_latest / transfers_reached_duration,
-				(double)devc->transfers_reached_nbytes / (transfers_reached_time_now - devc->transfers_reached_time_start),
-				(double)transfers_reached_duration / SR_KHZ(1),
-				(double)(transfers_reached_time_now - devc->transfers_reached_time_start) / SR_KHZ(1)
-			);
 			devc->transfers_reached_time_latest = transfers_reached_time_now;
 
 			if (transfer->actual_length == 0) {
 				devc->num_transfers_used -= 1;
+				devc->stats.num_dropped++;
 				break;
 			}
 
-			/* TODO: move out submit to ensure continuous transfers */
-			if (devc->cur_pattern_mode_idx != PATTERN_MODE_TEST_MAX_SPEED) {
-				uint8_t * d = transfer->buffer;
-				size_t len = transfer->actual_length;
-				// sr_dbg("HEAD: %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x",
-				// 	d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], d[8], d[9], d[10], d[11], d[12], d[13], d[14], d[15]);
-				devc->model->submit_raw_data(d, len, sdi);
-			}
-
-			devc->num_transfers_used -= 1;
-			if (devc->samples_got_nbytes + devc->num_transfers_used * devc->per_transfer_nbytes < devc->samples_need_nbytes) {
-				transfer->actual_length = 0;
-				transfer->timeout = (TRANSFERS_DURATION_TOLERANCE + 1) * devc->per_transfer_duration * (devc->num_transfers_used + 2);
-				ret = libusb_submit_transfer(transfer);
-				if (ret) {
-					sr_dbg("Failed to submit transfer: %s", libusb_error_name(ret));
-				} else {
-					sr_spew("Resubmit transfer: %p", transfer);
-					devc->num_transfers_used += 1;
-				}
+			if (devc->cur_pattern_mode_idx == PATTERN_MODE_TEST_MAX_SPEED) {
+				link_test_completed(devc, transfer->actual_length,
+					transfers_reached_duration);
+				resubmit_transfer(sdi, transfer, transfers_reached_time_now);
+			} else if (devc->pipelined) {
+				/* Parked transfers get resubmitted by pipeline_drain(). */
+				if (pipeline_push(sdi, transfer))
+					resubmit_transfer(sdi, transfer, transfers_reached_time_now);
+			} else {
+				submit_raw_data(sdi, transfer->buffer, transfer->actual_length);
+				resubmit_transfer(sdi, transfer, transfers_reached_time_now);
 			}
 		} break;
 
 		case LIBUSB_TRANSFER_OVERFLOW:
 		case LIBUSB_TRANSFER_STALL:
 		case LIBUSB_TRANSFER_NO_DEVICE: {
+			devc->stats.num_dropped += devc->num_transfers_used;
 			devc->num_transfers_used = 0;
 		} break;
 
 		default: {
 			devc->num_transfers_used -= 1;
+			devc->stats.num_dropped++;
 		} break;
 	}
 
-	if (devc->num_transfers_completed && (double)transfers_reached_duration / SR_KHZ(1) > (TRANSFERS_DURATION_TOLERANCE + 1) * devc->per_transfer_duration) {
-		sr_err("Timeout %.3fms!!! Reach duration limit: %.3f(%u+%.1f%%) except first one.",
+	if (devc->num_transfers_completed && transfers_reached_duration > devc->transfer_timeout) {
+		sr_err("Timeout %.3fms!!! Reach duration limit: %.3f(%" PRIu64 "+%.1f%%) except first one.",
 			(double)transfers_reached_duration / SR_KHZ(1),
 			(TRANSFERS_DURATION_TOLERANCE + 1) * devc->per_transfer_duration, devc->per_transfer_duration, TRANSFERS_DURATION_TOLERANCE * 100
 		);
-		devc->num_transfers_used = 0;
+		if (devc->streaming)
+			report_overrun(sdi);
+		else
+			devc->num_transfers_used = 0;
 	}
 
 	if (devc->num_transfers_used == 0) {
@@ -113,58 +1152,278 @@ static void LIBUSB_CALL receive_transfer(struct libusb_transfer *transfer) {
 	devc->num_transfers_completed += 1;
 };
 
-static int handle_events(int fd, int revents, void *cb_data)
+/*
+ * Cancel and free the transfers, release everything the acquisition
+ * set up and send the end packet. Called from the thread servicing the
+ * device, or with its events locked.
+ */
+static void acquisition_end(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct drv_context *drvc;
+
+	devc = sdi->priv;
+	drvc = sdi->driver->context;
+
+	for (size_t i = 0; i < NUM_MAX_TRANSFERS; ++i) {
+		struct libusb_transfer *transfer = devc->transfers[i];
+		if (transfer) {
+			sr_usb_cancel_transfer(drvc->sr_ctx, transfer);
+		}
+	}
+	/* Data still in the pipeline goes out before the end packet. */
+	if (devc->pipelined) {
+		sr_usb_handle_pending(drvc->sr_ctx);
+		pipeline_stop(sdi);
+		devc->pipelined = FALSE;
+	}
+	for (size_t i = 0; i < NUM_MAX_TRANSFERS; ++i) {
+		sr_usb_handle_pending(drvc->sr_ctx);
+		struct libusb_transfer *transfer = devc->transfers[i];
+		if (transfer)
+			libusb_free_transfer(transfer);
+		devc->transfers[i] = NULL;
+	}
+	for (size_t i = 0; i < devc->num_raw_buffers; ++i)
+		sr_usb_buffer_free(sdi->conn, devc->raw_buffers[i], devc->per_transfer_nbytes);
+	sr_mem_release(drvc->sr_ctx, devc->num_raw_buffers * devc->per_transfer_nbytes);
+	devc->num_raw_buffers = 0;
+
+	sr_dbg("Freed all transfers.");
+	sr_info("Bulk in %" PRIu64 "/%" PRIu64 " bytes with %zu transfers.", devc->samples_got_nbytes, devc->samples_need_nbytes, devc->num_transfers_completed);
+
+	if (devc->raw_capture) {
+		sr_raw_capture_close(devc->raw_capture);
+		devc->raw_capture = NULL;
+	}
+
+	if (devc->cur_pattern_mode_idx == PATTERN_MODE_TEST_MAX_SPEED)
+		link_test_finish(devc);
+	stats_send(sdi);
+	std_session_send_df_end(sdi);
+	sipeed_slogic_unpack_pool_free(devc);
+	raw_trigger_free(devc);
+	devc->run_pending = FALSE;
+	sr_session_abort_hook_remove(sdi->session, sdi);
+	g_atomic_int_set(&devc->acq_running, FALSE);
+
+	/* The session source goes away on its next call, make that now. */
+	if (devc->usb_thread)
+		sr_session_source_wake(sdi->session,
+			-1 * (size_t)drvc->sr_ctx->libusb_ctx);
+}
+
+/* Service one device, returns FALSE once its acquisition has ended. */
+static gboolean service_device(struct sr_dev_inst *sdi)
 {
+	struct dev_context *devc;
+
+	devc = sdi->priv;
+
+	if (devc->pipelined && !devc->acq_aborted) {
+		pipeline_drain(sdi);
+		if (devc->num_transfers_used == 0)
+			sipeed_slogic_acquisition_stop(sdi);
+	}
+
+	if (!devc->acq_aborted && g_get_monotonic_time() - devc->stats_time_sent >= STATS_INTERVAL * 1000)
+		stats_send(sdi);
+
+	if (!devc->acq_aborted)
+		return TRUE;
+
+	acquisition_end(sdi);
+
+	return FALSE;
+}
+
+/* Service the running devices of the driver that use the given thread. */
+static gboolean service_devices(struct sr_dev_driver *di, gboolean threaded)
+{
+	struct drv_context *drvc;
 	struct sr_dev_inst *sdi;
-	struct sr_dev_driver *di;
 	struct dev_context *devc;
+	GSList *l;
+	gboolean running;
+
+	drvc = di->context;
+
+	running = FALSE;
+	for (l = drvc->instances; l; l = l->next) {
+		sdi = l->data;
+		devc = sdi->priv;
+		if (!devc || !devc->acq_running || devc->usb_thread != threaded)
+			continue;
+		if (service_device(sdi))
+			running = TRUE;
+	}
+
+	return running;
+}
+
+/*
+ * Run by sr_session_stop() on the caller's thread. The acquisition
+ * ends on the next round of servicing, which gets started right away.
+ */
+static void abort_hook(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc = sdi->priv;
+	struct drv_context *drvc = sdi->driver->context;
+
+	devc->acq_aborted = 1;
+	if (devc->usb_thread)
+		sr_usb_event_thread_wake(drvc->sr_ctx);
+	else
+		sr_session_source_wake(sdi->session,
+			-1 * (size_t)drvc->sr_ctx->libusb_ctx);
+}
+
+/*
+ * All devices of the driver share the libusb context, one event source
+ * services all of them. It goes away with the last running device.
+ * With the USB event thread doing the actual work, the source only
+ * keeps the session going.
+ */
+static int handle_events(int fd, int revents, void *cb_data)
+{
+	struct sr_dev_driver *di;
 	struct drv_context *drvc;
+	struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct sr_session *session;
+	GSList *l;
+	gboolean running, threaded;
 
 	(void)fd;
 	(void)revents;
 
-	sdi = cb_data;
-	devc = sdi->priv;
-	di = sdi->driver;
+	di = cb_data;
 	drvc = di->context;
 
-	//sr_spew("handle_events enter");
+	session = NULL;
+	threaded = FALSE;
+	for (l = drvc->instances; l; l = l->next) {
+		sdi = l->data;
+		devc = sdi->priv;
+		if (!devc || !g_atomic_int_get(&devc->acq_running))
+			continue;
+		session = sdi->session;
+		if (devc->usb_thread)
+			threaded = TRUE;
+	}
+	running = threaded || service_devices(di, FALSE);
 
-	if (devc->acq_aborted) {
-		for (size_t i = 0; i < NUM_MAX_TRANSFERS; ++i) {
-			struct libusb_transfer *transfer = devc->transfers[i];
-			if (transfer) {
-				libusb_cancel_transfer(transfer);
-			}
-		}
-		for (size_t i = 0; i < NUM_MAX_TRANSFERS; ++i) {
-			libusb_handle_events_timeout_completed(drvc->sr_ctx->libusb_ctx, &(struct timeval){0, 0}, NULL);
-			struct libusb_transfer *transfer = devc->transfers[i];
-			if (transfer) {
-				g_free(transfer->buffer);
-				libusb_free_transfer(transfer);
-			}
-			devc->transfers[i] = NULL;
+	if (!running && session)
+		sr_session_source_remove(session, -1 * (size_t)drvc->sr_ctx->libusb_ctx);
+
+	if (!threaded)
+		sr_usb_handle_pending(drvc->sr_ctx);
+
+	return TRUE;
+}
+
+/* USB event thread hook, done with the last threaded device. */
+static gboolean handle_thread_events(void *cb_data)
+{
+	return service_devices(cb_data, TRUE);
+}
+
+/*
+ * Whether another device of the driver is already being serviced,
+ * and if so, from which thread.
+ */
+static gboolean events_installed(const struct sr_dev_inst *sdi,
+		gboolean *threaded)
+{
+	struct drv_context *drvc = sdi->driver->context;
+	struct dev_context *devc;
+	GSList *l;
+
+	for (l = drvc->instances; l; l = l->next) {
+		devc = ((struct sr_dev_inst *)l->data)->priv;
+		if (l->data != sdi && devc && g_atomic_int_get(&devc->acq_running)) {
+			*threaded = devc->usb_thread;
+			return TRUE;
 		}
+	}
+
+	return FALSE;
+}
 
-		sr_dbg("Freed all transfers.");
-		sr_info("Bulk in %u/%u bytes with %u transfers.", devc->samples_got_nbytes, devc->samples_need_nbytes, devc->num_transfers_completed);
+/*
+ * Start the synchronized group once its last member is armed. The run
+ * commands go out back to back, the measured offsets are reported and
+ * the data that early devices capture ahead of the last one is dropped,
+ * so that all streams begin at the same instant.
+ */
+static int sync_group_run(const struct sr_dev_inst *sdi)
+{
+	struct drv_context *drvc = sdi->driver->context;
+	struct sr_dev_inst *member;
+	struct dev_context *devc;
+	GSList *l, *group;
+	int64_t first, last;
+	uint64_t samples;
+	int ret;
+
+	group = NULL;
+	for (l = drvc->instances; l; l = l->next) {
+		member = l->data;
+		devc = member->priv;
+		if (member->session != sdi->session || !devc || !devc->sync_start)
+			continue;
+		/* Not everybody armed yet. */
+		if (!devc->run_pending) {
+			g_slist_free(group);
+			return SR_OK;
+		}
+		group = g_slist_append(group, member);
+	}
+	if (!group)
+		return SR_OK;
 
-		sr_session_source_remove(sdi->session, -1 * (size_t)drvc->sr_ctx->libusb_ctx);
-		std_session_send_df_end(sdi);
+	ret = SR_OK;
+	for (l = group; l; l = l->next) {
+		member = l->data;
+		devc = member->priv;
+		devc->run_pending = FALSE;
+		devc->run_time = g_get_monotonic_time();
+		if (devc->model->operation.remote_run(member) < 0) {
+			sr_err("Failed to start %s.", devc->model->name);
+			ret = SR_ERR;
+		}
 	}
 
-	libusb_handle_events_timeout_completed(drvc->sr_ctx->libusb_ctx, &(struct timeval){0, 0}, NULL);
+	first = ((struct dev_context *)((struct sr_dev_inst *)group->data)->priv)->run_time;
+	last = ((struct dev_context *)((struct sr_dev_inst *)g_slist_last(group)->data)->priv)->run_time;
+	for (l = group; l; l = l->next) {
+		member = l->data;
+		devc = member->priv;
+		devc->sync_skew = devc->run_time - first;
+		samples = (last - devc->run_time) * devc->cur_samplerate / G_USEC_PER_SEC;
+		devc->sync_drop_nbytes = samples / 8 * devc->cur_samplechannel;
+		sr_info("%s starts %" PRIu64 "us after the first of %u, dropping %" PRIu64 " samples.",
+			devc->model->name, devc->sync_skew, g_slist_length(group), samples / 8 * 8);
+		sr_session_send_meta(member, SR_CONF_SYNC_SKEW,
+			g_variant_new_uint64(devc->sync_skew));
+	}
+	g_slist_free(group);
 
-	return TRUE;
+	return ret;
 }
 
+
 SR_PRIV int sipeed_slogic_acquisition_start(const struct sr_dev_inst *sdi)
 {
 	struct sr_dev_driver *di;
 	struct dev_context *devc;
 	struct drv_context *drvc;
 	struct sr_usb_dev_inst *usb;
+	struct slogic_transfer_plan plan;
+	struct slogic_trigger_cfg trigger;
+	gboolean installed, threaded;
+	uint64_t max_depth, reserved;
+	int interval;
 
 	int ret;
 
@@ -179,127 +1438,225 @@ SR_PRIV int sipeed_slogic_acquisition_start(const struct sr_dev_inst *sdi)
 	}
 	// clear_ep(sdi);
 
+	ret = sipeed_slogic_trigger_cfg(sdi, &trigger);
+	if (ret == SR_ERR_NA)
+		sr_err("Only single stage triggers are supported.");
+	if (ret != SR_OK)
+		return SR_ERR_ARG;
+	devc->trigger = trigger;
+	devc->trigger_fired = TRUE;
+	if (trigger.mask && devc->raw_capture_path) {
+		sr_warn("No host side trigger when writing a raw capture.");
+	} else if (trigger.mask &&
+			devc->cur_pattern_mode_idx != PATTERN_MODE_TEST_MAX_SPEED) {
+		if ((ret = raw_trigger_init(devc)) != SR_OK)
+			return ret;
+		devc->trigger_fired = FALSE;
+	}
+	reserved = 0;
+	devc->raw_capture = NULL;
+
 	devc->samples_got_nbytes = 0;
 	devc->samples_need_nbytes = devc->cur_limit_samples * devc->cur_samplechannel / 8;
-	sr_info("Need %ux %uch@%uMHz in %ums.", 
-			devc->cur_limit_samples,
-			devc->cur_samplechannel, 
-			devc->cur_samplerate / SR_MHZ(1),
-			1000 * devc->cur_limit_samples / devc->cur_samplerate
-	);
+	devc->streaming = devc->continuous || !devc->cur_limit_samples;
+	devc->num_overruns = 0;
+	if (devc->streaming) {
+		sr_info("Streaming %" PRIu64 "ch@%" PRIu64 "MHz until stopped.",
+				devc->cur_samplechannel,
+				devc->cur_samplerate / SR_MHZ(1)
+		);
+	} else {
+		sr_info("Need %" PRIu64 "x %" PRIu64 "ch@%" PRIu64 "MHz in %" PRIu64 "ms.",
+				devc->cur_limit_samples,
+				devc->cur_samplechannel,
+				devc->cur_samplerate / SR_MHZ(1),
+				1000 * devc->cur_limit_samples / devc->cur_samplerate
+		);
+	}
 
-	devc->per_transfer_duration = 125;
-	devc->per_transfer_nbytes = devc->per_transfer_duration * devc->cur_samplerate * devc->cur_samplechannel / 8 / SR_KHZ(1) /* ms */;
+	/* Below 8 channels, Lite 8 data is packed samples already. */
+	devc->packed_bits = 0;
+	if (devc->model->raw_layout == SR_RAW_CAPTURE_PACKED &&
+			devc->cur_samplechannel < 8 &&
+			sr_session_takes_logic_packed(sdi->session))
+		devc->packed_bits = devc->cur_samplechannel;
 
-	do {
-		struct libusb_transfer *transfer = libusb_alloc_transfer(0);
-		if (!transfer) {
-			sr_err("Failed to allocate libusb transfer!");
-			return SR_ERR_IO;
-		}
-		do {
-			devc->per_transfer_nbytes = (devc->per_transfer_nbytes + (2*16*1024-1)) & ~(2*16*1024-1);
-			devc->per_transfer_duration = devc->per_transfer_nbytes * SR_KHZ(1) * 8 / (devc->cur_samplerate * devc->cur_samplechannel);
-			sr_dbg("Plan to receive %u bytes per %ums...", devc->per_transfer_nbytes, devc->per_transfer_duration);
-			
-			uint8_t *dev_buf = g_malloc(devc->per_transfer_nbytes);
-			if (!dev_buf) {
-				sr_dbg("Failed to allocate memory: %u bytes! Half .", devc->per_transfer_nbytes);
-				devc->per_transfer_nbytes >>= 1;
-				continue;
-			}
+	sipeed_slogic_transfer_plan(devc, &plan);
+	devc->per_transfer_nbytes = plan.nbytes;
+	devc->per_transfer_duration = plan.duration;
+	devc->transfer_timeout = (TRANSFERS_DURATION_TOLERANCE + 1) * plan.duration * 1000;
+	devc->num_transfers_planned = plan.depth;
+	sr_info("Nice plan! :) => %zu x %" PRIu64 " bytes per %" PRIu64 "ms.",
+		plan.depth, plan.nbytes, plan.duration);
 
-			libusb_fill_bulk_transfer(transfer, usb->devhdl, devc->model->ep_in,
-										dev_buf, devc->per_transfer_nbytes, NULL,
-										NULL, 0);
-
-			ret = libusb_submit_transfer(transfer);
-			if (ret) {
-				g_free(transfer->buffer);
-				if (ret == LIBUSB_ERROR_NO_MEM) {
-					sr_dbg("Failed to submit transfer: %s!", libusb_error_name(ret));
-					devc->per_transfer_nbytes >>= 1;
-					continue;
-				} else {
-					sr_err("Failed to submit transfer: %s!", libusb_error_name(ret));
-					libusb_free_transfer(transfer);
-					return SR_ERR_IO;
-				}
-			} else {
-				ret = libusb_cancel_transfer(transfer);
-				if (ret) {
-                    sr_dbg("Failed to cancel transfer: %s!", libusb_error_name(ret));
-                }
-                libusb_handle_events_timeout_completed(drvc->sr_ctx->libusb_ctx, &(struct timeval){3, 0}, NULL);
-				g_free(transfer->buffer);
-
-				devc->per_transfer_nbytes >>= 1;
-				devc->per_transfer_duration = devc->per_transfer_nbytes / (devc->cur_samplerate / SR_KHZ(1) * devc->cur_samplechannel / 8);
-				break;
-			}
-		} while (devc->per_transfer_nbytes > 32*1024); // 32kiB > 125ms * 1MHZ * 2ch
-		libusb_free_transfer(transfer);
-		sr_info("Nice plan! :) => %u bytes per %ums.", devc->per_transfer_nbytes, devc->per_transfer_duration);
-	} while (0);
+	/* Fewer transfers in flight rather than none, within the budget. */
+	max_depth = sr_mem_available(drvc->sr_ctx) / plan.nbytes;
+	if (max_depth < devc->num_transfers_planned) {
+		sr_warn("Memory budget limits the transfers to %" PRIu64 ".",
+			max_depth);
+		devc->num_transfers_planned = max_depth;
+	}
+	ret = sr_mem_reserve(drvc->sr_ctx, MAX(1, devc->num_transfers_planned) *
+		plan.nbytes, "USB transfer ring");
+	if (ret != SR_OK)
+		goto err;
+	reserved = MAX(1, devc->num_transfers_planned) * plan.nbytes;
+
+	/* The widest expansion is 2 channels, 4 samples out of every byte. */
+	ret = sipeed_slogic_unpack_pool_alloc(devc,
+		slogic_basic_16_unpacked_len(devc->per_transfer_nbytes, devc->cur_samplechannel));
+	if (ret != SR_OK)
+		goto err;
 
+	if (devc->raw_capture_path) {
+		ret = sr_raw_capture_open(&devc->raw_capture,
+			devc->raw_capture_path, &(struct sr_raw_capture_info) {
+				.model = devc->model->name,
+				.samplerate = devc->cur_samplerate,
+				.num_channels = devc->cur_samplechannel,
+				.layout = devc->model->raw_layout,
+				.word_bits = 8,
+				.msb_first = TRUE,
+			});
+		if (ret != SR_OK)
+			goto err;
+	}
 
 	devc->acq_aborted = 0;
 	devc->num_transfers_used = 0;
 	devc->num_transfers_completed = 0;
+	devc->num_raw_buffers = 0;
 	memset(devc->transfers, 0, sizeof(devc->transfers));
-	devc->transfers_reached_nbytes = 0;
+	memset(&devc->stats, 0, sizeof(devc->stats));
+	memset(&devc->stats_logged, 0, sizeof(devc->stats_logged));
+
+	devc->run_pending = FALSE;
+	devc->sync_skew = 0;
+	devc->sync_drop_nbytes = 0;
 
-	sr_session_source_add(sdi->session, -1 * (size_t)drvc->sr_ctx->libusb_ctx, 0, (devc->per_transfer_duration / 2)?:1, handle_events, (void *)sdi);
+	/*
+	 * Transfers complete on the USB event thread if it is enabled, so
+	 * that main loop load doesn't delay resubmission. Synchronized
+	 * starts stay on the main loop: the data to drop is only known
+	 * after the run commands went out, before any transfer is seen.
+	 */
+	installed = events_installed(sdi, &threaded);
+	if (installed && threaded && devc->sync_start) {
+		sr_err("Cannot start synchronized while other devices stream.");
+		ret = SR_ERR;
+		goto err;
+	}
+	if (!installed)
+		threaded = !devc->sync_start;
+	/* Nothing of this device gets serviced before it is fully set up. */
+	if (threaded)
+		libusb_lock_events(drvc->sr_ctx->libusb_ctx);
+	if (!installed) {
+		interval = (devc->per_transfer_duration / 2) ?: 1;
+		if (threaded && sr_usb_event_thread_add(drvc->sr_ctx, interval,
+				handle_thread_events, di) != SR_OK) {
+			libusb_unlock_events(drvc->sr_ctx->libusb_ctx);
+			threaded = FALSE;
+		}
+		sr_session_source_add(sdi->session, -1 * (size_t)drvc->sr_ctx->libusb_ctx, 0, interval, handle_events, (void *)di);
+	}
+	devc->usb_thread = threaded;
+	devc->acq_running = TRUE;
+	sr_session_abort_hook_add(sdi->session, sdi, abort_hook);
 
-	while (devc->num_transfers_used < NUM_MAX_TRANSFERS && devc->samples_got_nbytes + devc->num_transfers_used * devc->per_transfer_nbytes < devc->samples_need_nbytes)
+	/*
+	 * The buffers belong to raw_buffers[], not to the transfers: with
+	 * pipelining a transfer gets resubmitted with a spare buffer while
+	 * its last one is still being unpacked. acquisition_end() frees
+	 * them all.
+	 */
+	while (devc->num_transfers_used < devc->num_transfers_planned && need_more_transfers(devc))
 	{
-		uint8_t *dev_buf = g_malloc(devc->per_transfer_nbytes);
+		uint8_t *dev_buf = sr_usb_buffer_alloc(usb, devc->per_transfer_nbytes);
 		if (!dev_buf) {
-			sr_dbg("Failed to allocate memory[%d]", devc->num_transfers_used);
+			sr_dbg("Failed to allocate memory[%zu]", devc->num_transfers_used);
 			break;
 		}
 
 		struct libusb_transfer *transfer = libusb_alloc_transfer(0);
 		if (!transfer) {
-			sr_dbg("Failed to allocate transfer[%d]", devc->num_transfers_used);
-			g_free(dev_buf);
+			sr_dbg("Failed to allocate transfer[%zu]", devc->num_transfers_used);
+			sr_usb_buffer_free(usb, dev_buf, devc->per_transfer_nbytes);
 			break;
 		}
 
+		devc->transfer_ctx[devc->num_transfers_used].sdi = sdi;
+		devc->transfer_ctx[devc->num_transfers_used].idx = devc->num_transfers_used;
 		libusb_fill_bulk_transfer(transfer, usb->devhdl, devc->model->ep_in,
 									dev_buf, devc->per_transfer_nbytes, receive_transfer,
-									sdi, (TRANSFERS_DURATION_TOLERANCE + 1) * devc->per_transfer_duration * (devc->num_transfers_used + 2));
+									&devc->transfer_ctx[devc->num_transfers_used], (TRANSFERS_DURATION_TOLERANCE + 1) * devc->per_transfer_duration * (devc->num_transfers_used + 2));
 		transfer->actual_length = 0;
 
-		ret = libusb_submit_transfer(transfer);
+		ret = sr_usb_submit_transfer(drvc->sr_ctx, transfer);
 		if (ret) {
-			sr_dbg("Failed to submit transfer[%d]: %s.", devc->num_transfers_used, libusb_error_name(ret));
-			g_free(transfer->buffer);
+			sr_dbg("Failed to submit transfer[%zu]: %s.", devc->num_transfers_used, libusb_error_name(ret));
+			sr_usb_buffer_free(usb, dev_buf, devc->per_transfer_nbytes);
 			libusb_free_transfer(transfer);
 			break;
 		}
 		devc->transfers[devc->num_transfers_used] = transfer;
+		devc->raw_buffers[devc->num_raw_buffers++] = dev_buf;
 		devc->num_transfers_used += 1;
 	}
-	sr_dbg("Submited %u transfers", devc->num_transfers_used);
+	sr_dbg("Submitted %zu transfers.", devc->num_transfers_used);
+	sr_mem_release(drvc->sr_ctx, (MAX(1, devc->num_transfers_planned) -
+		devc->num_raw_buffers) * devc->per_transfer_nbytes);
+
+	devc->pipelined = devc->num_transfers_used &&
+		devc->cur_pattern_mode_idx != PATTERN_MODE_TEST_MAX_SPEED &&
+		pipeline_start(sdi) == SR_OK;
 
 	std_session_send_df_header(sdi);
 	std_session_send_df_frame_begin(sdi);
 
+	if (devc->cur_pattern_mode_idx == PATTERN_MODE_TEST_MAX_SPEED)
+		link_test_start(devc);
 	devc->transfers_reached_time_start = g_get_monotonic_time();
 	devc->transfers_reached_time_latest = devc->transfers_reached_time_start;
+	devc->stats_time_sent = devc->transfers_reached_time_start;
+
+	if (threaded)
+		libusb_unlock_events(drvc->sr_ctx->libusb_ctx);
 
 	if (!devc->num_transfers_used) {
 		sipeed_slogic_acquisition_stop(sdi);
 		return SR_OK;
 	}
 
+	if (devc->sync_start) {
+		devc->run_pending = TRUE;
+		return sync_group_run(sdi);
+	}
+
 	if ((ret = devc->model->operation.remote_run(sdi)) < 0) {
 		sr_err("Unhandled `CMD_RUN`");
+		/* Not to be serviced while the transfers are taken down. */
+		if (threaded)
+			libusb_lock_events(drvc->sr_ctx->libusb_ctx);
+		devc->acq_aborted = 1;
+		acquisition_end(sdi);
+		if (threaded)
+			libusb_unlock_events(drvc->sr_ctx->libusb_ctx);
 		return ret;
 	}
 
 	return SR_OK;
+
+err:
+	if (devc->raw_capture) {
+		sr_raw_capture_close(devc->raw_capture);
+		devc->raw_capture = NULL;
+	}
+	sipeed_slogic_unpack_pool_free(devc);
+	sr_mem_release(drvc->sr_ctx, reserved);
+	raw_trigger_free(devc);
+
+	return ret;
 }
 
 SR_PRIV int sipeed_slogic_acquisition_stop(struct sr_dev_inst *sdi)
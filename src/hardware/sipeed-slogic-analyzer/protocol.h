@@ -25,18 +25,43 @@
 #include <libusb.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
+#include "unpack.h"
 
 #define LOG_PREFIX "sipeed-slogic-analyzer"
 
 #define USB_VID_SIPEED UINT16_C(0x359f)
 #define NUM_MAX_TRANSFERS 64
+#define NUM_UNPACK_BUFFERS 4
+#define NUM_SPARE_BUFFERS 4
+#define NUM_RAW_BUFFERS (NUM_MAX_TRANSFERS + NUM_SPARE_BUFFERS)
+#define PIPELINE_QUEUE_SIZE (NUM_RAW_BUFFERS + 1)
 #define TRANSFERS_DURATION_TOLERANCE 0.05f
+#define TRANSFERS_LATENCY_TARGET 50 /* unit: ms */
+#define TRANSFERS_QUEUE_DURATION 500 /* unit: ms */
+#define TRANSFERS_INFLIGHT_MAX_NBYTES (16 * 1024 * 1024)
+#define TRANSFER_NBYTES_ALIGN (32 * 1024)
+#define TRANSFER_NBYTES_MIN TRANSFER_NBYTES_ALIGN
+#define TRANSFER_NBYTES_MAX (4 * 1024 * 1024)
+#define STATS_LATENCY_BUCKETS 8
+#define STATS_INTERVAL 1000 /* unit: ms */
+#define NUM_DRAIN_TRANSFERS 4
+#define DRAIN_TRANSFER_NBYTES (256 * 1024)
+#define DRAIN_IDLE_TIMEOUT 20 /* unit: ms */
+#define DRAIN_DEADLINE 1000 /* unit: ms */
 
 enum {
 	PATTERN_MODE_NOMAL,
 	PATTERN_MODE_TEST_MAX_SPEED,
 };
 
+/* Single stage trigger condition, one bit per channel. */
+struct slogic_trigger_cfg {
+	uint32_t mask; /* channels taking part */
+	uint32_t level; /* level condition, edge if clear */
+	uint32_t value; /* high level or rising edge */
+	uint32_t any_edge; /* either edge, value is ignored */
+};
+
 struct slogic_model {
 	char *name;
 	uint16_t pid;
@@ -48,11 +73,84 @@ struct slogic_model {
 		int (*remote_run)(const struct sr_dev_inst *sdi);
 		int (*remote_stop)(const struct sr_dev_inst *sdi);
 	} operation;
-	void (*submit_raw_data)(void *data, size_t len, const struct sr_dev_inst *sdi);
+	uint8_t *(*unpack_raw_data)(const struct sr_dev_inst *sdi,
+		uint8_t *dst, uint8_t *src, size_t *len);
+	void (*raw_channels)(uint8_t *vec, const uint8_t *block,
+		unsigned int channels);
+	/* How the raw data looks to the rawcapture input module. */
+	enum sr_raw_capture_layout raw_layout;
+};
+
+/*
+ * Single producer, single consumer queue. Only the producer writes
+ * tail, only the consumer writes head, one slot always stays empty.
+ */
+struct slogic_spsc_queue {
+	gpointer items[PIPELINE_QUEUE_SIZE];
+	gint head;
+	gint tail;
+};
+
+struct slogic_transfer_plan {
+	uint64_t nbytes;
+	uint64_t duration; /* unit: ms */
+	size_t depth;
+};
+
+/*
+ * Link health counters, kept per acquisition. Times are taken on the
+ * host when a transfer completes.
+ */
+struct slogic_stats {
+	uint64_t nbytes;
+	uint64_t num_transfers;
+	uint64_t num_timeouts; /* timed out, possibly with partial data */
+	uint64_t num_dropped; /* failed or not resubmitted */
+	uint64_t num_resubmits;
+	uint64_t resubmit_gap_sum; /* unit: us, completion to resubmit */
+	uint64_t resubmit_gap_max; /* unit: us */
+	/*
+	 * Time between completions, bucket 0 is below 1ms, bucket n is
+	 * [2^(n-1), 2^n) ms, the last one is open ended.
+	 */
+	uint64_t latency[STATS_LATENCY_BUCKETS];
+};
+
+/*
+ * Link throughput test, an acquisition in PATTERN_MODE_TEST_MAX_SPEED.
+ * Intervals are between transfer completions, the first one is left
+ * out as it includes the device starting up.
+ */
+struct slogic_link_test {
+	gboolean valid;
+	enum libusb_speed speed; /* the link the result is for */
+	uint64_t nbytes;
+	uint64_t num_intervals;
+	uint64_t interval_sum; /* unit: us */
+	uint64_t interval_max; /* unit: us */
+	double interval_sq_sum;
+	uint64_t max_interval_nbytes; /* data of the longest interval */
+	uint64_t num_dropped;
+};
+
+/* What a transfer's user_data points to. */
+struct slogic_transfer {
+	const struct sr_dev_inst *sdi;
+	unsigned int idx;
+};
+
+/* A filled raw buffer on its way through the pipeline. */
+struct slogic_pipeline_buffer {
+	uint8_t *raw;
+	size_t raw_len;
+	uint8_t *unpack;
+	uint8_t *samples;
+	size_t samples_len;
 };
 
 struct dev_context {
 	struct slogic_model *model;
+	const struct slogic_unpack_impl *unpack;
 
 	struct sr_channel_group *digital_group;
 
@@ -66,6 +164,13 @@ struct dev_context {
 		uint64_t cur_samplerate;
 		uint64_t cur_samplechannel;
 		int64_t cur_pattern_mode_idx;
+		gboolean continuous;
+		gboolean sync_start;
+		/* Transfer geometry overrides, 0 has the planner pick. */
+		uint64_t transfer_count;
+		uint64_t transfer_nbytes;
+		uint64_t transfer_latency; /* unit: ms */
+		char *raw_capture_path; /* NULL writes no raw capture */
 	}; // configuration
 
 	struct {
@@ -77,21 +182,85 @@ struct dev_context {
 		uint64_t per_transfer_duration; /* unit: ms */
 		uint64_t per_transfer_nbytes;
 
+		gboolean acq_running; /* serviced by handle_events() */
+		gboolean usb_thread; /* serviced from the USB event thread */
+		gboolean run_pending; /* armed, waiting for the sync group */
+		int64_t run_time;
+		uint64_t sync_skew; /* unit: us */
+		uint64_t sync_drop_nbytes; /* raw data ahead of the group */
+
+		gboolean streaming; /* no sample limit, runs until stopped */
+		uint64_t num_overruns;
+
 		size_t num_transfers_completed;
+		size_t num_transfers_planned;
 		size_t num_transfers_used;
 		struct libusb_transfer *transfers[NUM_MAX_TRANSFERS];
+		struct slogic_transfer transfer_ctx[NUM_MAX_TRANSFERS];
+		int64_t transfer_timeout; /* unit: us, between completions */
+
+		uint8_t *raw_buffers[NUM_RAW_BUFFERS]; /* owns transfer and spare buffers */
+		size_t num_raw_buffers;
 
-		uint64_t transfers_reached_nbytes; /* real received bytes in all */
-		uint64_t transfers_reached_nbytes_latest; /* real received bytes this transfer */
 		int64_t transfers_reached_time_start;
 		int64_t transfers_reached_time_latest;
+
+		struct slogic_stats stats;
+		int64_t stats_time_sent;
+		struct slogic_stats stats_logged; /* as of the last debug line */
+		struct slogic_link_test link_test; /* valid: of the last test */
 	}; // usb
 
+	struct {
+		uint8_t *unpack_buffers[NUM_UNPACK_BUFFERS];
+		size_t unpack_buffer_size;
+		size_t unpack_buffer_next;
+	}; // unpack buffer pool, reused across transfers
+
+	struct {
+		gboolean pipelined;
+		GThread *worker;
+		GMutex worker_mutex;
+		GCond worker_cond;
+		gboolean worker_wake;
+		gint worker_stop;
+		gint worker_done;
+
+		struct slogic_spsc_queue fill_queue; /* usb -> worker */
+		struct slogic_spsc_queue done_queue; /* worker -> usb */
+		struct slogic_spsc_queue unpack_queue; /* usb -> worker */
+
+		/*
+		 * Only touched from the thread handling the USB events, the
+		 * USB event thread if usb_thread is set.
+		 */
+		struct slogic_pipeline_buffer descs[NUM_RAW_BUFFERS];
+		struct slogic_pipeline_buffer *free_descs[NUM_RAW_BUFFERS];
+		size_t num_free_descs;
+		uint8_t *spare_raw[NUM_RAW_BUFFERS];
+		size_t num_spare_raw;
+		struct libusb_transfer *parked[NUM_MAX_TRANSFERS];
+		int64_t parked_time[NUM_MAX_TRANSFERS]; /* completion time */
+		size_t parked_head;
+		size_t num_parked;
+	}; // pipelined mode
+
 	int acq_aborted;
+	/* Raw data goes here instead of to the session, when set. */
+	struct sr_raw_capture *raw_capture;
+	/* Bits per sample of SR_DF_LOGIC_PACKED data, 0 to send it dense. */
+	unsigned int packed_bits;
 
 	/* Triggers */
 	uint64_t capture_ratio;
+	struct slogic_trigger_cfg trigger;
 	gboolean trigger_fired;
+	uint32_t trigger_last; /* last sample seen by the host side trigger */
+	gboolean trigger_have_last;
+	uint8_t *pre_trigger; /* ring of raw data, whole blocks */
+	size_t pre_trigger_size;
+	size_t pre_trigger_head;
+	size_t pre_trigger_fill;
 	struct soft_trigger_logic *stl;
 
 	double voltage_threshold[2];
@@ -99,19 +268,22 @@ struct dev_context {
 
 SR_PRIV int sipeed_slogic_acquisition_start(const struct sr_dev_inst *sdi);
 SR_PRIV int sipeed_slogic_acquisition_stop(struct sr_dev_inst *sdi);
+SR_PRIV void sipeed_slogic_transfer_plan(const struct dev_context *devc,
+	struct slogic_transfer_plan *plan);
+SR_PRIV int sipeed_slogic_trigger_cfg(const struct sr_dev_inst *sdi,
+	struct slogic_trigger_cfg *cfg);
+SR_PRIV GVariant *sipeed_slogic_stats_get(const struct dev_context *devc);
+SR_PRIV GVariant *sipeed_slogic_link_test_get(const struct dev_context *devc);
+SR_PRIV uint64_t sipeed_slogic_link_budget(const struct dev_context *devc);
+SR_PRIV int sipeed_slogic_unpack_pool_alloc(struct dev_context *devc, size_t size);
+SR_PRIV void sipeed_slogic_unpack_pool_free(struct dev_context *devc);
+SR_PRIV uint8_t *sipeed_slogic_unpack_buffer_get(struct dev_context *devc);
+
+SR_PRIV void sipeed_slogic_drain_ep(const struct sr_dev_inst *sdi,
+	unsigned int deadline_ms);
 
 static inline void clear_ep(const struct sr_dev_inst *sdi) {
-	struct dev_context *devc = sdi->priv;
-	struct sr_usb_dev_inst *usb = sdi->conn;
-	uint8_t ep = devc->model->ep_in;
-
-	uint8_t tmp[1024];
-	int actual_length = 0;
-	do {
-		libusb_bulk_transfer(usb->devhdl, ep,
-				tmp, sizeof(tmp), &actual_length, 100);
-	} while (actual_length);
-	sr_dbg("Cleared EP: 0x%02x", ep);
+	sipeed_slogic_drain_ep(sdi, DRAIN_DEADLINE);
 }
 
 #endif
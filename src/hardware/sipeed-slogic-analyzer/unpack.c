@@ -0,0 +1,424 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "unpack.h"
+#include "cpu_features.h"
+
+#ifdef SR_CPU_X86
+#define SLOGIC_UNPACK_X86
+#include <immintrin.h>
+#define TARGET_SSE2 SR_TARGET_SSE2
+#define TARGET_AVX2 SR_TARGET_AVX2
+#endif
+
+#ifdef SR_CPU_NEON_BUILD
+#define SLOGIC_UNPACK_NEON
+#include <arm_neon.h>
+#endif
+
+/* Scalar reference, this is what the driver always used to do. */
+
+static gboolean supported_always(void)
+{
+	return TRUE;
+}
+
+static void lite_8_unpack_scalar(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels)
+{
+	size_t i, j;
+	unsigned int per_byte;
+
+	per_byte = 8 / channels;
+	for (i = 0; i < len; i += channels) {
+		for (j = 0; j < 8; j++) {
+			dst[i * per_byte + j] = (src[i + j / per_byte] >>
+				(j % per_byte * channels)) & ((1 << channels) - 1);
+		}
+	}
+}
+
+static void basic_16_unpack_scalar(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels)
+{
+	size_t i, j;
+
+	for (i = 0; i < len; i += channels) {
+		for (j = 0; j < 8; j++) {
+#define B(n) ((((src[i + (n)] >> (7 - j)) & 0x1)) << ((n) % 8))
+			switch (channels) {
+			case 16:
+				dst[i + j * 2 + 0] =
+					B(0) | B(1) | B(2) | B(3) | B(4) | B(5) | B(6) | B(7);
+				dst[i + j * 2 + 1] =
+					B(8) | B(9) | B(10) | B(11) | B(12) | B(13) | B(14) | B(15);
+				break;
+			case 8:
+				dst[i + j] =
+					B(0) | B(1) | B(2) | B(3) | B(4) | B(5) | B(6) | B(7);
+				break;
+			case 4:
+				dst[i * 2 + j] = B(0) | B(1) | B(2) | B(3);
+				break;
+			case 2:
+				dst[i * 4 + j] = B(0) | B(1);
+				break;
+			}
+#undef B
+		}
+	}
+}
+
+/*
+ * Distribute the 8 "movemask" words of one vector (bit n of masks[j] is
+ * bit 7-j of input byte n) to transposed output samples. The vector
+ * covers nbits / channels blocks.
+ */
+static inline void basic_16_scatter(uint8_t *dst, const uint32_t *masks,
+	unsigned int nbits, unsigned int channels)
+{
+	unsigned int j, shift;
+	uint32_t m;
+
+	if (channels == 16) {
+		for (shift = 0; shift < nbits; shift += 16) {
+			for (j = 0; j < 8; j++) {
+				m = masks[j] >> shift;
+				*dst++ = m & 0xff;
+				*dst++ = (m >> 8) & 0xff;
+			}
+		}
+		return;
+	}
+
+	for (shift = 0; shift < nbits; shift += channels) {
+		for (j = 0; j < 8; j++)
+			*dst++ = (masks[j] >> shift) & ((1 << channels) - 1);
+	}
+}
+
+#ifdef SLOGIC_UNPACK_X86
+
+static gboolean supported_sse2(void)
+{
+	return sr_cpu_has(SR_CPU_SSE2);
+}
+
+static gboolean supported_avx2(void)
+{
+	return sr_cpu_has(SR_CPU_AVX2);
+}
+
+TARGET_SSE2
+static void lite_8_unpack_sse2(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels)
+{
+	const __m128i m4 = _mm_set1_epi8(0x0f);
+	const __m128i m2 = _mm_set1_epi8(0x03);
+	__m128i v, lo, hi, a0, a1, a2, a3, p01, p23;
+	size_t i;
+
+	i = 0;
+	switch (channels) {
+	case 8:
+		memcpy(dst, src, len);
+		return;
+	case 4:
+		for (; i + 16 <= len; i += 16, dst += 32) {
+			v = _mm_loadu_si128((const __m128i *)&src[i]);
+			lo = _mm_and_si128(v, m4);
+			hi = _mm_and_si128(_mm_srli_epi16(v, 4), m4);
+			_mm_storeu_si128((__m128i *)&dst[0], _mm_unpacklo_epi8(lo, hi));
+			_mm_storeu_si128((__m128i *)&dst[16], _mm_unpackhi_epi8(lo, hi));
+		}
+		break;
+	case 2:
+		for (; i + 16 <= len; i += 16, dst += 64) {
+			v = _mm_loadu_si128((const __m128i *)&src[i]);
+			a0 = _mm_and_si128(v, m2);
+			a1 = _mm_and_si128(_mm_srli_epi16(v, 2), m2);
+			a2 = _mm_and_si128(_mm_srli_epi16(v, 4), m2);
+			a3 = _mm_and_si128(_mm_srli_epi16(v, 6), m2);
+			p01 = _mm_unpacklo_epi8(a0, a1);
+			p23 = _mm_unpacklo_epi8(a2, a3);
+			_mm_storeu_si128((__m128i *)&dst[0], _mm_unpacklo_epi16(p01, p23));
+			_mm_storeu_si128((__m128i *)&dst[16], _mm_unpackhi_epi16(p01, p23));
+			p01 = _mm_unpackhi_epi8(a0, a1);
+			p23 = _mm_unpackhi_epi8(a2, a3);
+			_mm_storeu_si128((__m128i *)&dst[32], _mm_unpacklo_epi16(p01, p23));
+			_mm_storeu_si128((__m128i *)&dst[48], _mm_unpackhi_epi16(p01, p23));
+		}
+		break;
+	}
+
+	lite_8_unpack_scalar(dst, &src[i], len - i, channels);
+}
+
+TARGET_SSE2
+static void basic_16_unpack_sse2(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels)
+{
+	uint32_t masks[8];
+	__m128i v, lo, hi;
+	size_t i, step;
+	unsigned int j;
+
+	step = slogic_basic_16_unpacked_len(16, channels);
+	for (i = 0; i + 16 <= len; i += 16, dst += step) {
+		v = _mm_loadu_si128((const __m128i *)&src[i]);
+		for (j = 0; j < 8; j++) {
+			masks[j] = (uint32_t)_mm_movemask_epi8(v);
+			v = _mm_add_epi8(v, v);
+		}
+		if (channels == 16) {
+			/* The eight masks are the eight 16bit samples. */
+			v = _mm_setr_epi16(masks[0], masks[1], masks[2], masks[3],
+				masks[4], masks[5], masks[6], masks[7]);
+			_mm_storeu_si128((__m128i *)dst, v);
+		} else if (channels == 8) {
+			/* Low bytes are the first block, high bytes the second. */
+			v = _mm_setr_epi16(masks[0], masks[1], masks[2], masks[3],
+				masks[4], masks[5], masks[6], masks[7]);
+			lo = _mm_and_si128(v, _mm_set1_epi16(0x00ff));
+			hi = _mm_srli_epi16(v, 8);
+			_mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+		} else {
+			basic_16_scatter(dst, masks, 16, channels);
+		}
+	}
+
+	basic_16_unpack_scalar(dst, &src[i], len - i, channels);
+}
+
+TARGET_AVX2
+static void lite_8_unpack_avx2(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels)
+{
+	const __m256i m4 = _mm256_set1_epi8(0x0f);
+	const __m256i m2 = _mm256_set1_epi8(0x03);
+	__m256i v, lo, hi, a0, a1, a2, a3, q0, q1, q2, q3;
+	size_t i;
+
+	i = 0;
+	switch (channels) {
+	case 8:
+		memcpy(dst, src, len);
+		return;
+	case 4:
+		for (; i + 32 <= len; i += 32, dst += 64) {
+			v = _mm256_loadu_si256((const __m256i *)&src[i]);
+			lo = _mm256_and_si256(v, m4);
+			hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), m4);
+			/* Unpacking works per 128bit lane, fix up the order. */
+			q0 = _mm256_unpacklo_epi8(lo, hi);
+			q1 = _mm256_unpackhi_epi8(lo, hi);
+			_mm256_storeu_si256((__m256i *)&dst[0],
+				_mm256_permute2x128_si256(q0, q1, 0x20));
+			_mm256_storeu_si256((__m256i *)&dst[32],
+				_mm256_permute2x128_si256(q0, q1, 0x31));
+		}
+		break;
+	case 2:
+		for (; i + 32 <= len; i += 32, dst += 128) {
+			v = _mm256_loadu_si256((const __m256i *)&src[i]);
+			a0 = _mm256_and_si256(v, m2);
+			a1 = _mm256_and_si256(_mm256_srli_epi16(v, 2), m2);
+			a2 = _mm256_and_si256(_mm256_srli_epi16(v, 4), m2);
+			a3 = _mm256_and_si256(_mm256_srli_epi16(v, 6), m2);
+			lo = _mm256_unpacklo_epi8(a0, a1);
+			hi = _mm256_unpacklo_epi8(a2, a3);
+			q0 = _mm256_unpacklo_epi16(lo, hi);
+			q1 = _mm256_unpackhi_epi16(lo, hi);
+			lo = _mm256_unpackhi_epi8(a0, a1);
+			hi = _mm256_unpackhi_epi8(a2, a3);
+			q2 = _mm256_unpacklo_epi16(lo, hi);
+			q3 = _mm256_unpackhi_epi16(lo, hi);
+			_mm256_storeu_si256((__m256i *)&dst[0],
+				_mm256_permute2x128_si256(q0, q1, 0x20));
+			_mm256_storeu_si256((__m256i *)&dst[32],
+				_mm256_permute2x128_si256(q2, q3, 0x20));
+			_mm256_storeu_si256((__m256i *)&dst[64],
+				_mm256_permute2x128_si256(q0, q1, 0x31));
+			_mm256_storeu_si256((__m256i *)&dst[96],
+				_mm256_permute2x128_si256(q2, q3, 0x31));
+		}
+		break;
+	}
+
+	lite_8_unpack_scalar(dst, &src[i], len - i, channels);
+}
+
+TARGET_AVX2
+static void basic_16_unpack_avx2(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels)
+{
+	uint32_t masks[8];
+	__m256i v;
+	size_t i, step;
+	unsigned int j;
+
+	step = slogic_basic_16_unpacked_len(32, channels);
+	for (i = 0; i + 32 <= len; i += 32, dst += step) {
+		v = _mm256_loadu_si256((const __m256i *)&src[i]);
+		for (j = 0; j < 8; j++) {
+			masks[j] = (uint32_t)_mm256_movemask_epi8(v);
+			v = _mm256_add_epi8(v, v);
+		}
+		basic_16_scatter(dst, masks, 32, channels);
+	}
+
+	basic_16_unpack_sse2(dst, &src[i], len - i, channels);
+}
+
+#endif
+
+#ifdef SLOGIC_UNPACK_NEON
+
+static gboolean supported_neon(void)
+{
+	return sr_cpu_has(SR_CPU_NEON);
+}
+
+static inline uint32_t neon_movemask(uint8x16_t v)
+{
+	static const int8_t shifts[16] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7,
+	};
+	uint8x16_t t;
+
+	t = vshlq_u8(vshrq_n_u8(v, 7), vld1q_s8(shifts));
+
+	return vaddv_u8(vget_low_u8(t)) | (vaddv_u8(vget_high_u8(t)) << 8);
+}
+
+static void lite_8_unpack_neon(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels)
+{
+	uint8x16_t v, m;
+	uint8x16x2_t v2;
+	uint8x16x4_t v4;
+	size_t i;
+
+	i = 0;
+	switch (channels) {
+	case 8:
+		memcpy(dst, src, len);
+		return;
+	case 4:
+		m = vdupq_n_u8(0x0f);
+		for (; i + 16 <= len; i += 16, dst += 32) {
+			v = vld1q_u8(&src[i]);
+			v2.val[0] = vandq_u8(v, m);
+			v2.val[1] = vshrq_n_u8(v, 4);
+			vst2q_u8(dst, v2);
+		}
+		break;
+	case 2:
+		m = vdupq_n_u8(0x03);
+		for (; i + 16 <= len; i += 16, dst += 64) {
+			v = vld1q_u8(&src[i]);
+			v4.val[0] = vandq_u8(v, m);
+			v4.val[1] = vandq_u8(vshrq_n_u8(v, 2), m);
+			v4.val[2] = vandq_u8(vshrq_n_u8(v, 4), m);
+			v4.val[3] = vshrq_n_u8(v, 6);
+			vst4q_u8(dst, v4);
+		}
+		break;
+	}
+
+	lite_8_unpack_scalar(dst, &src[i], len - i, channels);
+}
+
+static void basic_16_unpack_neon(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels)
+{
+	uint32_t masks[8];
+	uint8x16_t v;
+	size_t i, step;
+	unsigned int j;
+
+	step = slogic_basic_16_unpacked_len(16, channels);
+	for (i = 0; i + 16 <= len; i += 16, dst += step) {
+		v = vld1q_u8(&src[i]);
+		for (j = 0; j < 8; j++) {
+			masks[j] = neon_movemask(v);
+			v = vshlq_n_u8(v, 1);
+		}
+		basic_16_scatter(dst, masks, 16, channels);
+	}
+
+	basic_16_unpack_scalar(dst, &src[i], len - i, channels);
+}
+
+#endif
+
+SR_PRIV const struct slogic_unpack_impl slogic_unpack_impls[] = {
+	{ "scalar", supported_always,
+		lite_8_unpack_scalar, basic_16_unpack_scalar, },
+#ifdef SLOGIC_UNPACK_X86
+	{ "sse2", supported_sse2,
+		lite_8_unpack_sse2, basic_16_unpack_sse2, },
+	{ "avx2", supported_avx2,
+		lite_8_unpack_avx2, basic_16_unpack_avx2, },
+#endif
+#ifdef SLOGIC_UNPACK_NEON
+	{ "neon", supported_neon,
+		lite_8_unpack_neon, basic_16_unpack_neon, },
+#endif
+	{ NULL, NULL, NULL, NULL, },
+};
+
+/* Pick the fastest implementation which the running CPU supports. */
+SR_PRIV const struct slogic_unpack_impl *slogic_unpack_impl_get(void)
+{
+	const struct slogic_unpack_impl *impl, *best;
+
+	best = &slogic_unpack_impls[0];
+	for (impl = &slogic_unpack_impls[1]; impl->name; impl++) {
+		if (impl->supported())
+			best = impl;
+	}
+
+	return best;
+}
+
+SR_PRIV void slogic_lite_8_channels(uint8_t *vec, const uint8_t *block,
+	unsigned int channels)
+{
+	unsigned int c, j, per_byte;
+	uint8_t byte;
+
+	per_byte = 8 / channels;
+	memset(vec, 0, channels);
+	for (j = 0; j < 8; j++) {
+		byte = block[j / per_byte] >> (j % per_byte * channels);
+		for (c = 0; c < channels; c++)
+			vec[c] |= ((byte >> c) & 0x1) << (7 - j);
+	}
+}
+
+SR_PRIV void slogic_basic_16_channels(uint8_t *vec, const uint8_t *block,
+	unsigned int channels)
+{
+	/* Already one byte per channel, first sample in the MSB. */
+	memcpy(vec, block, channels);
+}
+
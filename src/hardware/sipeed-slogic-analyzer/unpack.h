@@ -0,0 +1,80 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_HARDWARE_SIPEED_SLOGIC_ANALYZER_UNPACK_H
+#define LIBSIGROK_HARDWARE_SIPEED_SLOGIC_ANALYZER_UNPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+
+/*
+ * Sample unpack kernels for the Slogic devices.
+ *
+ * The Lite 8 packs 8/ch samples of ch bits into each byte (LSB first),
+ * the output is one byte per sample.
+ *
+ * The Basic 16 sends blocks of ch bytes, byte n holding 8 consecutive
+ * samples of channel n (MSB first). Each block transposes to 8 samples
+ * of (ch + 7) / 8 bytes each.
+ *
+ * Kernels only process complete blocks, that is len is expected to be a
+ * multiple of the channel count. This file does not depend on anything
+ * but glib, so that the unit tests can link it directly.
+ */
+
+typedef void (*slogic_unpack_fn)(uint8_t *dst, const uint8_t *src,
+	size_t len, unsigned int channels);
+
+struct slogic_unpack_impl {
+	const char *name;
+	gboolean (*supported)(void);
+	slogic_unpack_fn lite_8;
+	slogic_unpack_fn basic_16;
+};
+
+/* NULL terminated, scalar reference first, fastest last. */
+SR_PRIV extern const struct slogic_unpack_impl slogic_unpack_impls[];
+
+SR_PRIV const struct slogic_unpack_impl *slogic_unpack_impl_get(void);
+
+/*
+ * Split one raw block (channels bytes, 8 samples) into one byte per
+ * channel, sample n in bit 7 - n. This is what the host side trigger
+ * looks at, so the full unpack is only done for data that is kept.
+ */
+SR_PRIV void slogic_lite_8_channels(uint8_t *vec, const uint8_t *block,
+	unsigned int channels);
+SR_PRIV void slogic_basic_16_channels(uint8_t *vec, const uint8_t *block,
+	unsigned int channels);
+
+static inline size_t slogic_lite_8_unpacked_len(size_t len,
+	unsigned int channels)
+{
+	return len * (8 / channels);
+}
+
+static inline size_t slogic_basic_16_unpacked_len(size_t len,
+	unsigned int channels)
+{
+	return (channels >= 8) ? len : len * (8 / channels);
+}
+
+#endif
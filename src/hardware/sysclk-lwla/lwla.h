@@ -122,6 +122,7 @@ struct acquisition_state {
 	enum rle_state rle;		/* RLE decoding state */
 
 	gboolean rle_enabled;	/* capturing in timing-state mode */
+	struct feed_queue_logic *feed_queue;	/* runs output, or NULL */
 	gboolean clock_boost;	/* switch to faster clock during capture */
 	unsigned int status;	/* last received device status */
 
@@ -144,15 +144,21 @@ static void read_response_rle(struct acquisition_state *acq)
 				  PACKET_SIZE / UNIT_SIZE - acq->out_index);
 		run_samples = MIN(max_samples, acq->run_len);
 
-		/* Expand run-length samples into session packet. */
 		sample = GUINT16_TO_LE(acq->sample);
-		out_p = &((uint16_t *)acq->out_packet)[acq->out_index];
-
-		for (ri = 0; ri < run_samples; ri++)
-			out_p[ri] = sample;
+		if (acq->feed_queue) {
+			/* Queue the run as it is. */
+			if (run_samples)
+				feed_queue_logic_submit_one(acq->feed_queue,
+					(const uint8_t *)&sample, run_samples);
+		} else {
+			/* Expand run-length samples into session packet. */
+			out_p = &((uint16_t *)acq->out_packet)[acq->out_index];
+			for (ri = 0; ri < run_samples; ri++)
+				out_p[ri] = sample;
+			acq->out_index += run_samples;
+		}
 
 		acq->run_len -= run_samples;
-		acq->out_index += run_samples;
 		acq->samples_done += run_samples;
 
 		if (run_samples == max_samples)
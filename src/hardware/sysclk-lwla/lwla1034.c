@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <string.h>
 #include "lwla.h"
 #include "protocol.h"
 
@@ -191,7 +192,7 @@ static void read_response(struct acquisition_state *acq)
 {
 	uint64_t sample, high_nibbles, word;
 	uint32_t *slice;
-	uint8_t *out_p;
+	uint8_t *out_p, value[UNIT_SIZE];
 	unsigned int words_left, max_samples, run_samples, wi, ri, si;
 
 	/* Number of 36-bit words remaining in the transfer buffer. */
@@ -204,20 +205,28 @@ static void read_response(struct acquisition_state *acq)
 				  PACKET_SIZE / UNIT_SIZE - acq->out_index);
 		run_samples = MIN(max_samples, acq->run_len);
 
-		/* Expand run-length samples into session packet. */
 		sample = acq->sample;
-		out_p = &acq->out_packet[acq->out_index * UNIT_SIZE];
-
-		for (ri = 0; ri < run_samples; ri++) {
-			out_p[0] =  sample        & 0xFF;
-			out_p[1] = (sample >>  8) & 0xFF;
-			out_p[2] = (sample >> 16) & 0xFF;
-			out_p[3] = (sample >> 24) & 0xFF;
-			out_p[4] = (sample >> 32) & 0xFF;
-			out_p += UNIT_SIZE;
+		value[0] =  sample        & 0xFF;
+		value[1] = (sample >>  8) & 0xFF;
+		value[2] = (sample >> 16) & 0xFF;
+		value[3] = (sample >> 24) & 0xFF;
+		value[4] = (sample >> 32) & 0xFF;
+
+		if (acq->feed_queue) {
+			/* Queue the run as it is. */
+			if (run_samples)
+				feed_queue_logic_submit_one(acq->feed_queue,
+					value, run_samples);
+		} else {
+			/* Expand run-length samples into session packet. */
+			out_p = &acq->out_packet[acq->out_index * UNIT_SIZE];
+			for (ri = 0; ri < run_samples; ri++) {
+				memcpy(out_p, value, UNIT_SIZE);
+				out_p += UNIT_SIZE;
+			}
+			acq->out_index += run_samples;
 		}
 		acq->run_len -= run_samples;
-		acq->out_index += run_samples;
 		acq->samples_done += run_samples;
 
 		if (run_samples == max_samples)
@@ -239,6 +239,8 @@ static void handle_read_response(const struct sr_dev_inst *sdi)
 		sr_session_send(sdi, &packet);
 		acq->out_index = 0;
 	}
+	if (!devc->cancel_requested && acq->feed_queue)
+		feed_queue_logic_flush(acq->feed_queue);
 	submit_request(sdi, STATE_READ_FINISH);
 }
 
@@ -254,6 +256,7 @@ static void clear_acquisition_state(const struct sr_dev_inst *sdi)
 	devc->acquisition = NULL;
 
 	if (acq) {
+		feed_queue_logic_free(acq->feed_queue);
 		libusb_free_transfer(acq->xfer_out);
 		libusb_free_transfer(acq->xfer_in);
 		g_free(acq);
@@ -442,6 +445,7 @@ static int init_acquisition_state(const struct sr_dev_inst *sdi)
 	struct dev_context *devc;
 	struct sr_usb_dev_inst *usb;
 	struct acquisition_state *acq;
+	size_t unitsize;
 
 	devc = sdi->priv;
 	usb = sdi->conn;
@@ -519,6 +523,18 @@ static int init_acquisition_state(const struct sr_dev_inst *sdi)
 	}
 
 	acq->rle_enabled = devc->cfg_rle;
+
+	/*
+	 * Pass the device's runs on as they are when the session takes
+	 * them, instead of expanding them into every single sample.
+	 */
+	if (acq->rle_enabled && sr_session_takes_logic_rle(sdi->session)) {
+		unitsize = (devc->model->num_channels + 7) / 8;
+		acq->feed_queue = feed_queue_logic_alloc(sdi,
+			PACKET_SIZE / unitsize, unitsize);
+		if (acq->feed_queue)
+			feed_queue_logic_rle(acq->feed_queue, TRUE);
+	}
 	devc->acquisition = acq;
 
 	return SR_OK;
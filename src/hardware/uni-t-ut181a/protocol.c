@@ -1232,6 +1232,43 @@ SR_PRIV int ut181a_send_cmd_get_rec_samples(struct sr_serial_dev_inst *serial, s
 	return ut181a_send_frame(serial, cmd, sizeof(cmd));
 }
 
+/*
+ * Keep requests for record samples in flight. Just one until the first
+ * response told the chunk size, then up to the pipeline depth.
+ */
+SR_PRIV int ut181a_request_rec_samples(struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sr_serial_dev_inst *serial;
+	struct ut181a_rec_data *rec;
+	size_t depth, slot;
+	int ret;
+
+	devc = sdi->priv;
+	serial = sdi->conn;
+	rec = &devc->info.rec_data;
+
+	if (sdi->status != SR_ST_ACTIVE)
+		return SR_OK;
+
+	depth = rec->chunk_size ? UT181A_REC_PIPELINE : 1;
+	while (rec->pending_count + rec->discard_count < depth &&
+			rec->samples_requested < rec->samples_total) {
+		ret = ut181a_send_cmd_get_rec_samples(serial,
+			rec->rec_idx, rec->samples_requested);
+		if (ret < 0)
+			return ret;
+		slot = rec->pending_head + rec->pending_count;
+		rec->pending_off[slot % UT181A_REC_PIPELINE] = rec->samples_requested;
+		rec->pending_count++;
+		if (!rec->chunk_size)
+			break;
+		rec->samples_requested += rec->chunk_size;
+	}
+
+	return SR_OK;
+}
+
 /* TODO
  * Construct and transmit "record on/off" command. Requires a caption,
  * an interval, and a duration to start a recording. Recordings can get
@@ -1518,6 +1555,39 @@ static int ut181a_feedbuff_send_feed(struct feed_buffer *buff,
 	return ret;
 }
 
+/**
+ * Send several values of the feed buffer's channel in one packet.
+ */
+static int ut181a_feedbuff_send_values(struct feed_buffer *buff,
+	struct sr_dev_inst *sdi, float *values, size_t count, int digits)
+{
+	int ret;
+	struct dev_context *devc;
+
+	if (!buff || !sdi)
+		return SR_ERR_ARG;
+
+	if (sdi->status != SR_ST_ACTIVE)
+		return SR_OK;
+	devc = sdi->priv;
+	if (!devc || devc->disable_feed)
+		return SR_OK;
+
+	count = sr_sw_limits_samples_allowed(&devc->limits, count);
+	if (!count)
+		return SR_OK;
+
+	buff->analog.data = values;
+	buff->analog.num_samples = count;
+	buff->analog.encoding->digits = digits;
+	buff->analog.spec->spec_digits = digits;
+	ret = ut181a_feedbuff_send_feed(buff, sdi, count);
+	buff->analog.data = &buff->main_value;
+	buff->analog.num_samples = 1;
+
+	return ret;
+}
+
 /**
  * Release previously allocated resources in the feed buffer.
  */
@@ -1742,6 +1812,10 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 	struct feed_buffer feedbuff;
 	struct value_params value;
 	const struct mqopt_item *mqitem;
+	struct ut181a_rec_data *rec;
+	float rec_values[256];
+	size_t rec_off, rec_idx, rec_count;
+	int rec_digits;
 	int ret;
 	uint8_t v8; uint16_t v16; uint32_t v32; float vf;
 
@@ -2549,9 +2623,7 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 			break;
 		if (!devc || devc->disable_feed || !info)
 			break;
-		ret = ut181a_feedbuff_initialize(&feedbuff);
-		ret = ut181a_feedbuff_setup_channel(&feedbuff, UT181A_CH_MAIN, sdi);
-		ret = ut181a_feedbuff_setup_unit(&feedbuff, devc->last_data.unit_text);
+		rec = &info->rec_data;
 
 		/*
 		 * Record data:
@@ -2561,42 +2633,77 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 		 *   - u8 precision
 		 *   - u32 timestamp
 		 */
-		ret = consume_u8(&info->rec_data.samples_chunk, &payload, &pl_dlen);
+		ret = consume_u8(&rec->samples_chunk, &payload, &pl_dlen);
 		if (ret != SR_OK)
 			return SR_ERR_DATA;
-		info->rec_data.samples_curr += info->rec_data.samples_chunk;
-		while (info->rec_data.samples_chunk--) {
-			/*
-			 * Implementation detail: Consume all received
-			 * data, yet skip processing when a limit was
-			 * reached and previously terminated acquisition.
-			 */
+
+		/* Answers to requests sent before a short chunk arrived. */
+		if (rec->discard_count) {
+			rec->discard_count--;
+			break;
+		}
+		if (rec->pending_count) {
+			rec_off = rec->pending_off[rec->pending_head];
+			rec->pending_head++;
+			rec->pending_head %= UT181A_REC_PIPELINE;
+			rec->pending_count--;
+		} else {
+			rec_off = rec->samples_curr;
+		}
+
+		/*
+		 * Send runs of samples with the same precision in one
+		 * packet each, rather than one packet per sample.
+		 */
+		ret = ut181a_feedbuff_initialize(&feedbuff);
+		ret |= ut181a_feedbuff_setup_channel(&feedbuff, UT181A_CH_MAIN, sdi);
+		ret |= ut181a_feedbuff_setup_unit(&feedbuff, devc->last_data.unit_text);
+		rec_count = 0;
+		rec_digits = 0;
+		for (rec_idx = 0; rec_idx < rec->samples_chunk; rec_idx++) {
 			ret = SR_OK;
 			ret |= consume_flt(&vf, &payload, &pl_dlen);
 			ret |= consume_u8(&v8, &payload, &pl_dlen);
 			ret |= consume_u32(&v32, &payload, &pl_dlen);
-			if (ret != SR_OK)
-				return SR_ERR_DATA;
-
-			if (sdi->status != SR_ST_ACTIVE)
-				continue;
-
-			ret = ut181a_feedbuff_start_frame(sdi);
-			if (ret != SR_OK)
-				return SR_ERR_DATA;
-
-			ret = SR_OK;
 			ret |= ut181a_get_value_params(&value, vf, v8);
 			ret |= ut181a_feedbuff_setup_value(&feedbuff, &value);
-			ret |= ut181a_feedbuff_send_feed(&feedbuff, sdi, 1);
-			if (ret != SR_OK)
-				return SR_ERR_DATA;
-
-			ret = ut181a_feedbuff_count_frame(sdi);
-			if (ret != SR_OK)
+			if (ret != SR_OK) {
+				ut181a_feedbuff_cleanup(&feedbuff);
 				return SR_ERR_DATA;
+			}
+			if (rec_count && value.digits != rec_digits) {
+				ut181a_feedbuff_send_values(&feedbuff, sdi,
+					rec_values, rec_count, rec_digits);
+				rec_count = 0;
+			}
+			rec_digits = value.digits;
+			rec_values[rec_count++] = feedbuff.main_value;
+		}
+		if (rec_count)
+			ut181a_feedbuff_send_values(&feedbuff, sdi,
+				rec_values, rec_count, rec_digits);
+		ut181a_feedbuff_cleanup(&feedbuff);
+		rec->samples_curr += rec->samples_chunk;
+
+		if (!rec->samples_chunk && rec->samples_curr < rec->samples_total) {
+			sr_warn("Empty record data chunk, download ends early.");
+			rec->samples_total = rec->samples_curr;
+		}
+		if (!rec->chunk_size) {
+			rec->chunk_size = rec->samples_chunk;
+			rec->samples_requested = rec->samples_curr;
+		} else if (rec->samples_chunk != MIN(rec->chunk_size,
+				rec->samples_total - rec_off)) {
+			/*
+			 * The meter picked another chunk size. Drop what was
+			 * requested from wrong offsets, continue from here.
+			 */
+			sr_dbg("Record chunk of %u samples at %zu, re-requesting.",
+				rec->samples_chunk, rec_off);
+			rec->discard_count = rec->pending_count;
+			rec->pending_count = 0;
+			rec->samples_requested = rec->samples_curr;
 		}
-		ret = ut181a_feedbuff_cleanup(&feedbuff);
 		break;
 
 	case RSP_TYPE_REPLY_DATA:
@@ -2672,14 +2779,13 @@ static int process_packet(struct sr_dev_inst *sdi, uint8_t *pkt, size_t len)
 			/*
 			 * The sample count was incremented above during
 			 * reception, because of variable length chunks
-			 * of sample data.
+			 * of sample data. Top up the requests in flight.
 			 */
 			if (info->rec_data.samples_curr >= info->rec_data.samples_total) {
 				ut181a_cond_stop_acquisition(sdi);
 				break;
 			}
-			ret = ut181a_send_cmd_get_rec_samples(serial,
-				info->rec_data.rec_idx, info->rec_data.samples_curr);
+			ret = ut181a_request_rec_samples(sdi);
 			if (ret < 0)
 				ut181a_cond_stop_acquisition(sdi);
 			break;
@@ -34,6 +34,15 @@
 #define UT181A_WITH_TIMESTAMP 0
 #define UT181A_WITH_SER_ECHO 0
 
+/*
+ * Record samples get downloaded in chunks, of a size the meter picks.
+ * Once the first response told the chunk size, this many requests for
+ * the following chunks are kept in flight. The meter answers them in
+ * order. Few enough for the meter and the CP2110 bridge to buffer,
+ * enough to hide the round trip.
+ */
+#define UT181A_REC_PIPELINE 4
+
 /*
  * The largest frame we expect to receive is chunked record data. Which
  * can span up to 256 items which each occupy 9 bytes, plus some header
@@ -351,11 +360,19 @@ struct ut181a_info {
 		uint8_t max_prec, avg_prec, min_prec;
 		uint32_t start_stamp;
 	} rec_info;
-	struct {
+	struct ut181a_rec_data {
 		size_t rec_idx;
 		size_t samples_total;
 		size_t samples_curr;
 		uint8_t samples_chunk;
+		/* Learnt from the first response, 0 before. */
+		size_t chunk_size;
+		/* Offset of the next request, and of those in flight. */
+		size_t samples_requested;
+		size_t pending_off[UT181A_REC_PIPELINE];
+		size_t pending_head, pending_count;
+		/* Responses in flight to discard after a short chunk. */
+		size_t discard_count;
 	} rec_data;
 	struct {
 		enum ut181_cmd_code code;
@@ -421,6 +438,7 @@ SR_PRIV int ut181a_send_cmd_get_saved_value(struct sr_serial_dev_inst *serial, s
 SR_PRIV int ut181a_send_cmd_get_recs_count(struct sr_serial_dev_inst *serial);
 SR_PRIV int ut181a_send_cmd_get_rec_info(struct sr_serial_dev_inst *serial, size_t idx);
 SR_PRIV int ut181a_send_cmd_get_rec_samples(struct sr_serial_dev_inst *serial, size_t idx, size_t off);
+SR_PRIV int ut181a_request_rec_samples(struct sr_dev_inst *sdi);
 
 SR_PRIV int ut181a_configure_waitfor(struct dev_context *devc,
 	gboolean want_code, enum ut181_cmd_code want_data,
@@ -851,59 +851,68 @@ SR_PRIV int dlm_channel_data_request(const struct sr_dev_inst *sdi)
 		devc->data_pending = TRUE;
 	else
 		devc->data_pending = FALSE;
+	devc->data_started = FALSE;
 
 	return result;
 }
 
 /**
- * Reads and removes the block data header from a given data input.
+ * Collects the block data header at the start of a query response.
  * Format is #ndddd... with n being the number of decimal digits d.
  * The string dddd... contains the decimal-encoded length of the data.
  * Example: #9000000013 would yield a length of 13 bytes.
  *
- * @param data The input data.
- * @param len The determined input data length.
+ * @param devc The device context, which keeps the partial header.
+ * @param buf The received bytes.
+ * @param len The number of received bytes.
+ *
+ * @return The number of bytes taken from buf, or -1 for a malformed header.
  */
-static int dlm_block_data_header_process(GArray *data, int *len)
+static int dlm_block_data_header_process(struct dev_context *devc,
+		const char *buf, int len)
 {
-	int i, n;
-	gchar s[20];
-
-	if (g_array_index(data, gchar, 0) != '#')
-		return SR_ERR;
+	int used, n;
 
-	n = (uint8_t)(g_array_index(data, gchar, 1) - '0');
+	used = 0;
+	while (used < len && !devc->header_done) {
+		devc->block_header[devc->block_header_len++] = buf[used++];
 
-	for (i = 0; i < n; i++)
-		s[i] = g_array_index(data, gchar, 2 + i);
-	s[i] = 0;
+		if (devc->block_header[0] != '#')
+			return -1;
+		if (devc->block_header_len < 2)
+			continue;
 
-	if (sr_atoi(s, len) != SR_OK)
-		return SR_ERR;
+		n = devc->block_header[1] - '0';
+		if (n < 1 || n > 9)
+			return -1;
+		if (devc->block_header_len < (size_t)(2 + n))
+			continue;
 
-	g_array_remove_range(data, 0, 2 + n);
+		devc->block_header[devc->block_header_len] = '\0';
+		if (sr_atoi(devc->block_header + 2, &devc->block_len) != SR_OK ||
+				devc->block_len < 0)
+			return -1;
+		devc->block_bytes_left = devc->block_len;
+		devc->header_done = TRUE;
+	}
 
-	return SR_OK;
+	return used;
 }
 
 /**
- * Turns raw sample data into voltages and sends them off to the session bus.
+ * Sends raw sample data off to the session bus, together with the
+ * scale and offset which turn it into voltages.
  *
  * @param data The raw sample data.
+ * @param samples The number of samples.
  * @ch_state Pointer to the state of the channel whose data we're processing.
  * @sdi The device instance.
- *
- * @return SR_ERR when data is trucated, SR_OK otherwise.
  */
-static int dlm_analog_samples_send(GArray *data,
+static void dlm_analog_samples_send(const uint8_t *data, size_t samples,
 		struct analog_channel_state *ch_state,
 		struct sr_dev_inst *sdi)
 {
-	uint32_t i, samples;
-	float voltage, range, offset;
-	GArray *float_data;
 	struct dev_context *devc;
-	struct scope_state *model_state;
 	struct sr_channel *ch;
 	struct sr_datafeed_analog analog;
 	struct sr_analog_encoding encoding;
@@ -912,35 +921,25 @@ static int dlm_analog_samples_send(GArray *data,
 	struct sr_datafeed_packet packet;
 
 	devc = sdi->priv;
-	model_state = devc->model_state;
-	samples = model_state->samples_per_frame;
 	ch = devc->current_channel->data;
 
-	if (data->len < samples * sizeof(uint8_t)) {
-		sr_err("Truncated waveform data packet received.");
-		return SR_ERR;
-	}
-
-	range = ch_state->waveform_range;
-	offset = ch_state->waveform_offset;
+	/* TODO: Use proper 'digits' value for this device (and its modes). */
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
+	analog.meaning->channels = g_slist_append(NULL, ch);
+	analog.num_samples = samples;
+	analog.data = (void *)data;
 
 	/*
-	 * Convert byte sample to voltage according to
+	 * Byte samples turn into voltages according to
 	 * page 269 of the Communication Interface User's Manual.
 	 */
-	float_data = g_array_new(FALSE, FALSE, sizeof(float));
-	for (i = 0; i < samples; i++) {
-		voltage = (float)g_array_index(data, int8_t, i);
-		voltage = (range * voltage /
-				DLM_DIVISION_FOR_BYTE_FORMAT) + offset;
-		g_array_append_val(float_data, voltage);
-	}
+	encoding.unitsize = sizeof(int8_t);
+	encoding.is_signed = TRUE;
+	encoding.is_float = FALSE;
+	sr_rational_from_double(&encoding.scale,
+		ch_state->waveform_range / DLM_DIVISION_FOR_BYTE_FORMAT);
+	sr_rational_from_double(&encoding.offset, ch_state->waveform_offset);
 
-	/* TODO: Use proper 'digits' value for this device (and its modes). */
-	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
-	analog.meaning->channels = g_slist_append(NULL, ch);
-	analog.num_samples = float_data->len;
-	analog.data = (float*)float_data->data;
 	analog.meaning->mq = SR_MQ_VOLTAGE;
 	analog.meaning->unit = SR_UNIT_VOLT;
 	analog.meaning->mqflags = 0;
@@ -948,50 +947,27 @@ static int dlm_analog_samples_send(GArray *data,
 	packet.payload = &analog;
 	sr_session_send(sdi, &packet);
 	g_slist_free(analog.meaning->channels);
-
-	g_array_free(float_data, TRUE);
-	g_array_remove_range(data, 0, samples * sizeof(uint8_t));
-
-	return SR_OK;
 }
 
 /**
  * Sends logic sample data off to the session bus.
  *
  * @param data The raw sample data.
- * @ch_state Pointer to the state of the channel whose data we're processing.
+ * @param samples The number of samples.
  * @sdi The device instance.
- *
- * @return SR_ERR when data is trucated, SR_OK otherwise.
  */
-static int dlm_digital_samples_send(GArray *data,
+static void dlm_digital_samples_send(const uint8_t *data, size_t samples,
 		struct sr_dev_inst *sdi)
 {
-	struct dev_context *devc;
-	struct scope_state *model_state;
-	uint32_t samples;
 	struct sr_datafeed_logic logic;
 	struct sr_datafeed_packet packet;
 
-	devc = sdi->priv;
-	model_state = devc->model_state;
-	samples = model_state->samples_per_frame;
-
-	if (data->len < samples * sizeof(uint8_t)) {
-		sr_err("Truncated waveform data packet received.");
-		return SR_ERR;
-	}
-
 	logic.length = samples;
 	logic.unitsize = 1;
-	logic.data = data->data;
+	logic.data = (void *)data;
 	packet.type = SR_DF_LOGIC;
 	packet.payload = &logic;
 	sr_session_send(sdi, &packet);
-
-	g_array_remove_range(data, 0, samples * sizeof(uint8_t));
-
-	return SR_OK;
 }
 
 /**
@@ -1011,8 +987,9 @@ SR_PRIV int dlm_data_receive(int fd, int revents, void *cb_data)
 	struct scope_state *model_state;
 	struct dev_context *devc;
 	struct sr_channel *ch;
-	int chunk_len, num_bytes;
-	static GArray *data = NULL;
+	const char *buf;
+	int chunk_len, used;
+	uint64_t num_bytes;
 
 	(void)fd;
 	(void)revents;
@@ -1031,71 +1008,97 @@ SR_PRIV int dlm_data_receive(int fd, int revents, void *cb_data)
 		return TRUE;
 
 	/* Check if a new query response is coming our way. */
-	if (!data) {
-		if (sr_scpi_read_begin(sdi->conn) == SR_OK)
-			/* The 16 here accounts for the header and EOL. */
-			data = g_array_sized_new(FALSE, FALSE, sizeof(uint8_t),
-					16 + model_state->samples_per_frame);
-		else
+	if (!devc->data_started) {
+		if (sr_scpi_read_begin(sdi->conn) != SR_OK)
 			return TRUE;
+		devc->data_started = TRUE;
+		devc->header_done = FALSE;
+		devc->block_header_len = 0;
+		devc->samples_sent = 0;
 	}
 
-	/* Store incoming data. */
 	chunk_len = sr_scpi_read_data(sdi->conn, devc->receive_buffer,
 			RECEIVE_BUFFER_SIZE);
 	if (chunk_len < 0) {
 		sr_err("Error while reading data: %d", chunk_len);
 		goto fail;
 	}
-	g_array_append_vals(data, devc->receive_buffer, chunk_len);
+	buf = devc->receive_buffer;
+
+	if (!devc->header_done) {
+		used = dlm_block_data_header_process(devc, buf, chunk_len);
+		if (used < 0) {
+			sr_err("Encountered malformed block data header.");
+			goto fail;
+		}
+		buf += used;
+		chunk_len -= used;
+	}
+
+	/*
+	 * Send the samples as they arrive, rather than collecting the
+	 * entire query response first. Bytes past the expected number
+	 * of samples and the trailing EOL get dropped.
+	 */
+	ch = devc->current_channel->data;
+	if (devc->header_done && chunk_len > 0) {
+		num_bytes = MIN((uint64_t)chunk_len, devc->block_bytes_left);
+		devc->block_bytes_left -= num_bytes;
+		num_bytes = MIN(num_bytes,
+			model_state->samples_per_frame - devc->samples_sent);
+		if (num_bytes > 0) {
+			/* Signal the beginning of a new frame if this is the first channel. */
+			if (devc->samples_sent == 0 &&
+					devc->current_channel == devc->enabled_channels)
+				std_session_send_df_frame_begin(sdi);
+
+			switch (ch->type) {
+			case SR_CHANNEL_ANALOG:
+				dlm_analog_samples_send((const uint8_t *)buf,
+					num_bytes,
+					&model_state->analog_states[ch->index],
+					sdi);
+				break;
+			case SR_CHANNEL_LOGIC:
+				dlm_digital_samples_send((const uint8_t *)buf,
+					num_bytes, sdi);
+				break;
+			default:
+				sr_err("Invalid channel type encountered.");
+				break;
+			}
+			devc->samples_sent += num_bytes;
+		}
+	}
 
-	/* Read the entire query response before processing. */
+	/* Read the entire query response before moving on. */
 	if (!sr_scpi_read_complete(sdi->conn))
 		return TRUE;
 
 	/* We finished reading and are no longer waiting for data. */
 	devc->data_pending = FALSE;
+	devc->data_started = FALSE;
 
-	/* Signal the beginning of a new frame if this is the first channel. */
-	if (devc->current_channel == devc->enabled_channels)
-		std_session_send_df_frame_begin(sdi);
-
-	if (dlm_block_data_header_process(data, &num_bytes) != SR_OK) {
+	if (!devc->header_done) {
 		sr_err("Encountered malformed block data header.");
 		goto fail;
 	}
 
-	if (num_bytes == 0) {
+	if (devc->block_len == 0) {
 		sr_warn("Zero-length waveform data packet received. " \
 				"Live mode not supported yet, stopping " \
 				"acquisition and retrying.");
 		/* Don't care about return value here. */
 		dlm_acquisition_stop(sdi->conn);
-		g_array_free(data, TRUE);
 		dlm_channel_data_request(sdi);
 		return TRUE;
 	}
 
-	ch = devc->current_channel->data;
-	switch (ch->type) {
-	case SR_CHANNEL_ANALOG:
-		if (dlm_analog_samples_send(data,
-				&model_state->analog_states[ch->index],
-				sdi) != SR_OK)
-			goto fail;
-		break;
-	case SR_CHANNEL_LOGIC:
-		if (dlm_digital_samples_send(data, sdi) != SR_OK)
-			goto fail;
-		break;
-	default:
-		sr_err("Invalid channel type encountered.");
-		break;
+	if (devc->samples_sent < model_state->samples_per_frame) {
+		sr_err("Truncated waveform data packet received.");
+		goto fail;
 	}
 
-	g_array_free(data, TRUE);
-	data = NULL;
-
 	/*
 	 * Signal the end of this frame if this was the last enabled channel
 	 * and set the next enabled channel. Then, request its data.
@@ -1121,10 +1124,7 @@ SR_PRIV int dlm_data_receive(int fd, int revents, void *cb_data)
 	return TRUE;
 
 fail:
-	if (data) {
-		g_array_free(data, TRUE);
-		data = NULL;
-	}
+	devc->data_started = FALSE;
 
 	return FALSE;
 }
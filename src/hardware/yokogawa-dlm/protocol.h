@@ -34,7 +34,7 @@
 
 #define MAX_INSTRUMENT_VERSIONS 8
 
-#define RECEIVE_BUFFER_SIZE 4096
+#define RECEIVE_BUFFER_SIZE (64 * 1024)
 
 /* See Communication Interface User's Manual on p. 268 (:WAVeform:ALL:SEND?). */
 #define DLM_MAX_FRAME_LENGTH 12500
@@ -111,6 +111,15 @@ struct dev_context {
 
 	char receive_buffer[RECEIVE_BUFFER_SIZE];
 	gboolean data_pending;
+
+	/* Block data of the query response being received. */
+	gboolean data_started;
+	gboolean header_done;
+	char block_header[12];
+	size_t block_header_len;
+	int block_len;
+	uint64_t block_bytes_left;
+	uint32_t samples_sent;
 };
 
 SR_PRIV int dlm_channel_state_set(const struct sr_dev_inst *sdi,
@@ -429,6 +429,15 @@ SR_PRIV int analyzer_read_data(libusb_device_handle *devh, void *buffer,
 	return gl_read_bulk(devh, buffer, size);
 }
 
+SR_PRIV int analyzer_read_data_async(libusb_device_handle *devh,
+		struct libusb_transfer *transfer, void *buffer,
+		unsigned int size, libusb_transfer_cb_fn callback,
+		void *user_data)
+{
+	return gl_read_bulk_async(devh, transfer, buffer, size,
+				  callback, user_data);
+}
+
 SR_PRIV void analyzer_read_stop(libusb_device_handle *devh)
 {
 	analyzer_write_status(devh, 3, STATUS_FLAG_20);
@@ -89,20 +89,28 @@ static int gl_read_data(libusb_device_handle *devh)
 	return (ret == 1) ? packet[0] : ret;
 }
 
-SR_PRIV int gl_read_bulk(libusb_device_handle *devh, void *buffer,
-			 unsigned int size)
+static int gl_read_bulk_request(libusb_device_handle *devh, unsigned int size)
 {
 	unsigned char packet[8] = {
 		0, 0, 0, 0, size & 0xff, (size & 0xff00) >> 8,
 		(size & 0xff0000) >> 16, (size & 0xff000000) >> 24
 	};
-	int ret, transferred = 0;
+	int ret;
 
 	ret = libusb_control_transfer(devh, CTRL_OUT, 0x4, REQ_READBULK,
 				      0, packet, 8, TIMEOUT_MS);
 	if (ret != 8)
 		sr_err("%s: libusb_control_transfer: %s.", __func__,
 		       libusb_error_name(ret));
+	return ret;
+}
+
+SR_PRIV int gl_read_bulk(libusb_device_handle *devh, void *buffer,
+			 unsigned int size)
+{
+	int ret, transferred = 0;
+
+	gl_read_bulk_request(devh, size);
 
 	ret = libusb_bulk_transfer(devh, EP1_BULK_IN, buffer, size,
 				   &transferred, TIMEOUT_MS);
@@ -112,6 +120,26 @@ SR_PRIV int gl_read_bulk(libusb_device_handle *devh, void *buffer,
 	return transferred;
 }
 
+SR_PRIV int gl_read_bulk_async(libusb_device_handle *devh,
+			       struct libusb_transfer *transfer,
+			       void *buffer, unsigned int size,
+			       libusb_transfer_cb_fn callback, void *user_data)
+{
+	int ret;
+
+	ret = gl_read_bulk_request(devh, size);
+	if (ret != 8)
+		return (ret < 0) ? ret : LIBUSB_ERROR_IO;
+
+	libusb_fill_bulk_transfer(transfer, devh, EP1_BULK_IN, buffer, size,
+				  callback, user_data, TIMEOUT_MS);
+	ret = libusb_submit_transfer(transfer);
+	if (ret < 0)
+		sr_err("%s: libusb_submit_transfer: %s.", __func__,
+		       libusb_error_name(ret));
+	return ret;
+}
+
 SR_PRIV int gl_reg_write(libusb_device_handle *devh, unsigned int reg,
 		 unsigned int val)
 {
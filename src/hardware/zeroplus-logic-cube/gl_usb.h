@@ -37,6 +37,10 @@
 
 SR_PRIV int gl_read_bulk(libusb_device_handle *devh, void *buffer,
 			 unsigned int size);
+SR_PRIV int gl_read_bulk_async(libusb_device_handle *devh,
+			       struct libusb_transfer *transfer,
+			       void *buffer, unsigned int size,
+			       libusb_transfer_cb_fn callback, void *user_data);
 SR_PRIV int gl_reg_write(libusb_device_handle *devh, unsigned int reg,
 			 unsigned int val);
 SR_PRIV int gl_reg_read(libusb_device_handle *devh, unsigned int reg);
@@ -126,3 +126,318 @@ SR_PRIV void set_triggerbar(struct dev_context *devc)
 	sr_dbg("ramsize_triggerbar_address = %d(0x%x)",
 	       ramsize_trigger, ramsize_trigger);
 }
+
+static void acquisition_finish(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct drv_context *drvc;
+	struct sr_usb_dev_inst *usb;
+	size_t i;
+
+	devc = sdi->priv;
+	drvc = sdi->driver->context;
+	usb = sdi->conn;
+
+	if (devc->acq_state == ZP_ACQ_READ)
+		analyzer_read_stop(usb->devhdl);
+	if (devc->acq_aborted)
+		analyzer_reset(usb->devhdl);
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		libusb_free_transfer(devc->transfers[i]);
+		devc->transfers[i] = NULL;
+		g_free(devc->transfer_bufs[i]);
+		devc->transfer_bufs[i] = NULL;
+	}
+	devc->acq_state = ZP_ACQ_IDLE;
+
+	usb_source_remove(sdi->session, drvc->sr_ctx);
+	std_session_send_df_end(sdi);
+}
+
+static void LIBUSB_CALL transfer_callback(struct libusb_transfer *transfer)
+{
+	const struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	size_t i;
+
+	sdi = transfer->user_data;
+	devc = sdi->priv;
+
+	/* Chunks get sent out by the source callback, not in here. */
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfers[i] == transfer)
+			devc->transfer_busy[i] = FALSE;
+	}
+}
+
+static int submit_transfer(const struct sr_dev_inst *sdi, size_t idx)
+{
+	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
+	unsigned int len;
+	int ret;
+
+	devc = sdi->priv;
+	usb = sdi->conn;
+
+	len = MIN(devc->bytes_left, TRANSFER_SIZE);
+	ret = analyzer_read_data_async(usb->devhdl, devc->transfers[idx],
+		devc->transfer_bufs[idx], len, transfer_callback, (void *)sdi);
+	if (ret < 0)
+		return SR_ERR_IO;
+
+	devc->bytes_left -= len;
+	devc->transfer_busy[idx] = TRUE;
+
+	return SR_OK;
+}
+
+/* Send out a chunk of capture memory, minus the samples to throw away. */
+static void send_samples(const struct sr_dev_inst *sdi,
+		unsigned char *buf, unsigned int len)
+{
+	struct dev_context *devc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	unsigned int skip;
+
+	devc = sdi->priv;
+
+	skip = MIN(devc->discard, len / 4);
+	devc->discard -= skip;
+	buf += skip * 4;
+	len -= skip * 4;
+
+	/* Check if we've read all the samples */
+	if (devc->samples_read + len / 4 >= devc->valid_samples)
+		len = (devc->valid_samples - devc->samples_read) * 4;
+	if (!len)
+		return;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = 4;
+
+	if (devc->samples_read < devc->trigger_offset &&
+	    devc->samples_read + len / 4 > devc->trigger_offset) {
+		/* Send out samples remaining before trigger */
+		logic.length = (devc->trigger_offset - devc->samples_read) * 4;
+		logic.data = buf;
+		sr_session_send(sdi, &packet);
+		len -= logic.length;
+		buf += logic.length;
+		devc->samples_read += logic.length / 4;
+	}
+
+	if (devc->samples_read == devc->trigger_offset)
+		std_session_send_df_trigger(sdi);
+
+	/* Send out data (or data after trigger) */
+	logic.length = len;
+	logic.data = buf;
+	sr_session_send(sdi, &packet);
+	devc->samples_read += len / 4;
+}
+
+/* The capture is done, work out what to read back and start reading. */
+static void readback_start(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct sr_usb_dev_inst *usb;
+	unsigned int status;
+	unsigned int stop_address;
+	unsigned int now_address;
+	unsigned int trigger_address;
+	unsigned int triggerbar;
+	unsigned int ramsize_trigger;
+	unsigned int memory_size;
+	unsigned int n;
+	int trigger_now;
+	size_t i;
+
+	devc = sdi->priv;
+	usb = sdi->conn;
+
+	status = analyzer_read_status(usb->devhdl);
+	stop_address = analyzer_get_stop_address(usb->devhdl);
+	now_address = analyzer_get_now_address(usb->devhdl);
+	trigger_address = analyzer_get_trigger_address(usb->devhdl);
+
+	triggerbar = analyzer_get_triggerbar_address();
+	ramsize_trigger = analyzer_get_ramsize_trigger_address();
+
+	n = get_memory_size(devc->memory_size);
+	memory_size = n / 4;
+
+	sr_info("Status = 0x%x.", status);
+	sr_info("Stop address       = 0x%x.", stop_address);
+	sr_info("Now address        = 0x%x.", now_address);
+	sr_info("Trigger address    = 0x%x.", trigger_address);
+	sr_info("Triggerbar address = 0x%x.", triggerbar);
+	sr_info("Ramsize trigger    = 0x%x.", ramsize_trigger);
+	sr_info("Memory size        = 0x%x.", memory_size);
+
+	/* Check for empty capture */
+	if ((status & STATUS_READY) && !stop_address) {
+		acquisition_finish(sdi);
+		return;
+	}
+
+	/* Check if the trigger is in the samples we are throwing away */
+	trigger_now = now_address == trigger_address ||
+		((now_address + 1) % memory_size) == trigger_address;
+
+	/*
+	 * STATUS_READY doesn't clear until now_address advances past
+	 * addr 0, but for our logic, clear it in that case
+	 */
+	if (!now_address)
+		status &= ~STATUS_READY;
+
+	analyzer_read_start(usb->devhdl);
+	devc->acq_state = ZP_ACQ_READ;
+
+	/* Calculate how much data to discard */
+	devc->discard = 0;
+	if (status & STATUS_READY) {
+		/*
+		 * We haven't wrapped around, we need to throw away data from
+		 * our current position to the end of the buffer.
+		 * Additionally, the first two samples captured are always
+		 * bogus.
+		 */
+		devc->discard += memory_size - now_address + 2;
+		now_address = 2;
+	}
+
+	/* If we have more samples than we need, discard them */
+	devc->valid_samples = (stop_address - now_address) % memory_size;
+	if (devc->valid_samples > ramsize_trigger + triggerbar) {
+		devc->discard += devc->valid_samples -
+			(ramsize_trigger + triggerbar);
+		now_address += devc->valid_samples -
+			(ramsize_trigger + triggerbar);
+	}
+
+	sr_info("Need to discard %d samples.", devc->discard);
+
+	/* Calculate how far in the trigger is */
+	if (trigger_now)
+		devc->trigger_offset = 0;
+	else
+		devc->trigger_offset = (trigger_address - now_address) %
+			memory_size;
+
+	/* Recalculate the number of samples available */
+	devc->valid_samples = (stop_address - now_address) % memory_size;
+	devc->samples_read = 0;
+
+	/* Don't read back more packets than hold samples to keep. */
+	devc->bytes_left = (devc->discard + devc->valid_samples) * 4;
+	devc->bytes_left = (devc->bytes_left + PACKET_SIZE - 1) /
+		PACKET_SIZE * PACKET_SIZE;
+	devc->bytes_left = MIN(devc->bytes_left, n);
+
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		devc->transfers[i] = libusb_alloc_transfer(0);
+		devc->transfer_bufs[i] = g_malloc(TRANSFER_SIZE);
+		devc->transfer_busy[i] = FALSE;
+	}
+	devc->transfer_cur = 0;
+
+	if (!devc->bytes_left || submit_transfer(sdi, 0) != SR_OK)
+		acquisition_finish(sdi);
+}
+
+/*
+ * Send out the oldest chunk once it arrived. The next chunk gets
+ * requested before, so that the device transfers it in the meantime.
+ */
+static void readback_continue(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	struct libusb_transfer *transfer;
+	size_t cur, next;
+
+	devc = sdi->priv;
+	cur = devc->transfer_cur;
+	next = (cur + 1) % NUM_TRANSFERS;
+	transfer = devc->transfers[cur];
+
+	if (devc->transfer_busy[cur])
+		return;
+
+	if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+		if (transfer->actual_length != transfer->length)
+			sr_warn("Tried to read %d bytes, actually read %d.",
+				transfer->length, transfer->actual_length);
+		if (!devc->acq_aborted && devc->bytes_left &&
+				submit_transfer(sdi, next) != SR_OK)
+			sr_err("Failed to request capture memory.");
+		send_samples(sdi, transfer->buffer, transfer->actual_length);
+	} else if (!devc->acq_aborted) {
+		sr_err("Capture memory readback failed (status %d).",
+			transfer->status);
+	}
+
+	devc->transfer_cur = next;
+	if (!devc->transfer_busy[next])
+		acquisition_finish(sdi);
+}
+
+SR_PRIV int zp_receive_data(int fd, int revents, void *cb_data)
+{
+	const struct sr_dev_inst *sdi;
+	struct dev_context *devc;
+	struct drv_context *drvc;
+	struct sr_usb_dev_inst *usb;
+	struct timeval tv;
+
+	(void)fd;
+	(void)revents;
+
+	sdi = cb_data;
+	devc = sdi->priv;
+	drvc = sdi->driver->context;
+	usb = sdi->conn;
+
+	tv.tv_sec = tv.tv_usec = 0;
+	libusb_handle_events_timeout_completed(drvc->sr_ctx->libusb_ctx,
+		&tv, NULL);
+
+	switch (devc->acq_state) {
+	case ZP_ACQ_WAIT:
+		if (analyzer_read_status(usb->devhdl) & STATUS_BUSY)
+			break;
+		readback_start(sdi);
+		break;
+	case ZP_ACQ_READ:
+		readback_continue(sdi);
+		break;
+	default:
+		break;
+	}
+
+	return TRUE;
+}
+
+SR_PRIV void zp_abort_acquisition(const struct sr_dev_inst *sdi)
+{
+	struct dev_context *devc;
+	size_t i;
+
+	devc = sdi->priv;
+	devc->acq_aborted = TRUE;
+
+	if (devc->acq_state == ZP_ACQ_WAIT) {
+		acquisition_finish(sdi);
+		return;
+	}
+
+	/* The source callback finishes once the transfers are cancelled. */
+	for (i = 0; i < NUM_TRANSFERS; i++) {
+		if (devc->transfer_busy[i])
+			libusb_cancel_transfer(devc->transfers[i]);
+	}
+}
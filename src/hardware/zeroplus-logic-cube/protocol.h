@@ -29,11 +29,24 @@
 
 #define LOG_PREFIX "zeroplus-logic-cube"
 
+#define PACKET_SIZE		2048	/* ?? */
+/* Capture memory gets read back in chunks of this many bytes. */
+#define TRANSFER_SIZE		(32 * PACKET_SIZE)
+/* One chunk gets transferred while the previous one gets sent out. */
+#define NUM_TRANSFERS		2
+#define POLL_INTERVAL_MS	100
+
 typedef enum {
 	LAPC_CLOCK_EDGE_RISING,
 	LAPC_CLOCK_EDGE_FALLING,
 } ext_clock_edge_t;
 
+enum zp_acq_state {
+	ZP_ACQ_IDLE,
+	ZP_ACQ_WAIT,	/* Capture running, poll for its end. */
+	ZP_ACQ_READ,	/* Reading back the capture memory. */
+};
+
 struct zp_model;
 struct dev_context {
 	uint64_t cur_samplerate;
@@ -48,6 +61,19 @@ struct dev_context {
 	const struct zp_model *prof;
 	gboolean use_ext_clock;
 	ext_clock_edge_t ext_clock_edge;
+
+	/* Acquisition and readback state. */
+	enum zp_acq_state acq_state;
+	gboolean acq_aborted;
+	struct libusb_transfer *transfers[NUM_TRANSFERS];
+	unsigned char *transfer_bufs[NUM_TRANSFERS];
+	gboolean transfer_busy[NUM_TRANSFERS];
+	size_t transfer_cur;
+	unsigned int bytes_left;	/* Capture memory not requested yet. */
+	unsigned int discard;
+	unsigned int valid_samples;
+	unsigned int trigger_offset;
+	unsigned int samples_read;
 };
 
 SR_PRIV size_t get_memory_size(int type);
@@ -55,5 +81,7 @@ SR_PRIV int zp_set_samplerate(struct dev_context *devc, uint64_t samplerate);
 SR_PRIV int set_limit_samples(struct dev_context *devc, uint64_t samples);
 SR_PRIV int set_voltage_threshold(struct dev_context *devc, double thresh);
 SR_PRIV void set_triggerbar(struct dev_context *devc);
+SR_PRIV int zp_receive_data(int fd, int revents, void *cb_data);
+SR_PRIV void zp_abort_acquisition(const struct sr_dev_inst *sdi);
 
 #endif
@@ -236,6 +236,28 @@ static struct sr_key_info sr_key_info_config[] = {
 		"Probe factor", NULL},
 	{SR_CONF_ADC_POWERLINE_CYCLES, SR_T_FLOAT, "nplc",
 		"Number of ADC powerline cycles", NULL},
+	{SR_CONF_TRANSFER_PLAN, SR_T_STRING, "transfer_plan",
+		"Transfer plan", NULL},
+	{SR_CONF_BUFFER_OVERRUNS, SR_T_UINT64, "buffer_overruns",
+		"Buffer overruns", NULL},
+	{SR_CONF_TRANSFER_STATS, SR_T_KEYVALUE, "transfer_stats",
+		"Transfer statistics", NULL},
+	{SR_CONF_SYNC_START, SR_T_BOOL, "sync_start",
+		"Synchronized start, each device keeps its own channels", NULL},
+	{SR_CONF_SYNC_SKEW, SR_T_UINT64, "sync_skew",
+		"Synchronized start skew", NULL},
+	{SR_CONF_TRANSFER_COUNT, SR_T_UINT64, "transfer_count",
+		"Number of transfers", NULL},
+	{SR_CONF_TRANSFER_SIZE, SR_T_UINT64, "transfer_size",
+		"Transfer size", NULL},
+	{SR_CONF_TRANSFER_LATENCY, SR_T_UINT64, "transfer_latency",
+		"Transfer latency", NULL},
+	{SR_CONF_BENCHMARK, SR_T_BOOL, "benchmark",
+		"Benchmark mode", NULL},
+	{SR_CONF_RAW_CAPTURE_FILE, SR_T_STRING, "raw_capture_file",
+		"Raw capture file", NULL},
+	{SR_CONF_LINK_TEST, SR_T_KEYVALUE, "link_test",
+		"Link throughput test", NULL},
 
 	/* Acquisition modes, sample limiting */
 	{SR_CONF_LIMIT_MSEC, SR_T_UINT64, "limit_time",
@@ -385,6 +407,15 @@ SR_PRIV int sr_variant_type_check(uint32_t key, GVariant *value)
 		return SR_OK;
 
 	expected = sr_variant_type_get(info->datatype);
+	/* Most keys take a basic type, a single character to compare. */
+	if (expected && g_variant_type_is_basic(expected)) {
+		if (g_variant_classify(value) ==
+				*g_variant_type_peek_string(expected))
+			return SR_OK;
+	} else if (expected && g_variant_is_of_type(value, expected)) {
+		return SR_OK;
+	}
+
 	type = g_variant_get_type(value);
 	if (!g_variant_type_equal(type, expected)
 			&& !g_variant_type_is_subtype_of(type, expected)) {
@@ -569,6 +600,9 @@ static int check_options(struct sr_dev_driver *driver, GSList *options,
 SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options)
 {
 	GSList *l;
+#ifdef HAVE_LIBUSB_1_0
+	struct drv_context *drvc;
+#endif
 
 	if (!driver) {
 		sr_err("Invalid driver, can't scan for devices.");
@@ -585,13 +619,366 @@ SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options)
 			return NULL;
 	}
 
+#ifdef HAVE_LIBUSB_1_0
+	/* Models of the same driver share one look at the bus. */
+	drvc = driver->context;
+	sr_usb_cache_hold(drvc->sr_ctx);
+#endif
 	l = driver->scan(driver, options);
+#ifdef HAVE_LIBUSB_1_0
+	sr_usb_cache_release(drvc->sr_ctx);
+#endif
 
 	sr_spew("Scan found %d devices (%s).", g_slist_length(l), driver->name);
 
 	return l;
 }
 
+/* Drivers which scan at the same time, at most. */
+#define SCAN_THREADS_MAX	8
+
+struct scan_run;
+
+struct scan_job {
+	struct scan_run *run;
+	struct sr_dev_driver *driver;
+	GSList *devices;
+	gboolean done;
+};
+
+/*
+ * One call to sr_driver_scan_all(). Jobs which still run when the
+ * deadline passed keep a reference, and so do the caller.
+ */
+struct scan_run {
+	struct sr_context *ctx;
+	GSList *options;
+	struct scan_job *jobs;
+	size_t num_jobs;
+	size_t pending;
+	int refs;
+	gboolean expired;
+};
+
+/* Called with the context's scan_mutex held. */
+static void scan_run_unref(struct scan_run *run)
+{
+	if (--run->refs)
+		return;
+	g_slist_free_full(run->options, (GDestroyNotify)sr_config_free);
+	g_free(run->jobs);
+	g_free(run);
+}
+
+static void scan_job_run(gpointer data, gpointer user_data)
+{
+	struct scan_job *job;
+	struct scan_run *run;
+	struct sr_context *ctx;
+	GSList *devices;
+	gboolean skip;
+
+	(void)user_data;
+
+	job = data;
+	run = job->run;
+	ctx = run->ctx;
+
+	g_mutex_lock(&ctx->scan_mutex);
+	skip = run->expired;
+	g_mutex_unlock(&ctx->scan_mutex);
+
+	devices = NULL;
+	if (!skip) {
+		devices = job->driver->scan(job->driver, run->options);
+		sr_spew("Scan found %d devices (%s).",
+			g_slist_length(devices), job->driver->name);
+	}
+
+	g_mutex_lock(&ctx->scan_mutex);
+	if (run->expired) {
+		/* The devices are on the driver's list all the same. */
+		if (devices)
+			sr_info("Scan of %s ended after the deadline.",
+				job->driver->name);
+		g_slist_free(devices);
+	} else {
+		job->devices = devices;
+		job->done = TRUE;
+	}
+	run->pending--;
+	ctx->scans_running--;
+	g_cond_broadcast(&ctx->scan_cond);
+	scan_run_unref(run);
+	g_mutex_unlock(&ctx->scan_mutex);
+}
+
+/* Whether the driver takes all of the options, without logging errors. */
+static gboolean scan_options_supported(const struct sr_dev_driver *driver,
+		GSList *options)
+{
+	const struct sr_config *src;
+	GArray *opts;
+	GSList *l;
+	guint i;
+
+	if (!options)
+		return TRUE;
+	if (!(opts = sr_driver_scan_options_list(driver)))
+		return FALSE;
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		for (i = 0; i < opts->len; i++) {
+			if (g_array_index(opts, uint32_t, i) == src->key)
+				break;
+		}
+		if (i == opts->len)
+			break;
+	}
+	g_array_free(opts, TRUE);
+
+	return !l;
+}
+
+static int scan_str_cmp(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/*
+ * Describes the USB devices which are present: port path, bus address
+ * and VID:PID. Reading serial numbers would need every device to be
+ * opened. The bus address changes whenever a device gets plugged in,
+ * which also catches devices swapped at the same port.
+ */
+static char *scan_fingerprint(struct sr_context *ctx)
+{
+#ifdef HAVE_LIBUSB_1_0
+	libusb_device **devlist;
+	struct libusb_device_descriptor des;
+	GPtrArray *entries;
+	GString *s;
+	char path[64];
+	guint i;
+
+	if (sr_usb_get_device_list(ctx->libusb_ctx, &devlist) < 0)
+		return NULL;
+	entries = g_ptr_array_new_with_free_func(g_free);
+	for (i = 0; devlist[i]; i++) {
+		libusb_get_device_descriptor(devlist[i], &des);
+		if (usb_get_port_path(devlist[i], path, sizeof(path)) < 0)
+			path[0] = '\0';
+		g_ptr_array_add(entries, g_strdup_printf("%s/%d.%d/%04x:%04x",
+			path, libusb_get_bus_number(devlist[i]),
+			libusb_get_device_address(devlist[i]),
+			des.idVendor, des.idProduct));
+	}
+	libusb_free_device_list(devlist, 1);
+
+	g_ptr_array_sort(entries, scan_str_cmp);
+	s = g_string_new(NULL);
+	for (i = 0; i < entries->len; i++)
+		g_string_append_printf(s, "%s;", (char *)entries->pdata[i]);
+	g_ptr_array_free(entries, TRUE);
+
+	return g_string_free(s, FALSE);
+#else
+	(void)ctx;
+
+	return NULL;
+#endif
+}
+
+/**
+ * Tell several hardware drivers to scan for devices, in parallel.
+ *
+ * Each driver scans in a thread of its own, with up to eight drivers
+ * at a time. Drivers which don't support all of the @p options are
+ * skipped. When @p options is not empty, the drivers would all probe
+ * the same resource, and they scan one after another.
+ *
+ * Drivers which didn't find any devices are remembered. As long as the
+ * same USB devices are present at the same ports, repeated scans
+ * without options skip those drivers.
+ *
+ * Drivers still scanning when @p timeout_ms passes are not waited
+ * for. The devices which they find end up in their sr_dev_list(), but
+ * not in @p devices.
+ *
+ * Before calling sr_driver_scan_all(), the user must have previously
+ * initialized the drivers by calling sr_driver_init(). Drivers which
+ * were not initialized are skipped.
+ *
+ * @param ctx A libsigrok context object allocated by a previous call to
+ *            sr_init(). Must not be NULL.
+ * @param drivers A NULL terminated list of drivers which should scan,
+ *                or NULL for all drivers returned by sr_driver_list().
+ * @param options A list of 'struct sr_config' options to pass to the
+ *                drivers' scanners. Can be NULL/empty.
+ * @param timeout_ms The time to wait for the scans, in ms. Zero waits
+ *                   for all drivers to finish.
+ * @param[out] devices A GSList * of 'struct sr_dev_inst' on return. This
+ *                     list must be freed by the caller using g_slist_free(),
+ *                     but without freeing the data pointed to in the list.
+ *                     Must not be NULL.
+ *
+ * @retval SR_OK All drivers finished scanning.
+ * @retval SR_ERR_TIMEOUT Some drivers did not finish in time. @p devices
+ *                        holds the devices which the others found.
+ * @retval SR_ERR_ARG Invalid parameter(s).
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_driver_scan_all(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, GSList *options, int timeout_ms,
+		GSList **devices)
+{
+	struct scan_run *run;
+	struct scan_job *job;
+	struct sr_config *src;
+	GThreadPool *pool;
+	GSList *l;
+	char *fingerprint;
+	int64_t deadline;
+	size_t i, count;
+	int ret;
+
+	if (!ctx || !devices || timeout_ms < 0)
+		return SR_ERR_ARG;
+	*devices = NULL;
+
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		if (sr_variant_type_check(src->key, src->data) != SR_OK)
+			return SR_ERR_ARG;
+	}
+	if (!drivers)
+		drivers = sr_driver_list(ctx);
+	for (count = 0; drivers[count]; count++)
+		;
+
+#ifdef HAVE_LIBUSB_1_0
+	/* All the drivers share one look at the bus. */
+	sr_usb_cache_hold(ctx);
+#endif
+	fingerprint = options ? NULL : scan_fingerprint(ctx);
+	g_mutex_lock(&ctx->scan_mutex);
+	if (!options && g_strcmp0(fingerprint, ctx->scan_fingerprint) != 0) {
+		g_hash_table_remove_all(ctx->scan_idle);
+		g_free(ctx->scan_fingerprint);
+		ctx->scan_fingerprint = fingerprint;
+		fingerprint = NULL;
+	}
+	g_free(fingerprint);
+
+	run = g_malloc0(sizeof(*run));
+	run->ctx = ctx;
+	run->jobs = g_malloc0_n(MAX(count, 1), sizeof(*run->jobs));
+	for (l = options; l; l = l->next) {
+		src = l->data;
+		run->options = g_slist_append(run->options,
+			sr_config_new(src->key, src->data));
+	}
+	for (i = 0; i < count; i++) {
+		if (!drivers[i]->context) {
+			sr_dbg("Driver %s not initialized, not scanning.",
+				drivers[i]->name);
+			continue;
+		}
+		if (!options && ctx->scan_fingerprint &&
+				g_hash_table_contains(ctx->scan_idle,
+					drivers[i]->name)) {
+			sr_spew("No devices for %s last time, not scanning.",
+				drivers[i]->name);
+			continue;
+		}
+		if (!scan_options_supported(drivers[i], options))
+			continue;
+		job = &run->jobs[run->num_jobs++];
+		job->run = run;
+		job->driver = drivers[i];
+	}
+	run->pending = run->num_jobs;
+	run->refs = run->num_jobs + 1;
+	ctx->scans_running += run->num_jobs;
+	g_mutex_unlock(&ctx->scan_mutex);
+
+	pool = g_thread_pool_new(scan_job_run, NULL,
+		options ? 1 : SCAN_THREADS_MAX, FALSE, NULL);
+	for (i = 0; i < run->num_jobs; i++)
+		g_thread_pool_push(pool, &run->jobs[i], NULL);
+
+	deadline = g_get_monotonic_time() + (int64_t)timeout_ms * 1000;
+	g_mutex_lock(&ctx->scan_mutex);
+	while (run->pending) {
+		if (!timeout_ms)
+			g_cond_wait(&ctx->scan_cond, &ctx->scan_mutex);
+		else if (!g_cond_wait_until(&ctx->scan_cond,
+				&ctx->scan_mutex, deadline))
+			break;
+	}
+	run->expired = TRUE;
+	ret = run->pending ? SR_ERR_TIMEOUT : SR_OK;
+	for (i = 0; i < run->num_jobs; i++) {
+		job = &run->jobs[i];
+		if (!job->done) {
+			sr_warn("Scan of %s did not end in time.",
+				job->driver->name);
+			continue;
+		}
+		if (!job->devices && !options && ctx->scan_fingerprint)
+			g_hash_table_add(ctx->scan_idle,
+				g_strdup(job->driver->name));
+		*devices = g_slist_concat(*devices, job->devices);
+	}
+	scan_run_unref(run);
+	g_mutex_unlock(&ctx->scan_mutex);
+#ifdef HAVE_LIBUSB_1_0
+	sr_usb_cache_release(ctx);
+#endif
+
+	/* Late scans keep their threads until they end. */
+	g_thread_pool_free(pool, FALSE, FALSE);
+
+	return ret;
+}
+
+/**
+ * Get exclusive use of a resource, such as a port, during a scan.
+ *
+ * Drivers which scan in parallel may probe the same resource. Waits
+ * while another scanner holds the same resource.
+ *
+ * @param[in] ctx Pointer to a libsigrok context struct. Must not be NULL.
+ * @param[in] name The resource's name, such as a connection spec.
+ *
+ * @private
+ */
+SR_PRIV void sr_resource_lock(struct sr_context *ctx, const char *name)
+{
+	g_mutex_lock(&ctx->scan_mutex);
+	while (g_hash_table_contains(ctx->busy_resources, name))
+		g_cond_wait(&ctx->scan_cond, &ctx->scan_mutex);
+	g_hash_table_add(ctx->busy_resources, g_strdup(name));
+	g_mutex_unlock(&ctx->scan_mutex);
+}
+
+/**
+ * Give up the use of a resource which sr_resource_lock() got.
+ *
+ * @param[in] ctx Pointer to a libsigrok context struct. Must not be NULL.
+ * @param[in] name The resource's name, as passed to sr_resource_lock().
+ *
+ * @private
+ */
+SR_PRIV void sr_resource_unlock(struct sr_context *ctx, const char *name)
+{
+	g_mutex_lock(&ctx->scan_mutex);
+	g_hash_table_remove(ctx->busy_resources, name);
+	g_cond_broadcast(&ctx->scan_cond);
+	g_mutex_unlock(&ctx->scan_mutex);
+}
+
 /**
  * Call driver cleanup function for all drivers.
  *
@@ -599,7 +986,7 @@ SR_API GSList *sr_driver_scan(struct sr_dev_driver *driver, GSList *options)
  *
  * @private
  */
-SR_PRIV void sr_hw_cleanup_all(const struct sr_context *ctx)
+SR_PRIV void sr_hw_cleanup_all(struct sr_context *ctx)
 {
 	int i;
 	struct sr_dev_driver **drivers;
@@ -609,6 +996,12 @@ SR_PRIV void sr_hw_cleanup_all(const struct sr_context *ctx)
 
 	sr_dbg("Cleaning up all drivers.");
 
+	/* Scans which sr_driver_scan_all() stopped waiting for. */
+	g_mutex_lock(&ctx->scan_mutex);
+	while (ctx->scans_running)
+		g_cond_wait(&ctx->scan_cond, &ctx->scan_mutex);
+	g_mutex_unlock(&ctx->scan_mutex);
+
 	drivers = sr_driver_list(ctx);
 	for (i = 0; drivers[i]; i++) {
 		if (drivers[i]->cleanup)
@@ -893,6 +1286,8 @@ SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 	else if ((ret = sr_variant_type_check(key, data)) == SR_OK) {
 		log_key(sdi, cg, key, SR_CONF_SET, data);
 		ret = sdi->driver->config_set(key, data, sdi, cg);
+		if (ret == SR_OK)
+			sr_dev_config_changed(sdi, cg, key, g_variant_ref(data));
 	}
 
 	g_variant_unref(data);
@@ -904,6 +1299,180 @@ SR_API int sr_config_set(const struct sr_dev_inst *sdi,
 	return ret;
 }
 
+/**
+ * Query the values of several configuration keys at once.
+ *
+ * Drivers which can fetch many keys in one transaction with the device
+ * do so, the others get queried key by key. Keys the driver doesn't
+ * know, or which it failed to get, are left without value.
+ *
+ * @param[in] driver The sr_dev_driver struct to query. Must not be NULL.
+ * @param[in] sdi (optional) The device instance, see sr_config_get().
+ * @param[in] cg The channel group on the device, or NULL.
+ * @param[in,out] items The keys to query. On return, the data of each
+ *                item is the value, which the caller must unref, or NULL.
+ * @param[in] count The number of items.
+ *
+ * @retval SR_OK Success, also when some keys got no value.
+ * @retval SR_ERR Error.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_get_multi(const struct sr_dev_driver *driver,
+		const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		struct sr_config *items, size_t count)
+{
+	struct sr_config *valid;
+	size_t *idx;
+	size_t i, n;
+	int ret;
+
+	if (!driver || (!items && count))
+		return SR_ERR_ARG;
+	if (!driver->config_get)
+		return SR_ERR_ARG;
+	if (sdi && !sdi->priv) {
+		sr_err("Can't get config (sdi != NULL, sdi->priv == NULL).");
+		return SR_ERR;
+	}
+
+	for (i = 0; i < count; i++)
+		items[i].data = NULL;
+
+	if (!driver->config_get_multi) {
+		for (i = 0; i < count; i++) {
+			if (sr_config_get(driver, sdi, cg, items[i].key,
+					&items[i].data) != SR_OK)
+				items[i].data = NULL;
+		}
+		return SR_OK;
+	}
+
+	/* Hand the driver only the keys it offers, in one go. */
+	valid = g_malloc0_n(count ? count : 1, sizeof(*valid));
+	idx = g_malloc0_n(count ? count : 1, sizeof(*idx));
+	for (i = 0, n = 0; i < count; i++) {
+		if (check_key(driver, sdi, cg, items[i].key, SR_CONF_GET, NULL) != SR_OK)
+			continue;
+		idx[n] = i;
+		valid[n++].key = items[i].key;
+	}
+	ret = n ? driver->config_get_multi(valid, n, sdi, cg) : SR_OK;
+	if (ret == SR_ERR_CHANNEL_GROUP)
+		sr_err("%s: No channel group specified.", driver->name);
+
+	for (i = 0; i < n; i++) {
+		if (!valid[i].data)
+			continue;
+		log_key(sdi, cg, valid[i].key, SR_CONF_GET, valid[i].data);
+		/* Floating references from the driver, see sr_config_get(). */
+		items[idx[i]].data = g_variant_ref_sink(valid[i].data);
+	}
+	g_free(idx);
+	g_free(valid);
+
+	return ret == SR_ERR_CHANNEL_GROUP ? ret : SR_OK;
+}
+
+/**
+ * Set the values of several configuration keys at once.
+ *
+ * Drivers which can apply many keys in one transaction with the device
+ * do so, for the others the keys get set one by one, in order. Keys the
+ * driver doesn't offer are skipped.
+ *
+ * @param[in] sdi The device instance, see sr_config_set().
+ * @param[in] cg The channel group on the device, or NULL.
+ * @param[in] items The keys and their new values. Floating references
+ *                  are sunk, all values get unreferenced after use.
+ * @param[in] count The number of items.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or a key was skipped.
+ * @retval other The first error setting a key, the other keys were still
+ *               set.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_config_set_multi(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg,
+		const struct sr_config *items, size_t count)
+{
+	struct sr_config *valid;
+	size_t i, n, usable;
+	int ret, r;
+
+	if (!items && count)
+		return SR_ERR_ARG;
+
+	if (!sdi || !sdi->driver || !sdi->driver->config_set_multi) {
+		ret = SR_OK;
+		for (i = 0; i < count; i++) {
+			r = sr_config_set(sdi, cg, items[i].key, items[i].data);
+			if (ret == SR_OK)
+				ret = r;
+		}
+		return ret;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (items[i].data)
+			g_variant_ref_sink(items[i].data);
+	}
+
+	ret = SR_OK;
+	usable = count;
+	if (!sdi->priv) {
+		ret = SR_ERR;
+		usable = 0;
+	} else if (sdi->status != SR_ST_ACTIVE) {
+		sr_err("%s: Device instance not active, can't set config.",
+			sdi->driver->name);
+		ret = SR_ERR_DEV_CLOSED;
+		usable = 0;
+	}
+
+	/* Hand the driver only the keys it accepts, in one go. */
+	valid = g_malloc0_n(count ? count : 1, sizeof(*valid));
+	for (i = 0, n = 0; i < usable; i++) {
+		if (!items[i].data)
+			r = SR_ERR_ARG;
+		else if (check_key(sdi->driver, sdi, cg, items[i].key,
+				SR_CONF_SET, items[i].data) != SR_OK)
+			r = SR_ERR_ARG;
+		else
+			r = sr_variant_type_check(items[i].key, items[i].data);
+		if (r != SR_OK) {
+			if (ret == SR_OK)
+				ret = r;
+			continue;
+		}
+		log_key(sdi, cg, items[i].key, SR_CONF_SET, items[i].data);
+		valid[n++] = items[i];
+	}
+	if (n) {
+		r = sdi->driver->config_set_multi(valid, n, sdi, cg);
+		if (r == SR_ERR_CHANNEL_GROUP)
+			sr_err("%s: No channel group specified.",
+				sdi->driver->name);
+		for (i = 0; r == SR_OK && i < n; i++)
+			sr_dev_config_changed(sdi, cg, valid[i].key,
+				g_variant_ref(valid[i].data));
+		if (ret == SR_OK)
+			ret = r;
+	}
+	g_free(valid);
+
+	for (i = 0; i < count; i++) {
+		if (items[i].data)
+			g_variant_unref(items[i].data);
+	}
+
+	return ret;
+}
+
 /**
  * Apply configuration settings to the device hardware.
  *
@@ -1038,6 +1607,43 @@ static struct sr_key_info *get_keytable(int keytype)
 	return table;
 }
 
+/* Lookups by key and by name, built on first use. */
+static struct key_index {
+	gsize ready;
+	GHashTable *by_key;
+	GHashTable *by_name;
+} key_indexes[SR_KEY_MQFLAGS + 1];
+
+static struct key_index *get_keyindex(int keytype)
+{
+	struct sr_key_info *table;
+	struct key_index *ki;
+	gpointer key;
+	int i;
+
+	if (!(table = get_keytable(keytype)))
+		return NULL;
+
+	ki = &key_indexes[keytype];
+	if (g_once_init_enter(&ki->ready)) {
+		ki->by_key = g_hash_table_new(g_direct_hash, g_direct_equal);
+		ki->by_name = g_hash_table_new(g_str_hash, g_str_equal);
+		/* Like the table scan before, the first entry wins. */
+		for (i = 0; table[i].key; i++) {
+			key = GUINT_TO_POINTER(table[i].key);
+			if (!g_hash_table_contains(ki->by_key, key))
+				g_hash_table_insert(ki->by_key, key, &table[i]);
+			if (table[i].id && !g_hash_table_contains(ki->by_name,
+					table[i].id))
+				g_hash_table_insert(ki->by_name,
+					(gpointer)table[i].id, &table[i]);
+		}
+		g_once_init_leave(&ki->ready, 1);
+	}
+
+	return ki;
+}
+
 /**
  * Get information about a key, by key.
  *
@@ -1051,18 +1657,12 @@ static struct sr_key_info *get_keytable(int keytype)
  */
 SR_API const struct sr_key_info *sr_key_info_get(int keytype, uint32_t key)
 {
-	struct sr_key_info *table;
-	int i;
+	struct key_index *ki;
 
-	if (!(table = get_keytable(keytype)))
+	if (!(ki = get_keyindex(keytype)))
 		return NULL;
 
-	for (i = 0; table[i].key; i++) {
-		if (table[i].key == key)
-			return &table[i];
-	}
-
-	return NULL;
+	return g_hash_table_lookup(ki->by_key, GUINT_TO_POINTER(key));
 }
 
 /**
@@ -1078,20 +1678,12 @@ SR_API const struct sr_key_info *sr_key_info_get(int keytype, uint32_t key)
  */
 SR_API const struct sr_key_info *sr_key_info_name_get(int keytype, const char *keyid)
 {
-	struct sr_key_info *table;
-	int i;
+	struct key_index *ki;
 
-	if (!(table = get_keytable(keytype)))
+	if (!keyid || !(ki = get_keyindex(keytype)))
 		return NULL;
 
-	for (i = 0; table[i].key; i++) {
-		if (!table[i].id)
-			continue;
-		if (!strcmp(table[i].id, keyid))
-			return &table[i];
-	}
-
-	return NULL;
+	return g_hash_table_lookup(ki->by_name, keyid);
 }
 
 /** @} */
@@ -66,7 +66,9 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/* Returns how much of the data was sent, whole samples only. */
+static size_t process_data(struct sr_input *in, const uint8_t *data,
+		size_t len, struct sr_buffer *ref)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
@@ -91,17 +93,30 @@ static int process_buffer(struct sr_input *in)
 	logic.unitsize = inc->unitsize;
 
 	/* Cut off at multiple of unitsize. */
-	chunk_size = in->buf->len / logic.unitsize * logic.unitsize;
+	chunk_size = len / logic.unitsize * logic.unitsize;
 
 	for (i = 0; i < chunk_size; i += chunk) {
-		logic.data = in->buf->str + i;
+		logic.data = (uint8_t *)data + i;
 		chunk = MIN(CHUNK_SIZE, chunk_size - i);
 		chunk /= logic.unitsize;
 		chunk *= logic.unitsize;
 		logic.length = chunk;
-		sr_session_send(in->sdi, &packet);
+		if (ref)
+			sr_session_send_buffer(in->sdi, &packet, ref);
+		else
+			sr_session_send(in->sdi, &packet);
 	}
-	g_string_erase(in->buf, 0, chunk_size);
+
+	return chunk_size;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	size_t len;
+
+	len = process_data(in, (const uint8_t *)sr_input_buf_data(in),
+		sr_input_buf_len(in), NULL);
+	sr_input_buf_consume(in, len);
 
 	return SR_OK;
 }
@@ -110,7 +125,7 @@ static int receive(struct sr_input *in, GString *buf)
 {
 	int ret;
 
-	g_string_append_len(in->buf, buf->str, buf->len);
+	sr_input_buf_append(in, buf->str, buf->len);
 
 	if (!in->sdi_ready) {
 		/* sdi is ready, notify frontend. */
@@ -123,6 +138,26 @@ static int receive(struct sr_input *in, GString *buf)
 	return ret;
 }
 
+static int receive_mapped(struct sr_input *in)
+{
+	const uint8_t *data;
+	size_t len;
+
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	/* Send straight from the mapping, a partial sample at the end is dropped. */
+	data = (const uint8_t *)sr_buffer_data(in->mapping) + in->mapped_pos;
+	len = sr_buffer_size(in->mapping) - in->mapped_pos;
+	process_data(in, data, len, in->mapping);
+	in->mapped_pos += len;
+
+	return SR_OK;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -176,4 +211,5 @@ SR_PRIV struct sr_input_module input_binary = {
 	.receive = receive,
 	.end = end,
 	.reset = reset,
+	.receive_mapped = receive_mapped,
 };
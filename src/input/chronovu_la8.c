@@ -127,7 +127,9 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/* Returns how much of the data was sent, whole samples only. */
+static size_t process_data(struct sr_input *in, const uint8_t *data,
+		size_t len, struct sr_buffer *ref)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
@@ -158,19 +160,32 @@ static int process_buffer(struct sr_input *in)
 	logic.unitsize = unitsize;
 
 	/* Cut off at multiple of unitsize. Avoid sending the "header". */
-	chunk_size = in->buf->len / logic.unitsize * logic.unitsize;
+	chunk_size = len / logic.unitsize * logic.unitsize;
 	chunk_size = MIN(chunk_size, inc->samples_remain * unitsize);
 
 	for (i = 0; i < chunk_size; i += chunk) {
-		logic.data = in->buf->str + i;
+		logic.data = (uint8_t *)data + i;
 		chunk = MIN(CHUNK_SIZE, chunk_size - i);
 		if (chunk) {
 			logic.length = chunk;
-			sr_session_send(in->sdi, &packet);
+			if (ref)
+				sr_session_send_buffer(in->sdi, &packet, ref);
+			else
+				sr_session_send(in->sdi, &packet);
 			inc->samples_remain -= chunk / unitsize;
 		}
 	}
-	g_string_erase(in->buf, 0, chunk_size);
+
+	return chunk_size;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	size_t len;
+
+	len = process_data(in, (const uint8_t *)sr_input_buf_data(in),
+		sr_input_buf_len(in), NULL);
+	sr_input_buf_consume(in, len);
 
 	return SR_OK;
 }
@@ -179,7 +194,7 @@ static int receive(struct sr_input *in, GString *buf)
 {
 	int ret;
 
-	g_string_append_len(in->buf, buf->str, buf->len);
+	sr_input_buf_append(in, buf->str, buf->len);
 
 	if (!in->sdi_ready) {
 		/* sdi is ready, notify frontend. */
@@ -192,6 +207,26 @@ static int receive(struct sr_input *in, GString *buf)
 	return ret;
 }
 
+static int receive_mapped(struct sr_input *in)
+{
+	const uint8_t *data;
+	size_t len;
+
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	/* Send straight from the mapping, the "header" is not needed. */
+	data = (const uint8_t *)sr_buffer_data(in->mapping) + in->mapped_pos;
+	len = sr_buffer_size(in->mapping) - in->mapped_pos;
+	process_data(in, data, len, in->mapping);
+	in->mapped_pos += len;
+
+	return SR_OK;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -247,4 +282,5 @@ SR_PRIV struct sr_input_module input_chronovu_la8 = {
 	.receive = receive,
 	.end = end,
 	.reset = reset,
+	.receive_mapped = receive_mapped,
 };
@@ -91,6 +91,11 @@
  *     up to the end of the current text line. Can be empty to disable
  *     comment support. Defaults to semicolon.
  *
+ * threads: Specifies the number of threads which parse data lines. Large
+ *     input gets split into chunks of lines, which are parsed in parallel
+ *     and sent in their original order. 0 uses a thread per processor.
+ *     Defaults to 1 (no parallel parsing).
+ *
  * Typical examples of using these options:
  * - ... -I csv:column_formats=*l ...
  *   All columns are single-bit logic data. Identical to the previous
@@ -253,6 +258,9 @@ struct context {
 	/* Current line number. */
 	size_t line_number;
 
+	/* Number of threads to parse data lines with. */
+	size_t threads;
+
 	/* List of previously created sigrok channels. */
 	GSList *prev_sr_channels;
 	GSList **prev_df_channels;
@@ -1115,7 +1123,8 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	 * Check file content for compatibility with the input module's
 	 * default format. Which translates to:
 	 * - Must be at least one text line worth of input data. Ignore
-	 *   incomplete lines at the end of the available buffer.
+	 *   incomplete lines at the end of the available buffer. Ask for
+	 *   more data when not even the first line is complete.
 	 * - Must be LF terminated text lines, optional CR-LF sequence.
 	 *   (Drop CR-only for simplicity since that's rare and users
 	 *   can override the automatic detection.)
@@ -1133,7 +1142,7 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 		return SR_ERR;
 	rdptr = g_strstr_len(buf->str, buf->len, line_termination);
 	if (!rdptr)
-		return SR_ERR;
+		return SR_ERR_NA;
 	tmpbuf = g_string_new_len(buf->str, rdptr + 1 - buf->str);
 	tmpbuf->str[tmpbuf->len - 1] = '\0';
 	status = TRUE;
@@ -1218,6 +1227,14 @@ static int init(struct sr_input *in, GHashTable *options)
 		sr_err("Invalid start line %zu.", inc->start_line);
 		return SR_ERR_ARG;
 	}
+	inc->threads = g_variant_get_uint32(g_hash_table_lookup(options, "threads"));
+	if (!inc->threads) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		inc->threads = g_get_num_processors();
+#else
+		inc->threads = 1;
+#endif
+	}
 
 	/*
 	 * Scan flexible, to get prefered format specs which describe
@@ -1479,21 +1496,21 @@ out:
  * against multiple execution or dropping the BOM multiple times --
  * there should be at most one in the input stream.
  */
-static void initial_bom_check(const struct sr_input *in)
+static void initial_bom_check(struct sr_input *in)
 {
 	static const char *utf8_bom = "\xef\xbb\xbf";
 
-	if (in->buf->len < strlen(utf8_bom))
+	if (sr_input_buf_len(in) < strlen(utf8_bom))
 		return;
-	if (strncmp(in->buf->str, utf8_bom, strlen(utf8_bom)) != 0)
+	if (strncmp(sr_input_buf_data(in), utf8_bom, strlen(utf8_bom)) != 0)
 		return;
-	g_string_erase(in->buf, 0, strlen(utf8_bom));
+	sr_input_buf_consume(in, strlen(utf8_bom));
 }
 
-static int initial_receive(const struct sr_input *in)
+static int initial_receive(struct sr_input *in)
 {
 	struct context *inc;
-	GString *new_buf;
+	GString *buf, *new_buf;
 	int len, ret;
 	char *p;
 	const char *termination;
@@ -1501,23 +1518,24 @@ static int initial_receive(const struct sr_input *in)
 	initial_bom_check(in);
 
 	inc = in->priv;
+	buf = sr_input_buf_compact(in);
 
-	termination = get_line_termination(in->buf);
+	termination = get_line_termination(buf);
 	if (!termination)
 		/* Don't have a full line yet. */
 		return SR_ERR_NA;
 
-	p = g_strrstr_len(in->buf->str, in->buf->len, termination);
+	p = g_strrstr_len(buf->str, buf->len, termination);
 	if (!p)
 		/* Don't have a full line yet. */
 		return SR_ERR_NA;
-	len = p - in->buf->str - 1;
-	new_buf = g_string_new_len(in->buf->str, len);
+	len = p - buf->str - 1;
+	new_buf = g_string_new_len(buf->str, len);
 	g_string_append_c(new_buf, '\0');
 
 	inc->termination = g_strdup(termination);
 
-	if (in->buf->str[0] != '\0')
+	if (buf->str[0] != '\0')
 		ret = initial_parse(in, new_buf);
 	else
 		ret = SR_OK;
@@ -1527,16 +1545,370 @@ static int initial_receive(const struct sr_input *in)
 	return ret;
 }
 
-static int process_buffer(struct sr_input *in, gboolean is_eof)
+/*
+ * Process one text line of input data. Skips lines before the start
+ * line, blank and comment-only lines, as well as the header line. Else
+ * fills in the current sample set, which the caller then queues.
+ */
+static int process_line(struct context *inc, char *line, gboolean *have_sample)
 {
-	struct context *inc;
 	gsize num_columns;
-	size_t line_idx, col_idx, col_nr;
+	size_t col_idx, col_nr;
 	const struct column_details *details;
 	col_parse_cb parse_func;
+	char **columns, *column;
+	int ret;
+
+	*have_sample = FALSE;
+
+	inc->line_number++;
+	if (inc->line_number < inc->start_line) {
+		sr_spew("Line %zu skipped (before start).", inc->line_number);
+		return SR_OK;
+	}
+	if (line[0] == '\0') {
+		sr_spew("Blank line %zu skipped.", inc->line_number);
+		return SR_OK;
+	}
+
+	/* Remove trailing comment. */
+	strip_comment(line, inc->comment);
+	if (line[0] == '\0') {
+		sr_spew("Comment-only line %zu skipped.", inc->line_number);
+		return SR_OK;
+	}
+
+	/* Skip the header line, its content was used as the channel names. */
+	if (inc->use_header && !inc->header_seen) {
+		sr_spew("Header line %zu skipped.", inc->line_number);
+		inc->header_seen = TRUE;
+		return SR_OK;
+	}
+
+	/* Split the line into columns, check for minimum length. */
+	columns = split_line(line, inc);
+	if (!columns) {
+		sr_err("Error while parsing line %zu.", inc->line_number);
+		return SR_ERR;
+	}
+	num_columns = g_strv_length(columns);
+	if (num_columns < inc->column_want_count) {
+		sr_err("Insufficient column count %zu in line %zu.",
+			num_columns, inc->line_number);
+		g_strfreev(columns);
+		return SR_ERR;
+	}
+
+	/* Have the columns of the current text line processed. */
+	clear_logic_samples(inc);
+	clear_analog_samples(inc);
+	for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
+		column = columns[col_idx];
+		col_nr = col_idx + 1;
+		details = lookup_column_details(inc, col_nr);
+		if (!details || !details->text_format)
+			continue;
+		parse_func = col_parse_funcs[details->text_format];
+		if (!parse_func)
+			continue;
+		ret = parse_func(column, inc, details);
+		if (ret != SR_OK) {
+			g_strfreev(columns);
+			return SR_ERR;
+		}
+	}
+	g_strfreev(columns);
+	*have_sample = TRUE;
+
+	return SR_OK;
+}
+
+/*
+ * Parallel processing of data lines. The text gets split into chunks at
+ * line boundaries, worker threads parse the chunks into sample arrays
+ * of their own, then the samples get queued in the order of the chunks.
+ * Only lines which don't change the context's state can get processed
+ * this way, which is the case after the start line and the header, and
+ * once the samplerate was taken from timestamps (if any).
+ */
+
+/* Smallest amount of text worth handing to a thread. */
+#define MIN_CHUNK_TEXT	(256 * 1024)
+
+struct parse_chunk {
+	char *text;
+	size_t first_line;
+	size_t line_count;
+	/* The chunk's own context, with the sample arrays. */
+	struct context ctx;
+	size_t sample_count;
+	int ret;
+};
+
+struct parse_job {
+	struct parse_chunk *chunks;
+	int num_chunks;
+	volatile gint next_chunk;
+	volatile gint ret;
+};
+
+static gboolean can_process_parallel(const struct context *inc)
+{
+	size_t col_idx;
+
+	if (inc->threads < 2)
+		return FALSE;
+	if (inc->line_number + 1 < inc->start_line)
+		return FALSE;
+	if (inc->use_header && !inc->header_seen)
+		return FALSE;
+	if (inc->calc_samplerate)
+		return TRUE;
+	for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
+		if (format_is_timestamp(inc->column_details[col_idx].text_format))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int parse_chunk_lines(struct parse_chunk *chunk, const char *termination)
+{
+	struct context *ctx;
+	char *line, *next;
+	gboolean have_sample;
+	int ret;
+
+	ctx = &chunk->ctx;
+	for (line = chunk->text; line; line = next) {
+		next = strstr(line, termination);
+		if (next) {
+			*next = '\0';
+			next += strlen(termination);
+		}
+		ret = process_line(ctx, line, &have_sample);
+		if (ret != SR_OK)
+			return ret;
+		if (!have_sample)
+			continue;
+		if (ctx->logic_channels)
+			ctx->datafeed_buf_fill += ctx->sample_unit_size;
+		if (ctx->analog_channels)
+			ctx->analog_datafeed_buf_fill++;
+		chunk->sample_count++;
+	}
+
+	return SR_OK;
+}
+
+static gpointer parse_thread(gpointer data)
+{
+	struct parse_job *job;
+	struct parse_chunk *chunk;
+	int idx;
+
+	job = data;
+
+	while ((idx = g_atomic_int_add(&job->next_chunk, 1)) < job->num_chunks) {
+		if (g_atomic_int_get(&job->ret) != SR_OK)
+			break;
+		chunk = &job->chunks[idx];
+		chunk->ret = parse_chunk_lines(chunk, chunk->ctx.termination);
+		if (chunk->ret != SR_OK)
+			g_atomic_int_set(&job->ret, chunk->ret);
+	}
+
+	return NULL;
+}
+
+/* Queue a chunk's samples, flushing the same as line by line queueing does. */
+static int queue_chunk_samples(const struct sr_input *in,
+	const struct parse_chunk *chunk)
+{
+	struct context *inc;
+	size_t done, count, space, ch_idx;
+	csv_analog_t *src, *dst;
+	int ret;
+
+	inc = in->priv;
+	done = 0;
+	while (done < chunk->sample_count) {
+		count = chunk->sample_count - done;
+		if (inc->logic_channels) {
+			space = inc->datafeed_buf_size - inc->datafeed_buf_fill;
+			count = MIN(count, space / inc->sample_unit_size);
+		}
+		if (inc->analog_channels) {
+			space = inc->analog_datafeed_buf_size;
+			space -= inc->analog_datafeed_buf_fill;
+			count = MIN(count, space);
+		}
+
+		if (inc->logic_channels) {
+			memcpy(&inc->datafeed_buffer[inc->datafeed_buf_fill],
+				&chunk->ctx.datafeed_buffer[done * inc->sample_unit_size],
+				count * inc->sample_unit_size);
+			inc->datafeed_buf_fill += count * inc->sample_unit_size;
+		}
+		for (ch_idx = 0; ch_idx < inc->analog_channels; ch_idx++) {
+			src = &chunk->ctx.analog_datafeed_buffer[done];
+			src += ch_idx * chunk->ctx.analog_datafeed_buf_size;
+			dst = &inc->analog_datafeed_buffer[inc->analog_datafeed_buf_fill];
+			dst += ch_idx * inc->analog_datafeed_buf_size;
+			memcpy(dst, src, count * sizeof(*dst));
+		}
+		if (inc->analog_channels)
+			inc->analog_datafeed_buf_fill += count;
+		done += count;
+
+		ret = SR_OK;
+		if (inc->logic_channels && inc->datafeed_buf_fill == inc->datafeed_buf_size)
+			ret = flush_logic_samples(in);
+		if (ret == SR_OK && inc->analog_channels &&
+				inc->analog_datafeed_buf_fill == inc->analog_datafeed_buf_size)
+			ret = flush_analog_samples(in);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static size_t count_lines(const char *text, const char *termination)
+{
+	size_t count;
+
+	count = 1;
+	while ((text = strstr(text, termination))) {
+		text += strlen(termination);
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Process all lines of the (NUL terminated) text, which holds len bytes,
+ * on the context's threads. Returns SR_ERR_NA when the text is not worth
+ * splitting.
+ */
+static int process_parallel(const struct sr_input *in, char *text, size_t len)
+{
+	struct context *inc;
+	struct parse_job job;
+	struct parse_chunk *chunk;
+	GThread **threads;
+	size_t term_len, line_number, num_chunks, chunk_idx;
+	unsigned int i, started;
+	char *pos, *split;
+	int ret;
+
+	inc = in->priv;
+	term_len = strlen(inc->termination);
+
+	num_chunks = MIN(inc->threads, len / MIN_CHUNK_TEXT);
+	if (num_chunks < 2)
+		return SR_ERR_NA;
+
+	/* Split the text after the line which ends near each chunk's share. */
+	memset(&job, 0, sizeof(job));
+	job.chunks = g_malloc0(num_chunks * sizeof(job.chunks[0]));
+	pos = text;
+	line_number = inc->line_number;
+	for (chunk_idx = 0; chunk_idx < num_chunks && pos; chunk_idx++) {
+		chunk = &job.chunks[chunk_idx];
+		chunk->text = pos;
+		split = NULL;
+		if (chunk_idx + 1 < num_chunks) {
+			split = MAX(pos, text + (chunk_idx + 1) * (len / num_chunks));
+			split = strstr(split, inc->termination);
+		}
+		if (split) {
+			*split = '\0';
+			pos = split + term_len;
+		} else {
+			pos = NULL;
+		}
+		chunk->first_line = line_number;
+		chunk->line_count = count_lines(chunk->text, inc->termination);
+		line_number += chunk->line_count;
+
+		chunk->ctx = *inc;
+		chunk->ctx.line_number = chunk->first_line;
+		chunk->ctx.datafeed_buf_fill = 0;
+		chunk->ctx.datafeed_buffer = NULL;
+		if (inc->logic_channels) {
+			chunk->ctx.datafeed_buf_size = chunk->line_count;
+			chunk->ctx.datafeed_buf_size *= inc->sample_unit_size;
+			chunk->ctx.datafeed_buffer = g_try_malloc(chunk->ctx.datafeed_buf_size);
+		}
+		chunk->ctx.analog_datafeed_buf_fill = 0;
+		chunk->ctx.analog_datafeed_buffer = NULL;
+		if (inc->analog_channels) {
+			chunk->ctx.analog_datafeed_buf_size = chunk->line_count;
+			chunk->ctx.analog_datafeed_buffer = g_try_malloc(
+				inc->analog_channels * chunk->line_count *
+				sizeof(chunk->ctx.analog_datafeed_buffer[0]));
+		}
+		if ((inc->logic_channels && !chunk->ctx.datafeed_buffer) ||
+				(inc->analog_channels && !chunk->ctx.analog_datafeed_buffer)) {
+			sr_err("Cannot allocate parse buffer.");
+			job.ret = SR_ERR_MALLOC;
+			chunk_idx++;
+			break;
+		}
+	}
+	job.num_chunks = chunk_idx;
+
+	/* The calling thread parses too. */
+	if (job.ret == SR_OK) {
+		threads = g_new0(GThread *, job.num_chunks);
+		for (started = 0; started + 1 < (unsigned int)job.num_chunks; started++) {
+			threads[started] = g_thread_try_new("sr-csv-parse",
+				parse_thread, &job, NULL);
+			if (!threads[started])
+				break;
+		}
+		parse_thread(&job);
+		for (i = 0; i < started; i++)
+			g_thread_join(threads[i]);
+		g_free(threads);
+	}
+
+	/* Queue the samples in order, up to the first line which failed. */
+	ret = job.ret;
+	if (ret != SR_ERR_MALLOC) {
+		for (chunk_idx = 0; chunk_idx < (size_t)job.num_chunks; chunk_idx++) {
+			chunk = &job.chunks[chunk_idx];
+			ret = queue_chunk_samples(in, chunk);
+			if (ret != SR_OK) {
+				sr_err("Sending samples failed.");
+				break;
+			}
+			inc->line_number = chunk->ctx.line_number;
+			ret = chunk->ret;
+			if (ret != SR_OK)
+				break;
+		}
+	}
+
+	for (chunk_idx = 0; chunk_idx < (size_t)job.num_chunks; chunk_idx++) {
+		g_free(job.chunks[chunk_idx].ctx.datafeed_buffer);
+		g_free(job.chunks[chunk_idx].ctx.analog_datafeed_buffer);
+	}
+	g_free(job.chunks);
+
+	return ret;
+}
+
+static int process_buffer(struct sr_input *in, gboolean is_eof)
+{
+	struct context *inc;
 	int ret;
-	char *processed_up_to;
-	char **lines, *line, **columns, *column;
+	char *data, *processed_up_to, *text_end;
+	size_t len, term_len;
+	char *line, *next;
+	gboolean have_sample;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -1557,97 +1929,57 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 	 * on Windows). A present termination sequence will just result
 	 * in the "execution of an empty line", and does not harm.
 	 */
-	if (!in->buf->len)
+	data = sr_input_buf_data(in);
+	len = sr_input_buf_len(in);
+	if (!len)
 		return SR_OK;
+	term_len = strlen(inc->termination);
 	if (is_eof) {
-		processed_up_to = in->buf->str + in->buf->len;
+		processed_up_to = data + len;
+		text_end = processed_up_to;
 	} else {
-		processed_up_to = g_strrstr_len(in->buf->str, in->buf->len,
-			inc->termination);
+		processed_up_to = g_strrstr_len(data, len, inc->termination);
 		if (!processed_up_to)
 			return SR_OK;
 		*processed_up_to = '\0';
-		processed_up_to += strlen(inc->termination);
+		text_end = processed_up_to;
+		processed_up_to += term_len;
 	}
 
 	/* Split input text lines and process their columns. */
 	ret = SR_OK;
-	lines = g_strsplit(in->buf->str, inc->termination, 0);
-	for (line_idx = 0; (line = lines[line_idx]); line_idx++) {
-		inc->line_number++;
-		if (inc->line_number < inc->start_line) {
-			sr_spew("Line %zu skipped (before start).", inc->line_number);
-			continue;
-		}
-		if (line[0] == '\0') {
-			sr_spew("Blank line %zu skipped.", inc->line_number);
-			continue;
-		}
-
-		/* Remove trailing comment. */
-		strip_comment(line, inc->comment);
-		if (line[0] == '\0') {
-			sr_spew("Comment-only line %zu skipped.", inc->line_number);
-			continue;
+	line = *data ? data : NULL;
+	for (; line; line = next) {
+		if (can_process_parallel(inc)) {
+			ret = process_parallel(in, line, text_end - line);
+			if (ret != SR_ERR_NA) {
+				if (ret != SR_OK)
+					return SR_ERR;
+				break;
+			}
+			ret = SR_OK;
 		}
 
-		/* Skip the header line, its content was used as the channel names. */
-		if (inc->use_header && !inc->header_seen) {
-			sr_spew("Header line %zu skipped.", inc->line_number);
-			inc->header_seen = TRUE;
-			continue;
+		next = strstr(line, inc->termination);
+		if (next) {
+			*next = '\0';
+			next += term_len;
 		}
-
-		/* Split the line into columns, check for minimum length. */
-		columns = split_line(line, inc);
-		if (!columns) {
-			sr_err("Error while parsing line %zu.", inc->line_number);
-			g_strfreev(lines);
+		ret = process_line(inc, line, &have_sample);
+		if (ret != SR_OK)
 			return SR_ERR;
-		}
-		num_columns = g_strv_length(columns);
-		if (num_columns < inc->column_want_count) {
-			sr_err("Insufficient column count %zu in line %zu.",
-				num_columns, inc->line_number);
-			g_strfreev(columns);
-			g_strfreev(lines);
-			return SR_ERR;
-		}
-
-		/* Have the columns of the current text line processed. */
-		clear_logic_samples(inc);
-		clear_analog_samples(inc);
-		for (col_idx = 0; col_idx < inc->column_want_count; col_idx++) {
-			column = columns[col_idx];
-			col_nr = col_idx + 1;
-			details = lookup_column_details(inc, col_nr);
-			if (!details || !details->text_format)
-				continue;
-			parse_func = col_parse_funcs[details->text_format];
-			if (!parse_func)
-				continue;
-			ret = parse_func(column, inc, details);
-			if (ret != SR_OK) {
-				g_strfreev(columns);
-				g_strfreev(lines);
-				return SR_ERR;
-			}
-		}
+		if (!have_sample)
+			continue;
 
 		/* Send sample data to the session bus (buffered). */
 		ret = queue_logic_samples(in);
 		ret += queue_analog_samples(in);
 		if (ret != SR_OK) {
 			sr_err("Sending samples failed.");
-			g_strfreev(columns);
-			g_strfreev(lines);
 			return SR_ERR;
 		}
-
-		g_strfreev(columns);
 	}
-	g_strfreev(lines);
-	g_string_erase(in->buf, 0, processed_up_to - in->buf->str);
+	sr_input_buf_consume(in, processed_up_to - data);
 
 	return ret;
 }
@@ -1657,7 +1989,7 @@ static int receive(struct sr_input *in, GString *buf)
 	struct context *inc;
 	int ret;
 
-	g_string_append_len(in->buf, buf->str, buf->len);
+	sr_input_buf_append(in, buf->str, buf->len);
 
 	inc = in->priv;
 	if (!inc->column_seen_count) {
@@ -1734,6 +2066,7 @@ static void cleanup(struct sr_input *in)
 	inc->column_formats = save_ctx.column_formats;
 	inc->start_line = save_ctx.start_line;
 	inc->use_header = save_ctx.use_header;
+	inc->threads = save_ctx.threads;
 	inc->prev_sr_channels = save_ctx.prev_sr_channels;
 	inc->prev_df_channels = save_ctx.prev_df_channels;
 }
@@ -1761,6 +2094,7 @@ enum option_index {
 	OPT_SAMPLERATE,
 	OPT_COL_SEP,
 	OPT_COMMENT,
+	OPT_THREADS,
 	OPT_MAX,
 };
 
@@ -1815,6 +2149,11 @@ static struct sr_option options[] = {
 		"The text which starts comments at the end of text lines, semicolon by default.",
 		NULL, NULL,
 	},
+	[OPT_THREADS] = {
+		"threads", "Parser threads",
+		"Number of threads which parse data lines of large input, 0 for one per processor (default: 1).",
+		NULL, NULL,
+	},
 	[OPT_MAX] = ALL_ZERO,
 };
 
@@ -1838,6 +2177,7 @@ static const struct sr_option *get_options(void)
 		options[OPT_SAMPLERATE].def = g_variant_ref_sink(g_variant_new_uint64(0));
 		options[OPT_COL_SEP].def = g_variant_ref_sink(g_variant_new_string(","));
 		options[OPT_COMMENT].def = g_variant_ref_sink(g_variant_new_string(";"));
+		options[OPT_THREADS].def = g_variant_ref_sink(g_variant_new_uint32(1));
 	}
 
 	return options;
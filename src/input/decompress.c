@@ -0,0 +1,323 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "input"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Reading input files which may be compressed.
+ *
+ * The reader looks at the first bytes of the file. Files compressed
+ * with gzip or zstd get decompressed as they are read, everything else
+ * is passed through. Decompression is done in passing, in the chunks
+ * the caller asks for, so a large capture never exists decompressed
+ * as a whole, neither in memory nor on disk.
+ */
+
+/** @cond PRIVATE */
+/* Compressed bytes read from the file at a time. */
+#define IN_SIZE		(256 * 1024)
+
+static const uint8_t gzip_magic[] = { 0x1f, 0x8b };
+static const uint8_t zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+struct sr_zreader {
+	FILE *file;
+	enum sr_zreader_format format;
+	uint8_t *in;
+	size_t in_len, in_pos;
+	gboolean in_eof;
+	/* The last compressed stream ended, nothing is pending. */
+	gboolean stream_end;
+#ifdef HAVE_ZLIB
+	z_stream z;
+#endif
+#ifdef HAVE_LIBZSTD
+	ZSTD_DStream *zd;
+#endif
+};
+/** @endcond */
+
+static int refill(struct sr_zreader *zr)
+{
+	if (zr->in_pos < zr->in_len || zr->in_eof)
+		return SR_OK;
+
+	zr->in_pos = 0;
+	zr->in_len = fread(zr->in, 1, IN_SIZE, zr->file);
+	if (zr->in_len == 0) {
+		if (ferror(zr->file)) {
+			sr_err("Failed to read input file: %s.",
+				g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		zr->in_eof = TRUE;
+	}
+
+	return SR_OK;
+}
+
+static gboolean has_magic(const struct sr_zreader *zr,
+		const uint8_t *magic, size_t len)
+{
+	return zr->in_len >= len && memcmp(zr->in, magic, len) == 0;
+}
+
+static int decoder_init(struct sr_zreader *zr)
+{
+	switch (zr->format) {
+	case SR_ZREADER_GZIP:
+#ifdef HAVE_ZLIB
+		/* 32 lets zlib take the gzip header. */
+		if (inflateInit2(&zr->z, 15 + 32) != Z_OK)
+			return SR_ERR_MALLOC;
+		return SR_OK;
+#else
+		sr_err("Input file is gzip compressed, but zlib support "
+			"is not compiled in.");
+		return SR_ERR_NA;
+#endif
+	case SR_ZREADER_ZSTD:
+#ifdef HAVE_LIBZSTD
+		if (!(zr->zd = ZSTD_createDStream()))
+			return SR_ERR_MALLOC;
+		ZSTD_initDStream(zr->zd);
+		return SR_OK;
+#else
+		sr_err("Input file is zstd compressed, but zstd support "
+			"is not compiled in.");
+		return SR_ERR_NA;
+#endif
+	default:
+		return SR_OK;
+	}
+}
+
+/**
+ * Start reading a file which may be compressed.
+ *
+ * @param file The file, positioned at its start. The reader takes
+ *             ownership, and closes it in sr_zreader_close().
+ * @param zr Receives the new reader.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_NA The file is compressed in a format this build
+ *                   cannot decompress.
+ * @retval other Error reading the file.
+ *
+ * @private
+ */
+SR_PRIV int sr_zreader_open(FILE *file, struct sr_zreader **zr)
+{
+	struct sr_zreader *r;
+	int ret;
+
+	r = g_malloc0(sizeof(*r));
+	r->file = file;
+	r->in = g_malloc(IN_SIZE);
+	r->stream_end = TRUE;
+	if ((ret = refill(r)) != SR_OK) {
+		sr_zreader_close(r);
+		return ret;
+	}
+
+	if (has_magic(r, gzip_magic, sizeof(gzip_magic)))
+		r->format = SR_ZREADER_GZIP;
+	else if (has_magic(r, zstd_magic, sizeof(zstd_magic)))
+		r->format = SR_ZREADER_ZSTD;
+	else
+		r->format = SR_ZREADER_PLAIN;
+	if ((ret = decoder_init(r)) != SR_OK) {
+		r->format = SR_ZREADER_PLAIN;
+		sr_zreader_close(r);
+		return ret;
+	}
+	if (r->format != SR_ZREADER_PLAIN)
+		sr_dbg("Decompressing %s input.",
+			r->format == SR_ZREADER_GZIP ? "gzip" : "zstd");
+
+	*zr = r;
+
+	return SR_OK;
+}
+
+/** @private */
+SR_PRIV enum sr_zreader_format sr_zreader_format(const struct sr_zreader *zr)
+{
+	return zr->format;
+}
+
+/** @private */
+SR_PRIV void sr_zreader_close(struct sr_zreader *zr)
+{
+	if (!zr)
+		return;
+
+#ifdef HAVE_ZLIB
+	if (zr->format == SR_ZREADER_GZIP)
+		inflateEnd(&zr->z);
+#endif
+#ifdef HAVE_LIBZSTD
+	if (zr->format == SR_ZREADER_ZSTD)
+		ZSTD_freeDStream(zr->zd);
+#endif
+	fclose(zr->file);
+	g_free(zr->in);
+	g_free(zr);
+}
+
+/* Decompress what the input buffer holds, return the bytes produced. */
+static int inflate_step(struct sr_zreader *zr, uint8_t *out, size_t len,
+		size_t *produced)
+{
+#ifdef HAVE_ZLIB
+	int ret;
+
+	if (zr->stream_end && zr->in_pos < zr->in_len) {
+		/* Another gzip member follows, as "cat a.gz b.gz" makes. */
+		inflateReset(&zr->z);
+	}
+	zr->z.next_in = zr->in + zr->in_pos;
+	zr->z.avail_in = zr->in_len - zr->in_pos;
+	zr->z.next_out = out;
+	zr->z.avail_out = MIN(len, G_MAXUINT32);
+	ret = inflate(&zr->z, Z_NO_FLUSH);
+	zr->in_pos = zr->in_len - zr->z.avail_in;
+	*produced = MIN(len, G_MAXUINT32) - zr->z.avail_out;
+	if (ret == Z_STREAM_END) {
+		zr->stream_end = TRUE;
+		return SR_OK;
+	}
+	if (ret != Z_OK && ret != Z_BUF_ERROR) {
+		sr_err("Corrupt gzip input: %s.",
+			zr->z.msg ? zr->z.msg : "unknown error");
+		return SR_ERR_DATA;
+	}
+	zr->stream_end = FALSE;
+
+	return SR_OK;
+#else
+	(void)zr;
+	(void)out;
+	(void)len;
+	(void)produced;
+
+	return SR_ERR_BUG;
+#endif
+}
+
+static int zstd_step(struct sr_zreader *zr, uint8_t *out, size_t len,
+		size_t *produced)
+{
+#ifdef HAVE_LIBZSTD
+	ZSTD_inBuffer zin;
+	ZSTD_outBuffer zout;
+	size_t ret;
+
+	zin.src = zr->in;
+	zin.size = zr->in_len;
+	zin.pos = zr->in_pos;
+	zout.dst = out;
+	zout.size = len;
+	zout.pos = 0;
+	ret = ZSTD_decompressStream(zr->zd, &zout, &zin);
+	zr->in_pos = zin.pos;
+	*produced = zout.pos;
+	if (ZSTD_isError(ret)) {
+		sr_err("Corrupt zstd input: %s.", ZSTD_getErrorName(ret));
+		return SR_ERR_DATA;
+	}
+	/* Zero is the end of a frame, more frames may follow. */
+	zr->stream_end = ret == 0;
+
+	return SR_OK;
+#else
+	(void)zr;
+	(void)out;
+	(void)len;
+	(void)produced;
+
+	return SR_ERR_BUG;
+#endif
+}
+
+/**
+ * Read the next bytes of the file, decompressed.
+ *
+ * @param zr The reader.
+ * @param buf Where to put the bytes.
+ * @param len How many bytes to read at most.
+ *
+ * @return The number of bytes read, which is less than len only at the
+ *         end of the file, or -1 on error.
+ *
+ * @private
+ */
+SR_PRIV gssize sr_zreader_read(struct sr_zreader *zr, void *buf, size_t len)
+{
+	uint8_t *out;
+	size_t pos, count;
+	int ret;
+
+	out = buf;
+	pos = 0;
+	while (pos < len) {
+		if (refill(zr) != SR_OK)
+			return -1;
+		if (zr->in_eof)
+			break;
+		switch (zr->format) {
+		case SR_ZREADER_GZIP:
+			ret = inflate_step(zr, out + pos, len - pos, &count);
+			break;
+		case SR_ZREADER_ZSTD:
+			ret = zstd_step(zr, out + pos, len - pos, &count);
+			break;
+		default:
+			count = MIN(len - pos, zr->in_len - zr->in_pos);
+			memcpy(out + pos, zr->in + zr->in_pos, count);
+			zr->in_pos += count;
+			ret = SR_OK;
+			break;
+		}
+		if (ret != SR_OK)
+			return -1;
+		pos += count;
+	}
+	if (pos < len && !zr->stream_end) {
+		sr_warn("Compressed input ends prematurely.");
+		zr->stream_end = TRUE;
+	}
+
+	return pos;
+}
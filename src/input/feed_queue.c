@@ -29,6 +29,13 @@ struct feed_queue_logic {
 	uint8_t *data_bytes;
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_logic logic;
+	/* Runs of values instead, see feed_queue_logic_rle(). */
+	gboolean rle;
+	uint64_t *run_offsets;
+	size_t run_count;
+	uint64_t run_samples;
+	struct sr_datafeed_logic_rle logic_rle;
+	struct sr_context *mem_ctx;
 };
 
 SR_API struct feed_queue_logic *feed_queue_logic_alloc(
@@ -41,8 +48,15 @@ SR_API struct feed_queue_logic *feed_queue_logic_alloc(
 	q->sdi = sdi;
 	q->unit_size = unit_size;
 	q->alloc_count = sample_count;
+	q->mem_ctx = sr_mem_context(sdi);
+	if (sr_mem_reserve(q->mem_ctx, q->alloc_count * q->unit_size,
+			"Logic feed queue") != SR_OK) {
+		g_free(q);
+		return NULL;
+	}
 	q->data_bytes = g_try_malloc(q->alloc_count * q->unit_size);
 	if (!q->data_bytes) {
+		sr_mem_release(q->mem_ctx, q->alloc_count * q->unit_size);
 		g_free(q);
 		return NULL;
 	}
@@ -57,22 +71,128 @@ SR_API struct feed_queue_logic *feed_queue_logic_alloc(
 	return q;
 }
 
+/*
+ * Repeat the item at the start of the buffer until it holds count items.
+ * Copies what was filled in so far, which doubles the size per copy.
+ */
+static void fill_repeat(void *buffer, size_t item_size, size_t count)
+{
+	uint8_t *start;
+	size_t done, copy;
+
+	start = buffer;
+	for (done = 1; done < count; done += copy) {
+		copy = MIN(done, count - done);
+		memcpy(&start[done * item_size], start, copy * item_size);
+	}
+}
+
+/*
+ * Queue samples as runs, the values go where the samples would. A run
+ * of the value which the last run has just gets longer.
+ */
+static int submit_run(struct feed_queue_logic *q,
+	const uint8_t *data, size_t repeat_count)
+{
+	uint8_t *last;
+	int ret;
+
+	if (!repeat_count)
+		return SR_OK;
+
+	if (q->run_count) {
+		last = &q->data_bytes[(q->run_count - 1) * q->unit_size];
+		if (memcmp(last, data, q->unit_size) == 0) {
+			q->run_samples += repeat_count;
+			return SR_OK;
+		}
+	}
+	if (q->run_count == q->alloc_count) {
+		ret = feed_queue_logic_flush(q);
+		if (ret != SR_OK)
+			return ret;
+	}
+	q->run_offsets[q->run_count] = q->run_samples;
+	memcpy(&q->data_bytes[q->run_count * q->unit_size], data, q->unit_size);
+	q->run_count++;
+	q->run_samples += repeat_count;
+
+	return SR_OK;
+}
+
+/**
+ * Have the queue send SR_DF_LOGIC_RLE packets instead of SR_DF_LOGIC.
+ *
+ * Drivers which get runs of repeated values from the device can pass
+ * them on without expanding them. Only use this when the session
+ * takes SR_DF_LOGIC_RLE, see sr_session_takes_logic_rle(). A packet
+ * then holds up to the queue's sample_count runs.
+ *
+ * @param q The queue.
+ * @param enable Whether to send runs.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other Sending what was queued before failed.
+ *
+ * @since 0.6.0
+ */
+SR_API int feed_queue_logic_rle(struct feed_queue_logic *q, gboolean enable)
+{
+	int ret;
+
+	if (!q)
+		return SR_ERR_ARG;
+	if (q->rle == !!enable)
+		return SR_OK;
+
+	ret = feed_queue_logic_flush(q);
+	if (ret != SR_OK)
+		return ret;
+
+	q->rle = !!enable;
+	if (q->rle) {
+		if (!q->run_offsets)
+			q->run_offsets = g_malloc(q->alloc_count * sizeof(uint64_t));
+		q->packet.type = SR_DF_LOGIC_RLE;
+		q->packet.payload = &q->logic_rle;
+		q->logic_rle.unitsize = q->unit_size;
+		q->logic_rle.offsets = q->run_offsets;
+		q->logic_rle.values = q->data_bytes;
+	} else {
+		q->packet.type = SR_DF_LOGIC;
+		q->packet.payload = &q->logic;
+	}
+
+	return SR_OK;
+}
+
 SR_API int feed_queue_logic_submit_one(struct feed_queue_logic *q,
 	const uint8_t *data, size_t repeat_count)
 {
 	uint8_t *wrptr;
+	size_t space, fill_count;
 	int ret;
 
-	wrptr = &q->data_bytes[q->fill_count * q->unit_size];
-	while (repeat_count--) {
-		memcpy(wrptr, data, q->unit_size);
-		wrptr += q->unit_size;
-		q->fill_count++;
+	if (q->rle)
+		return submit_run(q, data, repeat_count);
+
+	while (repeat_count) {
+		space = q->alloc_count - q->fill_count;
+		fill_count = MIN(repeat_count, space);
+		wrptr = &q->data_bytes[q->fill_count * q->unit_size];
+		if (q->unit_size == 1) {
+			memset(wrptr, data[0], fill_count);
+		} else {
+			memcpy(wrptr, data, q->unit_size);
+			fill_repeat(wrptr, q->unit_size, fill_count);
+		}
+		q->fill_count += fill_count;
+		repeat_count -= fill_count;
 		if (q->fill_count == q->alloc_count) {
 			ret = feed_queue_logic_flush(q);
 			if (ret != SR_OK)
 				return ret;
-			wrptr = &q->data_bytes[0];
 		}
 	}
 
@@ -86,6 +206,15 @@ SR_API int feed_queue_logic_submit_many(struct feed_queue_logic *q,
 	size_t space, copy_count;
 	int ret;
 
+	if (q->rle) {
+		for (; samples_count; samples_count--, data += q->unit_size) {
+			ret = submit_run(q, data, 1);
+			if (ret != SR_OK)
+				return ret;
+		}
+		return SR_OK;
+	}
+
 	wrptr = &q->data_bytes[q->fill_count * q->unit_size];
 	while (samples_count) {
 		space = q->alloc_count - q->fill_count;
@@ -112,6 +241,19 @@ SR_API int feed_queue_logic_flush(struct feed_queue_logic *q)
 {
 	int ret;
 
+	if (q->rle) {
+		if (!q->run_count)
+			return SR_OK;
+		q->logic_rle.num_samples = q->run_samples;
+		q->logic_rle.num_runs = q->run_count;
+		ret = sr_session_send(q->sdi, &q->packet);
+		if (ret != SR_OK)
+			return ret;
+		q->run_count = 0;
+		q->run_samples = 0;
+		return SR_OK;
+	}
+
 	if (!q->fill_count)
 		return SR_OK;
 
@@ -145,7 +287,9 @@ SR_API void feed_queue_logic_free(struct feed_queue_logic *q)
 	if (!q)
 		return;
 
+	g_free(q->run_offsets);
 	g_free(q->data_bytes);
+	sr_mem_release(q->mem_ctx, q->alloc_count * q->unit_size);
 	g_free(q);
 }
 
@@ -233,10 +377,18 @@ SR_API int feed_queue_analog_scale_offset(struct feed_queue_analog *q,
 SR_API int feed_queue_analog_submit_one(struct feed_queue_analog *q,
 	float data, size_t repeat_count)
 {
+	float *wrptr;
+	size_t space, fill_count;
 	int ret;
 
-	while (repeat_count--) {
-		q->data_values[q->fill_count++] = data;
+	while (repeat_count) {
+		space = q->alloc_count - q->fill_count;
+		fill_count = MIN(repeat_count, space);
+		wrptr = &q->data_values[q->fill_count];
+		wrptr[0] = data;
+		fill_repeat(wrptr, sizeof(*wrptr), fill_count);
+		q->fill_count += fill_count;
+		repeat_count -= fill_count;
 		if (q->fill_count == q->alloc_count) {
 			ret = feed_queue_analog_flush(q);
 			if (ret != SR_OK)
@@ -31,6 +31,8 @@
 
 /** @cond PRIVATE */
 #define CHUNK_SIZE	(4 * 1024 * 1024)
+/* How much of a file gets read first when looking for its format. */
+#define PROBE_SIZE	(64 * 1024)
 /** @endcond */
 
 /**
@@ -70,6 +72,7 @@ extern SR_PRIV struct sr_input_module input_logicport;
 extern SR_PRIV struct sr_input_module input_null;
 extern SR_PRIV struct sr_input_module input_protocoldata;
 extern SR_PRIV struct sr_input_module input_raw_analog;
+extern SR_PRIV struct sr_input_module input_raw_capture;
 extern SR_PRIV struct sr_input_module input_saleae;
 extern SR_PRIV struct sr_input_module input_stf;
 extern SR_PRIV struct sr_input_module input_trace32_ad;
@@ -86,6 +89,7 @@ static const struct sr_input_module *input_module_list[] = {
 	&input_null,
 	&input_protocoldata,
 	&input_raw_analog,
+	&input_raw_capture,
 	&input_saleae,
 #if defined HAVE_INPUT_STF && HAVE_INPUT_STF
 	&input_stf,
@@ -438,6 +442,37 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
 	return SR_ERR;
 }
 
+/* Append up to len more bytes of the stream to the header. */
+static gssize read_header(struct sr_zreader *zr, GString *header, size_t len)
+{
+	size_t have;
+	gssize count;
+
+	have = header->len;
+	g_string_set_size(header, have + len);
+	count = sr_zreader_read(zr, header->str + have, len);
+	g_string_set_size(header, have + MAX(count, 0));
+
+	return count;
+}
+
+/* The name the contents of a compressed file would have, "a.vcd.gz" is
+ * taken as "a.vcd", for modules matching on the file name. */
+static char *uncompressed_name(const char *filename)
+{
+	static const char *const suffixes[] = { ".gz", ".zst", NULL };
+	size_t len;
+	int i;
+
+	len = strlen(filename);
+	for (i = 0; suffixes[i]; i++) {
+		if (g_str_has_suffix(filename, suffixes[i]))
+			return g_strndup(filename, len - strlen(suffixes[i]));
+	}
+
+	return g_strdup(filename);
+}
+
 /**
  * Try to find an input module that can parse the given file.
  *
@@ -446,19 +481,31 @@ SR_API int sr_input_scan_buffer(GString *buf, const struct sr_input **in)
  * support for the format, the one with highest confidence takes
  * precedence. Applications will see at most one input module spec.
  *
+ * Only a small part of the file is read at first. Modules which need
+ * more of it to decide get asked again after more was read, up to
+ * CHUNK_SIZE bytes.
+ *
+ * Files compressed with gzip or zstd are recognized by their contents,
+ * and modules get to see the decompressed data. Use
+ * sr_input_send_mapped() to send such a file to the module.
+ *
  */
 SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 {
 	int64_t filesize;
 	FILE *stream;
+	struct sr_zreader *zr;
 	const struct sr_input_module *imod, *best_imod;
 	GHashTable *meta;
 	GString *header;
-	size_t count;
+	char *name;
+	gssize count;
+	size_t want;
 	unsigned int midx, i;
 	unsigned int conf, best_conf;
 	int ret;
 	uint8_t avail_metadata[8];
+	gboolean *pending, more, eof;
 
 	*in = NULL;
 
@@ -478,20 +525,30 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 		fclose(stream);
 		return SR_ERR;
 	}
-	header = g_string_sized_new(CHUNK_SIZE);
-	count = fread(header->str, 1, header->allocated_len - 1, stream);
-	if (count < 1 || ferror(stream)) {
-		sr_err("Failed to read %s: %s", filename, g_strerror(errno));
-		fclose(stream);
+	if ((ret = sr_zreader_open(stream, &zr)) != SR_OK)
+		return ret == SR_ERR_NA ? SR_ERR_NA : SR_ERR;
+	if (sr_zreader_format(zr) == SR_ZREADER_PLAIN)
+		name = g_strdup(filename);
+	else
+		name = uncompressed_name(filename);
+	header = g_string_sized_new(PROBE_SIZE);
+	count = read_header(zr, header, PROBE_SIZE);
+	if (count < 1) {
+		sr_err("Failed to read %s.", filename);
+		sr_zreader_close(zr);
 		g_string_free(header, TRUE);
+		g_free(name);
 		return SR_ERR;
 	}
-	fclose(stream);
-	g_string_set_size(header, count);
+	eof = count < PROBE_SIZE;
 
+	/*
+	 * The file size stays that of the file, for compressed files
+	 * it is less than what the module will get.
+	 */
 	meta = g_hash_table_new(NULL, NULL);
 	g_hash_table_insert(meta, GINT_TO_POINTER(SR_INPUT_META_FILENAME),
-			(char *)filename);
+			name);
 	g_hash_table_insert(meta, GINT_TO_POINTER(SR_INPUT_META_FILESIZE),
 			GSIZE_TO_POINTER(MIN(filesize, G_MAXSSIZE)));
 	g_hash_table_insert(meta, GINT_TO_POINTER(SR_INPUT_META_HEADER),
@@ -503,8 +560,9 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 	avail_metadata[midx] = 0;
 	/* TODO: MIME type */
 
-	best_imod = NULL;
-	best_conf = ~0;
+	for (i = 0; input_module_list[i]; i++)
+		;
+	pending = g_malloc0(i * sizeof(pending[0]));
 	for (i = 0; input_module_list[i]; i++) {
 		imod = input_module_list[i];
 		if (!imod->metadata[0]) {
@@ -515,26 +573,56 @@ SR_API int sr_input_scan_file(const char *filename, const struct sr_input **in)
 		if (!check_required_metadata(imod->metadata, avail_metadata))
 			/* Cannot satisfy this module's requirements. */
 			continue;
+		pending[i] = TRUE;
+	}
 
-		sr_dbg("Trying module %s.", imod->id);
-
-		ret = imod->format_match(meta, &conf);
-		if (ret == SR_ERR) {
-			/* Module didn't recognize this buffer. */
-			continue;
-		} else if (ret != SR_OK) {
-			/* Module recognized this buffer, but cannot handle it. */
-			continue;
+	best_imod = NULL;
+	best_conf = ~0;
+	do {
+		more = FALSE;
+		for (i = 0; input_module_list[i]; i++) {
+			if (!pending[i])
+				continue;
+			pending[i] = FALSE;
+			imod = input_module_list[i];
+
+			sr_dbg("Trying module %s.", imod->id);
+
+			ret = imod->format_match(meta, &conf);
+			if (ret == SR_ERR_NA && !eof &&
+					header->len < CHUNK_SIZE) {
+				/* Module needs more of the file to decide. */
+				pending[i] = TRUE;
+				more = TRUE;
+				continue;
+			} else if (ret == SR_ERR) {
+				/* Module didn't recognize this buffer. */
+				continue;
+			} else if (ret != SR_OK) {
+				/* Module recognized this buffer, but cannot handle it. */
+				continue;
+			}
+			/* Found a matching module. */
+			sr_dbg("Module %s matched, confidence %u.", imod->id, conf);
+			if (conf >= best_conf)
+				continue;
+			best_imod = imod;
+			best_conf = conf;
 		}
-		/* Found a matching module. */
-		sr_dbg("Module %s matched, confidence %u.", imod->id, conf);
-		if (conf >= best_conf)
-			continue;
-		best_imod = imod;
-		best_conf = conf;
-	}
+		if (more) {
+			want = MIN(header->len * 4, CHUNK_SIZE) - header->len;
+			sr_dbg("Reading %zu more bytes for format match.", want);
+			count = read_header(zr, header, want);
+			if (count < 1)
+				break;
+			eof = (size_t)count < want;
+		}
+	} while (more);
+	sr_zreader_close(zr);
+	g_free(pending);
 	g_hash_table_destroy(meta);
 	g_string_free(header, TRUE);
+	g_free(name);
 
 	if (best_imod) {
 		*in = sr_input_new(best_imod, NULL);
@@ -601,6 +689,156 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
 	return in->module->receive((struct sr_input *)in, buf);
 }
 
+static void mapping_release(void *data, void *cb_data)
+{
+	(void)data;
+
+	g_mapped_file_unref(cb_data);
+}
+
+static int send_mapped(struct sr_input *in)
+{
+	const char *data;
+	size_t size, len;
+	GString *buf;
+	gboolean ready;
+	int ret;
+
+	if (in->module->receive_mapped)
+		return in->module->receive_mapped(in);
+
+	/* Feed copies to modules which only take buffers. */
+	data = sr_buffer_data(in->mapping);
+	size = sr_buffer_size(in->mapping);
+	ready = in->sdi_ready;
+	buf = g_string_sized_new(CHUNK_SIZE);
+	ret = SR_OK;
+	while (in->mapped_pos < size) {
+		len = MIN(CHUNK_SIZE, size - in->mapped_pos);
+		g_string_truncate(buf, 0);
+		g_string_append_len(buf, data + in->mapped_pos, len);
+		in->mapped_pos += len;
+		ret = in->module->receive(in, buf);
+		if (ret != SR_OK)
+			break;
+		if (!ready && in->sdi_ready)
+			break;
+	}
+	g_string_free(buf, TRUE);
+
+	return ret;
+}
+
+/* Feed a compressed file to the module, decompressing one chunk at a time. */
+static int send_compressed(struct sr_input *in)
+{
+	GString *buf;
+	gssize len;
+	gboolean ready;
+	int ret;
+
+	ready = in->sdi_ready;
+	buf = g_string_sized_new(CHUNK_SIZE);
+	ret = SR_OK;
+	while (TRUE) {
+		g_string_set_size(buf, CHUNK_SIZE);
+		len = sr_zreader_read(in->zreader, buf->str, CHUNK_SIZE);
+		if (len < 0) {
+			ret = SR_ERR;
+			break;
+		}
+		if (len == 0)
+			break;
+		g_string_set_size(buf, len);
+		ret = in->module->receive(in, buf);
+		if (ret != SR_OK)
+			break;
+		if (!ready && in->sdi_ready)
+			break;
+	}
+	g_string_free(buf, TRUE);
+
+	return ret;
+}
+
+/**
+ * Send a whole file to the specified input instance.
+ *
+ * Maps the file into memory rather than reading it. Modules which
+ * support this send packets pointing into the mapping, without copying
+ * any sample data. Other modules are fed the file in chunks, as with
+ * sr_input_send().
+ *
+ * Like sr_input_send(), this returns the moment the device instance is
+ * ready. Call it again, or sr_input_end(), to process the rest of the
+ * file. The filename is only used by the first call. The mapping must
+ * not be combined with sr_input_send() on the same instance.
+ *
+ * Files compressed with gzip or zstd are not mapped, they are
+ * decompressed as they are fed to the module, a chunk at a time.
+ *
+ * @param in_ro The input instance. Must not be NULL.
+ * @param filename The file to send. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The file could not be mapped.
+ * @retval other Error code of the input module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_input_send_mapped(const struct sr_input *in_ro,
+		const char *filename)
+{
+	struct sr_input *in;
+	struct sr_zreader *zr;
+	GMappedFile *mapped;
+	GError *error;
+	FILE *stream;
+	int ret;
+
+	in = (struct sr_input *)in_ro;	/* "un-const" */
+	if (!in || !in->module || !filename)
+		return SR_ERR_ARG;
+
+	if (!in->mapping && !in->zreader) {
+		if (!(stream = g_fopen(filename, "rb"))) {
+			sr_err("Failed to open %s: %s", filename,
+				g_strerror(errno));
+			return SR_ERR;
+		}
+		if ((ret = sr_zreader_open(stream, &zr)) != SR_OK)
+			return ret == SR_ERR_NA ? SR_ERR_NA : SR_ERR;
+		if (sr_zreader_format(zr) != SR_ZREADER_PLAIN)
+			in->zreader = zr;
+		else
+			sr_zreader_close(zr);
+	}
+	if (in->zreader) {
+		sr_spew("Sending compressed %s to %s module.",
+			filename, in->module->id);
+		return send_compressed(in);
+	}
+
+	if (!in->mapping) {
+		error = NULL;
+		mapped = g_mapped_file_new(filename, FALSE, &error);
+		if (!mapped) {
+			sr_err("Cannot map %s: %s.", filename, error->message);
+			g_error_free(error);
+			return SR_ERR;
+		}
+		in->mapping = sr_buffer_new(g_mapped_file_get_contents(mapped),
+			g_mapped_file_get_length(mapped), mapping_release, mapped);
+		in->mapped_pos = 0;
+	}
+
+	sr_spew("Sending %zu mapped bytes to %s module.",
+		sr_buffer_size(in->mapping) - in->mapped_pos, in->module->id);
+
+	return send_mapped(in);
+}
+
 /**
  * Signal the input module no more data will come.
  *
@@ -609,10 +847,35 @@ SR_API int sr_input_send(const struct sr_input *in, GString *buf)
  *
  * @since 0.4.0
  */
-SR_API int sr_input_end(const struct sr_input *in)
+SR_API int sr_input_end(const struct sr_input *in_ro)
 {
+	struct sr_input *in;
+	int ret;
+
+	in = (struct sr_input *)in_ro;	/* "un-const" */
+
+	/* Process what's left of a mapped file, getting ready first. */
+	if (in->mapping && in->mapped_pos < sr_buffer_size(in->mapping)) {
+		ret = SR_OK;
+		if (!in->sdi_ready)
+			ret = send_mapped(in);
+		if (ret == SR_OK && in->mapped_pos < sr_buffer_size(in->mapping))
+			ret = send_mapped(in);
+		if (ret != SR_OK)
+			return ret;
+	}
+	if (in->zreader) {
+		ret = SR_OK;
+		if (!in->sdi_ready)
+			ret = send_compressed(in);
+		if (ret == SR_OK)
+			ret = send_compressed(in);
+		if (ret != SR_OK)
+			return ret;
+	}
+
 	sr_spew("Calling end() on %s module.", in->module->id);
-	return in->module->end((struct sr_input *)in);
+	return in->module->end(in);
 }
 
 /**
@@ -664,7 +927,13 @@ SR_API int sr_input_reset(const struct sr_input *in_ro)
 	 */
 	if (in->buf)
 		g_string_truncate(in->buf, 0);
+	in->buf_pos = 0;
 	in->sdi_ready = FALSE;
+	sr_buffer_unref(in->mapping);
+	in->mapping = NULL;
+	in->mapped_pos = 0;
+	sr_zreader_close(in->zreader);
+	in->zreader = NULL;
 
 	return rc;
 }
@@ -693,14 +962,89 @@ SR_API void sr_input_free(const struct sr_input *in)
 	 * .cleanup() released potentially nested resources under 'inc').
 	 */
 	sr_dev_inst_free(in->sdi);
-	if (in->buf->len > 64) {
+	if (sr_input_buf_len(in) > 64) {
 		/* That seems more than just some sub-unitsize leftover... */
 		sr_warn("Found %" G_GSIZE_FORMAT
-			" unprocessed bytes at free time.", in->buf->len);
+			" unprocessed bytes at free time.", sr_input_buf_len(in));
 	}
 	g_string_free(in->buf, TRUE);
+	sr_buffer_unref(in->mapping);
+	sr_zreader_close(in->zreader);
 	g_free(in->priv);
 	g_free((gpointer)in);
 }
 
+/**
+ * Get the unconsumed data of an input instance's receive buffer.
+ *
+ * The data is NUL terminated, and may be modified in place.
+ *
+ * @private
+ */
+SR_PRIV char *sr_input_buf_data(const struct sr_input *in)
+{
+	return in->buf->str + in->buf_pos;
+}
+
+/**
+ * Get the size of the unconsumed data in the receive buffer.
+ *
+ * @private
+ */
+SR_PRIV size_t sr_input_buf_len(const struct sr_input *in)
+{
+	return in->buf->len - in->buf_pos;
+}
+
+/**
+ * Append received data to an input instance's receive buffer.
+ *
+ * Consumed data only gets removed from the front of the buffer here,
+ * and only after at least as much was consumed as is left over. Each
+ * byte is thus moved at most once on average, no matter how little a
+ * module consumes at a time.
+ *
+ * @private
+ */
+SR_PRIV void sr_input_buf_append(struct sr_input *in,
+		const char *data, size_t len)
+{
+	if (in->buf_pos && in->buf_pos >= sr_input_buf_len(in))
+		sr_input_buf_compact(in);
+	g_string_append_len(in->buf, data, len);
+}
+
+/**
+ * Mark data at the start of the receive buffer as consumed.
+ *
+ * @private
+ */
+SR_PRIV void sr_input_buf_consume(struct sr_input *in, size_t len)
+{
+	in->buf_pos += MIN(len, sr_input_buf_len(in));
+	if (in->buf_pos == in->buf->len) {
+		g_string_truncate(in->buf, 0);
+		in->buf_pos = 0;
+	}
+}
+
+/**
+ * Remove consumed data from the receive buffer right away.
+ *
+ * For code which needs the unconsumed data as a GString of its own.
+ *
+ * @return The receive buffer, holding just the unconsumed data.
+ *
+ * @private
+ */
+SR_PRIV GString *sr_input_buf_compact(struct sr_input *in)
+{
+	if (in->buf_pos) {
+		g_string_erase(in->buf, 0, in->buf_pos);
+		in->buf_pos = 0;
+	}
+
+	return in->buf;
+}
+
 /** @} */
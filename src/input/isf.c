@@ -105,11 +105,6 @@ enum waveform_type {
 	RF_FD,
 };
 
-union floating_point {
-	float f;
-	uint32_t i;
-};
-
 struct context {
 	gboolean started;
 	gboolean create_channel;
@@ -123,6 +118,11 @@ struct context {
 	enum format bn_fmt;
 	enum waveform_type wfmtype;
 	char channel_name[MAX_CHANNEL_NAME_SIZE];
+	gboolean send_raw;
+	void (*convert)(const uint8_t *data, float *out,
+		size_t count, unsigned int bytnr);
+	float *fdata;
+	size_t fdata_size;
 };
 
 /* Header items used to process the input file. */
@@ -513,117 +513,124 @@ static int init(struct sr_input *in, GHashTable *options)
 }
 
 /*
- * Read an integer value from the data buffer.
- * The number of bytes per sample may vary and the sample is stored
- * in a signed 64-bit integer. Therefore a negative integer extension
- * might be needed.
+ * Bulk converters for the sample formats which cannot be sent as they
+ * are. Integers of any width up to MAX_INT_BYTNR get assembled and
+ * sign extended, floats get their byte order adjusted.
  */
-static float read_int_sample(struct sr_input *in, size_t offset)
+static void convert_uint_msb(const uint8_t *data, float *out,
+	size_t count, unsigned int bytnr)
 {
-	struct context *inc;
-	unsigned int bytnr;
-	int i;
-	int64_t value;
-	uint8_t data[MAX_INT_BYTNR];
-
-	inc = in->priv;
-	bytnr = inc->bytnr;
-
-	if (bytnr > MAX_INT_BYTNR)
-		return 0;
+	size_t i;
+	unsigned int b;
+	uint64_t value;
+
+	for (i = 0; i < count; i++) {
+		value = 0;
+		for (b = 0; b < bytnr; b++)
+			value = (value << 8) | data[b];
+		out[i] = (float)value;
+		data += bytnr;
+	}
+}
 
-	memcpy(data, in->buf->str + offset, bytnr);
-	value = 0;
-	if (inc->byte_order == MSB) {
-		for (i = 0; i < (int)bytnr; i++) {
-			value = value << 8;
-			value |= data[i];
-		}
-	} else {
-		for (i = (int)bytnr - 1; i >= 0; i--) {
-			value = value << 8;
-			value |= data[i];
-		}
+static void convert_uint_lsb(const uint8_t *data, float *out,
+	size_t count, unsigned int bytnr)
+{
+	size_t i;
+	unsigned int b;
+	uint64_t value;
+
+	for (i = 0; i < count; i++) {
+		value = 0;
+		for (b = bytnr; b > 0; b--)
+			value = (value << 8) | data[b - 1];
+		out[i] = (float)value;
+		data += bytnr;
 	}
+}
 
-	/* Check if the loaded value is negative. */
-	if ((value & (1 << (8 * bytnr - 1))) != 0) {
-		/* Extend the 64-bit integer if the value is negative. */
-		i = ~((1 << (8 * bytnr - 1)) - 1);
-		value |= i;
+static void convert_int_msb(const uint8_t *data, float *out,
+	size_t count, unsigned int bytnr)
+{
+	size_t i;
+	unsigned int b;
+	uint64_t value, sign;
+
+	sign = UINT64_C(1) << (8 * bytnr - 1);
+	for (i = 0; i < count; i++) {
+		value = 0;
+		for (b = 0; b < bytnr; b++)
+			value = (value << 8) | data[b];
+		out[i] = (float)(int64_t)((value ^ sign) - sign);
+		data += bytnr;
 	}
+}
 
-	return (float)value;
+static void convert_int_lsb(const uint8_t *data, float *out,
+	size_t count, unsigned int bytnr)
+{
+	size_t i;
+	unsigned int b;
+	uint64_t value, sign;
+
+	sign = UINT64_C(1) << (8 * bytnr - 1);
+	for (i = 0; i < count; i++) {
+		value = 0;
+		for (b = bytnr; b > 0; b--)
+			value = (value << 8) | data[b - 1];
+		out[i] = (float)(int64_t)((value ^ sign) - sign);
+		data += bytnr;
+	}
 }
 
-/*
- * Read an unsigned integer value from the data buffer.
- * The amount of bytes per sample may vary and a sample
- * is stored in an unsigned 64-bit integer.
- */
-static float read_unsigned_int_sample(struct sr_input *in, size_t offset)
+static void convert_float_msb(const uint8_t *data, float *out,
+	size_t count, unsigned int bytnr)
 {
-	struct context *inc;
-	uint64_t value = 0;
-	char data[MAX_INT_BYTNR];
-	int i;
+	size_t i;
 
-	inc = in->priv;
+	(void)bytnr;
 
-	if (inc->bytnr > MAX_INT_BYTNR)
-		return 0;
+	for (i = 0; i < count; i++)
+		out[i] = read_fltbe(&data[i * FLOAT_BYTNR]);
+}
 
-	memcpy(data, in->buf->str + offset, inc->bytnr);
-	if (inc->byte_order == MSB) {
-		for (i = 0; i < (int)inc->bytnr; i++) {
-			value <<= 8;
-			value |= data[i];
-		}
-	} else {
-		for (i = (int)inc->bytnr; i >= 0; i--) {
-			value <<= 8;
-			value |= data[i];
-		}
-	}
+static void convert_float_lsb(const uint8_t *data, float *out,
+	size_t count, unsigned int bytnr)
+{
+	size_t i;
+
+	(void)bytnr;
 
-	return (float)value;
+	for (i = 0; i < count; i++)
+		out[i] = read_fltle(&data[i * FLOAT_BYTNR]);
 }
 
 /*
- * Read a float value from the data buffer.
- * The value is stored as a 32-bit integer representing
- * a single precision value.
+ * Pick how the data section gets sent, once the header is known.
+ * Analog waveforms in a width which sr_analog_to_float() understands
+ * pass through unmodified, with YMULT, YOFF and YZERO expressed in
+ * the encoding's scale and offset. Everything else, including RF
+ * waveforms which need a logarithm, takes a bulk converter.
  */
-static float read_float_sample(struct sr_input *in, size_t offset)
+static void setup_conversion(struct context *inc)
 {
-	struct context *inc;
-	union floating_point fp;
-	unsigned int bytnr;
-	int i;
-	uint8_t data[FLOAT_BYTNR];
+	gboolean msb;
 
-	inc = in->priv;
-	bytnr = inc->bytnr;
-	fp.i = 0;
-
-	if (bytnr > FLOAT_BYTNR)
-		return 0;
-
-	memcpy(data, in->buf->str + offset, bytnr);
-
-	if (inc->byte_order == MSB) {
-		for (i = 0; i < (int)bytnr; i++) {
-			fp.i = fp.i << 8;
-			fp.i |= data[i];
-		}
-	} else {
-		for (i = (int)bytnr - 1; i >= 0; i--) {
-			fp.i = fp.i << 8;
-			fp.i |= data[i];
-		}
-	}
-
-	return fp.f;
+	msb = inc->byte_order == MSB;
+	if (inc->bn_fmt == FP)
+		inc->convert = msb ? convert_float_msb : convert_float_lsb;
+	else if (inc->bn_fmt == RI)
+		inc->convert = msb ? convert_int_msb : convert_int_lsb;
+	else
+		inc->convert = msb ? convert_uint_msb : convert_uint_lsb;
+
+	inc->send_raw = FALSE;
+	if (inc->wfmtype != ANALOG)
+		return;
+	if (inc->bn_fmt == FP || inc->bytnr == sizeof(uint8_t) ||
+			inc->bytnr == sizeof(uint16_t) ||
+			inc->bytnr == sizeof(uint32_t))
+		inc->send_raw = TRUE;
 }
 
 /* Send a sample chunk to the sigrok session. */
@@ -635,39 +642,53 @@ static void send_chunk(struct sr_input *in, size_t initial_offset, size_t num_sa
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
 	struct context *inc;
+	const uint8_t *data;
 	float *fdata;
-	size_t offset, i;
+	size_t i;
 
 	inc = in->priv;
-	offset = initial_offset;
-	fdata = g_malloc0(sizeof(float) * num_samples);
-	for (i = 0; i < num_samples; i++) {
-		if (inc->bn_fmt == RI) {
-			fdata[i] = (read_int_sample(in, offset) - inc->yoff) * inc->ymult + inc->yzero;
-		} else if (inc->bn_fmt == RP) {
-			fdata[i] = (read_unsigned_int_sample(in, offset) - inc->yoff) * inc->ymult + inc->yzero;
-		} else if (inc->bn_fmt == FP) {
-			fdata[i] = (read_float_sample(in, offset) - inc->yoff) * inc->ymult + inc->yzero;
-		}
-		offset += inc->bytnr;
-
-		/* Convert W to dBm if the sample is RF. */
-		if (inc->wfmtype == RF_FD)
-			fdata[i] = 10 * log10f(1000 * fdata[i]);
-	}
+	data = (const uint8_t *)in->buf->str + initial_offset;
 
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
 	packet.type = SR_DF_ANALOG;
 	packet.payload = &analog;
 	analog.num_samples = num_samples;
-	analog.data = fdata;
 	analog.meaning->channels = in->sdi->channels;
 	analog.meaning->mq = 0;
 	analog.meaning->mqflags = 0;
 	analog.meaning->unit = 0;
 
+	if (inc->send_raw) {
+		encoding.unitsize = inc->bytnr;
+		encoding.is_signed = inc->bn_fmt != RP;
+		encoding.is_float = inc->bn_fmt == FP;
+		encoding.is_bigendian = inc->byte_order == MSB;
+		sr_rational_from_double(&encoding.scale, inc->ymult);
+		sr_rational_from_double(&encoding.offset,
+			(double)inc->yzero - (double)inc->yoff * inc->ymult);
+		analog.data = (void *)data;
+		sr_session_send(in->sdi, &packet);
+		return;
+	}
+
+	if (num_samples > inc->fdata_size) {
+		g_free(inc->fdata);
+		inc->fdata = g_malloc(sizeof(float) * num_samples);
+		inc->fdata_size = num_samples;
+	}
+	fdata = inc->fdata;
+	inc->convert(data, fdata, num_samples, inc->bytnr);
+	for (i = 0; i < num_samples; i++)
+		fdata[i] = (fdata[i] - inc->yoff) * inc->ymult + inc->yzero;
+
+	/* Convert W to dBm if the samples are RF. */
+	if (inc->wfmtype == RF_FD) {
+		for (i = 0; i < num_samples; i++)
+			fdata[i] = 10 * log10f(1000 * fdata[i]);
+	}
+
+	analog.data = fdata;
 	sr_session_send(in->sdi, &packet);
-	g_free(fdata);
 }
 
 /* Process the buffer data. */
@@ -751,7 +772,8 @@ static int receive(struct sr_input *in, GString *buf)
 			return ret;
 
 		/* Check bytnr value. */
-		if ((inc->bn_fmt == RI || inc->bn_fmt == RP) && inc->bytnr > MAX_INT_BYTNR) {
+		if ((inc->bn_fmt == RI || inc->bn_fmt == RP) &&
+			(inc->bytnr == 0 || inc->bytnr > MAX_INT_BYTNR)) {
 			sr_err("This value of byte number per sample is unsupported.");
 			return SR_ERR_NA;
 		}
@@ -762,6 +784,8 @@ static int receive(struct sr_input *in, GString *buf)
 			return SR_ERR_NA;
 		}
 
+		setup_conversion(inc);
+
 		/* Set default channel name if WFID couldn't be found. */
 		if (strlen(inc->channel_name) == 0)
 			snprintf(inc->channel_name, MAX_CHANNEL_NAME_SIZE, "CH");
@@ -797,8 +821,19 @@ static int end(struct sr_input *in)
 	return ret;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->fdata);
+	inc->fdata = NULL;
+	inc->fdata_size = 0;
+}
+
 /* Clear the buffer and metadata. */
 static int reset(struct sr_input *in) {
+	cleanup(in);
 	memset(in->priv, 0, sizeof(struct context));
 
 	g_string_truncate(in->buf, 0);
@@ -815,5 +850,6 @@ SR_PRIV struct sr_input_module input_isf = {
 		.init = init,
 		.receive = receive,
 		.end = end,
+		.cleanup = cleanup,
 		.reset = reset
 };
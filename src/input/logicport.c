@@ -64,6 +64,8 @@
 
 #define MAX_CHANNELS	34
 #define CHUNK_SIZE	(4 * 1024 * 1024)
+/* Sample lines which get decoded before they are sent in one go. */
+#define STAGE_LINES	(64 * 1024)
 
 #define CRLF		"\r\n"
 #define DC1_CHR		'\x11'
@@ -127,9 +129,8 @@ struct context {
 	GSList *signal_groups;
 	GSList *channels;
 	size_t unitsize;
-	size_t samples_per_chunk;
-	size_t samples_in_buffer;
-	uint8_t *feed_buffer;
+	struct feed_queue_logic *feed;
+	uint8_t *stage;
 };
 
 static struct signal_group_desc *alloc_signal_group(const char *name)
@@ -435,9 +436,11 @@ static int process_sample_line(struct context *inc, char **values)
 	entry->bits = 0;
 	mask = UINT64_C(1);
 	for (idx = 0; idx < inc->channel_count; idx++, mask <<= 1) {
-		if (strcmp(values[idx], "1") == 0)
+		if (!values[idx][0] || values[idx][1])
+			continue;
+		if (values[idx][0] == '1')
 			entry->bits |= mask;
-		if (strcmp(values[idx], "U") == 0)
+		else if (values[idx][0] == 'U')
 			inc->wires_undefined |= mask;
 	}
 	rc = sr_atol(values[inc->channel_count], &conv_ret);
@@ -641,7 +644,7 @@ static int have_text_line(struct sr_input *in, char **line, char **next)
 
 	if (!in || !in->buf || !in->buf->str)
 		return 0;
-	sol_ptr = in->buf->str;
+	sol_ptr = sr_input_buf_data(in);
 	eol_ptr = strstr(sol_ptr, CRLF);
 	if (!eol_ptr)
 		return 0;
@@ -735,7 +738,7 @@ static int parse_header(struct sr_input *in)
 	inc = in->priv;
 	while (have_text_line(in, &line, &next)) {
 		rc = process_text_line(inc, line);
-		g_string_erase(in->buf, 0, next - line);
+		sr_input_buf_consume(in, next - line);
 		if (rc)
 			return rc;
 	}
@@ -795,7 +798,7 @@ static int create_channels_groups(struct sr_input *in)
 	return SR_OK;
 }
 
-/* Allocate the session feed buffer. */
+/* Allocate the session feed queue. */
 static int create_feed_buffer(struct sr_input *in)
 {
 	struct context *inc;
@@ -803,28 +806,30 @@ static int create_feed_buffer(struct sr_input *in)
 	inc = in->priv;
 
 	inc->unitsize = (inc->channel_count + 7) / 8;
-	inc->samples_per_chunk = CHUNK_SIZE / inc->unitsize;
-	inc->samples_in_buffer = 0;
-	inc->feed_buffer = g_malloc0(inc->samples_per_chunk * inc->unitsize);
-	if (!inc->feed_buffer)
+	inc->feed = feed_queue_logic_alloc(in->sdi,
+		CHUNK_SIZE / inc->unitsize, inc->unitsize);
+	if (!inc->feed)
 		return SR_ERR_MALLOC;
+	/* Values get written as 64bit words, have room for the last. */
+	inc->stage = g_malloc(STAGE_LINES * inc->unitsize + sizeof(uint64_t));
 
 	return SR_OK;
 }
 
-/* Send all accumulated sample data values to the session. */
-static int send_buffer(struct sr_input *in)
+/* Send the packets which precede sample data, once. */
+static int send_feed_start(struct sr_input *in)
 {
 	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
 	int rc;
 
 	inc = in->priv;
-	if (!inc->samples_in_buffer)
-		return SR_OK;
 
 	if (!inc->header_sent) {
+		/* Sample lines carry repeat counts, pass them on as runs. */
+		rc = feed_queue_logic_rle(inc->feed,
+			sr_session_takes_logic_rle(in->sdi->session));
+		if (rc)
+			return rc;
 		rc = std_session_send_df_header(in->sdi);
 		if (rc)
 			return rc;
@@ -839,80 +844,62 @@ static int send_buffer(struct sr_input *in)
 		inc->rate_sent = TRUE;
 	}
 
-	packet.type = SR_DF_LOGIC;
-	packet.payload = &logic;
-	logic.unitsize = inc->unitsize;
-	logic.data = inc->feed_buffer;
-	logic.length = inc->unitsize * inc->samples_in_buffer;
-	rc = sr_session_send(in->sdi, &packet);
-
-	inc->samples_in_buffer = 0;
-
-	if (rc)
-		return rc;
-
 	return SR_OK;
 }
 
 /*
- * Add N copies of the current sample to the buffer. Send the buffer to
- * the session feed when a maximum amount of data was collected.
+ * Pass on previously received samples to the session. Lines which
+ * occur once get decoded into a staging buffer and are sent in bulk,
+ * repeated lines are expanded by the feed queue.
  */
-static int add_samples(struct sr_input *in, uint64_t samples, size_t count)
-{
-	struct context *inc;
-	uint8_t sample_buffer[sizeof(uint64_t)];
-	size_t idx;
-	size_t copy_count;
-	uint8_t *p;
-	int rc;
-
-	inc = in->priv;
-	for (idx = 0; idx < inc->unitsize; idx++) {
-		sample_buffer[idx] = samples & 0xff;
-		samples >>= 8;
-	}
-	while (count) {
-		copy_count = inc->samples_per_chunk - inc->samples_in_buffer;
-		if (copy_count > count)
-			copy_count = count;
-		count -= copy_count;
-
-		p = inc->feed_buffer + inc->samples_in_buffer * inc->unitsize;
-		while (copy_count-- > 0) {
-			memcpy(p, sample_buffer, inc->unitsize);
-			p += inc->unitsize;
-			inc->samples_in_buffer++;
-		}
-
-		if (inc->samples_in_buffer == inc->samples_per_chunk) {
-			rc = send_buffer(in);
-			if (rc)
-				return rc;
-		}
-	}
-
-	return SR_OK;
-}
-
-/* Pass on previously received samples to the session. */
 static int process_queued_samples(struct sr_input *in)
 {
 	struct context *inc;
 	struct sample_data_entry *entry;
 	uint64_t sample_bits;
+	size_t staged;
 	int rc;
 
 	inc = in->priv;
+	if (inc->sample_lines_fed == inc->sample_lines_total)
+		return SR_OK;
+
+	rc = send_feed_start(in);
+	if (rc)
+		return rc;
+
+	staged = 0;
 	while (inc->sample_lines_fed < inc->sample_lines_total) {
 		entry = &inc->sample_data_queue[inc->sample_lines_fed++];
+		if (!entry->repeat)
+			continue;
 		sample_bits = entry->bits;
 		sample_bits ^= inc->wires_inverted;
 		sample_bits &= inc->wires_enabled;
-		rc = add_samples(in, sample_bits, entry->repeat);
+		write_u64le(&inc->stage[staged * inc->unitsize], sample_bits);
+		if (entry->repeat == 1) {
+			if (++staged < STAGE_LINES)
+				continue;
+			rc = feed_queue_logic_submit_many(inc->feed,
+				inc->stage, staged);
+			if (rc)
+				return rc;
+			staged = 0;
+			continue;
+		}
+		rc = feed_queue_logic_submit_many(inc->feed,
+			inc->stage, staged);
 		if (rc)
 			return rc;
+		rc = feed_queue_logic_submit_one(inc->feed,
+			&inc->stage[staged * inc->unitsize], entry->repeat);
+		if (rc)
+			return rc;
+		staged = 0;
 	}
+	rc = feed_queue_logic_submit_many(inc->feed, inc->stage, staged);
+	if (rc)
+		return rc;
 
 	return SR_OK;
 }
@@ -1041,7 +1028,7 @@ static int receive(struct sr_input *in, GString *buf)
 	int rc;
 
 	/* Accumulate another chunk of input data. */
-	g_string_append_len(in->buf, buf->str, buf->len);
+	sr_input_buf_append(in, buf->str, buf->len);
 
 	/*
 	 * Wait for the full header's availability, then process it in a
@@ -1051,7 +1038,7 @@ static int receive(struct sr_input *in, GString *buf)
 	 */
 	inc = in->priv;
 	if (!inc->got_header) {
-		if (!have_header(in->buf))
+		if (!have_header(sr_input_buf_compact(in)))
 			return SR_OK;
 		rc = parse_header(in);
 		if (rc)
@@ -1085,12 +1072,14 @@ static int end(struct sr_input *in)
 	rc = process_queued_samples(in);
 	if (rc)
 		return rc;
-	rc = send_buffer(in);
-	if (rc)
-		return rc;
+	inc = in->priv;
+	if (inc->feed) {
+		rc = feed_queue_logic_flush(inc->feed);
+		if (rc)
+			return rc;
+	}
 
 	/* End the session feed if one was started. */
-	inc = in->priv;
 	if (inc->header_sent) {
 		rc = std_session_send_df_end(in->sdi);
 		inc->header_sent = FALSE;
@@ -1125,7 +1114,8 @@ static void cleanup(struct sr_input *in)
 		g_free(inc->signal_names[idx]);
 	g_slist_free_full(inc->signal_groups, sg_free);
 	g_slist_free_full(inc->channels, g_free);
-	g_free(inc->feed_buffer);
+	feed_queue_logic_free(inc->feed);
+	g_free(inc->stage);
 	memset(inc, 0, sizeof(*inc));
 }
 
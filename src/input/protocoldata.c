@@ -231,6 +231,9 @@
 
 #define CHUNK_SIZE	(4 * 1024 * 1024)
 
+/* Upper limit for the samples of rendered waveforms kept for re-use. */
+#define TEMPLATES_MAX_SIZE	(16 * 1024 * 1024)
+
 /*
  * Support optional automatic file type detection. Support optionally
  * embedded options in a header section after the file detection magic
@@ -475,6 +478,13 @@ struct context {
 	size_t *sample_edges;
 	size_t *sample_widths;
 	uint8_t *sample_levels;	/* Sample data, logic traces. */
+	/*
+	 * Rendered samples of previously sent waveforms, keyed by their
+	 * levels per slot. Slot widths don't change after configuration,
+	 * so a repeated waveform can be sent as a copy of its samples.
+	 */
+	GHashTable *templates;
+	size_t templates_size;
 	/* Common support for samples updating by manipulation. */
 	struct {
 		uint8_t idle_levels;
@@ -537,6 +547,10 @@ static int alloc_frame_storage(struct context *inc)
 	if (!inc->bit_scale)
 		return SR_ERR_MALLOC;
 
+	inc->templates = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+		(GDestroyNotify)g_bytes_unref, (GDestroyNotify)g_bytes_unref);
+	inc->templates_size = 0;
+
 	return SR_OK;
 }
 
@@ -742,16 +756,61 @@ static int send_idle_interframe(struct context *inc)
 	return SR_OK;
 }
 
+/*
+ * Render the accumulated waveform's samples, and keep them for later
+ * frames which have the same levels. Returns NULL when the waveform is
+ * empty, or when the templates already take all the space they may.
+ */
+static GBytes *render_frame(struct context *inc)
+{
+	size_t count, index;
+	uint8_t *samples, *wrptr;
+	GBytes *key, *rendered;
+
+	if (!inc->top_frame_bits)
+		return NULL;
+	count = inc->sample_edges[inc->top_frame_bits - 1];
+	if (inc->templates_size + count > TEMPLATES_MAX_SIZE)
+		return NULL;
+
+	samples = g_malloc(count);
+	wrptr = samples;
+	for (index = 0; index < inc->top_frame_bits; index++) {
+		memset(wrptr, inc->sample_levels[index],
+			inc->sample_widths[index]);
+		wrptr += inc->sample_widths[index];
+	}
+	rendered = g_bytes_new_take(samples, count);
+	key = g_bytes_new(inc->sample_levels, inc->top_frame_bits);
+	g_hash_table_insert(inc->templates, key, rendered);
+	inc->templates_size += count;
+
+	return rendered;
+}
+
 /* Forward the previously accumulated samples of the waveform. */
 static int send_frame(struct sr_input *in)
 {
 	struct context *inc;
+	GBytes *key, *rendered;
+	const uint8_t *samples;
 	size_t count, index;
 	uint8_t data;
 	int ret;
 
 	inc = in->priv;
 
+	key = g_bytes_new_static(inc->sample_levels, inc->top_frame_bits);
+	rendered = g_hash_table_lookup(inc->templates, key);
+	g_bytes_unref(key);
+	if (!rendered)
+		rendered = render_frame(inc);
+	if (rendered) {
+		samples = g_bytes_get_data(rendered, &count);
+		return feed_queue_logic_submit_many(inc->feed_logic,
+			samples, count);
+	}
+
 	for (index = 0; index < inc->top_frame_bits; index++) {
 		data = inc->sample_levels[index];
 		count = inc->sample_widths[index];
@@ -3523,6 +3582,10 @@ static void cleanup(struct sr_input *in)
 	inc->sample_levels = NULL;
 	g_free(inc->bit_scale);
 	inc->bit_scale = NULL;
+	if (inc->templates)
+		g_hash_table_destroy(inc->templates);
+	inc->templates = NULL;
+	inc->templates_size = 0;
 }
 
 static int reset(struct sr_input *in)
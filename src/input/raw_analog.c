@@ -152,10 +152,12 @@ static int init(struct sr_input *in, GHashTable *options)
 	return SR_OK;
 }
 
-static int process_buffer(struct sr_input *in)
+/* Returns how much of the data was sent, whole samples only. */
+static size_t process_data(struct sr_input *in, const uint8_t *data,
+		size_t len, struct sr_buffer *ref)
 {
 	struct context *inc;
-	unsigned int offset, chunk_size;
+	size_t offset, chunk_size;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -174,29 +176,37 @@ static int process_buffer(struct sr_input *in)
 	chunk_size = inc->analog.num_samples * inc->samplesize;
 	offset = 0;
 
-	while ((offset + chunk_size) < in->buf->len) {
-		inc->analog.data = in->buf->str + offset;
-		sr_session_send(in->sdi, &inc->packet);
+	while ((offset + chunk_size) < len) {
+		inc->analog.data = (uint8_t *)data + offset;
+		if (ref)
+			sr_session_send_buffer(in->sdi, &inc->packet, ref);
+		else
+			sr_session_send(in->sdi, &inc->packet);
 		offset += chunk_size;
 	}
 
-	inc->analog.num_samples = (in->buf->len - offset) / inc->samplesize;
+	inc->analog.num_samples = (len - offset) / inc->samplesize;
 	chunk_size = inc->analog.num_samples * inc->samplesize;
 	if (chunk_size > 0) {
-		inc->analog.data = in->buf->str + offset;
-		sr_session_send(in->sdi, &inc->packet);
+		inc->analog.data = (uint8_t *)data + offset;
+		if (ref)
+			sr_session_send_buffer(in->sdi, &inc->packet, ref);
+		else
+			sr_session_send(in->sdi, &inc->packet);
 		offset += chunk_size;
 	}
 
-	if ((unsigned int)offset < in->buf->len) {
-		/*
-		 * The incoming buffer wasn't processed completely. Stash
-		 * the leftover data for next time.
-		 */
-		g_string_erase(in->buf, 0, offset);
-	} else {
-		g_string_truncate(in->buf, 0);
-	}
+	return offset;
+}
+
+static int process_buffer(struct sr_input *in)
+{
+	size_t offset;
+
+	/* Leftover data stays for next time. */
+	offset = process_data(in, (const uint8_t *)sr_input_buf_data(in),
+		sr_input_buf_len(in), NULL);
+	sr_input_buf_consume(in, offset);
 
 	return SR_OK;
 }
@@ -205,7 +215,7 @@ static int receive(struct sr_input *in, GString *buf)
 {
 	int ret;
 
-	g_string_append_len(in->buf, buf->str, buf->len);
+	sr_input_buf_append(in, buf->str, buf->len);
 
 	if (!in->sdi_ready) {
 		/* sdi is ready, notify frontend. */
@@ -218,6 +228,26 @@ static int receive(struct sr_input *in, GString *buf)
 	return ret;
 }
 
+static int receive_mapped(struct sr_input *in)
+{
+	const uint8_t *data;
+	size_t len;
+
+	if (!in->sdi_ready) {
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	/* Send straight from the mapping, a partial sample at the end is dropped. */
+	data = (const uint8_t *)sr_buffer_data(in->mapping) + in->mapped_pos;
+	len = sr_buffer_size(in->mapping) - in->mapped_pos;
+	process_data(in, data, len, in->mapping);
+	in->mapped_pos += len;
+
+	return SR_OK;
+}
+
 static int end(struct sr_input *in)
 {
 	struct context *inc;
@@ -290,4 +320,5 @@ SR_PRIV struct sr_input_module input_raw_analog = {
 	.end = end,
 	.cleanup = cleanup,
 	.reset = reset,
+	.receive_mapped = receive_mapped,
 };
@@ -0,0 +1,315 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reads raw capture files, which drivers write with the data as their
+ * device sent it, see raw_capture.c. The header tells how to unpack it
+ * to logic samples.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "transpose.h"
+
+#define LOG_PREFIX "input/rawcapture"
+
+#define MAGIC "[raw capture]"
+#define CHUNK_SAMPLES (1024 * 1024)
+
+struct context {
+	gboolean started;
+	uint64_t samplerate;
+	unsigned int num_channels;
+	enum sr_raw_capture_layout layout;
+	struct sr_transpose transpose;
+	uint16_t unitsize;
+	/* Raw bytes which unpack as a whole, and what's left to read. */
+	size_t block_bytes;
+	unsigned int block_samples;
+	gboolean sized;
+	uint64_t bytes_left;
+	uint8_t *samples;
+	uint16_t *words;
+};
+
+static int format_match(GHashTable *metadata, unsigned int *confidence)
+{
+	GString *header;
+
+	header = g_hash_table_lookup(metadata,
+		GINT_TO_POINTER(SR_INPUT_META_HEADER));
+	if (!header || header->len < strlen(MAGIC) ||
+			strncmp(header->str, MAGIC, strlen(MAGIC)) != 0)
+		return SR_ERR;
+
+	*confidence = 1;
+
+	return SR_OK;
+}
+
+static int init(struct sr_input *in, GHashTable *options)
+{
+	(void)options;
+
+	in->sdi = g_malloc0(sizeof(struct sr_dev_inst));
+	in->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+static int parse_header(struct sr_input *in)
+{
+	struct context *inc;
+	GKeyFile *kf;
+	GError *error;
+	const char *group, *data;
+	char *layout, *name;
+	unsigned int i, word_bits;
+	gboolean msb_first;
+	int ret;
+
+	inc = in->priv;
+	data = sr_input_buf_data(in);
+	group = "raw capture";
+	kf = g_key_file_new();
+	error = NULL;
+	ret = SR_ERR_DATA;
+	if (!g_key_file_load_from_data(kf, data,
+			strnlen(data, SR_RAW_CAPTURE_HEADER_SIZE),
+			G_KEY_FILE_NONE, &error)) {
+		sr_err("Bad raw capture header: %s.", error->message);
+		g_error_free(error);
+		goto out;
+	}
+	if (g_key_file_get_integer(kf, group, "version", NULL) != 1) {
+		sr_err("Unsupported raw capture version.");
+		goto out;
+	}
+
+	inc->samplerate = g_key_file_get_uint64(kf, group, "samplerate", NULL);
+	inc->num_channels = g_key_file_get_integer(kf, group, "channels", NULL);
+	inc->bytes_left = g_key_file_get_uint64(kf, group, "bytes", NULL);
+	inc->sized = inc->bytes_left != 0;
+	layout = g_key_file_get_string(kf, group, "layout", NULL);
+	word_bits = g_key_file_get_integer(kf, group, "word_bits", NULL);
+	msb_first = g_key_file_get_boolean(kf, group, "msb_first", NULL);
+	if (g_strcmp0(layout, "packed") == 0) {
+		inc->layout = SR_RAW_CAPTURE_PACKED;
+		if (inc->num_channels != 1 && inc->num_channels != 2 &&
+				inc->num_channels != 4 && inc->num_channels != 8) {
+			sr_err("Can't unpack %u packed channels.",
+				inc->num_channels);
+			g_free(layout);
+			goto out;
+		}
+		inc->block_bytes = 1;
+		inc->block_samples = 8 / inc->num_channels;
+	} else if (g_strcmp0(layout, "planar") == 0) {
+		inc->layout = SR_RAW_CAPTURE_PLANAR;
+		if (sr_transpose_init(&inc->transpose, word_bits, msb_first,
+				NULL, inc->num_channels) != SR_OK) {
+			sr_err("Can't unpack %u planar channels of %u bits.",
+				inc->num_channels, word_bits);
+			g_free(layout);
+			goto out;
+		}
+		inc->block_bytes = sr_transpose_block_bytes(&inc->transpose);
+		inc->block_samples = word_bits;
+		inc->words = g_malloc(CHUNK_SAMPLES * sizeof(uint16_t));
+	} else {
+		sr_err("Unknown raw capture layout '%s'.", layout);
+		g_free(layout);
+		goto out;
+	}
+	g_free(layout);
+
+	inc->unitsize = (inc->num_channels + 7) / 8;
+	inc->samples = g_malloc(CHUNK_SAMPLES * inc->unitsize);
+	for (i = 0; i < inc->num_channels; i++) {
+		name = g_strdup_printf("D%u", i);
+		sr_channel_new(in->sdi, i, SR_CHANNEL_LOGIC, TRUE, name);
+		g_free(name);
+	}
+	sr_input_buf_consume(in, SR_RAW_CAPTURE_HEADER_SIZE);
+	ret = SR_OK;
+
+out:
+	g_key_file_free(kf);
+
+	return ret;
+}
+
+static void unpack_packed(struct context *inc, const uint8_t *src,
+		size_t num_bytes)
+{
+	unsigned int k, ch, mask;
+	uint8_t *dst;
+	size_t i;
+
+	ch = inc->num_channels;
+	dst = inc->samples;
+	if (ch == 8) {
+		memcpy(dst, src, num_bytes);
+		return;
+	}
+	mask = (1 << ch) - 1;
+	for (i = 0; i < num_bytes; i++) {
+		for (k = 0; k < 8; k += ch)
+			*dst++ = (src[i] >> k) & mask;
+	}
+}
+
+static void unpack_planar(struct context *inc, const uint8_t *src,
+		size_t num_blocks)
+{
+	size_t i, n;
+
+	sr_transpose_blocks(&inc->transpose, inc->words, src, num_blocks);
+	n = num_blocks * inc->block_samples;
+	if (inc->unitsize == 1) {
+		for (i = 0; i < n; i++)
+			inc->samples[i] = inc->words[i];
+	} else {
+		for (i = 0; i < n; i++)
+			WL16(&inc->samples[i * 2], inc->words[i]);
+	}
+}
+
+/* Unpack and send all complete blocks of the buffer. */
+static int process_buffer(struct sr_input *in)
+{
+	struct context *inc;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	const uint8_t *data;
+	size_t len, num_blocks, max_blocks, n;
+
+	inc = in->priv;
+	if (!inc->started) {
+		std_session_send_df_header(in->sdi);
+		if (inc->samplerate)
+			(void)sr_session_send_meta(in->sdi, SR_CONF_SAMPLERATE,
+				g_variant_new_uint64(inc->samplerate));
+		inc->started = TRUE;
+	}
+
+	data = (const uint8_t *)sr_input_buf_data(in);
+	len = sr_input_buf_len(in);
+	/* A file which wasn't closed properly has no size, read all. */
+	if (inc->sized)
+		len = MIN(len, inc->bytes_left);
+	num_blocks = len / inc->block_bytes;
+	max_blocks = CHUNK_SAMPLES / inc->block_samples;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = inc->unitsize;
+	logic.data = inc->samples;
+	while (num_blocks) {
+		n = MIN(num_blocks, max_blocks);
+		if (inc->layout == SR_RAW_CAPTURE_PACKED)
+			unpack_packed(inc, data, n);
+		else
+			unpack_planar(inc, data, n);
+		logic.length = n * inc->block_samples * inc->unitsize;
+		sr_session_send(in->sdi, &packet);
+		data += n * inc->block_bytes;
+		num_blocks -= n;
+	}
+
+	len = data - (const uint8_t *)sr_input_buf_data(in);
+	if (inc->sized)
+		inc->bytes_left -= len;
+	sr_input_buf_consume(in, len);
+
+	return SR_OK;
+}
+
+static int receive(struct sr_input *in, GString *buf)
+{
+	int ret;
+
+	sr_input_buf_append(in, buf->str, buf->len);
+
+	if (!in->sdi_ready) {
+		if (sr_input_buf_len(in) < SR_RAW_CAPTURE_HEADER_SIZE)
+			return SR_OK;
+		if ((ret = parse_header(in)) != SR_OK)
+			return ret;
+		/* sdi is ready, notify frontend. */
+		in->sdi_ready = TRUE;
+		return SR_OK;
+	}
+
+	return process_buffer(in);
+}
+
+static int end(struct sr_input *in)
+{
+	struct context *inc;
+	int ret;
+
+	if (in->sdi_ready)
+		ret = process_buffer(in);
+	else
+		ret = SR_OK;
+
+	inc = in->priv;
+	if (inc->started)
+		std_session_send_df_end(in->sdi);
+
+	return ret;
+}
+
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->samples);
+	g_free(inc->words);
+	inc->samples = NULL;
+	inc->words = NULL;
+}
+
+static int reset(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	cleanup(in);
+	memset(inc, 0, sizeof(*inc));
+	g_string_truncate(in->buf, 0);
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_input_module input_raw_capture = {
+	.id = "rawcapture",
+	.name = "Raw capture",
+	.desc = "Raw device data written by a driver",
+	.exts = (const char*[]){"raw", NULL},
+	.metadata = { SR_INPUT_META_HEADER | SR_INPUT_META_REQUIRED },
+	.format_match = format_match,
+	.init = init,
+	.receive = receive,
+	.end = end,
+	.cleanup = cleanup,
+	.reset = reset,
+};
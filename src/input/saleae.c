@@ -161,6 +161,9 @@ struct context {
 		uint8_t *buffer_digital;
 		float *buffer_analog;
 		uint8_t *write_pos;
+		/* The whole digital buffer holds this one value. */
+		gboolean buffer_is_run;
+		uint64_t run_value;
 		struct {
 			uint64_t stamp;
 			double time;
@@ -268,6 +271,7 @@ static int alloc_feed_buffer(struct sr_input *in)
 		return SR_ERR_NA;
 	}
 	inc->feed.samples_in_buffer = 0;
+	inc->feed.buffer_is_run = FALSE;
 
 	return SR_OK;
 }
@@ -287,6 +291,7 @@ static int relse_feed_buffer(struct sr_input *in)
 	g_free(inc->feed.buffer_analog);
 	inc->feed.buffer_analog = NULL;
 	inc->feed.write_pos = NULL;
+	inc->feed.buffer_is_run = FALSE;
 
 	return SR_OK;
 }
@@ -374,30 +379,60 @@ static int flush_feed_buffer(struct sr_input *in)
 	return sr_session_send(in->sdi, &packet);
 }
 
+/*
+ * Queue a run of samples with the same value. Writes the value once,
+ * then fills the run by copying what was written so far, doubling the
+ * size of the copies. Long runs of rare transitions fill the complete
+ * buffer, which is sent again as is when the next run covers it again.
+ */
 static int addto_feed_buffer_logic(struct sr_input *in,
 	uint64_t data, size_t count)
 {
 	struct context *inc;
+	size_t unit_size, space, fill, done, copy;
+	uint8_t *start;
+	int rc;
 
 	inc = in->priv;
 
 	if (inc->feed.is_analog)
 		return SR_ERR_ARG;
 
-	while (count--) {
-		if (inc->feed.unit_size == sizeof(uint64_t))
-			write_u64le_inc(&inc->feed.write_pos, data);
-		else if (inc->feed.unit_size == sizeof(uint32_t))
-			write_u32le_inc(&inc->feed.write_pos, data);
-		else if (inc->feed.unit_size == sizeof(uint16_t))
-			write_u16le_inc(&inc->feed.write_pos, data);
-		else if (inc->feed.unit_size == sizeof(uint8_t))
-			write_u8_inc(&inc->feed.write_pos, data);
-		else
-			return SR_ERR_BUG;
-		inc->feed.samples_in_buffer++;
-		if (inc->feed.samples_in_buffer == inc->feed.samples_per_chunk)
-			flush_feed_buffer(in);
+	unit_size = inc->feed.unit_size;
+	while (count) {
+		space = inc->feed.samples_per_chunk - inc->feed.samples_in_buffer;
+		fill = MIN(count, space);
+		start = inc->feed.write_pos;
+		if (fill == inc->feed.samples_per_chunk &&
+				inc->feed.buffer_is_run && inc->feed.run_value == data) {
+			inc->feed.write_pos += fill * unit_size;
+		} else {
+			if (unit_size == sizeof(uint64_t))
+				write_u64le_inc(&inc->feed.write_pos, data);
+			else if (unit_size == sizeof(uint32_t))
+				write_u32le_inc(&inc->feed.write_pos, data);
+			else if (unit_size == sizeof(uint16_t))
+				write_u16le_inc(&inc->feed.write_pos, data);
+			else if (unit_size == sizeof(uint8_t))
+				write_u8_inc(&inc->feed.write_pos, data);
+			else
+				return SR_ERR_BUG;
+			for (done = 1; done < fill; done += copy) {
+				copy = MIN(done, fill - done);
+				memcpy(&start[done * unit_size], start,
+					copy * unit_size);
+			}
+			inc->feed.write_pos = &start[fill * unit_size];
+			inc->feed.buffer_is_run = fill == inc->feed.samples_per_chunk;
+			inc->feed.run_value = data;
+		}
+		inc->feed.samples_in_buffer += fill;
+		count -= fill;
+		if (inc->feed.samples_in_buffer == inc->feed.samples_per_chunk) {
+			rc = flush_feed_buffer(in);
+			if (rc != SR_OK)
+				return rc;
+		}
 	}
 
 	return SR_OK;
@@ -504,8 +539,8 @@ static int parse_header(struct sr_input *in)
 	uint64_t sample_rate;
 
 	inc = in->priv;
-	read_pos = (const uint8_t *)in->buf->str;
-	read_len = in->buf->len;
+	read_pos = (const uint8_t *)sr_input_buf_data(in);
+	read_len = sr_input_buf_len(in);
 
 	/*
 	 * Clear internal state. Normalize user specified option values
@@ -666,7 +701,7 @@ static int parse_header(struct sr_input *in)
 
 	/* Remove the consumed header fields from the receive buffer. */
 	read_len = read_pos - start_pos;
-	g_string_erase(in->buf, 0, read_len);
+	sr_input_buf_consume(in, read_len);
 
 	return SR_OK;
 }
@@ -854,9 +889,9 @@ static int parse_samples(struct sr_input *in)
 	size_t len;
 	int rc;
 
-	start = (const uint8_t *)in->buf->str;
+	start = (const uint8_t *)sr_input_buf_data(in);
 	buff = start;
-	blen = in->buf->len;
+	blen = sr_input_buf_len(in);
 	while (have_next_item(in, buff, blen, &curr, &next)) {
 		len = next - curr;
 		rc = parse_next_item(in, curr, len);
@@ -866,7 +901,7 @@ static int parse_samples(struct sr_input *in)
 		blen -= len;
 	}
 	len = buff - start;
-	g_string_erase(in->buf, 0, len);
+	sr_input_buf_consume(in, len);
 
 	return SR_OK;
 }
@@ -998,7 +1033,7 @@ static int receive(struct sr_input *in, GString *buf)
 	inc = in->priv;
 
 	/* Accumulate another chunk of input data. */
-	g_string_append_len(in->buf, buf->str, buf->len);
+	sr_input_buf_append(in, buf->str, buf->len);
 
 	/*
 	 * Wait for the full header's availability, then process it in
@@ -1007,7 +1042,7 @@ static int receive(struct sr_input *in, GString *buf)
 	 * backend requires those separate phases.
 	 */
 	if (!inc->module_state.got_header) {
-		if (!have_header(inc, in->buf))
+		if (!have_header(inc, sr_input_buf_compact(in)))
 			return SR_OK;
 		rc = parse_header(in);
 		if (rc)
@@ -1059,8 +1094,9 @@ static int end(struct sr_input *in)
 	}
 
 	/* Input data shall be exhausted by now. Non-fatal condition. */
-	if (in->buf->len)
-		sr_warn("Unprocessed remaining input: %zu bytes.", in->buf->len);
+	if (sr_input_buf_len(in))
+		sr_warn("Unprocessed remaining input: %zu bytes.",
+			sr_input_buf_len(in));
 
 	return SR_OK;
 }
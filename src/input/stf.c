@@ -185,11 +185,12 @@ struct context {
 	} header;
 	struct stf_record {
 		size_t len;		/* Payload length. */
-		uint32_t crc;		/* Payload checksum. */
 		uint8_t raw[STF_DATA_REC_PLMAX];	/* Payload data. */
-	} record_data;
+	} *records;	/* One per thread. */
+	struct stf_decode_item *decode_items;
 	struct keep_specs {
 		uint64_t sample_rate;
+		size_t threads;
 		GSList *prev_sr_channels;
 	} keep;
 	struct {
@@ -666,18 +667,18 @@ static int parse_magic(struct sr_input *in)
 	 * unknown or yet unsupported formats).
 	 */
 	inc = in->priv;
-	if (in->buf->len < STF_MAGIC_LENGTH)
+	if (sr_input_buf_len(in) < STF_MAGIC_LENGTH)
 		return SR_OK;
-	if (strncmp(in->buf->str, STF_MAGIC_SIGMA, STF_MAGIC_LENGTH) == 0) {
+	if (strncmp(sr_input_buf_data(in), STF_MAGIC_SIGMA, STF_MAGIC_LENGTH) == 0) {
 		inc->file_format = STF_FORMAT_SIGMA;
-		g_string_erase(in->buf, 0, STF_MAGIC_LENGTH);
+		sr_input_buf_consume(in, STF_MAGIC_LENGTH);
 		sr_dbg("Magic check: Detected SIGMA file format.");
 		inc->file_stage = STF_STAGE_HEADER;
 		return SR_OK;
 	}
-	if (strncmp(in->buf->str, STF_MAGIC_OMEGA, STF_MAGIC_LENGTH) == 0) {
+	if (strncmp(sr_input_buf_data(in), STF_MAGIC_OMEGA, STF_MAGIC_LENGTH) == 0) {
 		inc->file_format = STF_FORMAT_OMEGA;
-		g_string_erase(in->buf, 0, STF_MAGIC_LENGTH);
+		sr_input_buf_consume(in, STF_MAGIC_LENGTH);
 		sr_dbg("Magic check: Detected OMEGA file format.");
 		sr_err("OMEGA format not supported by STF input module.");
 		inc->file_stage = STF_STAGE_DONE;
@@ -748,9 +749,9 @@ static int parse_header(struct sr_input *in)
 	 * the Omega case, too.
 	 */
 	inc = in->priv;
-	while (in->buf->len) {
-		if (in->buf->str[0] == '\0') {
-			g_string_erase(in->buf, 0, 1);
+	while (sr_input_buf_len(in)) {
+		if (sr_input_buf_data(in)[0] == '\0') {
+			sr_input_buf_consume(in, 1);
 			sr_dbg("Header: End of section seen.");
 			rc = eval_header(in);
 			if (rc != SR_OK)
@@ -759,8 +760,8 @@ static int parse_header(struct sr_input *in)
 			return SR_OK;
 		}
 
-		line = in->buf->str;
-		len = in->buf->len;
+		line = sr_input_buf_data(in);
+		len = sr_input_buf_len(in);
 		eol = g_strstr_len(line, len, STF_HEADER_EOL);
 		if (!eol) {
 			sr_dbg("Header: Need more receive data.");
@@ -771,7 +772,7 @@ static int parse_header(struct sr_input *in)
 		sr_spew("Header: Got a line, len %zd, text: %s.", len, line);
 
 		parse_header_line(inc, line, len);
-		g_string_erase(in->buf, 0, len + strlen(STF_HEADER_EOL));
+		sr_input_buf_consume(in, len + strlen(STF_HEADER_EOL));
 	}
 	return SR_OK;
 }
@@ -1024,17 +1025,80 @@ static int stf_parse_data_record(struct sr_input *in, struct stf_record *rec)
 	return SR_OK;
 }
 
+/*
+ * Records decompress independently of each other. Several records from
+ * the receive buffer get decompressed by worker threads, then are
+ * processed in the order of the file.
+ */
+struct stf_decode_item {
+	const uint8_t *compressed;
+	size_t comp_len;
+	struct stf_record *rec;
+	lzo_uint raw_len;
+	int rc;
+};
+
+struct stf_decode_job {
+	struct stf_decode_item *items;
+	size_t count;
+	volatile gint next_item;
+};
+
+static gpointer decode_thread(gpointer data)
+{
+	struct stf_decode_job *job;
+	struct stf_decode_item *item;
+	size_t idx;
+
+	job = data;
+
+	while ((idx = g_atomic_int_add(&job->next_item, 1)) < job->count) {
+		item = &job->items[idx];
+		item->raw_len = sizeof(item->rec->raw);
+		memset(item->rec->raw, 0, sizeof(item->rec->raw));
+		item->rc = lzo1x_decompress_safe(item->compressed,
+			item->comp_len, item->rec->raw, &item->raw_len, NULL);
+	}
+
+	return NULL;
+}
+
+/* Decompress the records' payload, on the context's threads. */
+static void decode_records(struct context *inc, size_t count)
+{
+	struct stf_decode_job job;
+	GThread **threads;
+	size_t i, started;
+
+	job.items = inc->decode_items;
+	job.count = count;
+	job.next_item = 0;
+
+	/* The calling thread decompresses too. */
+	threads = g_new0(GThread *, count);
+	for (started = 0; started + 1 < count; started++) {
+		threads[started] = g_thread_try_new("sr-stf-decode",
+			decode_thread, &job, NULL);
+		if (!threads[started])
+			break;
+	}
+	decode_thread(&job);
+	for (i = 0; i < started; i++)
+		g_thread_join(threads[i]);
+	g_free(threads);
+}
+
 /* Parse the "data" section of the file (sample data). */
 static int parse_file_data(struct sr_input *in)
 {
 	struct context *inc;
 	size_t len, final_len;
 	uint32_t crc, crc_calc;
-	size_t have_len, want_len;
-	const uint8_t *read_ptr;
-	void *compressed;
-	lzo_uint raw_len;
-	int rc;
+	size_t have_len, want_len, offset, count, idx;
+	const uint8_t *data, *read_ptr;
+	struct stf_decode_item *item;
+	gboolean last_seen;
+	int rc, batch_rc;
 
 	inc = in->priv;
 
@@ -1042,6 +1106,17 @@ static int parse_file_data(struct sr_input *in)
 	if (rc != SR_OK)
 		return rc;
 
+	if (!inc->decode_items) {
+		inc->records = g_try_malloc(inc->keep.threads *
+			sizeof(inc->records[0]));
+		if (!inc->records)
+			return SR_ERR_MALLOC;
+		inc->decode_items = g_malloc0(inc->keep.threads *
+			sizeof(inc->decode_items[0]));
+		for (idx = 0; idx < inc->keep.threads; idx++)
+			inc->decode_items[idx].rec = &inc->records[idx];
+	}
+
 	/*
 	 * Make sure enough receive data is available for the
 	 * interpretation of the record header, and for the record's
@@ -1057,73 +1132,94 @@ static int parse_file_data(struct sr_input *in)
 	 * current read position when input data is incomplete.
 	 */
 	final_len = (uint32_t)~0ul;
-	while (in->buf->len) {
+	while (sr_input_buf_len(in)) {
 		/*
-		 * Wait for record data to become available. Check for
-		 * the availability of a header, get the payload size
-		 * from the header, check for the data's availability.
-		 * Check the CRC of the (compressed) payload data.
+		 * Get up to one record per thread which is complete in
+		 * the receive buffer. Check for the availability of a
+		 * header, get the payload size from the header, check
+		 * for the data's availability. Check the CRC of the
+		 * (compressed) payload data. A record with an error ends
+		 * the batch, the records before it get processed first.
 		 */
-		have_len = in->buf->len;
-		if (have_len < STF_DATA_REC_HDRLEN) {
-			sr_dbg("Data: Need more receive data (header).");
-			return SR_OK;
-		}
-		read_ptr = (const uint8_t *)in->buf->str;
-		len = read_u32le_inc(&read_ptr);
-		crc = read_u32le_inc(&read_ptr);
-		if (len == final_len && !crc) {
-			sr_dbg("Data: Last record seen.");
-			g_string_erase(in->buf, 0, STF_DATA_REC_HDRLEN);
-			inc->file_stage = STF_STAGE_DONE;
-			return SR_OK;
-		}
-		sr_dbg("Data: Record header, len %zu, crc 0x%08lx.",
-			len, (unsigned long)crc);
-		if (len > STF_DATA_REC_PLMAX) {
-			sr_err("Data: Illegal record length %zu.", len);
-			return SR_ERR_DATA;
-		}
-		inc->record_data.len = len;
-		inc->record_data.crc = crc;
-		want_len = inc->record_data.len;
-		if (have_len < STF_DATA_REC_HDRLEN + want_len) {
-			sr_dbg("Data: Need more receive data (payload).");
-			return SR_OK;
-		}
-		crc_calc = crc32(0, read_ptr, want_len);
-		sr_spew("DBG: CRC32 calc comp 0x%08lx.",
-			(unsigned long)crc_calc);
-		if (crc_calc != inc->record_data.crc) {
-			sr_err("Data: Record payload CRC mismatch.");
-			return SR_ERR_DATA;
+		data = (const uint8_t *)sr_input_buf_data(in);
+		have_len = sr_input_buf_len(in);
+		offset = 0;
+		count = 0;
+		last_seen = FALSE;
+		batch_rc = SR_OK;
+		while (count < inc->keep.threads) {
+			if (have_len - offset < STF_DATA_REC_HDRLEN) {
+				sr_dbg("Data: Need more receive data (header).");
+				break;
+			}
+			read_ptr = &data[offset];
+			len = read_u32le_inc(&read_ptr);
+			crc = read_u32le_inc(&read_ptr);
+			if (len == final_len && !crc) {
+				sr_dbg("Data: Last record seen.");
+				last_seen = TRUE;
+				break;
+			}
+			sr_dbg("Data: Record header, len %zu, crc 0x%08lx.",
+				len, (unsigned long)crc);
+			if (len > STF_DATA_REC_PLMAX) {
+				sr_err("Data: Illegal record length %zu.", len);
+				batch_rc = SR_ERR_DATA;
+				break;
+			}
+			want_len = len;
+			if (have_len - offset < STF_DATA_REC_HDRLEN + want_len) {
+				sr_dbg("Data: Need more receive data (payload).");
+				break;
+			}
+			crc_calc = crc32(0, read_ptr, want_len);
+			sr_spew("DBG: CRC32 calc comp 0x%08lx.",
+				(unsigned long)crc_calc);
+			if (crc_calc != crc) {
+				sr_err("Data: Record payload CRC mismatch.");
+				batch_rc = SR_ERR_DATA;
+				break;
+			}
+			item = &inc->decode_items[count++];
+			item->compressed = read_ptr;
+			item->comp_len = want_len;
+			offset += STF_DATA_REC_HDRLEN + want_len;
 		}
 
 		/*
-		 * Uncompress the payload data, have the record processed.
+		 * Uncompress the payload data, have the records processed.
 		 * Drop the compressed receive data from the input buffer.
 		 */
-		compressed = (void *)read_ptr;
-		raw_len = sizeof(inc->record_data.raw);
-		memset(&inc->record_data.raw, 0, sizeof(inc->record_data.raw));
-		rc = lzo1x_decompress_safe(compressed, want_len,
-			inc->record_data.raw, &raw_len, NULL);
-		g_string_erase(in->buf, 0, STF_DATA_REC_HDRLEN + want_len);
-		if (rc) {
-			sr_err("Data: Decompression error %d.", rc);
-			return SR_ERR_DATA;
+		if (count)
+			decode_records(inc, count);
+		for (idx = 0; idx < count; idx++) {
+			item = &inc->decode_items[idx];
+			sr_input_buf_consume(in, STF_DATA_REC_HDRLEN + item->comp_len);
+			if (item->rc) {
+				sr_err("Data: Decompression error %d.", item->rc);
+				return SR_ERR_DATA;
+			}
+			if (item->raw_len > sizeof(item->rec->raw)) {
+				sr_err("Data: Excessive decompressed size %zu.",
+					(size_t)item->raw_len);
+				return SR_ERR_DATA;
+			}
+			item->rec->len = item->raw_len;
+			sr_spew("Data: Uncompressed record, len %zu.",
+				item->rec->len);
+			rc = stf_parse_data_record(in, item->rec);
+			if (rc != SR_OK)
+				return rc;
 		}
-		if (raw_len > sizeof(inc->record_data.raw)) {
-			sr_err("Data: Excessive decompressed size %zu.",
-				(size_t)raw_len);
-			return SR_ERR_DATA;
+		if (batch_rc != SR_OK)
+			return batch_rc;
+		if (last_seen) {
+			sr_input_buf_consume(in, STF_DATA_REC_HDRLEN);
+			inc->file_stage = STF_STAGE_DONE;
+			return SR_OK;
 		}
-		inc->record_data.len = raw_len;
-		sr_spew("Data: Uncompressed record, len %zu.",
-			inc->record_data.len);
-		rc = stf_parse_data_record(in, &inc->record_data);
-		if (rc != SR_OK)
-			return rc;
+		if (count < inc->keep.threads)
+			return SR_OK;
 	}
 	return SR_OK;
 }
@@ -1260,6 +1356,15 @@ static int init(struct sr_input *in, GHashTable *options)
 	var = g_hash_table_lookup(options, "samplerate");
 	sample_rate = g_variant_get_uint64(var);
 	inc->keep.sample_rate = sample_rate;
+	var = g_hash_table_lookup(options, "threads");
+	inc->keep.threads = g_variant_get_uint32(var);
+	if (!inc->keep.threads) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		inc->keep.threads = g_get_num_processors();
+#else
+		inc->keep.threads = 1;
+#endif
+	}
 
 	return SR_OK;
 }
@@ -1274,7 +1379,7 @@ static int receive(struct sr_input *in, GString *buf)
 	 * with end(), to make sure pending data gets processed, even
 	 * when receive() is only invoked exactly once for short input.
 	 */
-	g_string_append_len(in->buf, buf->str, buf->len);
+	sr_input_buf_append(in, buf->str, buf->len);
 	return process_data(in);
 }
 
@@ -1311,6 +1416,10 @@ static void cleanup(struct sr_input *in)
 	g_slist_free_full(inc->channels, free_channel);
 	feed_queue_logic_free(inc->submit.feed);
 	inc->submit.feed = NULL;
+	g_free(inc->records);
+	inc->records = NULL;
+	g_free(inc->decode_items);
+	inc->decode_items = NULL;
 	g_strfreev(inc->header.sigma_clksrc);
 	inc->header.sigma_clksrc = NULL;
 	g_strfreev(inc->header.sigma_inputs);
@@ -1337,6 +1446,7 @@ static int reset(struct sr_input *in)
 
 enum option_index {
 	OPT_SAMPLERATE,
+	OPT_THREADS,
 	OPT_MAX,
 };
 
@@ -1346,6 +1456,11 @@ static struct sr_option options[] = {
 		"The input data's sample rate in Hz. No default value.",
 		NULL, NULL,
 	},
+	[OPT_THREADS] = {
+		"threads", "Decompression threads",
+		"Number of threads which decompress data records, 0 for one per processor (default: 0).",
+		NULL, NULL,
+	},
 	ALL_ZERO,
 };
 
@@ -1356,6 +1471,8 @@ static const struct sr_option *get_options(void)
 	if (!options[0].def) {
 		var = g_variant_new_uint64(0);
 		options[OPT_SAMPLERATE].def = g_variant_ref_sink(var);
+		var = g_variant_new_uint32(0);
+		options[OPT_THREADS].def = g_variant_ref_sink(var);
 	}
 
 	return options;
@@ -100,7 +100,13 @@ struct context {
 	int32_t last_record;
 	uint64_t samplerate;
 	double timestamp_scale;
-	GString *out_buf;
+	size_t unitsize;
+	struct feed_queue_logic *feed;
+	/* Decoded sample values and repeat counts of a block of records. */
+	size_t stage_alloc;
+	uint8_t *stage;
+	uint64_t *timestamps;
+	uint64_t *repeats;
 };
 
 static int process_header(GString *buf, struct context *inc);
@@ -182,7 +188,7 @@ static int init(struct sr_input *in, GHashTable *options)
 		return SR_ERR;
 	}
 
-	inc->out_buf = g_string_sized_new(CHUNK_SIZE);
+	inc->unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
 
 	return SR_OK;
 }
@@ -415,38 +421,63 @@ static void send_metadata(struct sr_input *in)
 	inc->meta_sent = TRUE;
 }
 
-static void flush_output_buffer(struct sr_input *in)
+static int create_feed(struct sr_input *in)
 {
 	struct context *inc;
-	struct sr_datafeed_packet packet;
-	struct sr_datafeed_logic logic;
 
 	inc = in->priv;
+	if (inc->feed)
+		return SR_OK;
 
-	if (inc->out_buf->len) {
-		packet.type = SR_DF_LOGIC;
-		packet.payload = &logic;
-		logic.unitsize = (g_slist_length(in->sdi->channels) + 7) / 8;
-		logic.data = inc->out_buf->str;
-		logic.length = inc->out_buf->len;
-		sr_session_send(in->sdi, &packet);
+	inc->feed = feed_queue_logic_alloc(in->sdi,
+		CHUNK_SIZE / inc->unitsize, inc->unitsize);
+	if (!inc->feed)
+		return SR_ERR_MALLOC;
+	/* Gaps between records are long runs of one value. */
+	return feed_queue_logic_rle(inc->feed,
+		sr_session_takes_logic_rle(in->sdi->session));
+}
 
-		g_string_truncate(inc->out_buf, 0);
-	}
+/* Have room in the staging arrays for a block of records. */
+static void alloc_stage(struct context *inc, size_t count)
+{
+	if (count <= inc->stage_alloc)
+		return;
+
+	g_free(inc->stage);
+	g_free(inc->timestamps);
+	g_free(inc->repeats);
+	inc->stage = g_malloc0(count * inc->unitsize);
+	inc->timestamps = g_malloc((count + 1) * sizeof(inc->timestamps[0]));
+	inc->repeats = g_malloc(count * sizeof(inc->repeats[0]));
+	inc->stage_alloc = count;
 }
 
-static void process_record_pi(struct sr_input *in, gsize start)
+static void free_stage(struct context *inc)
+{
+	g_free(inc->stage);
+	g_free(inc->timestamps);
+	g_free(inc->repeats);
+	inc->stage = NULL;
+	inc->timestamps = NULL;
+	inc->repeats = NULL;
+	inc->stage_alloc = 0;
+}
+
+static int decode_records_pi(struct sr_input *in,
+	const uint8_t *buf, size_t count)
 {
 	struct context *inc;
-	uint64_t timestamp, next_timestamp;
+	size_t data_offset[MAX_POD_COUNT], clk_offset[MAX_POD_COUNT];
+	int clk_bit[MAX_POD_COUNT];
+	const uint8_t *rec;
+	uint8_t *out;
+	uint64_t acc;
 	uint32_t pod_data;
-	char single_payload[12 * 3];
-	GString *buf;
-	int i, pod_count, clk_offset, packet_count, pod;
-	int payload_bit, payload_len, value;
+	size_t r, pod_clk_offset, payload_len;
+	int pod, pod_count, enabled, p, bits;
 
 	inc = in->priv;
-	buf = in->buf;
 
 	/*
 	 * 0x00 u8  timestamp
@@ -471,135 +502,69 @@ static void process_record_pi(struct sr_input *in, gsize start)
 	 * 0x2C/1B u8 ??
 	 */
 
-	timestamp = RL64(buf->str + start);
-
 	if (inc->record_mode == AD_MODE_500MHZ) {
 		pod_count = 6;
-		clk_offset = 0x18;
+		pod_clk_offset = 0x18;
 	} else {
 		pod_count = 12;
-		clk_offset = 0x28;
+		pod_clk_offset = 0x28;
 	}
 
-	payload_bit = 0;
-	payload_len = 0;
-	single_payload[0] = 0;
-
+	/* Look up where each enabled pod's data is once per block. */
+	enabled = 0;
 	for (pod = 0; pod < pod_count; pod++) {
 		if (!inc->pod_status[pod])
 			continue;
-
-		switch (pod) {
-		case 0: /* A */
-			pod_data = RL16(buf->str + start + 0x08);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 1) << 16;
-			break;
-		case 1: /* B */
-			pod_data = RL16(buf->str + start + 0x0A);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 2) << 15;
-			break;
-		case 2: /* C */
-			pod_data = RL16(buf->str + start + 0x0C);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 4) << 14;
-			break;
-		case 3: /* D */
-			pod_data = RL16(buf->str + start + 0x0E);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 8) << 13;
-			break;
-		case 4: /* E */
-			pod_data = RL16(buf->str + start + 0x10);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 16) << 12;
-			break;
-		case 5: /* F */
-			pod_data = RL16(buf->str + start + 0x12);
-			pod_data |= (RL16(buf->str + start + clk_offset) & 32) << 11;
-			break;
-		case 6: /* J */
-			pod_data = RL16(buf->str + start + 0x18);
-			pod_data |= (RL16(buf->str + start + 0x29) & 1) << 16;
-			break;
-		case 7: /* K */
-			pod_data = RL16(buf->str + start + 0x1A);
-			pod_data |= (RL16(buf->str + start + 0x29) & 2) << 15;
-			break;
-		case 8: /* L */
-			pod_data = RL16(buf->str + start + 0x1C);
-			pod_data |= (RL16(buf->str + start + 0x29) & 4) << 14;
-			break;
-		case 9: /* M */
-			pod_data = RL16(buf->str + start + 0x1E);
-			pod_data |= (RL16(buf->str + start + 0x29) & 8) << 13;
-			break;
-		case 10: /* N */
-			pod_data = RL16(buf->str + start + 0x20);
-			pod_data |= (RL16(buf->str + start + 0x29) & 16) << 12;
-			break;
-		case 11: /* O */
-			pod_data = RL16(buf->str + start + 0x22);
-			pod_data |= (RL16(buf->str + start + 0x29) & 32) << 11;
-			break;
-		default:
-			pod_data = 0;
-			sr_err("Don't know how to obtain data for pod %d.", pod);
-		}
-
-		for (i = 0; i < 17; i++) {
-			value = (pod_data >> i) & 1;
-			single_payload[payload_len] |= value << payload_bit;
-
-			payload_bit++;
-			if (payload_bit > 7) {
-				payload_bit = 0;
-				payload_len++;
-				single_payload[payload_len] = 0;
-			}
+		if (pod < 6) {
+			data_offset[enabled] = 0x08 + 2 * pod;
+			clk_offset[enabled] = pod_clk_offset;
+			clk_bit[enabled] = pod;
+		} else {
+			data_offset[enabled] = 0x18 + 2 * (pod - 6);
+			clk_offset[enabled] = 0x29;
+			clk_bit[enabled] = pod - 6;
 		}
+		enabled++;
 	}
 
-	/* Make sure that payload_len accounts for any incomplete bytes used. */
-	if (payload_bit)
-		payload_len++;
-
-	i = (g_slist_length(in->sdi->channels) + 7) / 8;
-	if (payload_len != i) {
-		sr_err("Payload unit size is %d but should be %d!", payload_len, i);
-		return;
-	}
-
-	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
-		sr_dbg("Trigger @%lf s, record #%d.",
-			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
-		std_session_send_df_trigger(in->sdi);
-		inc->trigger_sent = TRUE;
+	payload_len = (enabled * 17 + 7) / 8;
+	if (payload_len != inc->unitsize) {
+		sr_err("Payload unit size is %zu but should be %zu!",
+			payload_len, inc->unitsize);
+		return SR_ERR_DATA;
 	}
 
-	/* Is this the last record in the file? */
-	if (inc->cur_record == inc->record_count - 1) {
-		/* It is, so send the last sample data only once. */
-		g_string_append_len(inc->out_buf, single_payload, payload_len);
-	} else {
-		/* It's not, so fill the time gap by sending lots of data. */
-		next_timestamp = RL64(buf->str + start + inc->record_size);
-		packet_count = (int)(next_timestamp - timestamp) / inc->timestamp_scale;
-
-		/* Make sure we send at least one data set. */
-		if (packet_count == 0)
-			packet_count = 1;
-
-		for (i = 0; i < packet_count; i++)
-			g_string_append_len(inc->out_buf, single_payload, payload_len);
+	/* Each pod takes 17 bits, 16 data bits and its clock. */
+	for (r = 0; r < count; r++) {
+		rec = &buf[r * inc->record_size];
+		out = &inc->stage[r * inc->unitsize];
+		acc = 0;
+		bits = 0;
+		for (p = 0; p < enabled; p++) {
+			pod_data = RL16(rec + data_offset[p]);
+			pod_data |= ((R8(rec + clk_offset[p]) >> clk_bit[p]) & 1) << 16;
+			acc |= (uint64_t)pod_data << bits;
+			bits += 17;
+			while (bits >= 8) {
+				*out++ = acc & 0xff;
+				acc >>= 8;
+				bits -= 8;
+			}
+		}
+		if (bits)
+			*out = acc & 0xff;
 	}
 
-	if (inc->out_buf->len >= CHUNK_SIZE)
-		flush_output_buffer(in);
+	return SR_OK;
 }
 
-static void process_record_iprobe(struct sr_input *in, gsize start)
+static int decode_records_iprobe(struct sr_input *in,
+	const uint8_t *buf, size_t count)
 {
 	struct context *inc;
-	uint64_t timestamp, next_timestamp;
-	char single_payload[3];
-	int i, payload_len, packet_count;
+	const uint8_t *rec;
+	uint8_t *out;
+	size_t r;
 
 	inc = in->priv;
 
@@ -609,38 +574,127 @@ static void process_record_iprobe(struct sr_input *in, gsize start)
 	 * 0x0A u8  CLK
 	 */
 
-	timestamp = RL64(in->buf->str + start);
-	single_payload[0] = R8(in->buf->str + start + 0x08);
-	single_payload[1] = R8(in->buf->str + start + 0x09);
-	single_payload[2] = R8(in->buf->str + start + 0x0A) & 1;
-	payload_len = 3;
-
-	if (timestamp == inc->trigger_timestamp && !inc->trigger_sent) {
-		sr_dbg("Trigger @%lf s, record #%d.",
-			timestamp * TIMESTAMP_RESOLUTION, inc->cur_record);
-		std_session_send_df_trigger(in->sdi);
-		inc->trigger_sent = TRUE;
+	if (inc->unitsize < 3) {
+		sr_err("Payload unit size is 3 but should be %zu!",
+			inc->unitsize);
+		return SR_ERR_DATA;
 	}
 
-	/* Is this the last record in the file? */
-	if (inc->cur_record == inc->record_count - 1) {
-		/* It is, so send the last sample data only once. */
-		g_string_append_len(inc->out_buf, single_payload, payload_len);
-	} else {
-		/* It's not, so fill the time gap by sending lots of data. */
-		next_timestamp = RL64(in->buf->str + start + inc->record_size);
-		packet_count = (int)(next_timestamp - timestamp) / inc->timestamp_scale;
+	for (r = 0; r < count; r++) {
+		rec = &buf[r * inc->record_size];
+		out = &inc->stage[r * inc->unitsize];
+		out[0] = R8(rec + 0x08);
+		out[1] = R8(rec + 0x09);
+		out[2] = R8(rec + 0x0A) & 1;
+	}
 
+	return SR_OK;
+}
+
+/*
+ * Determine how often each record's value repeats, from the gap to the
+ * next record's timestamp. The caller made sure that the record after
+ * the block can be peeked into, unless the block ends the file. The
+ * last record of the file is sent once.
+ */
+static void expand_timestamps(struct context *inc,
+	const uint8_t *buf, size_t count, gboolean last_in_file)
+{
+	uint64_t *ts, *repeats;
+	size_t r, stamps;
+
+	ts = inc->timestamps;
+	repeats = inc->repeats;
+	stamps = last_in_file ? count : count + 1;
+	for (r = 0; r < stamps; r++)
+		ts[r] = RL64(&buf[r * inc->record_size]);
+	if (last_in_file)
+		ts[count] = ts[count - 1];
+
+	for (r = 0; r < count; r++) {
+		if (ts[r + 1] > ts[r])
+			repeats[r] = (ts[r + 1] - ts[r]) / inc->timestamp_scale;
+		else
+			repeats[r] = 0;
+	}
+	for (r = 0; r < count; r++) {
 		/* Make sure we send at least one data set. */
-		if (packet_count == 0)
-			packet_count = 1;
+		if (!repeats[r])
+			repeats[r] = 1;
+	}
+}
+
+/* Send a decoded block of records, single samples in bulk. */
+static int send_records(struct sr_input *in, size_t count)
+{
+	struct context *inc;
+	size_t r, run_end;
+	int ret;
+
+	inc = in->priv;
+	r = 0;
+	while (r < count) {
+		if (!inc->trigger_sent &&
+				inc->timestamps[r] == inc->trigger_timestamp) {
+			sr_dbg("Trigger @%lf s, record #%zu.",
+				inc->timestamps[r] * TIMESTAMP_RESOLUTION,
+				inc->cur_record + r);
+			ret = feed_queue_logic_send_trigger(inc->feed);
+			if (ret != SR_OK)
+				return ret;
+			inc->trigger_sent = TRUE;
+		}
+		if (inc->repeats[r] > 1) {
+			ret = feed_queue_logic_submit_one(inc->feed,
+				&inc->stage[r * inc->unitsize], inc->repeats[r]);
+			if (ret != SR_OK)
+				return ret;
+			r++;
+			continue;
+		}
+		run_end = r + 1;
+		while (run_end < count && inc->repeats[run_end] == 1 &&
+				(inc->trigger_sent ||
+				inc->timestamps[run_end] != inc->trigger_timestamp))
+			run_end++;
+		ret = feed_queue_logic_submit_many(inc->feed,
+			&inc->stage[r * inc->unitsize], run_end - r);
+		if (ret != SR_OK)
+			return ret;
+		r = run_end;
+	}
+
+	return SR_OK;
+}
+
+static int process_records(struct sr_input *in, size_t count)
+{
+	struct context *inc;
+	const uint8_t *buf;
+	gboolean last_in_file;
+	int ret;
 
-		for (i = 0; i < packet_count; i++)
-			g_string_append_len(inc->out_buf, single_payload, payload_len);
+	inc = in->priv;
+	buf = (const uint8_t *)sr_input_buf_data(in);
+	last_in_file = inc->cur_record + count == inc->record_count;
+
+	alloc_stage(inc, count);
+	switch (inc->device) {
+	case AD_DEVICE_PI:
+		ret = decode_records_pi(in, buf, count);
+		break;
+	case AD_DEVICE_IPROBE:
+		ret = decode_records_iprobe(in, buf, count);
+		break;
+	default:
+		sr_err("Trying to process records for unknown device!");
+		return SR_ERR;
 	}
+	if (ret != SR_OK)
+		return ret;
+	expand_timestamps(inc, buf, count, last_in_file);
 
-	if (inc->out_buf->len >= CHUNK_SIZE)
-		flush_output_buffer(in);
+	return send_records(in, count);
 }
 
 static void process_practice_token(struct sr_input *in, char *cmd_token)
@@ -724,18 +778,21 @@ static void process_practice_token(struct sr_input *in, char *cmd_token)
 static void process_practice(struct sr_input *in)
 {
 	char delimiter[3];
-	char **tokens, *token;
+	char **tokens, *token, *data;
+	size_t len;
 	int i;
 
 	/* Gather all input data until we see the end marker. */
-	if (in->buf->str[in->buf->len - 1] != 0x29)
+	data = sr_input_buf_data(in);
+	len = sr_input_buf_len(in);
+	if (!len || data[len - 1] != 0x29)
 		return;
 
 	delimiter[0] = 0x0A;
 	delimiter[1] = ' ';
 	delimiter[2] = 0;
 
-	tokens = g_strsplit(in->buf->str, delimiter, 0);
+	tokens = g_strsplit(data, delimiter, 0);
 
 	/* Special case: first token contains the start marker, too. Skip it. */
 	token = tokens[0];
@@ -749,19 +806,20 @@ static void process_practice(struct sr_input *in)
 
 	g_strfreev(tokens);
 
-	g_string_erase(in->buf, 0, in->buf->len);
+	sr_input_buf_consume(in, len);
 }
 
 static int process_buffer(struct sr_input *in)
 {
 	struct context *inc;
-	int i, chunk_size, res;
+	size_t avail, remain, count;
+	int res;
 
 	inc = in->priv;
 
 	if (!inc->header_read) {
-		res = process_header(in->buf, inc);
-		g_string_erase(in->buf, 0, inc->header_size);
+		res = process_header(sr_input_buf_compact(in), inc);
+		sr_input_buf_consume(in, inc->header_size);
 		if (res != SR_OK)
 			return res;
 	}
@@ -772,31 +830,31 @@ static int process_buffer(struct sr_input *in)
 	}
 
 	if (!inc->records_read) {
-		/* Cut off at a multiple of the record size. */
-		chunk_size = ((in->buf->len) / inc->record_size) * inc->record_size;
-
-		/* There needs to be at least one more record process_record() can peek into. */
-		chunk_size -= inc->record_size;
-
-		for (i = 0; (i < chunk_size) && (!inc->records_read); i += inc->record_size) {
-			switch (inc->device) {
-			case AD_DEVICE_PI:
-				process_record_pi(in, i);
-				break;
-			case AD_DEVICE_IPROBE:
-				process_record_iprobe(in, i);
-				break;
-			default:
-				sr_err("Trying to process records for unknown device!");
-				return SR_ERR;
-			}
+		res = create_feed(in);
+		if (res != SR_OK)
+			return res;
 
-			inc->cur_record++;
+		/*
+		 * Take all complete records, except for one which the
+		 * last of them can peek into. The file's last record
+		 * needs no successor.
+		 */
+		avail = sr_input_buf_len(in) / inc->record_size;
+		remain = inc->record_count - inc->cur_record;
+		if (avail >= remain)
+			count = remain;
+		else
+			count = avail ? avail - 1 : 0;
+
+		if (count) {
+			res = process_records(in, count);
+			if (res != SR_OK)
+				return res;
+			inc->cur_record += count;
 			if (inc->cur_record == inc->record_count)
 				inc->records_read = TRUE;
+			sr_input_buf_consume(in, count * inc->record_size);
 		}
-
-		g_string_erase(in->buf, 0, i);
 	}
 
 	if (inc->records_read) {
@@ -809,7 +867,7 @@ static int process_buffer(struct sr_input *in)
 
 static int receive(struct sr_input *in, GString *buf)
 {
-	g_string_append_len(in->buf, buf->str, buf->len);
+	sr_input_buf_append(in, buf->str, buf->len);
 
 	if (!in->sdi_ready) {
 		/* sdi is ready, notify frontend. */
@@ -832,7 +890,8 @@ static int end(struct sr_input *in)
 	else
 		ret = SR_OK;
 
-	flush_output_buffer(in);
+	if (inc->feed)
+		feed_queue_logic_flush(inc->feed);
 
 	if (inc->meta_sent)
 		std_session_send_df_end(in->sdi);
@@ -850,11 +909,24 @@ static int reset(struct sr_input *in)
 	inc->trigger_sent = FALSE;
 	inc->cur_record = 0;
 
+	feed_queue_logic_free(inc->feed);
+	inc->feed = NULL;
+
 	g_string_truncate(in->buf, 0);
 
 	return SR_OK;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	feed_queue_logic_free(inc->feed);
+	inc->feed = NULL;
+	free_stage(inc);
+}
+
 static struct sr_option options[] = {
 	{ "podA", "Import pod A / iprobe",
 		"Create channels and data for pod A / iprobe", NULL, NULL },
@@ -908,5 +980,6 @@ SR_PRIV struct sr_input_module input_trace32_ad = {
 	.init = init,
 	.receive = receive,
 	.end = end,
+	.cleanup = cleanup,
 	.reset = reset,
 };
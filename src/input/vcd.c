@@ -123,6 +123,21 @@
 #define CHUNK_SIZE (4 * 1024 * 1024)
 #define SCOPE_SEP '.'
 
+/*
+ * VCD identifiers are made of printable ASCII characters. Those of one
+ * or two characters, which is what generators use for the first few
+ * thousand signals, index a table. Longer ones go to a hash table.
+ */
+#define ID_CHAR_FIRST '!'
+#define ID_CHAR_COUNT ('~' - '!' + 1)
+#define SHORT_ID_COUNT (ID_CHAR_COUNT + ID_CHAR_COUNT * ID_CHAR_COUNT)
+
+/* What a value change for a VCD identifier affects. */
+struct vcd_id {
+	GSList *channels; /* struct vcd_channel, in channel order */
+	gboolean ignored;
+};
+
 struct context {
 	struct vcd_user_opt {
 		size_t maxchannels; /* sigrok channels (output) */
@@ -143,6 +158,9 @@ struct context {
 	gboolean ignore_end_keyword;
 	gboolean skip_until_end;
 	GSList *channels;
+	struct vcd_id *short_ids;
+	GHashTable *long_ids;
+	GPtrArray *analog_channels;
 	size_t unit_size;
 	size_t logic_count;
 	size_t analog_count;
@@ -982,6 +1000,104 @@ static void create_feeds(const struct sr_input *in)
 	}
 }
 
+/* Get the table index of a short identifier, or -1 for other ones. */
+static gssize short_id_index(const char *id)
+{
+	size_t c0, c1;
+
+	c0 = (size_t)(uint8_t)id[0] - ID_CHAR_FIRST;
+	if (c0 >= ID_CHAR_COUNT)
+		return -1;
+	if (!id[1])
+		return c0;
+	c1 = (size_t)(uint8_t)id[1] - ID_CHAR_FIRST;
+	if (c1 >= ID_CHAR_COUNT || id[2])
+		return -1;
+
+	return ID_CHAR_COUNT + c0 * ID_CHAR_COUNT + c1;
+}
+
+static struct vcd_id *lookup_id(struct context *inc, const char *id,
+	gboolean create)
+{
+	gssize idx;
+	struct vcd_id *entry;
+
+	if (!inc->short_ids)
+		return NULL;
+
+	idx = short_id_index(id);
+	if (idx >= 0)
+		return &inc->short_ids[idx];
+
+	entry = g_hash_table_lookup(inc->long_ids, id);
+	if (!entry && create) {
+		entry = g_malloc0(sizeof(*entry));
+		g_hash_table_insert(inc->long_ids, g_strdup(id), entry);
+	}
+
+	return entry;
+}
+
+static void free_id(void *data)
+{
+	struct vcd_id *entry;
+
+	entry = data;
+	g_slist_free(entry->channels);
+	g_free(entry);
+}
+
+static void free_id_table(struct context *inc)
+{
+	size_t idx;
+
+	if (inc->short_ids) {
+		for (idx = 0; idx < SHORT_ID_COUNT; idx++)
+			g_slist_free(inc->short_ids[idx].channels);
+		g_free(inc->short_ids);
+		inc->short_ids = NULL;
+	}
+	if (inc->long_ids) {
+		g_hash_table_destroy(inc->long_ids);
+		inc->long_ids = NULL;
+	}
+	if (inc->analog_channels) {
+		g_ptr_array_free(inc->analog_channels, TRUE);
+		inc->analog_channels = NULL;
+	}
+}
+
+/*
+ * Map identifiers to the channels their value changes affect, so that
+ * the data section need not search the channel list for every change.
+ * Also collect the analog channels which have a feed.
+ */
+static void create_id_table(struct context *inc)
+{
+	GSList *l;
+	struct vcd_channel *vcd_ch;
+	struct vcd_id *entry;
+
+	free_id_table(inc);
+	inc->short_ids = g_new0(struct vcd_id, SHORT_ID_COUNT);
+	inc->long_ids = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, free_id);
+	inc->analog_channels = g_ptr_array_new();
+
+	for (l = inc->channels; l; l = l->next) {
+		vcd_ch = l->data;
+		entry = lookup_id(inc, vcd_ch->identifier, TRUE);
+		entry->channels = g_slist_append(entry->channels, vcd_ch);
+		if (vcd_ch->type == SR_CHANNEL_ANALOG && vcd_ch->feed_analog)
+			g_ptr_array_add(inc->analog_channels, vcd_ch);
+	}
+	for (l = inc->ignored_signals; l; l = l->next) {
+		entry = lookup_id(inc, l->data, TRUE);
+		entry->ignored = TRUE;
+	}
+}
+
 /*
  * Keep track of a previously created channel list, in preparation of
  * re-reading the input file. Gets called from reset()/cleanup() paths.
@@ -1108,6 +1224,7 @@ done_section:
 	if (!check_header_in_reread(in))
 		return SR_ERR_DATA;
 	create_feeds(in);
+	create_id_table(inc);
 
 	/*
 	 * Allocate space for text to number conversion, and buffers to
@@ -1154,7 +1271,7 @@ done_section:
 static void add_samples(const struct sr_input *in, size_t count, gboolean flush)
 {
 	struct context *inc;
-	GSList *ch_list;
+	size_t idx;
 	struct vcd_channel *vcd_ch;
 	struct feed_queue_analog *q;
 	float value;
@@ -1167,13 +1284,9 @@ static void add_samples(const struct sr_input *in, size_t count, gboolean flush)
 		if (flush)
 			feed_queue_logic_flush(inc->feed_logic);
 	}
-	for (ch_list = inc->channels; ch_list; ch_list = ch_list->next) {
-		vcd_ch = ch_list->data;
-		if (vcd_ch->type != SR_CHANNEL_ANALOG)
-			continue;
+	for (idx = 0; idx < inc->analog_channels->len; idx++) {
+		vcd_ch = g_ptr_array_index(inc->analog_channels, idx);
 		q = vcd_ch->feed_analog;
-		if (!q)
-			continue;
 		value = inc->current_floats[vcd_ch->array_index];
 		feed_queue_analog_submit_one(q, value, count);
 		if (flush)
@@ -1181,17 +1294,12 @@ static void add_samples(const struct sr_input *in, size_t count, gboolean flush)
 	}
 }
 
-static gint vcd_compare_id(gconstpointer a, gconstpointer b)
-{
-	return strcmp((const char *)a, (const char *)b);
-}
-
 static gboolean is_ignored(struct context *inc, const char *id)
 {
-	GSList *ignored;
+	struct vcd_id *entry;
 
-	ignored = g_slist_find_custom(inc->ignored_signals, id, vcd_compare_id);
-	return ignored != NULL;
+	entry = lookup_id(inc, id, FALSE);
+	return entry && entry->ignored;
 }
 
 /*
@@ -1230,6 +1338,7 @@ static void process_bits(struct context *inc, char *identifier,
 {
 	size_t size;
 	gboolean have_int;
+	struct vcd_id *entry;
 	GSList *l;
 	struct vcd_channel *vcd_ch;
 	float int_val;
@@ -1241,10 +1350,9 @@ static void process_bits(struct context *inc, char *identifier,
 	size = 0;
 	have_int = FALSE;
 	int_val = 0;
-	for (l = inc->channels; l; l = l->next) {
+	entry = lookup_id(inc, identifier, FALSE);
+	for (l = entry ? entry->channels : NULL; l; l = l->next) {
 		vcd_ch = l->data;
-		if (g_strcmp0(identifier, vcd_ch->identifier) != 0)
-			continue;
 		if (vcd_ch->type == SR_CHANNEL_ANALOG) {
 			/* Special case for 'integer' VCD signal types. */
 			size = vcd_ch->size; /* Flag for "VCD signal found". */
@@ -1300,7 +1408,7 @@ static void process_bits(struct context *inc, char *identifier,
 			}
 		}
 	}
-	if (!size && !is_ignored(inc, identifier))
+	if (!size && !(entry && entry->ignored))
 		sr_warn("VCD signal not found for ID '%s'.", identifier);
 }
 
@@ -1311,16 +1419,16 @@ static void process_bits(struct context *inc, char *identifier,
 static void process_real(struct context *inc, char *identifier, float real_val)
 {
 	gboolean found;
+	struct vcd_id *entry;
 	GSList *l;
 	struct vcd_channel *vcd_ch;
 
 	found = FALSE;
-	for (l = inc->channels; l; l = l->next) {
+	entry = lookup_id(inc, identifier, FALSE);
+	for (l = entry ? entry->channels : NULL; l; l = l->next) {
 		vcd_ch = l->data;
 		if (vcd_ch->type != SR_CHANNEL_ANALOG)
 			continue;
-		if (g_strcmp0(identifier, vcd_ch->identifier) != 0)
-			continue;
 
 		/* Found our (analog) channel. */
 		found = TRUE;
@@ -1328,7 +1436,7 @@ static void process_real(struct context *inc, char *identifier, float real_val)
 			identifier, vcd_ch->array_index, real_val);
 		inc->current_floats[vcd_ch->array_index] = real_val;
 	}
-	if (!found && !is_ignored(inc, identifier))
+	if (!found && !(entry && entry->ignored))
 		sr_warn("VCD signal not found for ID '%s'.", identifier);
 }
 
@@ -1869,7 +1977,7 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 	uint64_t samplerate;
 	GVariant *gvar;
 	int ret;
-	char *rdptr, *line;
+	char *rdptr, *rdend, *line;
 	size_t taken, rdlen;
 
 	inc = in->priv;
@@ -1896,14 +2004,15 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 	 * harmed by another empty line of input data.
 	 */
 	if (is_eof)
-		g_string_append_c(in->buf, '\n');
+		sr_input_buf_append(in, "\n", 1);
 
 	/* Find and process complete text lines in the input data. */
 	ret = SR_OK;
-	rdptr = in->buf->str;
+	rdptr = sr_input_buf_data(in);
+	rdend = rdptr + sr_input_buf_len(in);
 	taken = 0;
 	while (rdptr) {
-		rdlen = &in->buf->str[in->buf->len] - rdptr;
+		rdlen = rdend - rdptr;
 		line = sr_text_next_line(rdptr, rdlen, &rdptr, &taken);
 		if (!line)
 			break;
@@ -1913,7 +2022,7 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 		if (ret != SR_OK)
 			break;
 	}
-	g_string_erase(in->buf, 0, taken);
+	sr_input_buf_consume(in, taken);
 
 	return ret;
 }
@@ -1921,7 +2030,7 @@ static int process_buffer(struct sr_input *in, gboolean is_eof)
 static int format_match(GHashTable *metadata, unsigned int *confidence)
 {
 	GString *buf, *tmpbuf;
-	gboolean status;
+	gboolean status, need_more;
 	char *name, *contents;
 
 	buf = g_hash_table_lookup(metadata,
@@ -1934,10 +2043,19 @@ static int format_match(GHashTable *metadata, unsigned int *confidence)
 	 */
 	check_remove_bom(tmpbuf);
 	status = parse_section(tmpbuf, &name, &contents);
-	g_string_free(tmpbuf, TRUE);
 	g_free(name);
 	g_free(contents);
 
+	/* A section which started but did not end needs more data. */
+	need_more = FALSE;
+	if (!status) {
+		g_strchug(tmpbuf->str);
+		need_more = tmpbuf->str[0] == '$' && !strstr(tmpbuf->str, "$end");
+	}
+	g_string_free(tmpbuf, TRUE);
+
+	if (need_more)
+		return SR_ERR_NA;
 	if (!status)
 		return SR_ERR;
 
@@ -1998,13 +2116,13 @@ static int receive(struct sr_input *in, GString *buf)
 	inc = in->priv;
 
 	/* Collect all input chunks, potential deferred processing. */
-	g_string_append_len(in->buf, buf->str, buf->len);
-	if (!inc->got_header && in->buf->len == buf->len)
-		check_remove_bom(in->buf);
+	sr_input_buf_append(in, buf->str, buf->len);
+	if (!inc->got_header && sr_input_buf_len(in) == buf->len)
+		check_remove_bom(sr_input_buf_compact(in));
 
 	/* Must complete reception of the VCD header first. */
 	if (!inc->got_header) {
-		if (!have_header(in->buf))
+		if (!have_header(sr_input_buf_compact(in)))
 			return SR_OK;
 		ret = parse_header(in, in->buf);
 		if (ret != SR_OK)
@@ -2059,6 +2177,7 @@ static void cleanup(struct sr_input *in)
 
 	keep_header_for_reread(in);
 
+	free_id_table(inc);
 	g_slist_free_full(inc->channels, free_channel);
 	inc->channels = NULL;
 	feed_queue_logic_free(inc->feed_logic);
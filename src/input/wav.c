@@ -51,6 +51,7 @@ struct context {
 	int num_channels;
 	int unitsize;
 	gboolean found_data;
+	float *fdata;
 	GSList *prev_sr_channels;
 };
 
@@ -184,7 +185,40 @@ static int find_data_chunk(GString *buf, int initial_offset)
 	return offset;
 }
 
-static void send_chunk(const struct sr_input *in, int offset, int num_samples)
+/*
+ * Convert samples to float. Each format has a loop of its own, which
+ * compilers can vectorize.
+ */
+static void convert_samples(const struct context *inc,
+	const uint8_t *s, float *fdata, size_t count)
+{
+	size_t i;
+
+	if (inc->fmt_code != WAVE_FORMAT_PCM_) {
+		/* BINARY32 float */
+		for (i = 0; i < count; i++)
+			fdata[i] = read_fltle(&s[i * sizeof(float)]);
+		return;
+	}
+
+	switch (inc->unitsize) {
+	case 1:
+		/* 8-bit PCM samples are unsigned. */
+		for (i = 0; i < count; i++)
+			fdata[i] = read_u8(&s[i]) / (float)255;
+		break;
+	case 2:
+		for (i = 0; i < count; i++)
+			fdata[i] = read_i16le(&s[i * 2]) / (float)INT16_MAX;
+		break;
+	case 4:
+		for (i = 0; i < count; i++)
+			fdata[i] = read_i32le(&s[i * 4]) / (float)INT32_MAX;
+		break;
+	}
+}
+
+static int send_chunk(const struct sr_input *in, int offset, int num_samples)
 {
 	struct sr_datafeed_packet packet;
 	struct sr_datafeed_analog analog;
@@ -192,64 +226,40 @@ static void send_chunk(const struct sr_input *in, int offset, int num_samples)
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
 	struct context *inc;
-	float *fdata;
-	int total_samples, samplenum;
-	char *s, *d;
+	size_t total_samples;
 
 	inc = in->priv;
 
-	total_samples = num_samples * inc->num_channels;
-	fdata = g_malloc0(total_samples * sizeof(float));
-	s = in->buf->str + offset;
-	d = (char *)fdata;
-
-	for (samplenum = 0; samplenum < total_samples; samplenum++) {
-		if (inc->fmt_code == WAVE_FORMAT_PCM_) {
-			switch (inc->unitsize) {
-			case 1:
-				/* 8-bit PCM samples are unsigned. */
-				fdata[samplenum] = *(uint8_t*)(s) / (float)255;
-				break;
-			case 2:
-				fdata[samplenum] = RL16S(s) / (float)INT16_MAX;
-				break;
-			case 4:
-				fdata[samplenum] = RL32S(s) / (float)INT32_MAX;
-				break;
-			}
-		} else {
-			/* BINARY32 float */
-#ifdef WORDS_BIGENDIAN
-			int i;
-			for (i = 0; i < inc->unitsize; i++)
-				d[i] = s[inc->unitsize - 1 - i];
-#else
-			memcpy(d, s, inc->unitsize);
-#endif
-		}
-		s += inc->unitsize;
-		d += inc->unitsize;
+	/* Keep one buffer for the largest chunk. */
+	if (!inc->fdata) {
+		inc->fdata = g_try_malloc(CHUNK_SIZE / inc->samplesize *
+			inc->num_channels * sizeof(float));
+		if (!inc->fdata)
+			return SR_ERR_MALLOC;
 	}
+	total_samples = num_samples * inc->num_channels;
+	convert_samples(inc, (const uint8_t *)in->buf->str + offset,
+		inc->fdata, total_samples);
 
 	/* TODO: Use proper 'digits' value for this device (and its modes). */
 	sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
 	packet.type = SR_DF_ANALOG;
 	packet.payload = &analog;
 	analog.num_samples = num_samples;
-	analog.data = fdata;
+	analog.data = inc->fdata;
 	analog.meaning->channels = in->sdi->channels;
 	analog.meaning->mq = 0;
 	analog.meaning->mqflags = 0;
 	analog.meaning->unit = 0;
-	sr_session_send(in->sdi, &packet);
-	g_free(fdata);
+
+	return sr_session_send(in->sdi, &packet);
 }
 
 static int process_buffer(struct sr_input *in)
 {
 	struct context *inc;
 	int offset, chunk_samples, total_samples, processed, max_chunk_samples;
-	int num_samples, i;
+	int num_samples, i, ret;
 
 	inc = in->priv;
 	if (!inc->started) {
@@ -283,7 +293,9 @@ static int process_buffer(struct sr_input *in)
 			num_samples = max_chunk_samples;
 		else
 			num_samples = chunk_samples;
-		send_chunk(in, offset, num_samples);
+		ret = send_chunk(in, offset, num_samples);
+		if (ret != SR_OK)
+			return ret;
 		offset += num_samples * inc->samplesize;
 		chunk_samples -= num_samples;
 		processed += num_samples;
@@ -397,11 +409,21 @@ static int end(struct sr_input *in)
 	return ret;
 }
 
+static void cleanup(struct sr_input *in)
+{
+	struct context *inc;
+
+	inc = in->priv;
+	g_free(inc->fdata);
+	inc->fdata = NULL;
+}
+
 static int reset(struct sr_input *in)
 {
 	struct context *inc;
 
 	inc = in->priv;
+	g_free(inc->fdata);
 	memset(inc, 0, sizeof(*inc));
 
 	/*
@@ -427,5 +449,6 @@ SR_PRIV struct sr_input_module input_wav = {
 	.init = init,
 	.receive = receive,
 	.end = end,
+	.cleanup = cleanup,
 	.reset = reset,
 };
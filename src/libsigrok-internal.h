@@ -59,6 +59,26 @@ struct zip_stat;
 #define ARRAY_AND_SIZE(a) (a), ARRAY_SIZE(a)
 #endif
 
+/*
+ * Static tracepoints in the "libsigrok" provider, see HACKING. They
+ * compile to nothing unless configured with --enable-tracepoints.
+ */
+#ifdef HAVE_TRACEPOINTS
+#include <sys/sdt.h>
+#define SR_TRACE0(name) DTRACE_PROBE(libsigrok, name)
+#define SR_TRACE1(name, a) DTRACE_PROBE1(libsigrok, name, a)
+#define SR_TRACE2(name, a, b) DTRACE_PROBE2(libsigrok, name, a, b)
+#define SR_TRACE3(name, a, b, c) DTRACE_PROBE3(libsigrok, name, a, b, c)
+#define SR_TRACE4(name, a, b, c, d) \
+	DTRACE_PROBE4(libsigrok, name, a, b, c, d)
+#else
+#define SR_TRACE0(name) do { } while (0)
+#define SR_TRACE1(name, a) do { } while (0)
+#define SR_TRACE2(name, a, b) do { } while (0)
+#define SR_TRACE3(name, a, b, c) do { } while (0)
+#define SR_TRACE4(name, a, b, c, d) do { } while (0)
+#endif
+
 #ifndef G_SOURCE_FUNC
 #define G_SOURCE_FUNC(f) ((GSourceFunc) (void (*)(void)) (f)) /* Since 2.58. */
 #endif
@@ -1208,11 +1228,29 @@ struct sr_context {
 	struct sr_dev_driver **driver_list;
 #ifdef HAVE_LIBUSB_1_0
 	libusb_context *libusb_ctx;
+	struct usb_event_thread *usb_thread;
+	struct usb_capture *usb_capture;
 #endif
 	sr_resource_open_callback resource_open_cb;
 	sr_resource_close_callback resource_close_cb;
 	sr_resource_read_callback resource_read_cb;
 	void *resource_cb_data;
+	/* Resources loaded by sr_resource_load_cached(), by type and name. */
+	GMutex resource_mutex;
+	GHashTable *resource_cache;
+	/* Started sr_log_async_start() for SIGROK_LOG_ASYNC. */
+	gboolean log_async;
+	/* Guards the fields below, used by sr_driver_scan_all(). */
+	GMutex scan_mutex;
+	GCond scan_cond;
+	int scans_running;
+	GHashTable *busy_resources;
+	/* Drivers which found nothing with these USB devices present. */
+	GHashTable *scan_idle;
+	char *scan_fingerprint;
+	/* Accounting of acquisition buffers, see sr_mem_reserve(). */
+	GMutex mem_mutex;
+	struct sr_mem_stats mem;
 };
 
 /** Input module metadata keys. */
@@ -1238,6 +1276,17 @@ struct sr_input {
 	struct sr_dev_inst *sdi;
 	gboolean sdi_ready;
 	void *priv;
+	/**
+	 * How much of buf was consumed but is not removed yet. Modules
+	 * access buf with the sr_input_buf_*() helpers.
+	 */
+	size_t buf_pos;
+	/** The file sent with sr_input_send_mapped(), or NULL. */
+	struct sr_buffer *mapping;
+	/** How much of the mapped file was consumed. */
+	size_t mapped_pos;
+	/** The compressed file sent with sr_input_send_mapped(), or NULL. */
+	struct sr_zreader *zreader;
 };
 
 /** Input (file) module driver. */
@@ -1370,6 +1419,22 @@ struct sr_input_module {
 	 * @retval other Negative error code.
 	 */
 	void (*cleanup) (struct sr_input *in);
+
+	/**
+	 * Process the file mapped by sr_input_send_mapped().
+	 *
+	 * The data is in->mapping, from in->mapped_pos on. Like receive(),
+	 * this returns the moment the device instance is ready. Otherwise
+	 * it consumes what it can, advancing in->mapped_pos, and may send
+	 * packets pointing into the mapping with sr_session_send_buffer().
+	 *
+	 * This function is optional. Without it, the mapped data is fed to
+	 * receive() in copied chunks.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code.
+	 */
+	int (*receive_mapped) (struct sr_input *in);
 };
 
 /** Output module instance. */
@@ -1478,6 +1543,25 @@ struct sr_output_module {
 	int (*receive) (const struct sr_output *o,
 			const struct sr_datafeed_packet *packet, GString **out);
 
+	/**
+	 * Optional variant of receive() which hands the output to a write
+	 * callback instead of returning a copy of it. The pieces may point
+	 * into the packet or into buffers of the module, and are only valid
+	 * during the call of the callback. A module needs at least one of
+	 * receive() and receive_iov(), the other is provided for it.
+	 *
+	 * @param o Pointer to the respective 'struct sr_output'.
+	 * @param packet The complete packet.
+	 * @param cb The callback to call with the output, if any.
+	 * @param cb_data Opaque pointer passed to the callback.
+	 *
+	 * @retval SR_OK Success
+	 * @retval other Negative error code, from the module or the callback.
+	 */
+	int (*receive_iov) (const struct sr_output *o,
+			const struct sr_datafeed_packet *packet,
+			sr_output_write_callback cb, void *cb_data);
+
 	/**
 	 * This function is called after the caller is finished using
 	 * the output module, and can be used to free any internal
@@ -1565,6 +1649,24 @@ struct sr_transform_module {
 			struct sr_datafeed_packet *packet_in,
 			struct sr_datafeed_packet **packet_out);
 
+	/**
+	 * Optional, for modules which change logic samples in place, each
+	 * sample on its own, and pass the packet on. Does for a part of
+	 * the samples of an SR_DF_LOGIC packet what receive() does for all
+	 * of them. When transforms next to each other all have this, the
+	 * session runs them one after the other on a small piece of the
+	 * samples, and then on the next one, so that the samples are only
+	 * walked once while they are in the cache. Otherwise receive()
+	 * gets the logic packets, and must do the same with them.
+	 *
+	 * @param t Pointer to the respective 'struct sr_transform'.
+	 * @param data The samples to change, a whole number of them.
+	 * @param length Size of the data in bytes.
+	 * @param unitsize Size of each sample in bytes, > 0.
+	 */
+	void (*logic_tile) (const struct sr_transform *t, uint8_t *data,
+			uint64_t length, uint16_t unitsize);
+
 	/**
 	 * This function is called after the caller is finished using
 	 * the transform module, and can be used to free any internal
@@ -1585,14 +1687,29 @@ struct sr_usb_dev_inst {
 	uint8_t address;
 	/** libusb device handle */
 	struct libusb_device_handle *devhdl;
+	/** Transfer buffers obtained from libusb_dev_mem_alloc() */
+	GHashTable *dev_mem;
 };
 #endif
 
 /** Raw TCP device instance. */
+/** Time to wait for TCP connections by default, in ms. */
+#define SR_TCP_CONNECT_TIMEOUT_MS 5000
+
+/** Socket options of TCP connections, see sr_tcp_parse_options(). */
+struct sr_tcp_options {
+	gboolean nodelay;	/**!< Send small writes right away */
+	gboolean keepalive;	/**!< Probe idle connections */
+	int rcvbuf;		/**!< Receive buffer size, 0 for the default */
+	int sndbuf;		/**!< Send buffer size, 0 for the default */
+	int connect_timeout_ms;	/**!< Connect timeout, 0 waits indefinitely */
+};
+
 struct sr_tcp_dev_inst {
 	char *host_addr;	/**!< IP address or host name */
 	char *tcp_port;		/**!< TCP port number/name */
 	int sock_fd;		/**!< TCP socket's file descriptor */
+	struct sr_tcp_options opts; /**!< Socket options for connecting */
 };
 
 struct sr_serial_dev_inst;
@@ -1602,6 +1719,20 @@ struct ser_hid_chip_functions;
 struct sr_bt_desc;
 typedef void (*serial_rx_chunk_callback)(struct sr_serial_dev_inst *serial,
 	void *cb_data, const void *buf, size_t count);
+/**
+ * Queue of data which a serial transport received in chunks. A ring
+ * buffer of fixed power of two size, its positions run freely and get
+ * masked upon access. See sr_ser_queue_rx_data() for what happens when
+ * it is full.
+ */
+struct sr_ser_rx_queue {
+	uint8_t *data;
+	size_t mask;
+	size_t head;
+	size_t tail;
+	gboolean overflow;
+};
+
 struct sr_serial_dev_inst {
 	/** Port name, e.g. '/dev/tty42'. */
 	char *port;
@@ -1614,7 +1745,9 @@ struct sr_serial_dev_inst {
 		int parity_bits;
 		int stop_bits;
 	} comm_params;
-	GString *rcv_buffer;
+	struct sr_ser_rx_queue *rcv_buffer;
+	/** Received data which was read ahead, and not taken yet. */
+	GString *rx_ahead;
 	serial_rx_chunk_callback rx_chunk_cb_func;
 	void *rx_chunk_cb_data;
 #ifdef HAVE_LIBSERIALPORT
@@ -1661,6 +1794,12 @@ struct sr_serial_dev_inst {
 	GSList *bt_source_args;
 #endif
 	struct sr_tcp_dev_inst *tcp_dev;
+	/** Request/response timing, see serial_get_latency(). */
+	struct {
+		gint64 write_time;
+		gint64 min_us, sum_us;
+		size_t count;
+	} latency;
 };
 #endif
 
@@ -1692,12 +1831,31 @@ struct drv_context {
 
 SR_PRIV int sr_log(int loglevel, const char *format, ...) ATTR_FMT_PRINTF(2, 3);
 
-/* Message logging helpers with subsystem-specific prefix string. */
-#define sr_spew(...)	sr_log(SR_LOG_SPEW, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_dbg(...)	sr_log(SR_LOG_DBG,  LOG_PREFIX ": " __VA_ARGS__)
-#define sr_info(...)	sr_log(SR_LOG_INFO, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_warn(...)	sr_log(SR_LOG_WARN, LOG_PREFIX ": " __VA_ARGS__)
-#define sr_err(...)	sr_log(SR_LOG_ERR,  LOG_PREFIX ": " __VA_ARGS__)
+SR_PRIV extern int sr_cur_loglevel;
+
+/*
+ * Most verbose loglevel that is compiled in at all. Building with e.g.
+ * -DSR_LOG_MAX_LEVEL=SR_LOG_INFO removes all debug and spew messages.
+ */
+#ifndef SR_LOG_MAX_LEVEL
+#define SR_LOG_MAX_LEVEL SR_LOG_SPEW
+#endif
+
+/* Whether messages of the given loglevel get output. */
+#define sr_log_enabled(loglevel) \
+	((loglevel) <= SR_LOG_MAX_LEVEL && (loglevel) <= sr_cur_loglevel)
+
+/*
+ * Message logging helpers with subsystem-specific prefix string.
+ * The arguments are not evaluated for messages that don't get output.
+ */
+#define sr_log_lvl(loglevel, ...) (sr_log_enabled(loglevel) ? \
+	sr_log((loglevel), LOG_PREFIX ": " __VA_ARGS__) : SR_OK)
+#define sr_spew(...)	sr_log_lvl(SR_LOG_SPEW, __VA_ARGS__)
+#define sr_dbg(...)	sr_log_lvl(SR_LOG_DBG,  __VA_ARGS__)
+#define sr_info(...)	sr_log_lvl(SR_LOG_INFO, __VA_ARGS__)
+#define sr_warn(...)	sr_log_lvl(SR_LOG_WARN, __VA_ARGS__)
+#define sr_err(...)	sr_log_lvl(SR_LOG_ERR,  __VA_ARGS__)
 
 /*--- device.c --------------------------------------------------------------*/
 
@@ -1722,6 +1880,34 @@ SR_PRIV void sr_channel_free(struct sr_channel *ch);
 SR_PRIV void sr_channel_free_cb(void *p);
 SR_PRIV struct sr_channel *sr_next_enabled_channel(const struct sr_dev_inst *sdi,
 		struct sr_channel *cur_channel);
+
+/** A device's channels as arrays, for per-packet lookups. */
+struct sr_channel_index {
+	/** All channels, in the order of sdi->channels. */
+	struct sr_channel **channels;
+	size_t num_channels;
+	/** Per position, the slot in logic[] or analog[], -1 if disabled. */
+	int *slots;
+	/** Channel to its position plus one. */
+	GHashTable *positions;
+	/** Number of enabled channels, of any type. */
+	size_t num_enabled;
+	/** The enabled logic channels. */
+	struct sr_channel **logic;
+	size_t num_logic;
+	/** The enabled analog channels. */
+	struct sr_channel **analog;
+	size_t num_analog;
+	/** Bits of the enabled logic channels, by channel index. */
+	uint64_t *logic_mask;
+	size_t logic_mask_words;
+};
+
+SR_PRIV const struct sr_channel_index *sr_dev_channel_index(
+		const struct sr_dev_inst *sdi);
+SR_PRIV void sr_dev_channel_index_invalidate(struct sr_dev_inst *sdi);
+SR_PRIV int sr_dev_channel_position(const struct sr_channel *ch);
+SR_PRIV int sr_dev_channel_slot(const struct sr_channel *ch);
 SR_PRIV gboolean sr_channels_differ(struct sr_channel *ch1, struct sr_channel *ch2);
 SR_PRIV gboolean sr_channel_lists_differ(GSList *l1, GSList *l2);
 
@@ -1758,10 +1944,16 @@ struct sr_dev_inst {
 	void *priv;
 	/** Session to which this device is currently assigned. */
 	struct sr_session *session;
+	/** Array based view of the channels, see sr_dev_channel_index(). */
+	struct sr_channel_index *channel_index;
+	/** Configuration change listeners, see sr_dev_config_listener_add(). */
+	GSList *config_listeners;
 };
 
 /* Generic device instances */
 SR_PRIV void sr_dev_inst_free(struct sr_dev_inst *sdi);
+SR_PRIV void sr_dev_config_changed(const struct sr_dev_inst *sdi,
+		const struct sr_channel_group *cg, uint32_t key, GVariant *data);
 
 #ifdef HAVE_LIBUSB_1_0
 /* USB-specific instances */
@@ -1810,7 +2002,9 @@ SR_PRIV void sr_usbtmc_dev_inst_free(struct sr_usbtmc_dev_inst *usbtmc);
 
 SR_PRIV const GVariantType *sr_variant_type_get(int datatype);
 SR_PRIV int sr_variant_type_check(uint32_t key, GVariant *data);
-SR_PRIV void sr_hw_cleanup_all(const struct sr_context *ctx);
+SR_PRIV void sr_hw_cleanup_all(struct sr_context *ctx);
+SR_PRIV void sr_resource_lock(struct sr_context *ctx, const char *name);
+SR_PRIV void sr_resource_unlock(struct sr_context *ctx, const char *name);
 SR_PRIV struct sr_config *sr_config_new(uint32_t key, GVariant *data);
 SR_PRIV void sr_config_free(struct sr_config *src);
 SR_PRIV int sr_dev_acquisition_start(struct sr_dev_inst *sdi);
@@ -1842,20 +2036,59 @@ struct sr_session {
 
 	/** Registered event sources for this session. */
 	GHashTable *event_sources;
+	/** Protects event_sources, which device threads change too. */
+	GRecMutex sources_mutex;
 	/** Session main loop. */
 	GMainLoop *main_loop;
 	/** ID of idle source for dispatching the session stop notification. */
 	unsigned int stop_check_id;
 	/** Whether the session has been started. */
 	gboolean running;
+	/** Asynchronous datafeed dispatch, NULL for synchronous. */
+	struct session_dispatch *dispatch;
+	/** Datafeed packet coalescing, NULL when disabled. */
+	struct session_coalesce *coalesce;
+	/** Performance counters, NULL when disabled. */
+	struct session_stats *stats;
+	/** Per-channel statistics, NULL when disabled. */
+	struct session_chanstats *chanstats;
+	/** Whether every device gets a thread of its own. */
+	gboolean threaded;
+	/** Per-device worker threads of the current run. */
+	GSList *workers;
+	/** Serializes sending packets, drivers may send from any thread. */
+	GRecMutex send_mutex;
+	/** Sample store, NULL when disabled. */
+	struct session_store *store;
+	/** Live overviews of the samples, NULL when disabled. */
+	struct session_overview *overview;
+	/** Frames of segmented acquisitions, NULL when none. */
+	struct session_frames *frames;
+	/** Schedulers of polled serial devices, one per main context. */
+	GSList *serial_pollers;
+	/** Driver hooks run right when a stop is requested. */
+	GSList *abort_hooks;
+	/** Protects abort_hooks. */
+	GMutex abort_mutex;
 };
 
+/*
+ * Run by sr_session_stop() on the calling thread, before the stop gets
+ * to the session thread. Must be thread safe, and only start the abort.
+ */
+typedef void (*sr_session_abort_hook)(const struct sr_dev_inst *sdi);
+
 SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
 		void *key, GSource *source);
 SR_PRIV int sr_session_source_remove_internal(struct sr_session *session,
 		void *key);
 SR_PRIV int sr_session_source_destroyed(struct sr_session *session,
 		void *key, GSource *source);
+SR_PRIV int sr_session_source_wake(struct sr_session *session, void *key);
+SR_PRIV int sr_session_abort_hook_add(struct sr_session *session,
+		const struct sr_dev_inst *sdi, sr_session_abort_hook hook);
+SR_PRIV void sr_session_abort_hook_remove(struct sr_session *session,
+		const struct sr_dev_inst *sdi);
 SR_PRIV int sr_session_fd_source_add(struct sr_session *session,
 		void *key, gintptr fd, int events, int timeout,
 		sr_receive_data_callback cb, void *cb_data);
@@ -1876,12 +2109,125 @@ SR_PRIV int sr_session_source_remove_channel(struct sr_session *session,
 
 SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
 		uint32_t key, GVariant *var);
+SR_PRIV gboolean sr_session_takes_logic_rle(const struct sr_session *session);
+SR_PRIV gboolean sr_session_takes_logic_planar(const struct sr_session *session);
+SR_PRIV gboolean sr_session_takes_logic_packed(const struct sr_session *session);
 SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet);
+SR_PRIV int sr_session_send_buffer(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, struct sr_buffer *buf);
+SR_PRIV int sr_session_send_after(const struct sr_transform *t,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV int sr_session_deliver(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV void sr_session_datafeed_dispatch(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, struct sr_buffer *buf);
+
+/*--- session_coalesce.c ----------------------------------------------------*/
+
+SR_PRIV int sr_session_coalesce_push(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV int sr_session_coalesce_start(struct sr_session *session);
+SR_PRIV void sr_session_coalesce_stop(struct sr_session *session);
+SR_PRIV void sr_session_coalesce_free(struct sr_session *session);
+
+/*--- session_stats.c -------------------------------------------------------*/
+
+SR_PRIV void sr_session_stats_packet(struct sr_session *session,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV void sr_session_stats_transform(struct sr_session *session,
+		unsigned int idx, int64_t us);
+SR_PRIV void sr_session_stats_callback(struct sr_session *session,
+		unsigned int idx, int64_t us);
+SR_PRIV void sr_session_stats_source(struct sr_session *session,
+		int64_t latency_us, int64_t dispatch_us);
+SR_PRIV void sr_session_stats_reset(struct sr_session *session);
+SR_PRIV void sr_session_stats_destroy(struct sr_session *session);
+
+/*--- session_chanstats.c --------------------------------------------------*/
+
+SR_PRIV void sr_session_chanstats_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV void sr_session_chanstats_reset(struct sr_session *session);
+SR_PRIV void sr_session_chanstats_destroy(struct sr_session *session);
+
+/*--- session_overview.c ---------------------------------------------------*/
+
+SR_PRIV void sr_session_overview_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV void sr_session_overview_reset(struct sr_session *session);
+SR_PRIV void sr_session_overview_free(struct sr_session *session);
+
+/*--- session_worker.c ------------------------------------------------------*/
+
+SR_PRIV GMainContext *sr_session_worker_context(struct sr_session *session);
+SR_PRIV int sr_session_worker_dev_start(struct sr_session *session,
+		struct sr_dev_inst *sdi);
+SR_PRIV int sr_session_workers_run(struct sr_session *session);
+SR_PRIV void sr_session_worker_dev_stop(struct sr_session *session,
+		struct sr_dev_inst *sdi);
+SR_PRIV void sr_session_workers_stop(struct sr_session *session);
+
+/*--- session_store.c -------------------------------------------------------*/
+
+SR_PRIV void sr_session_store_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet);
+SR_PRIV void sr_session_store_reset(struct sr_session *session);
+SR_PRIV void sr_session_store_free(struct sr_session *session);
+
+/*--- session_frames.c ------------------------------------------------------*/
+
+SR_PRIV int sr_session_frames_setup(const struct sr_dev_inst *sdi,
+		uint16_t unitsize, uint64_t frame_samples, uint64_t num_frames);
+SR_PRIV int sr_session_frame_append(const struct sr_dev_inst *sdi,
+		const void *data, uint64_t num_samples);
+SR_PRIV int sr_session_frame_trigger(const struct sr_dev_inst *sdi);
+SR_PRIV int sr_session_frame_end(const struct sr_dev_inst *sdi);
+SR_PRIV void sr_session_frames_reset(struct sr_session *session);
+SR_PRIV void sr_session_frames_free(struct sr_session *session);
+
+/*--- session_dispatch.c ----------------------------------------------------*/
+
+SR_PRIV int sr_session_dispatch_push(struct sr_session *session,
+		const struct sr_dev_inst *sdi, const struct sr_datafeed_packet *packet);
+SR_PRIV int sr_session_dispatch_start(struct sr_session *session);
+SR_PRIV void sr_session_dispatch_stop(struct sr_session *session);
+SR_PRIV void sr_session_dispatch_free(struct sr_session *session);
 SR_PRIV int sr_sessionfile_check(const char *filename);
 SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename,
 		struct sr_session **session);
 
+/*--- raw_capture.c ---------------------------------------------------------*/
+
+/* Size of the header, data starts there. Keeps O_DIRECT writes aligned. */
+#define SR_RAW_CAPTURE_HEADER_SIZE 4096
+
+enum sr_raw_capture_layout {
+	/* Each byte holds 8 / channels samples, the first in the low bits. */
+	SR_RAW_CAPTURE_PACKED,
+	/* Blocks of one word per channel, as described in transpose.h. */
+	SR_RAW_CAPTURE_PLANAR,
+};
+
+struct sr_raw_capture_info {
+	const char *model;
+	uint64_t samplerate;
+	unsigned int num_channels;
+	enum sr_raw_capture_layout layout;
+	/* SR_RAW_CAPTURE_PLANAR only. */
+	unsigned int word_bits;
+	gboolean msb_first;
+};
+
+struct sr_raw_capture;
+
+SR_PRIV int sr_raw_capture_open(struct sr_raw_capture **rc, const char *path,
+		const struct sr_raw_capture_info *info);
+SR_PRIV int sr_raw_capture_write(struct sr_raw_capture *rc,
+		const void *data, size_t len);
+SR_PRIV uint64_t sr_raw_capture_bytes(const struct sr_raw_capture *rc);
+SR_PRIV int sr_raw_capture_close(struct sr_raw_capture *rc);
+
 /*--- session_file.c --------------------------------------------------------*/
 
 #if !HAVE_ZIP_DISCARD
@@ -1890,8 +2236,49 @@ SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename,
 SR_PRIV void sr_zip_discard(struct zip *archive);
 #endif
 
+/* Name of the run-length encoding of logic chunks, and its header size. */
+#define SR_SESSIONFILE_RLE		"rle-1"
+#define SR_SESSIONFILE_RLE_HEADER	8
+
 SR_PRIV GKeyFile *sr_sessionfile_read_metadata(struct zip *archive,
 			const struct zip_stat *entry);
+SR_PRIV int sr_sessionfile_logic_rle(GKeyFile *kf, const char *devgroup,
+		gboolean *rle);
+SR_PRIV void sr_sessionfile_analog_encoding_set(GKeyFile *kf,
+		const char *devgroup, int ch_nr,
+		const struct sr_analog_encoding *enc);
+SR_PRIV int sr_sessionfile_analog_encoding(GKeyFile *kf,
+		const char *devgroup, int ch_nr, struct sr_analog_encoding *enc);
+SR_PRIV GHashTable *sr_sessionfile_entries(struct zip *archive);
+SR_PRIV gboolean sr_sessionfile_entry_find(GHashTable *entries,
+		const char *name, uint64_t *index);
+SR_PRIV int sr_sessionfile_version(struct zip *archive, uint64_t *version);
+SR_PRIV int sr_sessionfile_rle_decode(const uint8_t *src, uint64_t len,
+		unsigned int unitsize, uint8_t **samples, uint64_t *num_samples);
+
+/*--- input/input.c ---------------------------------------------------------*/
+
+SR_PRIV char *sr_input_buf_data(const struct sr_input *in);
+SR_PRIV size_t sr_input_buf_len(const struct sr_input *in);
+SR_PRIV void sr_input_buf_append(struct sr_input *in,
+		const char *data, size_t len);
+SR_PRIV void sr_input_buf_consume(struct sr_input *in, size_t len);
+SR_PRIV GString *sr_input_buf_compact(struct sr_input *in);
+
+/*--- input/decompress.c ----------------------------------------------------*/
+
+enum sr_zreader_format {
+	SR_ZREADER_PLAIN,
+	SR_ZREADER_GZIP,
+	SR_ZREADER_ZSTD,
+};
+
+struct sr_zreader;
+
+SR_PRIV int sr_zreader_open(FILE *file, struct sr_zreader **zr);
+SR_PRIV enum sr_zreader_format sr_zreader_format(const struct sr_zreader *zr);
+SR_PRIV gssize sr_zreader_read(struct sr_zreader *zr, void *buf, size_t len);
+SR_PRIV void sr_zreader_close(struct sr_zreader *zr);
 
 /*--- analog.c --------------------------------------------------------------*/
 
@@ -1900,6 +2287,12 @@ SR_PRIV int sr_analog_init(struct sr_datafeed_analog *analog,
                            struct sr_analog_meaning *meaning,
                            struct sr_analog_spec *spec,
                            int digits);
+SR_PRIV void sr_rational_from_double(struct sr_rational *r, double value);
+
+/*--- conversion.c ----------------------------------------------------------*/
+
+SR_PRIV size_t sr_logic_planar_data_size(const struct sr_datafeed_logic_planar *planar);
+SR_PRIV size_t sr_logic_packed_data_size(const struct sr_datafeed_logic_packed *packed);
 
 /*--- std.c -----------------------------------------------------------------*/
 
@@ -1991,6 +2384,16 @@ SR_PRIV gssize sr_resource_read(struct sr_context *ctx,
 SR_PRIV void *sr_resource_load(struct sr_context *ctx, int type,
 		const char *name, size_t *size, size_t max_size)
 		G_GNUC_MALLOC G_GNUC_WARN_UNUSED_RESULT;
+SR_PRIV GBytes *sr_resource_load_cached(struct sr_context *ctx, int type,
+		const char *name, size_t max_size) G_GNUC_WARN_UNUSED_RESULT;
+SR_PRIV void sr_resource_cache_clear(struct sr_context *ctx);
+
+/*--- ascii_float.c ---------------------------------------------------------*/
+
+SR_PRIV const char *sr_scan_decimal(const char *p, const char *end,
+		double *ret);
+SR_PRIV int sr_atof_ascii_list(const char *str, size_t len, char sep,
+	float *values, size_t max_count, size_t *count);
 
 /*--- strutil.c -------------------------------------------------------------*/
 
@@ -2010,19 +2413,100 @@ SR_PRIV int sr_count_digits(const char *str, int *digits);
 SR_PRIV GString *sr_hexdump_new(const uint8_t *data, const size_t len);
 SR_PRIV void sr_hexdump_free(GString *s);
 
+/*--- mem_budget.c ---------------------------------------------------------*/
+
+SR_PRIV int sr_mem_reserve(struct sr_context *ctx, uint64_t bytes,
+		const char *what);
+SR_PRIV void sr_mem_release(struct sr_context *ctx, uint64_t bytes);
+SR_PRIV uint64_t sr_mem_available(struct sr_context *ctx);
+SR_PRIV struct sr_context *sr_mem_context(const struct sr_dev_inst *sdi);
+
+/*--- trigger_compile.c ----------------------------------------------------*/
+
+#define HW_TRIGGER_MATCH(m)	(1U << (m))
+
+/* What a device's trigger hardware supports. */
+struct hw_trigger_caps {
+	int num_stages;
+	/* Channels with a trigger input, counting from index 0. */
+	int num_channels;
+	/* HW_TRIGGER_MATCH() of the supported SR_TRIGGER_* matches. */
+	uint32_t matches;
+	/* Edge matches per stage, 0 for any number. */
+	int max_edges;
+	gboolean repeat;
+	gboolean window;
+};
+
+/* A stage as mask, value and edge words, bit n for channel index n. */
+struct hw_trigger_stage {
+	uint64_t mask;
+	/* The level to match, or the level after the edge. */
+	uint64_t value;
+	/* Channels matching on an edge, any_edge of these on either. */
+	uint64_t edge;
+	uint64_t any_edge;
+	uint64_t repeat;
+	uint64_t window;
+	/* Whether the hardware can run this stage. */
+	gboolean offloaded;
+};
+
+struct hw_trigger {
+	int num_stages;
+	struct hw_trigger_stage *stages;
+	/*
+	 * Leading stages the hardware can run. When not all, drivers can
+	 * still arm the hardware on the first stage alone and have the
+	 * soft trigger check the whole trigger on the data from there on,
+	 * with soft_trigger_logic_span() samples of pre-trigger data.
+	 */
+	int num_offloaded;
+	gboolean complete;
+};
+
+SR_PRIV int hw_trigger_compile(const struct sr_trigger *trigger,
+	const struct hw_trigger_caps *caps, struct hw_trigger **hwt);
+SR_PRIV void hw_trigger_free(struct hw_trigger *hwt);
+SR_PRIV uint64_t hw_trigger_lut(uint64_t value, uint64_t mask,
+	unsigned int first, unsigned int width);
+
 /*--- soft-trigger.c --------------------------------------------------------*/
 
+struct soft_trigger_stage;
+
+typedef const uint8_t *(*soft_trigger_skip_func)(const uint8_t *p,
+		const uint8_t *end, int unitsize, uint64_t change_mask);
+
 struct soft_trigger_logic {
 	const struct sr_dev_inst *sdi;
 	const struct sr_trigger *trigger;
-	int count;
 	int unitsize;
 	int cur_stage;
+	/* Samples matched in a row, and waited for, on the current stage. */
+	uint64_t run;
+	uint64_t wait;
+	/* Sample where stage 0 last matched, relative to the buffer. */
+	int64_t stage0_end;
+	/* The trigger stages, compiled to masks of nwords words each. */
+	int num_stages;
+	int nwords;
+	struct soft_trigger_stage *stages;
+	uint64_t *stage_words;
+	/* Skips samples without edges, picked for the CPU. */
+	soft_trigger_skip_func skip;
+	gboolean have_prev;
 	uint8_t *prev_sample;
 	uint8_t *pre_trigger_buffer;
 	uint8_t *pre_trigger_head;
 	int pre_trigger_size;
 	int pre_trigger_fill;
+	/* Driver buffers kept as pre-trigger data, instead of the copy. */
+	GQueue *retained;
+	int retained_len;
+	/* The copy's memory, see sr_mem_reserve(). */
+	struct sr_context *mem_ctx;
+	uint64_t mem_reserved;
 };
 
 SR_PRIV int logic_channel_unitsize(GSList *channels);
@@ -2030,8 +2514,54 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
 		int pre_trigger_samples);
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *st);
+SR_PRIV void soft_trigger_logic_reset(struct soft_trigger_logic *st);
 SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *st, uint8_t *buf,
 		int len, int *pre_trigger_samples);
+SR_PRIV int soft_trigger_logic_check_ref(struct soft_trigger_logic *st,
+		uint8_t *buf, int len, struct sr_buffer *ref,
+		int *pre_trigger_samples);
+SR_PRIV int soft_trigger_logic_check_packed(struct soft_trigger_logic *st,
+		const struct sr_datafeed_logic_packed *packed,
+		int *pre_trigger_samples);
+SR_PRIV struct soft_trigger_logic *soft_trigger_logic_search_new(
+		const struct sr_trigger *trigger, int unitsize);
+SR_PRIV uint64_t soft_trigger_logic_span(const struct soft_trigger_logic *stl);
+SR_PRIV void soft_trigger_logic_find_all(const struct soft_trigger_logic *stl,
+		const uint8_t *buf, int num, int from, int to, uint64_t base,
+		GArray *offsets);
+
+struct soft_trigger_analog_stage;
+
+struct soft_trigger_analog {
+	const struct sr_dev_inst *sdi;
+	const struct sr_trigger *trigger;
+	/* The channel all matches are on. */
+	const struct sr_channel *channel;
+	float hysteresis;
+	/* The stage, compiled for the encoding of the last packet. */
+	struct soft_trigger_analog_stage *stage;
+	/* Slope matches wait for the signal to pass the hysteresis. */
+	gboolean rise_armed;
+	gboolean fall_armed;
+	/* Format of the last packet, and of the pre-trigger data. */
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	int frame_size;
+	/* Samples of all channels of the packets, in a circular buffer. */
+	int pre_trigger_samples;
+	uint8_t *pre_trigger_buffer;
+	int pre_trigger_head;
+	int pre_trigger_fill;
+};
+
+SR_PRIV struct soft_trigger_analog *soft_trigger_analog_new(
+		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
+		int pre_trigger_samples, float hysteresis);
+SR_PRIV void soft_trigger_analog_free(struct soft_trigger_analog *sta);
+SR_PRIV void soft_trigger_analog_reset(struct soft_trigger_analog *sta);
+SR_PRIV int soft_trigger_analog_check(struct soft_trigger_analog *sta,
+		const struct sr_datafeed_analog *analog, int *pre_trigger_samples);
 
 /*--- serial.c --------------------------------------------------------------*/
 
@@ -2070,6 +2600,10 @@ SR_PRIV int serial_set_handshake(struct sr_serial_dev_inst *serial,
 		int rts, int dtr);
 SR_PRIV int serial_set_paramstr(struct sr_serial_dev_inst *serial,
 		const char *paramstr);
+SR_PRIV int serial_set_low_latency(struct sr_serial_dev_inst *serial,
+		gboolean on);
+SR_PRIV int serial_get_latency(struct sr_serial_dev_inst *serial,
+		uint64_t *min_us, uint64_t *avg_us);
 SR_PRIV int serial_readline(struct sr_serial_dev_inst *serial, char **buf,
 		int *buflen, gint64 timeout_ms);
 SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
@@ -2085,6 +2619,41 @@ SR_PRIV int serial_source_remove(struct sr_session *session,
 SR_PRIV GSList *sr_serial_find_usb(uint16_t vendor_id, uint16_t product_id);
 SR_PRIV int serial_timeout(struct sr_serial_dev_inst *port, int num_bytes);
 
+/** Callbacks of a device polled by the serial scheduler. */
+struct sr_serial_poll_ops {
+	/** Send a request, SR_OK when it went out. */
+	int (*request)(struct sr_serial_dev_inst *serial, void *cb_data);
+	/** Take received data, TRUE when the reply is complete. */
+	gboolean (*receive)(struct sr_serial_dev_inst *serial, void *cb_data);
+	/** Optional, the reply to a request timed out. */
+	void (*timeout)(struct sr_serial_dev_inst *serial, void *cb_data);
+};
+
+/** Request statistics of a polled serial device. */
+struct sr_serial_poll_stats {
+	uint64_t requests;
+	uint64_t replies;
+	uint64_t timeouts;
+	/** Requests which were due while a reply was pending. */
+	uint64_t skipped;
+	/** How late requests were sent after they were due. */
+	int64_t jitter_min_us;
+	int64_t jitter_max_us;
+	int64_t jitter_mean_us;
+};
+
+SR_PRIV int sr_serial_poll_add(struct sr_session *session,
+		struct sr_serial_dev_inst *serial,
+		uint64_t interval_us, uint64_t timeout_us,
+		const struct sr_serial_poll_ops *ops, void *cb_data);
+SR_PRIV int sr_serial_poll_remove(struct sr_session *session,
+		struct sr_serial_dev_inst *serial);
+SR_PRIV int sr_serial_poll_get_stats(struct sr_session *session,
+		struct sr_serial_dev_inst *serial,
+		struct sr_serial_poll_stats *stats);
+
+SR_PRIV void sr_ser_alloc_rx_queue(struct sr_serial_dev_inst *serial,
+		size_t size);
 SR_PRIV void sr_ser_discard_queued_data(struct sr_serial_dev_inst *serial);
 SR_PRIV size_t sr_ser_has_queued_data(struct sr_serial_dev_inst *serial);
 SR_PRIV void sr_ser_queue_rx_data(struct sr_serial_dev_inst *serial,
@@ -2108,6 +2677,8 @@ struct ser_lib_functions {
 			int flowcontrol, int rts, int dtr);
 	int (*set_handshake)(struct sr_serial_dev_inst *serial,
 			int rts, int dtr);
+	int (*set_low_latency)(struct sr_serial_dev_inst *serial,
+			gboolean on);
 	int (*setup_source_add)(struct sr_session *session,
 			struct sr_serial_dev_inst *serial,
 			int events, int timeout,
@@ -2183,6 +2754,8 @@ SR_PRIV int sr_bt_config_notify(struct sr_bt_desc *desc,
 	uint16_t read_handle, uint16_t write_handle,
 	uint16_t cccd_handle, uint16_t cccd_value,
 	uint16_t ble_mtu);
+SR_PRIV int sr_bt_config_throughput(struct sr_bt_desc *desc,
+	uint16_t conn_interval, gboolean mtu_exchange, gboolean batch);
 
 SR_PRIV int sr_bt_scan_le(struct sr_bt_desc *desc, int duration);
 SR_PRIV int sr_bt_scan_bt(struct sr_bt_desc *desc, int duration);
@@ -2208,6 +2781,8 @@ SR_PRIV int ezusb_install_firmware(struct sr_context *ctx, libusb_device_handle
 				   const char *name);
 SR_PRIV int ezusb_upload_firmware(struct sr_context *ctx, libusb_device *dev,
 				  int configuration, const char *name);
+SR_PRIV int ezusb_wait_renumerated(const struct sr_dev_inst *sdi,
+		unsigned int timeout_ms);
 #endif
 
 /*--- usb.c -----------------------------------------------------------------*/
@@ -2215,12 +2790,45 @@ SR_PRIV int ezusb_upload_firmware(struct sr_context *ctx, libusb_device *dev,
 SR_PRIV int sr_usb_split_conn(const char *conn,
 	uint16_t *vid, uint16_t *pid, uint8_t *bus, uint8_t *addr);
 #ifdef HAVE_LIBUSB_1_0
+SR_PRIV void sr_usb_cache_init(struct sr_context *ctx);
+SR_PRIV void sr_usb_cache_exit(struct sr_context *ctx);
+SR_PRIV void sr_usb_cache_hold(struct sr_context *ctx);
+SR_PRIV void sr_usb_cache_release(struct sr_context *ctx);
+SR_PRIV ssize_t sr_usb_get_device_list(libusb_context *usb_ctx,
+		libusb_device ***list);
 SR_PRIV GSList *sr_usb_find(libusb_context *usb_ctx, const char *conn);
 SR_PRIV int sr_usb_open(libusb_context *usb_ctx, struct sr_usb_dev_inst *usb);
 SR_PRIV void sr_usb_close(struct sr_usb_dev_inst *usb);
+SR_PRIV uint8_t *sr_usb_buffer_alloc(struct sr_usb_dev_inst *usb, size_t len);
+SR_PRIV void sr_usb_buffer_free(struct sr_usb_dev_inst *usb,
+		uint8_t *buf, size_t len);
 SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 		int timeout, sr_receive_data_callback cb, void *cb_data);
 SR_PRIV int usb_source_remove(struct sr_session *session, struct sr_context *ctx);
+/* Called from the USB event thread, return FALSE to be removed. */
+typedef gboolean (*sr_usb_event_hook)(void *cb_data);
+SR_PRIV int sr_usb_event_thread_add(struct sr_context *ctx, int interval,
+		sr_usb_event_hook cb, void *cb_data);
+SR_PRIV gboolean sr_usb_event_thread_current(struct sr_context *ctx);
+SR_PRIV void sr_usb_handle_pending(struct sr_context *ctx);
+SR_PRIV void sr_usb_event_thread_wake(struct sr_context *ctx);
+SR_PRIV void sr_usb_event_thread_stop(struct sr_context *ctx);
+SR_PRIV void sr_usb_capture_init(struct sr_context *ctx);
+SR_PRIV void sr_usb_capture_exit(struct sr_context *ctx);
+SR_PRIV gboolean sr_usb_replay_device(struct sr_context *ctx,
+		uint16_t *vid, uint16_t *pid, int *speed);
+SR_PRIV int sr_usb_submit_transfer(struct sr_context *ctx,
+		struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_cancel_transfer(struct sr_context *ctx,
+		struct libusb_transfer *transfer);
+SR_PRIV int sr_usb_control_transfer(struct sr_context *ctx,
+		libusb_device_handle *devhdl, uint8_t request_type,
+		uint8_t request, uint16_t value, uint16_t index,
+		unsigned char *data, uint16_t length, unsigned int timeout);
+SR_PRIV int sr_usb_bulk_upload(struct sr_context *ctx,
+		libusb_device_handle *devhdl, unsigned char endpoint,
+		const uint8_t *data, size_t len, size_t chunk_size,
+		unsigned int timeout);
 SR_PRIV int usb_get_port_path(libusb_device *dev, char *path, int path_len);
 SR_PRIV gboolean usb_match_manuf_prod(libusb_device *dev,
 		const char *manufacturer, const char *product);
@@ -2235,6 +2843,10 @@ SR_PRIV struct sr_tcp_dev_inst *sr_tcp_dev_inst_new(
 SR_PRIV void sr_tcp_dev_inst_free(struct sr_tcp_dev_inst *tcp);
 SR_PRIV int sr_tcp_get_port_path(struct sr_tcp_dev_inst *tcp,
 	const char *prefix, char separator, char *path, size_t path_len);
+SR_PRIV int sr_tcp_parse_options(struct sr_tcp_options *opts,
+	char **fields);
+SR_PRIV int sr_tcp_connect_socket(const char *host_addr, const char *tcp_port,
+	const struct sr_tcp_options *opts);
 SR_PRIV int sr_tcp_connect(struct sr_tcp_dev_inst *tcp);
 SR_PRIV int sr_tcp_disconnect(struct sr_tcp_dev_inst *tcp);
 SR_PRIV int sr_tcp_write_bytes(struct sr_tcp_dev_inst *tcp,
@@ -2312,6 +2924,35 @@ SR_PRIV int bv_get_value(float *out, const struct binary_value_spec *spec,
  */
 SR_PRIV uint16_t sr_crc16(uint16_t crc, const uint8_t *buffer, int len);
 
+/*--- modbus/modbus_regmap.c ------------------------------------------------*/
+
+/** A range of holding registers, and where its values are kept. */
+struct sr_modbus_range {
+	int address;
+	int nb_registers;
+	size_t offset;
+};
+
+/** A plan for reading a set of holding registers in few requests. */
+struct sr_modbus_regmap {
+	/** The register ranges which were declared. */
+	GArray *ranges;
+	/** The requests which read them, empty until planned. */
+	GArray *requests;
+	/** The values of all requests' registers. */
+	uint16_t *values;
+	/** Unneeded registers read for merging two ranges. */
+	int max_gap;
+};
+
+SR_PRIV struct sr_modbus_regmap *sr_modbus_regmap_new(int max_gap);
+SR_PRIV void sr_modbus_regmap_free(struct sr_modbus_regmap *map);
+SR_PRIV int sr_modbus_regmap_add(struct sr_modbus_regmap *map,
+		int address, int nb_registers);
+SR_PRIV void sr_modbus_regmap_plan(struct sr_modbus_regmap *map);
+SR_PRIV const uint16_t *sr_modbus_regmap_get(const struct sr_modbus_regmap *map,
+		int address, int nb_registers);
+
 /*--- modbus/modbus.c -------------------------------------------------------*/
 
 struct sr_modbus_dev_inst {
@@ -2357,6 +2998,10 @@ SR_PRIV int sr_modbus_read_coils(struct sr_modbus_dev_inst *modbus,
 SR_PRIV int sr_modbus_read_holding_registers(struct sr_modbus_dev_inst *modbus,
                                              int address, int nb_registers,
                                              uint16_t *registers);
+
+SR_PRIV int sr_modbus_regmap_read(struct sr_modbus_dev_inst *modbus,
+		struct sr_modbus_regmap *map);
+
 SR_PRIV int sr_modbus_write_coil(struct sr_modbus_dev_inst *modbus,
                                  int address, int value);
 SR_PRIV int sr_modbus_write_multiple_registers(struct sr_modbus_dev_inst*modbus,
@@ -2853,6 +3498,8 @@ SR_PRIV gboolean sr_sw_limits_check(struct sr_sw_limits *limits);
 SR_PRIV int sr_sw_limits_get_remain(const struct sr_sw_limits *limits,
 	uint64_t *samples, uint64_t *frames, uint64_t *msecs,
 	gboolean *exceeded);
+SR_PRIV uint64_t sr_sw_limits_samples_allowed(const struct sr_sw_limits *limits,
+	uint64_t samples);
 SR_PRIV void sr_sw_limits_update_samples_read(struct sr_sw_limits *limits,
 	uint64_t samples_read);
 SR_PRIV void sr_sw_limits_update_frames_read(struct sr_sw_limits *limits,
@@ -2871,6 +3518,7 @@ SR_API int feed_queue_logic_submit_one(struct feed_queue_logic *q,
 	const uint8_t *data, size_t repeat_count);
 SR_API int feed_queue_logic_submit_many(struct feed_queue_logic *q,
 	const uint8_t *data, size_t samples_count);
+SR_API int feed_queue_logic_rle(struct feed_queue_logic *q, gboolean enable);
 SR_API int feed_queue_logic_flush(struct feed_queue_logic *q);
 SR_API int feed_queue_logic_send_trigger(struct feed_queue_logic *q);
 SR_API void feed_queue_logic_free(struct feed_queue_logic *q);
@@ -20,6 +20,7 @@
 #include <config.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib/gprintf.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -42,8 +43,11 @@
  * @{
  */
 
-/* Currently selected libsigrok loglevel. Default: SR_LOG_WARN. */
-static int cur_loglevel = SR_LOG_WARN; /* Show errors+warnings per default. */
+/*
+ * Currently selected libsigrok loglevel. Default: SR_LOG_WARN.
+ * Not static, so that sr_log_enabled() can check it without a call.
+ */
+SR_PRIV int sr_cur_loglevel = SR_LOG_WARN; /* Show errors+warnings per default. */
 
 /* Function prototype. */
 static int sr_logv(void *cb_data, int loglevel, const char *format,
@@ -90,7 +94,7 @@ SR_API int sr_log_loglevel_set(int loglevel)
 	if (loglevel >= LOGLEVEL_TIMESTAMP && sr_log_start_time == 0)
 		sr_log_start_time = g_get_monotonic_time();
 
-	cur_loglevel = loglevel;
+	sr_cur_loglevel = loglevel;
 
 	sr_dbg("libsigrok loglevel set to %d.", loglevel);
 
@@ -106,7 +110,7 @@ SR_API int sr_log_loglevel_set(int loglevel)
  */
 SR_API int sr_log_loglevel_get(void)
 {
-	return cur_loglevel;
+	return sr_cur_loglevel;
 }
 
 /**
@@ -182,28 +186,22 @@ SR_API int sr_log_callback_get(sr_log_callback *cb, void **cb_data)
 	return SR_OK;
 }
 
-static int sr_logv(void *cb_data, int loglevel, const char *format, va_list args)
+/* Write a message to stderr, as logged at the given time. */
+static int log_write(int64_t time_us, const char *raw_output)
 {
 	int ret;
 	uint64_t elapsed_us, minutes;
 	unsigned int rest_us, seconds, microseconds;
-	char *raw_output, *output, c;
-	ssize_t print_len;
-	size_t raw_len;
+	char *output, c;
 	const char *raw_ptr;
 	char *out_ptr;
 
-	/* This specific log callback doesn't need the void pointer data. */
-	(void)cb_data;
-
-	(void)loglevel;
-
 	/* Prefix with 'sr:'. Optionally prefix with timestamp. */
 	ret = fputs("sr: ", stderr);
 	if (ret < 0)
 		return SR_ERR;
-	if (cur_loglevel >= LOGLEVEL_TIMESTAMP) {
-		elapsed_us = g_get_monotonic_time() - sr_log_start_time;
+	if (sr_cur_loglevel >= LOGLEVEL_TIMESTAMP) {
+		elapsed_us = time_us - sr_log_start_time;
 
 		minutes = elapsed_us / G_TIME_SPAN_MINUTE;
 		rest_us = elapsed_us % G_TIME_SPAN_MINUTE;
@@ -216,21 +214,10 @@ static int sr_logv(void *cb_data, int loglevel, const char *format, va_list args
 			return SR_ERR;
 	}
 
-	/* Print the caller's message into a local buffer. */
-	raw_output = NULL;
-	print_len = g_vasprintf(&raw_output, format, args);
-	if (print_len < 0) {
-		g_free(raw_output);
-		return SR_ERR;
-	}
-	raw_len = (size_t)print_len;
-
 	/* Copy the string. Strip unwanted line breaks. */
-	output = g_malloc(raw_len + 1);
-	if (!output) {
-		g_free(raw_output);
+	output = g_malloc(strlen(raw_output) + 1);
+	if (!output)
 		return SR_ERR;
-	}
 	out_ptr = output;
 	raw_ptr = raw_output;
 	while (*raw_ptr) {
@@ -240,7 +227,6 @@ static int sr_logv(void *cb_data, int loglevel, const char *format, va_list args
 		*out_ptr++ = c;
 	}
 	*out_ptr = '\0';
-	g_free(raw_output);
 
 	/* Print the trimmed output text. */
 	g_fprintf(stderr, "%s\n", output);
@@ -250,6 +236,284 @@ static int sr_logv(void *cb_data, int loglevel, const char *format, va_list args
 	return SR_OK;
 }
 
+static int sr_logv(void *cb_data, int loglevel, const char *format, va_list args)
+{
+	int ret;
+	char *raw_output;
+	ssize_t print_len;
+
+	/* This specific log callback doesn't need the void pointer data. */
+	(void)cb_data;
+
+	(void)loglevel;
+
+	/* Print the caller's message into a local buffer. */
+	raw_output = NULL;
+	print_len = g_vasprintf(&raw_output, format, args);
+	if (print_len < 0) {
+		g_free(raw_output);
+		return SR_ERR;
+	}
+	ret = log_write(g_get_monotonic_time(), raw_output);
+	g_free(raw_output);
+
+	return ret;
+}
+
+/** @cond PRIVATE */
+#define LOG_ASYNC_RECORDS 4096
+#define LOG_RECORD_LEN 240
+#define LOG_ASYNC_POLL_US 10000
+/** @endcond */
+
+/*
+ * The asynchronous log sink. Threads logging a message claim a record
+ * in a bounded ring, format the message into it and publish it, without
+ * taking locks or allocating. A thread of its own writes the records
+ * out through the callback that was set before. Each record has a
+ * sequence number, telling whether it is free for the writer claiming
+ * position seq, or filled for the reader at position seq - 1.
+ */
+struct log_record {
+	gint seq;
+	int loglevel;
+	int64_t time_us;
+	char text[LOG_RECORD_LEN];
+};
+
+struct log_ring {
+	struct log_record *records;
+	guint mask;
+	gint head;
+	guint tail;
+	gint writers;
+	gint dropped;
+	guint reported;
+	gint stop;
+	GThread *thread;
+	sr_log_callback cb;
+	void *cb_data;
+};
+
+static struct log_ring *log_ring = NULL;
+
+static int log_async(void *cb_data, int loglevel, const char *format,
+		va_list args)
+{
+	struct log_ring *ring;
+	struct log_record *r;
+	guint pos;
+	gint diff;
+
+	ring = cb_data;
+	g_atomic_int_inc(&ring->writers);
+	pos = g_atomic_int_get(&ring->head);
+	for (;;) {
+		r = &ring->records[pos & ring->mask];
+		diff = (gint)((guint)g_atomic_int_get(&r->seq) - pos);
+		if (diff == 0) {
+			if (g_atomic_int_compare_and_exchange(&ring->head,
+					pos, pos + 1))
+				break;
+			pos = g_atomic_int_get(&ring->head);
+		} else if (diff < 0) {
+			/* Full, the writer thread is behind. */
+			g_atomic_int_inc(&ring->dropped);
+			g_atomic_int_add(&ring->writers, -1);
+			return SR_OK;
+		} else {
+			pos = g_atomic_int_get(&ring->head);
+		}
+	}
+
+	r->loglevel = loglevel;
+	r->time_us = g_get_monotonic_time();
+	g_vsnprintf(r->text, sizeof(r->text), format, args);
+	g_atomic_int_set(&r->seq, pos + 1);
+	g_atomic_int_add(&ring->writers, -1);
+
+	return SR_OK;
+}
+
+/* Call a log callback with an already formatted message. */
+static int log_forward(sr_log_callback cb, void *cb_data, int loglevel,
+		const char *format, ...)
+{
+	int ret;
+	va_list args;
+
+	va_start(args, format);
+	ret = cb(cb_data, loglevel, format, args);
+	va_end(args);
+
+	return ret;
+}
+
+static void log_async_emit(struct log_ring *ring, int loglevel,
+		int64_t time_us, const char *text)
+{
+	if (ring->cb == sr_logv)
+		log_write(time_us, text);
+	else
+		log_forward(ring->cb, ring->cb_data, loglevel, "%s", text);
+}
+
+/* Write out what the ring has, return the number of records. */
+static unsigned int log_async_drain(struct log_ring *ring)
+{
+	struct log_record *r;
+	unsigned int num;
+	guint dropped;
+	char msg[64];
+
+	num = 0;
+	for (;;) {
+		r = &ring->records[ring->tail & ring->mask];
+		if ((gint)((guint)g_atomic_int_get(&r->seq) - (ring->tail + 1)) < 0)
+			break;
+		log_async_emit(ring, r->loglevel, r->time_us, r->text);
+		g_atomic_int_set(&r->seq, ring->tail + ring->mask + 1);
+		ring->tail++;
+		num++;
+	}
+
+	dropped = g_atomic_int_get(&ring->dropped);
+	if (dropped != ring->reported) {
+		g_snprintf(msg, sizeof(msg), "log: %u messages dropped.",
+			dropped - ring->reported);
+		log_async_emit(ring, SR_LOG_WARN, g_get_monotonic_time(), msg);
+		ring->reported = dropped;
+	}
+
+	return num;
+}
+
+static gpointer log_async_thread(gpointer data)
+{
+	struct log_ring *ring;
+
+	ring = data;
+	while (!g_atomic_int_get(&ring->stop)) {
+		if (!log_async_drain(ring))
+			g_usleep(LOG_ASYNC_POLL_US);
+	}
+	log_async_drain(ring);
+
+	return NULL;
+}
+
+/**
+ * Log asynchronously, from a thread of its own.
+ *
+ * Messages are formatted into a ring of fixed size records by the
+ * thread logging them, and written out by another thread through the
+ * log callback currently set. This keeps logging cheap in time critical
+ * code, like USB transfer callbacks, at the cost of the messages being
+ * written a little later. Messages are truncated to 240 characters.
+ * When the ring is full, messages are dropped, and how many is logged
+ * when there is room again.
+ *
+ * @param num_records The number of records in the ring, rounded up to
+ *                    a power of two. 0 for the default of 4096.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Already logging asynchronously.
+ * @retval SR_ERR Cannot start the thread.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_log_async_start(unsigned int num_records)
+{
+	struct log_ring *ring;
+	unsigned int size, i;
+	GError *err;
+
+	if (log_ring)
+		return SR_ERR_ARG;
+
+	size = 1;
+	while (size < (num_records ? num_records : LOG_ASYNC_RECORDS))
+		size <<= 1;
+
+	ring = g_malloc0(sizeof(*ring));
+	ring->records = g_malloc(size * sizeof(*ring->records));
+	for (i = 0; i < size; i++)
+		ring->records[i].seq = i;
+	ring->mask = size - 1;
+	ring->cb = sr_log_cb;
+	ring->cb_data = sr_log_cb_data;
+
+	err = NULL;
+	ring->thread = g_thread_try_new("sr-log", log_async_thread, ring, &err);
+	if (!ring->thread) {
+		sr_err("Cannot start the log thread: %s.", err->message);
+		g_error_free(err);
+		g_free(ring->records);
+		g_free(ring);
+		return SR_ERR;
+	}
+
+	log_ring = ring;
+	sr_log_cb = log_async;
+	sr_log_cb_data = ring;
+
+	return SR_OK;
+}
+
+/**
+ * Stop logging asynchronously.
+ *
+ * Writes out the messages still in the ring, and puts back the log
+ * callback that was set when sr_log_async_start() was called. Other
+ * threads should not be logging anymore, like while an acquisition
+ * is running.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Not logging asynchronously.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_log_async_stop(void)
+{
+	struct log_ring *ring;
+
+	if (!(ring = log_ring))
+		return SR_ERR_ARG;
+
+	if (sr_log_cb == log_async) {
+		sr_log_cb = ring->cb;
+		sr_log_cb_data = ring->cb_data;
+	}
+	log_ring = NULL;
+
+	/* Let threads which are in the middle of a message finish it. */
+	while (g_atomic_int_get(&ring->writers))
+		g_thread_yield();
+
+	g_atomic_int_set(&ring->stop, 1);
+	g_thread_join(ring->thread);
+	g_free(ring->records);
+	g_free(ring);
+
+	return SR_OK;
+}
+
+/**
+ * Get the number of messages dropped by the asynchronous log sink.
+ *
+ * @return The number of messages dropped since sr_log_async_start(),
+ *         0 when not logging asynchronously.
+ *
+ * @since 0.6.0
+ */
+SR_API uint64_t sr_log_async_dropped(void)
+{
+	if (!log_ring)
+		return 0;
+
+	return (guint)g_atomic_int_get(&log_ring->dropped);
+}
+
 /** @private */
 SR_PRIV int sr_log(int loglevel, const char *format, ...)
 {
@@ -257,7 +521,7 @@ SR_PRIV int sr_log(int loglevel, const char *format, ...)
 	va_list args;
 
 	/* Only output messages of at least the selected loglevel(s). */
-	if (loglevel > cur_loglevel)
+	if (loglevel > sr_cur_loglevel)
 		return SR_OK;
 
 	/* Silently succeed when no logging callback is registered. */
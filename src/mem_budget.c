@@ -0,0 +1,194 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "mem-budget"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Accounting the memory of acquisition buffers against a budget.
+ *
+ * The large buffers of an acquisition, like USB transfer rings,
+ * pre-trigger buffers and output buffers, get reserved against the
+ * budget of the context before they are allocated. A deep capture
+ * which would not fit then fails when it starts, with a message naming
+ * the buffer, instead of running out of memory along the way. Drivers
+ * can also size their buffers to what is left.
+ */
+
+/**
+ * @addtogroup grp_init
+ *
+ * @{
+ */
+
+/**
+ * Set the memory budget for acquisition buffers.
+ *
+ * Buffers already allocated are not affected, even when they exceed a
+ * lower budget.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param bytes The budget, 0 for none (the default).
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_mem_budget_set(struct sr_context *ctx, uint64_t bytes)
+{
+	if (!ctx)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&ctx->mem_mutex);
+	ctx->mem.budget = bytes;
+	g_mutex_unlock(&ctx->mem_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get the memory accounting of a context.
+ *
+ * @param ctx The libsigrok context. Must not be NULL.
+ * @param[out] stats The budget, and the memory in use.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_mem_stats_get(struct sr_context *ctx, struct sr_mem_stats *stats)
+{
+	if (!ctx || !stats)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&ctx->mem_mutex);
+	*stats = ctx->mem;
+	g_mutex_unlock(&ctx->mem_mutex);
+
+	return SR_OK;
+}
+
+/** @} */
+
+/**
+ * Reserve memory for a buffer against the budget, before allocating it.
+ *
+ * @param ctx The libsigrok context. NULL accounts nothing.
+ * @param bytes The size of the buffer.
+ * @param what What the buffer is for, for the error message.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_MALLOC The buffer exceeds the budget.
+ *
+ * @private
+ */
+SR_PRIV int sr_mem_reserve(struct sr_context *ctx, uint64_t bytes,
+		const char *what)
+{
+	uint64_t budget;
+	int ret;
+
+	if (!ctx || !bytes)
+		return SR_OK;
+
+	ret = SR_OK;
+	g_mutex_lock(&ctx->mem_mutex);
+	budget = ctx->mem.budget;
+	if (budget && bytes > budget - MIN(ctx->mem.used, budget)) {
+		ctx->mem.refused++;
+		ret = SR_ERR_MALLOC;
+	} else {
+		ctx->mem.used += bytes;
+		ctx->mem.peak = MAX(ctx->mem.peak, ctx->mem.used);
+	}
+	g_mutex_unlock(&ctx->mem_mutex);
+
+	if (ret != SR_OK)
+		sr_err("%s of %" PRIu64 " bytes exceeds the memory budget "
+			"of %" PRIu64 " bytes.", what, bytes, budget);
+
+	return ret;
+}
+
+/**
+ * Return memory reserved with sr_mem_reserve(), once the buffer is freed.
+ *
+ * @private
+ */
+SR_PRIV void sr_mem_release(struct sr_context *ctx, uint64_t bytes)
+{
+	if (!ctx || !bytes)
+		return;
+
+	g_mutex_lock(&ctx->mem_mutex);
+	ctx->mem.used -= MIN(bytes, ctx->mem.used);
+	g_mutex_unlock(&ctx->mem_mutex);
+}
+
+/**
+ * Memory left within the budget, for sizing buffers.
+ *
+ * @return The bytes left, or UINT64_MAX without budget or context.
+ *
+ * @private
+ */
+SR_PRIV uint64_t sr_mem_available(struct sr_context *ctx)
+{
+	uint64_t avail;
+
+	if (!ctx)
+		return UINT64_MAX;
+
+	g_mutex_lock(&ctx->mem_mutex);
+	if (!ctx->mem.budget)
+		avail = UINT64_MAX;
+	else
+		avail = ctx->mem.budget - MIN(ctx->mem.used, ctx->mem.budget);
+	g_mutex_unlock(&ctx->mem_mutex);
+
+	return avail;
+}
+
+/**
+ * The context a device's buffers get accounted in: that of its session,
+ * or of its driver.
+ *
+ * @private
+ */
+SR_PRIV struct sr_context *sr_mem_context(const struct sr_dev_inst *sdi)
+{
+	struct drv_context *drvc;
+
+	if (!sdi)
+		return NULL;
+	if (sdi->session)
+		return sdi->session->ctx;
+	if (sdi->driver && (drvc = sdi->driver->context))
+		return drvc->sr_ctx;
+
+	return NULL;
+}
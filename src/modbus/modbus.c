@@ -478,6 +478,42 @@ SR_PRIV int sr_modbus_read_holding_registers(struct sr_modbus_dev_inst *modbus,
 	return SR_OK;
 }
 
+/**
+ * Read all the registers of a plan.
+ *
+ * @param modbus Previously initialized Modbus device structure.
+ * @param map The read plan. Must not be NULL.
+ *
+ * @return SR_OK upon success, SR_ERR_ARG upon invalid arguments,
+ *         SR_ERR_DATA upon invalid data, or SR_ERR on failure.
+ */
+SR_PRIV int sr_modbus_regmap_read(struct sr_modbus_dev_inst *modbus,
+		struct sr_modbus_regmap *map)
+{
+	const struct sr_modbus_range *req;
+	size_t i;
+	int ret;
+
+	if (!modbus || !map || !map->ranges->len)
+		return SR_ERR_ARG;
+
+	if (!map->requests->len) {
+		sr_modbus_regmap_plan(map);
+		sr_dbg("Reading %u register ranges with %u requests.",
+			map->ranges->len, map->requests->len);
+	}
+
+	for (i = 0; i < map->requests->len; i++) {
+		req = &g_array_index(map->requests, struct sr_modbus_range, i);
+		ret = sr_modbus_read_holding_registers(modbus, req->address,
+			req->nb_registers, map->values + req->offset);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
 /**
  * Send a Modbus write coil command.
  *
@@ -0,0 +1,181 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+static gint range_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct sr_modbus_range *ra, *rb;
+
+	ra = a;
+	rb = b;
+	if (ra->address != rb->address)
+		return ra->address < rb->address ? -1 : 1;
+
+	return rb->nb_registers - ra->nb_registers;
+}
+
+/**
+ * Create a plan for reading a set of holding registers.
+ *
+ * Drivers declare the register ranges they need with
+ * sr_modbus_regmap_add(). The ranges get merged into as few read
+ * requests as possible, each request being one round trip to the
+ * device. Ranges which are up to @a max_gap registers apart are read
+ * together with the registers between them, which costs two bytes of
+ * transfer each, while a request of its own costs some 20 bytes of
+ * framing and bus silence plus the device's turn around time.
+ *
+ * @param max_gap The number of unneeded registers to read for saving a
+ *                request.
+ *
+ * @return The new read plan, to be freed with sr_modbus_regmap_free().
+ */
+SR_PRIV struct sr_modbus_regmap *sr_modbus_regmap_new(int max_gap)
+{
+	struct sr_modbus_regmap *map;
+
+	map = g_malloc0(sizeof(*map));
+	map->ranges = g_array_new(FALSE, FALSE, sizeof(struct sr_modbus_range));
+	map->requests = g_array_new(FALSE, FALSE, sizeof(struct sr_modbus_range));
+	map->max_gap = MAX(max_gap, 0);
+
+	return map;
+}
+
+/**
+ * Free a plan for reading holding registers.
+ *
+ * @param map The read plan, or NULL.
+ */
+SR_PRIV void sr_modbus_regmap_free(struct sr_modbus_regmap *map)
+{
+	if (!map)
+		return;
+
+	g_array_free(map->ranges, TRUE);
+	g_array_free(map->requests, TRUE);
+	g_free(map->values);
+	g_free(map);
+}
+
+/**
+ * Declare registers which get read by a plan.
+ *
+ * @param map The read plan. Must not be NULL.
+ * @param address The Modbus address of the first register.
+ * @param nb_registers The number of registers, 1 to 125.
+ *
+ * @return SR_OK upon success, SR_ERR_ARG upon invalid arguments.
+ */
+SR_PRIV int sr_modbus_regmap_add(struct sr_modbus_regmap *map,
+		int address, int nb_registers)
+{
+	struct sr_modbus_range range;
+
+	if (!map || address < 0 || nb_registers < 1 || nb_registers > 125
+	    || address + nb_registers > 0x10000)
+		return SR_ERR_ARG;
+
+	range.address = address;
+	range.nb_registers = nb_registers;
+	range.offset = 0;
+	g_array_append_val(map->ranges, range);
+
+	/* Plan again on the next read. */
+	g_array_set_size(map->requests, 0);
+
+	return SR_OK;
+}
+
+/**
+ * Merge the declared ranges of a plan into requests of up to 125
+ * registers.
+ *
+ * sr_modbus_regmap_read() does this on the first read after a change.
+ *
+ * @param map The read plan. Must not be NULL.
+ */
+SR_PRIV void sr_modbus_regmap_plan(struct sr_modbus_regmap *map)
+{
+	struct sr_modbus_range *range, *req;
+	size_t i, total;
+	int end;
+
+	g_array_sort(map->ranges, range_cmp);
+	g_array_set_size(map->requests, 0);
+
+	req = NULL;
+	for (i = 0; i < map->ranges->len; i++) {
+		range = &g_array_index(map->ranges, struct sr_modbus_range, i);
+		end = range->address + range->nb_registers;
+		if (req && range->address <= req->address + req->nb_registers
+				+ map->max_gap && end - req->address <= 125) {
+			req->nb_registers = MAX(req->nb_registers,
+				end - req->address);
+			continue;
+		}
+		g_array_set_size(map->requests, map->requests->len + 1);
+		req = &g_array_index(map->requests, struct sr_modbus_range,
+			map->requests->len - 1);
+		req->address = range->address;
+		req->nb_registers = range->nb_registers;
+	}
+
+	total = 0;
+	for (i = 0; i < map->requests->len; i++) {
+		req = &g_array_index(map->requests, struct sr_modbus_range, i);
+		req->offset = total;
+		total += req->nb_registers;
+	}
+	g_free(map->values);
+	map->values = g_malloc0(MAX(total, 1) * sizeof(uint16_t));
+}
+
+/**
+ * Get the values of registers which were read by a plan.
+ *
+ * @param map The read plan. Must not be NULL.
+ * @param address The Modbus address of the first register.
+ * @param nb_registers The number of registers.
+ *
+ * @return The registers' values as received, like
+ *         sr_modbus_read_holding_registers() stores them, or NULL when
+ *         the plan doesn't read all these registers.
+ */
+SR_PRIV const uint16_t *sr_modbus_regmap_get(const struct sr_modbus_regmap *map,
+		int address, int nb_registers)
+{
+	const struct sr_modbus_range *req;
+	size_t i;
+
+	if (!map || !map->values)
+		return NULL;
+
+	for (i = 0; i < map->requests->len; i++) {
+		req = &g_array_index(map->requests, struct sr_modbus_range, i);
+		if (address >= req->address && address + nb_registers
+				<= req->address + req->nb_registers)
+			return map->values + req->offset
+				+ (address - req->address);
+	}
+
+	return NULL;
+}
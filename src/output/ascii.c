@@ -51,6 +51,12 @@ struct context {
 	GString **lines;
 	const char *charset;
 	gboolean edges;
+	/*
+	 * Text for 8 samples which are not the first in their line,
+	 * indexed by the previous sample's bit and the samples' bits,
+	 * the first one in the MSB.
+	 */
+	char bit_chars[512][8];
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -58,7 +64,8 @@ static int init(struct sr_output *o, GHashTable *options)
 	struct context *ctx;
 	struct sr_channel *ch;
 	GSList *l;
-	size_t j, max_namelen, alloc_line_len;
+	size_t i, j, max_namelen, alloc_line_len;
+	uint8_t curbit, prevbit;
 
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
@@ -74,6 +81,15 @@ static int init(struct sr_output *o, GHashTable *options)
 		ctx->charset = g_strdup(DEFAULT_ASCII_CHARS);
 	}
 	ctx->edges = (strlen(ctx->charset) >= 4) ? TRUE : FALSE;
+	for (i = 0; i < G_N_ELEMENTS(ctx->bit_chars); i++) {
+		prevbit = (i >> 8) & 1;
+		for (j = 0; j < 8; j++) {
+			curbit = (i >> (7 - j)) & 1;
+			ctx->bit_chars[i][j] = ctx->charset[curbit +
+				(ctx->edges && curbit != prevbit ? 2 : 0)];
+			prevbit = curbit;
+		}
+	}
 
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -172,6 +188,70 @@ static void maybe_add_trigger(struct context *ctx, GString *out)
 		offset + 1, "^", offset);
 }
 
+/* Get one channel's bits of 8 samples, the first sample in the MSB. */
+static uint8_t gather_bits(const uint8_t *data, size_t unitsize,
+		size_t bytepos, uint8_t bitmask)
+{
+	uint8_t bits;
+	size_t i;
+
+	bits = 0;
+	for (i = 0; i < 8; i++) {
+		bits <<= 1;
+		bits |= (data[bytepos] & bitmask) ? 1 : 0;
+		data += unitsize;
+	}
+
+	return bits;
+}
+
+/*
+ * Append a channel's text for samples which all fit in the current
+ * line. Edges are not shown for the first sample of a line. Groups of
+ * 8 samples after it get copied from the table in one go.
+ */
+static void append_chars(struct context *ctx, size_t chan,
+		const uint8_t *data, size_t unitsize, size_t count)
+{
+	GString *line;
+	size_t bytepos, len, k, pos, charidx;
+	uint8_t bitmask, bits, curbit, prevbit;
+	char *wrptr;
+
+	bytepos = ctx->channel_index[chan] / 8;
+	bitmask = 1U << (ctx->channel_index[chan] % 8);
+	pos = ctx->spl_cnt;
+	prevbit = (ctx->prev_sample[bytepos] & bitmask) ? 1 : 0;
+
+	/* Have room for all the text, then write it in place. */
+	line = ctx->lines[chan];
+	len = line->len;
+	g_string_set_size(line, len + count);
+	wrptr = line->str + len;
+	k = 0;
+	while (k < count) {
+		if (pos > 0 && count - k >= 8) {
+			bits = gather_bits(data, unitsize, bytepos, bitmask);
+			memcpy(wrptr, ctx->bit_chars[(prevbit << 8) | bits], 8);
+			prevbit = bits & 1;
+			wrptr += 8;
+			data += 8 * unitsize;
+			k += 8;
+			pos += 8;
+			continue;
+		}
+		curbit = (data[bytepos] & bitmask) ? 1 : 0;
+		charidx = curbit;
+		if (ctx->edges && pos > 0 && curbit != prevbit)
+			charidx += 2;
+		*wrptr++ = ctx->charset[charidx];
+		prevbit = curbit;
+		data += unitsize;
+		k++;
+		pos++;
+	}
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -180,13 +260,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	size_t idx, i, j;
-	size_t num_samples;
+	size_t i, j;
+	size_t num_samples, count;
 	const uint8_t *curr_sample;
-	size_t bytepos;
-	uint8_t bitmask, curbit, prevbit;
-	char c;
-	size_t charidx;
 
 	*out = NULL;
 	if (!o || !o->sdi)
@@ -215,40 +291,36 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			*out = g_string_sized_new(512);
 		}
 
+		/*
+		 * Handle the samples up to the end of the current line
+		 * by channel, then flush the lines when they are full.
+		 */
 		logic = packet->payload;
 		num_samples = logic->length / logic->unitsize;
 		curr_sample = logic->data;
-		while (num_samples--) {
-			ctx->spl_cnt++;
+		while (num_samples) {
+			count = num_samples;
+			if (ctx->spl > 0)
+				count = MIN(count, ctx->spl - ctx->spl_cnt);
+			for (j = 0; j < ctx->num_enabled_channels; j++)
+				append_chars(ctx, j, curr_sample, logic->unitsize, count);
+			ctx->spl_cnt += count;
+			curr_sample += count * logic->unitsize;
+			num_samples -= count;
+			memcpy(ctx->prev_sample, curr_sample - logic->unitsize,
+				logic->unitsize);
+			if (ctx->spl_cnt != ctx->spl)
+				continue;
+
+			/* Flush line buffers. */
 			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				bytepos = idx / 8;
-				bitmask = 1U << (idx % 8);
-				curbit = curr_sample[bytepos] & bitmask;
-				prevbit = ctx->prev_sample[bytepos] & bitmask;
-
-				charidx = curbit ? 1 : 0;
-				if (ctx->edges && ctx->spl_cnt > 1) {
-					if (curbit != prevbit)
-						charidx += 2;
-				}
-				c = ctx->charset[charidx];
-				g_string_append_c(ctx->lines[j], c);
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j + 1 == ctx->num_enabled_channels)
-						maybe_add_trigger(ctx, *out);
-					g_string_printf(ctx->lines[j], "%s:", ctx->aligned_names[j]);
-				}
+				g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
+				g_string_append_c(*out, '\n');
+				g_string_printf(ctx->lines[j], "%s:", ctx->aligned_names[j]);
 			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
-				ctx->spl_cnt = 0;
-			memcpy(ctx->prev_sample, curr_sample, logic->unitsize);
-			curr_sample += logic->unitsize;
+			if (ctx->num_enabled_channels)
+				maybe_add_trigger(ctx, *out);
+			ctx->spl_cnt = 0;
 		}
 		break;
 	case SR_DF_END:
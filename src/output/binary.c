@@ -26,20 +26,26 @@
 
 #define LOG_PREFIX "output/binary"
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_iov(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		sr_output_write_callback cb, void *cb_data)
 {
 	const struct sr_datafeed_logic *logic;
+	struct sr_output_iov iov;
 
 	(void)o;
 
-	*out = NULL;
 	if (packet->type != SR_DF_LOGIC)
 		return SR_OK;
 	logic = packet->payload;
-	*out = g_string_new_len(logic->data, logic->length);
+	if (!logic->length)
+		return SR_OK;
+
+	/* The samples are the output, as they are. */
+	iov.data = logic->data;
+	iov.len = logic->length;
 
-	return SR_OK;
+	return cb(&iov, 1, cb_data);
 }
 
 SR_PRIV struct sr_output_module output_binary = {
@@ -47,7 +53,7 @@ SR_PRIV struct sr_output_module output_binary = {
 	.name = "Binary",
 	.desc = "Raw binary logic data",
 	.exts = NULL,
-	.flags = 0,
+	.flags = SR_OUTPUT_PASSTHROUGH_LOGIC | SR_OUTPUT_ZERO_COPY,
 	.options = NULL,
-	.receive = receive,
+	.receive_iov = receive_iov,
 };
@@ -38,6 +38,8 @@ struct context {
 	char **channel_names;
 	gboolean header_done;
 	GString **lines;
+	/* Text for 8 samples, indexed by their bits, first one in the MSB. */
+	char bit_chars[256][8];
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -54,6 +56,10 @@ static int init(struct sr_output *o, GHashTable *options)
 	o->priv = ctx;
 	ctx->trigger = -1;
 	ctx->spl = g_variant_get_uint32(g_hash_table_lookup(options, "width"));
+	for (i = 0; i < G_N_ELEMENTS(ctx->bit_chars); i++) {
+		for (j = 0; j < 8; j++)
+			ctx->bit_chars[i][j] = (i & (0x80 >> j)) ? '1' : '0';
+	}
 
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -116,6 +122,67 @@ static GString *gen_header(const struct sr_output *o)
 	return header;
 }
 
+/* Get one channel's bits of 8 samples, the first sample in the MSB. */
+static uint8_t gather_bits(const uint8_t *data, size_t unitsize,
+		size_t bytepos, int bitpos)
+{
+	uint8_t bits;
+	size_t i;
+
+	bits = 0;
+	for (i = 0; i < 8; i++) {
+		bits <<= 1;
+		bits |= (data[bytepos] >> bitpos) & 1;
+		data += unitsize;
+	}
+
+	return bits;
+}
+
+/*
+ * Append a channel's text for samples which all fit in the current
+ * line. Groups of 8 samples which start a byte of the line's layout
+ * get copied from the table in one go.
+ */
+static void append_bits(struct context *ctx, unsigned int chan,
+		const uint8_t *data, size_t unitsize, size_t count)
+{
+	GString *line;
+	size_t bytepos, len, k;
+	int bitpos, pos;
+	char *wrptr;
+
+	bytepos = ctx->channel_index[chan] / 8;
+	bitpos = ctx->channel_index[chan] % 8;
+	pos = ctx->spl_cnt;
+
+	/* Have room for all the text, then write it in place. */
+	line = ctx->lines[chan];
+	len = line->len;
+	g_string_set_size(line, len + count + count / 8 + 1);
+	wrptr = line->str + len;
+	k = 0;
+	while (k < count) {
+		if ((pos & 7) == 0 && count - k >= 8) {
+			memcpy(wrptr, ctx->bit_chars[gather_bits(data, unitsize,
+				bytepos, bitpos)], 8);
+			wrptr += 8;
+			data += 8 * unitsize;
+			k += 8;
+			pos += 8;
+		} else {
+			*wrptr++ = ((data[bytepos] >> bitpos) & 1) ? '1' : '0';
+			data += unitsize;
+			k++;
+			pos++;
+		}
+		/* Add a space every 8th bit. */
+		if ((pos & 7) == 0 && pos != ctx->spl)
+			*wrptr++ = ' ';
+	}
+	g_string_truncate(line, wrptr - line->str);
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -124,9 +191,10 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_config *src;
 	struct context *ctx;
 	GSList *l;
-	int idx, offset;
+	const uint8_t *data;
+	uint64_t num_samples, count;
+	int offset;
 	uint64_t i, j;
-	gchar *p, c;
 
 	*out = NULL;
 	if (!o || !o->sdi)
@@ -154,38 +222,42 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		} else
 			*out = g_string_sized_new(512);
 
+		/*
+		 * Handle the samples up to the end of the current line
+		 * by channel, then flush the lines when they are full.
+		 */
 		logic = packet->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			ctx->spl_cnt++;
+		data = logic->data;
+		num_samples = logic->length / logic->unitsize;
+		while (num_samples) {
+			count = num_samples;
+			if (ctx->spl > 0)
+				count = MIN(count, (uint64_t)(ctx->spl - ctx->spl_cnt));
+			for (j = 0; j < ctx->num_enabled_channels; j++)
+				append_bits(ctx, j, data, logic->unitsize, count);
+			ctx->spl_cnt += count;
+			data += count * logic->unitsize;
+			num_samples -= count;
+			if (ctx->spl_cnt != ctx->spl)
+				continue;
+
+			/* Flush line buffers. */
 			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				p = logic->data + i + idx / 8;
-				c = (*p & (1 << (idx % 8))) ? '1' : '0';
-				g_string_append_c(ctx->lines[j], c);
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j == ctx->num_enabled_channels - 1 && ctx->trigger > -1) {
-						/*
-						 * Sample data lines have one character per bit,
-						 * plus one separator per byte. Align trigger marker
-						 * to this layout.
-						 */
-						offset = ctx->trigger + ctx->trigger / 8;
-						g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
-						ctx->trigger = -1;
-					}
-					g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
-				} else if ((ctx->spl_cnt & 7) == 0) {
-					/* Add a space every 8th bit. */
-					g_string_append_c(ctx->lines[j], ' ');
-				}
+				g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
+				g_string_append_c(*out, '\n');
+				g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
+			}
+			if (ctx->trigger > -1) {
+				/*
+				 * Sample data lines have one character per bit,
+				 * plus one separator per byte. Align trigger marker
+				 * to this layout.
+				 */
+				offset = ctx->trigger + ctx->trigger / 8;
+				g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
+				ctx->trigger = -1;
 			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
-				ctx->spl_cnt = 0;
+			ctx->spl_cnt = 0;
 		}
 		break;
 	case SR_DF_END:
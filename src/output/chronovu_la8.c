@@ -104,21 +104,24 @@ static int init(struct sr_output *o, GHashTable *options)
 	return SR_OK;
 }
 
-static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
-		GString **out)
+static int receive_iov(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		sr_output_write_callback cb, void *cb_data)
 {
 	const struct sr_datafeed_logic *logic;
 	struct context *ctx;
+	struct sr_output_iov iov[2];
 	GVariant *gvar;
 	uint64_t samplerate;
-	gchar c[4];
+	uint8_t c[4];
+	int ret;
 
-	*out = NULL;
 	if (!o || !o->sdi)
 		return SR_ERR_ARG;
 	if (!(ctx = o->priv))
 		return SR_ERR_ARG;
 
+	ret = SR_OK;
 	switch (packet->type) {
 	case SR_DF_HEADER:
 		/* One byte for the 'divcount' value. */
@@ -129,41 +132,48 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		} else
 			samplerate = 0;
 		c[0] = samplerate_to_divcount(samplerate);
-		*out = g_string_new_len(c, 1);
+		iov[0].data = c;
+		iov[0].len = 1;
+		ret = cb(iov, 1, cb_data);
 		ctx->triggered = FALSE;
 		break;
 	case SR_DF_TRIGGER:
 		/* Four bytes (little endian) for the trigger point. */
-		c[0] = ctx->samplecount & 0xff;
-		c[1] = (ctx->samplecount >> 8) & 0xff;
-		c[2] = (ctx->samplecount >> 16) & 0xff;
-		c[3] = (ctx->samplecount >> 24) & 0xff;
-		*out = g_string_new_len(c, 4);
+		WL32(c, ctx->samplecount);
+		iov[0].data = c;
+		iov[0].len = 4;
 		/* Flush the pre-trigger buffer. */
-		if (ctx->pretrig_buf->len)
-			g_string_append_len(*out, ctx->pretrig_buf->str,
-					ctx->pretrig_buf->len);
+		iov[1].data = ctx->pretrig_buf->str;
+		iov[1].len = ctx->pretrig_buf->len;
+		ret = cb(iov, iov[1].len ? 2 : 1, cb_data);
+		g_string_truncate(ctx->pretrig_buf, 0);
 		ctx->triggered = TRUE;
 		break;
 	case SR_DF_LOGIC:
 		logic = packet->payload;
-		if (!ctx->triggered)
+		if (!ctx->triggered) {
 			g_string_append_len(ctx->pretrig_buf, logic->data, logic->length);
-		else
-			*out = g_string_new_len(logic->data, logic->length);
+		} else if (logic->length) {
+			iov[0].data = logic->data;
+			iov[0].len = logic->length;
+			ret = cb(iov, 1, cb_data);
+		}
 		ctx->samplecount += logic->length / logic->unitsize;
 		break;
 	case SR_DF_END:
 		if (!ctx->triggered && ctx->pretrig_buf->len) {
 			/* We never got a trigger, submit an empty one. */
-			*out = g_string_sized_new(ctx->pretrig_buf->len + 4);
-			g_string_append_len(*out, "\x00\x00\x00\x00", 4);
-			g_string_append_len(*out, ctx->pretrig_buf->str, ctx->pretrig_buf->len);
+			memset(c, 0, sizeof(c));
+			iov[0].data = c;
+			iov[0].len = 4;
+			iov[1].data = ctx->pretrig_buf->str;
+			iov[1].len = ctx->pretrig_buf->len;
+			ret = cb(iov, 2, cb_data);
 		}
 		break;
 	}
 
-	return SR_OK;
+	return ret;
 }
 
 static int cleanup(struct sr_output *o)
@@ -189,9 +199,9 @@ SR_PRIV struct sr_output_module output_chronovu_la8 = {
 	.name = "ChronoVu LA8",
 	.desc = "ChronoVu LA8 native file format data",
 	.exts = (const char*[]){"kdt", NULL},
-	.flags = 0,
+	.flags = SR_OUTPUT_ZERO_COPY,
 	.options = NULL,
 	.init = init,
-	.receive = receive,
+	.receive_iov = receive_iov,
 	.cleanup = cleanup,
 };
@@ -0,0 +1,659 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Columnar binary output, for analysis tools which memory-map the file.
+ *
+ * The file starts with the 8 bytes "SRCOLUMN" and the length of a JSON
+ * header as an unsigned 64 bit little endian number. The JSON text comes
+ * next. It describes the capture and lists the columns, one per enabled
+ * channel, with their offset and size in bytes within the file. Every
+ * column starts at a multiple of the "align" option. Padding is zeros.
+ *
+ * Columns are contiguous little endian arrays:
+ * - Analog channels: "<f4" values, one per sample.
+ * - Logic channels, "bitplane" encoding: one bit per sample, the first
+ *   sample in the LSB of the first byte (numpy's bitorder "little").
+ * - Logic channels, "transitions" encoding: "<u8" sample numbers where
+ *   the channel's level changes, with the level of the first sample in
+ *   the header's "initial" field.
+ *
+ * The columns' sizes are only known at the end of the capture. So their
+ * data is kept in a temporary file per column next to the output file,
+ * and the output file is assembled when the capture ends.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "output/columnar"
+
+#define FILE_MAGIC		"SRCOLUMN"
+#define FORMAT_VERSION		1
+#define DEFAULT_ALIGN		4096
+/* Buffered column data before it gets written to the column's file. */
+#define COLUMN_BUFFER_SIZE	(64 * 1024)
+#define COPY_BUFFER_SIZE	(1024 * 1024)
+
+enum logic_encoding {
+	LOGIC_BITPLANE,
+	LOGIC_TRANSITIONS,
+};
+
+struct column {
+	const struct sr_channel *ch;
+	char *spool_name;
+	FILE *spool;
+	/* Number of samples, and number of bytes in the file. */
+	uint64_t samples;
+	uint64_t size;
+	/* Data not written yet. Bitplanes keep a partial last byte. */
+	uint8_t *buffer;
+	size_t buffer_len;
+	/* Logic transitions: level of the first and of the last sample. */
+	uint64_t transitions;
+	uint8_t initial, level;
+	/* Filled in when the file gets assembled. */
+	uint64_t offset;
+};
+
+struct out_context {
+	char *filename;
+	enum logic_encoding logic_encoding;
+	uint64_t align;
+	uint64_t samplerate;
+	size_t num_columns;
+	struct column *columns;
+	GArray *triggers;
+	float *fdata;
+	size_t fdata_size;
+	gboolean finished;
+};
+
+static int column_write(struct column *col, const void *data, size_t len)
+{
+	if (fwrite(data, 1, len, col->spool) != len) {
+		sr_err("Cannot write column data to '%s': %s.",
+			col->spool_name, g_strerror(errno));
+		return SR_ERR_IO;
+	}
+	col->size += len;
+
+	return SR_OK;
+}
+
+/* Write the complete part of the buffered data. */
+static int column_flush(struct column *col, gboolean final)
+{
+	size_t len;
+	int ret;
+
+	len = col->buffer_len;
+	if (col->ch->type == SR_CHANNEL_LOGIC && !final)
+		len = MIN(len, col->samples / 8 - col->size);
+	if (!len)
+		return SR_OK;
+
+	ret = column_write(col, col->buffer, len);
+	if (ret != SR_OK)
+		return ret;
+	memmove(col->buffer, col->buffer + len, col->buffer_len - len);
+	col->buffer_len -= len;
+
+	return SR_OK;
+}
+
+/* Append one logic channel's bits of the packet's samples. */
+static int append_bitplane(struct column *col, const uint8_t *data,
+	size_t unitsize, size_t count)
+{
+	size_t bytepos, i;
+	uint8_t bitmask, bitpos;
+	int ret;
+
+	bytepos = col->ch->index / 8;
+	bitmask = 1 << (col->ch->index % 8);
+	for (i = 0; i < count; i++) {
+		if (col->buffer_len == COLUMN_BUFFER_SIZE) {
+			ret = column_flush(col, FALSE);
+			if (ret != SR_OK)
+				return ret;
+		}
+		bitpos = col->samples % 8;
+		if (!bitpos)
+			col->buffer[col->buffer_len++] = 0;
+		if (bytepos < unitsize && (data[bytepos] & bitmask))
+			col->buffer[col->buffer_len - 1] |= 1 << bitpos;
+		col->samples++;
+		data += unitsize;
+	}
+
+	return SR_OK;
+}
+
+/* Append the sample numbers of the packet's changes of one channel. */
+static int append_transitions(struct column *col, const uint8_t *data,
+	size_t unitsize, size_t count)
+{
+	size_t bytepos, i;
+	uint8_t bitmask, level;
+	int ret;
+
+	bytepos = col->ch->index / 8;
+	bitmask = 1 << (col->ch->index % 8);
+	for (i = 0; i < count; i++) {
+		level = bytepos < unitsize && (data[bytepos] & bitmask);
+		data += unitsize;
+		if (!col->samples++) {
+			col->initial = col->level = level;
+			continue;
+		}
+		if (level == col->level)
+			continue;
+		col->level = level;
+		if (col->buffer_len + 8 > COLUMN_BUFFER_SIZE) {
+			ret = column_flush(col, TRUE);
+			if (ret != SR_OK)
+				return ret;
+		}
+		WL64(&col->buffer[col->buffer_len], col->samples - 1);
+		col->buffer_len += 8;
+		col->transitions++;
+	}
+
+	return SR_OK;
+}
+
+static int append_analog(struct column *col, const float *values,
+	size_t stride, size_t count)
+{
+	size_t i;
+	int ret;
+
+	for (i = 0; i < count; i++) {
+		if (col->buffer_len + 4 > COLUMN_BUFFER_SIZE) {
+			ret = column_flush(col, TRUE);
+			if (ret != SR_OK)
+				return ret;
+		}
+		write_fltle(&col->buffer[col->buffer_len], values[i * stride]);
+		col->buffer_len += 4;
+		col->samples++;
+	}
+
+	return SR_OK;
+}
+
+static void json_append_string(GString *s, const char *text)
+{
+	g_string_append_c(s, '"');
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\')
+			g_string_append_printf(s, "\\%c", *text);
+		else if ((unsigned char)*text < 0x20)
+			g_string_append_printf(s, "\\u%04x", *text);
+		else
+			g_string_append_c(s, *text);
+	}
+	g_string_append_c(s, '"');
+}
+
+static GString *gen_header(const struct out_context *outc)
+{
+	const struct column *col;
+	GString *s;
+	size_t i;
+
+	s = g_string_sized_new(1024);
+	g_string_append_printf(s, "{\"format\": \"sigrok-columnar\", "
+		"\"version\": %d, \"samplerate\": %" PRIu64
+		", \"alignment\": %" PRIu64 ", \"triggers\": [",
+		FORMAT_VERSION, outc->samplerate, outc->align);
+	for (i = 0; i < outc->triggers->len; i++)
+		g_string_append_printf(s, "%s%" PRIu64, i ? ", " : "",
+			g_array_index(outc->triggers, uint64_t, i));
+	g_string_append(s, "], \"columns\": [");
+	for (i = 0; i < outc->num_columns; i++) {
+		col = &outc->columns[i];
+		g_string_append(s, i ? ",\n" : "\n");
+		g_string_append(s, "  {\"name\": ");
+		json_append_string(s, col->ch->name);
+		if (col->ch->type == SR_CHANNEL_ANALOG) {
+			g_string_append(s, ", \"type\": \"analog\", "
+				"\"dtype\": \"<f4\"");
+		} else if (outc->logic_encoding == LOGIC_BITPLANE) {
+			g_string_append(s, ", \"type\": \"logic\", "
+				"\"encoding\": \"bitplane\", "
+				"\"dtype\": \"|u1\", \"bitorder\": \"little\"");
+		} else {
+			g_string_append_printf(s, ", \"type\": \"logic\", "
+				"\"encoding\": \"transitions\", "
+				"\"dtype\": \"<u8\", \"initial\": %d, "
+				"\"count\": %" PRIu64, col->initial,
+				col->transitions);
+		}
+		g_string_append_printf(s, ", \"samples\": %" PRIu64
+			", \"offset\": %" PRIu64 ", \"size\": %" PRIu64 "}",
+			col->samples, col->offset, col->size);
+	}
+	g_string_append(s, "\n]}\n");
+
+	return s;
+}
+
+static uint64_t align_up(uint64_t value, uint64_t align)
+{
+	return (value + align - 1) / align * align;
+}
+
+/*
+ * Find the columns' offsets. They depend on the header's size, which
+ * in turn depends on the offsets' text. Grow the space for the header
+ * until the text fits.
+ */
+static GString *layout_columns(struct out_context *outc)
+{
+	GString *header;
+	uint64_t header_space, offset;
+	size_t i;
+
+	header_space = outc->align;
+	while (1) {
+		offset = header_space;
+		for (i = 0; i < outc->num_columns; i++) {
+			outc->columns[i].offset = offset;
+			offset = align_up(offset + outc->columns[i].size,
+				outc->align);
+		}
+		header = gen_header(outc);
+		if (16 + header->len <= header_space)
+			return header;
+		header_space = align_up(16 + header->len, outc->align);
+		g_string_free(header, TRUE);
+	}
+}
+
+static int write_padding(FILE *file, uint64_t len, const char *filename)
+{
+	static const uint8_t zeros[256];
+	size_t chunk;
+
+	while (len) {
+		chunk = MIN(len, sizeof(zeros));
+		if (fwrite(zeros, 1, chunk, file) != chunk) {
+			sr_err("Cannot write to '%s': %s.", filename,
+				g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		len -= chunk;
+	}
+
+	return SR_OK;
+}
+
+static int copy_column(FILE *file, struct column *col, uint8_t *buf,
+	const char *filename)
+{
+	size_t len;
+
+	if (fflush(col->spool) != 0 || fseek(col->spool, 0, SEEK_SET) != 0) {
+		sr_err("Cannot read back '%s': %s.", col->spool_name,
+			g_strerror(errno));
+		return SR_ERR_IO;
+	}
+	while ((len = fread(buf, 1, COPY_BUFFER_SIZE, col->spool)) > 0) {
+		if (fwrite(buf, 1, len, file) != len) {
+			sr_err("Cannot write to '%s': %s.", filename,
+				g_strerror(errno));
+			return SR_ERR_IO;
+		}
+	}
+	if (ferror(col->spool)) {
+		sr_err("Cannot read back '%s'.", col->spool_name);
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+/* Write the header, then copy the columns to their offsets. */
+static int write_file(struct out_context *outc)
+{
+	struct column *col;
+	GString *header;
+	FILE *file;
+	uint8_t preamble[16], *buf;
+	uint64_t pos;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < outc->num_columns; i++) {
+		ret = column_flush(&outc->columns[i], TRUE);
+		if (ret != SR_OK)
+			return ret;
+	}
+	header = layout_columns(outc);
+
+	file = g_fopen(outc->filename, "wb");
+	if (!file) {
+		sr_err("Cannot create '%s': %s.", outc->filename,
+			g_strerror(errno));
+		g_string_free(header, TRUE);
+		return SR_ERR_IO;
+	}
+	buf = g_malloc(COPY_BUFFER_SIZE);
+
+	memcpy(preamble, FILE_MAGIC, 8);
+	WL64(&preamble[8], header->len);
+	ret = SR_OK;
+	if (fwrite(preamble, 1, sizeof(preamble), file) != sizeof(preamble) ||
+			fwrite(header->str, 1, header->len, file) != header->len) {
+		sr_err("Cannot write to '%s': %s.", outc->filename,
+			g_strerror(errno));
+		ret = SR_ERR_IO;
+	}
+	pos = sizeof(preamble) + header->len;
+	for (i = 0; ret == SR_OK && i < outc->num_columns; i++) {
+		col = &outc->columns[i];
+		ret = write_padding(file, col->offset - pos, outc->filename);
+		if (ret == SR_OK)
+			ret = copy_column(file, col, buf, outc->filename);
+		pos = col->offset + col->size;
+	}
+	if (fclose(file) != 0 && ret == SR_OK) {
+		sr_err("Cannot write to '%s': %s.", outc->filename,
+			g_strerror(errno));
+		ret = SR_ERR_IO;
+	}
+
+	g_free(buf);
+	g_string_free(header, TRUE);
+
+	return ret;
+}
+
+static void free_columns(struct out_context *outc)
+{
+	struct column *col;
+	size_t i;
+
+	for (i = 0; i < outc->num_columns; i++) {
+		col = &outc->columns[i];
+		if (col->spool) {
+			fclose(col->spool);
+			g_unlink(col->spool_name);
+		}
+		g_free(col->spool_name);
+		g_free(col->buffer);
+	}
+	g_free(outc->columns);
+	outc->columns = NULL;
+	outc->num_columns = 0;
+}
+
+static void free_context(struct out_context *outc)
+{
+	free_columns(outc);
+	if (outc->triggers)
+		g_array_free(outc->triggers, TRUE);
+	g_free(outc->fdata);
+	g_free(outc->filename);
+	g_free(outc);
+}
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct out_context *outc;
+	struct sr_channel *ch;
+	struct column *col;
+	const char *encoding;
+	GSList *l;
+	size_t count;
+
+	if (!o->filename || o->filename[0] == '\0') {
+		sr_info("columnar output module requires a file name, cannot save.");
+		return SR_ERR_ARG;
+	}
+
+	outc = g_malloc0(sizeof(*outc));
+	outc->filename = g_strdup(o->filename);
+	outc->triggers = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	outc->align = g_variant_get_uint32(g_hash_table_lookup(options, "align"));
+	if (outc->align < 8 || (outc->align & (outc->align - 1))) {
+		sr_err("Alignment must be a power of two, at least 8.");
+		free_context(outc);
+		return SR_ERR_ARG;
+	}
+	encoding = g_variant_get_string(g_hash_table_lookup(options,
+		"logic"), NULL);
+	if (g_ascii_strcasecmp(encoding, "bitplane") == 0) {
+		outc->logic_encoding = LOGIC_BITPLANE;
+	} else if (g_ascii_strcasecmp(encoding, "transitions") == 0) {
+		outc->logic_encoding = LOGIC_TRANSITIONS;
+	} else {
+		sr_err("Unknown logic encoding '%s'.", encoding);
+		free_context(outc);
+		return SR_ERR_ARG;
+	}
+
+	/* One column per enabled channel, each with its own file. */
+	count = 0;
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->enabled && (ch->type == SR_CHANNEL_LOGIC ||
+				ch->type == SR_CHANNEL_ANALOG))
+			count++;
+	}
+	outc->columns = g_new0(struct column, count);
+	for (l = o->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (!ch->enabled || (ch->type != SR_CHANNEL_LOGIC &&
+				ch->type != SR_CHANNEL_ANALOG))
+			continue;
+		col = &outc->columns[outc->num_columns++];
+		col->ch = ch;
+		col->buffer = g_malloc(COLUMN_BUFFER_SIZE);
+		col->spool_name = g_strdup_printf("%s.%zu.tmp",
+			outc->filename, outc->num_columns - 1);
+		col->spool = g_fopen(col->spool_name, "w+b");
+		if (!col->spool) {
+			sr_err("Cannot create '%s': %s.", col->spool_name,
+				g_strerror(errno));
+			free_context(outc);
+			return SR_ERR_IO;
+		}
+	}
+	o->priv = outc;
+
+	return SR_OK;
+}
+
+static int receive_logic(struct out_context *outc,
+	const struct sr_datafeed_logic *logic)
+{
+	struct column *col;
+	size_t count, i;
+	int ret;
+
+	if (!logic->unitsize)
+		return SR_ERR_ARG;
+	count = logic->length / logic->unitsize;
+	for (i = 0; i < outc->num_columns; i++) {
+		col = &outc->columns[i];
+		if (col->ch->type != SR_CHANNEL_LOGIC)
+			continue;
+		if (outc->logic_encoding == LOGIC_BITPLANE)
+			ret = append_bitplane(col, logic->data,
+				logic->unitsize, count);
+		else
+			ret = append_transitions(col, logic->data,
+				logic->unitsize, count);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static int receive_analog(struct out_context *outc,
+	const struct sr_datafeed_analog *analog)
+{
+	struct column *col;
+	const GSList *l;
+	size_t num_channels, size, i, j;
+	float *fdata;
+	int ret;
+
+	num_channels = g_slist_length(analog->meaning->channels);
+	size = analog->num_samples * num_channels;
+	if (size > outc->fdata_size) {
+		fdata = g_try_realloc(outc->fdata, size * sizeof(float));
+		if (!fdata)
+			return SR_ERR_MALLOC;
+		outc->fdata = fdata;
+		outc->fdata_size = size;
+	}
+	ret = sr_analog_to_float(analog, outc->fdata);
+	if (ret != SR_OK)
+		return ret;
+
+	for (l = analog->meaning->channels, j = 0; l; l = l->next, j++) {
+		for (i = 0; i < outc->num_columns; i++) {
+			col = &outc->columns[i];
+			if (col->ch != l->data)
+				continue;
+			ret = append_analog(col, &outc->fdata[j],
+				num_channels, analog->num_samples);
+			if (ret != SR_OK)
+				return ret;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Triggers are kept as the number of samples seen so far. */
+static uint64_t current_sample(const struct out_context *outc)
+{
+	uint64_t samples;
+	size_t i;
+
+	samples = 0;
+	for (i = 0; i < outc->num_columns; i++)
+		samples = MAX(samples, outc->columns[i].samples);
+
+	return samples;
+}
+
+static int receive(const struct sr_output *o,
+	const struct sr_datafeed_packet *packet, GString **out)
+{
+	struct out_context *outc;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	GSList *l;
+	GVariant *gvar;
+	uint64_t snum;
+
+	*out = NULL;
+	if (!o || !o->sdi || !(outc = o->priv))
+		return SR_ERR_ARG;
+	if (outc->finished)
+		return SR_OK;
+
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			outc->samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_TRIGGER:
+		snum = current_sample(outc);
+		g_array_append_val(outc->triggers, snum);
+		break;
+	case SR_DF_LOGIC:
+		return receive_logic(outc, packet->payload);
+	case SR_DF_ANALOG:
+		return receive_analog(outc, packet->payload);
+	case SR_DF_END:
+		if (!outc->samplerate && sr_config_get(o->sdi->driver, o->sdi,
+				NULL, SR_CONF_SAMPLERATE, &gvar) == SR_OK) {
+			outc->samplerate = g_variant_get_uint64(gvar);
+			g_variant_unref(gvar);
+		}
+		outc->finished = TRUE;
+		return write_file(outc);
+	}
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{"logic", "Logic encoding", "Logic channel columns as bitplane, or as transitions", NULL, NULL},
+	{"align", "Alignment", "Alignment of the columns in bytes, a power of two", NULL, NULL},
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	GSList *l = NULL;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string("bitplane"));
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("bitplane")));
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("transitions")));
+		options[0].values = l;
+		options[1].def = g_variant_ref_sink(g_variant_new_uint32(DEFAULT_ALIGN));
+	}
+
+	return options;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct out_context *outc;
+
+	outc = o->priv;
+	if (!outc)
+		return SR_OK;
+	free_context(outc);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_output_module output_columnar = {
+	.id = "columnar",
+	.name = "Columnar",
+	.desc = "Columnar binary data with a JSON header, for memory mapping",
+	.exts = (const char*[]){"srcol", NULL},
+	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -83,10 +83,17 @@ struct context {
 	gboolean do_trigger;
 	gboolean dedup;
 
+	/* Separator lengths, and logic values with their separator. */
+	size_t value_len, record_len;
+	char *logic_text[2];
+	size_t logic_text_len;
+
 	/* Plot data */
 	unsigned int num_analog_channels;
 	unsigned int num_logic_channels;
 	struct ctx_channel *channels;
+	/* Per enabled analog channel, its entry in channels[]. */
+	size_t *analog_channels;
 
 	/* Metadata */
 	gboolean trigger;
@@ -116,7 +123,7 @@ struct context {
 
 static int init(struct sr_output *o, GHashTable *options)
 {
-	unsigned int i, analog_channels, logic_channels;
+	unsigned int i, analog_idx, analog_channels, logic_channels;
 	struct context *ctx;
 	struct sr_channel *ch;
 	const char *label_string;
@@ -148,6 +155,12 @@ static int init(struct sr_output *o, GHashTable *options)
 	ctx->dedup = g_variant_get_boolean(g_hash_table_lookup(options, "dedup"));
 	ctx->dedup &= ctx->time;
 
+	ctx->value_len = strlen(ctx->value);
+	ctx->record_len = strlen(ctx->record);
+	ctx->logic_text[0] = g_strconcat("0", ctx->value, NULL);
+	ctx->logic_text[1] = g_strconcat("1", ctx->value, NULL);
+	ctx->logic_text_len = 1 + ctx->value_len;
+
 	if (*ctx->gnuplot && g_strcmp0(ctx->record, "\n"))
 		sr_warn("gnuplot record separator must be newline.");
 
@@ -186,9 +199,12 @@ static int init(struct sr_output *o, GHashTable *options)
 	}
 	ctx->channels = g_malloc(sizeof(struct ctx_channel)
 		* (ctx->num_analog_channels + ctx->num_logic_channels));
+	ctx->analog_channels = g_malloc0_n(ctx->num_analog_channels + 1,
+		sizeof(ctx->analog_channels[0]));
 
 	/* Once more to map the enabled channels. */
 	ctx->channel_count = g_slist_length(o->sdi->channels);
+	analog_idx = 0;
 	for (i = 0, l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
 		if (ch->enabled) {
@@ -203,6 +219,8 @@ static int init(struct sr_output *o, GHashTable *options)
 			}
 			if (ctx->label_do && ctx->label_names)
 				ctx->channels[i].label = ch->name;
+			if (ch->type == SR_CHANNEL_ANALOG)
+				ctx->analog_channels[analog_idx++] = i;
 			ctx->channels[i++].ch = ch;
 		}
 	}
@@ -318,10 +336,9 @@ static GString *gen_header(const struct sr_output *o,
 static void process_analog(struct context *ctx,
 			   const struct sr_datafeed_analog *analog)
 {
-	int ret;
-	size_t num_rcvd_ch, num_have_ch;
+	int ret, idx_send;
+	size_t num_rcvd_ch;
 	size_t idx_have, idx_smpl, idx_rcvd;
-	size_t idx_send;
 	struct sr_analog_meaning *meaning;
 	GSList *l;
 	float *fdata = NULL;
@@ -345,27 +362,23 @@ static void process_analog(struct context *ctx,
 	if ((ret = sr_analog_to_float(analog, fdata)) != SR_OK)
 		sr_warn("Problems converting data to floating point values.");
 
-	num_have_ch = ctx->num_analog_channels + ctx->num_logic_channels;
-	idx_send = 0;
-	for (idx_have = 0; idx_have < num_have_ch; idx_have++) {
-		if (ctx->channels[idx_have].ch->type != SR_CHANNEL_ANALOG)
+	for (l = meaning->channels, idx_rcvd = 0; l; l = l->next, idx_rcvd++) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_ANALOG)
 			continue;
-		sr_dbg("Looking for channel %s",
-		       ctx->channels[idx_have].ch->name);
-		for (l = meaning->channels, idx_rcvd = 0; l; l = l->next, idx_rcvd++) {
-			ch = l->data;
-			sr_dbg("Checking %s", ch->name);
-			if (ctx->channels[idx_have].ch != ch)
-				continue;
-			if (ctx->label_do && !ctx->label_names) {
-				sr_analog_unit_to_string(analog,
-					&ctx->channels[idx_have].label);
-			}
-			for (idx_smpl = 0; idx_smpl < analog->num_samples; idx_smpl++)
-				ctx->analog_samples[idx_smpl * ctx->num_analog_channels + idx_send] = fdata[idx_smpl * num_rcvd_ch + idx_rcvd];
-			break;
+		/* Enabled analog channels are in the same order here. */
+		idx_send = sr_dev_channel_slot(ch);
+		if (idx_send < 0 || (size_t)idx_send >= ctx->num_analog_channels)
+			continue;
+		idx_have = ctx->analog_channels[idx_send];
+		if (ctx->channels[idx_have].ch != ch)
+			continue;
+		if (ctx->label_do && !ctx->label_names) {
+			sr_analog_unit_to_string(analog,
+				&ctx->channels[idx_have].label);
 		}
-		idx_send++;
+		for (idx_smpl = 0; idx_smpl < analog->num_samples; idx_smpl++)
+			ctx->analog_samples[idx_smpl * ctx->num_analog_channels + idx_send] = fdata[idx_smpl * num_rcvd_ch + idx_rcvd];
 	}
 	g_free(fdata);
 }
@@ -407,6 +420,151 @@ static void process_logic(struct context *ctx,
 	}
 }
 
+/* Print a number in decimal, returns the number of characters. */
+static size_t format_decimal(char *text, uint64_t value)
+{
+	char digits[20];
+	size_t len, i;
+
+	len = 0;
+	do {
+		digits[len++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	for (i = 0; i < len; i++)
+		text[i] = digits[len - 1 - i];
+
+	return len;
+}
+
+/*
+ * Print a value the way "%g" does in the C locale, returns the number
+ * of characters. Six significant digits of a float's exact value are
+ * found with one double multiply or divide by an exact power of ten.
+ * Returns 0 for what that can't decide, like values close to a tie
+ * or outside the powers' range, and for NaN and infinity. Callers use
+ * the C library then.
+ */
+static size_t format_float_g(char *text, float value)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+		1e21, 1e22,
+	};
+	char digits[6], *p;
+	double v, scaled, frac;
+	uint32_t mant;
+	int exp, scale, count, i;
+
+	if (!isfinite(value))
+		return 0;
+
+	p = text;
+	if (signbit(value))
+		*p++ = '-';
+	v = fabs(value);
+	if (v == 0.0) {
+		*p++ = '0';
+		return p - text;
+	}
+
+	/* Scale to six digits before the point. */
+	exp = (int)floor(log10(v));
+	for (i = 0; i < 2; i++) {
+		scale = 5 - exp;
+		if (scale > 22 || scale < -22)
+			return 0;
+		scaled = scale >= 0 ? v * pow10[scale] : v / pow10[-scale];
+		if (scaled >= 1e6)
+			exp++;
+		else if (scaled < 1e5)
+			exp--;
+		else
+			break;
+	}
+	if (i == 2)
+		return 0;
+	mant = scaled;
+	frac = scaled - mant;
+	if (fabs(frac - 0.5) < 1e-6)
+		return 0;
+	if (frac > 0.5)
+		mant++;
+	if (mant == 1000000) {
+		mant = 100000;
+		exp++;
+	}
+
+	/* Significant digits, without trailing zeros. */
+	for (i = 5; i >= 0; i--) {
+		digits[i] = '0' + mant % 10;
+		mant /= 10;
+	}
+	count = 6;
+	while (count > 1 && digits[count - 1] == '0')
+		count--;
+
+	if (exp < -4 || exp >= 6) {
+		*p++ = digits[0];
+		if (count > 1)
+			*p++ = '.';
+		for (i = 1; i < count; i++)
+			*p++ = digits[i];
+		*p++ = 'e';
+		*p++ = exp < 0 ? '-' : '+';
+		exp = exp < 0 ? -exp : exp;
+		if (exp >= 10)
+			*p++ = '0' + exp / 10;
+		else
+			*p++ = '0';
+		*p++ = '0' + exp % 10;
+	} else if (exp >= 0) {
+		for (i = 0; i <= exp; i++)
+			*p++ = digits[i];
+		if (count > exp + 1)
+			*p++ = '.';
+		for (i = exp + 1; i < count; i++)
+			*p++ = digits[i];
+	} else {
+		*p++ = '0';
+		*p++ = '.';
+		for (i = 0; i < -exp - 1; i++)
+			*p++ = '0';
+		for (i = 0; i < count; i++)
+			*p++ = digits[i];
+	}
+
+	return p - text;
+}
+
+static void append_analog_value(struct context *ctx, GString *s, float value)
+{
+	char text[16];
+	size_t len;
+
+	len = format_float_g(text, value);
+	if (!len) {
+		g_string_append_printf(s, "%g%s", value, ctx->value);
+		return;
+	}
+	g_string_append_len(s, text, len);
+	g_string_append_len(s, ctx->value, ctx->value_len);
+}
+
+/*
+ * Have the string's allocation grow once for a chunk of samples, and
+ * not by repeated doubling while their text gets appended.
+ */
+static void reserve_text(GString *s, size_t size)
+{
+	size_t len;
+
+	len = s->len;
+	g_string_set_size(s, len + size);
+	g_string_truncate(s, len);
+}
+
 static void dump_saved_values(struct context *ctx, GString **out)
 {
 	unsigned int i, j, analog_size, num_channels;
@@ -414,6 +572,8 @@ static void dump_saved_values(struct context *ctx, GString **out)
 	uint64_t sample_time_u64;
 	float *analog_sample, value;
 	uint8_t *logic_sample;
+	size_t row_size, len;
+	char text[24];
 
 	/* If we haven't seen samples we're expecting, skip them. */
 	if ((ctx->num_analog_channels && !ctx->analog_samples) ||
@@ -449,6 +609,14 @@ static void dump_saved_values(struct context *ctx, GString **out)
 			ctx->label_do = FALSE;
 		}
 
+		/* Longest "%g" text is like "-1.23457e-38". */
+		row_size = ctx->record_len;
+		row_size += ctx->time ? 20 + ctx->value_len : 0;
+		row_size += ctx->num_analog_channels * (12 + ctx->value_len);
+		row_size += ctx->num_logic_channels * ctx->logic_text_len;
+		row_size += ctx->do_trigger ? ctx->logic_text_len : 0;
+		reserve_text(*out, (size_t)ctx->num_samples * row_size);
+
 		analog_size = ctx->num_analog_channels * sizeof(float);
 		if (ctx->dedup && !ctx->previous_sample)
 			ctx->previous_sample = g_malloc0(analog_size + ctx->num_logic_channels);
@@ -476,14 +644,17 @@ static void dump_saved_values(struct context *ctx, GString **out)
 			}
 
 			if (ctx->time && !ctx->sample_rate) {
-				g_string_append_printf(*out, "0%s", ctx->value);
+				g_string_append_len(*out, ctx->logic_text[0],
+					ctx->logic_text_len);
 			} else if (ctx->time) {
 				sample_time_dbl = ctx->out_sample_count++;
 				sample_time_dbl /= ctx->sample_rate;
 				sample_time_dbl *= ctx->sample_scale;
 				sample_time_u64 = sample_time_dbl;
-				g_string_append_printf(*out, "%" PRIu64 "%s",
-					sample_time_u64, ctx->value);
+				len = format_decimal(text, sample_time_u64);
+				g_string_append_len(*out, text, len);
+				g_string_append_len(*out, ctx->value,
+					ctx->value_len);
 			}
 
 			for (j = 0; j < num_channels; j++) {
@@ -493,11 +664,11 @@ static void dump_saved_values(struct context *ctx, GString **out)
 					    fmax(value, ctx->channels[j].max);
 					ctx->channels[j].min =
 					    fmin(value, ctx->channels[j].min);
-					g_string_append_printf(*out, "%g%s",
-						value, ctx->value);
+					append_analog_value(ctx, *out, value);
 				} else if (ctx->channels[j].ch->type == SR_CHANNEL_LOGIC) {
-					g_string_append_printf(*out, "%c%s",
-							       ctx->logic_samples[i * ctx->num_logic_channels + j] ? '1' : '0', ctx->value);
+					g_string_append_len(*out,
+						ctx->logic_text[ctx->logic_samples[i * ctx->num_logic_channels + j] ? 1 : 0],
+						ctx->logic_text_len);
 				} else {
 					sr_warn("Unexpected channel type: %d",
 						ctx->channels[i].ch->type);
@@ -505,12 +676,13 @@ static void dump_saved_values(struct context *ctx, GString **out)
 			}
 
 			if (ctx->do_trigger) {
-				g_string_append_printf(*out, "%d%s",
-					ctx->trigger, ctx->value);
+				g_string_append_len(*out,
+					ctx->logic_text[ctx->trigger ? 1 : 0],
+					ctx->logic_text_len);
 				ctx->trigger = FALSE;
 			}
 			g_string_truncate(*out, (*out)->len - 1);
-			g_string_append(*out, ctx->record);
+			g_string_append_len(*out, ctx->record, ctx->record_len);
 		}
 	}
 
@@ -730,8 +902,11 @@ static int cleanup(struct sr_output *o)
 		g_free((gpointer)ctx->comment);
 		g_free((gpointer)ctx->gnuplot);
 		g_free((gpointer)ctx->value);
+		g_free(ctx->logic_text[0]);
+		g_free(ctx->logic_text[1]);
 		g_free(ctx->previous_sample);
 		g_free(ctx->channels);
+		g_free(ctx->analog_channels);
 		g_free(o->priv);
 		o->priv = NULL;
 	}
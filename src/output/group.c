@@ -0,0 +1,412 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "output-group"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Feeding several output instances in parallel.
+ *
+ * An output group runs each of its outputs on a thread of its own. A
+ * packet sent to the group is copied once, and the copy is queued for
+ * all outputs, which release it when they are done with it. Exporting
+ * a capture to several formats then takes about as long as the slowest
+ * of them, instead of the sum of all.
+ */
+
+/**
+ * @addtogroup grp_output
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+/* Packets queued for an output before sending waits for it. */
+#define MAX_QUEUED	64
+
+/* A packet, queued for any number of outputs. */
+struct group_packet {
+	gint refcount;
+	struct sr_datafeed_packet *packet;
+	uint64_t samples;
+};
+
+struct group_output {
+	struct sr_output_group *group;
+	const struct sr_output *output;
+	sr_output_write_callback cb;
+	void *cb_data;
+	GThread *thread;
+	GCond cond;
+	/* Under the group mutex. */
+	GQueue queue;
+	int error;
+	struct sr_output_group_stats stats;
+};
+
+struct sr_output_group {
+	GMutex mutex;
+	/* Signalled when an output took a packet off its queue. */
+	GCond taken;
+	gboolean stop;
+	GPtrArray *outputs;
+};
+/** @endcond */
+
+static void packet_unref(struct group_packet *gp)
+{
+	if (!g_atomic_int_dec_and_test(&gp->refcount))
+		return;
+	sr_packet_free(gp->packet);
+	g_free(gp);
+}
+
+static uint64_t packet_samples(const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
+	const struct sr_datafeed_logic_packed *packed;
+	const struct sr_datafeed_analog *analog;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		return logic->unitsize ? logic->length / logic->unitsize : 0;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		return rle->num_samples;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		return planar->num_samples;
+	case SR_DF_LOGIC_PACKED:
+		packed = packet->payload;
+		return packed->num_samples;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		return analog->num_samples;
+	default:
+		return 0;
+	}
+}
+
+/* Count the output bytes on their way to the caller's callback. */
+static int write_output(const struct sr_output_iov *iov, size_t iovcnt,
+		void *cb_data)
+{
+	struct group_output *go;
+	uint64_t bytes;
+	size_t i;
+
+	go = cb_data;
+	bytes = 0;
+	for (i = 0; i < iovcnt; i++)
+		bytes += iov[i].len;
+	g_mutex_lock(&go->group->mutex);
+	go->stats.output_bytes += bytes;
+	g_mutex_unlock(&go->group->mutex);
+
+	return go->cb(iov, iovcnt, go->cb_data);
+}
+
+static gpointer output_thread(gpointer data)
+{
+	struct group_output *go;
+	struct sr_output_group *group;
+	struct group_packet *gp;
+	int64_t start, busy;
+	int ret;
+
+	go = data;
+	group = go->group;
+	g_mutex_lock(&group->mutex);
+	while (TRUE) {
+		while (g_queue_is_empty(&go->queue) && !group->stop)
+			g_cond_wait(&go->cond, &group->mutex);
+		gp = g_queue_pop_head(&go->queue);
+		if (!gp)
+			break;
+		g_cond_broadcast(&group->taken);
+		if (go->error != SR_OK) {
+			/* Drain the queue of an output which failed. */
+			g_mutex_unlock(&group->mutex);
+			packet_unref(gp);
+			g_mutex_lock(&group->mutex);
+			continue;
+		}
+		g_mutex_unlock(&group->mutex);
+
+		start = g_get_monotonic_time();
+		ret = sr_output_send_iov(go->output, gp->packet,
+			write_output, go);
+		busy = g_get_monotonic_time() - start;
+
+		g_mutex_lock(&group->mutex);
+		go->stats.packets++;
+		go->stats.samples += gp->samples;
+		go->stats.busy_us += busy;
+		if (ret != SR_OK) {
+			sr_err("Output '%s' failed: %s.",
+				go->output->module->id, sr_strerror(ret));
+			go->error = ret;
+		}
+		g_mutex_unlock(&group->mutex);
+		packet_unref(gp);
+		g_mutex_lock(&group->mutex);
+	}
+	g_mutex_unlock(&group->mutex);
+
+	return NULL;
+}
+
+/**
+ * Create a group of outputs which get fed in parallel.
+ *
+ * @param[out] group The new group.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_group_new(struct sr_output_group **group)
+{
+	struct sr_output_group *g;
+
+	if (!group)
+		return SR_ERR_ARG;
+
+	g = g_malloc0(sizeof(*g));
+	g_mutex_init(&g->mutex);
+	g_cond_init(&g->taken);
+	g->outputs = g_ptr_array_new();
+	*group = g;
+
+	return SR_OK;
+}
+
+/**
+ * Add an output to a group, and start its thread.
+ *
+ * The output receives the packets sent to the group from then on. Its
+ * output gets passed to the callback, which is called on the output's
+ * thread, see sr_output_send_iov(). The output stays owned by the
+ * caller, who may free it after the group.
+ *
+ * @param group The group.
+ * @param o The output instance.
+ * @param cb The callback to write the output.
+ * @param cb_data Opaque pointer passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_group_add(struct sr_output_group *group,
+		const struct sr_output *o,
+		sr_output_write_callback cb, void *cb_data)
+{
+	struct group_output *go;
+
+	if (!group || !o || !cb)
+		return SR_ERR_ARG;
+
+	go = g_malloc0(sizeof(*go));
+	go->group = group;
+	go->output = o;
+	go->cb = cb;
+	go->cb_data = cb_data;
+	g_cond_init(&go->cond);
+	g_queue_init(&go->queue);
+	go->thread = g_thread_new("sr-output", output_thread, go);
+
+	g_mutex_lock(&group->mutex);
+	g_ptr_array_add(group->outputs, go);
+	g_mutex_unlock(&group->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Send a packet to all outputs of a group.
+ *
+ * The packet is copied, the caller keeps ownership of it. This waits
+ * while an output has many packets queued, which keeps the memory in
+ * use bounded when an output cannot keep up.
+ *
+ * @param group The group.
+ * @param packet The packet.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other An output failed before, or the packet could not
+ *               be copied. Outputs which did not fail still get
+ *               the packet.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_group_send(struct sr_output_group *group,
+		const struct sr_datafeed_packet *packet)
+{
+	struct group_packet *gp;
+	struct group_output *go;
+	size_t i;
+	int ret;
+
+	if (!group || !packet)
+		return SR_ERR_ARG;
+
+	gp = g_malloc0(sizeof(*gp));
+	ret = sr_packet_copy(packet, &gp->packet);
+	if (ret != SR_OK) {
+		g_free(gp);
+		return ret;
+	}
+	gp->samples = packet_samples(packet);
+	/* Held by the sender until all outputs have it queued. */
+	gp->refcount = 1;
+
+	g_mutex_lock(&group->mutex);
+	for (i = 0; i < group->outputs->len; i++) {
+		go = g_ptr_array_index(group->outputs, i);
+		if (go->error != SR_OK) {
+			if (ret == SR_OK)
+				ret = go->error;
+			continue;
+		}
+		/* Pass-through outputs have nothing to do for other packets. */
+		if (packet->type != SR_DF_LOGIC &&
+				sr_output_test_flag(go->output->module,
+				SR_OUTPUT_PASSTHROUGH_LOGIC))
+			continue;
+		while (g_queue_get_length(&go->queue) >= MAX_QUEUED &&
+				go->error == SR_OK)
+			g_cond_wait(&group->taken, &group->mutex);
+		g_atomic_int_inc(&gp->refcount);
+		g_queue_push_tail(&go->queue, gp);
+		g_cond_signal(&go->cond);
+	}
+	g_mutex_unlock(&group->mutex);
+	packet_unref(gp);
+
+	return ret;
+}
+
+/**
+ * Get the statistics of an output in a group.
+ *
+ * The throughput of an output is its samples divided by its busy time.
+ *
+ * @param group The group.
+ * @param o The output instance.
+ * @param[out] stats The output's statistics.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the output is not in the group.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_group_stats(struct sr_output_group *group,
+		const struct sr_output *o, struct sr_output_group_stats *stats)
+{
+	struct group_output *go;
+	size_t i;
+	int ret;
+
+	if (!group || !o || !stats)
+		return SR_ERR_ARG;
+
+	ret = SR_ERR_ARG;
+	g_mutex_lock(&group->mutex);
+	for (i = 0; i < group->outputs->len; i++) {
+		go = g_ptr_array_index(group->outputs, i);
+		if (go->output != o)
+			continue;
+		*stats = go->stats;
+		stats->queued = g_queue_get_length(&go->queue);
+		stats->error = go->error;
+		ret = SR_OK;
+		break;
+	}
+	g_mutex_unlock(&group->mutex);
+
+	return ret;
+}
+
+/**
+ * Free a group, after its outputs have processed all queued packets.
+ *
+ * The outputs themselves are not freed.
+ *
+ * @param group The group.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other The first error of an output.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_group_free(struct sr_output_group *group)
+{
+	struct group_output *go;
+	size_t i;
+	int ret;
+
+	if (!group)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&group->mutex);
+	group->stop = TRUE;
+	for (i = 0; i < group->outputs->len; i++) {
+		go = g_ptr_array_index(group->outputs, i);
+		g_cond_signal(&go->cond);
+	}
+	g_mutex_unlock(&group->mutex);
+
+	ret = SR_OK;
+	for (i = 0; i < group->outputs->len; i++) {
+		go = g_ptr_array_index(group->outputs, i);
+		g_thread_join(go->thread);
+		sr_dbg("Output '%s': %" PRIu64 " packets, %" PRIu64
+			" samples, %" PRIu64 " bytes in %" PRIu64 " us.",
+			go->output->module->id, go->stats.packets,
+			go->stats.samples, go->stats.output_bytes,
+			go->stats.busy_us);
+		if (ret == SR_OK)
+			ret = go->error;
+		g_cond_clear(&go->cond);
+		g_free(go);
+	}
+	g_ptr_array_free(group->outputs, TRUE);
+	g_cond_clear(&group->taken);
+	g_mutex_clear(&group->mutex);
+	g_free(group);
+
+	return ret;
+}
+
+/** @} */
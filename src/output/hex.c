@@ -41,6 +41,8 @@ struct context {
 	uint8_t *sample_buf;
 	gboolean header_done;
 	GString **lines;
+	/* Text for a byte of samples, two hex digits and a separator. */
+	char hex_chars[256][3];
 };
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -57,6 +59,11 @@ static int init(struct sr_output *o, GHashTable *options)
 	o->priv = ctx;
 	ctx->trigger = -1;
 	ctx->spl = g_variant_get_uint32(g_hash_table_lookup(options, "width"));
+	for (i = 0; i < G_N_ELEMENTS(ctx->hex_chars); i++) {
+		ctx->hex_chars[i][0] = "0123456789abcdef"[i >> 4];
+		ctx->hex_chars[i][1] = "0123456789abcdef"[i & 0xf];
+		ctx->hex_chars[i][2] = ' ';
+	}
 
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -121,6 +128,45 @@ static GString *gen_header(const struct sr_output *o)
 	return header;
 }
 
+/*
+ * Append a channel's text for samples which all fit in the current
+ * line. Bits get shifted into the channel's sample buffer, which gets
+ * printed from the table for every 8th sample.
+ */
+static void append_hex(struct context *ctx, unsigned int chan,
+		const uint8_t *data, size_t unitsize, size_t count)
+{
+	GString *line;
+	size_t bytepos, len, k;
+	int bitpos, pos;
+	uint8_t bits;
+	char *wrptr;
+
+	bytepos = ctx->channel_index[chan] / 8;
+	bitpos = ctx->channel_index[chan] % 8;
+	pos = ctx->spl_cnt;
+	bits = ctx->sample_buf[chan];
+
+	/* Have room for all the text, then write it in place. */
+	line = ctx->lines[chan];
+	len = line->len;
+	g_string_set_size(line, len + 3 * (count / 8 + 1));
+	wrptr = line->str + len;
+	for (k = 0; k < count; k++) {
+		bits <<= 1;
+		bits |= (data[bytepos] >> bitpos) & 1;
+		data += unitsize;
+		if ((++pos & 7) == 0) {
+			/* Buffered a byte's worth, output hex. */
+			memcpy(wrptr, ctx->hex_chars[bits], 3);
+			wrptr += 3;
+			bits = 0;
+		}
+	}
+	g_string_truncate(line, wrptr - line->str);
+	ctx->sample_buf[chan] = bits;
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -129,9 +175,10 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_config *src;
 	GSList *l;
 	struct context *ctx;
-	int idx, pos, offset;
+	const uint8_t *data;
+	uint64_t num_samples, count;
+	int offset;
 	uint64_t i, j;
-	gchar *p;
 
 	*out = NULL;
 	if (!o || !o->sdi)
@@ -159,43 +206,42 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		} else
 			*out = g_string_sized_new(512);
 
+		/*
+		 * Handle the samples up to the end of the current line
+		 * by channel, then flush the lines when they are full.
+		 */
 		logic = packet->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			ctx->spl_cnt++;
-			pos = ctx->spl_cnt & 7;
+		data = logic->data;
+		num_samples = logic->length / logic->unitsize;
+		while (num_samples) {
+			count = num_samples;
+			if (ctx->spl > 0)
+				count = MIN(count, (uint64_t)(ctx->spl - ctx->spl_cnt));
+			for (j = 0; j < ctx->num_enabled_channels; j++)
+				append_hex(ctx, j, data, logic->unitsize, count);
+			ctx->spl_cnt += count;
+			data += count * logic->unitsize;
+			num_samples -= count;
+			if (ctx->spl_cnt != ctx->spl)
+				continue;
+
+			/* Flush line buffers. */
 			for (j = 0; j < ctx->num_enabled_channels; j++) {
-				idx = ctx->channel_index[j];
-				p = logic->data + i + idx / 8;
-				ctx->sample_buf[j] <<= 1;
-				if (*p & (1 << (idx % 8)))
-					ctx->sample_buf[j] |= 1;
-				if (ctx->spl_cnt && pos == 0) {
-					/* Buffered a byte's worth, output hex. */
-					g_string_append_printf(ctx->lines[j], "%.2x ",
-							ctx->sample_buf[j]);
-					ctx->sample_buf[j] = 0;
-				}
-
-				if (ctx->spl_cnt == ctx->spl) {
-					/* Flush line buffers. */
-					g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
-					g_string_append_c(*out, '\n');
-					if (j == ctx->num_enabled_channels - 1 && ctx->trigger > -1) {
-						/*
-						 * Sample data lines have one character per nibble,
-						 * plus one separator per byte. Align trigger marker
-						 * to this layout.
-						 */
-						offset = ctx->trigger / 4 + ctx->trigger / 8;
-						g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
-						ctx->trigger = -1;
-					}
-					g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
-				}
+				g_string_append_len(*out, ctx->lines[j]->str, ctx->lines[j]->len);
+				g_string_append_c(*out, '\n');
+				g_string_printf(ctx->lines[j], "%s:", ctx->channel_names[j]);
+			}
+			if (ctx->trigger > -1) {
+				/*
+				 * Sample data lines have one character per nibble,
+				 * plus one separator per byte. Align trigger marker
+				 * to this layout.
+				 */
+				offset = ctx->trigger / 4 + ctx->trigger / 8;
+				g_string_append_printf(*out, "T:%*s^ %d\n", offset, "", ctx->trigger);
+				ctx->trigger = -1;
 			}
-			if (ctx->spl_cnt == ctx->spl)
-				/* Line buffers were already flushed. */
-				ctx->spl_cnt = 0;
+			ctx->spl_cnt = 0;
 		}
 		break;
 	case SR_DF_END:
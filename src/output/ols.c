@@ -33,6 +33,11 @@
 
 #define LOG_PREFIX "output/ols"
 
+/* Longest sample index in decimal, a 64bit value has up to 20 digits. */
+#define MAX_INDEX_DIGITS 20
+
+static const char hex_digits[] = "0123456789abcdef";
+
 struct context {
 	uint64_t samplerate;
 	uint64_t num_samples;
@@ -86,6 +91,55 @@ static GString *gen_header(const struct sr_dev_inst *sdi, struct context *ctx)
 	return s;
 }
 
+/* Write a sample index in decimal, return the position after it. */
+static char *write_index(char *p, uint64_t value)
+{
+	char digits[MAX_INDEX_DIGITS];
+	size_t len;
+
+	len = 0;
+	do {
+		digits[len++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (len)
+		*p++ = digits[--len];
+
+	return p;
+}
+
+/*
+ * Format the samples as "<hex>@<index>" lines. The output string gets
+ * sized for the longest possible lines up front, and is written to
+ * directly.
+ */
+static void format_samples(struct context *ctx,
+	const struct sr_datafeed_logic *logic, GString *out)
+{
+	const uint8_t *sample;
+	size_t count, i, j, pos;
+	char *p;
+
+	count = logic->length / logic->unitsize;
+	pos = out->len;
+	g_string_set_size(out, pos +
+		count * (2 * logic->unitsize + MAX_INDEX_DIGITS + 2));
+	p = out->str + pos;
+	sample = logic->data;
+	for (i = 0; i < count; i++) {
+		/* The OLS format wants the samples presented MSB first. */
+		for (j = logic->unitsize; j > 0; j--) {
+			*p++ = hex_digits[sample[j - 1] >> 4];
+			*p++ = hex_digits[sample[j - 1] & 0xf];
+		}
+		*p++ = '@';
+		p = write_index(p, ctx->num_samples++);
+		*p++ = '\n';
+		sample += logic->unitsize;
+	}
+	g_string_truncate(out, p - out->str);
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -94,8 +148,6 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	const struct sr_datafeed_logic *logic;
 	const struct sr_config *src;
 	GSList *l;
-	unsigned int i, j;
-	uint8_t c;
 
 	*out = NULL;
 	if (!o || !o->sdi)
@@ -118,14 +170,7 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			*out = gen_header(o->sdi, ctx);
 		} else
 			*out = g_string_sized_new(512);
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			for (j = 0; j < logic->unitsize; j++) {
-				/* The OLS format wants the samples presented MSB first. */
-				c = *((uint8_t *)logic->data + i + logic->unitsize - 1 - j);
-				g_string_append_printf(*out, "%02x", c);
-			}
-			g_string_append_printf(*out, "@%"PRIu64"\n", ctx->num_samples++);
-		}
+		format_samples(ctx, logic, *out);
 		break;
 	}
 
@@ -57,6 +57,7 @@ extern SR_PRIV struct sr_output_module output_bits;
 extern SR_PRIV struct sr_output_module output_hex;
 extern SR_PRIV struct sr_output_module output_ascii;
 extern SR_PRIV struct sr_output_module output_binary;
+extern SR_PRIV struct sr_output_module output_columnar;
 extern SR_PRIV struct sr_output_module output_vcd;
 extern SR_PRIV struct sr_output_module output_ols;
 extern SR_PRIV struct sr_output_module output_chronovu_la8;
@@ -65,6 +66,7 @@ extern SR_PRIV struct sr_output_module output_analog;
 extern SR_PRIV struct sr_output_module output_srzip;
 extern SR_PRIV struct sr_output_module output_wav;
 extern SR_PRIV struct sr_output_module output_wavedrom;
+extern SR_PRIV struct sr_output_module output_shm;
 extern SR_PRIV struct sr_output_module output_null;
 /** @endcond */
 
@@ -72,6 +74,7 @@ static const struct sr_output_module *output_module_list[] = {
 	&output_ascii,
 	&output_binary,
 	&output_bits,
+	&output_columnar,
 	&output_csv,
 	&output_hex,
 	&output_ols,
@@ -81,6 +84,7 @@ static const struct sr_output_module *output_module_list[] = {
 	&output_srzip,
 	&output_wav,
 	&output_wavedrom,
+	&output_shm,
 	&output_null,
 	NULL,
 };
@@ -325,6 +329,25 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 	return op;
 }
 
+/* Collects the output of receive_iov() for modules without receive(). */
+static int append_iov(const struct sr_output_iov *iov, size_t iovcnt,
+		void *cb_data)
+{
+	GString **out;
+	size_t i, len;
+
+	out = cb_data;
+
+	for (len = 0, i = 0; i < iovcnt; i++)
+		len += iov[i].len;
+	if (!*out)
+		*out = g_string_sized_new(len);
+	for (i = 0; i < iovcnt; i++)
+		g_string_append_len(*out, iov[i].data, iov[i].len);
+
+	return SR_OK;
+}
+
 /**
  * Send a packet to the specified output instance.
  *
@@ -336,7 +359,109 @@ SR_API const struct sr_output *sr_output_new(const struct sr_output_module *omod
 SR_API int sr_output_send(const struct sr_output *o,
 		const struct sr_datafeed_packet *packet, GString **out)
 {
-	return o->module->receive(o, packet, out);
+	int ret;
+
+	if (o->module->receive)
+		return o->module->receive(o, packet, out);
+
+	*out = NULL;
+	ret = o->module->receive_iov(o, packet, append_iov, out);
+	if (ret != SR_OK && *out) {
+		g_string_free(*out, TRUE);
+		*out = NULL;
+	}
+
+	return ret;
+}
+
+/**
+ * Send a packet to the specified output instance, and have its output
+ * written by a callback.
+ *
+ * Unlike sr_output_send(), modules which pass on data they already
+ * hold, like the samples of a logic packet, don't need to copy it:
+ * the callback gets pointers to the pieces, in order, to write them
+ * with writev() or similar. The pieces are only valid during the call.
+ * The callback is not called for packets without output, and its
+ * return value other than SR_OK is returned.
+ *
+ * @param o The output instance. Must not be NULL.
+ * @param packet The packet. Must not be NULL.
+ * @param cb The callback to write the output. Must not be NULL.
+ * @param cb_data Opaque pointer passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other Error code returned by the module or the callback.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_send_iov(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		sr_output_write_callback cb, void *cb_data)
+{
+	struct sr_output_iov iov;
+	GString *out;
+	int ret;
+
+	if (!o || !packet || !cb)
+		return SR_ERR_ARG;
+
+	if (o->module->receive_iov)
+		return o->module->receive_iov(o, packet, cb, cb_data);
+
+	out = NULL;
+	ret = o->module->receive(o, packet, &out);
+	if (ret == SR_OK && out && out->len) {
+		iov.data = out->str;
+		iov.len = out->len;
+		ret = cb(&iov, 1, cb_data);
+	}
+	if (out)
+		g_string_free(out, TRUE);
+
+	return ret;
+}
+
+/**
+ * Write logic sample data to a pass-through output, without packets.
+ *
+ * For modules with the SR_OUTPUT_PASSTHROUGH_LOGIC flag, the output of
+ * a logic packet is its sample data. Frontends which have sample data
+ * in bulk, like a stored entry of an srzip file, can have it written
+ * in one go. Or they bypass the module entirely, once they checked the
+ * flag, and e.g. splice() the data to the output file.
+ *
+ * @param o The output instance. Must not be NULL.
+ * @param data The sample data. Must not be NULL.
+ * @param length The number of bytes of sample data.
+ * @param cb The callback to write the output. Must not be NULL.
+ * @param cb_data Opaque pointer passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The module is not a pass-through.
+ * @retval other Error code returned by the callback.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_output_write_samples(const struct sr_output *o,
+		const void *data, size_t length,
+		sr_output_write_callback cb, void *cb_data)
+{
+	struct sr_output_iov iov;
+
+	if (!o || !data || !cb)
+		return SR_ERR_ARG;
+	if (!(o->module->flags & SR_OUTPUT_PASSTHROUGH_LOGIC))
+		return SR_ERR_NA;
+	if (!length)
+		return SR_OK;
+
+	iov.data = data;
+	iov.len = length;
+
+	return cb(&iov, 1, cb_data);
 }
 
 /**
@@ -0,0 +1,345 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Publishes the datafeed into a POSIX shared memory ring, for other
+ * processes to read with sr_shm_reader_open(). See shm_ring.h for the
+ * layout. The writer never waits for readers; readers which fall behind
+ * by more than the ring lose packets, and see that from the sequence
+ * numbers. The module produces no output of its own.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#ifdef HAVE_SHM_OPEN
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "shm_ring.h"
+
+#define LOG_PREFIX "output/shm"
+
+#define DEFAULT_NAME "/sigrok"
+#define DEFAULT_SIZE (64 * 1024 * 1024)
+
+struct context {
+	char *name;
+	void *map;
+	size_t map_size;
+	struct shm_ring_header *hdr;
+	uint8_t *data;
+	uint32_t size;
+	guint head;
+	guint tail;
+	uint64_t seq;
+	float *fbuf;
+	size_t fbuf_len;
+};
+
+#ifdef HAVE_SHM_OPEN
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	struct context *ctx;
+	const char *name;
+	uint64_t size;
+	int fd;
+
+	name = g_variant_get_string(g_hash_table_lookup(options, "name"), NULL);
+	size = g_variant_get_uint64(g_hash_table_lookup(options, "size"));
+	if (name[0] != '/' || strchr(name + 1, '/')) {
+		sr_err("Shared memory name must be '/name'.");
+		return SR_ERR_ARG;
+	}
+	if (size < SHM_RING_MIN_SIZE || size > SHM_RING_MAX_SIZE ||
+			(size & (size - 1))) {
+		sr_err("Ring size must be a power of two, %d to %d bytes.",
+			SHM_RING_MIN_SIZE, SHM_RING_MAX_SIZE);
+		return SR_ERR_ARG;
+	}
+
+	ctx = g_malloc0(sizeof(*ctx));
+	ctx->name = g_strdup(name);
+	ctx->size = size;
+	ctx->map_size = SHM_RING_DATA_OFFSET + size;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		sr_err("Failed to create shared memory %s: %s.", name,
+			g_strerror(errno));
+		goto err;
+	}
+	if (ftruncate(fd, ctx->map_size) != 0) {
+		sr_err("Failed to size shared memory %s: %s.", name,
+			g_strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		goto err;
+	}
+	ctx->map = mmap(NULL, ctx->map_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	close(fd);
+	if (ctx->map == MAP_FAILED) {
+		sr_err("Failed to map shared memory %s: %s.", name,
+			g_strerror(errno));
+		shm_unlink(name);
+		goto err;
+	}
+
+	ctx->hdr = ctx->map;
+	ctx->data = (uint8_t *)ctx->map + SHM_RING_DATA_OFFSET;
+	ctx->hdr->version = SHM_RING_VERSION;
+	ctx->hdr->size = size;
+	g_atomic_int_set(&ctx->hdr->active, 1);
+	/* Readers check the magic last. */
+	memcpy(ctx->hdr->magic, SHM_RING_MAGIC, sizeof(ctx->hdr->magic));
+	o->priv = ctx;
+
+	return SR_OK;
+
+err:
+	g_free(ctx->name);
+	g_free(ctx);
+
+	return SR_ERR_IO;
+}
+
+/* Make room for len bytes at head, dropping the oldest records. */
+static void reserve(struct context *ctx, uint32_t len)
+{
+	const struct shm_record *rec;
+	guint tail;
+
+	tail = ctx->tail;
+	while (ctx->head + len - tail > ctx->size) {
+		rec = (const void *)(ctx->data + (tail & (ctx->size - 1)));
+		if (rec->type == SHM_RECORD_PAD)
+			tail += ctx->size - (tail & (ctx->size - 1));
+		else
+			tail += shm_record_bytes(rec->length);
+	}
+	if (tail != ctx->tail) {
+		ctx->tail = tail;
+		/* Full barrier: readers see it before the new bytes. */
+		g_atomic_int_set(&ctx->hdr->tail, tail);
+	}
+}
+
+static void publish(struct context *ctx, uint32_t type, uint32_t unitsize,
+		int channel, const void *payload, uint64_t length)
+{
+	struct shm_record *rec;
+	uint32_t len, off;
+
+	len = shm_record_bytes(length);
+	off = ctx->head & (ctx->size - 1);
+	if (off + len > ctx->size) {
+		reserve(ctx, ctx->size - off);
+		rec = (void *)(ctx->data + off);
+		memset(rec, 0, sizeof(*rec));
+		rec->type = SHM_RECORD_PAD;
+		ctx->head += ctx->size - off;
+		g_atomic_int_set(&ctx->hdr->head, ctx->head);
+		off = 0;
+	}
+	reserve(ctx, len);
+
+	rec = (void *)(ctx->data + off);
+	rec->seq = ctx->seq++;
+	rec->length = length;
+	rec->type = type;
+	rec->unitsize = unitsize;
+	rec->channel = channel;
+	rec->reserved = 0;
+	if (length)
+		memcpy(rec + 1, payload, length);
+	ctx->head += len;
+	g_atomic_int_set(&ctx->hdr->head, ctx->head);
+}
+
+/* Publish samples, split so that no record takes more than half the ring. */
+static void publish_samples(struct context *ctx, uint32_t type,
+		uint32_t unitsize, int channel, const uint8_t *data,
+		uint64_t length)
+{
+	uint64_t max, n;
+
+	max = ctx->size / 2 - sizeof(struct shm_record);
+	max -= max % unitsize;
+	do {
+		n = MIN(length, max);
+		publish(ctx, type, unitsize, channel, data, n);
+		data += n;
+		length -= n;
+	} while (length);
+}
+
+static int publish_analog(struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	struct sr_channel *ch;
+	size_t num;
+	int ret;
+
+	num = analog->num_samples * g_slist_length(analog->meaning->channels);
+	if (!num)
+		return SR_OK;
+	if (ctx->fbuf_len < num) {
+		g_free(ctx->fbuf);
+		ctx->fbuf = g_malloc(num * sizeof(float));
+		ctx->fbuf_len = num;
+	}
+	if ((ret = sr_analog_to_float(analog, ctx->fbuf)) != SR_OK)
+		return ret;
+	ch = analog->meaning->channels->data;
+	publish_samples(ctx, SR_DF_ANALOG, sizeof(float), ch->index,
+		(const uint8_t *)ctx->fbuf, num * sizeof(float));
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	const GSList *l;
+	uint64_t samplerate;
+
+	*out = NULL;
+	if (!(ctx = o->priv))
+		return SR_ERR_ARG;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		if (logic->length)
+			publish_samples(ctx, SR_DF_LOGIC, logic->unitsize, -1,
+				logic->data, logic->length);
+		break;
+	case SR_DF_ANALOG:
+		return publish_analog(ctx, packet->payload);
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			samplerate = g_variant_get_uint64(src->data);
+			publish(ctx, SR_DF_META, src->key, -1, &samplerate,
+				sizeof(samplerate));
+		}
+		break;
+	case SR_DF_HEADER:
+	case SR_DF_END:
+	case SR_DF_TRIGGER:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
+		publish(ctx, packet->type, 0, -1, NULL, 0);
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	struct context *ctx;
+
+	if (!(ctx = o->priv))
+		return SR_OK;
+
+	g_atomic_int_set(&ctx->hdr->active, 0);
+	/* Readers which have it mapped keep it, nobody new finds it. */
+	munmap(ctx->map, ctx->map_size);
+	shm_unlink(ctx->name);
+	g_free(ctx->name);
+	g_free(ctx->fbuf);
+	g_free(ctx);
+	o->priv = NULL;
+
+	return SR_OK;
+}
+
+#else
+
+static int init(struct sr_output *o, GHashTable *options)
+{
+	(void)o;
+	(void)options;
+
+	sr_err("Shared memory is not supported on this platform.");
+
+	return SR_ERR_NA;
+}
+
+static int receive(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString **out)
+{
+	(void)o;
+	(void)packet;
+
+	*out = NULL;
+
+	return SR_ERR_NA;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	(void)o;
+
+	return SR_OK;
+}
+
+#endif
+
+static struct sr_option options[] = {
+	{"name", "Name", "Shared memory object name, '/name'", NULL, NULL},
+	{"size", "Size", "Ring size in bytes, a power of two", NULL, NULL},
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string(DEFAULT_NAME));
+		options[1].def = g_variant_ref_sink(g_variant_new_uint64(DEFAULT_SIZE));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_output_module output_shm = {
+	.id = "shm",
+	.name = "Shared memory",
+	.desc = "Datafeed ring buffer in POSIX shared memory",
+	.exts = NULL,
+	.flags = SR_OUTPUT_INTERNAL_IO_HANDLING,
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -21,19 +21,159 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <math.h>
+#include <stdio.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
 #include <zip.h>
+#include <zstd.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
 #define LOG_PREFIX "output/srzip"
 #define CHUNK_SIZE (4 * 1024 * 1024)
+#define MIN_CHUNK_SIZE (4 * 1024)
+#define MAX_CHUNK_SIZE (1024 * 1024 * 1024)
+
+/*
+ * Summaries of the data, for drawing overviews and finding edges without
+ * reading the samples. The entry "summary-logic-1" summarizes the logic
+ * data, "summary-analog-1-N" analog channel N. Each has a header:
+ *
+ *   uint32_t version (1), uint32_t block shift, uint64_t number of samples
+ *
+ * followed by levels of blocks, the first level of blocks of 1 << shift
+ * samples, each next level of blocks twice the size, up to the level of
+ * a single block. A logic block has the unit size bytes of channels that
+ * change within the block, counting from the sample before it, and the
+ * unit size bytes of its first sample. An analog block has the minimum
+ * and maximum float value in it, also for integer analog chunks. All
+ * values are little endian, except the floats, which are in host order
+ * like float analog chunks.
+ */
+#define SUMMARY_VERSION		1
+#define SUMMARY_SHIFT		10
+#define SUMMARY_HEADER_SIZE	16
+
+/*
+ * ZIP archive writer that appends entries to the file as they come in,
+ * and writes the central directory only when the archive is finished.
+ * Every chunk costs the same, however many were written before.
+ */
+
+#define ZIP_LOCAL_HEADER	0x04034b50
+#define ZIP_CENTRAL_HEADER	0x02014b50
+#define ZIP64_END_RECORD	0x06064b50
+#define ZIP64_END_LOCATOR	0x07064b50
+#define ZIP_END_RECORD		0x06054b50
+
+#define ZIP_METHOD_STORE	0
+#define ZIP_METHOD_DEFLATE	8
+#define ZIP_METHOD_ZSTD		93
+
+/* Sizes and offsets from here on need ZIP64 records. */
+#define ZIP64_LIMIT		0xffffffffULL
+
+struct zip_entry {
+	char *name;
+	uint16_t method;
+	uint32_t crc;
+	uint64_t compressed_size;
+	uint64_t size;
+	uint64_t offset;
+};
+
+/* How entries get compressed, level 0 is the method's default. */
+struct zip_compressor {
+	uint16_t method;
+	int level;
+#ifdef HAVE_ZLIB
+	z_stream zstrm;
+	gboolean zstrm_ready;
+#endif
+#ifdef HAVE_LIBZSTD
+	ZSTD_CCtx *zcctx;
+#endif
+};
+
+/* An entry being compressed by a worker thread. */
+struct zip_job {
+	struct zip_entry entry;
+	uint8_t *data;
+	uint8_t *cbuf;
+	size_t cbuf_size;
+	const uint8_t *wrdata;
+	gboolean done;
+};
+
+struct zip_writer {
+	FILE *file;
+	uint64_t offset;
+	/* struct zip_entry, for the central directory. */
+	GArray *entries;
+	uint16_t dos_time;
+	uint16_t dos_date;
+	/*
+	 * Where the entries that get written over when continuing a
+	 * finished archive start, if there are any yet.
+	 */
+	gboolean finished;
+	gboolean trailing;
+	uint64_t last_offset;
+	guint last_entries;
+	/* For entries compressed by the calling thread. */
+	struct zip_compressor *comp;
+	uint8_t *cbuf;
+	size_t cbuf_size;
+	/*
+	 * Worker threads compress entries, each with a compressor taken
+	 * from the queue. The calling thread writes the entries in order.
+	 */
+	GThreadPool *pool;
+	GAsyncQueue *compressors;
+	GQueue jobs;
+	guint max_jobs;
+	GMutex mutex;
+	GCond cond;
+};
+
+struct summary {
+	size_t record_size;
+	uint64_t num_samples;
+	/* Complete blocks of the first level. */
+	GByteArray *blocks;
+	/* The block being filled, and the sample before, if there was one. */
+	uint8_t *block;
+	uint8_t *last;
+};
 
 struct out_context {
 	gboolean zip_created;
 	uint64_t samplerate;
 	char *filename;
+	uint16_t method;
+	int level;
+	unsigned int num_threads;
+	size_t chunk_size;
+	gboolean summarize;
+	/* Run-length encode the logic chunks, into the buffer. */
+	gboolean rle;
+	/* Keep integer analog data as it comes in, instead of floats. */
+	gboolean analog_raw;
+	uint8_t *rle_buf;
+	size_t rle_size;
+	struct summary *logic_summary;
+	struct summary **analog_summary;
+	struct zip_writer *writer;
+	GKeyFile *meta;
+	gboolean have_unitsize;
+	unsigned int next_logic_chunk;
+	unsigned int *next_analog_chunk;
 	size_t first_analog_index;
 	size_t analog_ch_count;
 	gint *analog_index_map;
@@ -44,25 +184,899 @@ struct out_context {
 		size_t fill_size;
 	} logic_buff;
 	struct analog_buff {
+		/* Bytes per sample in the chunks, 0 until the first packet. */
+		size_t unitsize;
+		/* The encoding of integer chunks, when kept raw. */
+		gboolean raw;
+		struct sr_analog_encoding encoding;
 		size_t alloc_size;
-		float *samples;
+		uint8_t *samples;
 		size_t fill_size;
 	} *analog_buff;
+	/* The chunk buffers' memory, see sr_mem_reserve(). */
+	struct sr_context *mem_ctx;
+	uint64_t mem_reserved;
 };
 
+#ifndef HAVE_ZLIB
+static uint32_t zip_crc32(const uint8_t *data, size_t len)
+{
+	static uint32_t table[256];
+	uint32_t crc, c;
+	int i, k;
+
+	if (!table[1]) {
+		for (i = 0; i < 256; i++) {
+			c = i;
+			for (k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+
+	crc = 0xffffffff;
+	while (len--)
+		crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+#endif
+
+static int zip_write(struct zip_writer *zw, const void *data, size_t len)
+{
+	if (len && fwrite(data, 1, len, zw->file) != len) {
+		sr_err("Cannot write session file: %s.", g_strerror(errno));
+		return SR_ERR_IO;
+	}
+	zw->offset += len;
+
+	return SR_OK;
+}
+
+static void zip_entry_clear(struct zip_entry *entry)
+{
+	g_free(entry->name);
+}
+
+static struct zip_compressor *zip_compressor_new(uint16_t method, int level)
+{
+	struct zip_compressor *zc;
+
+	zc = g_malloc0(sizeof(*zc));
+	zc->method = method;
+	zc->level = level;
+#ifdef HAVE_ZLIB
+	/* Raw deflate, the ZIP headers take the place of zlib's. */
+	if (method == ZIP_METHOD_DEFLATE) {
+		zc->zstrm_ready = deflateInit2(&zc->zstrm,
+			level ? level : Z_DEFAULT_COMPRESSION,
+			Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+		if (!zc->zstrm_ready)
+			zc->method = ZIP_METHOD_STORE;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	if (method == ZIP_METHOD_ZSTD) {
+		zc->zcctx = ZSTD_createCCtx();
+		if (!zc->zcctx)
+			zc->method = ZIP_METHOD_STORE;
+	}
+#endif
+	if (zc->method != method)
+		sr_warn("Cannot set up compression, storing data as is.");
+
+	return zc;
+}
+
+static void zip_compressor_free(struct zip_compressor *zc)
+{
+#ifdef HAVE_ZLIB
+	if (zc->zstrm_ready)
+		deflateEnd(&zc->zstrm);
+#endif
+#ifdef HAVE_LIBZSTD
+	ZSTD_freeCCtx(zc->zcctx);
+#endif
+	g_free(zc);
+}
+
+static gboolean zip_cbuf_reserve(uint8_t **cbuf, size_t *cbuf_size,
+		size_t size)
+{
+	uint8_t *buf;
+
+	if (size <= *cbuf_size)
+		return TRUE;
+	if (!(buf = g_try_realloc(*cbuf, size)))
+		return FALSE;
+	*cbuf = buf;
+	*cbuf_size = size;
+
+	return TRUE;
+}
+
+#ifdef HAVE_ZLIB
+static gboolean zip_deflate(struct zip_compressor *zc, const uint8_t *data,
+		size_t len, uint8_t **cbuf, size_t *cbuf_size,
+		size_t *compressed_size)
+{
+	size_t bound;
+
+	if (!zc->zstrm_ready || len > G_MAXUINT32)
+		return FALSE;
+
+	bound = deflateBound(&zc->zstrm, len);
+	if (!zip_cbuf_reserve(cbuf, cbuf_size, bound))
+		return FALSE;
+
+	deflateReset(&zc->zstrm);
+	zc->zstrm.next_in = (Bytef *)data;
+	zc->zstrm.avail_in = len;
+	zc->zstrm.next_out = *cbuf;
+	zc->zstrm.avail_out = bound;
+	if (deflate(&zc->zstrm, Z_FINISH) != Z_STREAM_END)
+		return FALSE;
+	*compressed_size = zc->zstrm.total_out;
+
+	return TRUE;
+}
+#endif
+
+#ifdef HAVE_LIBZSTD
+static gboolean zip_zstd(struct zip_compressor *zc, const uint8_t *data,
+		size_t len, uint8_t **cbuf, size_t *cbuf_size,
+		size_t *compressed_size)
+{
+	size_t bound, ret;
+
+	bound = ZSTD_compressBound(len);
+	if (!zip_cbuf_reserve(cbuf, cbuf_size, bound))
+		return FALSE;
+
+	ret = ZSTD_compressCCtx(zc->zcctx, *cbuf, bound, data, len,
+		zc->level ? zc->level : ZSTD_CLEVEL_DEFAULT);
+	if (ZSTD_isError(ret))
+		return FALSE;
+	*compressed_size = ret;
+
+	return TRUE;
+}
+#endif
+
+/* Compress data into the buffer, if that saves anything. */
+static gboolean zip_compress(struct zip_compressor *zc, const uint8_t *data,
+		size_t len, uint8_t **cbuf, size_t *cbuf_size,
+		size_t *compressed_size)
+{
+	gboolean ok;
+
+	if (!len)
+		return FALSE;
+
+	switch (zc->method) {
+#ifdef HAVE_ZLIB
+	case ZIP_METHOD_DEFLATE:
+		ok = zip_deflate(zc, data, len, cbuf, cbuf_size,
+			compressed_size);
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case ZIP_METHOD_ZSTD:
+		ok = zip_zstd(zc, data, len, cbuf, cbuf_size,
+			compressed_size);
+		break;
+#endif
+	default:
+		ok = FALSE;
+		break;
+	}
+
+	return ok && *compressed_size < len;
+}
+
+/*
+ * Fill in the entry for data, and get what is to be written for it:
+ * either the compressed data in the buffer, or the data itself.
+ */
+static const uint8_t *zip_entry_compress(struct zip_compressor *zc,
+		struct zip_entry *entry, const uint8_t *data, size_t len,
+		uint8_t **cbuf, size_t *cbuf_size)
+{
+	size_t compressed_size;
+
+	entry->size = len;
+#ifdef HAVE_ZLIB
+	entry->crc = crc32(0, data, len);
+#else
+	entry->crc = zip_crc32(data, len);
+#endif
+	if (zip_compress(zc, data, len, cbuf, cbuf_size, &compressed_size)) {
+		entry->method = zc->method;
+		entry->compressed_size = compressed_size;
+		return *cbuf;
+	}
+	entry->method = ZIP_METHOD_STORE;
+	entry->compressed_size = len;
+
+	return data;
+}
+
+static void zip_job_free(struct zip_job *job)
+{
+	g_free(job->entry.name);
+	g_free(job->data);
+	g_free(job->cbuf);
+	g_free(job);
+}
+
+static void zip_job_run(gpointer data, gpointer user_data)
+{
+	struct zip_job *job;
+	struct zip_writer *zw;
+	struct zip_compressor *zc;
+
+	job = data;
+	zw = user_data;
+
+	zc = g_async_queue_pop(zw->compressors);
+	job->wrdata = zip_entry_compress(zc, &job->entry, job->data,
+		job->entry.size, &job->cbuf, &job->cbuf_size);
+	g_async_queue_push(zw->compressors, zc);
+
+	g_mutex_lock(&zw->mutex);
+	job->done = TRUE;
+	g_cond_broadcast(&zw->cond);
+	g_mutex_unlock(&zw->mutex);
+}
+
+static struct zip_writer *zip_writer_new(const char *filename,
+		uint16_t method, int level, unsigned int num_threads)
+{
+	struct zip_writer *zw;
+	GDateTime *now;
+	unsigned int i;
+
+	zw = g_malloc0(sizeof(*zw));
+	zw->file = g_fopen(filename, "wb");
+	if (!zw->file) {
+		sr_err("Cannot create session file '%s': %s.", filename,
+			g_strerror(errno));
+		g_free(zw);
+		return NULL;
+	}
+	zw->entries = g_array_new(FALSE, FALSE, sizeof(struct zip_entry));
+	g_array_set_clear_func(zw->entries, (GDestroyNotify)zip_entry_clear);
+
+	now = g_date_time_new_now_local();
+	zw->dos_time = g_date_time_get_hour(now) << 11 |
+		g_date_time_get_minute(now) << 5 |
+		g_date_time_get_second(now) / 2;
+	zw->dos_date = MAX(0, g_date_time_get_year(now) - 1980) << 9 |
+		g_date_time_get_month(now) << 5 |
+		g_date_time_get_day_of_month(now);
+	g_date_time_unref(now);
+
+#ifndef HAVE_ZLIB
+	/* Set up the table, before threads use it. */
+	zip_crc32(NULL, 0);
+#endif
+	zw->comp = zip_compressor_new(method, level);
+	g_queue_init(&zw->jobs);
+	g_mutex_init(&zw->mutex);
+	g_cond_init(&zw->cond);
+
+	/* Storing data is about as fast as writing it. */
+	if (num_threads < 2 || zw->comp->method == ZIP_METHOD_STORE)
+		return zw;
+
+	zw->pool = g_thread_pool_new(zip_job_run, zw, num_threads, TRUE, NULL);
+	if (!zw->pool) {
+		sr_warn("Cannot start compression threads.");
+		return zw;
+	}
+	zw->compressors = g_async_queue_new();
+	for (i = 0; i < num_threads; i++)
+		g_async_queue_push(zw->compressors,
+			zip_compressor_new(method, level));
+	/* Enough to keep all threads busy while the oldest gets written. */
+	zw->max_jobs = 2 * num_threads;
+
+	return zw;
+}
+
+/* Version of the format needed to extract an entry. */
+static uint16_t zip_version_needed(const struct zip_entry *entry)
+{
+	if (entry->method == ZIP_METHOD_ZSTD)
+		return 63;
+	if (entry->offset >= ZIP64_LIMIT)
+		return 45;
+
+	return 20;
+}
+
+/* Write an entry, it goes into the central directory on success. */
+static int zip_write_entry(struct zip_writer *zw, struct zip_entry *entry,
+		const uint8_t *wrdata)
+{
+	uint8_t hdr[30];
+	size_t namelen;
+	int ret;
+
+	SR_TRACE3(srzip_chunk_write, entry->name, entry->size,
+		entry->compressed_size);
+	entry->offset = zw->offset;
+	namelen = strlen(entry->name);
+
+	WL32(&hdr[0], ZIP_LOCAL_HEADER);
+	WL16(&hdr[4], zip_version_needed(entry));
+	WL16(&hdr[6], 0);
+	WL16(&hdr[8], entry->method);
+	WL16(&hdr[10], zw->dos_time);
+	WL16(&hdr[12], zw->dos_date);
+	WL32(&hdr[14], entry->crc);
+	WL32(&hdr[18], entry->compressed_size);
+	WL32(&hdr[22], entry->size);
+	WL16(&hdr[26], namelen);
+	WL16(&hdr[28], 0);
+
+	if ((ret = zip_write(zw, hdr, sizeof(hdr))) != SR_OK ||
+			(ret = zip_write(zw, entry->name, namelen)) != SR_OK ||
+			(ret = zip_write(zw, wrdata, entry->compressed_size)) != SR_OK)
+		return ret;
+	g_array_append_val(zw->entries, *entry);
+	entry->name = NULL;
+
+	return SR_OK;
+}
+
+/*
+ * Write the compressed entries in order, until at most the given number
+ * are left. Waits for the oldest ones to be compressed if needed.
+ */
+static int zip_writer_drain(struct zip_writer *zw, guint max_left)
+{
+	struct zip_job *job;
+	gboolean done;
+	int ret;
+
+	while ((job = g_queue_peek_head(&zw->jobs))) {
+		g_mutex_lock(&zw->mutex);
+		while (!job->done && zw->jobs.length > max_left)
+			g_cond_wait(&zw->cond, &zw->mutex);
+		done = job->done;
+		g_mutex_unlock(&zw->mutex);
+		if (!done)
+			break;
+
+		g_queue_pop_head(&zw->jobs);
+		ret = zip_write_entry(zw, &job->entry, job->wrdata);
+		zip_job_free(job);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+/* Append an entry to the archive, with all its data. */
+static int zip_writer_add(struct zip_writer *zw, const char *name,
+		const void *data, size_t len)
+{
+	struct zip_entry entry;
+	struct zip_job *job;
+	const uint8_t *wrdata;
+	int ret;
+
+	/* Entries are chunks of a few MiB, never need ZIP64 sizes. */
+	if (len >= ZIP64_LIMIT) {
+		sr_err("Session file entry '%s' too large.", name);
+		return SR_ERR_ARG;
+	}
+
+	if (zw->pool && len && (job = g_try_malloc0(sizeof(*job)))) {
+		job->data = g_try_malloc(len);
+		if (job->data) {
+			memcpy(job->data, data, len);
+			job->entry.name = g_strdup(name);
+			job->entry.size = len;
+			g_queue_push_tail(&zw->jobs, job);
+			g_thread_pool_push(zw->pool, job, NULL);
+			return zip_writer_drain(zw, zw->max_jobs);
+		}
+		g_free(job);
+	}
+
+	/* Keep the order of entries still being compressed. */
+	if ((ret = zip_writer_drain(zw, 0)) != SR_OK)
+		return ret;
+
+	entry.name = g_strdup(name);
+	wrdata = zip_entry_compress(zw->comp, &entry, data, len,
+		&zw->cbuf, &zw->cbuf_size);
+	ret = zip_write_entry(zw, &entry, wrdata);
+	g_free(entry.name);
+
+	return ret;
+}
+
+static int zip_write_central(struct zip_writer *zw)
+{
+	struct zip_entry *entry;
+	uint8_t hdr[46 + 12], end[56 + 20 + 22], *p;
+	uint64_t cd_offset, cd_size, num;
+	size_t namelen, extralen;
+	guint i;
+	gboolean zip64;
+	int ret;
+
+	cd_offset = zw->offset;
+	for (i = 0; i < zw->entries->len; i++) {
+		entry = &g_array_index(zw->entries, struct zip_entry, i);
+		namelen = strlen(entry->name);
+		zip64 = entry->offset >= ZIP64_LIMIT;
+		extralen = zip64 ? 12 : 0;
+
+		WL32(&hdr[0], ZIP_CENTRAL_HEADER);
+		/* Made by a UNIX system, for version 6.3 of the format. */
+		WL16(&hdr[4], 3 << 8 | 63);
+		WL16(&hdr[6], zip_version_needed(entry));
+		WL16(&hdr[8], 0);
+		WL16(&hdr[10], entry->method);
+		WL16(&hdr[12], zw->dos_time);
+		WL16(&hdr[14], zw->dos_date);
+		WL32(&hdr[16], entry->crc);
+		WL32(&hdr[20], entry->compressed_size);
+		WL32(&hdr[24], entry->size);
+		WL16(&hdr[28], namelen);
+		WL16(&hdr[30], extralen);
+		WL16(&hdr[32], 0);
+		WL16(&hdr[34], 0);
+		WL16(&hdr[36], 0);
+		WL32(&hdr[38], 0100644U << 16);
+		WL32(&hdr[42], zip64 ? ZIP64_LIMIT : entry->offset);
+		if (zip64) {
+			WL16(&hdr[46], 0x0001);
+			WL16(&hdr[48], 8);
+			WL64(&hdr[50], entry->offset);
+		}
+
+		if ((ret = zip_write(zw, hdr, 46)) != SR_OK ||
+				(ret = zip_write(zw, entry->name, namelen)) != SR_OK ||
+				(ret = zip_write(zw, &hdr[46], extralen)) != SR_OK)
+			return ret;
+	}
+	cd_size = zw->offset - cd_offset;
+	num = zw->entries->len;
+
+	p = end;
+	zip64 = num >= 0xffff || cd_offset >= ZIP64_LIMIT ||
+		cd_size >= ZIP64_LIMIT;
+	if (zip64) {
+		WL32(&p[0], ZIP64_END_RECORD);
+		WL64(&p[4], 56 - 12);
+		WL16(&p[12], 3 << 8 | 63);
+		WL16(&p[14], 45);
+		WL32(&p[16], 0);
+		WL32(&p[20], 0);
+		WL64(&p[24], num);
+		WL64(&p[32], num);
+		WL64(&p[40], cd_size);
+		WL64(&p[48], cd_offset);
+		p += 56;
+
+		WL32(&p[0], ZIP64_END_LOCATOR);
+		WL32(&p[4], 0);
+		WL64(&p[8], cd_offset + cd_size);
+		WL32(&p[16], 1);
+		p += 20;
+	}
+	WL32(&p[0], ZIP_END_RECORD);
+	WL16(&p[4], 0);
+	WL16(&p[6], 0);
+	WL16(&p[8], MIN(num, 0xffff));
+	WL16(&p[10], MIN(num, 0xffff));
+	WL32(&p[12], MIN(cd_size, ZIP64_LIMIT));
+	WL32(&p[16], MIN(cd_offset, ZIP64_LIMIT));
+	WL16(&p[20], 0);
+	p += 22;
+
+	return zip_write(zw, end, p - end);
+}
+
+/*
+ * Start the entries that only go into a finished archive. They get
+ * written over, together with the directory, when more data follows.
+ */
+static int zip_writer_trailer(struct zip_writer *zw)
+{
+	int ret;
+
+	if (zw->trailing)
+		return SR_OK;
+	if ((ret = zip_writer_drain(zw, 0)) != SR_OK)
+		return ret;
+	zw->last_offset = zw->offset;
+	zw->last_entries = zw->entries->len;
+	zw->trailing = TRUE;
+
+	return SR_OK;
+}
+
+/*
+ * Write a last entry and the central directory, which makes the file a
+ * complete archive. More entries can still be added after this, the
+ * trailing entries and the directory then get written over.
+ */
+static int zip_writer_finish(struct zip_writer *zw, const char *name,
+		const void *data, size_t len)
+{
+	int ret;
+
+	if ((ret = zip_writer_trailer(zw)) != SR_OK)
+		return ret;
+	if ((ret = zip_writer_add(zw, name, data, len)) != SR_OK ||
+			(ret = zip_writer_drain(zw, 0)) != SR_OK)
+		return ret;
+	zw->finished = TRUE;
+	if ((ret = zip_write_central(zw)) != SR_OK)
+		return ret;
+	if (fflush(zw->file) != 0) {
+		sr_err("Cannot write session file: %s.", g_strerror(errno));
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+/* Continue a finished archive, before its trailing entries. */
+static int zip_writer_resume(struct zip_writer *zw)
+{
+	if (!zw->finished)
+		return SR_OK;
+
+	if (fseeko(zw->file, zw->last_offset, SEEK_SET) != 0) {
+		sr_err("Cannot seek in session file: %s.", g_strerror(errno));
+		return SR_ERR_IO;
+	}
+	zw->offset = zw->last_offset;
+	g_array_set_size(zw->entries, zw->last_entries);
+	zw->finished = FALSE;
+	zw->trailing = FALSE;
+
+	return SR_OK;
+}
+
+static void zip_writer_free(struct zip_writer *zw)
+{
+	struct zip_compressor *zc;
+
+	if (!zw)
+		return;
+
+	if (zw->pool) {
+		/* Let the threads finish, what they did is lost here. */
+		g_thread_pool_free(zw->pool, FALSE, TRUE);
+		g_queue_foreach(&zw->jobs, (GFunc)zip_job_free, NULL);
+		g_queue_clear(&zw->jobs);
+		while ((zc = g_async_queue_try_pop(zw->compressors)))
+			zip_compressor_free(zc);
+		g_async_queue_unref(zw->compressors);
+	}
+	g_mutex_clear(&zw->mutex);
+	g_cond_clear(&zw->cond);
+
+	if (fclose(zw->file) != 0)
+		sr_err("Cannot close session file: %s.", g_strerror(errno));
+	g_array_free(zw->entries, TRUE);
+	zip_compressor_free(zw->comp);
+	g_free(zw->cbuf);
+	g_free(zw);
+}
+
+#ifdef HAVE_LIBZSTD
+/* Only write what the session file reader can decompress again. */
+static gboolean zstd_readable(void)
+{
+#ifdef ZIP_CM_ZSTD
+	return zip_compression_method_supported(ZIP_CM_ZSTD, 0) != 0;
+#else
+	return FALSE;
+#endif
+}
+#endif
+
+static struct summary *summary_new(size_t record_size, size_t last_size)
+{
+	struct summary *s;
+
+	s = g_malloc0(sizeof(*s));
+	s->record_size = record_size;
+	s->blocks = g_byte_array_new();
+	s->block = g_malloc0(record_size);
+	s->last = g_malloc0(MAX(last_size, 1));
+
+	return s;
+}
+
+static void summary_free(struct summary *s)
+{
+	if (!s)
+		return;
+
+	g_byte_array_free(s->blocks, TRUE);
+	g_free(s->block);
+	g_free(s->last);
+	g_free(s);
+}
+
+static void summary_logic_add(struct summary *s, const uint8_t *data,
+		size_t unitsize, size_t count)
+{
+	uint8_t *changed, *first;
+	size_t i, j;
+
+	changed = s->block;
+	first = s->block + unitsize;
+
+	for (i = 0; i < count; i++, data += unitsize) {
+		if (!(s->num_samples & ((1 << SUMMARY_SHIFT) - 1))) {
+			if (s->num_samples)
+				g_byte_array_append(s->blocks, s->block,
+					s->record_size);
+			memset(changed, 0, unitsize);
+			memcpy(first, data, unitsize);
+		}
+		if (s->num_samples && memcmp(data, s->last, unitsize) != 0) {
+			for (j = 0; j < unitsize; j++)
+				changed[j] |= data[j] ^ s->last[j];
+		}
+		memcpy(s->last, data, unitsize);
+		s->num_samples++;
+	}
+}
+
+static void summary_analog_add(struct summary *s, const float *values,
+		size_t count)
+{
+	float range[2];
+	size_t i;
+
+	memcpy(range, s->block, sizeof(range));
+	for (i = 0; i < count; i++) {
+		if (!(s->num_samples & ((1 << SUMMARY_SHIFT) - 1))) {
+			if (s->num_samples) {
+				memcpy(s->block, range, sizeof(range));
+				g_byte_array_append(s->blocks, s->block,
+					s->record_size);
+			}
+			/* NaN values don't count. */
+			range[0] = INFINITY;
+			range[1] = -INFINITY;
+		}
+		if (values[i] < range[0])
+			range[0] = values[i];
+		if (values[i] > range[1])
+			range[1] = values[i];
+		s->num_samples++;
+	}
+	memcpy(s->block, range, sizeof(range));
+}
+
+static void summary_logic_combine(uint8_t *dst, const uint8_t *a,
+		const uint8_t *b, size_t record_size)
+{
+	size_t unitsize, j;
+
+	unitsize = record_size / 2;
+	memcpy(dst, a, record_size);
+	/* The second block's changes include those from the first one. */
+	for (j = 0; b && j < unitsize; j++)
+		dst[j] |= b[j];
+}
+
+static void summary_analog_combine(uint8_t *dst, const uint8_t *a,
+		const uint8_t *b, size_t record_size)
+{
+	float range[2], other[2];
+
+	(void)record_size;
+
+	memcpy(range, a, sizeof(range));
+	if (b) {
+		memcpy(other, b, sizeof(other));
+		range[0] = MIN(range[0], other[0]);
+		range[1] = MAX(range[1], other[1]);
+	}
+	memcpy(dst, range, sizeof(range));
+}
+
+/* Get the entry of a summary, with all its levels. */
+static uint8_t *summary_entry(const struct summary *s,
+		void (*combine)(uint8_t *dst, const uint8_t *a,
+			const uint8_t *b, size_t record_size),
+		size_t *len)
+{
+	uint8_t *entry, *prev, *dst;
+	uint64_t count, prev_count, total, i;
+
+	count = s->blocks->len / s->record_size + 1;
+	total = count;
+	for (prev_count = count; prev_count > 1; total += prev_count)
+		prev_count = (prev_count + 1) / 2;
+
+	*len = SUMMARY_HEADER_SIZE + total * s->record_size;
+	entry = g_try_malloc(*len);
+	if (!entry)
+		return NULL;
+	WL32(&entry[0], SUMMARY_VERSION);
+	WL32(&entry[4], SUMMARY_SHIFT);
+	WL64(&entry[8], s->num_samples);
+
+	dst = entry + SUMMARY_HEADER_SIZE;
+	if (s->blocks->len)
+		memcpy(dst, s->blocks->data, s->blocks->len);
+	memcpy(dst + s->blocks->len, s->block, s->record_size);
+	while (count > 1) {
+		prev = dst;
+		prev_count = count;
+		dst += prev_count * s->record_size;
+		count = (prev_count + 1) / 2;
+		for (i = 0; i < count; i++)
+			combine(dst + i * s->record_size,
+				prev + 2 * i * s->record_size,
+				2 * i + 1 < prev_count ?
+				prev + (2 * i + 1) * s->record_size : NULL,
+				s->record_size);
+	}
+
+	return entry;
+}
+
+static int summary_write(struct zip_writer *zw, const char *name,
+		const struct summary *s,
+		void (*combine)(uint8_t *dst, const uint8_t *a,
+			const uint8_t *b, size_t record_size))
+{
+	uint8_t *entry;
+	size_t len;
+	int ret;
+
+	if (!s || !s->num_samples)
+		return SR_OK;
+
+	if (!(entry = summary_entry(s, combine, &len))) {
+		sr_err("Cannot allocate summary '%s'.", name);
+		return SR_ERR_MALLOC;
+	}
+	ret = zip_writer_add(zw, name, entry, len);
+	g_free(entry);
+
+	return ret;
+}
+
+/*
+ * Run-length encode logic samples, as sr_sessionfile_rle_decode() reads
+ * them. The buffer must hold a header and a byte more than each sample.
+ */
+static size_t rle_encode(uint8_t *dst, const uint8_t *src, size_t unitsize,
+		size_t count)
+{
+	uint8_t *wrptr;
+	const uint8_t *sample;
+	size_t i, run, n;
+
+	WL64(dst, count);
+	wrptr = dst + SR_SESSIONFILE_RLE_HEADER;
+	for (i = 0; i < count; i += run) {
+		sample = src + i * unitsize;
+		for (run = 1; i + run < count; run++) {
+			if (memcmp(sample + run * unitsize, sample, unitsize))
+				break;
+		}
+		/* LEB128 run length, lowest seven bits first. */
+		for (n = run; n >= 0x80; n >>= 7)
+			*wrptr++ = (n & 0x7f) | 0x80;
+		*wrptr++ = n;
+		memcpy(wrptr, sample, unitsize);
+		wrptr += unitsize;
+	}
+
+	return wrptr - dst;
+}
+
 static int init(struct sr_output *o, GHashTable *options)
 {
 	struct out_context *outc;
-
-	(void)options;
+	const char *method, *encoding;
+	gboolean rle, analog_raw;
+	uint16_t method_id;
+	uint32_t level, max_level, num_threads;
+	uint64_t chunk_size;
 
 	if (!o->filename || o->filename[0] == '\0') {
 		sr_info("srzip output module requires a file name, cannot save.");
 		return SR_ERR_ARG;
 	}
 
+	method = g_variant_get_string(g_hash_table_lookup(options,
+		"compression"), NULL);
+	if (g_ascii_strcasecmp(method, "store") == 0) {
+		method_id = ZIP_METHOD_STORE;
+		max_level = 0;
+#ifdef HAVE_ZLIB
+	} else if (g_ascii_strcasecmp(method, "deflate") == 0) {
+		method_id = ZIP_METHOD_DEFLATE;
+		max_level = Z_BEST_COMPRESSION;
+#endif
+#ifdef HAVE_LIBZSTD
+	} else if (g_ascii_strcasecmp(method, "zstd") == 0 &&
+			zstd_readable()) {
+		method_id = ZIP_METHOD_ZSTD;
+		max_level = ZSTD_maxCLevel();
+#endif
+	} else {
+		sr_err("Unsupported compression method '%s'.", method);
+		return SR_ERR_ARG;
+	}
+
+	level = g_variant_get_uint32(g_hash_table_lookup(options, "level"));
+	if (level > max_level) {
+		sr_err("Compression level %u out of range for '%s'.",
+			level, method);
+		return SR_ERR_ARG;
+	}
+
+	chunk_size = g_variant_get_uint64(g_hash_table_lookup(options,
+		"chunksize"));
+	if (chunk_size < MIN_CHUNK_SIZE || chunk_size > MAX_CHUNK_SIZE) {
+		sr_err("Chunk size must be %d to %d bytes.",
+			MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+		return SR_ERR_ARG;
+	}
+
+	encoding = g_variant_get_string(g_hash_table_lookup(options,
+		"encoding"), NULL);
+	if (g_ascii_strcasecmp(encoding, "rle") == 0) {
+		rle = TRUE;
+	} else if (g_ascii_strcasecmp(encoding, "raw") == 0) {
+		rle = FALSE;
+	} else {
+		sr_err("Unsupported logic encoding '%s'.", encoding);
+		return SR_ERR_ARG;
+	}
+
+	encoding = g_variant_get_string(g_hash_table_lookup(options,
+		"analog"), NULL);
+	if (g_ascii_strcasecmp(encoding, "raw") == 0) {
+		analog_raw = TRUE;
+	} else if (g_ascii_strcasecmp(encoding, "float") == 0) {
+		analog_raw = FALSE;
+	} else {
+		sr_err("Unsupported analog encoding '%s'.", encoding);
+		return SR_ERR_ARG;
+	}
+
+	num_threads = g_variant_get_uint32(g_hash_table_lookup(options,
+		"threads"));
+	if (!num_threads) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		num_threads = g_get_num_processors();
+#else
+		num_threads = 1;
+#endif
+	}
+
 	outc = g_malloc0(sizeof(*outc));
 	outc->filename = g_strdup(o->filename);
+	outc->method = method_id;
+	outc->level = level;
+	outc->num_threads = num_threads;
+	outc->chunk_size = chunk_size;
+	outc->summarize = g_variant_get_boolean(g_hash_table_lookup(options,
+		"summary"));
+	outc->rle = rle;
+	outc->analog_raw = analog_raw;
 	o->priv = outc;
 
 	return SR_OK;
@@ -71,8 +1085,6 @@ static int init(struct sr_output *o, GHashTable *options)
 static int zip_create(const struct sr_output *o)
 {
 	struct out_context *outc;
-	struct zip *zipfile;
-	struct zip_source *versrc, *metasrc;
 	struct sr_channel *ch;
 	size_t ch_nr;
 	size_t alloc_size;
@@ -80,8 +1092,7 @@ static int zip_create(const struct sr_output *o)
 	GKeyFile *meta;
 	GSList *l;
 	const char *devgroup;
-	char *s, *metabuf;
-	gsize metalen;
+	char *s;
 	guint logic_channels, enabled_logic_channels;
 	guint enabled_analog_channels;
 	guint index;
@@ -94,24 +1105,17 @@ static int zip_create(const struct sr_output *o)
 		g_variant_unref(gvar);
 	}
 
-	/* Quietly delete it first, libzip wants replace ops otherwise. */
-	g_unlink(outc->filename);
-	zipfile = zip_open(outc->filename, ZIP_CREATE, NULL);
-	if (!zipfile)
+	outc->writer = zip_writer_new(outc->filename, outc->method,
+		outc->level, outc->num_threads);
+	if (!outc->writer)
 		return SR_ERR;
 
-	/* "version" */
-	versrc = zip_source_buffer(zipfile, "2", 1, FALSE);
-	if (zip_add(zipfile, "version", versrc) < 0) {
-		sr_err("Error saving version into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(versrc);
-		zip_discard(zipfile);
-		return SR_ERR;
-	}
-
-	/* init "metadata" */
+	/*
+	 * init "metadata", it goes into the archive as its last entry
+	 * when the archive gets finished
+	 */
 	meta = g_key_file_new();
+	outc->meta = meta;
 
 	g_key_file_set_string(meta, "global", "sigrok version",
 			sr_package_version_string_get());
@@ -137,6 +1141,15 @@ static int zip_create(const struct sr_output *o)
 		}
 	}
 
+	/*
+	 * "version", older readers can't decode run-length encoded logic
+	 * chunks (3), nor integer analog chunks (4)
+	 */
+	if (zip_writer_add(outc->writer, "version", outc->analog_raw &&
+			enabled_analog_channels ? "4" :
+			outc->rle ? "3" : "2", 1) != SR_OK)
+		return SR_ERR;
+
 	/* When reading the file, the first index of the analog channels
 	 * can only be deduced through the "total probes" count, so the
 	 * first analog index must follow the last logic one, enabled or not. */
@@ -149,6 +1162,9 @@ static int zip_create(const struct sr_output *o)
 	if (enabled_logic_channels > 0) {
 		g_key_file_set_string(meta, devgroup, "capturefile", "logic-1");
 		g_key_file_set_integer(meta, devgroup, "total probes", logic_channels);
+		if (outc->rle)
+			g_key_file_set_string(meta, devgroup, "logic encoding",
+				SR_SESSIONFILE_RLE);
 	}
 
 	s = sr_samplerate_string(outc->samplerate);
@@ -160,6 +1176,8 @@ static int zip_create(const struct sr_output *o)
 	outc->analog_ch_count = enabled_analog_channels;
 	alloc_size = sizeof(gint) * outc->analog_ch_count + 1;
 	outc->analog_index_map = g_malloc0(alloc_size);
+	alloc_size = sizeof(unsigned int) * outc->analog_ch_count + 1;
+	outc->next_analog_chunk = g_malloc0(alloc_size);
 
 	index = 0;
 	for (l = o->sdi->channels; l; l = l->next) {
@@ -189,12 +1207,12 @@ static int zip_create(const struct sr_output *o)
 	/*
 	 * Allocate one samples buffer for all logic channels, and
 	 * several samples buffers for the analog channels. Allocate
-	 * buffers of CHUNK_SIZE size (in bytes), and determine the
+	 * buffers of the chunk size (in bytes), and determine the
 	 * sample counts from the respective channel counts and data
 	 * type widths.
 	 *
 	 * These buffers are intended to reduce the number of ZIP
-	 * archive update calls, and decouple the srzip output module
+	 * archive entries, and decouple the srzip output module
 	 * from implementation details in other acquisition device
 	 * drivers and input modules.
 	 *
@@ -203,10 +1221,18 @@ static int zip_create(const struct sr_output *o)
 	 * holding a local buffer won't harm when no data is seen later
 	 * during execution. This simplifies other locations.
 	 */
-	alloc_size = CHUNK_SIZE;
 	outc->logic_buff.zip_unit_size = logic_channels;
 	outc->logic_buff.zip_unit_size += 8 - 1;
 	outc->logic_buff.zip_unit_size /= 8;
+	/* Hold at least one sample, however small the chunks are. */
+	alloc_size = MAX(outc->chunk_size, outc->logic_buff.zip_unit_size);
+	outc->mem_ctx = sr_mem_context(o->sdi);
+	if (sr_mem_reserve(outc->mem_ctx, alloc_size +
+			outc->analog_ch_count * outc->chunk_size,
+			"srzip chunk buffers") != SR_OK)
+		return SR_ERR_MALLOC;
+	outc->mem_reserved = alloc_size +
+		outc->analog_ch_count * outc->chunk_size;
 	outc->logic_buff.samples = g_try_malloc0(alloc_size);
 	if (!outc->logic_buff.samples)
 		return SR_ERR_MALLOC;
@@ -218,37 +1244,69 @@ static int zip_create(const struct sr_output *o)
 	alloc_size = sizeof(outc->analog_buff[0]) * outc->analog_ch_count + 1;
 	outc->analog_buff = g_malloc0(alloc_size);
 	for (index = 0; index < outc->analog_ch_count; index++) {
-		alloc_size = CHUNK_SIZE;
+		alloc_size = outc->chunk_size;
 		outc->analog_buff[index].samples = g_try_malloc0(alloc_size);
 		if (!outc->analog_buff[index].samples)
 			return SR_ERR_MALLOC;
-		alloc_size /= sizeof(outc->analog_buff[0].samples[0]);
-		outc->analog_buff[index].alloc_size = alloc_size;
+		/* The sample size is known with the first packet. */
+		outc->analog_buff[index].alloc_size = 0;
 		outc->analog_buff[index].fill_size = 0;
 	}
 
-	metabuf = g_key_file_to_data(meta, &metalen, NULL);
-	g_key_file_free(meta);
-
-	metasrc = zip_source_buffer(zipfile, metabuf, metalen, FALSE);
-	if (zip_add(zipfile, "metadata", metasrc) < 0) {
-		sr_err("Error saving metadata into zipfile: %s",
-			zip_strerror(zipfile));
-		zip_source_free(metasrc);
-		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+	if (outc->summarize) {
+		outc->logic_summary = summary_new(
+			2 * outc->logic_buff.zip_unit_size,
+			outc->logic_buff.zip_unit_size);
+		outc->analog_summary = g_malloc0(sizeof(outc->analog_summary[0]) *
+			outc->analog_ch_count + 1);
+		for (index = 0; index < outc->analog_ch_count; index++)
+			outc->analog_summary[index] = summary_new(
+				2 * sizeof(float), 0);
 	}
 
-	if (zip_close(zipfile) < 0) {
-		sr_err("Error saving zipfile: %s", zip_strerror(zipfile));
-		zip_discard(zipfile);
-		g_free(metabuf);
-		return SR_ERR;
+	return SR_OK;
+}
+
+/**
+ * Finish the srzip archive, with the metadata as it is now.
+ *
+ * @param[in] o Output module instance.
+ *
+ * @returns SR_OK et al error codes.
+ */
+static int zip_finish(const struct sr_output *o)
+{
+	struct out_context *outc;
+	char *metabuf, *name;
+	gsize metalen;
+	size_t idx;
+	int ret;
+
+	outc = o->priv;
+	if (outc->writer->finished)
+		return SR_OK;
+
+	if (outc->summarize) {
+		if ((ret = zip_writer_trailer(outc->writer)) != SR_OK)
+			return ret;
+		ret = summary_write(outc->writer, "summary-logic-1",
+			outc->logic_summary, summary_logic_combine);
+		for (idx = 0; ret == SR_OK && idx < outc->analog_ch_count; idx++) {
+			name = g_strdup_printf("summary-analog-1-%zu",
+				outc->first_analog_index + idx);
+			ret = summary_write(outc->writer, name,
+				outc->analog_summary[idx], summary_analog_combine);
+			g_free(name);
+		}
+		if (ret != SR_OK)
+			return ret;
 	}
+
+	metabuf = g_key_file_to_data(outc->meta, &metalen, NULL);
+	ret = zip_writer_finish(outc->writer, "metadata", metabuf, metalen);
 	g_free(metabuf);
 
-	return SR_OK;
+	return ret;
 }
 
 /**
@@ -265,123 +1323,51 @@ static int zip_append(const struct sr_output *o,
 	uint8_t *buf, size_t unitsize, size_t length)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *logicsrc;
-	int64_t i, num_files;
-	struct zip_stat zs;
-	struct zip_source *metasrc;
-	GKeyFile *kf;
-	GError *error;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *metabuf;
-	gsize metalen;
 	char *chunkname;
-	unsigned int next_chunk_num;
+	const uint8_t *data;
+	size_t count;
+	int ret;
 
 	if (!length)
 		return SR_OK;
 
 	outc = o->priv;
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
-		return SR_ERR;
+	if ((ret = zip_writer_resume(outc->writer)) != SR_OK)
+		return ret;
 
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		zip_discard(archive);
-		return SR_ERR;
-	}
-	kf = sr_sessionfile_read_metadata(archive, &zs);
-	if (!kf) {
-		zip_discard(archive);
-		return SR_ERR_DATA;
-	}
 	/*
 	 * If the file was only initialized but doesn't yet have any
 	 * data it in, it won't have a unitsize field in metadata yet.
 	 */
-	error = NULL;
-	metabuf = NULL;
-	if (!g_key_file_has_key(kf, "device 1", "unitsize", &error)) {
-		if (error && error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
-			sr_err("Failed to check unitsize key: %s", error->message);
-			g_error_free(error);
-			g_key_file_free(kf);
-			zip_discard(archive);
-			return SR_ERR;
-		}
-		g_clear_error(&error);
-
-		/* Add unitsize field. */
-		g_key_file_set_integer(kf, "device 1", "unitsize", unitsize);
-		metabuf = g_key_file_to_data(kf, &metalen, NULL);
-		metasrc = zip_source_buffer(archive, metabuf, metalen, FALSE);
-
-		if (zip_replace(archive, zs.index, metasrc) < 0) {
-			sr_err("Failed to replace metadata: %s",
-				zip_strerror(archive));
-			g_key_file_free(kf);
-			zip_source_free(metasrc);
-			zip_discard(archive);
-			g_free(metabuf);
-			return SR_ERR;
-		}
-	}
-	g_key_file_free(kf);
-
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, "logic-1", 7) != 0)
-			continue;
-		if (entry_name[7] == '\0') {
-			/*
-			 * This file has no extra chunks, just a single
-			 * "logic-1". Rename it to "logic-1-1" and continue
-			 * with chunk 2.
-			 */
-			if (zip_rename(archive, i, "logic-1-1") < 0) {
-				sr_err("Failed to rename 'logic-1' to 'logic-1-1': %s",
-					zip_strerror(archive));
-				zip_discard(archive);
-				g_free(metabuf);
-				return SR_ERR;
-			}
-			next_chunk_num = 2;
-			break;
-		} else if (entry_name[7] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + 8, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
-		}
+	if (!outc->have_unitsize) {
+		g_key_file_set_integer(outc->meta, "device 1", "unitsize", unitsize);
+		outc->have_unitsize = TRUE;
 	}
 
 	if (length % unitsize != 0) {
 		sr_warn("Chunk size %zu not a multiple of the"
 			" unit size %zu.", length, unitsize);
 	}
-	logicsrc = zip_source_buffer(archive, buf, length, FALSE);
-	chunkname = g_strdup_printf("logic-1-%u", next_chunk_num);
-	i = zip_add(archive, chunkname, logicsrc);
-	g_free(chunkname);
-	if (i < 0) {
-		sr_err("Failed to add chunk 'logic-1-%u': %s",
-			next_chunk_num, zip_strerror(archive));
-		zip_source_free(logicsrc);
-		zip_discard(archive);
-		g_free(metabuf);
-		return SR_ERR;
-	}
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		zip_discard(archive);
-		g_free(metabuf);
-		return SR_ERR;
+	count = length / unitsize;
+	if (outc->logic_summary)
+		summary_logic_add(outc->logic_summary, buf, unitsize, count);
+
+	data = buf;
+	if (outc->rle) {
+		if (!zip_cbuf_reserve(&outc->rle_buf, &outc->rle_size,
+				SR_SESSIONFILE_RLE_HEADER + count * (unitsize + 1)))
+			return SR_ERR_MALLOC;
+		length = rle_encode(outc->rle_buf, buf, unitsize, count);
+		data = outc->rle_buf;
 	}
-	g_free(metabuf);
 
-	return SR_OK;
+	chunkname = g_strdup_printf("logic-1-%u", ++outc->next_logic_chunk);
+	ret = zip_writer_add(outc->writer, chunkname, data, length);
+	if (ret != SR_OK)
+		sr_err("Failed to add chunk '%s'.", chunkname);
+	g_free(chunkname);
+
+	return ret;
 }
 
 /**
@@ -503,77 +1489,65 @@ static int zip_append_queue(const struct sr_output *o,
  * Append analog data of a channel to an srzip archive.
  *
  * @param[in] o Output module instance.
- * @param[in] values Sample data as array of floating point values.
- * @param[in] count Number of samples (float items, not bytes).
+ * @param[in] buff The channel's buffer, which gets appended.
  * @param[in] ch_nr 1-based channel number.
  *
  * @returns SR_OK et al error codes.
  */
 static int zip_append_analog(const struct sr_output *o,
-	const float *values, size_t count, size_t ch_nr)
+	const struct analog_buff *buff, size_t ch_nr)
 {
 	struct out_context *outc;
-	struct zip *archive;
-	struct zip_source *analogsrc;
-	int64_t i, num_files;
-	size_t size;
-	struct zip_stat zs;
-	uint64_t chunk_num;
-	const char *entry_name;
-	char *basename;
-	gsize baselen;
 	char *chunkname;
-	unsigned int next_chunk_num;
+	unsigned int *next_chunk;
+	int ret;
 
 	outc = o->priv;
+	if ((ret = zip_writer_resume(outc->writer)) != SR_OK)
+		return ret;
 
-	if (!(archive = zip_open(outc->filename, 0, NULL)))
-		return SR_ERR;
+	next_chunk = &outc->next_analog_chunk[ch_nr - outc->first_analog_index];
+	chunkname = g_strdup_printf("analog-1-%zu-%u", ch_nr, ++*next_chunk);
+	ret = zip_writer_add(outc->writer, chunkname, buff->samples,
+		buff->unitsize * buff->fill_size);
+	if (ret != SR_OK)
+		sr_err("Failed to add chunk '%s'.", chunkname);
+	g_free(chunkname);
 
-	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
-		sr_err("Failed to open metadata: %s", zip_strerror(archive));
-		zip_discard(archive);
-		return SR_ERR;
-	}
+	return ret;
+}
 
-	basename = g_strdup_printf("analog-1-%zu", ch_nr);
-	baselen = strlen(basename);
-	next_chunk_num = 1;
-	num_files = zip_get_num_entries(archive, 0);
-	for (i = 0; i < num_files; i++) {
-		entry_name = zip_get_name(archive, i, 0);
-		if (!entry_name || strncmp(entry_name, basename, baselen) != 0) {
-			continue;
-		} else if (entry_name[baselen] == '-') {
-			chunk_num = g_ascii_strtoull(entry_name + baselen + 1, NULL, 10);
-			if (chunk_num < G_MAXINT && chunk_num >= next_chunk_num)
-				next_chunk_num = chunk_num + 1;
-		}
-	}
+static gboolean analog_encoding_eq(const struct sr_analog_encoding *a,
+	const struct sr_analog_encoding *b)
+{
+	return a->unitsize == b->unitsize && a->is_signed == b->is_signed &&
+		a->is_float == b->is_float &&
+		a->is_bigendian == b->is_bigendian &&
+		sr_rational_eq(&a->scale, &b->scale) == 1 &&
+		sr_rational_eq(&a->offset, &b->offset) == 1;
+}
 
-	size = sizeof(values[0]) * count;
-	analogsrc = zip_source_buffer(archive, values, size, FALSE);
-	chunkname = g_strdup_printf("%s-%u", basename, next_chunk_num);
-	i = zip_add(archive, chunkname, analogsrc);
-	if (i < 0) {
-		sr_err("Failed to add chunk '%s': %s", chunkname, zip_strerror(archive));
-		g_free(chunkname);
-		g_free(basename);
-		zip_source_free(analogsrc);
-		zip_discard(archive);
-		return SR_ERR;
-	}
-	g_free(chunkname);
-	if (zip_close(archive) < 0) {
-		sr_err("Error saving session file: %s", zip_strerror(archive));
-		g_free(basename);
-		zip_discard(archive);
-		return SR_ERR;
+/*
+ * The first packet of a channel decides how its chunks are encoded:
+ * integers stay as they are when the raw option is set, scale and
+ * offset go to the metadata. Everything else is stored as floats.
+ */
+static void analog_buff_setup(struct out_context *outc,
+	struct analog_buff *buff, size_t ch_nr,
+	const struct sr_analog_encoding *enc)
+{
+	buff->raw = outc->analog_raw && !enc->is_float &&
+		(enc->unitsize == 1 || enc->unitsize == 2 ||
+		enc->unitsize == 4 || enc->unitsize == 8);
+	if (buff->raw) {
+		buff->encoding = *enc;
+		buff->unitsize = enc->unitsize;
+		sr_sessionfile_analog_encoding_set(outc->meta, "device 1",
+			ch_nr, enc);
+	} else {
+		buff->unitsize = sizeof(float);
 	}
-
-	g_free(basename);
-
-	return SR_OK;
+	buff->alloc_size = outc->chunk_size / buff->unitsize;
 }
 
 /**
@@ -592,7 +1566,8 @@ static int zip_append_analog_queue(const struct sr_output *o,
 	const struct sr_channel *ch;
 	size_t idx, nr;
 	struct analog_buff *buff;
-	float *values, *wrptr, *rdptr;
+	float *values;
+	const uint8_t *rdptr;
 	size_t send_size, remain, copy_size;
 	int ret;
 
@@ -605,8 +1580,7 @@ static int zip_append_analog_queue(const struct sr_output *o,
 			buff = &outc->analog_buff[idx];
 			if (!buff->fill_size)
 				continue;
-			ret = zip_append_analog(o,
-				buff->samples, buff->fill_size, nr);
+			ret = zip_append_analog(o, buff, nr);
 			if (ret != SR_OK)
 				return ret;
 			buff->fill_size = 0;
@@ -630,49 +1604,62 @@ static int zip_append_analog_queue(const struct sr_output *o,
 	nr = outc->first_analog_index + idx;
 	buff = &outc->analog_buff[idx];
 
-	/* Convert the analog data to an array of float values. */
-	values = g_try_malloc0(analog->num_samples * sizeof(values[0]));
-	if (!values)
-		return SR_ERR_MALLOC;
-	ret = sr_analog_to_float(analog, values);
-	if (ret != SR_OK) {
-		g_free(values);
-		return ret;
+	if (!buff->unitsize) {
+		analog_buff_setup(outc, buff, nr, analog->encoding);
+	} else if (buff->raw &&
+			!analog_encoding_eq(&buff->encoding, analog->encoding)) {
+		sr_err("Encoding of analog channel %s changed, cannot "
+			"keep its data raw.", ch->name);
+		return SR_ERR_DATA;
 	}
 
+	/* Convert the analog data to float, unless it is kept raw. */
+	values = NULL;
+	if (!buff->raw || outc->analog_summary) {
+		values = g_try_malloc0(analog->num_samples * sizeof(values[0]));
+		if (!values)
+			return SR_ERR_MALLOC;
+		ret = sr_analog_to_float(analog, values);
+		if (ret != SR_OK) {
+			g_free(values);
+			return ret;
+		}
+	}
+	if (outc->analog_summary)
+		summary_analog_add(outc->analog_summary[idx], values,
+			analog->num_samples);
+
 	/*
 	 * Queue most recently received samples to the local buffer.
 	 * Flush to the ZIP archive when the buffer space is exhausted.
 	 */
-	rdptr = values;
+	rdptr = buff->raw ? analog->data : (const uint8_t *)values;
 	send_size = analog->num_samples;
 	while (send_size) {
 		remain = buff->alloc_size - buff->fill_size;
 		if (remain) {
-			wrptr = &buff->samples[buff->fill_size];
 			copy_size = MIN(send_size, remain);
+			memcpy(&buff->samples[buff->fill_size * buff->unitsize],
+				rdptr, copy_size * buff->unitsize);
 			send_size -= copy_size;
 			buff->fill_size += copy_size;
-			memcpy(wrptr, rdptr, copy_size * sizeof(values[0]));
-			rdptr += copy_size;
+			rdptr += copy_size * buff->unitsize;
 			remain -= copy_size;
 		}
 		if (send_size && !remain) {
-			ret = zip_append_analog(o,
-				buff->samples, buff->fill_size, nr);
+			ret = zip_append_analog(o, buff, nr);
 			if (ret != SR_OK) {
 				g_free(values);
 				return ret;
 			}
 			buff->fill_size = 0;
-			remain = buff->alloc_size - buff->fill_size;
 		}
 	}
 	g_free(values);
 
 	/* Flush to the ZIP archive if the caller wants us to. */
 	if (flush && buff->fill_size) {
-		ret = zip_append_analog(o, buff->samples, buff->fill_size, nr);
+		ret = zip_append_analog(o, buff, nr);
 		if (ret != SR_OK)
 			return ret;
 		buff->fill_size = 0;
@@ -681,6 +1668,68 @@ static int zip_append_analog_queue(const struct sr_output *o,
 	return SR_OK;
 }
 
+/* Samples expanded at once from SR_DF_LOGIC_RLE and _PACKED packets. */
+#define RLE_EXPAND_SAMPLES (64 * 1024)
+
+/*
+ * Queue the samples of runs, expanded a slice at a time. The archive's
+ * own RLE encoding (when enabled) gets the runs back.
+ */
+static int zip_append_rle_queue(const struct sr_output *o,
+	const struct sr_datafeed_logic_rle *rle)
+{
+	uint8_t *buf;
+	uint64_t start, n;
+	int ret;
+
+	if (!rle->unitsize || !rle->num_samples)
+		return SR_OK;
+
+	buf = g_try_malloc(RLE_EXPAND_SAMPLES * rle->unitsize);
+	if (!buf)
+		return SR_ERR_MALLOC;
+	ret = SR_OK;
+	for (start = 0; start < rle->num_samples && ret == SR_OK; start += n) {
+		n = MIN(RLE_EXPAND_SAMPLES, rle->num_samples - start);
+		ret = sr_logic_rle_to_dense(rle, start, n, buf);
+		if (ret == SR_OK)
+			ret = zip_append_queue(o, buf, rle->unitsize,
+				n * rle->unitsize, FALSE);
+	}
+	g_free(buf);
+
+	return ret;
+}
+
+/*
+ * Queue packed samples, a byte per sample as the archive has them,
+ * unpacked a slice at a time.
+ */
+static int zip_append_packed_queue(const struct sr_output *o,
+	const struct sr_datafeed_logic_packed *packed)
+{
+	uint8_t *buf;
+	uint64_t start, n;
+	int ret;
+
+	if (!packed->num_samples)
+		return SR_OK;
+
+	buf = g_try_malloc(RLE_EXPAND_SAMPLES);
+	if (!buf)
+		return SR_ERR_MALLOC;
+	ret = SR_OK;
+	for (start = 0; start < packed->num_samples && ret == SR_OK; start += n) {
+		n = MIN(RLE_EXPAND_SAMPLES, packed->num_samples - start);
+		ret = sr_logic_packed_to_dense(packed, start, n, buf);
+		if (ret == SR_OK)
+			ret = zip_append_queue(o, buf, 1, n, FALSE);
+	}
+	g_free(buf);
+
+	return ret;
+}
+
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -719,6 +1768,26 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 		if (ret != SR_OK)
 			return ret;
 		break;
+	case SR_DF_LOGIC_RLE:
+		if (!outc->zip_created) {
+			if ((ret = zip_create(o)) != SR_OK)
+				return ret;
+			outc->zip_created = TRUE;
+		}
+		ret = zip_append_rle_queue(o, packet->payload);
+		if (ret != SR_OK)
+			return ret;
+		break;
+	case SR_DF_LOGIC_PACKED:
+		if (!outc->zip_created) {
+			if ((ret = zip_create(o)) != SR_OK)
+				return ret;
+			outc->zip_created = TRUE;
+		}
+		ret = zip_append_packed_queue(o, packet->payload);
+		if (ret != SR_OK)
+			return ret;
+		break;
 	case SR_DF_ANALOG:
 		if (!outc->zip_created) {
 			if ((ret = zip_create(o)) != SR_OK)
@@ -738,6 +1807,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			ret = zip_append_analog_queue(o, NULL, TRUE);
 			if (ret != SR_OK)
 				return ret;
+			ret = zip_finish(o);
+			if (ret != SR_OK)
+				return ret;
 		}
 		break;
 	}
@@ -746,11 +1818,49 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 }
 
 static struct sr_option options[] = {
+	{"compression", "Compression", "Compression method of the data chunks", NULL, NULL},
+	{"level", "Compression level", "Compression level, 0 for the method's default", NULL, NULL},
+	{"chunksize", "Chunk size", "Size of the data chunks in bytes", NULL, NULL},
+	{"threads", "Compression threads", "Number of threads compressing chunks, 0 for one per processor", NULL, NULL},
+	{"summary", "Summary", "Add a summary of the data for overviews", NULL, NULL},
+	{"encoding", "Logic encoding", "Encoding of the logic data chunks, rle for runs of the same sample", NULL, NULL},
+	{"analog", "Analog encoding", "Encoding of the analog data chunks, raw keeps integer data as captured", NULL, NULL},
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
+	GSList *l = NULL;
+
+	if (!options[0].def) {
+#ifdef HAVE_ZLIB
+		options[0].def = g_variant_ref_sink(g_variant_new_string("deflate"));
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("deflate")));
+#else
+		options[0].def = g_variant_ref_sink(g_variant_new_string("store"));
+#endif
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("store")));
+#ifdef HAVE_LIBZSTD
+		if (zstd_readable())
+			l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("zstd")));
+#endif
+		options[0].values = l;
+		options[1].def = g_variant_ref_sink(g_variant_new_uint32(0));
+		options[2].def = g_variant_ref_sink(g_variant_new_uint64(CHUNK_SIZE));
+		options[3].def = g_variant_ref_sink(g_variant_new_uint32(0));
+		options[4].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+		options[5].def = g_variant_ref_sink(g_variant_new_string("raw"));
+		l = NULL;
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("raw")));
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("rle")));
+		options[5].values = l;
+		options[6].def = g_variant_ref_sink(g_variant_new_string("float"));
+		l = NULL;
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("float")));
+		l = g_slist_append(l, g_variant_ref_sink(g_variant_new_string("raw")));
+		options[6].values = l;
+	}
+
 	return options;
 }
 
@@ -761,12 +1871,27 @@ static int cleanup(struct sr_output *o)
 
 	outc = o->priv;
 
+	if (outc->writer) {
+		/* Still keep what was written when the feed ended early. */
+		if (outc->meta && !outc->writer->finished)
+			zip_finish(o);
+		zip_writer_free(outc->writer);
+	}
+	if (outc->meta)
+		g_key_file_free(outc->meta);
+	g_free(outc->next_analog_chunk);
 	g_free(outc->analog_index_map);
 	g_free(outc->filename);
+	g_free(outc->rle_buf);
 	g_free(outc->logic_buff.samples);
 	for (idx = 0; idx < outc->analog_ch_count; idx++)
 		g_free(outc->analog_buff[idx].samples);
+	sr_mem_release(outc->mem_ctx, outc->mem_reserved);
 	g_free(outc->analog_buff);
+	summary_free(outc->logic_summary);
+	for (idx = 0; outc->analog_summary && idx < outc->analog_ch_count; idx++)
+		summary_free(outc->analog_summary[idx]);
+	g_free(outc->analog_summary);
 
 	g_free(outc);
 	o->priv = NULL;
@@ -31,6 +31,7 @@
 
 #include <ctype.h>
 #include <glib.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -45,14 +46,21 @@ static const int with_pool_stats = 0;
 struct vcd_channel_desc {
 	size_t index;
 	GString *name;
+	char ident[4];
+	size_t ident_len;
 	enum sr_channeltype type;
 	struct {
-		uint8_t logic;
 		double real;
 	} last;
 	uint64_t last_rcvd_snum;
 };
 
+/* Logic samples get compared in words of this many bits. */
+#define LOGIC_WORD_BITS		(8 * sizeof(gulong))
+
+/* Queue position which doesn't refer to any item. */
+#define QUEUE_NO_ITEM		SIZE_MAX
+
 /** Queued values for a given sample number. */
 struct vcd_queue_item {
 	uint64_t samplenum;	/**!< sample number, _not_ timestamp */
@@ -67,12 +75,29 @@ struct context {
 	uint64_t period;
 	struct vcd_channel_desc *channels;
 	uint64_t samplerate;
+	uint64_t ts_mul;
 	GSList *free_list, *used_list;
 	size_t alloced, freed, reused, pooled;
-	GList *vcd_queue_list;
-	GList *vcd_queue_last;
+	/*
+	 * Items are kept sorted by sample number, queue_count of them
+	 * starting at queue_head. The last accessed item's position is
+	 * kept, channels mostly continue where they left off.
+	 */
+	struct vcd_queue_item **queue;
+	size_t queue_alloc, queue_head, queue_count;
+	size_t queue_last;
 	gboolean immediate_write;
-	uint8_t *last_logic;
+	/*
+	 * The last logic data, converted to host order words. Which
+	 * bits of the words are enabled logic channels, and which
+	 * channels they are. Changes in a word are bits of its XOR
+	 * against the previous word.
+	 */
+	size_t logic_words;
+	gulong *last_logic;
+	gulong *logic_mask;
+	gulong *logic_diff;
+	struct vcd_channel_desc **logic_map;
 };
 
 /*
@@ -177,29 +202,84 @@ static GString *vcd_identifier(size_t idx)
  *   writer and the reader.
  */
 
-static void append_vcd_timestamp(GString *s, double ts, gboolean lf)
+static double snum_to_ts(struct context *ctx, uint64_t snum)
 {
+	double ts;
 
-	g_string_append_c(s, '\n');
-	g_string_append_c(s, '#');
-	g_string_append_printf(s, "%.0f", ts);
-	g_string_append_c(s, lf ? '\n' : ' ');
+	ts = (double)snum;
+	ts /= ctx->samplerate;
+	ts *= ctx->period;
+
+	return ts;
 }
 
-static void format_vcd_value_bit(GString *s, uint8_t bit_value, GString *id)
+/*
+ * Use integer timestamps when the timescale is a multiple of the
+ * samplerate, which get_timescale_freq() mostly arranges for.
+ */
+static void update_ts_mul(struct context *ctx)
 {
 
-	g_string_append_c(s, bit_value ? '1' : '0');
-	g_string_append(s, id->str);
+	ctx->ts_mul = 0;
+	if (ctx->samplerate && ctx->period % ctx->samplerate == 0)
+		ctx->ts_mul = ctx->period / ctx->samplerate;
 }
 
-static void format_vcd_value_real(GString *s, double real_value, GString *id)
+/* Print a number in decimal, returns the number of characters. */
+static size_t format_decimal(char *text, uint64_t value)
+{
+	char digits[20];
+	size_t len, i;
+
+	len = 0;
+	do {
+		digits[len++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	for (i = 0; i < len; i++)
+		text[i] = digits[len - 1 - i];
+
+	return len;
+}
+
+static void append_vcd_timestamp(struct context *ctx, GString *s,
+	uint64_t snum, gboolean lf)
+{
+	char text[2 + 20 + 1];
+	size_t len;
+
+	if (!ctx->ts_mul || snum > UINT64_MAX / ctx->ts_mul) {
+		g_string_append_printf(s, "\n#%.0f%c",
+			snum_to_ts(ctx, snum), lf ? '\n' : ' ');
+		return;
+	}
+
+	len = 0;
+	text[len++] = '\n';
+	text[len++] = '#';
+	len += format_decimal(&text[len], snum * ctx->ts_mul);
+	text[len++] = lf ? '\n' : ' ';
+	g_string_append_len(s, text, len);
+}
+
+static void format_vcd_value_bit(GString *s, uint8_t bit_value,
+	const struct vcd_channel_desc *desc)
+{
+	char text[1 + sizeof(desc->ident)];
+
+	text[0] = bit_value ? '1' : '0';
+	memcpy(&text[1], desc->ident, desc->ident_len);
+	g_string_append_len(s, text, 1 + desc->ident_len);
+}
+
+static void format_vcd_value_real(GString *s, double real_value,
+	const struct vcd_channel_desc *desc)
 {
 
 	g_string_append_c(s, 'r');
 	g_string_append_printf(s, "%.16g", real_value);
 	g_string_append_c(s, ' ');
-	g_string_append(s, id->str);
+	g_string_append_len(s, desc->ident, desc->ident_len);
 }
 
 static int init(struct sr_output *o, GHashTable *options)
@@ -209,6 +289,7 @@ static int init(struct sr_output *o, GHashTable *options)
 	struct sr_channel *ch;
 	GSList *l;
 	size_t num_enabled, num_logic, num_analog, desc_idx;
+	size_t max_index, bit, i;
 	struct vcd_channel_desc *desc;
 
 	(void)options;
@@ -256,6 +337,8 @@ static int init(struct sr_output *o, GHashTable *options)
 		desc = &ctx->channels[desc_idx];
 		desc->index = ch->index;
 		desc->name = vcd_identifier(desc_idx);
+		desc->ident_len = desc->name->len;
+		memcpy(desc->ident, desc->name->str, desc->ident_len);
 		desc->type = ch->type;
 		/*
 		 * Make sure to _not_ match next time, to have initial
@@ -263,7 +346,6 @@ static int init(struct sr_output *o, GHashTable *options)
 		 */
 		if (desc->type == SR_CHANNEL_LOGIC && num_logic) {
 			num_logic--;
-			desc->last.logic = ~0;
 		} else if (desc->type == SR_CHANNEL_ANALOG && num_analog) {
 			num_analog--;
 			/* "Construct" NaN, avoid a compile time error. */
@@ -290,13 +372,37 @@ static int init(struct sr_output *o, GHashTable *options)
 	/*
 	 * Keep a copy of the last logic data bitmap around. To avoid
 	 * iterating over individual bits when nothing in the set has
-	 * changed. The overhead of two byte array compares should
-	 * outweight the tenfold bit count compared to byte counts.
+	 * changed, and to only visit the bits which did change.
+	 *
+	 * TODO Check whether the mapping from data image positions to
+	 * channel numbers is required. Experiments suggest that the
+	 * data image "is dense", and packs bits of enabled channels,
+	 * and leaves no room for positions of disabled channels.
 	 */
-	alloc_size = (ctx->logic_count + 7) / 8;
-	ctx->last_logic = g_malloc0(alloc_size);
-	if (ctx->logic_count && !ctx->last_logic)
-		return SR_ERR_MALLOC;
+	max_index = 0;
+	for (i = 0; i < ctx->enabled_count; i++) {
+		desc = &ctx->channels[i];
+		if (desc->type == SR_CHANNEL_LOGIC && desc->index > max_index)
+			max_index = desc->index;
+	}
+	ctx->logic_words = 0;
+	if (ctx->logic_count)
+		ctx->logic_words = max_index / LOGIC_WORD_BITS + 1;
+	ctx->last_logic = g_new0(gulong, ctx->logic_words);
+	ctx->logic_mask = g_new0(gulong, ctx->logic_words);
+	ctx->logic_diff = g_new0(gulong, ctx->logic_words);
+	alloc_size = ctx->logic_words * LOGIC_WORD_BITS;
+	ctx->logic_map = g_new0(struct vcd_channel_desc *, alloc_size);
+	for (i = 0; i < ctx->enabled_count; i++) {
+		desc = &ctx->channels[i];
+		if (desc->type != SR_CHANNEL_LOGIC)
+			continue;
+		bit = desc->index % LOGIC_WORD_BITS;
+		ctx->logic_mask[desc->index / LOGIC_WORD_BITS] |= 1UL << bit;
+		ctx->logic_map[desc->index] = desc;
+	}
+
+	ctx->queue_last = QUEUE_NO_ITEM;
 
 	return SR_OK;
 }
@@ -361,6 +467,7 @@ static GString *gen_header(const struct sr_output *o)
 		}
 	}
 	ctx->period = get_timescale_freq(ctx->samplerate);
+	update_ts_mul(ctx);
 	t = time(NULL);
 	timestamp = g_strdup(ctime(&t));
 	timestamp[strlen(timestamp) - 1] = '\0';
@@ -555,31 +662,57 @@ static void queue_drain_pool(struct context *ctx)
 	g_slist_free(list);
 }
 
-static int cmp_snum(gconstpointer l, gconstpointer d)
+/*
+ * Find the position of the first queue item which is not before a
+ * specific sample number. The queue is sorted, bisect its items.
+ */
+static size_t queue_find_pos(struct context *ctx, uint64_t snum)
 {
-	const struct vcd_queue_item *list_item;
-	const uint64_t *snum_ptr;
-
-	list_item = l;
-	snum_ptr = d;
-	if (list_item->samplenum > *snum_ptr)
-		return +1;
-	if (list_item->samplenum < *snum_ptr)
-		return -1;
-	return 0;
+	size_t lo, hi, mid;
+
+	lo = ctx->queue_head;
+	hi = ctx->queue_head + ctx->queue_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ctx->queue[mid]->samplenum < snum)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
 }
 
-static int cmp_items(gconstpointer a, gconstpointer b)
+/* Insert an item at a position, make room for it when needed. */
+static int queue_insert_item(struct context *ctx, size_t pos,
+	struct vcd_queue_item *item)
 {
-	const struct vcd_queue_item *item_a, *item_b;
-
-	item_a = a;
-	item_b = b;
-	if (item_a->samplenum > item_b->samplenum)
-		return +1;
-	if (item_a->samplenum < item_b->samplenum)
-		return -1;
-	return 0;
+	struct vcd_queue_item **queue;
+	size_t end, alloc;
+
+	end = ctx->queue_head + ctx->queue_count;
+	if (end == ctx->queue_alloc && ctx->queue_head) {
+		memmove(&ctx->queue[0], &ctx->queue[ctx->queue_head],
+			ctx->queue_count * sizeof(ctx->queue[0]));
+		pos -= ctx->queue_head;
+		end -= ctx->queue_head;
+		ctx->queue_head = 0;
+	}
+	if (end == ctx->queue_alloc) {
+		alloc = MAX(2 * ctx->queue_alloc, 256);
+		queue = g_try_renew(struct vcd_queue_item *, ctx->queue, alloc);
+		if (!queue)
+			return SR_ERR_MALLOC;
+		ctx->queue = queue;
+		ctx->queue_alloc = alloc;
+	}
+	memmove(&ctx->queue[pos + 1], &ctx->queue[pos],
+		(end - pos) * sizeof(ctx->queue[0]));
+	ctx->queue[pos] = item;
+	ctx->queue_count++;
+	ctx->queue_last = pos;
+
+	return SR_OK;
 }
 
 /*
@@ -590,169 +723,45 @@ static int cmp_items(gconstpointer a, gconstpointer b)
  * Lower sample numbers near the start of the queue when channels change
  * between session feed packets, before another linear sequence follows.
  *
- * Naive use of convenience glib routines would severely lose performance.
- * That's why custom code is used, which is as complex as it needs to be,
- * yet shall execute faster than a simpler implementation. For trivial
- * cases (logic only, one analog channel only) this queue is bypassed.
+ * So check the current and the next item first, then whether the number
+ * is past the end of the queue. Only bisect the queue for the remaining
+ * cases. For trivial cases (logic only, one analog channel only) this
+ * queue is bypassed.
  */
 static int queue_samplenum(struct context *ctx, uint64_t snum)
 {
-	struct vcd_queue_item *item, *add_item;
-	GList *walk_list, *after_snum, *before_snum, *add_list;
-	GList *last;
-	gboolean add_after_last, do_search;
-
-	/* Already at that position? */
-	item = ctx->vcd_queue_last ? ctx->vcd_queue_last->data : NULL;
-	if (item && item->samplenum == snum)
-		return SR_OK;
+	struct vcd_queue_item *item;
+	size_t pos, end;
 
-	/*
-	 * Search after the current position in the remaining queue. The
-	 * custom code uses the queue's being sorted by sample number.
-	 * Narrow down a later insert position as much as possible. This
-	 * avoids linear search in huge spaces later on.
-	 */
-	last = NULL;
-	add_after_last = FALSE;
-	after_snum = NULL;
-	before_snum = NULL;
-	walk_list = ctx->vcd_queue_last;
-	while (walk_list) {
-		item = walk_list->data;
-		if (!item)
-			break;
-		if (item->samplenum == snum) {
-			ctx->vcd_queue_last = walk_list;
+	end = ctx->queue_head + ctx->queue_count;
+	pos = ctx->queue_last;
+	if (pos != QUEUE_NO_ITEM) {
+		if (ctx->queue[pos]->samplenum == snum)
 			return SR_OK;
-		}
-		last = walk_list;
-		if (item->samplenum < snum)
-			before_snum = walk_list;
-		if (item->samplenum > snum) {
-			after_snum = walk_list;
-			break;
-		}
-		if (!walk_list->next)
-			add_after_last = TRUE;
-		walk_list = walk_list->next;
-	}
-
-	/*
-	 * No exact match at or beyond the current position. Run another
-	 * search from the start of the queue, again restrict the space
-	 * which is searched, and narrow down the insert position when
-	 * no match is found.
-	 *
-	 * If the searched sample number is larger than any we have seen
-	 * before, or was in the above covered range but was not found,
-	 * then we know that another queue item needs to get added, and
-	 * where to put it. In that case we need not iterate the earlier
-	 * list items.
-	 */
-	walk_list = ctx->vcd_queue_list;
-	do_search = TRUE;
-	if (add_after_last)
-		do_search = FALSE;
-	if (before_snum)
-		do_search = FALSE;
-	while (do_search && walk_list && walk_list != ctx->vcd_queue_last) {
-		item = walk_list->data;
-		if (!item)
-			break;
-		if (item->samplenum == snum) {
-			ctx->vcd_queue_last = walk_list;
+		if (pos + 1 < end && ctx->queue[pos + 1]->samplenum == snum) {
+			ctx->queue_last = pos + 1;
 			return SR_OK;
 		}
-		if (item->samplenum < snum)
-			before_snum = walk_list;
-		if (item->samplenum > snum) {
-			after_snum = walk_list;
-			break;
-		}
-		walk_list = walk_list->next;
 	}
 
-	/*
-	 * The complete existing queue was exhausted, no exact match was
-	 * found. A new queue item must get inserted. Identify a good
-	 * position where to start searching for the exact position to
-	 * link the new item to the list. Assume that the combination of
-	 * the glib routine's list traversal and the sample number check
-	 * in the callback is expensive, reduce the amount of work done.
-	 *
-	 * If we have seen an item with a larger sample number than the
-	 * wanted, check its immediate predecessor. If this has a smaller
-	 * sample number, then we found a perfect location to insert the
-	 * new item. If we know that the new item must be inserted after
-	 * the last traversed queue item, start there.
-	 */
-	if (!before_snum) do {
-		if (add_after_last)
-			break;
-		if (!after_snum)
-			break;
-		walk_list = after_snum->prev;
-		if (!walk_list)
-			break;
-		item = walk_list->data;
-		if (!item)
-			break;
-		if (item->samplenum == snum) {
-			ctx->vcd_queue_last = walk_list;
+	if (!ctx->queue_count || ctx->queue[end - 1]->samplenum < snum) {
+		pos = end;
+	} else {
+		pos = queue_find_pos(ctx, snum);
+		if (ctx->queue[pos]->samplenum == snum) {
+			ctx->queue_last = pos;
 			return SR_OK;
 		}
-		if (item->samplenum < snum)
-			before_snum = walk_list;
-	} while (0);
-	add_list = add_after_last ? last : before_snum;
-	if (!add_list) {
-		walk_list = ctx->vcd_queue_list;
-		while (walk_list) {
-			item = walk_list->data;
-			if (!item)
-				break;
-			if (item->samplenum == snum) {
-				ctx->vcd_queue_last = walk_list;
-				return SR_OK;
-			}
-			if (item->samplenum > snum) {
-				after_snum = walk_list;
-				break;
-			}
-			add_list = walk_list;
-			walk_list = walk_list->next;
-		}
-	}
-	if (add_list && (item = add_list->data) && item->samplenum == snum) {
-		ctx->vcd_queue_last = add_list;
-		return SR_OK;
 	}
 
-	/*
-	 * Create a new queue item for the so far untracked sample
-	 * number. Immediately search for the inserted position (is
-	 * unfortunately not returned from the insert call), and
-	 * cache that position for subsequent lookups.
-	 */
+	/* Create a new queue item for the so far untracked sample number. */
 	if (with_queue_stats)
 		sr_dbg("%s(), queue nr %" PRIu64, __func__, snum);
-	add_item = queue_alloc_item(ctx, snum);
-	if (!add_item)
+	item = queue_alloc_item(ctx, snum);
+	if (!item)
 		return SR_ERR_MALLOC;
-	if (!add_list)
-		add_list = ctx->vcd_queue_list;
-	if (add_list && add_list->prev)
-		add_list = add_list->prev;
-	walk_list = g_list_insert_sorted(add_list, add_item, cmp_items);
-	if (!walk_list->prev)
-		ctx->vcd_queue_list = walk_list;
-	walk_list = g_list_find_custom(walk_list, &snum, cmp_snum);
-	item = walk_list ? walk_list->data : NULL;
-	if (item && item->samplenum == snum) {
-		ctx->vcd_queue_last = walk_list;
-	}
-	return SR_OK;
+
+	return queue_insert_item(ctx, pos, item);
 }
 
 /*
@@ -766,9 +775,9 @@ static GString *queue_value_text_prep(struct context *ctx)
 	GString *buff;
 
 	/* Cope with not-yet-positioned write pointers. */
-	item = ctx->vcd_queue_last ? ctx->vcd_queue_last->data : NULL;
-	if (!item)
+	if (ctx->queue_last == QUEUE_NO_ITEM)
 		return NULL;
+	item = ctx->queue[ctx->queue_last];
 
 	/* Create a GString if not done already. */
 	buff = item->values;
@@ -784,17 +793,6 @@ static GString *queue_value_text_prep(struct context *ctx)
 	return buff;
 }
 
-static double snum_to_ts(struct context *ctx, uint64_t snum)
-{
-	double ts;
-
-	ts = (double)snum;
-	ts /= ctx->samplerate;
-	ts *= ctx->period;
-
-	return ts;
-}
-
 /*
  * Unqueue one item of the VCD values queue which corresponds to one
  * sample number. Append all of the text to the passed in GString.
@@ -802,7 +800,6 @@ static double snum_to_ts(struct context *ctx, uint64_t snum)
 static int unqueue_item(struct context *ctx,
 	struct vcd_queue_item *item, GString *s)
 {
-	double ts;
 	GString *buff;
 	gboolean is_empty;
 
@@ -812,12 +809,11 @@ static int unqueue_item(struct context *ctx,
 	 * timestamp but no value changes, assuming this is the last
 	 * entry which corresponds to SR_DF_END.
 	 */
-	ts = snum_to_ts(ctx, item->samplenum);
 	buff = item->values;
 	is_empty = !buff || !buff->len || !buff->str || !*buff->str;
-	append_vcd_timestamp(s, ts, is_empty);
+	append_vcd_timestamp(ctx, s, item->samplenum, is_empty);
 	if (!is_empty)
-		g_string_append(s, buff->str);
+		g_string_append_len(s, buff->str, buff->len);
 
 	return SR_OK;
 }
@@ -934,7 +930,6 @@ static uint64_t get_max_snum_flush(struct context *ctx)
 static int write_completed_changes(struct context *ctx, GString *out)
 {
 	uint64_t upto_snum;
-	GList **listref, *node;
 	struct vcd_queue_item *item;
 	int rc;
 	size_t dumped;
@@ -945,38 +940,99 @@ static int write_completed_changes(struct context *ctx, GString *out)
 		sr_spew("%s(), check up to %" PRIu64, __func__, upto_snum);
 
 	/*
-	 * Forward and consume those items from the head of the list
+	 * Forward and consume those items from the head of the queue
 	 * which we completely have accumulated and are certain about.
+	 * Void the cached position when its item goes away.
 	 */
+	rc = SR_OK;
 	dumped = 0;
-	listref = &ctx->vcd_queue_list;
-	while (*listref) {
-		/* Find items before the targetted sample number. */
-		node = *listref;
-		item = node->data;
-		if (!item)
-			break;
+	while (ctx->queue_count && rc == SR_OK) {
+		item = ctx->queue[ctx->queue_head];
 		if (item->samplenum >= upto_snum)
 			break;
-
-		/*
-		 * Unlink the item from the list. Void cached positions.
-		 * Append its timestamp and values to the caller's text.
-		 */
 		dumped++;
 		if (with_queue_stats)
 			sr_dbg("%s(), dump nr %" PRIu64,
 				__func__, item->samplenum);
-		if (ctx->vcd_queue_last == node)
-			ctx->vcd_queue_last = NULL;
-		*listref = g_list_remove_link(*listref, node);
+		if (ctx->queue_last == ctx->queue_head)
+			ctx->queue_last = QUEUE_NO_ITEM;
+		ctx->queue_head++;
+		ctx->queue_count--;
 		rc = unqueue_item(ctx, item, out);
 		queue_free_item(ctx, item);
-		if (rc != SR_OK)
-			return rc;
+	}
+	if (!ctx->queue_count) {
+		ctx->queue_head = 0;
+		ctx->queue_last = QUEUE_NO_ITEM;
 	}
 
-	return SR_OK;
+	return rc;
+}
+
+/*
+ * Check which logic values of a sample have changed, and emit (or queue)
+ * them. Always dump all of them for the first sample.
+ */
+static void handle_logic_sample(struct context *ctx, GString *out,
+	uint64_t snum, const uint8_t *sample, size_t unit_size,
+	size_t word_count)
+{
+	struct vcd_channel_desc *desc;
+	size_t w, copy;
+	gboolean changed;
+	GString *s_val;
+	uint8_t curbit;
+	gulong word, diff;
+	gint bit;
+
+	changed = snum == 0;
+	for (w = 0; w < word_count; w++) {
+		word = 0;
+		copy = MIN(sizeof(word), unit_size - w * sizeof(word));
+		memcpy(&word, &sample[w * sizeof(word)], copy);
+		word = GULONG_FROM_LE(word);
+		ctx->logic_diff[w] = word ^ ctx->last_logic[w];
+		if (snum == 0)
+			ctx->logic_diff[w] = ~0UL;
+		ctx->logic_diff[w] &= ctx->logic_mask[w];
+		changed |= ctx->logic_diff[w] != 0;
+		ctx->last_logic[w] = word;
+	}
+	if (!changed)
+		return;
+
+	/*
+	 * Start or continue tracking that sample number.
+	 * Avoid string copies for logic-only setups.
+	 */
+	if (ctx->immediate_write)
+		append_vcd_timestamp(ctx, out, snum, FALSE);
+	else
+		queue_samplenum(ctx, snum);
+
+	/* Iterate over the logic channels which changed. */
+	for (w = 0; w < word_count; w++) {
+		diff = ctx->logic_diff[w];
+		bit = -1;
+		while ((bit = g_bit_nth_lsf(diff, bit)) >= 0) {
+			desc = ctx->logic_map[w * LOGIC_WORD_BITS + bit];
+			curbit = (ctx->last_logic[w] >> bit) & 1;
+
+			/*
+			 * Queue, or immediately emit the text
+			 * for the observed value change.
+			 */
+			if (ctx->immediate_write) {
+				g_string_append_c(out, ' ');
+				s_val = out;
+			} else {
+				s_val = queue_value_text_prep(ctx);
+				if (!s_val)
+					return;
+			}
+			format_vcd_value_bit(s_val, curbit, desc);
+		}
+	}
 }
 
 /* Get packets from the session feed, generate output text. */
@@ -986,20 +1042,21 @@ static int receive(const struct sr_output *o,
 	struct context *ctx;
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
 	const struct sr_datafeed_analog *analog;
 	const struct sr_config *src;
 	GSList *l;
 	struct vcd_channel_desc *desc;
 	uint64_t snum_curr;
-	size_t count, index, p, unit_size;
+	size_t count, index, unit_size, word_count;
 	gboolean changed;
 	GString *s_val;
-	uint8_t *sample, *last_logic, prevbit, curbit;
+	uint8_t *sample;
+	gulong word;
 	GSList *channels;
 	struct sr_channel *channel;
 	int rc;
 	float *floats, value;
-	double ts;
 
 	*out = NULL;
 	if (!o || !o->priv)
@@ -1014,6 +1071,7 @@ static int receive(const struct sr_output *o,
 			if (src->key != SR_CONF_SAMPLERATE)
 				continue;
 			ctx->samplerate = g_variant_get_uint64(src->data);
+			update_ts_mul(ctx);
 		}
 		break;
 	case SR_DF_LOGIC:
@@ -1026,71 +1084,38 @@ static int receive(const struct sr_output *o,
 		snum_curr = get_last_snum_logic(ctx);
 		upd_last_snum_logic(ctx, count);
 
-		last_logic = ctx->last_logic;
-		while (count--) {
-			/* Check whether any logic value has changed. */
-			changed = memcmp(last_logic, sample, unit_size) != 0;
-			changed |= snum_curr == 0;
-			if (changed)
-				memcpy(last_logic, sample, unit_size);
-
-			/*
-			 * Start or continue tracking that sample number.
-			 * Avoid string copies for logic-only setups.
-			 */
-			if (changed) {
-				if (ctx->immediate_write) {
-					ts = snum_to_ts(ctx, snum_curr);
-					append_vcd_timestamp(*out, ts, FALSE);
-				} else {
-					queue_samplenum(ctx, snum_curr);
-				}
-			}
-
-			/* Iterate over individual logic channels. */
-			for (p = 0; changed && p < ctx->enabled_count; p++) {
-				/*
-				 * TODO Check whether the mapping from
-				 * data image positions to channel numbers
-				 * is required. Experiments suggest that
-				 * the data image "is dense", and packs
-				 * bits of enabled channels, and leaves no
-				 * room for positions of disabled channels.
-				 */
-				desc = &ctx->channels[p];
-				if (desc->type != SR_CHANNEL_LOGIC)
-					continue;
-				index = desc->index;
-				prevbit = desc->last.logic;
-
-				/* Skip over unchanged values. */
-				curbit = sample[index / 8];
-				curbit = (curbit & (1 << (index % 8))) ? 1 : 0;
-				if (snum_curr != 0 && prevbit == curbit)
-					continue;
-				desc->last.logic = curbit;
-
-				/*
-				 * Queue, or immediately emit the text for
-				 * the observed value change.
-				 */
-				if (ctx->immediate_write) {
-					g_string_append_c(*out, ' ');
-					s_val = *out;
-				} else {
-					s_val = queue_value_text_prep(ctx);
-					if (!s_val)
-						break;
-				}
-				format_vcd_value_bit(s_val, curbit, desc->name);
-			}
+		/* Only look at the part of samples that has channels. */
+		word_count = (unit_size + sizeof(word) - 1) / sizeof(word);
+		word_count = MIN(word_count, ctx->logic_words);
 
-			/* Advance to next set of logic samples. */
+		while (count--) {
+			handle_logic_sample(ctx, *out, snum_curr, sample,
+				unit_size, word_count);
 			snum_curr++;
 			sample += unit_size;
 		}
 		write_completed_changes(ctx, *out);
 		break;
+	case SR_DF_LOGIC_RLE:
+		*out = chk_header(o);
+
+		/* Only the runs' starts can be changes. */
+		rle = packet->payload;
+		unit_size = rle->unitsize;
+		if (!unit_size)
+			break;
+		snum_curr = get_last_snum_logic(ctx);
+		upd_last_snum_logic(ctx, rle->num_samples);
+		word_count = (unit_size + sizeof(word) - 1) / sizeof(word);
+		word_count = MIN(word_count, ctx->logic_words);
+		for (index = 0; index < rle->num_runs; index++) {
+			handle_logic_sample(ctx, *out,
+				snum_curr + rle->offsets[index],
+				(const uint8_t *)rle->values + index * unit_size,
+				unit_size, word_count);
+		}
+		write_completed_changes(ctx, *out);
+		break;
 	case SR_DF_ANALOG:
 		*out = chk_header(o);
 
@@ -1149,14 +1174,14 @@ static int receive(const struct sr_output *o,
 
 			/* Queue, or emit the timestamp and the new value. */
 			if (ctx->immediate_write) {
-				ts = snum_to_ts(ctx, snum_curr + index);
-				append_vcd_timestamp(*out, ts, FALSE);
+				append_vcd_timestamp(ctx, *out,
+					snum_curr + index, FALSE);
 				s_val = *out;
 			} else {
 				queue_samplenum(ctx, snum_curr + index);
 				s_val = queue_value_text_prep(ctx);
 			}
-			format_vcd_value_real(s_val, value, desc->name);
+			format_vcd_value_real(s_val, value, desc);
 		}
 
 		g_free(floats);
@@ -1179,6 +1204,7 @@ static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
 	struct vcd_channel_desc *desc;
+	size_t i;
 
 	if (!o || !o->priv)
 		return SR_ERR_ARG;
@@ -1188,6 +1214,9 @@ static int cleanup(struct sr_output *o)
 	if (with_pool_stats)
 		sr_info("STATS: alloc/reuse %zu/%zu, pool/free %zu/%zu",
 			ctx->alloced, ctx->reused, ctx->pooled, ctx->freed);
+	for (i = 0; i < ctx->queue_count; i++)
+		queue_free_item(ctx, ctx->queue[ctx->queue_head + i]);
+	ctx->queue_count = 0;
 	queue_drain_pool(ctx);
 	if (with_pool_stats)
 		sr_info("STATS: alloc/reuse %zu/%zu, pool/free %zu/%zu",
@@ -1198,6 +1227,11 @@ static int cleanup(struct sr_output *o)
 		g_string_free(desc->name, TRUE);
 	}
 	g_free(ctx->channels);
+	g_free(ctx->queue);
+	g_free(ctx->last_logic);
+	g_free(ctx->logic_mask);
+	g_free(ctx->logic_diff);
+	g_free(ctx->logic_map);
 	g_free(ctx);
 
 	return SR_OK;
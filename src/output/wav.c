@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <math.h>
 #include <string.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
@@ -29,61 +30,119 @@
 
 struct out_context {
 	double scale;
+	gboolean int16;
 	gboolean header_done;
 	uint64_t samplerate;
 	int num_channels;
 	GSList *channels;
-	int chanbuf_size;
-	int *chanbuf_used;
-	uint8_t **chanbuf;
+	/*
+	 * Scaled values per channel which were received but not written
+	 * yet, because other channels' values for them are still missing.
+	 */
+	size_t chanbuf_size;
+	size_t *chanbuf_used;
+	float **chanbuf;
 	float *fdata;
+	int *chan_idx;
 };
 
-static int realloc_chanbufs(const struct sr_output *o, int size)
+/* Have room for another count of values in a channel's buffer. */
+static int grow_chanbuf(struct out_context *outc, int chan, size_t count)
 {
-	struct out_context *outc;
+	size_t size;
 	int i;
+	float *buf;
 
-	outc = o->priv;
+	if (outc->chanbuf_used[chan] + count <= outc->chanbuf_size)
+		return SR_OK;
+
+	size = MAX(2 * outc->chanbuf_size, outc->chanbuf_used[chan] + count);
 	for (i = 0; i < outc->num_channels; i++) {
-		if (!(outc->chanbuf[i] = g_try_realloc(outc->chanbuf[i], sizeof(float) * size))) {
+		buf = g_try_realloc(outc->chanbuf[i], sizeof(float) * size);
+		if (!buf) {
 			sr_err("Unable to allocate enough output buffer memory.");
-			return SR_ERR;
+			return SR_ERR_MALLOC;
 		}
-		outc->chanbuf_used[i] = 0;
+		outc->chanbuf[i] = buf;
 	}
 	outc->chanbuf_size = size;
 
 	return SR_OK;
 }
 
-static int flush_chanbufs(const struct sr_output *o, GString *out)
+/*
+ * Returns the number of samples which all channel buffers have values
+ * for, which is what can get written.
+ */
+static size_t complete_samples(const struct out_context *outc)
 {
-	struct out_context *outc;
-	int num_samples, i, j;
-	char *buf, *bufp;
+	size_t size;
+	int i;
 
-	outc = o->priv;
+	size = outc->num_channels ? outc->chanbuf_used[0] : 0;
+	for (i = 1; i < outc->num_channels; i++)
+		size = MIN(size, outc->chanbuf_used[i]);
 
-	/* Any one of them will do. */
-	num_samples = outc->chanbuf_used[0];
-	if (!(buf = g_try_malloc(4 * num_samples * outc->num_channels))) {
-		sr_err("Unable to allocate enough interleaved output buffer memory.");
-		return SR_ERR;
-	}
+	return size;
+}
 
-	bufp = buf;
-	for (i = 0; i < num_samples; i++) {
-		for (j = 0; j < outc->num_channels; j++) {
-			memcpy(bufp, outc->chanbuf[j] + i * 4, 4);
-			bufp += 4;
+/*
+ * Interleave the channels' values of a number of samples, in the
+ * output format. The inner loops only do a plain conversion, so that
+ * compilers can vectorize them.
+ */
+static void write_samples(const struct out_context *outc,
+	uint8_t *wrptr, size_t num_samples)
+{
+	size_t i, stride;
+	int j;
+	const float *values;
+	float value;
+	uint32_t bits;
+	int16_t pcm;
+
+	stride = outc->num_channels * (outc->int16 ? 2 : 4);
+	for (j = 0; j < outc->num_channels; j++) {
+		values = outc->chanbuf[j];
+		if (outc->int16) {
+			for (i = 0; i < num_samples; i++) {
+				value = CLAMP(values[i], -1.0f, 1.0f);
+				pcm = (int16_t)lrintf(value * 32767.0f);
+				WL16(&wrptr[i * stride], pcm);
+			}
+			wrptr += 2;
+		} else {
+			for (i = 0; i < num_samples; i++) {
+				memcpy(&bits, &values[i], sizeof(bits));
+				WL32(&wrptr[i * stride], bits);
+			}
+			wrptr += 4;
 		}
 	}
-	g_string_append_len(out, buf, 4 * num_samples * outc->num_channels);
-	g_free(buf);
+}
 
-	for (i = 0; i < outc->num_channels; i++)
-		outc->chanbuf_used[i] = 0;
+static int flush_chanbufs(const struct sr_output *o, GString *out,
+	size_t num_samples)
+{
+	struct out_context *outc;
+	size_t len, remain;
+	int i;
+
+	outc = o->priv;
+
+	len = out->len;
+	g_string_set_size(out, len + num_samples * outc->num_channels *
+		(outc->int16 ? 2 : 4));
+	write_samples(outc, (uint8_t *)out->str + len, num_samples);
+
+	/* Keep what other channels haven't caught up with yet. */
+	for (i = 0; i < outc->num_channels; i++) {
+		remain = outc->chanbuf_used[i] - num_samples;
+		if (remain)
+			memmove(outc->chanbuf[i], outc->chanbuf[i] + num_samples,
+				sizeof(float) * remain);
+		outc->chanbuf_used[i] = remain;
+	}
 
 	return SR_OK;
 }
@@ -93,10 +152,12 @@ static int init(struct sr_output *o, GHashTable *options)
 	struct out_context *outc;
 	struct sr_channel *ch;
 	GSList *l;
+	int i;
 
 	outc = g_malloc0(sizeof(struct out_context));
 	o->priv = outc;
 	outc->scale = g_variant_get_double(g_hash_table_lookup(options, "scale"));
+	outc->int16 = g_variant_get_boolean(g_hash_table_lookup(options, "int16"));
 
 	for (l = o->sdi->channels; l; l = l->next) {
 		ch = l->data;
@@ -109,10 +170,14 @@ static int init(struct sr_output *o, GHashTable *options)
 	}
 
 	outc->chanbuf = g_malloc0(sizeof(float *) * outc->num_channels);
-	outc->chanbuf_used = g_malloc0(sizeof(int) * outc->num_channels);
+	outc->chanbuf_used = g_malloc0(sizeof(size_t) * outc->num_channels);
+	outc->chan_idx = g_malloc0(sizeof(int) * outc->num_channels);
 
-	/* Start off the interleaved buffer with 100 samples/channel. */
-	realloc_chanbufs(o, 100);
+	/* Start off the channel buffers with 100 samples/channel. */
+	for (i = 0; i < outc->num_channels; i++) {
+		if (grow_chanbuf(outc, i, 100) != SR_OK)
+			return SR_ERR_MALLOC;
+	}
 
 	return SR_OK;
 }
@@ -121,14 +186,16 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 {
 	struct out_context *outc;
 	char tmp[4];
+	int sample_size;
 
 	outc = o->priv;
+	sample_size = outc->int16 ? 2 : 4;
 	g_string_append(gs, "fmt ");
 	/* Remaining chunk size */
 	WL32(tmp, 0x12);
 	g_string_append_len(gs, tmp, 4);
-	/* Format code 3 = IEEE float */
-	WL16(tmp, 0x0003);
+	/* Format code 1 = PCM, 3 = IEEE float */
+	WL16(tmp, outc->int16 ? 0x0001 : 0x0003);
 	g_string_append_len(gs, tmp, 2);
 	/* Number of channels */
 	WL16(tmp, outc->num_channels);
@@ -136,14 +203,14 @@ static void add_data_chunk(const struct sr_output *o, GString *gs)
 	/* Samplerate */
 	WL32(tmp, outc->samplerate);
 	g_string_append_len(gs, tmp, 4);
-	/* Byterate, using 32-bit floats. */
-	WL32(tmp, outc->samplerate * outc->num_channels * 4);
+	/* Byterate, using 16-bit integers or 32-bit floats. */
+	WL32(tmp, outc->samplerate * outc->num_channels * sample_size);
 	g_string_append_len(gs, tmp, 4);
 	/* Blockalign */
-	WL16(tmp, outc->num_channels * 4);
+	WL16(tmp, outc->num_channels * sample_size);
 	g_string_append_len(gs, tmp, 2);
 	/* Bits per sample */
-	WL16(tmp, 32);
+	WL16(tmp, 8 * sample_size);
 	g_string_append_len(gs, tmp, 2);
 	WL16(tmp, 0);
 	g_string_append_len(gs, tmp, 2);
@@ -181,58 +248,6 @@ static GString *gen_header(const struct sr_output *o)
 	return header;
 }
 
-/*
- * Stores the float in little-endian BINARY32 IEEE-754 2008 format.
- */
-static void float_to_le(uint8_t *buf, float value)
-{
-	uint8_t *old;
-
-	old = (uint8_t *)&value;
-#ifdef WORDS_BIGENDIAN
-	buf[0] = old[3];
-	buf[1] = old[2];
-	buf[2] = old[1];
-	buf[3] = old[0];
-#else
-	buf[0] = old[0];
-	buf[1] = old[1];
-	buf[2] = old[2];
-	buf[3] = old[3];
-#endif
-}
-
-/*
- * Returns the number of samples used in the current channel buffers,
- * or -1 if they're not all the same.
- */
-static int check_chanbuf_size(const struct sr_output *o)
-{
-	struct out_context *outc;
-	int size, i;
-
-	outc = o->priv;
-	size = 0;
-	for (i = 0; i < outc->num_channels; i++) {
-		if (size == 0) {
-			if (outc->chanbuf_used[i] == 0) {
-				/* Nothing in all the buffers yet. */
-				size = -1;
-				break;
-			} else {
-				/* New high water mark. */
-				size = outc->chanbuf_used[i];
-			}
-		} else if (outc->chanbuf_used[i] != size) {
-			/* All channel buffers are not equally full yet. */
-			size = -1;
-			break;
-		}
-	}
-
-	return size;
-}
-
 static int receive(const struct sr_output *o, const struct sr_datafeed_packet *packet,
 		GString **out)
 {
@@ -243,10 +258,9 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 	struct sr_channel *ch;
 	GSList *l;
 	const GSList *channels;
-	float f;
-	int num_channels, num_samples, size, *chan_idx, idx, i, j, ret;
-	float *data;
-	uint8_t *buf;
+	int num_channels, num_samples, idx, i, j, ret;
+	size_t size;
+	float *data, *buf;
 
 	*out = NULL;
 	if (!o || !o->sdi || !(outc = o->priv))
@@ -290,40 +304,42 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 			return SR_ERR;
 		}
 
-		if (num_samples > outc->chanbuf_size) {
-			if (realloc_chanbufs(o, analog->num_samples) != SR_OK)
+		/* Index the channels in this packet, so we can deinterleave quicker. */
+		for (j = 0, l = (GSList *)channels; j < num_channels; j++, l = l->next) {
+			ch = l->data;
+			idx = ch->type == SR_CHANNEL_ANALOG ? sr_dev_channel_slot(ch) : -1;
+			if (idx < 0 || idx >= outc->num_channels) {
+				sr_err("Packet has a channel which is not enabled.");
+				return SR_ERR;
+			}
+			outc->chan_idx[j] = idx;
+			if (grow_chanbuf(outc, idx, num_samples) != SR_OK)
 				return SR_ERR_MALLOC;
 		}
 
-		/* Index the channels in this packet, so we can interleave quicker. */
-		chan_idx = g_malloc(sizeof(int) * outc->num_channels);
-		for (i = 0; i < num_channels; i++) {
-			ch = g_slist_nth_data((GSList *) channels, i);
-			chan_idx[i] = g_slist_index(outc->channels, ch);
-		}
-
-		for (i = 0; i < num_samples; i++) {
-			for (j = 0; j < num_channels; j++) {
-				idx = chan_idx[j];
-				buf = outc->chanbuf[idx] + outc->chanbuf_used[idx]++ * 4;
-				f = data[i * num_channels + j];
-				if (outc->scale != 1.0)
-					f /= outc->scale;
-				float_to_le(buf, f);
+		/* Append the scaled values to the channels' buffers. */
+		for (j = 0; j < num_channels; j++) {
+			idx = outc->chan_idx[j];
+			buf = outc->chanbuf[idx] + outc->chanbuf_used[idx];
+			for (i = 0; i < num_samples; i++)
+				buf[i] = data[i * num_channels + j];
+			if (outc->scale != 1.0) {
+				for (i = 0; i < num_samples; i++)
+					buf[i] /= outc->scale;
 			}
+			outc->chanbuf_used[idx] += num_samples;
 		}
-		g_free(chan_idx);
 
-		size = check_chanbuf_size(o);
+		size = complete_samples(outc);
 		if (size > MIN_DATA_CHUNK_SAMPLES)
-			if (flush_chanbufs(o, *out) != SR_OK)
+			if (flush_chanbufs(o, *out, size) != SR_OK)
 				return SR_ERR;
 		break;
 	case SR_DF_END:
-		size = check_chanbuf_size(o);
+		size = complete_samples(outc);
 		if (size > 0) {
 			*out = g_string_sized_new(4 * size * outc->num_channels);
-			if (flush_chanbufs(o, *out) != SR_OK)
+			if (flush_chanbufs(o, *out, size) != SR_OK)
 				return SR_ERR;
 		}
 		break;
@@ -334,13 +350,16 @@ static int receive(const struct sr_output *o, const struct sr_datafeed_packet *p
 
 static struct sr_option options[] = {
 	{ "scale", "Scale", "Scale values by factor", NULL, NULL },
+	{ "int16", "16-bit integers", "Write 16-bit integer samples, values in the -1 to 1 range", NULL, NULL },
 	ALL_ZERO
 };
 
 static const struct sr_option *get_options(void)
 {
-	if (!options[0].def)
+	if (!options[0].def) {
 		options[0].def = g_variant_ref_sink(g_variant_new_double(1.0));
+		options[1].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+	}
 
 	return options;
 }
@@ -357,6 +376,7 @@ static int cleanup(struct sr_output *o)
 		g_free(outc->chanbuf[i]);
 	g_free(outc->chanbuf_used);
 	g_free(outc->chanbuf);
+	g_free(outc->chan_idx);
 	g_free(outc->fdata);
 	g_free(outc);
 	o->priv = NULL;
@@ -24,45 +24,71 @@
 
 #define LOG_PREFIX "output/wavedrom"
 
+/*
+ * Each channel's wave is kept as runs of equal values. Values alternate
+ * from one run to the next, so only the first value and the lengths
+ * need to be stored. Memory grows with the number of transitions, not
+ * with the number of samples.
+ */
+struct channel_wave {
+	gboolean seen;
+	uint8_t first_value;
+	uint8_t last_value;
+	uint64_t run_length;
+	GArray *runs; /* Lengths of completed runs. */
+};
+
 struct context {
 	uint32_t channel_count;
 	struct sr_channel **channels;
-	GString **channel_outputs; /* output strings */
+	struct channel_wave *waves;
 };
 
+/* Append a run as its value, followed by '.' for each repetition. */
+static void render_run(GString *output, uint8_t value, uint64_t length)
+{
+	size_t pos;
+
+	g_string_append_c(output, value ? '1' : '0');
+	if (length < 2)
+		return;
+	pos = output->len;
+	g_string_set_size(output, pos + length - 1);
+	memset(output->str + pos, '.', length - 1);
+}
+
 /* Converts accumulated output data to a JSON string. */
 static GString *wavedrom_render(const struct context *ctx)
 {
 	GString *output;
+	const struct channel_wave *wave;
 	size_t ch, i;
-	char last_char, curr_char;
+	uint8_t value;
+	gboolean first;
 
 	output = g_string_new("{ \"signal\": [");
+	first = TRUE;
 	for (ch = 0; ch < ctx->channel_count; ch++) {
-		if (!ctx->channel_outputs[ch])
+		if (!ctx->channels[ch])
 			continue;
+		wave = &ctx->waves[ch];
 
 		/* Channel strip. */
 		g_string_append_printf(output,
-			"{ \"name\": \"%s\", \"wave\": \"", ctx->channels[ch]->name);
-
-		last_char = 0;
-		for (i = 0; i < ctx->channel_outputs[ch]->len; i++) {
-			curr_char = ctx->channel_outputs[ch]->str[i];
-			/* Data point. */
-			if (curr_char == last_char) {
-				g_string_append_c(output, '.');
-			} else {
-				g_string_append_c(output, curr_char);
-				last_char = curr_char;
+			"%s{ \"name\": \"%s\", \"wave\": \"",
+			first ? "" : ",", ctx->channels[ch]->name);
+		first = FALSE;
+
+		if (wave->seen) {
+			value = wave->first_value;
+			for (i = 0; i < wave->runs->len; i++) {
+				render_run(output, value,
+					g_array_index(wave->runs, uint64_t, i));
+				value = !value;
 			}
+			render_run(output, value, wave->run_length);
 		}
-		if (ch < ctx->channel_count - 1) {
-			g_string_append(output, "\" },");
-		} else {
-			/* Last channel, no comma. */
-			g_string_append(output, "\" }");
-		}
+		g_string_append(output, "\" }");
 	}
 	g_string_append(output, "], \"config\": { \"skin\": \"narrow\" }}");
 
@@ -72,48 +98,46 @@ static GString *wavedrom_render(const struct context *ctx)
 static void process_logic(const struct context *ctx,
 	const struct sr_datafeed_logic *logic)
 {
-	size_t sample_count, ch, i;
-	uint8_t *sample, bit;
-	GString *accu;
+	size_t sample_count, ch, i, byte;
+	const uint8_t *data;
+	uint8_t mask, value;
+	struct channel_wave *wave;
 
 	if (!ctx->channel_count)
 		return;
 
 	/*
-	 * Extract the logic bits for each channel and store them
-	 * as wavedrom letters (1/0) in each channel's text string.
-	 * This transforms the input which consists of sample sets
-	 * that span multiple channels into output stripes per logic
-	 * channel which consist of bits for that individual channel.
-	 *
-	 * TODO Reduce memory consumption during accumulation of
-	 * output data.
-	 *
-	 * Ideally we'd accumulate binary chunks, and defer conversion
-	 * to the text format. Analog data already won't get here, only
-	 * logic data does. When the per-channel transformation also
-	 * gets deferred until later, then the only overhead would be
-	 * for disabled logic channels. Which may be acceptable or even
-	 * negligable.
-	 *
-	 * An optional addition to the above mentioned accumulation of
-	 * binary data is RLE compression. Mark both the position in the
-	 * accumulated data as well as a repetition counter, instead of
-	 * repeatedly storing the same sample set. The efficiency of
-	 * this approach of course depends on the change rate of input
-	 * data. But the approach perfectly matches the WaveDrom syntax
-	 * for repeated bit patterns, and thus is easily handled in the
-	 * text rendering stage of the output module.
+	 * Extract the logic bits for each channel, and fold repeated
+	 * values into runs as they arrive. This matches the WaveDrom
+	 * syntax for repeated bit patterns, the rendering stage only
+	 * needs to expand the runs to their text form.
 	 */
 	sample_count = logic->length / logic->unitsize;
-	for (i = 0; i < sample_count; i++) {
-		sample = logic->data + i * logic->unitsize;
-		for (ch = 0; ch < ctx->channel_count; ch++) {
-			accu = ctx->channel_outputs[ch];
-			if (!accu)
+	data = logic->data;
+	for (ch = 0; ch < ctx->channel_count; ch++) {
+		if (!ctx->channels[ch])
+			continue;
+		byte = ch / 8;
+		if (byte >= logic->unitsize)
+			continue;
+		mask = 1 << (ch % 8);
+		wave = &ctx->waves[ch];
+		for (i = 0; i < sample_count; i++) {
+			value = (data[i * logic->unitsize + byte] & mask) ? 1 : 0;
+			if (!wave->seen) {
+				wave->seen = TRUE;
+				wave->first_value = value;
+				wave->last_value = value;
+				wave->run_length = 1;
 				continue;
-			bit = sample[ch / 8] & (1 << (ch % 8));
-			g_string_append_c(accu, bit ? '1' : '0');
+			}
+			if (value == wave->last_value) {
+				wave->run_length++;
+				continue;
+			}
+			g_array_append_val(wave->runs, wave->run_length);
+			wave->last_value = value;
+			wave->run_length = 1;
 		}
 	}
 }
@@ -159,14 +183,15 @@ static int init(struct sr_output *o, GHashTable *options)
 	ctx->channel_count = g_slist_length(o->sdi->channels);
 	ctx->channels = g_malloc0(
 		sizeof(ctx->channels[0]) * ctx->channel_count);
-	ctx->channel_outputs = g_malloc0(
-		sizeof(ctx->channel_outputs[0]) * ctx->channel_count);
+	ctx->waves = g_malloc0(
+		sizeof(ctx->waves[0]) * ctx->channel_count);
 
 	for (i = 0, l = o->sdi->channels; l; l = l->next, i++) {
 		channel = l->data;
 		if (channel->enabled && channel->type == SR_CHANNEL_LOGIC) {
 			ctx->channels[i] = channel;
-			ctx->channel_outputs[i] = g_string_new(NULL);
+			ctx->waves[i].runs = g_array_new(FALSE, FALSE,
+				sizeof(uint64_t));
 		}
 	}
 
@@ -176,7 +201,7 @@ static int init(struct sr_output *o, GHashTable *options)
 static int cleanup(struct sr_output *o)
 {
 	struct context *ctx;
-	GString *s;
+	uint32_t ch;
 
 	if (!o)
 		return SR_ERR_ARG;
@@ -185,12 +210,11 @@ static int cleanup(struct sr_output *o)
 	o->priv = NULL;
 
 	if (ctx) {
-		while (--ctx->channel_count) {
-			s = ctx->channel_outputs[ctx->channel_count];
-			if (s)
-				g_string_free(s, TRUE);
+		for (ch = 0; ch < ctx->channel_count; ch++) {
+			if (ctx->waves[ch].runs)
+				g_array_free(ctx->waves[ch].runs, TRUE);
 		}
-		g_free(ctx->channel_outputs);
+		g_free(ctx->waves);
 		g_free(ctx->channels);
 		g_free(ctx);
 	}
@@ -0,0 +1,257 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __linux__
+/* For O_DIRECT. */
+#define _GNU_SOURCE
+#endif
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "raw-capture"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Raw capture files.
+ *
+ * Drivers which can't unpack their data as fast as the device sends it
+ * may write the device's own format to a file instead, to be unpacked
+ * later by the "rawcapture" input module. The file starts with a key
+ * file header of SR_RAW_CAPTURE_HEADER_SIZE bytes, padded with NULs,
+ * which describes the layout. The data follows as it came.
+ *
+ * Where the platform has O_DIRECT, the data bypasses the page cache as
+ * long as all writes are aligned, which transfer buffers usually are.
+ */
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* Alignment O_DIRECT needs, for buffers, lengths and file offsets. */
+#define DIRECT_ALIGN 4096
+
+struct sr_raw_capture {
+	int fd;
+	char *path;
+	GKeyFile *header;
+	gboolean direct;
+	gboolean failed;
+	uint64_t bytes;
+};
+
+static int write_all(struct sr_raw_capture *rc, const void *data, size_t len)
+{
+	const uint8_t *p;
+	ssize_t n;
+
+	p = data;
+	while (len) {
+		n = write(rc->fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			sr_err("Failed to write %s: %s.", rc->path,
+				g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return SR_OK;
+}
+
+static void set_direct(struct sr_raw_capture *rc, gboolean enable)
+{
+#ifdef O_DIRECT
+	int flags;
+
+	flags = fcntl(rc->fd, F_GETFL);
+	if (flags < 0)
+		return;
+	flags = enable ? flags | O_DIRECT : flags & ~O_DIRECT;
+	if (fcntl(rc->fd, F_SETFL, flags) == 0)
+		rc->direct = enable;
+#else
+	(void)rc;
+	(void)enable;
+#endif
+}
+
+static int write_header(struct sr_raw_capture *rc)
+{
+	char buf[SR_RAW_CAPTURE_HEADER_SIZE];
+	gchar *text;
+	gsize len;
+	int ret;
+
+	g_key_file_set_uint64(rc->header, "raw capture", "bytes", rc->bytes);
+	text = g_key_file_to_data(rc->header, &len, NULL);
+	if (len >= sizeof(buf)) {
+		g_free(text);
+		return SR_ERR_BUG;
+	}
+	memset(buf, 0, sizeof(buf));
+	memcpy(buf, text, len);
+	g_free(text);
+
+	if (lseek(rc->fd, 0, SEEK_SET) != 0)
+		return SR_ERR_IO;
+	ret = write_all(rc, buf, sizeof(buf));
+	lseek(rc->fd, 0, SEEK_END);
+
+	return ret;
+}
+
+/**
+ * Create a raw capture file.
+ *
+ * @param rc The capture, to be closed with sr_raw_capture_close().
+ * @param path The file, overwritten if it exists.
+ * @param info What the data is.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO The file can't be created.
+ *
+ * @private
+ */
+SR_PRIV int sr_raw_capture_open(struct sr_raw_capture **rc, const char *path,
+		const struct sr_raw_capture_info *info)
+{
+	struct sr_raw_capture *c;
+	const char *group;
+	int ret;
+
+	if (!rc || !path || !*path || !info || !info->num_channels)
+		return SR_ERR_ARG;
+
+	c = g_malloc0(sizeof(*c));
+	c->fd = g_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (c->fd < 0) {
+		sr_err("Failed to create %s: %s.", path, g_strerror(errno));
+		g_free(c);
+		return SR_ERR_IO;
+	}
+	c->path = g_strdup(path);
+
+	group = "raw capture";
+	c->header = g_key_file_new();
+	g_key_file_set_integer(c->header, group, "version", 1);
+	if (info->model)
+		g_key_file_set_string(c->header, group, "model", info->model);
+	g_key_file_set_uint64(c->header, group, "samplerate", info->samplerate);
+	g_key_file_set_integer(c->header, group, "channels", info->num_channels);
+	if (info->layout == SR_RAW_CAPTURE_PLANAR) {
+		g_key_file_set_string(c->header, group, "layout", "planar");
+		g_key_file_set_integer(c->header, group, "word_bits",
+			info->word_bits);
+		g_key_file_set_boolean(c->header, group, "msb_first",
+			info->msb_first);
+	} else {
+		g_key_file_set_string(c->header, group, "layout", "packed");
+	}
+
+	/* The header is rewritten with the final size on close. */
+	if ((ret = write_header(c)) != SR_OK) {
+		sr_raw_capture_close(c);
+		return ret;
+	}
+	set_direct(c, TRUE);
+	sr_info("Writing raw data to %s%s.", path,
+		c->direct ? ", bypassing the page cache" : "");
+	*rc = c;
+
+	return SR_OK;
+}
+
+/**
+ * Append data to a raw capture file.
+ *
+ * Blocks until the data is written, drivers call this from a thread of
+ * their own. After a failure, further data is dropped.
+ *
+ * @private
+ */
+SR_PRIV int sr_raw_capture_write(struct sr_raw_capture *rc,
+		const void *data, size_t len)
+{
+	int ret;
+
+	if (!rc || rc->failed)
+		return SR_ERR;
+	if (!len)
+		return SR_OK;
+
+	/* Once a write is unaligned, so are the file offsets after it. */
+	if (rc->direct && ((uintptr_t)data % DIRECT_ALIGN ||
+			len % DIRECT_ALIGN))
+		set_direct(rc, FALSE);
+
+	if ((ret = write_all(rc, data, len)) != SR_OK) {
+		rc->failed = TRUE;
+		return ret;
+	}
+	rc->bytes += len;
+
+	return SR_OK;
+}
+
+/** @private */
+SR_PRIV uint64_t sr_raw_capture_bytes(const struct sr_raw_capture *rc)
+{
+	return rc ? rc->bytes : 0;
+}
+
+/**
+ * Finish a raw capture file, with the final size in the header.
+ *
+ * @param rc The capture. Can be NULL.
+ *
+ * @private
+ */
+SR_PRIV int sr_raw_capture_close(struct sr_raw_capture *rc)
+{
+	int ret;
+
+	if (!rc)
+		return SR_OK;
+
+	set_direct(rc, FALSE);
+	ret = write_header(rc);
+	if (close(rc->fd) != 0 && ret == SR_OK)
+		ret = SR_ERR_IO;
+	if (ret == SR_OK)
+		sr_info("Wrote %" PRIu64 " raw bytes to %s.", rc->bytes,
+			rc->path);
+	g_key_file_free(rc->header);
+	g_free(rc->path);
+	g_free(rc);
+
+	return ret;
+}
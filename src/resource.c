@@ -269,6 +269,8 @@ SR_API int sr_resource_set_hooks(struct sr_context *ctx,
 		sr_err("%s: ctx was NULL.", __func__);
 		return SR_ERR_ARG;
 	}
+	/* Resources may come from elsewhere now. */
+	sr_resource_cache_clear(ctx);
 	if (open_cb && close_cb && read_cb) {
 		ctx->resource_open_cb = open_cb;
 		ctx->resource_close_cb = close_cb;
@@ -423,3 +425,79 @@ SR_PRIV void *sr_resource_load(struct sr_context *ctx,
 	*size = res_size;
 	return buf;
 }
+
+/**
+ * Load a resource into memory, or get it from memory when loaded before.
+ *
+ * Meant for firmware and FPGA bitstreams, which drivers send to each
+ * device they open. The data stays around until sr_exit(), or until
+ * the resource hooks are changed.
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ * @param type Resource type ID.
+ * @param name Name of the resource. Must not be NULL.
+ * @param max_size Size limit. Error out if the resource is larger than this.
+ *
+ * @return The resource data, or NULL on failure. Must be released by the
+ *         caller using g_bytes_unref().
+ *
+ * @private
+ */
+SR_PRIV GBytes *sr_resource_load_cached(struct sr_context *ctx,
+		int type, const char *name, size_t max_size)
+{
+	GBytes *bytes;
+	char *key;
+	void *buf;
+	size_t size;
+
+	key = g_strdup_printf("%d/%s", type, name);
+	g_mutex_lock(&ctx->resource_mutex);
+	if (!ctx->resource_cache)
+		ctx->resource_cache = g_hash_table_new_full(g_str_hash,
+			g_str_equal, g_free, (GDestroyNotify)g_bytes_unref);
+	bytes = g_hash_table_lookup(ctx->resource_cache, key);
+	if (bytes) {
+		g_free(key);
+		if (g_bytes_get_size(bytes) > max_size) {
+			sr_err("Size %zu of '%s' exceeds limit %zu.",
+				g_bytes_get_size(bytes), name, max_size);
+			bytes = NULL;
+		} else {
+			sr_dbg("Using loaded resource '%s'.", name);
+			g_bytes_ref(bytes);
+		}
+		g_mutex_unlock(&ctx->resource_mutex);
+		return bytes;
+	}
+
+	/* Keep the lock, another device may be after the same one. */
+	buf = sr_resource_load(ctx, type, name, &size, max_size);
+	if (!buf) {
+		g_free(key);
+		g_mutex_unlock(&ctx->resource_mutex);
+		return NULL;
+	}
+	bytes = g_bytes_new_take(buf, size);
+	g_hash_table_insert(ctx->resource_cache, key, g_bytes_ref(bytes));
+	g_mutex_unlock(&ctx->resource_mutex);
+
+	return bytes;
+}
+
+/**
+ * Forget resources loaded by sr_resource_load_cached().
+ *
+ * @param ctx libsigrok context. Must not be NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_resource_cache_clear(struct sr_context *ctx)
+{
+	g_mutex_lock(&ctx->resource_mutex);
+	if (ctx->resource_cache) {
+		g_hash_table_destroy(ctx->resource_cache);
+		ctx->resource_cache = NULL;
+	}
+	g_mutex_unlock(&ctx->resource_mutex);
+}
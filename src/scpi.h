@@ -73,6 +73,7 @@ enum scpi_transport_layer {
 	SCPI_TRANSPORT_USBTMC,
 	SCPI_TRANSPORT_VISA,
 	SCPI_TRANSPORT_VXI,
+	SCPI_TRANSPORT_HISLIP,
 };
 
 struct scpi_command {
@@ -114,6 +115,18 @@ struct sr_scpi_dev_inst {
 	GMutex scpi_mutex;
 	char *actual_channel_name;
 	gboolean no_opc_command;
+	/* Set when joined queries didn't each get a response. */
+	gboolean no_compound_queries;
+	/* Queries may be sent before the responses to earlier ones are read. */
+	gboolean pipelined;
+	/* Kept responses to queries of settings, see sr_scpi_cache_enable(). */
+	GHashTable *cache;
+	const char *const *cache_queries;
+};
+
+struct sr_scpi_batch {
+	GPtrArray *queries;
+	GPtrArray *responses;
 };
 
 SR_PRIV GSList *sr_scpi_scan(struct drv_context *drvc, GSList *options,
@@ -143,6 +156,10 @@ SR_PRIV int sr_scpi_read_response(struct sr_scpi_dev_inst *scpi,
 			GString *response, gint64 abs_timeout_us);
 SR_PRIV int sr_scpi_get_string(struct sr_scpi_dev_inst *scpi,
 			const char *command, char **scpi_response);
+SR_PRIV void sr_scpi_cache_enable(struct sr_scpi_dev_inst *scpi,
+			const char *const *queries);
+SR_PRIV void sr_scpi_cache_invalidate(struct sr_scpi_dev_inst *scpi,
+			const char *query);
 SR_PRIV int sr_scpi_get_bool(struct sr_scpi_dev_inst *scpi,
 			const char *command, gboolean *scpi_response);
 SR_PRIV int sr_scpi_get_int(struct sr_scpi_dev_inst *scpi,
@@ -160,6 +177,20 @@ SR_PRIV int sr_scpi_get_data(struct sr_scpi_dev_inst *scpi,
 			const char *command, GString **scpi_response);
 SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 			const char *command, GByteArray **scpi_response);
+SR_PRIV int sr_scpi_get_block_into(struct sr_scpi_dev_inst *scpi,
+			const char *command, GByteArray *block);
+SR_PRIV struct sr_scpi_batch *sr_scpi_batch_new(void);
+SR_PRIV void sr_scpi_batch_free(struct sr_scpi_batch *batch);
+SR_PRIV size_t sr_scpi_batch_add(struct sr_scpi_batch *batch,
+			const char *format, ...);
+SR_PRIV int sr_scpi_batch_run(struct sr_scpi_dev_inst *scpi,
+			struct sr_scpi_batch *batch);
+SR_PRIV const char *sr_scpi_batch_get_string(const struct sr_scpi_batch *batch,
+			size_t index);
+SR_PRIV int sr_scpi_batch_get_bool(const struct sr_scpi_batch *batch,
+			size_t index, gboolean *scpi_response);
+SR_PRIV int sr_scpi_batch_get_float(const struct sr_scpi_batch *batch,
+			size_t index, float *scpi_response);
 SR_PRIV int sr_scpi_get_hw_id(struct sr_scpi_dev_inst *scpi,
 			struct sr_scpi_hw_info **scpi_response);
 SR_PRIV void sr_scpi_hw_info_free(struct sr_scpi_hw_info *hw_info);
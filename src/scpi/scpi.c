@@ -81,6 +81,7 @@ static int parse_strict_bool(const char *str, gboolean *ret)
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_serial_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_tcp_raw_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_tcp_rigol_dev;
+SR_PRIV extern const struct sr_scpi_dev_inst scpi_hislip_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_usbtmc_libusb_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_vxi_dev;
 SR_PRIV extern const struct sr_scpi_dev_inst scpi_visa_dev;
@@ -89,6 +90,7 @@ SR_PRIV extern const struct sr_scpi_dev_inst scpi_libgpib_dev;
 static const struct sr_scpi_dev_inst *scpi_devs[] = {
 	&scpi_tcp_raw_dev,
 	&scpi_tcp_rigol_dev,
+	&scpi_hislip_dev,
 #ifdef HAVE_LIBUSB_1_0
 	&scpi_usbtmc_libusb_dev,
 #endif
@@ -116,7 +118,10 @@ static struct sr_dev_inst *sr_scpi_scan_resource(struct drv_context *drvc,
 	if (!(scpi = scpi_dev_inst_new(drvc, resource, serialcomm)))
 		return NULL;
 
+	/* Other drivers may probe the same resource at the same time. */
+	sr_resource_lock(drvc->sr_ctx, resource);
 	if (sr_scpi_open(scpi) != SR_OK) {
+		sr_resource_unlock(drvc->sr_ctx, resource);
 		sr_info("Couldn't open SCPI device.");
 		sr_scpi_free(scpi);
 		return NULL;
@@ -125,6 +130,7 @@ static struct sr_dev_inst *sr_scpi_scan_resource(struct drv_context *drvc,
 	sdi = probe_device(scpi);
 
 	sr_scpi_close(scpi);
+	sr_resource_unlock(drvc->sr_ctx, resource);
 
 	if (sdi)
 		sdi->status = SR_ST_INACTIVE;
@@ -134,6 +140,53 @@ static struct sr_dev_inst *sr_scpi_scan_resource(struct drv_context *drvc,
 	return sdi;
 }
 
+/*
+ * Whether a command only queries, that is whether each of the commands
+ * in a compound command ends in a query.
+ */
+static gboolean scpi_is_query(const char *command)
+{
+	gboolean query;
+
+	query = FALSE;
+	for (; *command; command++) {
+		if (*command == '?')
+			query = TRUE;
+		else if (*command == ';' && !query)
+			return FALSE;
+		else if (*command == ';')
+			query = FALSE;
+	}
+
+	return query;
+}
+
+/*
+ * The key under which a query's response gets cached, or NULL when the
+ * query is not one of the settings to cache.
+ */
+static char *scpi_cache_key(const struct sr_scpi_dev_inst *scpi,
+		const char *command)
+{
+	const char *const *prefix;
+	const char *name;
+	char *key;
+
+	if (!scpi->cache || !command || strchr(command, ';'))
+		return NULL;
+
+	key = g_ascii_strup(command[0] == ':' ? command + 1 : command, -1);
+	g_strstrip(key);
+	for (prefix = scpi->cache_queries; *prefix; prefix++) {
+		name = (*prefix)[0] == ':' ? *prefix + 1 : *prefix;
+		if (!g_ascii_strncasecmp(key, name, strlen(name)))
+			return key;
+	}
+	g_free(key);
+
+	return NULL;
+}
+
 /**
  * Send a SCPI command with a variadic argument list without mutex.
  *
@@ -161,6 +214,10 @@ static int scpi_send_variadic(struct sr_scpi_dev_inst *scpi,
 	if (buf[len - 1] != '\n')
 		buf[len] = '\n';
 
+	/* Settings may change upon anything but queries. */
+	if (scpi->cache && !scpi_is_query(buf))
+		g_hash_table_remove_all(scpi->cache);
+
 	/* Send command. */
 	ret = scpi->send(scpi->priv, buf);
 
@@ -606,9 +663,22 @@ SR_PRIV void sr_scpi_free(struct sr_scpi_dev_inst *scpi)
 	scpi->free(scpi->priv);
 	g_free(scpi->priv);
 	g_free(scpi->actual_channel_name);
+	if (scpi->cache)
+		g_hash_table_destroy(scpi->cache);
 	g_free(scpi);
 }
 
+static void response_strip(GString *response)
+{
+	/* Get rid of trailing linefeed if present */
+	if (response->len >= 1 && response->str[response->len - 1] == '\n')
+		g_string_truncate(response, response->len - 1);
+
+	/* Get rid of trailing carriage return if present */
+	if (response->len >= 1 && response->str[response->len - 1] == '\r')
+		g_string_truncate(response, response->len - 1);
+}
+
 /**
  * Send a SCPI command, receive the reply and store the reply in scpi_response.
  *
@@ -625,32 +695,108 @@ SR_PRIV int sr_scpi_get_string(struct sr_scpi_dev_inst *scpi,
 			       const char *command, char **scpi_response)
 {
 	GString *response;
+	char *key;
 
 	*scpi_response = NULL;
 
+	key = scpi_cache_key(scpi, command);
+	if (key) {
+		g_mutex_lock(&scpi->scpi_mutex);
+		*scpi_response = g_strdup(g_hash_table_lookup(scpi->cache, key));
+		g_mutex_unlock(&scpi->scpi_mutex);
+		if (*scpi_response) {
+			sr_spew("Cached response: '%.70s'.", *scpi_response);
+			g_free(key);
+			return SR_OK;
+		}
+	}
+
 	response = g_string_sized_new(1024);
 	if (sr_scpi_get_data(scpi, command, &response) != SR_OK) {
 		if (response)
 			g_string_free(response, TRUE);
+		g_free(key);
 		return SR_ERR;
 	}
 
-	/* Get rid of trailing linefeed if present */
-	if (response->len >= 1 && response->str[response->len - 1] == '\n')
-		g_string_truncate(response, response->len - 1);
-
-	/* Get rid of trailing carriage return if present */
-	if (response->len >= 1 && response->str[response->len - 1] == '\r')
-		g_string_truncate(response, response->len - 1);
+	response_strip(response);
 
 	sr_spew("Got response: '%.70s', length %" G_GSIZE_FORMAT ".",
 		response->str, response->len);
 
 	*scpi_response = g_string_free(response, FALSE);
 
+	if (key) {
+		g_mutex_lock(&scpi->scpi_mutex);
+		g_hash_table_insert(scpi->cache, key, g_strdup(*scpi_response));
+		g_mutex_unlock(&scpi->scpi_mutex);
+	}
+
 	return SR_OK;
 }
 
+/**
+ * Keep the responses to queries of settings, and answer these queries
+ * from memory until the settings may have changed.
+ *
+ * Any command which is not a query is taken to possibly change settings,
+ * and drops all of the kept responses. Drivers which know that settings
+ * changed otherwise, like on the device's front panel, or which only need
+ * some of them fresh, drop them with @ref sr_scpi_cache_invalidate().
+ *
+ * Compound queries are never answered from memory.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param queries NULL terminated list of the beginnings of the queries
+ *                to keep the responses for, like "C1:VDIV?" or "C" for
+ *                all channel settings. Must stay valid while the cache
+ *                is in use. NULL disables the cache.
+ */
+SR_PRIV void sr_scpi_cache_enable(struct sr_scpi_dev_inst *scpi,
+			const char *const *queries)
+{
+	g_mutex_lock(&scpi->scpi_mutex);
+	if (scpi->cache)
+		g_hash_table_destroy(scpi->cache);
+	scpi->cache = NULL;
+	scpi->cache_queries = queries;
+	if (queries)
+		scpi->cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, g_free);
+	g_mutex_unlock(&scpi->scpi_mutex);
+}
+
+/**
+ * Drop kept responses to queries of settings, so that these queries get
+ * sent to the device again.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param query The beginning of the queries to drop the responses for,
+ *              as in @ref sr_scpi_cache_enable(). NULL drops all of them.
+ */
+SR_PRIV void sr_scpi_cache_invalidate(struct sr_scpi_dev_inst *scpi,
+			const char *query)
+{
+	GHashTableIter iter;
+	gpointer key;
+	size_t len;
+
+	g_mutex_lock(&scpi->scpi_mutex);
+	if (scpi->cache && !query) {
+		g_hash_table_remove_all(scpi->cache);
+	} else if (scpi->cache) {
+		if (query[0] == ':')
+			query++;
+		len = strlen(query);
+		g_hash_table_iter_init(&iter, scpi->cache);
+		while (g_hash_table_iter_next(&iter, &key, NULL)) {
+			if (!g_ascii_strncasecmp(key, query, len))
+				g_hash_table_iter_remove(&iter);
+		}
+	}
+	g_mutex_unlock(&scpi->scpi_mutex);
+}
+
 /**
  * Do a non-blocking read of up to the allocated length, and
  * check if a timeout has occured.
@@ -860,10 +1006,9 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 			       const char *command, GArray **scpi_response)
 {
 	int ret;
-	float tmp;
 	char *response;
-	gchar **ptr, **tokens;
-	size_t token_count;
+	const char *p;
+	size_t len, max_count, count;
 	GArray *response_array;
 
 	*scpi_response = NULL;
@@ -873,24 +1018,24 @@ SR_PRIV int sr_scpi_get_floatv(struct sr_scpi_dev_inst *scpi,
 	if (ret != SR_OK && !response)
 		return ret;
 
-	tokens = g_strsplit(response, ",", 0);
-	token_count = g_strv_length(tokens);
-
+	/*
+	 * Waveforms in ASCII can have hundreds of thousands of values.
+	 * Size the array by the separators, and have them converted
+	 * into it in one pass.
+	 */
+	len = strlen(response);
+	max_count = 1;
+	for (p = response; (p = memchr(p, ',', len - (p - response))); p++)
+		max_count++;
 	response_array = g_array_sized_new(TRUE, FALSE,
-		sizeof(float), token_count + 1);
-
-	ptr = tokens;
-	while (*ptr) {
-		ret = sr_atof_ascii(*ptr, &tmp);
-		if (ret != SR_OK) {
-			ret = SR_ERR_DATA;
-			break;
-		}
-		response_array = g_array_append_val(response_array, tmp);
-		ptr++;
-	}
-	g_strfreev(tokens);
+		sizeof(float), max_count + 1);
+	g_array_set_size(response_array, max_count);
+	ret = sr_atof_ascii_list(response, len, ',',
+		(float *)response_array->data, max_count, &count);
+	g_array_set_size(response_array, count);
 	g_free(response);
+	if (ret != SR_OK)
+		ret = SR_ERR_DATA;
 
 	if (ret != SR_OK && response_array->len == 0) {
 		g_array_free(response_array, TRUE);
@@ -961,32 +1106,68 @@ SR_PRIV int sr_scpi_get_uint8v(struct sr_scpi_dev_inst *scpi,
 	return ret;
 }
 
+/**
+ * Read exactly the given number of bytes, or fail upon timeout, without
+ * mutex. Never reads beyond them, so the rest of the response remains
+ * with the transport.
+ */
+static int scpi_read_exact(struct sr_scpi_dev_inst *scpi,
+				char *buf, int len, gint64 abs_timeout_us)
+{
+	int ret;
+
+	while (len > 0) {
+		ret = scpi_read_data(scpi, buf, len);
+		if (ret < 0) {
+			sr_err("Incompletely read SCPI response.");
+			return SR_ERR;
+		}
+		if (ret == 0 && g_get_monotonic_time() > abs_timeout_us) {
+			sr_err("Timed out waiting for SCPI response.");
+			return SR_ERR_TIMEOUT;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
 /**
  * Send a SCPI command, read the reply, parse it as binary data with a
- * "definite length block" header and store the as an result in scpi_response.
+ * "definite length block" header and store the data bytes in a caller
+ * provided byte array.
  *
- * Callers must free the allocated memory (unless it's NULL) regardless of
- * the routine's return code. See @ref g_byte_array_free().
+ * Only the length spec is read ahead. The array is then sized to the
+ * block's length once, and the data bytes are read into it directly.
+ * Callers which receive many blocks can keep one array for all of them,
+ * which only grows where a block is larger than any before.
+ *
+ * Upon timeout while data bytes are received, the array is truncated to
+ * the data received so far and SR_OK is returned.
  *
  * @param[in] scpi Previously initialised SCPI device structure.
  * @param[in] command The SCPI command to send to the device (can be NULL).
- * @param[out] scpi_response Pointer where to store the parsed result.
+ * @param[in,out] block The array which receives the data bytes. Its
+ *                      previous content is replaced.
  *
- * @return SR_OK upon successfully parsing all values, SR_ERR* upon a parsing
- *         error or upon no response.
+ * @return SR_OK upon successfully receiving the block, SR_ERR* upon a
+ *         parsing error or upon no response.
  */
-SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
-			       const char *command, GByteArray **scpi_response)
+SR_PRIV int sr_scpi_get_block_into(struct sr_scpi_dev_inst *scpi,
+			       const char *command, GByteArray *block)
 {
 	int ret;
-	GString* response;
-	gsize oldlen;
 	char buf[10];
 	long llen;
 	long datalen;
+	size_t received;
+	int chunk;
 	gint64 timeout;
 
-	*scpi_response = NULL;
+	if (!block)
+		return SR_ERR_ARG;
+	g_byte_array_set_size(block, 0);
 
 	g_mutex_lock(&scpi->scpi_mutex);
 
@@ -1001,24 +1182,8 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 		return SR_ERR;
 	}
 
-	/*
-	 * Assume an initial maximum length, optionally gets adjusted below.
-	 * Prepare a NULL return value for when error paths will be taken.
-	 */
-	response = g_string_sized_new(1024);
-
 	timeout = g_get_monotonic_time() + scpi->read_timeout_us;
 
-	/* Get (the first chunk of) the response. */
-	do {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
-			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
-		}
-	} while (response->len < 2);
-
 	/*
 	 * SCPI protocol data blocks are preceeded with a length spec.
 	 * The length spec consists of a '#' marker, one digit which
@@ -1027,15 +1192,18 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 	 * length. Raw data bytes follow (thus one must no longer assume
 	 * that the received input stream would be an ASCIIZ string).
 	 *
-	 * Get the data block length, and strip off the length spec from
-	 * the input buffer, leaving just the data bytes.
+	 * Get the data block length before any of the data bytes.
 	 */
-	if (response->str[0] != '#') {
+	ret = scpi_read_exact(scpi, buf, 2, timeout);
+	if (ret != SR_OK) {
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return ret;
+	}
+	if (buf[0] != '#') {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
 		return SR_ERR_DATA;
 	}
-	buf[0] = response->str[1];
+	buf[0] = buf[1];
 	buf[1] = '\0';
 	ret = sr_atol(buf, &llen);
 	/*
@@ -1062,64 +1230,373 @@ SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
 	}
 	if (ret != SR_OK) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
 		return ret;
 	}
 
-	while (response->len < (unsigned long)(2 + llen)) {
-		ret = scpi_read_response(scpi, response, timeout);
-		if (ret < 0) {
-			g_mutex_unlock(&scpi->scpi_mutex);
-			g_string_free(response, TRUE);
-			return ret;
-		}
+	ret = scpi_read_exact(scpi, buf, llen, timeout);
+	if (ret != SR_OK) {
+		g_mutex_unlock(&scpi->scpi_mutex);
+		return ret;
 	}
-
-	memcpy(buf, &response->str[2], llen);
 	buf[llen] = '\0';
 	ret = sr_atol(buf, &datalen);
-	if ((ret != SR_OK) || (datalen == 0)) {
+	if ((ret != SR_OK) || (datalen <= 0)) {
 		g_mutex_unlock(&scpi->scpi_mutex);
-		g_string_free(response, TRUE);
 		return ret;
 	}
-	g_string_erase(response, 0, 2 + llen);
 
 	/*
-	 * Re-allocate the buffer size to the now known length
-	 * and keep reading more chunks of response data.
+	 * Size the array to the now known length, and read the data
+	 * bytes right into it.
 	 */
-	oldlen = response->len;
-	g_string_set_size(response, datalen);
-	g_string_set_size(response, oldlen);
-
-	if (oldlen < (unsigned long)(datalen)) {
-		do {
-			oldlen = response->len;
-			ret = scpi_read_response(scpi, response, timeout);
-
-			/* On timeout truncate the buffer and send the partial response
-			 * instead of getting stuck on timeouts...
-			 */
-			if (ret == SR_ERR_TIMEOUT) {
-				datalen = oldlen;
-				break;
-			}
-			if (ret < 0) {
-				g_mutex_unlock(&scpi->scpi_mutex);
-				g_string_free(response, TRUE);
-				return ret;
-			}
-			if (ret > 0)
-				timeout = g_get_monotonic_time() + scpi->read_timeout_us;
-		} while (response->len < (unsigned long)(datalen));
+	g_byte_array_set_size(block, datalen);
+	received = 0;
+	while (received < (size_t)datalen) {
+		chunk = MIN((size_t)datalen - received, G_MAXINT);
+		ret = scpi_read_data(scpi, (char *)&block->data[received], chunk);
+
+		/* On timeout truncate the buffer and send the partial response
+		 * instead of getting stuck on timeouts...
+		 */
+		if (ret == 0 && g_get_monotonic_time() > timeout) {
+			sr_err("Timed out waiting for SCPI response.");
+			break;
+		}
+		if (ret < 0) {
+			sr_err("Incompletely read SCPI response.");
+			g_mutex_unlock(&scpi->scpi_mutex);
+			g_byte_array_set_size(block, 0);
+			return SR_ERR;
+		}
+		if (ret > 0) {
+			received += ret;
+			timeout = g_get_monotonic_time() + scpi->read_timeout_us;
+		}
+	}
+	g_byte_array_set_size(block, received);
+
+	g_mutex_unlock(&scpi->scpi_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Send a SCPI command, read the reply, parse it as binary data with a
+ * "definite length block" header and store the as an result in scpi_response.
+ *
+ * Callers must free the allocated memory (unless it's NULL) regardless of
+ * the routine's return code. See @ref g_byte_array_free().
+ *
+ * @param[in] scpi Previously initialised SCPI device structure.
+ * @param[in] command The SCPI command to send to the device (can be NULL).
+ * @param[out] scpi_response Pointer where to store the parsed result.
+ *
+ * @return SR_OK upon successfully parsing all values, SR_ERR* upon a parsing
+ *         error or upon no response.
+ */
+SR_PRIV int sr_scpi_get_block(struct sr_scpi_dev_inst *scpi,
+			       const char *command, GByteArray **scpi_response)
+{
+	GByteArray *block;
+	int ret;
+
+	*scpi_response = NULL;
+
+	block = g_byte_array_new();
+	ret = sr_scpi_get_block_into(scpi, command, block);
+	if (ret != SR_OK) {
+		g_byte_array_free(block, TRUE);
+		return ret;
 	}
+	*scpi_response = block;
+
+	return SR_OK;
+}
+
+/* Upper length of the compound queries which are sent at once. */
+#define SCPI_BATCH_MAX_LEN 256
+/*
+ * Queries sent ahead of reading their responses. The responses must fit
+ * into the socket buffers, or the device stops taking queries.
+ */
+#define SCPI_BATCH_MAX_PIPELINED 32
+
+/**
+ * Create an empty batch of SCPI queries.
+ *
+ * Queries get added with @ref sr_scpi_batch_add(), get sent with
+ * @ref sr_scpi_batch_run(), and their responses are taken from the batch
+ * afterwards. This saves a round-trip for each query which can be sent
+ * along with others.
+ *
+ * @return The new batch. Callers must free it with sr_scpi_batch_free().
+ */
+SR_PRIV struct sr_scpi_batch *sr_scpi_batch_new(void)
+{
+	struct sr_scpi_batch *batch;
+
+	batch = g_malloc0(sizeof(*batch));
+	batch->queries = g_ptr_array_new_with_free_func(g_free);
+	batch->responses = g_ptr_array_new_with_free_func(g_free);
+
+	return batch;
+}
 
+/**
+ * Free a batch of SCPI queries, and the responses it received.
+ *
+ * @param batch The batch to free, can be NULL.
+ */
+SR_PRIV void sr_scpi_batch_free(struct sr_scpi_batch *batch)
+{
+	if (!batch)
+		return;
+
+	g_ptr_array_free(batch->queries, TRUE);
+	g_ptr_array_free(batch->responses, TRUE);
+	g_free(batch);
+}
+
+/**
+ * Add a query to a batch.
+ *
+ * Queries must get a response of their own, and must not get binary
+ * block data in response.
+ *
+ * @param batch The batch to add the query to.
+ * @param format Format string for the query, as in sr_scpi_send().
+ *
+ * @return The index of the query's response in the batch.
+ */
+SR_PRIV size_t sr_scpi_batch_add(struct sr_scpi_batch *batch,
+			const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	g_ptr_array_add(batch->queries, g_strdup_vprintf(format, args));
+	va_end(args);
+
+	return batch->queries->len - 1;
+}
+
+/*
+ * Split a response to a compound query at the semicolons which separate
+ * the responses to the individual queries. Semicolons in quoted strings
+ * are part of the response.
+ */
+static void batch_split_responses(struct sr_scpi_batch *batch, char *str)
+{
+	char *start, quote;
+
+	start = str;
+	quote = '\0';
+	for (; *str; str++) {
+		if (quote) {
+			if (*str == quote)
+				quote = '\0';
+		} else if (*str == '"' || *str == '\'') {
+			quote = *str;
+		} else if (*str == ';') {
+			*str = '\0';
+			g_ptr_array_add(batch->responses, g_strdup(g_strstrip(start)));
+			start = str + 1;
+		}
+	}
+	g_ptr_array_add(batch->responses, g_strdup(g_strstrip(start)));
+}
+
+/*
+ * Send queries as one compound query, with each of them starting at the
+ * root of the command tree. Returns SR_ERR_DATA when the device doesn't
+ * respond to each of them.
+ */
+static int batch_run_compound(struct sr_scpi_dev_inst *scpi,
+		struct sr_scpi_batch *batch, guint first, guint count)
+{
+	GString *command;
+	const char *query;
+	char *response;
+	guint i, expected;
+	int ret;
+
+	command = g_string_sized_new(SCPI_BATCH_MAX_LEN);
+	for (i = first; i < first + count; i++) {
+		query = g_ptr_array_index(batch->queries, i);
+		if (command->len)
+			g_string_append_c(command, ';');
+		if (query[0] != ':' && query[0] != '*')
+			g_string_append_c(command, ':');
+		g_string_append(command, query);
+	}
+	ret = sr_scpi_get_string(scpi, command->str, &response);
+	g_string_free(command, TRUE);
+	if (ret != SR_OK)
+		return ret;
+
+	expected = batch->responses->len + count;
+	batch_split_responses(batch, response);
+	g_free(response);
+	if (batch->responses->len != expected) {
+		g_ptr_array_set_size(batch->responses, expected - count);
+		return SR_ERR_DATA;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * Send some queries, and only then receive their responses, at the
+ * cost of one round-trip for all of them. Only for transports which
+ * keep the responses apart, see the pipelined flag.
+ */
+static int batch_run_pipelined(struct sr_scpi_dev_inst *scpi,
+		struct sr_scpi_batch *batch, guint first, guint count)
+{
+	GString *response;
+	guint i;
+	int ret;
+
+	ret = SR_OK;
+	g_mutex_lock(&scpi->scpi_mutex);
+	for (i = first; ret == SR_OK && i < first + count; i++)
+		ret = scpi_send(scpi, "%s", g_ptr_array_index(batch->queries, i));
+	for (i = first; ret == SR_OK && i < first + count; i++) {
+		response = g_string_sized_new(128);
+		ret = scpi_get_data(scpi, NULL, &response);
+		response_strip(response);
+		g_ptr_array_add(batch->responses, g_string_free(response, FALSE));
+	}
 	g_mutex_unlock(&scpi->scpi_mutex);
 
-	/* Convert received data to byte array. */
-	*scpi_response = g_byte_array_new_take(
-		(guint8*)g_string_free(response, FALSE), datalen);
+	return ret;
+}
+
+/**
+ * Send the queries of a batch, and receive their responses.
+ *
+ * Queries are joined into compound queries of a limited length, which
+ * cost one round-trip each. Devices which don't respond to each of the
+ * joined queries get sent them one by one, for this and all later
+ * batches. Transports which can take queries ahead of the responses
+ * send them one after another, and receive all responses after.
+ *
+ * @param scpi Previously initialised SCPI device structure.
+ * @param batch The batch to run. Its responses of a previous run are
+ *              discarded.
+ *
+ * @return SR_OK when all queries were responded to, SR_ERR* on failure.
+ */
+SR_PRIV int sr_scpi_batch_run(struct sr_scpi_dev_inst *scpi,
+			struct sr_scpi_batch *batch)
+{
+	const char *query;
+	char *response;
+	guint first, count;
+	size_t len;
+	int ret;
+
+	g_ptr_array_set_size(batch->responses, 0);
+
+	first = 0;
+	while (first < batch->queries->len) {
+		if (scpi->no_compound_queries && scpi->pipelined) {
+			count = MIN(batch->queries->len - first,
+				SCPI_BATCH_MAX_PIPELINED);
+			ret = batch_run_pipelined(scpi, batch, first, count);
+			if (ret != SR_OK)
+				return ret;
+			first += count;
+			continue;
+		}
+		if (scpi->no_compound_queries) {
+			query = g_ptr_array_index(batch->queries, first);
+			ret = sr_scpi_get_string(scpi, query, &response);
+			if (ret != SR_OK)
+				return ret;
+			g_ptr_array_add(batch->responses, response);
+			first++;
+			continue;
+		}
+
+		len = 0;
+		for (count = 0; first + count < batch->queries->len; count++) {
+			query = g_ptr_array_index(batch->queries, first + count);
+			len += strlen(query) + 2;
+			if (count && len > SCPI_BATCH_MAX_LEN)
+				break;
+		}
+		ret = batch_run_compound(scpi, batch, first, count);
+		if (ret != SR_OK && count > 1) {
+			sr_dbg("No response to each of %u joined queries, "
+				"sending queries one by one.", count);
+			scpi->no_compound_queries = TRUE;
+			continue;
+		} else if (ret != SR_OK) {
+			return ret;
+		}
+		first += count;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Get the response to a query of a batch which was run.
+ *
+ * @param batch The batch which was run.
+ * @param index The index of the query, as returned by sr_scpi_batch_add().
+ *
+ * @return The response, which belongs to the batch. NULL when there is
+ *         no response for this index.
+ */
+SR_PRIV const char *sr_scpi_batch_get_string(const struct sr_scpi_batch *batch,
+			size_t index)
+{
+	if (!batch || index >= batch->responses->len)
+		return NULL;
+
+	return g_ptr_array_index(batch->responses, index);
+}
+
+/**
+ * Get the response to a query of a batch which was run, parsed as a
+ * boolean.
+ *
+ * @param batch The batch which was run.
+ * @param index The index of the query, as returned by sr_scpi_batch_add().
+ * @param scpi_response Pointer where to store the parsed result.
+ *
+ * @return SR_OK on success, SR_ERR* on failure.
+ */
+SR_PRIV int sr_scpi_batch_get_bool(const struct sr_scpi_batch *batch,
+			size_t index, gboolean *scpi_response)
+{
+	if (parse_strict_bool(sr_scpi_batch_get_string(batch, index),
+			scpi_response) != SR_OK)
+		return SR_ERR_DATA;
+
+	return SR_OK;
+}
+
+/**
+ * Get the response to a query of a batch which was run, parsed as a
+ * float.
+ *
+ * @param batch The batch which was run.
+ * @param index The index of the query, as returned by sr_scpi_batch_add().
+ * @param scpi_response Pointer where to store the parsed result.
+ *
+ * @return SR_OK on success, SR_ERR* on failure.
+ */
+SR_PRIV int sr_scpi_batch_get_float(const struct sr_scpi_batch *batch,
+			size_t index, float *scpi_response)
+{
+	const char *response;
+
+	response = sr_scpi_batch_get_string(batch, index);
+	if (!response || sr_atof_ascii(response, scpi_response) != SR_OK)
+		return SR_ERR_DATA;
 
 	return SR_OK;
 }
@@ -0,0 +1,575 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * HiSLIP (IVI-6.1), the successor of VXI-11 for LAN instruments.
+ *
+ * A session has two TCP connections to the same port, the synchronous
+ * one carries commands and responses, the asynchronous one the control
+ * messages like device clear. Each message has a header of 16 bytes:
+ * "HS", the message type, a control code, a 32 bit message parameter
+ * and the 64 bit length of the payload which follows, all big endian.
+ * Commands and responses are Data messages, the last one of each a
+ * DataEnd message, which costs no round-trip of its own as VXI-11 does.
+ *
+ * In overlapped mode the instrument keeps queries apart, and responds
+ * to each of them in turn, so that several queries can be sent before
+ * reading the first response. The session asks for it when it opens.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include <string.h>
+
+#include "libsigrok-internal.h"
+#include "scpi.h"
+
+#define LOG_PREFIX "scpi_hislip"
+
+#define HISLIP_PORT		"4880"
+#define HISLIP_SUBADDRESS	"hislip0"
+#define HISLIP_HEADER_SIZE	16
+/* Protocol version 1.0, and a vendor ID for the client. */
+#define HISLIP_VERSION		0x0100
+#define HISLIP_VENDOR		(('S' << 8) | 'R')
+#define HISLIP_FIRST_MESSAGE_ID	0xffffff00
+/* The largest message the client takes. Responses stream in anyway. */
+#define HISLIP_MAX_MESSAGE	(UINT64_C(1) << 32)
+/* Payload of control messages this transport reads, like error text. */
+#define HISLIP_MAX_PAYLOAD	256
+
+enum hislip_message_type {
+	HISLIP_INITIALIZE = 0,
+	HISLIP_INITIALIZE_RESPONSE = 1,
+	HISLIP_FATAL_ERROR = 2,
+	HISLIP_ERROR = 3,
+	HISLIP_DATA = 6,
+	HISLIP_DATA_END = 7,
+	HISLIP_DEVICE_CLEAR_COMPLETE = 8,
+	HISLIP_DEVICE_CLEAR_ACKNOWLEDGE = 9,
+	HISLIP_INTERRUPTED = 13,
+	HISLIP_ASYNC_MAX_MESSAGE_SIZE = 15,
+	HISLIP_ASYNC_MAX_MESSAGE_SIZE_RESPONSE = 16,
+	HISLIP_ASYNC_INITIALIZE = 17,
+	HISLIP_ASYNC_INITIALIZE_RESPONSE = 18,
+	HISLIP_ASYNC_DEVICE_CLEAR = 19,
+	HISLIP_ASYNC_DEVICE_CLEAR_ACKNOWLEDGE = 23,
+};
+
+/* Control code bits. */
+#define HISLIP_CC_OVERLAPPED	(1 << 0)
+#define HISLIP_CC_RMT_DELIVERED	(1 << 0)
+
+struct hislip_header {
+	uint8_t type;
+	uint8_t control;
+	uint32_t param;
+	uint64_t length;
+};
+
+struct scpi_hislip {
+	struct sr_tcp_dev_inst *sync;
+	struct sr_tcp_dev_inst *async;
+	char *subaddress;
+	gboolean overlapped;
+	uint16_t session_id;
+	/* Of the next message, the server's responses carry the same. */
+	uint32_t message_id;
+	/* The largest message the server takes. */
+	uint64_t max_message;
+	/* A whole response arrived since the last message was sent. */
+	gboolean rmt_delivered;
+	/* The response being read. */
+	uint8_t header_buf[HISLIP_HEADER_SIZE];
+	size_t header_read;
+	struct hislip_header header;
+	uint64_t payload_left;
+	gboolean complete;
+};
+
+static void header_encode(uint8_t *buf, uint8_t type, uint8_t control,
+		uint32_t param, uint64_t length)
+{
+	buf[0] = 'H';
+	buf[1] = 'S';
+	buf[2] = type;
+	buf[3] = control;
+	write_u32be(&buf[4], param);
+	write_u64be(&buf[8], length);
+}
+
+static int header_decode(const uint8_t *buf, struct hislip_header *hdr)
+{
+	if (buf[0] != 'H' || buf[1] != 'S') {
+		sr_err("Invalid HiSLIP message header.");
+		return SR_ERR_DATA;
+	}
+	hdr->type = buf[2];
+	hdr->control = buf[3];
+	hdr->param = read_u32be(&buf[4]);
+	hdr->length = read_u64be(&buf[8]);
+
+	return SR_OK;
+}
+
+static int write_all(struct sr_tcp_dev_inst *tcp, const uint8_t *buf,
+		size_t len)
+{
+	int ret;
+
+	while (len) {
+		ret = sr_tcp_write_bytes(tcp, buf, len);
+		if (ret <= 0) {
+			sr_err("Send error: %s.", g_strerror(errno));
+			return SR_ERR_IO;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+static int read_all(struct sr_tcp_dev_inst *tcp, uint8_t *buf, size_t len)
+{
+	int ret;
+
+	while (len) {
+		ret = sr_tcp_read_bytes(tcp, buf, len, FALSE);
+		if (ret <= 0) {
+			sr_err("Receive error: %s.", ret < 0 ?
+				g_strerror(errno) : "Connection closed");
+			return SR_ERR_IO;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+static int message_send(struct sr_tcp_dev_inst *tcp, uint8_t type,
+		uint8_t control, uint32_t param,
+		const void *payload, uint64_t length)
+{
+	uint8_t hdr[HISLIP_HEADER_SIZE];
+	int ret;
+
+	header_encode(hdr, type, control, param, length);
+	if ((ret = write_all(tcp, hdr, sizeof(hdr))) != SR_OK)
+		return ret;
+
+	return write_all(tcp, payload, length);
+}
+
+/* Skip what does not fit into the payload buffer, error text mostly. */
+static int payload_read(struct sr_tcp_dev_inst *tcp, uint64_t length,
+		uint8_t *buf, size_t size)
+{
+	uint8_t discard[64];
+	size_t len;
+	int ret;
+
+	len = MIN(length, size);
+	if ((ret = read_all(tcp, buf, len)) != SR_OK)
+		return ret;
+	for (length -= len; length; length -= len) {
+		len = MIN(length, sizeof(discard));
+		if ((ret = read_all(tcp, discard, len)) != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static int error_report(struct sr_tcp_dev_inst *tcp,
+		const struct hislip_header *hdr)
+{
+	char text[HISLIP_MAX_PAYLOAD + 1];
+	size_t len;
+
+	len = MIN(hdr->length, HISLIP_MAX_PAYLOAD);
+	if (payload_read(tcp, hdr->length, (uint8_t *)text, len) != SR_OK)
+		return SR_ERR_IO;
+	text[len] = '\0';
+	sr_err("HiSLIP %serror %u: %s",
+		hdr->type == HISLIP_FATAL_ERROR ? "fatal " : "",
+		hdr->control, text);
+
+	return hdr->type == HISLIP_FATAL_ERROR ? SR_ERR_IO : SR_ERR;
+}
+
+static int header_receive(struct sr_tcp_dev_inst *tcp,
+		struct hislip_header *hdr)
+{
+	uint8_t buf[HISLIP_HEADER_SIZE];
+	int ret;
+
+	if ((ret = read_all(tcp, buf, sizeof(buf))) != SR_OK)
+		return ret;
+
+	return header_decode(buf, hdr);
+}
+
+/* Receive a control message of the given type, with a small payload. */
+static int message_receive(struct sr_tcp_dev_inst *tcp, uint8_t type,
+		struct hislip_header *hdr, uint8_t *payload, size_t size)
+{
+	int ret;
+
+	if ((ret = header_receive(tcp, hdr)) != SR_OK)
+		return ret;
+	if (hdr->type == HISLIP_ERROR || hdr->type == HISLIP_FATAL_ERROR)
+		return error_report(tcp, hdr);
+	if (hdr->type != type) {
+		sr_err("Unexpected HiSLIP message %u, expected %u.",
+			hdr->type, type);
+		return SR_ERR_DATA;
+	}
+
+	return payload_read(tcp, hdr->length, payload, size);
+}
+
+static int scpi_hislip_dev_inst_new(void *priv, struct drv_context *drvc,
+		const char *resource, char **params, const char *serialcomm)
+{
+	struct scpi_hislip *hislip = priv;
+	const char *port;
+	char **opts, *sep;
+
+	(void)drvc;
+	(void)resource;
+	(void)serialcomm;
+
+	if (!params || !params[1]) {
+		sr_err("Invalid parameters.");
+		return SR_ERR;
+	}
+
+	/* Socket options follow the sub-address, which is optional. */
+	opts = params + 2;
+	if (params[2] && !strchr(params[2], '=') &&
+			strcmp(params[2], "nodelay") != 0 &&
+			strcmp(params[2], "keepalive") != 0) {
+		hislip->subaddress = g_strdup(params[2]);
+		opts++;
+	} else {
+		hislip->subaddress = g_strdup(HISLIP_SUBADDRESS);
+	}
+
+	/* Like in VISA resource names, another port follows a comma. */
+	port = HISLIP_PORT;
+	if ((sep = strchr(hislip->subaddress, ','))) {
+		*sep = '\0';
+		port = sep + 1;
+	}
+
+	hislip->sync = sr_tcp_dev_inst_new(params[1], port);
+	hislip->async = sr_tcp_dev_inst_new(params[1], port);
+	if (!hislip->sync || !hislip->async)
+		return SR_ERR;
+	hislip->sync->opts.nodelay = TRUE;
+	if (sr_tcp_parse_options(&hislip->sync->opts, opts) != SR_OK)
+		return SR_ERR;
+	hislip->async->opts = hislip->sync->opts;
+
+	return SR_OK;
+}
+
+/*
+ * Have the server switch to overlapped mode, which it only does upon
+ * a device clear. This also resets the message IDs.
+ */
+static int hislip_device_clear(struct scpi_hislip *hislip)
+{
+	struct hislip_header hdr;
+	int ret;
+
+	ret = message_send(hislip->async, HISLIP_ASYNC_DEVICE_CLEAR, 0, 0,
+		NULL, 0);
+	if (ret == SR_OK)
+		ret = message_receive(hislip->async,
+			HISLIP_ASYNC_DEVICE_CLEAR_ACKNOWLEDGE, &hdr, NULL, 0);
+	if (ret == SR_OK)
+		ret = message_send(hislip->sync, HISLIP_DEVICE_CLEAR_COMPLETE,
+			HISLIP_CC_OVERLAPPED, 0, NULL, 0);
+	while (ret == SR_OK) {
+		if ((ret = header_receive(hislip->sync, &hdr)) != SR_OK)
+			break;
+		if (hdr.type == HISLIP_ERROR || hdr.type == HISLIP_FATAL_ERROR) {
+			ret = error_report(hislip->sync, &hdr);
+			break;
+		}
+		/* Responses of before the clear may still be on their way. */
+		ret = payload_read(hislip->sync, hdr.length, NULL, 0);
+		if (hdr.type == HISLIP_DEVICE_CLEAR_ACKNOWLEDGE)
+			break;
+	}
+	if (ret != SR_OK)
+		return ret;
+
+	hislip->overlapped = hdr.control & HISLIP_CC_OVERLAPPED;
+	hislip->message_id = HISLIP_FIRST_MESSAGE_ID;
+	hislip->rmt_delivered = FALSE;
+
+	return SR_OK;
+}
+
+static int scpi_hislip_open(struct sr_scpi_dev_inst *scpi)
+{
+	struct scpi_hislip *hislip = scpi->priv;
+	struct hislip_header hdr;
+	uint8_t size[8];
+	int ret;
+
+	if ((ret = sr_tcp_connect(hislip->sync)) != SR_OK)
+		return ret;
+	ret = message_send(hislip->sync, HISLIP_INITIALIZE, 0,
+		(HISLIP_VERSION << 16) | HISLIP_VENDOR,
+		hislip->subaddress, strlen(hislip->subaddress));
+	if (ret == SR_OK)
+		ret = message_receive(hislip->sync,
+			HISLIP_INITIALIZE_RESPONSE, &hdr, NULL, 0);
+	if (ret != SR_OK)
+		goto fail;
+	hislip->overlapped = hdr.control & HISLIP_CC_OVERLAPPED;
+	hislip->session_id = hdr.param & 0xffff;
+	hislip->message_id = HISLIP_FIRST_MESSAGE_ID;
+	sr_dbg("HiSLIP version %u.%u, session %u.", hdr.param >> 24,
+		(hdr.param >> 16) & 0xff, hislip->session_id);
+
+	if ((ret = sr_tcp_connect(hislip->async)) != SR_OK)
+		goto fail;
+	ret = message_send(hislip->async, HISLIP_ASYNC_INITIALIZE, 0,
+		hislip->session_id, NULL, 0);
+	if (ret == SR_OK)
+		ret = message_receive(hislip->async,
+			HISLIP_ASYNC_INITIALIZE_RESPONSE, &hdr, NULL, 0);
+	if (ret != SR_OK)
+		goto fail;
+
+	write_u64be(size, HISLIP_MAX_MESSAGE);
+	ret = message_send(hislip->async, HISLIP_ASYNC_MAX_MESSAGE_SIZE, 0, 0,
+		size, sizeof(size));
+	if (ret == SR_OK)
+		ret = message_receive(hislip->async,
+			HISLIP_ASYNC_MAX_MESSAGE_SIZE_RESPONSE, &hdr,
+			size, sizeof(size));
+	if (ret != SR_OK || hdr.length < sizeof(size))
+		goto fail;
+	hislip->max_message = read_u64be(size);
+
+	if (!hislip->overlapped && hislip_device_clear(hislip) != SR_OK)
+		sr_warn("Cannot switch to overlapped mode.");
+	sr_dbg("HiSLIP %s mode, messages up to %" PRIu64 " bytes.",
+		hislip->overlapped ? "overlapped" : "synchronized",
+		hislip->max_message);
+
+	/* Queries can be sent ahead of the responses in overlapped mode. */
+	scpi->pipelined = hislip->overlapped;
+
+	return SR_OK;
+
+fail:
+	sr_tcp_disconnect(hislip->async);
+	sr_tcp_disconnect(hislip->sync);
+
+	return ret != SR_OK ? ret : SR_ERR_DATA;
+}
+
+static int scpi_hislip_connection_id(struct sr_scpi_dev_inst *scpi,
+		char **connection_id)
+{
+	struct scpi_hislip *hislip = scpi->priv;
+
+	*connection_id = g_strdup_printf("%s/%s/%s", scpi->prefix,
+		hislip->sync->host_addr, hislip->subaddress);
+
+	return SR_OK;
+}
+
+static int scpi_hislip_source_add(struct sr_session *session, void *priv,
+		int events, int timeout, sr_receive_data_callback cb, void *cb_data)
+{
+	struct scpi_hislip *hislip = priv;
+
+	return sr_tcp_source_add(session, hislip->sync,
+		events, timeout, cb, cb_data);
+}
+
+static int scpi_hislip_source_remove(struct sr_session *session, void *priv)
+{
+	struct scpi_hislip *hislip = priv;
+
+	return sr_tcp_source_remove(session, hislip->sync);
+}
+
+/* Commands larger than the server takes get split into Data messages. */
+static int scpi_hislip_send(void *priv, const char *command)
+{
+	struct scpi_hislip *hislip = priv;
+	const char *wrptr;
+	uint64_t len, part;
+	uint8_t type;
+	int ret;
+
+	wrptr = command;
+	len = strlen(command);
+	do {
+		part = hislip->max_message ? MIN(len, hislip->max_message) : len;
+		type = part == len ? HISLIP_DATA_END : HISLIP_DATA;
+		ret = message_send(hislip->sync, type,
+			hislip->rmt_delivered ? HISLIP_CC_RMT_DELIVERED : 0,
+			hislip->message_id, wrptr, part);
+		if (ret != SR_OK)
+			return ret;
+		hislip->rmt_delivered = FALSE;
+		hislip->message_id += 2;
+		wrptr += part;
+		len -= part;
+	} while (len);
+
+	sr_spew("Successfully sent SCPI command: '%s'.", command);
+
+	return SR_OK;
+}
+
+static int scpi_hislip_read_begin(void *priv)
+{
+	struct scpi_hislip *hislip = priv;
+
+	hislip->header_read = 0;
+	hislip->payload_left = 0;
+	hislip->complete = FALSE;
+
+	return SR_OK;
+}
+
+/*
+ * Receive the payload of Data messages up to the DataEnd message. Their
+ * headers are taken in pieces, like the length of the tcp-rigol mode.
+ */
+static int scpi_hislip_read_data(void *priv, char *buf, int maxlen)
+{
+	struct scpi_hislip *hislip = priv;
+	struct hislip_header *hdr;
+	int ret;
+
+	hdr = &hislip->header;
+	if (!hislip->payload_left) {
+		ret = sr_tcp_read_bytes(hislip->sync,
+			&hislip->header_buf[hislip->header_read],
+			HISLIP_HEADER_SIZE - hislip->header_read, FALSE);
+		if (ret < 0) {
+			sr_err("Receive error: %s", g_strerror(errno));
+			return SR_ERR;
+		}
+		hislip->header_read += ret;
+		if (hislip->header_read < HISLIP_HEADER_SIZE)
+			return 0;
+		hislip->header_read = 0;
+		if (header_decode(hislip->header_buf, hdr) != SR_OK)
+			return SR_ERR;
+
+		switch (hdr->type) {
+		case HISLIP_DATA:
+		case HISLIP_DATA_END:
+			break;
+		case HISLIP_ERROR:
+		case HISLIP_FATAL_ERROR:
+			error_report(hislip->sync, hdr);
+			return SR_ERR;
+		case HISLIP_INTERRUPTED:
+			/* A query was sent before the last response was read. */
+			sr_dbg("HiSLIP response interrupted.");
+			return 0;
+		default:
+			sr_dbg("Skipping HiSLIP message %u.", hdr->type);
+			if (payload_read(hislip->sync, hdr->length,
+					NULL, 0) != SR_OK)
+				return SR_ERR;
+			return 0;
+		}
+		hislip->payload_left = hdr->length;
+		if (!hislip->payload_left && hdr->type == HISLIP_DATA_END) {
+			hislip->complete = TRUE;
+			hislip->rmt_delivered = TRUE;
+		}
+		if (!hislip->payload_left)
+			return 0;
+	}
+
+	ret = sr_tcp_read_bytes(hislip->sync, (uint8_t *)buf,
+		MIN((uint64_t)maxlen, hislip->payload_left), FALSE);
+	if (ret < 0) {
+		sr_err("Receive error: %s", g_strerror(errno));
+		return SR_ERR;
+	}
+	hislip->payload_left -= ret;
+	if (!hislip->payload_left && hdr->type == HISLIP_DATA_END) {
+		hislip->complete = TRUE;
+		hislip->rmt_delivered = TRUE;
+	}
+
+	return ret;
+}
+
+static int scpi_hislip_read_complete(void *priv)
+{
+	struct scpi_hislip *hislip = priv;
+
+	return hislip->complete;
+}
+
+static int scpi_hislip_close(struct sr_scpi_dev_inst *scpi)
+{
+	struct scpi_hislip *hislip = scpi->priv;
+
+	sr_tcp_disconnect(hislip->async);
+
+	return sr_tcp_disconnect(hislip->sync);
+}
+
+static void scpi_hislip_free(void *priv)
+{
+	struct scpi_hislip *hislip = priv;
+
+	sr_tcp_dev_inst_free(hislip->async);
+	sr_tcp_dev_inst_free(hislip->sync);
+	g_free(hislip->subaddress);
+}
+
+SR_PRIV const struct sr_scpi_dev_inst scpi_hislip_dev = {
+	.name          = "HiSLIP",
+	.prefix        = "hislip",
+	.transport     = SCPI_TRANSPORT_HISLIP,
+	.priv_size     = sizeof(struct scpi_hislip),
+	.dev_inst_new  = scpi_hislip_dev_inst_new,
+	.open          = scpi_hislip_open,
+	.connection_id = scpi_hislip_connection_id,
+	.source_add    = scpi_hislip_source_add,
+	.source_remove = scpi_hislip_source_remove,
+	.send          = scpi_hislip_send,
+	.read_begin    = scpi_hislip_read_begin,
+	.read_data     = scpi_hislip_read_data,
+	.read_complete = scpi_hislip_read_complete,
+	.close         = scpi_hislip_close,
+	.free          = scpi_hislip_free,
+};
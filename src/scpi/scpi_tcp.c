@@ -57,6 +57,18 @@ static int scpi_tcp_dev_inst_new(void *priv, struct drv_context *drvc,
 	if (!tcp->tcp_dev)
 		return SR_ERR;
 
+	/*
+	 * Commands often follow each other without a response between
+	 * them, which Nagle's algorithm would delay until an ACK came.
+	 * Socket options can follow the port.
+	 */
+	tcp->tcp_dev->opts.nodelay = TRUE;
+	if (sr_tcp_parse_options(&tcp->tcp_dev->opts, params + 3) != SR_OK) {
+		sr_tcp_dev_inst_free(tcp->tcp_dev);
+		tcp->tcp_dev = NULL;
+		return SR_ERR;
+	}
+
 	return SR_OK;
 }
 
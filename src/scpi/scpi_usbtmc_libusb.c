@@ -29,6 +29,13 @@
 #define MAX_TRANSFER_LENGTH 2048
 #define TRANSFER_TIMEOUT 1000
 
+/*
+ * Long responses get read with several bulk in transfers queued at
+ * the same time, so that the link doesn't idle between transfers.
+ */
+#define BULKIN_QUEUE_TRANSFERS 4
+#define BULKIN_QUEUE_SIZE (64 * 1024)
+
 struct scpi_usbtmc_libusb {
 	struct sr_context *ctx;
 	struct sr_usb_dev_inst *usb;
@@ -42,10 +49,21 @@ struct scpi_usbtmc_libusb {
 	uint8_t usb488_dev_cap;
 	uint8_t bTag;
 	uint8_t bulkin_attributes;
+	uint16_t bulk_in_max_packet;
 	uint8_t buffer[MAX_TRANSFER_LENGTH];
+	const uint8_t *response_data;
 	int response_length;
 	int response_bytes_read;
 	int remaining_length;
+	/* Queued bulk in transfers, a ring starting at bulkin_head. */
+	struct libusb_transfer *bulkin_xfer[BULKIN_QUEUE_TRANSFERS];
+	int bulkin_done[BULKIN_QUEUE_TRANSFERS];
+	size_t bulkin_head;
+	size_t bulkin_queued;
+	/* The previous head, still being read from. */
+	gboolean bulkin_consuming;
+	/* Bytes which are yet to be asked for with queued transfers. */
+	int bulkin_unqueued;
 };
 
 /* Some USBTMC-specific enums, as defined in the USBTMC standard. */
@@ -338,6 +356,7 @@ static int scpi_usbtmc_libusb_open(struct sr_scpi_dev_inst *scpi)
 				if (ep->bmAttributes == LIBUSB_TRANSFER_TYPE_BULK &&
 				    ep->bEndpointAddress & (LIBUSB_ENDPOINT_DIR_MASK)) {
 					uscpi->bulk_in_ep = ep->bEndpointAddress;
+					uscpi->bulk_in_max_packet = ep->wMaxPacketSize & 0x7ff;
 					sr_dbg("Bulk IN EP %d", uscpi->bulk_in_ep & 0x7f);
 				}
 				if (ep->bmAttributes == LIBUSB_TRANSFER_TYPE_INTERRUPT &&
@@ -563,6 +582,7 @@ static int scpi_usbtmc_bulkin_start(struct scpi_usbtmc_libusb *uscpi,
 	}
 
 	message_size += USBTMC_BULK_HEADER_SIZE;
+	uscpi->response_data = data;
 	uscpi->response_length = MIN(transferred, message_size);
 	uscpi->response_bytes_read = USBTMC_BULK_HEADER_SIZE;
 	uscpi->remaining_length = message_size - uscpi->response_length;
@@ -584,6 +604,7 @@ static int scpi_usbtmc_bulkin_continue(struct scpi_usbtmc_libusb *uscpi,
 		return SR_ERR;
 	}
 
+	uscpi->response_data = data;
 	uscpi->response_length = MIN(transferred, uscpi->remaining_length);
 	uscpi->response_bytes_read = 0;
 	uscpi->remaining_length -= uscpi->response_length;
@@ -591,6 +612,179 @@ static int scpi_usbtmc_bulkin_continue(struct scpi_usbtmc_libusb *uscpi,
 	return transferred;
 }
 
+static void LIBUSB_CALL bulkin_queue_cb(struct libusb_transfer *xfer)
+{
+	int *done;
+
+	done = xfer->user_data;
+	*done = 1;
+}
+
+static int bulkin_queue_wait(struct scpi_usbtmc_libusb *uscpi, int *done)
+{
+	struct timeval tv;
+	int ret;
+
+	while (!*done) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 100 * 1000;
+		ret = libusb_handle_events_timeout_completed(
+			uscpi->ctx->libusb_ctx, &tv, done);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED) {
+			sr_err("USBTMC event handling error: %s.",
+			       libusb_error_name(ret));
+			return SR_ERR;
+		}
+	}
+
+	return SR_OK;
+}
+
+/* Queue more transfers while there is data which wasn't asked for. */
+static int bulkin_queue_fill(struct scpi_usbtmc_libusb *uscpi)
+{
+	struct libusb_transfer *xfer;
+	size_t idx;
+	int len, ret;
+
+	while (uscpi->bulkin_unqueued > 0
+			&& uscpi->bulkin_queued + uscpi->bulkin_consuming
+				< BULKIN_QUEUE_TRANSFERS) {
+		idx = (uscpi->bulkin_head + uscpi->bulkin_consuming
+			+ uscpi->bulkin_queued) % BULKIN_QUEUE_TRANSFERS;
+		xfer = uscpi->bulkin_xfer[idx];
+		if (!xfer) {
+			xfer = libusb_alloc_transfer(0);
+			if (!xfer)
+				return SR_ERR_MALLOC;
+			xfer->buffer = g_malloc(BULKIN_QUEUE_SIZE);
+			xfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+			uscpi->bulkin_xfer[idx] = xfer;
+		}
+
+		/* Shorter ones end with a short packet, round them up. */
+		len = MIN(uscpi->bulkin_unqueued, BULKIN_QUEUE_SIZE);
+		len += uscpi->bulk_in_max_packet - 1;
+		len -= len % uscpi->bulk_in_max_packet;
+		len = MIN(len, BULKIN_QUEUE_SIZE);
+
+		/* Its timer runs while the transfers before it get filled. */
+		libusb_fill_bulk_transfer(xfer, uscpi->usb->devhdl,
+			uscpi->bulk_in_ep, xfer->buffer, len, bulkin_queue_cb,
+			&uscpi->bulkin_done[idx],
+			TRANSFER_TIMEOUT * BULKIN_QUEUE_TRANSFERS);
+		uscpi->bulkin_done[idx] = 0;
+		ret = libusb_submit_transfer(xfer);
+		if (ret < 0) {
+			sr_err("USBTMC bulk in submit error: %s.",
+			       libusb_error_name(ret));
+			return SR_ERR;
+		}
+		uscpi->bulkin_queued++;
+		uscpi->bulkin_unqueued -= MIN(len, uscpi->bulkin_unqueued);
+	}
+
+	return SR_OK;
+}
+
+/* Cancel and wait for all queued transfers. */
+static void bulkin_queue_cancel(struct scpi_usbtmc_libusb *uscpi)
+{
+	size_t i, idx;
+
+	if (uscpi->bulkin_consuming) {
+		uscpi->bulkin_head = (uscpi->bulkin_head + 1)
+			% BULKIN_QUEUE_TRANSFERS;
+		uscpi->bulkin_consuming = FALSE;
+	}
+	for (i = 0; i < uscpi->bulkin_queued; i++) {
+		idx = (uscpi->bulkin_head + i) % BULKIN_QUEUE_TRANSFERS;
+		if (!uscpi->bulkin_done[idx])
+			libusb_cancel_transfer(uscpi->bulkin_xfer[idx]);
+	}
+	for (i = 0; i < uscpi->bulkin_queued; i++) {
+		idx = (uscpi->bulkin_head + i) % BULKIN_QUEUE_TRANSFERS;
+		(void)bulkin_queue_wait(uscpi, &uscpi->bulkin_done[idx]);
+	}
+	uscpi->bulkin_queued = 0;
+	uscpi->bulkin_unqueued = 0;
+}
+
+/* Start queueing transfers for the rest of a long message. */
+static int bulkin_queue_start(struct scpi_usbtmc_libusb *uscpi)
+{
+	if (!uscpi->bulk_in_max_packet
+			|| uscpi->remaining_length <= MAX_TRANSFER_LENGTH)
+		return SR_OK;
+
+	/* Allow for the 0-3 alignment bytes at the message's end. */
+	uscpi->bulkin_unqueued = uscpi->remaining_length + 3;
+	sr_spew("Queueing bulk in transfers for %d bytes.",
+		uscpi->remaining_length);
+
+	return bulkin_queue_fill(uscpi);
+}
+
+/* Continue reading a long message from the next queued transfer. */
+static int bulkin_queue_continue(struct scpi_usbtmc_libusb *uscpi)
+{
+	struct libusb_transfer *xfer;
+	size_t idx;
+	int ret;
+
+	/* Reuse the transfer which was read from for more data. */
+	if (uscpi->bulkin_consuming) {
+		uscpi->bulkin_head = (uscpi->bulkin_head + 1)
+			% BULKIN_QUEUE_TRANSFERS;
+		uscpi->bulkin_consuming = FALSE;
+	}
+	if ((ret = bulkin_queue_fill(uscpi)) != SR_OK) {
+		bulkin_queue_cancel(uscpi);
+		return ret;
+	}
+
+	idx = uscpi->bulkin_head;
+	if ((ret = bulkin_queue_wait(uscpi, &uscpi->bulkin_done[idx])) != SR_OK) {
+		bulkin_queue_cancel(uscpi);
+		return ret;
+	}
+	uscpi->bulkin_queued--;
+	uscpi->bulkin_consuming = TRUE;
+
+	/* Data which came in before a timeout is still good. */
+	xfer = uscpi->bulkin_xfer[idx];
+	if (xfer->status != LIBUSB_TRANSFER_COMPLETED
+			&& (xfer->status != LIBUSB_TRANSFER_TIMED_OUT
+				|| !xfer->actual_length)) {
+		sr_err("USBTMC bulk in transfer error: %s.",
+		       libusb_error_name(xfer->status == LIBUSB_TRANSFER_TIMED_OUT
+				? LIBUSB_ERROR_TIMEOUT : LIBUSB_ERROR_IO));
+		bulkin_queue_cancel(uscpi);
+		return SR_ERR;
+	}
+
+	uscpi->response_data = xfer->buffer;
+	uscpi->response_length = MIN(xfer->actual_length,
+		uscpi->remaining_length);
+	uscpi->response_bytes_read = 0;
+	uscpi->remaining_length -= uscpi->response_length;
+	if (uscpi->remaining_length <= 0)
+		bulkin_queue_cancel(uscpi);
+
+	return xfer->actual_length;
+}
+
+static void bulkin_queue_free(struct scpi_usbtmc_libusb *uscpi)
+{
+	size_t i;
+
+	bulkin_queue_cancel(uscpi);
+	for (i = 0; i < BULKIN_QUEUE_TRANSFERS; i++) {
+		libusb_free_transfer(uscpi->bulkin_xfer[i]);
+		uscpi->bulkin_xfer[i] = NULL;
+	}
+}
+
 static int scpi_usbtmc_libusb_send(void *priv, const char *command)
 {
 	struct scpi_usbtmc_libusb *uscpi = priv;
@@ -608,6 +802,7 @@ static int scpi_usbtmc_libusb_read_begin(void *priv)
 {
 	struct scpi_usbtmc_libusb *uscpi = priv;
 
+	bulkin_queue_cancel(uscpi);
 	uscpi->remaining_length = 0;
 
 	if (scpi_usbtmc_bulkout(uscpi, REQUEST_DEV_DEP_MSG_IN,
@@ -618,7 +813,7 @@ static int scpi_usbtmc_libusb_read_begin(void *priv)
 	                             &uscpi->bulkin_attributes) < 0)
 		return SR_ERR;
 
-	return SR_OK;
+	return bulkin_queue_start(uscpi);
 }
 
 static int scpi_usbtmc_libusb_read_data(void *priv, char *buf, int maxlen)
@@ -627,7 +822,12 @@ static int scpi_usbtmc_libusb_read_data(void *priv, char *buf, int maxlen)
 	int read_length;
 
 	if (uscpi->response_bytes_read >= uscpi->response_length) {
-		if (uscpi->remaining_length > 0) {
+		if (uscpi->remaining_length > 0
+				&& (uscpi->bulkin_queued || uscpi->bulkin_unqueued)) {
+			if (bulkin_queue_continue(uscpi) <= 0)
+				return SR_ERR;
+		} else if (uscpi->remaining_length > 0) {
+			bulkin_queue_cancel(uscpi);
 			if (scpi_usbtmc_bulkin_continue(uscpi, uscpi->buffer,
 			                                sizeof(uscpi->buffer)) <= 0)
 				return SR_ERR;
@@ -641,7 +841,7 @@ static int scpi_usbtmc_libusb_read_data(void *priv, char *buf, int maxlen)
 
 	read_length = MIN(uscpi->response_length - uscpi->response_bytes_read, maxlen);
 
-	memcpy(buf, uscpi->buffer + uscpi->response_bytes_read, read_length);
+	memcpy(buf, uscpi->response_data + uscpi->response_bytes_read, read_length);
 
 	uscpi->response_bytes_read += read_length;
 
@@ -665,6 +865,7 @@ static int scpi_usbtmc_libusb_close(struct sr_scpi_dev_inst *scpi)
 	if (!usb->devhdl)
 		return SR_ERR;
 
+	bulkin_queue_free(uscpi);
 	scpi_usbtmc_local(uscpi);
 
 	if ((ret = libusb_release_interface(usb->devhdl, uscpi->interface)) < 0)
@@ -39,6 +39,12 @@
 #define LOG_PREFIX "serial"
 /** @endcond */
 
+/* Upper amount of receive data which gets read ahead at once. */
+#define READ_AHEAD_SIZE 256
+
+/* Lower size of receive queues, chunks accumulate while not read. */
+#define RX_QUEUE_MIN_SIZE (64 * 1024)
+
 /**
  * @file
  *
@@ -111,7 +117,7 @@ SR_PRIV int serial_open(struct sr_serial_dev_inst *serial, int flags)
 	 * size heavily depends on the specific transport. That's why the
 	 * buffer's content gets accessed and the buffer is released here in
 	 * common code, but the buffer gets allocated in libraries' open()
-	 * routines.
+	 * routines, see sr_ser_alloc_rx_queue().
 	 */
 
 	/*
@@ -165,14 +171,28 @@ SR_PRIV int serial_close(struct sr_serial_dev_inst *serial)
 
 	sr_spew("Closing serial port %s.", serial->port);
 
+	if (serial->latency.count) {
+		sr_dbg("Round trip latency on %s: min %" G_GINT64_FORMAT
+			" us, avg %" G_GINT64_FORMAT " us over %zu requests.",
+			serial->port, serial->latency.min_us,
+			serial->latency.sum_us / (gint64)serial->latency.count,
+			serial->latency.count);
+	}
+	memset(&serial->latency, 0, sizeof(serial->latency));
+
 	if (!serial->lib_funcs || !serial->lib_funcs->close)
 		return SR_ERR_NA;
 
 	rc = serial->lib_funcs->close(serial);
 	if (rc == SR_OK && serial->rcv_buffer) {
-		g_string_free(serial->rcv_buffer, TRUE);
+		g_free(serial->rcv_buffer->data);
+		g_free(serial->rcv_buffer);
 		serial->rcv_buffer = NULL;
 	}
+	if (rc == SR_OK && serial->rx_ahead) {
+		g_string_free(serial->rx_ahead, TRUE);
+		serial->rx_ahead = NULL;
+	}
 
 	return rc;
 }
@@ -197,6 +217,8 @@ SR_PRIV int serial_flush(struct sr_serial_dev_inst *serial)
 	sr_spew("Flushing serial port %s.", serial->port);
 
 	sr_ser_discard_queued_data(serial);
+	if (serial->rx_ahead)
+		g_string_truncate(serial->rx_ahead, 0);
 
 	if (!serial->lib_funcs || !serial->lib_funcs->flush)
 		return SR_ERR_NA;
@@ -276,6 +298,36 @@ SR_PRIV int serial_set_read_chunk_cb(struct sr_serial_dev_inst *serial,
 	return SR_OK;
 }
 
+/**
+ * Allocate the queue for received data. Internal to the serial subsystem,
+ * for transports which receive data in chunks, and queue them until
+ * they are read. A queue which exists is kept.
+ *
+ * @param[in] serial Previously opened serial port instance.
+ * @param[in] size Minimum size of the queue. It is rounded up to a
+ *                 power of two, and to a size which holds many chunks.
+ *
+ * @private
+ */
+SR_PRIV void sr_ser_alloc_rx_queue(struct sr_serial_dev_inst *serial,
+	size_t size)
+{
+	struct sr_ser_rx_queue *q;
+	size_t alloc;
+
+	if (!serial || serial->rcv_buffer)
+		return;
+
+	alloc = RX_QUEUE_MIN_SIZE;
+	while (alloc < size)
+		alloc *= 2;
+
+	q = g_malloc0(sizeof(*q));
+	q->data = g_malloc(alloc);
+	q->mask = alloc - 1;
+	serial->rcv_buffer = q;
+}
+
 /**
  * Discard previously queued RX data. Internal to the serial subsystem,
  * coordination between common and transport specific support code.
@@ -289,7 +341,8 @@ SR_PRIV void sr_ser_discard_queued_data(struct sr_serial_dev_inst *serial)
 	if (!serial || !serial->rcv_buffer)
 		return;
 
-	g_string_truncate(serial->rcv_buffer, 0);
+	serial->rcv_buffer->head = serial->rcv_buffer->tail = 0;
+	serial->rcv_buffer->overflow = FALSE;
 }
 
 /**
@@ -305,13 +358,17 @@ SR_PRIV size_t sr_ser_has_queued_data(struct sr_serial_dev_inst *serial)
 	if (!serial || !serial->rcv_buffer)
 		return 0;
 
-	return serial->rcv_buffer->len;
+	return serial->rcv_buffer->tail - serial->rcv_buffer->head;
 }
 
 /**
  * Queue received data. Internal to the serial subsystem, coordination
  * between common and transport specific support code.
  *
+ * The queue is of fixed size. When it is full, received data which does
+ * not fit is dropped, data which was queued before is kept. A warning
+ * is logged once for each run of dropped data.
+ *
  * @param[in] serial Previously opened serial port instance.
  * @param[in] data Pointer to data bytes to queue.
  * @param[in] len Number of data bytes to queue.
@@ -321,13 +378,36 @@ SR_PRIV size_t sr_ser_has_queued_data(struct sr_serial_dev_inst *serial)
 SR_PRIV void sr_ser_queue_rx_data(struct sr_serial_dev_inst *serial,
 	const uint8_t *data, size_t len)
 {
+	struct sr_ser_rx_queue *q;
+	size_t space, pos, span;
+
 	if (!serial || !data || !len)
 		return;
 
-	if (serial->rx_chunk_cb_func)
+	if (serial->rx_chunk_cb_func) {
 		serial->rx_chunk_cb_func(serial, serial->rx_chunk_cb_data, data, len);
-	else if (serial->rcv_buffer)
-		g_string_append_len(serial->rcv_buffer, (const gchar *)data, len);
+		return;
+	}
+	q = serial->rcv_buffer;
+	if (!q)
+		return;
+
+	space = q->mask + 1 - (q->tail - q->head);
+	if (len > space) {
+		if (!q->overflow)
+			sr_warn("RX queue full, dropping %zu bytes.", len - space);
+		q->overflow = TRUE;
+		len = space;
+	} else {
+		q->overflow = FALSE;
+	}
+
+	/* Copy in up to two spans, where the data wraps around. */
+	pos = q->tail & q->mask;
+	span = MIN(len, q->mask + 1 - pos);
+	memcpy(&q->data[pos], data, span);
+	memcpy(q->data, data + span, len - span);
+	q->tail += len;
 }
 
 /**
@@ -343,8 +423,8 @@ SR_PRIV void sr_ser_queue_rx_data(struct sr_serial_dev_inst *serial,
 SR_PRIV size_t sr_ser_unqueue_rx_data(struct sr_serial_dev_inst *serial,
 	uint8_t *data, size_t len)
 {
-	size_t qlen;
-	GString *buf;
+	struct sr_ser_rx_queue *q;
+	size_t qlen, pos, span;
 
 	if (!serial || !data || !len)
 		return 0;
@@ -353,13 +433,14 @@ SR_PRIV size_t sr_ser_unqueue_rx_data(struct sr_serial_dev_inst *serial,
 	if (!qlen)
 		return 0;
 
-	buf = serial->rcv_buffer;
-	if (len > buf->len)
-		len = buf->len;
-	if (len) {
-		memcpy(data, buf->str, len);
-		g_string_erase(buf, 0, len);
-	}
+	q = serial->rcv_buffer;
+	if (len > qlen)
+		len = qlen;
+	pos = q->head & q->mask;
+	span = MIN(len, q->mask + 1 - pos);
+	memcpy(data, &q->data[pos], span);
+	memcpy(data + span, q->data, len - span);
+	q->head += len;
 
 	return len;
 }
@@ -388,6 +469,8 @@ SR_PRIV size_t serial_has_receive_data(struct sr_serial_dev_inst *serial)
 		lib_count = serial->lib_funcs->get_rx_avail(serial);
 
 	buf_count = sr_ser_has_queued_data(serial);
+	if (serial->rx_ahead)
+		buf_count += serial->rx_ahead->len;
 
 	return lib_count + buf_count;
 }
@@ -408,6 +491,8 @@ static int _serial_write(struct sr_serial_dev_inst *serial,
 	ret = serial->lib_funcs->write(serial, buf, count,
 		nonblocking, timeout_ms);
 	sr_spew("Wrote %zd/%zu bytes.", ret, count);
+	if (ret > 0)
+		serial->latency.write_time = g_get_monotonic_time();
 
 	return ret;
 }
@@ -452,26 +537,104 @@ SR_PRIV int serial_write_nonblocking(struct sr_serial_dev_inst *serial,
 	return _serial_write(serial, buf, count, 1, 0);
 }
 
-static int _serial_read(struct sr_serial_dev_inst *serial,
+/*
+ * Take the time from the last write to the first data which came back
+ * after it. Only the first response byte counts, the time which the
+ * rest of a long response takes is a matter of bitrate.
+ */
+static void account_latency(struct sr_serial_dev_inst *serial)
+{
+	gint64 delta;
+
+	delta = g_get_monotonic_time() - serial->latency.write_time;
+	serial->latency.write_time = 0;
+	if (!serial->latency.count || delta < serial->latency.min_us)
+		serial->latency.min_us = delta;
+	serial->latency.sum_us += delta;
+	serial->latency.count++;
+}
+
+static int serial_lib_read(struct sr_serial_dev_inst *serial,
 	void *buf, size_t count, int nonblocking, unsigned int timeout_ms)
 {
 	ssize_t ret;
 
-	if (!serial) {
-		sr_dbg("Invalid serial port.");
-		return SR_ERR;
-	}
-
 	if (!serial->lib_funcs || !serial->lib_funcs->read)
 		return SR_ERR_NA;
 	ret = serial->lib_funcs->read(serial, buf, count,
 		nonblocking, timeout_ms);
 	if (ret > 0)
 		sr_spew("Read %zd/%zu bytes.", ret, count);
+	if (ret > 0 && serial->latency.write_time)
+		account_latency(serial);
 
 	return ret;
 }
 
+static int _serial_read(struct sr_serial_dev_inst *serial,
+	void *buf, size_t count, int nonblocking, unsigned int timeout_ms)
+{
+	size_t taken;
+	ssize_t ret;
+
+	if (!serial) {
+		sr_dbg("Invalid serial port.");
+		return SR_ERR;
+	}
+
+	/* Data which was read ahead comes first. */
+	taken = 0;
+	if (serial->rx_ahead && serial->rx_ahead->len) {
+		taken = MIN(count, serial->rx_ahead->len);
+		memcpy(buf, serial->rx_ahead->str, taken);
+		g_string_erase(serial->rx_ahead, 0, taken);
+		if (taken == count)
+			return taken;
+	}
+
+	ret = serial_lib_read(serial, (uint8_t *)buf + taken, count - taken,
+		nonblocking, timeout_ms);
+	if (ret < 0)
+		return taken ? (int)taken : ret;
+
+	return taken + ret;
+}
+
+/*
+ * Wait for receive data, and read ahead as much of it as is available
+ * right away. Returns the number of bytes read ahead, 0 upon timeout.
+ */
+static int serial_read_ahead(struct sr_serial_dev_inst *serial,
+	unsigned int timeout_ms)
+{
+	uint8_t chunk[READ_AHEAD_SIZE];
+	int len, more;
+
+	len = serial_lib_read(serial, chunk, 1, 0, timeout_ms);
+	if (len <= 0)
+		return len;
+	more = serial_lib_read(serial, &chunk[len], sizeof(chunk) - len, 1, 0);
+	if (more > 0)
+		len += more;
+
+	if (!serial->rx_ahead)
+		serial->rx_ahead = g_string_sized_new(sizeof(chunk));
+	g_string_append_len(serial->rx_ahead, (const gchar *)chunk, len);
+
+	return len;
+}
+
+/* Put back received data which the caller didn't take. */
+static void serial_unread(struct sr_serial_dev_inst *serial,
+	const uint8_t *data, size_t len)
+{
+	if (!len)
+		return;
+	if (!serial->rx_ahead)
+		serial->rx_ahead = g_string_sized_new(MAX(len, READ_AHEAD_SIZE));
+	g_string_prepend_len(serial->rx_ahead, (const gchar *)data, len);
+}
+
 /**
  * Read a number of bytes from the specified serial port, block until finished.
  *
@@ -608,6 +771,7 @@ SR_PRIV int serial_set_handshake(struct sr_serial_dev_inst *serial,
  * Options:\n
  * dtr=0|1 Set DTR off resp. on.\n
  * flow=0|1|2 Flow control. 0 for none, 1 for RTS/CTS, 2 for XON/XOFF.\n
+ * lowlat=0|1 Low latency mode of USB serial adapters off resp. on.\n
  * rts=0|1 Set RTS off resp. on.\n
  * Please note that values and combinations of these parameters must be
  * supported by the concrete serial interface hardware and the drivers for it.
@@ -626,14 +790,15 @@ SR_PRIV int serial_set_paramstr(struct sr_serial_dev_inst *serial,
 
 	GRegex *reg;
 	GMatchInfo *match;
-	int speed, databits, parity, stopbits, flow, rts, dtr, i;
+	int speed, databits, parity, stopbits, flow, rts, dtr, lowlat, i;
 	char *mstr, **opts, **kv;
+	int ret;
 
 	speed = flow = 0;
 	databits = 8;
 	parity = SP_PARITY_NONE;
 	stopbits = 1;
-	rts = dtr = -1;
+	rts = dtr = lowlat = -1;
 	sr_spew("Parsing parameters from \"%s\".", paramstr);
 	reg = g_regex_new(SERIAL_COMM_SPEC, 0, 0, NULL);
 	if (g_regex_match(reg, paramstr, 0, &match)) {
@@ -698,6 +863,15 @@ SR_PRIV int serial_set_paramstr(struct sr_serial_dev_inst *serial,
 							sr_dbg("invalid value for flow: %c", kv[1][0]);
 							speed = 0;
 						}
+					} else if (!strncmp(kv[0], "lowlat", 6)) {
+						if (kv[1][0] == '1')
+							lowlat = 1;
+						else if (kv[1][0] == '0')
+							lowlat = 0;
+						else {
+							sr_dbg("invalid value for lowlat: %c", kv[1][0]);
+							speed = 0;
+						}
 					}
 					g_strfreev(kv);
 				}
@@ -708,17 +882,106 @@ SR_PRIV int serial_set_paramstr(struct sr_serial_dev_inst *serial,
 	}
 	g_match_info_unref(match);
 	g_regex_unref(reg);
-	sr_spew("Got params: rate %d, frame %d/%d/%d, flow %d, rts %d, dtr %d.",
-		speed, databits, parity, stopbits, flow, rts, dtr);
+	sr_spew("Got params: rate %d, frame %d/%d/%d, flow %d, rts %d, dtr %d, "
+		"lowlat %d.", speed, databits, parity, stopbits,
+		flow, rts, dtr, lowlat);
 
 	if (!speed) {
 		sr_dbg("Could not infer speed from parameter string.");
 		return SR_ERR_ARG;
 	}
 
-	return serial_set_params(serial, speed,
+	ret = serial_set_params(serial, speed,
 			databits, parity, stopbits,
 			flow, rts, dtr);
+	if (ret != SR_OK || lowlat < 0)
+		return ret;
+
+	/* Low latency is an optimization, communication works without. */
+	if (serial_set_low_latency(serial, lowlat) != SR_OK)
+		sr_warn("Could not change low latency mode of %s.",
+			serial->port);
+
+	return SR_OK;
+}
+
+/**
+ * Enable or disable low latency mode of a serial port.
+ *
+ * USB serial adapters hold back receive data for some time, to send
+ * it to the host in fewer USB transfers. FTDI chips wait 16ms by
+ * default, which dominates request/response times of polled devices.
+ * Low latency mode has received data passed on immediately, at the
+ * cost of more USB traffic and CPU load.
+ *
+ * @param serial Previously initialized serial port structure.
+ * @param[in] on Whether to enable low latency mode.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_NA The port does not support low latency mode.
+ * @retval SR_ERR Failure.
+ *
+ * @private
+ */
+SR_PRIV int serial_set_low_latency(struct sr_serial_dev_inst *serial,
+	gboolean on)
+{
+	if (!serial) {
+		sr_dbg("Invalid serial port.");
+		return SR_ERR;
+	}
+
+	sr_spew("%s low latency mode on port %s.",
+		on ? "Enabling" : "Disabling", serial->port);
+
+	if (!serial->lib_funcs || !serial->lib_funcs->set_low_latency)
+		return SR_ERR_NA;
+
+	return serial->lib_funcs->set_low_latency(serial, on);
+}
+
+/**
+ * Get request/response latency which was observed on a serial port.
+ *
+ * The latency is the time from writing to the port until the first
+ * data comes back. It includes the device's response time, and is
+ * what limits the rate at which polled devices can be queried.
+ *
+ * @param serial Previously initialized serial port structure.
+ * @param[out] min_us The shortest latency in microseconds.
+ * @param[out] avg_us The average latency in microseconds.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_NA No response was received since the port was opened.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int serial_get_latency(struct sr_serial_dev_inst *serial,
+	uint64_t *min_us, uint64_t *avg_us)
+{
+	if (!serial)
+		return SR_ERR_ARG;
+	if (!serial->latency.count)
+		return SR_ERR_NA;
+
+	if (min_us)
+		*min_us = serial->latency.min_us;
+	if (avg_us)
+		*avg_us = serial->latency.sum_us / serial->latency.count;
+
+	return SR_OK;
+}
+
+/* Find the first CR or LF. */
+static const char *find_eol(const char *s, size_t len)
+{
+	const char *cr, *lf;
+
+	cr = memchr(s, '\r', len);
+	lf = memchr(s, '\n', cr ? (size_t)(cr - s) : len);
+
+	return lf ? lf : cr;
 }
 
 /**
@@ -730,6 +993,7 @@ SR_PRIV int serial_set_paramstr(struct sr_serial_dev_inst *serial,
  * @param[in] timeout_ms How long to wait for a line to come in.
  *
  * Reading stops when CR or LF is found, which is stripped from the buffer.
+ * Data which was received after it is kept for later reads.
  *
  * @retval SR_OK Success.
  * @retval SR_ERR Failure.
@@ -740,7 +1004,10 @@ SR_PRIV int serial_readline(struct sr_serial_dev_inst *serial,
 	char **buf, int *buflen, gint64 timeout_ms)
 {
 	gint64 start, remaining;
-	int maxlen, len;
+	int maxlen, ret;
+	size_t avail, len;
+	const char *eol;
+	GString *ahead;
 
 	if (!serial) {
 		sr_dbg("Invalid serial port.");
@@ -753,33 +1020,42 @@ SR_PRIV int serial_readline(struct sr_serial_dev_inst *serial,
 	}
 
 	start = g_get_monotonic_time();
-	remaining = timeout_ms;
 
 	maxlen = *buflen;
-	*buflen = len = 0;
+	*buflen = 0;
+	if (maxlen < 2)
+		return SR_OK;
+
+	/*
+	 * Scan the data which was read ahead for the end of the line,
+	 * and wait for more where it's not found. Data after the line
+	 * is kept for later reads.
+	 */
 	while (1) {
-		len = maxlen - *buflen - 1;
-		if (len < 1)
+		ahead = serial->rx_ahead;
+		avail = ahead ? MIN(ahead->len, (size_t)maxlen - 1) : 0;
+		eol = avail ? find_eol(ahead->str, avail) : NULL;
+		if (eol || avail == (size_t)maxlen - 1)
 			break;
-		len = serial_read_blocking(serial, *buf + *buflen, 1, remaining);
-		if (len > 0) {
-			*buflen += len;
-			*(*buf + *buflen) = '\0';
-			if (*buflen > 0 && (*(*buf + *buflen - 1) == '\r'
-					|| *(*buf + *buflen - 1) == '\n')) {
-				/* Strip CR/LF and terminate. */
-				*(*buf + --*buflen) = '\0';
-				break;
-			}
-		}
+
 		/* Reduce timeout by time elapsed. */
 		remaining = timeout_ms - ((g_get_monotonic_time() - start) / 1000);
 		if (remaining <= 0)
 			/* Timeout */
 			break;
-		if (len < 1)
-			g_usleep(2000);
+		ret = serial_read_ahead(serial, remaining);
+		if (ret < 0)
+			break;
 	}
+
+	len = eol ? (size_t)(eol - ahead->str) : avail;
+	if (avail) {
+		memcpy(*buf, ahead->str, len);
+		/* Strip CR/LF. */
+		g_string_erase(ahead, 0, eol ? len + 1 : len);
+	}
+	*(*buf + len) = '\0';
+	*buflen = len;
 	if (*buflen)
 		sr_dbg("Received %d: '%s'.", *buflen, *buf);
 
@@ -818,7 +1094,7 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 	packet_valid_len_callback is_valid_len, size_t *return_size,
 	uint64_t timeout_ms)
 {
-	uint64_t start_us, elapsed_ms, byte_delay_us;
+	uint64_t start_us, elapsed_ms;
 	size_t fill_idx, check_idx, max_fill_idx;
 	ssize_t recv_len;
 	const uint8_t *check_ptr;
@@ -840,86 +1116,97 @@ SR_PRIV int serial_stream_detect(struct sr_serial_dev_inst *serial,
 		return SR_ERR_ARG;
 	}
 
-	byte_delay_us = serial_timeout(serial, 1) * 1000;
 	start_us = g_get_monotonic_time();
 
 	check_idx = fill_idx = 0;
-	while (fill_idx < max_fill_idx) {
+	while (1) {
 		/*
-		 * Read bytes individually. Lets callers continue to
-		 * successfully process next RX data after first match.
-		 * Run full loop bodies for empty or failed reception
-		 * in an iteration, to have timeouts checked.
+		 * Check the data at each read position for which (a
+		 * minimum) size was received, until more is needed.
 		 */
-		recv_len = serial_read_nonblocking(serial, &buf[fill_idx], 1);
-		if (recv_len > 0)
-			fill_idx += recv_len;
-
-		/* Dump receive data when (a minimum) size is reached. */
-		check_ptr = &buf[check_idx];
-		check_len = fill_idx - check_idx;
-		do_dump = check_len >= packet_size;
-		do_dump &= sr_log_loglevel_get() >= SR_LOG_SPEW;
-		if (do_dump) {
-			GString *text;
-
-			text = sr_hexdump_new(check_ptr, check_len);
-			sr_spew("Trying packet: len %zu, bytes %s",
-				check_len, text->str);
-			sr_hexdump_free(text);
-		}
-
-		/* A packet's (minimum) length was received, check its data. */
-		elapsed_ms = g_get_monotonic_time() - start_us;
-		elapsed_ms /= 1000;
-		if (is_valid_len && check_len >= packet_size) {
-			pkt_len = packet_size;
-			ret = is_valid_len(NULL, check_ptr, check_len, &pkt_len);
-			if (ret == SR_PACKET_VALID) {
-				/* Exact match. Terminate with success. */
-				sr_spew("Valid packet after %" PRIu64 "ms.",
-					elapsed_ms);
-				sr_spew("RX count %zu, packet len %zu.",
-					fill_idx, pkt_len);
-				*buflen = fill_idx;
-				if (return_size)
-					*return_size = pkt_len;
-				return SR_OK;
+		pkt_len = 0;
+		while (fill_idx - check_idx >= packet_size) {
+			check_ptr = &buf[check_idx];
+			check_len = fill_idx - check_idx;
+			do_dump = sr_log_loglevel_get() >= SR_LOG_SPEW;
+			if (do_dump) {
+				GString *text;
+
+				text = sr_hexdump_new(check_ptr, check_len);
+				sr_spew("Trying packet: len %zu, bytes %s",
+					check_len, text->str);
+				sr_hexdump_free(text);
 			}
-			if (ret == SR_PACKET_NEED_RX) {
-				/* Incomplete, keep accumulating RX data. */
-				sr_spew("Checker needs more RX data.");
+
+			if (is_valid_len) {
+				pkt_len = packet_size;
+				ret = is_valid_len(NULL, check_ptr, check_len, &pkt_len);
+				if (ret == SR_PACKET_VALID)
+					break;
+				pkt_len = 0;
+				if (ret == SR_PACKET_NEED_RX) {
+					/* Incomplete, keep accumulating RX data. */
+					sr_spew("Checker needs more RX data.");
+					break;
+				}
+			} else if (is_valid) {
+				if (is_valid(check_ptr)) {
+					pkt_len = packet_size;
+					break;
+				}
 			} else {
-				/* Not a valid packet. Continue searching. */
-				sr_spew("Invalid packet, advancing read pos.");
-				check_idx++;
-			}
-		}
-		if (is_valid && check_len >= packet_size) {
-			if (is_valid(check_ptr)) {
-				/* Exact match. Terminate with success. */
-				sr_spew("Valid packet after %" PRIu64 "ms.",
-					elapsed_ms);
-				sr_spew("RX count %zu, packet len %zu.",
-					fill_idx, packet_size);
-				*buflen = fill_idx;
-				if (return_size)
-					*return_size = packet_size;
-				return SR_OK;
+				break;
 			}
 			/* Not a valid packet. Continue searching. */
-			sr_spew("Invalid packet, advancing read pointer.");
+			sr_spew("Invalid packet, advancing read pos.");
 			check_idx++;
 		}
 
+		elapsed_ms = g_get_monotonic_time() - start_us;
+		elapsed_ms /= 1000;
+		if (pkt_len) {
+			/*
+			 * Exact match. Terminate with success. Keep data
+			 * which was received after the packet for the
+			 * caller's next reads.
+			 */
+			pkt_len = MIN(pkt_len, fill_idx - check_idx);
+			sr_spew("Valid packet after %" PRIu64 "ms.", elapsed_ms);
+			sr_spew("RX count %zu, packet len %zu.",
+				check_idx + pkt_len, pkt_len);
+			serial_unread(serial, &buf[check_idx + pkt_len],
+				fill_idx - check_idx - pkt_len);
+			*buflen = check_idx + pkt_len;
+			if (return_size)
+				*return_size = pkt_len;
+			return SR_OK;
+		}
+
 		/* Check for packet search timeout. */
 		if (elapsed_ms >= timeout_ms) {
 			sr_dbg("Detection timed out after %" PRIu64 "ms.",
 				elapsed_ms);
 			break;
 		}
-		if (recv_len < 1)
-			g_usleep(byte_delay_us);
+		if (fill_idx >= max_fill_idx)
+			break;
+
+		/*
+		 * Wait for more data, and take what is available when
+		 * it comes in.
+		 */
+		recv_len = serial_read_blocking(serial, &buf[fill_idx], 1,
+			timeout_ms - elapsed_ms);
+		if (recv_len < 0)
+			break;
+		if (recv_len > 0)
+			fill_idx += recv_len;
+		if (recv_len > 0 && fill_idx < max_fill_idx) {
+			recv_len = serial_read_nonblocking(serial,
+				&buf[fill_idx], max_fill_idx - fill_idx);
+			if (recv_len > 0)
+				fill_idx += recv_len;
+		}
 	}
 	sr_info("Didn't find a valid packet (read %zu bytes).", fill_idx);
 	*buflen = fill_idx;
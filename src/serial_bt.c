@@ -38,6 +38,13 @@
 #define SER_BT_PARAM_PREFIX_HDL_CCCD	"handle_cccd="
 #define SER_BT_PARAM_PREFIX_VAL_CCCD	"value_cccd="
 #define SER_BT_PARAM_PREFIX_BLE_MTU	"mtu="
+#define SER_BT_PARAM_PREFIX_INTERVAL	"conn_interval="
+#define SER_BT_PARAM_PREFIX_MTU_XCHG	"mtu_exchange="
+#define SER_BT_PARAM_PREFIX_BATCH	"batch="
+
+/* BLE connection interval limits, in units of 1.25ms. */
+#define SER_BT_INTERVAL_MIN	6
+#define SER_BT_INTERVAL_MAX	3200
 
 /**
  * @file
@@ -156,6 +163,11 @@ static const char *conn_name_text(enum ser_bt_conn_t type)
  * @param[out] write_hdl The BLE notify write handle (if applicable).
  * @param[out] cccd_hdl The BLE notify CCCD handle (if applicable).
  * @param[out] cccd_val The BLE notify CCCD value (if applicable).
+ * @param[out] ble_mtu The BLE ATT MTU (if applicable).
+ * @param[out] conn_interval The BLE connection interval to request,
+ *             in units of 1.25ms, 0 to keep the default.
+ * @param[out] mtu_exchange Whether to start an MTU exchange.
+ * @param[out] batch Whether to pass pending notifications on at once.
  *
  * @return 0 upon success, non-zero upon failure.
  *
@@ -174,6 +186,10 @@ static const char *conn_name_text(enum ser_bt_conn_t type)
  *   get derived from the connection type.
  * - More fields after the remote address are options which override
  *   builtin defaults (RFCOMM channels, BLE handles, etc).
+ * - BLE throughput options: conn_interval= requests a connection
+ *   interval (units of 1.25ms, which takes privileges with BlueZ),
+ *   mtu_exchange=1 asks the peripheral for the mtu= value or a larger
+ *   default ATT MTU, batch=0 passes each notification on separately.
  *
  * Supported formats resulting from these rules:
  *   bt/<conn>/<addr>[/<param>]...
@@ -183,6 +199,7 @@ static const char *conn_name_text(enum ser_bt_conn_t type)
  *   bt/rfcomm/11-22-33-44-55-66/channel=2
  *   bt/ble122/88:6b:12:34:56:78
  *   bt/cc254x/0123456789ab
+ *   bt/dialog/0123456789ab/conn_interval=6/mtu_exchange=1
  *
  * It's assumed that users easily can create those conn= specs from
  * available information, or that scan routines will create such specs
@@ -195,7 +212,8 @@ static int ser_bt_parse_conn_spec(
 	size_t *rfcomm_channel,
 	uint16_t *read_hdl, uint16_t *write_hdl,
 	uint16_t *cccd_hdl, uint16_t *cccd_val,
-	uint16_t *ble_mtu)
+	uint16_t *ble_mtu, uint16_t *conn_interval,
+	gboolean *mtu_exchange, gboolean *batch)
 {
 	char **fields, *field;
 	enum ser_bt_conn_t type;
@@ -221,6 +239,12 @@ static int ser_bt_parse_conn_spec(
 		*cccd_val = 0;
 	if (ble_mtu)
 		*ble_mtu = 0;
+	if (conn_interval)
+		*conn_interval = 0;
+	if (mtu_exchange)
+		*mtu_exchange = FALSE;
+	if (batch)
+		*batch = TRUE;
 
 	if (!serial || !spec || !spec[0])
 		return SR_ERR_ARG;
@@ -413,6 +437,32 @@ static int ser_bt_parse_conn_spec(
 				*ble_mtu = parm_val;
 			continue;
 		}
+		if (g_str_has_prefix(field, SER_BT_PARAM_PREFIX_INTERVAL)) {
+			field += strlen(SER_BT_PARAM_PREFIX_INTERVAL);
+			endp = NULL;
+			ret = sr_atoul_base(field, &parm_val, &endp, 0);
+			if (ret != SR_OK || !endp || *endp != '\0' ||
+					parm_val < SER_BT_INTERVAL_MIN ||
+					parm_val > SER_BT_INTERVAL_MAX) {
+				ret_parse = SR_ERR_ARG;
+				break;
+			}
+			if (conn_interval)
+				*conn_interval = parm_val;
+			continue;
+		}
+		if (g_str_has_prefix(field, SER_BT_PARAM_PREFIX_MTU_XCHG)) {
+			field += strlen(SER_BT_PARAM_PREFIX_MTU_XCHG);
+			if (mtu_exchange)
+				*mtu_exchange = sr_parse_boolstring(field);
+			continue;
+		}
+		if (g_str_has_prefix(field, SER_BT_PARAM_PREFIX_BATCH)) {
+			field += strlen(SER_BT_PARAM_PREFIX_BATCH);
+			if (batch)
+				*batch = sr_parse_boolstring(field);
+			continue;
+		}
 		return SR_ERR_DATA;
 	}
 
@@ -487,7 +537,8 @@ static int ser_bt_open(struct sr_serial_dev_inst *serial, int flags)
 	const char *remote_addr;
 	size_t rfcomm_channel;
 	uint16_t read_hdl, write_hdl, cccd_hdl, cccd_val;
-	uint16_t ble_mtu;
+	uint16_t ble_mtu, conn_interval;
+	gboolean mtu_exchange, batch;
 	int rc;
 	struct sr_bt_desc *desc;
 
@@ -499,7 +550,8 @@ static int ser_bt_open(struct sr_serial_dev_inst *serial, int flags)
 			&rfcomm_channel,
 			&read_hdl, &write_hdl,
 			&cccd_hdl, &cccd_val,
-			&ble_mtu);
+			&ble_mtu, &conn_interval,
+			&mtu_exchange, &batch);
 	if (rc != SR_OK)
 		return SR_ERR_ARG;
 
@@ -535,6 +587,11 @@ static int ser_bt_open(struct sr_serial_dev_inst *serial, int flags)
 			ble_mtu);
 		if (rc < 0)
 			return SR_ERR;
+		/* The RX path takes a byte stream, notifications can merge. */
+		rc = sr_bt_config_throughput(desc,
+			conn_interval, mtu_exchange, batch);
+		if (rc < 0)
+			return SR_ERR;
 		serial->bt_notify_handle_read = read_hdl;
 		serial->bt_notify_handle_write = write_hdl;
 		serial->bt_notify_handle_cccd = cccd_hdl;
@@ -548,8 +605,7 @@ static int ser_bt_open(struct sr_serial_dev_inst *serial, int flags)
 	serial->bt_conn_type = conn_type;
 
 	/* Make sure the receive buffer can accept input data. */
-	if (!serial->rcv_buffer)
-		serial->rcv_buffer = g_string_sized_new(SER_BT_CHUNK_SIZE);
+	sr_ser_alloc_rx_queue(serial, SER_BT_CHUNK_SIZE);
 	rc = sr_bt_config_cb_data(desc, ser_bt_data_cb, serial);
 	if (rc < 0)
 		return SR_ERR;
@@ -69,6 +69,47 @@ static void ser_hid_mask_databits(struct sr_serial_dev_inst *serial,
 		data[idx] &= mask;
 }
 
+/*
+ * Drain the reports which the chip has pending, collect their payload
+ * and queue it as one block. Only the first read may wait for data,
+ * later reads don't block. The number of reports per call is limited,
+ * so that a continuous stream won't starve the main loop.
+ */
+#define SER_HID_DRAIN_REPORTS	64
+static int ser_hid_drain_rx(struct sr_serial_dev_inst *serial,
+	unsigned int timeout_ms)
+{
+	uint8_t buffer[16 * SER_HID_CHUNK_SIZE];
+	size_t fill, reports;
+	int rc, total;
+
+	fill = 0;
+	total = 0;
+	rc = 0;
+	for (reports = 0; reports < SER_HID_DRAIN_REPORTS; reports++) {
+		if (sizeof(buffer) - fill < SER_HID_CHUNK_SIZE) {
+			ser_hid_mask_databits(serial, buffer, fill);
+			sr_ser_queue_rx_data(serial, buffer, fill);
+			fill = 0;
+		}
+		rc = serial->hid_chip_funcs->read_bytes(serial,
+				&buffer[fill], SER_HID_CHUNK_SIZE, timeout_ms);
+		if (rc <= 0)
+			break;
+		fill += rc;
+		total += rc;
+		timeout_ms = 0;
+	}
+	if (fill) {
+		ser_hid_mask_databits(serial, buffer, fill);
+		sr_ser_queue_rx_data(serial, buffer, fill);
+	}
+	if (rc < 0 && !total)
+		return rc;
+
+	return total;
+}
+
 /* }}} */
 /* {{{ open/close/list/find HIDAPI connection, exchange HID requests and data */
 
@@ -437,25 +478,18 @@ struct hidapi_source_args_t {
 static int hidapi_source_cb(int fd, int revents, void *cb_data)
 {
 	struct hidapi_source_args_t *args;
-	uint8_t rx_buf[SER_HID_CHUNK_SIZE];
 	int rc;
 
 	args = cb_data;
 
 	/*
 	 * Drain receive data which the chip might have pending. This is
-	 * "a copy" of the "background part" of ser_hid_read(), without
-	 * the timeout support code, and not knowing how much data the
-	 * application is expecting.
+	 * the "background part" of ser_hid_read(), without the timeout
+	 * support code, and not knowing how much data the application
+	 * is expecting. All pending reports get collected, such that
+	 * the application callback runs once per batch.
 	 */
-	do {
-		rc = args->serial->hid_chip_funcs->read_bytes(args->serial,
-				rx_buf, sizeof(rx_buf), 0);
-		if (rc > 0) {
-			ser_hid_mask_databits(args->serial, rx_buf, rc);
-			sr_ser_queue_rx_data(args->serial, rx_buf, rc);
-		}
-	} while (rc > 0);
+	(void)ser_hid_drain_rx(args->serial, 0);
 
 	/*
 	 * When RX data became available (now or earlier), pass this
@@ -1132,8 +1166,7 @@ static int ser_hid_open(struct sr_serial_dev_inst *serial, int flags)
 		return SR_ERR_IO;
 	}
 
-	if (!serial->rcv_buffer)
-		serial->rcv_buffer = g_string_sized_new(SER_HID_CHUNK_SIZE);
+	sr_ser_alloc_rx_queue(serial, SER_HID_CHUNK_SIZE);
 
 	return SR_OK;
 }
@@ -1249,7 +1282,6 @@ static int ser_hid_read(struct sr_serial_dev_inst *serial,
 	int nonblocking, unsigned int timeout_ms)
 {
 	gint64 deadline_us, now_us;
-	uint8_t buffer[SER_HID_CHUNK_SIZE];
 	int rc;
 	unsigned int got;
 
@@ -1306,27 +1338,20 @@ static int ser_hid_read(struct sr_serial_dev_inst *serial,
 
 		/*
 		 * Check the HID transport for the availability of more
-		 * receive data.
+		 * receive data. Drains all reports which are pending.
 		 */
-		rc = serial->hid_chip_funcs->read_bytes(serial,
-				buffer, sizeof(buffer), timeout_ms);
+		rc = ser_hid_drain_rx(serial, timeout_ms);
 		if (rc < 0) {
 			sr_dbg("DBG: %s() read error %d.", __func__, rc);
 			return SR_ERR;
 		}
-		if (rc) {
-			ser_hid_mask_databits(serial, buffer, rc);
-			sr_ser_queue_rx_data(serial, buffer, rc);
-		}
 		got = sr_ser_has_queued_data(serial);
 
 		/*
 		 * Stop reading when the requested amount is available,
-		 * or when the timeout has expired.
-		 *
-		 * TODO Consider whether grabbing all RX data is more
-		 * desirable. Implementing this approach requires a cheap
-		 * check for the availability of more data on the USB level.
+		 * or when the timeout has expired. Reception above has
+		 * grabbed all pending reports, not just the requested
+		 * amount of data.
 		 */
 		if (got >= count)
 			break;
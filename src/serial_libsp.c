@@ -30,6 +30,12 @@
 #ifdef G_OS_WIN32
 #include <windows.h> /* for HANDLE */
 #endif
+#ifdef __linux__
+#include <errno.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#endif
 
 #define LOG_PREFIX "serial-libsp"
 
@@ -311,6 +317,94 @@ static int sr_ser_libsp_set_handshake(struct sr_serial_dev_inst *serial,
 	return SR_OK;
 }
 
+#ifdef __linux__
+/* FTDI latency timer in ms, for low latency mode and the default. */
+#define FTDI_LATENCY_LOW	1
+#define FTDI_LATENCY_DEFAULT	16
+
+/*
+ * The ftdi_sio driver exposes the chip's latency timer in sysfs. Writing
+ * it needs permission, which udev rules commonly grant to the group that
+ * may access the tty. Other USB serial drivers lack the attribute.
+ */
+static int set_ftdi_latency_timer(const char *port, int ms)
+{
+	char *name, *path;
+	FILE *f;
+	int ret;
+
+	name = g_path_get_basename(port);
+	path = g_strdup_printf("/sys/class/tty/%s/device/latency_timer", name);
+	g_free(name);
+
+	ret = SR_ERR_NA;
+	f = fopen(path, "w");
+	if (!f) {
+		if (errno != ENOENT)
+			sr_dbg("Cannot write %s: %s.", path, g_strerror(errno));
+	} else {
+		ret = fprintf(f, "%d\n", ms) > 0 ? SR_OK : SR_ERR;
+		if (fclose(f) != 0)
+			ret = SR_ERR;
+		if (ret == SR_OK)
+			sr_dbg("Latency timer of %s set to %d ms.", port, ms);
+	}
+	g_free(path);
+
+	return ret;
+}
+#endif
+
+static int sr_ser_libsp_set_low_latency(struct sr_serial_dev_inst *serial,
+	gboolean on)
+{
+#ifdef __linux__
+	struct serial_struct info;
+	int fd, ret, timer_ret;
+
+	if (!serial->sp_data) {
+		sr_dbg("Cannot configure unopened serial port %s.", serial->port);
+		return SR_ERR;
+	}
+	if (sp_get_port_handle(serial->sp_data, &fd) != SP_OK)
+		return SR_ERR;
+
+	/*
+	 * Drivers which honour ASYNC_LOW_LATENCY skip the tty layer's
+	 * deferred processing of receive data. Not all drivers support
+	 * the request, and not all of them forward it to the chip.
+	 */
+	ret = SR_ERR_NA;
+	if (ioctl(fd, TIOCGSERIAL, &info) == 0) {
+		if (on)
+			info.flags |= ASYNC_LOW_LATENCY;
+		else
+			info.flags &= ~ASYNC_LOW_LATENCY;
+		if (ioctl(fd, TIOCSSERIAL, &info) == 0)
+			ret = SR_OK;
+		else
+			sr_dbg("Cannot set ASYNC_LOW_LATENCY on %s: %s.",
+				serial->port, g_strerror(errno));
+	}
+
+	timer_ret = set_ftdi_latency_timer(serial->port,
+		on ? FTDI_LATENCY_LOW : FTDI_LATENCY_DEFAULT);
+	if (timer_ret == SR_OK)
+		ret = SR_OK;
+
+	if (ret == SR_OK)
+		sr_info("Low latency mode %s on %s.",
+			on ? "enabled" : "disabled", serial->port);
+
+	return ret;
+#else
+	(void)serial;
+	(void)on;
+
+	return SR_ERR_NA;
+#endif
+}
+
 #ifdef G_OS_WIN32
 typedef HANDLE event_handle;
 #else
@@ -526,6 +620,7 @@ static struct ser_lib_functions serlib_sp = {
 	.read = sr_ser_libsp_read,
 	.set_params = sr_ser_libsp_set_params,
 	.set_handshake = sr_ser_libsp_set_handshake,
+	.set_low_latency = sr_ser_libsp_set_low_latency,
 	.setup_source_add = sr_ser_libsp_source_add,
 	.setup_source_remove = sr_ser_libsp_source_remove,
 	.list = sr_ser_libsp_list,
@@ -0,0 +1,495 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Scheduler for serial instruments which are polled: a request gets
+ * sent, and a reply comes back some time later. All such devices of a
+ * session (of a worker thread in threaded sessions) share one event
+ * source, which wakes up when the next request is due or a reply timed
+ * out. Replies are taken from each port's own receive source as they
+ * come in. Nothing ever waits for the device, so one slow instrument
+ * doesn't hold up the requests to the others.
+ *
+ * Requests are due at fixed multiples of the poll interval after the
+ * device was added. A request gets sent when its slot came and the
+ * previous reply is in (or timed out), slots which passed meanwhile
+ * are skipped. How late requests went out is kept as statistics.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "serial-poll"
+/** @endcond */
+
+/* Receive sources also fire this often, for transports without fds. */
+#define RX_CHECK_MS 10
+
+struct serial_poll_dev {
+	struct serial_poller *poller;
+	struct sr_serial_dev_inst *serial;
+	const struct sr_serial_poll_ops *ops;
+	void *cb_data;
+	int64_t interval_us;
+	int64_t timeout_us;
+	int64_t due_us;
+	int64_t sent_us;
+	gboolean pending;
+	gboolean removed;
+	struct sr_serial_poll_stats stats;
+	int64_t jitter_sum_us;
+};
+
+struct serial_poller {
+	struct sr_session *session;
+	GMainContext *context;
+	GSList *devs;
+	/* Devices only get removed from the list outside of callbacks. */
+	int busy;
+	gboolean sweep;
+};
+
+struct poll_source {
+	GSource base;
+	struct serial_poller *poller;
+};
+
+/* The next point in time at which the scheduler has work to do. */
+static int64_t next_deadline(const struct serial_poller *poller)
+{
+	const struct serial_poll_dev *pdev;
+	const GSList *l;
+	int64_t deadline;
+
+	deadline = INT64_MAX;
+	for (l = poller->devs; l; l = l->next) {
+		pdev = l->data;
+		if (pdev->removed)
+			continue;
+		if (pdev->pending)
+			deadline = MIN(deadline, pdev->sent_us + pdev->timeout_us);
+		else
+			deadline = MIN(deadline, pdev->due_us);
+	}
+
+	return deadline;
+}
+
+static void log_stats(const struct serial_poll_dev *pdev)
+{
+	const struct sr_serial_poll_stats *st;
+
+	st = &pdev->stats;
+	sr_dbg("%s: %" PRIu64 " requests, %" PRIu64 " replies, %" PRIu64
+		" timeouts, %" PRIu64 " skipped.", pdev->serial->port,
+		st->requests, st->replies, st->timeouts, st->skipped);
+	if (st->requests)
+		sr_dbg("%s: jitter min %" PRId64 "us, max %" PRId64
+			"us, mean %" PRId64 "us.", pdev->serial->port,
+			st->jitter_min_us, st->jitter_max_us,
+			st->jitter_mean_us);
+}
+
+static void free_dev(struct serial_poll_dev *pdev)
+{
+	log_stats(pdev);
+	g_free(pdev);
+}
+
+static void destroy_poller(struct serial_poller *poller)
+{
+	GSList **pollers;
+
+	pollers = &poller->session->serial_pollers;
+	g_rec_mutex_lock(&poller->session->sources_mutex);
+	*pollers = g_slist_remove(*pollers, poller);
+	g_rec_mutex_unlock(&poller->session->sources_mutex);
+
+	/* The source's finalize() frees the poller. */
+	sr_session_source_remove_internal(poller->session, poller);
+}
+
+/* Drop the devices which were removed while callbacks ran. */
+static void sweep_devs(struct serial_poller *poller)
+{
+	struct serial_poll_dev *pdev;
+	GSList *l, *next;
+
+	if (poller->busy || !poller->sweep)
+		return;
+	poller->sweep = FALSE;
+
+	for (l = poller->devs; l; l = next) {
+		next = l->next;
+		pdev = l->data;
+		if (!pdev->removed)
+			continue;
+		poller->devs = g_slist_delete_link(poller->devs, l);
+		free_dev(pdev);
+	}
+	if (!poller->devs)
+		destroy_poller(poller);
+}
+
+static void update_jitter(struct serial_poll_dev *pdev, int64_t late_us)
+{
+	struct sr_serial_poll_stats *st;
+
+	st = &pdev->stats;
+	if (!st->requests || late_us < st->jitter_min_us)
+		st->jitter_min_us = late_us;
+	if (!st->requests || late_us > st->jitter_max_us)
+		st->jitter_max_us = late_us;
+	st->requests++;
+	pdev->jitter_sum_us += late_us;
+	st->jitter_mean_us = pdev->jitter_sum_us / (int64_t)st->requests;
+}
+
+static void run_dev(struct serial_poll_dev *pdev, int64_t now_us)
+{
+	int64_t slots;
+
+	if (pdev->pending) {
+		if (now_us < pdev->sent_us + pdev->timeout_us)
+			return;
+		sr_spew("%s: Reply timed out.", pdev->serial->port);
+		pdev->pending = FALSE;
+		pdev->stats.timeouts++;
+		if (pdev->ops->timeout)
+			pdev->ops->timeout(pdev->serial, pdev->cb_data);
+		if (pdev->removed)
+			return;
+	}
+	if (now_us < pdev->due_us)
+		return;
+
+	update_jitter(pdev, now_us - pdev->due_us);
+	slots = (now_us - pdev->due_us) / pdev->interval_us;
+	pdev->stats.skipped += slots;
+	pdev->due_us += (slots + 1) * pdev->interval_us;
+
+	if (pdev->ops->request(pdev->serial, pdev->cb_data) != SR_OK)
+		return;
+	pdev->pending = TRUE;
+	pdev->sent_us = now_us;
+}
+
+static gboolean poll_source_prepare(GSource *source, int *timeout)
+{
+	struct poll_source *psource;
+	int64_t deadline, now_us;
+
+	psource = (struct poll_source *)source;
+	deadline = next_deadline(psource->poller);
+	if (deadline == INT64_MAX) {
+		*timeout = -1;
+		return FALSE;
+	}
+	now_us = g_source_get_time(source);
+	*timeout = (MAX(0, deadline - now_us) + 999) / 1000;
+
+	return deadline <= now_us;
+}
+
+static gboolean poll_source_check(GSource *source)
+{
+	struct poll_source *psource;
+
+	psource = (struct poll_source *)source;
+
+	return next_deadline(psource->poller) <= g_source_get_time(source);
+}
+
+static gboolean poll_source_dispatch(GSource *source,
+		GSourceFunc callback, void *user_data)
+{
+	struct poll_source *psource;
+	struct serial_poller *poller;
+	GSList *l;
+	int64_t now_us;
+
+	(void)callback;
+	(void)user_data;
+
+	psource = (struct poll_source *)source;
+	poller = psource->poller;
+	now_us = g_source_get_time(source);
+
+	poller->busy++;
+	for (l = poller->devs; l; l = l->next) {
+		if (!((struct serial_poll_dev *)l->data)->removed)
+			run_dev(l->data, now_us);
+	}
+	poller->busy--;
+	sweep_devs(poller);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void poll_source_finalize(GSource *source)
+{
+	struct poll_source *psource;
+
+	psource = (struct poll_source *)source;
+
+	sr_session_source_destroyed(psource->poller->session,
+		psource->poller, source);
+	g_free(psource->poller);
+}
+
+static struct serial_poller *get_poller(struct sr_session *session)
+{
+	static GSourceFuncs poll_source_funcs = {
+		.prepare  = &poll_source_prepare,
+		.check    = &poll_source_check,
+		.dispatch = &poll_source_dispatch,
+		.finalize = &poll_source_finalize
+	};
+	struct serial_poller *poller;
+	struct poll_source *psource;
+	GSource *source;
+	GMainContext *context;
+	GSList *l;
+	int ret;
+
+	context = sr_session_worker_context(session);
+
+	g_rec_mutex_lock(&session->sources_mutex);
+	for (l = session->serial_pollers; l; l = l->next) {
+		poller = l->data;
+		if (poller->context == context) {
+			g_rec_mutex_unlock(&session->sources_mutex);
+			return poller;
+		}
+	}
+
+	poller = g_malloc0(sizeof(*poller));
+	poller->session = session;
+	poller->context = context;
+
+	source = g_source_new(&poll_source_funcs, sizeof(struct poll_source));
+	g_source_set_name(source, "serial-poll");
+	psource = (struct poll_source *)source;
+	psource->poller = poller;
+
+	ret = sr_session_source_add_internal(session, poller, source);
+	g_source_unref(source);
+	if (ret != SR_OK) {
+		g_rec_mutex_unlock(&session->sources_mutex);
+		return NULL;
+	}
+	session->serial_pollers = g_slist_append(session->serial_pollers,
+		poller);
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	return poller;
+}
+
+static struct serial_poll_dev *find_dev(struct sr_session *session,
+		struct sr_serial_dev_inst *serial)
+{
+	struct serial_poller *poller;
+	struct serial_poll_dev *pdev;
+	GSList *l, *d;
+
+	g_rec_mutex_lock(&session->sources_mutex);
+	for (l = session->serial_pollers; l; l = l->next) {
+		poller = l->data;
+		for (d = poller->devs; d; d = d->next) {
+			pdev = d->data;
+			if (pdev->serial == serial && !pdev->removed) {
+				g_rec_mutex_unlock(&session->sources_mutex);
+				return pdev;
+			}
+		}
+	}
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	return NULL;
+}
+
+static int receive_data(int fd, int revents, void *cb_data)
+{
+	struct serial_poll_dev *pdev;
+	struct serial_poller *poller;
+	gboolean done;
+
+	(void)fd;
+	(void)revents;
+
+	pdev = cb_data;
+	poller = pdev->poller;
+	if (pdev->removed)
+		return TRUE;
+
+	/* Take data which arrives unasked too, the source fires until then. */
+	poller->busy++;
+	done = pdev->ops->receive(pdev->serial, pdev->cb_data);
+	if (done && pdev->pending) {
+		pdev->pending = FALSE;
+		pdev->stats.replies++;
+	}
+	poller->busy--;
+	sweep_devs(poller);
+
+	return TRUE;
+}
+
+/**
+ * Poll a serial device through the session's scheduler.
+ *
+ * The first request goes out right away, later ones at the given
+ * interval. A request is only sent when the reply to the previous one
+ * came in or timed out. The ops->request() callback should write with
+ * serial_write_nonblocking(), ops->receive() should take what data is
+ * there with serial_read_nonblocking() and tell whether the reply is
+ * complete. The optional ops->timeout() callback is called when a reply
+ * didn't come in time.
+ *
+ * The callbacks may call sr_serial_poll_remove() for their own device,
+ * when the acquisition stops.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param serial Previously initialized serial port structure.
+ * @param interval_us Time between requests in microseconds, must not be 0.
+ * @param timeout_us Time to wait for a reply in microseconds, must not be 0.
+ * @param ops Callbacks for requests and replies. Must not be NULL.
+ * @param cb_data Data for the callbacks.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Failure to add the sources.
+ *
+ * @private
+ */
+SR_PRIV int sr_serial_poll_add(struct sr_session *session,
+		struct sr_serial_dev_inst *serial,
+		uint64_t interval_us, uint64_t timeout_us,
+		const struct sr_serial_poll_ops *ops, void *cb_data)
+{
+	struct serial_poller *poller;
+	struct serial_poll_dev *pdev;
+	int ret;
+
+	if (!session || !serial || !interval_us || !timeout_us || !ops
+			|| !ops->request || !ops->receive)
+		return SR_ERR_ARG;
+	if (find_dev(session, serial)) {
+		sr_err("%s: Already polled.", serial->port);
+		return SR_ERR_ARG;
+	}
+
+	poller = get_poller(session);
+	if (!poller)
+		return SR_ERR;
+
+	pdev = g_malloc0(sizeof(*pdev));
+	pdev->poller = poller;
+	pdev->serial = serial;
+	pdev->ops = ops;
+	pdev->cb_data = cb_data;
+	pdev->interval_us = interval_us;
+	pdev->timeout_us = timeout_us;
+	pdev->due_us = g_get_monotonic_time();
+
+	ret = serial_source_add(session, serial, G_IO_IN, RX_CHECK_MS,
+		receive_data, pdev);
+	if (ret != SR_OK) {
+		g_free(pdev);
+		if (!poller->devs)
+			destroy_poller(poller);
+		return ret;
+	}
+	poller->devs = g_slist_append(poller->devs, pdev);
+	sr_dbg("%s: Polled every %" PRIu64 "us.", serial->port, interval_us);
+
+	/* Have the new deadline looked at. */
+	g_main_context_wakeup(poller->context
+		? poller->context : session->main_context);
+
+	return SR_OK;
+}
+
+/**
+ * Stop polling a serial device.
+ *
+ * Logs the statistics of the device's requests.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param serial The serial port which was passed to sr_serial_poll_add().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the device is not polled.
+ *
+ * @private
+ */
+SR_PRIV int sr_serial_poll_remove(struct sr_session *session,
+		struct sr_serial_dev_inst *serial)
+{
+	struct serial_poll_dev *pdev;
+	struct serial_poller *poller;
+
+	if (!session || !serial)
+		return SR_ERR_ARG;
+	pdev = find_dev(session, serial);
+	if (!pdev) {
+		sr_err("%s: Not polled.", serial->port);
+		return SR_ERR_ARG;
+	}
+
+	serial_source_remove(session, serial);
+	pdev->removed = TRUE;
+	poller = pdev->poller;
+	poller->sweep = TRUE;
+	sweep_devs(poller);
+
+	return SR_OK;
+}
+
+/**
+ * Get the statistics of a polled serial device.
+ *
+ * The jitter is how late requests were sent after they were due.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param serial The serial port which was passed to sr_serial_poll_add().
+ * @param stats The statistics get stored here. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the device is not polled.
+ *
+ * @private
+ */
+SR_PRIV int sr_serial_poll_get_stats(struct sr_session *session,
+		struct sr_serial_dev_inst *serial,
+		struct sr_serial_poll_stats *stats)
+{
+	struct serial_poll_dev *pdev;
+
+	if (!session || !serial || !stats)
+		return SR_ERR_ARG;
+	pdev = find_dev(session, serial);
+	if (!pdev)
+		return SR_ERR_ARG;
+
+	*stats = pdev->stats;
+
+	return SR_OK;
+}
@@ -51,6 +51,7 @@
  * @param[in] spec The caller provided conn= specification.
  * @param[out] host_ref Pointer to host name or IP addr (text string).
  * @param[out] port_ref Pointer to a TCP port (text string).
+ * @param[out] opts Socket options, updated from trailing fields.
  *
  * @return 0 upon success, non-zero upon failure. Fills the *_ref output
  * values.
@@ -61,21 +62,19 @@
  *   mandatory.
  * - Host name follows. It's a DNS name or an IP address.
  * - TCP port follows. Can be a number or a "service" name.
- * - More than three fields are accepted, but currently don't take any
- *   effect. It's yet to be seen whether "options" or "variants" are
- *   needed or desired. For now any trailing fields are ignored. Cisco
- *   style serial-over-TCP as seen in ser2net(1) comes to mind (which
- *   includes configuration and control beyond data transmission). But
- *   its spec is rather involved, and ser2net can already derive COM
- *   port configurations from TCP port numbers, so it's not a blocker.
- *   That variant probably should go under a different name anyway.
+ * - Socket options can follow, see sr_tcp_parse_options(). Cisco style
+ *   serial-over-TCP as seen in ser2net(1) is not supported (which
+ *   includes configuration and control beyond data transmission). Its
+ *   spec is rather involved, and ser2net can already derive COM port
+ *   configurations from TCP port numbers, so it's not a blocker. That
+ *   variant probably should go under a different name anyway.
  *
  * Supported format resulting from these rules:
- *   tcp-raw/<ipaddr>/<port>
+ *   tcp-raw/<ipaddr>/<port>[/<option>...]
  */
 static int ser_tcpraw_parse_conn_spec(
 	struct sr_serial_dev_inst *serial, const char *spec,
-	char **host_ref, char **port_ref)
+	char **host_ref, char **port_ref, struct sr_tcp_options *opts)
 {
 	char **fields;
 	size_t count;
@@ -112,9 +111,8 @@ static int ser_tcpraw_parse_conn_spec(
 		if (!port || !*port)
 			valid = FALSE;
 	}
-	/* Silently ignore trailing fields. Could be future options. */
-	if (count > 3)
-		sr_warn("Ignoring excess parameters in %s.", spec);
+	if (valid && sr_tcp_parse_options(opts, fields + 3) != SR_OK)
+		valid = FALSE;
 
 	if (valid) {
 		if (host_ref && host)
@@ -152,12 +150,17 @@ SR_PRIV int ser_name_is_tcpraw(struct sr_serial_dev_inst *serial)
 static int ser_tcpraw_open(struct sr_serial_dev_inst *serial, int flags)
 {
 	char *host, *port;
+	struct sr_tcp_options opts;
 	int ret;
 
 	(void)flags;
 
+	/* Request and response protocols, see scpi_tcp.c. */
+	memset(&opts, 0, sizeof(opts));
+	opts.nodelay = TRUE;
+	opts.connect_timeout_ms = SR_TCP_CONNECT_TIMEOUT_MS;
 	ret = ser_tcpraw_parse_conn_spec(serial, serial->port,
-			&host, &port);
+			&host, &port, &opts);
 	if (ret != SR_OK) {
 		g_free(host);
 		g_free(port);
@@ -168,6 +171,7 @@ static int ser_tcpraw_open(struct sr_serial_dev_inst *serial, int flags)
 	g_free(port);
 	if (!serial->tcp_dev)
 		return SR_ERR_MALLOC;
+	serial->tcp_dev->opts = opts;
 
 	/*
 	 * Open the TCP socket. Only keep caller's parameters (and the
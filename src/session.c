@@ -51,6 +51,31 @@ struct datafeed_callback {
 	void *cb_data;
 };
 
+struct abort_hook {
+	const struct sr_dev_inst *sdi;
+	sr_session_abort_hook hook;
+};
+
+struct sr_buffer {
+	gint refcount;
+	void *data;
+	size_t size;
+	sr_buffer_release_callback release;
+	void *cb_data;
+};
+
+/*
+ * The packets being sent with a buffer by this thread, innermost first.
+ * Lets sr_packet_buffer_ref() find the buffer from within a callback.
+ */
+struct buffer_dispatch {
+	const struct sr_datafeed_packet *packet;
+	struct sr_buffer *buf;
+	struct buffer_dispatch *outer;
+};
+
+static GPrivate buffer_dispatch_key;
+
 /** Custom GLib event source for generic descriptor I/O.
  * @see https://developer.gnome.org/glib/stable/glib-The-Main-Event-Loop.html
  */
@@ -118,16 +143,29 @@ static gboolean fd_source_dispatch(GSource *source,
 	struct fd_source *fsource;
 	unsigned int revents;
 	gboolean keep;
+	int64_t start_us, ready_us;
 
 	fsource = (struct fd_source *)source;
 	revents = fsource->pollfd.revents;
+	start_us = 0;
 
 	if (!callback) {
 		sr_err("Callback not set, cannot dispatch event.");
 		return G_SOURCE_REMOVE;
 	}
+	/* Woken up by sr_session_source_wake(). */
+	if (G_UNLIKELY(g_source_get_ready_time(source) >= 0))
+		g_source_set_ready_time(source, -1);
+	if (fsource->session->stats)
+		start_us = g_get_monotonic_time();
 	keep = (*SR_RECEIVE_DATA_CALLBACK(callback))
 			(fsource->pollfd.fd, revents, user_data);
+	if (fsource->session->stats) {
+		/* Ready after the poll, or when the timeout expired. */
+		ready_us = revents ? g_source_get_time(source) : fsource->due_us;
+		sr_session_stats_source(fsource->session, start_us - ready_us,
+			g_get_monotonic_time() - start_us);
+	}
 
 	if (fsource->timeout_us >= 0 && G_LIKELY(keep)
 			&& G_LIKELY(!g_source_is_destroyed(source)))
@@ -225,6 +263,9 @@ SR_API int sr_session_new(struct sr_context *ctx,
 	session->ctx = ctx;
 
 	g_mutex_init(&session->main_mutex);
+	g_mutex_init(&session->abort_mutex);
+	g_rec_mutex_init(&session->sources_mutex);
+	g_rec_mutex_init(&session->send_mutex);
 
 	/* To maintain API compatibility, we need a lookup table
 	 * which maps poll_object IDs to GSource* pointers.
@@ -258,9 +299,20 @@ SR_API int sr_session_destroy(struct sr_session *session)
 	g_slist_free_full(session->owned_devs, (GDestroyNotify)sr_dev_inst_free);
 
 	sr_session_datafeed_callback_remove_all(session);
+	sr_session_coalesce_free(session);
+	sr_session_dispatch_free(session);
+	sr_session_stats_destroy(session);
+	sr_session_chanstats_destroy(session);
+	sr_session_overview_free(session);
+	sr_session_store_free(session);
+	sr_session_frames_free(session);
 
 	g_hash_table_unref(session->event_sources);
+	g_slist_free_full(session->abort_hooks, g_free);
 
+	g_rec_mutex_clear(&session->send_mutex);
+	g_rec_mutex_clear(&session->sources_mutex);
+	g_mutex_clear(&session->abort_mutex);
 	g_mutex_clear(&session->main_mutex);
 
 	g_free(session);
@@ -475,6 +527,12 @@ SR_API int sr_session_datafeed_callback_remove_all(struct sr_session *session)
  *           Must not be NULL.
  * @param cb_data Opaque pointer passed in by the caller.
  *
+ * The callback runs on the thread which sent the packet, which need not
+ * be the one running the session's main loop (drivers may send from a
+ * USB event or worker thread), or on the dispatch thread when
+ * sr_session_dispatch_async_set() enabled it. Calls for one session
+ * never overlap.
+ *
  * @retval SR_OK Success.
  * @retval SR_ERR_BUG No session exists.
  *
@@ -505,6 +563,45 @@ SR_API int sr_session_datafeed_callback_add(struct sr_session *session,
 	return SR_OK;
 }
 
+/**
+ * Remove a datafeed callback from a session.
+ *
+ * Must not be called while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param cb The callback, as it was added.
+ * @param cb_data The opaque pointer, as it was added.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG No such callback.
+ * @retval SR_ERR_BUG No session exists.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_datafeed_callback_remove(struct sr_session *session,
+		sr_datafeed_callback cb, void *cb_data)
+{
+	struct datafeed_callback *cb_struct;
+	GSList *l;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	for (l = session->datafeed_callbacks; l; l = l->next) {
+		cb_struct = l->data;
+		if (cb_struct->cb != cb || cb_struct->cb_data != cb_data)
+			continue;
+		session->datafeed_callbacks = g_slist_delete_link(
+			session->datafeed_callbacks, l);
+		g_free(cb_struct);
+		return SR_OK;
+	}
+
+	return SR_ERR_ARG;
+}
+
 /**
  * Get the trigger assigned to this session.
  *
@@ -686,10 +783,18 @@ static gboolean delayed_stop_check(void *data)
 		return G_SOURCE_REMOVE;
 
 	/* New event sources may have been installed in the meantime. */
-	if (g_hash_table_size(session->event_sources) != 0)
+	g_rec_mutex_lock(&session->sources_mutex);
+	if (g_hash_table_size(session->event_sources) != 0) {
+		g_rec_mutex_unlock(&session->sources_mutex);
 		return G_SOURCE_REMOVE;
+	}
+	g_rec_mutex_unlock(&session->sources_mutex);
 
+	/* Everything sent so far gets delivered before the stop notice. */
+	sr_session_workers_stop(session);
+	sr_session_coalesce_stop(session);
 	session->running = FALSE;
+	sr_session_dispatch_stop(session);
 	unset_main_context(session);
 
 	sr_info("Stopped.");
@@ -718,7 +823,9 @@ static int stop_check_later(struct sr_session *session)
 	if (session->stop_check_id != 0)
 		return SR_OK; /* idle handler already installed */
 
+	/* Ahead of any device sources still busy with other sessions. */
 	source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_HIGH);
 	g_source_set_callback(source, &delayed_stop_check, session, NULL);
 
 	source_id = session_source_attach(session, source);
@@ -753,8 +860,7 @@ static int stop_check_later(struct sr_session *session)
 SR_API int sr_session_start(struct sr_session *session)
 {
 	struct sr_dev_inst *sdi;
-	struct sr_channel *ch;
-	GSList *l, *c, *lend;
+	GSList *l, *lend;
 	int ret;
 
 	if (!session) {
@@ -782,12 +888,9 @@ SR_API int sr_session_start(struct sr_session *session)
 	/* Check enabled channels and commit settings of all devices. */
 	for (l = session->devs; l; l = l->next) {
 		sdi = l->data;
-		for (c = sdi->channels; c; c = c->next) {
-			ch = c->data;
-			if (ch->enabled)
-				break;
-		}
-		if (!c) {
+		/* Drivers may have changed channels behind our back. */
+		sr_dev_channel_index_invalidate(sdi);
+		if (!sr_dev_channel_index(sdi)->num_enabled) {
 			sr_err("%s device %s has no enabled channels.",
 				sdi->driver->name, sdi->connection_id);
 			return SR_ERR;
@@ -808,6 +911,22 @@ SR_API int sr_session_start(struct sr_session *session)
 
 	sr_info("Starting.");
 
+	sr_session_stats_reset(session);
+	sr_session_chanstats_reset(session);
+	sr_session_overview_reset(session);
+	sr_session_store_reset(session);
+	sr_session_frames_reset(session);
+	ret = sr_session_dispatch_start(session);
+	if (ret == SR_OK) {
+		ret = sr_session_coalesce_start(session);
+		if (ret != SR_OK)
+			sr_session_dispatch_stop(session);
+	}
+	if (ret != SR_OK) {
+		unset_main_context(session);
+		return ret;
+	}
+
 	session->running = TRUE;
 
 	/* Have all devices start acquisition. */
@@ -817,32 +936,39 @@ SR_API int sr_session_start(struct sr_session *session)
 			ret = SR_ERR;
 			break;
 		}
-		ret = sr_dev_acquisition_start(sdi);
+		ret = sr_session_worker_dev_start(session, sdi);
 		if (ret != SR_OK) {
 			sr_err("Could not start %s device %s acquisition.",
 				sdi->driver->name, sdi->connection_id);
 			break;
 		}
 	}
+	if (ret == SR_OK)
+		ret = sr_session_workers_run(session);
 
 	if (ret != SR_OK) {
 		/* If there are multiple devices, some of them may already have
 		 * started successfully. Stop them now before returning. */
-		lend = l->next;
+		lend = l ? l->next : NULL;
 		for (l = session->devs; l != lend; l = l->next) {
 			sdi = l->data;
-			sr_dev_acquisition_stop(sdi);
+			sr_session_worker_dev_stop(session, sdi);
 		}
 		/* TODO: Handle delayed stops. Need to iterate the event
 		 * sources... */
+		sr_session_workers_stop(session);
+		sr_session_coalesce_stop(session);
 		session->running = FALSE;
+		sr_session_dispatch_stop(session);
 
 		unset_main_context(session);
 		return ret;
 	}
 
+	g_rec_mutex_lock(&session->sources_mutex);
 	if (g_hash_table_size(session->event_sources) == 0)
 		stop_check_later(session);
+	g_rec_mutex_unlock(&session->sources_mutex);
 
 	return SR_OK;
 }
@@ -914,7 +1040,7 @@ static gboolean session_stop_sync(void *user_data)
 
 	for (node = session->devs; node; node = node->next) {
 		sdi = node->data;
-		sr_dev_acquisition_stop(sdi);
+		sr_session_worker_dev_stop(session, sdi);
 	}
 
 	return G_SOURCE_REMOVE;
@@ -946,12 +1072,22 @@ static gboolean session_stop_sync(void *user_data)
 SR_API int sr_session_stop(struct sr_session *session)
 {
 	GMainContext *main_context;
+	struct abort_hook *ah;
+	GSList *l;
 
 	if (!session) {
 		sr_err("%s: session was NULL", __func__);
 		return SR_ERR_ARG;
 	}
 
+	/* Drivers get going right away, wherever the session runs. */
+	g_mutex_lock(&session->abort_mutex);
+	for (l = session->abort_hooks; l; l = l->next) {
+		ah = l->data;
+		ah->hook(ah->sdi);
+	}
+	g_mutex_unlock(&session->abort_mutex);
+
 	g_mutex_lock(&session->main_mutex);
 
 	main_context = (session->main_context)
@@ -1035,6 +1171,9 @@ static void datafeed_dump(const struct sr_datafeed_packet *packet)
 {
 	const struct sr_datafeed_logic *logic;
 	const struct sr_datafeed_analog *analog;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
+	const struct sr_datafeed_logic_packed *packed;
 
 	/* Please use the same order as in libsigrok.h. */
 	switch (packet->type) {
@@ -1066,6 +1205,25 @@ static void datafeed_dump(const struct sr_datafeed_packet *packet)
 		sr_dbg("bus: Received SR_DF_ANALOG packet (%d samples).",
 		       analog->num_samples);
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC_RLE packet (%" PRIu64 " samples, "
+		       "%" PRIu64 " runs, unitsize = %d).", rle->num_samples,
+		       rle->num_runs, rle->unitsize);
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC_PLANAR packet (%" PRIu64
+		       " samples, %d planes, unitsize = %d).",
+		       planar->num_samples, planar->num_planes,
+		       planar->unitsize);
+		break;
+	case SR_DF_LOGIC_PACKED:
+		packed = packet->payload;
+		sr_dbg("bus: Received SR_DF_LOGIC_PACKED packet (%" PRIu64
+		       " samples, %d bits per sample).", packed->num_samples,
+		       packed->bits_per_sample);
+		break;
 	default:
 		sr_dbg("bus: Received unknown packet type: %d.", packet->type);
 		break;
@@ -1103,58 +1261,123 @@ SR_PRIV int sr_session_send_meta(const struct sr_dev_inst *sdi,
 
 	ret = sr_session_send(sdi, &packet);
 	g_slist_free(meta.config);
+	sr_dev_config_changed(sdi, NULL, key, g_variant_ref(cfg->data));
 	sr_config_free(cfg);
 
 	return ret;
 }
 
-/**
- * Send a packet to whatever is listening on the datafeed bus.
- *
- * Hardware drivers use this to send a data packet to the frontend.
- *
- * @param sdi TODO.
- * @param packet The datafeed packet to send to the session bus.
- *
- * @retval SR_OK Success.
- * @retval SR_ERR_ARG Invalid argument.
- *
- * @private
+/* Bytes of logic data each fused transform runs over before the next. */
+#define TRANSFORM_TILE_SIZE	(32 * 1024)
+/* Most transforms to fuse at once, more get fused in groups. */
+#define TRANSFORM_FUSE_MAX	8
+
+/*
+ * Run transforms which change logic samples in place over the packet
+ * a tile at a time, starting at the transform in l. Returns how many
+ * transforms were run.
  */
-SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
-		const struct sr_datafeed_packet *packet)
+static unsigned int run_logic_tiles(struct sr_session *session, GSList *l,
+		unsigned int idx, const struct sr_datafeed_packet *packet)
 {
-	GSList *l;
-	struct datafeed_callback *cb_struct;
-	struct sr_datafeed_packet *packet_in, *packet_out;
-	struct sr_transform *t;
-	int ret;
-
-	if (!sdi) {
-		sr_err("%s: sdi was NULL", __func__);
-		return SR_ERR_ARG;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_transform *fused[TRANSFORM_FUSE_MAX];
+	int64_t elapsed[TRANSFORM_FUSE_MAX], start_us;
+	unsigned int num, i;
+	uint64_t tile, offset, len;
+	uint8_t *data;
+
+	for (num = 0; l && num < TRANSFORM_FUSE_MAX; l = l->next) {
+		fused[num] = l->data;
+		if (!fused[num]->module->logic_tile)
+			break;
+		elapsed[num++] = 0;
 	}
 
-	if (!packet) {
-		sr_err("%s: packet was NULL", __func__);
-		return SR_ERR_ARG;
+	logic = packet->payload;
+	data = logic->data;
+	tile = MAX(TRANSFORM_TILE_SIZE / logic->unitsize, 1) * logic->unitsize;
+	len = logic->length - logic->length % logic->unitsize;
+	start_us = 0;
+	for (offset = 0; offset < len; offset += tile) {
+		for (i = 0; i < num; i++) {
+			if (session->stats)
+				start_us = g_get_monotonic_time();
+			fused[i]->module->logic_tile(fused[i], data + offset,
+				MIN(tile, len - offset), logic->unitsize);
+			if (session->stats)
+				elapsed[i] += g_get_monotonic_time() - start_us;
+		}
 	}
-
-	if (!sdi->session) {
-		sr_err("%s: session was NULL", __func__);
-		return SR_ERR_BUG;
+	if (session->stats) {
+		for (i = 0; i < num; i++)
+			sr_session_stats_transform(session, idx + i, elapsed[i]);
 	}
 
+	return num;
+}
+
+/* Whether the transform in l and the next one can run tile by tile. */
+static gboolean fusable(const struct sr_datafeed_packet *packet, GSList *l)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_transform *t;
+
+	if (packet->type != SR_DF_LOGIC || !l->next)
+		return FALSE;
+	logic = packet->payload;
+	if (!logic->unitsize)
+		return FALSE;
+	t = l->data;
+	if (!t->module->logic_tile)
+		return FALSE;
+	t = l->next->data;
+
+	return t->module->logic_tile != NULL;
+}
+
+/*
+ * Runs the transforms from the one in l, which is number idx, and passes
+ * the packet on.
+ */
+static int run_transforms(const struct sr_dev_inst *sdi, GSList *l,
+		unsigned int idx, const struct sr_datafeed_packet *packet)
+{
+	struct sr_datafeed_packet *packet_in, *packet_out;
+	struct sr_transform *t;
+	unsigned int num;
+	int64_t start_us;
+	int ret;
+
+	start_us = 0;
+
 	/*
 	 * Pass the packet to the first transform module. If that returns
 	 * another packet (instead of NULL), pass that packet to the next
-	 * transform module in the list, and so on.
+	 * transform module in the list, and so on. Logic data goes through
+	 * neighbouring transforms which change it in place tile by tile.
 	 */
 	packet_in = (struct sr_datafeed_packet *)packet;
-	for (l = sdi->session->transforms; l; l = l->next) {
+	for (; l; l = l->next, idx++) {
+		if (fusable(packet_in, l)) {
+			/* Leave l at the last of them, for the loop to step on. */
+			SR_TRACE1(transform_tiles_entry, idx);
+			num = run_logic_tiles(sdi->session, l, idx, packet_in);
+			SR_TRACE2(transform_tiles_exit, idx, num);
+			l = g_slist_nth(l, num - 1);
+			idx += num - 1;
+			continue;
+		}
 		t = l->data;
 		sr_spew("Running transform module '%s'.", t->module->id);
+		if (sdi->session->stats)
+			start_us = g_get_monotonic_time();
+		SR_TRACE2(transform_entry, t->module->id, idx);
 		ret = t->module->receive(t, packet_in, &packet_out);
+		SR_TRACE3(transform_exit, t->module->id, idx, ret);
+		if (sdi->session->stats)
+			sr_session_stats_transform(sdi->session, idx,
+				g_get_monotonic_time() - start_us);
 		if (ret < 0) {
 			sr_err("Error while running transform module: %d.", ret);
 			return SR_ERR;
@@ -1178,16 +1401,292 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 
 	/*
 	 * If the last transform did output a packet, pass it to all datafeed
-	 * callbacks.
+	 * callbacks, possibly merged with others first.
 	 */
-	for (l = sdi->session->datafeed_callbacks; l; l = l->next) {
-		if (sr_log_loglevel_get() >= SR_LOG_DBG)
-			datafeed_dump(packet);
+	if (sdi->session->coalesce && sdi->session->running)
+		return sr_session_coalesce_push(sdi, packet);
+
+	return sr_session_deliver(sdi, packet);
+}
+
+/* Runs the transforms and passes the packet on. */
+static int session_send(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	if (sdi->session->stats)
+		sr_session_stats_packet(sdi->session, packet);
+
+	return run_transforms(sdi, sdi->session->transforms, 0, packet);
+}
+
+/**
+ * Send a packet of a transform's own, in addition to those it returns.
+ *
+ * The packet goes through the transforms after t and on to the datafeed
+ * callbacks, before the packet t is working on does. Call it from the
+ * transform's receive() only.
+ *
+ * @param t The transform. Must not be NULL.
+ * @param packet The packet. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other Error of a later transform or of the delivery.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_after(const struct sr_transform *t,
+		const struct sr_datafeed_packet *packet)
+{
+	GSList *l;
+	unsigned int idx;
+
+	if (!t || !t->sdi || !t->sdi->session || !packet)
+		return SR_ERR_ARG;
+
+	for (l = t->sdi->session->transforms, idx = 0; l; l = l->next, idx++) {
+		if (l->data == t)
+			return run_transforms(t->sdi, l->next, idx + 1, packet);
+	}
+
+	return SR_ERR_ARG;
+}
+
+/**
+ * Whether the session's consumers take SR_DF_LOGIC_RLE packets.
+ *
+ * Consumers opt in by running the rle transform first. Drivers may
+ * then send runs of values as they get them from the device, instead
+ * of expanding them to SR_DF_LOGIC.
+ *
+ * @param session The session, may be NULL.
+ *
+ * @return TRUE when SR_DF_LOGIC_RLE packets may be sent.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_session_takes_logic_rle(const struct sr_session *session)
+{
+	const struct sr_transform *t;
+
+	if (!session || !session->transforms)
+		return FALSE;
+	t = session->transforms->data;
+
+	return strcmp(t->module->id, "rle") == 0;
+}
+
+/**
+ * Whether the session's consumers take SR_DF_LOGIC_PLANAR packets.
+ *
+ * Consumers opt in by running the planar transform first. Drivers
+ * which get channel major data from the device may then pass it on
+ * without transposing it.
+ *
+ * @param session The session, may be NULL.
+ *
+ * @return TRUE when SR_DF_LOGIC_PLANAR packets may be sent.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_session_takes_logic_planar(const struct sr_session *session)
+{
+	const struct sr_transform *t;
+
+	if (!session || !session->transforms)
+		return FALSE;
+	t = session->transforms->data;
+
+	return strcmp(t->module->id, "planar") == 0;
+}
+
+/**
+ * Whether the session's consumers take SR_DF_LOGIC_PACKED packets.
+ *
+ * Consumers opt in by running the packed transform first. Drivers
+ * which get several samples to a byte from the device may then pass
+ * them on as they are.
+ *
+ * @param session The session, may be NULL.
+ *
+ * @return TRUE when SR_DF_LOGIC_PACKED packets may be sent.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_session_takes_logic_packed(const struct sr_session *session)
+{
+	const struct sr_transform *t;
+
+	if (!session || !session->transforms)
+		return FALSE;
+	t = session->transforms->data;
+
+	return strcmp(t->module->id, "packed") == 0;
+}
+
+/**
+ * Send a packet to whatever is listening on the datafeed bus.
+ *
+ * Hardware drivers use this to send a data packet to the frontend.
+ *
+ * @param sdi TODO.
+ * @param packet The datafeed packet to send to the session bus.
+ *
+ * Drivers may send from any thread, e.g. per-device worker threads or
+ * the USB event thread, not just the one running the session's main
+ * loop. Packets are sent one at a time under the session's send mutex:
+ * transforms, coalescing, statistics, and the datafeed callbacks unless
+ * the dispatch thread runs them, see packets one after the other, but
+ * not necessarily on the main loop's thread.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct sr_session *session;
+	int ret;
+
+	if (!sdi) {
+		sr_err("%s: sdi was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!packet) {
+		sr_err("%s: packet was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	if (!sdi->session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_BUG;
+	}
+
+	SR_TRACE2(send_entry, sdi, packet->type);
+	session = sdi->session;
+	g_rec_mutex_lock(&session->send_mutex);
+	ret = session_send(sdi, packet);
+	g_rec_mutex_unlock(&session->send_mutex);
+	SR_TRACE1(send_exit, ret);
+
+	return ret;
+}
+
+/**
+ * Pass a packet to the datafeed callbacks, right here or from the
+ * dispatch thread.
+ *
+ * @param sdi The device instance that sent the packet.
+ * @param packet The packet, after the transforms.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_deliver(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	if (sdi->session->dispatch && sdi->session->running)
+		return sr_session_dispatch_push(sdi->session, sdi, packet);
+
+	sr_session_datafeed_dispatch(sdi, packet, NULL);
+
+	return SR_OK;
+}
+
+/**
+ * Run the datafeed callbacks for a packet queued earlier.
+ *
+ * @param sdi The device instance that sent the packet.
+ * @param packet The packet.
+ * @param buf The buffer backing the payload, or NULL.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_datafeed_dispatch(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, struct sr_buffer *buf)
+{
+	GSList *l;
+	struct datafeed_callback *cb_struct;
+	struct buffer_dispatch dispatch;
+	unsigned int idx;
+	int64_t start_us;
+
+	dispatch.packet = packet;
+	dispatch.buf = buf;
+	dispatch.outer = g_private_get(&buffer_dispatch_key);
+	if (buf)
+		g_private_set(&buffer_dispatch_key, &dispatch);
+
+	if (sr_log_enabled(SR_LOG_DBG))
+		datafeed_dump(packet);
+
+	if (sdi->session->store)
+		sr_session_store_packet(sdi, packet);
+	if (sdi->session->chanstats)
+		sr_session_chanstats_packet(sdi, packet);
+	if (sdi->session->overview)
+		sr_session_overview_packet(sdi, packet);
+
+	for (l = sdi->session->datafeed_callbacks, idx = 0; l;
+			l = l->next, idx++) {
 		cb_struct = l->data;
+		SR_TRACE2(callback_entry, idx, packet->type);
+		if (!sdi->session->stats) {
+			cb_struct->cb(sdi, packet, cb_struct->cb_data);
+			SR_TRACE1(callback_exit, idx);
+			continue;
+		}
+		start_us = g_get_monotonic_time();
 		cb_struct->cb(sdi, packet, cb_struct->cb_data);
+		SR_TRACE1(callback_exit, idx);
+		sr_session_stats_callback(sdi->session, idx,
+			g_get_monotonic_time() - start_us);
 	}
 
-	return SR_OK;
+	if (buf)
+		g_private_set(&buffer_dispatch_key, dispatch.outer);
+}
+
+/**
+ * Send a packet whose payload lives in a reference counted buffer.
+ *
+ * Works like sr_session_send(), but datafeed callbacks can keep the
+ * payload with sr_packet_buffer_ref() rather than copying it. The
+ * caller keeps its own reference and may drop it once this returns,
+ * the memory is only released after the last consumer let go of it.
+ *
+ * @param sdi The device instance sending the packet.
+ * @param packet The datafeed packet, its payload data must be in @a buf.
+ * @param buf The buffer backing the payload. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_send_buffer(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, struct sr_buffer *buf)
+{
+	struct buffer_dispatch dispatch;
+	int ret;
+
+	if (!buf) {
+		sr_err("%s: buffer was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+
+	dispatch.packet = packet;
+	dispatch.buf = buf;
+	dispatch.outer = g_private_get(&buffer_dispatch_key);
+	g_private_set(&buffer_dispatch_key, &dispatch);
+
+	ret = sr_session_send(sdi, packet);
+
+	g_private_set(&buffer_dispatch_key, dispatch.outer);
+
+	return ret;
 }
 
 /**
@@ -1207,22 +1706,32 @@ SR_PRIV int sr_session_send(const struct sr_dev_inst *sdi,
 SR_PRIV int sr_session_source_add_internal(struct sr_session *session,
 		void *key, GSource *source)
 {
+	GMainContext *context;
+	int ret;
+
 	/*
 	 * This must not ever happen, since the source has already been
 	 * created and its finalize() method will remove the key for the
 	 * already installed source. (Well it would, if we did not have
 	 * another sanity check there.)
 	 */
+	g_rec_mutex_lock(&session->sources_mutex);
 	if (g_hash_table_contains(session->event_sources, key)) {
+		g_rec_mutex_unlock(&session->sources_mutex);
 		sr_err("Event source with key %p already exists.", key);
 		return SR_ERR_BUG;
 	}
 	g_hash_table_insert(session->event_sources, key, source);
 
-	if (session_source_attach(session, source) == 0)
-		return SR_ERR;
+	/* On the device's own context when it has one. */
+	context = sr_session_worker_context(session);
+	if (context)
+		ret = g_source_attach(source, context) ? SR_OK : SR_ERR;
+	else
+		ret = session_source_attach(session, source) ? SR_OK : SR_ERR;
+	g_rec_mutex_unlock(&session->sources_mutex);
 
-	return SR_OK;
+	return ret;
 }
 
 /** @private */
@@ -1357,16 +1866,19 @@ SR_PRIV int sr_session_source_remove_internal(struct sr_session *session,
 {
 	GSource *source;
 
+	g_rec_mutex_lock(&session->sources_mutex);
 	source = g_hash_table_lookup(session->event_sources, key);
 	/*
 	 * Trying to remove an already removed event source is problematic
 	 * since the poll_object handle may have been reused in the meantime.
 	 */
 	if (!source) {
+		g_rec_mutex_unlock(&session->sources_mutex);
 		sr_warn("Cannot remove non-existing event source %p.", key);
 		return SR_ERR_BUG;
 	}
 	g_source_destroy(source);
+	g_rec_mutex_unlock(&session->sources_mutex);
 
 	return SR_OK;
 }
@@ -1453,31 +1965,128 @@ SR_PRIV int sr_session_source_destroyed(struct sr_session *session,
 		void *key, GSource *source)
 {
 	GSource *registered_source;
+	int ret;
 
+	g_rec_mutex_lock(&session->sources_mutex);
 	registered_source = g_hash_table_lookup(session->event_sources, key);
 	/*
 	 * Trying to remove an already removed event source is problematic
 	 * since the poll_object handle may have been reused in the meantime.
 	 */
 	if (!registered_source) {
+		g_rec_mutex_unlock(&session->sources_mutex);
 		sr_err("No event source for key %p found.", key);
 		return SR_ERR_BUG;
 	}
 	if (registered_source != source) {
+		g_rec_mutex_unlock(&session->sources_mutex);
 		sr_err("Event source for key %p does not match"
 			" destroyed source.", key);
 		return SR_ERR_BUG;
 	}
 	g_hash_table_remove(session->event_sources, key);
 
-	if (g_hash_table_size(session->event_sources) > 0)
-		return SR_OK;
-
 	/* If no event sources are left, consider the acquisition finished.
 	 * This is pretty crude, as it requires all event sources to be
-	 * registered via the libsigrok API.
+	 * registered via the libsigrok API. The check runs on the session
+	 * main context, also when a device thread removed the source.
 	 */
-	return stop_check_later(session);
+	ret = SR_OK;
+	if (g_hash_table_size(session->event_sources) == 0)
+		ret = stop_check_later(session);
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	return ret;
+}
+
+/**
+ * Have an event source dispatched as soon as possible.
+ *
+ * This can be called from any thread, e.g. by a device thread which
+ * finished, so that the session's timer source notices right away
+ * instead of on its next timeout.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param key The key of the source.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG No such event source.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_source_wake(struct sr_session *session, void *key)
+{
+	GSource *source;
+
+	g_rec_mutex_lock(&session->sources_mutex);
+	source = g_hash_table_lookup(session->event_sources, key);
+	if (source)
+		g_source_set_ready_time(source, 0);
+	g_rec_mutex_unlock(&session->sources_mutex);
+
+	return source ? SR_OK : SR_ERR_ARG;
+}
+
+/**
+ * Register a hook which sr_session_stop() runs for a device on the
+ * calling thread, so that drivers can abort the acquisition without
+ * waiting for the session thread. Replaces an earlier hook of the
+ * device.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device.
+ * @param hook The hook, see sr_session_abort_hook.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_abort_hook_add(struct sr_session *session,
+		const struct sr_dev_inst *sdi, sr_session_abort_hook hook)
+{
+	struct abort_hook *ah;
+
+	if (!session || !sdi || !hook)
+		return SR_ERR_ARG;
+
+	sr_session_abort_hook_remove(session, sdi);
+	ah = g_malloc0(sizeof(*ah));
+	ah->sdi = sdi;
+	ah->hook = hook;
+	g_mutex_lock(&session->abort_mutex);
+	session->abort_hooks = g_slist_append(session->abort_hooks, ah);
+	g_mutex_unlock(&session->abort_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Remove the abort hook of a device, if it has one. Once this returns,
+ * the hook does not run anymore.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_abort_hook_remove(struct sr_session *session,
+		const struct sr_dev_inst *sdi)
+{
+	struct abort_hook *ah;
+	GSList *l;
+
+	if (!session)
+		return;
+
+	g_mutex_lock(&session->abort_mutex);
+	for (l = session->abort_hooks; l; l = l->next) {
+		ah = l->data;
+		if (ah->sdi != sdi)
+			continue;
+		session->abort_hooks = g_slist_delete_link(
+			session->abort_hooks, l);
+		g_free(ah);
+		break;
+	}
+	g_mutex_unlock(&session->abort_mutex);
 }
 
 static void copy_src(struct sr_config *src, struct sr_datafeed_meta *meta_copy)
@@ -1506,6 +2115,12 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	struct sr_analog_encoding *encoding_copy;
 	struct sr_analog_meaning *meaning_copy;
 	struct sr_analog_spec *spec_copy;
+	const struct sr_datafeed_logic_rle *rle;
+	struct sr_datafeed_logic_rle *rle_copy;
+	const struct sr_datafeed_logic_planar *planar;
+	struct sr_datafeed_logic_planar *planar_copy;
+	const struct sr_datafeed_logic_packed *packed;
+	struct sr_datafeed_logic_packed *packed_copy;
 	uint8_t *payload;
 
 	*copy = g_malloc0(sizeof(struct sr_datafeed_packet));
@@ -1514,6 +2129,8 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
 	case SR_DF_END:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
 		/* No payload. */
 		break;
 	case SR_DF_HEADER:
@@ -1524,7 +2141,7 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 	case SR_DF_META:
 		meta = packet->payload;
 		meta_copy = g_malloc0(sizeof(struct sr_datafeed_meta));
-		g_slist_foreach(meta->config, (GFunc)copy_src, meta_copy->config);
+		g_slist_foreach(meta->config, (GFunc)copy_src, meta_copy);
 		(*copy)->payload = meta_copy;
 		break;
 	case SR_DF_LOGIC:
@@ -1566,6 +2183,55 @@ SR_API int sr_packet_copy(const struct sr_datafeed_packet *packet,
 		analog_copy->spec = spec_copy;
 		(*copy)->payload = analog_copy;
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		rle_copy = g_malloc(sizeof(*rle_copy));
+		*rle_copy = *rle;
+#if GLIB_CHECK_VERSION(2, 67, 3)
+		rle_copy->offsets = g_memdup2(rle->offsets,
+				rle->num_runs * sizeof(uint64_t));
+		rle_copy->values = g_memdup2(rle->values,
+				rle->num_runs * rle->unitsize);
+#else
+		rle_copy->offsets = g_memdup(rle->offsets,
+				rle->num_runs * sizeof(uint64_t));
+		rle_copy->values = g_memdup(rle->values,
+				rle->num_runs * rle->unitsize);
+#endif
+		(*copy)->payload = rle_copy;
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		planar_copy = g_malloc(sizeof(*planar_copy));
+		*planar_copy = *planar;
+#if GLIB_CHECK_VERSION(2, 67, 3)
+		if (planar->plane_bits)
+			planar_copy->plane_bits = g_memdup2(planar->plane_bits,
+				planar->num_planes * sizeof(uint16_t));
+		planar_copy->data = g_memdup2(planar->data,
+				sr_logic_planar_data_size(planar));
+#else
+		if (planar->plane_bits)
+			planar_copy->plane_bits = g_memdup(planar->plane_bits,
+				planar->num_planes * sizeof(uint16_t));
+		planar_copy->data = g_memdup(planar->data,
+				sr_logic_planar_data_size(planar));
+#endif
+		(*copy)->payload = planar_copy;
+		break;
+	case SR_DF_LOGIC_PACKED:
+		packed = packet->payload;
+		packed_copy = g_malloc(sizeof(*packed_copy));
+		*packed_copy = *packed;
+#if GLIB_CHECK_VERSION(2, 67, 3)
+		packed_copy->data = g_memdup2(packed->data,
+				sr_logic_packed_data_size(packed));
+#else
+		packed_copy->data = g_memdup(packed->data,
+				sr_logic_packed_data_size(packed));
+#endif
+		(*copy)->payload = packed_copy;
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 		return SR_ERR;
@@ -1579,12 +2245,17 @@ SR_API void sr_packet_free(struct sr_datafeed_packet *packet)
 	const struct sr_datafeed_meta *meta;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_datafeed_analog *analog;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
+	const struct sr_datafeed_logic_packed *packed;
 	struct sr_config *src;
 	GSList *l;
 
 	switch (packet->type) {
 	case SR_DF_TRIGGER:
 	case SR_DF_END:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
 		/* No payload. */
 		break;
 	case SR_DF_HEADER:
@@ -1615,10 +2286,143 @@ SR_API void sr_packet_free(struct sr_datafeed_packet *packet)
 		g_free(analog->spec);
 		g_free((void *)packet->payload);
 		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		g_free(rle->offsets);
+		g_free(rle->values);
+		g_free((void *)packet->payload);
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		g_free(planar->plane_bits);
+		g_free(planar->data);
+		g_free((void *)packet->payload);
+		break;
+	case SR_DF_LOGIC_PACKED:
+		packed = packet->payload;
+		g_free(packed->data);
+		g_free((void *)packet->payload);
+		break;
 	default:
 		sr_err("Unknown packet type %d", packet->type);
 	}
 	g_free(packet);
 }
 
+/**
+ * Create a reference counted buffer around existing memory.
+ *
+ * @param data The memory, must stay valid until released.
+ * @param size The size of the memory in bytes.
+ * @param release Called with @a data and @a cb_data when the last
+ *                reference is dropped, from whichever thread drops it.
+ *                May be NULL.
+ * @param cb_data Passed to @a release.
+ *
+ * @return A buffer with one reference, owned by the caller.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_buffer *sr_buffer_new(void *data, size_t size,
+		sr_buffer_release_callback release, void *cb_data)
+{
+	struct sr_buffer *buf;
+
+	buf = g_malloc0(sizeof(*buf));
+	buf->refcount = 1;
+	buf->data = data;
+	buf->size = size;
+	buf->release = release;
+	buf->cb_data = cb_data;
+
+	return buf;
+}
+
+/**
+ * Take another reference to a buffer.
+ *
+ * @param buf The buffer, may be NULL.
+ *
+ * @return @a buf.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_buffer *sr_buffer_ref(struct sr_buffer *buf)
+{
+	if (buf)
+		g_atomic_int_inc(&buf->refcount);
+
+	return buf;
+}
+
+/**
+ * Drop a reference to a buffer, releasing it with the last one.
+ *
+ * @param buf The buffer, may be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_buffer_unref(struct sr_buffer *buf)
+{
+	if (!buf || !g_atomic_int_dec_and_test(&buf->refcount))
+		return;
+
+	if (buf->release)
+		buf->release(buf->data, buf->cb_data);
+	g_free(buf);
+}
+
+/**
+ * Get the memory of a buffer.
+ *
+ * @param buf The buffer. Must not be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void *sr_buffer_data(const struct sr_buffer *buf)
+{
+	return buf ? buf->data : NULL;
+}
+
+/**
+ * Get the size of a buffer in bytes.
+ *
+ * @param buf The buffer. Must not be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API size_t sr_buffer_size(const struct sr_buffer *buf)
+{
+	return buf ? buf->size : 0;
+}
+
+/**
+ * Take a reference to the buffer backing a datafeed packet.
+ *
+ * Only valid from within a datafeed callback, for the packet it was
+ * passed. The payload data stays valid until the returned reference is
+ * dropped with sr_buffer_unref(), the packet structures themselves do
+ * not.
+ *
+ * @param packet The packet passed to the datafeed callback.
+ *
+ * @return A new reference, or NULL if the packet isn't backed by a
+ *         buffer. Use sr_packet_copy() in that case.
+ *
+ * @since 0.6.0
+ */
+SR_API struct sr_buffer *sr_packet_buffer_ref(
+		const struct sr_datafeed_packet *packet)
+{
+	struct buffer_dispatch *dispatch;
+
+	for (dispatch = g_private_get(&buffer_dispatch_key); dispatch;
+			dispatch = dispatch->outer) {
+		if (dispatch->packet == packet)
+			return sr_buffer_ref(dispatch->buf);
+	}
+
+	return NULL;
+}
+
 /** @} */
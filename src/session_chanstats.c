@@ -0,0 +1,529 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "transpose.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Per-channel statistics of an acquisition.
+ *
+ * When enabled, the session keeps edge counts and high time of logic
+ * channels, and the range and mean of analog channels, as the packets
+ * go to the datafeed callbacks. Logic samples are looked at 64 at a
+ * time per channel: as bit planes, the changes of a word w are the
+ * bits of w ^ (w << 1), and counting them is a popcount.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+struct chan_state {
+	struct sr_channel_stats stats;
+	double sum;
+	gboolean have_prev;
+	uint64_t prev;
+};
+
+struct session_chanstats {
+	GMutex mutex;
+	/* struct sr_channel * to struct chan_state. */
+	GHashTable *channels;
+};
+
+static inline unsigned int popcount64(uint64_t w)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(w);
+#else
+	w = w - ((w >> 1) & UINT64_C(0x5555555555555555));
+	w = (w & UINT64_C(0x3333333333333333)) +
+		((w >> 2) & UINT64_C(0x3333333333333333));
+	w = (w + (w >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+
+	return (w * UINT64_C(0x0101010101010101)) >> 56;
+#endif
+}
+
+/* Index of the top set bit, w must not be 0. */
+static inline unsigned int top_bit64(uint64_t w)
+{
+#ifdef __GNUC__
+	return 63 - __builtin_clzll(w);
+#else
+	unsigned int n;
+
+	for (n = 0; w >>= 1; n++);
+
+	return n;
+#endif
+}
+
+static struct chan_state *chan_state_get(struct session_chanstats *cs,
+		struct sr_channel *ch)
+{
+	struct chan_state *s;
+
+	s = g_hash_table_lookup(cs->channels, ch);
+	if (!s) {
+		s = g_malloc0(sizeof(*s));
+		s->stats.channel = ch;
+		g_hash_table_insert(cs->channels, ch, s);
+	}
+
+	return s;
+}
+
+/* Account n samples of a channel, in bits 0 to n - 1 of w. */
+static void logic_word(struct chan_state *s, uint64_t w, unsigned int n)
+{
+	uint64_t mask, d;
+
+	mask = n < 64 ? ((uint64_t)1 << n) - 1 : ~(uint64_t)0;
+	w &= mask;
+	d = (w ^ ((w << 1) | s->prev)) & mask;
+	if (!s->have_prev)
+		d &= ~(uint64_t)1;
+	if (d) {
+		s->stats.edges += popcount64(d);
+		s->stats.last_edge = s->stats.num_samples + top_bit64(d);
+	}
+	s->stats.high_samples += popcount64(w);
+	s->stats.num_samples += n;
+	s->prev = (w >> (n - 1)) & 1;
+	s->have_prev = TRUE;
+}
+
+/*
+ * The states of the enabled logic channels, NULL for those which are
+ * not in samples of unitsize bytes.
+ */
+static struct chan_state **logic_states(struct session_chanstats *cs,
+		const struct sr_channel_index *index, unsigned int unitsize)
+{
+	struct chan_state **states;
+	size_t i;
+
+	states = g_malloc0_n(index->num_logic, sizeof(*states));
+	for (i = 0; i < index->num_logic; i++) {
+		if ((unsigned int)index->logic[i]->index < unitsize * 8)
+			states[i] = chan_state_get(cs, index->logic[i]);
+	}
+
+	return states;
+}
+
+static void logic_dense(struct session_chanstats *cs,
+		const struct sr_channel_index *index,
+		const struct sr_datafeed_logic *logic)
+{
+	const struct sr_transpose_impl *impl;
+	struct chan_state **states;
+	const uint8_t *data, *p;
+	uint16_t samples[64];
+	uint64_t words[SR_TRANSPOSE_MAX_WORDS];
+	uint64_t num_samples, pos, w;
+	unsigned int unitsize, n, i, bit;
+	size_t c;
+
+	unitsize = logic->unitsize;
+	num_samples = logic->length / unitsize;
+	data = logic->data;
+	states = logic_states(cs, index, unitsize);
+	impl = sr_transpose_impl_get();
+
+	for (pos = 0; pos < num_samples; pos += n) {
+		n = MIN(64, num_samples - pos);
+		p = data + pos * unitsize;
+		if (unitsize <= 2) {
+			/* The transpose kernels turn these into bit planes. */
+			for (i = 0; i < n; i++, p += unitsize)
+				samples[i] = unitsize == 1 ? *p : RL16(p);
+			sr_transpose_to_planar(impl, words, samples,
+				unitsize * 8, 1);
+			for (c = 0; c < index->num_logic; c++) {
+				if (states[c])
+					logic_word(states[c],
+						words[index->logic[c]->index], n);
+			}
+			continue;
+		}
+		for (c = 0; c < index->num_logic; c++) {
+			if (!states[c])
+				continue;
+			bit = index->logic[c]->index;
+			w = 0;
+			for (i = 0; i < n; i++) {
+				if (p[i * unitsize + bit / 8] & (1 << (bit % 8)))
+					w |= (uint64_t)1 << i;
+			}
+			logic_word(states[c], w, n);
+		}
+	}
+	g_free(states);
+}
+
+/* Packed samples, unpacked a slice at a time. */
+static void logic_packed(struct session_chanstats *cs,
+		const struct sr_channel_index *index,
+		const struct sr_datafeed_logic_packed *packed)
+{
+	struct sr_datafeed_logic logic;
+	uint8_t samples[1024];
+	uint64_t pos, n;
+
+	logic.unitsize = 1;
+	logic.data = samples;
+	for (pos = 0; pos < packed->num_samples; pos += n) {
+		n = MIN(sizeof(samples), packed->num_samples - pos);
+		if (sr_logic_packed_to_dense(packed, pos, n, samples) != SR_OK)
+			return;
+		logic.length = n;
+		logic_dense(cs, index, &logic);
+	}
+}
+
+static void logic_planar(struct session_chanstats *cs,
+		const struct sr_channel_index *index,
+		const struct sr_datafeed_logic_planar *planar)
+{
+	struct chan_state *s;
+	const uint8_t *p;
+	uint64_t block, num_blocks, w;
+	uint32_t w32;
+	uint16_t w16;
+	unsigned int plane, bit, n, word_bytes;
+	size_t c;
+
+	if (!planar->word_bits)
+		return;
+	word_bytes = planar->word_bits / 8;
+	num_blocks = (planar->num_samples + planar->word_bits - 1) /
+		planar->word_bits;
+	for (plane = 0; plane < planar->num_planes; plane++) {
+		bit = planar->plane_bits ? planar->plane_bits[plane] : plane;
+		s = NULL;
+		for (c = 0; c < index->num_logic; c++) {
+			if ((unsigned int)index->logic[c]->index == bit)
+				s = chan_state_get(cs, index->logic[c]);
+		}
+		if (!s)
+			continue;
+		for (block = 0; block < num_blocks; block++) {
+			p = (const uint8_t *)planar->data +
+				(block * planar->num_planes + plane) * word_bytes;
+			switch (word_bytes) {
+			case 1:
+				w = *p;
+				break;
+			case 2:
+				memcpy(&w16, p, sizeof(w16));
+				w = w16;
+				break;
+			case 4:
+				memcpy(&w32, p, sizeof(w32));
+				w = w32;
+				break;
+			default:
+				memcpy(&w, p, sizeof(w));
+				break;
+			}
+			n = MIN(planar->word_bits,
+				planar->num_samples - block * planar->word_bits);
+			logic_word(s, w, n);
+		}
+	}
+}
+
+static void logic_rle(struct session_chanstats *cs,
+		const struct sr_channel_index *index,
+		const struct sr_datafeed_logic_rle *rle)
+{
+	struct chan_state **states, *s;
+	const uint8_t *value;
+	uint64_t run, start, end;
+	unsigned int bit, level;
+	size_t c;
+
+	states = logic_states(cs, index, rle->unitsize);
+	for (c = 0; c < index->num_logic; c++) {
+		if (!(s = states[c]))
+			continue;
+		bit = index->logic[c]->index;
+		for (run = 0; run < rle->num_runs; run++) {
+			start = rle->offsets[run];
+			end = run + 1 < rle->num_runs ?
+				rle->offsets[run + 1] : rle->num_samples;
+			value = (const uint8_t *)rle->values + run * rle->unitsize;
+			level = (value[bit / 8] >> (bit % 8)) & 1;
+			if (s->have_prev && level != s->prev) {
+				s->stats.edges++;
+				s->stats.last_edge = s->stats.num_samples;
+			}
+			if (level)
+				s->stats.high_samples += end - start;
+			s->stats.num_samples += end - start;
+			s->prev = level;
+			s->have_prev = TRUE;
+		}
+	}
+	g_free(states);
+}
+
+static void analog_values(struct session_chanstats *cs,
+		const struct sr_datafeed_analog *analog)
+{
+	struct chan_state *s;
+	GSList *l;
+	float *values, v;
+	unsigned int num_channels, c;
+	uint32_t i;
+
+	if (!analog->meaning || !analog->num_samples)
+		return;
+	num_channels = g_slist_length(analog->meaning->channels);
+	if (!num_channels)
+		return;
+	values = g_try_malloc(sizeof(float) * analog->num_samples *
+		num_channels);
+	if (!values)
+		return;
+	if (sr_analog_to_float(analog, values) != SR_OK) {
+		g_free(values);
+		return;
+	}
+
+	/* Channels are interleaved, a frame of all of them per sample. */
+	for (l = analog->meaning->channels, c = 0; l; l = l->next, c++) {
+		s = chan_state_get(cs, l->data);
+		if (!s->stats.num_samples)
+			s->stats.min = s->stats.max = values[c];
+		for (i = 0; i < analog->num_samples; i++) {
+			v = values[i * num_channels + c];
+			s->stats.min = MIN(s->stats.min, v);
+			s->stats.max = MAX(s->stats.max, v);
+			s->sum += v;
+		}
+		s->stats.num_samples += analog->num_samples;
+	}
+	g_free(values);
+}
+
+/**
+ * Account a packet which goes to the datafeed callbacks.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_chanstats_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct session_chanstats *cs;
+	const struct sr_channel_index *index;
+	const struct sr_datafeed_logic *logic;
+
+	cs = sdi->session->chanstats;
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+	case SR_DF_LOGIC_RLE:
+	case SR_DF_LOGIC_PLANAR:
+	case SR_DF_LOGIC_PACKED:
+	case SR_DF_ANALOG:
+		break;
+	default:
+		return;
+	}
+	if (!(index = sr_dev_channel_index(sdi)))
+		return;
+
+	g_mutex_lock(&cs->mutex);
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		if (logic->unitsize && index->num_logic)
+			logic_dense(cs, index, logic);
+		break;
+	case SR_DF_LOGIC_RLE:
+		logic_rle(cs, index, packet->payload);
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		logic_planar(cs, index, packet->payload);
+		break;
+	case SR_DF_LOGIC_PACKED:
+		if (index->num_logic)
+			logic_packed(cs, index, packet->payload);
+		break;
+	case SR_DF_ANALOG:
+		analog_values(cs, packet->payload);
+		break;
+	}
+	g_mutex_unlock(&cs->mutex);
+}
+
+/**
+ * Clear the statistics, for a new run of the session.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_chanstats_reset(struct sr_session *session)
+{
+	struct session_chanstats *cs;
+
+	cs = session->chanstats;
+	if (!cs)
+		return;
+
+	g_mutex_lock(&cs->mutex);
+	g_hash_table_remove_all(cs->channels);
+	g_mutex_unlock(&cs->mutex);
+}
+
+/** @private */
+SR_PRIV void sr_session_chanstats_destroy(struct sr_session *session)
+{
+	struct session_chanstats *cs;
+
+	cs = session->chanstats;
+	if (!cs)
+		return;
+
+	g_hash_table_destroy(cs->channels);
+	g_mutex_clear(&cs->mutex);
+	g_free(cs);
+	session->chanstats = NULL;
+}
+
+/**
+ * Enable or disable per-channel statistics.
+ *
+ * Disabled by default, since every sample gets looked at. The
+ * statistics are cleared whenever the session starts.
+ *
+ * @param session The session to use. Must not be NULL, nor running.
+ * @param enable TRUE to enable, FALSE to disable the statistics.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_channel_stats_enable(struct sr_session *session,
+		gboolean enable)
+{
+	struct session_chanstats *cs;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change channel statistics while running.");
+		return SR_ERR;
+	}
+
+	if (!enable) {
+		sr_session_chanstats_destroy(session);
+		return SR_OK;
+	}
+	if (session->chanstats)
+		return SR_OK;
+
+	cs = g_malloc0(sizeof(*cs));
+	g_mutex_init(&cs->mutex);
+	cs->channels = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, g_free);
+	session->chanstats = cs;
+
+	return SR_OK;
+}
+
+/**
+ * Get the per-channel statistics of the current or last run.
+ *
+ * Can be called from any thread, also while the session is running.
+ * Channels which didn't get any samples yet are not in the list.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param stats Newly allocated list of struct sr_channel_stats, free
+ *              it with sr_session_channel_stats_free(). Must not be
+ *              NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The statistics are not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_channel_stats_get(struct sr_session *session,
+		GSList **stats)
+{
+	struct session_chanstats *cs;
+	struct chan_state *s;
+	struct sr_channel_stats *copy;
+	GHashTableIter iter;
+	gpointer value;
+	GSList *l;
+
+	if (!session || !stats)
+		return SR_ERR_ARG;
+
+	cs = session->chanstats;
+	if (!cs)
+		return SR_ERR_NA;
+
+	l = NULL;
+	g_mutex_lock(&cs->mutex);
+	g_hash_table_iter_init(&iter, cs->channels);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		s = value;
+		copy = g_malloc(sizeof(*copy));
+		*copy = s->stats;
+		if (copy->num_samples)
+			copy->mean = s->sum / copy->num_samples;
+		l = g_slist_prepend(l, copy);
+	}
+	g_mutex_unlock(&cs->mutex);
+	*stats = l;
+
+	return SR_OK;
+}
+
+/**
+ * Free a list returned by sr_session_channel_stats_get().
+ *
+ * @param stats The list to free. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_channel_stats_free(GSList *stats)
+{
+	g_slist_free_full(stats, g_free);
+}
+
+/** @} */
@@ -0,0 +1,470 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Datafeed packet coalescing.
+ *
+ * When enabled, consecutive logic packets of the same device and unit
+ * size, and consecutive single channel analog packets of the same
+ * device and format, are merged before they are passed on to the
+ * datafeed callbacks. Any other packet first flushes what has been
+ * collected, so the order of data and control packets is kept.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+/* Packets merged so far, type is 0 when nothing is being collected. */
+struct collected {
+	const struct sr_dev_inst *sdi;
+	uint16_t type;
+	int64_t since;
+	uint8_t *data;
+	size_t len;
+	size_t size;
+
+	/* Format of the collected data. */
+	uint16_t unitsize;
+	uint32_t num_samples;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+};
+
+struct session_coalesce {
+	struct sr_session *session;
+	uint64_t max_bytes;
+	int64_t max_latency_us;
+	GSource *timer;
+	GMutex mutex;
+
+	struct collected cur;
+	/* Buffer of data delivered before, to collect into next. */
+	uint8_t *spare;
+	size_t spare_size;
+};
+
+static gboolean analog_compatible(const struct collected *c,
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_analog_encoding *e;
+
+	e = analog->encoding;
+	if (e->unitsize != c->encoding.unitsize ||
+			e->is_signed != c->encoding.is_signed ||
+			e->is_float != c->encoding.is_float ||
+			e->is_bigendian != c->encoding.is_bigendian ||
+			e->digits != c->encoding.digits ||
+			e->is_digits_decimal != c->encoding.is_digits_decimal ||
+			e->scale.p != c->encoding.scale.p ||
+			e->scale.q != c->encoding.scale.q ||
+			e->offset.p != c->encoding.offset.p ||
+			e->offset.q != c->encoding.offset.q)
+		return FALSE;
+
+	return analog->meaning->mq == c->meaning.mq &&
+		analog->meaning->unit == c->meaning.unit &&
+		analog->meaning->mqflags == c->meaning.mqflags &&
+		analog->meaning->channels->data == c->meaning.channels->data &&
+		analog->spec->spec_digits == c->spec.spec_digits;
+}
+
+/* Whether the packet can be appended to what is being collected. */
+static gboolean compatible(const struct collected *c,
+		const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+
+	if (!c->type)
+		return TRUE;
+	if (sdi != c->sdi || packet->type != c->type)
+		return FALSE;
+
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		return logic->unitsize == c->unitsize;
+	}
+
+	return analog_compatible(c, packet->payload);
+}
+
+/* Logic data and single channel analog data get merged. */
+static gboolean mergeable(const struct sr_datafeed_packet *packet,
+		size_t *len)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		*len = logic->length;
+		return logic->unitsize > 0;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		if (!analog->encoding || !analog->meaning || !analog->spec)
+			return FALSE;
+		if (g_slist_length(analog->meaning->channels) != 1)
+			return FALSE;
+		*len = (size_t)analog->num_samples * analog->encoding->unitsize;
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * Take what was collected, to deliver it once the mutex is released:
+ * callbacks and transforms may send again. Collecting goes on in the
+ * spare buffer. Called with the mutex held.
+ */
+static void detach(struct session_coalesce *c, struct collected *out)
+{
+	*out = c->cur;
+	memset(&c->cur, 0, sizeof(c->cur));
+	c->cur.data = c->spare;
+	c->cur.size = c->spare_size;
+	c->spare = NULL;
+	c->spare_size = 0;
+}
+
+/* Deliver detached packets, called without the mutex held. */
+static int deliver(struct session_coalesce *c, struct collected *out)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	int ret;
+
+	if (!out->type)
+		return SR_OK;
+
+	packet.type = out->type;
+	if (out->type == SR_DF_LOGIC) {
+		logic.length = out->len;
+		logic.unitsize = out->unitsize;
+		logic.data = out->data;
+		packet.payload = &logic;
+	} else {
+		analog.data = out->data;
+		analog.num_samples = out->num_samples;
+		analog.encoding = &out->encoding;
+		analog.meaning = &out->meaning;
+		analog.spec = &out->spec;
+		packet.payload = &analog;
+	}
+
+	ret = sr_session_deliver(out->sdi, &packet);
+
+	g_slist_free(out->meaning.channels);
+	out->type = 0;
+
+	/* Keep the buffer for collecting the next packets. */
+	g_mutex_lock(&c->mutex);
+	if (!c->spare) {
+		c->spare = out->data;
+		c->spare_size = out->size;
+		out->data = NULL;
+	}
+	g_mutex_unlock(&c->mutex);
+	g_free(out->data);
+	out->data = NULL;
+
+	return ret;
+}
+
+/* Called with the mutex held. */
+static int append(struct collected *c, const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, size_t len)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	const void *src;
+	uint8_t *data;
+
+	if (c->len + len > c->size) {
+		data = g_try_realloc(c->data, c->len + len);
+		if (!data) {
+			sr_err("Cannot allocate coalescing buffer.");
+			return SR_ERR_MALLOC;
+		}
+		c->data = data;
+		c->size = c->len + len;
+	}
+
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		src = logic->data;
+		if (!c->type)
+			c->unitsize = logic->unitsize;
+	} else {
+		analog = packet->payload;
+		src = analog->data;
+		if (!c->type) {
+			c->encoding = *analog->encoding;
+			c->meaning = *analog->meaning;
+			c->meaning.channels = g_slist_copy(analog->meaning->channels);
+			c->spec = *analog->spec;
+			c->num_samples = 0;
+		}
+		c->num_samples += analog->num_samples;
+	}
+
+	if (!c->type) {
+		c->sdi = sdi;
+		c->type = packet->type;
+		c->since = g_get_monotonic_time();
+	}
+	memcpy(c->data + c->len, src, len);
+	c->len += len;
+
+	return SR_OK;
+}
+
+/**
+ * Pass a packet on to coalescing.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_coalesce_push(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct session_coalesce *c;
+	struct collected before, full;
+	gboolean direct;
+	size_t len;
+	int ret, ret2;
+
+	c = sdi->session->coalesce;
+	before.type = full.type = 0;
+	before.data = full.data = NULL;
+	direct = FALSE;
+	ret = SR_OK;
+
+	g_mutex_lock(&c->mutex);
+	if (!mergeable(packet, &len)) {
+		/* Whatever was collected goes out first. */
+		if (c->cur.type)
+			detach(c, &before);
+		direct = TRUE;
+	} else {
+		if (c->cur.type && (!compatible(&c->cur, sdi, packet) ||
+				c->cur.len + len > c->max_bytes ||
+				g_get_monotonic_time() - c->cur.since >=
+				c->max_latency_us))
+			detach(c, &before);
+		if (len >= c->max_bytes) {
+			/* Large enough on its own, don't copy it. */
+			direct = TRUE;
+		} else {
+			ret = append(&c->cur, sdi, packet, len);
+			if (ret == SR_OK && c->cur.len >= c->max_bytes)
+				detach(c, &full);
+		}
+	}
+	g_mutex_unlock(&c->mutex);
+
+	/* Delivered in the order the data came in. */
+	ret2 = deliver(c, &before);
+	if (ret == SR_OK)
+		ret = ret2;
+	if (direct && ret == SR_OK)
+		ret = sr_session_deliver(sdi, packet);
+	ret2 = deliver(c, &full);
+	if (ret == SR_OK)
+		ret = ret2;
+
+	return ret;
+}
+
+/* Sends what was collected when no more data came in time. */
+static gboolean coalesce_timeout(void *cb_data)
+{
+	struct session_coalesce *c;
+	struct collected out;
+
+	c = cb_data;
+
+	/* Delivered like any packet sent, in turn with the drivers' sends. */
+	out.type = 0;
+	out.data = NULL;
+	g_rec_mutex_lock(&c->session->send_mutex);
+	g_mutex_lock(&c->mutex);
+	if (c->cur.type &&
+			g_get_monotonic_time() - c->cur.since >= c->max_latency_us)
+		detach(c, &out);
+	g_mutex_unlock(&c->mutex);
+	deliver(c, &out);
+	g_rec_mutex_unlock(&c->session->send_mutex);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/**
+ * Set up the latency timer, if coalescing is enabled.
+ *
+ * Must be called with the session main context set.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_coalesce_start(struct sr_session *session)
+{
+	struct session_coalesce *c;
+	unsigned int interval;
+
+	c = session->coalesce;
+	if (!c)
+		return SR_OK;
+
+	/* Half the latency, so that data is never held much longer. */
+	interval = MAX(1, (unsigned int)(c->max_latency_us / 2000));
+	c->timer = g_timeout_source_new(interval);
+	g_source_set_callback(c->timer, coalesce_timeout, c, NULL);
+
+	g_mutex_lock(&session->main_mutex);
+	if (!session->main_context ||
+			!g_source_attach(c->timer, session->main_context)) {
+		g_mutex_unlock(&session->main_mutex);
+		sr_err("Cannot start coalescing timer.");
+		g_source_unref(c->timer);
+		c->timer = NULL;
+		return SR_ERR;
+	}
+	g_mutex_unlock(&session->main_mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Send what was collected and stop the latency timer.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_coalesce_stop(struct sr_session *session)
+{
+	struct session_coalesce *c;
+	struct collected out;
+
+	c = session->coalesce;
+	if (!c)
+		return;
+
+	out.type = 0;
+	out.data = NULL;
+	g_rec_mutex_lock(&session->send_mutex);
+	g_mutex_lock(&c->mutex);
+	if (c->cur.type)
+		detach(c, &out);
+	g_mutex_unlock(&c->mutex);
+	deliver(c, &out);
+	g_rec_mutex_unlock(&session->send_mutex);
+
+	if (c->timer) {
+		g_source_destroy(c->timer);
+		g_source_unref(c->timer);
+		c->timer = NULL;
+	}
+}
+
+/** @private */
+SR_PRIV void sr_session_coalesce_free(struct sr_session *session)
+{
+	struct session_coalesce *c;
+
+	c = session->coalesce;
+	if (!c)
+		return;
+
+	sr_session_coalesce_stop(session);
+	g_mutex_clear(&c->mutex);
+	g_free(c->cur.data);
+	g_free(c->spare);
+	g_free(c);
+	session->coalesce = NULL;
+}
+
+/**
+ * Merge small data packets before passing them to datafeed callbacks.
+ *
+ * Consecutive logic packets of the same device and unit size, and
+ * consecutive single channel analog packets of the same device and
+ * format, are collected until they reach @a max_bytes, until
+ * @a max_latency_ms passed since the first of them, or until any
+ * other packet is sent. Transform modules still see the original
+ * packets.
+ *
+ * @param session The session to use. Must not be NULL, nor running.
+ * @param max_bytes Size to collect packets up to, 0 to disable
+ *                  coalescing (the default).
+ * @param max_latency_ms Longest time to hold back data. Must be > 0
+ *                       when coalescing is enabled.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_coalesce_set(struct sr_session *session,
+		uint64_t max_bytes, uint64_t max_latency_ms)
+{
+	struct session_coalesce *c;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (max_bytes && !max_latency_ms) {
+		sr_err("%s: latency must not be 0", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change coalescing while running.");
+		return SR_ERR;
+	}
+
+	sr_session_coalesce_free(session);
+	if (!max_bytes)
+		return SR_OK;
+
+	c = g_malloc0(sizeof(*c));
+	c->session = session;
+	c->max_bytes = max_bytes;
+	c->max_latency_us = max_latency_ms * 1000;
+	g_mutex_init(&c->mutex);
+	session->coalesce = c;
+
+	return SR_OK;
+}
+
+/** @} */
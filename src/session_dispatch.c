@@ -0,0 +1,466 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Asynchronous datafeed dispatch.
+ *
+ * When enabled, sr_session_send() queues a copy of each packet and a
+ * separate thread runs the datafeed callbacks, so that slow consumers
+ * don't hold up the acquisition. The queue is bounded, what happens
+ * when it is full is up to the configured policy.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+struct dispatch_item {
+	const struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet *packet;
+	/* Set when the logic payload is shared rather than copied. */
+	struct sr_buffer *buf;
+};
+
+/* Record header of a packet spilled to disk, followed by the data. */
+struct spill_record {
+	const struct sr_dev_inst *sdi;
+	uint64_t length;
+	uint16_t type;
+	uint16_t unitsize;
+};
+
+struct session_dispatch {
+	size_t depth;
+	enum sr_dispatch_policy policy;
+
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+	GQueue queue;
+	gboolean stop;
+
+	/* Spill file, in order after everything in the queue. */
+	FILE *spill;
+	uint64_t spill_rd;
+	uint64_t spill_wr;
+	uint64_t spill_count;
+
+	struct sr_dispatch_stats stats;
+};
+
+static void item_free(struct dispatch_item *item)
+{
+	if (item->buf) {
+		g_free((void *)item->packet->payload);
+		g_free(item->packet);
+		sr_buffer_unref(item->buf);
+	} else {
+		sr_packet_free(item->packet);
+	}
+	g_free(item);
+}
+
+static struct dispatch_item *item_new(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct dispatch_item *item;
+	struct sr_datafeed_logic *logic;
+
+	item = g_malloc0(sizeof(*item));
+	item->sdi = sdi;
+
+	/* Logic payloads in a refcounted buffer are shared, not copied. */
+	if (packet->type == SR_DF_LOGIC)
+		item->buf = sr_packet_buffer_ref(packet);
+	if (item->buf) {
+		logic = g_malloc(sizeof(*logic));
+		memcpy(logic, packet->payload, sizeof(*logic));
+		item->packet = g_malloc0(sizeof(*item->packet));
+		item->packet->type = packet->type;
+		item->packet->payload = logic;
+		return item;
+	}
+
+	if (sr_packet_copy(packet, &item->packet) != SR_OK) {
+		g_free(item->packet);
+		g_free(item);
+		return NULL;
+	}
+
+	return item;
+}
+
+static gboolean is_data(const struct sr_datafeed_packet *packet)
+{
+	return packet->type == SR_DF_LOGIC || packet->type == SR_DF_ANALOG;
+}
+
+/* What can be written to the spill file: logic data and no-payload packets. */
+static gboolean is_spillable(const struct sr_datafeed_packet *packet)
+{
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+	case SR_DF_TRIGGER:
+	case SR_DF_FRAME_BEGIN:
+	case SR_DF_FRAME_END:
+	case SR_DF_END:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* Called with the mutex held. */
+static int spill_write(struct session_dispatch *d,
+		const struct sr_dev_inst *sdi, const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+	struct spill_record rec;
+	size_t len;
+
+	if (!d->spill && !(d->spill = tmpfile())) {
+		sr_err("Cannot create datafeed spill file.");
+		return SR_ERR_IO;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.sdi = sdi;
+	rec.type = packet->type;
+	len = 0;
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		rec.length = logic->length;
+		rec.unitsize = logic->unitsize;
+		len = logic->length;
+	}
+
+	if (fseeko(d->spill, d->spill_wr, SEEK_SET) != 0 ||
+			fwrite(&rec, sizeof(rec), 1, d->spill) != 1 ||
+			(len && fwrite(((const struct sr_datafeed_logic *)packet->payload)->data,
+				len, 1, d->spill) != 1)) {
+		sr_err("Cannot write datafeed spill file.");
+		return SR_ERR_IO;
+	}
+	d->spill_wr += sizeof(rec) + len;
+	d->spill_count++;
+	d->stats.spilled++;
+
+	return SR_OK;
+}
+
+/* Called with the mutex held, returns NULL when the spill is empty. */
+static struct dispatch_item *spill_read(struct session_dispatch *d)
+{
+	struct dispatch_item *item;
+	struct sr_datafeed_logic *logic;
+	struct spill_record rec;
+
+	if (!d->spill_count)
+		return NULL;
+
+	if (fseeko(d->spill, d->spill_rd, SEEK_SET) != 0 ||
+			fread(&rec, sizeof(rec), 1, d->spill) != 1) {
+		sr_err("Cannot read datafeed spill file.");
+		d->spill_count = 0;
+		return NULL;
+	}
+
+	item = g_malloc0(sizeof(*item));
+	item->sdi = rec.sdi;
+	item->packet = g_malloc0(sizeof(*item->packet));
+	item->packet->type = rec.type;
+	if (rec.type == SR_DF_LOGIC) {
+		logic = g_malloc(sizeof(*logic));
+		logic->length = rec.length;
+		logic->unitsize = rec.unitsize;
+		logic->data = g_try_malloc(rec.length);
+		if (!logic->data || (rec.length &&
+				fread(logic->data, rec.length, 1, d->spill) != 1)) {
+			sr_err("Cannot read datafeed spill file.");
+			logic->length = 0;
+		}
+		item->packet->payload = logic;
+	}
+
+	d->spill_rd += sizeof(rec) + rec.length;
+	if (!--d->spill_count)
+		d->spill_rd = d->spill_wr = 0;
+
+	return item;
+}
+
+static gpointer dispatch_thread(gpointer data)
+{
+	struct sr_session *session;
+	struct session_dispatch *d;
+	struct dispatch_item *item;
+
+	session = data;
+	d = session->dispatch;
+
+	g_mutex_lock(&d->mutex);
+	for (;;) {
+		item = g_queue_pop_head(&d->queue);
+		if (!item)
+			item = spill_read(d);
+		if (!item) {
+			if (d->stop)
+				break;
+			g_cond_wait(&d->cond, &d->mutex);
+			continue;
+		}
+		/* Room for a waiting producer. */
+		g_cond_broadcast(&d->cond);
+		g_mutex_unlock(&d->mutex);
+
+		sr_session_datafeed_dispatch(item->sdi, item->packet, item->buf);
+		item_free(item);
+
+		g_mutex_lock(&d->mutex);
+	}
+	g_mutex_unlock(&d->mutex);
+
+	return NULL;
+}
+
+/**
+ * Queue a packet for the dispatch thread.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_dispatch_push(struct sr_session *session,
+		const struct sr_dev_inst *sdi, const struct sr_datafeed_packet *packet)
+{
+	struct session_dispatch *d;
+	struct dispatch_item *item;
+	gboolean waited;
+	int ret;
+
+	d = session->dispatch;
+	ret = SR_OK;
+	waited = FALSE;
+
+	g_mutex_lock(&d->mutex);
+	for (;;) {
+		/* Once spilling, everything spillable goes there, in order. */
+		if (d->policy == SR_DISPATCH_SPILL && (d->spill_count ||
+				g_queue_get_length(&d->queue) >= d->depth)) {
+			if (is_spillable(packet)) {
+				ret = spill_write(d, sdi, packet);
+				g_cond_broadcast(&d->cond);
+				g_mutex_unlock(&d->mutex);
+				return ret;
+			}
+		} else if (g_queue_get_length(&d->queue) < d->depth) {
+			break;
+		} else if (d->policy == SR_DISPATCH_DROP && is_data(packet)) {
+			d->stats.dropped++;
+			g_mutex_unlock(&d->mutex);
+			return SR_OK;
+		}
+		/* Block, also for control packets that must not get lost. */
+		waited = TRUE;
+		g_cond_wait(&d->cond, &d->mutex);
+	}
+	if (waited)
+		d->stats.blocked++;
+	g_mutex_unlock(&d->mutex);
+
+	/* Copy outside of the lock, the consumer can go on meanwhile. */
+	item = item_new(sdi, packet);
+	if (!item)
+		return SR_ERR_MALLOC;
+
+	g_mutex_lock(&d->mutex);
+	g_queue_push_tail(&d->queue, item);
+	d->stats.packets++;
+	d->stats.max_depth = MAX(d->stats.max_depth, g_queue_get_length(&d->queue));
+	g_cond_broadcast(&d->cond);
+	g_mutex_unlock(&d->mutex);
+
+	return ret;
+}
+
+/**
+ * Start the dispatch thread, if asynchronous dispatch is enabled.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_dispatch_start(struct sr_session *session)
+{
+	struct session_dispatch *d;
+
+	d = session->dispatch;
+	if (!d)
+		return SR_OK;
+
+	memset(&d->stats, 0, sizeof(d->stats));
+	d->stop = FALSE;
+	d->thread = g_thread_try_new("sr-dispatch", dispatch_thread, session, NULL);
+	if (!d->thread) {
+		sr_err("Cannot start datafeed dispatch thread.");
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Deliver everything still queued and stop the dispatch thread.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_dispatch_stop(struct sr_session *session)
+{
+	struct session_dispatch *d;
+
+	d = session->dispatch;
+	if (!d || !d->thread)
+		return;
+
+	g_mutex_lock(&d->mutex);
+	d->stop = TRUE;
+	g_cond_broadcast(&d->cond);
+	g_mutex_unlock(&d->mutex);
+
+	g_thread_join(d->thread);
+	d->thread = NULL;
+
+	if (d->stats.dropped || d->stats.spilled)
+		sr_info("Datafeed dispatch dropped %" PRIu64 ", spilled %"
+			PRIu64 " of %" PRIu64 " packets.", d->stats.dropped,
+			d->stats.spilled, d->stats.packets + d->stats.spilled);
+}
+
+/** @private */
+SR_PRIV void sr_session_dispatch_free(struct sr_session *session)
+{
+	struct session_dispatch *d;
+
+	d = session->dispatch;
+	if (!d)
+		return;
+
+	sr_session_dispatch_stop(session);
+	if (d->spill)
+		fclose(d->spill);
+	g_mutex_clear(&d->mutex);
+	g_cond_clear(&d->cond);
+	g_free(d);
+	session->dispatch = NULL;
+}
+
+/**
+ * Have datafeed callbacks run in a separate thread.
+ *
+ * Packets are copied into a queue of @a depth entries, the callbacks
+ * then run in a thread of their own. Logic packets that a driver sent
+ * in a refcounted buffer are queued without a copy.
+ *
+ * @param session The session to use. Must not be NULL, nor running.
+ * @param depth Number of packets to queue, 0 to run the callbacks
+ *              synchronously from sr_session_send() again (the default).
+ * @param policy What to do when the queue is full. Control packets are
+ *               never dropped, the producer waits for them instead.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_dispatch_async_set(struct sr_session *session,
+		size_t depth, enum sr_dispatch_policy policy)
+{
+	struct session_dispatch *d;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (policy != SR_DISPATCH_BLOCK && policy != SR_DISPATCH_DROP &&
+			policy != SR_DISPATCH_SPILL) {
+		sr_err("%s: invalid policy %d", __func__, policy);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change datafeed dispatch while running.");
+		return SR_ERR;
+	}
+
+	sr_session_dispatch_free(session);
+	if (!depth)
+		return SR_OK;
+
+	d = g_malloc0(sizeof(*d));
+	d->depth = depth;
+	d->policy = policy;
+	g_mutex_init(&d->mutex);
+	g_cond_init(&d->cond);
+	g_queue_init(&d->queue);
+	session->dispatch = d;
+
+	return SR_OK;
+}
+
+/**
+ * Get the asynchronous dispatch statistics of the current or last run.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param stats Filled in. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA Asynchronous dispatch is not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_dispatch_stats_get(struct sr_session *session,
+		struct sr_dispatch_stats *stats)
+{
+	struct session_dispatch *d;
+
+	if (!session || !stats)
+		return SR_ERR_ARG;
+
+	d = session->dispatch;
+	if (!d)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&d->mutex);
+	*stats = d->stats;
+	g_mutex_unlock(&d->mutex);
+
+	return SR_OK;
+}
+
+/** @} */
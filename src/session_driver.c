@@ -34,22 +34,54 @@
 #define CHUNKSIZE (4 * 1024 * 1024)
 /** @endcond */
 
+/* Most decoded data held ahead of what was sent. */
+#define READAHEAD_SIZE (64 * 1024 * 1024)
+
 SR_PRIV struct sr_dev_driver session_driver_info;
 
+/* An archive entry to replay, decoded by one of the worker threads. */
+struct replay_chunk {
+	char *name;
+	zip_uint64_t index;
+	uint64_t size;
+	/* 0 for logic data, the analog channel number otherwise. */
+	int analog_channel;
+	/* The decoded data, which may differ in size from the entry. */
+	uint8_t *data;
+	uint64_t length;
+	/* How much of the data was sent already. */
+	uint64_t sent;
+	gboolean done;
+	gboolean failed;
+};
+
 struct session_vdev {
 	char *sessionfile;
 	char *capturefile;
 	struct zip *archive;
-	struct zip_file *capfile;
 	int bytes_read;
 	uint64_t samplerate;
 	int unitsize;
 	int num_logic_channels;
 	int num_analog_channels;
-	int cur_analog_channel;
 	GArray *analog_channels;
-	int cur_chunk;
+	/* How the chunks of each analog channel are encoded. */
+	struct sr_analog_encoding *analog_encodings;
+	/* Logic chunks are run-length encoded. */
+	gboolean rle;
 	gboolean finished;
+
+	/* struct replay_chunk, in the order they are sent. */
+	GPtrArray *chunks;
+	guint next_decode;
+	guint next_send;
+	/* Size of the data decoded and being decoded, under the mutex. */
+	uint64_t readahead;
+	/* Worker threads, each takes an open archive from the queue. */
+	GThreadPool *pool;
+	GAsyncQueue *archives;
+	GMutex mutex;
+	GCond cond;
 };
 
 static const uint32_t devopts[] = {
@@ -61,7 +93,250 @@ static const uint32_t devopts[] = {
 	SR_CONF_SESSIONFILE | SR_CONF_SET,
 };
 
-static gboolean stream_session_data(struct sr_dev_inst *sdi)
+static void chunk_free(struct replay_chunk *chunk)
+{
+	g_free(chunk->name);
+	g_free(chunk->data);
+	g_free(chunk);
+}
+
+static gboolean chunk_add(struct session_vdev *vdev, GHashTable *entries,
+		const char *name, int analog_channel)
+{
+	struct replay_chunk *chunk;
+	struct zip_stat zs;
+	uint64_t index;
+
+	if (!sr_sessionfile_entry_find(entries, name, &index) ||
+			zip_stat_index(vdev->archive, index, 0, &zs) < 0)
+		return FALSE;
+
+	chunk = g_malloc0(sizeof(*chunk));
+	chunk->name = g_strdup(name);
+	chunk->index = zs.index;
+	chunk->size = zs.size;
+	chunk->analog_channel = analog_channel;
+	g_ptr_array_add(vdev->chunks, chunk);
+
+	return TRUE;
+}
+
+/*
+ * List the entries of a capture: either the single unchunked one, or all
+ * chunks numbered from 1 on.
+ */
+static gboolean chunks_add(struct session_vdev *vdev, GHashTable *entries,
+		const char *basename, int analog_channel)
+{
+	GString *name;
+	gsize len;
+	int n;
+
+	if (chunk_add(vdev, entries, basename, analog_channel))
+		return TRUE;
+
+	name = g_string_new(basename);
+	len = name->len;
+	for (n = 1; ; n++) {
+		g_string_truncate(name, len);
+		g_string_append_printf(name, "-%d", n);
+		if (!chunk_add(vdev, entries, name->str, analog_channel))
+			break;
+	}
+	g_string_free(name, TRUE);
+
+	return n > 1;
+}
+
+static int chunks_plan(struct session_vdev *vdev)
+{
+	struct zip_stat zs;
+	GKeyFile *kf;
+	GHashTable *entries;
+	char *basename;
+	int i, ret;
+
+	if (zip_stat(vdev->archive, "metadata", 0, &zs) < 0 ||
+			!(kf = sr_sessionfile_read_metadata(vdev->archive, &zs)))
+		return SR_ERR_DATA;
+	ret = sr_sessionfile_logic_rle(kf, "device 1", &vdev->rle);
+	vdev->analog_encodings = g_new0(struct sr_analog_encoding,
+		vdev->num_analog_channels + 1);
+	for (i = 0; ret == SR_OK && i < vdev->num_analog_channels; i++)
+		ret = sr_sessionfile_analog_encoding(kf, "device 1",
+			vdev->num_logic_channels + i + 1,
+			&vdev->analog_encodings[i]);
+	g_key_file_free(kf);
+	if (ret != SR_OK)
+		return ret;
+
+	vdev->chunks = g_ptr_array_new_with_free_func(
+		(GDestroyNotify)chunk_free);
+
+	/* Archives may have tens of thousands of chunks to look up. */
+	entries = sr_sessionfile_entries(vdev->archive);
+	ret = SR_OK;
+	if (vdev->capturefile &&
+			!chunks_add(vdev, entries, vdev->capturefile, 0)) {
+		sr_err("No capture file '%s' in session file '%s'.",
+			vdev->capturefile, vdev->sessionfile);
+		ret = SR_ERR;
+	}
+	for (i = 0; ret == SR_OK && i < vdev->num_analog_channels; i++) {
+		basename = g_strdup_printf("analog-1-%d",
+			vdev->num_logic_channels + i + 1);
+		chunks_add(vdev, entries, basename, i + 1);
+		g_free(basename);
+	}
+	g_hash_table_destroy(entries);
+
+	return ret;
+}
+
+static void chunk_decode(gpointer data, gpointer user_data)
+{
+	struct replay_chunk *chunk;
+	struct session_vdev *vdev;
+	struct zip *archive;
+	struct zip_file *zf;
+	zip_int64_t ret;
+	uint64_t len, num_samples;
+	uint8_t *samples;
+
+	chunk = data;
+	vdev = user_data;
+
+	archive = g_async_queue_pop(vdev->archives);
+	len = 0;
+	chunk->data = g_try_malloc(chunk->size);
+	if (chunk->data && (zf = zip_fopen_index(archive, chunk->index, 0))) {
+		while (len < chunk->size) {
+			ret = zip_fread(zf, chunk->data + len, chunk->size - len);
+			if (ret <= 0)
+				break;
+			len += ret;
+		}
+		zip_fclose(zf);
+	}
+	g_async_queue_push(vdev->archives, archive);
+	chunk->length = len;
+	chunk->failed = len != chunk->size;
+
+	if (!chunk->failed && vdev->rle && !chunk->analog_channel) {
+		if (sr_sessionfile_rle_decode(chunk->data, chunk->size,
+				vdev->unitsize, &samples, &num_samples) == SR_OK) {
+			g_free(chunk->data);
+			chunk->data = samples;
+			chunk->length = num_samples * vdev->unitsize;
+		} else {
+			chunk->failed = TRUE;
+		}
+	}
+
+	g_mutex_lock(&vdev->mutex);
+	/* Count what the data takes now that it is decoded. */
+	vdev->readahead += chunk->length;
+	vdev->readahead -= chunk->size;
+	chunk->done = TRUE;
+	g_cond_broadcast(&vdev->cond);
+	g_mutex_unlock(&vdev->mutex);
+}
+
+/* Have the next chunks decoded, as far as the read-ahead allows. */
+static void chunks_schedule(struct session_vdev *vdev)
+{
+	struct replay_chunk *chunk;
+
+	g_mutex_lock(&vdev->mutex);
+	while (vdev->next_decode < vdev->chunks->len) {
+		chunk = g_ptr_array_index(vdev->chunks, vdev->next_decode);
+		/* The chunk to send next is always decoded. */
+		if (vdev->next_decode > vdev->next_send &&
+				vdev->readahead + chunk->size > READAHEAD_SIZE)
+			break;
+		vdev->readahead += chunk->size;
+		vdev->next_decode++;
+		g_thread_pool_push(vdev->pool, chunk, NULL);
+	}
+	g_mutex_unlock(&vdev->mutex);
+}
+
+static int replay_start(struct session_vdev *vdev)
+{
+	struct zip *archive;
+	unsigned int i, num_threads;
+	int ret;
+
+	if ((ret = chunks_plan(vdev)) != SR_OK)
+		return ret;
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+	num_threads = g_get_num_processors();
+#else
+	num_threads = 1;
+#endif
+	num_threads = MAX(1, MIN(num_threads, vdev->chunks->len));
+
+	/* libzip archives aren't shared between threads. */
+	vdev->archives = g_async_queue_new();
+	g_async_queue_push(vdev->archives, vdev->archive);
+	vdev->archive = NULL;
+	for (i = 1; i < num_threads; i++) {
+		if (!(archive = zip_open(vdev->sessionfile, 0, NULL)))
+			break;
+		g_async_queue_push(vdev->archives, archive);
+	}
+
+	g_mutex_init(&vdev->mutex);
+	g_cond_init(&vdev->cond);
+	vdev->next_decode = 0;
+	vdev->next_send = 0;
+	vdev->readahead = 0;
+	vdev->pool = g_thread_pool_new(chunk_decode, vdev, i, TRUE, NULL);
+	if (!vdev->pool) {
+		sr_err("Cannot start session file decoder threads.");
+		return SR_ERR;
+	}
+	chunks_schedule(vdev);
+
+	return SR_OK;
+}
+
+static void replay_stop(struct session_vdev *vdev)
+{
+	struct zip *archive;
+
+	if (vdev->pool) {
+		/* Chunks not being decoded yet are dropped. */
+		g_thread_pool_free(vdev->pool, TRUE, TRUE);
+		vdev->pool = NULL;
+		g_mutex_clear(&vdev->mutex);
+		g_cond_clear(&vdev->cond);
+	}
+	if (vdev->archives) {
+		while ((archive = g_async_queue_try_pop(vdev->archives)))
+			zip_discard(archive);
+		g_async_queue_unref(vdev->archives);
+		vdev->archives = NULL;
+	}
+	if (vdev->archive) {
+		zip_discard(vdev->archive);
+		vdev->archive = NULL;
+	}
+	if (vdev->chunks) {
+		g_ptr_array_free(vdev->chunks, TRUE);
+		vdev->chunks = NULL;
+	}
+	if (vdev->analog_channels) {
+		g_array_free(vdev->analog_channels, TRUE);
+		vdev->analog_channels = NULL;
+	}
+	g_free(vdev->analog_encodings);
+	vdev->analog_encodings = NULL;
+}
+
+static void send_chunk_data(struct sr_dev_inst *sdi,
+		struct replay_chunk *chunk)
 {
 	struct session_vdev *vdev;
 	struct sr_datafeed_packet packet;
@@ -70,134 +345,98 @@ static gboolean stream_session_data(struct sr_dev_inst *sdi)
 	struct sr_analog_encoding encoding;
 	struct sr_analog_meaning meaning;
 	struct sr_analog_spec spec;
-	struct zip_stat zs;
-	int ret, got_data;
-	char capturefile[128];
-	void *buf;
+	const struct sr_analog_encoding *enc;
+	uint64_t len;
+	uint8_t *buf;
 
-	got_data = FALSE;
 	vdev = sdi->priv;
 
-	if (!vdev->capfile) {
-		/* No capture file opened yet, or finished with the last
-		 * chunked one. */
-		if (vdev->capturefile && (vdev->cur_chunk == 0)) {
-			/* capturefile is always the unchunked base name. */
-			if (zip_stat(vdev->archive, vdev->capturefile, 0, &zs) != -1) {
-				/* No chunks, just a single capture file. */
-				vdev->cur_chunk = 0;
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						vdev->capturefile, 0)))
-					return FALSE;
-				sr_dbg("Opened %s.", vdev->capturefile);
-			} else {
-				/* Try as first chunk filename. */
-				snprintf(capturefile, sizeof(capturefile) - 1, "%s-1", vdev->capturefile);
-				if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-					vdev->cur_chunk = 1;
-					if (!(vdev->capfile = zip_fopen(vdev->archive,
-							capturefile, 0)))
-						return FALSE;
-					sr_dbg("Opened %s.", capturefile);
-				} else {
-					sr_err("No capture file '%s' in " "session file '%s'.",
-							vdev->capturefile, vdev->sessionfile);
-					return FALSE;
-				}
-			}
-		} else {
-			/* Capture data is chunked, advance to the next chunk. */
-			vdev->cur_chunk++;
-			snprintf(capturefile, sizeof(capturefile) - 1, "%s-%d", vdev->capturefile,
-					vdev->cur_chunk);
-			if (zip_stat(vdev->archive, capturefile, 0, &zs) != -1) {
-				if (!(vdev->capfile = zip_fopen(vdev->archive,
-						capturefile, 0)))
-					return FALSE;
-				sr_dbg("Opened %s.", capturefile);
-			} else if (vdev->cur_analog_channel < vdev->num_analog_channels) {
-				vdev->capturefile = g_strdup_printf("analog-1-%d",
-						vdev->num_logic_channels + vdev->cur_analog_channel + 1);
-				vdev->cur_analog_channel++;
-				vdev->cur_chunk = 0;
-				return TRUE;
-			} else {
-				/* We got all the chunks, finish up. */
-				g_free(vdev->capturefile);
-
-				/* If the file has logic channels, the initial value for
-				 * capturefile is set by stream_session_data() - however only
-				 * once. In order to not mess this mechanism up, we simulate
-				 * this here if needed. For purely analog files, capturefile
-				 * is not set.
-				 */
-				if (vdev->num_logic_channels)
-					vdev->capturefile = g_strdup("logic-1");
-				else
-					vdev->capturefile = NULL;
-				return FALSE;
-			}
-		}
+	len = chunk->length - chunk->sent;
+	buf = chunk->data + chunk->sent;
+
+	if (chunk->analog_channel) {
+		enc = &vdev->analog_encodings[chunk->analog_channel - 1];
+		len = MIN(len, CHUNKSIZE / enc->unitsize * enc->unitsize);
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		sr_analog_init(&analog, &encoding, &meaning, &spec,
+			enc->digits);
+		/* Integers as they were captured, or floats. */
+		encoding = *enc;
+		analog.meaning->channels = g_slist_prepend(NULL,
+				g_array_index(vdev->analog_channels,
+					struct sr_channel *, chunk->analog_channel - 1));
+		analog.num_samples = len / enc->unitsize;
+		analog.meaning->mq = SR_MQ_VOLTAGE;
+		analog.meaning->unit = SR_UNIT_VOLT;
+		analog.meaning->mqflags = SR_MQFLAG_DC;
+		analog.data = buf;
+	} else if (vdev->unitsize) {
+		len = MIN(len, CHUNKSIZE / vdev->unitsize * vdev->unitsize);
+		if (len % vdev->unitsize != 0)
+			sr_warn("Read size %" PRIu64 " not a multiple of the"
+				" unit size %d.", len, vdev->unitsize);
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		logic.length = len;
+		logic.unitsize = vdev->unitsize;
+		logic.data = buf;
+	} else {
+		/*
+		 * Neither analog data, nor logic which has
+		 * unitsize, must be an unexpected API use.
+		 */
+		sr_warn("Neither analog nor logic data. Ignoring.");
+		chunk->sent = chunk->length;
+		return;
 	}
 
-	buf = g_malloc(CHUNKSIZE);
-
-	/* unitsize is not defined for purely analog session files. */
-	if (vdev->unitsize)
-		ret = zip_fread(vdev->capfile, buf,
-				CHUNKSIZE / vdev->unitsize * vdev->unitsize);
-	else
-		ret = zip_fread(vdev->capfile, buf, CHUNKSIZE);
-
-	if (ret > 0) {
-		if (vdev->cur_analog_channel != 0) {
-			got_data = TRUE;
-			packet.type = SR_DF_ANALOG;
-			packet.payload = &analog;
-			/* TODO: Use proper 'digits' value for this device (and its modes). */
-			sr_analog_init(&analog, &encoding, &meaning, &spec, 2);
-			analog.meaning->channels = g_slist_prepend(NULL,
-					g_array_index(vdev->analog_channels,
-						struct sr_channel *, vdev->cur_analog_channel - 1));
-			analog.num_samples = ret / sizeof(float);
-			analog.meaning->mq = SR_MQ_VOLTAGE;
-			analog.meaning->unit = SR_UNIT_VOLT;
-			analog.meaning->mqflags = SR_MQFLAG_DC;
-			analog.data = (float *) buf;
-		} else if (vdev->unitsize) {
-			got_data = TRUE;
-			if (ret % vdev->unitsize != 0)
-				sr_warn("Read size %d not a multiple of the"
-					" unit size %d.", ret, vdev->unitsize);
-			packet.type = SR_DF_LOGIC;
-			packet.payload = &logic;
-			logic.length = ret;
-			logic.unitsize = vdev->unitsize;
-			logic.data = buf;
-		} else {
-			/*
-			 * Neither analog data, nor logic which has
-			 * unitsize, must be an unexpected API use.
-			 */
-			sr_warn("Neither analog nor logic data. Ignoring.");
-		}
-		if (got_data) {
-			vdev->bytes_read += ret;
-			sr_session_send(sdi, &packet);
-		}
-	} else {
-		/* done with this capture file */
-		zip_fclose(vdev->capfile);
-		vdev->capfile = NULL;
-		if (vdev->cur_chunk != 0) {
-			/* There might be more chunks, so don't fall through
-			 * to the SR_DF_END here. */
-			got_data = TRUE;
-		}
+	chunk->sent += len;
+	vdev->bytes_read += len;
+	sr_session_send(sdi, &packet);
+	if (chunk->analog_channel)
+		g_slist_free(analog.meaning->channels);
+}
+
+/* Send the next piece of data, FALSE when there is no more. */
+static gboolean stream_session_data(struct sr_dev_inst *sdi)
+{
+	struct session_vdev *vdev;
+	struct replay_chunk *chunk;
+
+	vdev = sdi->priv;
+
+	if (vdev->next_send >= vdev->chunks->len)
+		return FALSE;
+	chunk = g_ptr_array_index(vdev->chunks, vdev->next_send);
+
+	/* Readahead keeps the workers busy, in the meantime wait here. */
+	g_mutex_lock(&vdev->mutex);
+	while (!chunk->done)
+		g_cond_wait(&vdev->cond, &vdev->mutex);
+	g_mutex_unlock(&vdev->mutex);
+
+	if (chunk->failed) {
+		sr_err("Failed to read '%s' from session file '%s'.",
+			chunk->name, vdev->sessionfile);
+		return FALSE;
+	}
+	sr_dbg("Sending %s.", chunk->name);
+
+	if (chunk->sent < chunk->length)
+		send_chunk_data(sdi, chunk);
+
+	if (chunk->sent >= chunk->length) {
+		g_free(chunk->data);
+		chunk->data = NULL;
+		g_mutex_lock(&vdev->mutex);
+		vdev->readahead -= chunk->length;
+		g_mutex_unlock(&vdev->mutex);
+		vdev->next_send++;
+		chunks_schedule(vdev);
 	}
-	g_free(buf);
 
-	return got_data;
+	return TRUE;
 }
 
 static int receive_data(int fd, int revents, void *cb_data)
@@ -216,14 +455,7 @@ static int receive_data(int fd, int revents, void *cb_data)
 	if (!vdev->finished)
 		return G_SOURCE_CONTINUE;
 
-	if (vdev->capfile) {
-		zip_fclose(vdev->capfile);
-		vdev->capfile = NULL;
-	}
-	if (vdev->archive) {
-		zip_discard(vdev->archive);
-		vdev->archive = NULL;
-	}
+	replay_stop(vdev);
 
 	std_session_send_df_end(sdi);
 
@@ -340,7 +572,6 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 
 	vdev = sdi->priv;
 	vdev->bytes_read = 0;
-	vdev->cur_analog_channel = 0;
 	vdev->analog_channels = g_array_sized_new(FALSE, FALSE,
 			sizeof(struct sr_channel *), vdev->num_analog_channels);
 	for (l = sdi->channels; l; l = l->next) {
@@ -348,7 +579,6 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 		if (ch->type == SR_CHANNEL_ANALOG)
 			g_array_append_val(vdev->analog_channels, ch);
 	}
-	vdev->cur_chunk = 0;
 	vdev->finished = FALSE;
 
 	sr_info("Opening archive %s file %s", vdev->sessionfile,
@@ -357,8 +587,13 @@ static int dev_acquisition_start(const struct sr_dev_inst *sdi)
 	if (!(vdev->archive = zip_open(vdev->sessionfile, 0, &ret))) {
 		sr_err("Failed to open session file '%s': "
 		       "zip error %d.", vdev->sessionfile, ret);
+		replay_stop(vdev);
 		return SR_ERR;
 	}
+	if ((ret = replay_start(vdev)) != SR_OK) {
+		replay_stop(vdev);
+		return ret;
+	}
 
 	std_session_send_df_header(sdi);
 
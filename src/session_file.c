@@ -111,33 +111,336 @@ SR_PRIV GKeyFile *sr_sessionfile_read_metadata(struct zip *archive,
 	return keyfile;
 }
 
-/** @private */
-SR_PRIV int sr_sessionfile_check(const char *filename)
+/**
+ * Get how the logic chunks of a device in a session file are encoded.
+ *
+ * @param[in] kf The session metadata.
+ * @param[in] devgroup The group of the device.
+ * @param[out] rle TRUE if the chunks are run-length encoded, see
+ *                 sr_sessionfile_rle_decode().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_DATA Unknown encoding.
+ *
+ * @private
+ */
+SR_PRIV int sr_sessionfile_logic_rle(GKeyFile *kf, const char *devgroup,
+		gboolean *rle)
 {
-	struct zip *archive;
-	struct zip_file *zf;
-	struct zip_stat zs;
-	uint64_t version;
+	char *encoding;
 	int ret;
-	char s[11];
 
-	if (!filename)
-		return SR_ERR_ARG;
+	*rle = FALSE;
+	encoding = g_key_file_get_string(kf, devgroup, "logic encoding", NULL);
+	if (!encoding)
+		return SR_OK;
 
-	if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
-		sr_err("Not a regular file: %s.", filename);
-		return SR_ERR;
+	ret = SR_OK;
+	if (!strcmp(encoding, SR_SESSIONFILE_RLE))
+		*rle = TRUE;
+	else if (strcmp(encoding, "raw") != 0) {
+		sr_err("Unknown logic data encoding '%s'.", encoding);
+		ret = SR_ERR_DATA;
 	}
+	g_free(encoding);
 
-	if (!(archive = zip_open(filename, 0, NULL)))
-		/* No logging: this can be used just to check if it's
-		 * a sigrok session file or not. */
-		return SR_ERR;
+	return ret;
+}
+
+static char *analog_key(int ch_nr, const char *what)
+{
+	return g_strdup_printf("analog%d %s", ch_nr, what);
+}
+
+static int rational_get(GKeyFile *kf, const char *devgroup, int ch_nr,
+		const char *what, struct sr_rational *r)
+{
+	char *key, *val;
+	int64_t p;
+	uint64_t q;
+	int ret;
+
+	key = analog_key(ch_nr, what);
+	val = g_key_file_get_string(kf, devgroup, key, NULL);
+	g_free(key);
+	if (!val)
+		return SR_OK;
+
+	ret = SR_ERR_DATA;
+	if (sscanf(val, "%" SCNd64 "/%" SCNu64, &p, &q) == 2 && q) {
+		sr_rational_set(r, p, q);
+		ret = SR_OK;
+	}
+	g_free(val);
+
+	return ret;
+}
+
+/**
+ * Store the encoding of the integer chunks of an analog channel.
+ *
+ * The encoding goes into "analogN encoding", as "int16le" and alike,
+ * the scale and offset into "analogN scale" and "analogN offset" as
+ * rationals like "1/256", and the digits into "analogN digits". Analog
+ * chunks without encoding are floats in host order.
+ *
+ * @param[in] kf The session metadata.
+ * @param[in] devgroup The group of the device.
+ * @param[in] ch_nr The 1-based number of the channel.
+ * @param[in] enc The encoding, of integers.
+ *
+ * @private
+ */
+SR_PRIV void sr_sessionfile_analog_encoding_set(GKeyFile *kf,
+		const char *devgroup, int ch_nr,
+		const struct sr_analog_encoding *enc)
+{
+	char *key, *val;
+
+	key = analog_key(ch_nr, "encoding");
+	val = g_strdup_printf("%sint%d%s", enc->is_signed ? "" : "u",
+		enc->unitsize * 8, enc->unitsize == 1 ? "" :
+		enc->is_bigendian ? "be" : "le");
+	g_key_file_set_string(kf, devgroup, key, val);
+	g_free(val);
+	g_free(key);
+
+	key = analog_key(ch_nr, "scale");
+	val = g_strdup_printf("%" PRId64 "/%" PRIu64,
+		enc->scale.p, enc->scale.q);
+	g_key_file_set_string(kf, devgroup, key, val);
+	g_free(val);
+	g_free(key);
+
+	key = analog_key(ch_nr, "offset");
+	val = g_strdup_printf("%" PRId64 "/%" PRIu64,
+		enc->offset.p, enc->offset.q);
+	g_key_file_set_string(kf, devgroup, key, val);
+	g_free(val);
+	g_free(key);
+
+	key = analog_key(ch_nr, "digits");
+	g_key_file_set_integer(kf, devgroup, key, enc->digits);
+	g_free(key);
+}
+
+/**
+ * Get the encoding of the chunks of an analog channel.
+ *
+ * See sr_sessionfile_analog_encoding_set().
+ *
+ * @param[in] kf The session metadata.
+ * @param[in] devgroup The group of the device.
+ * @param[in] ch_nr The 1-based number of the channel.
+ * @param[out] enc The encoding, host order floats for channels without.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_DATA Unknown encoding.
+ *
+ * @private
+ */
+SR_PRIV int sr_sessionfile_analog_encoding(GKeyFile *kf,
+		const char *devgroup, int ch_nr, struct sr_analog_encoding *enc)
+{
+	char *key, *val, *end;
+	const char *p;
+	uint64_t bits;
+	int ret;
+
+	memset(enc, 0, sizeof(*enc));
+	enc->unitsize = sizeof(float);
+	enc->is_signed = TRUE;
+	enc->is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	enc->is_bigendian = TRUE;
+#endif
+	/* What the session driver always used for floats. */
+	enc->digits = 2;
+	enc->is_digits_decimal = TRUE;
+	sr_rational_set(&enc->scale, 1, 1);
+	sr_rational_set(&enc->offset, 0, 1);
+
+	key = analog_key(ch_nr, "encoding");
+	val = g_key_file_get_string(kf, devgroup, key, NULL);
+	g_free(key);
+	if (!val)
+		return SR_OK;
+
+	ret = SR_ERR_DATA;
+	p = val;
+	enc->is_signed = *p != 'u';
+	if (*p == 'u')
+		p++;
+	if (g_str_has_prefix(p, "int")) {
+		bits = g_ascii_strtoull(p + 3, &end, 10);
+		enc->is_bigendian = !strcmp(end, "be");
+		if ((bits == 8 && !*end) || ((bits == 16 || bits == 32 ||
+				bits == 64) && (!strcmp(end, "le") ||
+				enc->is_bigendian))) {
+			enc->unitsize = bits / 8;
+			enc->is_float = FALSE;
+			ret = SR_OK;
+		}
+	}
+	if (ret != SR_OK)
+		sr_err("Unknown analog data encoding '%s'.", val);
+	g_free(val);
+	if (ret != SR_OK)
+		return ret;
+
+	if (rational_get(kf, devgroup, ch_nr, "scale", &enc->scale) != SR_OK ||
+			rational_get(kf, devgroup, ch_nr, "offset",
+			&enc->offset) != SR_OK) {
+		sr_err("Invalid analog data scale or offset.");
+		return SR_ERR_DATA;
+	}
+	key = analog_key(ch_nr, "digits");
+	if (g_key_file_has_key(kf, devgroup, key, NULL))
+		enc->digits = g_key_file_get_integer(kf, devgroup, key, NULL);
+	g_free(key);
+
+	return SR_OK;
+}
+
+/**
+ * Decode a run-length encoded logic chunk.
+ *
+ * The chunk starts with its number of samples, as a little endian
+ * uint64_t. Runs of the same sample follow, each the length of the run,
+ * a LEB128 number, and the sample.
+ *
+ * @param[in] src The chunk.
+ * @param[in] len Size of the chunk in bytes.
+ * @param[in] unitsize Size of each sample in bytes.
+ * @param[out] samples Newly allocated samples, free them with g_free().
+ * @param[out] num_samples Number of samples.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_DATA Malformed chunk.
+ * @retval SR_ERR_MALLOC Memory allocation error.
+ *
+ * @private
+ */
+SR_PRIV int sr_sessionfile_rle_decode(const uint8_t *src, uint64_t len,
+		unsigned int unitsize, uint8_t **samples, uint64_t *num_samples)
+{
+	const uint8_t *end;
+	uint8_t *dst, *wrptr;
+	uint64_t count, run, left, copied, n;
+	unsigned int shift;
+
+	if (len < SR_SESSIONFILE_RLE_HEADER || !unitsize)
+		return SR_ERR_DATA;
+	count = RL64(src);
+	if (count > G_MAXSIZE / unitsize)
+		return SR_ERR_DATA;
+	if (!(dst = g_try_malloc(MAX(count * unitsize, 1))))
+		return SR_ERR_MALLOC;
+
+	end = src + len;
+	src += SR_SESSIONFILE_RLE_HEADER;
+	wrptr = dst;
+	left = count;
+	while (src < end) {
+		run = 0;
+		for (shift = 0; src < end && shift < 64; shift += 7) {
+			run |= (uint64_t)(*src & 0x7f) << shift;
+			if (!(*src++ & 0x80))
+				break;
+		}
+		if (!run || run > left || (uint64_t)(end - src) < unitsize)
+			break;
+		memcpy(wrptr, src, unitsize);
+		src += unitsize;
+		/* Double what was copied, until the run is filled. */
+		for (copied = 1; copied < run; copied += n) {
+			n = MIN(copied, run - copied);
+			memcpy(wrptr + copied * unitsize, wrptr, n * unitsize);
+		}
+		wrptr += run * unitsize;
+		left -= run;
+	}
+	if (src != end || left) {
+		g_free(dst);
+		return SR_ERR_DATA;
+	}
+
+	*samples = dst;
+	*num_samples = count;
+
+	return SR_OK;
+}
+
+/**
+ * Map the names of all entries of a session archive to their index.
+ *
+ * Looking up many chunks by name this way doesn't depend on how libzip
+ * locates names.
+ *
+ * @param[in] archive An open ZIP archive. The names in the table are
+ *                    valid as long as the archive is open.
+ *
+ * @return A new table, free it with g_hash_table_destroy().
+ *
+ * @private
+ */
+SR_PRIV GHashTable *sr_sessionfile_entries(struct zip *archive)
+{
+	GHashTable *entries;
+	const char *name;
+	zip_int64_t num, i;
+
+	entries = g_hash_table_new(g_str_hash, g_str_equal);
+	num = zip_get_num_entries(archive, 0);
+	for (i = 0; i < num; i++) {
+		if ((name = zip_get_name(archive, i, 0)))
+			g_hash_table_insert(entries, (gpointer)name,
+				GSIZE_TO_POINTER(i + 1));
+	}
+
+	return entries;
+}
+
+/**
+ * Find an entry in a table from sr_sessionfile_entries().
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_sessionfile_entry_find(GHashTable *entries,
+		const char *name, uint64_t *index)
+{
+	gsize value;
+
+	value = GPOINTER_TO_SIZE(g_hash_table_lookup(entries, name));
+	if (!value)
+		return FALSE;
+	*index = value - 1;
+
+	return TRUE;
+}
+
+/**
+ * Check the version of an open session archive.
+ *
+ * @param[in] archive An open ZIP archive.
+ * @param[out] version The version of the session file format. Can be NULL.
+ *
+ * @retval SR_OK A session file this version of libsigrok can read.
+ * @retval SR_ERR Not a session file, or an unsupported version.
+ *
+ * @private
+ */
+SR_PRIV int sr_sessionfile_version(struct zip *archive, uint64_t *version)
+{
+	struct zip_file *zf;
+	struct zip_stat zs;
+	uint64_t v;
+	int ret;
+	char s[11];
 
 	/* check "version" */
 	if (!(zf = zip_fopen(archive, "version", 0))) {
 		sr_dbg("Not a sigrok session file: no version found.");
-		zip_discard(archive);
 		return SR_ERR;
 	}
 	ret = zip_fread(zf, s, sizeof(s) - 1);
@@ -145,31 +448,54 @@ SR_PRIV int sr_sessionfile_check(const char *filename)
 		sr_err("Failed to read version file: %s",
 			zip_file_strerror(zf));
 		zip_fclose(zf);
-		zip_discard(archive);
 		return SR_ERR;
 	}
 	zip_fclose(zf);
 	s[ret] = '\0';
-	version = g_ascii_strtoull(s, NULL, 10);
-	if (version == 0 || version > 2) {
+	v = g_ascii_strtoull(s, NULL, 10);
+	if (v == 0 || v > 4) {
 		sr_dbg("Cannot handle sigrok session file version %" PRIu64 ".",
-			version);
-		zip_discard(archive);
+			v);
 		return SR_ERR;
 	}
-	sr_spew("Detected sigrok session file version %" PRIu64 ".", version);
+	sr_spew("Detected sigrok session file version %" PRIu64 ".", v);
 
 	/* read "metadata" */
 	if (zip_stat(archive, "metadata", 0, &zs) < 0) {
 		sr_dbg("Not a valid sigrok session file.");
-		zip_discard(archive);
 		return SR_ERR;
 	}
-	zip_discard(archive);
+	if (version)
+		*version = v;
 
 	return SR_OK;
 }
 
+/** @private */
+SR_PRIV int sr_sessionfile_check(const char *filename)
+{
+	struct zip *archive;
+	int ret;
+
+	if (!filename)
+		return SR_ERR_ARG;
+
+	if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+		sr_err("Not a regular file: %s.", filename);
+		return SR_ERR;
+	}
+
+	if (!(archive = zip_open(filename, 0, NULL)))
+		/* No logging: this can be used just to check if it's
+		 * a sigrok session file or not. */
+		return SR_ERR;
+
+	ret = sr_sessionfile_version(archive, NULL);
+	zip_discard(archive);
+
+	return ret;
+}
+
 /** @private */
 SR_PRIV struct sr_dev_inst *sr_session_prepare_sdi(const char *filename, struct sr_session **session)
 {
@@ -218,9 +544,9 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 	int total_channels, total_analog, k;
 	GSList *l;
 	int unitsize;
-	char **sections, **keys, *val;
+	char **sections, **keys, *val, *end;
 	char channelname[SR_MAX_CHANNELNAME_LEN + 1];
-	gboolean file_has_logic;
+	gboolean file_has_logic, rle;
 
 	if ((ret = sr_sessionfile_check(filename)) != SR_OK)
 		return ret;
@@ -299,6 +625,13 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 					}
 					sr_config_set(sdi, NULL, SR_CONF_CAPTURE_UNITSIZE,
 							g_variant_new_uint64(unitsize));
+				} else if (!strcmp(keys[j], "logic encoding")) {
+					/* The session driver decodes it. */
+					if (sr_sessionfile_logic_rle(kf, sections[i],
+							&rle) != SR_OK) {
+						ret = SR_ERR_DATA;
+						break;
+					}
 				} else if (!strcmp(keys[j], "total probes")) {
 					total_channels = g_key_file_get_integer(kf,
 							sections[i], keys[j], &error);
@@ -351,7 +684,10 @@ SR_API int sr_session_load(struct sr_context *ctx, const char *filename,
 					g_free(val);
 					sr_dev_channel_enable(ch, TRUE);
 				} else if (!strncmp(keys[j], "analog", 6)) {
-					tmp_u64 = g_ascii_strtoull(keys[j]+6, NULL, 10);
+					tmp_u64 = g_ascii_strtoull(keys[j]+6, &end, 10);
+					/* "analogN encoding" and alike are for the session driver. */
+					if (*end == ' ')
+						continue;
 					if (!sdi || tmp_u64 == 0 || tmp_u64 > G_MAXINT) {
 						ret = SR_ERR_DATA;
 						break;
@@ -0,0 +1,1214 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <zip.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session-file"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Random access to the samples of session files.
+ *
+ * Opening a session file indexes the sample range of each of its logic
+ * chunks. Reading a range of samples then only touches the chunks that
+ * hold it. Chunks stored without compression are read straight from a
+ * mapping of the file, compressed ones are decompressed on their own.
+ *
+ * Files written with the srzip output module's "summary" option also
+ * have summaries of blocks of samples, on levels of increasing block
+ * size. They tell which logic channels change within a block, and the
+ * range of analog values in it, without reading the samples.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+#define ZIP_LOCAL_HEADER	0x04034b50
+#define ZIP_CENTRAL_HEADER	0x02014b50
+#define ZIP64_END_LOCATOR	0x07064b50
+#define ZIP64_END_RECORD	0x06064b50
+#define ZIP_END_RECORD		0x06054b50
+
+#define SUMMARY_VERSION		1
+#define SUMMARY_HEADER_SIZE	16
+/* Samples read at once when looking for an edge. */
+#define EDGE_SCAN_SAMPLES	(64 * 1024)
+
+struct file_chunk {
+	char *name;
+	uint64_t index;
+	uint64_t first_sample;
+	uint64_t num_samples;
+	/* Where the chunk entry is in the mapping, if stored. */
+	const uint8_t *data;
+	uint64_t size;
+};
+
+/* A summary entry, see the srzip output module for the format. */
+struct file_summary {
+	/* The entry, or NULL if there is none. */
+	uint8_t *data;
+	unsigned int shift;
+	uint64_t num_samples;
+	size_t record_size;
+};
+
+struct sr_session_file {
+	struct zip *archive;
+	uint64_t version;
+	uint64_t samplerate;
+	/* Names of the logic channels, by their bit in a sample. */
+	int num_logic;
+	char **logic_names;
+	/* Index of each entry of the archive, by name. */
+	GHashTable *entries;
+	GMappedFile *mapping;
+	uint16_t unitsize;
+	/* Logic chunks are run-length encoded. */
+	gboolean rle;
+	uint64_t num_samples;
+	/* struct file_chunk, by their first sample. */
+	GArray *chunks;
+	/* The last compressed chunk that was read. */
+	int cached;
+	uint8_t *cache;
+	struct file_summary logic_summary;
+	int num_analog;
+	struct file_summary *analog_summary;
+};
+
+/* Find the central directory of the mapped archive. */
+static gboolean central_dir_find(const uint8_t *map, uint64_t len,
+		uint64_t *cd_offset, uint64_t *num_entries)
+{
+	const uint8_t *p, *end;
+	uint64_t rec;
+
+	if (len < 22)
+		return FALSE;
+
+	/* The end record, followed by a comment of up to 64 KiB. */
+	end = NULL;
+	for (p = map + len - 22; p >= map && map + len - p <= 0xffff + 22; p--) {
+		if (RL32(p) == ZIP_END_RECORD) {
+			end = p;
+			break;
+		}
+	}
+	if (!end)
+		return FALSE;
+	*cd_offset = RL32(end + 16);
+	*num_entries = RL16(end + 10);
+
+	/* ZIP64 records hold the real values. */
+	if (end - map >= 20 && RL32(end - 20) == ZIP64_END_LOCATOR) {
+		rec = RL64(end - 20 + 8);
+		if (len < 56 || rec > len - 56 ||
+				RL32(map + rec) != ZIP64_END_RECORD)
+			return FALSE;
+		*num_entries = RL64(map + rec + 32);
+		*cd_offset = RL64(map + rec + 48);
+	}
+
+	return *cd_offset < len;
+}
+
+/* Get the data of an entry from its local header, if it is all there. */
+static const uint8_t *entry_data(const uint8_t *map, uint64_t len,
+		uint64_t loc, uint64_t size)
+{
+	uint64_t data;
+
+	if (len < 30 || loc > len - 30 || RL32(map + loc) != ZIP_LOCAL_HEADER)
+		return NULL;
+	data = loc + 30 + RL16(map + loc + 26) + RL16(map + loc + 28);
+	if (data > len || size > len - data)
+		return NULL;
+
+	return map + data;
+}
+
+/*
+ * Find the data of all entries stored without compression, by name, in
+ * the mapped archive.
+ */
+static GHashTable *stored_entries(const uint8_t *map, uint64_t len)
+{
+	GHashTable *entries;
+	const uint8_t *cd, *extra, *field, *data;
+	uint64_t offset, num_entries, i, usize, csize, loc;
+	size_t namelen, extralen, commentlen, j, fieldlen;
+
+	entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	if (!central_dir_find(map, len, &offset, &num_entries))
+		return entries;
+
+	for (i = 0; i < num_entries; i++) {
+		if (len < 46 || offset > len - 46)
+			break;
+		cd = map + offset;
+		if (RL32(cd) != ZIP_CENTRAL_HEADER)
+			break;
+		namelen = RL16(cd + 28);
+		extralen = RL16(cd + 30);
+		commentlen = RL16(cd + 32);
+		if (namelen + extralen + commentlen > len - offset - 46)
+			break;
+		offset += 46 + namelen + extralen + commentlen;
+		if (RL16(cd + 10) != 0)
+			continue;
+
+		usize = RL32(cd + 24);
+		csize = RL32(cd + 20);
+		loc = RL32(cd + 42);
+		/* ZIP64 extra field, with just the values that didn't fit. */
+		extra = cd + 46 + namelen;
+		for (j = 0; j + 4 <= extralen; j += 4 + fieldlen) {
+			fieldlen = RL16(extra + j + 2);
+			if (RL16(extra + j) != 0x0001 ||
+					j + 4 + fieldlen > extralen)
+				continue;
+			field = extra + j + 4;
+			if (usize == 0xffffffff && fieldlen >= 8) {
+				usize = RL64(field);
+				field += 8;
+				fieldlen -= 8;
+			}
+			if (csize == 0xffffffff && fieldlen >= 8) {
+				csize = RL64(field);
+				field += 8;
+				fieldlen -= 8;
+			}
+			if (loc == 0xffffffff && fieldlen >= 8)
+				loc = RL64(field);
+			break;
+		}
+		if (usize != csize || !(data = entry_data(map, len, loc, usize)))
+			continue;
+
+		g_hash_table_insert(entries,
+			g_strndup((const char *)cd + 46, namelen), (gpointer)data);
+	}
+
+	return entries;
+}
+
+static void chunk_clear(struct file_chunk *chunk)
+{
+	g_free(chunk->name);
+}
+
+/* Get the number of samples of a run-length encoded chunk. */
+static gboolean rle_num_samples(struct sr_session_file *f,
+		const struct file_chunk *chunk, uint64_t *num_samples)
+{
+	uint8_t header[SR_SESSIONFILE_RLE_HEADER];
+	struct zip_file *zf;
+	zip_int64_t ret;
+
+	if (chunk->data) {
+		if (chunk->size < sizeof(header))
+			return FALSE;
+		*num_samples = RL64(chunk->data);
+		return TRUE;
+	}
+
+	/* Only the start of the entry gets decompressed. */
+	if (!(zf = zip_fopen_index(f->archive, chunk->index, 0)))
+		return FALSE;
+	ret = zip_fread(zf, header, sizeof(header));
+	zip_fclose(zf);
+	if (ret != sizeof(header))
+		return FALSE;
+	*num_samples = RL64(header);
+
+	return TRUE;
+}
+
+/* Index the logic chunks, the same ones the session driver replays. */
+static void chunks_index(struct sr_session_file *f, const char *capturefile)
+{
+	struct file_chunk chunk;
+	struct zip_stat zs;
+	GHashTable *stored;
+	int n;
+
+	stored = NULL;
+	if (f->mapping)
+		stored = stored_entries(
+			(const uint8_t *)g_mapped_file_get_contents(f->mapping),
+			g_mapped_file_get_length(f->mapping));
+
+	for (n = 1; ; n++) {
+		chunk.name = g_strdup_printf("%s-%d", capturefile, n);
+		if (!sr_sessionfile_entry_find(f->entries, chunk.name,
+				&chunk.index)) {
+			g_free(chunk.name);
+			/* Old files have one chunk, named like the capture. */
+			if (n > 1 || !sr_sessionfile_entry_find(f->entries,
+					capturefile, &chunk.index))
+				break;
+			chunk.name = g_strdup(capturefile);
+		}
+		if (zip_stat_index(f->archive, chunk.index, 0, &zs) < 0) {
+			g_free(chunk.name);
+			break;
+		}
+		chunk.first_sample = f->num_samples;
+		chunk.size = zs.size;
+		chunk.data = NULL;
+		if (stored && zs.comp_method == ZIP_CM_STORE)
+			chunk.data = g_hash_table_lookup(stored, chunk.name);
+		if (!f->rle) {
+			if (zs.size % f->unitsize != 0)
+				sr_warn("Chunk '%s' not a multiple of the unit size.",
+					chunk.name);
+			chunk.num_samples = zs.size / f->unitsize;
+		} else if (!rle_num_samples(f, &chunk, &chunk.num_samples)) {
+			sr_warn("Cannot read chunk '%s'.", chunk.name);
+			chunk.num_samples = 0;
+		}
+		g_array_append_val(f->chunks, chunk);
+		f->num_samples += chunk.num_samples;
+
+		if (!strcmp(chunk.name, capturefile))
+			break;
+	}
+
+	if (stored)
+		g_hash_table_destroy(stored);
+}
+
+/* Get the number of blocks on a level, and where the level starts. */
+static gboolean summary_level(const struct file_summary *s,
+		unsigned int level, uint64_t *first, uint64_t *count)
+{
+	unsigned int k;
+
+	*first = 0;
+	*count = ((s->num_samples - 1) >> s->shift) + 1;
+	for (k = 0; k < level; k++) {
+		if (*count <= 1)
+			return FALSE;
+		*first += *count;
+		*count = (*count + 1) / 2;
+	}
+
+	return TRUE;
+}
+
+static void summary_load(struct sr_session_file *f, const char *name,
+		size_t record_size, struct file_summary *s)
+{
+	struct zip_stat zs;
+	struct zip_file *zf;
+	uint64_t index, first, count, total;
+	zip_int64_t ret;
+	unsigned int level;
+
+	if (!sr_sessionfile_entry_find(f->entries, name, &index) ||
+			zip_stat_index(f->archive, index, 0, &zs) < 0)
+		return;
+	if (zs.size < SUMMARY_HEADER_SIZE || !(s->data = g_try_malloc(zs.size)))
+		goto bad;
+	if (!(zf = zip_fopen_index(f->archive, zs.index, 0)))
+		goto bad;
+	ret = zip_fread(zf, s->data, zs.size);
+	zip_fclose(zf);
+	if (ret < 0 || (uint64_t)ret != zs.size)
+		goto bad;
+
+	s->shift = RL32(s->data + 4);
+	s->num_samples = RL64(s->data + 8);
+	s->record_size = record_size;
+	if (RL32(s->data) != SUMMARY_VERSION || s->shift >= 48 ||
+			!s->num_samples || !record_size)
+		goto bad;
+	/* The levels must fill the entry exactly. */
+	total = 0;
+	for (level = 0; summary_level(s, level, &first, &count); level++)
+		total += count;
+	if ((zs.size - SUMMARY_HEADER_SIZE) / record_size != total ||
+			(zs.size - SUMMARY_HEADER_SIZE) % record_size != 0)
+		goto bad;
+
+	return;
+
+bad:
+	sr_warn("Ignoring malformed summary '%s'.", name);
+	g_free(s->data);
+	s->data = NULL;
+}
+
+static void file_free(struct sr_session_file *f)
+{
+	int i;
+
+	if (f->entries)
+		g_hash_table_destroy(f->entries);
+	if (f->archive)
+		zip_discard(f->archive);
+	if (f->mapping)
+		g_mapped_file_unref(f->mapping);
+	if (f->chunks)
+		g_array_free(f->chunks, TRUE);
+	g_free(f->cache);
+	g_free(f->logic_summary.data);
+	for (i = 0; f->analog_summary && i < f->num_analog; i++)
+		g_free(f->analog_summary[i].data);
+	g_free(f->analog_summary);
+	for (i = 0; i < f->num_logic; i++)
+		g_free(f->logic_names[i]);
+	g_free(f->logic_names);
+	g_free(f);
+}
+
+/*
+ * Open a session file and index its logic chunks. Only what the chunk
+ * headers tell is read, unless the data is to be accessed.
+ */
+static int file_open(const char *filename, gboolean access,
+		struct sr_session_file **file, GKeyFile **metadata)
+{
+	struct sr_session_file *f;
+	struct zip_stat zs;
+	GKeyFile *kf;
+	GError *error;
+	char *capturefile, *name;
+	int unitsize, total_probes, first_analog, i, ret;
+
+	if (!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+		sr_err("Not a regular file: %s.", filename);
+		return SR_ERR;
+	}
+
+	f = g_malloc0(sizeof(*f));
+	f->cached = -1;
+	if (!(f->archive = zip_open(filename, 0, NULL)) ||
+			sr_sessionfile_version(f->archive, &f->version) != SR_OK) {
+		file_free(f);
+		return SR_ERR;
+	}
+	if (zip_stat(f->archive, "metadata", 0, &zs) < 0 ||
+			!(kf = sr_sessionfile_read_metadata(f->archive, &zs))) {
+		file_free(f);
+		return SR_ERR_DATA;
+	}
+
+	/* Only the first device holds logic data. */
+	capturefile = g_key_file_get_string(kf, "device 1", "capturefile", NULL);
+	error = NULL;
+	unitsize = g_key_file_get_integer(kf, "device 1", "unitsize", &error);
+	total_probes = g_key_file_get_integer(kf, "device 1", "total probes", NULL);
+	f->num_analog = g_key_file_get_integer(kf, "device 1", "total analog", NULL);
+	ret = sr_sessionfile_logic_rle(kf, "device 1", &f->rle);
+	if (ret != SR_OK) {
+		g_free(capturefile);
+		g_clear_error(&error);
+		g_key_file_free(kf);
+		file_free(f);
+		return ret;
+	}
+	if (capturefile && (error || unitsize <= 0 || unitsize > G_MAXUINT16)) {
+		g_free(capturefile);
+		capturefile = NULL;
+	}
+	g_clear_error(&error);
+	f->num_analog = MAX(f->num_analog, 0);
+	if (!capturefile && !f->num_analog) {
+		g_key_file_free(kf);
+		file_free(f);
+		return SR_ERR_NA;
+	}
+	if (capturefile)
+		f->unitsize = unitsize;
+	name = g_key_file_get_string(kf, "device 1", "samplerate", NULL);
+	if (name && sr_parse_sizestring(name, &f->samplerate) != SR_OK)
+		f->samplerate = 0;
+	g_free(name);
+	if (capturefile && total_probes > 0) {
+		f->num_logic = MIN(total_probes, 8 * f->unitsize);
+		f->logic_names = g_new0(char *, f->num_logic);
+		for (i = 0; i < f->num_logic; i++) {
+			name = g_strdup_printf("probe%d", i + 1);
+			f->logic_names[i] = g_key_file_get_string(kf,
+				"device 1", name, NULL);
+			g_free(name);
+		}
+	}
+
+	/* Without a mapping, all chunks are read through the archive. */
+	if (access) {
+		error = NULL;
+		f->mapping = g_mapped_file_new(filename, FALSE, &error);
+		if (!f->mapping) {
+			sr_dbg("Cannot map session file: %s.", error->message);
+			g_error_free(error);
+		}
+	}
+
+	f->entries = sr_sessionfile_entries(f->archive);
+	f->chunks = g_array_new(FALSE, FALSE, sizeof(struct file_chunk));
+	g_array_set_clear_func(f->chunks, (GDestroyNotify)chunk_clear);
+	if (capturefile)
+		chunks_index(f, capturefile);
+	if (capturefile && access) {
+		name = g_strdup_printf("summary-%s", capturefile);
+		summary_load(f, name, 2 * f->unitsize, &f->logic_summary);
+		g_free(name);
+		if (f->logic_summary.data &&
+				f->logic_summary.num_samples != f->num_samples) {
+			sr_warn("Ignoring summary of other logic data.");
+			g_free(f->logic_summary.data);
+			f->logic_summary.data = NULL;
+		}
+	}
+	g_free(capturefile);
+
+	/* Analog channels are numbered after all logic channels. */
+	first_analog = f->unitsize ? total_probes + 1 : 1;
+	f->analog_summary = g_new0(struct file_summary, f->num_analog);
+	for (i = 0; access && i < f->num_analog; i++) {
+		name = g_strdup_printf("summary-analog-1-%d", first_analog + i);
+		summary_load(f, name, 2 * sizeof(float), &f->analog_summary[i]);
+		g_free(name);
+	}
+
+	if (metadata)
+		*metadata = kf;
+	else
+		g_key_file_free(kf);
+	*file = f;
+
+	return SR_OK;
+}
+
+/**
+ * Open a session file for random access to its logic samples.
+ *
+ * The file is indexed by the sample ranges of its chunks. Chunks that
+ * were stored without compression are read directly from a mapping of
+ * the file, others are decompressed one at a time when read. Reading
+ * the end of a large file doesn't decode what comes before it.
+ *
+ * Session files written with the srzip output module's "store"
+ * compression get the fastest access. Files with only analog data can
+ * be opened for their summaries.
+ *
+ * @param filename The session file. Must not be NULL.
+ * @param file Newly opened session file, close it with
+ *             sr_session_file_close(). Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_DATA Malformed session file, or unknown encoding.
+ * @retval SR_ERR_NA The session file has neither logic nor analog data.
+ * @retval SR_ERR Not a session file.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_open(const char *filename,
+		struct sr_session_file **file)
+{
+	if (!filename || !file)
+		return SR_ERR_ARG;
+
+	return file_open(filename, TRUE, file, NULL);
+}
+
+/**
+ * Get the properties of a session file, without opening its data.
+ *
+ * Only the archive directory, the metadata and, for run-length encoded
+ * logic data, the headers of the chunks are read. Meant for showing
+ * what files hold, without the cost of sr_session_load() or
+ * sr_session_file_open().
+ *
+ * @param filename The session file. Must not be NULL.
+ * @param info Filled in with the properties of the file. Must not be
+ *             NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_DATA Malformed session file, or unknown encoding.
+ * @retval SR_ERR_NA The session file has neither logic nor analog data.
+ * @retval SR_ERR Not a session file.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_probe(const char *filename,
+		struct sr_session_file_info *info)
+{
+	struct sr_session_file *f;
+	GKeyFile *kf;
+	int ret;
+
+	if (!filename || !info)
+		return SR_ERR_ARG;
+
+	if ((ret = file_open(filename, FALSE, &f, &kf)) != SR_OK)
+		return ret;
+
+	memset(info, 0, sizeof(*info));
+	info->version = f->version;
+	info->num_samples = f->num_samples;
+	info->unitsize = f->unitsize;
+	info->num_logic_channels = MAX(0, g_key_file_get_integer(kf,
+		"device 1", "total probes", NULL));
+	info->num_analog_channels = f->num_analog;
+	info->samplerate = f->samplerate;
+
+	g_key_file_free(kf);
+	file_free(f);
+
+	return SR_OK;
+}
+
+/**
+ * Close a session file opened with sr_session_file_open().
+ *
+ * @param file The session file. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_file_close(struct sr_session_file *file)
+{
+	if (!file)
+		return;
+
+	file_free(file);
+}
+
+/**
+ * Get the size of the logic data of a session file.
+ *
+ * @param file The session file. Must not be NULL.
+ * @param num_samples Number of logic samples in the file. Must not be NULL.
+ * @param unitsize Size of each sample in bytes. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_logic_info(struct sr_session_file *file,
+		uint64_t *num_samples, uint16_t *unitsize)
+{
+	if (!file || !num_samples)
+		return SR_ERR_ARG;
+
+	*num_samples = file->num_samples;
+	if (unitsize)
+		*unitsize = file->unitsize;
+
+	return SR_OK;
+}
+
+/* Find the chunk holding a sample. */
+static int chunk_find(const struct sr_session_file *f, uint64_t sample)
+{
+	const struct file_chunk *chunk;
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = f->chunks->len - 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		chunk = &g_array_index(f->chunks, struct file_chunk, mid);
+		if (chunk->first_sample <= sample)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+/* Read a whole chunk entry, decompressing it. */
+static int chunk_read(struct sr_session_file *f,
+		const struct file_chunk *chunk, uint8_t **buf)
+{
+	struct zip_file *zf;
+	zip_int64_t ret;
+
+	if (!(*buf = g_try_malloc(MAX(chunk->size, 1)))) {
+		sr_err("Cannot allocate buffer for chunk '%s'.", chunk->name);
+		return SR_ERR_MALLOC;
+	}
+	if (!(zf = zip_fopen_index(f->archive, chunk->index, 0))) {
+		sr_err("Cannot open chunk '%s': %s.", chunk->name,
+			zip_strerror(f->archive));
+		return SR_ERR_DATA;
+	}
+	ret = zip_fread(zf, *buf, chunk->size);
+	zip_fclose(zf);
+	if (ret < 0 || (uint64_t)ret != chunk->size) {
+		sr_err("Cannot read chunk '%s'.", chunk->name);
+		return SR_ERR_DATA;
+	}
+
+	return SR_OK;
+}
+
+/* Get the samples of a chunk that isn't stored as is, decoding it. */
+static int chunk_decode(struct sr_session_file *f, int idx,
+		const uint8_t **data)
+{
+	struct file_chunk *chunk;
+	uint8_t *buf;
+	const uint8_t *entry;
+	uint64_t num_samples;
+	int ret;
+
+	if (f->cached == idx) {
+		*data = f->cache;
+		return SR_OK;
+	}
+
+	chunk = &g_array_index(f->chunks, struct file_chunk, idx);
+	g_free(f->cache);
+	f->cache = NULL;
+	f->cached = -1;
+
+	buf = NULL;
+	entry = chunk->data;
+	ret = SR_OK;
+	if (!entry) {
+		ret = chunk_read(f, chunk, &buf);
+		entry = buf;
+	}
+	if (ret == SR_OK && f->rle) {
+		ret = sr_sessionfile_rle_decode(entry, chunk->size, f->unitsize,
+			&f->cache, &num_samples);
+		if (ret == SR_OK && num_samples != chunk->num_samples)
+			ret = SR_ERR_DATA;
+		if (ret == SR_ERR_DATA)
+			sr_err("Malformed chunk '%s'.", chunk->name);
+		g_free(buf);
+	} else if (ret == SR_OK) {
+		f->cache = buf;
+	} else {
+		g_free(buf);
+	}
+	if (ret != SR_OK) {
+		g_free(f->cache);
+		f->cache = NULL;
+		return ret;
+	}
+	f->cached = idx;
+	*data = f->cache;
+
+	return SR_OK;
+}
+
+/**
+ * Read logic samples of a session file.
+ *
+ * Only the chunks holding the samples are read. The last compressed
+ * or run-length encoded chunk read is kept decoded, so consecutive
+ * reads within it are cheap. Not safe to call from several threads on the same file.
+ *
+ * @param file The session file. Must not be NULL.
+ * @param start Index of the first sample to read.
+ * @param count Number of samples to read.
+ * @param dest Buffer for count samples of the file's unit size. Must
+ *             not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or samples out of range.
+ * @retval SR_ERR_MALLOC Memory allocation error.
+ * @retval SR_ERR_DATA A chunk can't be read.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_logic_read(struct sr_session_file *file,
+		uint64_t start, uint64_t count, void *dest)
+{
+	const struct file_chunk *chunk;
+	const uint8_t *data;
+	uint8_t *wrptr;
+	uint64_t offset, num;
+	int idx, ret;
+
+	if (!file || !dest)
+		return SR_ERR_ARG;
+	if (start > file->num_samples || count > file->num_samples - start)
+		return SR_ERR_ARG;
+	if (!count)
+		return SR_OK;
+
+	wrptr = dest;
+	idx = chunk_find(file, start);
+	while (count) {
+		chunk = &g_array_index(file->chunks, struct file_chunk, idx);
+		offset = start - chunk->first_sample;
+		num = MIN(count, chunk->num_samples - offset);
+		if (num) {
+			data = chunk->data;
+			if ((!data || file->rle) &&
+					(ret = chunk_decode(file, idx, &data)) != SR_OK)
+				return ret;
+			memcpy(wrptr, data + offset * file->unitsize,
+				num * file->unitsize);
+			wrptr += num * file->unitsize;
+			start += num;
+			count -= num;
+		}
+		idx++;
+	}
+
+	return SR_OK;
+}
+
+static int export_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet,
+		sr_output_write_callback cb, void *cb_data)
+{
+	GString *out;
+	int ret;
+
+	if (cb)
+		return sr_output_send_iov(o, packet, cb, cb_data);
+
+	/* Modules which write the output themselves. */
+	out = NULL;
+	ret = sr_output_send(o, packet, &out);
+	if (out)
+		g_string_free(out, TRUE);
+
+	return ret;
+}
+
+/* Stream a range of logic samples through an output, chunk by chunk. */
+static int export_range(struct sr_session_file *f, const struct sr_output *o,
+		uint64_t start, uint64_t count,
+		sr_output_write_callback cb, void *cb_data)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_config *src;
+	const struct file_chunk *chunk;
+	const uint8_t *data;
+	uint64_t offset, num;
+	int64_t now;
+	int idx, ret;
+
+	now = g_get_real_time();
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	header.feed_version = 1;
+	header.starttime.tv_sec = now / G_USEC_PER_SEC;
+	header.starttime.tv_usec = now % G_USEC_PER_SEC;
+	if ((ret = export_send(o, &packet, cb, cb_data)) != SR_OK)
+		return ret;
+
+	if (f->samplerate) {
+		src = sr_config_new(SR_CONF_SAMPLERATE,
+			g_variant_new_uint64(f->samplerate));
+		meta.config = g_slist_append(NULL, src);
+		packet.type = SR_DF_META;
+		packet.payload = &meta;
+		ret = export_send(o, &packet, cb, cb_data);
+		g_slist_free(meta.config);
+		sr_config_free(src);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	/*
+	 * Pass each chunk's part of the range on as it is in the file.
+	 * The first packet starts with the state at the start of the
+	 * range, formats like VCD take their initial values from it.
+	 */
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = f->unitsize;
+	idx = count ? chunk_find(f, start) : 0;
+	while (count) {
+		chunk = &g_array_index(f->chunks, struct file_chunk, idx);
+		offset = start - chunk->first_sample;
+		num = MIN(count, chunk->num_samples - offset);
+		if (num) {
+			data = chunk->data;
+			if ((!data || f->rle) &&
+					(ret = chunk_decode(f, idx, &data)) != SR_OK)
+				return ret;
+			logic.data = (void *)(data + offset * f->unitsize);
+			logic.length = num * f->unitsize;
+			if ((ret = export_send(o, &packet, cb, cb_data)) != SR_OK)
+				return ret;
+			start += num;
+			count -= num;
+		}
+		idx++;
+	}
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+
+	return export_send(o, &packet, cb, cb_data);
+}
+
+/**
+ * Export a range of the logic samples of a session file to another format.
+ *
+ * Only the chunks holding the range are read, and their samples are
+ * passed to the output module without copies where the file allows
+ * it. Times in the output start at the beginning of the range, the
+ * state of all channels there is the initial state. Analog data is
+ * not exported.
+ *
+ * @param file The session file. Must not be NULL.
+ * @param start Index of the first sample to export.
+ * @param count Number of samples to export.
+ * @param omod The output module. Must not be NULL.
+ * @param options Options for the output module, as for
+ *                sr_output_new(). Can be NULL.
+ * @param filename File name for modules which write the output
+ *                 themselves. Can be NULL.
+ * @param cb The callback to write the output, see sr_output_send_iov().
+ *           Can be NULL only for modules which write the output
+ *           themselves.
+ * @param cb_data Opaque pointer passed to the callback.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or samples out of range.
+ * @retval SR_ERR_NA The session file has no logic data.
+ * @retval other Error reading the file, or of the output module.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_export(struct sr_session_file *file,
+		uint64_t start, uint64_t count,
+		const struct sr_output_module *omod, GHashTable *options,
+		const char *filename, sr_output_write_callback cb, void *cb_data)
+{
+	struct sr_dev_inst *sdi;
+	const struct sr_output *o;
+	char name[16];
+	int i, ret;
+
+	if (!file || !omod)
+		return SR_ERR_ARG;
+	if (!cb && !sr_output_test_flag(omod, SR_OUTPUT_INTERNAL_IO_HANDLING))
+		return SR_ERR_ARG;
+	if (!file->unitsize)
+		return SR_ERR_NA;
+	if (start > file->num_samples || count > file->num_samples - start)
+		return SR_ERR_ARG;
+
+	sdi = sr_dev_inst_user_new("sigrok", "session file", NULL);
+	for (i = 0; i < file->num_logic; i++) {
+		if (!file->logic_names[i])
+			snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC,
+			file->logic_names[i] ? file->logic_names[i] : name);
+	}
+
+	if (!(o = sr_output_new(omod, options, sdi, filename))) {
+		sr_dev_inst_free(sdi);
+		return SR_ERR;
+	}
+	ret = export_range(file, o, start, count, cb, cb_data);
+	if (ret != SR_OK)
+		sr_err("Export failed: %s.", sr_strerror(ret));
+	if (sr_output_free(o) != SR_OK && ret == SR_OK)
+		ret = SR_ERR;
+	sr_dev_inst_free(sdi);
+
+	return ret;
+}
+
+/* Get the records of blocks on a level, clamping count to those there are. */
+static const struct file_summary *summary_get(unsigned int level,
+		uint64_t first, uint64_t *count, const struct file_summary *s,
+		const uint8_t **records)
+{
+	uint64_t level_first, level_count;
+
+	if (!s->data)
+		return NULL;
+
+	if (!summary_level(s, level, &level_first, &level_count) ||
+			first >= level_count)
+		*count = 0;
+	else
+		*count = MIN(*count, level_count - first);
+	*records = s->data + SUMMARY_HEADER_SIZE +
+		(level_first + first) * s->record_size;
+
+	return s;
+}
+
+/**
+ * Get the block size of the summaries of a session file.
+ *
+ * Blocks on the first level of a summary start every block_samples
+ * samples, on each next level blocks are twice the size. The last block
+ * of a level may be short, the last level has a single block.
+ *
+ * @param file The session file. Must not be NULL.
+ * @param block_samples Number of samples per block on the first level.
+ *                      Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The file has no summaries.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_summary_info(struct sr_session_file *file,
+		uint64_t *block_samples)
+{
+	const struct file_summary *s;
+	int i;
+
+	if (!file || !block_samples)
+		return SR_ERR_ARG;
+
+	s = &file->logic_summary;
+	for (i = 0; !s->data && i < file->num_analog; i++)
+		s = &file->analog_summary[i];
+	if (!s->data)
+		return SR_ERR_NA;
+	*block_samples = (uint64_t)1 << s->shift;
+
+	return SR_OK;
+}
+
+/**
+ * Get blocks of the summary of the logic data of a session file.
+ *
+ * For each block, a channel's bit is set in changed if the channel's
+ * value differs between any sample in the block and the sample before.
+ * All channels keep to the values of the block's first sample otherwise.
+ *
+ * @param file The session file. Must not be NULL.
+ * @param level Level of the blocks, 0 for the smallest ones.
+ * @param first Index of the first block on the level.
+ * @param count Number of blocks to get, set to the number of blocks
+ *              there are from the first one on, up to that. 0 if the
+ *              level or first block is out of range. Must not be NULL.
+ * @param changed Buffer for count blocks of unit size bytes, of the
+ *                channels that change. Can be NULL.
+ * @param values Buffer for count blocks of unit size bytes, of the
+ *               first sample of each block. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The file has no summary of its logic data.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_logic_summary(struct sr_session_file *file,
+		unsigned int level, uint64_t first, uint64_t *count,
+		uint8_t *changed, uint8_t *values)
+{
+	const struct file_summary *s;
+	const uint8_t *rec;
+	uint64_t i;
+
+	if (!file || !count)
+		return SR_ERR_ARG;
+
+	s = summary_get(level, first, count, &file->logic_summary, &rec);
+	if (!s)
+		return SR_ERR_NA;
+
+	for (i = 0; i < *count; i++, rec += s->record_size) {
+		if (changed)
+			memcpy(changed + i * file->unitsize, rec, file->unitsize);
+		if (values)
+			memcpy(values + i * file->unitsize,
+				rec + file->unitsize, file->unitsize);
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Get blocks of the summary of an analog channel of a session file.
+ *
+ * NaN values are left out, a block of only those has a minimum above
+ * its maximum.
+ *
+ * @param file The session file. Must not be NULL.
+ * @param channel Index of the channel among the analog channels of the
+ *                file, from 0.
+ * @param level Level of the blocks, 0 for the smallest ones.
+ * @param first Index of the first block on the level.
+ * @param count Number of blocks to get, set to the number of blocks
+ *              there are, as with sr_session_file_logic_summary().
+ *              Must not be NULL.
+ * @param min Buffer for the minimum value of count blocks. Can be NULL.
+ * @param max Buffer for the maximum value of count blocks. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The file has no summary of the channel.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_analog_summary(struct sr_session_file *file,
+		unsigned int channel, unsigned int level, uint64_t first,
+		uint64_t *count, float *min, float *max)
+{
+	const struct file_summary *s;
+	const uint8_t *rec;
+	float range[2];
+	uint64_t i;
+
+	if (!file || !count || channel >= (unsigned int)file->num_analog)
+		return SR_ERR_ARG;
+
+	s = summary_get(level, first, count, &file->analog_summary[channel],
+		&rec);
+	if (!s)
+		return SR_ERR_NA;
+
+	for (i = 0; i < *count; i++, rec += s->record_size) {
+		memcpy(range, rec, sizeof(range));
+		if (min)
+			min[i] = range[0];
+		if (max)
+			max[i] = range[1];
+	}
+
+	return SR_OK;
+}
+
+/* Look for an edge in the samples from..to-1, reading them. */
+static int edge_scan(struct sr_session_file *f, unsigned int channel,
+		uint64_t from, uint64_t to, uint64_t *offset)
+{
+	uint8_t *buf, *sample, prev, cur, mask;
+	uint64_t pos, num, i;
+	unsigned int byte;
+	int ret;
+
+	byte = channel / 8;
+	mask = 1 << (channel % 8);
+	if (!(buf = g_try_malloc((EDGE_SCAN_SAMPLES + 1) * f->unitsize)))
+		return SR_ERR_MALLOC;
+
+	ret = SR_OK;
+	*offset = f->num_samples;
+	for (pos = from; pos < to; pos += num) {
+		num = MIN(to - pos, EDGE_SCAN_SAMPLES);
+		/* With the sample before, to compare against. */
+		ret = sr_session_file_logic_read(f, pos - 1, num + 1, buf);
+		if (ret != SR_OK)
+			break;
+		prev = buf[byte] & mask;
+		for (i = 1; i <= num; i++) {
+			sample = buf + i * f->unitsize;
+			cur = sample[byte] & mask;
+			if (cur != prev) {
+				*offset = pos + i - 1;
+				break;
+			}
+		}
+		if (*offset != f->num_samples)
+			break;
+	}
+	g_free(buf);
+
+	return ret;
+}
+
+/**
+ * Find the next edge of a logic channel in a session file.
+ *
+ * An edge is a sample on which the channel's value differs from the
+ * sample before. With a summary of the logic data, blocks in which the
+ * channel doesn't change are skipped without reading their samples.
+ *
+ * @param file The session file. Must not be NULL.
+ * @param channel Index of the logic channel, its bit in the samples.
+ * @param start The first sample that may be the edge.
+ * @param offset The sample of the edge, or the number of samples in the
+ *               file if there is no edge from start on. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_MALLOC Memory allocation error.
+ * @retval SR_ERR_DATA A chunk can't be read.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_file_logic_next_edge(struct sr_session_file *file,
+		unsigned int channel, uint64_t start, uint64_t *offset)
+{
+	const struct file_summary *s;
+	const uint8_t *rec;
+	uint64_t pos, end, size, skip, one;
+	unsigned int level;
+	int ret;
+
+	if (!file || !offset || channel >= 8 * (unsigned int)file->unitsize)
+		return SR_ERR_ARG;
+
+	*offset = file->num_samples;
+	/* The first sample has none before it. */
+	pos = MAX(start, 1);
+	s = file->logic_summary.data ? &file->logic_summary : NULL;
+	if (!s)
+		return pos < file->num_samples ?
+			edge_scan(file, channel, pos, file->num_samples, offset) :
+			SR_OK;
+
+	while (pos < file->num_samples) {
+		/* Skip the largest block starting here the channel is idle in. */
+		skip = 0;
+		for (level = 0; s->shift + level < 64; level++) {
+			size = (uint64_t)1 << (s->shift + level);
+			one = 1;
+			if (pos % size != 0 ||
+					!summary_get(level, pos / size, &one, s, &rec) ||
+					!one || rec[channel / 8] & (1 << (channel % 8)))
+				break;
+			skip = size;
+		}
+		if (skip) {
+			pos += skip;
+			continue;
+		}
+		size = (uint64_t)1 << s->shift;
+		end = MIN((pos / size + 1) * size, file->num_samples);
+		ret = edge_scan(file, channel, pos, end, offset);
+		if (ret != SR_OK || *offset != file->num_samples)
+			return ret;
+		pos = end;
+	}
+
+	return SR_OK;
+}
+
+/** @} */
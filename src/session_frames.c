@@ -0,0 +1,397 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Segmented acquisition.
+ *
+ * Drivers which capture many frames of the same size (rapid frames,
+ * segmented memory) announce the frame size and count when starting.
+ * The session then allocates the storage for all frames at once, the
+ * driver fills it frame by frame, and each frame is sent as a single
+ * logic packet between SR_DF_FRAME_BEGIN and SR_DF_FRAME_END. Nothing
+ * is allocated per frame, and the frames stay available to the
+ * application as contiguous slices after they were sent.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+/* Frames kept when the driver doesn't know how many there will be. */
+#define DEFAULT_SLOTS	64
+
+/* Upper limit for the storage of one device's frames. */
+#define MAX_STORAGE	(256 * 1024 * 1024)
+
+struct frame_store {
+	uint16_t unitsize;
+	uint64_t frame_samples;
+	/* Frame n is kept in slot n % num_slots. */
+	uint64_t num_slots;
+	uint8_t *data;
+	uint64_t *lengths;
+	int64_t *triggers;
+	/* Number of frames completed. */
+	uint64_t num_frames;
+	/* The frame being filled. */
+	uint64_t fill;
+	int64_t trigger;
+};
+
+struct session_frames {
+	GMutex mutex;
+	GHashTable *devs;
+};
+
+static void frame_store_free(void *p)
+{
+	struct frame_store *fs;
+
+	fs = p;
+	g_free(fs->data);
+	g_free(fs->lengths);
+	g_free(fs->triggers);
+	g_free(fs);
+}
+
+static struct frame_store *frame_store_get(const struct sr_dev_inst *sdi)
+{
+	struct session_frames *sf;
+
+	if (!sdi->session || !(sf = sdi->session->frames))
+		return NULL;
+
+	return g_hash_table_lookup(sf->devs, sdi);
+}
+
+static uint8_t *slot_data(const struct frame_store *fs, uint64_t frame)
+{
+	return fs->data + (frame % fs->num_slots) *
+		fs->frame_samples * fs->unitsize;
+}
+
+/**
+ * Set up the storage for a device's frames, at acquisition start.
+ *
+ * @param sdi The device. Must not be NULL, and be in a session.
+ * @param unitsize Size of a logic sample in bytes.
+ * @param frame_samples Number of samples per frame.
+ * @param num_frames Number of frames, 0 when not known up front.
+ *
+ * @retval SR_OK Success. Use sr_session_frame_append() and friends.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_MALLOC Not enough memory for a single frame. The
+ *         driver needs to send frames the usual way.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_frames_setup(const struct sr_dev_inst *sdi,
+		uint16_t unitsize, uint64_t frame_samples, uint64_t num_frames)
+{
+	struct sr_session *session;
+	struct session_frames *sf;
+	struct frame_store *fs;
+	uint64_t frame_size, slots;
+
+	if (!sdi || !(session = sdi->session) || !unitsize || !frame_samples)
+		return SR_ERR_ARG;
+
+	frame_size = frame_samples * unitsize;
+	if (frame_size > MAX_STORAGE) {
+		sr_dbg("Frames of %" PRIu64 " bytes are too large to keep.",
+			frame_size);
+		return SR_ERR_MALLOC;
+	}
+	slots = num_frames ? num_frames : DEFAULT_SLOTS;
+	/* Keep the latest frames only, when all of them don't fit. */
+	slots = MIN(slots, MAX_STORAGE / frame_size);
+
+	fs = g_malloc0(sizeof(*fs));
+	fs->unitsize = unitsize;
+	fs->frame_samples = frame_samples;
+	fs->num_slots = slots;
+	fs->data = g_try_malloc(slots * frame_size);
+	if (!fs->data) {
+		g_free(fs);
+		return SR_ERR_MALLOC;
+	}
+	fs->lengths = g_malloc0_n(slots, sizeof(fs->lengths[0]));
+	fs->triggers = g_malloc0_n(slots, sizeof(fs->triggers[0]));
+	fs->trigger = -1;
+
+	if (!(sf = session->frames)) {
+		sf = g_malloc0(sizeof(*sf));
+		g_mutex_init(&sf->mutex);
+		sf->devs = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, frame_store_free);
+		session->frames = sf;
+	}
+	g_mutex_lock(&sf->mutex);
+	g_hash_table_replace(sf->devs, (void *)sdi, fs);
+	g_mutex_unlock(&sf->mutex);
+
+	sr_dbg("Keeping %" PRIu64 " frames of %" PRIu64 " samples.",
+		slots, frame_samples);
+
+	return SR_OK;
+}
+
+/**
+ * Append samples to the device's current frame.
+ *
+ * Samples beyond the frame size are dropped.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_frame_append(const struct sr_dev_inst *sdi,
+		const void *data, uint64_t num_samples)
+{
+	struct frame_store *fs;
+
+	if (!(fs = frame_store_get(sdi)))
+		return SR_ERR_BUG;
+
+	num_samples = MIN(num_samples, fs->frame_samples - fs->fill);
+	memcpy(slot_data(fs, fs->num_frames) + fs->fill * fs->unitsize,
+		data, num_samples * fs->unitsize);
+	fs->fill += num_samples;
+
+	return SR_OK;
+}
+
+/**
+ * Mark the trigger point at the current position of the frame.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_frame_trigger(const struct sr_dev_inst *sdi)
+{
+	struct frame_store *fs;
+
+	if (!(fs = frame_store_get(sdi)))
+		return SR_ERR_BUG;
+
+	fs->trigger = fs->fill;
+
+	return SR_OK;
+}
+
+/**
+ * Complete the device's current frame, and send it.
+ *
+ * The frame goes out as SR_DF_FRAME_BEGIN, the logic samples (split
+ * in two packets at the trigger point, when there is one) and
+ * SR_DF_FRAME_END.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_frame_end(const struct sr_dev_inst *sdi)
+{
+	struct session_frames *sf;
+	struct frame_store *fs;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	uint64_t slot, pre;
+	uint8_t *data;
+	int ret;
+
+	if (!(fs = frame_store_get(sdi)))
+		return SR_ERR_BUG;
+
+	data = slot_data(fs, fs->num_frames);
+	pre = fs->trigger >= 0 ? (uint64_t)fs->trigger : fs->fill;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = fs->unitsize;
+
+	ret = std_session_send_df_frame_begin(sdi);
+	if (ret == SR_OK && pre) {
+		logic.length = pre * fs->unitsize;
+		logic.data = data;
+		ret = sr_session_send(sdi, &packet);
+	}
+	if (ret == SR_OK && fs->trigger >= 0)
+		ret = std_session_send_df_trigger(sdi);
+	if (ret == SR_OK && fs->fill > pre) {
+		logic.length = (fs->fill - pre) * fs->unitsize;
+		logic.data = data + pre * fs->unitsize;
+		ret = sr_session_send(sdi, &packet);
+	}
+	if (ret == SR_OK)
+		ret = std_session_send_df_frame_end(sdi);
+
+	sf = sdi->session->frames;
+	g_mutex_lock(&sf->mutex);
+	slot = fs->num_frames % fs->num_slots;
+	fs->lengths[slot] = fs->fill;
+	fs->triggers[slot] = fs->trigger;
+	fs->num_frames++;
+	g_mutex_unlock(&sf->mutex);
+	fs->fill = 0;
+	fs->trigger = -1;
+
+	return ret;
+}
+
+/**
+ * Drop the frames, for a new run of the session.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_frames_reset(struct sr_session *session)
+{
+	struct session_frames *sf;
+
+	if (!(sf = session->frames))
+		return;
+
+	g_mutex_lock(&sf->mutex);
+	g_hash_table_remove_all(sf->devs);
+	g_mutex_unlock(&sf->mutex);
+}
+
+/** @private */
+SR_PRIV void sr_session_frames_free(struct sr_session *session)
+{
+	struct session_frames *sf;
+
+	if (!(sf = session->frames))
+		return;
+
+	g_hash_table_unref(sf->devs);
+	g_mutex_clear(&sf->mutex);
+	g_free(sf);
+	session->frames = NULL;
+}
+
+/**
+ * Get which frames of a segmented acquisition are available.
+ *
+ * Only drivers which capture frames of a fixed size keep them. When
+ * there were more frames than fit the memory, the latest are kept.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device. Must not be NULL.
+ * @param first_frame Number of the oldest frame kept. Can be NULL.
+ * @param num_frames Number of frames captured so far. Must not be NULL.
+ * @param unitsize Size of a logic sample in bytes. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The device doesn't keep frames.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_frames_info(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t *first_frame,
+		uint64_t *num_frames, uint16_t *unitsize)
+{
+	struct session_frames *sf;
+	struct frame_store *fs;
+
+	if (!session || !sdi || !num_frames)
+		return SR_ERR_ARG;
+	if (!(sf = session->frames))
+		return SR_ERR_NA;
+
+	g_mutex_lock(&sf->mutex);
+	fs = g_hash_table_lookup(sf->devs, sdi);
+	if (fs) {
+		*num_frames = fs->num_frames;
+		if (first_frame)
+			*first_frame = fs->num_frames > fs->num_slots ?
+				fs->num_frames - fs->num_slots : 0;
+		if (unitsize)
+			*unitsize = fs->unitsize;
+	}
+	g_mutex_unlock(&sf->mutex);
+
+	return fs ? SR_OK : SR_ERR_NA;
+}
+
+/**
+ * Get the samples of a frame of a segmented acquisition.
+ *
+ * The samples are not copied. They stay valid until the session starts
+ * again, or until the frame gets replaced by a newer one when not all
+ * frames can be kept, see sr_session_frames_info().
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device. Must not be NULL.
+ * @param frame Number of the frame.
+ * @param data The frame's samples. Must not be NULL.
+ * @param num_samples Number of samples in the frame. Must not be NULL.
+ * @param trigger_pos Sample of the trigger, -1 for none. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or the frame is not kept.
+ * @retval SR_ERR_NA The device doesn't keep frames.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_frame_get(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t frame,
+		const uint8_t **data, uint64_t *num_samples, int64_t *trigger_pos)
+{
+	struct session_frames *sf;
+	struct frame_store *fs;
+	uint64_t slot;
+	int ret;
+
+	if (!session || !sdi || !data || !num_samples)
+		return SR_ERR_ARG;
+	if (!(sf = session->frames))
+		return SR_ERR_NA;
+
+	g_mutex_lock(&sf->mutex);
+	fs = g_hash_table_lookup(sf->devs, sdi);
+	if (!fs) {
+		ret = SR_ERR_NA;
+	} else if (frame >= fs->num_frames ||
+			frame + fs->num_slots < fs->num_frames) {
+		ret = SR_ERR_ARG;
+	} else {
+		slot = frame % fs->num_slots;
+		*data = slot_data(fs, frame);
+		*num_samples = fs->lengths[slot];
+		if (trigger_pos)
+			*trigger_pos = fs->triggers[slot];
+		ret = SR_OK;
+	}
+	g_mutex_unlock(&sf->mutex);
+
+	return ret;
+}
+
+/** @} */
@@ -0,0 +1,810 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Live overview of an acquisition.
+ *
+ * When enabled, the session keeps summaries of the logic data of each
+ * device and of each analog channel while the packets go to the
+ * datafeed callbacks, like the summaries of srzip session files. Blocks
+ * of a power of two samples make up the first level, each next level
+ * has blocks twice the size. A logic block has the bits of the channels
+ * which change within it, counting from the sample before, and its first
+ * sample. An analog block has the minimum and maximum value in it.
+ *
+ * Complete blocks are combined into the next level as they come in, the
+ * incomplete ones at the end get combined when they are asked for. So
+ * any range of blocks on any level is at hand in time of its size.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+#define DEFAULT_BLOCK_SAMPLES	1024
+
+/* Samples of the logic data of a device, or of an analog channel. */
+struct pyramid {
+	gboolean logic;
+	size_t unitsize;
+	size_t record_size;
+	uint64_t num_samples;
+	/* Complete blocks, a GByteArray per level. */
+	GPtrArray *levels;
+	/* The first level block being filled. */
+	uint8_t *block;
+	/* Logic: the sample before the next one. */
+	uint8_t *last;
+	/* Scratch records. */
+	uint8_t *tmp[2];
+};
+
+struct session_overview {
+	GMutex mutex;
+	unsigned int shift;
+	/* Logic pyramids by device, analog pyramids by channel. */
+	GHashTable *logic;
+	GHashTable *analog;
+	/* Conversion buffers. */
+	float *fbuf;
+	size_t fbuf_len;
+	uint8_t dense[4096];
+};
+
+static void pyramid_free(void *data)
+{
+	struct pyramid *p;
+	unsigned int i;
+
+	p = data;
+	for (i = 0; i < p->levels->len; i++)
+		g_byte_array_free(g_ptr_array_index(p->levels, i), TRUE);
+	g_ptr_array_free(p->levels, TRUE);
+	g_free(p->block);
+	g_free(p->last);
+	g_free(p->tmp[0]);
+	g_free(p->tmp[1]);
+	g_free(p);
+}
+
+static struct pyramid *pyramid_get(GHashTable *table, const void *key,
+		gboolean logic, size_t unitsize)
+{
+	struct pyramid *p;
+
+	p = g_hash_table_lookup(table, key);
+	if (p)
+		return p->unitsize == unitsize ? p : NULL;
+
+	p = g_malloc0(sizeof(*p));
+	p->logic = logic;
+	p->unitsize = unitsize;
+	p->record_size = logic ? 2 * unitsize : 2 * sizeof(float);
+	p->levels = g_ptr_array_new();
+	g_ptr_array_add(p->levels, g_byte_array_new());
+	p->block = g_malloc0(p->record_size);
+	p->last = g_malloc0(unitsize);
+	p->tmp[0] = g_malloc0(p->record_size);
+	p->tmp[1] = g_malloc0(p->record_size);
+	g_hash_table_insert(table, (void *)key, p);
+
+	return p;
+}
+
+/* Combine two adjacent blocks, b can be NULL when a is the last one. */
+static void combine(const struct pyramid *p, uint8_t *dst,
+		const uint8_t *a, const uint8_t *b)
+{
+	float range[2], other[2];
+	size_t j;
+
+	if (dst != a)
+		memmove(dst, a, p->record_size);
+	if (!b)
+		return;
+	if (p->logic) {
+		/* The second block's changes include those from the first. */
+		for (j = 0; j < p->unitsize; j++)
+			dst[j] |= b[j];
+		return;
+	}
+	memcpy(range, dst, sizeof(range));
+	memcpy(other, b, sizeof(other));
+	range[0] = MIN(range[0], other[0]);
+	range[1] = MAX(range[1], other[1]);
+	memcpy(dst, range, sizeof(range));
+}
+
+/* Append the completed first level block, carry pairs up the levels. */
+static void block_complete(struct pyramid *p)
+{
+	GByteArray *level;
+	unsigned int l;
+	size_t rs, n;
+
+	rs = p->record_size;
+	g_byte_array_append(g_ptr_array_index(p->levels, 0), p->block, rs);
+	for (l = 0; ; l++) {
+		level = g_ptr_array_index(p->levels, l);
+		n = level->len / rs;
+		if (n % 2)
+			break;
+		if (l + 1 == p->levels->len)
+			g_ptr_array_add(p->levels, g_byte_array_new());
+		combine(p, p->tmp[0], level->data + (n - 2) * rs,
+			level->data + (n - 1) * rs);
+		g_byte_array_append(g_ptr_array_index(p->levels, l + 1),
+			p->tmp[0], rs);
+	}
+}
+
+/*
+ * OR the changes between neighbouring samples into changed. Whole words
+ * at a time when a word holds whole samples, which compilers turn into
+ * vector code, the same byte of every sample is at the same place in
+ * every word then.
+ */
+static void changes_within(uint8_t *changed, const uint8_t *data,
+		size_t count, size_t unitsize)
+{
+	uint64_t a, b, acc;
+	uint8_t bytes[sizeof(acc)];
+	size_t len, k, j;
+
+	len = count * unitsize;
+	k = unitsize;
+	if (sizeof(acc) % unitsize == 0) {
+		acc = 0;
+		for (; k + sizeof(acc) <= len; k += sizeof(acc)) {
+			memcpy(&a, data + k, sizeof(a));
+			memcpy(&b, data + k - unitsize, sizeof(b));
+			acc |= a ^ b;
+		}
+		memcpy(bytes, &acc, sizeof(bytes));
+		for (j = 0; j < sizeof(bytes); j++)
+			changed[j % unitsize] |= bytes[j];
+	}
+	for (; k < len; k++)
+		changed[k % unitsize] |= data[k] ^ data[k - unitsize];
+}
+
+static void logic_add(struct pyramid *p, unsigned int shift,
+		const uint8_t *data, uint64_t count)
+{
+	uint8_t *changed, *first;
+	uint64_t mask, n;
+	size_t us, j;
+
+	us = p->unitsize;
+	changed = p->block;
+	first = p->block + us;
+	mask = ((uint64_t)1 << shift) - 1;
+	while (count) {
+		if (!(p->num_samples & mask)) {
+			memset(changed, 0, us);
+			memcpy(first, data, us);
+		}
+		n = MIN(count, mask + 1 - (p->num_samples & mask));
+		if (p->num_samples) {
+			for (j = 0; j < us; j++)
+				changed[j] |= data[j] ^ p->last[j];
+		}
+		changes_within(changed, data, n, us);
+		memcpy(p->last, data + (n - 1) * us, us);
+		p->num_samples += n;
+		data += n * us;
+		count -= n;
+		if (!(p->num_samples & mask))
+			block_complete(p);
+	}
+}
+
+/* A run of count samples of the same value. */
+static void logic_add_run(struct pyramid *p, unsigned int shift,
+		const uint8_t *value, uint64_t count)
+{
+	uint8_t *changed, *first;
+	uint64_t mask, n;
+	size_t us, j;
+
+	us = p->unitsize;
+	changed = p->block;
+	first = p->block + us;
+	mask = ((uint64_t)1 << shift) - 1;
+	while (count) {
+		if (!(p->num_samples & mask)) {
+			memset(changed, 0, us);
+			memcpy(first, value, us);
+		}
+		n = MIN(count, mask + 1 - (p->num_samples & mask));
+		if (p->num_samples) {
+			for (j = 0; j < us; j++)
+				changed[j] |= value[j] ^ p->last[j];
+		}
+		memcpy(p->last, value, us);
+		p->num_samples += n;
+		count -= n;
+		if (!(p->num_samples & mask))
+			block_complete(p);
+	}
+}
+
+static void analog_add(struct pyramid *p, unsigned int shift,
+		const float *values, uint64_t count)
+{
+	float range[2], lo, hi, v;
+	uint64_t mask, n, i;
+
+	mask = ((uint64_t)1 << shift) - 1;
+	memcpy(range, p->block, sizeof(range));
+	while (count) {
+		if (!(p->num_samples & mask)) {
+			/* NaN values don't count. */
+			range[0] = INFINITY;
+			range[1] = -INFINITY;
+		}
+		n = MIN(count, mask + 1 - (p->num_samples & mask));
+		lo = range[0];
+		hi = range[1];
+		for (i = 0; i < n; i++) {
+			v = values[i];
+			lo = v < lo ? v : lo;
+			hi = v > hi ? v : hi;
+		}
+		range[0] = lo;
+		range[1] = hi;
+		p->num_samples += n;
+		values += n;
+		count -= n;
+		memcpy(p->block, range, sizeof(range));
+		if (!(p->num_samples & mask))
+			block_complete(p);
+	}
+}
+
+static void logic_packed(struct session_overview *ov, struct pyramid *p,
+		const struct sr_datafeed_logic_packed *packed)
+{
+	uint64_t pos, n;
+
+	for (pos = 0; pos < packed->num_samples; pos += n) {
+		n = MIN(sizeof(ov->dense), packed->num_samples - pos);
+		if (sr_logic_packed_to_dense(packed, pos, n, ov->dense) != SR_OK)
+			return;
+		logic_add(p, ov->shift, ov->dense, n);
+	}
+}
+
+static uint64_t plane_word(const uint8_t *p, unsigned int word_bytes)
+{
+	uint64_t w;
+	uint32_t w32;
+	uint16_t w16;
+
+	switch (word_bytes) {
+	case 1:
+		return *p;
+	case 2:
+		memcpy(&w16, p, sizeof(w16));
+		return w16;
+	case 4:
+		memcpy(&w32, p, sizeof(w32));
+		return w32;
+	default:
+		memcpy(&w, p, sizeof(w));
+		return w;
+	}
+}
+
+/* Planar samples, turned back into dense ones a slice at a time. */
+static void logic_planar(struct session_overview *ov, struct pyramid *p,
+		const struct sr_datafeed_logic_planar *planar)
+{
+	const uint8_t *words;
+	uint64_t pos, n, i, s, w;
+	unsigned int plane, bit, word_bytes;
+	size_t us;
+
+	us = planar->unitsize;
+	word_bytes = planar->word_bits / 8;
+	words = planar->data;
+	for (pos = 0; pos < planar->num_samples; pos += n) {
+		n = MIN(sizeof(ov->dense) / us, planar->num_samples - pos);
+		memset(ov->dense, 0, n * us);
+		for (plane = 0; plane < planar->num_planes; plane++) {
+			bit = planar->plane_bits ? planar->plane_bits[plane] : plane;
+			if (bit >= us * 8)
+				continue;
+			for (i = 0; i < n; i++) {
+				s = pos + i;
+				w = plane_word(words + ((s / planar->word_bits) *
+					planar->num_planes + plane) * word_bytes,
+					word_bytes);
+				if (!((w >> (s % planar->word_bits)) & 1))
+					continue;
+				ov->dense[i * us + bit / 8] |= 1 << (bit % 8);
+			}
+		}
+		logic_add(p, ov->shift, ov->dense, n);
+	}
+}
+
+static void analog_values(struct session_overview *ov,
+		const struct sr_datafeed_analog *analog)
+{
+	struct pyramid *p;
+	GSList *l;
+	size_t len;
+	uint64_t i;
+
+	if (!analog->meaning || !analog->meaning->channels)
+		return;
+
+	len = (size_t)analog->num_samples *
+		g_slist_length(analog->meaning->channels);
+	if (len > ov->fbuf_len) {
+		g_free(ov->fbuf);
+		ov->fbuf = g_try_malloc(len * sizeof(float));
+		ov->fbuf_len = ov->fbuf ? len : 0;
+		if (!ov->fbuf)
+			return;
+	}
+	if (sr_analog_to_float(analog, ov->fbuf) != SR_OK)
+		return;
+
+	/* The samples come one channel after the other. */
+	for (l = analog->meaning->channels, i = 0; l; l = l->next, i++) {
+		p = pyramid_get(ov->analog, l->data, FALSE, sizeof(float));
+		analog_add(p, ov->shift, ov->fbuf + i * analog->num_samples,
+			analog->num_samples);
+	}
+}
+
+/**
+ * Account a packet which goes to the datafeed callbacks.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_overview_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct session_overview *ov;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
+	struct pyramid *p;
+	uint64_t run, end;
+
+	ov = sdi->session->overview;
+
+	g_mutex_lock(&ov->mutex);
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		if (!logic->unitsize)
+			break;
+		p = pyramid_get(ov->logic, sdi, TRUE, logic->unitsize);
+		if (p)
+			logic_add(p, ov->shift, logic->data,
+				logic->length / logic->unitsize);
+		break;
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		if (!rle->unitsize)
+			break;
+		p = pyramid_get(ov->logic, sdi, TRUE, rle->unitsize);
+		for (run = 0; p && run < rle->num_runs; run++) {
+			end = run + 1 < rle->num_runs ?
+				rle->offsets[run + 1] : rle->num_samples;
+			logic_add_run(p, ov->shift, (const uint8_t *)rle->values +
+				run * rle->unitsize, end - rle->offsets[run]);
+		}
+		break;
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		if (!planar->unitsize || !planar->word_bits)
+			break;
+		p = pyramid_get(ov->logic, sdi, TRUE, planar->unitsize);
+		if (p)
+			logic_planar(ov, p, planar);
+		break;
+	case SR_DF_LOGIC_PACKED:
+		p = pyramid_get(ov->logic, sdi, TRUE, 1);
+		if (p)
+			logic_packed(ov, p, packet->payload);
+		break;
+	case SR_DF_ANALOG:
+		analog_values(ov, packet->payload);
+		break;
+	}
+	g_mutex_unlock(&ov->mutex);
+}
+
+/**
+ * Drop the overviews, for a new run of the session.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_overview_reset(struct sr_session *session)
+{
+	struct session_overview *ov;
+
+	ov = session->overview;
+	if (!ov)
+		return;
+
+	g_mutex_lock(&ov->mutex);
+	g_hash_table_remove_all(ov->logic);
+	g_hash_table_remove_all(ov->analog);
+	g_mutex_unlock(&ov->mutex);
+}
+
+/** @private */
+SR_PRIV void sr_session_overview_free(struct sr_session *session)
+{
+	struct session_overview *ov;
+
+	ov = session->overview;
+	if (!ov)
+		return;
+
+	g_hash_table_destroy(ov->logic);
+	g_hash_table_destroy(ov->analog);
+	g_mutex_clear(&ov->mutex);
+	g_free(ov->fbuf);
+	g_free(ov);
+	session->overview = NULL;
+}
+
+/*
+ * Get blocks of a level, copying each record to out. The incomplete
+ * block at the end gets combined from the levels below.
+ */
+static int pyramid_read(struct session_overview *ov, struct pyramid *p,
+		unsigned int level, uint64_t first, uint64_t *count,
+		void (*out)(const struct pyramid *p, uint64_t i,
+			const uint8_t *rec, void *dst1, void *dst2),
+		void *dst1, void *dst2)
+{
+	GByteArray *arr;
+	const uint8_t *unpaired, *cur;
+	uint64_t total, complete, n, i;
+	unsigned int l, t;
+	size_t rs;
+
+	rs = p->record_size;
+	if (ov->shift + level >= 64) {
+		*count = 0;
+		return SR_OK;
+	}
+	total = (p->num_samples + ((uint64_t)1 << (ov->shift + level)) - 1) >>
+		(ov->shift + level);
+	if (first >= total) {
+		*count = 0;
+		return SR_OK;
+	}
+	n = MIN(*count, total - first);
+	*count = n;
+
+	arr = level < p->levels->len ? g_ptr_array_index(p->levels, level) : NULL;
+	complete = arr ? arr->len / rs : 0;
+	for (i = 0; i < n && first + i < complete; i++)
+		out(p, i, arr->data + (first + i) * rs, dst1, dst2);
+	if (i == n)
+		return SR_OK;
+
+	/* The incomplete last block. */
+	cur = (p->num_samples & (((uint64_t)1 << ov->shift) - 1)) ?
+		p->block : NULL;
+	for (l = 0, t = 0; l < level; l++) {
+		arr = g_ptr_array_index(p->levels, l);
+		complete = arr->len / rs;
+		unpaired = complete % 2 ? arr->data + (complete - 1) * rs : NULL;
+		if (!unpaired)
+			continue;
+		combine(p, p->tmp[t], unpaired, cur);
+		cur = p->tmp[t];
+		t ^= 1;
+	}
+	if (!cur)
+		return SR_ERR_BUG;
+	out(p, i, cur, dst1, dst2);
+
+	return SR_OK;
+}
+
+static void logic_out(const struct pyramid *p, uint64_t i,
+		const uint8_t *rec, void *changed, void *values)
+{
+	if (changed)
+		memcpy((uint8_t *)changed + i * p->unitsize, rec, p->unitsize);
+	if (values)
+		memcpy((uint8_t *)values + i * p->unitsize,
+			rec + p->unitsize, p->unitsize);
+}
+
+static void analog_out(const struct pyramid *p, uint64_t i,
+		const uint8_t *rec, void *min, void *max)
+{
+	float range[2];
+
+	(void)p;
+
+	memcpy(range, rec, sizeof(range));
+	if (min)
+		((float *)min)[i] = range[0];
+	if (max)
+		((float *)max)[i] = range[1];
+}
+
+/**
+ * Keep overviews of the samples of the session.
+ *
+ * Summarizes the logic samples of every device, and the analog samples
+ * of every channel, as they are passed on to the datafeed callbacks.
+ * Frontends can draw zoomed out views of long captures from them while
+ * samples still arrive. The overviews of the last run are kept until
+ * the session starts again, or they are disabled.
+ *
+ * @param session The session to use. Must not be NULL, nor running.
+ * @param enable TRUE to enable, FALSE to disable the overviews.
+ * @param block_samples Number of samples in a block of the first level,
+ *                      a power of two. 0 for the default.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_overview_set(struct sr_session *session,
+		gboolean enable, uint64_t block_samples)
+{
+	struct session_overview *ov;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (block_samples & (block_samples - 1))
+		return SR_ERR_ARG;
+	if (session->running) {
+		sr_err("Cannot change the overviews while running.");
+		return SR_ERR;
+	}
+
+	sr_session_overview_free(session);
+	if (!enable)
+		return SR_OK;
+
+	if (!block_samples)
+		block_samples = DEFAULT_BLOCK_SAMPLES;
+
+	ov = g_malloc0(sizeof(*ov));
+	g_mutex_init(&ov->mutex);
+	while (((uint64_t)1 << ov->shift) < block_samples)
+		ov->shift++;
+	ov->logic = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, pyramid_free);
+	ov->analog = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, pyramid_free);
+	session->overview = ov;
+
+	return SR_OK;
+}
+
+/**
+ * Get the number and size of the logic samples in a device's overview.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device. Must not be NULL.
+ * @param num_samples Number of samples summarized. Must not be NULL.
+ * @param unitsize Size of each sample in bytes. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The overviews are not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_overview_logic_info(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t *num_samples,
+		uint16_t *unitsize)
+{
+	struct session_overview *ov;
+	struct pyramid *p;
+
+	if (!session || !sdi || !num_samples)
+		return SR_ERR_ARG;
+
+	ov = session->overview;
+	if (!ov)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&ov->mutex);
+	p = g_hash_table_lookup(ov->logic, sdi);
+	*num_samples = p ? p->num_samples : 0;
+	if (unitsize)
+		*unitsize = p ? p->unitsize : 0;
+	g_mutex_unlock(&ov->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get blocks of the overview of a device's logic samples.
+ *
+ * The blocks are as with sr_session_file_logic_summary(). The last
+ * block of a level covers the samples which arrived so far.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device. Must not be NULL.
+ * @param level Level of the blocks, 0 for the smallest ones.
+ * @param first Index of the first block on the level.
+ * @param count Number of blocks to get, set to the number of blocks
+ *              there are from the first one on, up to that. 0 if the
+ *              level or first block is out of range. Must not be NULL.
+ * @param changed Buffer for count blocks of unit size bytes, of the
+ *                channels that change. Can be NULL.
+ * @param values Buffer for count blocks of unit size bytes, of the
+ *               first sample of each block. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The overviews are not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_overview_logic(struct sr_session *session,
+		const struct sr_dev_inst *sdi, unsigned int level,
+		uint64_t first, uint64_t *count, uint8_t *changed,
+		uint8_t *values)
+{
+	struct session_overview *ov;
+	struct pyramid *p;
+	int ret;
+
+	if (!session || !sdi || !count)
+		return SR_ERR_ARG;
+
+	ov = session->overview;
+	if (!ov)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&ov->mutex);
+	p = g_hash_table_lookup(ov->logic, sdi);
+	if (p) {
+		ret = pyramid_read(ov, p, level, first, count, logic_out,
+			changed, values);
+	} else {
+		*count = 0;
+		ret = SR_OK;
+	}
+	g_mutex_unlock(&ov->mutex);
+
+	return ret;
+}
+
+/**
+ * Get the number of samples in an analog channel's overview.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param ch The analog channel. Must not be NULL.
+ * @param num_samples Number of samples summarized. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The overviews are not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_overview_analog_info(struct sr_session *session,
+		const struct sr_channel *ch, uint64_t *num_samples)
+{
+	struct session_overview *ov;
+	struct pyramid *p;
+
+	if (!session || !ch || !num_samples)
+		return SR_ERR_ARG;
+
+	ov = session->overview;
+	if (!ov)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&ov->mutex);
+	p = g_hash_table_lookup(ov->analog, ch);
+	*num_samples = p ? p->num_samples : 0;
+	g_mutex_unlock(&ov->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get blocks of the overview of an analog channel.
+ *
+ * NaN values are left out, a block of only those has a minimum above
+ * its maximum.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param ch The analog channel. Must not be NULL.
+ * @param level Level of the blocks, 0 for the smallest ones.
+ * @param first Index of the first block on the level.
+ * @param count Number of blocks to get, set to the number of blocks
+ *              there are, as with sr_session_overview_logic().
+ *              Must not be NULL.
+ * @param min Buffer for the minimum value of count blocks. Can be NULL.
+ * @param max Buffer for the maximum value of count blocks. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The overviews are not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_overview_analog(struct sr_session *session,
+		const struct sr_channel *ch, unsigned int level,
+		uint64_t first, uint64_t *count, float *min, float *max)
+{
+	struct session_overview *ov;
+	struct pyramid *p;
+	int ret;
+
+	if (!session || !ch || !count)
+		return SR_ERR_ARG;
+
+	ov = session->overview;
+	if (!ov)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&ov->mutex);
+	p = g_hash_table_lookup(ov->analog, ch);
+	if (p) {
+		ret = pyramid_read(ov, p, level, first, count, analog_out,
+			min, max);
+	} else {
+		*count = 0;
+		ret = SR_OK;
+	}
+	g_mutex_unlock(&ov->mutex);
+
+	return ret;
+}
+
+/** @} */
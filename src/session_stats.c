@@ -0,0 +1,338 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Session performance counters.
+ *
+ * When enabled, the session counts the packets and bytes the devices
+ * send, and records how long event source callbacks, transform modules
+ * and datafeed callbacks take. Updates may come from the acquisition
+ * thread and the dispatch thread alike, a mutex keeps them consistent.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+struct session_stats {
+	GMutex mutex;
+	struct sr_session_stats stats;
+	/* struct sr_stats_histogram, indexed by position. */
+	GArray *transforms;
+	GArray *callbacks;
+};
+
+static void histogram_add(struct sr_stats_histogram *h, int64_t us)
+{
+	unsigned int bucket;
+	uint64_t v;
+
+	v = MAX(0, us);
+	h->count++;
+	h->total_us += v;
+	h->max_us = MAX(h->max_us, v);
+
+	bucket = 0;
+	while (v && bucket < SR_STATS_HISTOGRAM_BUCKETS - 1) {
+		v >>= 1;
+		bucket++;
+	}
+	h->buckets[bucket]++;
+}
+
+static struct sr_stats_histogram *histogram_at(GArray *array,
+		unsigned int idx)
+{
+	if (idx >= array->len)
+		g_array_set_size(array, idx + 1);
+
+	return &g_array_index(array, struct sr_stats_histogram, idx);
+}
+
+/**
+ * Count a packet sent by a device.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_stats_packet(struct sr_session *session,
+		const struct sr_datafeed_packet *packet)
+{
+	struct session_stats *st;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
+	const struct sr_datafeed_logic_packed *packed;
+	unsigned int idx;
+	uint64_t bytes;
+
+	st = session->stats;
+	if (packet->type < SR_DF_HEADER ||
+			packet->type >= SR_DF_HEADER + SR_DF_NUM_TYPES)
+		return;
+	idx = packet->type - SR_DF_HEADER;
+
+	bytes = 0;
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		bytes = logic->length;
+	} else if (packet->type == SR_DF_ANALOG) {
+		analog = packet->payload;
+		if (analog->encoding && analog->meaning)
+			bytes = (uint64_t)analog->num_samples *
+				analog->encoding->unitsize *
+				g_slist_length(analog->meaning->channels);
+	} else if (packet->type == SR_DF_LOGIC_RLE) {
+		rle = packet->payload;
+		bytes = rle->num_runs * (sizeof(uint64_t) + rle->unitsize);
+	} else if (packet->type == SR_DF_LOGIC_PLANAR) {
+		planar = packet->payload;
+		bytes = sr_logic_planar_data_size(planar);
+	} else if (packet->type == SR_DF_LOGIC_PACKED) {
+		packed = packet->payload;
+		bytes = sr_logic_packed_data_size(packed);
+	}
+
+	g_mutex_lock(&st->mutex);
+	st->stats.packets[idx]++;
+	st->stats.bytes[idx] += bytes;
+	g_mutex_unlock(&st->mutex);
+}
+
+/**
+ * Record the time a transform module took.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_stats_transform(struct sr_session *session,
+		unsigned int idx, int64_t us)
+{
+	struct session_stats *st;
+
+	st = session->stats;
+	g_mutex_lock(&st->mutex);
+	histogram_add(histogram_at(st->transforms, idx), us);
+	g_mutex_unlock(&st->mutex);
+}
+
+/**
+ * Record the time a datafeed callback took.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_stats_callback(struct sr_session *session,
+		unsigned int idx, int64_t us)
+{
+	struct session_stats *st;
+
+	st = session->stats;
+	g_mutex_lock(&st->mutex);
+	histogram_add(histogram_at(st->callbacks, idx), us);
+	g_mutex_unlock(&st->mutex);
+}
+
+/**
+ * Record an event source dispatch.
+ *
+ * @param session The session.
+ * @param latency_us Time from the source being ready to its dispatch.
+ * @param dispatch_us Time spent in the source callback.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_stats_source(struct sr_session *session,
+		int64_t latency_us, int64_t dispatch_us)
+{
+	struct session_stats *st;
+
+	st = session->stats;
+	g_mutex_lock(&st->mutex);
+	histogram_add(&st->stats.source_latency, latency_us);
+	histogram_add(&st->stats.source_dispatch, dispatch_us);
+	g_mutex_unlock(&st->mutex);
+}
+
+/**
+ * Clear the counters, for a new run of the session.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_stats_reset(struct sr_session *session)
+{
+	struct session_stats *st;
+
+	st = session->stats;
+	if (!st)
+		return;
+
+	g_mutex_lock(&st->mutex);
+	memset(&st->stats, 0, sizeof(st->stats));
+	g_array_set_size(st->transforms, 0);
+	g_array_set_size(st->callbacks, 0);
+	g_mutex_unlock(&st->mutex);
+}
+
+/** @private */
+SR_PRIV void sr_session_stats_destroy(struct sr_session *session)
+{
+	struct session_stats *st;
+
+	st = session->stats;
+	if (!st)
+		return;
+
+	g_array_free(st->transforms, TRUE);
+	g_array_free(st->callbacks, TRUE);
+	g_mutex_clear(&st->mutex);
+	g_free(st);
+	session->stats = NULL;
+}
+
+/**
+ * Enable or disable the session performance counters.
+ *
+ * Counting costs some time per packet, so it is disabled by default.
+ * The counters are cleared whenever the session starts.
+ *
+ * @param session The session to use. Must not be NULL, nor running.
+ * @param enable TRUE to enable, FALSE to disable the counters.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_stats_enable(struct sr_session *session,
+		gboolean enable)
+{
+	struct session_stats *st;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change performance counters while running.");
+		return SR_ERR;
+	}
+
+	if (!enable) {
+		sr_session_stats_destroy(session);
+		return SR_OK;
+	}
+	if (session->stats)
+		return SR_OK;
+
+	st = g_malloc0(sizeof(*st));
+	g_mutex_init(&st->mutex);
+	st->transforms = g_array_new(FALSE, TRUE,
+		sizeof(struct sr_stats_histogram));
+	st->callbacks = g_array_new(FALSE, TRUE,
+		sizeof(struct sr_stats_histogram));
+	session->stats = st;
+
+	return SR_OK;
+}
+
+static GSList *histogram_list(GArray *array)
+{
+	GSList *l;
+	struct sr_stats_histogram *h;
+	unsigned int i;
+
+	l = NULL;
+	for (i = array->len; i > 0; i--) {
+		h = g_malloc(sizeof(*h));
+		*h = g_array_index(array, struct sr_stats_histogram, i - 1);
+		l = g_slist_prepend(l, h);
+	}
+
+	return l;
+}
+
+/**
+ * Get the performance counters of the current or last run.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param stats Newly allocated counters, free them with
+ *              sr_session_stats_free(). Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The counters are not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_stats_get(struct sr_session *session,
+		struct sr_session_stats **stats)
+{
+	struct session_stats *st;
+	struct sr_session_stats *copy;
+
+	if (!session || !stats)
+		return SR_ERR_ARG;
+
+	st = session->stats;
+	if (!st)
+		return SR_ERR_NA;
+
+	copy = g_malloc(sizeof(*copy));
+	g_mutex_lock(&st->mutex);
+	*copy = st->stats;
+	copy->transforms = histogram_list(st->transforms);
+	copy->callbacks = histogram_list(st->callbacks);
+	g_mutex_unlock(&st->mutex);
+	*stats = copy;
+
+	return SR_OK;
+}
+
+/**
+ * Free counters returned by sr_session_stats_get().
+ *
+ * @param stats The counters to free. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_session_stats_free(struct sr_session_stats *stats)
+{
+	if (!stats)
+		return;
+
+	g_slist_free_full(stats->transforms, g_free);
+	g_slist_free_full(stats->callbacks, g_free);
+	g_free(stats);
+}
+
+/** @} */
@@ -0,0 +1,554 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Session sample store.
+ *
+ * When enabled, the session keeps all logic samples of each device and
+ * all analog samples of each channel, converted to float. The samples
+ * are kept in page aligned segments of equal size, so appending never
+ * moves data that was stored before, and any sample is found from its
+ * index directly. Segments can be mapped from files rather than taking
+ * memory, for captures larger than what fits in RAM.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+#define DEFAULT_SEGMENT_SIZE	(4 * 1024 * 1024)
+
+/* The samples of one device's logic data, or one analog channel. */
+struct store_stream {
+	size_t unitsize;
+	uint64_t num_samples;
+	uint64_t per_segment;
+	GPtrArray *segments;
+};
+
+struct session_store {
+	GMutex mutex;
+	size_t segment_size;
+	char *backing_dir;
+	/* Logic streams by device, analog streams by channel. */
+	GHashTable *logic;
+	GHashTable *analog;
+	/* Analog conversion buffer. */
+	float *fbuf;
+	size_t fbuf_len;
+};
+
+static size_t page_size(void)
+{
+#ifdef HAVE_SYS_MMAN_H
+	long size;
+
+	size = sysconf(_SC_PAGESIZE);
+	if (size > 0)
+		return size;
+#endif
+	return 4096;
+}
+
+static void *segment_new(struct session_store *st)
+{
+#ifdef HAVE_SYS_MMAN_H
+	void *mem;
+	char *path;
+	int fd;
+
+	if (!st->backing_dir) {
+		mem = mmap(NULL, st->segment_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return mem != MAP_FAILED ? mem : NULL;
+	}
+
+	/* The file goes away with the mapping. */
+	path = g_build_filename(st->backing_dir, "sigrok-store-XXXXXX", NULL);
+	fd = g_mkstemp(path);
+	if (fd < 0) {
+		sr_err("Cannot create sample store file in %s.", st->backing_dir);
+		g_free(path);
+		return NULL;
+	}
+	g_unlink(path);
+	g_free(path);
+
+	mem = MAP_FAILED;
+	if (ftruncate(fd, st->segment_size) == 0)
+		mem = mmap(NULL, st->segment_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+
+	return mem != MAP_FAILED ? mem : NULL;
+#else
+	return g_try_malloc(st->segment_size);
+#endif
+}
+
+static void segment_free(struct session_store *st, void *mem)
+{
+#ifdef HAVE_SYS_MMAN_H
+	munmap(mem, st->segment_size);
+#else
+	(void)st;
+	g_free(mem);
+#endif
+}
+
+static void stream_free(struct session_store *st, struct store_stream *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < s->segments->len; i++)
+		segment_free(st, g_ptr_array_index(s->segments, i));
+	g_ptr_array_free(s->segments, TRUE);
+	g_free(s);
+}
+
+static gboolean stream_remove(gpointer key, gpointer value, gpointer data)
+{
+	(void)key;
+
+	stream_free(data, value);
+
+	return TRUE;
+}
+
+static struct store_stream *stream_get(struct session_store *st,
+		GHashTable *streams, const void *key, size_t unitsize)
+{
+	struct store_stream *s;
+
+	s = g_hash_table_lookup(streams, key);
+	if (s && s->unitsize == unitsize)
+		return s;
+	if (s) {
+		/* Samples of differing size can't be indexed as one. */
+		sr_warn("Sample size changed, dropping stored samples.");
+		g_hash_table_remove(streams, key);
+		stream_free(st, s);
+	}
+
+	s = g_malloc0(sizeof(*s));
+	s->unitsize = unitsize;
+	s->per_segment = st->segment_size / unitsize;
+	s->segments = g_ptr_array_new();
+	g_hash_table_insert(streams, (void *)key, s);
+
+	return s;
+}
+
+static int stream_append(struct session_store *st, struct store_stream *s,
+		const uint8_t *data, uint64_t count)
+{
+	uint64_t seg, offset, n;
+	void *mem;
+
+	while (count) {
+		seg = s->num_samples / s->per_segment;
+		offset = s->num_samples % s->per_segment;
+		if (seg == s->segments->len) {
+			mem = segment_new(st);
+			if (!mem) {
+				sr_err("Cannot allocate sample store segment.");
+				return SR_ERR_MALLOC;
+			}
+			g_ptr_array_add(s->segments, mem);
+		}
+
+		n = MIN(count, s->per_segment - offset);
+		memcpy((uint8_t *)g_ptr_array_index(s->segments, seg) +
+			offset * s->unitsize, data, n * s->unitsize);
+		s->num_samples += n;
+		data += n * s->unitsize;
+		count -= n;
+	}
+
+	return SR_OK;
+}
+
+static void stream_read(const struct store_stream *s, uint64_t start,
+		uint64_t count, uint8_t *dest)
+{
+	uint64_t seg, offset, n;
+
+	while (count) {
+		seg = start / s->per_segment;
+		offset = start % s->per_segment;
+		n = MIN(count, s->per_segment - offset);
+		memcpy(dest, (uint8_t *)g_ptr_array_index(s->segments, seg) +
+			offset * s->unitsize, n * s->unitsize);
+		start += n;
+		dest += n * s->unitsize;
+		count -= n;
+	}
+}
+
+/* Called with the mutex held. */
+static int store_analog(struct session_store *st,
+		const struct sr_datafeed_analog *analog)
+{
+	struct store_stream *s;
+	GSList *l;
+	size_t len;
+	uint64_t i;
+	int ret;
+
+	if (!analog->meaning || !analog->meaning->channels)
+		return SR_OK;
+
+	len = (size_t)analog->num_samples *
+		g_slist_length(analog->meaning->channels);
+	if (len > st->fbuf_len) {
+		g_free(st->fbuf);
+		st->fbuf = g_try_malloc(len * sizeof(float));
+		st->fbuf_len = st->fbuf ? len : 0;
+		if (!st->fbuf) {
+			sr_err("Cannot allocate sample store buffer.");
+			return SR_ERR_MALLOC;
+		}
+	}
+	ret = sr_analog_to_float(analog, st->fbuf);
+	if (ret != SR_OK)
+		return ret;
+
+	/* The samples come one channel after the other. */
+	for (l = analog->meaning->channels, i = 0; l; l = l->next, i++) {
+		s = stream_get(st, st->analog, l->data, sizeof(float));
+		ret = stream_append(st, s,
+			(uint8_t *)(st->fbuf + i * analog->num_samples),
+			analog->num_samples);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Keep the samples of a packet in the store.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_store_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	struct session_store *st;
+	const struct sr_datafeed_logic *logic;
+	struct store_stream *s;
+
+	st = sdi->session->store;
+
+	g_mutex_lock(&st->mutex);
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		if (logic->unitsize) {
+			s = stream_get(st, st->logic, sdi, logic->unitsize);
+			stream_append(st, s, logic->data,
+				logic->length / logic->unitsize);
+		}
+	} else if (packet->type == SR_DF_ANALOG) {
+		store_analog(st, packet->payload);
+	}
+	g_mutex_unlock(&st->mutex);
+}
+
+/**
+ * Drop the stored samples, for a new run of the session.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_store_reset(struct sr_session *session)
+{
+	struct session_store *st;
+
+	st = session->store;
+	if (!st)
+		return;
+
+	g_mutex_lock(&st->mutex);
+	g_hash_table_foreach_remove(st->logic, stream_remove, st);
+	g_hash_table_foreach_remove(st->analog, stream_remove, st);
+	g_mutex_unlock(&st->mutex);
+}
+
+/** @private */
+SR_PRIV void sr_session_store_free(struct sr_session *session)
+{
+	struct session_store *st;
+
+	st = session->store;
+	if (!st)
+		return;
+
+	sr_session_store_reset(session);
+	g_hash_table_unref(st->logic);
+	g_hash_table_unref(st->analog);
+	g_mutex_clear(&st->mutex);
+	g_free(st->backing_dir);
+	g_free(st->fbuf);
+	g_free(st);
+	session->store = NULL;
+}
+
+/**
+ * Keep all samples of the session for random access.
+ *
+ * Stores the logic samples of every device, and the analog samples of
+ * every channel converted to float, as they are passed on to the
+ * datafeed callbacks. The samples of the last run are kept until the
+ * session starts again, or the store is disabled.
+ *
+ * @param session The session to use. Must not be NULL, nor running.
+ * @param enable TRUE to enable, FALSE to disable the store.
+ * @param segment_size Size of the memory blocks samples are kept in,
+ *                     rounded up to whole pages. 0 for the default.
+ * @param backing_dir Directory to create files in which back the store.
+ *                    NULL to keep samples in memory.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA File backing is not supported on this system.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_store_set(struct sr_session *session,
+		gboolean enable, size_t segment_size, const char *backing_dir)
+{
+	struct session_store *st;
+	size_t page;
+
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change the sample store while running.");
+		return SR_ERR;
+	}
+#ifndef HAVE_SYS_MMAN_H
+	if (backing_dir) {
+		sr_err("File backed sample store is not supported.");
+		return SR_ERR_NA;
+	}
+#endif
+
+	sr_session_store_free(session);
+	if (!enable)
+		return SR_OK;
+
+	if (!segment_size)
+		segment_size = DEFAULT_SEGMENT_SIZE;
+	page = page_size();
+
+	st = g_malloc0(sizeof(*st));
+	g_mutex_init(&st->mutex);
+	/* Whole pages, so that all segments are page aligned. */
+	st->segment_size = MAX(page, (segment_size + page - 1) / page * page);
+	st->backing_dir = g_strdup(backing_dir);
+	st->logic = g_hash_table_new(g_direct_hash, g_direct_equal);
+	st->analog = g_hash_table_new(g_direct_hash, g_direct_equal);
+	session->store = st;
+
+	return SR_OK;
+}
+
+/**
+ * Get the number and size of the logic samples stored for a device.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device. Must not be NULL.
+ * @param num_samples Number of samples stored. Must not be NULL.
+ * @param unitsize Size of each sample in bytes. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The store is not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_store_logic_info(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t *num_samples,
+		uint16_t *unitsize)
+{
+	struct session_store *st;
+	struct store_stream *s;
+
+	if (!session || !sdi || !num_samples)
+		return SR_ERR_ARG;
+
+	st = session->store;
+	if (!st)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&st->mutex);
+	s = g_hash_table_lookup(st->logic, sdi);
+	*num_samples = s ? s->num_samples : 0;
+	if (unitsize)
+		*unitsize = s ? s->unitsize : 0;
+	g_mutex_unlock(&st->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Copy stored logic samples of a device.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device. Must not be NULL.
+ * @param start Index of the first sample.
+ * @param count Number of samples to copy.
+ * @param dest Where to copy the samples to, @a count times the unit size
+ *             from sr_session_store_logic_info(). Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or samples not stored.
+ * @retval SR_ERR_NA The store is not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_store_logic_read(struct sr_session *session,
+		const struct sr_dev_inst *sdi, uint64_t start, uint64_t count,
+		void *dest)
+{
+	struct session_store *st;
+	struct store_stream *s;
+
+	if (!session || !sdi || !dest)
+		return SR_ERR_ARG;
+
+	st = session->store;
+	if (!st)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&st->mutex);
+	s = g_hash_table_lookup(st->logic, sdi);
+	if (!s || start > s->num_samples || count > s->num_samples - start) {
+		g_mutex_unlock(&st->mutex);
+		return SR_ERR_ARG;
+	}
+	stream_read(s, start, count, dest);
+	g_mutex_unlock(&st->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Get the number of analog samples stored for a channel.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param ch The channel. Must not be NULL.
+ * @param num_samples Number of samples stored. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA The store is not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_store_analog_info(struct sr_session *session,
+		const struct sr_channel *ch, uint64_t *num_samples)
+{
+	struct session_store *st;
+	struct store_stream *s;
+
+	if (!session || !ch || !num_samples)
+		return SR_ERR_ARG;
+
+	st = session->store;
+	if (!st)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&st->mutex);
+	s = g_hash_table_lookup(st->analog, ch);
+	*num_samples = s ? s->num_samples : 0;
+	g_mutex_unlock(&st->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Copy stored analog samples of a channel.
+ *
+ * Can be called from any thread, also while the session is running.
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param ch The channel. Must not be NULL.
+ * @param start Index of the first sample.
+ * @param count Number of samples to copy.
+ * @param dest Where to copy the samples to. Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or samples not stored.
+ * @retval SR_ERR_NA The store is not enabled.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_store_analog_read(struct sr_session *session,
+		const struct sr_channel *ch, uint64_t start, uint64_t count,
+		float *dest)
+{
+	struct session_store *st;
+	struct store_stream *s;
+
+	if (!session || !ch || !dest)
+		return SR_ERR_ARG;
+
+	st = session->store;
+	if (!st)
+		return SR_ERR_NA;
+
+	g_mutex_lock(&st->mutex);
+	s = g_hash_table_lookup(st->analog, ch);
+	if (!s || start > s->num_samples || count > s->num_samples - start) {
+		g_mutex_unlock(&st->mutex);
+		return SR_ERR_ARG;
+	}
+	stream_read(s, start, count, (uint8_t *)dest);
+	g_mutex_unlock(&st->mutex);
+
+	return SR_OK;
+}
+
+/** @} */
@@ -0,0 +1,256 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "session"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Per-device worker threads.
+ *
+ * When enabled, every device of a session gets a main context and a
+ * thread of its own. The event sources a driver installs while it
+ * starts, or later from its own callbacks, end up on that context, so
+ * one device's processing doesn't hold up the others. The session
+ * main context keeps the stop handling.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+struct session_worker {
+	struct sr_dev_inst *sdi;
+	GMainContext *context;
+	GMainLoop *loop;
+	GThread *thread;
+};
+
+/* The worker whose device the current thread is servicing. */
+static GPrivate current_worker;
+
+static gpointer worker_thread(gpointer data)
+{
+	struct session_worker *w;
+
+	w = data;
+
+	g_private_set(&current_worker, w);
+	g_main_context_push_thread_default(w->context);
+	g_main_loop_run(w->loop);
+	g_main_context_pop_thread_default(w->context);
+	g_private_set(&current_worker, NULL);
+
+	return NULL;
+}
+
+static void worker_free(struct session_worker *w)
+{
+	g_main_loop_unref(w->loop);
+	g_main_context_unref(w->context);
+	g_free(w);
+}
+
+static struct session_worker *worker_find(struct sr_session *session,
+		const struct sr_dev_inst *sdi)
+{
+	GSList *l;
+	struct session_worker *w;
+
+	for (l = session->workers; l; l = l->next) {
+		w = l->data;
+		if (w->sdi == sdi)
+			return w;
+	}
+
+	return NULL;
+}
+
+/**
+ * Get the main context for event sources installed from this thread.
+ *
+ * @retval NULL Use the session main context.
+ *
+ * @private
+ */
+SR_PRIV GMainContext *sr_session_worker_context(struct sr_session *session)
+{
+	struct session_worker *w;
+
+	if (!session->workers)
+		return NULL;
+
+	w = g_private_get(&current_worker);
+	if (!w || !g_slist_find(session->workers, w))
+		return NULL;
+
+	return w->context;
+}
+
+/**
+ * Start a device of the session, on its own context if enabled.
+ *
+ * The worker threads only start with sr_session_workers_run(), once all
+ * devices started.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_worker_dev_start(struct sr_session *session,
+		struct sr_dev_inst *sdi)
+{
+	struct session_worker *w;
+	int ret;
+
+	if (!session->threaded)
+		return sr_dev_acquisition_start(sdi);
+
+	w = g_malloc0(sizeof(*w));
+	w->sdi = sdi;
+	w->context = g_main_context_new();
+	w->loop = g_main_loop_new(w->context, FALSE);
+	session->workers = g_slist_append(session->workers, w);
+
+	g_private_set(&current_worker, w);
+	g_main_context_push_thread_default(w->context);
+	ret = sr_dev_acquisition_start(sdi);
+	g_main_context_pop_thread_default(w->context);
+	g_private_set(&current_worker, NULL);
+
+	return ret;
+}
+
+/**
+ * Start the worker threads.
+ *
+ * @private
+ */
+SR_PRIV int sr_session_workers_run(struct sr_session *session)
+{
+	GSList *l;
+	struct session_worker *w;
+	char name[16];
+
+	for (l = session->workers; l; l = l->next) {
+		w = l->data;
+		g_snprintf(name, sizeof(name), "sr-%s", w->sdi->driver->name);
+		w->thread = g_thread_try_new(name, worker_thread, w, NULL);
+		if (!w->thread) {
+			sr_err("Cannot start worker thread for %s.",
+				w->sdi->driver->name);
+			return SR_ERR;
+		}
+	}
+
+	return SR_OK;
+}
+
+static gboolean worker_dev_stop(void *data)
+{
+	sr_dev_acquisition_stop(data);
+
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * Stop a device of the session, from the thread servicing it.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_worker_dev_stop(struct sr_session *session,
+		struct sr_dev_inst *sdi)
+{
+	struct session_worker *w;
+
+	w = worker_find(session, sdi);
+	if (w && w->thread)
+		g_main_context_invoke(w->context, worker_dev_stop, sdi);
+	else
+		sr_dev_acquisition_stop(sdi);
+}
+
+/**
+ * End the worker threads and drop their contexts.
+ *
+ * Must not be called from a worker thread.
+ *
+ * @private
+ */
+SR_PRIV void sr_session_workers_stop(struct sr_session *session)
+{
+	GSList *l;
+	struct session_worker *w;
+
+	for (l = session->workers; l; l = l->next) {
+		w = l->data;
+		if (!w->thread)
+			continue;
+		g_main_loop_quit(w->loop);
+		g_thread_join(w->thread);
+		w->thread = NULL;
+	}
+
+	g_slist_free_full(session->workers, (GDestroyNotify)worker_free);
+	session->workers = NULL;
+}
+
+/**
+ * Run each device of the session on a thread of its own.
+ *
+ * Every device gets its own main context and thread for its event
+ * sources. Packets of all devices still go to the same transforms and
+ * datafeed callbacks, one packet at a time: each device's packets keep
+ * their order, packets of different devices are interleaved in the
+ * order they were sent. Datafeed callbacks are called from the worker
+ * threads then, see also sr_session_dispatch_async_set().
+ *
+ * @param session The session to use. Must not be NULL, nor running.
+ * @param enable TRUE for a thread per device, FALSE to run all devices
+ *               on the session main context (the default).
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR Session is running.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_session_device_threads_set(struct sr_session *session,
+		gboolean enable)
+{
+	if (!session) {
+		sr_err("%s: session was NULL", __func__);
+		return SR_ERR_ARG;
+	}
+	if (session->running) {
+		sr_err("Cannot change device threads while running.");
+		return SR_ERR;
+	}
+
+	session->threaded = enable;
+
+	return SR_OK;
+}
+
+/** @} */
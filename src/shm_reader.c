@@ -0,0 +1,280 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#ifdef HAVE_SHM_OPEN
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "shm_ring.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "shm-reader"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Reading the datafeed from another process.
+ *
+ * The "shm" output module publishes the packets of a session into a
+ * POSIX shared memory ring. Any number of processes can map the ring
+ * with sr_shm_reader_open() and read the packets in place, without
+ * copies and without disturbing the writer or each other. A reader
+ * which falls behind by more than the ring holds loses the oldest
+ * packets, which sr_shm_reader_lost() counts.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+struct sr_shm_reader {
+	void *map;
+	size_t map_size;
+	const struct shm_ring_header *hdr;
+	const uint8_t *data;
+	uint32_t size;
+	guint pos;
+	/* Bytes of the record handed out, 0 if none. */
+	uint32_t pending;
+	gboolean have_seq;
+	uint64_t next_seq;
+	uint64_t lost;
+};
+
+/**
+ * Map the shared memory ring of a "shm" output module.
+ *
+ * The reader starts with the next packet written, not with the ones
+ * already in the ring.
+ *
+ * @param name The name of the ring, the "name" option of the module.
+ * @param reader The reader, to be closed with sr_shm_reader_close().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_IO The ring can't be opened.
+ * @retval SR_ERR_DATA The object is not a ring of a supported version.
+ * @retval SR_ERR_NA Shared memory is not supported on this platform.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_shm_reader_open(const char *name, struct sr_shm_reader **reader)
+{
+#ifdef HAVE_SHM_OPEN
+	struct sr_shm_reader *r;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (!name || !reader)
+		return SR_ERR_ARG;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		sr_err("Failed to open shared memory %s: %s.", name,
+			g_strerror(errno));
+		return SR_ERR_IO;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < SHM_RING_DATA_OFFSET) {
+		close(fd);
+		return SR_ERR_DATA;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		sr_err("Failed to map shared memory %s: %s.", name,
+			g_strerror(errno));
+		return SR_ERR_IO;
+	}
+
+	r = g_malloc0(sizeof(*r));
+	r->map = map;
+	r->map_size = st.st_size;
+	r->hdr = map;
+	r->data = (const uint8_t *)map + SHM_RING_DATA_OFFSET;
+	r->size = r->hdr->size;
+	if (memcmp(r->hdr->magic, SHM_RING_MAGIC, sizeof(r->hdr->magic)) ||
+			r->hdr->version != SHM_RING_VERSION ||
+			r->map_size != SHM_RING_DATA_OFFSET + (size_t)r->size) {
+		sr_err("%s is not a datafeed ring.", name);
+		sr_shm_reader_close(r);
+		return SR_ERR_DATA;
+	}
+	r->pos = g_atomic_int_get(&r->hdr->head);
+	*reader = r;
+
+	return SR_OK;
+#else
+	(void)name;
+	(void)reader;
+
+	return SR_ERR_NA;
+#endif
+}
+
+/**
+ * Unmap a shared memory ring.
+ *
+ * @param reader The reader. Can be NULL.
+ *
+ * @since 0.6.0
+ */
+SR_API void sr_shm_reader_close(struct sr_shm_reader *reader)
+{
+	if (!reader)
+		return;
+
+#ifdef HAVE_SHM_OPEN
+	munmap(reader->map, reader->map_size);
+#endif
+	g_free(reader);
+}
+
+/* Whether the writer has started overwriting pos. */
+static gboolean overrun(const struct sr_shm_reader *r)
+{
+	return (gint)(r->pos - (guint)g_atomic_int_get(&r->hdr->tail)) < 0;
+}
+
+/**
+ * Get the next packet of the ring, without waiting.
+ *
+ * The packet points into the ring. Call sr_shm_reader_release() when
+ * done with it, which also tells whether the writer overwrote it
+ * meanwhile. Calling this function again releases it as well.
+ *
+ * @param reader The reader.
+ * @param packet Filled in with the packet.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_NA No new packet yet. Poll again later, unless
+ *         sr_shm_reader_active() tells the writer is gone.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_shm_reader_next(struct sr_shm_reader *reader,
+		struct sr_shm_packet *packet)
+{
+	struct shm_record rec;
+	uint32_t off;
+
+	if (!reader || !packet)
+		return SR_ERR_ARG;
+
+	(void)sr_shm_reader_release(reader);
+	for (;;) {
+		if (reader->pos == (guint)g_atomic_int_get(&reader->hdr->head))
+			return SR_ERR_NA;
+		if (overrun(reader)) {
+			reader->pos = g_atomic_int_get(&reader->hdr->tail);
+			continue;
+		}
+		off = reader->pos & (reader->size - 1);
+		memcpy(&rec, reader->data + off, sizeof(rec));
+		/* The copy is good only if it still was not overwritten. */
+		if (overrun(reader))
+			continue;
+		if (rec.type == SHM_RECORD_PAD) {
+			reader->pos += reader->size - off;
+			continue;
+		}
+		if (rec.length > reader->size - off - sizeof(rec)) {
+			sr_err("Bad record in ring, skipping to the writer.");
+			reader->pos = g_atomic_int_get(&reader->hdr->head);
+			continue;
+		}
+		break;
+	}
+
+	if (reader->have_seq && rec.seq > reader->next_seq)
+		reader->lost += rec.seq - reader->next_seq;
+	reader->have_seq = TRUE;
+	reader->next_seq = rec.seq + 1;
+	reader->pending = shm_record_bytes(rec.length);
+
+	packet->seq = rec.seq;
+	packet->type = rec.type;
+	packet->unitsize = rec.unitsize;
+	packet->channel = rec.channel;
+	packet->length = rec.length;
+	packet->data = reader->data + off + sizeof(rec);
+
+	return SR_OK;
+}
+
+/**
+ * Done with the packet of the last sr_shm_reader_next().
+ *
+ * @param reader The reader.
+ *
+ * @retval SR_OK Success, also if there is no packet to release.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR_DATA The writer overwrote the packet while it was used,
+ *         what was read from it may be garbage.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_shm_reader_release(struct sr_shm_reader *reader)
+{
+	gboolean lost;
+
+	if (!reader)
+		return SR_ERR_ARG;
+	if (!reader->pending)
+		return SR_OK;
+
+	lost = overrun(reader);
+	reader->pos += reader->pending;
+	reader->pending = 0;
+
+	return lost ? SR_ERR_DATA : SR_OK;
+}
+
+/**
+ * Number of packets the reader missed, because the writer overwrote
+ * them before they were read.
+ *
+ * @since 0.6.0
+ */
+SR_API uint64_t sr_shm_reader_lost(const struct sr_shm_reader *reader)
+{
+	return reader ? reader->lost : 0;
+}
+
+/**
+ * Whether the writer still has the ring open.
+ *
+ * @since 0.6.0
+ */
+SR_API gboolean sr_shm_reader_active(const struct sr_shm_reader *reader)
+{
+	return reader && g_atomic_int_get(&reader->hdr->active);
+}
+
+/** @} */
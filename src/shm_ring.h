@@ -0,0 +1,79 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_SHM_RING_H
+#define LIBSIGROK_SHM_RING_H
+
+#include <stdint.h>
+#include <glib.h>
+
+/*
+ * Layout of the shared memory ring which the "shm" output module writes
+ * and sr_shm_reader_*() read, possibly in other processes.
+ *
+ * The object starts with struct shm_ring_header, the records follow at
+ * SHM_RING_DATA_OFFSET. Each record is a struct shm_record with its
+ * payload, padded to SHM_RING_ALIGN, and never wraps: a SHM_RECORD_PAD
+ * record fills the rest of the ring instead.
+ *
+ * Positions are byte counts since the start, modulo 2^32. The writer
+ * publishes records by advancing head. Before it overwrites any byte,
+ * it advances tail past the records which go, so readers need no lock:
+ * a reader which finds tail beyond the record it read knows it was
+ * overwritten meanwhile, and skips ahead to tail.
+ */
+
+#define SHM_RING_MAGIC		"SRSHMRB"
+#define SHM_RING_VERSION	1
+#define SHM_RING_DATA_OFFSET	4096
+#define SHM_RING_ALIGN		32
+#define SHM_RING_MIN_SIZE	(64 * 1024)
+#define SHM_RING_MAX_SIZE	(1024 * 1024 * 1024)
+
+#define SHM_RECORD_PAD		0xffffffff
+
+struct shm_ring_header {
+	char magic[8];
+	uint32_t version;
+	/* Bytes of record space, a power of two. */
+	uint32_t size;
+	gint head;
+	gint tail;
+	/* Cleared when the writer is gone. */
+	gint active;
+	uint32_t reserved;
+};
+
+struct shm_record {
+	uint64_t seq;
+	/* Payload bytes, without the padding. */
+	uint64_t length;
+	/* A datafeed packet type, or SHM_RECORD_PAD. */
+	uint32_t type;
+	/* Bytes per sample, or the key of SR_DF_META. */
+	uint32_t unitsize;
+	int32_t channel;
+	uint32_t reserved;
+};
+
+static inline uint32_t shm_record_bytes(uint64_t length)
+{
+	return (sizeof(struct shm_record) + length + SHM_RING_ALIGN - 1)
+		& ~(uint32_t)(SHM_RING_ALIGN - 1);
+}
+
+#endif
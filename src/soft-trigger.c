@@ -18,14 +18,57 @@
  */
 
 #include <config.h>
+#include <float.h>
+#include <math.h>
 #include <string.h>
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
+#include "cpu_features.h"
+
+#ifdef SR_CPU_X86
+#define SOFT_TRIGGER_X86
+#include <immintrin.h>
+#define TARGET_SSE2 SR_TARGET_SSE2
+#define TARGET_AVX2 SR_TARGET_AVX2
+#endif
+
+#ifdef SR_CPU_NEON_BUILD
+#define SOFT_TRIGGER_NEON
+#include <arm_neon.h>
+#endif
 
 /** @cond PRIVATE */
 #define LOG_PREFIX "soft-trigger"
 /** @endcond */
 
+/*
+ * A trigger stage, compiled to bit masks over the sample. Bit n of the
+ * masks is logic channel n, in 64 bit words as samples are little endian.
+ */
+struct soft_trigger_stage {
+	/* The stage has no matches at all. */
+	gboolean empty;
+	/* The matches contradict each other, the stage can never match. */
+	gboolean impossible;
+	/* The stage has edge matches, which need a previous sample. */
+	gboolean edges;
+	/* Consecutive samples to match, at least 1. */
+	uint64_t repeat;
+	/* Samples the match may start after the previous stage's. */
+	uint64_t window;
+	uint64_t *level_mask;
+	uint64_t *level_value;
+	uint64_t *rising;
+	uint64_t *falling;
+	uint64_t *edge;
+	/*
+	 * The channels with edge matches, repeated for all samples in
+	 * 8 bytes of data, in host byte order. Zero if samples can't be
+	 * compared that way.
+	 */
+	uint64_t change_mask;
+};
+
 SR_PRIV int logic_channel_unitsize(GSList *channels)
 {
 	int number = 0;
@@ -41,18 +84,128 @@ SR_PRIV int logic_channel_unitsize(GSList *channels)
 	return (number + 7) / 8;
 }
 
+static void stage_compile(struct soft_trigger_stage *stage,
+		const struct sr_trigger_stage *trigger_stage, int nwords,
+		uint64_t *words)
+{
+	const struct sr_trigger_match *match;
+	GSList *l;
+	int index, w;
+	uint64_t bit;
+
+	stage->level_mask = words;
+	stage->level_value = words + nwords;
+	stage->rising = words + 2 * nwords;
+	stage->falling = words + 3 * nwords;
+	stage->edge = words + 4 * nwords;
+	stage->empty = !trigger_stage->matches;
+	stage->repeat = MAX(1, trigger_stage->repeat);
+	stage->window = trigger_stage->window;
+
+	for (l = trigger_stage->matches; l; l = l->next) {
+		match = l->data;
+		if (!match->channel->enabled)
+			/* Ignore disabled channels with a trigger. */
+			continue;
+		index = match->channel->index;
+		if (index >= nwords * 64) {
+			stage->impossible = TRUE;
+			continue;
+		}
+		w = index / 64;
+		bit = UINT64_C(1) << (index % 64);
+
+		switch (match->match) {
+		case SR_TRIGGER_ZERO:
+		case SR_TRIGGER_ONE:
+			if ((stage->level_mask[w] & bit) &&
+					!!(stage->level_value[w] & bit) !=
+					(match->match == SR_TRIGGER_ONE))
+				stage->impossible = TRUE;
+			stage->level_mask[w] |= bit;
+			if (match->match == SR_TRIGGER_ONE)
+				stage->level_value[w] |= bit;
+			break;
+		case SR_TRIGGER_RISING:
+			stage->rising[w] |= bit;
+			stage->edges = TRUE;
+			break;
+		case SR_TRIGGER_FALLING:
+			stage->falling[w] |= bit;
+			stage->edges = TRUE;
+			break;
+		case SR_TRIGGER_EDGE:
+			stage->edge[w] |= bit;
+			stage->edges = TRUE;
+			break;
+		default:
+			/* Analog matches never match on logic data. */
+			stage->impossible = TRUE;
+			break;
+		}
+	}
+}
+
+static void stage_compile_change_mask(struct soft_trigger_stage *stage,
+		int unitsize)
+{
+	uint64_t edges;
+	uint8_t bytes[8];
+	int i;
+
+	if (!stage->edges || 8 % unitsize)
+		return;
+
+	edges = stage->rising[0] | stage->falling[0] | stage->edge[0];
+	for (i = 0; i < 8; i++)
+		bytes[i] = edges >> (8 * (i % unitsize));
+	memcpy(&stage->change_mask, bytes, sizeof(stage->change_mask));
+}
+
+static struct soft_trigger_logic *stl_compile(const struct sr_trigger *trigger,
+		int unitsize)
+{
+	struct soft_trigger_logic *stl;
+	GSList *l;
+	int i;
+
+	stl = g_malloc0(sizeof(struct soft_trigger_logic));
+	stl->trigger = trigger;
+	stl->unitsize = unitsize;
+	stl->prev_sample = g_malloc0(stl->unitsize);
+	stl->skip = skip_func_get();
+
+	/* Compile the stages once, rather than walk them on every sample. */
+	stl->nwords = MAX(1, (stl->unitsize + 7) / 8);
+	stl->num_stages = g_slist_length(trigger->stages);
+	stl->stages = g_new0(struct soft_trigger_stage, stl->num_stages);
+	stl->stage_words = g_new0(uint64_t, 5 * stl->nwords * stl->num_stages);
+	for (l = trigger->stages, i = 0; l; l = l->next, i++) {
+		stage_compile(&stl->stages[i], l->data, stl->nwords,
+			stl->stage_words + 5 * stl->nwords * i);
+		stage_compile_change_mask(&stl->stages[i], stl->unitsize);
+	}
+
+	return stl;
+}
+
 SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
 		int pre_trigger_samples)
 {
 	struct soft_trigger_logic *stl;
 
-	stl = g_malloc0(sizeof(struct soft_trigger_logic));
+	stl = stl_compile(trigger, logic_channel_unitsize(sdi->channels));
 	stl->sdi = sdi;
-	stl->trigger = trigger;
-	stl->unitsize = logic_channel_unitsize(sdi->channels);
-	stl->prev_sample = g_malloc0(stl->unitsize);
+
 	stl->pre_trigger_size = stl->unitsize * pre_trigger_samples;
+	stl->mem_ctx = sr_mem_context(sdi);
+	if (sr_mem_reserve(stl->mem_ctx, MAX(0, stl->pre_trigger_size),
+			"Pre-trigger buffer") != SR_OK) {
+		soft_trigger_logic_free(stl);
+		return NULL;
+	}
+	stl->mem_reserved = MAX(0, stl->pre_trigger_size);
 	stl->pre_trigger_buffer = g_try_malloc(stl->pre_trigger_size);
 	if (pre_trigger_samples > 0 && !stl->pre_trigger_buffer) {
 		/*
@@ -73,10 +226,35 @@ SR_PRIV struct soft_trigger_logic *soft_trigger_logic_new(
 	return stl;
 }
 
+/* A piece of pre-trigger data, in a buffer the driver sent. */
+struct pre_trigger_chunk {
+	struct sr_buffer *buf;
+	const uint8_t *data;
+	int len;
+};
+
+static void copy_free(void *data, void *cb_data)
+{
+	(void)cb_data;
+
+	g_free(data);
+}
+
+static void chunk_free(struct pre_trigger_chunk *chunk)
+{
+	sr_buffer_unref(chunk->buf);
+	g_free(chunk);
+}
+
 SR_PRIV void soft_trigger_logic_free(struct soft_trigger_logic *stl)
 {
+	if (stl->retained)
+		g_queue_free_full(stl->retained, (GDestroyNotify)chunk_free);
 	g_free(stl->pre_trigger_buffer);
+	sr_mem_release(stl->mem_ctx, stl->mem_reserved);
 	g_free(stl->prev_sample);
+	g_free(stl->stages);
+	g_free(stl->stage_words);
 	g_free(stl);
 }
 
@@ -138,36 +316,510 @@ static void pre_trigger_send(struct soft_trigger_logic *stl,
 	}
 }
 
-static gboolean logic_check_match(struct soft_trigger_logic *stl,
-		uint8_t *sample, struct sr_trigger_match *match)
+static void pre_trigger_retain(struct soft_trigger_logic *stl,
+		uint8_t *buf, int len, struct sr_buffer *ref)
 {
-	int bit, prev_bit;
-	gboolean result;
+	struct pre_trigger_chunk *chunk;
+	uint8_t *copy;
+
+	if (len > stl->pre_trigger_size) {
+		buf += len - stl->pre_trigger_size;
+		len = stl->pre_trigger_size;
+	}
+	if (len <= 0)
+		return;
 
-	stl->count++;
-	result = FALSE;
-	bit = *(sample + match->channel->index / 8)
-			& (1 << (match->channel->index % 8));
-	if (match->match == SR_TRIGGER_ZERO)
-		result = bit == 0;
-	else if (match->match == SR_TRIGGER_ONE)
-		result = bit != 0;
-	else {
-		/* Edge matches. */
-		if (stl->count == 1)
-			/* First sample, don't have enough for an edge match yet. */
+	chunk = g_malloc(sizeof(*chunk));
+	if (ref) {
+		chunk->buf = sr_buffer_ref(ref);
+		chunk->data = buf;
+	} else {
+		/* Data the caller keeps no reference to must be copied. */
+		copy = g_malloc(len);
+		memcpy(copy, buf, len);
+		chunk->buf = sr_buffer_new(copy, len, copy_free, NULL);
+		chunk->data = copy;
+	}
+	chunk->len = len;
+	g_queue_push_tail(stl->retained, chunk);
+	stl->retained_len += len;
+
+	/* Drop the oldest buffers, but keep at least the pre-trigger size. */
+	chunk = g_queue_peek_head(stl->retained);
+	while (stl->retained_len - chunk->len >= stl->pre_trigger_size) {
+		g_queue_pop_head(stl->retained);
+		stl->retained_len -= chunk->len;
+		chunk_free(chunk);
+		chunk = g_queue_peek_head(stl->retained);
+	}
+}
+
+static void pre_trigger_send_retained(struct soft_trigger_logic *stl,
+		int *pre_trigger_samples)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct pre_trigger_chunk *chunk;
+	int skip;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = stl->unitsize;
+
+	if (pre_trigger_samples)
+		*pre_trigger_samples = 0;
+
+	/* Only the oldest buffer may hold more than is needed. */
+	skip = MAX(0, stl->retained_len - stl->pre_trigger_size);
+	while ((chunk = g_queue_pop_head(stl->retained))) {
+		logic.length = chunk->len - skip;
+		logic.data = (uint8_t *)chunk->data + skip;
+		sr_session_send_buffer(stl->sdi, &packet, chunk->buf);
+		if (pre_trigger_samples)
+			*pre_trigger_samples += logic.length / stl->unitsize;
+		chunk_free(chunk);
+		skip = 0;
+	}
+	stl->retained_len = 0;
+}
+
+/* Keeps data that may be needed as pre-trigger data. */
+static void pre_trigger_add(struct soft_trigger_logic *stl,
+		uint8_t *buf, int len, struct sr_buffer *ref)
+{
+	if (!stl->pre_trigger_size)
+		return;
+
+	if (ref && !stl->retained) {
+		/* Switch to keeping buffers, with what was copied so far. */
+		stl->retained = g_queue_new();
+		if (stl->pre_trigger_fill == stl->pre_trigger_size)
+			pre_trigger_retain(stl, stl->pre_trigger_head,
+				stl->pre_trigger_buffer + stl->pre_trigger_size
+				- stl->pre_trigger_head, NULL);
+		if (stl->pre_trigger_fill > 0)
+			pre_trigger_retain(stl, stl->pre_trigger_buffer,
+				stl->pre_trigger_fill == stl->pre_trigger_size ?
+				stl->pre_trigger_head - stl->pre_trigger_buffer :
+				stl->pre_trigger_fill, NULL);
+		g_free(stl->pre_trigger_buffer);
+		stl->pre_trigger_buffer = NULL;
+		stl->pre_trigger_head = NULL;
+		stl->pre_trigger_fill = 0;
+		sr_mem_release(stl->mem_ctx, stl->mem_reserved);
+		stl->mem_reserved = 0;
+	}
+
+	if (stl->retained)
+		pre_trigger_retain(stl, buf, len, ref);
+	else
+		pre_trigger_append(stl, buf, len);
+}
+
+static void pre_trigger_flush(struct soft_trigger_logic *stl,
+		int *pre_trigger_samples)
+{
+	if (stl->retained)
+		pre_trigger_send_retained(stl, pre_trigger_samples);
+	else
+		pre_trigger_send(stl, pre_trigger_samples);
+}
+
+/* Get the (w)th 64 bit word of a sample, unitsize is the whole sample. */
+static inline uint64_t sample_word(const uint8_t *sample, int unitsize, int w)
+{
+	uint64_t v;
+	int i;
+
+	switch (unitsize) {
+	case 1:
+		return R8(sample);
+	case 2:
+		return RL16(sample);
+	case 4:
+		return RL32(sample);
+	case 8:
+		return RL64(sample);
+	}
+
+	sample += 8 * w;
+	v = 0;
+	for (i = MIN(unitsize - 8 * w, 8) - 1; i >= 0; i--)
+		v = (v << 8) | sample[i];
+
+	return v;
+}
+
+static inline gboolean word_match(const struct soft_trigger_stage *stage,
+		int w, uint64_t cur, uint64_t prev)
+{
+	return (cur & stage->level_mask[w]) == stage->level_value[w] &&
+		(~prev & cur & stage->rising[w]) == stage->rising[w] &&
+		(prev & ~cur & stage->falling[w]) == stage->falling[w] &&
+		((prev ^ cur) & stage->edge[w]) == stage->edge[w];
+}
+
+/* The previous sample is NULL for the very first sample. */
+static gboolean stage_match(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *stage,
+		const uint8_t *sample, const uint8_t *prev)
+{
+	int w;
+
+	if (stage->impossible)
+		return FALSE;
+	if (!prev && stage->edges)
+		/* First sample, don't have enough for an edge match yet. */
+		return FALSE;
+
+	for (w = 0; w < stl->nwords; w++) {
+		if (!word_match(stage, w, sample_word(sample, stl->unitsize, w),
+				prev ? sample_word(prev, stl->unitsize, w) : 0))
 			return FALSE;
-		prev_bit = *(stl->prev_sample + match->channel->index / 8)
-				& (1 << (match->channel->index % 8));
-		if (match->match == SR_TRIGGER_RISING)
-			result = prev_bit == 0 && bit != 0;
-		else if (match->match == SR_TRIGGER_FALLING)
-			result = prev_bit != 0 && bit == 0;
-		else if (match->match == SR_TRIGGER_EDGE)
-			result = prev_bit != bit;
 	}
 
-	return result;
+	return TRUE;
+}
+
+/*
+ * Skip blocks of samples in which none of the masked channels changed,
+ * comparing them against the same data shifted by one sample. These
+ * return the start of the first block that changed, or of the tail too
+ * short for a block. The mask repeats every 8 bytes, which is a whole
+ * number of samples.
+ */
+static const uint8_t *skip_swar(const uint8_t *p, const uint8_t *end,
+		int unitsize, uint64_t change_mask)
+{
+	uint64_t cur, prev, diff;
+	int k;
+
+	while (end - p >= 32) {
+		diff = 0;
+		for (k = 0; k < 32; k += 8) {
+			memcpy(&cur, p + k, sizeof(cur));
+			memcpy(&prev, p + k - unitsize, sizeof(prev));
+			diff |= cur ^ prev;
+		}
+		if (diff & change_mask)
+			break;
+		p += 32;
+	}
+
+	return p;
+}
+
+#ifdef SOFT_TRIGGER_X86
+
+TARGET_SSE2
+static const uint8_t *skip_sse2(const uint8_t *p, const uint8_t *end,
+		int unitsize, uint64_t change_mask)
+{
+	__m128i mask, a, b;
+
+	mask = _mm_set1_epi64x(change_mask);
+	while (end - p >= 32) {
+		a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p),
+			_mm_loadu_si128((const __m128i *)(p - unitsize)));
+		b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + 16)),
+			_mm_loadu_si128((const __m128i *)(p + 16 - unitsize)));
+		a = _mm_and_si128(_mm_or_si128(a, b), mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a,
+				_mm_setzero_si128())) != 0xffff)
+			break;
+		p += 32;
+	}
+
+	return p;
+}
+
+TARGET_AVX2
+static const uint8_t *skip_avx2(const uint8_t *p, const uint8_t *end,
+		int unitsize, uint64_t change_mask)
+{
+	__m256i mask, a, b;
+
+	mask = _mm256_set1_epi64x(change_mask);
+	while (end - p >= 64) {
+		a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)p),
+			_mm256_loadu_si256((const __m256i *)(p - unitsize)));
+		b = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + 32)),
+			_mm256_loadu_si256((const __m256i *)(p + 32 - unitsize)));
+		if (!_mm256_testz_si256(_mm256_or_si256(a, b), mask))
+			break;
+		p += 64;
+	}
+
+	return skip_sse2(p, end, unitsize, change_mask);
+}
+
+#endif
+
+#ifdef SOFT_TRIGGER_NEON
+
+static const uint8_t *skip_neon(const uint8_t *p, const uint8_t *end,
+		int unitsize, uint64_t change_mask)
+{
+	uint8x16_t mask, a, b;
+
+	mask = vreinterpretq_u8_u64(vdupq_n_u64(change_mask));
+	while (end - p >= 32) {
+		a = veorq_u8(vld1q_u8(p), vld1q_u8(p - unitsize));
+		b = veorq_u8(vld1q_u8(p + 16), vld1q_u8(p + 16 - unitsize));
+		if (vmaxvq_u8(vandq_u8(vorrq_u8(a, b), mask)))
+			break;
+		p += 32;
+	}
+
+	return p;
+}
+
+#endif
+
+/* Pick the widest skip the running CPU supports. */
+static soft_trigger_skip_func skip_func_get(void)
+{
+#ifdef SOFT_TRIGGER_X86
+	if (sr_cpu_has(SR_CPU_AVX2))
+		return skip_avx2;
+	if (sr_cpu_has(SR_CPU_SSE2))
+		return skip_sse2;
+#endif
+#ifdef SOFT_TRIGGER_NEON
+	if (sr_cpu_has(SR_CPU_NEON))
+		return skip_neon;
+#endif
+	return skip_swar;
+}
+
+/*
+ * Skip to the first sample from index i on in which any of the masked
+ * channels changed, as all in between can't match an edge. Blocks go
+ * through the picked skip, the rest 8 bytes at a time. Sample i - 1
+ * must be in the buffer. Returns a sample index at most 8 bytes before
+ * the change.
+ */
+static inline int skip_unchanged(soft_trigger_skip_func skip,
+		const uint8_t *buf, int unitsize, uint64_t change_mask,
+		int i, int num)
+{
+	const uint8_t *p, *end;
+	uint64_t cur, prev;
+
+	end = buf + num * unitsize;
+	p = skip(buf + i * unitsize, end, unitsize, change_mask);
+	while (end - p >= 8) {
+		memcpy(&cur, p, sizeof(cur));
+		memcpy(&prev, p - unitsize, sizeof(prev));
+		if ((cur ^ prev) & change_mask)
+			break;
+		p += 8;
+	}
+
+	return (p - buf) / unitsize;
+}
+
+/*
+ * Find the first sample from index i on that matches a stage, for
+ * samples of a single word. Sample i - 1 must be in the buffer. The
+ * unit size is constant in each caller, so that the loads get inlined.
+ */
+static inline int scan_words(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *stage,
+		const uint8_t *buf, int unitsize, int i, int num)
+{
+	uint64_t cur, prev;
+	uint64_t level_mask, level_value, rising, falling, edge;
+	int block_end;
+
+	level_mask = stage->level_mask[0];
+	level_value = stage->level_value[0];
+	rising = stage->rising[0];
+	falling = stage->falling[0];
+	edge = stage->edge[0];
+
+	while (i < num) {
+		/* Runs without any edge on the trigger channels go quickly. */
+		if (stage->change_mask)
+			i = skip_unchanged(stl->skip, buf, unitsize,
+				stage->change_mask, i, num);
+		block_end = stage->change_mask ? MIN(num, i + 8 / unitsize) : num;
+
+		prev = sample_word(buf + (i - 1) * unitsize, unitsize, 0);
+		for (; i < block_end; i++) {
+			cur = sample_word(buf + i * unitsize, unitsize, 0);
+			if ((cur & level_mask) == level_value &&
+					(~prev & cur & rising) == rising &&
+					(prev & ~cur & falling) == falling &&
+					((prev ^ cur) & edge) == edge)
+				return i;
+			prev = cur;
+		}
+	}
+
+	return num;
+}
+
+static int stage_scan(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *stage,
+		const uint8_t *buf, int i, int num)
+{
+	if (stage->impossible)
+		return num;
+
+	switch (stl->unitsize) {
+	case 1:
+		return scan_words(stl, stage, buf, 1, i, num);
+	case 2:
+		return scan_words(stl, stage, buf, 2, i, num);
+	case 4:
+		return scan_words(stl, stage, buf, 4, i, num);
+	case 8:
+		return scan_words(stl, stage, buf, 8, i, num);
+	default:
+		return scan_words(stl, stage, buf, stl->unitsize, i, num);
+	}
+}
+
+/* Start over at stage 0, after a later stage didn't match in time. */
+static int restart(struct soft_trigger_logic *stl, int i)
+{
+	stl->cur_stage = 0;
+	stl->wait = 0;
+	stl->run = 0;
+
+	/*
+	 * Stage 0 may match again from the sample after the one where its
+	 * run started. All but the last sample of that run are known to
+	 * match, so carry on right after it. This never goes back more
+	 * than the later stages took, nor past the start of this buffer.
+	 */
+	if (stl->stage0_end + 1 < 0)
+		return -1;
+	stl->run = stl->stages[0].repeat - 1;
+
+	return MIN(i, stl->stage0_end);
+}
+
+SR_PRIV void soft_trigger_logic_reset(struct soft_trigger_logic *stl)
+{
+	stl->cur_stage = 0;
+	stl->run = 0;
+	stl->wait = 0;
+}
+
+/*
+ * Returns the offset (in samples) within buf of where the trigger
+ * occurred, or -1 if not triggered.
+ *
+ * Each stage must match its repeat count of consecutive samples. The
+ * run of the first stage can start anywhere, the run of every later
+ * stage must start within its window after the previous stage's run,
+ * the earliest such run is taken.
+ *
+ * When buf is part of a reference counted buffer, ref is that buffer,
+ * else NULL. With a buffer, pre-trigger data is kept by holding a
+ * reference to it rather than copying the data, and the driver must
+ * not reuse the memory until the last reference is dropped.
+ */
+SR_PRIV int soft_trigger_logic_check_ref(struct soft_trigger_logic *stl,
+		uint8_t *buf, int len, struct sr_buffer *ref,
+		int *pre_trigger_samples)
+{
+	const struct soft_trigger_stage *stage;
+	const uint8_t *prev;
+	int unitsize, num, offset, last, limit, start;
+	int i;
+	gboolean matched;
+
+	unitsize = stl->unitsize;
+	num = len / unitsize;
+	offset = -1;
+	last = num - 1;
+	for (i = 0; i < num; i++) {
+		stage = &stl->stages[stl->cur_stage];
+		if (stage->empty)
+			/* No matches supplied, client error. */
+			return SR_ERR_ARG;
+
+		if (stl->run == 0 && i > 0 && stl->nwords == 1) {
+			/* Skip right to where the stage matches, or may no longer. */
+			limit = num;
+			if (stl->cur_stage > 0 && stage->window - stl->wait < (uint64_t)(num - i))
+				limit = i + (stage->window - stl->wait) + 1;
+			start = i;
+			i = stage_scan(stl, stage, buf, i, limit);
+			if (stl->cur_stage > 0)
+				stl->wait += i - start;
+			if (i == num)
+				break;
+			matched = i < limit;
+			if (!matched) {
+				/* Out of the window. */
+				i = restart(stl, i);
+				continue;
+			}
+		} else {
+			if (i > 0)
+				prev = buf + (i - 1) * unitsize;
+			else
+				prev = stl->have_prev ? stl->prev_sample : NULL;
+			matched = stage_match(stl, stage, buf + i * unitsize, prev);
+		}
+
+		if (!matched) {
+			if (stl->cur_stage == 0) {
+				stl->run = 0;
+				continue;
+			}
+			/* A broken run counts as waiting, the next may still do. */
+			stl->wait += stl->run + 1;
+			stl->run = 0;
+			if (stl->wait > stage->window)
+				i = restart(stl, i);
+			continue;
+		}
+
+		if (++stl->run < stage->repeat)
+			continue;
+
+		/* Matched on the current stage. */
+		if (stl->cur_stage + 1 < stl->num_stages) {
+			/* Advance to next stage. */
+			if (stl->cur_stage == 0)
+				stl->stage0_end = i;
+			stl->cur_stage++;
+			stl->run = 0;
+			stl->wait = 0;
+			continue;
+		}
+
+		/* Matched on last stage, send pre-trigger data. */
+		pre_trigger_add(stl, buf, i * unitsize, ref);
+		pre_trigger_flush(stl, pre_trigger_samples);
+
+		/* Fire trigger. */
+		offset = i;
+		last = i;
+		soft_trigger_logic_reset(stl);
+
+		SR_TRACE2(soft_trigger_fire, stl->sdi, offset);
+		std_session_send_df_trigger(stl->sdi);
+		break;
+	}
+
+	/* Edges across buffers need the last sample that was looked at. */
+	if (last >= 0) {
+		memcpy(stl->prev_sample, buf + last * unitsize, unitsize);
+		stl->have_prev = TRUE;
+	}
+	/* Positions are relative to the next buffer from here on. */
+	stl->stage0_end -= num;
+
+	if (offset == -1)
+		pre_trigger_add(stl, buf, len, ref);
+
+	return offset;
 }
 
 /* Returns the offset (in samples) within buf of where the trigger
@@ -175,69 +827,887 @@ static gboolean logic_check_match(struct soft_trigger_logic *stl,
 SR_PRIV int soft_trigger_logic_check(struct soft_trigger_logic *stl,
 		uint8_t *buf, int len, int *pre_trigger_samples)
 {
-	struct sr_trigger_stage *stage;
-	struct sr_trigger_match *match;
-	GSList *l, *l_stage;
+	return soft_trigger_logic_check_ref(stl, buf, len, NULL,
+		pre_trigger_samples);
+}
+
+/*
+ * Like soft_trigger_logic_check(), for packed samples of a trigger on
+ * one byte samples. They are checked a slice at a time, the pre-trigger
+ * samples go out dense. Returns the offset in samples within the packet
+ * of where the trigger occurred, the caller sends the samples from there
+ * on, or -1 if not triggered.
+ */
+SR_PRIV int soft_trigger_logic_check_packed(struct soft_trigger_logic *stl,
+		const struct sr_datafeed_logic_packed *packed,
+		int *pre_trigger_samples)
+{
+	uint8_t samples[1024];
+	uint64_t pos, n;
 	int offset;
+
+	if (stl->unitsize != 1)
+		return SR_ERR_ARG;
+
+	for (pos = 0; pos < packed->num_samples; pos += n) {
+		n = MIN(sizeof(samples), packed->num_samples - pos);
+		if (sr_logic_packed_to_dense(packed, pos, n, samples) != SR_OK)
+			return SR_ERR_ARG;
+		offset = soft_trigger_logic_check(stl, samples, n,
+			pre_trigger_samples);
+		if (offset != -1)
+			return offset < 0 ? offset : (int)(pos + offset);
+	}
+
+	return -1;
+}
+
+/*
+ * Compile a trigger for searching data of the given unit size, without
+ * a device and pre-trigger data. It's only read while searching, so one
+ * can be shared by several threads.
+ */
+SR_PRIV struct soft_trigger_logic *soft_trigger_logic_search_new(
+		const struct sr_trigger *trigger, int unitsize)
+{
+	struct soft_trigger_logic *stl;
 	int i;
-	gboolean match_found;
 
-	offset = -1;
-	for (i = 0; i < len; i += stl->unitsize) {
-		l_stage = g_slist_nth(stl->trigger->stages, stl->cur_stage);
-		stage = l_stage->data;
-		if (!stage->matches)
+	if (!trigger->stages || unitsize <= 0)
+		return NULL;
+
+	stl = stl_compile(trigger, unitsize);
+	for (i = 0; i < stl->num_stages; i++) {
+		if (stl->stages[i].empty) {
 			/* No matches supplied, client error. */
-			return SR_ERR_ARG;
+			soft_trigger_logic_free(stl);
+			return NULL;
+		}
+	}
 
-		match_found = TRUE;
-		for (l = stage->matches; l; l = l->next) {
-			match = l->data;
-			if (!match->channel->enabled)
-				/* Ignore disabled channels with a trigger. */
-				continue;
-			if (!logic_check_match(stl, buf + i, match)) {
-				match_found = FALSE;
-				break;
+	return stl;
+}
+
+/*
+ * The most samples an occurrence of the trigger can end after where it
+ * starts, saturated.
+ */
+SR_PRIV uint64_t soft_trigger_logic_span(const struct soft_trigger_logic *stl)
+{
+	const struct soft_trigger_stage *stage;
+	uint64_t span, add;
+	int i;
+
+	span = 0;
+	for (i = 0; i < stl->num_stages; i++) {
+		stage = &stl->stages[i];
+		add = stage->repeat - (i == 0 ? 1 : 0);
+		if (i > 0)
+			add = stage->window > UINT64_MAX - add ?
+				UINT64_MAX : add + stage->window;
+		span = add > UINT64_MAX - span ? UINT64_MAX : span + add;
+	}
+
+	return span;
+}
+
+/*
+ * Find the earliest run of a stage that starts from index i up to limit,
+ * and ends before num. Returns its start, or -1.
+ */
+static int stage_run_find(const struct soft_trigger_logic *stl,
+		const struct soft_trigger_stage *stage, const uint8_t *buf,
+		int i, int limit, int num)
+{
+	uint64_t run;
+	int end;
+	gboolean matched;
+
+	end = MIN(num, limit + 1);
+	run = 0;
+	for (; i < num; i++) {
+		if (run == 0) {
+			if (i >= end)
+				return -1;
+			if (i > 0 && stl->nwords == 1) {
+				i = stage_scan(stl, stage, buf, i, end);
+				if (i == end)
+					return -1;
+				matched = TRUE;
+			} else {
+				matched = stage_match(stl, stage,
+					buf + i * stl->unitsize,
+					i > 0 ? buf + (i - 1) * stl->unitsize : NULL);
 			}
+		} else {
+			matched = stage_match(stl, stage, buf + i * stl->unitsize,
+				buf + (i - 1) * stl->unitsize);
 		}
-		memcpy(stl->prev_sample, buf + i, stl->unitsize);
-		if (match_found) {
-			/* Matched on the current stage. */
-			if (l_stage->next) {
-				/* Advance to next stage. */
-				stl->cur_stage++;
-			} else {
-				/* Matched on last stage, send pre-trigger data. */
-				pre_trigger_append(stl, buf, i);
-				pre_trigger_send(stl, pre_trigger_samples);
 
-				/* Fire trigger. */
-				offset = i / stl->unitsize;
+		if (!matched) {
+			run = 0;
+			continue;
+		}
+		if (++run == stage->repeat)
+			return i - (int)(run - 1);
+	}
+
+	return -1;
+}
+
+/*
+ * Find all occurrences of the trigger that start at an index from from
+ * up to to, in a buffer of num samples. The first sample has no previous
+ * one for edges. The sample where each occurrence completes, plus base,
+ * is appended to offsets, once only when several complete on the same
+ * one.
+ *
+ * Every sample where the first stage's run can start is an occurrence's
+ * start, the later stages take the earliest run within their window,
+ * as with soft_trigger_logic_check(). Occurrences may overlap, but
+ * complete in the order of their starts. All data an occurrence looks
+ * at is within soft_trigger_logic_span() samples after its start.
+ */
+SR_PRIV void soft_trigger_logic_find_all(const struct soft_trigger_logic *stl,
+		const uint8_t *buf, int num, int from, int to, uint64_t base,
+		GArray *offsets)
+{
+	const struct soft_trigger_stage *stage, *later;
+	uint64_t run, offset;
+	int unitsize, i, k, end, last, start, limit;
+	gboolean matched;
 
-				std_session_send_df_trigger(stl->sdi);
+	unitsize = stl->unitsize;
+	stage = &stl->stages[0];
+	/* Runs that start before to may end until here. */
+	end = to + (int)MIN((uint64_t)(num - to), stage->repeat - 1);
+	run = 0;
+	for (i = from; i < end; i++) {
+		if (run == 0) {
+			/* A new run must start before to. */
+			if (i >= to)
 				break;
+			if (i > 0 && stl->nwords == 1) {
+				i = stage_scan(stl, stage, buf, i, to);
+				if (i == to)
+					break;
+				matched = TRUE;
+			} else {
+				matched = stage_match(stl, stage, buf + i * unitsize,
+					i > 0 ? buf + (i - 1) * unitsize : NULL);
 			}
-		} else if (stl->cur_stage > 0) {
-			/*
-			 * We had a match at an earlier stage, but failed on the
-			 * current stage. However, we may have a match on this
-			 * stage in the next bit -- trigger on 0001 will fail on
-			 * seeing 00001, so we need to go back to stage 0 -- but
-			 * at the next sample from the one that matched originally,
-			 * which the counter increment at the end of the loop
-			 * takes care of.
-			 */
-			i -= stl->cur_stage * stl->unitsize;
-			if (i < -1)
-				i = -1; /* Oops, went back past this buffer. */
-			/* Reset trigger stage. */
-			stl->cur_stage = 0;
+		} else {
+			matched = stage_match(stl, stage, buf + i * unitsize,
+				buf + (i - 1) * unitsize);
 		}
+
+		if (!matched) {
+			run = 0;
+			continue;
+		}
+		if (++run < stage->repeat)
+			continue;
+		/* Further matching samples each complete another run. */
+		run = stage->repeat - 1;
+
+		/* Take the earliest run of each later stage. */
+		last = i;
+		for (k = 1; k < stl->num_stages && last >= 0; k++) {
+			later = &stl->stages[k];
+			limit = later->window >= (uint64_t)(num - last) ?
+				num : last + 1 + (int)later->window;
+			start = stage_run_find(stl, later, buf, last + 1, limit, num);
+			last = start < 0 ? -1 : start + (int)(later->repeat - 1);
+		}
+		if (last < 0)
+			continue;
+
+		offset = base + last;
+		if (!offsets->len ||
+				g_array_index(offsets, uint64_t, offsets->len - 1) != offset)
+			g_array_append_val(offsets, offset);
 	}
+}
 
-	if (offset == -1)
-		pre_trigger_append(stl, buf, len);
+/*
+ * Analog soft trigger.
+ *
+ * The matches are compared against the raw sample values, with the
+ * thresholds converted to the packet's encoding once, rather than every
+ * sample converted to float. Samples are classified a block at a time,
+ * one bit per comparison, in a loop without branches.
+ */
+
+#define ANALOG_BLOCK	256
+
+/* The comparisons, and their bit in the per-sample flags. */
+enum {
+	ANALOG_OVER,
+	ANALOG_UNDER,
+	ANALOG_RISE,
+	ANALOG_RISE_ARM,
+	ANALOG_FALL,
+	ANALOG_FALL_ARM,
+	ANALOG_NUM_CMP,
+};
+
+enum {
+	CMP_GT,
+	CMP_LT,
+	CMP_GE,
+	CMP_LE,
+};
+
+/* How each comparison compares a sample against its threshold. */
+static const int analog_cmp_kind[ANALOG_NUM_CMP] = {
+	[ANALOG_OVER] = CMP_GT,
+	[ANALOG_UNDER] = CMP_LT,
+	[ANALOG_RISE] = CMP_GE,
+	[ANALOG_RISE_ARM] = CMP_LT,
+	[ANALOG_FALL] = CMP_LE,
+	[ANALOG_FALL_ARM] = CMP_GT,
+};
+
+struct soft_trigger_analog_stage;
+
+typedef void (*analog_classify_func)(const struct soft_trigger_analog_stage *st,
+		const uint8_t *data, int stride, int num, uint8_t *flags);
+
+struct soft_trigger_analog_stage {
+	const struct sr_channel *channel;
+	/* The matches, in the channel's units. */
+	gboolean has_over;
+	gboolean has_under;
+	float over;
+	float under;
+	gboolean rising;
+	gboolean falling;
+	float level;
+	/* Over a higher level than to be under: outside of a window. */
+	gboolean outside;
+
+	/* For the current encoding, in raw sample units. */
+	gboolean impossible;
+	analog_classify_func classify;
+	uint8_t level_need;
+	gboolean raw_rising;
+	gboolean raw_falling;
+	/*
+	 * All but ANALOG_OVER, ANALOG_RISE and ANALOG_FALL_ARM are less
+	 * than comparisons, the thresholds are adjusted to the type.
+	 */
+	int64_t ithr[ANALOG_NUM_CMP];
+	int32_t ithr32[ANALOG_NUM_CMP];
+	float fthr[ANALOG_NUM_CMP];
+	double dthr[ANALOG_NUM_CMP];
+};
+
+#define ANALOG_CLASSIFY_LOOP(type, ttype, load, step) \
+	for (i = 0; i < num; i++) { \
+		v = load(data + i * (step)); \
+		flags[i] = (v > t0) << ANALOG_OVER | \
+			(v < t1) << ANALOG_UNDER | \
+			(v > t2) << ANALOG_RISE | \
+			(v < t3) << ANALOG_RISE_ARM | \
+			(v < t4) << ANALOG_FALL | \
+			(v > t5) << ANALOG_FALL_ARM; \
+	}
+
+/*
+ * Single channel data has a constant stride, which vectorizes better.
+ * Thresholds are of the narrowest type that holds all the type's values
+ * and one more on either side.
+ */
+#define ANALOG_CLASSIFY(name, type, ttype, thr, load) \
+static void name(const struct soft_trigger_analog_stage *st, \
+		const uint8_t *data, int stride, int num, uint8_t *flags) \
+{ \
+	ttype t0, t1, t2, t3, t4, t5; \
+	type v; \
+	int i; \
+\
+	t0 = st->thr[ANALOG_OVER]; \
+	t1 = st->thr[ANALOG_UNDER]; \
+	t2 = st->thr[ANALOG_RISE]; \
+	t3 = st->thr[ANALOG_RISE_ARM]; \
+	t4 = st->thr[ANALOG_FALL]; \
+	t5 = st->thr[ANALOG_FALL_ARM]; \
+	if (stride == sizeof(type)) { \
+		ANALOG_CLASSIFY_LOOP(type, ttype, load, sizeof(type)) \
+	} else { \
+		ANALOG_CLASSIFY_LOOP(type, ttype, load, stride) \
+	} \
+}
+
+ANALOG_CLASSIFY(classify_u8, uint8_t, int32_t, ithr32, read_u8)
+ANALOG_CLASSIFY(classify_i8, int8_t, int32_t, ithr32, read_i8)
+ANALOG_CLASSIFY(classify_u16le, uint16_t, int32_t, ithr32, read_u16le)
+ANALOG_CLASSIFY(classify_u16be, uint16_t, int32_t, ithr32, read_u16be)
+ANALOG_CLASSIFY(classify_i16le, int16_t, int32_t, ithr32, read_i16le)
+ANALOG_CLASSIFY(classify_i16be, int16_t, int32_t, ithr32, read_i16be)
+ANALOG_CLASSIFY(classify_u32le, uint32_t, int64_t, ithr, read_u32le)
+ANALOG_CLASSIFY(classify_u32be, uint32_t, int64_t, ithr, read_u32be)
+ANALOG_CLASSIFY(classify_i32le, int32_t, int64_t, ithr, read_i32le)
+ANALOG_CLASSIFY(classify_i32be, int32_t, int64_t, ithr, read_i32be)
+ANALOG_CLASSIFY(classify_i64le, int64_t, int64_t, ithr, read_i64le)
+ANALOG_CLASSIFY(classify_i64be, int64_t, int64_t, ithr, read_i64be)
+ANALOG_CLASSIFY(classify_fltle, float, float, fthr, read_fltle)
+ANALOG_CLASSIFY(classify_fltbe, float, float, fthr, read_fltbe)
+ANALOG_CLASSIFY(classify_dblle, double, double, dthr, read_dblle)
+ANALOG_CLASSIFY(classify_dblbe, double, double, dthr, read_dblbe)
+
+static analog_classify_func classify_func(const struct sr_analog_encoding *e)
+{
+	gboolean be;
+
+	be = e->is_bigendian;
+	if (e->is_float) {
+		switch (e->unitsize) {
+		case 4:
+			return be ? classify_fltbe : classify_fltle;
+		case 8:
+			return be ? classify_dblbe : classify_dblle;
+		}
+		return NULL;
+	}
+
+	switch (e->unitsize) {
+	case 1:
+		return e->is_signed ? classify_i8 : classify_u8;
+	case 2:
+		if (e->is_signed)
+			return be ? classify_i16be : classify_i16le;
+		return be ? classify_u16be : classify_u16le;
+	case 4:
+		if (e->is_signed)
+			return be ? classify_i32be : classify_i32le;
+		return be ? classify_u32be : classify_u32le;
+	case 8:
+		if (e->is_signed)
+			return be ? classify_i64be : classify_i64le;
+		break;
+	}
+
+	return NULL;
+}
+
+/* Integer threshold that compares the same as t, using > or <. */
+static int64_t int_threshold(double t, int kind)
+{
+	switch (kind) {
+	case CMP_GT:
+		t = floor(t);
+		break;
+	case CMP_LT:
+		t = ceil(t);
+		break;
+	case CMP_GE:
+		t = ceil(t) - 1;
+		break;
+	case CMP_LE:
+		t = floor(t) + 1;
+		break;
+	}
+
+	if (isnan(t))
+		return 0;
+	if (t >= 9223372036854775808.0)
+		return INT64_MAX;
+	if (t <= -9223372036854775808.0)
+		return INT64_MIN;
+
+	return t;
+}
+
+/* Single precision threshold that compares the same as t, using > or <. */
+static float float_threshold(double t, int kind)
+{
+	float f;
+
+	if (t > FLT_MAX)
+		f = INFINITY;
+	else if (t < -FLT_MAX)
+		f = -INFINITY;
+	else
+		f = t;
+
+	switch (kind) {
+	case CMP_GT:
+		if (f > t)
+			f = nextafterf(f, -INFINITY);
+		break;
+	case CMP_LT:
+		if (f < t)
+			f = nextafterf(f, INFINITY);
+		break;
+	case CMP_GE:
+		if (f < t)
+			f = nextafterf(f, INFINITY);
+		f = nextafterf(f, -INFINITY);
+		break;
+	case CMP_LE:
+		if (f > t)
+			f = nextafterf(f, -INFINITY);
+		f = nextafterf(f, INFINITY);
+		break;
+	}
+
+	return f;
+}
+
+static double double_threshold(double t, int kind)
+{
+	switch (kind) {
+	case CMP_GE:
+		return nextafter(t, -INFINITY);
+	case CMP_LE:
+		return nextafter(t, INFINITY);
+	}
+
+	return t;
+}
+
+static struct soft_trigger_analog_stage *analog_stage_new(
+		const struct sr_trigger *trigger)
+{
+	const struct sr_trigger_stage *ts;
+	const struct sr_trigger_match *match;
+	struct soft_trigger_analog_stage *stage;
+	GSList *l;
+
+	if (g_slist_length(trigger->stages) != 1) {
+		sr_err("Analog soft triggers support a single stage only.");
+		return NULL;
+	}
+	ts = trigger->stages->data;
+	if (ts->repeat > 1) {
+		sr_err("Analog soft triggers don't support repeat counts.");
+		return NULL;
+	}
+
+	stage = g_malloc0(sizeof(*stage));
+	for (l = ts->matches; l; l = l->next) {
+		match = l->data;
+		if (!match->channel->enabled)
+			/* Ignore disabled channels with a trigger. */
+			continue;
+		if (match->channel->type != SR_CHANNEL_ANALOG ||
+				(stage->channel && match->channel != stage->channel)) {
+			sr_err("Analog soft triggers must be on one analog channel.");
+			goto err;
+		}
+		stage->channel = match->channel;
+
+		switch (match->match) {
+		case SR_TRIGGER_OVER:
+			if (stage->has_over)
+				goto duplicate;
+			stage->has_over = TRUE;
+			stage->over = match->value;
+			break;
+		case SR_TRIGGER_UNDER:
+			if (stage->has_under)
+				goto duplicate;
+			stage->has_under = TRUE;
+			stage->under = match->value;
+			break;
+		case SR_TRIGGER_RISING:
+		case SR_TRIGGER_FALLING:
+		case SR_TRIGGER_EDGE:
+			if (stage->rising || stage->falling)
+				goto duplicate;
+			stage->rising = match->match != SR_TRIGGER_FALLING;
+			stage->falling = match->match != SR_TRIGGER_RISING;
+			stage->level = match->value;
+			break;
+		default:
+			sr_err("Invalid trigger match for an analog channel.");
+			goto err;
+		}
+	}
+	if (!stage->channel) {
+		sr_err("No analog trigger matches.");
+		goto err;
+	}
+
+	stage->outside = stage->has_over && stage->has_under &&
+		stage->over >= stage->under;
+
+	return stage;
+
+duplicate:
+	sr_err("Only one level and one slope match per analog trigger.");
+err:
+	g_free(stage);
+	return NULL;
+}
+
+/* Convert the thresholds to the raw values of an encoding. */
+static void analog_stage_compile(struct soft_trigger_analog_stage *stage,
+		const struct sr_analog_encoding *encoding, float hysteresis)
+{
+	double scale, offset, over, under, level, hyst;
+	double t[ANALOG_NUM_CMP];
+	gboolean flip, has_over, has_under;
+	int i;
+
+	stage->classify = classify_func(encoding);
+	stage->impossible = TRUE;
+	if (!stage->classify) {
+		sr_err("Unsupported analog encoding for a soft trigger.");
+		return;
+	}
+	if (!encoding->scale.p || !encoding->scale.q || !encoding->offset.q) {
+		sr_err("Invalid analog encoding for a soft trigger.");
+		return;
+	}
+	stage->impossible = FALSE;
+
+	scale = (double)encoding->scale.p / encoding->scale.q;
+	offset = (double)encoding->offset.p / encoding->offset.q;
+
+	/* A negative scale has raw values compare the other way round. */
+	flip = scale < 0;
+	over = ((flip ? stage->under : stage->over) - offset) / scale;
+	under = ((flip ? stage->over : stage->under) - offset) / scale;
+	has_over = flip ? stage->has_under : stage->has_over;
+	has_under = flip ? stage->has_over : stage->has_under;
+	stage->raw_rising = flip ? stage->falling : stage->rising;
+	stage->raw_falling = flip ? stage->rising : stage->falling;
+	level = (stage->level - offset) / scale;
+	hyst = hysteresis / fabs(scale);
+
+	stage->level_need = (has_over ? 1 << ANALOG_OVER : 0) |
+		(has_under ? 1 << ANALOG_UNDER : 0);
+
+	t[ANALOG_OVER] = has_over ? over : -INFINITY;
+	t[ANALOG_UNDER] = has_under ? under : INFINITY;
+	t[ANALOG_RISE] = level;
+	t[ANALOG_RISE_ARM] = level - hyst;
+	t[ANALOG_FALL] = level;
+	t[ANALOG_FALL_ARM] = level + hyst;
+
+	for (i = 0; i < ANALOG_NUM_CMP; i++) {
+		stage->ithr[i] = int_threshold(t[i], analog_cmp_kind[i]);
+		stage->ithr32[i] = CLAMP(stage->ithr[i], INT32_MIN, INT32_MAX);
+		stage->fthr[i] = float_threshold(t[i], analog_cmp_kind[i]);
+		stage->dthr[i] = double_threshold(t[i], analog_cmp_kind[i]);
+	}
+}
+
+static gboolean encoding_equal(const struct sr_analog_encoding *a,
+		const struct sr_analog_encoding *b)
+{
+	return a->unitsize == b->unitsize &&
+		a->is_signed == b->is_signed &&
+		a->is_float == b->is_float &&
+		a->is_bigendian == b->is_bigendian &&
+		a->digits == b->digits &&
+		a->is_digits_decimal == b->is_digits_decimal &&
+		a->scale.p == b->scale.p && a->scale.q == b->scale.q &&
+		a->offset.p == b->offset.p && a->offset.q == b->offset.q;
+}
+
+/* Whether a packet's data can be kept with the pre-trigger data so far. */
+static gboolean analog_format_equal(const struct soft_trigger_analog *sta,
+		const struct sr_datafeed_analog *analog)
+{
+	const GSList *a, *b;
+
+	if (!sta->frame_size || !encoding_equal(&sta->encoding, analog->encoding))
+		return FALSE;
+	if (analog->meaning->mq != sta->meaning.mq ||
+			analog->meaning->unit != sta->meaning.unit ||
+			analog->meaning->mqflags != sta->meaning.mqflags ||
+			analog->spec->spec_digits != sta->spec.spec_digits)
+		return FALSE;
+
+	for (a = analog->meaning->channels, b = sta->meaning.channels;
+			a && b; a = a->next, b = b->next) {
+		if (a->data != b->data)
+			return FALSE;
+	}
+
+	return !a && !b;
+}
+
+static void analog_pre_trigger_setup(struct soft_trigger_analog *sta,
+		const struct sr_datafeed_analog *analog)
+{
+	if (sta->pre_trigger_fill)
+		sr_dbg("Analog format changed, dropping pre-trigger data.");
+
+	sta->encoding = *analog->encoding;
+	g_slist_free(sta->meaning.channels);
+	sta->meaning = *analog->meaning;
+	sta->meaning.channels = g_slist_copy(analog->meaning->channels);
+	sta->spec = *analog->spec;
+	sta->frame_size = analog->encoding->unitsize *
+		g_slist_length(analog->meaning->channels);
+
+	g_free(sta->pre_trigger_buffer);
+	sta->pre_trigger_buffer = NULL;
+	sta->pre_trigger_head = 0;
+	sta->pre_trigger_fill = 0;
+	if (sta->pre_trigger_samples > 0) {
+		sta->pre_trigger_buffer = g_try_malloc(
+			(size_t)sta->pre_trigger_samples * sta->frame_size);
+		if (!sta->pre_trigger_buffer)
+			sr_err("Cannot allocate analog pre-trigger buffer.");
+	}
+}
+
+/* Keep the last samples of all channels of the packet. */
+static void analog_pre_trigger_append(struct soft_trigger_analog *sta,
+		const uint8_t *data, int num)
+{
+	int size, n;
+
+	if (!sta->pre_trigger_buffer)
+		return;
+
+	size = sta->pre_trigger_samples;
+	if (num > size) {
+		data += (size_t)(num - size) * sta->frame_size;
+		num = size;
+	}
+	sta->pre_trigger_fill = MIN(sta->pre_trigger_fill + num, size);
+
+	while (num > 0) {
+		n = MIN(size - sta->pre_trigger_head, num);
+		memcpy(sta->pre_trigger_buffer +
+			(size_t)sta->pre_trigger_head * sta->frame_size,
+			data, (size_t)n * sta->frame_size);
+		sta->pre_trigger_head = (sta->pre_trigger_head + n) % size;
+		data += (size_t)n * sta->frame_size;
+		num -= n;
+	}
+}
+
+static void analog_pre_trigger_send(struct soft_trigger_analog *sta,
+		int *pre_trigger_samples)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	int start, n;
+
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	analog.encoding = &sta->encoding;
+	analog.meaning = &sta->meaning;
+	analog.spec = &sta->spec;
+
+	/* The oldest sample is at the head once the buffer filled up. */
+	start = sta->pre_trigger_fill < sta->pre_trigger_samples ?
+		0 : sta->pre_trigger_head;
+	while (sta->pre_trigger_fill > 0) {
+		n = MIN(sta->pre_trigger_samples - start, sta->pre_trigger_fill);
+		analog.data = sta->pre_trigger_buffer +
+			(size_t)start * sta->frame_size;
+		analog.num_samples = n;
+		sr_session_send(sta->sdi, &packet);
+		if (pre_trigger_samples)
+			*pre_trigger_samples += n;
+		sta->pre_trigger_fill -= n;
+		start = 0;
+	}
+	sta->pre_trigger_head = 0;
+}
+
+static inline gboolean analog_level_match(
+		const struct soft_trigger_analog_stage *stage, uint8_t f)
+{
+	if (stage->outside)
+		return (f & stage->level_need) != 0;
+
+	return (f & stage->level_need) == stage->level_need;
+}
+
+/* Find the first sample of a block that matches, updating the slopes. */
+static int analog_block_find(struct soft_trigger_analog *sta,
+		const uint8_t *flags, int num)
+{
+	const struct soft_trigger_analog_stage *stage;
+	uint8_t any, f;
+	gboolean fire;
+	int i;
+
+	stage = sta->stage;
+	any = 0;
+	for (i = 0; i < num; i++)
+		any |= flags[i];
+
+	if (!stage->raw_rising && !stage->raw_falling) {
+		if (!analog_level_match(stage, any))
+			return -1;
+		for (i = 0; i < num; i++) {
+			if (analog_level_match(stage, flags[i]))
+				return i;
+		}
+		return -1;
+	}
+
+	/*
+	 * Nothing changes in a block that has an armed slope never reach
+	 * the level, nor a disarmed one get past the hysteresis.
+	 */
+	if (!(stage->raw_rising && (any & (sta->rise_armed ?
+			1 << ANALOG_RISE : 1 << ANALOG_RISE_ARM))) &&
+			!(stage->raw_falling && (any & (sta->fall_armed ?
+			1 << ANALOG_FALL : 1 << ANALOG_FALL_ARM))))
+		return -1;
+
+	for (i = 0; i < num; i++) {
+		f = flags[i];
+		fire = (stage->raw_rising && sta->rise_armed &&
+				(f & 1 << ANALOG_RISE)) ||
+			(stage->raw_falling && sta->fall_armed &&
+				(f & 1 << ANALOG_FALL));
+		if (fire && analog_level_match(stage, f))
+			return i;
+
+		/* A crossing that didn't match has to be armed again. */
+		if (f & 1 << ANALOG_RISE_ARM)
+			sta->rise_armed = TRUE;
+		else if (f & 1 << ANALOG_RISE)
+			sta->rise_armed = FALSE;
+		if (f & 1 << ANALOG_FALL_ARM)
+			sta->fall_armed = TRUE;
+		else if (f & 1 << ANALOG_FALL)
+			sta->fall_armed = FALSE;
+	}
+
+	return -1;
+}
+
+/**
+ * Create an analog soft trigger.
+ *
+ * The trigger must have a single stage, with matches on one analog
+ * channel: SR_TRIGGER_OVER and SR_TRIGGER_UNDER compare against a level,
+ * both together check for the channel being within the window between
+ * them, or outside of it when the OVER level is the higher one.
+ * SR_TRIGGER_RISING, SR_TRIGGER_FALLING and SR_TRIGGER_EDGE match where
+ * the signal crosses their level, having been at least the hysteresis
+ * below (or above) it before. All matches must hold on the same sample.
+ *
+ * @param sdi The device.
+ * @param trigger The trigger.
+ * @param pre_trigger_samples Number of samples to keep before the trigger.
+ * @param hysteresis Distance from the level to arm slope matches, in the
+ *                   channel's units.
+ *
+ * @return The trigger, NULL if it can't be used on analog data.
+ *
+ * @private
+ */
+SR_PRIV struct soft_trigger_analog *soft_trigger_analog_new(
+		const struct sr_dev_inst *sdi, struct sr_trigger *trigger,
+		int pre_trigger_samples, float hysteresis)
+{
+	struct soft_trigger_analog *sta;
+	struct soft_trigger_analog_stage *stage;
+
+	if (!(stage = analog_stage_new(trigger)))
+		return NULL;
+
+	sta = g_malloc0(sizeof(struct soft_trigger_analog));
+	sta->sdi = sdi;
+	sta->trigger = trigger;
+	sta->channel = stage->channel;
+	sta->hysteresis = fabsf(hysteresis);
+	sta->stage = stage;
+	sta->pre_trigger_samples = MAX(0, pre_trigger_samples);
+
+	return sta;
+}
+
+/** @private */
+SR_PRIV void soft_trigger_analog_free(struct soft_trigger_analog *sta)
+{
+	g_slist_free(sta->meaning.channels);
+	g_free(sta->pre_trigger_buffer);
+	g_free(sta->stage);
+	g_free(sta);
+}
+
+/**
+ * Have slope matches wait for the hysteresis again.
+ *
+ * @private
+ */
+SR_PRIV void soft_trigger_analog_reset(struct soft_trigger_analog *sta)
+{
+	sta->rise_armed = FALSE;
+	sta->fall_armed = FALSE;
+}
+
+/**
+ * Check an analog packet for the trigger.
+ *
+ * Packets without the trigger channel are not looked at. Of those with
+ * it, the data of all channels is kept as pre-trigger data, and sent
+ * before the trigger fires. A change of format drops what was kept.
+ *
+ * @return The sample within the packet where the trigger occurred, -1
+ *         if not triggered.
+ *
+ * @private
+ */
+SR_PRIV int soft_trigger_analog_check(struct soft_trigger_analog *sta,
+		const struct sr_datafeed_analog *analog, int *pre_trigger_samples)
+{
+	struct soft_trigger_analog_stage *stage;
+	uint8_t flags[ANALOG_BLOCK];
+	const uint8_t *data;
+	int pos, num, i, n, offset;
+
+	stage = sta->stage;
+	if (pre_trigger_samples)
+		*pre_trigger_samples = 0;
+
+	if (!analog->data || !analog->encoding || !analog->meaning ||
+			!analog->spec || !analog->encoding->unitsize)
+		return SR_ERR_ARG;
+	pos = g_slist_index(analog->meaning->channels, sta->channel);
+	if (pos < 0)
+		return -1;
+
+	if (!analog_format_equal(sta, analog)) {
+		if (!sta->frame_size ||
+				!encoding_equal(&sta->encoding, analog->encoding)) {
+			analog_stage_compile(stage, analog->encoding,
+				sta->hysteresis);
+			soft_trigger_analog_reset(sta);
+		}
+		analog_pre_trigger_setup(sta, analog);
+	}
+
+	data = (const uint8_t *)analog->data + pos * analog->encoding->unitsize;
+	num = analog->num_samples;
+	offset = -1;
+	for (i = 0; i < num && !stage->impossible; i += n) {
+		n = MIN(num - i, ANALOG_BLOCK);
+		stage->classify(stage, data + (size_t)i * sta->frame_size,
+			sta->frame_size, n, flags);
+		offset = analog_block_find(sta, flags, n);
+		if (offset >= 0) {
+			offset += i;
+			break;
+		}
+	}
+
+	if (offset < 0) {
+		analog_pre_trigger_append(sta, analog->data, num);
+		return -1;
+	}
+
+	analog_pre_trigger_append(sta, analog->data, offset);
+	analog_pre_trigger_send(sta, pre_trigger_samples);
+	soft_trigger_analog_reset(sta);
+
+	SR_TRACE2(soft_trigger_fire, sta->sdi, offset);
+	std_session_send_df_trigger(sta->sdi);
 
 	return offset;
 }
@@ -0,0 +1,119 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_STREAM_H
+#define LIBSIGROK_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+
+/*
+ * Wire protocol between the streaming server (stream_server.c) and the
+ * sigrok-stream driver.
+ *
+ * Both sides send frames: a STREAM_FRAME_HEADER_SIZE header, then the
+ * payload. All integers are little endian.
+ *
+ *   u32 length		payload bytes on the wire
+ *   u8  type		STREAM_FRAME_*
+ *   u8  codec		STREAM_CODEC_* the payload is compressed with
+ *   u16 reserved
+ *   u32 raw_length	payload bytes after decompression
+ *   u32 arg		depends on the type, see below
+ *
+ * The client starts with HELLO: STREAM_MAGIC, u32 version, u32 mask of
+ * the codecs it takes, u32 credit. The server answers HELLO with the
+ * codec it chose in the mask, then DEVICE with a key file describing
+ * the device. If an acquisition runs, HEADER and the META frames seen
+ * since follow.
+ *
+ * The server only sends while the client has credit, counted in wire
+ * bytes of whole frames. The client grants more with CREDIT frames as
+ * it consumes what it got. Samples which don't fit the server's queue
+ * for a slow client are dropped, a DROPPED frame tells how many frames
+ * went. Other frames are never dropped.
+ */
+
+#define STREAM_MAGIC			"SRSTREAM"
+#define STREAM_VERSION			1
+#define STREAM_FRAME_HEADER_SIZE	16
+/* Larger frames are a protocol error. */
+#define STREAM_MAX_FRAME		(64 * 1024 * 1024)
+#define STREAM_DEFAULT_PORT		"5566"
+
+enum stream_frame_type {
+	STREAM_FRAME_HELLO = 1,
+	/* GKeyFile text, see stream_server.c. */
+	STREAM_FRAME_DEVICE,
+	STREAM_FRAME_HEADER,
+	STREAM_FRAME_END,
+	/* arg: config key. Payload: GVariant type string, NUL, data. */
+	STREAM_FRAME_META,
+	/* arg: unitsize. Payload: samples. */
+	STREAM_FRAME_LOGIC,
+	/* arg: channel index. Payload: struct stream_analog, floats. */
+	STREAM_FRAME_ANALOG,
+	STREAM_FRAME_TRIGGER,
+	STREAM_FRAME_FRAME_BEGIN,
+	STREAM_FRAME_FRAME_END,
+	/* arg: bytes granted, client to server. */
+	STREAM_FRAME_CREDIT,
+	/* arg: frames dropped since the last DROPPED. */
+	STREAM_FRAME_DROPPED,
+};
+
+enum stream_codec {
+	STREAM_CODEC_NONE,
+	STREAM_CODEC_DEFLATE,
+	STREAM_CODEC_ZSTD,
+	STREAM_NUM_CODECS,
+};
+
+/* Prefix of ANALOG payloads, the float samples follow. */
+#define STREAM_ANALOG_SIZE 20
+struct stream_analog {
+	uint32_t mq;
+	uint32_t unit;
+	uint64_t mqflags;
+	int32_t digits;
+};
+
+struct stream_frame_header {
+	uint32_t length;
+	uint8_t type;
+	uint8_t codec;
+	uint32_t raw_length;
+	uint32_t arg;
+};
+
+SR_PRIV uint32_t sr_stream_codecs(void);
+SR_PRIV const char *sr_stream_codec_name(int codec);
+SR_PRIV void sr_stream_header_write(uint8_t *buf,
+	const struct stream_frame_header *hdr);
+SR_PRIV int sr_stream_header_read(const uint8_t *buf,
+	struct stream_frame_header *hdr);
+SR_PRIV GBytes *sr_stream_compress(int codec, const void *data, size_t len);
+SR_PRIV int sr_stream_decompress(int codec, const void *src, size_t len,
+	void *dst, size_t raw_len);
+SR_PRIV void sr_stream_analog_write(uint8_t *buf,
+	const struct stream_analog *analog);
+SR_PRIV void sr_stream_analog_read(const uint8_t *buf,
+	struct stream_analog *analog);
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "stream.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "stream"
+/** @endcond */
+
+/*
+ * Frame and payload coding of the streaming protocol, shared by the
+ * server and the sigrok-stream driver. See stream.h.
+ */
+
+/* Fast settings, the point is to save bandwidth at streaming rates. */
+#define DEFLATE_LEVEL	1
+#define ZSTD_LEVEL	1
+
+/** Mask of the codecs this build has. @private */
+SR_PRIV uint32_t sr_stream_codecs(void)
+{
+	uint32_t codecs;
+
+	codecs = 1 << STREAM_CODEC_NONE;
+#ifdef HAVE_ZLIB
+	codecs |= 1 << STREAM_CODEC_DEFLATE;
+#endif
+#ifdef HAVE_LIBZSTD
+	codecs |= 1 << STREAM_CODEC_ZSTD;
+#endif
+
+	return codecs;
+}
+
+/** @private */
+SR_PRIV const char *sr_stream_codec_name(int codec)
+{
+	switch (codec) {
+	case STREAM_CODEC_NONE:
+		return "none";
+	case STREAM_CODEC_DEFLATE:
+		return "deflate";
+	case STREAM_CODEC_ZSTD:
+		return "zstd";
+	default:
+		return "unknown";
+	}
+}
+
+/** @private */
+SR_PRIV void sr_stream_header_write(uint8_t *buf,
+		const struct stream_frame_header *hdr)
+{
+	WL32(&buf[0], hdr->length);
+	buf[4] = hdr->type;
+	buf[5] = hdr->codec;
+	WL16(&buf[6], 0);
+	WL32(&buf[8], hdr->raw_length);
+	WL32(&buf[12], hdr->arg);
+}
+
+/**
+ * Parse a frame header.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_DATA The header is not valid.
+ *
+ * @private
+ */
+SR_PRIV int sr_stream_header_read(const uint8_t *buf,
+		struct stream_frame_header *hdr)
+{
+	hdr->length = RL32(&buf[0]);
+	hdr->type = buf[4];
+	hdr->codec = buf[5];
+	hdr->raw_length = RL32(&buf[8]);
+	hdr->arg = RL32(&buf[12]);
+
+	if (hdr->length > STREAM_MAX_FRAME ||
+			hdr->raw_length > STREAM_MAX_FRAME ||
+			hdr->codec >= STREAM_NUM_CODECS)
+		return SR_ERR_DATA;
+	if (hdr->codec == STREAM_CODEC_NONE &&
+			hdr->length != hdr->raw_length)
+		return SR_ERR_DATA;
+
+	return SR_OK;
+}
+
+/**
+ * Compress a payload.
+ *
+ * @return The compressed payload, or NULL if the codec is not available
+ *         or does not make it smaller. The payload goes as it is then.
+ *
+ * @private
+ */
+SR_PRIV GBytes *sr_stream_compress(int codec, const void *data, size_t len)
+{
+	uint8_t *buf;
+	size_t size;
+
+	(void)data;
+
+	if (!len)
+		return NULL;
+
+	buf = NULL;
+	size = 0;
+	switch (codec) {
+#ifdef HAVE_ZLIB
+	case STREAM_CODEC_DEFLATE: {
+		uLongf dlen;
+
+		dlen = compressBound(len);
+		buf = g_malloc(dlen);
+		if (compress2(buf, &dlen, data, len, DEFLATE_LEVEL) == Z_OK)
+			size = dlen;
+		break;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	case STREAM_CODEC_ZSTD: {
+		size_t ret;
+
+		buf = g_malloc(ZSTD_compressBound(len));
+		ret = ZSTD_compress(buf, ZSTD_compressBound(len), data, len,
+			ZSTD_LEVEL);
+		if (!ZSTD_isError(ret))
+			size = ret;
+		break;
+	}
+#endif
+	default:
+		return NULL;
+	}
+
+	if (!size || size >= len) {
+		g_free(buf);
+		return NULL;
+	}
+
+	return g_bytes_new_take(g_realloc(buf, size), size);
+}
+
+/**
+ * Decompress a payload into a buffer of its raw length.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_NA The codec is not available.
+ * @retval SR_ERR_DATA The payload is corrupt.
+ *
+ * @private
+ */
+SR_PRIV int sr_stream_decompress(int codec, const void *src, size_t len,
+		void *dst, size_t raw_len)
+{
+	switch (codec) {
+	case STREAM_CODEC_NONE:
+		if (len != raw_len)
+			return SR_ERR_DATA;
+		memcpy(dst, src, len);
+		return SR_OK;
+#ifdef HAVE_ZLIB
+	case STREAM_CODEC_DEFLATE: {
+		uLongf dlen;
+
+		dlen = raw_len;
+		if (uncompress(dst, &dlen, src, len) != Z_OK ||
+				dlen != raw_len)
+			return SR_ERR_DATA;
+		return SR_OK;
+	}
+#endif
+#ifdef HAVE_LIBZSTD
+	case STREAM_CODEC_ZSTD:
+		if (ZSTD_decompress(dst, raw_len, src, len) != raw_len)
+			return SR_ERR_DATA;
+		return SR_OK;
+#endif
+	default:
+		return SR_ERR_NA;
+	}
+}
+
+/** @private */
+SR_PRIV void sr_stream_analog_write(uint8_t *buf,
+		const struct stream_analog *analog)
+{
+	WL32(&buf[0], analog->mq);
+	WL32(&buf[4], analog->unit);
+	WL64(&buf[8], analog->mqflags);
+	WL32(&buf[16], analog->digits);
+}
+
+/** @private */
+SR_PRIV void sr_stream_analog_read(const uint8_t *buf,
+		struct stream_analog *analog)
+{
+	analog->mq = RL32(&buf[0]);
+	analog->unit = RL32(&buf[4]);
+	analog->mqflags = RL64(&buf[8]);
+	analog->digits = (int32_t)RL32(&buf[16]);
+}
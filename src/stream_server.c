@@ -0,0 +1,883 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#if !defined _WIN32 && defined HAVE_POLL
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#define STREAM_SERVER_SUPPORTED 1
+#endif
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "stream.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "stream-server"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Streaming a session to remote clients.
+ *
+ * A streaming server forwards the datafeed of a session over TCP to any
+ * number of clients, which inject it into a session of their own with
+ * the sigrok-stream driver. Each client chooses a compression method
+ * and grants credit for what it can take. The server never blocks the
+ * session for a client. Samples which don't fit a slow client's queue
+ * are dropped for that client, and it is told so.
+ *
+ * The sockets are served by a thread of the server. Compression runs
+ * there as well, at most once per frame and method.
+ */
+
+/**
+ * @addtogroup grp_session
+ *
+ * @{
+ */
+
+#ifdef STREAM_SERVER_SUPPORTED
+
+/* Sample bytes queued for a client before its samples get dropped. */
+#define MAX_QUEUE	(64 * 1024 * 1024)
+/* How often the thread looks at the queues without socket events. */
+#define POLL_MS		5
+#define RX_SIZE		4096
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* A frame, queued for any number of clients. */
+struct stream_frame {
+	gint refcount;
+	uint8_t type;
+	uint32_t arg;
+	GBytes *raw;
+	/* Compressed payloads, only touched by the server thread. */
+	GBytes *enc[STREAM_NUM_CODECS];
+	gboolean enc_tried[STREAM_NUM_CODECS];
+};
+
+struct stream_client {
+	int fd;
+	char *peer;
+	gboolean ready;
+	gboolean dead;
+	int codec;
+	/* Wire bytes of samples the client takes, can go negative. */
+	int64_t credit;
+	GByteArray *rx;
+	/* Under the server mutex. */
+	GQueue queue;
+	uint64_t queued;
+	uint32_t dropped;
+	/* The frame being sent. */
+	struct stream_frame *tx;
+	GBytes *tx_payload;
+	uint8_t tx_hdr[STREAM_FRAME_HEADER_SIZE];
+	size_t tx_len;
+	size_t tx_pos;
+};
+
+struct sr_stream_server {
+	struct sr_session *session;
+	int listen_fd;
+	GThread *thread;
+	gint stop;
+	GMutex mutex;
+	/* The rest is under the mutex. */
+	GSList *clients;
+	const struct sr_dev_inst *sdi;
+	GBytes *device;
+	/* HEADER and META frames of the running acquisition. */
+	GPtrArray *prologue;
+};
+
+static struct stream_frame *frame_new(uint8_t type, uint32_t arg,
+		GBytes *raw)
+{
+	struct stream_frame *f;
+
+	f = g_malloc0(sizeof(*f));
+	f->refcount = 1;
+	f->type = type;
+	f->arg = arg;
+	f->raw = raw ? raw : g_bytes_new(NULL, 0);
+
+	return f;
+}
+
+static struct stream_frame *frame_ref(struct stream_frame *f)
+{
+	g_atomic_int_inc(&f->refcount);
+
+	return f;
+}
+
+static void frame_unref(struct stream_frame *f)
+{
+	int i;
+
+	if (!f || !g_atomic_int_dec_and_test(&f->refcount))
+		return;
+
+	g_bytes_unref(f->raw);
+	for (i = 0; i < STREAM_NUM_CODECS; i++) {
+		if (f->enc[i])
+			g_bytes_unref(f->enc[i]);
+	}
+	g_free(f);
+}
+
+static gboolean frame_is_samples(const struct stream_frame *f)
+{
+	return f->type == STREAM_FRAME_LOGIC || f->type == STREAM_FRAME_ANALOG;
+}
+
+/* The payload for a codec, and the codec it really has. */
+static GBytes *frame_payload(struct stream_frame *f, int *codec)
+{
+	if (*codec != STREAM_CODEC_NONE && !f->enc_tried[*codec]) {
+		f->enc_tried[*codec] = TRUE;
+		if (frame_is_samples(f))
+			f->enc[*codec] = sr_stream_compress(*codec,
+				g_bytes_get_data(f->raw, NULL),
+				g_bytes_get_size(f->raw));
+	}
+	if (*codec != STREAM_CODEC_NONE && f->enc[*codec])
+		return f->enc[*codec];
+	*codec = STREAM_CODEC_NONE;
+
+	return f->raw;
+}
+
+static GBytes *device_describe(const struct sr_dev_inst *sdi)
+{
+	const struct sr_channel *ch;
+	GKeyFile *kf;
+	GSList *l;
+	GVariant *data;
+	char *group, *text;
+	gsize len;
+
+	kf = g_key_file_new();
+	if (sdi->vendor)
+		g_key_file_set_string(kf, "device", "vendor", sdi->vendor);
+	if (sdi->model)
+		g_key_file_set_string(kf, "device", "model", sdi->model);
+	if (sdi->version)
+		g_key_file_set_string(kf, "device", "version", sdi->version);
+	if (sr_config_get(sdi->driver, sdi, NULL, SR_CONF_SAMPLERATE,
+			&data) == SR_OK) {
+		g_key_file_set_uint64(kf, "device", "samplerate",
+			g_variant_get_uint64(data));
+		g_variant_unref(data);
+	}
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		group = g_strdup_printf("channel %d", ch->index);
+		g_key_file_set_string(kf, group, "name", ch->name);
+		g_key_file_set_string(kf, group, "type",
+			ch->type == SR_CHANNEL_ANALOG ? "analog" : "logic");
+		g_key_file_set_boolean(kf, group, "enabled", ch->enabled);
+		g_free(group);
+	}
+	text = g_key_file_to_data(kf, &len, NULL);
+	g_key_file_free(kf);
+
+	return g_bytes_new_take(text, len);
+}
+
+static void buffer_unref(gpointer data)
+{
+	sr_buffer_unref(data);
+}
+
+static GBytes *logic_payload(const struct sr_datafeed_packet *packet,
+		uint16_t *unitsize)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_logic_rle *rle;
+	const struct sr_datafeed_logic_planar *planar;
+	const struct sr_datafeed_logic_packed *packed;
+	struct sr_buffer *buf;
+	uint8_t *samples;
+	size_t len;
+
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		*unitsize = logic->unitsize;
+		/* Keep the driver's buffer if it has one, else copy. */
+		if ((buf = sr_packet_buffer_ref(packet)))
+			return g_bytes_new_with_free_func(logic->data,
+				logic->length, buffer_unref, buf);
+		return g_bytes_new(logic->data, logic->length);
+	case SR_DF_LOGIC_RLE:
+		rle = packet->payload;
+		*unitsize = rle->unitsize;
+		len = rle->num_samples * rle->unitsize;
+		samples = g_malloc(len);
+		if (sr_logic_rle_to_dense(rle, 0, rle->num_samples,
+				samples) != SR_OK) {
+			g_free(samples);
+			return NULL;
+		}
+		return g_bytes_new_take(samples, len);
+	case SR_DF_LOGIC_PLANAR:
+		planar = packet->payload;
+		*unitsize = planar->unitsize;
+		len = planar->num_samples * planar->unitsize;
+		samples = g_malloc(len);
+		if (sr_logic_planar_to_dense(planar, 0, planar->num_samples,
+				samples) != SR_OK) {
+			g_free(samples);
+			return NULL;
+		}
+		return g_bytes_new_take(samples, len);
+	case SR_DF_LOGIC_PACKED:
+		packed = packet->payload;
+		*unitsize = 1;
+		len = packed->num_samples;
+		samples = g_malloc(len);
+		if (sr_logic_packed_to_dense(packed, 0, packed->num_samples,
+				samples) != SR_OK) {
+			g_free(samples);
+			return NULL;
+		}
+		return g_bytes_new_take(samples, len);
+	default:
+		return NULL;
+	}
+}
+
+static struct stream_frame *analog_frame(
+		const struct sr_datafeed_analog *analog)
+{
+	const struct sr_channel *ch;
+	struct stream_analog sa;
+	uint8_t *buf;
+	size_t len;
+
+	if (!analog->num_samples || !analog->meaning->channels)
+		return NULL;
+
+	len = STREAM_ANALOG_SIZE + analog->num_samples * sizeof(float);
+	buf = g_malloc(len);
+	if (sr_analog_to_float(analog,
+			(float *)(buf + STREAM_ANALOG_SIZE)) != SR_OK) {
+		g_free(buf);
+		return NULL;
+	}
+	sa.mq = analog->meaning->mq;
+	sa.unit = analog->meaning->unit;
+	sa.mqflags = analog->meaning->mqflags;
+	sa.digits = analog->encoding->digits;
+	sr_stream_analog_write(buf, &sa);
+	ch = analog->meaning->channels->data;
+
+	/* The floats are in host order, like everything the client gets. */
+	return frame_new(STREAM_FRAME_ANALOG, ch->index,
+		g_bytes_new_take(buf, len));
+}
+
+static struct stream_frame *meta_frame(const struct sr_config *src)
+{
+	GVariant *v;
+	GByteArray *buf;
+	const char *type;
+
+	v = g_variant_get_normal_form(src->data);
+#ifdef WORDS_BIGENDIAN
+	{
+		GVariant *swapped;
+
+		swapped = g_variant_byteswap(v);
+		g_variant_unref(v);
+		v = swapped;
+	}
+#endif
+	type = g_variant_get_type_string(v);
+	buf = g_byte_array_new();
+	g_byte_array_append(buf, (const guint8 *)type, strlen(type) + 1);
+	g_byte_array_append(buf, g_variant_get_data(v), g_variant_get_size(v));
+	g_variant_unref(v);
+
+	return frame_new(STREAM_FRAME_META, src->key,
+		g_byte_array_free_to_bytes(buf));
+}
+
+static void client_push(struct stream_client *c, struct stream_frame *f)
+{
+	size_t len;
+
+	len = g_bytes_get_size(f->raw);
+	if (frame_is_samples(f) && c->queued + len > MAX_QUEUE) {
+		c->dropped++;
+		return;
+	}
+	g_queue_push_tail(&c->queue, frame_ref(f));
+	c->queued += len;
+}
+
+/* Queue a frame for all clients, under the mutex. */
+static void server_push(struct sr_stream_server *server,
+		struct stream_frame *f)
+{
+	struct stream_client *c;
+	GSList *l;
+
+	for (l = server->clients; l; l = l->next) {
+		c = l->data;
+		if (c->ready)
+			client_push(c, f);
+	}
+
+	switch (f->type) {
+	case STREAM_FRAME_HEADER:
+		g_ptr_array_set_size(server->prologue, 0);
+		/* Fall through. */
+	case STREAM_FRAME_META:
+		g_ptr_array_add(server->prologue, frame_ref(f));
+		break;
+	case STREAM_FRAME_END:
+		g_ptr_array_set_size(server->prologue, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+static void datafeed_in(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct sr_stream_server *server;
+	struct stream_frame *f;
+	const struct sr_datafeed_meta *meta;
+	const GSList *l;
+	GBytes *raw, *device;
+	uint16_t unitsize;
+
+	server = cb_data;
+	if (server->sdi && sdi != server->sdi)
+		return;
+
+	f = NULL;
+	device = NULL;
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		/* Channels may have been enabled or renamed since. */
+		device = device_describe(sdi);
+		f = frame_new(STREAM_FRAME_HEADER, 0, NULL);
+		break;
+	case SR_DF_END:
+		f = frame_new(STREAM_FRAME_END, 0, NULL);
+		break;
+	case SR_DF_TRIGGER:
+		f = frame_new(STREAM_FRAME_TRIGGER, 0, NULL);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		f = frame_new(STREAM_FRAME_FRAME_BEGIN, 0, NULL);
+		break;
+	case SR_DF_FRAME_END:
+		f = frame_new(STREAM_FRAME_FRAME_END, 0, NULL);
+		break;
+	case SR_DF_META:
+		meta = packet->payload;
+		g_mutex_lock(&server->mutex);
+		for (l = meta->config; l; l = l->next) {
+			f = meta_frame(l->data);
+			server_push(server, f);
+			frame_unref(f);
+		}
+		g_mutex_unlock(&server->mutex);
+		return;
+	case SR_DF_LOGIC:
+	case SR_DF_LOGIC_RLE:
+	case SR_DF_LOGIC_PLANAR:
+	case SR_DF_LOGIC_PACKED:
+		if ((raw = logic_payload(packet, &unitsize)))
+			f = frame_new(STREAM_FRAME_LOGIC, unitsize, raw);
+		break;
+	case SR_DF_ANALOG:
+		f = analog_frame(packet->payload);
+		break;
+	default:
+		break;
+	}
+	if (!f)
+		return;
+
+	g_mutex_lock(&server->mutex);
+	if (device) {
+		g_bytes_unref(server->device);
+		server->device = device;
+	}
+	server_push(server, f);
+	g_mutex_unlock(&server->mutex);
+	frame_unref(f);
+}
+
+static void client_free(struct stream_client *c)
+{
+	struct stream_frame *f;
+
+	close(c->fd);
+	while ((f = g_queue_pop_head(&c->queue)))
+		frame_unref(f);
+	frame_unref(c->tx);
+	g_byte_array_free(c->rx, TRUE);
+	g_free(c->peer);
+	g_free(c);
+}
+
+static void client_hello(struct sr_stream_server *server,
+		struct stream_client *c, const uint8_t *payload, size_t len)
+{
+	struct stream_frame *f;
+	uint8_t *buf;
+	uint32_t codecs;
+	guint i;
+
+	if (len < 20 || memcmp(payload, STREAM_MAGIC, 8) != 0 ||
+			RL32(&payload[8]) != STREAM_VERSION) {
+		sr_err("Client %s speaks another protocol.", c->peer);
+		c->dead = TRUE;
+		return;
+	}
+	codecs = RL32(&payload[12]) & sr_stream_codecs();
+	if (codecs & (1 << STREAM_CODEC_ZSTD))
+		c->codec = STREAM_CODEC_ZSTD;
+	else if (codecs & (1 << STREAM_CODEC_DEFLATE))
+		c->codec = STREAM_CODEC_DEFLATE;
+	else
+		c->codec = STREAM_CODEC_NONE;
+	c->credit += RL32(&payload[16]);
+	sr_info("Client %s connected, compression %s.", c->peer,
+		sr_stream_codec_name(c->codec));
+
+	buf = g_malloc(20);
+	memcpy(buf, STREAM_MAGIC, 8);
+	WL32(&buf[8], STREAM_VERSION);
+	WL32(&buf[12], 1 << c->codec);
+	WL32(&buf[16], 0);
+	f = frame_new(STREAM_FRAME_HELLO, 0, g_bytes_new_take(buf, 20));
+
+	g_mutex_lock(&server->mutex);
+	client_push(c, f);
+	frame_unref(f);
+	f = frame_new(STREAM_FRAME_DEVICE, 0, g_bytes_ref(server->device));
+	client_push(c, f);
+	frame_unref(f);
+	for (i = 0; i < server->prologue->len; i++)
+		client_push(c, g_ptr_array_index(server->prologue, i));
+	c->ready = TRUE;
+	g_mutex_unlock(&server->mutex);
+}
+
+static void client_receive(struct sr_stream_server *server,
+		struct stream_client *c)
+{
+	struct stream_frame_header hdr;
+	uint8_t buf[RX_SIZE];
+	ssize_t n;
+
+	n = recv(c->fd, buf, sizeof(buf), 0);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+			errno == EINTR))
+		return;
+	if (n <= 0) {
+		c->dead = TRUE;
+		return;
+	}
+	g_byte_array_append(c->rx, buf, n);
+
+	while (c->rx->len >= STREAM_FRAME_HEADER_SIZE && !c->dead) {
+		/* Clients send small frames only, never compressed. */
+		if (sr_stream_header_read(c->rx->data, &hdr) != SR_OK ||
+				hdr.codec != STREAM_CODEC_NONE ||
+				hdr.length > RX_SIZE) {
+			sr_err("Bad frame from client %s.", c->peer);
+			c->dead = TRUE;
+			return;
+		}
+		if (c->rx->len < STREAM_FRAME_HEADER_SIZE + hdr.length)
+			break;
+		switch (hdr.type) {
+		case STREAM_FRAME_HELLO:
+			if (!c->ready)
+				client_hello(server, c, c->rx->data +
+					STREAM_FRAME_HEADER_SIZE, hdr.length);
+			break;
+		case STREAM_FRAME_CREDIT:
+			c->credit += hdr.arg;
+			break;
+		default:
+			break;
+		}
+		g_byte_array_remove_range(c->rx, 0,
+			STREAM_FRAME_HEADER_SIZE + hdr.length);
+	}
+}
+
+/* Take the next frame to send, if the client may have it now. */
+static gboolean client_next(struct sr_stream_server *server,
+		struct stream_client *c)
+{
+	struct stream_frame_header hdr;
+	struct stream_frame *f;
+	int codec;
+
+	g_mutex_lock(&server->mutex);
+	f = g_queue_peek_head(&c->queue);
+	if (c->dropped) {
+		f = frame_new(STREAM_FRAME_DROPPED, c->dropped, NULL);
+		c->dropped = 0;
+	} else if (f && (!frame_is_samples(f) || c->credit > 0)) {
+		g_queue_pop_head(&c->queue);
+		c->queued -= g_bytes_get_size(f->raw);
+	} else {
+		f = NULL;
+	}
+	g_mutex_unlock(&server->mutex);
+	if (!f)
+		return FALSE;
+
+	codec = c->codec;
+	c->tx = f;
+	c->tx_payload = frame_payload(f, &codec);
+	hdr.length = g_bytes_get_size(c->tx_payload);
+	hdr.type = f->type;
+	hdr.codec = codec;
+	hdr.raw_length = g_bytes_get_size(f->raw);
+	hdr.arg = f->arg;
+	sr_stream_header_write(c->tx_hdr, &hdr);
+	c->tx_len = STREAM_FRAME_HEADER_SIZE + hdr.length;
+	c->tx_pos = 0;
+	if (frame_is_samples(f))
+		c->credit -= c->tx_len;
+
+	return TRUE;
+}
+
+static void client_send(struct sr_stream_server *server,
+		struct stream_client *c)
+{
+	const uint8_t *data;
+	size_t len;
+	ssize_t n;
+
+	while (!c->dead) {
+		if (!c->tx && !client_next(server, c))
+			return;
+		if (c->tx_pos < STREAM_FRAME_HEADER_SIZE) {
+			data = c->tx_hdr + c->tx_pos;
+			len = STREAM_FRAME_HEADER_SIZE - c->tx_pos;
+		} else {
+			data = g_bytes_get_data(c->tx_payload, NULL);
+			data += c->tx_pos - STREAM_FRAME_HEADER_SIZE;
+			len = c->tx_len - c->tx_pos;
+		}
+		n = send(c->fd, data, len, MSG_NOSIGNAL);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+				errno == EINTR))
+			return;
+		if (n < 0) {
+			c->dead = TRUE;
+			return;
+		}
+		c->tx_pos += n;
+		if (c->tx_pos == c->tx_len) {
+			frame_unref(c->tx);
+			c->tx = NULL;
+		}
+	}
+}
+
+static gboolean client_wants_out(struct sr_stream_server *server,
+		struct stream_client *c)
+{
+	struct stream_frame *f;
+	gboolean ret;
+
+	if (c->tx)
+		return TRUE;
+	g_mutex_lock(&server->mutex);
+	f = g_queue_peek_head(&c->queue);
+	ret = c->dropped || (f && (!frame_is_samples(f) || c->credit > 0));
+	g_mutex_unlock(&server->mutex);
+
+	return ret;
+}
+
+static void server_accept(struct sr_stream_server *server)
+{
+	struct stream_client *c;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	char host[NI_MAXHOST], port[NI_MAXSERV];
+	int fd;
+
+	addrlen = sizeof(addr);
+	fd = accept(server->listen_fd, (struct sockaddr *)&addr, &addrlen);
+	if (fd < 0)
+		return;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	c = g_malloc0(sizeof(*c));
+	c->fd = fd;
+	c->rx = g_byte_array_new();
+	g_queue_init(&c->queue);
+	if (getnameinfo((struct sockaddr *)&addr, addrlen, host, sizeof(host),
+			port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+		c->peer = g_strdup_printf("%s:%s", host, port);
+	else
+		c->peer = g_strdup("?");
+
+	g_mutex_lock(&server->mutex);
+	server->clients = g_slist_append(server->clients, c);
+	g_mutex_unlock(&server->mutex);
+}
+
+static gpointer server_thread(gpointer data)
+{
+	struct sr_stream_server *server;
+	struct stream_client *c;
+	struct pollfd *fds;
+	GSList *l, *clients;
+	guint i, num;
+
+	server = data;
+	fds = NULL;
+	while (!g_atomic_int_get(&server->stop)) {
+		/* Only this thread changes the list. */
+		clients = server->clients;
+		num = g_slist_length(clients) + 1;
+		fds = g_realloc(fds, num * sizeof(*fds));
+		fds[0].fd = server->listen_fd;
+		fds[0].events = POLLIN;
+		for (l = clients, i = 1; l; l = l->next, i++) {
+			c = l->data;
+			fds[i].fd = c->fd;
+			fds[i].events = POLLIN;
+			if (client_wants_out(server, c))
+				fds[i].events |= POLLOUT;
+		}
+		if (poll(fds, num, POLL_MS) < 0 && errno != EINTR)
+			break;
+
+		for (l = clients, i = 1; l; l = l->next, i++) {
+			c = l->data;
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				client_receive(server, c);
+			/* Frames queued since the poll go out right away. */
+			client_send(server, c);
+		}
+		for (l = clients; l; ) {
+			c = l->data;
+			l = l->next;
+			if (!c->dead)
+				continue;
+			sr_info("Client %s disconnected.", c->peer);
+			g_mutex_lock(&server->mutex);
+			server->clients = g_slist_remove(server->clients, c);
+			g_mutex_unlock(&server->mutex);
+			client_free(c);
+		}
+		if (fds[0].revents & POLLIN)
+			server_accept(server);
+	}
+	g_free(fds);
+
+	return NULL;
+}
+
+static int listen_socket(const char *address, const char *port)
+{
+	struct addrinfo hints, *res, *r;
+	int fd, on, ret;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if ((ret = getaddrinfo(address, port, &hints, &res)) != 0) {
+		sr_err("Cannot resolve %s:%s: %s.", address ? address : "*",
+			port, gai_strerror(ret));
+		return -1;
+	}
+	fd = -1;
+	for (r = res; r; r = r->ai_next) {
+		fd = socket(r->ai_family, r->ai_socktype, r->ai_protocol);
+		if (fd < 0)
+			continue;
+		on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (bind(fd, r->ai_addr, r->ai_addrlen) == 0 &&
+				listen(fd, 8) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd < 0)
+		sr_err("Cannot listen on %s:%s: %s.", address ? address : "*",
+			port, g_strerror(errno));
+	else
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	return fd;
+}
+
+#endif
+
+/**
+ * Start streaming a session to remote clients.
+ *
+ * The server streams the packets of the first device of the session,
+ * the one to describe to clients, and ignores other devices. Clients
+ * can connect at any time.
+ *
+ * @param session The session. Must have its device added already.
+ * @param address Local address to listen on, NULL for all.
+ * @param port TCP port to listen on, NULL for the default 5566.
+ * @param server The server, to be freed with sr_stream_server_free().
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or a session without devices.
+ * @retval SR_ERR_IO Cannot listen on the address.
+ * @retval SR_ERR_NA Not supported on this platform.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_stream_server_new(struct sr_session *session,
+		const char *address, const char *port,
+		struct sr_stream_server **server)
+{
+#ifdef STREAM_SERVER_SUPPORTED
+	struct sr_stream_server *s;
+	GSList *devs;
+	int fd;
+
+	if (!session || !server)
+		return SR_ERR_ARG;
+	devs = NULL;
+	if (sr_session_dev_list(session, &devs) != SR_OK || !devs) {
+		sr_err("The session has no device to stream.");
+		return SR_ERR_ARG;
+	}
+
+	if ((fd = listen_socket(address, port ? port : STREAM_DEFAULT_PORT)) < 0) {
+		g_slist_free(devs);
+		return SR_ERR_IO;
+	}
+
+	s = g_malloc0(sizeof(*s));
+	s->session = session;
+	s->listen_fd = fd;
+	s->sdi = devs->data;
+	g_slist_free(devs);
+	s->device = device_describe(s->sdi);
+	s->prologue = g_ptr_array_new_with_free_func(
+		(GDestroyNotify)frame_unref);
+	g_mutex_init(&s->mutex);
+	sr_session_datafeed_callback_add(session, datafeed_in, s);
+	s->thread = g_thread_new("stream-server", server_thread, s);
+	sr_info("Streaming on %s:%s.", address ? address : "*",
+		port ? port : STREAM_DEFAULT_PORT);
+	*server = s;
+
+	return SR_OK;
+#else
+	(void)session;
+	(void)address;
+	(void)port;
+	(void)server;
+
+	return SR_ERR_NA;
+#endif
+}
+
+/**
+ * Stop streaming, disconnecting all clients.
+ *
+ * Must not be called while the session is running.
+ *
+ * @param server The server. Can be NULL.
+ *
+ * @retval SR_OK Success.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_stream_server_free(struct sr_stream_server *server)
+{
+#ifdef STREAM_SERVER_SUPPORTED
+	if (!server)
+		return SR_OK;
+
+	sr_session_datafeed_callback_remove(server->session, datafeed_in,
+		server);
+	g_atomic_int_set(&server->stop, 1);
+	g_thread_join(server->thread);
+	g_slist_free_full(server->clients, (GDestroyNotify)client_free);
+	close(server->listen_fd);
+	g_ptr_array_free(server->prologue, TRUE);
+	g_bytes_unref(server->device);
+	g_mutex_clear(&server->mutex);
+	g_free(server);
+#else
+	(void)server;
+#endif
+
+	return SR_OK;
+}
+
+/**
+ * Number of clients connected to a streaming server.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_stream_server_num_clients(struct sr_stream_server *server)
+{
+#ifdef STREAM_SERVER_SUPPORTED
+	int num;
+
+	if (!server)
+		return 0;
+
+	g_mutex_lock(&server->mutex);
+	num = g_slist_length(server->clients);
+	g_mutex_unlock(&server->mutex);
+
+	return num;
+#else
+	(void)server;
+
+	return 0;
+#endif
+}
+
+/** @} */
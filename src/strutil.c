@@ -294,6 +294,151 @@ SR_PRIV int sr_atof(const char *str, float *ret)
 	return SR_OK;
 }
 
+/**
+ * Convert a string representation of a numeric value to a double. The
+ * conversion is strict and will fail if the complete string does not represent
+ * a valid double. The function sets errno according to the details of the
+ * failure.
+ *
+ * @param str The string representation to convert.
+ * @param ret Pointer to double where the result of the conversion will be stored.
+ *
+ * @retval SR_OK Conversion successful.
+ * @retval SR_ERR Failure.
+ *
+ * @private
+ */
+SR_PRIV int sr_atod(const char *str, double *ret)
+{
+	double tmp;
+	char *endptr = NULL;
+
+	errno = 0;
+	tmp = strtof(str, &endptr);
+
+	while (endptr && isspace(*endptr))
+		endptr++;
+
+	if (!endptr || *endptr || errno) {
+		if (!errno)
+			errno = EINVAL;
+		return SR_ERR;
+	}
+
+	*ret = tmp;
+	return SR_OK;
+}
+
+/**
+ * Convert a string representation of a numeric value to a float. The
+ * conversion is strict and will fail if the complete string does not represent
+ * a valid float. The function sets errno according to the details of the
+ * failure.
+ *
+ * @param str The string representation to convert.
+ * @param ret Pointer to float where the result of the conversion will be stored.
+ *
+ * @retval SR_OK Conversion successful.
+ * @retval SR_ERR Failure.
+ *
+ * @private
+ */
+SR_PRIV int sr_atof(const char *str, float *ret)
+{
+	double tmp;
+
+	if (sr_atod(str, &tmp) != SR_OK)
+		return SR_ERR;
+
+	if ((float) tmp != tmp) {
+		errno = ERANGE;
+		return SR_ERR;
+	}
+
+	*ret = (float) tmp;
+	return SR_OK;
+}
+
+/*
+ * Convert plain decimal text like "-12.345e-3" without the C library.
+ * Only takes input which converts exactly: up to 2^53 for the digits,
+ * and a power of ten which is exact in a double. Correctly rounds then,
+ * the same as strtod() does. Returns FALSE for anything else, which
+ * includes invalid input.
+ */
+static gboolean atod_ascii_fast(const char *str, double *ret)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+		1e21, 1e22,
+	};
+	const char *p;
+	gboolean neg, exp_neg;
+	uint64_t mant;
+	int digits, exp, exp_val;
+	double value;
+
+	p = str;
+	neg = *p == '-';
+	if (*p == '-' || *p == '+')
+		p++;
+
+	mant = 0;
+	digits = 0;
+	exp = 0;
+	while (g_ascii_isdigit(*p)) {
+		if (mant > (UINT64_MAX - 9) / 10)
+			return FALSE;
+		mant = mant * 10 + (*p++ - '0');
+		digits++;
+	}
+	if (*p == '.') {
+		p++;
+		while (g_ascii_isdigit(*p)) {
+			if (mant > (UINT64_MAX - 9) / 10)
+				return FALSE;
+			mant = mant * 10 + (*p++ - '0');
+			digits++;
+			exp--;
+		}
+	}
+	if (!digits)
+		return FALSE;
+
+	if (*p == 'e' || *p == 'E') {
+		p++;
+		exp_neg = *p == '-';
+		if (*p == '-' || *p == '+')
+			p++;
+		if (!g_ascii_isdigit(*p))
+			return FALSE;
+		exp_val = 0;
+		while (g_ascii_isdigit(*p)) {
+			if (exp_val > 1000)
+				return FALSE;
+			exp_val = exp_val * 10 + (*p++ - '0');
+		}
+		exp += exp_neg ? -exp_val : exp_val;
+	}
+	if (*p)
+		return FALSE;
+
+	if (mant > (UINT64_C(1) << 53))
+		return FALSE;
+	if (mant && (exp < -22 || exp > 22))
+		return FALSE;
+
+	value = mant;
+	if (mant && exp < 0)
+		value /= pow10[-exp];
+	else if (mant)
+		value *= pow10[exp];
+	*ret = neg ? -value : value;
+
+	return TRUE;
+}
+
 /**
  * Convert a string representation of a numeric value to a double. The
  * conversion is strict and will fail if the complete string does not represent
@@ -310,10 +455,16 @@ SR_PRIV int sr_atof(const char *str, float *ret)
  */
 SR_PRIV int sr_atod_ascii(const char *str, double *ret)
 {
+	const char *end;
 	double tmp;
 	char *endptr = NULL;
 
 	errno = 0;
+	end = str + strlen(str);
+	if (sr_scan_decimal(str, end, &tmp) == end) {
+		*ret = tmp;
+		return SR_OK;
+	}
 	tmp = g_ascii_strtod(str, &endptr);
 
 	if (!endptr || *endptr || errno) {
@@ -1803,9 +1954,13 @@ SR_API char *sr_text_next_line(char *s, size_t l, char **next, size_t *taken)
 	if (!s || !*s || !l)
 		return NULL;
 
-	/* Search for the next line termination. NUL terminate. */
-	p = g_strstr_len(s, l, "\n");
-	if (!p)
+	/*
+	 * Search for the next line termination. NUL terminate. Like a
+	 * string search, don't look past a NUL, but let memchr() do the
+	 * scanning of long input.
+	 */
+	p = memchr(s, '\n', l);
+	if (!p || memchr(s, '\0', p - s))
 		return NULL;
 	*p++ = '\0';
 	if (taken)
@@ -252,6 +252,37 @@ SR_PRIV int sr_sw_limits_get_remain(const struct sr_sw_limits *limits,
 	return SR_OK;
 }
 
+/**
+ * Get how many samples may still be sent before a limit is reached
+ *
+ * Lets drivers size a batch of samples once, and send all of it without
+ * further checks. All limits are checked in one go, which takes the time
+ * once per call instead of once per sample. Samples which get sent still
+ * need to be accounted for with sr_sw_limits_update_samples_read().
+ *
+ * @param[in] limits software limit instance
+ * @param[in] samples number of samples the caller has to send
+ *
+ * @return how many of the @p samples may be sent, 0 if any of the limits
+ *         was reached before
+ */
+SR_PRIV uint64_t sr_sw_limits_samples_allowed(const struct sr_sw_limits *limits,
+	uint64_t samples)
+{
+	uint64_t remain, frames, msecs;
+	gboolean exceeded;
+
+	if (sr_sw_limits_get_remain(limits, &remain, &frames, &msecs,
+			&exceeded) != SR_OK)
+		return 0;
+	if (exceeded)
+		return 0;
+	if (limits->limit_samples && samples > remain)
+		samples = remain;
+
+	return samples;
+}
+
 /**
  * Update the amount of samples that have been read
  *
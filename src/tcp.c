@@ -33,13 +33,16 @@
 
 #include <errno.h>
 #include <glib.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #if !defined _WIN32
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #endif
@@ -84,7 +87,7 @@ SR_PRIV gboolean sr_fd_is_readable(int fd)
 	memset(fds, 0, sizeof(fds));
 	fds[0].fd = fd;
 	fds[0].events = POLLIN;
-	ret = poll(fds, ARRAY_SIZE(fds), -1);
+	ret = poll(fds, ARRAY_SIZE(fds), 0);
 	if (ret < 0)
 		return FALSE;
 	if (!ret)
@@ -144,9 +147,73 @@ SR_PRIV struct sr_tcp_dev_inst *sr_tcp_dev_inst_new(
 	tcp->host_addr = host;
 	tcp->tcp_port = port;
 	tcp->sock_fd = -1;
+	tcp->opts.connect_timeout_ms = SR_TCP_CONNECT_TIMEOUT_MS;
 	return tcp;
 }
 
+/**
+ * Parse TCP socket options from conn= spec fields.
+ *
+ * Supported fields:
+ * - nodelay[=0|1]: Send small writes right away (TCP_NODELAY).
+ * - keepalive[=0|1]: Probe idle connections (SO_KEEPALIVE).
+ * - rcvbuf=<bytes>, sndbuf=<bytes>: Socket buffer sizes.
+ * - timeout=<ms>: Time to wait for the connection, 0 waits indefinitely.
+ *
+ * @param[out] opts The options to update. Fields which are not given
+ *   keep their value.
+ * @param[in] fields NULL terminated list of fields, can be NULL.
+ *
+ * @return SR_OK on success, SR_ERR_ARG for unknown fields or values.
+ *
+ * @since 6.0
+ */
+SR_PRIV int sr_tcp_parse_options(struct sr_tcp_options *opts,
+	char **fields)
+{
+	const char *field, *value;
+	char *end;
+	size_t name_len;
+	long num;
+
+	if (!opts)
+		return SR_ERR_ARG;
+
+	for (; fields && *fields; fields++) {
+		field = *fields;
+		if (!*field)
+			continue;
+		value = strchr(field, '=');
+		name_len = value ? (size_t)(value - field) : strlen(field);
+		num = 1;
+		if (value) {
+			num = strtol(++value, &end, 0);
+			if (!*value || *end || num < 0 || num > G_MAXINT) {
+				sr_err("Invalid TCP option value: %s.", field);
+				return SR_ERR_ARG;
+			}
+		}
+		if (name_len == strlen("nodelay")
+				&& !strncmp(field, "nodelay", name_len))
+			opts->nodelay = num != 0;
+		else if (name_len == strlen("keepalive")
+				&& !strncmp(field, "keepalive", name_len))
+			opts->keepalive = num != 0;
+		else if (value && !strncmp(field, "rcvbuf=", name_len + 1))
+			opts->rcvbuf = num;
+		else if (value && !strncmp(field, "sndbuf=", name_len + 1))
+			opts->sndbuf = num;
+		else if (value && !strncmp(field, "timeout=", name_len + 1))
+			opts->connect_timeout_ms = num;
+		else {
+			sr_err("Unknown TCP option: %s.", field);
+			return SR_ERR_ARG;
+		}
+	}
+
+	return SR_OK;
+}
+
 /**
  * Release a TCP communication instance.
  *
@@ -206,60 +273,223 @@ SR_PRIV int sr_tcp_get_port_path(struct sr_tcp_dev_inst *tcp,
 	return SR_OK;
 }
 
+static int set_nonblocking(int fd, gboolean nonblocking)
+{
+#if defined _WIN32
+	u_long mode;
+
+	mode = nonblocking ? 1 : 0;
+	return ioctlsocket(fd, FIONBIO, &mode) == 0 ? SR_OK : SR_ERR_IO;
+#else
+	int flags;
+
+	flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0)
+		return SR_ERR_IO;
+	if (nonblocking)
+		flags |= O_NONBLOCK;
+	else
+		flags &= ~O_NONBLOCK;
+	return fcntl(fd, F_SETFL, flags) == 0 ? SR_OK : SR_ERR_IO;
+#endif
+}
+
+static void set_int_option(int fd, int level, int name, const char *text,
+	int value)
+{
+	if (setsockopt(fd, level, name, (const void *)&value, sizeof(value)))
+		sr_warn("Cannot set %s=%d: %s.", text, value, g_strerror(errno));
+}
+
+/* Options which need to be in place before connecting. */
+static void apply_options(int fd, const struct sr_tcp_options *opts)
+{
+	if (opts->nodelay)
+		set_int_option(fd, IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", 1);
+	if (opts->keepalive)
+		set_int_option(fd, SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", 1);
+	/* Buffers take effect on the window size which gets negotiated. */
+	if (opts->rcvbuf)
+		set_int_option(fd, SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF",
+			opts->rcvbuf);
+	if (opts->sndbuf)
+		set_int_option(fd, SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF",
+			opts->sndbuf);
+}
+
+static gboolean connect_in_progress(void)
+{
+#if defined _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EINPROGRESS;
+#endif
+}
+
+/* Wait until the socket became writable, that is connected or failed. */
+static int wait_connected(int fd, int timeout_ms)
+{
+	socklen_t len;
+	int ret, err;
+#if HAVE_POLL
+	struct pollfd fds[1];
+
+	memset(fds, 0, sizeof(fds));
+	fds[0].fd = fd;
+	fds[0].events = POLLOUT;
+	do {
+		ret = poll(fds, ARRAY_SIZE(fds), timeout_ms ? timeout_ms : -1);
+	} while (ret < 0 && errno == EINTR);
+#else
+	fd_set wfds;
+	struct timeval tv, *ptv;
+
+	FD_ZERO(&wfds);
+	FD_SET(fd, &wfds);
+	ptv = NULL;
+	if (timeout_ms) {
+		tv.tv_sec = timeout_ms / 1000;
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
+		ptv = &tv;
+	}
+	ret = select(fd + 1, NULL, &wfds, NULL, ptv);
+#endif
+	if (ret < 0)
+		return SR_ERR_IO;
+	if (ret == 0) {
+		errno = ETIMEDOUT;
+		return SR_ERR_TIMEOUT;
+	}
+
+	err = 0;
+	len = sizeof(err);
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&err, &len) < 0)
+		return SR_ERR_IO;
+	if (err) {
+		errno = err;
+		return SR_ERR_IO;
+	}
+
+	return SR_OK;
+}
+
+static int connect_address(const struct addrinfo *r,
+	const struct sr_tcp_options *opts)
+{
+	int fd, ret;
+
+	fd = socket(r->ai_family, r->ai_socktype, r->ai_protocol);
+	if (fd < 0)
+		return -1;
+	apply_options(fd, opts);
+
+	if (!opts->connect_timeout_ms) {
+		if (connect(fd, r->ai_addr, r->ai_addrlen) != 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	/* Only wait for as long as the caller is willing to. */
+	ret = set_nonblocking(fd, TRUE);
+	if (ret == SR_OK && connect(fd, r->ai_addr, r->ai_addrlen) != 0) {
+		ret = SR_ERR_IO;
+		if (connect_in_progress())
+			ret = wait_connected(fd, opts->connect_timeout_ms);
+	}
+	if (ret == SR_OK)
+		ret = set_nonblocking(fd, FALSE);
+	if (ret != SR_OK) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 /**
- * Connect to a remote TCP communication peer.
+ * Open a TCP connection to a remote peer.
  *
- * @param[in] tcp The TCP communication instance to connect.
+ * Tries all the addresses of the host, with the given socket options.
  *
- * @return SR_OK on success, SR_ERR_* otherwise.
+ * @param[in] host_addr The host name or IP address (a string).
+ * @param[in] tcp_port The TCP port number or service name.
+ * @param[in] opts The socket options, or NULL for the defaults.
+ *
+ * @return The socket's file descriptor on success, SR_ERR_* otherwise.
  *
  * @since 6.0
  */
-SR_PRIV int sr_tcp_connect(struct sr_tcp_dev_inst *tcp)
+SR_PRIV int sr_tcp_connect_socket(const char *host_addr, const char *tcp_port,
+	const struct sr_tcp_options *opts)
 {
+	static const struct sr_tcp_options defaults = {
+		.connect_timeout_ms = SR_TCP_CONNECT_TIMEOUT_MS,
+	};
 	struct addrinfo hints;
 	struct addrinfo *results, *r;
 	int ret;
 	int fd;
 
-	if (!tcp)
-		return SR_ERR_ARG;
-	if (!tcp->host_addr || !tcp->tcp_port)
+	if (!host_addr || !tcp_port)
 		return SR_ERR_ARG;
+	if (!opts)
+		opts = &defaults;
 
 	/* Lookup address information for the caller's spec. */
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = AF_UNSPEC;
 	hints.ai_socktype = SOCK_STREAM;
 	hints.ai_protocol = IPPROTO_TCP;
-	ret = getaddrinfo(tcp->host_addr, tcp->tcp_port, &hints, &results);
+	ret = getaddrinfo(host_addr, tcp_port, &hints, &results);
 	if (ret != 0) {
 		sr_err("Address lookup failed: %s:%s: %s.",
-			tcp->host_addr, tcp->tcp_port, gai_strerror(ret));
+			host_addr, tcp_port, gai_strerror(ret));
 		return SR_ERR_DATA;
 	}
 
 	/* Try to connect using the resulting address details. */
 	fd = -1;
 	for (r = results; r; r = r->ai_next) {
-		fd = socket(r->ai_family, r->ai_socktype, r->ai_protocol);
-		if (fd < 0)
-			continue;
-		ret = connect(fd, r->ai_addr, r->ai_addrlen);
-		if (ret != 0) {
-			close(fd);
-			fd = -1;
-			continue;
-		}
-		break;
+		fd = connect_address(r, opts);
+		if (fd >= 0)
+			break;
 	}
 	freeaddrinfo(results);
 	if (fd < 0) {
 		sr_err("Failed to connect to %s:%s: %s.",
-			tcp->host_addr, tcp->tcp_port, g_strerror(errno));
+			host_addr, tcp_port, g_strerror(errno));
 		return SR_ERR_IO;
 	}
 
+	return fd;
+}
+
+/**
+ * Connect to a remote TCP communication peer.
+ *
+ * Uses the instance's socket options, see sr_tcp_parse_options().
+ *
+ * @param[in] tcp The TCP communication instance to connect.
+ *
+ * @return SR_OK on success, SR_ERR_* otherwise.
+ *
+ * @since 6.0
+ */
+SR_PRIV int sr_tcp_connect(struct sr_tcp_dev_inst *tcp)
+{
+	int fd;
+
+	if (!tcp)
+		return SR_ERR_ARG;
+	if (!tcp->host_addr || !tcp->tcp_port)
+		return SR_ERR_ARG;
+
+	fd = sr_tcp_connect_socket(tcp->host_addr, tcp->tcp_port, &tcp->opts);
+	if (fd < 0)
+		return fd;
+
 	tcp->sock_fd = fd;
 	return SR_OK;
 }
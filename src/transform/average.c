@@ -0,0 +1,437 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Combines the analog data of repetitive frames, like those of scopes
+ * between SR_DF_FRAME_BEGIN and SR_DF_FRAME_END. Every "frames" frames
+ * give one frame of the mean, the smallest or the largest value of each
+ * sample ("mean", "min", "max"). Or every frame gives the running mean
+ * ("running"), the mean of the frames so far up to "frames" of them,
+ * and an exponential average with a weight of 1 / frames after that.
+ *
+ * A frame gets collected per channel, and then folded into the result
+ * in one pass. A frame of another length than the ones before restarts
+ * the result. Frames still incomplete at the end of the feed, and logic
+ * data in frames, are dropped. Packets outside of frames pass as they
+ * are.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/average"
+
+enum average_mode {
+	AVERAGE_MEAN,
+	AVERAGE_RUNNING,
+	AVERAGE_MIN,
+	AVERAGE_MAX,
+};
+
+static const char *average_modes[] = {
+	[AVERAGE_MEAN] = "mean",
+	[AVERAGE_RUNNING] = "running",
+	[AVERAGE_MIN] = "min",
+	[AVERAGE_MAX] = "max",
+};
+
+/* An analog channel's samples in the current frame, and the result. */
+struct channel_state {
+	GSList channels;
+	float *frame;
+	size_t frame_len, frame_size;
+	float *result;
+	size_t result_len, result_size;
+	/* How the channel's packets were, for the result. */
+	struct sr_analog_meaning meaning;
+	int digits, spec_digits;
+};
+
+struct context {
+	uint64_t frames;
+	enum average_mode mode;
+
+	gboolean in_frame;
+	/* Frames folded into the results. */
+	uint64_t count;
+	/* Channel states, in the order the channels first came in. */
+	GSList *states;
+	float *analog_in;
+	size_t analog_in_size;
+	float *out;
+	size_t out_size;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	const char *name;
+	uint64_t frames;
+	unsigned int i;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	frames = g_variant_get_uint64(g_hash_table_lookup(options, "frames"));
+	if (!frames) {
+		sr_err("Number of frames must be at least 1.");
+		return SR_ERR_ARG;
+	}
+	name = g_variant_get_string(g_hash_table_lookup(options, "mode"), NULL);
+	for (i = 0; i < G_N_ELEMENTS(average_modes); i++) {
+		if (strcmp(name, average_modes[i]) == 0)
+			break;
+	}
+	if (i == G_N_ELEMENTS(average_modes)) {
+		sr_err("Unknown mode '%s'.", name);
+		return SR_ERR_ARG;
+	}
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->frames = frames;
+	ctx->mode = i;
+
+	return SR_OK;
+}
+
+static void state_free(void *data)
+{
+	struct channel_state *st;
+
+	st = data;
+	g_free(st->frame);
+	g_free(st->result);
+	g_free(st);
+}
+
+static void reset(struct context *ctx)
+{
+	g_slist_free_full(ctx->states, state_free);
+	ctx->states = NULL;
+	ctx->count = 0;
+	ctx->in_frame = FALSE;
+}
+
+static struct channel_state *state_get(struct context *ctx,
+		struct sr_channel *ch)
+{
+	struct channel_state *st;
+	GSList *l;
+
+	for (l = ctx->states; l; l = l->next) {
+		st = l->data;
+		if (st->channels.data == ch)
+			return st;
+	}
+	st = g_malloc0(sizeof(*st));
+	st->channels.data = ch;
+	ctx->states = g_slist_append(ctx->states, st);
+
+	return st;
+}
+
+static float *grow(float *buf, size_t *size, size_t len)
+{
+	if (len <= *size)
+		return buf;
+	*size = MAX(len, 2 * *size);
+
+	return g_realloc(buf, *size * sizeof(float));
+}
+
+/* Collect the samples of an analog packet in a frame. */
+static int collect_analog(struct context *ctx,
+		const struct sr_datafeed_analog *analog_in)
+{
+	struct channel_state *st;
+	const float *values;
+	GSList *l;
+	size_t num_channels, ch_idx, size;
+	uint64_t i;
+	int ret;
+
+	num_channels = g_slist_length(analog_in->meaning->channels);
+	if (!num_channels || !analog_in->num_samples)
+		return SR_OK;
+
+	size = analog_in->num_samples * num_channels * sizeof(float);
+	if (size > ctx->analog_in_size) {
+		g_free(ctx->analog_in);
+		ctx->analog_in = g_malloc(size);
+		ctx->analog_in_size = size;
+	}
+	ret = sr_analog_to_float(analog_in, ctx->analog_in);
+	if (ret != SR_OK)
+		return ret;
+
+	l = analog_in->meaning->channels;
+	for (ch_idx = 0; l; l = l->next, ch_idx++) {
+		st = state_get(ctx, l->data);
+		st->frame = grow(st->frame, &st->frame_size,
+			st->frame_len + analog_in->num_samples);
+		values = ctx->analog_in + ch_idx;
+		if (num_channels == 1) {
+			memcpy(st->frame + st->frame_len, values,
+				analog_in->num_samples * sizeof(float));
+		} else {
+			for (i = 0; i < analog_in->num_samples; i++)
+				st->frame[st->frame_len + i] =
+					values[i * num_channels];
+		}
+		st->frame_len += analog_in->num_samples;
+		st->meaning.mq = analog_in->meaning->mq;
+		st->meaning.mqflags = analog_in->meaning->mqflags;
+		st->meaning.unit = analog_in->meaning->unit;
+		st->digits = analog_in->encoding->digits;
+		st->spec_digits = analog_in->spec ?
+			analog_in->spec->spec_digits : st->digits;
+	}
+
+	return SR_OK;
+}
+
+/* Fold a channel's frame into its result, count frames were before. */
+static void fold(struct context *ctx, struct channel_state *st,
+		uint64_t count)
+{
+	float *r;
+	const float *f;
+	float w;
+	size_t i, n;
+
+	n = st->frame_len;
+	r = st->result;
+	f = st->frame;
+	switch (ctx->mode) {
+	case AVERAGE_MEAN:
+		for (i = 0; i < n; i++)
+			r[i] += f[i];
+		break;
+	case AVERAGE_RUNNING:
+		w = 1.0f / (float)MIN(count + 1, ctx->frames);
+		for (i = 0; i < n; i++)
+			r[i] += (f[i] - r[i]) * w;
+		break;
+	case AVERAGE_MIN:
+		for (i = 0; i < n; i++)
+			r[i] = f[i] < r[i] ? f[i] : r[i];
+		break;
+	case AVERAGE_MAX:
+		for (i = 0; i < n; i++)
+			r[i] = f[i] > r[i] ? f[i] : r[i];
+		break;
+	}
+}
+
+/* The channels' frames are complete, fold them into the results. */
+static void frame_complete(struct context *ctx)
+{
+	struct channel_state *st;
+	GSList *l;
+	gboolean restart;
+
+	/* Start over when the frame doesn't fit the ones before. */
+	restart = !ctx->count;
+	for (l = ctx->states; l && !restart; l = l->next) {
+		st = l->data;
+		if (st->frame_len != st->result_len)
+			restart = TRUE;
+	}
+	if (restart && ctx->count)
+		sr_dbg("Frame of another length, restarting.");
+
+	for (l = ctx->states; l; l = l->next) {
+		st = l->data;
+		if (restart) {
+			st->result = grow(st->result, &st->result_size,
+				st->frame_len);
+			if (st->frame_len)
+				memcpy(st->result, st->frame,
+					st->frame_len * sizeof(float));
+			st->result_len = st->frame_len;
+		} else {
+			fold(ctx, st, ctx->count);
+		}
+		st->frame_len = 0;
+	}
+	ctx->count = restart ? 1 : ctx->count + 1;
+}
+
+/* Send a frame of the results on, ahead of the frame end packet. */
+static int send_results(const struct sr_transform *t)
+{
+	struct context *ctx;
+	struct channel_state *st;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	const float *values;
+	float scale;
+	GSList *l;
+	size_t i;
+	int ret;
+
+	ctx = t->priv;
+
+	packet.type = SR_DF_FRAME_BEGIN;
+	packet.payload = NULL;
+	ret = sr_session_send_after(t, &packet);
+	if (ret != SR_OK)
+		return ret;
+
+	for (l = ctx->states; l; l = l->next) {
+		st = l->data;
+		if (!st->result_len)
+			continue;
+		values = st->result;
+		if (ctx->mode == AVERAGE_MEAN && ctx->count > 1) {
+			ctx->out = grow(ctx->out, &ctx->out_size, st->result_len);
+			scale = 1.0f / (float)ctx->count;
+			for (i = 0; i < st->result_len; i++)
+				ctx->out[i] = st->result[i] * scale;
+			values = ctx->out;
+		}
+		sr_analog_init(&analog, &encoding, &meaning, &spec, st->digits);
+		analog.data = (void *)values;
+		analog.num_samples = st->result_len;
+		meaning.mq = st->meaning.mq;
+		meaning.mqflags = st->meaning.mqflags;
+		meaning.unit = st->meaning.unit;
+		meaning.channels = &st->channels;
+		spec.spec_digits = st->spec_digits;
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		ret = sr_session_send_after(t, &packet);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	int ret;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	switch (packet_in->type) {
+	case SR_DF_HEADER:
+	case SR_DF_END:
+		reset(ctx);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		ctx->in_frame = TRUE;
+		*packet_out = NULL;
+		break;
+	case SR_DF_FRAME_END:
+		if (!ctx->in_frame)
+			break;
+		ctx->in_frame = FALSE;
+		*packet_out = NULL;
+		frame_complete(ctx);
+		if (ctx->mode != AVERAGE_RUNNING && ctx->count < ctx->frames)
+			break;
+		ret = send_results(t);
+		if (ctx->mode != AVERAGE_RUNNING)
+			ctx->count = 0;
+		if (ret != SR_OK)
+			return ret;
+		*packet_out = packet_in;
+		break;
+	case SR_DF_ANALOG:
+		if (!ctx->in_frame)
+			break;
+		*packet_out = NULL;
+		return collect_analog(ctx, packet_in->payload);
+	case SR_DF_LOGIC:
+	case SR_DF_LOGIC_RLE:
+	case SR_DF_LOGIC_PLANAR:
+	case SR_DF_LOGIC_PACKED:
+		if (ctx->in_frame)
+			*packet_out = NULL;
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	if (ctx) {
+		reset(ctx);
+		g_free(ctx->analog_in);
+		g_free(ctx->out);
+		g_free(ctx);
+	}
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "frames", "Frames", "Number of frames to combine", NULL, NULL },
+	{ "mode", "Mode", "How to combine frames (mean, running, min, max)", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	GSList *l;
+	unsigned int i;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(4));
+		options[1].def = g_variant_ref_sink(g_variant_new_string(
+			average_modes[AVERAGE_MEAN]));
+		l = NULL;
+		for (i = 0; i < G_N_ELEMENTS(average_modes); i++)
+			l = g_slist_append(l, g_variant_ref_sink(
+				g_variant_new_string(average_modes[i])));
+		options[1].values = l;
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_average = {
+	.id = "average",
+	.name = "Average",
+	.desc = "Average or take the envelope of repetitive frames",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -0,0 +1,628 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Combines groups of logic channels into bus values, bit n of a value
+ * being the n-th channel of its bus. Each bus becomes an analog channel
+ * of the device, named after the bus, and its values are sent as
+ * unsigned integer analog packets of their own next to the logic
+ * packets, which pass unchanged.
+ *
+ * With "changes" set, the logic packets are replaced by SR_DF_LOGIC_RLE
+ * packets which only list where a bus value changes instead, the buses
+ * side by side in the values, the first one in the lowest bits. No
+ * analog channels are added then.
+ *
+ * The values are gathered like the repack transform does: each byte of
+ * a sample is looked up in a table of where its bus bits go, or where
+ * the channels of a bus ascend in samples of up to 64 bits, the PEXT
+ * instruction does it when the CPU has it.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "cpu_features.h"
+
+#if defined(SR_CPU_X86) && defined(__x86_64__)
+#define BUS_PEXT
+#include <immintrin.h>
+#define TARGET_BMI2 SR_TARGET_BMI2
+#endif
+
+#define LOG_PREFIX "transform/bus"
+
+/* Widest bus, the widest integer analog data can take. */
+#define MAX_BUS_BITS 32
+/* Widest value of all buses together, with "changes" set. */
+#define MAX_BITS 64
+
+/* Gathers channel bits into the low bits of a value. */
+struct gather {
+	/* Channel indices, in the order of their value bits. */
+	int bits[MAX_BITS];
+	int num_bits;
+	gboolean ascending;
+
+	/* Lookup tables for the unit size they are made for. */
+	uint16_t unitsize;
+	uint64_t pext_mask;
+	uint16_t num_tables;
+	uint16_t *table_bytes;
+	uint64_t (*tables)[256];
+};
+
+struct bus {
+	struct gather gather;
+	struct sr_channel *analog;
+	uint16_t unitsize;
+};
+
+struct context {
+	struct bus *buses;
+	size_t num_buses;
+	gboolean changes;
+	gboolean use_pext;
+
+	/* All buses side by side, with "changes" set. */
+	struct gather all;
+
+	uint64_t *values;
+	size_t values_size;
+	uint8_t *out;
+	size_t out_size;
+
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	size_t runs_alloc;
+	size_t rle_values_alloc;
+};
+
+static struct sr_channel *find_channel(const struct sr_dev_inst *sdi,
+		const char *name)
+{
+	struct sr_channel *ch;
+	GSList *l;
+
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (g_strcmp0(ch->name, name) == 0)
+			return ch;
+	}
+
+	return NULL;
+}
+
+static int add_channel(struct gather *g, const struct sr_channel *ch,
+		int max_bits)
+{
+	if (ch->type != SR_CHANNEL_LOGIC) {
+		sr_err("Channel '%s' is not a logic channel.", ch->name);
+		return SR_ERR_ARG;
+	}
+	if (g->num_bits == max_bits) {
+		sr_err("Can't combine more than %d channels.", max_bits);
+		return SR_ERR_ARG;
+	}
+	g->bits[g->num_bits++] = ch->index;
+
+	return SR_OK;
+}
+
+static void gather_done(struct gather *g)
+{
+	int i;
+
+	g->ascending = TRUE;
+	for (i = 1; i < g->num_bits; i++) {
+		if (g->bits[i] <= g->bits[i - 1])
+			g->ascending = FALSE;
+	}
+}
+
+static void gather_free(struct gather *g)
+{
+	g_free(g->table_bytes);
+	g_free(g->tables);
+}
+
+/* "[name=]channel,channel,...", the name defaults to "bus<n>". */
+static int parse_bus(const struct sr_dev_inst *sdi, GArray *buses,
+		GPtrArray *names, char *spec)
+{
+	struct bus bus;
+	struct sr_channel *ch;
+	char *list, **chans, *name;
+	int i, ret;
+
+	if ((list = strchr(spec, '='))) {
+		*list++ = '\0';
+		name = g_strdup(g_strstrip(spec));
+	} else {
+		list = spec;
+		name = g_strdup_printf("bus%u", buses->len);
+	}
+	if (!*name) {
+		sr_err("Empty bus name.");
+		g_free(name);
+		return SR_ERR_ARG;
+	}
+
+	memset(&bus, 0, sizeof(bus));
+	ret = SR_OK;
+	chans = g_strsplit(list, ",", 0);
+	for (i = 0; ret == SR_OK && chans[i]; i++) {
+		if (!*g_strstrip(chans[i]))
+			continue;
+		if (!(ch = find_channel(sdi, chans[i]))) {
+			sr_err("Unknown channel '%s'.", chans[i]);
+			ret = SR_ERR_ARG;
+			break;
+		}
+		ret = add_channel(&bus.gather, ch, MAX_BUS_BITS);
+	}
+	g_strfreev(chans);
+	if (ret == SR_OK && !bus.gather.num_bits) {
+		sr_err("No channels for bus '%s'.", name);
+		ret = SR_ERR_ARG;
+	}
+	if (ret != SR_OK) {
+		g_free(name);
+		return ret;
+	}
+
+	g_array_append_val(buses, bus);
+	g_ptr_array_add(names, name);
+
+	return SR_OK;
+}
+
+static void context_free(struct sr_dev_inst *sdi, struct context *ctx)
+{
+	size_t i;
+
+	for (i = 0; i < ctx->num_buses; i++) {
+		gather_free(&ctx->buses[i].gather);
+		if (!ctx->buses[i].analog)
+			continue;
+		sdi->channels = g_slist_remove(sdi->channels,
+			ctx->buses[i].analog);
+		sr_channel_free(ctx->buses[i].analog);
+	}
+	gather_free(&ctx->all);
+	g_free(ctx->buses);
+	g_free(ctx->values);
+	g_free(ctx->out);
+	g_free(ctx->rle.offsets);
+	g_free(ctx->rle.values);
+	g_free(ctx);
+}
+
+static gboolean supported_pext(void)
+{
+#ifdef BUS_PEXT
+	return sr_cpu_has(SR_CPU_BMI2);
+#else
+	return FALSE;
+#endif
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct sr_dev_inst *sdi;
+	struct context *ctx;
+	struct sr_channel *ch;
+	struct bus bus;
+	GArray *buses;
+	GPtrArray *names;
+	GSList *l;
+	const char *list;
+	char **specs;
+	int i, index, ret;
+	size_t n;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+	sdi = (struct sr_dev_inst *)t->sdi;
+
+	list = g_variant_get_string(g_hash_table_lookup(options, "buses"),
+		NULL);
+
+	ret = SR_OK;
+	buses = g_array_new(FALSE, FALSE, sizeof(struct bus));
+	names = g_ptr_array_new_with_free_func(g_free);
+	if (*list) {
+		specs = g_strsplit(list, ";", 0);
+		for (i = 0; ret == SR_OK && specs[i]; i++) {
+			if (!*g_strstrip(specs[i]))
+				continue;
+			ret = parse_bus(sdi, buses, names, specs[i]);
+		}
+		g_strfreev(specs);
+	} else {
+		/* Default to one bus of the enabled logic channels. */
+		memset(&bus, 0, sizeof(bus));
+		for (l = sdi->channels; ret == SR_OK && l; l = l->next) {
+			ch = l->data;
+			if (ch->type == SR_CHANNEL_LOGIC && ch->enabled)
+				ret = add_channel(&bus.gather, ch, MAX_BUS_BITS);
+		}
+		if (ret == SR_OK && bus.gather.num_bits) {
+			g_array_append_val(buses, bus);
+			g_ptr_array_add(names, g_strdup("bus0"));
+		}
+	}
+	if (ret == SR_OK && !buses->len) {
+		sr_err("No buses to combine.");
+		ret = SR_ERR_ARG;
+	}
+	if (ret != SR_OK) {
+		g_array_free(buses, TRUE);
+		g_ptr_array_free(names, TRUE);
+		return ret;
+	}
+
+	ctx = g_malloc0(sizeof(*ctx));
+	ctx->num_buses = buses->len;
+	ctx->buses = (struct bus *)g_array_free(buses, FALSE);
+	ctx->changes = g_variant_get_boolean(g_hash_table_lookup(options,
+		"changes"));
+	ctx->use_pext = supported_pext();
+	for (n = 0; n < ctx->num_buses; n++) {
+		gather_done(&ctx->buses[n].gather);
+		if (ctx->buses[n].gather.num_bits <= 8)
+			ctx->buses[n].unitsize = sizeof(uint8_t);
+		else if (ctx->buses[n].gather.num_bits <= 16)
+			ctx->buses[n].unitsize = sizeof(uint16_t);
+		else
+			ctx->buses[n].unitsize = sizeof(uint32_t);
+	}
+
+	if (ctx->changes) {
+		for (n = 0; ret == SR_OK && n < ctx->num_buses; n++) {
+			for (i = 0; i < ctx->buses[n].gather.num_bits; i++) {
+				if (ctx->all.num_bits == MAX_BITS) {
+					sr_err("Can't list changes of more "
+						"than %d bits.", MAX_BITS);
+					ret = SR_ERR_ARG;
+					break;
+				}
+				ctx->all.bits[ctx->all.num_bits++] =
+					ctx->buses[n].gather.bits[i];
+			}
+		}
+		gather_done(&ctx->all);
+	} else {
+		index = 0;
+		for (l = sdi->channels; l; l = l->next) {
+			ch = l->data;
+			index = MAX(index, ch->index + 1);
+		}
+		for (n = 0; ret == SR_OK && n < ctx->num_buses; n++) {
+			if (find_channel(sdi, names->pdata[n])) {
+				sr_err("Channel '%s' exists already.",
+					(char *)names->pdata[n]);
+				ret = SR_ERR_ARG;
+				break;
+			}
+			ctx->buses[n].analog = sr_channel_new(sdi, index++,
+				SR_CHANNEL_ANALOG, TRUE, names->pdata[n]);
+		}
+	}
+	g_ptr_array_free(names, TRUE);
+	if (ret != SR_OK) {
+		context_free(sdi, ctx);
+		return ret;
+	}
+	t->priv = ctx;
+
+	return SR_OK;
+}
+
+/* Prepare for packets of a unit size. */
+static void update_tables(struct gather *g, uint16_t unitsize)
+{
+	uint16_t *slot;
+	int i, byte, bit;
+	unsigned int v;
+
+	if (g->unitsize == unitsize)
+		return;
+	g->unitsize = unitsize;
+
+	g->pext_mask = 0;
+	for (i = 0; i < g->num_bits; i++) {
+		if (g->bits[i] < 64)
+			g->pext_mask |= UINT64_C(1) << g->bits[i];
+	}
+
+	/* One table for each byte which has bus bits. */
+	g_free(g->table_bytes);
+	g_free(g->tables);
+	g->table_bytes = g_malloc0(unitsize * sizeof(*g->table_bytes));
+	slot = g_malloc0(unitsize * sizeof(*slot));
+	g->num_tables = 0;
+	for (i = 0; i < g->num_bits; i++) {
+		byte = g->bits[i] / 8;
+		if (byte < unitsize && !slot[byte])
+			slot[byte] = ++g->num_tables;
+	}
+	g->tables = g_malloc0(MAX(g->num_tables, 1) * sizeof(*g->tables));
+	for (byte = 0; byte < unitsize; byte++) {
+		if (slot[byte])
+			g->table_bytes[slot[byte] - 1] = byte;
+	}
+	for (i = 0; i < g->num_bits; i++) {
+		byte = g->bits[i] / 8;
+		bit = g->bits[i] % 8;
+		if (byte >= unitsize)
+			continue;
+		for (v = 0; v < 256; v++) {
+			if (v & (1 << bit))
+				g->tables[slot[byte] - 1][v] |= UINT64_C(1) << i;
+		}
+	}
+	g_free(slot);
+}
+
+static void gather_table(const struct gather *g, uint64_t *dst,
+		const uint8_t *src, uint64_t num_samples)
+{
+	uint64_t i, v;
+	uint16_t j, unitsize;
+
+	unitsize = g->unitsize;
+	for (i = 0; i < num_samples; i++) {
+		v = 0;
+		for (j = 0; j < g->num_tables; j++)
+			v |= g->tables[j][src[g->table_bytes[j]]];
+		dst[i] = v;
+		src += unitsize;
+	}
+}
+
+#ifdef BUS_PEXT
+TARGET_BMI2
+static void gather_pext(const struct gather *g, uint64_t *dst,
+		const uint8_t *src, uint64_t num_samples)
+{
+	uint64_t i, v;
+	uint16_t unitsize;
+
+	unitsize = g->unitsize;
+	for (i = 0; i < num_samples; i++) {
+		v = 0;
+		memcpy(&v, src, unitsize);
+		dst[i] = _pext_u64(v, g->pext_mask);
+		src += unitsize;
+	}
+}
+#endif
+
+static void gather(const struct context *ctx, struct gather *g,
+		uint64_t *dst, const struct sr_datafeed_logic *logic,
+		uint64_t num_samples)
+{
+	update_tables(g, logic->unitsize);
+#ifdef BUS_PEXT
+	if (ctx->use_pext && g->ascending && logic->unitsize <= 8)
+		gather_pext(g, dst, logic->data, num_samples);
+	else
+#else
+	(void)ctx;
+#endif
+		gather_table(g, dst, logic->data, num_samples);
+}
+
+/* Narrow the values to the bus' unit size, in host byte order. */
+static void store_values(void *dst, const uint64_t *values,
+		uint16_t unitsize, uint64_t num_samples)
+{
+	uint8_t *d8;
+	uint16_t *d16;
+	uint32_t *d32;
+	uint64_t i;
+
+	switch (unitsize) {
+	case sizeof(uint8_t):
+		d8 = dst;
+		for (i = 0; i < num_samples; i++)
+			d8[i] = values[i];
+		break;
+	case sizeof(uint16_t):
+		d16 = dst;
+		for (i = 0; i < num_samples; i++)
+			d16[i] = values[i];
+		break;
+	default:
+		d32 = dst;
+		for (i = 0; i < num_samples; i++)
+			d32[i] = values[i];
+		break;
+	}
+}
+
+static int send_bus(const struct sr_transform *t, struct context *ctx,
+		const struct bus *bus, uint64_t num_samples)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	int ret;
+
+	store_values(ctx->out, ctx->values, bus->unitsize, num_samples);
+
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 0);
+	analog.data = ctx->out;
+	analog.num_samples = num_samples;
+	encoding.unitsize = bus->unitsize;
+	encoding.is_float = FALSE;
+	encoding.is_signed = FALSE;
+	meaning.mq = SR_MQ_COUNT;
+	meaning.unit = SR_UNIT_UNITLESS;
+	meaning.channels = g_slist_append(NULL, bus->analog);
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+
+	ret = sr_session_send_after(t, &packet);
+	g_slist_free(meaning.channels);
+
+	return ret;
+}
+
+static int send_buses(const struct sr_transform *t, struct context *ctx,
+		const struct sr_datafeed_logic *logic, uint64_t num_samples)
+{
+	size_t i;
+	int ret;
+
+	for (i = 0; i < ctx->num_buses; i++) {
+		gather(ctx, &ctx->buses[i].gather, ctx->values, logic,
+			num_samples);
+		ret = send_bus(t, ctx, &ctx->buses[i], num_samples);
+		if (ret != SR_OK)
+			return ret;
+	}
+
+	return SR_OK;
+}
+
+static void add_run(struct context *ctx, uint64_t offset, uint64_t value)
+{
+	struct sr_datafeed_logic_rle *rle;
+	uint8_t *dst;
+	uint16_t j;
+
+	rle = &ctx->rle;
+	if (rle->num_runs == ctx->runs_alloc) {
+		ctx->runs_alloc = MAX(ctx->runs_alloc * 2, 256);
+		rle->offsets = g_realloc(rle->offsets,
+			ctx->runs_alloc * sizeof(uint64_t));
+	}
+	if ((rle->num_runs + 1) * rle->unitsize > ctx->rle_values_alloc) {
+		ctx->rle_values_alloc = ctx->runs_alloc * rle->unitsize;
+		rle->values = g_realloc(rle->values, ctx->rle_values_alloc);
+	}
+	rle->offsets[rle->num_runs] = offset;
+	dst = (uint8_t *)rle->values + rle->num_runs * rle->unitsize;
+	for (j = 0; j < rle->unitsize; j++)
+		dst[j] = value >> (8 * j);
+	rle->num_runs++;
+}
+
+static void find_changes(struct context *ctx,
+		const struct sr_datafeed_logic *logic, uint64_t num_samples)
+{
+	const uint64_t *values;
+	uint64_t i;
+
+	gather(ctx, &ctx->all, ctx->values, logic, num_samples);
+	values = ctx->values;
+	ctx->rle.unitsize = (ctx->all.num_bits + 7) / 8;
+	ctx->rle.num_samples = num_samples;
+	ctx->rle.num_runs = 0;
+	add_run(ctx, 0, values[0]);
+	for (i = 1; i < num_samples; i++) {
+		if (values[i] != values[i - 1])
+			add_run(ctx, i, values[i]);
+	}
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	uint64_t num_samples;
+	size_t size;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	if (packet_in->type != SR_DF_LOGIC)
+		return SR_OK;
+	logic = packet_in->payload;
+	if (!logic->unitsize)
+		return SR_OK;
+	num_samples = logic->length / logic->unitsize;
+	if (!num_samples)
+		return SR_OK;
+
+	size = num_samples * sizeof(uint64_t);
+	if (size > ctx->values_size) {
+		g_free(ctx->values);
+		g_free(ctx->out);
+		ctx->values = g_malloc(size);
+		/* Values of up to 32 bits fit into half of that. */
+		ctx->out = g_malloc(size / 2);
+		ctx->values_size = size;
+	}
+
+	if (!ctx->changes)
+		return send_buses(t, ctx, logic, num_samples);
+
+	find_changes(ctx, logic, num_samples);
+	ctx->packet.type = SR_DF_LOGIC_RLE;
+	ctx->packet.payload = &ctx->rle;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	if (t->priv)
+		context_free((struct sr_dev_inst *)t->sdi, t->priv);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "buses", "Buses", "Semicolon separated buses, each [name=]channel,channel,... with bit 0 first, one bus of the enabled logic channels if empty", NULL, NULL },
+	{ "changes", "Changes only", "Replace the logic data by the runs of the bus values instead of sending analog values", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+		options[1].def = g_variant_ref_sink(g_variant_new_boolean(FALSE));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_bus = {
+	.id = "bus",
+	.name = "Bus",
+	.desc = "Combine logic channels into bus values",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
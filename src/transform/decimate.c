@@ -0,0 +1,521 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Keeps one sample out of every "factor" samples. Blocks of samples may
+ * span packets, the part of a block at the end of a packet is kept until
+ * the next one. A block still incomplete at the end of the feed is
+ * dropped. The samplerate in metadata packets is divided by the factor,
+ * outputs asking the device for its samplerate get the original one.
+ *
+ * Logic blocks are represented by their first sample ("sample"), or by
+ * all of their samples ORed ("or") or ANDed ("and") together, which
+ * keeps short high or low pulses. Analog blocks give their mean, their
+ * smallest or largest value, or the value of largest magnitude ("peak").
+ */
+
+#include <config.h>
+#include <math.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/decimate"
+
+enum logic_mode {
+	LOGIC_SAMPLE,
+	LOGIC_OR,
+	LOGIC_AND,
+};
+
+enum analog_mode {
+	ANALOG_MEAN,
+	ANALOG_MIN,
+	ANALOG_MAX,
+	ANALOG_PEAK,
+};
+
+static const char *logic_modes[] = {
+	[LOGIC_SAMPLE] = "sample",
+	[LOGIC_OR] = "or",
+	[LOGIC_AND] = "and",
+};
+
+static const char *analog_modes[] = {
+	[ANALOG_MEAN] = "mean",
+	[ANALOG_MIN] = "min",
+	[ANALOG_MAX] = "max",
+	[ANALOG_PEAK] = "peak",
+};
+
+/* Partial block of an analog channel. */
+struct analog_state {
+	uint64_t count;
+	double sum;
+	float min, max, peak;
+};
+
+struct context {
+	uint64_t factor;
+	enum logic_mode logic_mode;
+	enum analog_mode analog_mode;
+
+	/* Partial logic block. */
+	uint64_t logic_count;
+	uint16_t logic_unitsize;
+	uint8_t *logic_acc;
+
+	/* Partial analog blocks, by channel. */
+	GHashTable *analog_states;
+	float *analog_in;
+	size_t analog_in_size;
+
+	/* What the last packet passed on was made of. */
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_datafeed_meta meta;
+	void *out;
+	size_t out_size;
+};
+
+static int find_mode(const char *name, const char **modes, int num_modes)
+{
+	int i;
+
+	for (i = 0; i < num_modes; i++) {
+		if (strcmp(name, modes[i]) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	const char *name;
+	int logic_mode, analog_mode;
+	uint64_t factor;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	factor = g_variant_get_uint64(g_hash_table_lookup(options, "factor"));
+	if (!factor) {
+		sr_err("Decimation factor must be at least 1.");
+		return SR_ERR_ARG;
+	}
+	name = g_variant_get_string(g_hash_table_lookup(options, "logic"), NULL);
+	logic_mode = find_mode(name, logic_modes, G_N_ELEMENTS(logic_modes));
+	if (logic_mode < 0) {
+		sr_err("Unknown logic mode '%s'.", name);
+		return SR_ERR_ARG;
+	}
+	name = g_variant_get_string(g_hash_table_lookup(options, "analog"), NULL);
+	analog_mode = find_mode(name, analog_modes, G_N_ELEMENTS(analog_modes));
+	if (analog_mode < 0) {
+		sr_err("Unknown analog mode '%s'.", name);
+		return SR_ERR_ARG;
+	}
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+	ctx->factor = factor;
+	ctx->logic_mode = logic_mode;
+	ctx->analog_mode = analog_mode;
+	ctx->analog_states = g_hash_table_new_full(g_direct_hash,
+		g_direct_equal, NULL, g_free);
+
+	return SR_OK;
+}
+
+static void reset_blocks(struct context *ctx)
+{
+	ctx->logic_count = 0;
+	g_hash_table_remove_all(ctx->analog_states);
+}
+
+static void *out_buffer(struct context *ctx, size_t size)
+{
+	if (size > ctx->out_size) {
+		g_free(ctx->out);
+		ctx->out = g_malloc(size);
+		ctx->out_size = size;
+	}
+
+	return ctx->out;
+}
+
+static void free_meta(struct context *ctx)
+{
+	g_slist_free_full(ctx->meta.config, (GDestroyNotify)sr_config_free);
+	ctx->meta.config = NULL;
+}
+
+/* Pass on metadata with the samplerate as it is after decimation. */
+static struct sr_datafeed_packet *decimate_meta(struct context *ctx,
+		struct sr_datafeed_packet *packet_in)
+{
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	GVariant *data;
+	GSList *l;
+
+	meta = packet_in->payload;
+	for (l = meta->config; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_SAMPLERATE)
+			break;
+	}
+	if (!l || ctx->factor == 1)
+		return packet_in;
+
+	free_meta(ctx);
+	for (l = meta->config; l; l = l->next) {
+		src = l->data;
+		if (src->key == SR_CONF_SAMPLERATE)
+			data = g_variant_new_uint64(
+				g_variant_get_uint64(src->data) / ctx->factor);
+		else
+			data = g_variant_ref(src->data);
+		ctx->meta.config = g_slist_append(ctx->meta.config,
+			sr_config_new(src->key, data));
+	}
+	ctx->packet.type = SR_DF_META;
+	ctx->packet.payload = &ctx->meta;
+
+	return &ctx->packet;
+}
+
+static void reduce(enum logic_mode mode, uint8_t *acc, const uint8_t *data,
+		uint64_t count, uint16_t unitsize)
+{
+	uint64_t i;
+	uint16_t j;
+
+	if (mode == LOGIC_OR && unitsize == 1) {
+		for (i = 0; i < count; i++)
+			acc[0] |= data[i];
+	} else if (mode == LOGIC_AND && unitsize == 1) {
+		for (i = 0; i < count; i++)
+			acc[0] &= data[i];
+	} else if (mode == LOGIC_OR) {
+		for (i = 0; i < count; i++, data += unitsize) {
+			for (j = 0; j < unitsize; j++)
+				acc[j] |= data[j];
+		}
+	} else if (mode == LOGIC_AND) {
+		for (i = 0; i < count; i++, data += unitsize) {
+			for (j = 0; j < unitsize; j++)
+				acc[j] &= data[j];
+		}
+	}
+}
+
+static struct sr_datafeed_packet *decimate_logic(struct context *ctx,
+		const struct sr_datafeed_logic *logic_in)
+{
+	const uint8_t *data;
+	uint8_t *out;
+	uint64_t num_samples, take, blocks;
+	uint16_t unitsize;
+
+	unitsize = logic_in->unitsize;
+	if (!unitsize)
+		return NULL;
+	if (unitsize != ctx->logic_unitsize) {
+		ctx->logic_acc = g_realloc(ctx->logic_acc, unitsize);
+		ctx->logic_unitsize = unitsize;
+		ctx->logic_count = 0;
+	}
+
+	data = logic_in->data;
+	num_samples = logic_in->length / unitsize;
+	blocks = (ctx->logic_count + num_samples) / ctx->factor;
+	out = blocks ? out_buffer(ctx, blocks * unitsize) : NULL;
+	ctx->logic.length = blocks * unitsize;
+	ctx->logic.unitsize = unitsize;
+	ctx->logic.data = out;
+
+	while (num_samples) {
+		/* Whole blocks go to the output directly. */
+		if (!ctx->logic_count && num_samples >= ctx->factor) {
+			memcpy(out, data, unitsize);
+			reduce(ctx->logic_mode, out, data + unitsize,
+				ctx->factor - 1, unitsize);
+			out += unitsize;
+			data += ctx->factor * unitsize;
+			num_samples -= ctx->factor;
+			continue;
+		}
+		/* Otherwise the block is completed in the context. */
+		take = MIN(ctx->factor - ctx->logic_count, num_samples);
+		if (!ctx->logic_count) {
+			memcpy(ctx->logic_acc, data, unitsize);
+			reduce(ctx->logic_mode, ctx->logic_acc, data + unitsize,
+				take - 1, unitsize);
+		} else {
+			reduce(ctx->logic_mode, ctx->logic_acc, data,
+				take, unitsize);
+		}
+		data += take * unitsize;
+		num_samples -= take;
+		ctx->logic_count += take;
+		if (ctx->logic_count == ctx->factor) {
+			memcpy(out, ctx->logic_acc, unitsize);
+			out += unitsize;
+			ctx->logic_count = 0;
+		}
+	}
+
+	if (!blocks)
+		return NULL;
+	ctx->packet.type = SR_DF_LOGIC;
+	ctx->packet.payload = &ctx->logic;
+
+	return &ctx->packet;
+}
+
+static void analog_add(struct analog_state *st, const float *values,
+		size_t stride, uint64_t count)
+{
+	double sum;
+	float min, max, peak, v;
+	uint64_t i;
+
+	sum = 0;
+	if (st->count) {
+		min = st->min;
+		max = st->max;
+		peak = st->peak;
+	} else {
+		min = max = peak = values[0];
+	}
+	for (i = 0; i < count; i++) {
+		v = values[i * stride];
+		sum += v;
+		min = MIN(min, v);
+		max = MAX(max, v);
+		if (fabsf(v) > fabsf(peak))
+			peak = v;
+	}
+	st->sum += sum;
+	st->min = min;
+	st->max = max;
+	st->peak = peak;
+	st->count += count;
+}
+
+static float analog_value(struct context *ctx, struct analog_state *st)
+{
+	float value;
+
+	switch (ctx->analog_mode) {
+	case ANALOG_MIN:
+		value = st->min;
+		break;
+	case ANALOG_MAX:
+		value = st->max;
+		break;
+	case ANALOG_PEAK:
+		value = st->peak;
+		break;
+	default:
+		value = st->sum / st->count;
+		break;
+	}
+	st->count = 0;
+	st->sum = 0;
+
+	return value;
+}
+
+static int decimate_analog(struct context *ctx,
+		const struct sr_datafeed_analog *analog_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct analog_state *st;
+	const float *values;
+	float *out;
+	GSList *l;
+	size_t num_channels, ch_idx, size, num_out, first_out;
+	uint64_t i, take, done;
+	int ret;
+
+	*packet_out = NULL;
+	num_channels = g_slist_length(analog_in->meaning->channels);
+	if (!num_channels || !analog_in->num_samples)
+		return SR_OK;
+
+	size = analog_in->num_samples * num_channels * sizeof(float);
+	if (size > ctx->analog_in_size) {
+		g_free(ctx->analog_in);
+		ctx->analog_in = g_malloc(size);
+		ctx->analog_in_size = size;
+	}
+	ret = sr_analog_to_float(analog_in, ctx->analog_in);
+	if (ret != SR_OK)
+		return ret;
+
+	/* All channels of a packet have the same number of samples. */
+	l = analog_in->meaning->channels;
+	st = g_hash_table_lookup(ctx->analog_states, l->data);
+	first_out = st ? st->count : 0;
+	num_out = (first_out + analog_in->num_samples) / ctx->factor;
+	out = num_out ? out_buffer(ctx, num_out * num_channels * sizeof(float)) : NULL;
+
+	for (ch_idx = 0; l; l = l->next, ch_idx++) {
+		st = g_hash_table_lookup(ctx->analog_states, l->data);
+		if (!st) {
+			st = g_malloc0(sizeof(*st));
+			g_hash_table_insert(ctx->analog_states, l->data, st);
+		}
+		values = ctx->analog_in + ch_idx;
+		for (done = 0, i = 0; done < analog_in->num_samples; i++) {
+			take = MIN(ctx->factor - st->count,
+				analog_in->num_samples - done);
+			analog_add(st, values + done * num_channels,
+				num_channels, take);
+			done += take;
+			if (st->count < ctx->factor)
+				break;
+			if (i < num_out)
+				out[i * num_channels + ch_idx] = analog_value(ctx, st);
+			else
+				st->count = 0;
+		}
+	}
+	if (!num_out)
+		return SR_OK;
+
+	sr_analog_init(&ctx->analog, &ctx->encoding, &ctx->meaning,
+		&ctx->spec, analog_in->encoding->digits);
+	ctx->analog.data = out;
+	ctx->analog.num_samples = num_out;
+	ctx->meaning.mq = analog_in->meaning->mq;
+	ctx->meaning.mqflags = analog_in->meaning->mqflags;
+	ctx->meaning.unit = analog_in->meaning->unit;
+	ctx->meaning.channels = analog_in->meaning->channels;
+	if (analog_in->spec)
+		ctx->spec.spec_digits = analog_in->spec->spec_digits;
+	ctx->packet.type = SR_DF_ANALOG;
+	ctx->packet.payload = &ctx->analog;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	switch (packet_in->type) {
+	case SR_DF_HEADER:
+	case SR_DF_END:
+		reset_blocks(ctx);
+		break;
+	case SR_DF_META:
+		*packet_out = decimate_meta(ctx, packet_in);
+		break;
+	case SR_DF_LOGIC:
+		if (ctx->factor > 1)
+			*packet_out = decimate_logic(ctx, packet_in->payload);
+		break;
+	case SR_DF_ANALOG:
+		if (ctx->factor > 1)
+			return decimate_analog(ctx, packet_in->payload, packet_out);
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	if (ctx) {
+		free_meta(ctx);
+		g_hash_table_destroy(ctx->analog_states);
+		g_free(ctx->logic_acc);
+		g_free(ctx->analog_in);
+		g_free(ctx->out);
+		g_free(ctx);
+	}
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "factor", "Factor", "Number of samples to take one sample for", NULL, NULL },
+	{ "logic", "Logic mode", "Logic samples to keep (sample, or, and)", NULL, NULL },
+	{ "analog", "Analog mode", "Analog values to keep (mean, min, max, peak)", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	GSList *l;
+	unsigned int i;
+
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_uint64(1));
+		options[1].def = g_variant_ref_sink(g_variant_new_string(
+			logic_modes[LOGIC_SAMPLE]));
+		l = NULL;
+		for (i = 0; i < G_N_ELEMENTS(logic_modes); i++)
+			l = g_slist_append(l, g_variant_ref_sink(
+				g_variant_new_string(logic_modes[i])));
+		options[1].values = l;
+		options[2].def = g_variant_ref_sink(g_variant_new_string(
+			analog_modes[ANALOG_MEAN]));
+		l = NULL;
+		for (i = 0; i < G_N_ELEMENTS(analog_modes); i++)
+			l = g_slist_append(l, g_variant_ref_sink(
+				g_variant_new_string(analog_modes[i])));
+		options[2].values = l;
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_decimate = {
+	.id = "decimate",
+	.name = "Decimate",
+	.desc = "Reduce the samplerate by a factor",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
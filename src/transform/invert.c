@@ -24,32 +24,174 @@
 
 #define LOG_PREFIX "transform/invert"
 
+struct context {
+	/* Selected channels, or NULL for all of them. */
+	GSList *channels;
+	/* Mask repeated over 8 samples, for the unit size it is made for. */
+	uint16_t mask_unitsize;
+	uint64_t *mask;
+};
+
+static struct sr_channel *find_channel(const struct sr_dev_inst *sdi,
+		const char *name)
+{
+	struct sr_channel *ch;
+	GSList *l;
+
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (g_strcmp0(ch->name, name) == 0)
+			return ch;
+	}
+
+	return NULL;
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	const char *list;
+	char **names;
+	int i, ret;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	t->priv = ctx = g_malloc0(sizeof(struct context));
+
+	list = g_variant_get_string(g_hash_table_lookup(options, "channels"), NULL);
+	if (!*list)
+		return SR_OK;
+
+	ret = SR_OK;
+	names = g_strsplit(list, ",", 0);
+	for (i = 0; names[i]; i++) {
+		g_strstrip(names[i]);
+		if (!*names[i])
+			continue;
+		ch = find_channel(t->sdi, names[i]);
+		if (!ch) {
+			sr_err("Unknown channel '%s'.", names[i]);
+			ret = SR_ERR_ARG;
+			break;
+		}
+		ctx->channels = g_slist_append(ctx->channels, ch);
+	}
+	g_strfreev(names);
+
+	if (ret != SR_OK) {
+		g_slist_free(ctx->channels);
+		g_free(ctx);
+		t->priv = NULL;
+	}
+
+	return ret;
+}
+
+/*
+ * Build the XOR mask for a unit size. Eight samples take a whole number
+ * of 64-bit words, so repeating these words lines up with the samples
+ * however large the buffer is.
+ */
+static void update_mask(struct context *ctx, uint16_t unitsize)
+{
+	struct sr_channel *ch;
+	uint8_t *bytes;
+	GSList *l;
+	size_t i;
+
+	if (ctx->mask && ctx->mask_unitsize == unitsize)
+		return;
+
+	g_free(ctx->mask);
+	ctx->mask = g_malloc0(unitsize * sizeof(uint64_t));
+	ctx->mask_unitsize = unitsize;
+	bytes = (uint8_t *)ctx->mask;
+
+	if (!ctx->channels) {
+		/* Invert every bit in every byte. */
+		memset(bytes, 0xff, unitsize * sizeof(uint64_t));
+		return;
+	}
+	for (l = ctx->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type != SR_CHANNEL_LOGIC || ch->index >= unitsize * 8)
+			continue;
+		for (i = 0; i < 8; i++)
+			bytes[i * unitsize + ch->index / 8] |= 1 << (ch->index % 8);
+	}
+}
+
+static void invert_logic(struct context *ctx, uint8_t *data, uint64_t length,
+		uint16_t unitsize)
+{
+	const uint8_t *mask_bytes;
+	uint64_t word, words, i;
+	size_t j;
+
+	update_mask(ctx, unitsize);
+	words = length / sizeof(uint64_t);
+
+	for (i = 0, j = 0; i < words; i++) {
+		memcpy(&word, data, sizeof(word));
+		word ^= ctx->mask[j];
+		memcpy(data, &word, sizeof(word));
+		data += sizeof(word);
+		if (++j == unitsize)
+			j = 0;
+	}
+	mask_bytes = (const uint8_t *)&ctx->mask[j];
+	for (i = 0; i < length % sizeof(uint64_t); i++)
+		data[i] ^= mask_bytes[i];
+}
+
+static void logic_tile(const struct sr_transform *t, uint8_t *data,
+		uint64_t length, uint16_t unitsize)
+{
+	invert_logic(t->priv, data, length, unitsize);
+}
+
+static gboolean analog_selected(struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	GSList *l;
+
+	if (!ctx->channels)
+		return TRUE;
+	for (l = analog->meaning->channels; l; l = l->next) {
+		if (!g_slist_find(ctx->channels, l->data))
+			return FALSE;
+	}
+
+	return analog->meaning->channels != NULL;
+}
+
 static int receive(const struct sr_transform *t,
 		struct sr_datafeed_packet *packet_in,
 		struct sr_datafeed_packet **packet_out)
 {
+	struct context *ctx;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_datafeed_analog *analog;
-	uint8_t *b;
 	int64_t p;
-	uint64_t i, j, q;
+	uint64_t q;
 
 	if (!t || !t->sdi || !packet_in || !packet_out)
 		return SR_ERR_ARG;
+	ctx = t->priv;
 
 	switch (packet_in->type) {
 	case SR_DF_LOGIC:
 		logic = packet_in->payload;
-		for (i = 0; i <= logic->length - logic->unitsize; i += logic->unitsize) {
-			for (j = 0; j < logic->unitsize; j++) {
-				/* For now invert every bit in every byte. */
-				b = (uint8_t *)logic->data + i + logic->unitsize - 1 - j;
-				*b = ~(*b);
-			}
-		}
+		if (logic->unitsize)
+			invert_logic(ctx, logic->data, logic->length,
+				logic->unitsize);
 		break;
 	case SR_DF_ANALOG:
 		analog = packet_in->payload;
+		if (!analog_selected(ctx, analog))
+			break;
 		p = analog->encoding->scale.p;
 		q = analog->encoding->scale.q;
 		if (q > INT64_MAX)
@@ -68,12 +210,44 @@ static int receive(const struct sr_transform *t,
 	return SR_OK;
 }
 
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	ctx = t->priv;
+	if (ctx) {
+		g_slist_free(ctx->channels);
+		g_free(ctx->mask);
+		g_free(ctx);
+	}
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "channels", "Channels", "Comma separated names of the channels to invert, all if empty", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def)
+		options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+
+	return options;
+}
+
 SR_PRIV struct sr_transform_module transform_invert = {
 	.id = "invert",
 	.name = "Invert",
 	.desc = "Invert values",
-	.options = NULL,
-	.init = NULL,
+	.options = get_options,
+	.init = init,
 	.receive = receive,
-	.cleanup = NULL,
+	.logic_tile = logic_tile,
+	.cleanup = cleanup,
 };
@@ -38,6 +38,16 @@ static int receive(const struct sr_transform *t,
 	return SR_OK;
 }
 
+static void logic_tile(const struct sr_transform *t, uint8_t *data,
+		uint64_t length, uint16_t unitsize)
+{
+	/* Leave the samples as they are. */
+	(void)t;
+	(void)data;
+	(void)length;
+	(void)unitsize;
+}
+
 SR_PRIV struct sr_transform_module transform_nop = {
 	.id = "nop",
 	.name = "NOP",
@@ -45,5 +55,6 @@ SR_PRIV struct sr_transform_module transform_nop = {
 	.options = NULL,
 	.init = NULL,
 	.receive = receive,
+	.logic_tile = logic_tile,
 	.cleanup = NULL,
 };
@@ -0,0 +1,126 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Turns SR_DF_LOGIC packets of devices with up to 4 logic channels into
+ * SR_DF_LOGIC_PACKED packets, with 2, 4 or 8 samples to a byte. Running
+ * this transform first also tells drivers which get packed samples from
+ * the device to pass them on as they are, those packets go through
+ * untouched.
+ */
+
+#include <config.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/packed"
+
+struct context {
+	/* Bits per packed sample, 0 when samples stay dense. */
+	unsigned int bits;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_packed *packed;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	const struct sr_channel *ch;
+	unsigned int width;
+	GSList *l;
+
+	(void)options;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	/* Samples must hold every enabled logic channel. */
+	width = 0;
+	for (l = t->sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC && ch->enabled)
+			width = MAX(width, (unsigned int)ch->index + 1);
+	}
+	ctx = g_malloc0(sizeof(*ctx));
+	if (width <= 1)
+		ctx->bits = 1;
+	else if (width <= 2)
+		ctx->bits = 2;
+	else if (width <= 4)
+		ctx->bits = 4;
+	t->priv = ctx;
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	int ret;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	if (packet_in->type != SR_DF_LOGIC || !ctx->bits)
+		return SR_OK;
+	logic = packet_in->payload;
+	if (logic->unitsize != 1)
+		return SR_OK;
+
+	sr_logic_packed_free(ctx->packed);
+	ctx->packed = NULL;
+	ret = sr_logic_dense_to_packed(logic, ctx->bits, &ctx->packed);
+	if (ret != SR_OK)
+		return ret;
+	ctx->packet.type = SR_DF_LOGIC_PACKED;
+	ctx->packet.payload = ctx->packed;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	if (ctx) {
+		sr_logic_packed_free(ctx->packed);
+		g_free(ctx);
+	}
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_transform_module transform_packed = {
+	.id = "packed",
+	.name = "Packed",
+	.desc = "Pass on logic data of up to 4 channels with several samples to a byte",
+	.options = NULL,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -0,0 +1,104 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Turns SR_DF_LOGIC packets into SR_DF_LOGIC_PLANAR packets, with one
+ * bit plane per channel. Consumers which look at channels one by one
+ * then scan 64 samples per word. Running this transform first also
+ * tells drivers which get planar data from the device to pass it on
+ * as it is, those packets go through untouched.
+ */
+
+#include <config.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/planar"
+
+struct context {
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_planar *planar;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	(void)options;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	t->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	int ret;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	if (packet_in->type != SR_DF_LOGIC)
+		return SR_OK;
+	logic = packet_in->payload;
+	if (!logic->unitsize)
+		return SR_OK;
+
+	sr_logic_planar_free(ctx->planar);
+	ctx->planar = NULL;
+	if ((ret = sr_logic_dense_to_planar(logic, &ctx->planar)) != SR_OK)
+		return ret;
+	ctx->packet.type = SR_DF_LOGIC_PLANAR;
+	ctx->packet.payload = ctx->planar;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	if (ctx) {
+		sr_logic_planar_free(ctx->planar);
+		g_free(ctx);
+	}
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_transform_module transform_planar = {
+	.id = "planar",
+	.name = "Planar",
+	.desc = "Pass on logic data as one bit plane per channel",
+	.options = NULL,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -0,0 +1,346 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Gathers the bits of some logic channels into samples of just as many
+ * bits as are needed for them: bit n of the output holds the n-th of the
+ * selected channels. Consumers of the packets need to know this mapping,
+ * they can't find the bits by channel index anymore.
+ *
+ * Each byte of a sample is looked up in a table of where its selected
+ * bits go, and the lookups are ORed together. Where channels are kept
+ * in the order of their index in samples of up to 64 bits, the PEXT
+ * instruction does the same when the CPU has it.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "cpu_features.h"
+
+#if defined(SR_CPU_X86) && defined(__x86_64__)
+#define REPACK_PEXT
+#include <immintrin.h>
+#define TARGET_BMI2 SR_TARGET_BMI2
+#endif
+
+#define LOG_PREFIX "transform/repack"
+
+/* Output samples are gathered into 64 bits. */
+#define MAX_CHANNELS 64
+
+struct context {
+	/* Channel indices, in the order of their output bits. */
+	int bits[MAX_CHANNELS];
+	int num_bits;
+	uint16_t out_unitsize;
+	gboolean ascending;
+	gboolean use_pext;
+
+	/* Lookup tables for the unit size they are made for. */
+	uint16_t in_unitsize;
+	gboolean identity;
+	uint64_t pext_mask;
+	uint16_t num_tables;
+	uint16_t *table_bytes;
+	uint64_t (*tables)[256];
+
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	uint8_t *out;
+	size_t out_size;
+};
+
+static struct sr_channel *find_channel(const struct sr_dev_inst *sdi,
+		const char *name)
+{
+	struct sr_channel *ch;
+	GSList *l;
+
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (g_strcmp0(ch->name, name) == 0)
+			return ch;
+	}
+
+	return NULL;
+}
+
+static int add_channel(struct context *ctx, const struct sr_channel *ch)
+{
+	if (ch->type != SR_CHANNEL_LOGIC) {
+		sr_err("Channel '%s' is not a logic channel.", ch->name);
+		return SR_ERR_ARG;
+	}
+	if (ctx->num_bits == MAX_CHANNELS) {
+		sr_err("Can't keep more than %d channels.", MAX_CHANNELS);
+		return SR_ERR_ARG;
+	}
+	ctx->bits[ctx->num_bits++] = ch->index;
+
+	return SR_OK;
+}
+
+static gboolean supported_pext(void)
+{
+#ifdef REPACK_PEXT
+	return sr_cpu_has(SR_CPU_BMI2);
+#else
+	return FALSE;
+#endif
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct context *ctx;
+	struct sr_channel *ch;
+	const char *list;
+	char **names;
+	GSList *l;
+	int i, ret;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+
+	ctx = g_malloc0(sizeof(struct context));
+
+	ret = SR_OK;
+	list = g_variant_get_string(g_hash_table_lookup(options, "channels"), NULL);
+	if (*list) {
+		names = g_strsplit(list, ",", 0);
+		for (i = 0; ret == SR_OK && names[i]; i++) {
+			g_strstrip(names[i]);
+			if (!*names[i])
+				continue;
+			ch = find_channel(t->sdi, names[i]);
+			if (!ch) {
+				sr_err("Unknown channel '%s'.", names[i]);
+				ret = SR_ERR_ARG;
+				break;
+			}
+			ret = add_channel(ctx, ch);
+		}
+		g_strfreev(names);
+	} else {
+		/* Default to the enabled logic channels. */
+		for (l = t->sdi->channels; ret == SR_OK && l; l = l->next) {
+			ch = l->data;
+			if (ch->type == SR_CHANNEL_LOGIC && ch->enabled)
+				ret = add_channel(ctx, ch);
+		}
+	}
+	if (ret == SR_OK && !ctx->num_bits) {
+		sr_err("No channels to keep.");
+		ret = SR_ERR_ARG;
+	}
+	if (ret != SR_OK) {
+		g_free(ctx);
+		return ret;
+	}
+
+	ctx->out_unitsize = (ctx->num_bits + 7) / 8;
+	ctx->ascending = TRUE;
+	for (i = 1; i < ctx->num_bits; i++) {
+		if (ctx->bits[i] <= ctx->bits[i - 1])
+			ctx->ascending = FALSE;
+	}
+	ctx->use_pext = supported_pext();
+	t->priv = ctx;
+
+	return SR_OK;
+}
+
+/* Prepare for packets of a unit size. */
+static void update_tables(struct context *ctx, uint16_t unitsize)
+{
+	uint16_t *slot;
+	int i, byte, bit;
+	unsigned int v;
+
+	if (ctx->in_unitsize == unitsize)
+		return;
+	ctx->in_unitsize = unitsize;
+
+	ctx->identity = ctx->out_unitsize == unitsize;
+	ctx->pext_mask = 0;
+	for (i = 0; i < ctx->num_bits; i++) {
+		if (ctx->bits[i] != i)
+			ctx->identity = FALSE;
+		if (ctx->bits[i] < 64)
+			ctx->pext_mask |= UINT64_C(1) << ctx->bits[i];
+	}
+
+	/* One table for each byte which has selected bits. */
+	g_free(ctx->table_bytes);
+	g_free(ctx->tables);
+	ctx->table_bytes = g_malloc0(unitsize * sizeof(*ctx->table_bytes));
+	slot = g_malloc0(unitsize * sizeof(*slot));
+	ctx->num_tables = 0;
+	for (i = 0; i < ctx->num_bits; i++) {
+		byte = ctx->bits[i] / 8;
+		if (byte < unitsize && !slot[byte])
+			slot[byte] = ++ctx->num_tables;
+	}
+	ctx->tables = g_malloc0(MAX(ctx->num_tables, 1) * sizeof(*ctx->tables));
+	for (byte = 0; byte < unitsize; byte++) {
+		if (slot[byte])
+			ctx->table_bytes[slot[byte] - 1] = byte;
+	}
+	for (i = 0; i < ctx->num_bits; i++) {
+		byte = ctx->bits[i] / 8;
+		bit = ctx->bits[i] % 8;
+		if (byte >= unitsize)
+			continue;
+		for (v = 0; v < 256; v++) {
+			if (v & (1 << bit))
+				ctx->tables[slot[byte] - 1][v] |= UINT64_C(1) << i;
+		}
+	}
+	g_free(slot);
+}
+
+static void repack_table(const struct context *ctx, uint8_t *dst,
+		const uint8_t *src, uint64_t num_samples)
+{
+	uint64_t i, v;
+	uint16_t j, in_unitsize, out_unitsize;
+
+	in_unitsize = ctx->in_unitsize;
+	out_unitsize = ctx->out_unitsize;
+	for (i = 0; i < num_samples; i++) {
+		v = 0;
+		for (j = 0; j < ctx->num_tables; j++)
+			v |= ctx->tables[j][src[ctx->table_bytes[j]]];
+		for (j = 0; j < out_unitsize; j++)
+			dst[j] = v >> (8 * j);
+		src += in_unitsize;
+		dst += out_unitsize;
+	}
+}
+
+#ifdef REPACK_PEXT
+TARGET_BMI2
+static void repack_pext(const struct context *ctx, uint8_t *dst,
+		const uint8_t *src, uint64_t num_samples)
+{
+	uint64_t i, v;
+	uint16_t in_unitsize, out_unitsize;
+
+	in_unitsize = ctx->in_unitsize;
+	out_unitsize = ctx->out_unitsize;
+	for (i = 0; i < num_samples; i++) {
+		v = 0;
+		memcpy(&v, src, in_unitsize);
+		v = _pext_u64(v, ctx->pext_mask);
+		memcpy(dst, &v, out_unitsize);
+		src += in_unitsize;
+		dst += out_unitsize;
+	}
+}
+#endif
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+	uint64_t num_samples;
+	size_t size;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	if (packet_in->type != SR_DF_LOGIC)
+		return SR_OK;
+	logic = packet_in->payload;
+	if (!logic->unitsize)
+		return SR_OK;
+
+	update_tables(ctx, logic->unitsize);
+	if (ctx->identity)
+		return SR_OK;
+
+	num_samples = logic->length / logic->unitsize;
+	size = num_samples * ctx->out_unitsize;
+	if (size > ctx->out_size) {
+		g_free(ctx->out);
+		ctx->out = g_malloc(size);
+		ctx->out_size = size;
+	}
+
+#ifdef REPACK_PEXT
+	if (ctx->use_pext && ctx->ascending && logic->unitsize <= 8)
+		repack_pext(ctx, ctx->out, logic->data, num_samples);
+	else
+#endif
+		repack_table(ctx, ctx->out, logic->data, num_samples);
+
+	ctx->logic.length = size;
+	ctx->logic.unitsize = ctx->out_unitsize;
+	ctx->logic.data = ctx->out;
+	ctx->packet.type = SR_DF_LOGIC;
+	ctx->packet.payload = &ctx->logic;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	if (ctx) {
+		g_free(ctx->table_bytes);
+		g_free(ctx->tables);
+		g_free(ctx->out);
+		g_free(ctx);
+	}
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "channels", "Channels", "Comma separated names of the logic channels to keep, in the order of their bits, the enabled ones if empty", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def)
+		options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_repack = {
+	.id = "repack",
+	.name = "Repack",
+	.desc = "Gather logic channels into smaller samples",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
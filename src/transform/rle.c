@@ -0,0 +1,166 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Turns SR_DF_LOGIC packets into SR_DF_LOGIC_RLE packets, which list
+ * where the value changes. Consumers which only care about changes then
+ * get work that grows with the number of changes, not of samples.
+ * Consumers which don't know SR_DF_LOGIC_RLE only see other packets.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/rle"
+
+/* Samples compared at once when looking for the next change. */
+#define SCAN_SAMPLES 64
+
+struct context {
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic_rle rle;
+	size_t runs_alloc;
+	size_t values_alloc;
+};
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	(void)options;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	t->priv = g_malloc0(sizeof(struct context));
+
+	return SR_OK;
+}
+
+static void add_run(struct context *ctx, uint64_t offset, const uint8_t *value)
+{
+	struct sr_datafeed_logic_rle *rle;
+
+	rle = &ctx->rle;
+	if (rle->num_runs == ctx->runs_alloc) {
+		ctx->runs_alloc = MAX(ctx->runs_alloc * 2, 256);
+		rle->offsets = g_realloc(rle->offsets,
+			ctx->runs_alloc * sizeof(uint64_t));
+	}
+	if ((rle->num_runs + 1) * rle->unitsize > ctx->values_alloc) {
+		ctx->values_alloc = ctx->runs_alloc * rle->unitsize;
+		rle->values = g_realloc(rle->values, ctx->values_alloc);
+	}
+	rle->offsets[rle->num_runs] = offset;
+	memcpy((uint8_t *)rle->values + rle->num_runs * rle->unitsize,
+		value, rle->unitsize);
+	rle->num_runs++;
+}
+
+/*
+ * Where a block of samples doesn't change, the block compares equal to
+ * itself one sample later. memcmp() compares many bytes at a time, so
+ * this skips runs much faster than comparing sample by sample.
+ */
+static void find_runs(struct context *ctx,
+		const struct sr_datafeed_logic *logic)
+{
+	const uint8_t *data, *prev, *cur;
+	uint64_t num_samples, i, n;
+	uint16_t unitsize;
+
+	data = logic->data;
+	unitsize = logic->unitsize;
+	num_samples = logic->length / unitsize;
+	ctx->rle.unitsize = unitsize;
+	ctx->rle.num_samples = num_samples;
+	ctx->rle.num_runs = 0;
+	if (!num_samples)
+		return;
+
+	add_run(ctx, 0, data);
+	i = 1;
+	while (i < num_samples) {
+		prev = data + (i - 1) * unitsize;
+		n = MIN(SCAN_SAMPLES, num_samples - i);
+		if (memcmp(prev, prev + unitsize, n * unitsize) == 0) {
+			i += n;
+			continue;
+		}
+		for (; n; n--, i++) {
+			cur = data + i * unitsize;
+			if (memcmp(cur - unitsize, cur, unitsize) != 0)
+				add_run(ctx, i, cur);
+		}
+	}
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	const struct sr_datafeed_logic *logic;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	if (packet_in->type != SR_DF_LOGIC)
+		return SR_OK;
+	logic = packet_in->payload;
+	if (!logic->unitsize)
+		return SR_OK;
+
+	if (ctx->rle.unitsize != logic->unitsize)
+		ctx->values_alloc = 0;
+	find_runs(ctx, logic);
+	ctx->packet.type = SR_DF_LOGIC_RLE;
+	ctx->packet.payload = &ctx->rle;
+	*packet_out = &ctx->packet;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	struct context *ctx;
+
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	if (ctx) {
+		g_free(ctx->rle.offsets);
+		g_free(ctx->rle.values);
+		g_free(ctx);
+	}
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+SR_PRIV struct sr_transform_module transform_rle = {
+	.id = "rle",
+	.name = "RLE",
+	.desc = "Pass on logic data as runs of values",
+	.options = NULL,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -0,0 +1,464 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Derives a logic channel from each of some analog channels, by
+ * comparing the values to a threshold, with hysteresis if given. The
+ * logic channels are added to the device, named after their analog
+ * channel with "_logic" appended, and are sent as logic packets of
+ * their own next to the analog packets, which pass unchanged.
+ *
+ * Analog packets come one channel at a time. The bits of each channel
+ * are kept until all channels have them for a sample, then the logic
+ * packet for those samples is sent.
+ *
+ * Devices which send logic data of their own are not supported, there
+ * would be two streams of logic packets not in step.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define LOG_PREFIX "transform/threshold"
+
+#define SUFFIX "_logic"
+
+struct slot {
+	const struct sr_channel *analog;
+	struct sr_channel *logic;
+	float lo_thr, hi_thr;
+	uint8_t state;
+	/* Pending bits, from bit start to bit end. */
+	uint8_t *bits;
+	size_t size;
+	uint64_t start, end;
+};
+
+struct context {
+	struct slot *slots;
+	size_t num_slots;
+	uint16_t unitsize;
+
+	uint8_t *tmp;
+	size_t tmp_size;
+	uint8_t *out;
+	size_t out_size;
+};
+
+static struct sr_channel *find_channel(const struct sr_dev_inst *sdi,
+		const char *name)
+{
+	struct sr_channel *ch;
+	GSList *l;
+
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (g_strcmp0(ch->name, name) == 0)
+			return ch;
+	}
+
+	return NULL;
+}
+
+static int add_slot(GArray *slots, const struct sr_channel *ch,
+		double threshold, double hysteresis)
+{
+	struct slot slot;
+
+	if (ch->type != SR_CHANNEL_ANALOG) {
+		sr_err("Channel '%s' is not an analog channel.", ch->name);
+		return SR_ERR_ARG;
+	}
+	if (hysteresis < 0) {
+		sr_err("Negative hysteresis for channel '%s'.", ch->name);
+		return SR_ERR_ARG;
+	}
+	memset(&slot, 0, sizeof(slot));
+	slot.analog = ch;
+	slot.lo_thr = threshold - hysteresis / 2;
+	slot.hi_thr = threshold + hysteresis / 2;
+	g_array_append_val(slots, slot);
+
+	return SR_OK;
+}
+
+/* "name[=threshold[:hysteresis]]", the levels default to the options. */
+static int parse_channel(const struct sr_dev_inst *sdi, GArray *slots,
+		char *spec, double threshold, double hysteresis)
+{
+	struct sr_channel *ch;
+	char *levels, *hyst, *end;
+
+	if ((levels = strchr(spec, '='))) {
+		*levels++ = '\0';
+		if ((hyst = strchr(levels, ':'))) {
+			*hyst++ = '\0';
+			hysteresis = g_ascii_strtod(hyst, &end);
+			if (end == hyst || *end) {
+				sr_err("Invalid hysteresis '%s'.", hyst);
+				return SR_ERR_ARG;
+			}
+		}
+		threshold = g_ascii_strtod(levels, &end);
+		if (end == levels || *end) {
+			sr_err("Invalid threshold '%s'.", levels);
+			return SR_ERR_ARG;
+		}
+	}
+	g_strstrip(spec);
+	if (!(ch = find_channel(sdi, spec))) {
+		sr_err("Unknown channel '%s'.", spec);
+		return SR_ERR_ARG;
+	}
+
+	return add_slot(slots, ch, threshold, hysteresis);
+}
+
+static void remove_logic_channels(struct sr_dev_inst *sdi,
+		struct context *ctx)
+{
+	size_t i;
+
+	for (i = 0; i < ctx->num_slots; i++) {
+		if (!ctx->slots[i].logic)
+			continue;
+		sdi->channels = g_slist_remove(sdi->channels,
+			ctx->slots[i].logic);
+		sr_channel_free(ctx->slots[i].logic);
+		ctx->slots[i].logic = NULL;
+	}
+}
+
+static void context_free(struct sr_dev_inst *sdi, struct context *ctx)
+{
+	size_t i;
+
+	remove_logic_channels(sdi, ctx);
+	for (i = 0; i < ctx->num_slots; i++)
+		g_free(ctx->slots[i].bits);
+	g_free(ctx->slots);
+	g_free(ctx->tmp);
+	g_free(ctx->out);
+	g_free(ctx);
+}
+
+static int init(struct sr_transform *t, GHashTable *options)
+{
+	struct sr_dev_inst *sdi;
+	struct context *ctx;
+	struct sr_channel *ch;
+	GArray *slots;
+	GSList *l;
+	const char *list;
+	char **specs, *name;
+	double threshold, hysteresis;
+	int i, index, ret;
+	size_t n;
+
+	if (!t || !t->sdi || !options)
+		return SR_ERR_ARG;
+	sdi = (struct sr_dev_inst *)t->sdi;
+
+	index = 0;
+	for (l = sdi->channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC && ch->enabled) {
+			sr_err("Device sends logic data of its own, "
+				"channel '%s'.", ch->name);
+			return SR_ERR_NA;
+		}
+		index = MAX(index, ch->index + 1);
+	}
+
+	threshold = g_variant_get_double(g_hash_table_lookup(options,
+		"threshold"));
+	hysteresis = g_variant_get_double(g_hash_table_lookup(options,
+		"hysteresis"));
+	list = g_variant_get_string(g_hash_table_lookup(options, "channels"),
+		NULL);
+
+	ret = SR_OK;
+	slots = g_array_new(FALSE, FALSE, sizeof(struct slot));
+	if (*list) {
+		specs = g_strsplit(list, ",", 0);
+		for (i = 0; ret == SR_OK && specs[i]; i++) {
+			if (!*g_strstrip(specs[i]))
+				continue;
+			ret = parse_channel(sdi, slots, specs[i], threshold,
+				hysteresis);
+		}
+		g_strfreev(specs);
+	} else {
+		/* Default to the enabled analog channels. */
+		for (l = sdi->channels; ret == SR_OK && l; l = l->next) {
+			ch = l->data;
+			if (ch->type == SR_CHANNEL_ANALOG && ch->enabled)
+				ret = add_slot(slots, ch, threshold, hysteresis);
+		}
+	}
+	if (ret == SR_OK && !slots->len) {
+		sr_err("No channels to convert.");
+		ret = SR_ERR_ARG;
+	}
+	if (ret != SR_OK) {
+		g_array_free(slots, TRUE);
+		return ret;
+	}
+
+	ctx = g_malloc0(sizeof(*ctx));
+	ctx->num_slots = slots->len;
+	ctx->slots = (struct slot *)g_array_free(slots, FALSE);
+	for (n = 0; n < ctx->num_slots; n++) {
+		name = g_strconcat(ctx->slots[n].analog->name, SUFFIX, NULL);
+		if (find_channel(sdi, name)) {
+			sr_err("Channel '%s' exists already.", name);
+			g_free(name);
+			context_free(sdi, ctx);
+			return SR_ERR_ARG;
+		}
+		ctx->slots[n].logic = sr_channel_new(sdi, index++,
+			SR_CHANNEL_LOGIC, TRUE, name);
+		g_free(name);
+	}
+	ctx->unitsize = (index - 1) / 8 + 1;
+	t->priv = ctx;
+
+	return SR_OK;
+}
+
+static void reset(struct context *ctx)
+{
+	size_t i;
+
+	for (i = 0; i < ctx->num_slots; i++) {
+		ctx->slots[i].start = ctx->slots[i].end = 0;
+		ctx->slots[i].state = 0;
+	}
+}
+
+static struct slot *find_slot(struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	GSList *channels;
+	size_t i;
+
+	channels = analog->meaning ? analog->meaning->channels : NULL;
+	if (!channels || channels->next)
+		return NULL;
+	for (i = 0; i < ctx->num_slots; i++) {
+		if (ctx->slots[i].analog == channels->data)
+			return &ctx->slots[i];
+	}
+
+	return NULL;
+}
+
+/* Append n packed bits to the slot's pending ones. */
+static void append_bits(struct slot *slot, const uint8_t *bits, uint64_t n)
+{
+	size_t need, bytes, i;
+	uint8_t *dst;
+	int sh;
+
+	if (slot->start >= 8) {
+		/* Drop the bytes which were sent. */
+		bytes = slot->start / 8;
+		memmove(slot->bits, slot->bits + bytes,
+			(slot->end + 7) / 8 - bytes);
+		slot->start -= bytes * 8;
+		slot->end -= bytes * 8;
+	}
+	bytes = (n + 7) / 8;
+	need = slot->end / 8 + bytes + 1;
+	if (need > slot->size) {
+		slot->size = MAX(need, slot->size * 2);
+		slot->bits = g_realloc(slot->bits, slot->size);
+	}
+
+	dst = slot->bits + slot->end / 8;
+	sh = slot->end % 8;
+	if (!sh) {
+		memcpy(dst, bits, bytes);
+	} else {
+		dst[0] &= (1 << sh) - 1;
+		for (i = 0; i < bytes; i++) {
+			dst[i] |= bits[i] << sh;
+			dst[i + 1] = bits[i] >> (8 - sh);
+		}
+	}
+	slot->end += n;
+}
+
+/* Set the slot's bit in the next n samples. */
+static void scatter_bits(const struct slot *slot, uint8_t *out,
+		uint16_t unitsize, uint64_t n)
+{
+	const uint8_t *bits;
+	uint64_t i, pos;
+	uint8_t mask;
+
+	bits = slot->bits;
+	out += slot->logic->index / 8;
+	mask = 1 << (slot->logic->index % 8);
+	pos = slot->start;
+	for (i = 0; i < n; i++, pos++, out += unitsize) {
+		if (bits[pos / 8] & (1 << (pos % 8)))
+			*out |= mask;
+	}
+}
+
+/* Send the samples all channels have bits for. */
+static int flush(const struct sr_transform *t, struct context *ctx)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	uint64_t n;
+	size_t i, size;
+
+	n = G_MAXUINT64;
+	for (i = 0; i < ctx->num_slots; i++)
+		n = MIN(n, ctx->slots[i].end - ctx->slots[i].start);
+	if (!n)
+		return SR_OK;
+
+	size = n * ctx->unitsize;
+	if (size > ctx->out_size) {
+		g_free(ctx->out);
+		ctx->out = g_malloc(size);
+		ctx->out_size = size;
+	}
+	memset(ctx->out, 0, size);
+	for (i = 0; i < ctx->num_slots; i++) {
+		scatter_bits(&ctx->slots[i], ctx->out, ctx->unitsize, n);
+		ctx->slots[i].start += n;
+	}
+
+	logic.length = size;
+	logic.unitsize = ctx->unitsize;
+	logic.data = ctx->out;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+
+	return sr_session_send_after(t, &packet);
+}
+
+static int convert(const struct sr_transform *t, struct context *ctx,
+		const struct sr_datafeed_analog *analog)
+{
+	struct slot *slot;
+	size_t size;
+	int ret;
+
+	if (!analog->num_samples)
+		return SR_OK;
+	if (!(slot = find_slot(ctx, analog)))
+		return SR_OK;
+
+	size = (analog->num_samples + 7) / 8;
+	if (size > ctx->tmp_size) {
+		g_free(ctx->tmp);
+		ctx->tmp = g_malloc(size);
+		ctx->tmp_size = size;
+	}
+	if (slot->lo_thr == slot->hi_thr)
+		ret = sr_a2l_threshold_bits(analog, slot->hi_thr, ctx->tmp,
+			analog->num_samples);
+	else
+		ret = sr_a2l_schmitt_trigger_bits(analog, slot->lo_thr,
+			slot->hi_thr, &slot->state, ctx->tmp,
+			analog->num_samples);
+	if (ret != SR_OK) {
+		sr_err("Cannot convert channel '%s'.", slot->analog->name);
+		return ret;
+	}
+	append_bits(slot, ctx->tmp, analog->num_samples);
+
+	return flush(t, ctx);
+}
+
+static int receive(const struct sr_transform *t,
+		struct sr_datafeed_packet *packet_in,
+		struct sr_datafeed_packet **packet_out)
+{
+	struct context *ctx;
+	int ret;
+
+	if (!t || !t->sdi || !packet_in || !packet_out)
+		return SR_ERR_ARG;
+	ctx = t->priv;
+
+	*packet_out = packet_in;
+	switch (packet_in->type) {
+	case SR_DF_HEADER:
+		reset(ctx);
+		break;
+	case SR_DF_ANALOG:
+		if ((ret = convert(t, ctx, packet_in->payload)) != SR_OK)
+			return ret;
+		break;
+	case SR_DF_END:
+		/* Channels which got fewer samples than others. */
+		reset(ctx);
+		break;
+	default:
+		break;
+	}
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_transform *t)
+{
+	if (!t || !t->sdi)
+		return SR_ERR_ARG;
+
+	if (t->priv)
+		context_free((struct sr_dev_inst *)t->sdi, t->priv);
+	t->priv = NULL;
+
+	return SR_OK;
+}
+
+static struct sr_option options[] = {
+	{ "channels", "Channels", "Comma separated analog channels to convert, each name[=threshold[:hysteresis]], the enabled ones if empty", NULL, NULL },
+	{ "threshold", "Threshold", "Value above which the logic level is high", NULL, NULL },
+	{ "hysteresis", "Hysteresis", "Width of the band around the threshold the logic level keeps its state in", NULL, NULL },
+	ALL_ZERO
+};
+
+static const struct sr_option *get_options(void)
+{
+	if (!options[0].def) {
+		options[0].def = g_variant_ref_sink(g_variant_new_string(""));
+		options[1].def = g_variant_ref_sink(g_variant_new_double(1.5));
+		options[2].def = g_variant_ref_sink(g_variant_new_double(0.0));
+	}
+
+	return options;
+}
+
+SR_PRIV struct sr_transform_module transform_threshold = {
+	.id = "threshold",
+	.name = "Threshold",
+	.desc = "Derive logic channels from analog channels",
+	.options = get_options,
+	.init = init,
+	.receive = receive,
+	.cleanup = cleanup,
+};
@@ -45,12 +45,28 @@
 extern SR_PRIV struct sr_transform_module transform_nop;
 extern SR_PRIV struct sr_transform_module transform_scale;
 extern SR_PRIV struct sr_transform_module transform_invert;
+extern SR_PRIV struct sr_transform_module transform_decimate;
+extern SR_PRIV struct sr_transform_module transform_average;
+extern SR_PRIV struct sr_transform_module transform_repack;
+extern SR_PRIV struct sr_transform_module transform_rle;
+extern SR_PRIV struct sr_transform_module transform_planar;
+extern SR_PRIV struct sr_transform_module transform_packed;
+extern SR_PRIV struct sr_transform_module transform_threshold;
+extern SR_PRIV struct sr_transform_module transform_bus;
 /** @endcond */
 
 static const struct sr_transform_module *transform_module_list[] = {
 	&transform_nop,
 	&transform_scale,
 	&transform_invert,
+	&transform_decimate,
+	&transform_average,
+	&transform_repack,
+	&transform_rle,
+	&transform_planar,
+	&transform_packed,
+	&transform_threshold,
+	&transform_bus,
 	NULL,
 };
 
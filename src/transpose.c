@@ -0,0 +1,386 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "transpose.h"
+#include "cpu_features.h"
+
+#ifdef SR_CPU_X86
+#define TRANSPOSE_X86
+#include <immintrin.h>
+#define TARGET_SSE2 SR_TARGET_SSE2
+#define TARGET_AVX2 SR_TARGET_AVX2
+#endif
+
+#ifdef SR_CPU_NEON_BUILD
+#define TRANSPOSE_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * All kernels first split the words of a block into rows of bytes:
+ * rows[k][c] holds the samples 8k to 8k + 7 of word c. They differ in
+ * how they turn 16 such bytes into eight samples, t[j] holding bit j
+ * of each byte.
+ */
+typedef sr_transpose_bits_fn bits_fn;
+
+static inline void gather(const struct sr_transpose *tp,
+	const uint8_t *block, uint8_t rows[][SR_TRANSPOSE_MAX_WORDS])
+{
+	unsigned int c, k, nbytes;
+	uint64_t w;
+	uint32_t w32;
+	uint16_t w16;
+
+	nbytes = tp->word_bits / 8;
+	for (c = 0; c < tp->num_words; c++) {
+		switch (tp->word_bits) {
+		case 8:
+			w = block[c];
+			break;
+		case 16:
+			memcpy(&w16, &block[c * 2], sizeof(w16));
+			w = w16;
+			break;
+		case 32:
+			memcpy(&w32, &block[c * 4], sizeof(w32));
+			w = w32;
+			break;
+		default:
+			memcpy(&w, &block[c * 8], sizeof(w));
+			break;
+		}
+		for (k = 0; k < nbytes; k++) {
+			rows[k][c] = w >> (8 * (tp->msb_first
+				? nbytes - 1 - k : k));
+		}
+	}
+}
+
+static inline void emit(const struct sr_transpose *tp, uint16_t *dst,
+	const uint16_t *t)
+{
+	unsigned int i;
+	uint16_t s;
+
+	for (i = 0; i < 8; i++) {
+		s = t[tp->msb_first ? 7 - i : i];
+		if (!tp->identity)
+			s = tp->lut[0][s & 0xff] | tp->lut[1][s >> 8];
+		dst[i] = s;
+	}
+}
+
+/*
+ * The common block loop. Kernels which handle two rows at once pass
+ * bits2, which gets 32 bytes and fills 16 samples.
+ */
+static inline void transpose_rows(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks,
+	bits_fn bits, bits_fn bits2)
+{
+	uint8_t rows[8][SR_TRANSPOSE_MAX_WORDS];
+	uint16_t t[16];
+	const uint8_t *block;
+	size_t b, block_bytes;
+	unsigned int k, nbytes;
+
+	memset(rows, 0, sizeof(rows));
+	block = src;
+	block_bytes = sr_transpose_block_bytes(tp);
+	nbytes = tp->word_bits / 8;
+	for (b = 0; b < num_blocks; b++, block += block_bytes) {
+		gather(tp, block, rows);
+		k = 0;
+		if (bits2) {
+			for (; k + 2 <= nbytes; k += 2, dst += 16) {
+				bits2(rows[k], t);
+				emit(tp, dst, &t[0]);
+				emit(tp, dst + 8, &t[8]);
+			}
+		}
+		for (; k < nbytes; k++, dst += 8) {
+			bits(rows[k], t);
+			emit(tp, dst, t);
+		}
+	}
+}
+
+/* Scalar reference, one bit at a time. */
+
+static gboolean supported_always(void)
+{
+	return TRUE;
+}
+
+static void bits_scalar(const uint8_t *rows, uint16_t *t)
+{
+	unsigned int j, c;
+
+	for (j = 0; j < 8; j++) {
+		t[j] = 0;
+		for (c = 0; c < SR_TRANSPOSE_MAX_WORDS; c++)
+			t[j] |= ((rows[c] >> j) & 1) << c;
+	}
+}
+
+static void transpose_scalar(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks)
+{
+	transpose_rows(tp, dst, src, num_blocks, bits_scalar, NULL);
+}
+
+/*
+ * 8x8 bit matrix columns by multiplication. With row c in byte c, the
+ * multiplier moves bit j of row c to bit 56 + c, and no two partial
+ * products overlap.
+ */
+
+static inline uint64_t load_rows64(const uint8_t *rows)
+{
+	uint64_t x;
+
+	memcpy(&x, rows, sizeof(x));
+
+	return GUINT64_FROM_LE(x);
+}
+
+static void bits_swar(const uint8_t *rows, uint16_t *t)
+{
+	const uint64_t lsbs = UINT64_C(0x0101010101010101);
+	const uint64_t gather_mul = UINT64_C(0x0102040810204080);
+	uint64_t lo, hi;
+	unsigned int j;
+
+	lo = load_rows64(&rows[0]);
+	hi = load_rows64(&rows[8]);
+	for (j = 0; j < 8; j++) {
+		t[j] = ((((lo >> j) & lsbs) * gather_mul) >> 56) |
+			(((((hi >> j) & lsbs) * gather_mul) >> 56) << 8);
+	}
+}
+
+static void transpose_swar(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks)
+{
+	transpose_rows(tp, dst, src, num_blocks, bits_swar, NULL);
+}
+
+#ifdef TRANSPOSE_X86
+
+static gboolean supported_sse2(void)
+{
+	return sr_cpu_has(SR_CPU_SSE2);
+}
+
+static gboolean supported_avx2(void)
+{
+	return sr_cpu_has(SR_CPU_AVX2);
+}
+
+/* movemask collects the top bit of every byte, doubling shifts them up. */
+TARGET_SSE2
+static void bits_sse2(const uint8_t *rows, uint16_t *t)
+{
+	__m128i v;
+	int j;
+
+	v = _mm_loadu_si128((const __m128i *)rows);
+	for (j = 7; j >= 0; j--) {
+		t[j] = _mm_movemask_epi8(v);
+		v = _mm_add_epi8(v, v);
+	}
+}
+
+TARGET_SSE2
+static void transpose_sse2(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks)
+{
+	transpose_rows(tp, dst, src, num_blocks, bits_sse2, NULL);
+}
+
+TARGET_AVX2
+static void bits2_avx2(const uint8_t *rows, uint16_t *t)
+{
+	__m256i v;
+	uint32_t m;
+	int j;
+
+	v = _mm256_loadu_si256((const __m256i *)rows);
+	for (j = 7; j >= 0; j--) {
+		m = _mm256_movemask_epi8(v);
+		t[j] = m & 0xffff;
+		t[8 + j] = m >> 16;
+		v = _mm256_add_epi8(v, v);
+	}
+}
+
+TARGET_AVX2
+static void transpose_avx2(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks)
+{
+	transpose_rows(tp, dst, src, num_blocks, bits_sse2, bits2_avx2);
+}
+
+#endif
+
+#ifdef TRANSPOSE_NEON
+
+static gboolean supported_neon(void)
+{
+	return sr_cpu_has(SR_CPU_NEON);
+}
+
+static void bits_neon(const uint8_t *rows, uint16_t *t)
+{
+	static const int8_t shifts[16] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7,
+	};
+	const int8x16_t sh = vld1q_s8(shifts);
+	uint8x16_t v, m;
+	int j;
+
+	v = vld1q_u8(rows);
+	for (j = 7; j >= 0; j--) {
+		m = vshlq_u8(vshrq_n_u8(v, 7), sh);
+		t[j] = vaddv_u8(vget_low_u8(m)) |
+			(vaddv_u8(vget_high_u8(m)) << 8);
+		v = vshlq_n_u8(v, 1);
+	}
+}
+
+static void transpose_neon(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks)
+{
+	transpose_rows(tp, dst, src, num_blocks, bits_neon, NULL);
+}
+
+#endif
+
+SR_PRIV const struct sr_transpose_impl sr_transpose_impls[] = {
+	{ "scalar", supported_always, transpose_scalar, bits_scalar, },
+	{ "swar", supported_always, transpose_swar, bits_swar, },
+#ifdef TRANSPOSE_X86
+	{ "sse2", supported_sse2, transpose_sse2, bits_sse2, },
+	{ "avx2", supported_avx2, transpose_avx2, bits_sse2, },
+#endif
+#ifdef TRANSPOSE_NEON
+	{ "neon", supported_neon, transpose_neon, bits_neon, },
+#endif
+	{ NULL, NULL, NULL, NULL, },
+};
+
+/* Pick the fastest implementation which the running CPU supports. */
+SR_PRIV const struct sr_transpose_impl *sr_transpose_impl_get(void)
+{
+	const struct sr_transpose_impl *impl, *best;
+
+	best = &sr_transpose_impls[0];
+	for (impl = &sr_transpose_impls[1]; impl->name; impl++) {
+		if (impl->supported())
+			best = impl;
+	}
+
+	return best;
+}
+
+/*
+ * Set up a transpose of num_words words of word_bits (8, 16, 32 or 64)
+ * bits each. Word n ORs its bits into the samples as word_masks[n],
+ * NULL has word n go to bit n.
+ */
+SR_PRIV int sr_transpose_init(struct sr_transpose *tp,
+	unsigned int word_bits, gboolean msb_first,
+	const uint16_t *word_masks, unsigned int num_words)
+{
+	unsigned int n, v;
+	uint16_t mask;
+
+	if (!tp || !num_words || num_words > SR_TRANSPOSE_MAX_WORDS)
+		return SR_ERR_ARG;
+	if (word_bits != 8 && word_bits != 16 && word_bits != 32 &&
+			word_bits != 64)
+		return SR_ERR_ARG;
+
+	memset(tp, 0, sizeof(*tp));
+	tp->num_words = num_words;
+	tp->word_bits = word_bits;
+	tp->msb_first = msb_first;
+	tp->identity = TRUE;
+	for (n = 0; n < num_words; n++) {
+		mask = word_masks ? word_masks[n] : 1 << n;
+		if (mask != 1 << n)
+			tp->identity = FALSE;
+		for (v = 0; v < 256; v++) {
+			if (v & (1 << (n % 8)))
+				tp->lut[n / 8][v] |= mask;
+		}
+	}
+	tp->fn = sr_transpose_impl_get()->fn;
+
+	return SR_OK;
+}
+
+/* Transpose complete blocks of sr_transpose_block_bytes() each. */
+SR_PRIV void sr_transpose_blocks(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks)
+{
+	tp->fn(tp, dst, src, num_blocks);
+}
+
+/*
+ * The other direction: blocks of 64 samples to blocks of num_words
+ * 64 bit words, word n holding bit n of the samples, first sample in
+ * bit 0. The same kernels do the work: with the low bytes of eight
+ * samples in rows 0-7 and their high bytes in rows 8-15, t[j] holds
+ * eight samples of bit j in its low byte and of bit j + 8 in its high
+ * byte. NULL impl picks the fastest one.
+ */
+SR_PRIV void sr_transpose_to_planar(const struct sr_transpose_impl *impl,
+	void *dst, const uint16_t *src, unsigned int num_words,
+	size_t num_blocks)
+{
+	uint8_t rows[SR_TRANSPOSE_MAX_WORDS];
+	uint64_t words[SR_TRANSPOSE_MAX_WORDS];
+	uint16_t t[8];
+	uint8_t *out;
+	bits_fn bits;
+	size_t b;
+	unsigned int k, c, j;
+
+	bits = (impl ? impl : sr_transpose_impl_get())->bits;
+	num_words = MIN(num_words, SR_TRANSPOSE_MAX_WORDS);
+	out = dst;
+	for (b = 0; b < num_blocks; b++) {
+		memset(words, 0, sizeof(words));
+		for (k = 0; k < 8; k++, src += 8) {
+			for (c = 0; c < 8; c++) {
+				rows[c] = src[c] & 0xff;
+				rows[8 + c] = src[c] >> 8;
+			}
+			bits(rows, t);
+			for (j = 0; j < 8; j++) {
+				words[j] |= (uint64_t)(t[j] & 0xff) << (8 * k);
+				words[8 + j] |= (uint64_t)(t[j] >> 8) << (8 * k);
+			}
+		}
+		memcpy(out, words, num_words * sizeof(uint64_t));
+		out += num_words * sizeof(uint64_t);
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBSIGROK_TRANSPOSE_H
+#define LIBSIGROK_TRANSPOSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+
+/*
+ * Bit transpose kernels for logic analyzers which send channel major
+ * data: a block of words, one per channel, each word holding word_bits
+ * consecutive samples of its channel. A block transposes to word_bits
+ * samples of 16 bits each.
+ *
+ * Words are in host byte order. The first sample is in bit 0 of a word,
+ * or in its top bit for msb_first. Each word ORs its bits into the
+ * samples with its own mask, usually a single channel bit.
+ *
+ * This file does not depend on anything but glib, so that the unit
+ * tests and benchmarks can link it directly.
+ */
+
+#define SR_TRANSPOSE_MAX_WORDS 16
+
+struct sr_transpose;
+
+typedef void (*sr_transpose_fn)(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks);
+/* 16 bytes in, t[j] gets bit j of each byte, see transpose.c. */
+typedef void (*sr_transpose_bits_fn)(const uint8_t *rows, uint16_t *t);
+
+struct sr_transpose_impl {
+	const char *name;
+	gboolean (*supported)(void);
+	sr_transpose_fn fn;
+	sr_transpose_bits_fn bits;
+};
+
+struct sr_transpose {
+	unsigned int num_words;
+	unsigned int word_bits;
+	gboolean msb_first;
+	/* Word n goes to sample bit n, the masks need not be applied. */
+	gboolean identity;
+	/* Sample bits for the words 0-7 and 8-15, by their bit values. */
+	uint16_t lut[2][256];
+	sr_transpose_fn fn;
+};
+
+/* NULL terminated, scalar reference first, fastest last. */
+SR_PRIV extern const struct sr_transpose_impl sr_transpose_impls[];
+
+SR_PRIV const struct sr_transpose_impl *sr_transpose_impl_get(void);
+SR_PRIV int sr_transpose_init(struct sr_transpose *tp,
+	unsigned int word_bits, gboolean msb_first,
+	const uint16_t *word_masks, unsigned int num_words);
+SR_PRIV void sr_transpose_blocks(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks);
+SR_PRIV void sr_transpose_to_planar(const struct sr_transpose_impl *impl,
+	void *dst, const uint16_t *src, unsigned int num_words,
+	size_t num_blocks);
+
+static inline size_t sr_transpose_block_bytes(const struct sr_transpose *tp)
+{
+	return tp->num_words * tp->word_bits / 8;
+}
+
+#endif
@@ -178,4 +178,59 @@ SR_API int sr_trigger_match_add(struct sr_trigger_stage *stage,
 	return SR_OK;
 }
 
+/**
+ * Require the matches of a trigger stage to hold for consecutive samples.
+ *
+ * Only supported by software triggers, for logic channels.
+ *
+ * @param stage The trigger stage. Must not be NULL.
+ * @param count The number of samples, 0 or 1 for a single sample (the
+ *              default).
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_trigger_stage_repeat_set(struct sr_trigger_stage *stage,
+		uint64_t count)
+{
+	if (!stage)
+		return SR_ERR_ARG;
+
+	stage->repeat = count;
+
+	return SR_OK;
+}
+
+/**
+ * Let a trigger stage match some time after the previous stage did.
+ *
+ * By default, a stage must match on the sample right after the previous
+ * stage matched. With a window, it may start to match on any of the
+ * @a samples samples following that one, the earliest match is taken.
+ * To get a window in time, multiply by the samplerate. Has no effect on
+ * the first stage.
+ *
+ * Only supported by software triggers, for logic channels.
+ *
+ * @param stage The trigger stage. Must not be NULL.
+ * @param samples The number of samples.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_trigger_stage_window_set(struct sr_trigger_stage *stage,
+		uint64_t samples)
+{
+	if (!stage)
+		return SR_ERR_ARG;
+
+	stage->window = samples;
+
+	return SR_OK;
+}
+
 /** @} */
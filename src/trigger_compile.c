@@ -0,0 +1,183 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "trigger-compile"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Compiling triggers for logic analyzer trigger hardware.
+ *
+ * Drivers describe what their trigger hardware can do, and get the
+ * session trigger as mask, value and edge words per stage, which map
+ * directly onto the registers of most FPGA based devices. Stages which
+ * the hardware cannot handle are reported, so that drivers can leave
+ * the whole trigger, or all but its first stage, to the soft trigger.
+ */
+
+static gboolean stage_offloadable(const struct hw_trigger_stage *hs,
+	const struct hw_trigger_caps *caps, int num_edges, int index)
+{
+	if (index >= caps->num_stages)
+		return FALSE;
+	if (caps->max_edges && num_edges > caps->max_edges)
+		return FALSE;
+	if (hs->repeat > 1 && !caps->repeat)
+		return FALSE;
+	if (index > 0 && hs->window && !caps->window)
+		return FALSE;
+
+	return TRUE;
+}
+
+/**
+ * Compile a trigger for trigger hardware.
+ *
+ * Matches on disabled channels are ignored, as drivers always did.
+ * A stage is offloaded when the hardware has room for it, and supports
+ * all its matches, channels, repeat count and window.
+ *
+ * @param trigger The trigger, may be NULL for none.
+ * @param caps What the trigger hardware supports.
+ * @param[out] hwt The compiled trigger, NULL without trigger. Free with
+ *                 hw_trigger_free().
+ *
+ * @retval SR_OK Success, also when stages cannot be offloaded.
+ * @retval SR_ERR_ARG Invalid argument.
+ */
+SR_PRIV int hw_trigger_compile(const struct sr_trigger *trigger,
+	const struct hw_trigger_caps *caps, struct hw_trigger **hwt)
+{
+	struct hw_trigger *t;
+	struct hw_trigger_stage *hs;
+	const struct sr_trigger_stage *stage;
+	const struct sr_trigger_match *match;
+	const GSList *l, *m;
+	uint64_t bit;
+	int i, num_edges;
+	gboolean fits;
+
+	if (!caps || !hwt)
+		return SR_ERR_ARG;
+	*hwt = NULL;
+	if (!trigger || !trigger->stages)
+		return SR_OK;
+
+	t = g_malloc0(sizeof(*t));
+	t->num_stages = g_slist_length(trigger->stages);
+	t->stages = g_malloc0_n(t->num_stages, sizeof(t->stages[0]));
+
+	for (l = trigger->stages, i = 0; l; l = l->next, i++) {
+		stage = l->data;
+		hs = &t->stages[i];
+		hs->repeat = stage->repeat;
+		hs->window = stage->window;
+		fits = TRUE;
+		num_edges = 0;
+		for (m = stage->matches; m; m = m->next) {
+			match = m->data;
+			if (!match->channel->enabled)
+				continue;
+			if (match->channel->type != SR_CHANNEL_LOGIC ||
+					match->channel->index >= caps->num_channels ||
+					match->channel->index >= 64 ||
+					!(caps->matches & HW_TRIGGER_MATCH(match->match))) {
+				fits = FALSE;
+				continue;
+			}
+			bit = UINT64_C(1) << match->channel->index;
+			hs->mask |= bit;
+			switch (match->match) {
+			case SR_TRIGGER_ONE:
+				hs->value |= bit;
+				break;
+			case SR_TRIGGER_RISING:
+				hs->value |= bit;
+				hs->edge |= bit;
+				num_edges++;
+				break;
+			case SR_TRIGGER_FALLING:
+				hs->edge |= bit;
+				num_edges++;
+				break;
+			case SR_TRIGGER_EDGE:
+				hs->any_edge |= bit;
+				hs->edge |= bit;
+				num_edges++;
+				break;
+			}
+		}
+		hs->offloaded = fits && stage_offloadable(hs, caps, num_edges, i);
+		if (hs->offloaded && t->num_offloaded == i)
+			t->num_offloaded++;
+	}
+	t->complete = t->num_offloaded == t->num_stages;
+	sr_dbg("%d of %d trigger stages run on the device.",
+		t->num_offloaded, t->num_stages);
+	*hwt = t;
+
+	return SR_OK;
+}
+
+/** Free a trigger from hw_trigger_compile(), NULL is fine. */
+SR_PRIV void hw_trigger_free(struct hw_trigger *hwt)
+{
+	if (!hwt)
+		return;
+	g_free(hwt->stages);
+	g_free(hwt);
+}
+
+/**
+ * Build a lookup table of the levels to match on a group of channels.
+ *
+ * Bit n of the result is set when the channels' levels, given as the
+ * bits of n, match. Channels outside the mask match on any level.
+ *
+ * @param value The levels to match, bit 0 for channel 0.
+ * @param mask The channels to match.
+ * @param first The first channel of the group.
+ * @param width The number of channels in the group, up to 6.
+ *
+ * @return The table, of 2^width bits.
+ */
+SR_PRIV uint64_t hw_trigger_lut(uint64_t value, uint64_t mask,
+	unsigned int first, unsigned int width)
+{
+	uint64_t lut, bits, care;
+	unsigned int n;
+
+	if (width > 6 || first >= 64)
+		return 0;
+
+	care = (mask >> first) & ((1 << width) - 1);
+	bits = (value >> first) & care;
+	lut = 0;
+	for (n = 0; n < (1U << width); n++) {
+		if ((n & care) == bits)
+			lut |= UINT64_C(1) << n;
+	}
+
+	return lut;
+}
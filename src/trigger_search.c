@@ -0,0 +1,302 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "trigger"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Searching captured logic data for all occurrences of a trigger.
+ *
+ * The data is split into chunks by where occurrences start, which
+ * worker threads search with the same compiled trigger. Each chunk is
+ * searched with the sample before it, for edges, and as many samples
+ * after it as an occurrence starting in it can take, so that every
+ * occurrence is found in exactly the chunk it starts in.
+ */
+
+/**
+ * @addtogroup grp_trigger
+ *
+ * @{
+ */
+
+/* Smallest number of samples worth handing to a thread. */
+#define MIN_CHUNK_SAMPLES	(64 * 1024)
+/* Chunks per thread, so that threads finishing early get more work. */
+#define CHUNKS_PER_THREAD	4
+
+struct trigger_search {
+	const struct soft_trigger_logic *stl;
+	/* Data in memory, or else the session store the data is in. */
+	const uint8_t *data;
+	struct sr_session *session;
+	const struct sr_dev_inst *sdi;
+	uint64_t num_samples;
+	int unitsize;
+	uint64_t span;
+	uint64_t chunk_samples;
+	int num_chunks;
+	volatile gint next_chunk;
+	volatile gint ret;
+	/* One array of offsets per chunk, in order. */
+	GArray **results;
+};
+
+static int search_chunk(struct trigger_search *s, int idx)
+{
+	uint64_t start, end, first, last;
+	uint8_t *buf;
+	int ret;
+
+	start = idx * s->chunk_samples;
+	end = MIN(start + s->chunk_samples, s->num_samples);
+	/* The sample before, and what occurrences may take after. */
+	first = start > 0 ? start - 1 : 0;
+	last = s->span >= s->num_samples - end ?
+		s->num_samples : end + s->span;
+
+	if (s->data) {
+		soft_trigger_logic_find_all(s->stl,
+			s->data + first * s->unitsize, last - first,
+			start - first, end - first, first, s->results[idx]);
+		return SR_OK;
+	}
+
+	buf = g_try_malloc((last - first) * s->unitsize);
+	if (!buf) {
+		sr_err("Cannot allocate trigger search buffer.");
+		return SR_ERR_MALLOC;
+	}
+	ret = sr_session_store_logic_read(s->session, s->sdi, first,
+		last - first, buf);
+	if (ret == SR_OK)
+		soft_trigger_logic_find_all(s->stl, buf, last - first,
+			start - first, end - first, first, s->results[idx]);
+	g_free(buf);
+
+	return ret;
+}
+
+static gpointer search_thread(gpointer data)
+{
+	struct trigger_search *s;
+	int idx, ret;
+
+	s = data;
+
+	while ((idx = g_atomic_int_add(&s->next_chunk, 1)) < s->num_chunks) {
+		if (g_atomic_int_get(&s->ret) != SR_OK)
+			break;
+		ret = search_chunk(s, idx);
+		if (ret != SR_OK)
+			g_atomic_int_set(&s->ret, ret);
+	}
+
+	return NULL;
+}
+
+static int search_run(struct trigger_search *s, unsigned int num_threads,
+		GArray **offsets)
+{
+	GThread **threads;
+	GArray *all;
+	uint64_t max_samples, offset;
+	unsigned int i, j, started;
+	int ret;
+
+	if (!num_threads) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		num_threads = g_get_num_processors();
+#else
+		num_threads = 1;
+#endif
+	}
+
+	/* Each chunk with its overlap must fit what the search indexes. */
+	max_samples = G_MAXINT / s->unitsize;
+	if (max_samples < 2 || s->span >= max_samples - 1) {
+		sr_err("Trigger spans too many samples to search.");
+		return SR_ERR_ARG;
+	}
+	s->chunk_samples = s->num_samples / (num_threads * CHUNKS_PER_THREAD) + 1;
+	s->chunk_samples = MAX(s->chunk_samples, MIN_CHUNK_SAMPLES);
+	s->chunk_samples = MIN(s->chunk_samples, max_samples - 1 - s->span);
+	s->num_chunks = (s->num_samples + s->chunk_samples - 1) / s->chunk_samples;
+	num_threads = MIN(num_threads, (unsigned int)MAX(s->num_chunks, 1));
+
+	s->results = g_new(GArray *, s->num_chunks);
+	for (i = 0; i < (unsigned int)s->num_chunks; i++)
+		s->results[i] = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	s->next_chunk = 0;
+	s->ret = SR_OK;
+
+	/* The calling thread searches too. */
+	threads = g_new0(GThread *, num_threads);
+	for (started = 0; started + 1 < num_threads; started++) {
+		threads[started] = g_thread_try_new("sr-trigger-search",
+			search_thread, s, NULL);
+		if (!threads[started])
+			break;
+	}
+	search_thread(s);
+	for (i = 0; i < started; i++)
+		g_thread_join(threads[i]);
+	g_free(threads);
+
+	ret = s->ret;
+	all = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	for (i = 0; i < (unsigned int)s->num_chunks; i++) {
+		/* Occurrences of neighbouring chunks may end on one sample. */
+		for (j = 0; ret == SR_OK && j < s->results[i]->len; j++) {
+			offset = g_array_index(s->results[i], uint64_t, j);
+			if (!all->len || g_array_index(all, uint64_t,
+					all->len - 1) != offset)
+				g_array_append_val(all, offset);
+		}
+		g_array_free(s->results[i], TRUE);
+	}
+	g_free(s->results);
+
+	if (ret != SR_OK) {
+		g_array_free(all, TRUE);
+		return ret;
+	}
+	*offsets = all;
+
+	return SR_OK;
+}
+
+static int search(const struct sr_trigger *trigger, struct trigger_search *s,
+		unsigned int num_threads, GArray **offsets)
+{
+	struct soft_trigger_logic *stl;
+	int ret;
+
+	stl = soft_trigger_logic_search_new(trigger, s->unitsize);
+	if (!stl) {
+		sr_err("Trigger has a stage without matches.");
+		return SR_ERR_ARG;
+	}
+	s->stl = stl;
+	s->span = soft_trigger_logic_span(stl);
+
+	ret = search_run(s, num_threads, offsets);
+	soft_trigger_logic_free(stl);
+
+	return ret;
+}
+
+/**
+ * Find all occurrences of a trigger in logic data.
+ *
+ * The first stage of the trigger may start to match on any sample. From
+ * each such start, every later stage takes the earliest run of samples
+ * matching it within its window, the same as a software trigger during
+ * an acquisition does. Unlike there, occurrences may overlap: a stage
+ * matching on a sample doesn't keep other occurrences from using it.
+ * The first sample has no previous one, so edges can't match on it.
+ *
+ * @param trigger The trigger, on the logic channels of the data. Must
+ *                not be NULL.
+ * @param data The logic samples. Must not be NULL.
+ * @param length Size of the data in bytes.
+ * @param unitsize Size of each sample in bytes. Must be > 0.
+ * @param num_threads Number of threads to search with, 0 for one per
+ *                    processor.
+ * @param offsets Newly allocated array of uint64_t, the samples on which
+ *                an occurrence completed in ascending order, each once.
+ *                Free it with g_array_free(). Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_trigger_search(const struct sr_trigger *trigger,
+		const void *data, uint64_t length, unsigned int unitsize,
+		unsigned int num_threads, GArray **offsets)
+{
+	struct trigger_search s = { 0 };
+
+	if (!trigger || !data || !unitsize || unitsize > G_MAXINT || !offsets)
+		return SR_ERR_ARG;
+
+	s.data = data;
+	s.unitsize = unitsize;
+	s.num_samples = length / unitsize;
+
+	return search(trigger, &s, num_threads, offsets);
+}
+
+/**
+ * Find all occurrences of a trigger in the logic samples of a session.
+ *
+ * Searches the samples the session store kept for a device, see
+ * sr_session_store_set(). To search a session file, load it with
+ * sr_session_load(), enable the store and run the session, then search
+ * with a trigger on the channels of its device. Otherwise the same as
+ * sr_trigger_search().
+ *
+ * @param session The session to use. Must not be NULL.
+ * @param sdi The device whose samples to search. Must not be NULL.
+ * @param trigger The trigger. Must not be NULL.
+ * @param num_threads Number of threads to search with, 0 for one per
+ *                    processor.
+ * @param offsets Newly allocated array of uint64_t, as with
+ *                sr_trigger_search(). Must not be NULL.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or no samples stored.
+ * @retval SR_ERR_NA The store is not enabled.
+ * @retval SR_ERR_MALLOC Memory allocation error.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_trigger_search_session(struct sr_session *session,
+		const struct sr_dev_inst *sdi, const struct sr_trigger *trigger,
+		unsigned int num_threads, GArray **offsets)
+{
+	struct trigger_search s = { 0 };
+	uint16_t unitsize;
+	int ret;
+
+	if (!session || !sdi || !trigger || !offsets)
+		return SR_ERR_ARG;
+
+	ret = sr_session_store_logic_info(session, sdi, &s.num_samples,
+		&unitsize);
+	if (ret != SR_OK)
+		return ret;
+	if (!unitsize)
+		return SR_ERR_ARG;
+
+	s.session = session;
+	s.sdi = sdi;
+	s.unitsize = unitsize;
+
+	return search(trigger, &s, num_threads, offsets);
+}
+
+/** @} */
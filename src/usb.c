@@ -19,11 +19,24 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef __linux__
+/* For pthread_setaffinity_np(). */
+#define _GNU_SOURCE
+#endif
+
 #include <config.h>
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <string.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <libusb.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include <libsigrok/libsigrok.h>
 #include "libsigrok-internal.h"
 
@@ -37,6 +50,81 @@
 typedef int libusb_os_handle;
 #endif
 
+/* libusb_dev_mem_alloc() appeared in libusb 1.0.21. */
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+#define HAVE_LIBUSB_DEV_MEM 1
+#else
+#define HAVE_LIBUSB_DEV_MEM 0
+#endif
+
+/* Longest time between two event thread hook calls, in ms. */
+#define USB_EVENT_THREAD_TIMEOUT 100
+
+struct usb_event_hook {
+	sr_usb_event_hook cb;
+	void *cb_data;
+	int interval;
+};
+
+/*
+ * A thread dedicated to libusb event handling. While it runs all
+ * transfers of the libusb context complete on it, rather than from
+ * the session main loop.
+ */
+struct usb_event_thread {
+	GThread *thread;
+	GMutex mutex;
+	/* Protected by the mutex. */
+	GSList *hooks;
+	gboolean running;
+	gboolean quit;
+};
+
+/*
+ * Capture files hold what a device sent: the completed bulk and
+ * interrupt transfers and the data of IN control transfers, with the
+ * time since the first transfer. All numbers are little endian.
+ *
+ * File header: "SRUSBCAP", u16 version, u16 VID, u16 PID, u8 speed,
+ * u8 reserved. Record: u64 time in us, u8 kind, u8 endpoint (transfers)
+ * or request (control), u8 transfer status, u8 reserved, u16 value,
+ * u16 index, u32 length, then the data.
+ */
+#define CAPTURE_MAGIC		"SRUSBCAP"
+#define CAPTURE_VERSION		1
+#define CAPTURE_HEADER_SIZE	16
+#define CAPTURE_RECORD_SIZE	20
+
+enum {
+	CAPTURE_TRANSFER,
+	CAPTURE_CONTROL_IN,
+};
+
+/* Recording to or replaying from a capture file. */
+struct usb_capture {
+	GMutex mutex;
+	GCond cond;
+	/* Recording. */
+	FILE *file;
+	gboolean header_done;
+	/* Replay. */
+	GMappedFile *mapped;
+	const uint8_t *data;
+	size_t len;
+	size_t transfer_pos;
+	size_t control_pos;
+	uint16_t vid, pid;
+	int speed;
+	gboolean max_speed;
+	gboolean loop;
+	int64_t loop_us;
+	/* Submitted and cancelled transfers, waiting for their callback. */
+	GQueue pending;
+	GQueue cancelled;
+	/* Time of the first transfer. */
+	int64_t start_us;
+};
+
 /** Custom GLib event source for libusb I/O.
  */
 struct usb_source {
@@ -121,9 +209,11 @@ static gboolean usb_source_dispatch(GSource *source,
 	unsigned int revents;
 	unsigned int i;
 	gboolean keep;
+	int64_t start_us, ready_us;
 
 	usource = (struct usb_source *)source;
 	revents = 0;
+	start_us = 0;
 	/*
 	 * This is somewhat arbitrary, but drivers use revents to distinguish
 	 * actual I/O from timeouts. When we remove the user timeout from the
@@ -138,7 +228,15 @@ static gboolean usb_source_dispatch(GSource *source,
 		sr_err("Callback not set, cannot dispatch event.");
 		return G_SOURCE_REMOVE;
 	}
+	if (usource->session->stats)
+		start_us = g_get_monotonic_time();
 	keep = (*SR_RECEIVE_DATA_CALLBACK(callback))(-1, revents, user_data);
+	if (usource->session->stats) {
+		/* Ready after the poll, or when the timeout expired. */
+		ready_us = revents ? g_source_get_time(source) : usource->due_us;
+		sr_session_stats_source(usource->session, start_us - ready_us,
+			g_get_monotonic_time() - start_us);
+	}
 
 	if (G_LIKELY(keep) && G_LIKELY(!g_source_is_destroyed(source))) {
 		if (usource->timeout_us >= 0)
@@ -379,6 +477,240 @@ SR_PRIV int sr_usb_split_conn(const char *conn,
 	return valid ? SR_OK : SR_ERR_ARG;
 }
 
+/*
+ * The list of USB devices, kept while drivers scan. Every driver looks
+ * at the whole bus, most of them for several models, which would have
+ * libusb enumerate it over and over. Hotplug events, where libusb has
+ * them, mark the list stale, so that it is read again next time.
+ */
+struct usb_cache {
+	libusb_context *usb_ctx;
+	GMutex mutex;
+	int holds;
+	gint stale;
+	libusb_device **devlist;
+	ssize_t num;
+	gboolean hotplug;
+	libusb_hotplug_callback_handle hotplug_handle;
+};
+
+static GMutex usb_caches_mutex;
+static GSList *usb_caches;
+static int usb_caches_held;
+/* Manufacturer and product strings by "bus.address:vid:pid". */
+static GHashTable *usb_strings;
+
+static struct usb_cache *usb_cache_find(libusb_context *usb_ctx)
+{
+	struct usb_cache *cache;
+	GSList *l;
+
+	cache = NULL;
+	g_mutex_lock(&usb_caches_mutex);
+	for (l = usb_caches; l; l = l->next) {
+		if (((struct usb_cache *)l->data)->usb_ctx == usb_ctx) {
+			cache = l->data;
+			break;
+		}
+	}
+	g_mutex_unlock(&usb_caches_mutex);
+
+	return cache;
+}
+
+static int LIBUSB_CALL usb_cache_hotplug(libusb_context *usb_ctx,
+		libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+	struct usb_cache *cache;
+
+	(void)usb_ctx;
+	(void)dev;
+	(void)event;
+
+	cache = user_data;
+	g_atomic_int_set(&cache->stale, 1);
+
+	return 0;
+}
+
+static void usb_cache_drop(struct usb_cache *cache)
+{
+	if (cache->devlist)
+		libusb_free_device_list(cache->devlist, 1);
+	cache->devlist = NULL;
+	cache->num = 0;
+}
+
+/**
+ * Set up the USB device cache of a context.
+ *
+ * @param ctx The libsigrok context, with libusb initialized.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_cache_init(struct sr_context *ctx)
+{
+	struct usb_cache *cache;
+	int ret;
+
+	cache = g_malloc0(sizeof(*cache));
+	cache->usb_ctx = ctx->libusb_ctx;
+	g_mutex_init(&cache->mutex);
+	if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		ret = libusb_hotplug_register_callback(ctx->libusb_ctx,
+			LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+			LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 0,
+			LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+			LIBUSB_HOTPLUG_MATCH_ANY, usb_cache_hotplug, cache,
+			&cache->hotplug_handle);
+		cache->hotplug = ret == LIBUSB_SUCCESS;
+	}
+
+	g_mutex_lock(&usb_caches_mutex);
+	usb_caches = g_slist_prepend(usb_caches, cache);
+	g_mutex_unlock(&usb_caches_mutex);
+}
+
+/**
+ * Free the USB device cache of a context.
+ *
+ * @param ctx The libsigrok context, before libusb gets shut down.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_cache_exit(struct sr_context *ctx)
+{
+	struct usb_cache *cache;
+
+	if (!(cache = usb_cache_find(ctx->libusb_ctx)))
+		return;
+
+	g_mutex_lock(&usb_caches_mutex);
+	usb_caches = g_slist_remove(usb_caches, cache);
+	g_mutex_unlock(&usb_caches_mutex);
+
+	if (cache->hotplug)
+		libusb_hotplug_deregister_callback(ctx->libusb_ctx,
+			cache->hotplug_handle);
+	usb_cache_drop(cache);
+	g_mutex_clear(&cache->mutex);
+	g_free(cache);
+}
+
+/**
+ * Keep the list of USB devices, until sr_usb_cache_release().
+ *
+ * Called around scans. In between, sr_usb_get_device_list() hands out
+ * the same list, unless a device was plugged in or out.
+ *
+ * @param ctx The libsigrok context.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_cache_hold(struct sr_context *ctx)
+{
+	struct usb_cache *cache;
+
+	if (!(cache = usb_cache_find(ctx->libusb_ctx)))
+		return;
+
+	g_mutex_lock(&cache->mutex);
+	cache->holds++;
+	g_mutex_unlock(&cache->mutex);
+
+	g_mutex_lock(&usb_caches_mutex);
+	if (!usb_caches_held++)
+		usb_strings = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, g_free);
+	g_mutex_unlock(&usb_caches_mutex);
+}
+
+/**
+ * Let go of the list of USB devices kept by sr_usb_cache_hold().
+ *
+ * @param ctx The libsigrok context.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_cache_release(struct sr_context *ctx)
+{
+	struct usb_cache *cache;
+
+	if (!(cache = usb_cache_find(ctx->libusb_ctx)))
+		return;
+
+	g_mutex_lock(&cache->mutex);
+	if (cache->holds && !--cache->holds)
+		usb_cache_drop(cache);
+	g_mutex_unlock(&cache->mutex);
+
+	g_mutex_lock(&usb_caches_mutex);
+	if (usb_caches_held && !--usb_caches_held) {
+		g_hash_table_destroy(usb_strings);
+		usb_strings = NULL;
+	}
+	g_mutex_unlock(&usb_caches_mutex);
+}
+
+/**
+ * Get the list of USB devices, like libusb_get_device_list().
+ *
+ * During scans, this is the list read at the first call, as long as no
+ * device comes or goes. The caller frees it with libusb_free_device_list()
+ * as usual.
+ *
+ * @param usb_ctx The libusb context.
+ * @param[out] list The list of devices, NULL terminated.
+ *
+ * @return The number of devices, or a negative libusb error code.
+ *
+ * @private
+ */
+SR_PRIV ssize_t sr_usb_get_device_list(libusb_context *usb_ctx,
+		libusb_device ***list)
+{
+	struct usb_cache *cache;
+	libusb_device **copy;
+	ssize_t i, num;
+
+	cache = usb_cache_find(usb_ctx);
+	if (!cache)
+		return libusb_get_device_list(usb_ctx, list);
+
+	g_mutex_lock(&cache->mutex);
+	if (!cache->holds) {
+		g_mutex_unlock(&cache->mutex);
+		return libusb_get_device_list(usb_ctx, list);
+	}
+	if (!cache->devlist || g_atomic_int_get(&cache->stale)) {
+		usb_cache_drop(cache);
+		g_atomic_int_set(&cache->stale, 0);
+		num = libusb_get_device_list(usb_ctx, &cache->devlist);
+		if (num < 0) {
+			cache->devlist = NULL;
+			g_mutex_unlock(&cache->mutex);
+			return num;
+		}
+		cache->num = num;
+		sr_spew("Read the list of %zd USB devices.", num);
+	}
+
+	/* libusb_free_device_list() frees the array with free(). */
+	num = cache->num;
+	copy = calloc(num + 1, sizeof(*copy));
+	if (!copy) {
+		g_mutex_unlock(&cache->mutex);
+		return LIBUSB_ERROR_NO_MEM;
+	}
+	for (i = 0; i < num; i++)
+		copy[i] = libusb_ref_device(cache->devlist[i]);
+	g_mutex_unlock(&cache->mutex);
+
+	*list = copy;
+
+	return num;
+}
+
 /**
  * Find USB devices according to a connection string.
  *
@@ -412,7 +744,8 @@ SR_PRIV GSList *sr_usb_find(libusb_context *usb_ctx, const char *conn)
 
 	/* Looks like a valid USB device specification, but is it connected? */
 	devices = NULL;
-	libusb_get_device_list(usb_ctx, &devlist);
+	if (sr_usb_get_device_list(usb_ctx, &devlist) < 0)
+		return NULL;
 	for (i = 0; devlist[i]; i++) {
 		if ((ret = libusb_get_device_descriptor(devlist[i], &des))) {
 			sr_err("Failed to get device descriptor: %s.",
@@ -488,11 +821,549 @@ SR_PRIV int sr_usb_open(libusb_context *usb_ctx, struct sr_usb_dev_inst *usb)
 
 SR_PRIV void sr_usb_close(struct sr_usb_dev_inst *usb)
 {
+	if (usb->dev_mem && g_hash_table_size(usb->dev_mem))
+		sr_warn("Closing USB device with %u transfer buffers in use.",
+			g_hash_table_size(usb->dev_mem));
 	libusb_close(usb->devhdl);
 	usb->devhdl = NULL;
 	sr_dbg("Closed USB device %d.%d.", usb->bus, usb->address);
 }
 
+/**
+ * Allocate a buffer for bulk transfers on the given device.
+ *
+ * Where the platform supports it (usbfs on Linux), the memory is mapped
+ * from the kernel so that transfers don't need to be copied between
+ * user space and kernel buffers. Otherwise heap memory is returned.
+ *
+ * The buffer must be released with sr_usb_buffer_free(), while the
+ * device is still open, and must not be used with
+ * LIBUSB_TRANSFER_FREE_BUFFER.
+ *
+ * @param usb The USB device instance, must be open.
+ * @param len The size of the buffer in bytes.
+ *
+ * @return The buffer, or NULL when out of memory.
+ *
+ * @private
+ */
+SR_PRIV uint8_t *sr_usb_buffer_alloc(struct sr_usb_dev_inst *usb, size_t len)
+{
+	uint8_t *buf;
+
+	if (!usb || !len)
+		return NULL;
+
+#if HAVE_LIBUSB_DEV_MEM
+	if (usb->devhdl) {
+		buf = libusb_dev_mem_alloc(usb->devhdl, len);
+		if (buf) {
+			if (!usb->dev_mem)
+				usb->dev_mem = g_hash_table_new(NULL, NULL);
+			g_hash_table_add(usb->dev_mem, buf);
+			return buf;
+		}
+		sr_spew("No device memory for %zu bytes, using the heap.", len);
+	}
+#endif
+
+	buf = g_try_malloc(len);
+
+	return buf;
+}
+
+/**
+ * Release a buffer obtained from sr_usb_buffer_alloc().
+ *
+ * @param usb The USB device instance the buffer was allocated for.
+ * @param buf The buffer, NULL is ignored.
+ * @param len The size that was passed to sr_usb_buffer_alloc().
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_buffer_free(struct sr_usb_dev_inst *usb,
+		uint8_t *buf, size_t len)
+{
+	if (!buf)
+		return;
+
+#if HAVE_LIBUSB_DEV_MEM
+	if (usb && usb->dev_mem && g_hash_table_remove(usb->dev_mem, buf)) {
+		libusb_dev_mem_free(usb->devhdl, buf, len);
+		return;
+	}
+#else
+	(void)usb;
+	(void)len;
+#endif
+
+	g_free(buf);
+}
+
+/* Write the file header, once the device is known. */
+static void capture_header(struct usb_capture *c,
+		libusb_device_handle *devhdl)
+{
+	struct libusb_device_descriptor des;
+	libusb_device *dev;
+	uint8_t buf[CAPTURE_HEADER_SIZE];
+
+	memset(buf, 0, sizeof(buf));
+	memcpy(buf, CAPTURE_MAGIC, 8);
+	WL16(&buf[8], CAPTURE_VERSION);
+	if (devhdl && (dev = libusb_get_device(devhdl))
+			&& libusb_get_device_descriptor(dev, &des) == 0) {
+		WL16(&buf[10], des.idVendor);
+		WL16(&buf[12], des.idProduct);
+		buf[14] = libusb_get_device_speed(dev);
+	}
+	fwrite(buf, 1, sizeof(buf), c->file);
+	c->header_done = TRUE;
+}
+
+/* Append a record, with the capture mutex held. */
+static void capture_write(struct usb_capture *c, libusb_device_handle *devhdl,
+		int kind, uint8_t id, uint8_t status, uint16_t value,
+		uint16_t index, const uint8_t *data, uint32_t len)
+{
+	uint8_t buf[CAPTURE_RECORD_SIZE];
+	int64_t now;
+
+	if (!c->header_done)
+		capture_header(c, devhdl);
+	now = g_get_monotonic_time();
+	if (!c->start_us)
+		c->start_us = now;
+
+	WL64(&buf[0], now - c->start_us);
+	buf[8] = kind;
+	buf[9] = id;
+	buf[10] = status;
+	buf[11] = 0;
+	WL16(&buf[12], value);
+	WL16(&buf[14], index);
+	WL32(&buf[16], len);
+	if (fwrite(buf, 1, sizeof(buf), c->file) != sizeof(buf)
+			|| fwrite(data, 1, len, c->file) != len)
+		sr_warn("Failed to write the USB capture file.");
+}
+
+/*
+ * The callbacks of recorded transfers in flight, by transfer. Transfer
+ * callbacks only get the transfer, so this can't be per context.
+ */
+struct capture_transfer {
+	struct usb_capture *capture;
+	libusb_transfer_cb_fn cb;
+};
+static GMutex capture_transfers_mutex;
+static GHashTable *capture_transfers;
+
+static void LIBUSB_CALL capture_record_cb(struct libusb_transfer *transfer)
+{
+	struct capture_transfer *ct;
+	struct usb_capture *c;
+
+	g_mutex_lock(&capture_transfers_mutex);
+	ct = g_hash_table_lookup(capture_transfers, transfer);
+	g_hash_table_steal(capture_transfers, transfer);
+	g_mutex_unlock(&capture_transfers_mutex);
+	if (!ct)
+		return;
+
+	c = ct->capture;
+	transfer->callback = ct->cb;
+	g_free(ct);
+
+	if (transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+		g_mutex_lock(&c->mutex);
+		capture_write(c, transfer->dev_handle, CAPTURE_TRANSFER,
+			transfer->endpoint, transfer->status, 0, 0,
+			transfer->buffer, MAX(transfer->actual_length, 0));
+		g_mutex_unlock(&c->mutex);
+	}
+	transfer->callback(transfer);
+}
+
+/*
+ * Find the next record of a kind at or after pos, matching id, value
+ * and index for control transfers. Returns its offset, or the length
+ * of the capture when there is none.
+ */
+static size_t capture_find(const struct usb_capture *c, size_t pos, int kind,
+		uint8_t id, uint16_t value, uint16_t index)
+{
+	const uint8_t *rec;
+
+	while (pos + CAPTURE_RECORD_SIZE <= c->len) {
+		rec = c->data + pos;
+		if (rec[8] == kind && rec[9] == id && (kind == CAPTURE_TRANSFER
+				|| (RL16(&rec[12]) == value
+				&& RL16(&rec[14]) == index)))
+			return pos;
+		pos += CAPTURE_RECORD_SIZE + RL32(&rec[16]);
+	}
+
+	return c->len;
+}
+
+/* Complete a replayed transfer, with the capture mutex held. */
+static void capture_complete(struct usb_capture *c,
+		struct libusb_transfer *transfer, const uint8_t *rec)
+{
+	uint32_t len;
+
+	if (rec) {
+		len = MIN(RL32(&rec[16]), (uint32_t)transfer->length);
+		memcpy(transfer->buffer, rec + CAPTURE_RECORD_SIZE, len);
+		transfer->actual_length = len;
+		transfer->status = rec[10];
+	} else {
+		transfer->actual_length = 0;
+		transfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+	}
+
+	/* The callback may submit again. */
+	g_mutex_unlock(&c->mutex);
+	transfer->callback(transfer);
+	g_mutex_lock(&c->mutex);
+}
+
+/*
+ * Run the callbacks of replayed transfers which are due, waiting up to
+ * timeout_ms for the first one. Stands in for libusb event handling,
+ * so it runs wherever libsigrok handles libusb events.
+ *
+ * Transfers on an endpoint get the records of that endpoint in order,
+ * at their original time after the first transfer or right away. At
+ * the end of the capture they fail with LIBUSB_TRANSFER_NO_DEVICE, as
+ * if the device was gone, unless the capture loops.
+ */
+static void capture_replay(struct usb_capture *c, int timeout_ms)
+{
+	struct libusb_transfer *transfer;
+	const uint8_t *last;
+	int64_t now, due, deadline;
+	size_t pos;
+	unsigned int num, done;
+
+	g_mutex_lock(&c->mutex);
+	deadline = g_get_monotonic_time() + timeout_ms * (int64_t)1000;
+	/* No more than what is there now, resubmitted ones wait. */
+	num = g_queue_get_length(&c->pending);
+	done = 0;
+	for (;;) {
+		while ((transfer = g_queue_pop_head(&c->cancelled))) {
+			g_mutex_unlock(&c->mutex);
+			transfer->actual_length = 0;
+			transfer->status = LIBUSB_TRANSFER_CANCELLED;
+			transfer->callback(transfer);
+			g_mutex_lock(&c->mutex);
+		}
+		now = g_get_monotonic_time();
+		if (!(transfer = g_queue_peek_head(&c->pending))) {
+			if (done || now >= deadline)
+				break;
+			g_cond_wait_until(&c->cond, &c->mutex, deadline);
+			continue;
+		}
+		if (!num)
+			num = g_queue_get_length(&c->pending);
+		if (done == num)
+			break;
+
+		pos = capture_find(c, c->transfer_pos, CAPTURE_TRANSFER,
+			transfer->endpoint, 0, 0);
+		if (pos == c->len && c->loop
+				&& c->transfer_pos > CAPTURE_HEADER_SIZE) {
+			/* Start over, later by the length of the capture. */
+			last = c->data + CAPTURE_HEADER_SIZE;
+			for (pos = CAPTURE_HEADER_SIZE; pos < c->len;
+					pos += CAPTURE_RECORD_SIZE + RL32(&c->data[pos + 16]))
+				last = c->data + pos;
+			c->loop_us += RL64(last) + 1;
+			pos = capture_find(c, CAPTURE_HEADER_SIZE,
+				CAPTURE_TRANSFER, transfer->endpoint, 0, 0);
+		}
+		if (pos < c->len && !c->max_speed) {
+			due = c->start_us + c->loop_us + RL64(&c->data[pos]);
+			if (due > now) {
+				if (due > deadline) {
+					g_cond_wait_until(&c->cond, &c->mutex, deadline);
+					break;
+				}
+				g_cond_wait_until(&c->cond, &c->mutex, due);
+				continue;
+			}
+		}
+
+		g_queue_pop_head(&c->pending);
+		done++;
+		if (pos < c->len) {
+			c->transfer_pos = pos + CAPTURE_RECORD_SIZE
+				+ RL32(&c->data[pos + 16]);
+			capture_complete(c, transfer, c->data + pos);
+		} else {
+			capture_complete(c, transfer, NULL);
+		}
+	}
+	g_mutex_unlock(&c->mutex);
+}
+
+/* Optional scheduling tweaks, from SIGROK_USB_THREAD_PRIORITY/_CPU. */
+static void usb_event_thread_sched(void)
+{
+#ifdef __linux__
+	const char *env;
+	struct sched_param param;
+	cpu_set_t cpus;
+	int prio, cpu, ret;
+
+	if ((env = g_getenv("SIGROK_USB_THREAD_PRIORITY"))) {
+		prio = atoi(env);
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = prio;
+		ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (ret)
+			sr_warn("Cannot use realtime priority %d: %s.",
+				prio, g_strerror(ret));
+		else
+			sr_dbg("USB event thread at realtime priority %d.", prio);
+	}
+	if ((env = g_getenv("SIGROK_USB_THREAD_CPU"))) {
+		cpu = atoi(env);
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (ret)
+			sr_warn("Cannot bind USB event thread to CPU %d: %s.",
+				cpu, g_strerror(ret));
+		else
+			sr_dbg("USB event thread bound to CPU %d.", cpu);
+	}
+#endif
+}
+
+static gpointer usb_event_thread(gpointer data)
+{
+	struct sr_context *ctx;
+	struct usb_event_thread *t;
+	struct usb_event_hook *hook;
+	struct timeval tv;
+	GSList *l, *hooks;
+	int interval;
+	gboolean done;
+
+	ctx = data;
+	t = ctx->usb_thread;
+
+	usb_event_thread_sched();
+
+	for (;;) {
+		g_mutex_lock(&t->mutex);
+		interval = USB_EVENT_THREAD_TIMEOUT;
+		for (l = t->hooks; l; l = l->next)
+			interval = MIN(interval, ((struct usb_event_hook *)l->data)->interval);
+		hooks = t->quit ? NULL : g_slist_copy(t->hooks);
+		g_mutex_unlock(&t->mutex);
+
+		/*
+		 * Hooks run with the event lock held, like the transfer
+		 * callbacks, so the two never run concurrently.
+		 */
+		tv.tv_sec = interval / 1000;
+		tv.tv_usec = (interval % 1000) * 1000;
+		libusb_lock_events(ctx->libusb_ctx);
+		if (hooks && ctx->usb_capture && ctx->usb_capture->mapped)
+			capture_replay(ctx->usb_capture, interval);
+		else if (hooks && libusb_event_handling_ok(ctx->libusb_ctx))
+			libusb_handle_events_locked(ctx->libusb_ctx, &tv);
+		for (l = hooks; l; l = l->next) {
+			hook = l->data;
+			if (hook->cb(hook->cb_data))
+				continue;
+			g_mutex_lock(&t->mutex);
+			t->hooks = g_slist_remove(t->hooks, hook);
+			g_mutex_unlock(&t->mutex);
+			g_free(hook);
+		}
+		libusb_unlock_events(ctx->libusb_ctx);
+		g_slist_free(hooks);
+
+		g_mutex_lock(&t->mutex);
+		done = t->quit || !t->hooks;
+		if (done)
+			t->running = FALSE;
+		g_mutex_unlock(&t->mutex);
+		if (done)
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * Have a hook serviced from the USB event thread.
+ *
+ * Starts the thread if needed. Transfer callbacks then run on that
+ * thread, as does the hook after every round of event handling. The
+ * hook stays registered until it returns FALSE. Drivers that want the
+ * thread but keep an acquisition going also need an event source on
+ * the session, because the session stops once it has none left.
+ *
+ * Packets sent from the thread go through the transforms and usually
+ * the datafeed callbacks right there, serialized with the session's
+ * other senders by sr_session_send(). Frontends see callbacks from it.
+ *
+ * The thread is opt-in: it is only used with SIGROK_USB_THREAD set to
+ * something other than 0 in the environment. Otherwise the caller
+ * polls from the main loop as before.
+ * SIGROK_USB_THREAD_PRIORITY=<n> runs it at SCHED_FIFO priority n,
+ * SIGROK_USB_THREAD_CPU=<n> binds it to CPU n (Linux only).
+ *
+ * @param ctx The libsigrok context.
+ * @param interval Longest time between two hook calls, in ms.
+ * @param cb The hook.
+ * @param cb_data Passed to the hook.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_NA The thread is not enabled, poll from the main loop.
+ * @retval SR_ERR Cannot start the thread.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_event_thread_add(struct sr_context *ctx, int interval,
+		sr_usb_event_hook cb, void *cb_data)
+{
+	struct usb_event_thread *t;
+	struct usb_event_hook *hook;
+	const char *env;
+
+	env = g_getenv("SIGROK_USB_THREAD");
+	if (!env || !*env || !strcmp(env, "0"))
+		return SR_ERR_NA;
+
+	if (!ctx->usb_thread) {
+		t = g_malloc0(sizeof(*t));
+		g_mutex_init(&t->mutex);
+		ctx->usb_thread = t;
+	}
+	t = ctx->usb_thread;
+
+	hook = g_malloc0(sizeof(*hook));
+	hook->cb = cb;
+	hook->cb_data = cb_data;
+	hook->interval = MAX(1, interval);
+
+	g_mutex_lock(&t->mutex);
+	if (!t->running && t->thread) {
+		/* Left on its own when the previous hooks were done. */
+		g_thread_join(t->thread);
+		t->thread = NULL;
+	}
+	t->hooks = g_slist_append(t->hooks, hook);
+	if (!t->running) {
+		t->quit = FALSE;
+		t->running = TRUE;
+		t->thread = g_thread_try_new("sr-usb-events",
+			usb_event_thread, ctx, NULL);
+		if (!t->thread) {
+			t->running = FALSE;
+			t->hooks = g_slist_remove(t->hooks, hook);
+			g_mutex_unlock(&t->mutex);
+			g_free(hook);
+			sr_err("Cannot start USB event thread.");
+			return SR_ERR;
+		}
+	}
+	g_mutex_unlock(&t->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Whether the caller is the USB event thread.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_usb_event_thread_current(struct sr_context *ctx)
+{
+	struct usb_event_thread *t;
+	gboolean ret;
+
+	t = ctx->usb_thread;
+	if (!t)
+		return FALSE;
+
+	g_mutex_lock(&t->mutex);
+	ret = t->running && t->thread == g_thread_self();
+	g_mutex_unlock(&t->mutex);
+
+	return ret;
+}
+
+/**
+ * Handle the libusb events that are pending, without waiting.
+ *
+ * Works from the main loop as well as from USB event thread hooks,
+ * which already hold the event lock.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_handle_pending(struct sr_context *ctx)
+{
+	struct timeval tv = { 0, 0 };
+
+	if (ctx->usb_capture && ctx->usb_capture->mapped)
+		capture_replay(ctx->usb_capture, 0);
+	else if (sr_usb_event_thread_current(ctx))
+		libusb_handle_events_locked(ctx->libusb_ctx, &tv);
+	else
+		libusb_handle_events_timeout_completed(ctx->libusb_ctx, &tv, NULL);
+}
+
+/**
+ * Have the USB event thread run its hooks now, rather than after its
+ * current round of event handling. Without libusb 1.0.21, the hooks
+ * run within the interval they asked for, as always.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_event_thread_wake(struct sr_context *ctx)
+{
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+	if (ctx->usb_thread)
+		libusb_interrupt_event_handler(ctx->libusb_ctx);
+#else
+	(void)ctx;
+#endif
+}
+
+/**
+ * Stop the USB event thread, dropping any hooks that are left.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_event_thread_stop(struct sr_context *ctx)
+{
+	struct usb_event_thread *t;
+
+	t = ctx->usb_thread;
+	if (!t)
+		return;
+
+	g_mutex_lock(&t->mutex);
+	t->quit = TRUE;
+	g_mutex_unlock(&t->mutex);
+	if (t->thread)
+		g_thread_join(t->thread);
+
+	g_slist_free_full(t->hooks, g_free);
+	g_mutex_clear(&t->mutex);
+	g_free(t);
+	ctx->usb_thread = NULL;
+}
+
 SR_PRIV int usb_source_add(struct sr_session *session, struct sr_context *ctx,
 		int timeout, sr_receive_data_callback cb, void *cb_data)
 {
@@ -567,34 +1438,458 @@ SR_PRIV gboolean usb_match_manuf_prod(libusb_device *dev,
 {
 	struct libusb_device_descriptor des;
 	struct libusb_device_handle *hdl;
+	unsigned char manuf[64], prod[64];
+	gpointer value;
+	gboolean found;
+	char *key, *strings, *expected;
 	gboolean ret;
-	unsigned char strdesc[64];
 
-	hdl = NULL;
-	ret = FALSE;
-	while (!ret) {
+	libusb_get_device_descriptor(dev, &des);
+	key = g_strdup_printf("%d.%d:%04x:%04x", libusb_get_bus_number(dev),
+		libusb_get_device_address(dev), des.idVendor, des.idProduct);
+
+	/* During scans, each device is only opened once. */
+	g_mutex_lock(&usb_caches_mutex);
+	found = usb_strings && g_hash_table_lookup_extended(usb_strings,
+		key, NULL, &value);
+	strings = found ? g_strdup(value) : NULL;
+	g_mutex_unlock(&usb_caches_mutex);
+
+	if (!found) {
 		/* Assume the FW has not been loaded, unless proven wrong. */
-		libusb_get_device_descriptor(dev, &des);
+		hdl = NULL;
+		if (libusb_open(dev, &hdl) == 0 &&
+				libusb_get_string_descriptor_ascii(hdl,
+					des.iManufacturer, manuf, sizeof(manuf)) >= 0 &&
+				libusb_get_string_descriptor_ascii(hdl,
+					des.iProduct, prod, sizeof(prod)) >= 0)
+			strings = g_strdup_printf("%s\n%s", manuf, prod);
+		if (hdl)
+			libusb_close(hdl);
+
+		g_mutex_lock(&usb_caches_mutex);
+		if (usb_strings)
+			g_hash_table_insert(usb_strings, g_strdup(key),
+				g_strdup(strings));
+		g_mutex_unlock(&usb_caches_mutex);
+	}
+	g_free(key);
 
-		if (libusb_open(dev, &hdl) != 0)
-			break;
+	expected = g_strdup_printf("%s\n%s", manufacturer, product);
+	ret = strings && !strcmp(strings, expected);
+	g_free(expected);
+	g_free(strings);
 
-		if (libusb_get_string_descriptor_ascii(hdl,
-				des.iManufacturer, strdesc, sizeof(strdesc)) < 0)
-			break;
-		if (strcmp((const char *)strdesc, manufacturer))
-			break;
+	return ret;
+}
 
-		if (libusb_get_string_descriptor_ascii(hdl,
-				des.iProduct, strdesc, sizeof(strdesc)) < 0)
-			break;
-		if (strcmp((const char *)strdesc, product))
-			break;
+/**
+ * Set up recording or replay of USB captures, from the environment.
+ *
+ * SIGROK_USB_RECORD=<file> records what devices send to a capture file.
+ * SIGROK_USB_REPLAY=<file> replays a capture file instead of talking to
+ * the device, for drivers which support that. The replay keeps the
+ * original timing, unless SIGROK_USB_REPLAY_SPEED=max is set as well.
+ * SIGROK_USB_REPLAY_LOOP=1 starts the capture over at its end.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_capture_init(struct sr_context *ctx)
+{
+	struct usb_capture *c;
+	const char *record, *replay, *env;
+	GMappedFile *mapped;
+	GError *error;
+	const uint8_t *data;
+	size_t len;
+
+	record = g_getenv("SIGROK_USB_RECORD");
+	replay = g_getenv("SIGROK_USB_REPLAY");
+	if (!record && !replay)
+		return;
 
-		ret = TRUE;
+	c = g_malloc0(sizeof(*c));
+	g_mutex_init(&c->mutex);
+	g_cond_init(&c->cond);
+	g_queue_init(&c->pending);
+	g_queue_init(&c->cancelled);
+
+	if (replay) {
+		error = NULL;
+		if (!(mapped = g_mapped_file_new(replay, FALSE, &error))) {
+			sr_err("Cannot open USB capture: %s.", error->message);
+			g_error_free(error);
+			goto fail;
+		}
+		data = (const uint8_t *)g_mapped_file_get_contents(mapped);
+		len = g_mapped_file_get_length(mapped);
+		if (len < CAPTURE_HEADER_SIZE || memcmp(data, CAPTURE_MAGIC, 8)
+				|| RL16(&data[8]) != CAPTURE_VERSION) {
+			sr_err("'%s' is not a USB capture.", replay);
+			g_mapped_file_unref(mapped);
+			goto fail;
+		}
+		c->mapped = mapped;
+		c->data = data;
+		c->len = len;
+		c->vid = RL16(&data[10]);
+		c->pid = RL16(&data[12]);
+		c->speed = data[14];
+		c->transfer_pos = c->control_pos = CAPTURE_HEADER_SIZE;
+		env = g_getenv("SIGROK_USB_REPLAY_SPEED");
+		c->max_speed = env && !strcmp(env, "max");
+		env = g_getenv("SIGROK_USB_REPLAY_LOOP");
+		c->loop = env && strcmp(env, "0");
+		if (record)
+			sr_warn("Replaying a USB capture, not recording.");
+		sr_info("Replaying USB capture of %04x:%04x from '%s'.",
+			c->vid, c->pid, replay);
+	} else {
+		if (!(c->file = g_fopen(record, "wb"))) {
+			sr_err("Cannot create USB capture '%s': %s.",
+				record, g_strerror(errno));
+			goto fail;
+		}
+		setvbuf(c->file, NULL, _IOFBF, 1024 * 1024);
+		sr_info("Recording USB capture to '%s'.", record);
 	}
-	if (hdl)
-		libusb_close(hdl);
+	ctx->usb_capture = c;
+
+	return;
+
+fail:
+	g_cond_clear(&c->cond);
+	g_mutex_clear(&c->mutex);
+	g_free(c);
+}
+
+/**
+ * Finish recording or replay of USB captures.
+ *
+ * @private
+ */
+SR_PRIV void sr_usb_capture_exit(struct sr_context *ctx)
+{
+	struct usb_capture *c;
+
+	if (!(c = ctx->usb_capture))
+		return;
+
+	if (c->file)
+		fclose(c->file);
+	if (c->mapped)
+		g_mapped_file_unref(c->mapped);
+	g_queue_clear(&c->pending);
+	g_queue_clear(&c->cancelled);
+	g_cond_clear(&c->cond);
+	g_mutex_clear(&c->mutex);
+	g_free(c);
+	ctx->usb_capture = NULL;
+}
+
+/**
+ * Whether a USB capture replaces the device, and which one.
+ *
+ * Drivers which support replay then create a device of this kind
+ * without opening it. Its transfers and control transfers must go
+ * through sr_usb_submit_transfer(), sr_usb_cancel_transfer() and
+ * sr_usb_control_transfer(), with a NULL device handle.
+ *
+ * @param ctx The libsigrok context.
+ * @param vid The vendor ID of the captured device. Can be NULL.
+ * @param pid The product ID of the captured device. Can be NULL.
+ * @param speed The enum libusb_speed of the captured device. Can be NULL.
+ *
+ * @return TRUE when replaying.
+ *
+ * @private
+ */
+SR_PRIV gboolean sr_usb_replay_device(struct sr_context *ctx,
+		uint16_t *vid, uint16_t *pid, int *speed)
+{
+	struct usb_capture *c;
+
+	c = ctx->usb_capture;
+	if (!c || !c->mapped)
+		return FALSE;
+
+	if (vid)
+		*vid = c->vid;
+	if (pid)
+		*pid = c->pid;
+	if (speed)
+		*speed = c->speed;
+
+	return TRUE;
+}
+
+/**
+ * Submit a bulk or interrupt transfer, like libusb_submit_transfer().
+ *
+ * Records the transfer when it completes, or queues it for the replay
+ * when a capture is replayed. Replayed transfers complete where
+ * libsigrok handles libusb events: on the USB event thread, and in
+ * sr_usb_handle_pending().
+ *
+ * @param ctx The libsigrok context.
+ * @param transfer The transfer, filled in.
+ *
+ * @return 0, or a negative libusb error code.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_submit_transfer(struct sr_context *ctx,
+		struct libusb_transfer *transfer)
+{
+	struct usb_capture *c;
+	struct capture_transfer *ct;
+	int ret;
+
+	SR_TRACE3(usb_submit, transfer, transfer->endpoint, transfer->length);
+	c = ctx->usb_capture;
+	if (!c)
+		return libusb_submit_transfer(transfer);
+
+	if (c->mapped) {
+		g_mutex_lock(&c->mutex);
+		if (!c->start_us)
+			c->start_us = g_get_monotonic_time();
+		g_queue_push_tail(&c->pending, transfer);
+		g_cond_signal(&c->cond);
+		g_mutex_unlock(&c->mutex);
+		return 0;
+	}
+
+	ct = g_malloc(sizeof(*ct));
+	ct->capture = c;
+	ct->cb = transfer->callback;
+	transfer->callback = capture_record_cb;
+	g_mutex_lock(&capture_transfers_mutex);
+	if (!capture_transfers)
+		capture_transfers = g_hash_table_new_full(NULL, NULL,
+			NULL, g_free);
+	g_hash_table_replace(capture_transfers, transfer, ct);
+	g_mutex_unlock(&capture_transfers_mutex);
+
+	if ((ret = libusb_submit_transfer(transfer)) < 0) {
+		transfer->callback = ct->cb;
+		g_mutex_lock(&capture_transfers_mutex);
+		g_hash_table_remove(capture_transfers, transfer);
+		g_mutex_unlock(&capture_transfers_mutex);
+	}
+
+	return ret;
+}
+
+/**
+ * Cancel a transfer, like libusb_cancel_transfer().
+ *
+ * @param ctx The libsigrok context.
+ * @param transfer The transfer, submitted with sr_usb_submit_transfer().
+ *
+ * @return 0, or a negative libusb error code.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_cancel_transfer(struct sr_context *ctx,
+		struct libusb_transfer *transfer)
+{
+	struct usb_capture *c;
+	int ret;
+
+	c = ctx->usb_capture;
+	if (!c || !c->mapped)
+		return libusb_cancel_transfer(transfer);
+
+	ret = LIBUSB_ERROR_NOT_FOUND;
+	g_mutex_lock(&c->mutex);
+	if (g_queue_remove(&c->pending, transfer)) {
+		g_queue_push_tail(&c->cancelled, transfer);
+		g_cond_signal(&c->cond);
+		ret = 0;
+	}
+	g_mutex_unlock(&c->mutex);
 
 	return ret;
 }
+
+/**
+ * Do a control transfer, like libusb_control_transfer().
+ *
+ * The data of IN transfers is recorded. During replay, IN transfers
+ * get the data of the next recorded one with the same request, value
+ * and index, or zeroes when there is none, and OUT transfers succeed
+ * without going anywhere.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_control_transfer(struct sr_context *ctx,
+		libusb_device_handle *devhdl, uint8_t request_type,
+		uint8_t request, uint16_t value, uint16_t index,
+		unsigned char *data, uint16_t length, unsigned int timeout)
+{
+	struct usb_capture *c;
+	size_t pos;
+	uint32_t len;
+	int ret;
+
+	c = ctx->usb_capture;
+	if (c && c->mapped) {
+		if (!(request_type & LIBUSB_ENDPOINT_IN))
+			return length;
+		g_mutex_lock(&c->mutex);
+		pos = capture_find(c, c->control_pos, CAPTURE_CONTROL_IN,
+			request, value, index);
+		if (pos == c->len)
+			pos = capture_find(c, CAPTURE_HEADER_SIZE,
+				CAPTURE_CONTROL_IN, request, value, index);
+		if (pos < c->len) {
+			len = MIN(RL32(&c->data[pos + 16]), length);
+			memcpy(data, c->data + pos + CAPTURE_RECORD_SIZE, len);
+			c->control_pos = pos + CAPTURE_RECORD_SIZE
+				+ RL32(&c->data[pos + 16]);
+			ret = len;
+		} else {
+			sr_dbg("No capture of control request 0x%02x, "
+				"returning zeroes.", request);
+			memset(data, 0, length);
+			ret = length;
+		}
+		g_mutex_unlock(&c->mutex);
+		return ret;
+	}
+
+	ret = libusb_control_transfer(devhdl, request_type, request, value,
+		index, data, length, timeout);
+	if (c && ret >= 0 && (request_type & LIBUSB_ENDPOINT_IN)) {
+		g_mutex_lock(&c->mutex);
+		capture_write(c, devhdl, CAPTURE_CONTROL_IN, request, 0,
+			value, index, data, ret);
+		g_mutex_unlock(&c->mutex);
+	}
+
+	return ret;
+}
+
+/** @cond PRIVATE */
+#define BULK_UPLOAD_TRANSFERS 4
+/** @endcond */
+
+struct bulk_upload {
+	const uint8_t *data;
+	size_t len;
+	size_t pos;
+	size_t chunk_size;
+	int outstanding;
+	int completed;
+	int ret;
+};
+
+/* Fill a transfer with the next chunk and submit it. */
+static int bulk_upload_next(struct bulk_upload *up,
+		struct libusb_transfer *transfer)
+{
+	size_t len;
+	int ret;
+
+	len = MIN(up->chunk_size, up->len - up->pos);
+	transfer->buffer = (unsigned char *)up->data + up->pos;
+	transfer->length = len;
+	if ((ret = libusb_submit_transfer(transfer)) != 0) {
+		sr_err("Failed to submit upload transfer: %s.",
+			libusb_error_name(ret));
+		return SR_ERR_IO;
+	}
+	up->pos += len;
+	up->outstanding++;
+
+	return SR_OK;
+}
+
+static void LIBUSB_CALL bulk_upload_cb(struct libusb_transfer *transfer)
+{
+	struct bulk_upload *up;
+
+	up = transfer->user_data;
+	up->outstanding--;
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED ||
+			transfer->actual_length != transfer->length) {
+		if (up->ret == SR_OK)
+			sr_err("Upload transfer failed: %s, %d of %d bytes.",
+				libusb_error_name(transfer->status),
+				transfer->actual_length, transfer->length);
+		up->ret = SR_ERR_IO;
+	} else if (up->ret == SR_OK && up->pos < up->len) {
+		up->ret = bulk_upload_next(up, transfer);
+		if (up->ret == SR_OK)
+			return;
+	}
+
+	libusb_free_transfer(transfer);
+	if (!up->outstanding)
+		up->completed = 1;
+}
+
+/**
+ * Write a block of data to a bulk OUT endpoint, like a firmware image.
+ *
+ * The data is sent in chunks, with several transfers outstanding at a
+ * time, so that the device doesn't wait for the host between chunks.
+ * Returns when all of it was sent, or on the first error.
+ *
+ * @param ctx The libsigrok context.
+ * @param devhdl The device handle.
+ * @param endpoint The bulk OUT endpoint.
+ * @param data The data. Must stay valid until this returns.
+ * @param len The length of the data.
+ * @param chunk_size The size of each transfer.
+ * @param timeout The timeout of each transfer, in ms.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_IO Submitting or completing a transfer failed.
+ *
+ * @private
+ */
+SR_PRIV int sr_usb_bulk_upload(struct sr_context *ctx,
+		libusb_device_handle *devhdl, unsigned char endpoint,
+		const uint8_t *data, size_t len, size_t chunk_size,
+		unsigned int timeout)
+{
+	struct bulk_upload up;
+	struct libusb_transfer *transfer;
+	struct timeval tv;
+	int i, ret;
+
+	up.data = data;
+	up.len = len;
+	up.pos = 0;
+	up.chunk_size = chunk_size;
+	up.outstanding = 0;
+	up.completed = 0;
+	up.ret = SR_OK;
+
+	for (i = 0; i < BULK_UPLOAD_TRANSFERS && up.pos < up.len; i++) {
+		transfer = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfer, devhdl, endpoint, NULL, 0,
+			bulk_upload_cb, &up, timeout);
+		if ((up.ret = bulk_upload_next(&up, transfer)) != SR_OK) {
+			libusb_free_transfer(transfer);
+			break;
+		}
+	}
+	if (!up.outstanding)
+		return up.ret;
+
+	/* Transfers time out, so this does end. */
+	while (!up.completed) {
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+		ret = libusb_handle_events_timeout_completed(ctx->libusb_ctx,
+			&tv, &up.completed);
+		if (ret < 0 && ret != LIBUSB_ERROR_INTERRUPTED)
+			sr_dbg("Handling upload events: %s.",
+				libusb_error_name(ret));
+	}
+
+	return up.ret;
+}
@@ -0,0 +1,388 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+/** @cond PRIVATE */
+#define LOG_PREFIX "user-feed"
+/** @endcond */
+
+/**
+ * @file
+ *
+ * Feeding samples of user devices through a ring buffer.
+ *
+ * Applications write logic samples into preallocated slots of the ring,
+ * from any thread, and commit them when done. The session thread picks
+ * up committed slots in ring order, at an interval the application
+ * chooses, and sends slots which are adjacent in memory as one packet,
+ * without copying them. Producers never wait for the session: when the
+ * ring is full, acquiring a slot fails and the overrun gets counted.
+ */
+
+/**
+ * @addtogroup grp_devices
+ *
+ * @{
+ */
+
+/** @cond PRIVATE */
+enum slot_state {
+	SLOT_FREE,
+	SLOT_WRITING,
+	SLOT_READY,
+};
+
+struct sr_user_feed {
+	const struct sr_dev_inst *sdi;
+	uint16_t unitsize;
+	size_t slot_samples;
+	size_t slot_bytes;
+	size_t num_slots;
+	uint8_t *buf;
+	GSource *source;
+	gboolean header_sent;
+	/* Everything below is under the mutex. */
+	GMutex mutex;
+	enum slot_state *state;
+	size_t *fill;
+	/* Next slot to hand out, oldest slot not sent, slots in use. */
+	size_t head, tail, used;
+	uint64_t overruns;
+};
+/** @endcond */
+
+static int send_slots(struct sr_user_feed *feed, size_t first, size_t count)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	size_t idx, run, bytes;
+	int ret;
+
+	if (!feed->header_sent) {
+		ret = std_session_send_df_header(feed->sdi);
+		if (ret != SR_OK)
+			return ret;
+		feed->header_sent = TRUE;
+	}
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = feed->unitsize;
+	while (count) {
+		/* Full slots run into the next one, unless the ring wraps. */
+		idx = first;
+		bytes = 0;
+		run = 0;
+		while (run < count) {
+			bytes += feed->fill[idx] * feed->unitsize;
+			run++;
+			if (feed->fill[idx] != feed->slot_samples)
+				break;
+			if (++idx == feed->num_slots)
+				break;
+		}
+		if (bytes) {
+			logic.length = bytes;
+			logic.data = feed->buf + first * feed->slot_bytes;
+			ret = sr_session_send(feed->sdi, &packet);
+			if (ret != SR_OK)
+				return ret;
+		}
+		first = (first + run) % feed->num_slots;
+		count -= run;
+	}
+
+	return SR_OK;
+}
+
+static gboolean flush_timeout(void *cb_data)
+{
+	sr_user_feed_flush(cb_data);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void flush_source_gone(void *cb_data)
+{
+	struct sr_user_feed *feed;
+
+	feed = cb_data;
+	sr_session_source_destroyed(feed->sdi->session, feed, feed->source);
+	feed->source = NULL;
+}
+
+/**
+ * Create a ring buffer which feeds logic samples into the session of a
+ * user device.
+ *
+ * The device must have been added to a session. The session header is
+ * sent along with the first samples.
+ *
+ * @param sdi The user device, see sr_dev_inst_user_new().
+ * @param unitsize Bytes per sample.
+ * @param slot_samples Samples per slot.
+ * @param num_slots Slots in the ring.
+ * @param flush_ms Interval at which the running session sends committed
+ *                 slots. With 0, the application calls
+ *                 sr_user_feed_flush() itself.
+ * @param[out] feed The new feed.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval SR_ERR The session is not running, see sr_session_start().
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_user_feed_new(const struct sr_dev_inst *sdi, uint16_t unitsize,
+		size_t slot_samples, size_t num_slots, unsigned int flush_ms,
+		struct sr_user_feed **feed)
+{
+	struct sr_user_feed *f;
+	GSource *source;
+	int ret;
+
+	if (!sdi || sdi->inst_type != SR_INST_USER || !sdi->session)
+		return SR_ERR_ARG;
+	if (!unitsize || !slot_samples || !num_slots || !feed)
+		return SR_ERR_ARG;
+	if (slot_samples > G_MAXSIZE / unitsize / num_slots)
+		return SR_ERR_ARG;
+
+	f = g_malloc0(sizeof(*f));
+	f->sdi = sdi;
+	f->unitsize = unitsize;
+	f->slot_samples = slot_samples;
+	f->slot_bytes = slot_samples * unitsize;
+	f->num_slots = num_slots;
+	f->buf = g_malloc(f->slot_bytes * num_slots);
+	f->state = g_malloc0(num_slots * sizeof(f->state[0]));
+	f->fill = g_malloc0(num_slots * sizeof(f->fill[0]));
+	g_mutex_init(&f->mutex);
+
+	if (flush_ms) {
+		source = g_timeout_source_new(flush_ms);
+		g_source_set_callback(source, flush_timeout, f,
+			flush_source_gone);
+		f->source = source;
+		ret = sr_session_source_add_internal(sdi->session, f, source);
+		g_source_unref(source);
+		if (ret != SR_OK) {
+			sr_user_feed_free(f);
+			return ret;
+		}
+	}
+	*feed = f;
+
+	return SR_OK;
+}
+
+/**
+ * Get a free slot of the ring, to write samples into.
+ *
+ * This can be called from any thread. Slots get handed out in ring
+ * order, and have room for slot_samples samples.
+ *
+ * @param feed The feed.
+ *
+ * @return The slot, or NULL when all slots are in use, which counts as
+ *         an overrun.
+ *
+ * @since 0.6.0
+ */
+SR_API void *sr_user_feed_acquire(struct sr_user_feed *feed)
+{
+	size_t idx;
+
+	if (!feed)
+		return NULL;
+
+	g_mutex_lock(&feed->mutex);
+	if (feed->used == feed->num_slots) {
+		feed->overruns++;
+		g_mutex_unlock(&feed->mutex);
+		return NULL;
+	}
+	idx = feed->head;
+	feed->state[idx] = SLOT_WRITING;
+	feed->fill[idx] = 0;
+	feed->head = (idx + 1) % feed->num_slots;
+	feed->used++;
+	g_mutex_unlock(&feed->mutex);
+
+	return feed->buf + idx * feed->slot_bytes;
+}
+
+/**
+ * Hand the samples written into a slot over to the session.
+ *
+ * This can be called from any thread, also for slots out of order. A
+ * slot is sent only after all slots acquired before it were committed.
+ *
+ * @param feed The feed.
+ * @param slot The slot, as returned by sr_user_feed_acquire().
+ * @param samples The samples written, which may be fewer than the slot
+ *                holds, or none.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument, or not an acquired slot.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_user_feed_commit(struct sr_user_feed *feed, void *slot,
+		size_t samples)
+{
+	size_t offset, idx;
+
+	if (!feed || !slot || (uint8_t *)slot < feed->buf)
+		return SR_ERR_ARG;
+	offset = (uint8_t *)slot - feed->buf;
+	idx = offset / feed->slot_bytes;
+	if (offset % feed->slot_bytes || idx >= feed->num_slots)
+		return SR_ERR_ARG;
+	if (samples > feed->slot_samples)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&feed->mutex);
+	if (feed->state[idx] != SLOT_WRITING) {
+		g_mutex_unlock(&feed->mutex);
+		return SR_ERR_ARG;
+	}
+	feed->fill[idx] = samples;
+	feed->state[idx] = SLOT_READY;
+	g_mutex_unlock(&feed->mutex);
+
+	return SR_OK;
+}
+
+/**
+ * Send the committed slots to the session.
+ *
+ * This runs on the session thread at the flush interval. Applications
+ * which passed no interval call it themselves, on the thread which
+ * runs the session.
+ *
+ * @param feed The feed.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other Error sending the samples.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_user_feed_flush(struct sr_user_feed *feed)
+{
+	size_t first, count, idx, i;
+	int ret;
+
+	if (!feed)
+		return SR_ERR_ARG;
+
+	g_mutex_lock(&feed->mutex);
+	first = feed->tail;
+	count = 0;
+	idx = first;
+	while (count < feed->used && feed->state[idx] == SLOT_READY) {
+		count++;
+		idx = (idx + 1) % feed->num_slots;
+	}
+	g_mutex_unlock(&feed->mutex);
+	if (!count)
+		return SR_OK;
+
+	/* Producers leave committed slots alone, no need for the lock. */
+	ret = send_slots(feed, first, count);
+
+	g_mutex_lock(&feed->mutex);
+	for (i = 0, idx = first; i < count; i++) {
+		feed->state[idx] = SLOT_FREE;
+		idx = (idx + 1) % feed->num_slots;
+	}
+	feed->tail = idx;
+	feed->used -= count;
+	g_mutex_unlock(&feed->mutex);
+
+	return ret;
+}
+
+/**
+ * Get the number of times a slot was asked for while the ring was full.
+ *
+ * @param feed The feed.
+ *
+ * @return The number of overruns.
+ *
+ * @since 0.6.0
+ */
+SR_API uint64_t sr_user_feed_overruns(struct sr_user_feed *feed)
+{
+	uint64_t overruns;
+
+	if (!feed)
+		return 0;
+
+	g_mutex_lock(&feed->mutex);
+	overruns = feed->overruns;
+	g_mutex_unlock(&feed->mutex);
+
+	return overruns;
+}
+
+/**
+ * Send the remaining committed slots and end the feed.
+ *
+ * The end of the data feed is sent when samples were sent before.
+ * Slots still being written are dropped. Call this on the thread which
+ * runs the session, or after the session stopped, when no producer
+ * uses the feed anymore. Removing the flush interval lets the session
+ * stop, when the feed was its last event source.
+ *
+ * @param feed The feed.
+ *
+ * @retval SR_OK Success.
+ * @retval SR_ERR_ARG Invalid argument.
+ * @retval other Error sending the samples.
+ *
+ * @since 0.6.0
+ */
+SR_API int sr_user_feed_free(struct sr_user_feed *feed)
+{
+	int ret;
+
+	if (!feed)
+		return SR_ERR_ARG;
+
+	ret = sr_user_feed_flush(feed);
+	if (feed->header_sent)
+		std_session_send_df_end(feed->sdi);
+	if (feed->source)
+		sr_session_source_remove_internal(feed->sdi->session, feed);
+
+	g_mutex_clear(&feed->mutex);
+	g_free(feed->fill);
+	g_free(feed->state);
+	g_free(feed->buf);
+	g_free(feed);
+
+	return ret;
+}
+
+/** @} */
@@ -428,6 +428,81 @@ START_TEST(test_analog_to_float_conv)
 }
 END_TEST
 
+/* Check 8-bit values, which go through a table when there are many. */
+START_TEST(test_analog_to_float_bytes)
+{
+	int ret;
+	unsigned int i;
+	uint8_t data[1000];
+	float fout[1000], fone;
+	double dout[1000];
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	meaning.channels = g_slist_append(NULL, &ch);
+	encoding.unitsize = 1;
+	encoding.is_float = FALSE;
+	encoding.is_signed = TRUE;
+	encoding.scale.p = 3;
+	encoding.scale.q = 10;
+	encoding.offset.p = -1;
+	encoding.offset.q = 4;
+	for (i = 0; i < ARRAY_SIZE(data); i++)
+		data[i] = i * 7;
+
+	analog.data = data;
+	analog.num_samples = ARRAY_SIZE(data);
+	ret = sr_analog_to_float(&analog, fout);
+	fail_unless(ret == SR_OK, "sr_analog_to_float() failed: %d.", ret);
+	ret = sr_analog_to_double(&analog, dout);
+	fail_unless(ret == SR_OK, "sr_analog_to_double() failed: %d.", ret);
+
+	/* A single value doesn't take the table. */
+	analog.num_samples = 1;
+	for (i = 0; i < ARRAY_SIZE(data); i++) {
+		analog.data = &data[i];
+		ret = sr_analog_to_float(&analog, &fone);
+		fail_unless(ret == SR_OK);
+		fail_unless(fout[i] == fone, "%f != %f", fout[i], fone);
+		fail_unless(fabs(dout[i] - ((int8_t)data[i] * 0.3 - 0.25)) < 1e-9,
+			"%f != %f", dout[i], (int8_t)data[i] * 0.3 - 0.25);
+	}
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+START_TEST(test_analog_to_double)
+{
+	int ret;
+	double d, dout;
+	struct sr_channel ch;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+
+	sr_analog_init_(&analog, &encoding, &meaning, &spec, 3);
+	meaning.channels = g_slist_append(NULL, &ch);
+	encoding.unitsize = sizeof(double);
+	analog.num_samples = 1;
+	analog.data = &d;
+
+	/* Not representable as a float. */
+	d = 1.0 + 1e-12;
+	ret = sr_analog_to_double(&analog, &dout);
+	fail_unless(ret == SR_OK, "sr_analog_to_double() failed: %d.", ret);
+	fail_unless(dout == d, "%.15f != %.15f", dout, d);
+
+	ret = sr_analog_to_double(&analog, NULL);
+	fail_unless(ret == SR_ERR_ARG);
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
 START_TEST(test_analog_si_prefix)
 {
 	struct {
@@ -610,6 +685,8 @@ START_TEST(test_mult_rational)
 		/* Test reduction */
 		{ { INT32_MAX, (1ll<<12) }, { (1<<2), 1 }, { INT32_MAX, (1ll<<10) }},
 		{ { INT64_MAX, (1ll<<63) }, { (1<<3), 1 }, { INT64_MAX, (1ll<<60) }},
+		{ { 3000000000ll, 7000000000ll }, { 7000000000ll, 3000000001ll }, { 3000000000ll, 3000000001ll }},
+		{ { -3000000000ll, 7000000000ll }, { 14000000000ll, 9000000000ll }, { -2, 3 }},
 		/* Test large numbers */
 		{ {  (1ll<<40), (1ll<<10) }, {  (1ll<<30), 1 }, { (1ll<<60), 1 }},
 		{ { -(1ll<<40), (1ll<<10) }, { -(1ll<<30), 1 }, { (1ll<<60), 1 }},
@@ -697,6 +774,8 @@ Suite *suite_analog(void)
 	tcase_add_test(tc, test_analog_to_float);
 	tcase_add_test(tc, test_analog_to_float_null);
 	tcase_add_test(tc, test_analog_to_float_conv);
+	tcase_add_test(tc, test_analog_to_float_bytes);
+	tcase_add_test(tc, test_analog_to_double);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("analog_si_unit");
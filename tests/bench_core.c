@@ -0,0 +1,668 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Core hot path benchmark, not run as part of "make check".
+ *
+ * Times the session send path at several packet sizes, the feed queues,
+ * analog to float conversion, analog to logic conversion, the software
+ * trigger search, every transform module, every output module, and
+ * every input module that can read back what the output module of the
+ * same name wrote. All of it runs on generated data.
+ *
+ * Progress goes to stderr, the results go to stdout as one JSON object,
+ * so that runs can be stored and compared:
+ *
+ *   tests/bench_core [samples] > results.json
+ */
+
+#include <config.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define DEFAULT_SAMPLES	(64 * 1024 * 1024)
+#define PACKET_SAMPLES	(64 * 1024)
+#define NUM_LOGIC	8
+/* Outputs and inputs are much slower, they get a fraction of the samples. */
+#define FILE_DIVISOR	16
+/* Most output data kept to read back with the input module. */
+#define FILE_DATA_MAX	(16 * 1024 * 1024)
+#define INPUT_CHUNK	(64 * 1024)
+
+struct bench {
+	struct sr_context *ctx;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	GSList *analog_channels;
+	uint64_t samples;
+	uint8_t *logic;
+	float *analog;
+	GString *json;
+	gboolean first;
+};
+
+/* What the datafeed callback saw, so that no stage can be skipped. */
+static uint64_t recv_samples;
+static uint64_t recv_sum;
+
+static void count_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+
+	(void)sdi;
+	(void)cb_data;
+
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		recv_samples += logic->length / logic->unitsize;
+		if (logic->length)
+			recv_sum += ((const uint8_t *)logic->data)[0];
+	} else if (packet->type == SR_DF_ANALOG) {
+		analog = packet->payload;
+		recv_samples += analog->num_samples;
+	}
+}
+
+static void record(struct bench *b, const char *group, const char *name,
+		uint64_t items, uint64_t bytes, int64_t elapsed, int ret)
+{
+	double ns_per_item, mb_per_s;
+
+	ns_per_item = items ? elapsed * 1000.0 / items : 0.0;
+	mb_per_s = elapsed > 0 ? (double)bytes / elapsed : 0.0;
+
+	fprintf(stderr, "%-14s %-18s %11" PRIu64 " items, %8.1f ms, "
+		"%8.3f ns/item, %8.1f MB/s%s%s\n", group, name, items,
+		elapsed / 1000.0, ns_per_item, mb_per_s,
+		ret == SR_OK ? "" : ", ", ret == SR_OK ? "" : sr_strerror(ret));
+
+	g_string_append_printf(b->json, "%s\n    {\"group\": \"%s\", "
+		"\"name\": \"%s\", \"items\": %" PRIu64 ", \"bytes\": %" PRIu64
+		", \"elapsed_us\": %" PRId64 ", \"ns_per_item\": %.3f, "
+		"\"mb_per_s\": %.1f, \"result\": \"%s\"}",
+		b->first ? "" : ",", group, name, items, bytes, elapsed,
+		ns_per_item, mb_per_s, sr_strerror_name(ret));
+	b->first = FALSE;
+}
+
+static void analog_setup(struct sr_datafeed_analog *analog,
+		struct sr_analog_encoding *encoding,
+		struct sr_analog_meaning *meaning, struct sr_analog_spec *spec,
+		GSList *channels, void *data, uint64_t num_samples,
+		uint8_t unitsize, gboolean is_float, gboolean is_signed)
+{
+	memset(analog, 0, sizeof(*analog));
+	memset(encoding, 0, sizeof(*encoding));
+	memset(meaning, 0, sizeof(*meaning));
+	memset(spec, 0, sizeof(*spec));
+
+	encoding->unitsize = unitsize;
+	encoding->is_float = is_float;
+	encoding->is_signed = is_signed;
+	encoding->is_bigendian = G_BYTE_ORDER == G_BIG_ENDIAN;
+	encoding->digits = 3;
+	encoding->is_digits_decimal = TRUE;
+	sr_rational_set(&encoding->scale, 1, 1);
+	sr_rational_set(&encoding->offset, 0, 1);
+	meaning->mq = SR_MQ_VOLTAGE;
+	meaning->unit = SR_UNIT_VOLT;
+	meaning->mqflags = SR_MQFLAG_DC;
+	meaning->channels = channels;
+	spec->spec_digits = 3;
+
+	analog->data = data;
+	analog->num_samples = num_samples;
+	analog->encoding = encoding;
+	analog->meaning = meaning;
+	analog->spec = spec;
+}
+
+/* sr_session_send() with the datafeed callback, at several packet sizes. */
+static void bench_session(struct bench *b)
+{
+	static const size_t packet_sizes[] = { 64, 1024, 16 * 1024, 64 * 1024, };
+	struct feed_queue_logic *q;
+	uint64_t done;
+	int64_t start;
+	size_t i;
+	int ret;
+	char name[32];
+
+	for (i = 0; i < G_N_ELEMENTS(packet_sizes); i++) {
+		q = feed_queue_logic_alloc(b->sdi, packet_sizes[i], 1);
+		if (!q)
+			return;
+		recv_samples = 0;
+		ret = SR_OK;
+		start = g_get_monotonic_time();
+		for (done = 0; ret == SR_OK && done < b->samples;
+				done += PACKET_SAMPLES)
+			ret = feed_queue_logic_submit_many(q, b->logic,
+				PACKET_SAMPLES);
+		if (ret == SR_OK)
+			ret = feed_queue_logic_flush(q);
+		g_snprintf(name, sizeof(name), "logic/%zu", packet_sizes[i]);
+		record(b, "session_send", name, recv_samples, recv_samples,
+			g_get_monotonic_time() - start, ret);
+		feed_queue_logic_free(q);
+	}
+}
+
+static void bench_feed_queue(struct bench *b)
+{
+	struct feed_queue_logic *lq;
+	struct feed_queue_analog *aq;
+	uint64_t done;
+	int64_t start;
+	int ret;
+
+	lq = feed_queue_logic_alloc(b->sdi, PACKET_SAMPLES, 1);
+	if (!lq)
+		return;
+	recv_samples = 0;
+	ret = SR_OK;
+	start = g_get_monotonic_time();
+	for (done = 0; ret == SR_OK && done < b->samples; done++)
+		ret = feed_queue_logic_submit_one(lq, &b->logic[done % PACKET_SAMPLES], 1);
+	if (ret == SR_OK)
+		ret = feed_queue_logic_flush(lq);
+	record(b, "feed_queue", "logic_one", done, done,
+		g_get_monotonic_time() - start, ret);
+	feed_queue_logic_free(lq);
+
+	aq = feed_queue_analog_alloc(b->sdi, PACKET_SAMPLES, 3,
+		b->analog_channels->data);
+	if (!aq)
+		return;
+	ret = SR_OK;
+	start = g_get_monotonic_time();
+	for (done = 0; ret == SR_OK && done < b->samples / 4; done++)
+		ret = feed_queue_analog_submit_one(aq,
+			b->analog[done % PACKET_SAMPLES], 1);
+	if (ret == SR_OK)
+		ret = feed_queue_analog_flush(aq);
+	record(b, "feed_queue", "analog_one", done, done * sizeof(float),
+		g_get_monotonic_time() - start, ret);
+	feed_queue_analog_free(aq);
+}
+
+static void bench_analog_to_float(struct bench *b)
+{
+	static const struct {
+		const char *name;
+		uint8_t unitsize;
+		gboolean is_float;
+		gboolean is_signed;
+		int64_t scale_p, offset_p;
+	} formats[] = {
+		{ "float", 4, TRUE, TRUE, 1, 0, },
+		{ "double", 8, TRUE, TRUE, 1, 0, },
+		{ "int16_scaled", 2, FALSE, TRUE, 5, 0, },
+		{ "uint8_offset", 1, FALSE, FALSE, 1, -128, },
+	};
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	uint8_t *raw;
+	float *out;
+	uint64_t done;
+	int64_t start;
+	size_t i, j;
+	int ret;
+
+	raw = g_malloc(PACKET_SAMPLES * sizeof(double));
+	out = g_malloc(PACKET_SAMPLES * sizeof(float));
+	for (i = 0; i < G_N_ELEMENTS(formats); i++) {
+		for (j = 0; j < PACKET_SAMPLES; j++) {
+			switch (formats[i].unitsize) {
+			case 8:
+				((double *)raw)[j] = b->analog[j];
+				break;
+			case 4:
+				((float *)raw)[j] = b->analog[j];
+				break;
+			case 2:
+				((int16_t *)raw)[j] = b->analog[j] * 1000;
+				break;
+			default:
+				raw[j] = 128 + b->analog[j] * 100;
+				break;
+			}
+		}
+		analog_setup(&analog, &encoding, &meaning, &spec,
+			b->analog_channels, raw, PACKET_SAMPLES,
+			formats[i].unitsize, formats[i].is_float,
+			formats[i].is_signed);
+		sr_rational_set(&encoding.scale, formats[i].scale_p, 1000);
+		sr_rational_set(&encoding.offset, formats[i].offset_p, 1);
+		if (formats[i].is_float)
+			sr_rational_set(&encoding.scale, 1, 1);
+
+		ret = SR_OK;
+		start = g_get_monotonic_time();
+		for (done = 0; ret == SR_OK && done < b->samples;
+				done += PACKET_SAMPLES)
+			ret = sr_analog_to_float(&analog, out);
+		record(b, "analog_to_float", formats[i].name, done,
+			done * formats[i].unitsize,
+			g_get_monotonic_time() - start, ret);
+	}
+	g_free(out);
+	g_free(raw);
+}
+
+static void bench_a2l(struct bench *b)
+{
+	static const char *names[] = {
+		"threshold", "schmitt", "threshold_bits", "schmitt_bits",
+	};
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	uint8_t *out, state;
+	uint64_t done;
+	int64_t start;
+	int i, ret;
+
+	analog_setup(&analog, &encoding, &meaning, &spec, b->analog_channels,
+		b->analog, PACKET_SAMPLES, sizeof(float), TRUE, TRUE);
+	out = g_malloc(PACKET_SAMPLES);
+
+	for (i = 0; i < (int)G_N_ELEMENTS(names); i++) {
+		state = 0;
+		ret = SR_OK;
+		start = g_get_monotonic_time();
+		for (done = 0; ret == SR_OK && done < b->samples;
+				done += PACKET_SAMPLES) {
+			switch (i) {
+			case 0:
+				ret = sr_a2l_threshold(&analog, 0.0,
+					out, PACKET_SAMPLES);
+				break;
+			case 1:
+				ret = sr_a2l_schmitt_trigger(&analog, -0.2, 0.2,
+					&state, out, PACKET_SAMPLES);
+				break;
+			case 2:
+				ret = sr_a2l_threshold_bits(&analog, 0.0,
+					out, PACKET_SAMPLES);
+				break;
+			default:
+				ret = sr_a2l_schmitt_trigger_bits(&analog,
+					-0.2, 0.2, &state, out, PACKET_SAMPLES);
+				break;
+			}
+		}
+		record(b, "a2l", names[i], done, done * sizeof(float),
+			g_get_monotonic_time() - start, ret);
+	}
+	g_free(out);
+}
+
+/*
+ * The software trigger, through sr_trigger_search() which runs the
+ * same matcher as an acquisition does, on one thread.
+ */
+static void bench_trigger(struct bench *b)
+{
+	static const char *names[] = { "edge", "pattern", "two_stages", };
+	struct sr_trigger *trigger;
+	struct sr_trigger_stage *stage;
+	GSList *channels;
+	GArray *offsets;
+	uint64_t done, found;
+	int64_t start;
+	int i, ret;
+
+	channels = sr_dev_inst_channels_get(b->sdi);
+	for (i = 0; i < (int)G_N_ELEMENTS(names); i++) {
+		trigger = sr_trigger_new(NULL);
+		stage = sr_trigger_stage_add(trigger);
+		switch (i) {
+		case 0:
+			sr_trigger_match_add(stage, channels->data,
+				SR_TRIGGER_RISING, 0);
+			break;
+		case 1:
+			sr_trigger_match_add(stage, channels->data,
+				SR_TRIGGER_ONE, 0);
+			sr_trigger_match_add(stage, channels->next->data,
+				SR_TRIGGER_ZERO, 0);
+			sr_trigger_match_add(stage, channels->next->next->data,
+				SR_TRIGGER_FALLING, 0);
+			break;
+		default:
+			sr_trigger_match_add(stage, channels->data,
+				SR_TRIGGER_RISING, 0);
+			stage = sr_trigger_stage_add(trigger);
+			sr_trigger_match_add(stage, channels->next->data,
+				SR_TRIGGER_FALLING, 0);
+			break;
+		}
+
+		found = 0;
+		ret = SR_OK;
+		start = g_get_monotonic_time();
+		for (done = 0; ret == SR_OK && done < b->samples;
+				done += PACKET_SAMPLES) {
+			ret = sr_trigger_search(trigger, b->logic,
+				PACKET_SAMPLES, 1, 1, &offsets);
+			if (ret == SR_OK) {
+				found += offsets->len;
+				g_array_free(offsets, TRUE);
+			}
+		}
+		record(b, "trigger", names[i], done, done,
+			g_get_monotonic_time() - start,
+			ret == SR_OK && !found ? SR_ERR_DATA : ret);
+		sr_trigger_free(trigger);
+	}
+}
+
+/* Logic through a feed queue and analog through another one. */
+static int send_through_session(struct bench *b, uint64_t *items)
+{
+	struct feed_queue_logic *lq;
+	struct feed_queue_analog *aq;
+	uint64_t done;
+	int ret;
+
+	lq = feed_queue_logic_alloc(b->sdi, PACKET_SAMPLES, 1);
+	aq = feed_queue_analog_alloc(b->sdi, PACKET_SAMPLES, 3,
+		b->analog_channels->data);
+	ret = lq && aq ? SR_OK : SR_ERR_MALLOC;
+
+	for (done = 0; ret == SR_OK && done < b->samples;
+			done += PACKET_SAMPLES)
+		ret = feed_queue_logic_submit_many(lq, b->logic, PACKET_SAMPLES);
+	if (ret == SR_OK)
+		ret = feed_queue_logic_flush(lq);
+	*items = done;
+	for (done = 0; ret == SR_OK && done < b->samples / 16; done += 64)
+		ret = feed_queue_analog_submit_one(aq,
+			b->analog[done % PACKET_SAMPLES], 64);
+	if (ret == SR_OK)
+		ret = feed_queue_analog_flush(aq);
+	*items += done;
+
+	feed_queue_logic_free(lq);
+	feed_queue_analog_free(aq);
+
+	return ret;
+}
+
+static void bench_transforms(struct bench *b)
+{
+	const struct sr_transform_module **tmods;
+	const struct sr_transform *t;
+	uint64_t items;
+	int64_t start;
+	int i, ret;
+
+	/* Without a transform first, to compare with. */
+	start = g_get_monotonic_time();
+	ret = send_through_session(b, &items);
+	record(b, "transform", "none", items, items,
+		g_get_monotonic_time() - start, ret);
+
+	tmods = sr_transform_list();
+	for (i = 0; tmods[i]; i++) {
+		t = sr_transform_new(tmods[i], NULL, b->sdi);
+		if (!t) {
+			record(b, "transform", sr_transform_id_get(tmods[i]),
+				0, 0, 0, SR_ERR);
+			continue;
+		}
+		start = g_get_monotonic_time();
+		ret = send_through_session(b, &items);
+		record(b, "transform", sr_transform_id_get(tmods[i]), items,
+			items, g_get_monotonic_time() - start, ret);
+		b->session->transforms = g_slist_remove(b->session->transforms,
+			(gpointer)t);
+		sr_transform_free(t);
+	}
+}
+
+static int output_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *keep,
+		uint64_t *bytes)
+{
+	GString *out;
+	int ret;
+
+	out = NULL;
+	ret = sr_output_send(o, packet, &out);
+	if (out) {
+		*bytes += out->len;
+		if (keep && keep->len + out->len <= FILE_DATA_MAX)
+			g_string_append_len(keep, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+
+	return ret;
+}
+
+static int run_output(struct bench *b, const struct sr_output *o,
+		GString *keep, uint64_t *items, uint64_t *bytes)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	uint64_t done, samples;
+	int ret;
+
+	samples = b->samples / FILE_DIVISOR;
+	*items = *bytes = 0;
+
+	header.feed_version = 1;
+	gettimeofday(&header.starttime, NULL);
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	ret = output_send(o, &packet, keep, bytes);
+
+	logic.length = PACKET_SAMPLES;
+	logic.unitsize = 1;
+	logic.data = b->logic;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	for (done = 0; ret == SR_OK && done < samples; done += PACKET_SAMPLES)
+		ret = output_send(o, &packet, keep, bytes);
+	*items += done;
+
+	analog_setup(&analog, &encoding, &meaning, &spec, b->analog_channels,
+		b->analog, PACKET_SAMPLES / 16, sizeof(float), TRUE, TRUE);
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	for (done = 0; ret == SR_OK && done < samples / 16;
+			done += analog.num_samples)
+		ret = output_send(o, &packet, keep, bytes);
+	*items += done;
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	if (ret == SR_OK)
+		ret = output_send(o, &packet, keep, bytes);
+
+	return ret;
+}
+
+static int run_input(struct bench *b, const struct sr_input_module *imod,
+		const GString *data, uint64_t *items)
+{
+	struct sr_session *session;
+	const struct sr_input *in;
+	struct sr_dev_inst *sdi;
+	GString *buf;
+	size_t offset, len;
+	int ret;
+
+	in = sr_input_new(imod, NULL);
+	if (!in)
+		return SR_ERR;
+	if ((ret = sr_session_new(b->ctx, &session)) != SR_OK) {
+		sr_input_free(in);
+		return ret;
+	}
+	sr_session_datafeed_callback_add(session, count_packet, NULL);
+
+	/* Same as a frontend: add the device once the module has one. */
+	recv_samples = 0;
+	sdi = NULL;
+	for (offset = 0; ret == SR_OK && offset < data->len; offset += len) {
+		len = MIN(INPUT_CHUNK, data->len - offset);
+		buf = g_string_new_len(data->str + offset, len);
+		ret = sr_input_send(in, buf);
+		g_string_free(buf, TRUE);
+		if (ret == SR_OK && !sdi && (sdi = sr_input_dev_inst_get(in)))
+			ret = sr_session_dev_add(session, sdi);
+	}
+	if (ret == SR_OK)
+		ret = sr_input_end(in);
+	*items = recv_samples;
+
+	sr_session_destroy(session);
+	sr_input_free(in);
+
+	return ret;
+}
+
+/*
+ * Every output module, and every input module on what the output
+ * module of the same name wrote.
+ */
+static void bench_files(struct bench *b)
+{
+	const struct sr_output_module **omods;
+	const struct sr_input_module *imod;
+	const struct sr_output *o;
+	const char *id;
+	GString *keep;
+	uint64_t items, bytes;
+	int64_t start;
+	int i, ret;
+
+	omods = sr_output_list();
+	for (i = 0; omods[i]; i++) {
+		id = sr_output_id_get(omods[i]);
+		if (sr_output_test_flag(omods[i], SR_OUTPUT_INTERNAL_IO_HANDLING)) {
+			fprintf(stderr, "%-14s %-18s skipped, writes files itself\n",
+				"output", id);
+			continue;
+		}
+		imod = sr_input_find(id);
+		keep = imod ? g_string_sized_new(FILE_DATA_MAX / 4) : NULL;
+
+		o = sr_output_new(omods[i], NULL, b->sdi, NULL);
+		if (!o) {
+			record(b, "output", id, 0, 0, 0, SR_ERR);
+			if (keep)
+				g_string_free(keep, TRUE);
+			continue;
+		}
+		start = g_get_monotonic_time();
+		ret = run_output(b, o, keep, &items, &bytes);
+		record(b, "output", id, items, bytes,
+			g_get_monotonic_time() - start, ret);
+		sr_output_free(o);
+
+		if (keep && ret == SR_OK && keep->len) {
+			start = g_get_monotonic_time();
+			ret = run_input(b, imod, keep, &items);
+			record(b, "input", id, items, keep->len,
+				g_get_monotonic_time() - start, ret);
+		}
+		if (keep)
+			g_string_free(keep, TRUE);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct bench b;
+	char name[8];
+	size_t i;
+
+	memset(&b, 0, sizeof(b));
+	b.samples = argc > 1 ? g_ascii_strtoull(argv[1], NULL, 10) : DEFAULT_SAMPLES;
+	b.samples = MAX(b.samples, PACKET_SAMPLES * FILE_DIVISOR);
+
+	if (sr_init(&b.ctx) != SR_OK)
+		return 1;
+	if (sr_session_new(b.ctx, &b.session) != SR_OK) {
+		sr_exit(b.ctx);
+		return 1;
+	}
+	b.sdi = sr_dev_inst_user_new("sigrok", "bench", NULL);
+	for (i = 0; i < NUM_LOGIC; i++) {
+		g_snprintf(name, sizeof(name), "D%zu", i);
+		sr_dev_inst_channel_add(b.sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	sr_dev_inst_channel_add(b.sdi, NUM_LOGIC, SR_CHANNEL_ANALOG, "A0");
+	b.analog_channels = g_slist_last(sr_dev_inst_channels_get(b.sdi));
+	sr_session_dev_add(b.session, b.sdi);
+	sr_session_datafeed_callback_add(b.session, count_packet, NULL);
+
+	/*
+	 * Logic data with edges on all channels at different rates, and
+	 * a triangle wave between -1 and 1 as the analog data.
+	 */
+	b.logic = g_malloc(PACKET_SAMPLES);
+	b.analog = g_malloc(PACKET_SAMPLES * sizeof(float));
+	for (i = 0; i < PACKET_SAMPLES; i++) {
+		b.logic[i] = (i / 3) ^ (i >> 9);
+		b.analog[i] = (float)(i % 200) / 100 - 1;
+	}
+
+	b.json = g_string_new(NULL);
+	b.first = TRUE;
+	g_string_append_printf(b.json, "{\n  \"version\": \"%s\",\n"
+		"  \"samples\": %" PRIu64 ",\n  \"benchmarks\": [",
+		sr_package_version_string_get(), b.samples);
+
+	bench_session(&b);
+	bench_feed_queue(&b);
+	bench_analog_to_float(&b);
+	bench_a2l(&b);
+	bench_trigger(&b);
+	bench_transforms(&b);
+	bench_files(&b);
+
+	g_string_append(b.json, "\n  ]\n}\n");
+	fputs(b.json->str, stdout);
+
+	g_string_free(b.json, TRUE);
+	g_free(b.analog);
+	g_free(b.logic);
+	sr_session_destroy(b.session);
+	sr_exit(b.ctx);
+
+	return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * C++ datafeed callback benchmark, not run as part of "make check".
+ *
+ * Runs the demo driver as fast as it goes, once with a per-packet
+ * datafeed callback and once with batched callbacks of various sizes,
+ * and reports the time per packet. Both callbacks touch the sample
+ * data, so the difference is the cost of the C++ wrapper objects.
+ *
+ *   tests/bench_cxx_datafeed [samples]
+ */
+
+#include <config.h>
+#include <cstdio>
+#include <cstdlib>
+#include <glib.h>
+#include <libsigrokcxx/libsigrokcxx.hpp>
+
+using namespace std;
+using namespace sigrok;
+
+static const uint64_t default_samples = 200 * 1000 * 1000;
+
+static shared_ptr<HardwareDevice> demo_dev(shared_ptr<Context> context)
+{
+	auto drivers = context->drivers();
+	auto it = drivers.find("demo");
+	if (it == drivers.end())
+		return nullptr;
+	auto devices = it->second->scan();
+	if (devices.empty())
+		return nullptr;
+	return devices.front();
+}
+
+static void report(const char *name, uint64_t packets, uint64_t bytes,
+	int64_t elapsed)
+{
+	printf("%-16s %8" G_GUINT64_FORMAT " packets, %10" G_GUINT64_FORMAT
+		" bytes, %8.1f ms, %7.1f ns/packet\n", name, packets, bytes,
+		elapsed / 1000.0, packets ? elapsed * 1000.0 / packets : 0.0);
+}
+
+static void run_single(shared_ptr<Context> context,
+	shared_ptr<HardwareDevice> device)
+{
+	uint64_t packets = 0, bytes = 0;
+
+	auto session = context->create_session();
+	session->add_device(device);
+	session->add_datafeed_callback([&] (shared_ptr<Device>,
+			shared_ptr<Packet> packet) {
+		packets++;
+		if (packet->type() == PacketType::LOGIC) {
+			auto logic = dynamic_pointer_cast<Logic>(packet->payload());
+			bytes += logic->data().size();
+		}
+	});
+
+	int64_t start = g_get_monotonic_time();
+	session->start();
+	session->run();
+	report("per packet", packets, bytes, g_get_monotonic_time() - start);
+	session->remove_datafeed_callbacks();
+	session->remove_devices();
+}
+
+static void run_batched(shared_ptr<Context> context,
+	shared_ptr<HardwareDevice> device, size_t max_packets)
+{
+	uint64_t packets = 0, bytes = 0;
+	char name[32];
+
+	auto session = context->create_session();
+	session->add_device(device);
+	session->add_datafeed_batch_callback([&] (shared_ptr<Device>,
+			const vector<PacketView> &views) {
+		packets += views.size();
+		for (auto &view : views)
+			bytes += view.data().size();
+	}, max_packets, 100 * 1000);
+
+	int64_t start = g_get_monotonic_time();
+	session->start();
+	session->run();
+	snprintf(name, sizeof(name), "batch of %zu", max_packets);
+	report(name, packets, bytes, g_get_monotonic_time() - start);
+	session->remove_datafeed_callbacks();
+	session->remove_devices();
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t samples;
+
+	samples = argc > 1 ? g_ascii_strtoull(argv[1], NULL, 10) : default_samples;
+
+	try {
+		auto context = Context::create();
+		auto device = demo_dev(context);
+		if (!device) {
+			fprintf(stderr, "Cannot find the demo device.\n");
+			return 1;
+		}
+		device->open();
+
+		/* Logic only, at the highest rate the demo device has. */
+		device->config_set(ConfigKey::SAMPLERATE,
+			Glib::Variant<guint64>::create(SR_GHZ(1)));
+		device->config_set(ConfigKey::LIMIT_SAMPLES,
+			Glib::Variant<guint64>::create(samples));
+		for (auto &channel : device->channels())
+			if (channel->type() == ChannelType::ANALOG)
+				channel->set_enabled(false);
+
+		run_single(context, device);
+		for (size_t max_packets = 1; max_packets <= 256; max_packets *= 4)
+			run_batched(context, device, max_packets);
+
+		device->close();
+	} catch (Error &e) {
+		fprintf(stderr, "Error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Feed queue repeat fill benchmark, not run as part of "make check".
+ *
+ * Submits runs of repeated samples to logic feed queues of several unit
+ * sizes and to an analog feed queue, and reports the time per sample
+ * for each run length. A shorter run first checks that the packets hold
+ * what was submitted, which is left out of the timed run.
+ *
+ *   tests/bench_feed_queue [samples]
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#define DEFAULT_SAMPLES	(256 * 1024 * 1024)
+#define CHECK_SAMPLES	(4 * 1024 * 1024)
+#define QUEUE_SAMPLES	(1024 * 1024)
+
+/* Sums of what the packets held, to compare with what was submitted. */
+static gboolean checking;
+static uint64_t recv_samples;
+static uint64_t recv_sum;
+
+static void check_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	const uint8_t *bytes;
+	const float *values;
+	uint64_t i;
+
+	(void)sdi;
+	(void)cb_data;
+
+	if (!checking)
+		return;
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		bytes = logic->data;
+		for (i = 0; i < logic->length; i++)
+			recv_sum += bytes[i];
+		recv_samples += logic->length / logic->unitsize;
+	} else if (packet->type == SR_DF_ANALOG) {
+		analog = packet->payload;
+		values = analog->data;
+		for (i = 0; i < analog->num_samples; i++)
+			recv_sum += (uint64_t)values[i];
+		recv_samples += analog->num_samples;
+	}
+}
+
+static int check_sums(uint64_t samples, uint64_t sum)
+{
+	if (!checking)
+		return SR_OK;
+	if (recv_samples == samples && recv_sum == sum)
+		return SR_OK;
+
+	fprintf(stderr, "Packets differ: %" PRIu64 " samples, sum %" PRIu64
+		", expected %" PRIu64 ", sum %" PRIu64 ".\n",
+		recv_samples, recv_sum, samples, sum);
+
+	return SR_ERR;
+}
+
+static void report(const char *what, size_t run_length, uint64_t samples,
+		int64_t elapsed)
+{
+	if (checking)
+		return;
+	printf("%-10s run %8zu, %10" PRIu64 " samples, %8.1f ms, "
+		"%6.3f ns/sample\n", what, run_length, samples,
+		elapsed / 1000.0, elapsed * 1000.0 / samples);
+}
+
+static int run_logic(struct sr_dev_inst *sdi, size_t unit_size,
+		size_t run_length, uint64_t samples)
+{
+	struct feed_queue_logic *q;
+	uint8_t value[8];
+	uint64_t done, sum;
+	int64_t start;
+	size_t i;
+	int ret;
+	char what[16];
+
+	q = feed_queue_logic_alloc(sdi, QUEUE_SAMPLES, unit_size);
+	if (!q)
+		return SR_ERR_MALLOC;
+	g_snprintf(what, sizeof(what), "logic/%zu", unit_size);
+
+	recv_samples = recv_sum = 0;
+	sum = 0;
+	ret = SR_OK;
+	start = g_get_monotonic_time();
+	for (done = 0; ret == SR_OK && done < samples; done += run_length) {
+		for (i = 0; i < unit_size; i++) {
+			value[i] = done / run_length + i;
+			sum += (uint64_t)value[i] * run_length;
+		}
+		ret = feed_queue_logic_submit_one(q, value, run_length);
+	}
+	if (ret == SR_OK)
+		ret = feed_queue_logic_flush(q);
+	report(what, run_length, done, g_get_monotonic_time() - start);
+	feed_queue_logic_free(q);
+	if (ret != SR_OK)
+		return ret;
+
+	return check_sums(done, sum);
+}
+
+static int run_analog(struct sr_dev_inst *sdi, struct sr_channel *ch,
+		size_t run_length, uint64_t samples)
+{
+	struct feed_queue_analog *q;
+	uint64_t done, sum;
+	int64_t start;
+	float value;
+	int ret;
+
+	q = feed_queue_analog_alloc(sdi, QUEUE_SAMPLES, 3, ch);
+	if (!q)
+		return SR_ERR_MALLOC;
+
+	recv_samples = recv_sum = 0;
+	sum = 0;
+	ret = SR_OK;
+	start = g_get_monotonic_time();
+	for (done = 0; ret == SR_OK && done < samples; done += run_length) {
+		value = (done / run_length) % 1000;
+		sum += (uint64_t)value * run_length;
+		ret = feed_queue_analog_submit_one(q, value, run_length);
+	}
+	if (ret == SR_OK)
+		ret = feed_queue_analog_flush(q);
+	report("analog", run_length, done, g_get_monotonic_time() - start);
+	feed_queue_analog_free(q);
+	if (ret != SR_OK)
+		return ret;
+
+	return check_sums(done, sum);
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t unit_sizes[] = { 1, 2, 3, 4, 8, };
+	static const size_t run_lengths[] = { 1, 16, 1024, 1024 * 1024, };
+	struct sr_context *ctx;
+	struct sr_session *session;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	uint64_t samples;
+	size_t i, j;
+	int ret;
+
+	samples = argc > 1 ? g_ascii_strtoull(argv[1], NULL, 10) : DEFAULT_SAMPLES;
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+	if (sr_session_new(ctx, &session) != SR_OK) {
+		sr_exit(ctx);
+		return 1;
+	}
+	sdi = sr_dev_inst_user_new("sigrok", "bench", NULL);
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_ANALOG, "A0");
+	ch = sr_dev_inst_channels_get(sdi)->data;
+	sr_session_dev_add(session, sdi);
+	sr_session_datafeed_callback_add(session, check_packet, NULL);
+
+	ret = SR_OK;
+	for (i = 0; ret == SR_OK && i < G_N_ELEMENTS(unit_sizes); i++) {
+		for (j = 0; ret == SR_OK && j < G_N_ELEMENTS(run_lengths); j++) {
+			checking = TRUE;
+			ret = run_logic(sdi, unit_sizes[i], run_lengths[j],
+				CHECK_SAMPLES);
+			checking = FALSE;
+			if (ret == SR_OK)
+				ret = run_logic(sdi, unit_sizes[i],
+					run_lengths[j], samples);
+		}
+	}
+	for (j = 0; ret == SR_OK && j < G_N_ELEMENTS(run_lengths); j++) {
+		checking = TRUE;
+		ret = run_analog(sdi, ch, run_lengths[j], CHECK_SAMPLES);
+		checking = FALSE;
+		if (ret == SR_OK)
+			ret = run_analog(sdi, ch, run_lengths[j], samples);
+	}
+
+	sr_session_destroy(session);
+	sr_exit(ctx);
+
+	return ret == SR_OK ? 0 : 1;
+}
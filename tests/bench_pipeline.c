@@ -0,0 +1,412 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * End to end pipeline benchmark, not run as part of "make check".
+ *
+ * Runs the demo device as fast as it goes, or replays a session file,
+ * through the given transforms into an output module, and writes what
+ * the output module makes to a file, /dev/null by default. Reports the
+ * throughput, the peak memory use and the time spent in each stage,
+ * from the session performance counters.
+ *
+ *   tests/bench_pipeline [-s samples] [-r samplerate] [-a]
+ *       [-i session.sr] [-t transform[:key=value...]]...
+ *       [-o output[:key=value...]] [-f file]
+ *
+ * For example, the demo device through the invert transform into a
+ * VCD file on a tmpfs:
+ *
+ *   tests/bench_pipeline -t invert -o vcd -f /dev/shm/bench.vcd
+ */
+
+#include <config.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+
+#define DEFAULT_SAMPLES	(200 * 1000 * 1000)
+
+static gint64 opt_samples = DEFAULT_SAMPLES;
+static gint64 opt_samplerate = SR_GHZ(1);
+static gboolean opt_analog;
+static gchar *opt_session;
+static gchar **opt_transforms;
+static gchar *opt_output = "binary";
+static gchar *opt_file;
+
+static const GOptionEntry entries[] = {
+	{ "samples", 's', 0, G_OPTION_ARG_INT64, &opt_samples,
+		"Number of samples from the demo device", "N" },
+	{ "samplerate", 'r', 0, G_OPTION_ARG_INT64, &opt_samplerate,
+		"Samplerate of the demo device", "HZ" },
+	{ "analog", 'a', 0, G_OPTION_ARG_NONE, &opt_analog,
+		"Keep the analog channels of the demo device", NULL },
+	{ "input-session", 'i', 0, G_OPTION_ARG_FILENAME, &opt_session,
+		"Replay a session file instead of the demo device", "FILE" },
+	{ "transform", 't', 0, G_OPTION_ARG_STRING_ARRAY, &opt_transforms,
+		"Transform module to run, can be repeated", "ID[:KEY=VALUE...]" },
+	{ "output", 'o', 0, G_OPTION_ARG_STRING, &opt_output,
+		"Output module, binary by default", "ID[:KEY=VALUE...]" },
+	{ "file", 'f', 0, G_OPTION_ARG_FILENAME, &opt_file,
+		"File to write, /dev/null by default", "FILE" },
+	{ NULL, 0, 0, 0, NULL, NULL, NULL },
+};
+
+struct pipeline {
+	struct sr_session *session;
+	const struct sr_output *o;
+	FILE *file;
+	uint64_t written;
+	int ret;
+};
+
+static void write_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct pipeline *p;
+	GString *out;
+	int ret;
+
+	(void)sdi;
+
+	p = cb_data;
+	if (p->ret != SR_OK)
+		return;
+
+	out = NULL;
+	ret = sr_output_send(p->o, packet, &out);
+	if (out) {
+		if (p->file && fwrite(out->str, 1, out->len, p->file) != out->len)
+			ret = SR_ERR_IO;
+		p->written += out->len;
+		g_string_free(out, TRUE);
+	}
+	if (ret != SR_OK) {
+		fprintf(stderr, "Output failed: %s.\n", sr_strerror(ret));
+		p->ret = ret;
+		sr_session_stop(p->session);
+	}
+}
+
+/*
+ * Options from "key=value" strings, each value parsed as the type of
+ * the option's default value.
+ */
+static GHashTable *module_options(const char *id, char **args,
+		const struct sr_option **opts)
+{
+	const GVariantType *type;
+	GHashTable *options;
+	GVariant *value;
+	char *eq;
+	int i, j;
+
+	options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	for (i = 0; args[i]; i++) {
+		value = NULL;
+		if ((eq = strchr(args[i], '=')))
+			*eq++ = '\0';
+		for (j = 0; eq && opts && opts[j]; j++) {
+			if (strcmp(opts[j]->id, args[i]))
+				continue;
+			type = g_variant_get_type(opts[j]->def);
+			if (g_variant_type_equal(type, G_VARIANT_TYPE_STRING))
+				value = g_variant_new_string(eq);
+			else
+				value = g_variant_parse(type, eq, NULL, NULL, NULL);
+			break;
+		}
+		if (!value) {
+			fprintf(stderr, "Bad option '%s' for '%s'.\n",
+				args[i], id);
+			g_hash_table_destroy(options);
+			return NULL;
+		}
+		g_hash_table_insert(options, g_strdup(args[i]),
+			g_variant_ref_sink(value));
+	}
+
+	return options;
+}
+
+/* Set up a transform from "id:key=value:key=value". */
+static const struct sr_transform *transform_new(const char *arg,
+		const struct sr_dev_inst *sdi)
+{
+	const struct sr_transform_module *tmod;
+	const struct sr_transform *t;
+	const struct sr_option **opts;
+	GHashTable *options;
+	char **parts;
+
+	parts = g_strsplit(arg, ":", 0);
+	t = NULL;
+	if ((tmod = sr_transform_find(parts[0]))) {
+		opts = sr_transform_options_get(tmod);
+		options = module_options(parts[0], parts + 1, opts);
+		sr_transform_options_free(opts);
+		if (options) {
+			t = sr_transform_new(tmod, options, sdi);
+			g_hash_table_destroy(options);
+		}
+	}
+	if (!t)
+		fprintf(stderr, "Cannot set up transform '%s'.\n", parts[0]);
+	g_strfreev(parts);
+
+	return t;
+}
+
+/* Set up an output from "id:key=value:key=value". */
+static const struct sr_output *output_new(const char *arg,
+		const struct sr_dev_inst *sdi, struct pipeline *p,
+		char **filename)
+{
+	const struct sr_output_module *omod;
+	const struct sr_output *o;
+	const struct sr_option **opts;
+	GHashTable *options;
+	char **parts;
+
+	parts = g_strsplit(arg, ":", 0);
+	o = NULL;
+	options = NULL;
+	if ((omod = sr_output_find(parts[0]))) {
+		opts = sr_output_options_get(omod);
+		options = module_options(parts[0], parts + 1, opts);
+		sr_output_options_free(opts);
+	}
+	if (!options) {
+		fprintf(stderr, "Cannot set up output '%s'.\n", parts[0]);
+		g_strfreev(parts);
+		return NULL;
+	}
+
+	if (sr_output_test_flag(omod, SR_OUTPUT_INTERNAL_IO_HANDLING)) {
+		/* The module writes the file itself, it needs a real one. */
+		*filename = opt_file ? g_strdup(opt_file) :
+			g_build_filename(g_get_tmp_dir(), "bench_pipeline.out", NULL);
+	} else if (!(p->file = fopen(opt_file ? opt_file : "/dev/null", "wb"))) {
+		fprintf(stderr, "Cannot open the output file.\n");
+	}
+	if (*filename || p->file)
+		o = sr_output_new(omod, options, sdi, *filename);
+	if (!o)
+		fprintf(stderr, "Cannot set up output '%s'.\n", parts[0]);
+	g_hash_table_destroy(options);
+	g_strfreev(parts);
+
+	return o;
+}
+
+static struct sr_dev_inst *demo_dev(struct sr_context *ctx)
+{
+	struct sr_dev_driver **drivers;
+	GSList *devs, *l;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	int i;
+
+	drivers = sr_driver_list(ctx);
+	for (i = 0; drivers && drivers[i]; i++) {
+		if (strcmp(drivers[i]->name, "demo"))
+			continue;
+		if (sr_driver_init(ctx, drivers[i]) != SR_OK)
+			return NULL;
+		devs = sr_driver_scan(drivers[i], NULL);
+		if (!devs)
+			return NULL;
+		sdi = devs->data;
+		g_slist_free(devs);
+		if (sr_dev_open(sdi) != SR_OK)
+			return NULL;
+		sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+			g_variant_new_uint64(opt_samplerate));
+		sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+			g_variant_new_uint64(opt_samples));
+		for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+			ch = l->data;
+			if (ch->type == SR_CHANNEL_ANALOG)
+				sr_dev_channel_enable(ch, opt_analog);
+		}
+		return sdi;
+	}
+
+	return NULL;
+}
+
+static double histogram_ms(const struct sr_stats_histogram *h)
+{
+	return h->total_us / 1000.0;
+}
+
+static void report(struct pipeline *p, struct sr_session_stats *stats,
+		int64_t elapsed, const struct rusage *ru_start,
+		const struct rusage *ru_end)
+{
+	const struct sr_stats_histogram *h;
+	uint64_t packets, bytes, stage_us;
+	double cpu_ms, wall_s;
+	GSList *l;
+	int i;
+
+	packets = bytes = 0;
+	for (i = 0; i < SR_DF_NUM_TYPES; i++) {
+		packets += stats->packets[i];
+		bytes += stats->bytes[i];
+	}
+	wall_s = elapsed / 1e6;
+	cpu_ms = (ru_end->ru_utime.tv_sec - ru_start->ru_utime.tv_sec) * 1e3
+		+ (ru_end->ru_utime.tv_usec - ru_start->ru_utime.tv_usec) / 1e3
+		+ (ru_end->ru_stime.tv_sec - ru_start->ru_stime.tv_sec) * 1e3
+		+ (ru_end->ru_stime.tv_usec - ru_start->ru_stime.tv_usec) / 1e3;
+
+	printf("%" PRIu64 " packets, %" PRIu64 " bytes in %.1f ms: "
+		"%.1f MB/s, %.0f packets/s\n", packets, bytes, elapsed / 1000.0,
+		bytes / 1e6 / wall_s, packets / wall_s);
+	printf("%" PRIu64 " bytes written, %.1f MB/s\n", p->written,
+		p->written / 1e6 / wall_s);
+	printf("CPU %.1f ms (%.0f %%), peak RSS %ld KiB\n", cpu_ms,
+		cpu_ms / 10.0 / wall_s, ru_end->ru_maxrss);
+
+	/* Driver time includes everything it sent, take that back out. */
+	stage_us = 0;
+	for (l = stats->transforms; l; l = l->next)
+		stage_us += ((struct sr_stats_histogram *)l->data)->total_us;
+	for (l = stats->callbacks; l; l = l->next)
+		stage_us += ((struct sr_stats_histogram *)l->data)->total_us;
+	printf("  %-24s %10.1f ms\n", "driver",
+		stats->source_dispatch.total_us > stage_us ?
+		(stats->source_dispatch.total_us - stage_us) / 1000.0 : 0.0);
+	for (l = stats->transforms, i = 0; l; l = l->next, i++) {
+		h = l->data;
+		printf("  transform %-14s %10.1f ms, max %" PRIu64 " us\n",
+			opt_transforms[i], histogram_ms(h), h->max_us);
+	}
+	for (l = stats->callbacks; l; l = l->next) {
+		h = l->data;
+		printf("  output %-17s %10.1f ms, max %" PRIu64 " us\n",
+			opt_output, histogram_ms(h), h->max_us);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct sr_context *ctx;
+	struct sr_session_stats *stats;
+	struct sr_dev_inst *sdi;
+	struct pipeline p;
+	struct rusage ru_start, ru_end;
+	GOptionContext *opt_ctx;
+	GError *error;
+	GSList *devs, *transforms, *l;
+	const struct sr_transform *t;
+	char *filename;
+	int64_t start, elapsed;
+	int i, ret;
+
+	error = NULL;
+	opt_ctx = g_option_context_new(NULL);
+	g_option_context_add_main_entries(opt_ctx, entries, NULL);
+	if (!g_option_context_parse(opt_ctx, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	g_option_context_free(opt_ctx);
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+
+	memset(&p, 0, sizeof(p));
+	sdi = NULL;
+	transforms = NULL;
+	filename = NULL;
+	ret = SR_ERR;
+
+	if (opt_session) {
+		if (sr_session_load(ctx, opt_session, &p.session) != SR_OK) {
+			fprintf(stderr, "Cannot load '%s'.\n", opt_session);
+			goto done;
+		}
+		devs = NULL;
+		sr_session_dev_list(p.session, &devs);
+		sdi = devs ? devs->data : NULL;
+		g_slist_free(devs);
+	} else {
+		if (!(sdi = demo_dev(ctx))) {
+			fprintf(stderr, "Cannot open the demo device.\n");
+			goto done;
+		}
+		sr_session_new(ctx, &p.session);
+		sr_session_dev_add(p.session, sdi);
+	}
+	if (!sdi)
+		goto done;
+
+	for (i = 0; opt_transforms && opt_transforms[i]; i++) {
+		if (!(t = transform_new(opt_transforms[i], sdi)))
+			goto done;
+		transforms = g_slist_append(transforms, (gpointer)t);
+	}
+	if (!(p.o = output_new(opt_output, sdi, &p, &filename)))
+		goto done;
+
+	sr_session_datafeed_callback_add(p.session, write_packet, &p);
+	sr_session_stats_enable(p.session, TRUE);
+
+	getrusage(RUSAGE_SELF, &ru_start);
+	start = g_get_monotonic_time();
+	if ((ret = sr_session_start(p.session)) == SR_OK)
+		ret = sr_session_run(p.session);
+	elapsed = g_get_monotonic_time() - start;
+	getrusage(RUSAGE_SELF, &ru_end);
+	if (ret == SR_OK)
+		ret = p.ret;
+
+	if (ret == SR_OK && sr_session_stats_get(p.session, &stats) == SR_OK) {
+		report(&p, stats, elapsed, &ru_start, &ru_end);
+		sr_session_stats_free(stats);
+	}
+
+done:
+	if (p.o)
+		sr_output_free(p.o);
+	if (p.file)
+		fclose(p.file);
+	if (filename && !opt_file)
+		g_unlink(filename);
+	g_free(filename);
+	for (l = transforms; l; l = l->next)
+		sr_transform_free(l->data);
+	g_slist_free(transforms);
+	if (p.session)
+		sr_session_destroy(p.session);
+	if (sdi && !opt_session)
+		sr_dev_close(sdi);
+	sr_exit(ctx);
+
+	return ret == SR_OK ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Session dispatch benchmark, not run as part of "make check".
+ *
+ * Runs the demo driver as fast as it goes with a number of trivial
+ * datafeed callbacks, and reports the time per packet. The difference
+ * between the runs is the cost of the session dispatch itself.
+ *
+ *   tests/bench_session [samples]
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+
+#define DEFAULT_SAMPLES	(200 * 1000 * 1000)
+#define MAX_CALLBACKS	16
+
+static uint64_t num_packets;
+
+static void count_packet(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	(void)sdi;
+	(void)packet;
+
+	if (cb_data)
+		num_packets++;
+}
+
+static struct sr_dev_inst *demo_dev(struct sr_context *ctx)
+{
+	struct sr_dev_driver **drivers;
+	GSList *devs;
+	struct sr_dev_inst *sdi;
+	int i;
+
+	drivers = sr_driver_list(ctx);
+	for (i = 0; drivers && drivers[i]; i++) {
+		if (strcmp(drivers[i]->name, "demo"))
+			continue;
+		if (sr_driver_init(ctx, drivers[i]) != SR_OK)
+			return NULL;
+		devs = sr_driver_scan(drivers[i], NULL);
+		if (!devs)
+			return NULL;
+		sdi = devs->data;
+		g_slist_free(devs);
+		return sdi;
+	}
+
+	return NULL;
+}
+
+static int run(struct sr_context *ctx, struct sr_dev_inst *sdi,
+		uint64_t samples, int callbacks, size_t depth)
+{
+	struct sr_session *session;
+	int64_t start, elapsed;
+	int i;
+
+	if (sr_session_new(ctx, &session) != SR_OK)
+		return SR_ERR;
+	sr_session_dev_add(session, sdi);
+	sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(samples));
+	sr_session_dispatch_async_set(session, depth, SR_DISPATCH_BLOCK);
+
+	/* Only the first callback counts, the others are pure overhead. */
+	for (i = 0; i < callbacks; i++)
+		sr_session_datafeed_callback_add(session, count_packet,
+			i ? NULL : session);
+
+	num_packets = 0;
+	start = g_get_monotonic_time();
+	if (sr_session_start(session) != SR_OK) {
+		sr_session_destroy(session);
+		return SR_ERR;
+	}
+	sr_session_run(session);
+	elapsed = g_get_monotonic_time() - start;
+	sr_session_destroy(session);
+
+	printf("%2d callbacks, %-12s %8" PRIu64 " packets, %8.1f ms, "
+		"%7.1f ns/packet\n", callbacks, depth ? "async" : "sync",
+		num_packets, elapsed / 1000.0,
+		num_packets ? elapsed * 1000.0 / num_packets : 0.0);
+
+	return SR_OK;
+}
+
+int main(int argc, char **argv)
+{
+	struct sr_context *ctx;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	GSList *l;
+	uint64_t samples;
+	int callbacks;
+
+	samples = argc > 1 ? g_ascii_strtoull(argv[1], NULL, 10) : DEFAULT_SAMPLES;
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+	if (!(sdi = demo_dev(ctx)) || sr_dev_open(sdi) != SR_OK) {
+		fprintf(stderr, "Cannot open the demo device.\n");
+		sr_exit(ctx);
+		return 1;
+	}
+	/* Logic only, at the highest rate the demo device has. */
+	sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(SR_GHZ(1)));
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_ANALOG)
+			sr_dev_channel_enable(ch, FALSE);
+	}
+
+	for (callbacks = 1; callbacks <= MAX_CALLBACKS; callbacks *= 4) {
+		run(ctx, sdi, samples, callbacks, 0);
+		run(ctx, sdi, samples, callbacks, 256);
+	}
+
+	sr_dev_close(sdi);
+	sr_exit(ctx);
+
+	return 0;
+}
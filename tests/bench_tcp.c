@@ -0,0 +1,225 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * TCP transport benchmark, not run as part of "make check".
+ *
+ * Runs a peer on the loopback interface in a thread, and reports:
+ * - Bulk download throughput through sr_tcp_read_bytes(), with the
+ *   default and with a large receive buffer.
+ * - Queries per second for commands which are written in two parts
+ *   before the response gets read, with and without TCP_NODELAY.
+ *   Nagle's algorithm holds the second part back until the first got
+ *   acknowledged, which the peer delays.
+ *
+ *   tests/bench_tcp [megabytes] [queries]
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+
+#if !defined _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define DEFAULT_MEGABYTES	1024
+#define DEFAULT_QUERIES		200
+#define CHUNK_SIZE		(64 * 1024)
+#define LARGE_RCVBUF		(4 * 1024 * 1024)
+
+#if !defined _WIN32
+
+struct peer {
+	int listen_fd;
+	char port[16];
+	uint64_t bulk_bytes;
+	size_t queries;
+};
+
+static int peer_listen(struct peer *peer)
+{
+	struct sockaddr_in addr;
+	socklen_t len;
+
+	peer->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (peer->listen_fd < 0)
+		return SR_ERR_IO;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	len = sizeof(addr);
+	if (bind(peer->listen_fd, (struct sockaddr *)&addr, len) < 0
+			|| listen(peer->listen_fd, 1) < 0
+			|| getsockname(peer->listen_fd,
+				(struct sockaddr *)&addr, &len) < 0) {
+		close(peer->listen_fd);
+		return SR_ERR_IO;
+	}
+	g_snprintf(peer->port, sizeof(peer->port), "%u", ntohs(addr.sin_port));
+
+	return SR_OK;
+}
+
+/* Send the bulk data, then answer every received newline. */
+static gpointer peer_thread(gpointer data)
+{
+	struct peer *peer;
+	uint8_t *buf;
+	uint64_t left;
+	size_t answered;
+	ssize_t n, i;
+	int fd;
+
+	peer = data;
+	buf = g_malloc0(CHUNK_SIZE);
+	fd = accept(peer->listen_fd, NULL, NULL);
+	if (fd < 0) {
+		g_free(buf);
+		return NULL;
+	}
+
+	for (left = peer->bulk_bytes; left; left -= n) {
+		n = send(fd, buf, MIN(left, CHUNK_SIZE), 0);
+		if (n <= 0)
+			break;
+	}
+	answered = 0;
+	while (answered < peer->queries) {
+		n = recv(fd, buf, CHUNK_SIZE, 0);
+		if (n <= 0)
+			break;
+		for (i = 0; i < n; i++) {
+			if (buf[i] != '\n')
+				continue;
+			if (send(fd, "1\n", 2, 0) != 2)
+				break;
+			answered++;
+		}
+	}
+
+	close(fd);
+	g_free(buf);
+
+	return NULL;
+}
+
+static int run(const char *what, const struct sr_tcp_options *opts,
+		uint64_t bulk_bytes, size_t queries)
+{
+	struct peer peer;
+	struct sr_tcp_dev_inst *tcp;
+	GThread *thread;
+	uint8_t *buf;
+	uint64_t got;
+	size_t i;
+	int64_t start, bulk_us, query_us;
+	int ret, n;
+
+	memset(&peer, 0, sizeof(peer));
+	peer.bulk_bytes = bulk_bytes;
+	peer.queries = queries;
+	if ((ret = peer_listen(&peer)) != SR_OK)
+		return ret;
+	thread = g_thread_new("peer", peer_thread, &peer);
+
+	tcp = sr_tcp_dev_inst_new("127.0.0.1", peer.port);
+	tcp->opts = *opts;
+	buf = g_malloc(CHUNK_SIZE);
+	ret = sr_tcp_connect(tcp);
+
+	start = g_get_monotonic_time();
+	for (got = 0; ret == SR_OK && got < bulk_bytes; got += n) {
+		n = sr_tcp_read_bytes(tcp, buf, CHUNK_SIZE, FALSE);
+		if (n <= 0)
+			ret = SR_ERR_IO;
+	}
+	bulk_us = g_get_monotonic_time() - start;
+
+	start = g_get_monotonic_time();
+	for (i = 0; ret == SR_OK && i < queries; i++) {
+		if (sr_tcp_write_bytes(tcp, (const uint8_t *)"MEAS:VOLT", 9) != 9
+				|| sr_tcp_write_bytes(tcp,
+					(const uint8_t *)"?\n", 2) != 2)
+			ret = SR_ERR_IO;
+		for (n = 0; ret == SR_OK && n < 2; ) {
+			ret = sr_tcp_read_bytes(tcp, buf + n, 2 - n, FALSE);
+			n += MAX(ret, 0);
+			ret = ret > 0 ? SR_OK : SR_ERR_IO;
+		}
+	}
+	query_us = g_get_monotonic_time() - start;
+
+	sr_tcp_dev_inst_free(tcp);
+	g_thread_join(thread);
+	close(peer.listen_fd);
+	g_free(buf);
+	if (ret != SR_OK) {
+		fprintf(stderr, "%s: Transfer failed.\n", what);
+		return ret;
+	}
+
+	printf("%-16s %8.1f MiB/s, %8.1f queries/s\n", what,
+		bulk_bytes / 1048576.0 / (MAX(bulk_us, 1) / 1e6),
+		queries / (MAX(query_us, 1) / 1e6));
+
+	return SR_OK;
+}
+
+int main(int argc, char **argv)
+{
+	struct sr_tcp_options opts;
+	uint64_t bulk_bytes;
+	size_t queries;
+	int ret;
+
+	bulk_bytes = (argc > 1 ? g_ascii_strtoull(argv[1], NULL, 10)
+		: DEFAULT_MEGABYTES) * 1024 * 1024;
+	queries = argc > 2 ? g_ascii_strtoull(argv[2], NULL, 10)
+		: DEFAULT_QUERIES;
+
+	memset(&opts, 0, sizeof(opts));
+	ret = run("defaults", &opts, bulk_bytes, queries);
+	if (ret == SR_OK) {
+		opts.rcvbuf = LARGE_RCVBUF;
+		ret = run("rcvbuf=4MiB", &opts, bulk_bytes, queries);
+	}
+	if (ret == SR_OK) {
+		opts.nodelay = TRUE;
+		ret = run("+nodelay", &opts, bulk_bytes, queries);
+	}
+
+	return ret == SR_OK ? 0 : 1;
+}
+
+#else
+
+int main(void)
+{
+	printf("Not supported on this platform.\n");
+
+	return 0;
+}
+
+#endif
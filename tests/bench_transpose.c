@@ -0,0 +1,138 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Bit transpose benchmark, not run as part of "make check".
+ *
+ * Converts channel major data the way the DSLogic (64 bit words, LSB
+ * first) and the Logic Pro (32 bit words, MSB first) send it, with 16
+ * and with 3 enabled channels, and reports the throughput of every
+ * kernel which the CPU supports. The former DSLogic loop is included
+ * as a baseline.
+ *
+ *   tests/bench_transpose [megabytes]
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "transpose.h"
+
+#define DEFAULT_MEGABYTES	256
+#define CHUNK_SIZE		(768 * 1024)
+
+/* What dreamsourcelab-dslogic used to do, bit by bit and word by word. */
+static void baseline(const struct sr_transpose *tp,
+	uint16_t *dst, const void *src, size_t num_blocks)
+{
+	const uint64_t *words;
+	size_t b;
+	unsigned int bit, c;
+	uint16_t sample;
+
+	words = src;
+	for (b = 0; b < num_blocks; b++, words += tp->num_words) {
+		for (bit = 0; bit < 64; bit++) {
+			sample = 0;
+			for (c = 0; c < tp->num_words; c++) {
+				if ((words[c] >> bit) & 1)
+					sample |= tp->lut[c / 8][1 << (c % 8)];
+			}
+			*dst++ = sample;
+		}
+	}
+}
+
+static void run(const char *what, sr_transpose_fn fn,
+	unsigned int word_bits, gboolean msb_first, unsigned int num_words,
+	const uint8_t *src, uint16_t *dst, uint64_t total)
+{
+	struct sr_transpose tp;
+	uint16_t word_masks[SR_TRANSPOSE_MAX_WORDS];
+	size_t num_blocks;
+	uint64_t done;
+	unsigned int n;
+	int64_t start, us;
+
+	/* Leave gaps in the channel bits, as with disabled channels. */
+	for (n = 0; n < num_words; n++)
+		word_masks[n] = 1 << (num_words < 16 ? 2 * n : n);
+	sr_transpose_init(&tp, word_bits, msb_first, word_masks, num_words);
+	if (fn)
+		tp.fn = fn;
+	num_blocks = CHUNK_SIZE / sr_transpose_block_bytes(&tp);
+
+	start = g_get_monotonic_time();
+	for (done = 0; done < total; done += CHUNK_SIZE)
+		sr_transpose_blocks(&tp, dst, src, num_blocks);
+	us = g_get_monotonic_time() - start;
+
+	printf("%2u x %2u bit %-4s %-8s %8.1f MiB/s\n", num_words, word_bits,
+		msb_first ? "msb" : "lsb", what,
+		total / 1048576.0 / (MAX(us, 1) / 1e6));
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		unsigned int word_bits;
+		gboolean msb_first;
+		unsigned int num_words;
+	} layouts[] = {
+		{ 64, FALSE, 16 },
+		{ 64, FALSE, 3 },
+		{ 32, TRUE, 16 },
+		{ 32, TRUE, 3 },
+	};
+	const struct sr_transpose_impl *impl;
+	uint8_t *src;
+	uint16_t *dst;
+	uint64_t total;
+	size_t i;
+
+	total = (argc > 1 ? g_ascii_strtoull(argv[1], NULL, 10)
+		: DEFAULT_MEGABYTES) * 1024 * 1024;
+
+	src = g_malloc(CHUNK_SIZE);
+	/* 3 channels expand most, 16 bit samples for 1 bit each. */
+	dst = g_malloc(CHUNK_SIZE * 16);
+	for (i = 0; i < CHUNK_SIZE; i++)
+		src[i] = g_random_int();
+
+	printf("Selected kernel: %s\n", sr_transpose_impl_get()->name);
+	for (i = 0; i < G_N_ELEMENTS(layouts); i++) {
+		if (layouts[i].word_bits == 64) {
+			run("baseline", baseline, 64, FALSE,
+				layouts[i].num_words, src, dst, total);
+		}
+		for (impl = sr_transpose_impls; impl->name; impl++) {
+			if (!impl->supported())
+				continue;
+			run(impl->name, impl->fn, layouts[i].word_bits,
+				layouts[i].msb_first, layouts[i].num_words,
+				src, dst, total);
+		}
+	}
+
+	g_free(dst);
+	g_free(src);
+
+	return 0;
+}
@@ -268,6 +268,193 @@ START_TEST(test_endian_write_inc)
 }
 END_TEST
 
+static void init_analog(struct sr_datafeed_analog *analog,
+		struct sr_analog_encoding *encoding,
+		struct sr_analog_meaning *meaning, struct sr_analog_spec *spec)
+{
+	memset(analog, 0, sizeof(*analog));
+	memset(encoding, 0, sizeof(*encoding));
+	analog->encoding = encoding;
+	analog->meaning = meaning;
+	analog->spec = spec;
+	encoding->unitsize = sizeof(float);
+	encoding->is_float = TRUE;
+#ifdef WORDS_BIGENDIAN
+	encoding->is_bigendian = TRUE;
+#endif
+	encoding->scale.p = 1;
+	encoding->scale.q = 1;
+	encoding->offset.q = 1;
+}
+
+/*
+ * Check packed bits from raw 16-bit values against the values which
+ * sr_analog_to_float() gives, for thresholds right at their steps.
+ */
+START_TEST(test_a2l_bits)
+{
+	static const float thresholds[][2] = {
+		{ -1.0, 1.0 }, { 0.3, 0.3 }, { -100.0, 100.0 }, { 2.0, -2.0 },
+	};
+	struct sr_datafeed_analog analog, analog_f;
+	struct sr_analog_encoding encoding, encoding_f;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_channel ch;
+	uint8_t raw[2 * 2003], bits[2003 / 8 + 1], bytes[2003];
+	uint8_t state_bits, state_bytes;
+	float values[2003];
+	unsigned int i, t;
+	int ret;
+
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	init_analog(&analog, &encoding, &meaning, &spec);
+	meaning.channels = g_slist_append(NULL, &ch);
+	encoding.unitsize = 2;
+	encoding.is_float = FALSE;
+	encoding.is_signed = TRUE;
+	encoding.is_bigendian = FALSE;
+	encoding.scale.p = 1;
+	encoding.scale.q = 10;
+	encoding.offset.p = 1;
+	encoding.offset.q = 5;
+	for (i = 0; i < ARRAY_SIZE(values); i++)
+		WL16(&raw[2 * i], (int16_t)((i * 37) % 4001 - 2000));
+	analog.data = raw;
+	analog.num_samples = ARRAY_SIZE(values);
+	ret = sr_analog_to_float(&analog, values);
+	fail_unless(ret == SR_OK);
+
+	/* The same values, as floats without scale. */
+	init_analog(&analog_f, &encoding_f, &meaning, &spec);
+	analog_f.data = values;
+	analog_f.num_samples = ARRAY_SIZE(values);
+
+	for (t = 0; t < ARRAY_SIZE(thresholds); t++) {
+		ret = sr_a2l_threshold_bits(&analog, thresholds[t][0],
+			bits, ARRAY_SIZE(values));
+		fail_unless(ret == SR_OK);
+		ret = sr_a2l_threshold(&analog_f, thresholds[t][0],
+			bytes, ARRAY_SIZE(values));
+		fail_unless(ret == SR_OK);
+		for (i = 0; i < ARRAY_SIZE(values); i++)
+			fail_unless(((bits[i / 8] >> (i % 8)) & 1) == bytes[i],
+				"Threshold %f differs at %u.", thresholds[t][0], i);
+
+		state_bits = state_bytes = 0;
+		ret = sr_a2l_schmitt_trigger_bits(&analog, thresholds[t][0],
+			thresholds[t][1], &state_bits, bits, ARRAY_SIZE(values));
+		fail_unless(ret == SR_OK);
+		ret = sr_a2l_schmitt_trigger(&analog_f, thresholds[t][0],
+			thresholds[t][1], &state_bytes, bytes, ARRAY_SIZE(values));
+		fail_unless(ret == SR_OK);
+		for (i = 0; i < ARRAY_SIZE(values); i++)
+			fail_unless(((bits[i / 8] >> (i % 8)) & 1) == bytes[i],
+				"Schmitt trigger %f/%f differs at %u.",
+				thresholds[t][0], thresholds[t][1], i);
+		fail_unless(state_bits == state_bytes);
+	}
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+/* Check that several channels end up in the bits of their index. */
+START_TEST(test_a2l_multi)
+{
+	static const float thresholds[] = { 0.0, 100.0, -50.0, };
+	struct sr_datafeed_analog analog[3];
+	const struct sr_datafeed_analog *analogs[3];
+	struct sr_analog_encoding encoding[3];
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_channel ch;
+	int8_t raw[3][1000];
+	uint8_t bits[3][1000 / 8], output[2 * 1000], state[3];
+	unsigned int i, c;
+	int ret;
+
+	memset(&meaning, 0, sizeof(meaning));
+	memset(&spec, 0, sizeof(spec));
+	meaning.channels = g_slist_append(NULL, &ch);
+	for (c = 0; c < 3; c++) {
+		init_analog(&analog[c], &encoding[c], &meaning, &spec);
+		encoding[c].unitsize = 1;
+		encoding[c].is_float = FALSE;
+		encoding[c].is_signed = TRUE;
+		for (i = 0; i < ARRAY_SIZE(raw[c]); i++)
+			raw[c][i] = (i * (c + 3) * 17) % 256 - 128;
+		analog[c].data = raw[c];
+		analog[c].num_samples = ARRAY_SIZE(raw[c]);
+		analogs[c] = &analog[c];
+		ret = sr_a2l_threshold_bits(&analog[c], thresholds[c],
+			bits[c], ARRAY_SIZE(raw[c]));
+		fail_unless(ret == SR_OK);
+	}
+
+	/* Bits above the channels are left alone. */
+	memset(output, 0xf0, sizeof(output));
+	ret = sr_a2l_threshold_multi(analogs, 3, thresholds, output, 2,
+		ARRAY_SIZE(raw[0]), 0);
+	fail_unless(ret == SR_OK, "sr_a2l_threshold_multi() failed: %d.", ret);
+	for (i = 0; i < ARRAY_SIZE(raw[0]); i++) {
+		fail_unless((output[2 * i] & 0xf8) == 0xf0);
+		fail_unless(output[2 * i + 1] == 0xf0);
+		for (c = 0; c < 3; c++)
+			fail_unless(((output[2 * i] >> c) & 1) ==
+				((bits[c][i / 8] >> (i % 8)) & 1),
+				"Channel %u differs at %u.", c, i);
+	}
+
+	memset(state, 0, sizeof(state));
+	ret = sr_a2l_schmitt_trigger_multi(analogs, 3, thresholds, thresholds,
+		state, output, 2, ARRAY_SIZE(raw[0]));
+	fail_unless(ret == SR_OK);
+	ret = sr_a2l_threshold_multi(analogs, 17, thresholds, output, 2,
+		ARRAY_SIZE(raw[0]), 0);
+	fail_unless(ret == SR_ERR_ARG);
+	g_slist_free(meaning.channels);
+}
+END_TEST
+
+/* Check that packed samples unpack to what they were packed from. */
+START_TEST(test_logic_packed)
+{
+	static const unsigned int bits[] = { 1, 2, 4, };
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_logic_packed *packed;
+	uint8_t samples[203], output[203];
+	unsigned int i, b, mask;
+	int ret;
+
+	logic.unitsize = 1;
+	logic.length = sizeof(samples);
+	logic.data = samples;
+	for (b = 0; b < ARRAY_SIZE(bits); b++) {
+		mask = (1 << bits[b]) - 1;
+		for (i = 0; i < sizeof(samples); i++)
+			samples[i] = (i * 37 + b) & 0xff;
+		ret = sr_logic_dense_to_packed(&logic, bits[b], &packed);
+		fail_unless(ret == SR_OK);
+		fail_unless(packed->num_samples == sizeof(samples));
+		/* A start within a byte, and a tail. */
+		ret = sr_logic_packed_to_dense(packed, 3, sizeof(samples) - 3,
+			output);
+		fail_unless(ret == SR_OK);
+		for (i = 3; i < sizeof(samples); i++)
+			fail_unless(output[i - 3] == (samples[i] & mask),
+				"%u bits differ at %u.", bits[b], i);
+		ret = sr_logic_packed_to_dense(packed, 1, sizeof(samples),
+			output);
+		fail_unless(ret == SR_ERR_ARG);
+		sr_logic_packed_free(packed);
+	}
+	fail_unless(sr_logic_dense_to_packed(&logic, 3, &packed) == SR_ERR_ARG);
+	logic.unitsize = 2;
+	fail_unless(sr_logic_dense_to_packed(&logic, 2, &packed) == SR_ERR_ARG);
+}
+END_TEST
+
 Suite *suite_conv(void)
 {
 	Suite *s;
@@ -284,5 +471,14 @@ Suite *suite_conv(void)
 	tcase_add_test(tc, test_endian_write_inc);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("a2l");
+	tcase_add_test(tc, test_a2l_bits);
+	tcase_add_test(tc, test_a2l_multi);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("logic");
+	tcase_add_test(tc, test_logic_packed);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -20,6 +20,7 @@
 #include <config.h>
 #include <check.h>
 #include <glib/gstdio.h>
+#include <unistd.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
 
@@ -308,6 +309,58 @@ START_TEST(test_input_binary_hello_world)
 }
 END_TEST
 
+START_TEST(test_input_binary_mapped)
+{
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	struct sr_session *session;
+	char *filename;
+	int fd, ret;
+
+	fd = g_file_open_tmp("sr-test-XXXXXX.bin", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create temporary file.");
+	close(fd);
+	fail_unless(g_file_set_contents(filename, "Hello world", 11, NULL));
+
+	df_packet_counter = sample_counter = 0;
+	have_seen_df_end = FALSE;
+	check_to_perform = CHECK_HELLO_WORLD;
+	expected_samples = 11;
+	expected_samplerate = NULL;
+
+	imod = sr_input_find("binary");
+	fail_unless(imod != NULL, "Failed to find input module.");
+	in = sr_input_new(imod, NULL);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	/* The first call only gets the device ready. */
+	ret = sr_input_send_mapped(in, filename);
+	fail_unless(ret == SR_OK, "sr_input_send_mapped() error: %d", ret);
+	fail_unless(sr_input_dev_inst_get(in) != NULL);
+	fail_unless(df_packet_counter == 0);
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, datafeed_in, NULL);
+	sr_session_dev_add(session, sr_input_dev_inst_get(in));
+
+	ret = sr_input_end(in);
+	fail_unless(ret == SR_OK, "sr_input_end() error: %d", ret);
+	fail_unless(have_seen_df_end, "No SR_DF_END was sent.");
+	fail_unless(sample_counter == 11);
+
+	ret = sr_input_send_mapped(in, "/nonexistent/file");
+	fail_unless(ret == SR_OK, "Mapping must be kept until reset.");
+	sr_input_reset(in);
+	ret = sr_input_send_mapped(in, "/nonexistent/file");
+	fail_unless(ret == SR_ERR, "Mapping a missing file must fail.");
+
+	sr_input_free(in);
+	sr_session_destroy(session);
+	g_unlink(filename);
+	g_free(filename);
+}
+END_TEST
+
 Suite *suite_input_binary(void)
 {
 	Suite *s;
@@ -321,6 +374,7 @@ Suite *suite_input_binary(void)
 	tcase_add_test(tc, test_input_binary_all_high);
 	tcase_add_loop_test(tc, test_input_binary_all_high_loop, 1, 10);
 	tcase_add_test(tc, test_input_binary_hello_world);
+	tcase_add_test(tc, test_input_binary_mapped);
 	suite_add_tcase(s, tc);
 
 	return s;
@@ -0,0 +1,153 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+/* Enough text for several parser chunks of the threaded mode. */
+#define CSV_LINES 80000
+
+static const char *analog_names[] = { "v0", "v1" };
+
+/* Logic and analog columns, the numbers in various notations. */
+static GString *csv_text(void)
+{
+	GString *s;
+	uint32_t lfsr;
+	int i;
+
+	s = g_string_new("d0,d1,v0,v1\n");
+	lfsr = 0xace1u;
+	for (i = 0; i < CSV_LINES; i++) {
+		lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xb400u);
+		g_string_append_printf(s, "%u,%u,", lfsr & 1, (lfsr >> 1) & 1);
+		switch (i % 4) {
+		case 0:
+			g_string_append_printf(s, "%u.%03u", lfsr >> 8, lfsr & 0x3ff);
+			break;
+		case 1:
+			g_string_append_printf(s, "-%ue-%u", lfsr, lfsr % 30);
+			break;
+		case 2:
+			g_string_append_printf(s, "0.%u%u", lfsr, lfsr * 7);
+			break;
+		default:
+			g_string_append_printf(s, "%ue%u", lfsr & 0xff, lfsr % 25);
+			break;
+		}
+		g_string_append_printf(s, ",%.9g\n", (double)lfsr / 3);
+	}
+
+	return s;
+}
+
+/* Import the text in pieces, which don't end at line boundaries. */
+static void csv_import(const GString *text, uint32_t threads,
+		struct srtest_feed *feed)
+{
+	const struct sr_input_module *imod;
+	struct sr_input *in;
+	struct sr_session *session;
+	GHashTable *options;
+	GString *piece;
+	size_t cuts[] = { 0, 1000, text->len / 2, text->len };
+	size_t i;
+
+	imod = sr_input_find("csv");
+	fail_unless(imod != NULL, "Failed to find input module.");
+	options = srtest_params(
+		"column_formats", g_variant_new_string("2l,2a"),
+		"threads", g_variant_new_uint32(threads),
+		NULL);
+	in = sr_input_new(imod, options);
+	g_hash_table_destroy(options);
+	fail_unless(in != NULL, "Failed to create input instance.");
+
+	sr_session_new(srtest_ctx, &session);
+	sr_session_datafeed_callback_add(session, srtest_feed_cb, feed);
+	for (i = 0; i + 1 < ARRAY_SIZE(cuts); i++) {
+		piece = g_string_new_len(text->str + cuts[i],
+			cuts[i + 1] - cuts[i]);
+		fail_unless(sr_input_send(in, piece) == SR_OK);
+		g_string_free(piece, TRUE);
+		/* The first piece only gets the device ready. */
+		if (i == 0) {
+			fail_unless(sr_input_dev_inst_get(in) != NULL);
+			sr_session_dev_add(session, sr_input_dev_inst_get(in));
+		}
+	}
+	fail_unless(sr_input_end(in) == SR_OK);
+	fail_unless(feed->ends == 1, "Got %d end packets.", feed->ends);
+
+	sr_input_free(in);
+	sr_session_destroy(session);
+}
+
+/* Parsing on threads sends the same samples as a single thread. */
+START_TEST(test_input_csv_threads)
+{
+	struct srtest_feed single, threaded;
+	struct srtest_trace *want, *got;
+	GString *text;
+	size_t i;
+
+	text = csv_text();
+	srtest_feed_init(&single);
+	srtest_feed_init(&threaded);
+	csv_import(text, 1, &single);
+	csv_import(text, 4, &threaded);
+
+	fail_unless(single.logic->len == CSV_LINES * single.unitsize,
+		"Got %u logic bytes.", single.logic->len);
+	fail_unless(threaded.unitsize == single.unitsize);
+	fail_unless(threaded.logic->len == single.logic->len);
+	fail_unless(!memcmp(threaded.logic->data, single.logic->data,
+		single.logic->len), "Logic samples differ.");
+	for (i = 0; i < ARRAY_SIZE(analog_names); i++) {
+		want = srtest_feed_trace(&single, analog_names[i]);
+		got = srtest_feed_trace(&threaded, analog_names[i]);
+		fail_unless(want && got, "No values for %s.", analog_names[i]);
+		fail_unless(want->values->len == CSV_LINES);
+		fail_unless(got->values->len == want->values->len);
+		fail_unless(!memcmp(got->values->data, want->values->data,
+			want->values->len * sizeof(float)),
+			"Channel %s differs.", analog_names[i]);
+	}
+
+	srtest_feed_free(&single);
+	srtest_feed_free(&threaded);
+	g_string_free(text, TRUE);
+}
+END_TEST
+
+Suite *suite_input_csv(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("input-csv");
+
+	tc = tcase_create("threads");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_input_csv_threads);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
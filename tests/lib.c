@@ -18,6 +18,8 @@
  */
 
 #include <config.h>
+#include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <glib.h>
@@ -90,6 +92,265 @@ void srtest_driver_init_all(struct sr_context *sr_ctx)
 	}
 }
 
+/* Scan and open a demo device, set up to send a number of samples. */
+struct sr_dev_inst *srtest_demo_dev(int num_logic, int num_analog,
+		uint64_t samplerate, uint64_t limit_samples)
+{
+	struct sr_dev_driver *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_config opts[2];
+	GSList *options, *devs;
+	int ret;
+
+	driver = srtest_driver_get("demo");
+	srtest_driver_init(srtest_ctx, driver);
+
+	opts[0].key = SR_CONF_NUM_LOGIC_CHANNELS;
+	opts[0].data = g_variant_ref_sink(g_variant_new_int32(num_logic));
+	opts[1].key = SR_CONF_NUM_ANALOG_CHANNELS;
+	opts[1].data = g_variant_ref_sink(g_variant_new_int32(num_analog));
+	options = g_slist_append(NULL, &opts[0]);
+	options = g_slist_append(options, &opts[1]);
+	devs = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(opts[0].data);
+	g_variant_unref(opts[1].data);
+	fail_unless(devs != NULL, "No demo device found.");
+	sdi = devs->data;
+	g_slist_free(devs);
+
+	ret = sr_dev_open(sdi);
+	fail_unless(ret == SR_OK, "Failed to open demo device: %d.", ret);
+	ret = sr_config_set(sdi, NULL, SR_CONF_SAMPLERATE,
+		g_variant_new_uint64(samplerate));
+	fail_unless(ret == SR_OK, "Failed to set samplerate: %d.", ret);
+	ret = sr_config_set(sdi, NULL, SR_CONF_LIMIT_SAMPLES,
+		g_variant_new_uint64(limit_samples));
+	fail_unless(ret == SR_OK, "Failed to set sample limit: %d.", ret);
+
+	return sdi;
+}
+
+/* Set a demo device's pattern on the channel group of that name. */
+void srtest_demo_pattern(const struct sr_dev_inst *sdi, const char *cg_name,
+		const char *pattern)
+{
+	struct sr_channel_group *cg;
+	GSList *l;
+	int ret;
+
+	for (l = sr_dev_inst_channel_groups_get(sdi); l; l = l->next) {
+		cg = l->data;
+		if (strcmp(cg->name, cg_name))
+			continue;
+		ret = sr_config_set(sdi, cg, SR_CONF_PATTERN_MODE,
+			g_variant_new_string(pattern));
+		fail_unless(ret == SR_OK, "Failed to set pattern '%s': %d.",
+			pattern, ret);
+		return;
+	}
+	fail("No channel group '%s'.", cg_name);
+}
+
+/*
+ * Options for an output or transform, as pairs of a name and a floating
+ * GVariant, ending with NULL.
+ */
+GHashTable *srtest_params(const char *key, ...)
+{
+	GHashTable *params;
+	GVariant *value;
+	va_list args;
+
+	params = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify)g_variant_unref);
+	va_start(args, key);
+	for (; key; key = va_arg(args, const char *)) {
+		value = va_arg(args, GVariant *);
+		g_hash_table_insert(params, g_strdup(key),
+			g_variant_ref_sink(value));
+	}
+	va_end(args);
+
+	return params;
+}
+
+static void trace_free(void *data)
+{
+	struct srtest_trace *trace;
+
+	trace = data;
+	g_array_free(trace->values, TRUE);
+	g_array_free(trace->frame_ends, TRUE);
+	g_free(trace);
+}
+
+void srtest_feed_init(struct srtest_feed *feed)
+{
+	memset(feed, 0, sizeof(*feed));
+	feed->logic = g_byte_array_new();
+	feed->traces = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, trace_free);
+}
+
+void srtest_feed_free(struct srtest_feed *feed)
+{
+	g_byte_array_free(feed->logic, TRUE);
+	g_hash_table_destroy(feed->traces);
+}
+
+/* Get the trace of an analog channel, NULL if it got no values. */
+struct srtest_trace *srtest_feed_trace(const struct srtest_feed *feed,
+		const char *name)
+{
+	return g_hash_table_lookup(feed->traces, name);
+}
+
+/* Get logic sample k, as a little endian number. */
+uint64_t srtest_feed_sample(const struct srtest_feed *feed, uint64_t k)
+{
+	uint64_t v;
+	int i;
+
+	v = 0;
+	for (i = feed->unitsize - 1; i >= 0; i--)
+		v = v << 8 | feed->logic->data[k * feed->unitsize + i];
+
+	return v;
+}
+
+static void feed_unitsize(struct srtest_feed *feed, uint16_t unitsize)
+{
+	fail_unless(unitsize > 0);
+	fail_unless(!feed->unitsize || feed->unitsize == unitsize,
+		"Unit size changed from %d to %d.", feed->unitsize, unitsize);
+	feed->unitsize = unitsize;
+}
+
+static void feed_rle(struct srtest_feed *feed,
+		const struct sr_datafeed_logic_rle *rle)
+{
+	const uint8_t *values;
+	uint64_t n, end, i;
+
+	feed_unitsize(feed, rle->unitsize);
+	fail_unless(rle->num_runs > 0 && rle->offsets[0] == 0);
+	values = rle->values;
+	for (n = 0; n < rle->num_runs; n++) {
+		end = n + 1 < rle->num_runs ?
+			rle->offsets[n + 1] : rle->num_samples;
+		fail_unless(rle->offsets[n] < end, "Empty run %" PRIu64 ".", n);
+		/* Runs list changes only. */
+		fail_unless(n == 0 || memcmp(values + n * rle->unitsize,
+			values + (n - 1) * rle->unitsize, rle->unitsize),
+			"Run %" PRIu64 " has the value of the one before.", n);
+		for (i = rle->offsets[n]; i < end; i++)
+			g_byte_array_append(feed->logic,
+				values + n * rle->unitsize, rle->unitsize);
+	}
+	feed->rle_packets++;
+	feed->rle_runs += rle->num_runs;
+}
+
+static void feed_analog(struct srtest_feed *feed,
+		const struct sr_datafeed_analog *analog)
+{
+	struct srtest_trace *trace;
+	struct sr_channel *ch;
+	float *values;
+	GSList *l;
+	unsigned int num_channels, i, c;
+
+	num_channels = g_slist_length(analog->meaning->channels);
+	values = g_malloc(analog->num_samples * num_channels * sizeof(float));
+	fail_unless(sr_analog_to_float(analog, values) == SR_OK);
+	for (l = analog->meaning->channels, c = 0; l; l = l->next, c++) {
+		ch = l->data;
+		trace = g_hash_table_lookup(feed->traces, ch->name);
+		if (!trace) {
+			trace = g_malloc0(sizeof(*trace));
+			trace->values = g_array_new(FALSE, FALSE, sizeof(float));
+			trace->frame_ends = g_array_new(FALSE, FALSE,
+				sizeof(unsigned int));
+			g_hash_table_insert(feed->traces, g_strdup(ch->name),
+				trace);
+		}
+		trace->is_float = analog->encoding->is_float;
+		trace->unitsize = analog->encoding->unitsize;
+		for (i = 0; i < analog->num_samples; i++)
+			g_array_append_val(trace->values,
+				values[i * num_channels + c]);
+	}
+	g_free(values);
+}
+
+/* Datafeed callback collecting what a run sends into a feed. */
+void srtest_feed_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct srtest_feed *feed;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_config *src;
+	struct srtest_trace *trace;
+	GHashTableIter iter;
+	GSList *l;
+	void *value;
+
+	(void)sdi;
+
+	feed = cb_data;
+	switch (packet->type) {
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key == SR_CONF_SAMPLERATE)
+				feed->samplerate = g_variant_get_uint64(src->data);
+		}
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		feed_unitsize(feed, logic->unitsize);
+		g_byte_array_append(feed->logic, logic->data, logic->length);
+		break;
+	case SR_DF_LOGIC_RLE:
+		feed_rle(feed, packet->payload);
+		break;
+	case SR_DF_ANALOG:
+		feed_analog(feed, packet->payload);
+		break;
+	case SR_DF_FRAME_END:
+		feed->frames++;
+		g_hash_table_iter_init(&iter, feed->traces);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			trace = value;
+			g_array_append_val(trace->frame_ends, trace->values->len);
+		}
+		break;
+	case SR_DF_END:
+		feed->ends++;
+		break;
+	default:
+		break;
+	}
+}
+
+/* Run a session, its datafeed callback collecting into the feed. */
+void srtest_feed_run(struct sr_session *sess, struct srtest_feed *feed)
+{
+	g_byte_array_set_size(feed->logic, 0);
+	g_hash_table_remove_all(feed->traces);
+	feed->unitsize = 0;
+	feed->rle_packets = feed->rle_runs = 0;
+	feed->frames = feed->ends = 0;
+	feed->samplerate = 0;
+
+	fail_unless(sr_session_start(sess) == SR_OK);
+	fail_unless(sr_session_run(sess) == SR_OK);
+	fail_unless(feed->ends == 1, "Got %d end packets.", feed->ends);
+}
+
 /* Set the samplerate for the respective driver to the specified value. */
 void srtest_set_samplerate(struct sr_dev_driver *driver, uint64_t samplerate)
 {
@@ -26,6 +26,29 @@
 
 extern struct sr_context *srtest_ctx;
 
+/* The values of an analog channel a run sent. */
+struct srtest_trace {
+	GArray *values;
+	/* Number of values at the end of each frame. */
+	GArray *frame_ends;
+	gboolean is_float;
+	int unitsize;
+};
+
+/* What a run sent, see srtest_feed_run(). */
+struct srtest_feed {
+	/* Logic samples, with those of SR_DF_LOGIC_RLE packets expanded. */
+	GByteArray *logic;
+	uint16_t unitsize;
+	uint64_t rle_packets;
+	uint64_t rle_runs;
+	/* By channel name. */
+	GHashTable *traces;
+	uint64_t samplerate;
+	int frames;
+	int ends;
+};
+
 void srtest_setup(void);
 void srtest_teardown(void);
 
@@ -34,6 +57,21 @@ struct sr_dev_driver *srtest_driver_get(const char *drivername);
 void srtest_driver_init(struct sr_context *sr_ctx, struct sr_dev_driver *driver);
 void srtest_driver_init_all(struct sr_context *sr_ctx);
 
+struct sr_dev_inst *srtest_demo_dev(int num_logic, int num_analog,
+		uint64_t samplerate, uint64_t limit_samples);
+void srtest_demo_pattern(const struct sr_dev_inst *sdi, const char *cg_name,
+		const char *pattern);
+GHashTable *srtest_params(const char *key, ...);
+
+void srtest_feed_init(struct srtest_feed *feed);
+void srtest_feed_free(struct srtest_feed *feed);
+struct srtest_trace *srtest_feed_trace(const struct srtest_feed *feed,
+		const char *name);
+uint64_t srtest_feed_sample(const struct srtest_feed *feed, uint64_t k);
+void srtest_feed_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data);
+void srtest_feed_run(struct sr_session *sess, struct srtest_feed *feed);
+
 void srtest_set_samplerate(struct sr_dev_driver *driver, uint64_t samplerate);
 uint64_t srtest_get_samplerate(struct sr_dev_driver *driver);
 void srtest_check_samplerate(struct sr_context *sr_ctx, const char *drivername,
@@ -45,6 +83,7 @@ Suite *suite_core(void);
 Suite *suite_driver_all(void);
 Suite *suite_input_all(void);
 Suite *suite_input_binary(void);
+Suite *suite_input_csv(void);
 Suite *suite_output_all(void);
 Suite *suite_transform_all(void);
 Suite *suite_session(void);
@@ -54,5 +93,10 @@ Suite *suite_device(void);
 Suite *suite_trigger(void);
 Suite *suite_analog(void);
 Suite *suite_conv(void);
+Suite *suite_slogic_unpack(void);
+Suite *suite_transpose(void);
+Suite *suite_stream(void);
+Suite *suite_scpi_hislip(void);
+Suite *suite_modbus_regmap(void);
 
 #endif
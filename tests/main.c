@@ -37,6 +37,7 @@ int main(void)
 	srunner_add_suite(srunner, suite_driver_all());
 	srunner_add_suite(srunner, suite_input_all());
 	srunner_add_suite(srunner, suite_input_binary());
+	srunner_add_suite(srunner, suite_input_csv());
 	srunner_add_suite(srunner, suite_output_all());
 	srunner_add_suite(srunner, suite_transform_all());
 	srunner_add_suite(srunner, suite_session());
@@ -46,6 +47,11 @@ int main(void)
 	srunner_add_suite(srunner, suite_trigger());
 	srunner_add_suite(srunner, suite_analog());
 	srunner_add_suite(srunner, suite_conv());
+	srunner_add_suite(srunner, suite_slogic_unpack());
+	srunner_add_suite(srunner, suite_transpose());
+	srunner_add_suite(srunner, suite_stream());
+	srunner_add_suite(srunner, suite_scpi_hislip());
+	srunner_add_suite(srunner, suite_modbus_regmap());
 
 	srunner_run_all(srunner, CK_VERBOSE);
 	ret = srunner_ntests_failed(srunner);
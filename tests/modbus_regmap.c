@@ -0,0 +1,185 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+
+/* Declared ranges, and the requests they are expected to take. */
+struct plan_case {
+	int max_gap;
+	/* Address and count pairs, ended by a count of 0. */
+	int ranges[8][2];
+	int requests[8][2];
+};
+
+static const struct plan_case plan_cases[] = {
+	/* One range. */
+	{ 0, { { 10, 3 } }, { { 10, 3 } } },
+	/* Adjacent ranges merge without a gap, in any order. */
+	{ 0, { { 13, 2 }, { 10, 3 } }, { { 10, 5 } } },
+	/* One register apart. */
+	{ 0, { { 10, 3 }, { 14, 1 } }, { { 10, 3 }, { 14, 1 } } },
+	{ 1, { { 10, 3 }, { 14, 1 } }, { { 10, 5 } } },
+	/* Overlapping and contained ranges. */
+	{ 0, { { 10, 5 }, { 12, 6 }, { 13, 1 } }, { { 10, 8 } } },
+	{ 0, { { 10, 2 }, { 10, 6 } }, { { 10, 6 } } },
+	/* A chain of ranges, each within the gap of the one before. */
+	{ 2, { { 0, 1 }, { 3, 1 }, { 6, 1 }, { 20, 2 } },
+		{ { 0, 7 }, { 20, 2 } } },
+	/* Requests don't exceed 125 registers. */
+	{ 10, { { 0, 100 }, { 100, 26 } }, { { 0, 100 }, { 100, 26 } } },
+	{ 10, { { 0, 100 }, { 105, 20 } }, { { 0, 125 } } },
+	{ 10, { { 0, 125 }, { 125, 1 } }, { { 0, 125 }, { 125, 1 } } },
+	/* The last addresses. */
+	{ 0, { { 0xffff, 1 }, { 0xfff0, 15 } }, { { 0xfff0, 16 } } },
+};
+
+static struct sr_modbus_regmap *plan_new(const struct plan_case *c)
+{
+	struct sr_modbus_regmap *map;
+	int i;
+
+	map = sr_modbus_regmap_new(c->max_gap);
+	for (i = 0; c->ranges[i][1]; i++) {
+		fail_unless(sr_modbus_regmap_add(map, c->ranges[i][0],
+			c->ranges[i][1]) == SR_OK);
+	}
+	sr_modbus_regmap_plan(map);
+
+	return map;
+}
+
+START_TEST(test_regmap_plan)
+{
+	const struct plan_case *c;
+	const struct sr_modbus_range *req;
+	struct sr_modbus_regmap *map;
+	size_t offset;
+	unsigned int i;
+	int n;
+
+	c = &plan_cases[_i];
+	map = plan_new(c);
+	for (n = 0; c->requests[n][1]; n++)
+		;
+	fail_unless(map->requests->len == (unsigned int)n,
+		"Case %d: %u requests, expected %d.", _i, map->requests->len, n);
+	offset = 0;
+	for (i = 0; i < map->requests->len; i++) {
+		req = &g_array_index(map->requests, struct sr_modbus_range, i);
+		fail_unless(req->address == c->requests[i][0] &&
+			req->nb_registers == c->requests[i][1],
+			"Case %d: request %u reads %d/%d, expected %d/%d.", _i,
+			i, req->address, req->nb_registers,
+			c->requests[i][0], c->requests[i][1]);
+		fail_unless(req->offset == offset);
+		offset += req->nb_registers;
+	}
+	sr_modbus_regmap_free(map);
+}
+END_TEST
+
+/* The values of each declared range are found where their request puts them. */
+START_TEST(test_regmap_get)
+{
+	const struct plan_case *c;
+	const struct sr_modbus_range *req;
+	struct sr_modbus_regmap *map;
+	const uint16_t *values;
+	unsigned int i;
+	int j, k;
+
+	c = &plan_cases[_i];
+	map = plan_new(c);
+	/* Fill in each register's address, like a read would. */
+	for (i = 0; i < map->requests->len; i++) {
+		req = &g_array_index(map->requests, struct sr_modbus_range, i);
+		for (k = 0; k < req->nb_registers; k++)
+			map->values[req->offset + k] = req->address + k;
+	}
+	for (j = 0; c->ranges[j][1]; j++) {
+		values = sr_modbus_regmap_get(map, c->ranges[j][0],
+			c->ranges[j][1]);
+		fail_unless(values != NULL, "Case %d: no range %d.", _i, j);
+		for (k = 0; k < c->ranges[j][1]; k++)
+			fail_unless(values[k] == (uint16_t)(c->ranges[j][0] + k));
+	}
+	sr_modbus_regmap_free(map);
+}
+END_TEST
+
+START_TEST(test_regmap_get_unread)
+{
+	struct sr_modbus_regmap *map;
+
+	map = sr_modbus_regmap_new(1);
+	fail_unless(sr_modbus_regmap_get(map, 10, 1) == NULL);
+	sr_modbus_regmap_add(map, 10, 3);
+	sr_modbus_regmap_add(map, 20, 3);
+	sr_modbus_regmap_plan(map);
+	fail_unless(sr_modbus_regmap_get(map, 10, 3) != NULL);
+	fail_unless(sr_modbus_regmap_get(map, 11, 2) != NULL);
+	fail_unless(sr_modbus_regmap_get(map, 9, 2) == NULL);
+	fail_unless(sr_modbus_regmap_get(map, 12, 2) == NULL);
+	fail_unless(sr_modbus_regmap_get(map, 15, 1) == NULL);
+	/* Both ranges, but not in one request. */
+	fail_unless(sr_modbus_regmap_get(map, 10, 13) == NULL);
+
+	/* Adding a range drops the plan until it's made again. */
+	sr_modbus_regmap_add(map, 14, 5);
+	fail_unless(map->requests->len == 0);
+	sr_modbus_regmap_plan(map);
+	fail_unless(sr_modbus_regmap_get(map, 10, 13) != NULL);
+	sr_modbus_regmap_free(map);
+}
+END_TEST
+
+START_TEST(test_regmap_add_invalid)
+{
+	struct sr_modbus_regmap *map;
+
+	map = sr_modbus_regmap_new(0);
+	fail_unless(sr_modbus_regmap_add(NULL, 0, 1) == SR_ERR_ARG);
+	fail_unless(sr_modbus_regmap_add(map, -1, 1) == SR_ERR_ARG);
+	fail_unless(sr_modbus_regmap_add(map, 0, 0) == SR_ERR_ARG);
+	fail_unless(sr_modbus_regmap_add(map, 0, 126) == SR_ERR_ARG);
+	fail_unless(sr_modbus_regmap_add(map, 0xffff, 2) == SR_ERR_ARG);
+	fail_unless(map->ranges->len == 0);
+	sr_modbus_regmap_free(map);
+	sr_modbus_regmap_free(NULL);
+}
+END_TEST
+
+Suite *suite_modbus_regmap(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("modbus-regmap");
+
+	tc = tcase_create("plan");
+	tcase_add_loop_test(tc, test_regmap_plan, 0, ARRAY_SIZE(plan_cases));
+	tcase_add_loop_test(tc, test_regmap_get, 0, ARRAY_SIZE(plan_cases));
+	tcase_add_test(tc, test_regmap_get_unread);
+	tcase_add_test(tc, test_regmap_add_invalid);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -19,7 +19,10 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <check.h>
+#include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
 
@@ -96,6 +99,766 @@ START_TEST(test_output_options)
 }
 END_TEST
 
+/* Check the columnar output's layout, for bitplanes of logic channels. */
+START_TEST(test_output_columnar)
+{
+	static const uint8_t samples[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, };
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	GString *out;
+	char *filename, *spool, *contents;
+	gsize len;
+	uint64_t header_len;
+	int fd, ret, i;
+
+	fd = g_file_open_tmp("sr-test-XXXXXX.srcol", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create temporary file.");
+	close(fd);
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_LOGIC, "D0");
+	sr_dev_inst_channel_add(sdi, 1, SR_CHANNEL_LOGIC, "D1");
+	o = sr_output_new(sr_output_find("columnar"), NULL, sdi, filename);
+	fail_unless(o != NULL, "Failed to create output instance.");
+
+	logic.length = sizeof(samples);
+	logic.unitsize = 1;
+	logic.data = (void *)samples;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "Sending logic data failed: %d.", ret);
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	ret = sr_output_send(o, &packet, &out);
+	fail_unless(ret == SR_OK, "Sending the end failed: %d.", ret);
+	sr_output_free(o);
+
+	/* Header in the first page, a page per column. */
+	fail_unless(g_file_get_contents(filename, &contents, &len, NULL));
+	fail_unless(len == 2 * 4096 + 2, "Wrong file size %zu.", len);
+	fail_unless(memcmp(contents, "SRCOLUMN", 8) == 0);
+	header_len = 0;
+	for (i = 7; i >= 0; i--)
+		header_len = header_len << 8 | (uint8_t)contents[8 + i];
+	fail_unless(16 + header_len <= 4096);
+	fail_unless(g_strstr_len(contents + 16, header_len,
+		"\"name\": \"D1\", \"type\": \"logic\", \"encoding\": \"bitplane\"") != NULL);
+	fail_unless(g_strstr_len(contents + 16, header_len,
+		"\"samples\": 10, \"offset\": 8192, \"size\": 2}") != NULL);
+	fail_unless((uint8_t)contents[4096] == 0xaa && contents[4097] == 0x02);
+	fail_unless((uint8_t)contents[8192] == 0xcc && contents[8193] == 0x00);
+	g_free(contents);
+
+	spool = g_strdup_printf("%s.0.tmp", filename);
+	fail_unless(!g_file_test(spool, G_FILE_TEST_EXISTS),
+		"Column file was not removed.");
+	g_free(spool);
+	g_unlink(filename);
+	g_free(filename);
+}
+END_TEST
+
+static int append_output(const struct sr_output_iov *iov, size_t iovcnt,
+		void *cb_data)
+{
+	size_t i;
+
+	for (i = 0; i < iovcnt; i++)
+		g_string_append_len(cb_data, iov[i].data, iov[i].len);
+
+	return SR_OK;
+}
+
+/* Check that writing by callback gives the same output as GStrings do. */
+START_TEST(test_output_send_iov)
+{
+	static const uint8_t samples[] = { 0x12, 0x34, 0x56, 0x78, };
+	static const int types[] = {
+		SR_DF_HEADER, SR_DF_LOGIC, SR_DF_TRIGGER, SR_DF_LOGIC, SR_DF_END,
+	};
+	static const char *ids[] = { "binary", "chronovu-la8", "ols", };
+	const struct sr_output *o, *o_iov;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_logic logic;
+	GString *out, *all, *all_iov;
+	unsigned int i, j;
+	int ret;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_LOGIC, "D0");
+
+	header.feed_version = 1;
+	logic.length = sizeof(samples);
+	logic.unitsize = 1;
+	logic.data = (void *)samples;
+
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		o = sr_output_new(sr_output_find((char *)ids[i]), NULL, sdi, NULL);
+		o_iov = sr_output_new(sr_output_find((char *)ids[i]), NULL, sdi, NULL);
+		fail_unless(o && o_iov, "Failed to create %s output.", ids[i]);
+		all = g_string_new(NULL);
+		all_iov = g_string_new(NULL);
+		for (j = 0; j < G_N_ELEMENTS(types); j++) {
+			packet.type = types[j];
+			packet.payload = NULL;
+			if (types[j] == SR_DF_HEADER)
+				packet.payload = &header;
+			else if (types[j] == SR_DF_LOGIC)
+				packet.payload = &logic;
+			ret = sr_output_send(o, &packet, &out);
+			fail_unless(ret == SR_OK, "Sending to %s failed.", ids[i]);
+			if (out) {
+				g_string_append_len(all, out->str, out->len);
+				g_string_free(out, TRUE);
+			}
+			ret = sr_output_send_iov(o_iov, &packet, append_output, all_iov);
+			fail_unless(ret == SR_OK, "Writing %s failed.", ids[i]);
+		}
+		fail_unless(all->len > 0, "No %s output.", ids[i]);
+		fail_unless(g_string_equal(all, all_iov), "%s output differs.", ids[i]);
+		g_string_free(all, TRUE);
+		g_string_free(all_iov, TRUE);
+		sr_output_free(o);
+		sr_output_free(o_iov);
+	}
+}
+END_TEST
+
+/* Check that pass-through outputs take sample data without packets. */
+START_TEST(test_output_write_samples)
+{
+	static const uint8_t samples[] = { 0x12, 0x34, 0x56, 0x78, };
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	GString *all;
+	int ret;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_LOGIC, "D0");
+
+	fail_unless(sr_output_test_flag(sr_output_find("binary"),
+		SR_OUTPUT_PASSTHROUGH_LOGIC), "binary is no pass-through.");
+	fail_unless(!sr_output_test_flag(sr_output_find("ols"),
+		SR_OUTPUT_PASSTHROUGH_LOGIC), "ols is a pass-through.");
+
+	all = g_string_new(NULL);
+	o = sr_output_new(sr_output_find("binary"), NULL, sdi, NULL);
+	ret = sr_output_write_samples(o, samples, sizeof(samples),
+		append_output, all);
+	fail_unless(ret == SR_OK, "Writing samples failed.");
+	fail_unless(all->len == sizeof(samples) &&
+		memcmp(all->str, samples, sizeof(samples)) == 0,
+		"Output differs from the samples.");
+	sr_output_free(o);
+
+	o = sr_output_new(sr_output_find("ols"), NULL, sdi, NULL);
+	ret = sr_output_write_samples(o, samples, sizeof(samples),
+		append_output, all);
+	fail_unless(ret == SR_ERR_NA, "ols took samples without packets.");
+	sr_output_free(o);
+	g_string_free(all, TRUE);
+}
+END_TEST
+
+/* Check that a group feeds each output as sending to it directly does. */
+START_TEST(test_output_group)
+{
+	static const uint8_t samples[] = { 0x12, 0x34, 0x56, 0x78, };
+	static const int types[] = {
+		SR_DF_HEADER, SR_DF_LOGIC, SR_DF_TRIGGER, SR_DF_LOGIC, SR_DF_END,
+	};
+	static const char *ids[] = { "binary", "ols", };
+	const struct sr_output *o[G_N_ELEMENTS(ids)], *o_group[G_N_ELEMENTS(ids)];
+	struct sr_output_group *group;
+	struct sr_output_group_stats stats;
+	struct sr_dev_inst *sdi;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_logic logic;
+	GString *out, *all[G_N_ELEMENTS(ids)], *all_group[G_N_ELEMENTS(ids)];
+	unsigned int i, j;
+	int ret;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_dev_inst_channel_add(sdi, 0, SR_CHANNEL_LOGIC, "D0");
+
+	header.feed_version = 1;
+	logic.length = sizeof(samples);
+	logic.unitsize = 1;
+	logic.data = (void *)samples;
+
+	ret = sr_output_group_new(&group);
+	fail_unless(ret == SR_OK, "Failed to create output group.");
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		o[i] = sr_output_new(sr_output_find((char *)ids[i]), NULL, sdi, NULL);
+		o_group[i] = sr_output_new(sr_output_find((char *)ids[i]), NULL, sdi, NULL);
+		fail_unless(o[i] && o_group[i], "Failed to create %s output.", ids[i]);
+		all[i] = g_string_new(NULL);
+		all_group[i] = g_string_new(NULL);
+		ret = sr_output_group_add(group, o_group[i], append_output, all_group[i]);
+		fail_unless(ret == SR_OK, "Failed to add %s output.", ids[i]);
+	}
+
+	for (j = 0; j < G_N_ELEMENTS(types); j++) {
+		packet.type = types[j];
+		packet.payload = NULL;
+		if (types[j] == SR_DF_HEADER)
+			packet.payload = &header;
+		else if (types[j] == SR_DF_LOGIC)
+			packet.payload = &logic;
+		ret = sr_output_group_send(group, &packet);
+		fail_unless(ret == SR_OK, "Sending to the group failed.");
+		for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+			ret = sr_output_send(o[i], &packet, &out);
+			fail_unless(ret == SR_OK, "Sending to %s failed.", ids[i]);
+			if (out) {
+				g_string_append_len(all[i], out->str, out->len);
+				g_string_free(out, TRUE);
+			}
+		}
+	}
+
+	/* Freeing the group waits for the outputs to finish. */
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		ret = sr_output_group_stats(group, o_group[i], &stats);
+		fail_unless(ret == SR_OK, "No statistics for %s.", ids[i]);
+		fail_unless(stats.error == SR_OK, "%s output failed.", ids[i]);
+	}
+	ret = sr_output_group_free(group);
+	fail_unless(ret == SR_OK, "Output group failed.");
+
+	for (i = 0; i < G_N_ELEMENTS(ids); i++) {
+		fail_unless(all[i]->len > 0, "No %s output.", ids[i]);
+		fail_unless(g_string_equal(all[i], all_group[i]),
+			"%s output differs.", ids[i]);
+		g_string_free(all[i], TRUE);
+		g_string_free(all_group[i], TRUE);
+		sr_output_free(o[i]);
+		sr_output_free(o_group[i]);
+	}
+}
+END_TEST
+
+#define SRZIP_SAMPLES (64 * 1024)
+#define SRZIP_CHANNELS 12
+
+/* Logic channels D0 to D11 and analog channel A0. */
+static struct sr_dev_inst *srzip_dev(void)
+{
+	struct sr_dev_inst *sdi;
+	char name[8];
+	int i;
+
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	for (i = 0; i < SRZIP_CHANNELS; i++) {
+		g_snprintf(name, sizeof(name), "D%d", i);
+		sr_dev_inst_channel_add(sdi, i, SR_CHANNEL_LOGIC, name);
+	}
+	sr_dev_inst_channel_add(sdi, SRZIP_CHANNELS, SR_CHANNEL_ANALOG, "A0");
+
+	return sdi;
+}
+
+static void srzip_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet)
+{
+	GString *out;
+	int ret;
+
+	ret = sr_output_send(o, packet, &out);
+	fail_unless(ret == SR_OK, "Sending packet %d failed: %d.",
+		packet->type, ret);
+	if (out)
+		g_string_free(out, TRUE);
+}
+
+/*
+ * Write samples from start to end as packets of varying sizes, logic
+ * and analog in turns, and the end of the feed.
+ */
+static void srzip_write(const struct sr_output *o, struct sr_dev_inst *sdi,
+		const uint8_t *logic_data, const float *analog_data,
+		unsigned int start, unsigned int end)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_config src;
+	unsigned int i, n;
+
+	if (!start) {
+		src.key = SR_CONF_SAMPLERATE;
+		src.data = g_variant_ref_sink(g_variant_new_uint64(SR_MHZ(1)));
+		meta.config = g_slist_append(NULL, &src);
+		packet.type = SR_DF_META;
+		packet.payload = &meta;
+		srzip_send(o, &packet);
+		g_slist_free(meta.config);
+		g_variant_unref(src.data);
+	}
+
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 3);
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	meaning.channels = g_slist_append(NULL,
+		g_slist_nth_data(sr_dev_inst_channels_get(sdi), SRZIP_CHANNELS));
+	logic.unitsize = 2;
+
+	for (i = start; i < end; i += n) {
+		n = MIN(end - i, 1 + (i * 7919) % 3000);
+		logic.length = n * logic.unitsize;
+		logic.data = (void *)(logic_data + i * logic.unitsize);
+		packet.type = SR_DF_LOGIC;
+		packet.payload = &logic;
+		srzip_send(o, &packet);
+		analog.data = (void *)(analog_data + i);
+		analog.num_samples = n;
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		srzip_send(o, &packet);
+	}
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	srzip_send(o, &packet);
+	g_slist_free(meaning.channels);
+}
+
+/* Load an archive as a session, check that it has the samples. */
+static void srzip_check(const char *filename, const uint8_t *logic_data,
+		const float *analog_data)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct srtest_feed feed;
+	struct srtest_trace *trace;
+	GSList *devs;
+	GVariant *gvar;
+	int ret;
+
+	ret = sr_session_load(srtest_ctx, filename, &sess);
+	fail_unless(ret == SR_OK, "Failed to load %s: %d.", filename, ret);
+	fail_unless(sr_session_dev_list(sess, &devs) == SR_OK && devs);
+	sdi = devs->data;
+	g_slist_free(devs);
+	ret = sr_config_get(sr_dev_inst_driver_get(sdi), sdi, NULL,
+		SR_CONF_SAMPLERATE, &gvar);
+	fail_unless(ret == SR_OK, "No samplerate: %d.", ret);
+	fail_unless(g_variant_get_uint64(gvar) == SR_MHZ(1));
+	g_variant_unref(gvar);
+
+	srtest_feed_init(&feed);
+	sr_session_datafeed_callback_add(sess, srtest_feed_cb, &feed);
+	srtest_feed_run(sess, &feed);
+	sr_session_destroy(sess);
+
+	fail_unless(feed.unitsize == 2, "Unit size %d.", feed.unitsize);
+	fail_unless(feed.logic->len == SRZIP_SAMPLES * 2,
+		"Got %u bytes of logic data.", feed.logic->len);
+	fail_unless(memcmp(feed.logic->data, logic_data,
+		SRZIP_SAMPLES * 2) == 0, "Logic data differs.");
+	trace = srtest_feed_trace(&feed, "A0");
+	fail_unless(trace != NULL, "No analog data.");
+	fail_unless(trace->values->len == SRZIP_SAMPLES,
+		"Got %u analog values.", trace->values->len);
+	fail_unless(memcmp(trace->values->data, analog_data,
+		SRZIP_SAMPLES * sizeof(float)) == 0, "Analog data differs.");
+	srtest_feed_free(&feed);
+}
+
+static void srzip_data(uint8_t **logic_data, float **analog_data)
+{
+	unsigned int i;
+
+	*logic_data = g_malloc(SRZIP_SAMPLES * 2);
+	*analog_data = g_malloc(SRZIP_SAMPLES * sizeof(float));
+	for (i = 0; i < SRZIP_SAMPLES; i++) {
+		/* Runs of a few samples, so that compression has work. */
+		(*logic_data)[2 * i] = (i / 3) ^ (i >> 9);
+		(*logic_data)[2 * i + 1] = (i >> 6) & 0x0f;
+		(*analog_data)[i] = (float)(i % 1000) / 8 - 60;
+	}
+}
+
+/*
+ * Check that the streaming srzip writer gives archives which load with
+ * the samples written, with each compression method it lists, in many
+ * chunks, and when more data follows the end of the feed.
+ */
+START_TEST(test_output_srzip)
+{
+	const struct sr_output_module *omod;
+	const struct sr_output *o;
+	const struct sr_option **opts;
+	struct sr_dev_inst *sdi;
+	GHashTable *params;
+	GSList *l;
+	uint8_t *logic_data;
+	float *analog_data;
+	char *filename;
+	const char *method;
+	int fd;
+
+	srzip_data(&logic_data, &analog_data);
+	sdi = srzip_dev();
+	omod = sr_output_find("srzip");
+	fail_unless(omod != NULL);
+	fd = g_file_open_tmp("sr-test-XXXXXX.sr", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create temporary file.");
+	close(fd);
+
+	opts = sr_output_options_get(omod);
+	fail_unless(!strcmp(opts[0]->id, "compression"));
+	for (l = opts[0]->values; l; l = l->next) {
+		method = g_variant_get_string(l->data, NULL);
+		params = srtest_params("compression",
+			g_variant_new_string(method),
+			"chunksize", g_variant_new_uint64(4096),
+			"threads", g_variant_new_uint32(1), NULL);
+
+		g_unlink(filename);
+		o = sr_output_new(omod, params, sdi, filename);
+		fail_unless(o != NULL, "Failed to create %s output.", method);
+		srzip_write(o, sdi, logic_data, analog_data, 0, SRZIP_SAMPLES);
+		sr_output_free(o);
+		srzip_check(filename, logic_data, analog_data);
+
+		/* Writing on after the end replaces the metadata. */
+		g_unlink(filename);
+		o = sr_output_new(omod, params, sdi, filename);
+		fail_unless(o != NULL, "Failed to create %s output.", method);
+		srzip_write(o, sdi, logic_data, analog_data, 0,
+			SRZIP_SAMPLES / 3);
+		srzip_write(o, sdi, logic_data, analog_data,
+			SRZIP_SAMPLES / 3, SRZIP_SAMPLES);
+		sr_output_free(o);
+		srzip_check(filename, logic_data, analog_data);
+
+		g_hash_table_destroy(params);
+	}
+	sr_output_options_free(opts);
+
+	g_unlink(filename);
+	g_free(filename);
+	g_free(logic_data);
+	g_free(analog_data);
+}
+END_TEST
+
+static void srzip_write_file(const char *filename, GHashTable *params,
+		struct sr_dev_inst *sdi, const uint8_t *logic_data,
+		const float *analog_data)
+{
+	const struct sr_output *o;
+
+	g_unlink(filename);
+	o = sr_output_new(sr_output_find("srzip"), params, sdi, filename);
+	fail_unless(o != NULL, "Failed to create output.");
+	srzip_write(o, sdi, logic_data, analog_data, 0, SRZIP_SAMPLES);
+	sr_output_free(o);
+}
+
+/*
+ * Check that compressing chunks on several threads gives archives of
+ * the same size as on one, which load with the samples written.
+ */
+START_TEST(test_output_srzip_threads)
+{
+	static const uint32_t threads[] = { 4, 0, };
+	const struct sr_option **opts;
+	struct sr_dev_inst *sdi;
+	GHashTable *params;
+	GStatBuf st;
+	GSList *l;
+	uint8_t *logic_data;
+	float *analog_data;
+	char *filename;
+	const char *method;
+	goffset size;
+	unsigned int i;
+	int fd;
+
+	srzip_data(&logic_data, &analog_data);
+	sdi = srzip_dev();
+	fd = g_file_open_tmp("sr-test-XXXXXX.sr", &filename, NULL);
+	fail_unless(fd >= 0, "Failed to create temporary file.");
+	close(fd);
+
+	opts = sr_output_options_get(sr_output_find("srzip"));
+	for (l = opts[0]->values; l; l = l->next) {
+		method = g_variant_get_string(l->data, NULL);
+		params = srtest_params("compression",
+			g_variant_new_string(method),
+			"chunksize", g_variant_new_uint64(4096),
+			"threads", g_variant_new_uint32(1), NULL);
+		srzip_write_file(filename, params, sdi, logic_data,
+			analog_data);
+		g_hash_table_destroy(params);
+		fail_unless(g_stat(filename, &st) == 0);
+		size = st.st_size;
+
+		for (i = 0; i < G_N_ELEMENTS(threads); i++) {
+			params = srtest_params("compression",
+				g_variant_new_string(method),
+				"chunksize", g_variant_new_uint64(4096),
+				"threads", g_variant_new_uint32(threads[i]),
+				NULL);
+			srzip_write_file(filename, params, sdi, logic_data,
+				analog_data);
+			g_hash_table_destroy(params);
+			fail_unless(g_stat(filename, &st) == 0);
+			fail_unless(st.st_size == size,
+				"%s on %u threads: %" G_GOFFSET_FORMAT
+				" bytes, %" G_GOFFSET_FORMAT " on one.",
+				method, threads[i], (goffset)st.st_size, size);
+			srzip_check(filename, logic_data, analog_data);
+		}
+	}
+	sr_output_options_free(opts);
+
+	g_unlink(filename);
+	g_free(filename);
+	g_free(logic_data);
+	g_free(analog_data);
+}
+END_TEST
+
+#define VCD_SAMPLES 20000
+
+static void vcd_send(const struct sr_output *o,
+		const struct sr_datafeed_packet *packet, GString *all)
+{
+	GString *out;
+	int ret;
+
+	ret = sr_output_send(o, packet, &out);
+	fail_unless(ret == SR_OK, "Sending packet %d failed: %d.",
+		packet->type, ret);
+	if (out) {
+		g_string_append_len(all, out->str, out->len);
+		g_string_free(out, TRUE);
+	}
+}
+
+/*
+ * Feed the samples as packets of varying sizes, logic data as runs
+ * when asked to, analog data when A0 is enabled. Returns the text.
+ */
+static GString *vcd_write(const struct sr_output *o, struct sr_dev_inst *sdi,
+		uint64_t samplerate, const uint8_t *logic_data,
+		const float *analog_data, gboolean rle_feed)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_datafeed_logic_rle rle;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	struct sr_channel *ch;
+	struct sr_config src;
+	GString *all;
+	const uint8_t *p;
+	unsigned int i, j, n;
+
+	all = g_string_new(NULL);
+	src.key = SR_CONF_SAMPLERATE;
+	src.data = g_variant_ref_sink(g_variant_new_uint64(samplerate));
+	meta.config = g_slist_append(NULL, &src);
+	packet.type = SR_DF_META;
+	packet.payload = &meta;
+	vcd_send(o, &packet, all);
+	g_slist_free(meta.config);
+	g_variant_unref(src.data);
+
+	ch = g_slist_nth_data(sr_dev_inst_channels_get(sdi), SRZIP_CHANNELS);
+	sr_analog_init(&analog, &encoding, &meaning, &spec, 3);
+	meaning.mq = SR_MQ_VOLTAGE;
+	meaning.unit = SR_UNIT_VOLT;
+	meaning.channels = g_slist_append(NULL, ch);
+	logic.unitsize = 2;
+	rle.unitsize = 2;
+	rle.offsets = g_new(uint64_t, 3000);
+	rle.values = g_malloc(3000 * 2);
+
+	for (i = 0; i < VCD_SAMPLES; i += n) {
+		n = MIN(VCD_SAMPLES - i, 1 + (i * 7919) % 3000);
+		if (rle_feed) {
+			rle.num_samples = n;
+			rle.num_runs = 0;
+			for (j = 0; j < n; j++) {
+				p = logic_data + (i + j) * 2;
+				if (j && !memcmp(p, p - 2, 2))
+					continue;
+				rle.offsets[rle.num_runs] = j;
+				memcpy((uint8_t *)rle.values + rle.num_runs * 2,
+					p, 2);
+				rle.num_runs++;
+			}
+			packet.type = SR_DF_LOGIC_RLE;
+			packet.payload = &rle;
+		} else {
+			logic.length = n * logic.unitsize;
+			logic.data = (void *)(logic_data + i * logic.unitsize);
+			packet.type = SR_DF_LOGIC;
+			packet.payload = &logic;
+		}
+		vcd_send(o, &packet, all);
+		if (!ch->enabled)
+			continue;
+		analog.data = (void *)(analog_data + i);
+		analog.num_samples = n;
+		packet.type = SR_DF_ANALOG;
+		packet.payload = &analog;
+		vcd_send(o, &packet, all);
+	}
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	vcd_send(o, &packet, all);
+	g_slist_free(meaning.channels);
+	g_free(rle.offsets);
+	g_free(rle.values);
+
+	return all;
+}
+
+/*
+ * The value changes expected after the header, sample by sample. For
+ * logic only, changes follow the timestamp each with its own space.
+ * With analog data they are queued, and get joined by spaces.
+ */
+static GString *vcd_expect(const uint8_t *logic_data, const float *analog_data,
+		uint64_t ts_mul, uint16_t mask, gboolean with_analog)
+{
+	GString *s, *changes;
+	char ident[SRZIP_CHANNELS + 1];
+	uint16_t value, prev, diff;
+	unsigned int i, bit, pos;
+	const char *sep;
+
+	pos = 0;
+	for (bit = 0; bit < SRZIP_CHANNELS; bit++) {
+		if (mask & (1 << bit))
+			ident[bit] = '!' + pos++;
+	}
+	ident[SRZIP_CHANNELS] = '!' + pos;
+
+	s = g_string_new(NULL);
+	changes = g_string_new(NULL);
+	prev = 0;
+	for (i = 0; i < VCD_SAMPLES; i++) {
+		value = logic_data[2 * i] | logic_data[2 * i + 1] << 8;
+		diff = (i ? value ^ prev : 0xffff) & mask;
+		prev = value;
+		g_string_truncate(changes, 0);
+		for (bit = 0; bit < SRZIP_CHANNELS; bit++) {
+			if (!(diff & (1 << bit)))
+				continue;
+			sep = with_analog && !changes->len ? "" : " ";
+			g_string_append_printf(changes, "%s%c%c", sep,
+				(value >> bit) & 1 ? '1' : '0', ident[bit]);
+		}
+		if (with_analog && (!i || analog_data[i] != analog_data[i - 1])) {
+			sep = changes->len ? " " : "";
+			g_string_append_printf(changes, "%sr%.16g %c", sep,
+				(double)analog_data[i], ident[SRZIP_CHANNELS]);
+		}
+		if (changes->len)
+			g_string_append_printf(s, "\n#%" G_GUINT64_FORMAT " %s",
+				i * ts_mul, changes->str);
+	}
+	g_string_append_printf(s, "\n#%" G_GUINT64_FORMAT "\n",
+		VCD_SAMPLES * ts_mul);
+	g_string_free(changes, TRUE);
+
+	return s;
+}
+
+/*
+ * Check the VCD output's value changes and timestamps against the
+ * samples, for logic data and for logic runs, alone and mixed with
+ * analog data, at a samplerate which needs a finer timescale.
+ */
+START_TEST(test_output_vcd)
+{
+	static const uint64_t samplerates[] = { SR_MHZ(1), SR_MHZ(400), };
+	static const uint64_t ts_muls[] = { 1, 25, };
+	static const char *timescales[] = {
+		"$timescale 1 us $end", "$timescale 100 ps $end",
+	};
+	static const char *enddefs = "$enddefinitions $end\n";
+	const struct sr_output *o;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *a0;
+	GSList *channels;
+	GString *all, *expect;
+	uint8_t *logic_data;
+	float *analog_data;
+	const char *body;
+	unsigned int i, j;
+	int with_analog, rle_feed;
+
+	logic_data = g_malloc(VCD_SAMPLES * 2);
+	analog_data = g_malloc(VCD_SAMPLES * sizeof(float));
+	for (i = 0; i < VCD_SAMPLES; i++) {
+		/* Bits past the channels change too, they don't count. */
+		logic_data[2 * i] = (i / 3) ^ (i >> 9);
+		logic_data[2 * i + 1] = (i >> 6) & 0xff;
+		analog_data[i] = (float)((i / 4) % 50) / 8 - 3;
+	}
+
+	/* D5 is disabled, D6 and later take the identifiers up. */
+	sdi = srzip_dev();
+	channels = sr_dev_inst_channels_get(sdi);
+	sr_dev_channel_enable(g_slist_nth_data(channels, 5), FALSE);
+	a0 = g_slist_nth_data(channels, SRZIP_CHANNELS);
+
+	for (with_analog = 0; with_analog <= 1; with_analog++) {
+		sr_dev_channel_enable(a0, with_analog);
+		for (i = 0; i < G_N_ELEMENTS(samplerates); i++) {
+			expect = vcd_expect(logic_data, analog_data, ts_muls[i],
+				0x0fff & ~(1 << 5), with_analog);
+			for (rle_feed = 0; rle_feed <= 1; rle_feed++) {
+				o = sr_output_new(sr_output_find("vcd"), NULL,
+					sdi, NULL);
+				fail_unless(o != NULL, "Failed to create output.");
+				all = vcd_write(o, sdi, samplerates[i],
+					logic_data, analog_data, rle_feed);
+				sr_output_free(o);
+
+				fail_unless(strstr(all->str, timescales[i]) != NULL,
+					"Wrong timescale.");
+				fail_unless(strstr(all->str,
+					"$var wire 1 & D6 $end") != NULL);
+				body = strstr(all->str, enddefs);
+				fail_unless(body != NULL, "No header.");
+				body += strlen(enddefs);
+				for (j = 0; body[j] && body[j] == expect->str[j]; j++)
+					;
+				fail_unless(!body[j] && j == expect->len,
+					"Output differs at %u (analog %d, rate %"
+					G_GUINT64_FORMAT ", runs %d).",
+					j, with_analog, samplerates[i], rle_feed);
+				g_string_free(all, TRUE);
+			}
+			g_string_free(expect, TRUE);
+		}
+	}
+
+	g_free(logic_data);
+	g_free(analog_data);
+}
+END_TEST
+
 Suite *suite_output_all(void)
 {
 	Suite *s;
@@ -112,5 +875,33 @@ Suite *suite_output_all(void)
 	tcase_add_test(tc, test_output_options);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("columnar");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_columnar);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("srzip");
+	tcase_set_timeout(tc, 0);
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_srzip);
+	tcase_add_test(tc, test_output_srzip_threads);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("vcd");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_vcd);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("send_iov");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_send_iov);
+	tcase_add_test(tc, test_output_write_samples);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("group");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_output_group);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
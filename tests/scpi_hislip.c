@@ -0,0 +1,367 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <inttypes.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "lib.h"
+
+#if !defined _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define HEADER_SIZE	16
+#define SESSION_ID	0x1234
+#define FIRST_MESSAGE_ID 0xffffff00
+/* Small enough for the client to split its commands. */
+#define MAX_MESSAGE	4
+
+enum {
+	INITIALIZE = 0,
+	INITIALIZE_RESPONSE = 1,
+	DATA = 6,
+	DATA_END = 7,
+	ASYNC_MAX_MESSAGE_SIZE = 15,
+	ASYNC_MAX_MESSAGE_SIZE_RESPONSE = 16,
+	ASYNC_INITIALIZE = 17,
+	ASYNC_INITIALIZE_RESPONSE = 18,
+};
+
+#if !defined _WIN32
+
+/* A message as the server received it. */
+struct message {
+	uint8_t type;
+	uint8_t control;
+	uint32_t param;
+	GString *payload;
+};
+
+/* A HiSLIP server on the loopback interface, in a thread. */
+struct server {
+	int listen_fd;
+	char port[16];
+	/* Both connections' messages, in the order they arrived. */
+	GPtrArray *messages;
+	int queries;
+};
+
+static void message_free(void *data)
+{
+	struct message *msg;
+
+	msg = data;
+	g_string_free(msg->payload, TRUE);
+	g_free(msg);
+}
+
+static void put_be32(uint8_t *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static gboolean read_all(int fd, void *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = read(fd, buf, len);
+		if (ret <= 0)
+			return FALSE;
+		buf = (uint8_t *)buf + ret;
+		len -= ret;
+	}
+
+	return TRUE;
+}
+
+static void message_send(int fd, uint8_t type, uint8_t control,
+		uint32_t param, const char *payload, size_t len)
+{
+	uint8_t hdr[HEADER_SIZE];
+
+	hdr[0] = 'H';
+	hdr[1] = 'S';
+	hdr[2] = type;
+	hdr[3] = control;
+	put_be32(&hdr[4], param);
+	put_be32(&hdr[8], 0);
+	put_be32(&hdr[12], len);
+	fail_unless(write(fd, hdr, sizeof(hdr)) == sizeof(hdr));
+	if (len)
+		fail_unless(write(fd, payload, len) == (ssize_t)len);
+}
+
+static struct message *message_receive(struct server *server, int fd)
+{
+	struct message *msg;
+	uint8_t hdr[HEADER_SIZE];
+	uint64_t len;
+
+	if (!read_all(fd, hdr, sizeof(hdr)))
+		return NULL;
+	fail_unless(hdr[0] == 'H' && hdr[1] == 'S', "Invalid header.");
+	msg = g_malloc0(sizeof(*msg));
+	msg->type = hdr[2];
+	msg->control = hdr[3];
+	msg->param = get_be32(&hdr[4]);
+	len = (uint64_t)get_be32(&hdr[8]) << 32 | get_be32(&hdr[12]);
+	fail_unless(len < 1024, "Message of %" PRIu64 " bytes.", len);
+	msg->payload = g_string_sized_new(len);
+	g_string_set_size(msg->payload, len);
+	fail_unless(read_all(fd, msg->payload->str, len));
+	g_ptr_array_add(server->messages, msg);
+
+	return msg;
+}
+
+static int server_accept(struct server *server)
+{
+	int fd;
+
+	fd = accept(server->listen_fd, NULL, NULL);
+	fail_unless(fd >= 0, "Cannot accept the connection.");
+
+	return fd;
+}
+
+/* Answer queries, the responses split into a Data and a DataEnd message. */
+static const char *response(const char *query)
+{
+	if (!strcmp(query, "*IDN?\n"))
+		return "Keysight Technologies,34465A,MY00000001,A.03.01\n";
+	if (!strcmp(query, "*OPC?\n"))
+		return "1\n";
+
+	return NULL;
+}
+
+static gpointer server_thread(gpointer data)
+{
+	struct server *server;
+	struct message *msg;
+	GString *command;
+	const char *resp;
+	uint8_t size[8];
+	int sync_fd, async_fd;
+	size_t half;
+
+	server = data;
+
+	sync_fd = server_accept(server);
+	msg = message_receive(server, sync_fd);
+	fail_unless(msg && msg->type == INITIALIZE);
+	message_send(sync_fd, INITIALIZE_RESPONSE, 1,
+		0x0100 << 16 | SESSION_ID, NULL, 0);
+
+	async_fd = server_accept(server);
+	msg = message_receive(server, async_fd);
+	fail_unless(msg && msg->type == ASYNC_INITIALIZE);
+	message_send(async_fd, ASYNC_INITIALIZE_RESPONSE, 0, 0, NULL, 0);
+	msg = message_receive(server, async_fd);
+	fail_unless(msg && msg->type == ASYNC_MAX_MESSAGE_SIZE);
+	memset(size, 0, sizeof(size));
+	size[7] = MAX_MESSAGE;
+	message_send(async_fd, ASYNC_MAX_MESSAGE_SIZE_RESPONSE, 0, 0,
+		(const char *)size, sizeof(size));
+
+	command = g_string_new(NULL);
+	while ((msg = message_receive(server, sync_fd))) {
+		g_string_append_len(command, msg->payload->str,
+			msg->payload->len);
+		if (msg->type != DATA_END)
+			continue;
+		if ((resp = response(command->str))) {
+			half = strlen(resp) / 2;
+			message_send(sync_fd, DATA, 0, msg->param, resp, half);
+			message_send(sync_fd, DATA_END, 0, msg->param,
+				resp + half, strlen(resp) - half);
+			server->queries++;
+		}
+		g_string_truncate(command, 0);
+	}
+	g_string_free(command, TRUE);
+
+	close(async_fd);
+	close(sync_fd);
+
+	return NULL;
+}
+
+static void server_listen(struct server *server)
+{
+	struct sockaddr_in addr;
+	socklen_t len;
+
+	server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	fail_unless(server->listen_fd >= 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	len = sizeof(addr);
+	fail_unless(bind(server->listen_fd, (struct sockaddr *)&addr, len) == 0);
+	fail_unless(listen(server->listen_fd, 2) == 0);
+	fail_unless(getsockname(server->listen_fd,
+		(struct sockaddr *)&addr, &len) == 0);
+	g_snprintf(server->port, sizeof(server->port), "%u",
+		ntohs(addr.sin_port));
+	server->messages = g_ptr_array_new_with_free_func(message_free);
+	server->queries = 0;
+}
+
+/*
+ * Check the commands a scan sent: split into messages of the size the
+ * server takes, the last one of each a DataEnd message, with message
+ * IDs going up by two, and the first message after a response was read
+ * telling so.
+ */
+static void check_commands(const struct server *server, unsigned int first,
+		const char **commands)
+{
+	const struct message *msg;
+	GString *command;
+	uint32_t id;
+	gboolean delivered;
+	unsigned int i;
+
+	command = g_string_new(NULL);
+	id = FIRST_MESSAGE_ID;
+	delivered = FALSE;
+	for (i = first; i < server->messages->len; i++) {
+		msg = g_ptr_array_index(server->messages, i);
+		fail_unless(msg->type == DATA || msg->type == DATA_END,
+			"Message %u is of type %u.", i, msg->type);
+		fail_unless(msg->param == id, "Message %u has ID 0x%08x.",
+			i, msg->param);
+		fail_unless(msg->payload->len <= MAX_MESSAGE);
+		fail_unless(msg->control == (command->len == 0 && delivered),
+			"Message %u, control code %u.", i, msg->control);
+		id += 2;
+		g_string_append_len(command, msg->payload->str,
+			msg->payload->len);
+		if (msg->type == DATA)
+			continue;
+		fail_unless(*commands != NULL, "Extra command '%s'.",
+			command->str);
+		fail_unless(!strcmp(command->str, *commands),
+			"Command '%s', expected '%s'.", command->str, *commands);
+		delivered = strchr(command->str, '?') != NULL;
+		commands++;
+		g_string_truncate(command, 0);
+	}
+	fail_unless(*commands == NULL, "No command '%s'.", *commands);
+	g_string_free(command, TRUE);
+}
+
+START_TEST(test_hislip_scan)
+{
+	static const char *commands[] = {
+		"*IDN?\n", "*OPC?\n", "SYST:LOC\n", NULL,
+	};
+	struct sr_dev_driver **drivers, *driver;
+	struct sr_dev_inst *sdi;
+	struct sr_config src;
+	struct server server;
+	const struct message *msg;
+	GThread *thread;
+	GSList *options, *devs;
+	char *conn;
+	int i;
+
+	driver = NULL;
+	drivers = sr_driver_list(srtest_ctx);
+	for (i = 0; drivers && drivers[i]; i++) {
+		if (!strcmp(drivers[i]->name, "scpi-dmm"))
+			driver = drivers[i];
+	}
+	if (!driver)
+		return;
+	srtest_driver_init(srtest_ctx, driver);
+
+	server_listen(&server);
+	thread = g_thread_new("hislip-server", server_thread, &server);
+
+	conn = g_strdup_printf("hislip/127.0.0.1/hislip3,%s", server.port);
+	src.key = SR_CONF_CONN;
+	src.data = g_variant_ref_sink(g_variant_new_string(conn));
+	options = g_slist_append(NULL, &src);
+	devs = sr_driver_scan(driver, options);
+	g_slist_free(options);
+	g_variant_unref(src.data);
+	g_thread_join(thread);
+	close(server.listen_fd);
+
+	fail_unless(g_slist_length(devs) == 1, "Found %u devices.",
+		g_slist_length(devs));
+	sdi = devs->data;
+	fail_unless(!strcmp(sr_dev_inst_model_get(sdi), "34465A"));
+	g_slist_free(devs);
+	fail_unless(server.queries == 2);
+
+	/* The handshake. */
+	fail_unless(server.messages->len > 3);
+	msg = g_ptr_array_index(server.messages, 0);
+	fail_unless(msg->type == INITIALIZE);
+	fail_unless(msg->param >> 16 == 0x0100, "Version 0x%04x.",
+		msg->param >> 16);
+	fail_unless(!strcmp(msg->payload->str, "hislip3"),
+		"Sub-address '%s'.", msg->payload->str);
+	msg = g_ptr_array_index(server.messages, 1);
+	fail_unless(msg->type == ASYNC_INITIALIZE);
+	fail_unless(msg->param == SESSION_ID);
+	msg = g_ptr_array_index(server.messages, 2);
+	fail_unless(msg->type == ASYNC_MAX_MESSAGE_SIZE);
+	fail_unless(msg->payload->len == 8);
+
+	check_commands(&server, 3, commands);
+
+	g_ptr_array_free(server.messages, TRUE);
+	g_free(conn);
+}
+END_TEST
+
+#endif
+
+Suite *suite_scpi_hislip(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("scpi-hislip");
+
+	tc = tcase_create("loopback");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+#if !defined _WIN32
+	tcase_add_test(tc, test_hislip_scan);
+#endif
+	suite_add_tcase(s, tc);
+
+	return s;
+}
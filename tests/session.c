@@ -18,8 +18,11 @@
  */
 
 #include <config.h>
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
+#include <glib/gstdio.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
 
@@ -185,6 +188,592 @@ START_TEST(test_session_trigger_get_null)
 }
 END_TEST
 
+static int buffer_releases;
+
+static void buffer_release(void *data, void *cb_data)
+{
+	fail_unless(data == cb_data);
+	buffer_releases++;
+}
+
+/* Check that a buffer gets released exactly once, with the last unref. */
+START_TEST(test_buffer_ref_unref)
+{
+	struct sr_buffer *buf;
+	uint8_t data[16];
+
+	buffer_releases = 0;
+	buf = sr_buffer_new(data, sizeof(data), buffer_release, data);
+	fail_unless(buf != NULL);
+	fail_unless(sr_buffer_data(buf) == data);
+	fail_unless(sr_buffer_size(buf) == sizeof(data));
+
+	fail_unless(sr_buffer_ref(buf) == buf);
+	sr_buffer_unref(buf);
+	fail_unless(buffer_releases == 0);
+	sr_buffer_unref(buf);
+	fail_unless(buffer_releases == 1);
+
+	/* NULL buffers, must not segfault. */
+	fail_unless(sr_buffer_ref(NULL) == NULL);
+	sr_buffer_unref(NULL);
+}
+END_TEST
+
+/* Check that packets sent without a buffer don't report one. */
+START_TEST(test_packet_buffer_ref_none)
+{
+	struct sr_datafeed_packet packet;
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	fail_unless(sr_packet_buffer_ref(&packet) == NULL);
+}
+END_TEST
+
+/* Samples of a demo run, and the most the demo sends per packet. */
+#define DEMO_SAMPLES	(64 * 1024)
+#define DEMO_PACKET	4096
+
+/* What the datafeed callback got during a demo run. */
+struct feed_log {
+	GThread *thread;
+	uint64_t packets;
+	uint64_t logic_packets;
+	uint64_t logic_bytes;
+	/* Logic packets of up to small_len bytes. */
+	uint64_t small_len;
+	uint64_t small_packets;
+	/* Logic packets the callback got on another thread than the run's. */
+	uint64_t logic_off_thread;
+	/* Logic bytes when the end packet came. */
+	uint64_t end_bytes;
+	uint64_t ends;
+	/* The samples themselves, if set. */
+	GByteArray *logic;
+	GArray *analog;
+};
+
+static void feed_log(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	struct feed_log *log;
+	guint len;
+
+	(void)sdi;
+
+	log = cb_data;
+	log->packets++;
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		log->logic_packets++;
+		log->logic_bytes += logic->length;
+		if (logic->length <= log->small_len)
+			log->small_packets++;
+		if (g_thread_self() != log->thread)
+			log->logic_off_thread++;
+		if (log->logic)
+			g_byte_array_append(log->logic, logic->data,
+				logic->length);
+		break;
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		if (!log->analog)
+			break;
+		len = log->analog->len;
+		g_array_set_size(log->analog, len + analog->num_samples);
+		fail_unless(sr_analog_to_float(analog,
+			&g_array_index(log->analog, float, len)) == SR_OK);
+		break;
+	case SR_DF_END:
+		log->ends++;
+		log->end_bytes = log->logic_bytes;
+		break;
+	default:
+		break;
+	}
+}
+
+/* Run the session to its end, logging what the callback gets. */
+static void run_logged(struct sr_session *sess, struct feed_log *log,
+		uint64_t small_len)
+{
+	GByteArray *logic;
+	GArray *analog;
+
+	logic = log->logic;
+	analog = log->analog;
+	memset(log, 0, sizeof(*log));
+	log->thread = g_thread_self();
+	log->small_len = small_len;
+	if ((log->logic = logic))
+		g_byte_array_set_size(logic, 0);
+	if ((log->analog = analog))
+		g_array_set_size(analog, 0);
+	fail_unless(sr_session_start(sess) == SR_OK);
+	fail_unless(sr_session_run(sess) == SR_OK);
+	fail_unless(log->ends == 1, "Got %" PRIu64 " end packets.", log->ends);
+	fail_unless(log->logic_bytes == DEMO_SAMPLES,
+		"Got %" PRIu64 " logic bytes.", log->logic_bytes);
+}
+
+/* Check that the callbacks get all packets, on the dispatch thread. */
+START_TEST(test_session_dispatch_async)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_dispatch_stats stats;
+	struct feed_log log;
+
+	memset(&log, 0, sizeof(log));
+	sr_session_new(srtest_ctx, &sess);
+	sdi = srtest_demo_dev(8, 0, SR_MHZ(1), DEMO_SAMPLES);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, feed_log, &log);
+	fail_unless(sr_session_dispatch_stats_get(sess, &stats) == SR_ERR_NA);
+	fail_unless(sr_session_dispatch_async_set(sess, 4,
+		SR_DISPATCH_BLOCK) == SR_OK);
+
+	run_logged(sess, &log, 0);
+	fail_unless(log.logic_off_thread == log.logic_packets);
+	fail_unless(sr_session_dispatch_stats_get(sess, &stats) == SR_OK);
+	fail_unless(stats.packets == log.packets,
+		"Queued %" PRIu64 " of %" PRIu64 " packets.",
+		stats.packets, log.packets);
+	fail_unless(stats.dropped == 0 && stats.spilled == 0);
+	fail_unless(stats.max_depth >= 1 && stats.max_depth <= 4);
+
+	/* Back to calling them from the sending thread. */
+	fail_unless(sr_session_dispatch_async_set(sess, 0,
+		SR_DISPATCH_BLOCK) == SR_OK);
+	fail_unless(sr_session_dispatch_stats_get(sess, &stats) == SR_ERR_NA);
+	run_logged(sess, &log, 0);
+	fail_unless(log.logic_off_thread == 0);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check that invalid arguments are rejected. */
+START_TEST(test_session_dispatch_async_set_bogus)
+{
+	struct sr_session *sess;
+
+	fail_unless(sr_session_dispatch_async_set(NULL, 16,
+		SR_DISPATCH_BLOCK) == SR_ERR_ARG);
+	sr_session_new(srtest_ctx, &sess);
+	fail_unless(sr_session_dispatch_async_set(sess, 16,
+		(enum sr_dispatch_policy)42) == SR_ERR_ARG);
+	fail_unless(sr_session_dispatch_stats_get(sess, NULL) == SR_ERR_ARG);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check that small logic packets come out merged, up to the size set. */
+START_TEST(test_session_coalesce_merge)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct feed_log log;
+
+	memset(&log, 0, sizeof(log));
+	sr_session_new(srtest_ctx, &sess);
+	sdi = srtest_demo_dev(8, 0, SR_MHZ(1), DEMO_SAMPLES);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, feed_log, &log);
+
+	run_logged(sess, &log, 0);
+	fail_unless(log.logic_packets >= DEMO_SAMPLES / DEMO_PACKET);
+
+	/*
+	 * A packet goes out once the next one doesn't fit anymore, so all
+	 * but the last are larger than the limit less one demo packet.
+	 */
+	fail_unless(sr_session_coalesce_set(sess, 4 * DEMO_PACKET,
+		10 * 1000) == SR_OK);
+	run_logged(sess, &log, 3 * DEMO_PACKET);
+	fail_unless(log.small_packets <= 1,
+		"%" PRIu64 " packets not merged.", log.small_packets);
+	fail_unless(log.logic_packets <= DEMO_SAMPLES / (3 * DEMO_PACKET) + 1);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check that what was collected goes out before the end packet. */
+START_TEST(test_session_coalesce_end)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct feed_log log;
+
+	memset(&log, 0, sizeof(log));
+	sr_session_new(srtest_ctx, &sess);
+	sdi = srtest_demo_dev(8, 0, SR_MHZ(1), DEMO_SAMPLES);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, feed_log, &log);
+	/* More than the whole run, held back longer than it takes. */
+	fail_unless(sr_session_coalesce_set(sess, 4 * DEMO_SAMPLES,
+		10 * 1000) == SR_OK);
+
+	run_logged(sess, &log, 0);
+	fail_unless(log.logic_packets == 1,
+		"Got %" PRIu64 " logic packets.", log.logic_packets);
+	fail_unless(log.end_bytes == DEMO_SAMPLES);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check that invalid arguments are rejected. */
+START_TEST(test_session_coalesce_set_bogus)
+{
+	struct sr_session *sess;
+
+	fail_unless(sr_session_coalesce_set(NULL, 4096, 10) == SR_ERR_ARG);
+	sr_session_new(srtest_ctx, &sess);
+	fail_unless(sr_session_coalesce_set(sess, 4096, 0) == SR_ERR_ARG);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check that the counters match what the callback got. */
+START_TEST(test_session_stats)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_session_stats *stats;
+	struct sr_stats_histogram *cb;
+	struct feed_log log;
+
+	memset(&log, 0, sizeof(log));
+	sr_session_new(srtest_ctx, &sess);
+	sdi = srtest_demo_dev(8, 0, SR_MHZ(1), DEMO_SAMPLES);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, feed_log, &log);
+	fail_unless(sr_session_stats_get(sess, &stats) == SR_ERR_NA);
+	fail_unless(sr_session_stats_enable(sess, TRUE) == SR_OK);
+
+	run_logged(sess, &log, 0);
+	fail_unless(sr_session_stats_get(sess, &stats) == SR_OK);
+	fail_unless(stats->packets[SR_DF_HEADER - SR_DF_HEADER] == 1);
+	fail_unless(stats->packets[SR_DF_END - SR_DF_HEADER] == 1);
+	fail_unless(stats->packets[SR_DF_LOGIC - SR_DF_HEADER] ==
+		log.logic_packets);
+	fail_unless(stats->bytes[SR_DF_LOGIC - SR_DF_HEADER] == DEMO_SAMPLES);
+	fail_unless(stats->source_dispatch.count > 0);
+	fail_unless(stats->transforms == NULL);
+	fail_unless(g_slist_length(stats->callbacks) == 1);
+	cb = stats->callbacks->data;
+	fail_unless(cb->count == log.packets,
+		"Timed %" PRIu64 " of %" PRIu64 " callbacks.",
+		cb->count, log.packets);
+	sr_session_stats_free(stats);
+
+	/* Counting starts over with the next run. */
+	run_logged(sess, &log, 0);
+	fail_unless(sr_session_stats_get(sess, &stats) == SR_OK);
+	fail_unless(stats->packets[SR_DF_END - SR_DF_HEADER] == 1);
+	fail_unless(stats->bytes[SR_DF_LOGIC - SR_DF_HEADER] == DEMO_SAMPLES);
+	sr_session_stats_free(stats);
+
+	fail_unless(sr_session_stats_enable(sess, FALSE) == SR_OK);
+	fail_unless(sr_session_stats_get(sess, &stats) == SR_ERR_NA);
+	fail_unless(sr_session_stats_get(NULL, &stats) == SR_ERR_ARG);
+	fail_unless(sr_session_stats_get(sess, NULL) == SR_ERR_ARG);
+	fail_unless(sr_session_stats_enable(NULL, TRUE) == SR_ERR_ARG);
+	sr_session_stats_free(NULL);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check that each device runs on a thread of its own. */
+START_TEST(test_session_device_threads)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct feed_log log;
+
+	memset(&log, 0, sizeof(log));
+	sr_session_new(srtest_ctx, &sess);
+	sdi = srtest_demo_dev(8, 0, SR_MHZ(1), DEMO_SAMPLES);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, feed_log, &log);
+	fail_unless(sr_session_device_threads_set(sess, TRUE) == SR_OK);
+
+	/* The demo sends its data from its event sources. */
+	run_logged(sess, &log, 0);
+	fail_unless(log.logic_off_thread == log.logic_packets);
+
+	fail_unless(sr_session_device_threads_set(sess, FALSE) == SR_OK);
+	run_logged(sess, &log, 0);
+	fail_unless(log.logic_off_thread == 0);
+	fail_unless(sr_session_device_threads_set(NULL, TRUE) == SR_ERR_ARG);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Callbacks in flight, and how often one came in while another ran. */
+struct overlap_log {
+	gint active;
+	gint overlaps;
+	gint logic_bytes;
+	gint ends;
+};
+
+static void overlap_log(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	struct overlap_log *log;
+
+	(void)sdi;
+
+	log = cb_data;
+	if (g_atomic_int_add(&log->active, 1))
+		g_atomic_int_inc(&log->overlaps);
+	/* Leave the other device's thread time to come in. */
+	g_usleep(20);
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		g_atomic_int_add(&log->logic_bytes, logic->length);
+	} else if (packet->type == SR_DF_END) {
+		g_atomic_int_inc(&log->ends);
+	}
+	g_atomic_int_add(&log->active, -1);
+}
+
+/*
+ * Check that two devices sending from their own threads never get
+ * into the datafeed callbacks at the same time.
+ */
+START_TEST(test_session_device_threads_serialized)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct overlap_log log;
+	int i;
+
+	memset(&log, 0, sizeof(log));
+	sr_session_new(srtest_ctx, &sess);
+	for (i = 0; i < 2; i++) {
+		sdi = srtest_demo_dev(8, 0, SR_MHZ(1), DEMO_SAMPLES);
+		sr_session_dev_add(sess, sdi);
+	}
+	sr_session_datafeed_callback_add(sess, overlap_log, &log);
+	fail_unless(sr_session_device_threads_set(sess, TRUE) == SR_OK);
+
+	fail_unless(sr_session_start(sess) == SR_OK);
+	fail_unless(sr_session_run(sess) == SR_OK);
+	fail_unless(log.ends == 2, "Got %d end packets.", log.ends);
+	fail_unless(log.logic_bytes == 2 * DEMO_SAMPLES,
+		"Got %d logic bytes.", log.logic_bytes);
+	fail_unless(log.overlaps == 0, "%d callbacks overlapped.",
+		log.overlaps);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check that the store keeps the samples the callback got. */
+START_TEST(test_session_store)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	struct feed_log log;
+	uint64_t num_samples;
+	uint16_t unitsize;
+	uint8_t *logic;
+	float *analog;
+	GSList *l;
+
+	memset(&log, 0, sizeof(log));
+	log.logic = g_byte_array_new();
+	log.analog = g_array_new(FALSE, FALSE, sizeof(float));
+	sr_session_new(srtest_ctx, &sess);
+	sdi = srtest_demo_dev(8, 1, SR_MHZ(1), DEMO_SAMPLES);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, feed_log, &log);
+	fail_unless(sr_session_store_logic_info(sess, sdi, &num_samples, &unitsize) == SR_ERR_NA);
+	/* Small segments, so that reads cross their boundaries. */
+	fail_unless(sr_session_store_set(sess, TRUE, 4096, NULL) == SR_OK);
+
+	run_logged(sess, &log, 0);
+	fail_unless(sr_session_store_logic_info(sess, sdi, &num_samples, &unitsize) == SR_OK);
+	fail_unless(num_samples == DEMO_SAMPLES && unitsize == 1);
+	logic = g_malloc(DEMO_SAMPLES);
+	fail_unless(sr_session_store_logic_read(sess, sdi, 0, DEMO_SAMPLES, logic) == SR_OK);
+	fail_unless(memcmp(logic, log.logic->data, DEMO_SAMPLES) == 0);
+	fail_unless(sr_session_store_logic_read(sess, sdi, 1000, 5000, logic) == SR_OK);
+	fail_unless(memcmp(logic, log.logic->data + 1000, 5000) == 0);
+	fail_unless(sr_session_store_logic_read(sess, sdi, 1, DEMO_SAMPLES, logic) == SR_ERR_ARG);
+	g_free(logic);
+
+	ch = NULL;
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		if (((struct sr_channel *)l->data)->type == SR_CHANNEL_ANALOG)
+			ch = l->data;
+	}
+	fail_unless(ch != NULL);
+	fail_unless(log.analog->len > 0);
+	fail_unless(sr_session_store_analog_info(sess, ch, &num_samples) == SR_OK);
+	fail_unless(num_samples == log.analog->len,
+		"Stored %" PRIu64 " of %u analog samples.",
+		num_samples, log.analog->len);
+	analog = g_malloc(num_samples * sizeof(float));
+	fail_unless(sr_session_store_analog_read(sess, ch, 0, num_samples, analog) == SR_OK);
+	fail_unless(memcmp(analog, log.analog->data,
+		num_samples * sizeof(float)) == 0);
+	g_free(analog);
+
+	fail_unless(sr_session_store_set(sess, FALSE, 0, NULL) == SR_OK);
+	fail_unless(sr_session_store_analog_info(sess, ch, &num_samples) == SR_ERR_NA);
+	fail_unless(sr_session_store_set(NULL, TRUE, 0, NULL) == SR_ERR_ARG);
+	sr_session_destroy(sess);
+	g_byte_array_free(log.logic, TRUE);
+	g_array_free(log.analog, TRUE);
+}
+END_TEST
+
+/* Check the levels of a live logic overview, with an incomplete block. */
+START_TEST(test_session_overview)
+{
+	static const uint8_t samples[12] = {
+		0, 0, 0, 0, 0, 1, 0, 0, 2, 2, 2, 2,
+	};
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_user_feed *feed;
+	uint64_t num_samples, count;
+	uint16_t unitsize;
+	uint8_t changed[4], values[4];
+	void *slot;
+
+	sr_session_new(srtest_ctx, &sess);
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	sr_session_dev_add(sess, sdi);
+	fail_unless(sr_session_overview_logic_info(sess, sdi, &num_samples, NULL) == SR_ERR_NA);
+	fail_unless(sr_session_overview_set(sess, TRUE, 3) == SR_ERR_ARG);
+	fail_unless(sr_session_overview_set(sess, TRUE, 4) == SR_OK);
+
+	fail_unless(sr_user_feed_new(sdi, 1, 16, 2, 0, &feed) == SR_OK);
+	slot = sr_user_feed_acquire(feed);
+	memcpy(slot, samples, sizeof(samples));
+	fail_unless(sr_user_feed_commit(feed, slot, sizeof(samples)) == SR_OK);
+	fail_unless(sr_user_feed_free(feed) == SR_OK);
+
+	fail_unless(sr_session_overview_logic_info(sess, sdi, &num_samples, &unitsize) == SR_OK);
+	fail_unless(num_samples == 12 && unitsize == 1);
+	count = 4;
+	fail_unless(sr_session_overview_logic(sess, sdi, 0, 0, &count, changed, values) == SR_OK);
+	fail_unless(count == 3);
+	fail_unless(changed[0] == 0 && changed[1] == 1 && changed[2] == 2);
+	fail_unless(values[0] == 0 && values[1] == 0 && values[2] == 2);
+	count = 4;
+	fail_unless(sr_session_overview_logic(sess, sdi, 1, 0, &count, changed, values) == SR_OK);
+	fail_unless(count == 2);
+	fail_unless(changed[0] == 1 && changed[1] == 2 && values[1] == 2);
+	count = 4;
+	fail_unless(sr_session_overview_logic(sess, sdi, 2, 0, &count, changed, values) == SR_OK);
+	fail_unless(count == 1 && changed[0] == 3 && values[0] == 0);
+	count = 4;
+	fail_unless(sr_session_overview_logic(sess, sdi, 3, 1, &count, changed, values) == SR_OK);
+	fail_unless(count == 0);
+
+	fail_unless(sr_session_overview_set(sess, FALSE, 0) == SR_OK);
+	fail_unless(sr_session_overview_set(NULL, TRUE, 0) == SR_ERR_ARG);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+/* Check that only session files open, and bogus arguments are rejected. */
+START_TEST(test_session_file_open_bogus)
+{
+	struct sr_session_file *file;
+	struct sr_session_file_info info;
+	uint64_t num_samples;
+	uint8_t buf[1];
+	char *path;
+
+	path = g_build_filename(g_get_tmp_dir(), "sigrok-test-notzip.sr", NULL);
+	fail_unless(g_file_set_contents(path, "not a zip", -1, NULL));
+	fail_unless(sr_session_file_open(path, &file) == SR_ERR);
+	fail_unless(sr_session_file_probe(path, &info) == SR_ERR);
+	g_remove(path);
+	g_free(path);
+
+	fail_unless(sr_session_file_open(NULL, &file) == SR_ERR_ARG);
+	fail_unless(sr_session_file_open("foo.sr", NULL) == SR_ERR_ARG);
+	fail_unless(sr_session_file_probe(NULL, &info) == SR_ERR_ARG);
+	fail_unless(sr_session_file_probe("foo.sr", NULL) == SR_ERR_ARG);
+	fail_unless(sr_session_file_logic_info(NULL, &num_samples, NULL) == SR_ERR_ARG);
+	fail_unless(sr_session_file_logic_read(NULL, 0, 1, buf) == SR_ERR_ARG);
+	fail_unless(sr_session_file_export(NULL, 0, 1, sr_output_find("vcd"),
+		NULL, NULL, NULL, NULL) == SR_ERR_ARG);
+	sr_session_file_close(NULL);
+}
+END_TEST
+
+/* Count the logic bytes and packets a user feed sends. */
+static void feed_count(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	const struct sr_datafeed_logic *logic;
+	uint64_t *counts;
+
+	(void)sdi;
+
+	counts = cb_data;
+	if (packet->type != SR_DF_LOGIC)
+		return;
+	logic = packet->payload;
+	counts[0]++;
+	counts[1] += logic->length;
+}
+
+/* Check that committed slots get sent in ring order, merged when full. */
+START_TEST(test_user_feed)
+{
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_user_feed *feed;
+	uint64_t counts[2];
+	void *a, *b, *c;
+
+	sr_session_new(srtest_ctx, &sess);
+	sdi = sr_dev_inst_user_new("Vendor", "Model", "Version");
+	fail_unless(sr_user_feed_new(sdi, 1, 16, 2, 0, &feed) == SR_ERR_ARG);
+	sr_session_dev_add(sess, sdi);
+	memset(counts, 0, sizeof(counts));
+	sr_session_datafeed_callback_add(sess, feed_count, counts);
+	fail_unless(sr_user_feed_new(sdi, 0, 16, 2, 0, &feed) == SR_ERR_ARG);
+	fail_unless(sr_user_feed_new(sdi, 1, 16, 2, 0, &feed) == SR_OK);
+
+	a = sr_user_feed_acquire(feed);
+	b = sr_user_feed_acquire(feed);
+	fail_unless(a != NULL && b != NULL);
+	fail_unless(sr_user_feed_acquire(feed) == NULL);
+	fail_unless(sr_user_feed_overruns(feed) == 1);
+	memset(b, 0x55, 8);
+	fail_unless(sr_user_feed_commit(feed, b, 8) == SR_OK);
+	fail_unless(sr_user_feed_commit(feed, b, 8) == SR_ERR_ARG);
+	fail_unless(sr_user_feed_flush(feed) == SR_OK);
+	fail_unless(counts[0] == 0);
+	memset(a, 0xaa, 16);
+	fail_unless(sr_user_feed_commit(feed, a, 16) == SR_OK);
+	fail_unless(sr_user_feed_flush(feed) == SR_OK);
+	fail_unless(counts[0] == 1 && counts[1] == 24);
+
+	c = sr_user_feed_acquire(feed);
+	fail_unless(c == a);
+	fail_unless(sr_user_feed_commit(feed, (uint8_t *)c + 1, 1) == SR_ERR_ARG);
+	fail_unless(sr_user_feed_commit(feed, c, 4) == SR_OK);
+	fail_unless(sr_user_feed_free(feed) == SR_OK);
+	fail_unless(counts[0] == 2 && counts[1] == 28);
+	sr_session_destroy(sess);
+}
+END_TEST
+
 Suite *suite_session(void)
 {
 	Suite *s;
@@ -209,5 +798,54 @@ Suite *suite_session(void)
 	tcase_add_test(tc, test_session_trigger_get_null);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("buffer");
+	tcase_add_test(tc, test_buffer_ref_unref);
+	tcase_add_test(tc, test_packet_buffer_ref_none);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("dispatch");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_dispatch_async);
+	tcase_add_test(tc, test_session_dispatch_async_set_bogus);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("coalesce");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_coalesce_merge);
+	tcase_add_test(tc, test_session_coalesce_end);
+	tcase_add_test(tc, test_session_coalesce_set_bogus);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("stats");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_stats);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("threads");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_device_threads);
+	tcase_add_test(tc, test_session_device_threads_serialized);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("store");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_store);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("overview");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_overview);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("file");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_session_file_open_bogus);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("user_feed");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_user_feed);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -0,0 +1,173 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "hardware/sipeed-slogic-analyzer/unpack.h"
+
+/* Not a multiple of any vector width, so that the tails get exercised. */
+#define RAW_LEN (4096 + 48)
+/* Largest expansion is 2 channels, 4 samples per input byte. */
+#define OUT_LEN (4 * RAW_LEN)
+
+static const unsigned int channel_counts[] = { 2, 4, 8, 16 };
+
+static uint8_t raw[RAW_LEN];
+static uint8_t ref[OUT_LEN];
+static uint8_t out[OUT_LEN];
+
+static void fill_raw(void)
+{
+	size_t i;
+	uint32_t lfsr;
+
+	lfsr = 0xace1u;
+	for (i = 0; i < ARRAY_SIZE(raw); i++) {
+		lfsr = lfsr * 1103515245u + 12345u;
+		raw[i] = lfsr >> 16;
+	}
+}
+
+static void check_unpack(const char *name, slogic_unpack_fn ref_fn,
+	slogic_unpack_fn fn, unsigned int channels, size_t len, size_t outlen)
+{
+	memset(ref, 0xaa, sizeof(ref));
+	memset(out, 0x55, sizeof(out));
+	ref_fn(ref, raw, len, channels);
+	fn(out, raw, len, channels);
+	fail_unless(memcmp(ref, out, outlen) == 0,
+		"%s mismatch for %u channels, %zu bytes.", name, channels, len);
+}
+
+/* Check that all usable kernels produce the same output as the scalar code. */
+START_TEST(test_unpack_vs_scalar)
+{
+	const struct slogic_unpack_impl *scalar, *impl;
+	unsigned int ch;
+	size_t i, len;
+
+	fill_raw();
+	scalar = &slogic_unpack_impls[0];
+	for (impl = &slogic_unpack_impls[1]; impl->name; impl++) {
+		if (!impl->supported())
+			continue;
+		for (i = 0; i < ARRAY_SIZE(channel_counts); i++) {
+			ch = channel_counts[i];
+			for (len = 0; len <= RAW_LEN; len += ch) {
+				if (ch <= 8) {
+					check_unpack(impl->name, scalar->lite_8,
+						impl->lite_8, ch, len,
+						slogic_lite_8_unpacked_len(len, ch));
+				}
+				check_unpack(impl->name, scalar->basic_16,
+					impl->basic_16, ch, len,
+					slogic_basic_16_unpacked_len(len, ch));
+			}
+		}
+	}
+}
+END_TEST
+
+/* Check the scalar Basic 16 transpose against hand-made blocks. */
+START_TEST(test_unpack_basic_16_scalar)
+{
+	const uint8_t in8[] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+	const uint8_t exp8[] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
+	const uint8_t in2[] = { 0xf0, 0x0f };
+	const uint8_t exp2[] = { 1, 1, 1, 1, 2, 2, 2, 2 };
+
+	memset(out, 0, sizeof(out));
+	slogic_unpack_impls[0].basic_16(out, in8, sizeof(in8), 8);
+	fail_unless(memcmp(out, exp8, sizeof(exp8)) == 0);
+
+	memset(out, 0, sizeof(out));
+	slogic_unpack_impls[0].basic_16(out, in2, sizeof(in2), 2);
+	fail_unless(memcmp(out, exp2, sizeof(exp2)) == 0);
+}
+END_TEST
+
+/* Check the per channel block view against the scalar unpack. */
+START_TEST(test_unpack_channels)
+{
+	const struct slogic_unpack_impl *scalar;
+	uint8_t vec[16];
+	unsigned int ch, c, j, bit, unitsize;
+	size_t i, blk;
+
+	fill_raw();
+	scalar = &slogic_unpack_impls[0];
+	for (i = 0; i < ARRAY_SIZE(channel_counts); i++) {
+		ch = channel_counts[i];
+		unitsize = (ch + 7) / 8;
+		for (blk = 0; blk + ch <= 64; blk += ch) {
+			if (ch <= 8) {
+				scalar->lite_8(out, &raw[blk], ch, ch);
+				slogic_lite_8_channels(vec, &raw[blk], ch);
+				for (c = 0; c < ch; c++) {
+					for (j = 0; j < 8; j++) {
+						bit = (out[j] >> c) & 0x1;
+						fail_unless(bit == ((vec[c] >> (7 - j)) & 0x1u),
+							"Lite 8 mismatch for %u channels.", ch);
+					}
+				}
+			}
+			scalar->basic_16(out, &raw[blk], ch, ch);
+			slogic_basic_16_channels(vec, &raw[blk], ch);
+			for (c = 0; c < ch; c++) {
+				for (j = 0; j < 8; j++) {
+					bit = (out[j * unitsize + c / 8] >> (c % 8)) & 0x1;
+					fail_unless(bit == ((vec[c] >> (7 - j)) & 0x1u),
+						"Basic 16 mismatch for %u channels.", ch);
+				}
+			}
+		}
+	}
+}
+END_TEST
+
+/* Check that the selected kernel is one of the supported ones. */
+START_TEST(test_unpack_impl_get)
+{
+	const struct slogic_unpack_impl *impl;
+
+	impl = slogic_unpack_impl_get();
+	fail_unless(impl != NULL);
+	fail_unless(impl->name != NULL);
+	fail_unless(impl->supported());
+}
+END_TEST
+
+Suite *suite_slogic_unpack(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("slogic_unpack");
+
+	tc = tcase_create("unpack");
+	tcase_add_test(tc, test_unpack_vs_scalar);
+	tcase_add_test(tc, test_unpack_basic_16_scalar);
+	tcase_add_test(tc, test_unpack_channels);
+	tcase_add_test(tc, test_unpack_impl_get);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
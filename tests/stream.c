@@ -0,0 +1,158 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <string.h>
+#include <libsigrok/libsigrok.h>
+#include "libsigrok-internal.h"
+#include "lib.h"
+#include "stream.h"
+
+/* Check that a header reads back as written, little endian. */
+START_TEST(test_stream_header)
+{
+	struct stream_frame_header hdr, out;
+	uint8_t buf[STREAM_FRAME_HEADER_SIZE];
+
+	hdr.length = 0x1234;
+	hdr.type = STREAM_FRAME_LOGIC;
+	hdr.codec = STREAM_CODEC_DEFLATE;
+	hdr.raw_length = 0x10000;
+	hdr.arg = 0xa1b2c3d4;
+	sr_stream_header_write(buf, &hdr);
+	fail_unless(buf[0] == 0x34 && buf[1] == 0x12);
+	fail_unless(buf[12] == 0xd4 && buf[15] == 0xa1);
+
+	fail_unless(sr_stream_header_read(buf, &out) == SR_OK);
+	fail_unless(out.length == hdr.length && out.type == hdr.type);
+	fail_unless(out.codec == hdr.codec);
+	fail_unless(out.raw_length == hdr.raw_length && out.arg == hdr.arg);
+}
+END_TEST
+
+/* Check that headers a peer must not send are rejected. */
+START_TEST(test_stream_header_bogus)
+{
+	static const struct stream_frame_header bogus[] = {
+		/* Too large. */
+		{ STREAM_MAX_FRAME + 1, STREAM_FRAME_LOGIC,
+			STREAM_CODEC_DEFLATE, 16, 1 },
+		{ 16, STREAM_FRAME_LOGIC,
+			STREAM_CODEC_DEFLATE, STREAM_MAX_FRAME + 1, 1 },
+		/* Unknown codec. */
+		{ 16, STREAM_FRAME_LOGIC, STREAM_NUM_CODECS, 16, 1 },
+		{ 16, STREAM_FRAME_LOGIC, 0xff, 16, 1 },
+		/* Uncompressed, but the lengths differ. */
+		{ 16, STREAM_FRAME_LOGIC, STREAM_CODEC_NONE, 17, 1 },
+	};
+	struct stream_frame_header hdr;
+	uint8_t buf[STREAM_FRAME_HEADER_SIZE];
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(bogus); i++) {
+		sr_stream_header_write(buf, &bogus[i]);
+		fail_unless(sr_stream_header_read(buf, &hdr) == SR_ERR_DATA,
+			"Header %u was accepted.", i);
+	}
+}
+END_TEST
+
+/* Check that every codec of the build gets the payload back. */
+START_TEST(test_stream_codecs)
+{
+	uint8_t data[64 * 1024], out[sizeof(data)];
+	const uint8_t *comp;
+	GBytes *bytes;
+	uint32_t codecs;
+	gsize len;
+	size_t i;
+	int codec;
+
+	/* Compresses well, but is not all the same. */
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (i / 100) ^ (i % 7);
+
+	codecs = sr_stream_codecs();
+	fail_unless(codecs & (1 << STREAM_CODEC_NONE));
+	fail_unless(sr_stream_compress(STREAM_CODEC_NONE, data,
+		sizeof(data)) == NULL);
+	fail_unless(sr_stream_decompress(STREAM_CODEC_NONE, data,
+		sizeof(data), out, sizeof(out)) == SR_OK);
+	fail_unless(memcmp(data, out, sizeof(data)) == 0);
+
+	for (codec = STREAM_CODEC_NONE + 1; codec < STREAM_NUM_CODECS; codec++) {
+		if (!(codecs & (1 << codec))) {
+			fail_unless(sr_stream_decompress(codec, data, 16,
+				out, 16) == SR_ERR_NA);
+			continue;
+		}
+		bytes = sr_stream_compress(codec, data, sizeof(data));
+		fail_unless(bytes != NULL, "%s didn't compress.",
+			sr_stream_codec_name(codec));
+		comp = g_bytes_get_data(bytes, &len);
+		fail_unless(len < sizeof(data));
+		memset(out, 0, sizeof(out));
+		fail_unless(sr_stream_decompress(codec, comp, len,
+			out, sizeof(out)) == SR_OK);
+		fail_unless(memcmp(data, out, sizeof(data)) == 0,
+			"%s changed the data.", sr_stream_codec_name(codec));
+		/* A raw length that doesn't match is corrupt data. */
+		fail_unless(sr_stream_decompress(codec, comp, len,
+			out, sizeof(out) - 1) == SR_ERR_DATA);
+		g_bytes_unref(bytes);
+	}
+}
+END_TEST
+
+/* Check the analog payload prefix, including a negative digits value. */
+START_TEST(test_stream_analog)
+{
+	struct stream_analog analog, out;
+	uint8_t buf[STREAM_ANALOG_SIZE];
+
+	analog.mq = SR_MQ_VOLTAGE;
+	analog.unit = SR_UNIT_VOLT;
+	analog.mqflags = SR_MQFLAG_DC | SR_MQFLAG_FOUR_WIRE;
+	analog.digits = -3;
+	sr_stream_analog_write(buf, &analog);
+	fail_unless(RL32(&buf[0]) == SR_MQ_VOLTAGE);
+	fail_unless(RL64(&buf[8]) == (SR_MQFLAG_DC | SR_MQFLAG_FOUR_WIRE));
+
+	sr_stream_analog_read(buf, &out);
+	fail_unless(out.mq == analog.mq && out.unit == analog.unit);
+	fail_unless(out.mqflags == analog.mqflags);
+	fail_unless(out.digits == -3);
+}
+END_TEST
+
+Suite *suite_stream(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("stream");
+
+	tc = tcase_create("proto");
+	tcase_add_test(tc, test_stream_header);
+	tcase_add_test(tc, test_stream_header_bogus);
+	tcase_add_test(tc, test_stream_codecs);
+	tcase_add_test(tc, test_stream_analog);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -21,8 +21,11 @@
 #include <check.h>
 #include <errno.h>
 #include <locale.h>
+#include <math.h>
+#include <string.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
+#include "libsigrok-internal.h"
 
 #if 0
 static void test_vsnprintf(const char *expected, char *format, ...)
@@ -608,6 +611,104 @@ START_TEST(test_calc_power_of_two)
 }
 END_TEST
 
+/* Whether the fast path takes the text, else it is g_ascii_strtod()'s. */
+static const struct {
+	const char *text;
+	gboolean exact;
+} decimal_cases[] = {
+	{ "0", TRUE, },
+	{ "-0", TRUE, },
+	{ "-17.25", TRUE, },
+	{ "0.1", TRUE, },
+	{ "123.456e-5", TRUE, },
+	{ "-.5", TRUE, },
+	{ "5.", TRUE, },
+	{ "0e400", TRUE, },
+	{ "00000000000000000000000001.5", TRUE, },
+	{ "9007199254740992", TRUE, },
+	{ "9007199254740993", FALSE, },
+	{ "1e22", TRUE, },
+	{ "1e-22", TRUE, },
+	{ "1e23", FALSE, },
+	{ "1e-23", FALSE, },
+	{ "1234567890123456789", FALSE, },
+	{ "12345678901234567890123", FALSE, },
+	{ " 1", FALSE, },
+	{ "0x10", FALSE, },
+	{ "inf", FALSE, },
+	{ "nan", FALSE, },
+	{ "1e", FALSE, },
+	{ ".", FALSE, },
+};
+
+START_TEST(test_scan_decimal)
+{
+	const char *text, *end, *next;
+	double value, want;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(decimal_cases); i++) {
+		text = decimal_cases[i].text;
+		end = text + strlen(text);
+		value = 0;
+		next = sr_scan_decimal(text, end, &value);
+		if (!decimal_cases[i].exact) {
+			fail_unless(next != end, "'%s' was taken.", text);
+			continue;
+		}
+		fail_unless(next == end, "'%s' was not taken.", text);
+		want = g_ascii_strtod(text, NULL);
+		fail_unless(!memcmp(&value, &want, sizeof(value)),
+			"'%s' gave %.17g, not %.17g.", text, value, want);
+	}
+}
+END_TEST
+
+static void check_float_list(const char *text, int want_ret,
+		const float *want, size_t want_count)
+{
+	float values[4];
+	size_t count, i;
+	int ret;
+
+	ret = sr_atof_ascii_list(text, strlen(text), ',',
+		values, ARRAY_SIZE(values), &count);
+	fail_unless(ret == want_ret, "'%s' returned %d.", text, ret);
+	fail_unless(count == want_count, "'%s' gave %zu values.", text, count);
+	for (i = 0; i < count; i++) {
+		if (isnan(want[i])) {
+			fail_unless(isnan(values[i]), "'%s' value %zu.", text, i);
+			continue;
+		}
+		fail_unless(values[i] == want[i], "'%s' value %zu is %g, not %g.",
+			text, i, values[i], want[i]);
+	}
+}
+
+START_TEST(test_atof_list)
+{
+	const float fast[] = { 1, -2.5, 3e-3 };
+	const float slow[] = {
+		(float)12345678901234567890123.0, (float)1e-30, (float)3e25,
+		INFINITY,
+	};
+	const float special[] = { NAN, 16 };
+	const float counts[] = { 1, 2, 3, 4 };
+
+	check_float_list("", SR_OK, NULL, 0);
+	check_float_list(" \r\n", SR_OK, NULL, 0);
+	check_float_list("1, -2.5 ,3e-3", SR_OK, fast, 3);
+	check_float_list("1,-2.5,3e-3,", SR_OK, fast, 3);
+	check_float_list("12345678901234567890123,1e-30,3e25,inf", SR_OK,
+		slow, 4);
+	check_float_list("nan,0x10", SR_OK, special, 2);
+	check_float_list("1,,-2.5", SR_ERR_DATA, fast, 1);
+	check_float_list("1,-2.5,1e400", SR_ERR_DATA, fast, 2);
+	check_float_list("1,-2.5x", SR_ERR_DATA, fast, 2);
+	check_float_list("1,2,3,4,5", SR_ERR, counts, 4);
+}
+END_TEST
+
 Suite *suite_strutil(void)
 {
 	Suite *s;
@@ -639,5 +740,10 @@ Suite *suite_strutil(void)
 	tcase_add_test(tc, test_calc_power_of_two);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("ascii_float");
+	tcase_add_test(tc, test_scan_decimal);
+	tcase_add_test(tc, test_atof_list);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
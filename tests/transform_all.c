@@ -18,7 +18,9 @@
  */
 
 #include <config.h>
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -96,6 +98,549 @@ START_TEST(test_transform_options)
 }
 END_TEST
 
+/* Samples of each run, in blocks of a few packets at 1 MHz. */
+#define DEMO_SAMPLES 20000
+
+/* Demo logic sample k on 16 channels, the gray code of k + 1. */
+static uint16_t gray(uint64_t k)
+{
+	uint16_t n;
+
+	n = k + 1;
+
+	return n ^ (n >> 1);
+}
+
+/* A session with the device, collecting what it sends into the feed. */
+static struct sr_session *feed_session(struct sr_dev_inst *sdi,
+		struct srtest_feed *feed)
+{
+	struct sr_session *sess;
+
+	fail_unless(sr_session_new(srtest_ctx, &sess) == SR_OK);
+	fail_unless(sr_session_dev_add(sess, sdi) == SR_OK);
+	sr_session_datafeed_callback_add(sess, srtest_feed_cb, feed);
+
+	return sess;
+}
+
+/* Add a transform to the device's session, the parameters get freed. */
+static const struct sr_transform *transform_new(const struct sr_dev_inst *sdi,
+		const char *id, GHashTable *params)
+{
+	const struct sr_transform *t;
+
+	t = sr_transform_new(sr_transform_find(id), params, sdi);
+	fail_unless(t != NULL, "Failed to create '%s' transform.", id);
+	if (params)
+		g_hash_table_destroy(params);
+
+	return t;
+}
+
+/* Get the analog values a run sent on a channel, checking their count. */
+static const float *trace_values(const struct srtest_feed *feed,
+		const char *name, unsigned int count)
+{
+	struct srtest_trace *trace;
+
+	trace = srtest_feed_trace(feed, name);
+	fail_unless(trace != NULL, "No values on %s.", name);
+	fail_unless(trace->values->len == count, "Got %u values on %s.",
+		trace->values->len, name);
+
+	return (const float *)trace->values->data;
+}
+
+static float magnitude(float v)
+{
+	return v < 0 ? -v : v;
+}
+
+#define DECIMATE_FACTOR 7
+
+/*
+ * Decimate gray code and random values with each mode, check the blocks
+ * against those of a run without the transform. The last block is
+ * incomplete and gets dropped.
+ */
+START_TEST(test_transform_decimate)
+{
+	static const char *modes[][2] = {
+		{ "sample", "mean" }, { "or", "min" },
+		{ "and", "max" }, { "sample", "peak" },
+	};
+	const struct sr_transform *t;
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct srtest_feed feed;
+	const float *values;
+	float *ref, v, want, diff;
+	double sum;
+	uint64_t num_blocks, b, k;
+	uint16_t acc;
+	unsigned int i;
+
+	sdi = srtest_demo_dev(16, 1, SR_MHZ(1), DEMO_SAMPLES);
+	srtest_demo_pattern(sdi, "Logic", "graycode");
+	srtest_demo_pattern(sdi, "A0", "random");
+	srtest_feed_init(&feed);
+
+	sess = feed_session(sdi, &feed);
+	srand(1);
+	srtest_feed_run(sess, &feed);
+	sr_session_destroy(sess);
+	values = trace_values(&feed, "A0", DEMO_SAMPLES);
+	ref = g_malloc(DEMO_SAMPLES * sizeof(float));
+	memcpy(ref, values, DEMO_SAMPLES * sizeof(float));
+
+	num_blocks = DEMO_SAMPLES / DECIMATE_FACTOR;
+	for (i = 0; i < G_N_ELEMENTS(modes); i++) {
+		sess = feed_session(sdi, &feed);
+		t = transform_new(sdi, "decimate", srtest_params(
+			"factor", g_variant_new_uint64(DECIMATE_FACTOR),
+			"logic", g_variant_new_string(modes[i][0]),
+			"analog", g_variant_new_string(modes[i][1]), NULL));
+		srand(1);
+		srtest_feed_run(sess, &feed);
+		sr_session_destroy(sess);
+		sr_transform_free(t);
+
+		fail_unless(feed.unitsize == 2, "Unit size %d.", feed.unitsize);
+		fail_unless(feed.logic->len == num_blocks * 2,
+			"Got %u bytes of logic data.", feed.logic->len);
+		values = trace_values(&feed, "A0", num_blocks);
+		for (b = 0; b < num_blocks; b++) {
+			k = b * DECIMATE_FACTOR;
+			acc = gray(k);
+			for (k++; k < (b + 1) * DECIMATE_FACTOR; k++) {
+				if (!strcmp(modes[i][0], "or"))
+					acc |= gray(k);
+				else if (!strcmp(modes[i][0], "and"))
+					acc &= gray(k);
+			}
+			fail_unless(srtest_feed_sample(&feed, b) == acc,
+				"%s: block %" PRIu64 " is 0x%04" PRIx64 ".",
+				modes[i][0], b, srtest_feed_sample(&feed, b));
+
+			k = b * DECIMATE_FACTOR;
+			sum = 0;
+			want = ref[k];
+			for (; k < (b + 1) * DECIMATE_FACTOR; k++) {
+				v = ref[k];
+				sum += v;
+				if (!strcmp(modes[i][1], "min"))
+					want = MIN(want, v);
+				else if (!strcmp(modes[i][1], "max"))
+					want = MAX(want, v);
+				else if (!strcmp(modes[i][1], "peak") &&
+						magnitude(v) > magnitude(want))
+					want = v;
+			}
+			if (!strcmp(modes[i][1], "mean"))
+				want = sum / DECIMATE_FACTOR;
+			diff = values[b] - want;
+			fail_unless(magnitude(diff) < 1e-4,
+				"%s: block %" PRIu64 " is %f, not %f.",
+				modes[i][1], b, values[b], want);
+		}
+	}
+
+	srtest_feed_free(&feed);
+	g_free(ref);
+}
+END_TEST
+
+/*
+ * Repack gray code with channels out of order, in order (the PEXT path
+ * where the CPU has it), into more than a byte, and all of them as they
+ * are. Output bit n must be the n-th listed channel's.
+ */
+START_TEST(test_transform_repack)
+{
+	static const struct {
+		const char *channels;
+		int bits[16];
+		int num_bits;
+	} lists[] = {
+		{ "D3,D12,D0,D9", { 3, 12, 0, 9, }, 4, },
+		{ "D1,D2,D5,D8,D15", { 1, 2, 5, 8, 15, }, 5, },
+		{ "D0,D2,D4,D6,D8,D10,D12,D14,D15",
+			{ 0, 2, 4, 6, 8, 10, 12, 14, 15, }, 9, },
+		{ "", { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, },
+			16, },
+	};
+	const struct sr_transform *t;
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct srtest_feed feed;
+	uint64_t k, want;
+	unsigned int i;
+	int n;
+
+	sdi = srtest_demo_dev(16, 0, SR_MHZ(1), DEMO_SAMPLES);
+	srtest_demo_pattern(sdi, "Logic", "graycode");
+	srtest_feed_init(&feed);
+
+	for (i = 0; i < G_N_ELEMENTS(lists); i++) {
+		sess = feed_session(sdi, &feed);
+		t = transform_new(sdi, "repack", srtest_params("channels",
+			g_variant_new_string(lists[i].channels), NULL));
+		srtest_feed_run(sess, &feed);
+		sr_session_destroy(sess);
+		sr_transform_free(t);
+
+		fail_unless(feed.unitsize == (lists[i].num_bits + 7) / 8,
+			"'%s': unit size %d.", lists[i].channels, feed.unitsize);
+		fail_unless(feed.logic->len == DEMO_SAMPLES * feed.unitsize,
+			"'%s': got %u bytes.", lists[i].channels, feed.logic->len);
+		for (k = 0; k < DEMO_SAMPLES; k++) {
+			want = 0;
+			for (n = 0; n < lists[i].num_bits; n++)
+				want |= (uint64_t)((gray(k) >> lists[i].bits[n]) & 1) << n;
+			fail_unless(srtest_feed_sample(&feed, k) == want,
+				"'%s': sample %" PRIu64 " is 0x%" PRIx64 ".",
+				lists[i].channels, k, srtest_feed_sample(&feed, k));
+		}
+	}
+
+	srtest_feed_free(&feed);
+}
+END_TEST
+
+/*
+ * Turn the demo's gray code into runs, where every sample changes, and
+ * after repacking the top channels, where few do. Expanded the runs must
+ * give the samples, the feed checks that they only list changes.
+ */
+START_TEST(test_transform_rle)
+{
+	const struct sr_transform *t, *t_rle;
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct srtest_feed feed;
+	uint64_t k, changes;
+
+	sdi = srtest_demo_dev(16, 0, SR_MHZ(1), DEMO_SAMPLES);
+	srtest_demo_pattern(sdi, "Logic", "graycode");
+	srtest_feed_init(&feed);
+
+	sess = feed_session(sdi, &feed);
+	t_rle = transform_new(sdi, "rle", NULL);
+	srtest_feed_run(sess, &feed);
+	sr_session_destroy(sess);
+	sr_transform_free(t_rle);
+
+	fail_unless(feed.unitsize == 2, "Unit size %d.", feed.unitsize);
+	fail_unless(feed.logic->len == DEMO_SAMPLES * 2,
+		"Got %u bytes.", feed.logic->len);
+	fail_unless(feed.rle_runs == DEMO_SAMPLES,
+		"Got %" PRIu64 " runs.", feed.rle_runs);
+	for (k = 0; k < DEMO_SAMPLES; k++)
+		fail_unless(srtest_feed_sample(&feed, k) == gray(k),
+			"Sample %" PRIu64 " is 0x%04" PRIx64 ".",
+			k, srtest_feed_sample(&feed, k));
+
+	sess = feed_session(sdi, &feed);
+	t = transform_new(sdi, "repack", srtest_params("channels",
+		g_variant_new_string("D12,D13,D14,D15"), NULL));
+	t_rle = transform_new(sdi, "rle", NULL);
+	srtest_feed_run(sess, &feed);
+	sr_session_destroy(sess);
+	sr_transform_free(t);
+	sr_transform_free(t_rle);
+
+	fail_unless(feed.unitsize == 1, "Unit size %d.", feed.unitsize);
+	fail_unless(feed.logic->len == DEMO_SAMPLES,
+		"Got %u bytes.", feed.logic->len);
+	changes = 0;
+	for (k = 0; k < DEMO_SAMPLES; k++) {
+		fail_unless(srtest_feed_sample(&feed, k) == (gray(k) >> 12),
+			"Sample %" PRIu64 " is 0x%" PRIx64 ".",
+			k, srtest_feed_sample(&feed, k));
+		if (k && gray(k) >> 12 != gray(k - 1) >> 12)
+			changes++;
+	}
+	/* Each packet starts with a run, the others are changes. */
+	fail_unless(feed.rle_packets > 0);
+	fail_unless(feed.rle_runs >= feed.rle_packets &&
+		feed.rle_runs <= feed.rle_packets + changes,
+		"%" PRIu64 " runs in %" PRIu64 " packets for %" PRIu64
+		" changes.", feed.rle_runs, feed.rle_packets, changes);
+
+	srtest_feed_free(&feed);
+}
+END_TEST
+
+static struct sr_channel *find_channel(const struct sr_dev_inst *sdi,
+		const char *name)
+{
+	struct sr_channel *ch;
+	GSList *l;
+
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		if (!strcmp(ch->name, name))
+			return ch;
+	}
+
+	return NULL;
+}
+
+/*
+ * Threshold a square wave at the default level, and a sine wave with
+ * hysteresis. The logic channels get added after the analog ones, and
+ * go away with the transform. Analog values pass unchanged.
+ */
+START_TEST(test_transform_threshold)
+{
+	const struct sr_transform *t;
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	struct srtest_feed feed;
+	const float *square, *sine;
+	uint64_t k, v;
+	uint8_t state;
+
+	sdi = srtest_demo_dev(0, 2, SR_MHZ(1), DEMO_SAMPLES);
+	srtest_demo_pattern(sdi, "A0", "square");
+	srtest_demo_pattern(sdi, "A1", "sine");
+	srtest_feed_init(&feed);
+
+	sess = feed_session(sdi, &feed);
+	t = transform_new(sdi, "threshold", srtest_params("channels",
+		g_variant_new_string("A0,A1=3:4"), NULL));
+	ch = find_channel(sdi, "A0_logic");
+	fail_unless(ch && ch->type == SR_CHANNEL_LOGIC && ch->index == 2);
+	ch = find_channel(sdi, "A1_logic");
+	fail_unless(ch && ch->type == SR_CHANNEL_LOGIC && ch->index == 3);
+	srtest_feed_run(sess, &feed);
+	sr_session_destroy(sess);
+	sr_transform_free(t);
+	fail_unless(!find_channel(sdi, "A0_logic") &&
+		!find_channel(sdi, "A1_logic"), "Logic channels were kept.");
+
+	square = trace_values(&feed, "A0", DEMO_SAMPLES);
+	sine = trace_values(&feed, "A1", DEMO_SAMPLES);
+	fail_unless(feed.unitsize == 1, "Unit size %d.", feed.unitsize);
+	fail_unless(feed.logic->len == DEMO_SAMPLES,
+		"Got %u bytes.", feed.logic->len);
+	state = 0;
+	for (k = 0; k < DEMO_SAMPLES; k++) {
+		/* Hysteresis 4 around 3: low below 1, high above 5. */
+		if (sine[k] < 1)
+			state = 0;
+		else if (sine[k] > 5)
+			state = 1;
+		v = (square[k] >= 1.5) << 2 | state << 3;
+		fail_unless(srtest_feed_sample(&feed, k) == v,
+			"Sample %" PRIu64 " is 0x%" PRIx64 " for %f, %f.",
+			k, srtest_feed_sample(&feed, k), square[k], sine[k]);
+	}
+
+	srtest_feed_free(&feed);
+}
+END_TEST
+
+/* Frames the demo sends, of this many samples each. */
+#define AVERAGE_FRAMES 8
+#define FRAME_SAMPLES 1000
+
+static void run_frames(struct sr_dev_inst *sdi, struct sr_session *sess,
+		struct srtest_feed *feed)
+{
+	/* The demo counts the frames down as it sends them. */
+	fail_unless(sr_config_set(sdi, NULL, SR_CONF_LIMIT_FRAMES,
+		g_variant_new_uint64(AVERAGE_FRAMES)) == SR_OK);
+	srand(1);
+	srtest_feed_run(sess, feed);
+}
+
+/*
+ * Average frames of random values by fours, and as a running mean over
+ * four. The expected frames get computed from those of a run without
+ * the transform as the transform does, in single precision.
+ */
+START_TEST(test_transform_average)
+{
+	static const char *modes[] = { "mean", "min", "max", "running", };
+	const struct sr_transform *t;
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct srtest_trace *trace;
+	struct srtest_feed feed;
+	const float *values, *f;
+	float *ref, r[FRAME_SAMPLES], w, want, diff;
+	unsigned int i, j, n, c, num_out, end;
+
+	sdi = srtest_demo_dev(0, 1, SR_MHZ(1), AVERAGE_FRAMES * FRAME_SAMPLES);
+	srtest_demo_pattern(sdi, "A0", "random");
+	srtest_feed_init(&feed);
+
+	sess = feed_session(sdi, &feed);
+	run_frames(sdi, sess, &feed);
+	sr_session_destroy(sess);
+	fail_unless(feed.frames == AVERAGE_FRAMES, "Got %d frames.",
+		feed.frames);
+	values = trace_values(&feed, "A0", AVERAGE_FRAMES * FRAME_SAMPLES);
+	ref = g_malloc(AVERAGE_FRAMES * FRAME_SAMPLES * sizeof(float));
+	memcpy(ref, values, AVERAGE_FRAMES * FRAME_SAMPLES * sizeof(float));
+
+	for (i = 0; i < G_N_ELEMENTS(modes); i++) {
+		sess = feed_session(sdi, &feed);
+		t = transform_new(sdi, "average", srtest_params(
+			"frames", g_variant_new_uint64(4),
+			"mode", g_variant_new_string(modes[i]), NULL));
+		run_frames(sdi, sess, &feed);
+		sr_session_destroy(sess);
+		sr_transform_free(t);
+
+		num_out = strcmp(modes[i], "running") ?
+			AVERAGE_FRAMES / 4 : AVERAGE_FRAMES;
+		fail_unless(feed.frames == (int)num_out, "%s: got %d frames.",
+			modes[i], feed.frames);
+		values = trace_values(&feed, "A0", num_out * FRAME_SAMPLES);
+		trace = srtest_feed_trace(&feed, "A0");
+		for (j = 0; j < num_out; j++) {
+			end = g_array_index(trace->frame_ends, unsigned int, j);
+			fail_unless(end == (j + 1) * FRAME_SAMPLES,
+				"%s: frame %u ends at %u.", modes[i], j, end);
+		}
+
+		for (c = 0; c < AVERAGE_FRAMES; c++) {
+			f = ref + c * FRAME_SAMPLES;
+			if (c % 4 == 0 && strcmp(modes[i], "running")) {
+				memcpy(r, f, sizeof(r));
+				continue;
+			}
+			if (c == 0) {
+				memcpy(r, f, sizeof(r));
+			} else if (!strcmp(modes[i], "running")) {
+				w = 1.0f / (float)MIN(c + 1, 4);
+				for (n = 0; n < FRAME_SAMPLES; n++)
+					r[n] += (f[n] - r[n]) * w;
+			} else {
+				for (n = 0; n < FRAME_SAMPLES; n++) {
+					if (!strcmp(modes[i], "mean"))
+						r[n] += f[n];
+					else if (!strcmp(modes[i], "min"))
+						r[n] = MIN(r[n], f[n]);
+					else
+						r[n] = MAX(r[n], f[n]);
+				}
+			}
+			if (strcmp(modes[i], "running") && c % 4 != 3)
+				continue;
+
+			j = strcmp(modes[i], "running") ? c / 4 : c;
+			for (n = 0; n < FRAME_SAMPLES; n++) {
+				want = r[n];
+				if (!strcmp(modes[i], "mean"))
+					want *= 1.0f / 4;
+				diff = values[j * FRAME_SAMPLES + n] - want;
+				fail_unless(magnitude(diff) < 1e-4,
+					"%s: frame %u sample %u is %f, not %f.",
+					modes[i], j, n,
+					values[j * FRAME_SAMPLES + n], want);
+			}
+		}
+	}
+
+	srtest_feed_free(&feed);
+	g_free(ref);
+}
+END_TEST
+
+/*
+ * Combine gray code into buses: a named one in order, a named one in
+ * reverse order wider than a byte, and one named by default. Then list
+ * the changes of two buses instead, which adds no analog channels.
+ */
+START_TEST(test_transform_bus)
+{
+	static const char *names[] = { "lo", "hi", "bus2", };
+	static const int unitsizes[] = { 1, 2, 1, };
+	const struct sr_transform *t;
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	struct srtest_trace *trace;
+	struct srtest_feed feed;
+	const float *values[G_N_ELEMENTS(names)];
+	uint64_t k, want;
+	unsigned int i;
+	int n;
+
+	sdi = srtest_demo_dev(16, 0, SR_MHZ(1), DEMO_SAMPLES);
+	srtest_demo_pattern(sdi, "Logic", "graycode");
+	srtest_feed_init(&feed);
+
+	sess = feed_session(sdi, &feed);
+	t = transform_new(sdi, "bus", srtest_params("buses",
+		g_variant_new_string("lo=D0,D1,D2,D3;"
+			"hi=D15,D14,D13,D12,D11,D10,D9,D8,D7;D4,D5"), NULL));
+	for (i = 0; i < G_N_ELEMENTS(names); i++) {
+		ch = find_channel(sdi, names[i]);
+		fail_unless(ch && ch->type == SR_CHANNEL_ANALOG &&
+			ch->index == 16 + (int)i, "No analog channel %s.",
+			names[i]);
+	}
+	srtest_feed_run(sess, &feed);
+	sr_session_destroy(sess);
+	sr_transform_free(t);
+	for (i = 0; i < G_N_ELEMENTS(names); i++)
+		fail_unless(!find_channel(sdi, names[i]),
+			"Channel %s was kept.", names[i]);
+
+	/* The logic data passes. */
+	fail_unless(feed.unitsize == 2, "Unit size %d.", feed.unitsize);
+	fail_unless(feed.logic->len == DEMO_SAMPLES * 2,
+		"Got %u bytes.", feed.logic->len);
+	for (i = 0; i < G_N_ELEMENTS(names); i++) {
+		values[i] = trace_values(&feed, names[i], DEMO_SAMPLES);
+		trace = srtest_feed_trace(&feed, names[i]);
+		fail_unless(!trace->is_float && trace->unitsize == unitsizes[i],
+			"%s: unit size %d.", names[i], trace->unitsize);
+	}
+	for (k = 0; k < DEMO_SAMPLES; k++) {
+		fail_unless(srtest_feed_sample(&feed, k) == gray(k),
+			"Sample %" PRIu64 " is 0x%04" PRIx64 ".",
+			k, srtest_feed_sample(&feed, k));
+		want = 0;
+		for (n = 0; n < 9; n++)
+			want |= (uint64_t)((gray(k) >> (15 - n)) & 1) << n;
+		fail_unless(values[0][k] == (gray(k) & 0xf) &&
+			values[1][k] == want &&
+			values[2][k] == ((gray(k) >> 4) & 0x3),
+			"Sample %" PRIu64 ": %f, %f, %f.", k,
+			values[0][k], values[1][k], values[2][k]);
+	}
+
+	sess = feed_session(sdi, &feed);
+	t = transform_new(sdi, "bus", srtest_params(
+		"buses", g_variant_new_string("D12,D13;D14,D15"),
+		"changes", g_variant_new_boolean(TRUE), NULL));
+	fail_unless(!find_channel(sdi, "bus0") && !find_channel(sdi, "bus1"),
+		"Analog channels were added.");
+	srtest_feed_run(sess, &feed);
+	sr_session_destroy(sess);
+	sr_transform_free(t);
+
+	fail_unless(g_hash_table_size(feed.traces) == 0, "Got analog values.");
+	fail_unless(feed.rle_packets > 0, "No runs.");
+	fail_unless(feed.unitsize == 1, "Unit size %d.", feed.unitsize);
+	fail_unless(feed.logic->len == DEMO_SAMPLES,
+		"Got %u bytes.", feed.logic->len);
+	for (k = 0; k < DEMO_SAMPLES; k++)
+		fail_unless(srtest_feed_sample(&feed, k) == (gray(k) >> 12),
+			"Sample %" PRIu64 " is 0x%" PRIx64 ".",
+			k, srtest_feed_sample(&feed, k));
+
+	srtest_feed_free(&feed);
+}
+END_TEST
+
 Suite *suite_transform_all(void)
 {
 	Suite *s;
@@ -112,5 +657,35 @@ Suite *suite_transform_all(void)
 	tcase_add_test(tc, test_transform_options);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("decimate");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_transform_decimate);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("repack");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_transform_repack);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("rle");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_transform_rle);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("threshold");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_transform_threshold);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("average");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_transform_average);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("bus");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_transform_bus);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -0,0 +1,216 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <libsigrok/libsigrok.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "transpose.h"
+#include "cpu_features.h"
+
+#define NUM_BLOCKS 37
+
+static const unsigned int word_sizes[] = { 8, 16, 32, 64 };
+
+static uint8_t raw[NUM_BLOCKS * SR_TRANSPOSE_MAX_WORDS * 8];
+static uint16_t out[NUM_BLOCKS * 64];
+
+static void fill_raw(void)
+{
+	size_t i;
+	uint32_t lfsr;
+
+	lfsr = 0xace1u;
+	for (i = 0; i < ARRAY_SIZE(raw); i++) {
+		lfsr = lfsr * 1103515245u + 12345u;
+		raw[i] = lfsr >> 16;
+	}
+}
+
+/* One sample, straight from the description of the layout. */
+static uint16_t ref_sample(const struct sr_transpose *tp,
+	const uint16_t *word_masks, size_t block, unsigned int sample)
+{
+	const uint8_t *words;
+	unsigned int c, bit;
+	uint64_t w;
+	uint16_t s;
+
+	words = &raw[block * sr_transpose_block_bytes(tp)];
+	bit = tp->msb_first ? tp->word_bits - 1 - sample : sample;
+	s = 0;
+	for (c = 0; c < tp->num_words; c++) {
+		w = 0;
+		memcpy(&w, &words[c * tp->word_bits / 8], tp->word_bits / 8);
+		if (G_BYTE_ORDER == G_BIG_ENDIAN)
+			w >>= 64 - tp->word_bits;
+		if ((w >> bit) & 1)
+			s |= word_masks[c];
+	}
+
+	return s;
+}
+
+static void check_impl(const struct sr_transpose_impl *impl,
+	unsigned int word_bits, gboolean msb_first,
+	const uint16_t *word_masks, unsigned int num_words)
+{
+	struct sr_transpose tp;
+	size_t b;
+	unsigned int i;
+
+	fail_unless(sr_transpose_init(&tp, word_bits, msb_first,
+		word_masks, num_words) == SR_OK);
+	tp.fn = impl->fn;
+	memset(out, 0x55, sizeof(out));
+	sr_transpose_blocks(&tp, out, raw, NUM_BLOCKS);
+	for (b = 0; b < NUM_BLOCKS; b++) {
+		for (i = 0; i < word_bits; i++) {
+			fail_unless(out[b * word_bits + i] ==
+				ref_sample(&tp, word_masks, b, i),
+				"%s mismatch for %u words of %u bits.",
+				impl->name, num_words, word_bits);
+		}
+	}
+}
+
+/* Check all usable kernels, for all layouts, with and without remapping. */
+START_TEST(test_transpose_layouts)
+{
+	const struct sr_transpose_impl *impl;
+	uint16_t identity[SR_TRANSPOSE_MAX_WORDS], spread[SR_TRANSPOSE_MAX_WORDS];
+	unsigned int i, n;
+	int msb;
+
+	fill_raw();
+	for (n = 0; n < SR_TRANSPOSE_MAX_WORDS; n++) {
+		identity[n] = 1 << n;
+		spread[n] = 1 << ((n * 5 + 3) % 16);
+	}
+	for (impl = sr_transpose_impls; impl->name; impl++) {
+		if (!impl->supported())
+			continue;
+		for (i = 0; i < ARRAY_SIZE(word_sizes); i++) {
+			for (msb = 0; msb < 2; msb++) {
+				for (n = 1; n <= SR_TRANSPOSE_MAX_WORDS; n++) {
+					check_impl(impl, word_sizes[i], msb,
+						identity, n);
+					check_impl(impl, word_sizes[i], msb,
+						spread, n);
+				}
+			}
+		}
+	}
+}
+END_TEST
+
+/* Check a hand-made block of two 8 bit words. */
+START_TEST(test_transpose_simple)
+{
+	struct sr_transpose tp;
+	const uint8_t in[] = { 0x0f, 0x55 };
+	const uint16_t exp[] = { 3, 1, 3, 1, 2, 0, 2, 0 };
+	const uint16_t exp_msb[] = { 0, 2, 0, 2, 1, 3, 1, 3 };
+
+	fail_unless(sr_transpose_init(&tp, 8, FALSE, NULL, 2) == SR_OK);
+	sr_transpose_blocks(&tp, out, in, 1);
+	fail_unless(memcmp(out, exp, sizeof(exp)) == 0);
+
+	fail_unless(sr_transpose_init(&tp, 8, TRUE, NULL, 2) == SR_OK);
+	sr_transpose_blocks(&tp, out, in, 1);
+	fail_unless(memcmp(out, exp_msb, sizeof(exp_msb)) == 0);
+}
+END_TEST
+
+/* Check that planar blocks transpose back to the samples they came from. */
+START_TEST(test_transpose_to_planar)
+{
+	const struct sr_transpose_impl *impl;
+	struct sr_transpose tp;
+	static uint16_t samples[NUM_BLOCKS * 64];
+	static uint8_t planes[NUM_BLOCKS * SR_TRANSPOSE_MAX_WORDS * 8];
+	unsigned int n;
+	size_t i;
+
+	fill_raw();
+	memcpy(samples, raw, sizeof(samples));
+	for (impl = sr_transpose_impls; impl->name; impl++) {
+		if (!impl->supported())
+			continue;
+		for (n = 1; n <= SR_TRANSPOSE_MAX_WORDS; n++) {
+			fail_unless(sr_transpose_init(&tp, 64, FALSE,
+				NULL, n) == SR_OK);
+			sr_transpose_to_planar(impl, planes, samples, n,
+				NUM_BLOCKS);
+			sr_transpose_blocks(&tp, out, planes, NUM_BLOCKS);
+			for (i = 0; i < ARRAY_SIZE(samples); i++) {
+				fail_unless(out[i] == (samples[i] &
+					((1u << n) - 1)),
+					"%s mismatch for %u planes.",
+					impl->name, n);
+			}
+		}
+	}
+}
+END_TEST
+
+/* Check that invalid layouts get rejected. */
+START_TEST(test_transpose_init)
+{
+	struct sr_transpose tp;
+
+	fail_unless(sr_transpose_init(&tp, 24, FALSE, NULL, 4) == SR_ERR_ARG);
+	fail_unless(sr_transpose_init(&tp, 64, FALSE, NULL, 0) == SR_ERR_ARG);
+	fail_unless(sr_transpose_init(&tp, 64, FALSE, NULL, 17) == SR_ERR_ARG);
+	fail_unless(sr_transpose_init(NULL, 64, FALSE, NULL, 4) == SR_ERR_ARG);
+	fail_unless(sr_transpose_impl_get()->supported());
+}
+END_TEST
+
+/* SIGROK_CPU_FEATURES can only take away features. */
+START_TEST(test_cpu_features_parse)
+{
+	const uint32_t all = SR_CPU_SSE2 | SR_CPU_SSSE3 | SR_CPU_AVX2;
+
+	fail_unless(sr_cpu_features_parse(NULL, all) == all);
+	fail_unless(sr_cpu_features_parse("none", all) == 0);
+	fail_unless(sr_cpu_features_parse("", all) == 0);
+	fail_unless(sr_cpu_features_parse("sse2, AVX2", all) ==
+		(SR_CPU_SSE2 | SR_CPU_AVX2));
+	fail_unless(sr_cpu_features_parse("neon,bmi2", all) == 0);
+}
+END_TEST
+
+Suite *suite_transpose(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("transpose");
+
+	tc = tcase_create("transpose");
+	tcase_add_test(tc, test_transpose_layouts);
+	tcase_add_test(tc, test_transpose_simple);
+	tcase_add_test(tc, test_transpose_to_planar);
+	tcase_add_test(tc, test_transpose_init);
+	tcase_add_test(tc, test_cpu_features_parse);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -18,8 +18,10 @@
  */
 
 #include <config.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <libsigrok/libsigrok.h>
 #include "lib.h"
@@ -30,6 +32,37 @@
 #define NUM_MATCHES 70
 #define NUM_CHANNELS NUM_MATCHES
 
+#define DEMO_SAMPLES (64 * 1024)
+
+/* One match of a trigger, rows end with a stage of -1. */
+struct trigger_spec {
+	int stage;
+	int channel;
+	int match;
+};
+
+static const struct trigger_spec trigger_specs[][4] = {
+	{ { 0, 3, SR_TRIGGER_RISING }, { -1 } },
+	{ { 0, 4, SR_TRIGGER_ONE }, { 0, 5, SR_TRIGGER_FALLING }, { -1 } },
+	{ { 0, 3, SR_TRIGGER_ONE }, { 0, 4, SR_TRIGGER_EDGE },
+		{ 0, 7, SR_TRIGGER_ONE }, { -1 } },
+	{ { 0, 0, SR_TRIGGER_RISING }, { 1, 1, SR_TRIGGER_ONE },
+		{ 1, 2, SR_TRIGGER_ZERO }, { -1 } },
+	{ { 0, 6, SR_TRIGGER_FALLING }, { 1, 0, SR_TRIGGER_EDGE },
+		{ 1, 6, SR_TRIGGER_ZERO }, { -1 } },
+	{ { 0, 15, SR_TRIGGER_RISING }, { -1 } },
+	{ { 0, 1, SR_TRIGGER_ONE }, { 0, 1, SR_TRIGGER_ZERO }, { -1 } },
+};
+
+struct trigger_log {
+	uint16_t unitsize;
+	uint64_t logic_before;
+	uint64_t first;
+	gboolean have_first;
+	int triggers;
+	int ends;
+};
+
 /* Check whether creating/freeing triggers with valid names works. */
 START_TEST(test_trigger_new_free)
 {
@@ -115,6 +148,24 @@ START_TEST(test_trigger_stage_add_null)
 }
 END_TEST
 
+/* Check whether setting stage repeat counts and windows works. */
+START_TEST(test_trigger_stage_repeat_window)
+{
+	struct sr_trigger *t;
+	struct sr_trigger_stage *s;
+
+	t = sr_trigger_new("T");
+	s = sr_trigger_stage_add(t);
+	fail_unless(s->repeat == 0 && s->window == 0);
+	fail_unless(sr_trigger_stage_repeat_set(s, 16) == SR_OK);
+	fail_unless(sr_trigger_stage_window_set(s, 100) == SR_OK);
+	fail_unless(s->repeat == 16 && s->window == 100);
+	fail_unless(sr_trigger_stage_repeat_set(NULL, 16) == SR_ERR_ARG);
+	fail_unless(sr_trigger_stage_window_set(NULL, 100) == SR_ERR_ARG);
+	sr_trigger_free(t);
+}
+END_TEST
+
 /* Check whether creating/freeing triggers with matches works. */
 START_TEST(test_trigger_match_add)
 {
@@ -249,6 +300,634 @@ START_TEST(test_trigger_match_add_bogus)
 }
 END_TEST
 
+/* Sample k of the demo's "graycode" pattern with n logic channels. */
+static uint64_t demo_gray(uint64_t k, int n)
+{
+	uint64_t mask, x;
+
+	mask = (n < 64) ? (1ULL << n) - 1 : ~0ULL;
+	x = (k + 1) & mask;
+
+	return (x ^ (x >> 1)) & mask;
+}
+
+static gboolean spec_match(const struct trigger_spec *spec, int stage,
+		uint64_t k, int n)
+{
+	uint64_t cur, prev;
+	gboolean c, p;
+
+	cur = demo_gray(k, n);
+	prev = (k > 0) ? demo_gray(k - 1, n) : 0;
+	for (; spec->stage >= 0; spec++) {
+		if (spec->stage != stage)
+			continue;
+		c = (cur >> spec->channel) & 1;
+		p = (prev >> spec->channel) & 1;
+		switch (spec->match) {
+		case SR_TRIGGER_ZERO:
+			if (c)
+				return FALSE;
+			break;
+		case SR_TRIGGER_ONE:
+			if (!c)
+				return FALSE;
+			break;
+		case SR_TRIGGER_RISING:
+			if (k == 0 || p || !c)
+				return FALSE;
+			break;
+		case SR_TRIGGER_FALLING:
+			if (k == 0 || !p || c)
+				return FALSE;
+			break;
+		case SR_TRIGGER_EDGE:
+			if (k == 0 || p == c)
+				return FALSE;
+			break;
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Reference matcher: stages match consecutive samples, the trigger
+ * fires on the sample where the last stage matched.
+ */
+static int64_t trigger_expect(const struct trigger_spec *spec, int n)
+{
+	const struct trigger_spec *m;
+	int num_stages, s;
+	uint64_t k;
+
+	num_stages = 0;
+	for (m = spec; m->stage >= 0; m++)
+		num_stages = MAX(num_stages, m->stage + 1);
+
+	for (k = num_stages - 1; k < DEMO_SAMPLES; k++) {
+		for (s = 0; s < num_stages; s++) {
+			if (!spec_match(spec, s, k - num_stages + 1 + s, n))
+				break;
+		}
+		if (s == num_stages)
+			return k;
+	}
+
+	return -1;
+}
+
+static void trigger_log_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct trigger_log *log;
+	const struct sr_datafeed_logic *logic;
+	const uint8_t *p;
+	int i;
+
+	(void)sdi;
+
+	log = cb_data;
+	switch (packet->type) {
+	case SR_DF_TRIGGER:
+		log->triggers++;
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		if (!logic->length)
+			break;
+		if (!log->triggers) {
+			log->logic_before += logic->length;
+			break;
+		}
+		if (log->have_first)
+			break;
+		p = logic->data;
+		log->unitsize = logic->unitsize;
+		for (i = logic->unitsize - 1; i >= 0; i--)
+			log->first = (log->first << 8) | p[i];
+		log->have_first = TRUE;
+		break;
+	case SR_DF_END:
+		log->ends++;
+		break;
+	}
+}
+
+static struct sr_channel *channel_get(const struct sr_dev_inst *sdi, int index)
+{
+	struct sr_channel *ch;
+	char name[8];
+	GSList *l;
+
+	snprintf(name, sizeof(name), "D%d", index);
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		if (!strcmp(ch->name, name))
+			return ch;
+	}
+	fail("No channel '%s'.", name);
+
+	return NULL;
+}
+
+/*
+ * Check the compiled soft trigger against a reference matcher, on the
+ * demo's graycode pattern for several unit sizes.
+ */
+START_TEST(test_trigger_soft_match)
+{
+	static const int num_logic[] = { 8, 16, 24, 32 };
+	const struct trigger_spec *spec, *m;
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *trig;
+	struct sr_trigger_stage *stage;
+	struct trigger_log log;
+	int64_t expect;
+	unsigned int i, j;
+	int n, ret;
+
+	for (i = 0; i < ARRAY_SIZE(num_logic); i++) {
+		n = num_logic[i];
+		ret = sr_session_new(srtest_ctx, &sess);
+		fail_unless(ret == SR_OK, "Failed to create session: %d.", ret);
+		sdi = srtest_demo_dev(n, 0, SR_MHZ(1), DEMO_SAMPLES);
+		srtest_demo_pattern(sdi, "Logic", "graycode");
+		ret = sr_config_set(sdi, NULL, SR_CONF_CAPTURE_RATIO,
+			g_variant_new_uint64(0));
+		fail_unless(ret == SR_OK, "Failed to set capture ratio: %d.", ret);
+		ret = sr_session_dev_add(sess, sdi);
+		fail_unless(ret == SR_OK, "Failed to add device: %d.", ret);
+		ret = sr_session_datafeed_callback_add(sess, trigger_log_cb, &log);
+		fail_unless(ret == SR_OK);
+
+		for (j = 0; j < ARRAY_SIZE(trigger_specs); j++) {
+			spec = trigger_specs[j];
+			for (m = spec; m->stage >= 0; m++) {
+				if (m->channel >= n)
+					break;
+			}
+			if (m->stage >= 0)
+				continue;
+
+			trig = sr_trigger_new(NULL);
+			for (m = spec; m->stage >= 0; m++) {
+				while (g_slist_length(trig->stages) <= (guint)m->stage)
+					sr_trigger_stage_add(trig);
+				stage = g_slist_nth_data(trig->stages, m->stage);
+				ret = sr_trigger_match_add(stage,
+					channel_get(sdi, m->channel), m->match, 0);
+				fail_unless(ret == SR_OK);
+			}
+			ret = sr_session_trigger_set(sess, trig);
+			fail_unless(ret == SR_OK);
+
+			memset(&log, 0, sizeof(log));
+			ret = sr_session_start(sess);
+			fail_unless(ret == SR_OK, "Failed to start session: %d.", ret);
+			ret = sr_session_run(sess);
+			fail_unless(ret == SR_OK, "Failed to run session: %d.", ret);
+
+			expect = trigger_expect(spec, n);
+			fail_unless(log.ends == 1, "%d channels, trigger %u: "
+				"%d ends.", n, j, log.ends);
+			if (expect < 0) {
+				fail_unless(log.triggers == 0 && !log.have_first,
+					"%d channels, trigger %u fired.", n, j);
+			} else {
+				fail_unless(log.triggers == 1, "%d channels, "
+					"trigger %u: %d triggers.", n, j,
+					log.triggers);
+				fail_unless(log.logic_before == 0);
+				fail_unless(log.have_first && log.unitsize == (n + 7) / 8);
+				fail_unless(log.first == demo_gray(expect, n),
+					"%d channels, trigger %u: sample 0x%" PRIx64
+					", expected 0x%" PRIx64 " (sample %" PRId64 ").",
+					n, j, log.first, demo_gray(expect, n), expect);
+			}
+
+			sr_session_trigger_set(sess, NULL);
+			sr_trigger_free(trig);
+		}
+
+		sr_session_destroy(sess);
+	}
+}
+END_TEST
+
+/* Graycode on 16 channels, the top one rises for the first time here. */
+#define DEMO_TRIGGER 32767
+
+struct pre_trigger_log {
+	GByteArray *logic;
+	/* Logic bytes received before the trigger packet, -1 if none. */
+	int64_t pre_bytes;
+	int ends;
+};
+
+static void pre_trigger_log_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct pre_trigger_log *log;
+	const struct sr_datafeed_logic *logic;
+
+	(void)sdi;
+
+	log = cb_data;
+	switch (packet->type) {
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		g_byte_array_append(log->logic, logic->data, logic->length);
+		break;
+	case SR_DF_TRIGGER:
+		fail_unless(log->pre_bytes == -1, "Second trigger packet.");
+		log->pre_bytes = log->logic->len;
+		break;
+	case SR_DF_END:
+		log->ends++;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * The demo's soft trigger keeps its pre-trigger data by reference. Check
+ * that it sends just the samples before the trigger, up to the capture
+ * ratio, and that they and the ones after it are the generated ones.
+ */
+START_TEST(test_trigger_soft_pre_trigger)
+{
+	static const uint64_t ratios[] = { 0, 5, 20, 49, 90 };
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_trigger *t;
+	struct sr_trigger_stage *s;
+	struct pre_trigger_log log;
+	uint64_t pre, first, v;
+	unsigned int i, k;
+
+	sr_session_new(srtest_ctx, &sess);
+	sdi = srtest_demo_dev(16, 0, SR_MHZ(10), DEMO_SAMPLES);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, pre_trigger_log_cb, &log);
+	srtest_demo_pattern(sdi, "Logic", "graycode");
+
+	t = sr_trigger_new("T");
+	s = sr_trigger_stage_add(t);
+	sr_trigger_match_add(s, channel_get(sdi, 15), SR_TRIGGER_RISING, 0);
+	fail_unless(sr_session_trigger_set(sess, t) == SR_OK);
+
+	log.logic = g_byte_array_new();
+	for (i = 0; i < ARRAY_SIZE(ratios); i++) {
+		fail_unless(sr_config_set(sdi, NULL, SR_CONF_CAPTURE_RATIO,
+			g_variant_new_uint64(ratios[i])) == SR_OK);
+		g_byte_array_set_size(log.logic, 0);
+		log.pre_bytes = -1;
+		log.ends = 0;
+		fail_unless(sr_session_start(sess) == SR_OK);
+		fail_unless(sr_session_run(sess) == SR_OK);
+		fail_unless(log.ends == 1);
+
+		pre = MIN(ratios[i] * DEMO_SAMPLES / 100, DEMO_TRIGGER);
+		fail_unless(log.pre_bytes == (int64_t)pre * 2,
+			"Ratio %" PRIu64 ": %" PRIi64 " bytes before the trigger.",
+			ratios[i], log.pre_bytes);
+		fail_unless(log.logic->len > pre * 2 && log.logic->len % 2 == 0);
+
+		first = DEMO_TRIGGER - pre;
+		for (k = 0; k < log.logic->len / 2; k++) {
+			v = log.logic->data[2 * k] | log.logic->data[2 * k + 1] << 8;
+			fail_unless(v == demo_gray(first + k, 16),
+				"Ratio %" PRIu64 ": sample %u is 0x%04" PRIx64 ".",
+				ratios[i], k, v);
+		}
+	}
+
+	g_byte_array_free(log.logic, TRUE);
+	sr_session_destroy(sess);
+	sr_trigger_free(t);
+}
+END_TEST
+
+#define ANALOG_SAMPLES 60
+
+struct analog_log {
+	GArray *values;
+	/* Values received before the trigger packet, -1 if none. */
+	int pre_values;
+	int ends;
+};
+
+static void analog_log_cb(const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct analog_log *log;
+	const struct sr_datafeed_analog *analog;
+	unsigned int len;
+
+	(void)sdi;
+
+	log = cb_data;
+	switch (packet->type) {
+	case SR_DF_ANALOG:
+		analog = packet->payload;
+		len = log->values->len;
+		g_array_set_size(log->values, len + analog->num_samples);
+		fail_unless(sr_analog_to_float(analog,
+			&g_array_index(log->values, float, len)) == SR_OK);
+		break;
+	case SR_DF_TRIGGER:
+		fail_unless(log->pre_values == -1, "Second trigger packet.");
+		log->pre_values = log->values->len;
+		break;
+	case SR_DF_END:
+		log->ends++;
+		break;
+	default:
+		break;
+	}
+}
+
+static void analog_run(struct sr_session *sess, struct analog_log *log)
+{
+	g_array_set_size(log->values, 0);
+	log->pre_values = -1;
+	log->ends = 0;
+	fail_unless(sr_session_start(sess) == SR_OK);
+	fail_unless(sr_session_run(sess) == SR_OK);
+	fail_unless(log->ends == 1);
+	fail_unless(log->values->len > 0);
+}
+
+/* Where the trigger fires in the values, with no hysteresis. */
+static int analog_expect(const float *v, int num, int match, float level)
+{
+	gboolean rise_armed, fall_armed;
+	int i;
+
+	rise_armed = fall_armed = FALSE;
+	for (i = 0; i < num; i++) {
+		switch (match) {
+		case SR_TRIGGER_OVER:
+			if (v[i] > level)
+				return i;
+			break;
+		case SR_TRIGGER_UNDER:
+			if (v[i] < level)
+				return i;
+			break;
+		default:
+			if (match != SR_TRIGGER_FALLING && rise_armed &&
+					v[i] >= level)
+				return i;
+			if (match != SR_TRIGGER_RISING && fall_armed &&
+					v[i] <= level)
+				return i;
+			break;
+		}
+		rise_armed = v[i] < level;
+		fall_armed = v[i] > level;
+	}
+
+	return -1;
+}
+
+/*
+ * The demo's analog trigger on a sawtooth, in packets of a sample each
+ * when averaging over single samples, else of all the samples a round
+ * has. The values around the trigger must be those of an untriggered
+ * run, with the pre-trigger data as much of them as the capture ratio
+ * asks for and were there before the trigger.
+ */
+START_TEST(test_trigger_soft_analog)
+{
+	static const struct {
+		int match;
+		float level;
+		uint64_t ratio;
+	} cases[] = {
+		{ SR_TRIGGER_OVER, 4.2, 50, },
+		{ SR_TRIGGER_UNDER, -4.2, 10, },
+		{ SR_TRIGGER_RISING, -0.25, 25, },
+		{ SR_TRIGGER_FALLING, 2, 0, },
+		{ SR_TRIGGER_EDGE, 1.25, 90, },
+	};
+	struct sr_session *sess;
+	struct sr_dev_inst *sdi;
+	struct sr_channel *ch;
+	struct sr_trigger *t;
+	struct sr_trigger_stage *s;
+	struct analog_log log;
+	GArray *ref;
+	float *v;
+	int avg, pos, pre;
+	unsigned int i, k;
+
+	sr_session_new(srtest_ctx, &sess);
+	sdi = srtest_demo_dev(0, 1, SR_KHZ(10), ANALOG_SAMPLES);
+	sr_session_dev_add(sess, sdi);
+	sr_session_datafeed_callback_add(sess, analog_log_cb, &log);
+	srtest_demo_pattern(sdi, "A0", "sawtooth");
+	ch = sr_dev_inst_channels_get(sdi)->data;
+	fail_unless(ch->type == SR_CHANNEL_ANALOG);
+
+	log.values = g_array_new(FALSE, FALSE, sizeof(float));
+	ref = g_array_new(FALSE, FALSE, sizeof(float));
+	for (avg = 0; avg < 2; avg++) {
+		fail_unless(sr_config_set(sdi, NULL, SR_CONF_AVERAGING,
+			g_variant_new_boolean(avg)) == SR_OK);
+		fail_unless(sr_config_set(sdi, NULL, SR_CONF_AVG_SAMPLES,
+			g_variant_new_uint64(1)) == SR_OK);
+
+		sr_session_trigger_set(sess, NULL);
+		analog_run(sess, &log);
+		fail_unless(log.pre_values == -1);
+		fail_unless(log.values->len == ANALOG_SAMPLES);
+		g_array_set_size(ref, 0);
+		g_array_append_vals(ref, log.values->data, log.values->len);
+
+		for (i = 0; i < ARRAY_SIZE(cases); i++) {
+			t = sr_trigger_new("T");
+			s = sr_trigger_stage_add(t);
+			sr_trigger_match_add(s, ch, cases[i].match,
+				cases[i].level);
+			fail_unless(sr_session_trigger_set(sess, t) == SR_OK);
+			fail_unless(sr_config_set(sdi, NULL, SR_CONF_CAPTURE_RATIO,
+				g_variant_new_uint64(cases[i].ratio)) == SR_OK);
+			analog_run(sess, &log);
+
+			pos = analog_expect((float *)ref->data, ref->len,
+				cases[i].match, cases[i].level);
+			fail_unless(pos > 0, "Case %u never triggers.", i);
+			pre = MIN(cases[i].ratio * ANALOG_SAMPLES / 100,
+				(uint64_t)pos);
+			fail_unless(log.pre_values == pre,
+				"Averaging %d, case %u: %d values before the "
+				"trigger, expected %d.", avg, i, log.pre_values,
+				pre);
+			fail_unless(log.values->len == (unsigned int)
+				(pre + ANALOG_SAMPLES - pos),
+				"Averaging %d, case %u: %u values.", avg, i,
+				log.values->len);
+			v = (float *)log.values->data;
+			for (k = 0; k < log.values->len; k++)
+				fail_unless(v[k] == g_array_index(ref, float,
+					pos - pre + k),
+					"Averaging %d, case %u: value %u is %g.",
+					avg, i, k, v[k]);
+
+			sr_session_trigger_set(sess, NULL);
+			sr_trigger_free(t);
+		}
+	}
+
+	g_array_free(ref, TRUE);
+	g_array_free(log.values, TRUE);
+	sr_session_destroy(sess);
+}
+END_TEST
+
+#define SEARCH_SAMPLES (1000 * 1000)
+#define SEARCH_PERIOD 1000
+#define SEARCH_PULSE 300
+
+/* Check that searching finds every pulse, with any number of threads. */
+START_TEST(test_trigger_search)
+{
+	struct sr_trigger *t;
+	struct sr_trigger_stage *s;
+	struct sr_channel *ch;
+	GArray *offsets[2];
+	uint8_t *data;
+	unsigned int i;
+
+	ch = g_malloc0(sizeof(struct sr_channel));
+	ch->index = 0;
+	ch->type = SR_CHANNEL_LOGIC;
+	ch->enabled = TRUE;
+	ch->name = g_strdup("L0");
+
+	/* Pulses on the channel, noise on the others. */
+	data = g_malloc(SEARCH_SAMPLES);
+	for (i = 0; i < SEARCH_SAMPLES; i++)
+		data[i] = (rand() & 0xfe) |
+			(i % SEARCH_PERIOD >= SEARCH_PERIOD - SEARCH_PULSE);
+
+	/* A rising and then a falling edge, within the pulse width. */
+	t = sr_trigger_new("T");
+	s = sr_trigger_stage_add(t);
+	sr_trigger_match_add(s, ch, SR_TRIGGER_RISING, 0);
+	s = sr_trigger_stage_add(t);
+	sr_trigger_match_add(s, ch, SR_TRIGGER_FALLING, 0);
+	sr_trigger_stage_window_set(s, SEARCH_PULSE);
+
+	fail_unless(sr_trigger_search(t, data, SEARCH_SAMPLES, 1, 1,
+		&offsets[0]) == SR_OK);
+	fail_unless(sr_trigger_search(t, data, SEARCH_SAMPLES, 1, 4,
+		&offsets[1]) == SR_OK);
+
+	/* The last pulse doesn't end within the data. */
+	fail_unless(offsets[0]->len == SEARCH_SAMPLES / SEARCH_PERIOD - 1);
+	fail_unless(offsets[1]->len == offsets[0]->len);
+	for (i = 0; i < offsets[0]->len; i++) {
+		fail_unless(g_array_index(offsets[0], uint64_t, i) ==
+			(i + 1) * SEARCH_PERIOD);
+		fail_unless(g_array_index(offsets[1], uint64_t, i) ==
+			(i + 1) * SEARCH_PERIOD);
+	}
+	g_array_free(offsets[0], TRUE);
+	g_array_free(offsets[1], TRUE);
+
+	/* A window that ends right before the falling edge. */
+	sr_trigger_stage_window_set(s, SEARCH_PULSE - 2);
+	fail_unless(sr_trigger_search(t, data, SEARCH_SAMPLES, 1, 0,
+		&offsets[0]) == SR_OK);
+	fail_unless(offsets[0]->len == 0);
+	g_array_free(offsets[0], TRUE);
+
+	fail_unless(sr_trigger_search(NULL, data, SEARCH_SAMPLES, 1, 0,
+		&offsets[0]) == SR_ERR_ARG);
+	fail_unless(sr_trigger_search(t, data, SEARCH_SAMPLES, 0, 0,
+		&offsets[0]) == SR_ERR_ARG);
+
+	sr_trigger_free(t);
+	g_free(data);
+	g_free(ch->name);
+	g_free(ch);
+}
+END_TEST
+
+#define SKIP_SAMPLES (64 * 1024)
+
+/*
+ * Edges after long runs without changes on the trigger channel, at all
+ * offsets into the blocks the scan skips, with noise on the others.
+ */
+START_TEST(test_trigger_search_skip)
+{
+	struct sr_trigger *t;
+	struct sr_trigger_stage *s;
+	struct sr_channel *ch;
+	GArray *offsets, *expected;
+	uint8_t *data, *sample, bit;
+	unsigned int unitsize, i, j, level, next;
+	uint64_t pos;
+
+	for (unitsize = 1; unitsize <= 8; unitsize *= 2) {
+		ch = g_malloc0(sizeof(struct sr_channel));
+		ch->index = 8 * unitsize - 1;
+		ch->type = SR_CHANNEL_LOGIC;
+		ch->enabled = TRUE;
+		ch->name = g_strdup("T");
+		bit = 0x80;
+
+		expected = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+		data = g_malloc(SKIP_SAMPLES * unitsize);
+		level = 0;
+		next = 1;
+		for (i = 0; i < SKIP_SAMPLES; i++) {
+			if (i == next) {
+				level = !level;
+				if (level) {
+					pos = i;
+					g_array_append_val(expected, pos);
+				}
+				next += 100 + i % 67;
+			}
+			sample = data + i * unitsize;
+			for (j = 0; j < unitsize; j++)
+				sample[j] = rand();
+			sample[unitsize - 1] &= ~bit;
+			if (level)
+				sample[unitsize - 1] |= bit;
+		}
+
+		t = sr_trigger_new("T");
+		s = sr_trigger_stage_add(t);
+		sr_trigger_match_add(s, ch, SR_TRIGGER_RISING, 0);
+		fail_unless(sr_trigger_search(t, data, SKIP_SAMPLES * unitsize,
+			unitsize, 1, &offsets) == SR_OK);
+		fail_unless(offsets->len == expected->len,
+			"Unit size %u: %u edges, expected %u.",
+			unitsize, offsets->len, expected->len);
+		for (i = 0; i < offsets->len; i++)
+			fail_unless(g_array_index(offsets, uint64_t, i) ==
+				g_array_index(expected, uint64_t, i),
+				"Unit size %u: edge %u at %" PRIu64 ".", unitsize,
+				i, g_array_index(offsets, uint64_t, i));
+
+		g_array_free(offsets, TRUE);
+		g_array_free(expected, TRUE);
+		sr_trigger_free(t);
+		g_free(data);
+		g_free(ch->name);
+		g_free(ch);
+	}
+}
+END_TEST
+
 Suite *suite_trigger(void)
 {
 	Suite *s;
@@ -267,6 +946,7 @@ Suite *suite_trigger(void)
 	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
 	tcase_add_test(tc, test_trigger_stage_add);
 	tcase_add_test(tc, test_trigger_stage_add_null);
+	tcase_add_test(tc, test_trigger_stage_repeat_window);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("match");
@@ -276,5 +956,19 @@ Suite *suite_trigger(void)
 	tcase_add_test(tc, test_trigger_match_add_bogus);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("soft");
+	tcase_set_timeout(tc, 0);
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_trigger_soft_match);
+	tcase_add_test(tc, test_trigger_soft_pre_trigger);
+	tcase_add_test(tc, test_trigger_soft_analog);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("search");
+	tcase_add_checked_fixture(tc, srtest_setup, srtest_teardown);
+	tcase_add_test(tc, test_trigger_search);
+	tcase_add_test(tc, test_trigger_search_skip);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -0,0 +1,253 @@
+/*
+ * This file is part of the libsigrok project.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs acquisitions on a local device back to back and streams them to
+ * the clients of sr_stream_server_new(), the sigrok-stream driver on
+ * other hosts, until interrupted.
+ *
+ *   sigrok-stream-server -d fx2lafw -c samplerate=24m -p 5566
+ *
+ * "make tools" builds it.
+ */
+
+#include <config.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+
+static volatile sig_atomic_t quit;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+
+	quit = 1;
+}
+
+static gpointer watch_thread(gpointer data)
+{
+	while (!quit)
+		g_usleep(100 * 1000);
+	sr_session_stop(data);
+
+	return NULL;
+}
+
+/* Make a config from "key=value", as the key's data type wants it. */
+static struct sr_config *parse_config(const char *text)
+{
+	const struct sr_key_info *info;
+	struct sr_config *src;
+	GVariant *v;
+	char **kv;
+	uint64_t u, p, q;
+
+	kv = g_strsplit(text, "=", 2);
+	info = kv[0] ? sr_key_info_name_get(SR_KEY_CONFIG, kv[0]) : NULL;
+	if (!info) {
+		fprintf(stderr, "Unknown option '%s'.\n", text);
+		g_strfreev(kv);
+		return NULL;
+	}
+
+	v = NULL;
+	switch (info->datatype) {
+	case SR_T_UINT64:
+		if (kv[1] && sr_parse_sizestring(kv[1], &u) == SR_OK)
+			v = g_variant_new_uint64(u);
+		break;
+	case SR_T_INT32:
+		if (kv[1])
+			v = g_variant_new_int32(strtol(kv[1], NULL, 0));
+		break;
+	case SR_T_FLOAT:
+		if (kv[1])
+			v = g_variant_new_double(g_ascii_strtod(kv[1], NULL));
+		break;
+	case SR_T_BOOL:
+		v = g_variant_new_boolean(!kv[1] || sr_parse_boolstring(kv[1]));
+		break;
+	case SR_T_STRING:
+		if (kv[1])
+			v = g_variant_new_string(kv[1]);
+		break;
+	case SR_T_RATIONAL_PERIOD:
+		if (kv[1] && sr_parse_period(kv[1], &p, &q) == SR_OK)
+			v = g_variant_new("(tt)", p, q);
+		break;
+	case SR_T_RATIONAL_VOLT:
+		if (kv[1] && sr_parse_voltage(kv[1], &p, &q) == SR_OK)
+			v = g_variant_new("(tt)", p, q);
+		break;
+	default:
+		break;
+	}
+	g_strfreev(kv);
+	if (!v) {
+		fprintf(stderr, "Bad value in '%s'.\n", text);
+		return NULL;
+	}
+
+	src = g_malloc0(sizeof(*src));
+	src->key = info->key;
+	src->data = g_variant_ref_sink(v);
+
+	return src;
+}
+
+static void config_free(struct sr_config *src)
+{
+	g_variant_unref(src->data);
+	g_free(src);
+}
+
+static struct sr_dev_inst *open_device(struct sr_context *ctx,
+		const char *spec)
+{
+	struct sr_dev_driver **drivers, *driver;
+	struct sr_config *src;
+	struct sr_dev_inst *sdi;
+	GSList *options, *devices;
+	char **fields;
+	int i;
+
+	fields = g_strsplit(spec, ":", 0);
+	driver = NULL;
+	drivers = sr_driver_list(ctx);
+	for (i = 0; drivers[i]; i++) {
+		if (strcmp(drivers[i]->name, fields[0]) == 0)
+			driver = drivers[i];
+	}
+	if (!driver) {
+		fprintf(stderr, "Unknown driver '%s'.\n", fields[0]);
+		g_strfreev(fields);
+		return NULL;
+	}
+
+	options = NULL;
+	for (i = 1; fields[i]; i++) {
+		if (!(src = parse_config(fields[i]))) {
+			g_slist_free_full(options, (GDestroyNotify)config_free);
+			g_strfreev(fields);
+			return NULL;
+		}
+		options = g_slist_append(options, src);
+	}
+	g_strfreev(fields);
+
+	devices = NULL;
+	if (sr_driver_init(ctx, driver) == SR_OK)
+		devices = sr_driver_scan(driver, options);
+	g_slist_free_full(options, (GDestroyNotify)config_free);
+	if (!devices) {
+		fprintf(stderr, "No device found.\n");
+		return NULL;
+	}
+	sdi = devices->data;
+	g_slist_free(devices);
+	if (sr_dev_open(sdi) != SR_OK) {
+		fprintf(stderr, "Cannot open the device.\n");
+		return NULL;
+	}
+
+	return sdi;
+}
+
+int main(int argc, char **argv)
+{
+	struct sr_context *ctx;
+	struct sr_session *session;
+	struct sr_stream_server *server;
+	struct sr_dev_inst *sdi;
+	struct sr_config *src;
+	GOptionContext *octx;
+	GThread *watch;
+	GError *error;
+	char *driver, *address, *port, **configs;
+	int i, ret;
+	GOptionEntry entries[] = {
+		{"driver", 'd', 0, G_OPTION_ARG_STRING, &driver,
+			"Driver and scan options, driver[:key=value...]", NULL},
+		{"config", 'c', 0, G_OPTION_ARG_STRING_ARRAY, &configs,
+			"Device option, key=value", NULL},
+		{"listen", 'l', 0, G_OPTION_ARG_STRING, &address,
+			"Address to listen on", NULL},
+		{"port", 'p', 0, G_OPTION_ARG_STRING, &port,
+			"TCP port to listen on", NULL},
+		{NULL, 0, 0, 0, NULL, NULL, NULL},
+	};
+
+	driver = address = port = NULL;
+	configs = NULL;
+	error = NULL;
+	octx = g_option_context_new("- stream a device to sigrok-stream clients");
+	g_option_context_add_main_entries(octx, entries, NULL);
+	if (!g_option_context_parse(octx, &argc, &argv, &error) || !driver) {
+		fprintf(stderr, "%s\n", error ? error->message :
+			"A driver is needed, see --help.");
+		return 1;
+	}
+	g_option_context_free(octx);
+
+	if (sr_init(&ctx) != SR_OK)
+		return 1;
+	ret = 1;
+	if (!(sdi = open_device(ctx, driver)))
+		goto out;
+	for (i = 0; configs && configs[i]; i++) {
+		if (!(src = parse_config(configs[i])))
+			goto out;
+		if (sr_config_set(sdi, NULL, src->key, src->data) != SR_OK)
+			fprintf(stderr, "Cannot set '%s'.\n", configs[i]);
+		config_free(src);
+	}
+
+	sr_session_new(ctx, &session);
+	sr_session_dev_add(session, sdi);
+	if (sr_stream_server_new(session, address, port, &server) != SR_OK) {
+		sr_session_destroy(session);
+		goto out;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	watch = g_thread_new("watch", watch_thread, session);
+	while (!quit) {
+		if (sr_session_start(session) != SR_OK)
+			break;
+		sr_session_run(session);
+	}
+	quit = 1;
+	g_thread_join(watch);
+
+	sr_stream_server_free(server);
+	sr_session_destroy(session);
+	ret = 0;
+
+out:
+	sr_exit(ctx);
+	g_free(driver);
+	g_free(address);
+	g_free(port);
+	g_strfreev(configs);
+
+	return ret;
+}